@@ -20,9 +20,13 @@ LIBARCH_SOURCES := \
 	rt.cc \
 	abort.cc \
 	spinlock.cc \
+	metrics.cc \
+	sampling_profiler.cc \
+	perf_counters.cc \
+	memory_arenas.cc \
 
 ifeq ($(ARCH),x86_64)
-LIBARCH_SOURCES += simd_vector_avx.cc
+LIBARCH_SOURCES += simd_vector_avx.cc simd_vector_avx2.cc simd_vector_avx512.cc
 endif
 
 LIBARCH_LINK := dl
@@ -35,13 +39,20 @@ $(eval $(call library,arch,$(LIBARCH_SOURCES),$(LIBARCH_LINK)))
 
 LIBGC_SOURCES := \
 	gc_lock.cc \
-	shared_gc_lock.cc
+	shared_gc_lock.cc \
+	epoch_lock.cc
 
 $(eval $(call library,gc,$(LIBGC_SOURCES),rt arch))
 
 # Note: we should be able to get away without this, but we get a segfault on
 # shared library loading if it's not here.
 $(eval $(call set_single_compile_option,simd_vector_avx.cc,-mavx))
+# The elementwise kernels need to round like the generic ones, so gcc mustn't
+# fuse their multiplies and adds; the fmas that are wanted are explicit.
+$(eval $(call set_single_compile_option,simd_vector_avx2.cc,-mavx2 -mfma -ffp-contract=off))
+# Some gcc versions warn about the placeholder operand inside their own
+# avx-512 intrinsics, which is unused.
+$(eval $(call set_single_compile_option,simd_vector_avx512.cc,-mavx512f -ffp-contract=off -Wno-maybe-uninitialized))
 
 $(eval $(call library,exception_hook,exception_hook.cc,arch dl))
 
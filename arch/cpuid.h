@@ -157,6 +157,30 @@ struct CPU_Info {
         uint32_t amd;
     };
 
+    /* Structured extended features (leaf 7, ebx) */
+    union {
+        struct {
+            uint32_t fsgsbase:1;  // 0
+            uint32_t res1_s7:2;
+            uint32_t bmi1:1;      // 3
+            uint32_t res2_s7:1;
+            uint32_t avx2:1;      // 5
+            uint32_t res3_s7:2;
+            uint32_t bmi2:1;      // 8
+            uint32_t res4_s7:7;
+            uint32_t avx512f:1;   // 16
+            uint32_t avx512dq:1;  // 17
+            uint32_t res5_s7:12;
+            uint32_t avx512bw:1;  // 30
+            uint32_t avx512vl:1;  // 31
+        };
+        uint32_t structured;
+    };
+
+    /// Register state the OS saves on context switch (XCR0), or zero if
+    /// xgetbv isn't usable.  AVX needs bits 1-2 and AVX-512 bits 5-7.
+    uint64_t xcr0;
+
     std::string print_flags();
 };
 
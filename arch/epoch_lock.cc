@@ -0,0 +1,308 @@
+/* epoch_lock.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Epoch based reclamation.
+*/
+
+#include "epoch_lock.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/metrics.h"
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MLDB {
+
+thread_local EpochLock::Slot * EpochLock::threadSlot = nullptr;
+std::atomic<uint64_t> EpochLock::globalEpoch(2);
+std::atomic<uint64_t> EpochLock::pending(0);
+
+namespace {
+
+struct Work {
+    void (*fn) (void *) = nullptr;
+    void * arg = nullptr;
+    std::function<void ()> fnObj;
+
+    void operator () () const
+    {
+        if (fn)
+            fn(arg);
+        else fnObj();
+    }
+};
+
+/// Work deferred during one epoch
+struct Batch {
+    uint64_t epoch;
+    std::vector<Work> work;
+};
+
+/** The state shared by all EpochLocks.  It's never destroyed, as threads
+    may still exit and readers may still unlock after the end of main().
+*/
+struct Domain {
+    /// Protects everything below, and is held while moving the epoch
+    std::mutex mutex;
+
+    /// Every slot ever handed out, used or free
+    std::vector<EpochLock::Slot *> slots;
+
+    /// Slots of threads that have exited
+    EpochLock::Slot * freeSlots = nullptr;
+
+    /// Deferred work, oldest epoch first
+    std::deque<Batch> batches;
+
+    MetricCounter & deferred = MetricsRegistry::global().counter
+        ("mldb_gc_deferrals_total",
+         "Number of deferred reclamations",
+         { { "lock", "epoch" }, { "outcome", "queued" } });
+
+    MetricCounter & reclaimed = MetricsRegistry::global().counter
+        ("mldb_gc_reclaimed_total",
+         "Number of deferred reclamations that have been run",
+         { { "lock", "epoch" } });
+};
+
+Domain & getDomain()
+{
+    static Domain * domain = new Domain();
+    return *domain;
+}
+
+/** Gives the slot of a thread back when it exits. */
+struct SlotReleaser {
+    EpochLock::Slot * slot = nullptr;
+    EpochLock::Slot ** threadSlot = nullptr;  ///< This thread's threadSlot
+
+    ~SlotReleaser()
+    {
+        if (!slot)
+            return;
+        Domain & domain = getDomain();
+        std::unique_lock<std::mutex> guard(domain.mutex);
+        slot->epoch = 0;
+        slot->depth = 0;
+        slot->nextFree = domain.freeSlots;
+        domain.freeSlots = slot;
+        // The thread may still lock after this, from the destructor of
+        // another thread local; it then needs to register again rather
+        // than share a slot that's been handed to someone else.
+        *threadSlot = nullptr;
+        slot = nullptr;
+    }
+};
+
+thread_local SlotReleaser slotReleaser;
+
+} // file scope
+
+EpochLock::Slot *
+EpochLock::
+registerThread()
+{
+    Domain & domain = getDomain();
+    Slot * slot;
+    {
+        std::unique_lock<std::mutex> guard(domain.mutex);
+        if (domain.freeSlots) {
+            slot = domain.freeSlots;
+            domain.freeSlots = slot->nextFree;
+        }
+        else {
+            slot = new Slot();
+            domain.slots.push_back(slot);
+        }
+    }
+
+    slot->epoch = 0;
+    slot->depth = 0;
+    slot->nextFree = nullptr;
+    threadSlot = slot;
+    slotReleaser.slot = slot;
+    slotReleaser.threadSlot = &threadSlot;
+    return slot;
+}
+
+namespace {
+
+/** Move the epoch forward if every thread in a critical section has seen
+    the current one.  Must be called with the domain locked.
+*/
+bool tryAdvance(Domain & domain, std::atomic<uint64_t> & globalEpoch)
+{
+    uint64_t epoch = globalEpoch.load();
+    for (EpochLock::Slot * slot: domain.slots) {
+        uint64_t slotEpoch = slot->epoch.load();
+        if (slotEpoch != 0 && slotEpoch != epoch)
+            return false;
+    }
+    globalEpoch.store(epoch + 1);
+    return true;
+}
+
+/** Take the batches that can now be run.  Must be called with the domain
+    locked.
+*/
+std::vector<Batch> takeReady(Domain & domain, uint64_t epoch)
+{
+    std::vector<Batch> result;
+    while (!domain.batches.empty()
+           && domain.batches.front().epoch + 2 <= epoch) {
+        result.emplace_back(std::move(domain.batches.front()));
+        domain.batches.pop_front();
+    }
+    return result;
+}
+
+/** Run the batches, with the domain unlocked, so that the work can defer
+    more work.  All of the work is run even if some of it throws, and the
+    first exception is then rethrown, unless rethrow is false, in which case
+    it's logged instead.  Readers reclaim from the destructors of their
+    guards, where throwing would terminate.
+*/
+void runBatches(std::vector<Batch> & batches, std::atomic<uint64_t> & pending,
+                bool rethrow = true)
+{
+    if (batches.empty())
+        return;
+    std::exception_ptr exc;
+    for (auto & batch: batches) {
+        for (auto & work: batch.work) {
+            try {
+                work();
+            } catch (...) {
+                if (!exc)
+                    exc = std::current_exception();
+            }
+        }
+        pending -= batch.work.size();
+        getDomain().reclaimed.add(batch.work.size());
+    }
+    if (!exc)
+        return;
+    if (rethrow)
+        std::rethrow_exception(exc);
+    try {
+        std::rethrow_exception(exc);
+    } catch (...) {
+        std::cerr << "EpochLock: deferred work threw while reclaiming: "
+                  << getExceptionString() << std::endl;
+    }
+}
+
+/** Add the work to the batch of the current epoch.  With no readers
+    around, the epoch can move forward twice straight away, and the work is
+    run before we return.  Work is never run from within a critical section,
+    as it may itself need to wait for a barrier; the readers pick it up when
+    they leave instead.
+*/
+void deferWork(Work work, bool inCriticalSection,
+               std::atomic<uint64_t> & globalEpoch,
+               std::atomic<uint64_t> & pending)
+{
+    Domain & domain = getDomain();
+    std::vector<Batch> ready;
+    {
+        std::unique_lock<std::mutex> guard(domain.mutex);
+        uint64_t epoch = globalEpoch.load();
+        if (domain.batches.empty() || domain.batches.back().epoch != epoch)
+            domain.batches.push_back(Batch{ epoch, {} });
+        domain.batches.back().work.emplace_back(std::move(work));
+        ++pending;
+        domain.deferred.add();
+
+        if (tryAdvance(domain, globalEpoch))
+            tryAdvance(domain, globalEpoch);
+        if (!inCriticalSection)
+            ready = takeReady(domain, globalEpoch.load());
+    }
+    runBatches(ready, pending);
+}
+
+} // file scope
+
+void
+EpochLock::
+defer(std::function<void ()> work)
+{
+    Work w;
+    w.fnObj = std::move(work);
+    deferWork(std::move(w), threadSlot && threadSlot->depth > 0,
+              globalEpoch, pending);
+}
+
+void
+EpochLock::
+defer(void (work) (void *), void * arg)
+{
+    Work w;
+    w.fn = work;
+    w.arg = arg;
+    deferWork(std::move(w), threadSlot && threadSlot->depth > 0,
+              globalEpoch, pending);
+}
+
+void
+EpochLock::
+tryReclaim()
+{
+    Domain & domain = getDomain();
+    std::vector<Batch> ready;
+    {
+        std::unique_lock<std::mutex> guard(domain.mutex, std::try_to_lock);
+        if (!guard)
+            return;
+        if (tryAdvance(domain, globalEpoch))
+            tryAdvance(domain, globalEpoch);
+        ready = takeReady(domain, globalEpoch.load());
+    }
+    runBatches(ready, pending, false /* rethrow */);
+}
+
+void
+EpochLock::
+visibleBarrier()
+{
+    if (threadSlot && threadSlot->depth > 0)
+        throw MLDB::Exception("visibleBarrier called in critical section will "
+                              "deadlock");
+
+    Domain & domain = getDomain();
+    std::vector<Batch> ready;
+    {
+        std::unique_lock<std::mutex> guard(domain.mutex);
+        uint64_t target = globalEpoch.load() + 2;
+        while (globalEpoch.load() < target) {
+            if (!tryAdvance(domain, globalEpoch)) {
+                guard.unlock();
+                std::this_thread::yield();
+                guard.lock();
+            }
+        }
+        ready = takeReady(domain, globalEpoch.load());
+    }
+    runBatches(ready, pending);
+}
+
+void
+EpochLock::
+deferBarrier()
+{
+    // Work deferred before now belongs to an epoch no later than the
+    // current one, so it's all run once the epoch has moved forward twice
+    visibleBarrier();
+}
+
+uint64_t
+EpochLock::
+currentEpoch()
+{
+    return globalEpoch.load();
+}
+
+} // namespace MLDB
@@ -0,0 +1,184 @@
+/* epoch_lock.h                                                    -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Epoch based reclamation, as a lighter weight alternative to GcLock for
+   read-mostly structures.
+*/
+
+#pragma once
+
+#include "mldb/compiler/compiler.h"
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+/** Epoch based reclamation (EBR) defers the destruction of objects that
+    have been unlinked from a shared structure until no reader can still be
+    looking at them, like GcLock does.
+
+    Each thread has its own slot, on its own cache line, in which it
+    announces the global epoch that it saw when it entered its read side
+    critical section.  Entering and leaving a critical section only write
+    to that slot: there is no shared counter, so readers on different cores
+    don't contend with each other.  The global epoch can move forward once
+    every thread in a critical section has seen its current value; work
+    deferred during an epoch is run once the epoch has moved forward twice,
+    as by then no reader can still be in a critical section that started
+    before the work was deferred.
+
+    Deferred work is kept in batches, one per epoch, which are run together.
+    There is no exclusive critical section: that's what allows entry and
+    exit to be so cheap.
+
+    All EpochLocks share the same epochs, and critical sections nest, even
+    when they are for different locks.  A reader that stays in a critical
+    section holds up the deferred work of every lock, so critical sections
+    should be short, as with GcLock.
+*/
+
+namespace MLDB {
+
+/*****************************************************************************/
+/* EPOCH LOCK                                                                */
+/*****************************************************************************/
+
+struct EpochLock {
+
+    /** Deferred work belongs to the epochs, not to the lock, so it is
+        still run after the lock that deferred it is gone.
+    */
+    EpochLock() = default;
+    EpochLock(const EpochLock &) = delete;
+    void operator = (const EpochLock &) = delete;
+
+    /// A thread's announcement of the epoch it's reading in
+    struct Slot {
+        std::atomic<uint64_t> epoch;   ///< 0 when not in a critical section
+        int depth;                     ///< Nesting of critical sections
+        Slot * nextFree;               ///< When not used by a thread
+
+        /// Keep slots on separate cache lines even when they're not aligned
+        char padding[128 - sizeof(std::atomic<uint64_t>) - sizeof(int)
+                     - sizeof(Slot *)];
+    };
+
+    static MLDB_ALWAYS_INLINE Slot & getSlot()
+    {
+        Slot * slot = threadSlot;
+        if (MLDB_UNLIKELY(!slot))
+            slot = registerThread();
+        return *slot;
+    }
+
+    MLDB_ALWAYS_INLINE void lockShared() const
+    {
+        Slot & slot = getSlot();
+        if (slot.depth++ == 0)
+            enter(slot);
+    }
+
+    MLDB_ALWAYS_INLINE void unlockShared() const
+    {
+        Slot & slot = getSlot();
+        if (--slot.depth == 0) {
+            slot.epoch.store(0, std::memory_order_release);
+            // Reclaiming is done by the writers, except when they can't
+            // because readers were around, in which case the readers
+            // finish it off as they leave.  Exceptions from the work are
+            // logged there, as we may be in a guard's destructor.
+            if (MLDB_UNLIKELY(pending.load(std::memory_order_relaxed)))
+                tryReclaim();
+        }
+    }
+
+    bool isLockedShared() const
+    {
+        return getSlot().depth > 0;
+    }
+
+    struct SharedGuard {
+        SharedGuard(const EpochLock & lock)
+            : lock(lock)
+        {
+            lock.lockShared();
+        }
+
+        ~SharedGuard()
+        {
+            lock.unlockShared();
+        }
+
+        const EpochLock & lock;
+    };
+
+    /** Run the work once no reader can see what is visible now.  If work
+        that's run from here throws, the exception is passed on to the
+        caller once the rest of the ready work has been run.
+    */
+    void defer(std::function<void ()> work);
+    void defer(void (work) (void *), void * arg);
+
+    template<typename T>
+    void defer(void (*work) (T *), T * arg)
+    {
+        defer((void (*) (void *))work, (void *)arg);
+    }
+
+    template<typename T>
+    static void doDelete(T * arg)
+    {
+        delete arg;
+    }
+
+    template<typename T>
+    void deferDelete(T * toDelete)
+    {
+        if (!toDelete) return;
+        defer(doDelete<T>, toDelete);
+    }
+
+    /** Wait until no reader can see anything that was unlinked before the
+        call.  As with GcLock, this would deadlock if called from within a
+        critical section, so it throws instead.  As the epochs are shared,
+        that includes critical sections of other EpochLocks.
+    */
+    void visibleBarrier();
+
+    /** Wait until all work deferred before the call has been run.  Can't
+        be called from within a critical section either.
+    */
+    void deferBarrier();
+
+    /** Return the current global epoch, for testing. */
+    static uint64_t currentEpoch();
+
+private:
+    static thread_local Slot * threadSlot;
+
+    /// Global epoch; starts at 2 so that 0 can mean "not reading"
+    static std::atomic<uint64_t> globalEpoch;
+
+    /// Number of deferred work items that haven't been run yet
+    static std::atomic<uint64_t> pending;
+
+    static Slot * registerThread();
+    static void tryReclaim();
+
+    static MLDB_ALWAYS_INLINE void enter(Slot & slot)
+    {
+        // The exchange is a full barrier, so that the announcement is seen
+        // before anything we read in the critical section.  If the epoch
+        // moved in the meantime, a writer may have missed it, so we
+        // announce again.
+        uint64_t epoch = globalEpoch.load(std::memory_order_relaxed);
+        for (;;) {
+            slot.epoch.exchange(epoch);
+            uint64_t now = globalEpoch.load();
+            if (MLDB_LIKELY(now == epoch))
+                return;
+            epoch = now;
+        }
+    }
+};
+
+} // namespace MLDB
@@ -15,6 +15,7 @@
 #include "mldb/arch/tick_counter.h"
 #include "mldb/arch/spinlock.h"
 #include "mldb/arch/futex.h"
+#include "mldb/arch/metrics.h"
 #include "mldb/base/exc_check.h"
 #include "mldb/jml/utils/guard.h"
 #include <iterator>
@@ -822,6 +823,29 @@ defer(std::function<void ()> work)
     defer(callFn, new std::function<void ()>(work));
 }
 
+namespace {
+
+struct DeferMetrics {
+    MetricCounter & inlined = counter("inline");
+    MetricCounter & queued = counter("queued");
+
+    static MetricCounter & counter(const std::string & outcome)
+    {
+        return MetricsRegistry::global().counter
+            ("mldb_gc_deferrals_total",
+             "Number of deferred reclamations",
+             { { "lock", "gc" }, { "outcome", outcome } });
+    }
+};
+
+DeferMetrics & deferMetrics()
+{
+    static DeferMetrics result;
+    return result;
+}
+
+} // file scope
+
 template<typename... Args>
 void
 GcLockBase::
@@ -850,6 +874,7 @@ doDefer(void (fn) (Args...), Args... args)
 #if 1
     // Nothing is in a critical section; we can run it inline
     if (current.anyInCurrent() + current.anyInOld() == 0) {
+        deferMetrics().inlined.add();
         fn(std::forward<Args>(args)...);
         return;
     }
@@ -893,6 +918,7 @@ doDefer(void (fn) (Args...), Args... args)
         
         DeferredList & list = *epochIt->second;
         list.addDeferred(newestVisibleEpoch, fn, std::forward<Args>(args)...);
+        deferMetrics().queued.add();
 
         // TODO: we only need to do this if the newestVisibleEpoch has
         // changed since we last calculated it...
@@ -902,6 +928,7 @@ doDefer(void (fn) (Args...), Args... args)
     }
     
     // If we got here we can run it straight away
+    deferMetrics().inlined.add();
     fn(std::forward<Args>(args)...);
     return;
 }
@@ -0,0 +1,200 @@
+/* memory_arenas.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Separate allocator arenas for the subsystems, when running on jemalloc.
+*/
+
+#include "memory_arenas.h"
+#include "mldb/jml/utils/environment.h"
+#include <malloc.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+
+// jemalloc's non-standard API.  These are weak so that they're null unless
+// the program is linked with jemalloc.
+extern "C" {
+    int mallctl(const char * name, void * oldp, size_t * oldlenp,
+                void * newp, size_t newlen) __attribute__((weak));
+    void * mallocx(size_t size, int flags) __attribute__((weak));
+    void dallocx(void * ptr, int flags) __attribute__((weak));
+} // extern "C"
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<bool> MLDB_MEMORY_ARENAS("MLDB_MEMORY_ARENAS", true);
+
+// From jemalloc.h
+constexpr unsigned MALLCTL_ARENAS_ALL = 4096;
+constexpr int MALLOCX_TCACHE_NONE = (-1 + 2) << 8;
+
+int mallocxArena(unsigned arena)
+{
+    return (int)((arena + 1) << 20);
+}
+
+struct Arenas {
+    Arenas()
+    {
+        if (!MLDB_MEMORY_ARENAS || !mallctl || !mallocx || !dallocx)
+            return;
+
+        for (unsigned i = 0;  i < NUM_MEMORY_ARENAS;  ++i) {
+            size_t len = sizeof(indexes[i]);
+            if (mallctl("arenas.create", &indexes[i], &len, nullptr, 0) != 0)
+                return;
+        }
+
+        size_t len = sizeof(pageSize);
+        if (mallctl("arenas.page", &pageSize, &len, nullptr, 0) != 0)
+            pageSize = 4096;
+
+        enabled = true;
+    }
+
+    bool enabled = false;
+    unsigned indexes[NUM_MEMORY_ARENAS];
+    size_t pageSize = 4096;
+
+    std::mutex statsMutex;
+    MemoryArenaStats stats[NUM_MEMORY_ARENAS];
+};
+
+/* Never destroyed, as memory may be freed into them at any time */
+Arenas & getArenas()
+{
+    static Arenas * arenas = new Arenas();
+    return *arenas;
+}
+
+template<typename T>
+bool readCtl(const char * format, unsigned arena, T & value)
+{
+    char name[128];
+    snprintf(name, sizeof(name), format, arena);
+    size_t len = sizeof(T);
+    return mallctl(name, &value, &len, nullptr, 0) == 0;
+}
+
+void purgeArenaIndex(unsigned index)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "arena.%u.purge", index);
+    mallctl(name, nullptr, nullptr, nullptr, 0);
+}
+
+} // file scope
+
+const char * memoryArenaName(MemoryArena arena)
+{
+    switch (arena) {
+    case MEMORY_ARENA_FROZEN:   return "frozen";
+    case MEMORY_ARENA_QUERY:    return "query";
+    case MEMORY_ARENA_REST:     return "rest";
+    default:                    return "unknown";
+    }
+}
+
+bool memoryArenasEnabled()
+{
+    return getArenas().enabled;
+}
+
+void * arenaAllocate(MemoryArena arena, size_t bytes)
+{
+    Arenas & arenas = getArenas();
+    void * result;
+    if (arenas.enabled) {
+        // The thread cache would hand out memory of whatever arena it came
+        // from, so it's bypassed
+        result = mallocx(std::max<size_t>(bytes, 1),
+                         mallocxArena(arenas.indexes[arena])
+                         | MALLOCX_TCACHE_NONE);
+    }
+    else {
+        result = malloc(bytes);
+    }
+    if (!result && bytes)
+        throw std::bad_alloc();
+    return result;
+}
+
+void arenaFree(MemoryArena arena, void * mem)
+{
+    if (!mem)
+        return;
+    if (getArenas().enabled)
+        dallocx(mem, MALLOCX_TCACHE_NONE);
+    else free(mem);
+}
+
+void bindThreadToArena(MemoryArena arena)
+{
+    Arenas & arenas = getArenas();
+    if (!arenas.enabled)
+        return;
+    unsigned index = arenas.indexes[arena];
+    mallctl("thread.arena", nullptr, nullptr, &index, sizeof(index));
+}
+
+void refreshMemoryArenaStats()
+{
+    Arenas & arenas = getArenas();
+    if (!arenas.enabled)
+        return;
+
+    std::unique_lock<std::mutex> guard(arenas.statsMutex);
+
+    uint64_t epoch = 1;
+    size_t len = sizeof(epoch);
+    mallctl("epoch", &epoch, &len, &epoch, len);
+
+    for (unsigned i = 0;  i < NUM_MEMORY_ARENAS;  ++i) {
+        unsigned index = arenas.indexes[i];
+        MemoryArenaStats stats;
+        size_t value = 0, small = 0, large = 0;
+
+        if (readCtl("stats.arenas.%u.small.allocated", index, small)
+            && readCtl("stats.arenas.%u.large.allocated", index, large))
+            stats.allocatedBytes = small + large;
+        if (readCtl("stats.arenas.%u.pactive", index, value))
+            stats.activeBytes = value * arenas.pageSize;
+        if (readCtl("stats.arenas.%u.pdirty", index, value))
+            stats.dirtyBytes = value * arenas.pageSize;
+        if (readCtl("stats.arenas.%u.resident", index, value))
+            stats.residentBytes = value;
+        if (readCtl("stats.arenas.%u.mapped", index, value))
+            stats.mappedBytes = value;
+
+        arenas.stats[i] = stats;
+    }
+}
+
+MemoryArenaStats getMemoryArenaStats(MemoryArena arena)
+{
+    Arenas & arenas = getArenas();
+    std::unique_lock<std::mutex> guard(arenas.statsMutex);
+    return arenas.stats[arena];
+}
+
+void purgeMemoryArena(MemoryArena arena)
+{
+    Arenas & arenas = getArenas();
+    if (arenas.enabled)
+        purgeArenaIndex(arenas.indexes[arena]);
+}
+
+void purgeAllMemoryArenas()
+{
+    if (mallctl)
+        purgeArenaIndex(MALLCTL_ARENAS_ALL);
+    else malloc_trim(0);
+}
+
+} // namespace MLDB
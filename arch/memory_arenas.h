@@ -0,0 +1,95 @@
+/* memory_arenas.h                                                 -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Separate allocator arenas for the subsystems whose allocations have
+   very different lifetimes, when MLDB runs on jemalloc.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MEMORY ARENAS                                                             */
+/*****************************************************************************/
+
+/** Long lived storage of frozen datasets and the short lived temporaries
+    of queries and of REST requests fragment each other's memory when they
+    share a heap, so that the resident size doesn't go down after a large
+    query even though the memory is free.  When the process is linked with
+    jemalloc (JEMALLOC_ENABLED=1 in the build), each of them gets its own
+    arena:
+
+    - frozen storage is allocated explicitly from its arena with
+      arenaAllocate();
+    - the threads of the thread pools running queries, and those serving
+      HTTP requests, are bound to their arena with bindThreadToArena(), so
+      that everything they allocate comes from it.
+
+    Setting MLDB_MEMORY_ARENAS=0 keeps everything in the default arenas.
+    Without jemalloc, arenaAllocate() is malloc(), binding does nothing and
+    purging trims the glibc heap.
+*/
+
+enum MemoryArena {
+    MEMORY_ARENA_FROZEN,   ///< Storage of frozen columns
+    MEMORY_ARENA_QUERY,    ///< Threads of the thread pool
+    MEMORY_ARENA_REST,     ///< Threads serving HTTP requests
+
+    NUM_MEMORY_ARENAS
+};
+
+/// Name of the arena in statistics and metrics, like "frozen"
+const char * memoryArenaName(MemoryArena arena);
+
+/** Are allocations split over the arenas?  True when running on jemalloc
+    and they weren't disabled.
+*/
+bool memoryArenasEnabled();
+
+/** Allocate the given number of bytes from the arena, aligned like
+    malloc().  Throws std::bad_alloc if it can't.
+*/
+void * arenaAllocate(MemoryArena arena, size_t bytes);
+
+/** Free memory from arenaAllocate() for the given arena. */
+void arenaFree(MemoryArena arena, void * mem);
+
+/** Make what the calling thread allocates from now on come from the
+    arena.  Memory allocated before stays where it is.
+*/
+void bindThreadToArena(MemoryArena arena);
+
+/** Statistics of an arena, as of the last call to refreshMemoryArenaStats()
+    (jemalloc only refreshes them when asked to).  All zero without
+    jemalloc.
+*/
+struct MemoryArenaStats {
+    uint64_t allocatedBytes = 0;  ///< In live allocations
+    uint64_t activeBytes = 0;     ///< In pages holding live allocations
+    uint64_t dirtyBytes = 0;      ///< Free, but not yet returned to the OS
+    uint64_t residentBytes = 0;   ///< Resident, including metadata
+    uint64_t mappedBytes = 0;     ///< Mapped from the OS
+};
+
+/** Update the statistics returned by getMemoryArenaStats(). */
+void refreshMemoryArenaStats();
+
+MemoryArenaStats getMemoryArenaStats(MemoryArena arena);
+
+/** Return the free pages of the arena to the OS at once, rather than
+    waiting for them to decay.
+*/
+void purgeMemoryArena(MemoryArena arena);
+
+/** Same for all of the arenas of the process, including the default ones.
+    Without jemalloc, this does malloc_trim(0).
+*/
+void purgeAllMemoryArenas();
+
+} // namespace MLDB
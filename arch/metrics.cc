@@ -0,0 +1,409 @@
+/* metrics.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Counters and histograms for internal metrics.
+*/
+
+#include "metrics.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/format.h"
+#include <map>
+#include <mutex>
+
+
+namespace MLDB {
+
+int assignMetricShard()
+{
+    static std::atomic<int> nextShard(0);
+    return nextShard.fetch_add(1, std::memory_order_relaxed) & 0xffff;
+}
+
+
+/*****************************************************************************/
+/* METRIC COUNTER                                                            */
+/*****************************************************************************/
+
+uint64_t
+MetricCounter::
+value() const
+{
+    uint64_t result = 0;
+    for (auto & s: shards)
+        result += s.value.load(std::memory_order_relaxed);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* METRIC HISTOGRAM                                                          */
+/*****************************************************************************/
+
+MetricHistogram::Shard::
+Shard()
+    : sum(0)
+{
+    for (auto & b: buckets)
+        b.store(0, std::memory_order_relaxed);
+}
+
+uint64_t
+MetricHistogram::
+bucketLowerBound(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    int shift = bucket / SUB_BUCKETS - 1;
+    uint64_t top = bucket % SUB_BUCKETS + SUB_BUCKETS;
+    return top << shift;
+}
+
+MetricHistogram::Snapshot
+MetricHistogram::
+snapshot() const
+{
+    Snapshot result;
+    result.buckets.resize(NUM_BUCKETS);
+    for (auto & s: shards) {
+        for (int i = 0;  i < NUM_BUCKETS;  ++i)
+            result.buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+        result.sum += s.sum.load(std::memory_order_relaxed);
+    }
+    for (auto & b: result.buckets)
+        result.count += b;
+    return result;
+}
+
+double
+MetricHistogram::Snapshot::
+quantile(double q) const
+{
+    if (count == 0)
+        return 0.0;
+    uint64_t rank = std::min<uint64_t>(count - 1, q * count);
+    uint64_t seen = 0;
+    for (int i = 0;  i < NUM_BUCKETS;  ++i) {
+        seen += buckets[i];
+        if (seen > rank) {
+            // Middle of the bucket
+            uint64_t lower = bucketLowerBound(i);
+            if (i == NUM_BUCKETS - 1)
+                return lower;
+            uint64_t upper = bucketLowerBound(i + 1);
+            return lower + (upper - lower - 1) / 2.0;
+        }
+    }
+    return bucketLowerBound(NUM_BUCKETS - 1);
+}
+
+uint64_t
+MetricHistogram::Snapshot::
+countBelowPowerOfTwo(int bits) const
+{
+    int end;
+    if (bits <= SUB_BITS)
+        end = 1 << bits;
+    else if (bits >= MAX_BITS)
+        end = NUM_BUCKETS;
+    else end = (bits - SUB_BITS + 1) * SUB_BUCKETS;
+
+    uint64_t result = 0;
+    for (int i = 0;  i < end;  ++i)
+        result += buckets[i];
+    return result;
+}
+
+
+/*****************************************************************************/
+/* METRICS REGISTRY                                                          */
+/*****************************************************************************/
+
+const char * const MetricsRegistry::CONTENT_TYPE
+    = "text/plain; version=0.0.4; charset=utf-8";
+
+namespace {
+
+enum MetricType {
+    COUNTER,
+    HISTOGRAM,
+    GAUGE
+};
+
+const char * typeName(MetricType type)
+{
+    switch (type) {
+    case COUNTER:    return "counter";
+    case HISTOGRAM:  return "histogram";
+    case GAUGE:      return "gauge";
+    }
+    return "untyped";
+}
+
+struct Series {
+    MetricLabels labels;
+    std::unique_ptr<MetricCounter> counter;
+    std::unique_ptr<MetricHistogram> histogram;
+    double scale = 1.0;
+    int minBits = 0, maxBits = 0, bitsPerBucket = 1;
+    uint64_t gaugeId = 0;
+    std::function<double ()> gauge;
+};
+
+struct Family {
+    MetricType type;
+    std::string help;
+    std::vector<std::unique_ptr<Series> > series;
+
+    Series * find(const MetricLabels & labels)
+    {
+        for (auto & s: series)
+            if (s->labels == labels)
+                return s.get();
+        return nullptr;
+    }
+};
+
+void escape(std::string & out, const std::string & str, bool quotes)
+{
+    for (char c: str) {
+        if (c == '\\')
+            out += "\\\\";
+        else if (c == '\n')
+            out += "\\n";
+        else if (c == '"' && quotes)
+            out += "\\\"";
+        else out += c;
+    }
+}
+
+/** Write the name of a metric followed by its labels, and an extra label
+    if it's given.
+*/
+void writeName(std::string & out,
+               const std::string & name,
+               const MetricLabels & labels,
+               const char * extraName = nullptr,
+               const std::string & extraValue = std::string())
+{
+    out += name;
+    if (labels.empty() && !extraName) {
+        out += ' ';
+        return;
+    }
+    out += '{';
+    bool first = true;
+    for (auto & l: labels) {
+        if (!first)
+            out += ',';
+        first = false;
+        out += l.first;
+        out += "=\"";
+        escape(out, l.second, true);
+        out += '"';
+    }
+    if (extraName) {
+        if (!first)
+            out += ',';
+        out += extraName;
+        out += "=\"";
+        out += extraValue;
+        out += '"';
+    }
+    out += "} ";
+}
+
+std::string formatValue(double value)
+{
+    return MLDB::format("%.17g", value);
+}
+
+/// Bucket bounds are short, so that they're readable in queries
+std::string formatBound(double value)
+{
+    return MLDB::format("%.9g", value);
+}
+
+} // file scope
+
+struct MetricsRegistry::Itl {
+    std::mutex mutex;
+    std::map<std::string, Family> families;
+    uint64_t nextGaugeId = 1;
+
+    Family & getFamily(const std::string & name,
+                       const std::string & help,
+                       MetricType type)
+    {
+        auto it = families.find(name);
+        if (it == families.end()) {
+            it = families.emplace(name, Family()).first;
+            it->second.type = type;
+            it->second.help = help;
+        }
+        else if (it->second.type != type) {
+            throw MLDB::Exception("Metric '" + name + "' is a "
+                                  + typeName(it->second.type) + ", not a "
+                                  + typeName(type));
+        }
+        return it->second;
+    }
+};
+
+MetricsRegistry::
+MetricsRegistry()
+    : itl(new Itl())
+{
+}
+
+MetricsRegistry::
+~MetricsRegistry()
+{
+}
+
+MetricsRegistry &
+MetricsRegistry::
+global()
+{
+    static MetricsRegistry * registry = new MetricsRegistry();
+    return *registry;
+}
+
+MetricCounter &
+MetricsRegistry::
+counter(const std::string & name,
+        const std::string & help,
+        const MetricLabels & labels)
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    Family & family = itl->getFamily(name, help, COUNTER);
+    Series * series = family.find(labels);
+    if (!series) {
+        family.series.emplace_back(new Series());
+        series = family.series.back().get();
+        series->labels = labels;
+        series->counter.reset(new MetricCounter());
+    }
+    return *series->counter;
+}
+
+MetricHistogram &
+MetricsRegistry::
+histogram(const std::string & name,
+          const std::string & help,
+          const MetricLabels & labels,
+          double scale,
+          int minBits,
+          int maxBits,
+          int bitsPerBucket)
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    Family & family = itl->getFamily(name, help, HISTOGRAM);
+    Series * series = family.find(labels);
+    if (!series) {
+        family.series.emplace_back(new Series());
+        series = family.series.back().get();
+        series->labels = labels;
+        series->histogram.reset(new MetricHistogram());
+        series->scale = scale;
+        series->minBits = minBits;
+        series->maxBits = std::min<int>(maxBits, MetricHistogram::MAX_BITS);
+        series->bitsPerBucket = std::max(1, bitsPerBucket);
+    }
+    return *series->histogram;
+}
+
+uint64_t
+MetricsRegistry::
+addGauge(const std::string & name,
+         const std::string & help,
+         const MetricLabels & labels,
+         std::function<double ()> read)
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    Family & family = itl->getFamily(name, help, GAUGE);
+    Series * series = family.find(labels);
+    if (!series) {
+        family.series.emplace_back(new Series());
+        series = family.series.back().get();
+        series->labels = labels;
+    }
+    series->gauge = std::move(read);
+    series->gaugeId = itl->nextGaugeId++;
+    return series->gaugeId;
+}
+
+void
+MetricsRegistry::
+removeGauge(uint64_t id)
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    for (auto & f: itl->families) {
+        if (f.second.type != GAUGE)
+            continue;
+        auto & series = f.second.series;
+        for (auto it = series.begin();  it != series.end();  ++it) {
+            if ((*it)->gaugeId == id) {
+                series.erase(it);
+                return;
+            }
+        }
+    }
+}
+
+std::string
+MetricsRegistry::
+exposition() const
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+
+    std::string out;
+    for (auto & f: itl->families) {
+        const std::string & name = f.first;
+        const Family & family = f.second;
+        if (family.series.empty())
+            continue;
+
+        out += "# HELP " + name + ' ';
+        escape(out, family.help, false);
+        out += "\n# TYPE " + name + ' ' + typeName(family.type) + '\n';
+
+        for (auto & s: family.series) {
+            switch (family.type) {
+            case COUNTER:
+                writeName(out, name, s->labels);
+                out += std::to_string(s->counter->value()) + '\n';
+                break;
+
+            case GAUGE:
+                writeName(out, name, s->labels);
+                out += formatValue(s->gauge()) + '\n';
+                break;
+
+            case HISTOGRAM: {
+                auto snapshot = s->histogram->snapshot();
+                for (int bits = s->minBits;  bits <= s->maxBits;
+                     bits += s->bitsPerBucket) {
+                    // Buckets are "less than or equal"; the values below
+                    // the next power of two are those up to one less than it
+                    double le = ((uint64_t(1) << bits) - 1) * s->scale;
+                    writeName(out, name + "_bucket", s->labels,
+                              "le", formatBound(le));
+                    out += std::to_string(snapshot.countBelowPowerOfTwo(bits))
+                        + '\n';
+                }
+                writeName(out, name + "_bucket", s->labels, "le", "+Inf");
+                out += std::to_string(snapshot.count) + '\n';
+                writeName(out, name + "_sum", s->labels);
+                out += formatValue(snapshot.sum * s->scale) + '\n';
+                writeName(out, name + "_count", s->labels);
+                out += std::to_string(snapshot.count) + '\n';
+                break;
+            }
+            }
+        }
+    }
+
+    return out;
+}
+
+} // namespace MLDB
@@ -0,0 +1,223 @@
+/* metrics.h                                                       -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Counters and histograms for internal metrics, which are scraped in the
+   Prometheus text exposition format.
+*/
+
+#pragma once
+
+#include "mldb/compiler/compiler.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/** Recording must be cheap enough to be done on hot paths, so each metric
+    is split into shards, each on its own cache line, and a thread records
+    into the shard it was assigned when it first recorded anything.  That
+    makes a recording a relaxed atomic increment on a cache line that no
+    other thread is usually writing to; the shards are only summed when
+    the metrics are scraped.
+
+    Metrics are created once through the MetricsRegistry, and the reference
+    that's returned is kept by the code that records into it; they are
+    never destroyed.
+*/
+
+namespace MLDB {
+
+typedef std::vector<std::pair<std::string, std::string> > MetricLabels;
+
+/** Return the shard to record into for the calling thread. */
+int assignMetricShard();
+
+MLDB_ALWAYS_INLINE int getMetricShard()
+{
+    static thread_local int shard = -1;
+    if (MLDB_UNLIKELY(shard < 0))
+        shard = assignMetricShard();
+    return shard;
+}
+
+
+/*****************************************************************************/
+/* METRIC COUNTER                                                            */
+/*****************************************************************************/
+
+/** Monotonic counter. */
+
+struct MetricCounter {
+    static constexpr int NUM_SHARDS = 16;
+
+    MetricCounter() = default;
+    MetricCounter(const MetricCounter &) = delete;
+    void operator = (const MetricCounter &) = delete;
+
+    MLDB_ALWAYS_INLINE void add(uint64_t n = 1)
+    {
+        shards[getMetricShard() % NUM_SHARDS].value
+            .fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const;
+
+private:
+    struct Shard {
+        std::atomic<uint64_t> value = { 0 };
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    Shard shards[NUM_SHARDS];
+};
+
+
+/*****************************************************************************/
+/* METRIC HISTOGRAM                                                          */
+/*****************************************************************************/
+
+/** Histogram of integer values, such as latencies in nanoseconds or sizes
+    in bytes, with log-linear buckets like those of an HDR histogram: each
+    power of two is split into 16 buckets, so that any value is known to
+    within 1/16th of itself.  Values up to 2^40 are kept (18 minutes in
+    nanoseconds); larger values are counted in the last bucket.
+*/
+
+struct MetricHistogram {
+    static constexpr int NUM_SHARDS = 8;
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int MAX_BITS = 40;
+    static constexpr int NUM_BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+    MetricHistogram() = default;
+    MetricHistogram(const MetricHistogram &) = delete;
+    void operator = (const MetricHistogram &) = delete;
+
+    MLDB_ALWAYS_INLINE void record(uint64_t value)
+    {
+        Shard & shard = shards[getMetricShard() % NUM_SHARDS];
+        shard.buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /** Record the nanoseconds since the given time. */
+    MLDB_ALWAYS_INLINE
+    void recordSince(std::chrono::steady_clock::time_point start)
+    {
+        record(std::chrono::duration_cast<std::chrono::nanoseconds>
+               (std::chrono::steady_clock::now() - start).count());
+    }
+
+    static MLDB_ALWAYS_INLINE int bucketOf(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+            return value;
+        int msb = 63 - __builtin_clzll(value);
+        if (MLDB_UNLIKELY(msb >= MAX_BITS))
+            return NUM_BUCKETS - 1;
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + (value >> shift) - SUB_BUCKETS;
+    }
+
+    /** Smallest value that goes into the given bucket. */
+    static uint64_t bucketLowerBound(int bucket);
+
+    /** Totals over all of the shards. */
+    struct Snapshot {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        /** Return the value below which the given fraction of the values
+            fall, to within the resolution of the buckets.
+        */
+        double quantile(double q) const;
+
+        /** Return how many values are below the given power of two. */
+        uint64_t countBelowPowerOfTwo(int bits) const;
+    };
+
+    Snapshot snapshot() const;
+
+private:
+    struct Shard {
+        std::atomic<uint64_t> buckets[NUM_BUCKETS];
+        std::atomic<uint64_t> sum;
+
+        Shard();
+    };
+
+    Shard shards[NUM_SHARDS];
+};
+
+
+/*****************************************************************************/
+/* METRICS REGISTRY                                                          */
+/*****************************************************************************/
+
+struct MetricsRegistry {
+
+    MetricsRegistry();
+    ~MetricsRegistry();
+
+    MetricsRegistry(const MetricsRegistry &) = delete;
+    void operator = (const MetricsRegistry &) = delete;
+
+    /** The registry of the process, which is never destroyed. */
+    static MetricsRegistry & global();
+
+    /** Return the counter with the given name and labels, creating it the
+        first time.  This takes a lock; the result should be kept rather
+        than looked up for each recording.
+    */
+    MetricCounter & counter(const std::string & name,
+                            const std::string & help,
+                            const MetricLabels & labels = MetricLabels());
+
+    /** Return the histogram with the given name and labels, creating it
+        the first time.  Values are multiplied by scale when exposed, which
+        for latencies recorded in nanoseconds turns them into seconds.  The
+        exposed buckets are the powers of two from 2^minBits to 2^maxBits,
+        every bitsPerBucket bits; the default is from about 1 microsecond
+        to 69 seconds, every factor of 4.
+    */
+    MetricHistogram & histogram(const std::string & name,
+                                const std::string & help,
+                                const MetricLabels & labels = MetricLabels(),
+                                double scale = 1e-9,
+                                int minBits = 10,
+                                int maxBits = 36,
+                                int bitsPerBucket = 2);
+
+    /** Add a gauge whose value is read when the metrics are scraped.
+        Returns an ID to pass to removeGauge() before what it reads goes
+        away.  Adding a gauge with the same name and labels as an existing
+        one replaces it.
+    */
+    uint64_t addGauge(const std::string & name,
+                      const std::string & help,
+                      const MetricLabels & labels,
+                      std::function<double ()> read);
+
+    void removeGauge(uint64_t id);
+
+    /** Return all of the metrics in the Prometheus text format (version
+        0.0.4), which OpenMetrics scrapers also accept.
+    */
+    std::string exposition() const;
+
+    /// Content type of the exposition
+    static const char * const CONTENT_TYPE;
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace MLDB
@@ -0,0 +1,209 @@
+/* perf_counters.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Hardware performance counters from perf_event_open.
+*/
+
+#include "perf_counters.h"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PERF COUNTS                                                               */
+/*****************************************************************************/
+
+PerfCounts &
+PerfCounts::
+operator += (const PerfCounts & other)
+{
+    instructions += other.instructions;
+    cycles += other.cycles;
+    llcMisses += other.llcMisses;
+    branchMisses += other.branchMisses;
+    dtlbMisses += other.dtlbMisses;
+    return *this;
+}
+
+PerfCounts
+PerfCounts::
+operator - (const PerfCounts & other) const
+{
+    auto sub = [] (uint64_t v1, uint64_t v2) { return v1 > v2 ? v1 - v2 : 0; };
+
+    PerfCounts result;
+    result.instructions = sub(instructions, other.instructions);
+    result.cycles = sub(cycles, other.cycles);
+    result.llcMisses = sub(llcMisses, other.llcMisses);
+    result.branchMisses = sub(branchMisses, other.branchMisses);
+    result.dtlbMisses = sub(dtlbMisses, other.dtlbMisses);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* PERF COUNTER GROUP                                                        */
+/*****************************************************************************/
+
+namespace {
+
+struct CounterSpec {
+    uint32_t type;
+    uint64_t config;
+    uint64_t PerfCounts::* field;
+};
+
+/// Cycles go first, as the leader of the group
+const CounterSpec COUNTERS[] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, &PerfCounts::cycles },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+      &PerfCounts::instructions },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,
+      &PerfCounts::llcMisses },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,
+      &PerfCounts::branchMisses },
+    { PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_DTLB
+      | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      &PerfCounts::dtlbMisses }
+};
+
+constexpr size_t NUM_COUNTERS = sizeof(COUNTERS) / sizeof(COUNTERS[0]);
+
+int openCounter(const CounterSpec & spec, pid_t tid, int groupFd)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.read_format = PERF_FORMAT_GROUP
+        | PERF_FORMAT_TOTAL_TIME_ENABLED
+        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(__NR_perf_event_open, &attr, tid, -1 /* any cpu */,
+                   groupFd, PERF_FLAG_FD_CLOEXEC);
+}
+
+} // file scope
+
+PerfCounterGroup::
+PerfCounterGroup(pid_t tid)
+{
+    for (auto & spec: COUNTERS) {
+        int fd = openCounter(spec, tid, leader);
+        if (fd == -1) {
+            // Without a leader there's nothing to count with; a hypervisor
+            // that doesn't virtualize the PMU fails them all
+            if (leader == -1 && errno != ENOENT && errno != EOPNOTSUPP)
+                return;
+            continue;
+        }
+        if (leader == -1)
+            leader = fd;
+        counters.emplace_back(fd, spec.field);
+    }
+}
+
+PerfCounterGroup::
+~PerfCounterGroup()
+{
+    for (auto & c: counters)
+        ::close(c.first);
+}
+
+PerfCounts
+PerfCounterGroup::
+read() const
+{
+    PerfCounts result;
+    if (leader == -1)
+        return result;
+
+    // Layout of a group read: nr, time_enabled, time_running, values[nr]
+    uint64_t buf[3 + NUM_COUNTERS];
+    ssize_t res = ::read(leader, buf, sizeof(buf));
+    if (res < (ssize_t)(3 * sizeof(uint64_t)))
+        return result;
+
+    uint64_t nr = buf[0], enabled = buf[1], running = buf[2];
+    if (!running)
+        return result;
+    double scale = running < enabled ? 1.0 * enabled / running : 1.0;
+
+    for (size_t i = 0;  i < nr && i < counters.size();  ++i)
+        result.*counters[i].second = buf[3 + i] * scale;
+    return result;
+}
+
+bool
+PerfCounterGroup::
+available()
+{
+    static const bool result = PerfCounterGroup().valid();
+    return result;
+}
+
+const PerfCounterGroup &
+PerfCounterGroup::
+forThisThread()
+{
+    static thread_local PerfCounterGroup group;
+    return group;
+}
+
+
+/*****************************************************************************/
+/* PROCESS PERF COUNTERS                                                     */
+/*****************************************************************************/
+
+ProcessPerfCounters::
+ProcessPerfCounters()
+{
+    if (!PerfCounterGroup::available())
+        return;
+
+    DIR * dir = opendir("/proc/self/task");
+    if (!dir)
+        return;
+
+    while (dirent * entry = readdir(dir)) {
+        char * end = nullptr;
+        long tid = strtol(entry->d_name, &end, 10);
+        if (end == entry->d_name || *end != 0)
+            continue;
+        std::unique_ptr<PerfCounterGroup> group(new PerfCounterGroup(tid));
+        if (group->valid())
+            threads.emplace_back(std::move(group));
+    }
+
+    closedir(dir);
+}
+
+ProcessPerfCounters::
+~ProcessPerfCounters()
+{
+}
+
+PerfCounts
+ProcessPerfCounters::
+read() const
+{
+    PerfCounts result;
+    for (auto & t: threads)
+        result += t->read();
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,127 @@
+/* perf_counters.h                                                 -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Hardware performance counters from perf_event_open, to tell whether code
+   is bound by memory or by computation.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <sys/types.h>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PERF COUNTS                                                               */
+/*****************************************************************************/
+
+/** Values of the hardware counters over some piece of work.  When the
+    kernel had to multiplex the counters, they are scaled up to the whole
+    time they were enabled, and so are estimates.
+*/
+struct PerfCounts {
+    uint64_t instructions = 0;   ///< Instructions retired
+    uint64_t cycles = 0;         ///< CPU cycles, on the core's clock
+    uint64_t llcMisses = 0;      ///< Last level cache misses
+    uint64_t branchMisses = 0;   ///< Mispredicted branches
+    uint64_t dtlbMisses = 0;     ///< Data TLB read misses
+
+    /// Instructions per cycle; low values with many cache misses point to
+    /// code that waits on memory
+    double ipc() const
+    {
+        return cycles ? 1.0 * instructions / cycles : 0.0;
+    }
+
+    PerfCounts & operator += (const PerfCounts & other);
+
+    /// Difference between two readings; counters never go backwards, but
+    /// scaled estimates can, so each one stops at zero
+    PerfCounts operator - (const PerfCounts & other) const;
+};
+
+
+/*****************************************************************************/
+/* PERF COUNTER GROUP                                                        */
+/*****************************************************************************/
+
+/** The counters of PerfCounts for one thread, opened as a group so that
+    they are all counted over the same time.  Only user space is counted,
+    which is allowed for the threads of our own process unless
+    kernel.perf_event_paranoid is 3 or more.
+
+    Counters that the CPU or the hypervisor don't have stay at zero.  If
+    none can be opened, valid() is false and read() returns zeros, so
+    that nothing needs to be done specially where they're not available.
+*/
+struct PerfCounterGroup {
+
+    /** Count for the given thread, or the calling one if it's zero.  The
+        counts only start at construction, and so should be read at the
+        start and end of what's measured.
+    */
+    explicit PerfCounterGroup(pid_t tid = 0);
+
+    ~PerfCounterGroup();
+
+    PerfCounterGroup(const PerfCounterGroup &) = delete;
+    void operator = (const PerfCounterGroup &) = delete;
+
+    bool valid() const { return leader != -1; }
+
+    /** Return the counts since construction.  This is a single system
+        call, and can be done from any thread.
+    */
+    PerfCounts read() const;
+
+    /** Can counters be opened in this process at all?  This is checked
+        once, by opening a group for the calling thread.
+    */
+    static bool available();
+
+    /** Return the group of the calling thread, opened the first time it's
+        asked for and kept until the thread exits.
+    */
+    static const PerfCounterGroup & forThisThread();
+
+private:
+    int leader = -1;
+
+    /// Field of PerfCounts that each fd of the group, in the order of a
+    /// group read, counts into
+    std::vector<std::pair<int, uint64_t PerfCounts::*> > counters;
+};
+
+
+/*****************************************************************************/
+/* PROCESS PERF COUNTERS                                                     */
+/*****************************************************************************/
+
+/** Counts for all of the threads of the process, by opening a group for
+    each thread that exists at construction.  Threads that start later
+    aren't counted, which is fine for the work done on a thread pool;
+    those that exit keep their counts.
+
+    Like the CPU time of the process, this includes anything else that
+    runs at the same time.
+*/
+struct ProcessPerfCounters {
+    ProcessPerfCounters();
+    ~ProcessPerfCounters();
+
+    /** Were counters opened for any thread? */
+    bool valid() const { return !threads.empty(); }
+
+    /** Return the sum of the counts of the threads since construction. */
+    PerfCounts read() const;
+
+private:
+    std::vector<std::unique_ptr<PerfCounterGroup> > threads;
+};
+
+} // namespace MLDB
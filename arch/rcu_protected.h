@@ -16,9 +16,13 @@
 
 namespace MLDB {
 
-template<typename T>
+/** The lock type defaults to GcLock; EpochLock (epoch_lock.h) can be used
+    instead for structures with hot read paths, as it has cheaper read side
+    critical sections.
+*/
+template<typename T, typename Lock = GcLock>
 struct RcuLocked {
-    RcuLocked(T * ptr = nullptr, GcLock * lock = nullptr)
+    RcuLocked(T * ptr = nullptr, Lock * lock = nullptr)
         : ptr(ptr), lock(lock)
     {
         if (lock)
@@ -27,7 +31,7 @@ struct RcuLocked {
 
     /// Transfer from another lock
     template<typename T2>
-    RcuLocked(T * ptr, RcuLocked<T2> && other)
+    RcuLocked(T * ptr, RcuLocked<T2, Lock> && other)
         : ptr(ptr), lock(other.lock)
     {
         other.lock = nullptr;
@@ -36,7 +40,7 @@ struct RcuLocked {
 
     /// Copy from another lock
     template<typename T2>
-    RcuLocked(T * ptr, const RcuLocked<T2> & other)
+    RcuLocked(T * ptr, const RcuLocked<T2, Lock> & other)
         : ptr(ptr), lock(other.lock)
     {
         if (lock)
@@ -44,7 +48,7 @@ struct RcuLocked {
     }
 
     template<typename T2>
-    RcuLocked(RcuLocked<T2> && other)
+    RcuLocked(RcuLocked<T2, Lock> && other)
         : ptr(other.ptr), lock(other.lock)
     {
         other.lock = nullptr;
@@ -63,7 +67,7 @@ struct RcuLocked {
     }
 
     template<typename T2>
-    RcuLocked & operator = (RcuLocked<T2> && other)
+    RcuLocked & operator = (RcuLocked<T2, Lock> && other)
     {
         unlock();
         lock = other.lock;
@@ -87,7 +91,7 @@ struct RcuLocked {
     }
 
     T * ptr;
-    GcLock * lock;
+    Lock * lock;
 
     operator T * () const
     {
@@ -109,19 +113,19 @@ struct RcuLocked {
     }
 };
 
-template<typename T>
+template<typename T, typename Lock = GcLock>
 struct RcuProtected {
     std::atomic<T *> val;
-    GcLock * lock;
+    Lock * lock;
 
     template<typename... Args>
-    RcuProtected(GcLock & lock, Args&&... args)
+    RcuProtected(Lock & lock, Args&&... args)
         : val(new T(std::forward<Args>(args)...)), lock(&lock)
     {
         //ExcAssert(this->lock);
     }
 
-    RcuProtected(T * val, GcLock & lock)
+    RcuProtected(T * val, Lock & lock)
         : val(val), lock(&lock)
     {
         //ExcAssert(this->lock);
@@ -153,22 +157,30 @@ struct RcuProtected {
 
     MLDB_IMPLEMENT_OPERATOR_BOOL(val);
 
-    RcuLocked<T> operator () ()
+    RcuLocked<T, Lock> operator () ()
     {
         //ExcAssert(lock);
-        return RcuLocked<T>(val, lock);
+        // The value must be read once we're in the critical section, or it
+        // may already have been freed
+        RcuLocked<T, Lock> result(nullptr, lock);
+        result.ptr = val;
+        return result;
     }
 
-    RcuLocked<const T> operator () () const
+    RcuLocked<const T, Lock> operator () () const
     {
         //ExcAssert(lock);
-        return RcuLocked<const T>(val, lock);
+        RcuLocked<const T, Lock> result(nullptr, lock);
+        result.ptr = val;
+        return result;
     }
 
-    RcuLocked<const T> getImmutable() const
+    RcuLocked<const T, Lock> getImmutable() const
     {
         //ExcAssert(lock);
-        return RcuLocked<const T>(val, lock);
+        RcuLocked<const T, Lock> result(nullptr, lock);
+        result.ptr = val;
+        return result;
     }
 
     T * unsafePtr() const
@@ -177,7 +189,7 @@ struct RcuProtected {
     }
 
     void replace(T * newVal, bool defer = true,
-                 void (*cleanup) (T *) = GcLock::doDelete<T>)
+                 void (*cleanup) (T *) = Lock::template doDelete<T>)
     {
         T * toDelete = val.exchange(newVal);
         if (toDelete) {
@@ -199,10 +211,10 @@ struct RcuProtected {
         return std::unique_ptr<T>(val.exchange(newVal));
     }
     
-    bool cmp_xchg(RcuLocked<T> & current,
+    bool cmp_xchg(RcuLocked<T, Lock> & current,
                   std::unique_ptr<T> & newValue,
                   bool defer = true,
-                  void (*cleanup) (T *) = GcLock::doDelete<T>)
+                  void (*cleanup) (T *) = Lock::template doDelete<T>)
     {
         T * currentVal = current.ptr;
         if (val.compare_exchange_strong(currentVal, newValue.get())) {
@@ -232,27 +244,27 @@ private:
     void operator = (const RcuProtected & other);
 };
 
-template<typename T>
-struct RcuProtectedCopyable : public RcuProtected<T> {
+template<typename T, typename Lock = GcLock>
+struct RcuProtectedCopyable : public RcuProtected<T, Lock> {
 
-    using RcuProtected<T>::val;
-    using RcuProtected<T>::lock;
-    using RcuProtected<T>::operator ();
-    using RcuProtected<T>::replace;
+    using RcuProtected<T, Lock>::val;
+    using RcuProtected<T, Lock>::lock;
+    using RcuProtected<T, Lock>::operator ();
+    using RcuProtected<T, Lock>::replace;
 
     template<typename... Args>
-    RcuProtectedCopyable(GcLock & lock, Args&&... args)
-        : RcuProtected<T>(lock, std::forward<Args>(args)...)
+    RcuProtectedCopyable(Lock & lock, Args&&... args)
+        : RcuProtected<T, Lock>(lock, std::forward<Args>(args)...)
     {
     }
 
     RcuProtectedCopyable(const RcuProtectedCopyable & other)
-        : RcuProtected<T>(new T(*other()), *other.lock)
+        : RcuProtected<T, Lock>(new T(*other()), *other.lock)
     {
     }
 
     RcuProtectedCopyable(RcuProtectedCopyable && other)
-        : RcuProtected<T>(static_cast<RcuProtected<T> &&>(other))
+        : RcuProtected<T, Lock>(static_cast<RcuProtected<T, Lock> &&>(other))
     {
     }
 
@@ -0,0 +1,286 @@
+/* sampling_profiler.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   In-process sampling profiler.
+*/
+
+#include "sampling_profiler.h"
+#include "backtrace.h"
+#include "exception.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+
+
+namespace MLDB {
+
+namespace {
+
+/** The tag of the thread, as read by the signal handler.  It uses the
+    initial-exec TLS model so that reading it from the handler can't
+    allocate.  The owner keeps the string alive while it's current.
+*/
+thread_local const std::string * currentTag
+    __attribute__((tls_model("initial-exec"))) = nullptr;
+thread_local std::shared_ptr<const std::string> currentTagOwner;
+
+struct Sample {
+    void * frames[SamplingProfiler::MAX_FRAMES];
+    int depth;
+    int tagLength;
+    char tag[SamplingProfiler::MAX_TAG_LENGTH];
+};
+
+/// Frames of each sample that are the handler and the signal trampoline
+constexpr int HANDLER_FRAMES = 2;
+
+/// Most samples kept by a run, which bounds its memory to about 40MB
+constexpr size_t MAX_SAMPLES = 65536;
+
+std::mutex runMutex;
+std::atomic<bool> isRunning(false);
+
+// State shared with the signal handler
+std::atomic<Sample *> sampleBuffer(nullptr);
+size_t sampleCapacity = 0;
+std::atomic<size_t> nextSample(0);
+std::atomic<uint64_t> numDropped(0);
+std::atomic<int> numInHandler(0);
+
+/** Record a sample.  This must be async signal safe, so it only writes
+    into the buffer that was allocated before the run started.
+*/
+void __attribute__((noinline))
+onProfilingSignal(int, siginfo_t *, void *)
+{
+    int savedErrno = errno;
+    numInHandler.fetch_add(1);
+
+    Sample * buffer = sampleBuffer.load();
+    if (buffer) {
+        size_t i = nextSample.fetch_add(1, std::memory_order_relaxed);
+        if (i < sampleCapacity) {
+            Sample & sample = buffer[i];
+            sample.depth = ::backtrace(sample.frames,
+                                       SamplingProfiler::MAX_FRAMES);
+            const std::string * tag = currentTag;
+            size_t length = 0;
+            if (tag) {
+                length = std::min<size_t>(tag->size(),
+                                          SamplingProfiler::MAX_TAG_LENGTH);
+                memcpy(sample.tag, tag->data(), length);
+            }
+            sample.tagLength = length;
+        }
+        else ++numDropped;
+    }
+
+    numInHandler.fetch_sub(1);
+    errno = savedErrno;
+}
+
+/// Name of the function containing the given address
+std::string frameName(const void * address)
+{
+    BacktraceFrame frame(0, address);
+    std::string result = frame.function;
+    if (result.empty()) {
+        if (frame.object.empty())
+            return "[unknown]";
+        auto pos = frame.object.rfind('/');
+        result = "["
+            + (pos == std::string::npos
+               ? frame.object : frame.object.substr(pos + 1))
+            + "]";
+    }
+    // Semicolons separate the frames of folded stacks
+    std::replace(result.begin(), result.end(), ';', ':');
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SAMPLING PROFILE                                                          */
+/*****************************************************************************/
+
+std::string
+SamplingProfile::
+folded() const
+{
+    std::string result;
+    for (auto & s: stacks) {
+        result += s.first;
+        result += ' ';
+        result += std::to_string(s.second);
+        result += '\n';
+    }
+    return result;
+}
+
+
+/*****************************************************************************/
+/* SAMPLING PROFILER                                                         */
+/*****************************************************************************/
+
+SamplingProfile
+SamplingProfiler::
+run(double seconds, int frequency)
+{
+    if (!(seconds > 0) || seconds > 3600)
+        throw MLDB::Exception("Sampling profiler duration must be between "
+                              "0 and 3600 seconds");
+    if (frequency < 1 || frequency > 10000)
+        throw MLDB::Exception("Sampling profiler frequency must be between "
+                              "1 and 10000 samples per second");
+
+    std::unique_lock<std::mutex> guard(runMutex, std::try_to_lock);
+    if (!guard)
+        throw MLDB::Exception("Sampling profiler is already running");
+
+    // The first call to backtrace() loads libgcc, which allocates; doing it
+    // here makes the calls from the signal handler safe.
+    void * warmup[4];
+    ::backtrace(warmup, 4);
+
+    // Each busy CPU gets its own stream of samples
+    size_t numCpus = std::max(1u, std::thread::hardware_concurrency());
+    size_t capacity = std::min<size_t>(MAX_SAMPLES,
+                                       seconds * frequency * numCpus + 16);
+    std::unique_ptr<Sample[]> samples(new Sample[capacity]);
+
+    sampleCapacity = capacity;
+    nextSample = 0;
+    numDropped = 0;
+    sampleBuffer = samples.get();
+
+    struct sigaction action, oldAction;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = onProfilingSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &oldAction) == -1) {
+        sampleBuffer = nullptr;
+        throw MLDB::Exception(errno, "sigaction(SIGPROF)");
+    }
+
+    isRunning = true;
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = std::max(1, 1000000 / frequency);
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+
+    isRunning = false;
+    sampleBuffer = nullptr;
+    while (numInHandler.load() > 0)
+        std::this_thread::yield();
+
+    // A signal may still be pending.  Without a handler of its own to go
+    // back to, the process would be killed by it, so we ignore it instead.
+    if ((oldAction.sa_flags & SA_SIGINFO)
+        || (oldAction.sa_handler != SIG_DFL
+            && oldAction.sa_handler != SIG_IGN))
+        sigaction(SIGPROF, &oldAction, nullptr);
+    else signal(SIGPROF, SIG_IGN);
+
+    // Turn the addresses into folded stacks
+    SamplingProfile result;
+    result.numSamples = std::min(nextSample.load(), capacity);
+    result.numDropped = numDropped;
+
+    std::unordered_map<const void *, std::string> names;
+    auto getName = [&] (const void * address) -> const std::string &
+        {
+            auto it = names.find(address);
+            if (it == names.end())
+                it = names.emplace(address, frameName(address)).first;
+            return it->second;
+        };
+
+    std::map<std::string, uint64_t> counts;
+    std::string stack;
+    for (size_t i = 0;  i < result.numSamples;  ++i) {
+        const Sample & sample = samples[i];
+        if (sample.tagLength)
+            stack.assign(sample.tag, sample.tagLength);
+        else stack = "[untagged]";
+        std::replace(stack.begin(), stack.end(), ';', ':');
+
+        // Frames other than the interrupted one are return addresses, one
+        // past the call, which may be in the next function
+        for (int j = sample.depth - 1;  j >= HANDLER_FRAMES;  --j) {
+            const char * address = (const char *)sample.frames[j];
+            if (j > HANDLER_FRAMES)
+                address -= 1;
+            stack += ';';
+            stack += getName(address);
+        }
+        counts[stack] += 1;
+    }
+
+    result.stacks.insert(result.stacks.end(), counts.begin(), counts.end());
+    std::stable_sort(result.stacks.begin(), result.stacks.end(),
+                     [] (const std::pair<std::string, uint64_t> & p1,
+                         const std::pair<std::string, uint64_t> & p2)
+                     {
+                         return p1.second > p2.second;
+                     });
+
+    return result;
+}
+
+bool
+SamplingProfiler::
+running()
+{
+    return isRunning.load(std::memory_order_relaxed);
+}
+
+
+/*****************************************************************************/
+/* SAMPLE TAG SCOPE                                                          */
+/*****************************************************************************/
+
+SampleTagScope::
+SampleTagScope(std::shared_ptr<const std::string> tag)
+    : previous(std::move(currentTagOwner))
+{
+    currentTagOwner = std::move(tag);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    currentTag = currentTagOwner.get();
+}
+
+SampleTagScope::
+~SampleTagScope()
+{
+    // Stop the handler from reading the tag before letting it go
+    currentTag = previous.get();
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    currentTagOwner = std::move(previous);
+}
+
+std::shared_ptr<const std::string>
+SampleTagScope::
+current()
+{
+    return currentTagOwner;
+}
+
+} // namespace MLDB
@@ -0,0 +1,101 @@
+/* sampling_profiler.h                                             -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   In-process sampling profiler, producing folded stacks for flame graphs.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SAMPLING PROFILE                                                          */
+/*****************************************************************************/
+
+/** The stacks seen by a run of the SamplingProfiler. */
+struct SamplingProfile {
+    /// Each distinct stack with its number of samples, most sampled first.
+    /// Stacks are the tag followed by the frames from the outermost to the
+    /// innermost, separated by semicolons.
+    std::vector<std::pair<std::string, uint64_t> > stacks;
+
+    uint64_t numSamples = 0;   ///< Samples that were recorded
+    uint64_t numDropped = 0;   ///< Samples lost as the buffer was full
+
+    /** Return the stacks in the folded format read by flamegraph.pl,
+        one "stack count" line per stack.
+    */
+    std::string folded() const;
+};
+
+
+/*****************************************************************************/
+/* SAMPLING PROFILER                                                         */
+/*****************************************************************************/
+
+/** Samples the stacks of the threads of the process while they use the
+    CPU, from a SIGPROF timer.  Nothing is done outside of a run, so that
+    it can be left in production builds.
+
+    Each sample records the tag that was current on the sampled thread
+    (see SampleTagScope), so that the samples of a query or procedure run
+    can be told apart.
+
+    Only one run can happen at a time.  While it runs, system calls of the
+    sampled threads may be interrupted; SA_RESTART restarts most of them.
+*/
+
+struct SamplingProfiler {
+
+    /** Sample for the given number of seconds, at the given frequency in
+        samples per second of CPU time, and return what was seen.  This
+        blocks the calling thread for the whole run.  Throws if another run
+        is in progress.
+    */
+    static SamplingProfile run(double seconds, int frequency = 99);
+
+    /** Is a run in progress?  While one is, jobs carry the tag of the
+        thread that submitted them (see ThreadPool).
+    */
+    static bool running();
+
+    /// Deepest stack that is recorded; deeper frames are cut off
+    static constexpr int MAX_FRAMES = 64;
+
+    /// Longest tag that is recorded; longer tags are truncated
+    static constexpr int MAX_TAG_LENGTH = 127;
+};
+
+
+/*****************************************************************************/
+/* SAMPLE TAG SCOPE                                                          */
+/*****************************************************************************/
+
+/** Make the given tag the one recorded for samples of this thread while
+    the object is in scope, restoring the previous one afterwards.  A null
+    tag means no tag.
+*/
+
+struct SampleTagScope {
+    SampleTagScope(std::shared_ptr<const std::string> tag);
+    ~SampleTagScope();
+
+    SampleTagScope(const SampleTagScope &) = delete;
+    void operator = (const SampleTagScope &) = delete;
+
+    /** Return the tag current on this thread, or null. */
+    static std::shared_ptr<const std::string> current();
+
+private:
+    std::shared_ptr<const std::string> previous;
+};
+
+} // namespace MLDB
@@ -50,7 +50,18 @@ MLDB_ALWAYS_INLINE bool has_avx()
 
 MLDB_ALWAYS_INLINE bool has_avx2()
 {
-    return cpuid(7, 0).ebx & (1 << 5);
+    return has_avx() && cpu_info().avx2;
+}
+
+MLDB_ALWAYS_INLINE bool has_fma()
+{
+    return has_avx() && cpu_info().fma;
+}
+
+MLDB_ALWAYS_INLINE bool has_avx512f()
+{
+    const CPU_Info & info = cpu_info();
+    return info.avx512f && (info.xcr0 & 0xe6) == 0xe6;
 }
 
 #endif // __i686__
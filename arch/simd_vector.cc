@@ -12,6 +12,7 @@
 #include "exception.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #if MLDB_INTEL_ISA
 # include "simd_vector.h"
 # include "simd_vector_avx.h"
@@ -35,6 +36,13 @@ int ptr_align(const X * p)
 
 void vec_scale(const float * x, float k, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_scale(x, k, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_scale(x, k, r, n);
+#endif
+
     size_t i = 0;
 
         if (false)
@@ -71,6 +79,13 @@ void vec_scale(const float * x, float k, float * r, size_t n)
 
 void vec_add(const float * x, const float * y, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_add(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_add(x, y, r, n);
+#endif
+
     size_t i = 0;
 
         if (false)
@@ -112,6 +127,13 @@ void vec_add(const float * x, const float * y, float * r, size_t n)
 
 void vec_prod(const float * x, const float * y, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_prod(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_prod(x, y, r, n);
+#endif
+
     size_t i = 0;
 
         if (false)
@@ -207,6 +229,13 @@ void vec_prod(const double * x, const double * y, float * r, size_t n)
 
 void vec_add(const float * x, float k, const float * y, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_add(x, k, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_add(x, k, y, r, n);
+#endif
+
     size_t i = 0;
 
     //bool alignment_unimportant = true;  // nehalem?
@@ -367,11 +396,20 @@ float vec_dotprod_sse2(const float * x, const float * y, size_t n)
 
 float vec_dotprod(const float * x, const float * y, size_t n)
 {
-    return vec_dotprod_generic(x, y, n);
+    // Same double precision accumulation as vec_dotprod_generic(), which
+    // vec_dotprod_dp() has vectorized versions of
+    return vec_dotprod_dp(x, y, n);
 }
 
 void vec_scale(const double * x, double k, double * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_scale(x, k, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_scale(x, k, r, n);
+#endif
+
     size_t i = 0;
 
         if (false)
@@ -409,6 +447,13 @@ void vec_scale(const double * x, double k, double * r, size_t n)
 void vec_add(const double * x, double k, const double * y, double * r,
              size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_add(x, k, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_add(x, k, y, r, n);
+#endif
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -675,7 +720,13 @@ double vec_euclid(const float * x, const float * y, size_t n)
         ;
 
 #if MLDB_INTEL_ISA
-    if (has_avx()) {
+    else if (has_avx512f()) {
+        return Avx512::vec_euclid(x, y, n);
+    }
+    else if (has_avx2() && has_fma()) {
+        return Avx2::vec_euclid(x, y, n);
+    }
+    else if (has_avx()) {
         return Avx::vec_euclid(x, y, n);
     }
     else if (true) /* sse2 */ {
@@ -1073,6 +1124,12 @@ double vec_dotprod_dp(const float * x, const float * y, size_t n)
         ;
 
 #if MLDB_INTEL_ISA
+    else if (has_avx512f()) {
+        return Avx512::vec_dotprod_dp(x, y, n);
+    }
+    else if (has_avx2() && has_fma()) {
+        return Avx2::vec_dotprod_dp(x, y, n);
+    }
     else if (has_avx()) {
         return Avx::vec_dotprod_dp(x, y, n);
     }
@@ -1087,6 +1144,42 @@ double vec_dotprod_dp(const float * x, const float * y, size_t n)
     }
 }
 
+void vec_dotprod_norms_dp(const float * x, const float * y, size_t n,
+                          double & xy, double & xx, double & yy)
+{
+    // Interrogate the cpuid flags directly to decide which one to use
+    if (false)
+        ;
+#if MLDB_INTEL_ISA
+    else if (has_avx512f()) {
+        Avx512::vec_dotprod_norms_dp(x, y, n, xy, xx, yy);
+    }
+    else if (has_avx2() && has_fma()) {
+        Avx2::vec_dotprod_norms_dp(x, y, n, xy, xx, yy);
+    }
+#endif
+    else {
+        // No fused kernel; three passes of the best dot product we have
+        xy = vec_dotprod_dp(x, y, n);
+        xx = vec_dotprod_dp(x, x, n);
+        yy = vec_dotprod_dp(y, y, n);
+    }
+}
+
+double vec_cosine_distance(const float * x, const float * y, size_t n)
+{
+    double xy, xx, yy;
+    vec_dotprod_norms_dp(x, y, n, xy, xx, yy);
+
+    if (xx == 0.0 || yy == 0.0) {
+        // Two zero vectors are the same; a zero vector is as far as it
+        // can be from anything else
+        return xx == yy ? 0.0 : 1.0;
+    }
+
+    return std::max(1.0 - xy / sqrt(xx * yy), 0.0);
+}
+
 double vec_sum_dp(const float * x, size_t n)
 {
     double res = 0.0;
@@ -1097,6 +1190,13 @@ double vec_sum_dp(const float * x, size_t n)
 
 void vec_add(const double * x, const double * y, double * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_add(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_add(x, y, r, n);
+#endif
+
     size_t i = 0;
 #if MLDB_INTEL_ISA
     if (true) {
@@ -1203,6 +1303,13 @@ void vec_add(const double * x, const float * y, double * r, size_t n)
 
 void vec_prod(const double * x, const double * y, double * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_prod(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_prod(x, y, r, n);
+#endif
+
     size_t i = 0;
 #if MLDB_INTEL_ISA
     if (true) {
@@ -1814,6 +1921,102 @@ double vec_kl(const float * p, const float * q, size_t n)
     return total;
 }
 
+void vec_min(const float * x, const float * y, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_min(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_min(x, y, r, n);
+#endif
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::min(x[i], y[i]);
+}
+
+void vec_min(const float * x, float y, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_min(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_min(x, y, r, n);
+#endif
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::min(x[i], y);
+}
+
+void vec_max(const float * x, const float * y, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_max(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_max(x, y, r, n);
+#endif
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::max(x[i], y[i]);
+}
+
+void vec_max(const float * x, float y, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_max(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_max(x, y, r, n);
+#endif
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::max(x[i], y);
+}
+
+void vec_min(const double * x, const double * y, double * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_min(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_min(x, y, r, n);
+#endif
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::min(x[i], y[i]);
+}
+
+void vec_min(const double * x, double y, double * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_min(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_min(x, y, r, n);
+#endif
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::min(x[i], y);
+}
+
+void vec_max(const double * x, const double * y, double * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_max(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_max(x, y, r, n);
+#endif
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::max(x[i], y[i]);
+}
+
+void vec_max(const double * x, double y, double * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return Avx512::vec_max(x, y, r, n);
+    if (has_avx2() && has_fma())
+        return Avx2::vec_max(x, y, r, n);
+#endif
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::max(x[i], y);
+}
+
 void vec_min_max_el(const float * x, float * mins, float * maxs, size_t n)
 {
     size_t i = 0;
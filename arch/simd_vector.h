@@ -114,6 +114,17 @@ void vec_add(const double * x, const float * y, double * r, size_t n);
 /* Floating point using double precision accumulation */
 double vec_dotprod_dp(const float * x, const float * y, size_t n);
 double vec_sum_dp(const float * x, size_t n);
+
+/** Dot product and both squared norms of x and y in a single pass, with
+    internal summation in dp. */
+void vec_dotprod_norms_dp(const float * x, const float * y, size_t n,
+                          double & xy, double & xx, double & yy);
+
+/** Cosine distance 1 - x.y / (|x| |y|), clamped to be non-negative.  Two
+    zero vectors are at distance 0; a zero vector is at distance 1 from
+    any other vector. */
+double vec_cosine_distance(const float * x, const float * y, size_t n);
+
 void vec_add(const double * x, double k, const float * y, double * r,
              size_t n);
 
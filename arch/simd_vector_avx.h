@@ -30,5 +30,79 @@ void vec_minus(const float * x, const float * y, float * r, size_t n);
 double vec_euclid(const float * x, const float * y, size_t n);
 
 } // namespace Avx
+
+namespace Avx2 {
+
+/// Single precision vector dot product with internal summation in dp,
+/// avx2 version
+double vec_dotprod_dp(const float * x, const float * y, size_t n);
+
+/// Single precision vector euclidean distance squared, avx2 and fma version
+double vec_euclid(const float * x, const float * y, size_t n);
+
+/// Dot product and both squared norms in one pass, avx2 version
+void vec_dotprod_norms_dp(const float * x, const float * y, size_t n,
+                          double & xy, double & xx, double & yy);
+
+/** Elementwise kernels, avx2 versions.  They round like the generic
+    versions (no fused multiply-adds), so give exactly the same results.
+*/
+void vec_scale(const float * x, float k, float * r, size_t n);
+void vec_add(const float * x, const float * y, float * r, size_t n);
+void vec_add(const float * x, float k, const float * y, float * r, size_t n);
+void vec_prod(const float * x, const float * y, float * r, size_t n);
+void vec_min(const float * x, const float * y, float * r, size_t n);
+void vec_min(const float * x, float y, float * r, size_t n);
+void vec_max(const float * x, const float * y, float * r, size_t n);
+void vec_max(const float * x, float y, float * r, size_t n);
+
+void vec_scale(const double * x, double k, double * r, size_t n);
+void vec_add(const double * x, const double * y, double * r, size_t n);
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n);
+void vec_prod(const double * x, const double * y, double * r, size_t n);
+void vec_min(const double * x, const double * y, double * r, size_t n);
+void vec_min(const double * x, double y, double * r, size_t n);
+void vec_max(const double * x, const double * y, double * r, size_t n);
+void vec_max(const double * x, double y, double * r, size_t n);
+
+} // namespace Avx2
+
+namespace Avx512 {
+
+/// Single precision vector dot product with internal summation in dp,
+/// avx-512 version
+double vec_dotprod_dp(const float * x, const float * y, size_t n);
+
+/// Single precision vector euclidean distance squared, avx-512 version
+double vec_euclid(const float * x, const float * y, size_t n);
+
+/// Dot product and both squared norms in one pass, avx-512 version
+void vec_dotprod_norms_dp(const float * x, const float * y, size_t n,
+                          double & xy, double & xx, double & yy);
+
+/** Elementwise kernels, avx-512 versions.  They round like the generic
+    versions (no fused multiply-adds), so give exactly the same results.
+*/
+void vec_scale(const float * x, float k, float * r, size_t n);
+void vec_add(const float * x, const float * y, float * r, size_t n);
+void vec_add(const float * x, float k, const float * y, float * r, size_t n);
+void vec_prod(const float * x, const float * y, float * r, size_t n);
+void vec_min(const float * x, const float * y, float * r, size_t n);
+void vec_min(const float * x, float y, float * r, size_t n);
+void vec_max(const float * x, const float * y, float * r, size_t n);
+void vec_max(const float * x, float y, float * r, size_t n);
+
+void vec_scale(const double * x, double k, double * r, size_t n);
+void vec_add(const double * x, const double * y, double * r, size_t n);
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n);
+void vec_prod(const double * x, const double * y, double * r, size_t n);
+void vec_min(const double * x, const double * y, double * r, size_t n);
+void vec_min(const double * x, double y, double * r, size_t n);
+void vec_max(const double * x, const double * y, double * r, size_t n);
+void vec_max(const double * x, double y, double * r, size_t n);
+
+} // namespace Avx512
 } // namespace SIMD
 } // namespace MLDB
@@ -0,0 +1,407 @@
+/** simd_vector_avx2.cc
+
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    SIMD vector operations; AVX2 and FMA specializations of the distance
+    and elementwise kernels.
+*/
+
+#include "simd_vector_avx.h"
+#include <immintrin.h>
+
+namespace MLDB {
+namespace SIMD {
+namespace Avx2 {
+
+namespace {
+
+inline double horiz_sum(__m256d rr)
+{
+    double results[4];
+    _mm256_storeu_pd(results, rr);
+    return (results[0] + results[1]) + (results[2] + results[3]);
+}
+
+inline double horiz_sum(__m256 rr)
+{
+    float results[8];
+    _mm256_storeu_ps(results, rr);
+    double result = 0.0;
+    for (unsigned i = 0;  i < 8;  ++i)
+        result += results[i];
+    return result;
+}
+
+/** Products of 8 pairs of floats, widened to double.  The products are
+    done in single precision like the other dp kernels, so that they give
+    the same results for the same data. */
+inline void prod_dp(const float * x, const float * y,
+                    __m256d & lo, __m256d & hi)
+{
+    __m256 p = _mm256_mul_ps(_mm256_loadu_ps(x), _mm256_loadu_ps(y));
+    lo = _mm256_cvtps_pd(_mm256_castps256_ps128(p));
+    hi = _mm256_cvtps_pd(_mm256_extractf128_ps(p, 1));
+}
+
+/** Operations on vectors of floats or doubles, so that the elementwise
+    kernels can be written once for both. */
+template<typename F> struct Vecs;
+
+template<>
+struct Vecs<float> {
+    typedef __m256 Vec;
+    static constexpr size_t N = 8;
+
+    static Vec load(const float * x) { return _mm256_loadu_ps(x); }
+    static void store(float * r, Vec v) { _mm256_storeu_ps(r, v); }
+    static Vec splat(float k) { return _mm256_set1_ps(k); }
+
+    /// Mask of the first n < N lanes, for the end of the arrays
+    static __m256i mask(size_t n)
+    {
+        return _mm256_cmpgt_epi32(_mm256_set1_epi32(n),
+                                  _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    }
+    static Vec load(const float * x, __m256i m)
+    {
+        return _mm256_maskload_ps(x, m);
+    }
+    static void store(float * r, __m256i m, Vec v)
+    {
+        _mm256_maskstore_ps(r, m, v);
+    }
+
+    static Vec add(Vec x, Vec y) { return _mm256_add_ps(x, y); }
+    static Vec mul(Vec x, Vec y) { return _mm256_mul_ps(x, y); }
+    static Vec min(Vec x, Vec y) { return _mm256_min_ps(x, y); }
+    static Vec max(Vec x, Vec y) { return _mm256_max_ps(x, y); }
+};
+
+template<>
+struct Vecs<double> {
+    typedef __m256d Vec;
+    static constexpr size_t N = 4;
+
+    static Vec load(const double * x) { return _mm256_loadu_pd(x); }
+    static void store(double * r, Vec v) { _mm256_storeu_pd(r, v); }
+    static Vec splat(double k) { return _mm256_set1_pd(k); }
+
+    static __m256i mask(size_t n)
+    {
+        return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n),
+                                  _mm256_setr_epi64x(0, 1, 2, 3));
+    }
+    static Vec load(const double * x, __m256i m)
+    {
+        return _mm256_maskload_pd(x, m);
+    }
+    static void store(double * r, __m256i m, Vec v)
+    {
+        _mm256_maskstore_pd(r, m, v);
+    }
+
+    static Vec add(Vec x, Vec y) { return _mm256_add_pd(x, y); }
+    static Vec mul(Vec x, Vec y) { return _mm256_mul_pd(x, y); }
+    static Vec min(Vec x, Vec y) { return _mm256_min_pd(x, y); }
+    static Vec max(Vec x, Vec y) { return _mm256_max_pd(x, y); }
+};
+
+/** r[i] = op(x[i], y[i]), a vector at a time.  The end of the arrays is
+    done with masked loads and stores rather than a scalar loop, so that
+    every element goes through the same instructions.  r may be x or y.
+*/
+template<typename F, typename Op>
+inline void binary(const F * x, const F * y, F * r, size_t n, Op op)
+{
+    typedef Vecs<F> V;
+    size_t i = 0;
+    for (; i + 2 * V::N <= n;  i += 2 * V::N) {
+        auto r0 = op(V::load(x + i), V::load(y + i));
+        auto r1 = op(V::load(x + i + V::N), V::load(y + i + V::N));
+        V::store(r + i, r0);
+        V::store(r + i + V::N, r1);
+    }
+    for (; i < n;  i += V::N) {
+        if (i + V::N <= n) {
+            V::store(r + i, op(V::load(x + i), V::load(y + i)));
+            continue;
+        }
+        auto m = V::mask(n - i);
+        V::store(r + i, m, op(V::load(x + i, m), V::load(y + i, m)));
+    }
+}
+
+/** r[i] = op(x[i]); same as binary(). */
+template<typename F, typename Op>
+inline void unary(const F * x, F * r, size_t n, Op op)
+{
+    typedef Vecs<F> V;
+    size_t i = 0;
+    for (; i + 2 * V::N <= n;  i += 2 * V::N) {
+        auto r0 = op(V::load(x + i));
+        auto r1 = op(V::load(x + i + V::N));
+        V::store(r + i, r0);
+        V::store(r + i + V::N, r1);
+    }
+    for (; i < n;  i += V::N) {
+        if (i + V::N <= n) {
+            V::store(r + i, op(V::load(x + i)));
+            continue;
+        }
+        auto m = V::mask(n - i);
+        V::store(r + i, m, op(V::load(x + i, m)));
+    }
+}
+
+// The min and max have their arguments swapped, as the instructions
+// return their second argument when either is NaN where std::min() and
+// std::max() return their first.
+
+template<typename F>
+void scale(const F * x, F k, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    auto kk = V::splat(k);
+    unary(x, r, n, [&] (typename V::Vec xx) { return V::mul(xx, kk); });
+}
+
+template<typename F>
+void add(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    binary(x, y, r, n, [] (typename V::Vec xx, typename V::Vec yy)
+           { return V::add(xx, yy); });
+}
+
+template<typename F>
+void add(const F * x, F k, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    auto kk = V::splat(k);
+    binary(x, y, r, n, [&] (typename V::Vec xx, typename V::Vec yy)
+           { return V::add(xx, V::mul(kk, yy)); });
+}
+
+template<typename F>
+void prod(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    binary(x, y, r, n, [] (typename V::Vec xx, typename V::Vec yy)
+           { return V::mul(xx, yy); });
+}
+
+template<typename F>
+void min(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    binary(x, y, r, n, [] (typename V::Vec xx, typename V::Vec yy)
+           { return V::min(yy, xx); });
+}
+
+template<typename F>
+void min(const F * x, F k, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    auto kk = V::splat(k);
+    unary(x, r, n, [&] (typename V::Vec xx) { return V::min(kk, xx); });
+}
+
+template<typename F>
+void max(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    binary(x, y, r, n, [] (typename V::Vec xx, typename V::Vec yy)
+           { return V::max(yy, xx); });
+}
+
+template<typename F>
+void max(const F * x, F k, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    auto kk = V::splat(k);
+    unary(x, r, n, [&] (typename V::Vec xx) { return V::max(kk, xx); });
+}
+
+} // file scope
+
+double vec_dotprod_dp(const float * x, const float * y, size_t n)
+{
+    size_t i = 0;
+    __m256d rr0 = _mm256_setzero_pd(), rr1 = rr0, rr2 = rr0, rr3 = rr0;
+
+    for (; i + 16 <= n;  i += 16) {
+        __m256d lo, hi;
+        prod_dp(x + i, y + i, lo, hi);
+        rr0 = _mm256_add_pd(rr0, lo);
+        rr1 = _mm256_add_pd(rr1, hi);
+        prod_dp(x + i + 8, y + i + 8, lo, hi);
+        rr2 = _mm256_add_pd(rr2, lo);
+        rr3 = _mm256_add_pd(rr3, hi);
+    }
+
+    for (; i + 8 <= n;  i += 8) {
+        __m256d lo, hi;
+        prod_dp(x + i, y + i, lo, hi);
+        rr0 = _mm256_add_pd(rr0, lo);
+        rr1 = _mm256_add_pd(rr1, hi);
+    }
+
+    double result = horiz_sum(_mm256_add_pd(_mm256_add_pd(rr0, rr1),
+                                            _mm256_add_pd(rr2, rr3)));
+
+    for (;  i < n;  ++i) result += x[i] * y[i];
+
+    return result;
+}
+
+double vec_euclid(const float * x, const float * y, size_t n)
+{
+    size_t i = 0;
+    __m256 rr0 = _mm256_setzero_ps(), rr1 = rr0, rr2 = rr0, rr3 = rr0;
+
+    for (; i + 32 <= n;  i += 32) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + i),
+                                  _mm256_loadu_ps(y + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(x + i + 8),
+                                  _mm256_loadu_ps(y + i + 8));
+        __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(x + i + 16),
+                                  _mm256_loadu_ps(y + i + 16));
+        __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(x + i + 24),
+                                  _mm256_loadu_ps(y + i + 24));
+        rr0 = _mm256_fmadd_ps(d0, d0, rr0);
+        rr1 = _mm256_fmadd_ps(d1, d1, rr1);
+        rr2 = _mm256_fmadd_ps(d2, d2, rr2);
+        rr3 = _mm256_fmadd_ps(d3, d3, rr3);
+    }
+
+    for (; i + 8 <= n;  i += 8) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + i),
+                                  _mm256_loadu_ps(y + i));
+        rr0 = _mm256_fmadd_ps(d0, d0, rr0);
+    }
+
+    double result = horiz_sum(_mm256_add_ps(_mm256_add_ps(rr0, rr1),
+                                            _mm256_add_ps(rr2, rr3)));
+
+    for (; i < n;  ++i) result += (x[i] - y[i]) * (x[i] - y[i]);
+
+    return result;
+}
+
+void vec_dotprod_norms_dp(const float * x, const float * y, size_t n,
+                          double & xy, double & xx, double & yy)
+{
+    size_t i = 0;
+    __m256d xy0 = _mm256_setzero_pd(), xy1 = xy0;
+    __m256d xx0 = xy0, xx1 = xy0, yy0 = xy0, yy1 = xy0;
+
+    for (; i + 8 <= n;  i += 8) {
+        __m256d lo, hi;
+        prod_dp(x + i, y + i, lo, hi);
+        xy0 = _mm256_add_pd(xy0, lo);
+        xy1 = _mm256_add_pd(xy1, hi);
+        prod_dp(x + i, x + i, lo, hi);
+        xx0 = _mm256_add_pd(xx0, lo);
+        xx1 = _mm256_add_pd(xx1, hi);
+        prod_dp(y + i, y + i, lo, hi);
+        yy0 = _mm256_add_pd(yy0, lo);
+        yy1 = _mm256_add_pd(yy1, hi);
+    }
+
+    xy = horiz_sum(_mm256_add_pd(xy0, xy1));
+    xx = horiz_sum(_mm256_add_pd(xx0, xx1));
+    yy = horiz_sum(_mm256_add_pd(yy0, yy1));
+
+    for (;  i < n;  ++i) {
+        xy += x[i] * y[i];
+        xx += x[i] * x[i];
+        yy += y[i] * y[i];
+    }
+}
+
+void vec_scale(const float * x, float k, float * r, size_t n)
+{
+    scale(x, k, r, n);
+}
+
+void vec_add(const float * x, const float * y, float * r, size_t n)
+{
+    add(x, y, r, n);
+}
+
+void vec_add(const float * x, float k, const float * y, float * r, size_t n)
+{
+    add(x, k, y, r, n);
+}
+
+void vec_prod(const float * x, const float * y, float * r, size_t n)
+{
+    prod(x, y, r, n);
+}
+
+void vec_min(const float * x, const float * y, float * r, size_t n)
+{
+    min(x, y, r, n);
+}
+
+void vec_min(const float * x, float y, float * r, size_t n)
+{
+    min(x, y, r, n);
+}
+
+void vec_max(const float * x, const float * y, float * r, size_t n)
+{
+    max(x, y, r, n);
+}
+
+void vec_max(const float * x, float y, float * r, size_t n)
+{
+    max(x, y, r, n);
+}
+
+void vec_scale(const double * x, double k, double * r, size_t n)
+{
+    scale(x, k, r, n);
+}
+
+void vec_add(const double * x, const double * y, double * r, size_t n)
+{
+    add(x, y, r, n);
+}
+
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n)
+{
+    add(x, k, y, r, n);
+}
+
+void vec_prod(const double * x, const double * y, double * r, size_t n)
+{
+    prod(x, y, r, n);
+}
+
+void vec_min(const double * x, const double * y, double * r, size_t n)
+{
+    min(x, y, r, n);
+}
+
+void vec_min(const double * x, double y, double * r, size_t n)
+{
+    min(x, y, r, n);
+}
+
+void vec_max(const double * x, const double * y, double * r, size_t n)
+{
+    max(x, y, r, n);
+}
+
+void vec_max(const double * x, double y, double * r, size_t n)
+{
+    max(x, y, r, n);
+}
+
+} // namespace Avx2
+} // namespace SIMD
+} // namespace MLDB
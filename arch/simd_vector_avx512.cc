@@ -0,0 +1,396 @@
+/** simd_vector_avx512.cc
+
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    SIMD vector operations; AVX-512 specializations of the distance and
+    elementwise kernels.
+*/
+
+#include "simd_vector_avx.h"
+#include <immintrin.h>
+
+namespace MLDB {
+namespace SIMD {
+namespace Avx512 {
+
+namespace {
+
+inline double horiz_sum(__m512d rr)
+{
+    double results[8];
+    _mm512_storeu_pd(results, rr);
+    return ((results[0] + results[1]) + (results[2] + results[3]))
+        + ((results[4] + results[5]) + (results[6] + results[7]));
+}
+
+inline double horiz_sum(__m512 rr)
+{
+    float results[16];
+    _mm512_storeu_ps(results, rr);
+    double result = 0.0;
+    for (unsigned i = 0;  i < 16;  ++i)
+        result += results[i];
+    return result;
+}
+
+/** Products of 16 pairs of floats, widened to double.  The products are
+    done in single precision like the other dp kernels, so that they give
+    the same results for the same data. */
+inline void prod_dp(const float * x, const float * y,
+                    __m512d & lo, __m512d & hi)
+{
+    lo = _mm512_cvtps_pd(_mm256_mul_ps(_mm256_loadu_ps(x),
+                                       _mm256_loadu_ps(y)));
+    hi = _mm512_cvtps_pd(_mm256_mul_ps(_mm256_loadu_ps(x + 8),
+                                       _mm256_loadu_ps(y + 8)));
+}
+
+/** Operations on vectors of floats or doubles, so that the elementwise
+    kernels can be written once for both. */
+template<typename F> struct Vecs;
+
+template<>
+struct Vecs<float> {
+    typedef __m512 Vec;
+    typedef __mmask16 Mask;
+    static constexpr size_t N = 16;
+
+    static Vec load(const float * x) { return _mm512_loadu_ps(x); }
+    static void store(float * r, Vec v) { _mm512_storeu_ps(r, v); }
+    static Vec splat(float k) { return _mm512_set1_ps(k); }
+
+    /// Mask of the first n < N lanes, for the end of the arrays
+    static Mask mask(size_t n) { return (Mask)((1U << n) - 1); }
+    static Vec load(const float * x, Mask m)
+    {
+        return _mm512_maskz_loadu_ps(m, x);
+    }
+    static void store(float * r, Mask m, Vec v)
+    {
+        _mm512_mask_storeu_ps(r, m, v);
+    }
+
+    static Vec add(Vec x, Vec y) { return _mm512_add_ps(x, y); }
+    static Vec mul(Vec x, Vec y) { return _mm512_mul_ps(x, y); }
+    static Vec min(Vec x, Vec y) { return _mm512_min_ps(x, y); }
+    static Vec max(Vec x, Vec y) { return _mm512_max_ps(x, y); }
+};
+
+template<>
+struct Vecs<double> {
+    typedef __m512d Vec;
+    typedef __mmask8 Mask;
+    static constexpr size_t N = 8;
+
+    static Vec load(const double * x) { return _mm512_loadu_pd(x); }
+    static void store(double * r, Vec v) { _mm512_storeu_pd(r, v); }
+    static Vec splat(double k) { return _mm512_set1_pd(k); }
+
+    static Mask mask(size_t n) { return (Mask)((1U << n) - 1); }
+    static Vec load(const double * x, Mask m)
+    {
+        return _mm512_maskz_loadu_pd(m, x);
+    }
+    static void store(double * r, Mask m, Vec v)
+    {
+        _mm512_mask_storeu_pd(r, m, v);
+    }
+
+    static Vec add(Vec x, Vec y) { return _mm512_add_pd(x, y); }
+    static Vec mul(Vec x, Vec y) { return _mm512_mul_pd(x, y); }
+    static Vec min(Vec x, Vec y) { return _mm512_min_pd(x, y); }
+    static Vec max(Vec x, Vec y) { return _mm512_max_pd(x, y); }
+};
+
+/** r[i] = op(x[i], y[i]), a vector at a time.  The end of the arrays is
+    done with masked loads and stores rather than a scalar loop, so that
+    every element goes through the same instructions.  r may be x or y.
+*/
+template<typename F, typename Op>
+inline void binary(const F * x, const F * y, F * r, size_t n, Op op)
+{
+    typedef Vecs<F> V;
+    size_t i = 0;
+    for (; i + 2 * V::N <= n;  i += 2 * V::N) {
+        auto r0 = op(V::load(x + i), V::load(y + i));
+        auto r1 = op(V::load(x + i + V::N), V::load(y + i + V::N));
+        V::store(r + i, r0);
+        V::store(r + i + V::N, r1);
+    }
+    for (; i < n;  i += V::N) {
+        if (i + V::N <= n) {
+            V::store(r + i, op(V::load(x + i), V::load(y + i)));
+            continue;
+        }
+        auto m = V::mask(n - i);
+        V::store(r + i, m, op(V::load(x + i, m), V::load(y + i, m)));
+    }
+}
+
+/** r[i] = op(x[i]); same as binary(). */
+template<typename F, typename Op>
+inline void unary(const F * x, F * r, size_t n, Op op)
+{
+    typedef Vecs<F> V;
+    size_t i = 0;
+    for (; i + 2 * V::N <= n;  i += 2 * V::N) {
+        auto r0 = op(V::load(x + i));
+        auto r1 = op(V::load(x + i + V::N));
+        V::store(r + i, r0);
+        V::store(r + i + V::N, r1);
+    }
+    for (; i < n;  i += V::N) {
+        if (i + V::N <= n) {
+            V::store(r + i, op(V::load(x + i)));
+            continue;
+        }
+        auto m = V::mask(n - i);
+        V::store(r + i, m, op(V::load(x + i, m)));
+    }
+}
+
+// The min and max have their arguments swapped, as the instructions
+// return their second argument when either is NaN where std::min() and
+// std::max() return their first.
+
+template<typename F>
+void scale(const F * x, F k, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    auto kk = V::splat(k);
+    unary(x, r, n, [&] (typename V::Vec xx) { return V::mul(xx, kk); });
+}
+
+template<typename F>
+void add(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    binary(x, y, r, n, [] (typename V::Vec xx, typename V::Vec yy)
+           { return V::add(xx, yy); });
+}
+
+template<typename F>
+void add(const F * x, F k, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    auto kk = V::splat(k);
+    binary(x, y, r, n, [&] (typename V::Vec xx, typename V::Vec yy)
+           { return V::add(xx, V::mul(kk, yy)); });
+}
+
+template<typename F>
+void prod(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    binary(x, y, r, n, [] (typename V::Vec xx, typename V::Vec yy)
+           { return V::mul(xx, yy); });
+}
+
+template<typename F>
+void min(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    binary(x, y, r, n, [] (typename V::Vec xx, typename V::Vec yy)
+           { return V::min(yy, xx); });
+}
+
+template<typename F>
+void min(const F * x, F k, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    auto kk = V::splat(k);
+    unary(x, r, n, [&] (typename V::Vec xx) { return V::min(kk, xx); });
+}
+
+template<typename F>
+void max(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    binary(x, y, r, n, [] (typename V::Vec xx, typename V::Vec yy)
+           { return V::max(yy, xx); });
+}
+
+template<typename F>
+void max(const F * x, F k, F * r, size_t n)
+{
+    typedef Vecs<F> V;
+    auto kk = V::splat(k);
+    unary(x, r, n, [&] (typename V::Vec xx) { return V::max(kk, xx); });
+}
+
+} // file scope
+
+double vec_dotprod_dp(const float * x, const float * y, size_t n)
+{
+    size_t i = 0;
+    __m512d rr0 = _mm512_setzero_pd(), rr1 = rr0, rr2 = rr0, rr3 = rr0;
+
+    for (; i + 32 <= n;  i += 32) {
+        __m512d lo, hi;
+        prod_dp(x + i, y + i, lo, hi);
+        rr0 = _mm512_add_pd(rr0, lo);
+        rr1 = _mm512_add_pd(rr1, hi);
+        prod_dp(x + i + 16, y + i + 16, lo, hi);
+        rr2 = _mm512_add_pd(rr2, lo);
+        rr3 = _mm512_add_pd(rr3, hi);
+    }
+
+    for (; i + 16 <= n;  i += 16) {
+        __m512d lo, hi;
+        prod_dp(x + i, y + i, lo, hi);
+        rr0 = _mm512_add_pd(rr0, lo);
+        rr1 = _mm512_add_pd(rr1, hi);
+    }
+
+    double result = horiz_sum(_mm512_add_pd(_mm512_add_pd(rr0, rr1),
+                                            _mm512_add_pd(rr2, rr3)));
+
+    for (;  i < n;  ++i) result += x[i] * y[i];
+
+    return result;
+}
+
+double vec_euclid(const float * x, const float * y, size_t n)
+{
+    size_t i = 0;
+    __m512 rr0 = _mm512_setzero_ps(), rr1 = rr0;
+
+    for (; i + 32 <= n;  i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(x + i),
+                                  _mm512_loadu_ps(y + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(x + i + 16),
+                                  _mm512_loadu_ps(y + i + 16));
+        rr0 = _mm512_fmadd_ps(d0, d0, rr0);
+        rr1 = _mm512_fmadd_ps(d1, d1, rr1);
+    }
+
+    for (; i + 16 <= n;  i += 16) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(x + i),
+                                  _mm512_loadu_ps(y + i));
+        rr0 = _mm512_fmadd_ps(d0, d0, rr0);
+    }
+
+    double result = horiz_sum(_mm512_add_ps(rr0, rr1));
+
+    for (; i < n;  ++i) result += (x[i] - y[i]) * (x[i] - y[i]);
+
+    return result;
+}
+
+void vec_dotprod_norms_dp(const float * x, const float * y, size_t n,
+                          double & xy, double & xx, double & yy)
+{
+    size_t i = 0;
+    __m512d xy0 = _mm512_setzero_pd(), xy1 = xy0;
+    __m512d xx0 = xy0, xx1 = xy0, yy0 = xy0, yy1 = xy0;
+
+    for (; i + 16 <= n;  i += 16) {
+        __m512d lo, hi;
+        prod_dp(x + i, y + i, lo, hi);
+        xy0 = _mm512_add_pd(xy0, lo);
+        xy1 = _mm512_add_pd(xy1, hi);
+        prod_dp(x + i, x + i, lo, hi);
+        xx0 = _mm512_add_pd(xx0, lo);
+        xx1 = _mm512_add_pd(xx1, hi);
+        prod_dp(y + i, y + i, lo, hi);
+        yy0 = _mm512_add_pd(yy0, lo);
+        yy1 = _mm512_add_pd(yy1, hi);
+    }
+
+    xy = horiz_sum(_mm512_add_pd(xy0, xy1));
+    xx = horiz_sum(_mm512_add_pd(xx0, xx1));
+    yy = horiz_sum(_mm512_add_pd(yy0, yy1));
+
+    for (;  i < n;  ++i) {
+        xy += x[i] * y[i];
+        xx += x[i] * x[i];
+        yy += y[i] * y[i];
+    }
+}
+
+void vec_scale(const float * x, float k, float * r, size_t n)
+{
+    scale(x, k, r, n);
+}
+
+void vec_add(const float * x, const float * y, float * r, size_t n)
+{
+    add(x, y, r, n);
+}
+
+void vec_add(const float * x, float k, const float * y, float * r, size_t n)
+{
+    add(x, k, y, r, n);
+}
+
+void vec_prod(const float * x, const float * y, float * r, size_t n)
+{
+    prod(x, y, r, n);
+}
+
+void vec_min(const float * x, const float * y, float * r, size_t n)
+{
+    min(x, y, r, n);
+}
+
+void vec_min(const float * x, float y, float * r, size_t n)
+{
+    min(x, y, r, n);
+}
+
+void vec_max(const float * x, const float * y, float * r, size_t n)
+{
+    max(x, y, r, n);
+}
+
+void vec_max(const float * x, float y, float * r, size_t n)
+{
+    max(x, y, r, n);
+}
+
+void vec_scale(const double * x, double k, double * r, size_t n)
+{
+    scale(x, k, r, n);
+}
+
+void vec_add(const double * x, const double * y, double * r, size_t n)
+{
+    add(x, y, r, n);
+}
+
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n)
+{
+    add(x, k, y, r, n);
+}
+
+void vec_prod(const double * x, const double * y, double * r, size_t n)
+{
+    prod(x, y, r, n);
+}
+
+void vec_min(const double * x, const double * y, double * r, size_t n)
+{
+    min(x, y, r, n);
+}
+
+void vec_min(const double * x, double y, double * r, size_t n)
+{
+    min(x, y, r, n);
+}
+
+void vec_max(const double * x, const double * y, double * r, size_t n)
+{
+    max(x, y, r, n);
+}
+
+void vec_max(const double * x, double y, double * r, size_t n)
+{
+    max(x, y, r, n);
+}
+
+} // namespace Avx512
+} // namespace SIMD
+} // namespace MLDB
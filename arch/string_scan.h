@@ -0,0 +1,157 @@
+/* string_scan.h                                                    -*- C++ -*-
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Scanning of byte strings for the characters that need special handling,
+   sixteen bytes at a time with SSE2 where it's available.
+*/
+
+#pragma once
+
+#include "mldb/compiler/compiler.h"
+#include <cstddef>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace MLDB {
+
+namespace StringScan {
+
+#ifdef __SSE2__
+
+/** Scan the full 16 byte blocks of the string, returning the position of
+    the first byte whose top bit is set by matches(), or len if there is
+    none.  done is set to the number of bytes that were scanned, so that
+    the caller can handle the bytes left over at the end.
+*/
+template<typename Matches>
+MLDB_ALWAYS_INLINE size_t scanBlocks(const char * s, size_t len,
+                                     size_t & done, Matches && matches)
+{
+    for (done = 0;  done + 16 <= len;  done += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + done));
+        int mask = _mm_movemask_epi8(matches(v));
+        if (mask)
+            return done + __builtin_ctz(mask);
+    }
+    return len;
+}
+
+#endif // __SSE2__
+
+} // namespace StringScan
+
+/** Return whether the byte can be written as it is inside a JSON string:
+    printable ASCII other than the double quote and the backslash.
+*/
+MLDB_ALWAYS_INLINE bool isJsonSafeAscii(char c)
+{
+    return c >= ' ' && c < 127 && c != '\"' && c != '\\';
+}
+
+/** Return the number of bytes at the start of the string that can be
+    written as they are inside a JSON string; see isJsonSafeAscii().
+*/
+inline size_t jsonSafeAsciiPrefix(const char * s, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    size_t found = StringScan::scanBlocks
+        (s, len, i,
+         [] (__m128i v)
+         {
+             // Bytes of 128 and over are negative, so the signed
+             // comparison picks them up along with the control characters
+             __m128i r = _mm_cmplt_epi8(v, _mm_set1_epi8(' '));
+             r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8(127)));
+             r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8('\"')));
+             r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+             return r;
+         });
+    if (found != len)
+        return found;
+#endif
+    for (;  i < len;  ++i)
+        if (!isJsonSafeAscii(s[i]))
+            return i;
+    return len;
+}
+
+/** Return the number of bytes at the start of the string that are ASCII,
+    ie under 128.
+*/
+inline size_t asciiPrefix(const char * s, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    size_t found = StringScan::scanBlocks
+        (s, len, i,
+         [] (__m128i v)
+         {
+             // The top bit of each byte is what movemask picks up
+             return v;
+         });
+    if (found != len)
+        return found;
+#endif
+    for (;  i < len;  ++i)
+        if ((unsigned char)s[i] >= 128)
+            return i;
+    return len;
+}
+
+/** Return the position of the first byte of the string that is either c1
+    or c2, or len if there is none.
+*/
+inline size_t findEither(const char * s, size_t len, char c1, char c2)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2);
+    size_t found = StringScan::scanBlocks
+        (s, len, i,
+         [&] (__m128i v)
+         {
+             return _mm_or_si128(_mm_cmpeq_epi8(v, v1),
+                                 _mm_cmpeq_epi8(v, v2));
+         });
+    if (found != len)
+        return found;
+#endif
+    for (;  i < len;  ++i)
+        if (s[i] == c1 || s[i] == c2)
+            return i;
+    return len;
+}
+
+/** Return the position of the first byte of the string that is either c1,
+    c2 or c3, or len if there is none.
+*/
+inline size_t findAnyOf(const char * s, size_t len, char c1, char c2, char c3)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2),
+        v3 = _mm_set1_epi8(c3);
+    size_t found = StringScan::scanBlocks
+        (s, len, i,
+         [&] (__m128i v)
+         {
+             __m128i r = _mm_or_si128(_mm_cmpeq_epi8(v, v1),
+                                      _mm_cmpeq_epi8(v, v2));
+             return _mm_or_si128(r, _mm_cmpeq_epi8(v, v3));
+         });
+    if (found != len)
+        return found;
+#endif
+    for (;  i < len;  ++i)
+        if (s[i] == c1 || s[i] == c2 || s[i] == c3)
+            return i;
+    return len;
+}
+
+} // namespace MLDB
@@ -12,9 +12,14 @@ $(eval $(call test,vm_test,arch,boost manual)) # latest linux path make this tes
 $(eval $(call test,info_test,arch,boost))
 $(eval $(call test,rtti_utils_test,arch,boost))
 $(eval $(call test,thread_specific_test,arch,boost))
+$(eval $(call test,metrics_test,arch,boost))
+$(eval $(call test,sampling_profiler_test,arch,boost))
+$(eval $(call test,perf_counters_test,arch,boost))
+$(eval $(call test,memory_arenas_test,arch,boost))
 $(eval $(call test,gc_test,gc,boost))
 $(eval $(call test,shared_gc_lock_test,gc,boost manual)) # broken on some environments since gc lock changes
 $(eval $(call test,rcu_protected_test,gc,boost timed))
+$(eval $(call test,epoch_lock_test,gc,boost))
 
 ifeq ($(ARCH),x86_64)
 $(eval $(call test,sse2_math_test,arch,boost))
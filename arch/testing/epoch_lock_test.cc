@@ -0,0 +1,237 @@
+/* epoch_lock_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Tests of the epoch based reclamation lock, and a benchmark of its read
+   side against GcLock.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/arch/epoch_lock.h"
+#include "mldb/arch/gc_lock.h"
+#include "mldb/arch/rcu_protected.h"
+#include "mldb/arch/exception.h"
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_defer_without_readers )
+{
+    EpochLock lock;
+    int done = 0;
+    lock.defer([&] () { ++done; });
+    // Nobody was reading, so it's run straight away
+    BOOST_CHECK_EQUAL(done, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_defer_waits_for_readers )
+{
+    EpochLock lock;
+    std::atomic<int> done(0);
+
+    std::atomic<int> stage(0);
+    std::thread reader([&] ()
+        {
+            EpochLock::SharedGuard guard(lock);
+            stage = 1;
+            while (stage != 2)
+                std::this_thread::yield();
+        });
+
+    while (stage != 1)
+        std::this_thread::yield();
+
+    lock.defer([&] () { ++done; });
+    BOOST_CHECK_EQUAL(done, 0);
+
+    // Let the reader finish; it runs the work on the way out
+    stage = 2;
+    reader.join();
+    BOOST_CHECK_EQUAL(done, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_throwing_work_run_by_reader )
+{
+    EpochLock lock;
+    int done = 0;
+    {
+        EpochLock::SharedGuard guard(lock);
+        lock.defer([] () { throw MLDB::Exception("deferred work failed"); });
+        lock.defer([&] () { ++done; });
+    }
+    // The guard ran the work as it left; the exception was logged rather
+    // than thrown from its destructor, and the rest of the work still ran
+    BOOST_CHECK_EQUAL(done, 1);
+
+    // Without a reader around, the writer runs it and gets the exception
+    BOOST_CHECK_THROW(lock.defer([] () { throw MLDB::Exception("again"); }),
+                      MLDB::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_nesting )
+{
+    EpochLock lock1, lock2;
+    int done = 0;
+
+    BOOST_CHECK(!lock1.isLockedShared());
+    {
+        EpochLock::SharedGuard guard1(lock1);
+        {
+            EpochLock::SharedGuard guard2(lock2);
+            // Deferred from within our own critical section: it can't be
+            // run until we're out of it
+            lock1.defer([&] () { ++done; });
+            BOOST_CHECK_EQUAL(done, 0);
+        }
+        BOOST_CHECK(lock1.isLockedShared());
+        BOOST_CHECK_EQUAL(done, 0);
+
+        // The epochs are shared, so a barrier would never return
+        BOOST_CHECK_THROW(lock2.visibleBarrier(), MLDB::Exception);
+    }
+
+    BOOST_CHECK(!lock1.isLockedShared());
+    BOOST_CHECK_EQUAL(done, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_visible_barrier )
+{
+    EpochLock lock;
+    std::atomic<int> stage(0);
+    std::atomic<bool> readerFinished(false);
+
+    std::thread reader([&] ()
+        {
+            {
+                EpochLock::SharedGuard guard(lock);
+                stage = 1;
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                readerFinished = true;
+            }
+        });
+
+    while (stage != 1)
+        std::this_thread::yield();
+
+    uint64_t startEpoch = EpochLock::currentEpoch();
+    lock.visibleBarrier();
+    BOOST_CHECK(readerFinished);
+    BOOST_CHECK_GE(EpochLock::currentEpoch(), startEpoch + 2);
+    reader.join();
+}
+
+BOOST_AUTO_TEST_CASE( test_rcu_protected )
+{
+    static std::atomic<int> numLive(0);
+
+    struct Counted {
+        Counted(int value) : value(value) { ++numLive; }
+        ~Counted() { --numLive; }
+        int value;
+    };
+
+    {
+        EpochLock lock;
+        RcuProtected<Counted, EpochLock> val(lock, 0);
+        std::atomic<bool> finished(false);
+        std::atomic<int> errors(0);
+
+        auto reader = [&] ()
+            {
+                while (!finished) {
+                    auto locked = val();
+                    if (locked->value < 0 || numLive == 0)
+                        ++errors;
+                }
+            };
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 0;  i < 4;  ++i)
+            threads.emplace_back(reader);
+
+        for (int i = 1;  i <= 10000;  ++i)
+            val.replace(new Counted(i));
+
+        finished = true;
+        for (auto & t: threads)
+            t.join();
+
+        BOOST_CHECK_EQUAL(errors, 0);
+        lock.deferBarrier();
+        BOOST_CHECK_EQUAL(numLive, 1);
+    }
+
+    EpochLock lock;
+    lock.deferBarrier();
+    BOOST_CHECK_EQUAL(numLive, 0);
+}
+
+namespace {
+
+/** Have each thread enter and leave a read side critical section over and
+    over, with a writer deferring work once in a while.  Returns the number
+    of critical sections per second.
+*/
+template<typename Lock>
+double benchmarkReaders(int numReaders, double seconds)
+{
+    Lock lock;
+    std::atomic<bool> finished(false);
+    std::atomic<uint64_t> numSections(0);
+
+    auto reader = [&] ()
+        {
+            uint64_t sections = 0;
+            while (!finished.load(std::memory_order_relaxed)) {
+                for (unsigned i = 0;  i < 1000;  ++i) {
+                    lock.lockShared();
+                    lock.unlockShared();
+                }
+                sections += 1000;
+            }
+            numSections += sections;
+        };
+
+    auto writer = [&] ()
+        {
+            while (!finished.load(std::memory_order_relaxed)) {
+                lock.defer([] () {});
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < numReaders;  ++i)
+        threads.emplace_back(reader);
+    threads.emplace_back(writer);
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    finished = true;
+    for (auto & t: threads)
+        t.join();
+
+    lock.deferBarrier();
+    return numSections / seconds;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( benchmark_read_side )
+{
+    int numThreads = std::max<int>(2, std::thread::hardware_concurrency());
+
+    for (int readers: { 1, numThreads / 2, numThreads }) {
+        double gc = benchmarkReaders<GcLock>(readers, 0.25);
+        double epoch = benchmarkReaders<EpochLock>(readers, 0.25);
+        cerr << readers << " readers: GcLock " << gc / 1e6
+             << "M sections/s, EpochLock " << epoch / 1e6
+             << "M sections/s" << endl;
+    }
+}
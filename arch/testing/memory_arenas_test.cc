@@ -0,0 +1,85 @@
+/* memory_arenas_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Tests of the allocator arenas.  Without jemalloc, these check that the
+   fallbacks behave like malloc.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/arch/memory_arenas.h"
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_allocate_free )
+{
+    cerr << "memory arenas are "
+         << (memoryArenasEnabled() ? "enabled" : "disabled") << endl;
+
+    for (int i = 0;  i < NUM_MEMORY_ARENAS;  ++i) {
+        MemoryArena arena = (MemoryArena)i;
+        BOOST_CHECK_NE(string(memoryArenaName(arena)), "unknown");
+
+        std::vector<void *> blocks;
+        for (size_t size: { 1, 16, 1000, 100000, 10000000 }) {
+            void * mem = arenaAllocate(arena, size);
+            BOOST_REQUIRE(mem);
+            BOOST_CHECK_EQUAL((uintptr_t)mem % 8, 0);
+            memset(mem, i, size);
+            blocks.push_back(mem);
+        }
+        for (void * mem: blocks)
+            arenaFree(arena, mem);
+        arenaFree(arena, nullptr);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_stats )
+{
+    const size_t size = 64 * 1024 * 1024;
+
+    refreshMemoryArenaStats();
+    MemoryArenaStats before = getMemoryArenaStats(MEMORY_ARENA_FROZEN);
+
+    void * mem = arenaAllocate(MEMORY_ARENA_FROZEN, size);
+    memset(mem, 1, size);
+    refreshMemoryArenaStats();
+    MemoryArenaStats during = getMemoryArenaStats(MEMORY_ARENA_FROZEN);
+
+    arenaFree(MEMORY_ARENA_FROZEN, mem);
+    purgeMemoryArena(MEMORY_ARENA_FROZEN);
+    refreshMemoryArenaStats();
+    MemoryArenaStats after = getMemoryArenaStats(MEMORY_ARENA_FROZEN);
+
+    if (!memoryArenasEnabled()) {
+        BOOST_CHECK_EQUAL(during.allocatedBytes, 0);
+        return;
+    }
+
+    BOOST_CHECK_GE(during.allocatedBytes, before.allocatedBytes + size);
+    BOOST_CHECK_LT(after.allocatedBytes, during.allocatedBytes);
+    BOOST_CHECK_LT(after.dirtyBytes, size);
+}
+
+BOOST_AUTO_TEST_CASE( test_bind_thread )
+{
+    // What's allocated on a bound thread can be freed anywhere
+    void * mem = nullptr;
+    std::thread thread([&] ()
+        {
+            bindThreadToArena(MEMORY_ARENA_QUERY);
+            mem = malloc(1000);
+        });
+    thread.join();
+    BOOST_REQUIRE(mem);
+    free(mem);
+
+    purgeAllMemoryArenas();
+}
@@ -0,0 +1,183 @@
+/* metrics_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Tests of the internal metrics and of their exposition, and a benchmark
+   of the cost of recording.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/arch/metrics.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/exception_handler.h"
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_counter_threads )
+{
+    MetricCounter counter;
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < 4;  ++i) {
+        threads.emplace_back([&] ()
+            {
+                for (int j = 0;  j < 100000;  ++j)
+                    counter.add();
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+    counter.add(5);
+    BOOST_CHECK_EQUAL(counter.value(), 400005);
+}
+
+BOOST_AUTO_TEST_CASE( test_histogram_buckets )
+{
+    // Small values have a bucket each
+    for (int i = 0;  i < MetricHistogram::SUB_BUCKETS;  ++i) {
+        BOOST_CHECK_EQUAL(MetricHistogram::bucketOf(i), i);
+        BOOST_CHECK_EQUAL(MetricHistogram::bucketLowerBound(i), i);
+    }
+
+    // Buckets are contiguous and each value is within its bucket
+    for (int b = 0;  b < MetricHistogram::NUM_BUCKETS - 1;  ++b) {
+        uint64_t lower = MetricHistogram::bucketLowerBound(b);
+        uint64_t upper = MetricHistogram::bucketLowerBound(b + 1);
+        BOOST_REQUIRE_GT(upper, lower);
+        BOOST_CHECK_EQUAL(MetricHistogram::bucketOf(lower), b);
+        BOOST_CHECK_EQUAL(MetricHistogram::bucketOf(upper - 1), b);
+        // Relative resolution is 1/16th
+        BOOST_CHECK_LE((upper - lower) * 16, std::max<uint64_t>(lower, 16));
+    }
+
+    // Large values go into the last bucket
+    BOOST_CHECK_EQUAL(MetricHistogram::bucketOf(uint64_t(1) << 50),
+                      MetricHistogram::NUM_BUCKETS - 1);
+    BOOST_CHECK_EQUAL(MetricHistogram::bucketOf(-1),
+                      MetricHistogram::NUM_BUCKETS - 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_histogram_quantiles )
+{
+    MetricHistogram histogram;
+    for (int i = 1;  i <= 10000;  ++i)
+        histogram.record(i * 1000);
+
+    auto snapshot = histogram.snapshot();
+    BOOST_CHECK_EQUAL(snapshot.count, 10000);
+    BOOST_CHECK_EQUAL(snapshot.sum, 1000ULL * 10000 * 10001 / 2);
+
+    for (double q: { 0.5, 0.9, 0.99 }) {
+        double expected = q * 10000 * 1000;
+        double found = snapshot.quantile(q);
+        BOOST_CHECK_LE(std::abs(found - expected), expected / 16);
+    }
+
+    BOOST_CHECK_EQUAL(snapshot.countBelowPowerOfTwo(10), 1);  // 1000
+    BOOST_CHECK_EQUAL(snapshot.countBelowPowerOfTwo(20), 1048);
+    BOOST_CHECK_EQUAL(snapshot.countBelowPowerOfTwo(60), 10000);
+}
+
+BOOST_AUTO_TEST_CASE( test_exposition )
+{
+    MetricsRegistry registry;
+
+    auto & requests = registry.counter("test_requests_total",
+                                       "Number of requests",
+                                       { { "method", "GET" } });
+    requests.add(3);
+    // Looking it up again gives the same counter
+    BOOST_CHECK_EQUAL(&registry.counter("test_requests_total", "",
+                                        { { "method", "GET" } }),
+                      &requests);
+    registry.counter("test_requests_total", "", { { "method", "PUT" } })
+        .add(1);
+
+    auto & latency = registry.histogram("test_latency_seconds",
+                                        "Latency of \"requests\"",
+                                        { }, 1e-9, 10, 20, 5);
+    latency.record(500);
+    latency.record(100000);
+    latency.record(1u << 30);
+
+    int depth = 7;
+    uint64_t gauge = registry.addGauge("test_queue_depth", "Queue depth",
+                                       { { "queue", "a\"b\\c" } },
+                                       [&] () { return depth; });
+
+    std::string text = registry.exposition();
+    cerr << text;
+
+    auto contains = [&] (const std::string & line)
+        {
+            return text.find(line + "\n") != std::string::npos;
+        };
+
+    BOOST_CHECK(contains("# HELP test_requests_total Number of requests"));
+    BOOST_CHECK(contains("# TYPE test_requests_total counter"));
+    BOOST_CHECK(contains("test_requests_total{method=\"GET\"} 3"));
+    BOOST_CHECK(contains("test_requests_total{method=\"PUT\"} 1"));
+
+    BOOST_CHECK(contains("# TYPE test_latency_seconds histogram"));
+    BOOST_CHECK(contains("test_latency_seconds_bucket{le=\"1.023e-06\"} 1"));
+    BOOST_CHECK(contains("test_latency_seconds_bucket{le=\"3.2767e-05\"} 1"));
+    BOOST_CHECK(contains("test_latency_seconds_bucket{le=\"0.001048575\"} 2"));
+    BOOST_CHECK(contains("test_latency_seconds_bucket{le=\"+Inf\"} 3"));
+    BOOST_CHECK(contains("test_latency_seconds_count 3"));
+
+    BOOST_CHECK(contains("# TYPE test_queue_depth gauge"));
+    BOOST_CHECK(contains("test_queue_depth{queue=\"a\\\"b\\\\c\"} 7"));
+
+    depth = 9;
+    BOOST_CHECK(registry.exposition().find("} 9\n") != std::string::npos);
+
+    // A name can't change its type
+    {
+        MLDB_TRACE_EXCEPTIONS(false);
+        BOOST_CHECK_THROW(registry.histogram("test_requests_total", ""),
+                          MLDB::Exception);
+    }
+
+    registry.removeGauge(gauge);
+    BOOST_CHECK_EQUAL(registry.exposition().find("test_queue_depth"),
+                      std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_recording )
+{
+    MetricCounter counter;
+    MetricHistogram histogram;
+
+    static constexpr int N = 10000000;
+
+    auto time = [] (const std::function<void ()> & fn)
+        {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            return std::chrono::duration<double, std::nano>
+                (std::chrono::steady_clock::now() - start).count() / N;
+        };
+
+    double counterNs = time([&] ()
+        {
+            for (int i = 0;  i < N;  ++i)
+                counter.add();
+        });
+    double histogramNs = time([&] ()
+        {
+            for (int i = 0;  i < N;  ++i)
+                histogram.record(i);
+        });
+
+    cerr << "counter: " << counterNs << "ns per add" << endl;
+    cerr << "histogram: " << histogramNs << "ns per record" << endl;
+
+    BOOST_CHECK_EQUAL(counter.value(), N);
+    BOOST_CHECK_EQUAL(histogram.snapshot().count, N);
+}
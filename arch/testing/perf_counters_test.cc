@@ -0,0 +1,93 @@
+/* perf_counters_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Tests of the hardware performance counters.  Most virtual machines don't
+   expose them; these then check that nothing is counted rather than
+   failing.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/arch/perf_counters.h"
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+/// Work that can't be optimized out
+uint64_t spin(uint64_t n)
+{
+    volatile uint64_t total = 0;
+    for (uint64_t i = 0;  i < n;  ++i)
+        total += i;
+    return total;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_thread_counters )
+{
+    const PerfCounterGroup & group = PerfCounterGroup::forThisThread();
+    BOOST_CHECK_EQUAL(group.valid(), PerfCounterGroup::available());
+
+    PerfCounts before = group.read();
+    spin(10000000);
+    PerfCounts counts = group.read() - before;
+
+    if (!PerfCounterGroup::available()) {
+        cerr << "hardware counters aren't available" << endl;
+        BOOST_CHECK_EQUAL(counts.instructions, 0);
+        BOOST_CHECK_EQUAL(counts.cycles, 0);
+        return;
+    }
+
+    cerr << counts.instructions << " instructions, " << counts.cycles
+         << " cycles, " << counts.ipc() << " IPC" << endl;
+    BOOST_CHECK_GT(counts.instructions, 10000000);
+    BOOST_CHECK_GT(counts.cycles, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_process_counters )
+{
+    // A thread that exists before the counters are opened is counted,
+    // including after it exits
+    std::atomic<bool> go(false);
+    std::thread thread([&] ()
+        {
+            while (!go)
+                std::this_thread::yield();
+            spin(10000000);
+        });
+
+    ProcessPerfCounters counters;
+    BOOST_CHECK_EQUAL(counters.valid(), PerfCounterGroup::available());
+
+    go = true;
+    thread.join();
+
+    PerfCounts counts = counters.read();
+    if (!counters.valid()) {
+        BOOST_CHECK_EQUAL(counts.instructions, 0);
+        return;
+    }
+    BOOST_CHECK_GT(counts.instructions, 10000000);
+}
+
+BOOST_AUTO_TEST_CASE( test_difference )
+{
+    PerfCounts c1, c2;
+    c1.instructions = 10;
+    c2.instructions = 15;
+    c2.cycles = 5;
+    PerfCounts d = c2 - c1;
+    BOOST_CHECK_EQUAL(d.instructions, 5);
+    BOOST_CHECK_EQUAL(d.cycles, 5);
+    BOOST_CHECK_EQUAL((c1 - c2).instructions, 0);
+    BOOST_CHECK_EQUAL(d.ipc(), 1.0);
+}
@@ -0,0 +1,85 @@
+/* sampling_profiler_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the sampling profiler.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/arch/sampling_profiler.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/exception_handler.h"
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace MLDB;
+
+std::atomic<bool> finished(false);
+std::atomic<double> total(0);
+
+void __attribute__((noinline)) spinTaggedLoop()
+{
+    double result = 0;
+    for (int i = 0;  !finished;  ++i)
+        result += std::sqrt(i);
+    total = result;
+}
+
+BOOST_AUTO_TEST_CASE( test_tagged_samples )
+{
+    std::thread worker([] ()
+        {
+            SampleTagScope scope(std::make_shared<std::string>("query test"));
+            spinTaggedLoop();
+        });
+
+    SamplingProfile profile = SamplingProfiler::run(0.5, 200);
+    finished = true;
+    worker.join();
+
+    cerr << profile.folded();
+
+    BOOST_CHECK_GT(profile.numSamples, 10);
+    BOOST_CHECK_EQUAL(profile.numDropped, 0);
+    BOOST_CHECK(!SamplingProfiler::running());
+
+    // The worker was busy the whole time, so its stack is the most common
+    BOOST_REQUIRE(!profile.stacks.empty());
+    const std::string & stack = profile.stacks[0].first;
+    BOOST_CHECK_EQUAL(stack.find("query test;"), 0);
+    BOOST_CHECK_NE(stack.find("spinTaggedLoop"), std::string::npos);
+    // The signal handler isn't part of the stack
+    BOOST_CHECK_EQUAL(stack.find("onProfilingSignal"), std::string::npos);
+
+    uint64_t counted = 0;
+    for (auto & s: profile.stacks)
+        counted += s.second;
+    BOOST_CHECK_EQUAL(counted, profile.numSamples);
+}
+
+BOOST_AUTO_TEST_CASE( test_tag_scopes_nest )
+{
+    BOOST_CHECK(!SampleTagScope::current());
+    auto outer = std::make_shared<std::string>("procedure p");
+    {
+        SampleTagScope scope1(outer);
+        {
+            SampleTagScope scope2(std::make_shared<std::string>("query q"));
+            BOOST_CHECK_EQUAL(*SampleTagScope::current(), "query q");
+        }
+        BOOST_CHECK_EQUAL(SampleTagScope::current(), outer);
+    }
+    BOOST_CHECK(!SampleTagScope::current());
+}
+
+BOOST_AUTO_TEST_CASE( test_bad_arguments )
+{
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(SamplingProfiler::run(0), MLDB::Exception);
+    BOOST_CHECK_THROW(SamplingProfiler::run(1, 0), MLDB::Exception);
+}
@@ -14,6 +14,9 @@
 #include "mldb/arch/simd_vector.h"
 #include "mldb/arch/demangle.h"
 #include "mldb/arch/tick_counter.h"
+#if MLDB_INTEL_ISA
+# include "mldb/arch/simd_vector_avx.h"
+#endif
 
 #include <boost/test/unit_test.hpp>
 #include <boost/test/floating_point_comparison.hpp>
@@ -21,6 +24,7 @@
 #include <set>
 #include <iostream>
 #include <cmath>
+#include <functional>
 
 
 using namespace MLDB;
@@ -93,3 +97,103 @@ BOOST_AUTO_TEST_CASE( benchmark )
              << endl;
     }
 }
+
+#if MLDB_INTEL_ISA
+
+/** Minimum number of cycles per element of the given kernel over nvals
+    elements. */
+double cycles_per_element(int nvals, const std::function<void ()> & kernel)
+{
+    double best = INFINITY;
+    for (unsigned i = 0;  i < 100;  ++i) {
+        uint64_t t0 = ticks();
+        kernel();
+        uint64_t t1 = ticks();
+        best = std::min<double>(best, t1 - t0);
+    }
+    return best / nvals;
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_elementwise )
+{
+    for (int nvals: { 16, 256, 4096, 65536, 1000000 }) {
+        cerr << "nvals = " << nvals << endl;
+
+        vector<float> x(nvals), y(nvals), r(nvals);
+        for (unsigned i = 0; i < nvals;  ++i) {
+            x[i] = rand() / 16384.0;
+            y[i] = rand() / 16384.0;
+        }
+
+        float k = 0.5;
+        const float * xp = x.data(), * yp = y.data();
+        float * rp = r.data();
+
+        typedef std::function<void ()> Kernel;
+
+        auto report = [&] (const char * name, Kernel generic, Kernel dispatched,
+                           Kernel avx2, Kernel avx512)
+            {
+                cerr << "  " << name << " cycles/op: generic "
+                     << cycles_per_element(nvals, generic)
+                     << " dispatched " << cycles_per_element(nvals, dispatched);
+                if (has_avx2() && has_fma())
+                    cerr << " avx2 " << cycles_per_element(nvals, avx2);
+                if (has_avx512f())
+                    cerr << " avx512 " << cycles_per_element(nvals, avx512);
+                cerr << endl;
+            };
+
+        report("add_k",
+               [&] ()
+               {
+                   for (int i = 0;  i < nvals;  ++i)
+                       rp[i] = xp[i] + k * yp[i];
+               },
+               [&] () { SIMD::vec_add(xp, k, yp, rp, nvals); },
+               [&] () { SIMD::Avx2::vec_add(xp, k, yp, rp, nvals); },
+               [&] () { SIMD::Avx512::vec_add(xp, k, yp, rp, nvals); });
+        report("prod",
+               [&] ()
+               {
+                   for (int i = 0;  i < nvals;  ++i)
+                       rp[i] = xp[i] * yp[i];
+               },
+               [&] () { SIMD::vec_prod(xp, yp, rp, nvals); },
+               [&] () { SIMD::Avx2::vec_prod(xp, yp, rp, nvals); },
+               [&] () { SIMD::Avx512::vec_prod(xp, yp, rp, nvals); });
+        report("scale",
+               [&] ()
+               {
+                   for (int i = 0;  i < nvals;  ++i)
+                       rp[i] = xp[i] * k;
+               },
+               [&] () { SIMD::vec_scale(xp, k, rp, nvals); },
+               [&] () { SIMD::Avx2::vec_scale(xp, k, rp, nvals); },
+               [&] () { SIMD::Avx512::vec_scale(xp, k, rp, nvals); });
+        report("max",
+               [&] ()
+               {
+                   for (int i = 0;  i < nvals;  ++i)
+                       rp[i] = std::max(xp[i], yp[i]);
+               },
+               [&] () { SIMD::vec_max(xp, yp, rp, nvals); },
+               [&] () { SIMD::Avx2::vec_max(xp, yp, rp, nvals); },
+               [&] () { SIMD::Avx512::vec_max(xp, yp, rp, nvals); });
+
+        double dot = 0.0;
+        report("dotprod",
+               [&] ()
+               {
+                   double d = 0.0;
+                   for (int i = 0;  i < nvals;  ++i)
+                       d += xp[i] * yp[i];
+                   dot += d;
+               },
+               [&] () { dot += SIMD::vec_dotprod(xp, yp, nvals); },
+               [&] () { dot += SIMD::Avx2::vec_dotprod_dp(xp, yp, nvals); },
+               [&] () { dot += SIMD::Avx512::vec_dotprod_dp(xp, yp, nvals); });
+        BOOST_CHECK(dot > 0.0);
+    }
+}
+#endif // MLDB_INTEL_ISA
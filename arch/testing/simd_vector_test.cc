@@ -21,6 +21,7 @@
 #include <set>
 #include <iostream>
 #include <cmath>
+#include <functional>
 
 
 using namespace MLDB;
@@ -321,6 +322,52 @@ double vec_dotprod(const float * x, const float * y, size_t n);
 double vec_dotprod_dp(const float * x, const float * y, size_t n);
 double vec_dotprod(const double * x, const double * y, size_t n);
 } // namespace Avx
+namespace Avx2 {
+double vec_dotprod_dp(const float * x, const float * y, size_t n);
+double vec_euclid(const float * x, const float * y, size_t n);
+void vec_dotprod_norms_dp(const float * x, const float * y, size_t n,
+                          double & xy, double & xx, double & yy);
+void vec_scale(const float * x, float k, float * r, size_t n);
+void vec_add(const float * x, const float * y, float * r, size_t n);
+void vec_add(const float * x, float k, const float * y, float * r, size_t n);
+void vec_prod(const float * x, const float * y, float * r, size_t n);
+void vec_min(const float * x, const float * y, float * r, size_t n);
+void vec_min(const float * x, float y, float * r, size_t n);
+void vec_max(const float * x, const float * y, float * r, size_t n);
+void vec_max(const float * x, float y, float * r, size_t n);
+void vec_scale(const double * x, double k, double * r, size_t n);
+void vec_add(const double * x, const double * y, double * r, size_t n);
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n);
+void vec_prod(const double * x, const double * y, double * r, size_t n);
+void vec_min(const double * x, const double * y, double * r, size_t n);
+void vec_min(const double * x, double y, double * r, size_t n);
+void vec_max(const double * x, const double * y, double * r, size_t n);
+void vec_max(const double * x, double y, double * r, size_t n);
+} // namespace Avx2
+namespace Avx512 {
+double vec_dotprod_dp(const float * x, const float * y, size_t n);
+double vec_euclid(const float * x, const float * y, size_t n);
+void vec_dotprod_norms_dp(const float * x, const float * y, size_t n,
+                          double & xy, double & xx, double & yy);
+void vec_scale(const float * x, float k, float * r, size_t n);
+void vec_add(const float * x, const float * y, float * r, size_t n);
+void vec_add(const float * x, float k, const float * y, float * r, size_t n);
+void vec_prod(const float * x, const float * y, float * r, size_t n);
+void vec_min(const float * x, const float * y, float * r, size_t n);
+void vec_min(const float * x, float y, float * r, size_t n);
+void vec_max(const float * x, const float * y, float * r, size_t n);
+void vec_max(const float * x, float y, float * r, size_t n);
+void vec_scale(const double * x, double k, double * r, size_t n);
+void vec_add(const double * x, const double * y, double * r, size_t n);
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n);
+void vec_prod(const double * x, const double * y, double * r, size_t n);
+void vec_min(const double * x, const double * y, double * r, size_t n);
+void vec_min(const double * x, double y, double * r, size_t n);
+void vec_max(const double * x, const double * y, double * r, size_t n);
+void vec_max(const double * x, double y, double * r, size_t n);
+} // namespace Avx512
 } // namespace SIMD
 } // namespace MLDB
 
@@ -896,3 +943,188 @@ BOOST_AUTO_TEST_CASE( vec_min_max_el_test )
     }
 }
 
+
+template<typename F>
+struct Elementwise_Kernels {
+    void (*scale) (const F *, F, F *, size_t);
+    void (*add) (const F *, const F *, F *, size_t);
+    void (*add_k) (const F *, F, const F *, F *, size_t);
+    void (*prod) (const F *, const F *, F *, size_t);
+    void (*min) (const F *, const F *, F *, size_t);
+    void (*min_k) (const F *, F, F *, size_t);
+    void (*max) (const F *, const F *, F *, size_t);
+    void (*max_k) (const F *, F, F *, size_t);
+};
+
+template<typename F>
+void elementwise_kernels_test_case(const char * isa,
+                                   const Elementwise_Kernels<F> & kernels,
+                                   int nvals)
+{
+    cerr << "testing " << isa << " elementwise kernels with " << nvals
+         << endl;
+
+    // Some NaNs, to check that min and max treat them like std::min and
+    // std::max do
+    vector<F> x(nvals), y(nvals);
+    for (unsigned i = 0; i < nvals;  ++i) {
+        x[i] = i % 7 == 3 ? NAN : rand() / 16384.0 - 65536.0;
+        y[i] = i % 5 == 1 ? NAN : rand() / 16384.0 - 65536.0;
+    }
+    F k = 1.37;
+
+    // One more than needed, to check that nothing is written past the end
+    vector<F> r(nvals + 1), expected(nvals);
+
+    auto check = [&] (const char * kernel)
+        {
+            for (unsigned i = 0;  i < nvals;  ++i) {
+                if (std::isnan(expected[i]) && std::isnan(r[i]))
+                    continue;
+                BOOST_CHECK_MESSAGE(r[i] == expected[i],
+                                    kernel << " at " << i << ": " << r[i]
+                                    << " != " << expected[i]);
+            }
+            BOOST_CHECK_EQUAL(r[nvals], 42);
+        };
+
+    auto run = [&] (const char * kernel, std::function<void ()> doKernel,
+                    std::function<F (unsigned)> element)
+        {
+            r[nvals] = 42;
+            for (unsigned i = 0;  i < nvals;  ++i)
+                expected[i] = element(i);
+            doKernel();
+            check(kernel);
+        };
+
+    run("scale", [&] () { kernels.scale(x.data(), k, r.data(), nvals); },
+        [&] (unsigned i) { return x[i] * k; });
+    run("add", [&] () { kernels.add(x.data(), y.data(), r.data(), nvals); },
+        [&] (unsigned i) { return x[i] + y[i]; });
+    run("add_k",
+        [&] () { kernels.add_k(x.data(), k, y.data(), r.data(), nvals); },
+        [&] (unsigned i) { return x[i] + k * y[i]; });
+    run("prod", [&] () { kernels.prod(x.data(), y.data(), r.data(), nvals); },
+        [&] (unsigned i) { return x[i] * y[i]; });
+    run("min", [&] () { kernels.min(x.data(), y.data(), r.data(), nvals); },
+        [&] (unsigned i) { return std::min(x[i], y[i]); });
+    run("min_k", [&] () { kernels.min_k(x.data(), k, r.data(), nvals); },
+        [&] (unsigned i) { return std::min(x[i], k); });
+    run("max", [&] () { kernels.max(x.data(), y.data(), r.data(), nvals); },
+        [&] (unsigned i) { return std::max(x[i], y[i]); });
+    run("max_k", [&] () { kernels.max_k(x.data(), k, r.data(), nvals); },
+        [&] (unsigned i) { return std::max(x[i], k); });
+
+    // In place, as the distribution operators do on temporaries
+    vector<F> inPlace = x;
+    kernels.add(inPlace.data(), y.data(), inPlace.data(), nvals);
+    for (unsigned i = 0;  i < nvals;  ++i)
+        BOOST_CHECK(inPlace[i] == x[i] + y[i]
+                    || (std::isnan(inPlace[i]) && std::isnan(x[i] + y[i])));
+}
+
+template<typename F>
+void elementwise_kernels_test(int nvals)
+{
+    Elementwise_Kernels<F> generic = {
+        SIMD::vec_scale, SIMD::vec_add, SIMD::vec_add, SIMD::vec_prod,
+        SIMD::vec_min, SIMD::vec_min, SIMD::vec_max, SIMD::vec_max };
+    elementwise_kernels_test_case("generic", generic, nvals);
+
+#if MLDB_INTEL_ISA
+    if (MLDB::has_avx2() && MLDB::has_fma()) {
+        Elementwise_Kernels<F> avx2 = {
+            SIMD::Avx2::vec_scale, SIMD::Avx2::vec_add, SIMD::Avx2::vec_add,
+            SIMD::Avx2::vec_prod, SIMD::Avx2::vec_min, SIMD::Avx2::vec_min,
+            SIMD::Avx2::vec_max, SIMD::Avx2::vec_max };
+        elementwise_kernels_test_case("avx2", avx2, nvals);
+    }
+    if (MLDB::has_avx512f()) {
+        Elementwise_Kernels<F> avx512 = {
+            SIMD::Avx512::vec_scale, SIMD::Avx512::vec_add,
+            SIMD::Avx512::vec_add, SIMD::Avx512::vec_prod,
+            SIMD::Avx512::vec_min, SIMD::Avx512::vec_min,
+            SIMD::Avx512::vec_max, SIMD::Avx512::vec_max };
+        elementwise_kernels_test_case("avx512", avx512, nvals);
+    }
+#endif
+}
+
+BOOST_AUTO_TEST_CASE( vec_elementwise_kernels_test )
+{
+    for(auto x : {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 123}) {
+        elementwise_kernels_test<float>(x);
+        elementwise_kernels_test<double>(x);
+    }
+}
+
+void distance_kernels_test_case(int nvals)
+{
+    cerr << "nvals = " << nvals << endl;
+
+    float x[nvals], y[nvals];
+    double xy = 0.0, xx = 0.0, yy = 0.0, euclid = 0.0;
+
+    for (unsigned i = 0; i < nvals;  ++i) {
+        x[i] = rand() / 16384.0;
+        y[i] = rand() / 16384.0;
+        xy += (double)x[i] * y[i];
+        xx += (double)x[i] * x[i];
+        yy += (double)y[i] * y[i];
+        euclid += ((double)x[i] - y[i]) * ((double)x[i] - y[i]);
+    }
+
+    auto check = [&] (const char * isa,
+                      double (*dotprod) (const float *, const float *, size_t),
+                      double (*euc) (const float *, const float *, size_t),
+                      void (*norms) (const float *, const float *, size_t,
+                                     double &, double &, double &))
+        {
+            cerr << "  " << isa << endl;
+            BOOST_CHECK_CLOSE(dotprod(x, y, nvals), xy, 1e-4);
+            BOOST_CHECK_CLOSE(euc(x, y, nvals), euclid, 1e-2);
+            BOOST_CHECK_EQUAL(euc(x, x, nvals), 0.0);
+
+            double xy2 = -1, xx2 = -1, yy2 = -1;
+            norms(x, y, nvals, xy2, xx2, yy2);
+            BOOST_CHECK_CLOSE(xy2, xy, 1e-4);
+            BOOST_CHECK_CLOSE(xx2, xx, 1e-4);
+            BOOST_CHECK_CLOSE(yy2, yy, 1e-4);
+        };
+
+    check("generic", SIMD::vec_dotprod_dp, SIMD::vec_euclid,
+          SIMD::vec_dotprod_norms_dp);
+#if MLDB_INTEL_ISA
+    if (MLDB::has_avx2() && MLDB::has_fma())
+        check("avx2", SIMD::Avx2::vec_dotprod_dp, SIMD::Avx2::vec_euclid,
+              SIMD::Avx2::vec_dotprod_norms_dp);
+    if (MLDB::has_avx512f())
+        check("avx512", SIMD::Avx512::vec_dotprod_dp, SIMD::Avx512::vec_euclid,
+              SIMD::Avx512::vec_dotprod_norms_dp);
+#endif
+
+    BOOST_CHECK_LE(fabs(SIMD::vec_cosine_distance(x, y, nvals)
+                        - std::max(1.0 - xy / sqrt(xx * yy), 0.0)), 1e-6);
+    BOOST_CHECK_LE(SIMD::vec_cosine_distance(x, x, nvals), 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE( vec_distance_kernels_test )
+{
+    for(auto x : {1, 2, 3, 4, 5, 6, 8, 9, 12, 15, 16, 17, 31, 32, 33, 64, 123}) {
+        distance_kernels_test_case(x);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( vec_cosine_distance_zero_test )
+{
+    float zero[5] = { 0, 0, 0, 0, 0 };
+    float one[5] = { 1, 0, 0, 0, 0 };
+    float minusOne[5] = { -1, 0, 0, 0, 0 };
+
+    BOOST_CHECK_EQUAL(SIMD::vec_cosine_distance(zero, zero, 5), 0.0);
+    BOOST_CHECK_EQUAL(SIMD::vec_cosine_distance(zero, one, 5), 1.0);
+    BOOST_CHECK_EQUAL(SIMD::vec_cosine_distance(one, zero, 5), 1.0);
+    BOOST_CHECK_EQUAL(SIMD::vec_cosine_distance(one, one, 5), 0.0);
+    BOOST_CHECK_EQUAL(SIMD::vec_cosine_distance(one, minusOne, 5), 2.0);
+}
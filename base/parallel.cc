@@ -27,14 +27,21 @@ void parallelMap(size_t first, size_t last,
     std::mutex exc_mutex;
     std::exception_ptr exc;
 
-    // This creates a thread pool that runs jobs on the default thread pool
-    ThreadPool tp;
-
     if (occupancyLimit == -1)
         occupancyLimit = numCpus();
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
+    // Fast path: with only one thread, skip the thread pool entirely
+    if (occupancyLimit <= 1) {
+        for (size_t i = first;  i < last;  ++i)
+            doWork(i);
+        return;
+    }
+
+    // This creates a thread pool that runs jobs on the default thread pool
+    ThreadPool tp;
+
     auto worker = [&] ()
         {
             while (!hasException.load(std::memory_order_relaxed)) {
@@ -79,14 +86,23 @@ bool parallelMapHaltable(size_t first, size_t last,
     std::mutex exc_mutex;
     std::exception_ptr exc;
 
-    // This creates a thread pool that runs jobs on the default thread pool
-    ThreadPool tp;
-
     if (occupancyLimit == -1)
         occupancyLimit = numCpus();
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
+    // Fast path: with only one thread, skip the thread pool entirely
+    if (occupancyLimit <= 1) {
+        for (size_t i = first;  i < last;  ++i) {
+            if (!doWork(i))
+                return false;
+        }
+        return true;
+    }
+
+    // This creates a thread pool that runs jobs on the default thread pool
+    ThreadPool tp;
+
     auto worker = [&] ()
         {
             while (!stop.load(std::memory_order_relaxed)
@@ -139,14 +155,21 @@ void parallelMapChunked(size_t first, size_t last, size_t chunkSize,
     std::mutex exc_mutex;
     std::exception_ptr exc;
 
-    // This creates a thread pool that runs jobs on the default thread pool
-    ThreadPool tp;
-    
     if (occupancyLimit == -1)
         occupancyLimit = numCpus();
     if (occupancyLimit > (last - first + chunkSize - 1) / chunkSize)
         occupancyLimit = (last - first + chunkSize - 1) / chunkSize;
 
+    // Fast path: with only one thread, skip the thread pool entirely
+    if (occupancyLimit <= 1) {
+        for (size_t i = first;  i < last;  i += chunkSize)
+            doWork(i, std::min(last, i + chunkSize));
+        return;
+    }
+
+    // This creates a thread pool that runs jobs on the default thread pool
+    ThreadPool tp;
+
     auto worker = [&] ()
         {
             while (!hasException.load(std::memory_order_relaxed)) {
@@ -105,6 +105,41 @@ BOOST_AUTO_TEST_CASE (thread_pool_startup_shutdown_zero_threads)
     BOOST_CHECK_EQUAL(threadPool.jobsRunning(), 0);
 }
 
+BOOST_AUTO_TEST_CASE (thread_pool_zero_threads_runs_inline)
+{
+    ThreadPool threadPool(0);
+
+    int jobsRun = 0;
+    threadPool.add([&] () { ++jobsRun; });
+
+    // With no threads, the job is run before add() returns
+    BOOST_CHECK_EQUAL(jobsRun, 1);
+    BOOST_CHECK_EQUAL(threadPool.jobsRunInline(), 1);
+    BOOST_CHECK_EQUAL(threadPool.jobsRunning(), 0);
+    BOOST_CHECK_EQUAL(threadPool.queueDepth(), 0);
+}
+
+BOOST_AUTO_TEST_CASE (thread_pool_stats)
+{
+    ThreadPool threadPool(2);
+
+    // Let the threads sleep for long enough to wake up at least once, which
+    // is when their idle time is accounted for
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    BOOST_CHECK_GT(threadPool.idleSeconds(), 0.0);
+
+    std::atomic<int> jobsRun(0);
+    for (unsigned i = 0;  i < 1000;  ++i)
+        threadPool.add([&] () { ++jobsRun; });
+    threadPool.waitForAll();
+
+    BOOST_CHECK_EQUAL(jobsRun, 1000);
+    BOOST_CHECK_EQUAL(threadPool.queueDepth(), 0);
+    BOOST_CHECK_EQUAL(threadPool.jobsRunInline(), 0);
+    BOOST_CHECK_EQUAL(threadPool.jobsRunLocally() + threadPool.jobsStolen()
+                      + threadPool.jobsWithFullQueue(), 1000);
+}
+
 //Failing depending on availability of cores...
 BOOST_AUTO_TEST_CASE (thread_pool_no_busy_looping)
 {
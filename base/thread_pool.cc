@@ -11,12 +11,19 @@
 #include "thread_pool_impl.h"
 #include "mldb/arch/thread_specific.h"
 #include "mldb/arch/demangle.h"
+#include "mldb/arch/sampling_profiler.h"
+#include "mldb/arch/memory_arenas.h"
+#include "mldb/compiler/compiler.h"
 #include "mldb/jml/utils/environment.h"
 #include <atomic>
 #include <condition_variable>
 #include <vector>
 #include <thread>
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
 
 
 using namespace std;
@@ -32,6 +39,15 @@ int numCpus()
     return NUM_CPUS;
 }
 
+// Number of thread pool jobs that the thread is running, as jobs can run
+// other jobs while waiting for them
+static thread_local int jobDepth = 0;
+
+// Pin each worker thread of a thread pool to a single core, to keep its
+// caches warm.  Only worth doing when the machine is dedicated to us.
+static EnvOption<bool, true /* trace */>
+MLDB_THREAD_POOL_PIN_THREADS("MLDB_THREAD_POOL_PIN_THREADS", false);
+
 /*****************************************************************************/
 /* THREAD POOL                                                               */
 /*****************************************************************************/
@@ -129,6 +145,10 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
 
     /// Statistics counters for debugging and information
     std::atomic<uint64_t> jobsStolen, jobsWithFullQueue, jobsRunLocally;
+    std::atomic<uint64_t> jobsRunInline;
+
+    /// Total time that worker threads have spent asleep waiting for work
+    std::atomic<uint64_t> idleNanoseconds;
 
     /// Non-zero when we're shutting down.
     std::atomic<int> shutdown;
@@ -195,6 +215,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         : jobsStolen(0),
           jobsWithFullQueue(0),
           jobsRunLocally(0),
+          jobsRunInline(0),
+          idleNanoseconds(0),
           shutdown(0),
           threadsSleeping(0),
           threadCreationEpoch(0),
@@ -208,6 +230,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
 
         for (unsigned i = 0;  i < numThreads;  ++i) {
             workers.emplace_back([this, i] () { this->runWorker(i); });
+            if (MLDB_THREAD_POOL_PIN_THREADS)
+                pinThread(workers.back(), i);
         }
 
         getEntry();
@@ -217,6 +241,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         : jobsStolen(0),
           jobsWithFullQueue(0),
           jobsRunLocally(0),
+          jobsRunInline(0),
+          idleNanoseconds(0),
           shutdown(0),
           threadsSleeping(0),
           threadCreationEpoch(0),
@@ -281,6 +307,14 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     {
         submitted += 1;
 
+        // With nobody else to run it, queueing the job would only delay it
+        // until the next call to waitForAll(), so we run it straight away.
+        if (!parent && workers.empty()) {
+            ++jobsRunInline;
+            runJob(job);
+            return;
+        }
+
         std::unique_ptr<ThreadJob> overflow
             (getEntry().queue->push(new ThreadJob(std::move(job))));
 
@@ -420,7 +454,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     void runJob(const ThreadJob & job)
     {
         try {
+            ++jobDepth;
             job();
+            --jobDepth;
             finished += 1;
         } catch (const std::exception & exc) {
             finished += 1;
@@ -472,9 +508,68 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         return result;
     }
 
+    /** Return the number of jobs sitting in the queues waiting to be run
+        or stolen.
+    */
+    uint64_t queueDepth()
+    {
+        std::shared_ptr<const Queues> currentQueues;
+        {
+            std::unique_lock<std::mutex> guard(queuesMutex);
+            currentQueues = queues;
+        }
+
+        uint64_t result = 0;
+        for (auto & q: *currentQueues)
+            result += q->num_queued_.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    /** Sleep for up to the given time waiting for a wakeup, accounting for
+        the time spent idle.
+    */
+    void sleepUntilWoken(std::chrono::milliseconds maxTime)
+    {
+        auto before = std::chrono::steady_clock::now();
+
+        ++threadsSleeping;
+        {
+            std::unique_lock<std::mutex> guard(wakeupMutex);
+            wakeupCv.wait_for(guard, maxTime);
+        }
+        --threadsSleeping;
+
+        idleNanoseconds
+            += std::chrono::duration_cast<std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now() - before).count();
+    }
+
+    /** Pin the given worker thread to a single core. */
+    static void pinThread(std::thread & thread, int workerNum)
+    {
+        int numCores = std::thread::hardware_concurrency();
+        if (numCores <= 0)
+            return;
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(workerNum % numCores, &cpus);
+
+        // Failure to pin is not fatal; the thread just moves around
+        int res = pthread_setaffinity_np(thread.native_handle(),
+                                         sizeof(cpus), &cpus);
+        if (res != 0) {
+            cerr << "warning: couldn't pin thread pool worker " << workerNum
+                 << ": " << strerror(res) << endl;
+        }
+    }
+
     /** Run a worker thread. */
     void runWorker(int workerNum)
     {
+        // The temporaries of the jobs come from their own arena
+        bindThreadToArena(MEMORY_ARENA_QUERY);
+
         ThreadEntry & entry = getEntry(workerNum);
 
         int itersWithNoWork = 0;
@@ -496,28 +591,19 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
                     if (s == f) {
                         // We're idle.  No need to look for a job; we almost
                         // certainly won't find one.
-                        ++threadsSleeping;
-                        std::unique_lock<std::mutex> guard(wakeupMutex);
 
                         // We can't sleep forever, since we allow for
                         // wakeups to be missed for efficiency reasons,
                         // and so we need to poll every now and again.
-                        wakeupCv.wait_for(guard, std::chrono::milliseconds(250));
-
-                        --threadsSleeping;
+                        sleepUntilWoken(std::chrono::milliseconds(250));
                         itersWithNoWork = 0;
                     }
 
                     if (itersWithNoWork == 10) {
-                        ++threadsSleeping;
-                        std::unique_lock<std::mutex> guard(wakeupMutex);
-
                         // We can't sleep forever, since we allow for
                         // wakeups to be missed for efficiency reasons,
                         // and so we need to poll every now and again.
-                        wakeupCv.wait_for(guard, std::chrono::milliseconds(10));
-
-                        --threadsSleeping;
+                        sleepUntilWoken(std::chrono::milliseconds(10));
                         itersWithNoWork = 0;
                     }
                     else {
@@ -609,7 +695,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         cerr << "submitted " << submitted << " finished " << finished
              << endl;
         cerr << "stolen " << jobsStolen << " full " << jobsWithFullQueue
-             << " local " << jobsRunLocally << endl;
+             << " local " << jobsRunLocally << " inline " << jobsRunInline
+             << endl;
+        cerr << "idle " << idleNanoseconds / 1000000000.0 << "s" << endl;
         cerr << "shutdown " << shutdown << endl;
         cerr << "sleeping " << threadsSleeping << endl;
         cerr << "epoch " << threadCreationEpoch << endl;
@@ -643,6 +731,18 @@ void
 ThreadPool::
 add(ThreadJob job)
 {
+    // While profiling, jobs carry the tag of the thread that submitted
+    // them, so that their samples are attributed to the same work
+    if (MLDB_UNLIKELY(SamplingProfiler::running())) {
+        if (auto tag = SampleTagScope::current()) {
+            job = [tag, job] () noexcept
+                {
+                    SampleTagScope scope(tag);
+                    job();
+                };
+        }
+    }
+
     itl->add(std::move(job));
 }
 
@@ -709,6 +809,34 @@ jobsRunLocally() const
     return itl->jobsRunLocally;
 }
 
+uint64_t
+ThreadPool::
+jobsRunInline() const
+{
+    return itl->jobsRunInline;
+}
+
+uint64_t
+ThreadPool::
+queueDepth() const
+{
+    return itl->queueDepth();
+}
+
+double
+ThreadPool::
+idleSeconds() const
+{
+    return itl->idleNanoseconds / 1000000000.0;
+}
+
+bool
+ThreadPool::
+inJob()
+{
+    return jobDepth > 0;
+}
+
 ThreadPool &
 ThreadPool::
 instance()
@@ -50,6 +50,9 @@ struct ThreadPool {
 
         If this function returns, the job WILL be eventually run, or has
         already been run.
+
+        While the SamplingProfiler is running, the job is run with the
+        sample tag of the calling thread.
     */
     void add(ThreadJob job);
 
@@ -67,7 +70,29 @@ struct ThreadPool {
     uint64_t jobsWithFullQueue() const;
     uint64_t jobsRunLocally() const;
 
+    /** Number of jobs that were run directly by add(), as the pool has no
+        threads of its own and no parent to run them.
+    */
+    uint64_t jobsRunInline() const;
+
+    /** Number of jobs currently waiting in the queues of the pool's
+        threads.
+    */
+    uint64_t queueDepth() const;
+
+    /** Total time, over all of its worker threads, that the pool has spent
+        asleep waiting for work.
+    */
+    double idleSeconds() const;
+
     static ThreadPool & instance();
+
+    /** Return whether the calling thread is running a job of a thread
+        pool.  Code that can use several threads of its own, like a
+        multithreaded BLAS, should use a single one when called from a
+        job, as the pool is already keeping all of the CPUs busy.
+    */
+    static bool inJob();
     
 private:
     struct Itl;
@@ -8,6 +8,7 @@ LIBMLDB_BUILTIN_SOURCES:= \
 	filtered_dataset.cc \
 	sampled_dataset.cc \
 	union_dataset.cc \
+	materialized_view_dataset.cc \
 
 LIBMLDB_BUILTIN_LINK:= mldb_core runner
 
@@ -210,7 +210,10 @@ struct IdHashes {
 
         }
 
-        const_iterator(const IdHashes* source) : source(source), bucket(0)
+        /// Iterator at the first entry of the given bucket, or of the
+        /// first one after it that isn't empty
+        const_iterator(const IdHashes* source, size_t bucket = 0)
+            : source(source), bucket(bucket)
         {
             bucketIter = source->buckets[bucket].begin();
             while (bucketIter == source->buckets[bucket].end())
@@ -249,6 +252,11 @@ struct IdHashes {
     {
         return const_iterator(this);
     }
+
+    const_iterator beginBucket(size_t bucket) const
+    {
+        return const_iterator(this, bucket);
+    }
 };
 
 } // namespace MLDB
@@ -21,6 +21,10 @@
 #include "mldb/http/http_exception.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/utils/compact_vector.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/base/parallel.h"
+#include "mldb/compiler/compiler.h"
+#include <atomic>
 
 using namespace std;
 
@@ -50,6 +54,20 @@ JoinedDatasetConfigDescription()
              "Type of join");
 }
 
+// Memory, in bytes, that the hash table of a hash join may use.  Joins
+// with a bigger build side fall back to a sort-merge join, which needs no
+// extra memory.
+EnvOption<size_t> MLDB_HASH_JOIN_MEMORY_BUDGET
+("MLDB_HASH_JOIN_MEMORY_BUDGET", 1024ULL * 1024 * 1024);
+
+// defined in table_expression_operations.cc
+BoundTableExpression
+bindDataset(std::shared_ptr<Dataset> dataset, Utf8String asName);
+
+// Whether chains of inner joins of datasets are run in the order which is
+// estimated to be cheapest, rather than the one they are written in.
+EnvOption<bool> MLDB_REORDER_JOINS("MLDB_REORDER_JOINS", true);
+
 struct JoinedDataset::Itl
     : public MatrixView, public ColumnIndex {
 
@@ -143,7 +161,8 @@ struct JoinedDataset::Itl
         std::shared_ptr<TableExpression> rightExpr,
         BoundTableExpression right,
         std::shared_ptr<SqlExpression> on,
-        JoinQualification qualification)
+        JoinQualification qualification,
+        const std::vector<std::pair<RowPath, RowPath> > * joinedRows = nullptr)
     {
         bool debug = false;
 
@@ -211,6 +230,74 @@ struct JoinedDataset::Itl
         sideChildNames[JOIN_SIDE_LEFT]  = leftOps.getChildAliases();
         sideChildNames[JOIN_SIDE_RIGHT] = rightOps.getChildAliases();
       
+        if (joinedRows) {
+            // The rows were already found by JoinedDataset::reorderJoin()
+            for (auto & r: *joinedRows)
+                recordJoinRow(r.first, RowHash(r.first), r.second, RowHash(r.second));
+        }
+        else if (!runJoin(scope, leftExpr, left, rightExpr, right, on,
+                          qualification)) {
+            return;
+        }
+
+        // Finally, the column indexes
+        for (auto & c: leftDataset->getFlattenedColumnNames()) {
+
+            ColumnPath newColumnName;
+            if (!left.asName.empty())
+                newColumnName = ColumnPath(left.asName) + c;
+            else newColumnName = c;
+
+            ColumnHash newColumnHash(newColumnName);
+
+            ColumnEntry entry;
+            entry.columnName = newColumnName;
+            entry.childColumnName = c;
+            entry.bitmap = 1;
+
+            columnIndex[newColumnHash] = std::move(entry);
+            leftColumns[c] = newColumnName;
+        }
+
+        for (auto & c: rightDataset->getFlattenedColumnNames()) {
+
+            ColumnPath newColumnName;
+
+            if (!right.asName.empty())
+                newColumnName = ColumnPath(right.asName) + c;
+            else newColumnName = c;
+            ColumnHash newColumnHash(newColumnName);
+
+            ColumnEntry entry;
+            entry.columnName = newColumnName;
+            entry.childColumnName = c;
+            entry.bitmap = 2;
+
+            columnIndex[newColumnHash] = std::move(entry);
+            rightColumns[c] = newColumnName;
+        }
+
+        if (debug) {
+            cerr << "total of " << columnIndex.size() << " columns and "
+                 << rows.size() << " rows returned from join" << endl;
+                
+            cerr << jsonEncode(getColumnPaths());
+        }
+    }
+
+    /** Find the rows of the join, recording them with recordJoinRow().
+        Returns false if the join is always empty.
+    */
+    bool runJoin(SqlBindingScope & scope,
+                 std::shared_ptr<TableExpression> leftExpr,
+                 BoundTableExpression & left,
+                 std::shared_ptr<TableExpression> rightExpr,
+                 BoundTableExpression & right,
+                 std::shared_ptr<SqlExpression> on,
+                 JoinQualification qualification)
+    {
+        bool debug = false;
+
         AnnotatedJoinCondition condition(leftExpr, rightExpr, on, 
                                          nullptr, //where
                                          qualification,
@@ -223,13 +310,13 @@ struct JoinedDataset::Itl
         if (!condition.constantWhere->constantValue().isTrue()
             && qualification == JoinQualification::JOIN_INNER)
         {
-            return;
+            return false;
         }
 
         if (!condition.crossWhere || condition.crossWhere->isConstant()) {
             if (condition.crossWhere
                 && !condition.crossWhere->constantValue().isTrue())
-                return;
+                return false;
             
             // We can use a fast path, since we have simple non-filtered
             // equijoin
@@ -267,49 +354,7 @@ struct JoinedDataset::Itl
                 ->takeAll(gotElement);
         }
 
-        // Finally, the column indexes
-        for (auto & c: leftDataset->getFlattenedColumnNames()) {
-
-            ColumnPath newColumnName;
-            if (!left.asName.empty())
-                newColumnName = ColumnPath(left.asName) + c;
-            else newColumnName = c;
-
-            ColumnHash newColumnHash(newColumnName);
-
-            ColumnEntry entry;
-            entry.columnName = newColumnName;
-            entry.childColumnName = c;
-            entry.bitmap = 1;
-
-            columnIndex[newColumnHash] = std::move(entry);
-            leftColumns[c] = newColumnName;
-        }
-
-        for (auto & c: rightDataset->getFlattenedColumnNames()) {
-
-            ColumnPath newColumnName;
-
-            if (!right.asName.empty())
-                newColumnName = ColumnPath(right.asName) + c;
-            else newColumnName = c;
-            ColumnHash newColumnHash(newColumnName);
-
-            ColumnEntry entry;
-            entry.columnName = newColumnName;
-            entry.childColumnName = c;
-            entry.bitmap = 2;
-
-            columnIndex[newColumnHash] = std::move(entry);
-            rightColumns[c] = newColumnName;
-        }
-
-        if (debug) {
-            cerr << "total of " << columnIndex.size() << " columns and "
-                 << rows.size() << " rows returned from join" << endl;
-                
-            cerr << jsonEncode(getColumnPaths());
-        }
+        return true;
     }
 
      /* This is called to record a new entry from the join. */
@@ -469,7 +514,6 @@ struct JoinedDataset::Itl
                     sorted.emplace_back(value, r.rowName, r.rowHash);
                 }
 
-                parallelQuickSortRecursive(sorted);
                 parallelQuickSortRecursive(outerRows);
 
                 for (auto & r: outerRows) {
@@ -521,7 +565,16 @@ struct JoinedDataset::Itl
                                       "condition", condition);
         }
 
-        // Finally, perform the join
+        // Finally, perform the join.  Equijoins are done with a hash join
+        // if its hash table fits in memory, otherwise both sides are
+        // sorted and merged.
+        if (condition.style == AnnotatedJoinCondition::EQUIJOIN
+            && hashJoin(leftRows, rightRows, outerLeft, outerRight))
+            return;
+
+        parallelQuickSortRecursive(leftRows);
+        parallelQuickSortRecursive(rightRows);
+
         // We keep a list of the row hashes of those that join up
         auto it1 = leftRows.begin(), end1 = leftRows.end();
         auto it2 = rightRows.begin(), end2 = rightRows.end();
@@ -616,6 +669,125 @@ struct JoinedDataset::Itl
         }
     }
 
+    /** Join the two sides on the equality of their values with a hash
+        join.  The hash table is built on the smaller side, and the larger
+        side probes it in parallel.  Joined rows are recorded in the order
+        of the probe side, followed for an outer join by the rows of the
+        build side that didn't match.
+
+        Returns false without doing anything if the hash table wouldn't
+        fit within MLDB_HASH_JOIN_MEMORY_BUDGET.
+    */
+    bool hashJoin(const std::vector<std::tuple<ExpressionValue, RowPath, RowHash> >
+                      & leftRows,
+                  const std::vector<std::tuple<ExpressionValue, RowPath, RowHash> >
+                      & rightRows,
+                  bool outerLeft, bool outerRight)
+    {
+        typedef std::tuple<ExpressionValue, RowPath, RowHash> SideRow;
+
+        bool buildLeft = leftRows.size() < rightRows.size();
+        const std::vector<SideRow> & build = buildLeft ? leftRows : rightRows;
+        const std::vector<SideRow> & probe = buildLeft ? rightRows : leftRows;
+        bool outerBuild = buildLeft ? outerLeft : outerRight;
+        bool outerProbe = buildLeft ? outerRight : outerLeft;
+
+        // The table points to the values of the build side rather than
+        // copying them, so each row costs about the same
+        struct HashValue {
+            size_t operator () (const ExpressionValue * val) const
+            {
+                return val->hash();
+            }
+        };
+        struct EqualValue {
+            bool operator () (const ExpressionValue * val1,
+                              const ExpressionValue * val2) const
+            {
+                return *val1 == *val2;
+            }
+        };
+        typedef std::unordered_map<const ExpressionValue *,
+                                   compact_vector<uint32_t, 1>,
+                                   HashValue, EqualValue> HashTable;
+
+        size_t bytesPerRow = sizeof(HashTable::value_type) + 4 * sizeof(void *);
+        if (build.size() * bytesPerRow > MLDB_HASH_JOIN_MEMORY_BUDGET
+            || build.size() >= std::numeric_limits<uint32_t>::max())
+            return false;
+
+        // Build.  Null values never match, so they don't go into the table.
+        HashTable table;
+        table.reserve(build.size());
+        for (size_t i = 0;  i < build.size();  ++i) {
+            const ExpressionValue & val = std::get<0>(build[i]);
+            if (!val.empty())
+                table[&val].push_back(i);
+        }
+
+        auto recordRow = [&] (const SideRow * probeRow, const SideRow * buildRow)
+            {
+                const SideRow * leftRow = buildLeft ? buildRow : probeRow;
+                const SideRow * rightRow = buildLeft ? probeRow : buildRow;
+                recordJoinRow(leftRow ? std::get<1>(*leftRow) : RowPath(),
+                              leftRow ? std::get<2>(*leftRow) : RowHash(),
+                              rightRow ? std::get<1>(*rightRow) : RowPath(),
+                              rightRow ? std::get<2>(*rightRow) : RowHash());
+            };
+
+        // Probe.  Each block of the probe side collects its matches, which
+        // are then recorded in order so that the result is deterministic.
+        static constexpr size_t BLOCK_SIZE = 4096;
+        size_t numBlocks = (probe.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        std::vector<std::vector<std::pair<uint32_t, uint32_t> > >
+            blockMatches(numBlocks);
+        std::unique_ptr<std::atomic<bool>[]> buildMatched
+            (new std::atomic<bool>[build.size()]);
+        for (size_t i = 0;  i < build.size();  ++i)
+            buildMatched[i] = false;
+
+        // Marks a probe row without a match, for outer joins
+        static constexpr uint32_t NO_MATCH = -1;
+
+        auto onBlock = [&] (size_t block)
+            {
+                auto & matches = blockMatches[block];
+                size_t end = std::min(probe.size(), (block + 1) * BLOCK_SIZE);
+                for (size_t i = block * BLOCK_SIZE;  i < end;  ++i) {
+                    const ExpressionValue & val = std::get<0>(probe[i]);
+                    auto it = val.empty() ? table.end() : table.find(&val);
+                    if (it == table.end()) {
+                        if (outerProbe)
+                            matches.emplace_back(i, NO_MATCH);
+                        continue;
+                    }
+                    for (uint32_t j: it->second) {
+                        matches.emplace_back(i, j);
+                        if (outerBuild)
+                            buildMatched[j].store(true, std::memory_order_relaxed);
+                    }
+                }
+            };
+
+        parallelMap(0, numBlocks, onBlock);
+
+        for (auto & matches: blockMatches) {
+            for (auto & m: matches) {
+                recordRow(&probe[m.first],
+                          m.second == NO_MATCH ? nullptr : &build[m.second]);
+            }
+        }
+
+        if (outerBuild) {
+            for (size_t i = 0;  i < build.size();  ++i) {
+                if (!buildMatched[i])
+                    recordRow(nullptr, &build[i]);
+            }
+        }
+
+        return true;
+    }
+
     virtual std::vector<RowPath>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const
     {
@@ -956,6 +1128,22 @@ JoinedDataset(SqlBindingScope & scope,
                       on, qualification));
 }
 
+JoinedDataset::
+JoinedDataset(SqlBindingScope & scope,
+              std::shared_ptr<TableExpression> leftExpr,
+              BoundTableExpression left,
+              std::shared_ptr<TableExpression> rightExpr,
+              BoundTableExpression right,
+              std::shared_ptr<SqlExpression> on,
+              const std::vector<std::pair<RowPath, RowPath> > & joinedRows)
+    : Dataset(scope.getMldbServer())
+{
+    itl.reset(new Itl(scope,
+                      leftExpr, std::move(left),
+                      rightExpr, std::move(right),
+                      on, JOIN_INNER, &joinedRows));
+}
+
 JoinedDataset::
 ~JoinedDataset()
 {
@@ -1167,6 +1355,283 @@ getChainedJoinDepth() const
 }
 
 
+// Selectivity of clauses which we know nothing about, as classically used
+// by query planners: equalities keep one row in ten, and anything else
+// keeps one row in three.
+static constexpr double DEFAULT_EQUALITY_SELECTIVITY = 0.1;
+static constexpr double DEFAULT_SELECTIVITY = 1.0 / 3;
+
+std::shared_ptr<Dataset>
+JoinedDataset::
+reorderJoin(SqlBindingScope & scope, const JoinExpression & join)
+{
+    if (!MLDB_REORDER_JOINS)
+        return nullptr;
+
+    // Flatten the tree of inner joins into its datasets, in the order
+    // they're written, and the AND clauses of all of the ON conditions.
+    std::vector<std::shared_ptr<TableExpression> > tables;
+    std::vector<std::shared_ptr<SqlExpression> > clauses;
+    bool reorderable = true;
+
+    std::function<void (const std::shared_ptr<SqlExpression> &)> addClauses
+        = [&] (const std::shared_ptr<SqlExpression> & expr)
+        {
+            auto boolean
+                = dynamic_cast<const BooleanOperatorExpression *>(expr.get());
+            if (boolean && boolean->op == "AND" && boolean->lhs) {
+                addClauses(boolean->lhs);
+                addClauses(boolean->rhs);
+            }
+            else clauses.push_back(expr);
+        };
+
+    std::function<void (const TableExpression &,
+                        const std::shared_ptr<TableExpression> &)> flatten
+        = [&] (const TableExpression & table,
+               const std::shared_ptr<TableExpression> & ptr)
+        {
+            auto child = dynamic_cast<const JoinExpression *>(&table);
+            if (child && child->qualification == JOIN_INNER) {
+                flatten(*child->left, child->left);
+                flatten(*child->right, child->right);
+                if (child->on)
+                    addClauses(child->on);
+            }
+            // Other tables may be expensive to bind, and binding them twice
+            // if we don't reorder would make that worse
+            else if (ptr && table.getType() == "dataset")
+                tables.push_back(ptr);
+            else reorderable = false;
+        };
+
+    flatten(join, nullptr);
+
+    size_t numTables = tables.size();
+    if (!reorderable || numTables < 3
+        || numTables > JoinOrderPlanner::MAX_TABLES)
+        return nullptr;
+
+    std::vector<std::set<Utf8String> > tableNames;
+    std::vector<BoundTableExpression> boundTables;
+    std::set<Utf8String> allTableNames;
+    for (auto & t: tables) {
+        tableNames.emplace_back(t->getTableNames());
+        for (auto & name: tableNames.back()) {
+            // Ambiguous names are reported by the join as written
+            if (!allTableNames.insert(name).second)
+                return nullptr;
+        }
+        boundTables.emplace_back(t->bind(scope));
+        if (!boundTables.back().dataset)
+            return nullptr;
+    }
+
+    JoinOrderPlanner planner;
+    for (auto & b: boundTables)
+        planner.rowCounts.push_back(b.dataset->getRowCount());
+
+    // Number of distinct values of a column of one of the tables, or 0 if
+    // we don't know
+    auto getDistinctValues = [&] (const SqlExpression & expr, int table)
+        -> size_t
+        {
+            auto read = dynamic_cast<const ReadColumnExpression *>(&expr);
+            if (!read)
+                return 0;
+            ColumnPath column = read->columnName;
+            if (!extractTableName(column, tableNames[table]))
+                return 0;
+            try {
+                ColumnStats storage;
+                return boundTables[table].dataset->getColumnIndex()
+                    ->getColumnStats(column, storage).values.size();
+            } MLDB_CATCH_ALL {
+                return 0;
+            }
+        };
+
+    std::vector<uint32_t> clauseTables;
+    for (auto & c: clauses) {
+        int64_t usedTables = JoinOrderPlanner::getClauseTables(*c, tableNames);
+        if (usedTables == -1)
+            return nullptr;  // the join as written will report the error
+
+        JoinOrderPlanner::Clause clause;
+        clause.tables = usedTables;
+        clauseTables.push_back(usedTables);
+
+        auto comparison = dynamic_cast<const ComparisonExpression *>(c.get());
+        if (!usedTables) {
+            clause.selectivity = 1.0;
+        }
+        else if (comparison
+                 && (comparison->op == "=" || comparison->op == "==")) {
+            clause.selectivity = DEFAULT_EQUALITY_SELECTIVITY;
+
+            // An equijoin of two columns keeps one row in the number of
+            // distinct values of the column with the most of them
+            int64_t lhsTables
+                = JoinOrderPlanner::getClauseTables(*comparison->lhs, tableNames);
+            int64_t rhsTables
+                = JoinOrderPlanner::getClauseTables(*comparison->rhs, tableNames);
+            if (lhsTables > 0 && rhsTables > 0 && lhsTables != rhsTables
+                && !(lhsTables & (lhsTables - 1))
+                && !(rhsTables & (rhsTables - 1))) {
+                size_t distinct
+                    = std::max(getDistinctValues(*comparison->lhs,
+                                                 __builtin_ctzll(lhsTables)),
+                               getDistinctValues(*comparison->rhs,
+                                                 __builtin_ctzll(rhsTables)));
+                if (distinct > 0)
+                    clause.selectivity = 1.0 / distinct;
+            }
+        }
+        else clause.selectivity = DEFAULT_SELECTIVITY;
+
+        planner.clauses.push_back(clause);
+    }
+
+    // Cost of the joins as written, which is the total size of the join at
+    // each node of the tree apart from the whole one, which every order has
+    size_t nextTable = 0;
+    double writtenCost = 0.0;
+    std::function<uint32_t (const TableExpression &)> getWrittenCost
+        = [&] (const TableExpression & table) -> uint32_t
+        {
+            auto child = dynamic_cast<const JoinExpression *>(&table);
+            if (!child || child->qualification != JOIN_INNER)
+                return 1U << nextTable++;
+            uint32_t joined
+                = getWrittenCost(*child->left) | getWrittenCost(*child->right);
+            writtenCost += planner.estimateRows(joined);
+            return joined;
+        };
+
+    uint32_t allTables = getWrittenCost(join);
+    double finalRows = planner.estimateRows(allTables);
+    writtenCost -= finalRows;
+
+    double bestCost;
+    std::vector<int> order = planner.bestOrder(bestCost);
+    bestCost -= finalRows;
+
+    // Rebuilding the joins as written from the rows of the reordered joins
+    // costs about the size of the whole join at each node
+    if (bestCost + finalRows * (numTables - 1) >= writtenCost)
+        return nullptr;
+
+    // Run the joins in the chosen order, each clause being used as soon as
+    // all of its tables have been joined
+    std::vector<std::shared_ptr<JoinedDataset> > steps;
+    std::vector<bool> clauseUsed(clauses.size(), false);
+    std::shared_ptr<TableExpression> expr = tables[order[0]];
+    BoundTableExpression bound = boundTables[order[0]];
+    uint32_t joined = 1U << order[0];
+
+    for (size_t i = 1;  i < numTables;  ++i) {
+        int t = order[i];
+        joined |= 1U << t;
+
+        std::shared_ptr<SqlExpression> on;
+        for (size_t c = 0;  c < clauses.size();  ++c) {
+            if (clauseUsed[c] || (clauseTables[c] & joined) != clauseTables[c])
+                continue;
+            clauseUsed[c] = true;
+            if (on) {
+                on = std::make_shared<BooleanOperatorExpression>
+                    (on, clauses[c], "AND");
+                on->surface = on->print();
+            }
+            else on = clauses[c];
+        }
+
+        auto ds = std::make_shared<JoinedDataset>
+            (scope, expr, bound, tables[t], boundTables[t], on, JOIN_INNER);
+        steps.push_back(ds);
+
+        expr = std::make_shared<JoinExpression>(expr, tables[t], on, JOIN_INNER);
+        expr->surface = expr->print();
+        bound = bindDataset(ds, Utf8String());
+    }
+
+    // Find the row of each table in each joined row
+    const std::vector<Itl::RowEntry> & joinedRows = steps.back()->itl->rows;
+    size_t numRows = joinedRows.size();
+    std::vector<std::vector<RowPath> > tableRows
+        (numTables, std::vector<RowPath>(numRows));
+
+    for (size_t r = 0;  r < numRows;  ++r) {
+        const Itl::RowEntry * entry = &joinedRows[r];
+        for (size_t i = numTables - 1;  i > 0;  --i) {
+            tableRows[order[i]][r] = entry->rightName;
+            if (i == 1) {
+                tableRows[order[0]][r] = entry->leftName;
+                break;
+            }
+            const Itl & previous = *steps[i - 2]->itl;
+            auto it = previous.rowIndex.find(RowHash(entry->leftName));
+            ExcAssert(it != previous.rowIndex.end());
+            entry = &previous.rows[it->second];
+        }
+    }
+
+    steps.clear();
+    bound = BoundTableExpression();
+
+    // Rebuild the tree as written, so that the rows and columns have the
+    // same names and order as if it had been run that way
+    struct Built {
+        BoundTableExpression bound;
+        std::vector<RowPath> rowNames;  ///< Name of each joined row
+        std::shared_ptr<JoinedDataset> dataset;
+    };
+
+    nextTable = 0;
+    std::function<Built (const TableExpression &)> build
+        = [&] (const TableExpression & table) -> Built
+        {
+            Built result;
+
+            auto child = dynamic_cast<const JoinExpression *>(&table);
+            if (!child || child->qualification != JOIN_INNER) {
+                size_t t = nextTable++;
+                result.bound = boundTables[t];
+                result.rowNames = std::move(tableRows[t]);
+                return result;
+            }
+
+            Built left = build(*child->left);
+            Built right = build(*child->right);
+
+            // Each pair of rows may be in several of the joined rows
+            std::map<std::pair<RowPath, RowPath>, size_t> pairIndex;
+            std::vector<std::pair<RowPath, RowPath> > pairs;
+            std::vector<size_t> rowPairs(numRows);
+            for (size_t r = 0;  r < numRows;  ++r) {
+                auto inserted = pairIndex.emplace
+                    (std::make_pair(left.rowNames[r], right.rowNames[r]),
+                     pairs.size());
+                if (inserted.second)
+                    pairs.push_back(inserted.first->first);
+                rowPairs[r] = inserted.first->second;
+            }
+
+            result.dataset.reset(new JoinedDataset
+                                 (scope, child->left, std::move(left.bound),
+                                  child->right, std::move(right.bound),
+                                  child->on, pairs));
+            result.bound = bindDataset(result.dataset, Utf8String());
+            result.rowNames.resize(numRows);
+            const auto & rows = result.dataset->itl->rows;
+            for (size_t r = 0;  r < numRows;  ++r)
+                result.rowNames[r] = rows[rowPairs[r]].rowName;
+            return result;
+        };
+
+    return build(join).dataset;
+}
+
 static RegisterDatasetType<JoinedDataset, JoinedDatasetConfig> 
 regJoined(builtinPackage(),
           "joined",
@@ -1175,6 +1640,9 @@ regJoined(builtinPackage(),
           nullptr,
           {MldbEntity::INTERNAL_ENTITY});
 
+extern std::shared_ptr<Dataset>
+(*reorderJoinFn) (SqlBindingScope &, const JoinExpression &);
+
 extern std::shared_ptr<Dataset>
 (*createJoinedDatasetFn) (SqlBindingScope &,
                           std::shared_ptr<TableExpression>,
@@ -1202,6 +1670,7 @@ struct AtInit {
     AtInit()
     {
         createJoinedDatasetFn = createJoinedDataset;
+        reorderJoinFn = JoinedDataset::reorderJoin;
     }
 } atInit;
 
@@ -72,7 +72,30 @@ struct JoinedDataset: public Dataset {
 
     virtual int getChainedJoinDepth() const;
 
+    /** Run a tree of inner joins of datasets in the order which is
+        estimated to give the smallest intermediate joins, from the row
+        count of each dataset and the number of distinct values of the
+        columns joined on.  The result has the same rows, row names and
+        columns as the joins run as written.
+
+        Returns null if the joins should be run as written, because the
+        tree can't be reordered or the order as written is good enough.
+    */
+    static std::shared_ptr<Dataset>
+    reorderJoin(SqlBindingScope & scope, const JoinExpression & join);
+
 private:
+    /** Constructor used by reorderJoin() for a join whose rows, as pairs
+        of left and right row names, are already known.
+    */
+    JoinedDataset(SqlBindingScope & scope,
+                  std::shared_ptr<TableExpression> leftExpr,
+                  BoundTableExpression left,
+                  std::shared_ptr<TableExpression> rightExpr,
+                  BoundTableExpression right,
+                  std::shared_ptr<SqlExpression> on,
+                  const std::vector<std::pair<RowPath, RowPath> > & joinedRows);
+
 
     BoundFunction
     overrideFunctionFromSide(JoinSide tableSide,
@@ -0,0 +1,484 @@
+/** materialized_view_dataset.cc                                  -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Dataset holding the result of a GROUP BY query that is maintained from
+    the rows committed to its source.
+*/
+
+#include "materialized_view_dataset.h"
+#include "sub_dataset.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/utils/log.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MATERIALIZED VIEW DATASET CONFIG                                          */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(MaterializedViewDatasetConfig);
+
+MaterializedViewDatasetConfigDescription::
+MaterializedViewDatasetConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("query", &MaterializedViewDatasetConfig::query,
+             "GROUP BY query over a single dataset whose result is held by "
+             "the view.  Its select clauses must each be a group key, "
+             "an expression of the group keys or one of the count, sum, "
+             "min, max or avg aggregators.  HAVING, ORDER BY, OFFSET and "
+             "LIMIT aren't supported.");
+}
+
+static RegisterDatasetType<MaterializedViewDataset, MaterializedViewDatasetConfig>
+regMaterializedView(builtinPackage(),
+                    "materialized.view",
+                    "Result of a GROUP BY query kept up to date as rows are "
+                    "committed to the dataset it reads from",
+                    "datasets/MaterializedViewDataset.md.html");
+
+
+/*****************************************************************************/
+/* MATERIALIZED VIEW DATASET                                                 */
+/*****************************************************************************/
+
+struct MaterializedViewDataset::Itl {
+
+    /// How the partial results of two sets of rows are merged
+    enum Merge {
+        KEY,    ///< Expression of the group keys; keeps the latest
+        COUNT,
+        SUM,
+        MIN,
+        MAX,
+        AVG     ///< Uses a sum and a count partial
+    };
+
+    /// Column of the output rows
+    struct Output {
+        ColumnPath name;
+        Merge merge;
+        int partial;  ///< Index of its (first) partial result
+    };
+
+    struct Group {
+        RowPath rowName;
+        std::vector<ExpressionValue> partials;
+    };
+
+    Itl(MldbServer * server, const MaterializedViewDatasetConfig & config)
+        : server(server), rowsAggregated(0), commitsApplied(0), generation(0),
+          initializing(false), logger(getMldbLog<MaterializedViewDataset>())
+    {
+        if (!config.query.stm)
+            throw HttpReturnException(400, "Materialized view needs a query");
+        statement = *config.query.stm;
+
+        if (!statement.from)
+            throw HttpReturnException
+                (400, "Query of a materialized view must read from a dataset",
+                 "query", statement.surface);
+        if (statement.groupBy.clauses.empty())
+            throw HttpReturnException
+                (400, "Query of a materialized view must have a GROUP BY clause",
+                 "query", statement.surface);
+        if (!statement.orderBy.clauses.empty()
+            || statement.offset != 0 || statement.limit != -1)
+            throw HttpReturnException
+                (400, "ORDER BY, OFFSET and LIMIT aren't supported in the query "
+                 "of a materialized view",
+                 "query", statement.surface);
+        if (statement.having && !statement.having->isConstantTrue())
+            throw HttpReturnException
+                (400, "HAVING isn't supported in the query of a materialized "
+                 "view, since groups that it removes could match it later",
+                 "query", statement.surface);
+
+        initPartials();
+
+        SqlExpressionMldbScope context(server);
+        auto bound = statement.from->bind(context);
+        if (!bound.dataset)
+            throw HttpReturnException
+                (400, "Query of a materialized view must read from a dataset",
+                 "query", statement.surface);
+        source = bound.dataset;
+        alias = bound.asName;
+
+        contents = std::make_shared<SubDataset>(server, vector<NamedRowValue>());
+
+        // Datasets that can't tell us which rows are committed throw here,
+        // as do errors aggregating the rows that are already there
+        initializing = true;
+        watch = source->watchCommittedRows
+            ([this] (const std::shared_ptr<Dataset> & rows)
+             {
+                 this->onCommittedRows(*rows);
+             });
+        initializing = false;
+    }
+
+    /** Turn the select clauses into the outputs and into the select
+        expression calculating their partial results for a set of rows.
+    */
+    void initPartials()
+    {
+        vector<std::shared_ptr<SqlExpression> > partials;
+
+        for (auto & clause: statement.select.clauses) {
+            auto named
+                = std::dynamic_pointer_cast<const NamedColumnExpression>(clause);
+            if (!named)
+                throw HttpReturnException
+                    (400, "Select clauses of a materialized view must each "
+                     "name a single value",
+                     "clause", clause->surface);
+
+            Output output;
+            output.name = named->alias;
+            output.partial = partials.size();
+
+            auto call = std::dynamic_pointer_cast<FunctionCallExpression>
+                (named->expression);
+            if (call && call->isAggregator()) {
+                const Utf8String & fn = call->functionName;
+                if (fn == "count")
+                    output.merge = COUNT;
+                else if (fn == "sum")
+                    output.merge = SUM;
+                else if (fn == "min")
+                    output.merge = MIN;
+                else if (fn == "max")
+                    output.merge = MAX;
+                else if (fn == "avg")
+                    output.merge = AVG;
+                else throw HttpReturnException
+                         (400, "Aggregator can't be maintained by a materialized "
+                          "view; only count, sum, min, max and avg can",
+                          "aggregator", fn);
+                if (call->args.size() != 1)
+                    throw HttpReturnException
+                        (400, "Aggregators of a materialized view must have "
+                         "a single argument",
+                         "clause", clause->surface);
+
+                if (output.merge == AVG) {
+                    partials.push_back(std::make_shared<FunctionCallExpression>
+                                       (call->tableName, "sum", call->args));
+                    partials.push_back(std::make_shared<FunctionCallExpression>
+                                       (call->tableName, "count", call->args));
+                }
+                else partials.push_back(named->expression);
+            }
+            else {
+                if (!findAggregators(named->expression, true).empty())
+                    throw HttpReturnException
+                        (400, "Expressions of aggregators aren't supported by "
+                         "materialized views; select the aggregators "
+                         "themselves",
+                         "clause", clause->surface);
+                output.merge = KEY;
+                partials.push_back(named->expression);
+            }
+
+            outputs.push_back(output);
+        }
+
+        vector<std::shared_ptr<SqlRowExpression> > clauses;
+        for (unsigned i = 0;  i < partials.size();  ++i) {
+            clauses.push_back(std::make_shared<NamedColumnExpression>
+                              (ColumnPath(PathElement(i)), partials[i]));
+        }
+        partialSelect = SelectExpression(clauses);
+        numPartials = partials.size();
+    }
+
+    static ExpressionValue merge(Merge merge,
+                                 const ExpressionValue & current,
+                                 const ExpressionValue & added)
+    {
+        if (added.empty() && merge != KEY)
+            return current;
+        if (current.empty())
+            return added;
+
+        Date ts = std::max(current.getEffectiveTimestamp(),
+                           added.getEffectiveTimestamp());
+
+        switch (merge) {
+        case KEY:
+            return added;
+        case COUNT:
+            return ExpressionValue(current.getAtom().toUInt()
+                                   + added.getAtom().toUInt(), ts);
+        case SUM:
+            return ExpressionValue(current.toDouble() + added.toDouble(), ts);
+        case MIN:
+            return added.getAtom() < current.getAtom() ? added : current;
+        case MAX:
+            return current.getAtom() < added.getAtom() ? added : current;
+        case AVG:
+            break;
+        }
+
+        throw HttpReturnException(500, "Unknown materialized view merge");
+    }
+
+    void onCommittedRows(const Dataset & rows)
+    {
+        try {
+            apply(rows);
+        } catch (const std::exception & exc) {
+            if (initializing)
+                throw;
+            WARNING_MSG(logger) << "materialized view couldn't aggregate the "
+                                << "rows committed to its source: " << exc.what();
+            std::unique_lock<std::mutex> guard(mutex);
+            lastError = exc.what();
+        }
+    }
+
+    /** Aggregate the rows committed to the source and merge them into the
+        groups.  This is done without the lock, so that it only serializes
+        the merging.
+    */
+    void apply(const Dataset & rows)
+    {
+        uint64_t numRows = rows.getMatrixView()->getRowCount();
+        if (numRows == 0)
+            return;
+
+        auto result = rows.queryStructuredExpr
+            (partialSelect, statement.when, *statement.where,
+             OrderByExpression(), statement.groupBy, statement.having,
+             statement.rowName, 0 /* offset */, -1 /* limit */, alias);
+
+        std::unique_lock<std::mutex> guard(mutex);
+
+        vector<ExpressionValue> values(numPartials);
+        for (auto & row: std::get<0>(result)) {
+            std::fill(values.begin(), values.end(), ExpressionValue());
+            for (auto & column: row.columns) {
+                const ExpressionValue & val = std::get<1>(column);
+                if (!val.isAtom())
+                    throw HttpReturnException
+                        (400, "Select clauses of a materialized view must "
+                         "each have a single value",
+                         "value", val);
+                values.at(std::get<0>(column).toIndex()) = val;
+            }
+
+            Group & group = groups[row.rowHash];
+            if (group.partials.empty()) {
+                group.rowName = row.rowName;
+                group.partials = std::move(values);
+                values.resize(numPartials);
+                continue;
+            }
+
+            for (auto & output: outputs) {
+                int p = output.partial;
+                if (output.merge == AVG) {
+                    group.partials[p]
+                        = merge(SUM, group.partials[p], values[p]);
+                    group.partials[p + 1]
+                        = merge(COUNT, group.partials[p + 1], values[p + 1]);
+                }
+                else {
+                    group.partials[p]
+                        = merge(output.merge, group.partials[p], values[p]);
+                }
+            }
+        }
+
+        rowsAggregated += numRows;
+        commitsApplied += 1;
+
+        publish();
+    }
+
+    /** Rebuild the dataset holding the groups.  Must be called with the
+        lock held.
+    */
+    void publish()
+    {
+        vector<NamedRowValue> output;
+        output.reserve(groups.size());
+
+        for (auto & g: groups) {
+            const Group & group = g.second;
+
+            NamedRowValue row;
+            row.rowName = group.rowName;
+            row.rowHash = g.first;
+
+            for (auto & o: outputs) {
+                ExpressionValue val = group.partials[o.partial];
+                if (o.merge == AVG) {
+                    const ExpressionValue & count = group.partials[o.partial + 1];
+                    uint64_t n = count.empty() ? 0 : count.getAtom().toUInt();
+                    val = ExpressionValue
+                        (val.empty() || n == 0 ? NAN : val.toDouble() / n,
+                         std::max(val.getEffectiveTimestamp(),
+                                  count.getEffectiveTimestamp()));
+                }
+                val.appendToRow(o.name, row.columns);
+            }
+
+            output.emplace_back(std::move(row));
+        }
+
+        std::sort(output.begin(), output.end(),
+                  [] (const NamedRowValue & r1, const NamedRowValue & r2)
+                  {
+                      return r1.rowName < r2.rowName;
+                  });
+
+        auto newContents = std::make_shared<SubDataset>(server, std::move(output));
+
+        std::unique_lock<std::mutex> guard(contentsMutex);
+        contents = std::move(newContents);
+        ++generation;
+    }
+
+    std::shared_ptr<Dataset> getContents() const
+    {
+        std::unique_lock<std::mutex> guard(contentsMutex);
+        return contents;
+    }
+
+    Any getStatus() const
+    {
+        Json::Value result;
+        std::unique_lock<std::mutex> guard(mutex);
+        result["rowCount"] = (Json::UInt)groups.size();
+        result["rowsAggregated"] = (Json::UInt)rowsAggregated;
+        result["commitsApplied"] = (Json::UInt)commitsApplied;
+        result["sourceGeneration"] = (Json::UInt)source->getGeneration();
+        if (!lastError.empty())
+            result["lastError"] = lastError;
+        return result;
+    }
+
+    MldbServer * server;
+    SelectStatement statement;
+    vector<Output> outputs;
+    SelectExpression partialSelect;
+    size_t numPartials;
+
+    std::shared_ptr<Dataset> source;
+    Utf8String alias;
+
+    /// Protects the groups and the statistics
+    mutable std::mutex mutex;
+    std::unordered_map<RowHash, Group> groups;
+    uint64_t rowsAggregated;
+    uint64_t commitsApplied;
+    std::string lastError;
+
+    /// Protects the contents, which are replaced on each commit
+    mutable std::mutex contentsMutex;
+    std::shared_ptr<Dataset> contents;
+    std::atomic<uint64_t> generation;
+
+    /// Set while the rows already in the source are aggregated
+    bool initializing;
+
+    shared_ptr<spdlog::logger> logger;
+
+    /// Destroyed first, so that no commit uses the rest of this object
+    std::shared_ptr<void> watch;
+};
+
+MaterializedViewDataset::
+MaterializedViewDataset(MldbServer * owner,
+                        PolyConfig config,
+                        const std::function<bool (const Json::Value &)> & onProgress)
+    : Dataset(owner)
+{
+    datasetConfig = config.params.convert<MaterializedViewDatasetConfig>();
+    itl.reset(new Itl(server, datasetConfig));
+}
+
+MaterializedViewDataset::
+~MaterializedViewDataset()
+{
+}
+
+Any
+MaterializedViewDataset::
+getStatus() const
+{
+    return itl->getStatus();
+}
+
+std::shared_ptr<MatrixView>
+MaterializedViewDataset::
+getMatrixView() const
+{
+    return itl->getContents()->getMatrixView();
+}
+
+std::shared_ptr<ColumnIndex>
+MaterializedViewDataset::
+getColumnIndex() const
+{
+    return itl->getContents()->getColumnIndex();
+}
+
+std::shared_ptr<RowStream>
+MaterializedViewDataset::
+getRowStream() const
+{
+    return itl->getContents()->getRowStream();
+}
+
+std::pair<Date, Date>
+MaterializedViewDataset::
+getTimestampRange() const
+{
+    return itl->getContents()->getTimestampRange();
+}
+
+KnownColumn
+MaterializedViewDataset::
+getKnownColumnInfo(const ColumnPath & columnName) const
+{
+    return itl->getContents()->getKnownColumnInfo(columnName);
+}
+
+std::vector<ColumnPath>
+MaterializedViewDataset::
+getFlattenedColumnNames() const
+{
+    return itl->getContents()->getFlattenedColumnNames();
+}
+
+size_t
+MaterializedViewDataset::
+getFlattenedColumnCount() const
+{
+    return itl->getContents()->getFlattenedColumnCount();
+}
+
+uint64_t
+MaterializedViewDataset::
+getGeneration() const
+{
+    return itl->generation;
+}
+
+} // namespace MLDB
@@ -0,0 +1,77 @@
+/** materialized_view_dataset.h                                   -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Dataset holding the result of a GROUP BY query, which is kept up to date
+    by aggregating the rows committed to the dataset that it reads from.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MATERIALIZED VIEW DATASET CONFIG                                          */
+/*****************************************************************************/
+
+struct MaterializedViewDatasetConfig {
+    InputQuery query;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(MaterializedViewDatasetConfig);
+
+
+/*****************************************************************************/
+/* MATERIALIZED VIEW DATASET                                                 */
+/*****************************************************************************/
+
+/** Dataset with one row per group of a GROUP BY query over another
+    dataset.  Each commit of that dataset aggregates only the rows that it
+    added and merges them into the groups, so the aggregators must be ones
+    that can be merged: count, sum, min, max and avg.
+*/
+
+struct MaterializedViewDataset: public Dataset {
+
+    MaterializedViewDataset(MldbServer * owner,
+                            PolyConfig config,
+                            const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual ~MaterializedViewDataset() override;
+
+    virtual Any getStatus() const override;
+    virtual void recordRowItl(const RowPath & rowPath,
+        const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) override
+    {
+        throw MLDB::Exception("Dataset type doesn't allow recording");
+    }
+
+    virtual std::shared_ptr<MatrixView> getMatrixView() const override;
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const override;
+    virtual std::shared_ptr<RowStream> getRowStream() const override;
+
+    virtual std::pair<Date, Date> getTimestampRange() const override;
+
+    virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const override;
+
+    virtual std::vector<ColumnPath> getFlattenedColumnNames() const override;
+
+    virtual size_t getFlattenedColumnCount() const override;
+
+    /** Incremented each time that a commit of the source dataset changes
+        the groups.
+    */
+    virtual uint64_t getGeneration() const override;
+
+private:
+    MaterializedViewDatasetConfig datasetConfig;
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
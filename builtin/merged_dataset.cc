@@ -198,11 +198,57 @@ struct MergedDataset::Itl
         /* set where the stream should start*/
         virtual void initAt(size_t start) override
         {
-            it = source->rowIndex.begin();
+            // Skip over whole buckets before stepping within one
+            size_t bucket = 0;
+            while (bucket < IdHashes::NBUCKETS
+                   && start >= source->rowIndex.buckets[bucket].size()) {
+                start -= source->rowIndex.buckets[bucket].size();
+                ++bucket;
+            }
+            if (bucket == IdHashes::NBUCKETS) {
+                ExcAssertEqual(start, 0);
+                it = IdHashes::const_iterator();
+                return;
+            }
+            it = source->rowIndex.beginBucket(bucket);
             for (size_t i = 0; i < start; ++i)
                 ++it;
         }
 
+        /// Parallelize bucket by bucket of the row index, which are
+        /// natural boundaries with about the same number of rows in each
+        /// as the rows are spread by their hash.
+        virtual std::vector<std::shared_ptr<RowStream> >
+        parallelize(int64_t rowStreamTotalRows,
+                    ssize_t approxNumberOfChildStreams,
+                    std::vector<size_t> * streamOffsets) const override
+        {
+            std::vector<std::shared_ptr<RowStream> > streams;
+            if (streamOffsets)
+                streamOffsets->clear();
+
+            size_t startAt = 0;
+            for (size_t i = 0;  i < IdHashes::NBUCKETS;  ++i) {
+                size_t rowCount = source->rowIndex.buckets[i].size();
+                if (rowCount == 0)
+                    continue;
+                if (streamOffsets)
+                    streamOffsets->push_back(startAt);
+                startAt += rowCount;
+
+                auto stream = std::make_shared<MergedRowStream>(source);
+                stream->it = source->rowIndex.beginBucket(i);
+                streams.emplace_back(std::move(stream));
+            }
+
+            if (streamOffsets)
+                streamOffsets->push_back(startAt);
+
+            ExcAssertEqual(startAt, rowStreamTotalRows);
+
+            return streams;
+        }
+
         virtual RowPath next() override
         {
             uint64_t hash = (*it).first;
@@ -9,8 +9,13 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
+#include "mldb/types/enum_description.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/http/http_exception.h"
+#include "mldb/base/parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
 #include <random>
 #include <unordered_set>
 
@@ -29,11 +34,37 @@ std::random_device rd;
 
 SampledDatasetConfig::
 SampledDatasetConfig() :
-        rows(0), fraction(0), withReplacement(false)
+        rows(0), fraction(0), withReplacement(false), method(SAMPLE_INDEX)
 {
     seed = rd();
 }
 
+DEFINE_ENUM_DESCRIPTION(SampleMethod);
+
+SampleMethodDescription::
+SampleMethodDescription()
+{
+    addValue("index", SAMPLE_INDEX,
+             "Pick random rows from the list of all of the rows of the "
+             "dataset.  This reads the whole list when the sample is "
+             "created, and is the only method that samples with "
+             "replacement.");
+    addValue("hash", SAMPLE_HASH,
+             "Keep each row or not depending on its name and the seed, "
+             "so that each row is kept with a probability of `fraction` "
+             "(or `rows` divided by the number of rows of the dataset).  "
+             "The number of rows in the sample is only approximate.  "
+             "Whether a row is in the sample is known without reading "
+             "the dataset, and the list of rows is only made the first "
+             "time that it is needed, by scanning the rows of the dataset "
+             "in parallel.");
+    addValue("reservoir", SAMPLE_RESERVOIR,
+             "Pick exactly `rows` rows (or `fraction` of them), without "
+             "replacement, in one parallel scan of the rows of the "
+             "dataset the first time that they are needed.  Only the "
+             "sampled rows are held in memory.");
+}
+
 
 /*****************************************************************************/
 /* SAMPLED DATASET CONFIG                                                    */
@@ -49,6 +80,10 @@ void validateConfig(SampledDatasetConfig * config)
         throw MLDB::Exception(SampledDataset::getErrorMsg("The 'rows' or 'fraction' parameters "
                     "need to be set."));
     }
+    if (config->method != SAMPLE_INDEX && config->withReplacement) {
+        throw MLDB::Exception(SampledDataset::getErrorMsg("Sampling with "
+                    "replacement is only possible with the 'index' method."));
+    }
     if(config->rows == 0 && (config->fraction > 1 || config->fraction <= 0)) {
         throw MLDB::Exception(SampledDataset::getErrorMsg(MLDB::format("The 'fraction' parameter needs to "
                     "be between 0 and 1. Value provided is '%0.4f'", config->fraction)));
@@ -80,6 +115,12 @@ SampledDatasetConfigDescription()
               "this parameter is to permit reproducible random samples. "
               "This parameter is optional, with the default value being "
               "selected randomly for each sample.");
+    addField("method", &SampledDatasetConfig::method,
+             "How the rows of the sample are chosen.  The `hash` and "
+             "`reservoir` methods only keep the sampled rows in memory, "
+             "rather than the names of all of the rows of `dataset`, "
+             "which matters for very large datasets.",
+             SAMPLE_INDEX);
 
     onPostValidate = [] (SampledDatasetConfig * config,
                          JsonParsingContext & context)
@@ -93,6 +134,67 @@ SampledDatasetConfigDescription()
 /* SAMPLED INTERNAL REPRESENTATION                                        */
 /*****************************************************************************/
 
+namespace {
+
+/** Pseudo-random number for the row, which is the same for a given row and
+    seed however the dataset is scanned.  This is the finalizer of the
+    splitmix64 generator, which spreads out the bits of the row hash.
+*/
+uint64_t sampleKey(const RowHash & row, unsigned seed)
+{
+    uint64_t z = row.hash() + 0x9e3779b97f4a7c15ULL * (seed + 1ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/** The rows of a dataset split into parts that can be scanned in parallel,
+    along the natural divisions of its row stream, or in blocks of its row
+    names if it doesn't have one.
+*/
+struct SourceParts {
+    SourceParts(const Dataset & dataset)
+    {
+        static constexpr size_t ROWS_PER_BLOCK = 1024;
+
+        size_t numRows = dataset.getMatrixView()->getRowCount();
+        if (numRows == 0)
+            return;
+
+        auto stream = dataset.getRowStream();
+        if (stream) {
+            streams = stream->parallelize(numRows, RowStream::AUTO, &offsets);
+            return;
+        }
+
+        rowNames = dataset.getMatrixView()->getRowPaths();
+        for (size_t i = 0;  i < rowNames.size();  i += ROWS_PER_BLOCK)
+            offsets.push_back(i);
+        offsets.push_back(rowNames.size());
+    }
+
+    size_t size() const
+    {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    /// Call onRow with the name of each row of the given part, in order
+    template<typename Fn>
+    void forEachRow(size_t part, Fn && onRow) const
+    {
+        for (size_t i = offsets[part];  i < offsets[part + 1];  ++i) {
+            if (streams.empty())
+                onRow(rowNames[i]);
+            else onRow(streams[part]->next());
+        }
+    }
+
+    std::vector<std::shared_ptr<RowStream> > streams;
+    std::vector<RowPath> rowNames;
+    std::vector<size_t> offsets;
+};
+
+} // file scope
 
 struct SampledDataset::Itl
     : public MatrixView, public ColumnIndex {
@@ -104,36 +206,103 @@ struct SampledDataset::Itl
     std::shared_ptr<ColumnIndex> index;
     size_t columnCount;
 
-    std::unordered_set<RowPath> sampledRowsIndex;
-    std::vector<RowPath> sampledRows;
-    std::vector<RowHash> sampledRowsHash;
+    SampledDatasetConfig config;
+
+    /// For the hash method, rows with a sampleKey() below this are kept
+    uint64_t hashThreshold;
+    bool hashKeepsAll;
+
+    /// The rows in the sample, which apart from the index method are only
+    /// found the first time that they are needed.  For the hash method,
+    /// the index of the row names is not used and so left empty.
+    struct Sample {
+        std::unordered_set<RowPath> sampledRowsIndex;
+        std::vector<RowPath> sampledRows;
+        std::vector<RowHash> sampledRowsHash;
+
+        void add(RowPath rowName, bool addToIndex = true)
+        {
+            sampledRowsHash.emplace_back(rowName);
+            if (addToIndex)
+                sampledRowsIndex.insert(rowName);
+            sampledRows.emplace_back(std::move(rowName));
+        }
+    };
+
+    mutable std::once_flag sampleOnce;
+    mutable std::shared_ptr<const Sample> sample;
 
     Itl(MldbServer * server, std::shared_ptr<Dataset> dataset,
             const SampledDatasetConfig config)
         : dataset(dataset),
           matrix(dataset->getMatrixView()),
           index(dataset->getColumnIndex()),
-          columnCount(matrix->getColumnPaths().size())
+          columnCount(matrix->getColumnPaths().size()),
+          config(config),
+          hashThreshold(0),
+          hashKeepsAll(false)
     {
+        if (config.method == SAMPLE_HASH) {
+            double fraction = config.fraction;
+            if (config.rows != 0) {
+                size_t numRows = matrix->getRowCount();
+                fraction = numRows ? 1.0 * config.rows / numRows : 1.0;
+            }
+            hashKeepsAll = fraction >= 1.0;
+            if (!hashKeepsAll)
+                hashThreshold = std::ldexp(fraction, 64);
+        }
+
+        // Sampling by index reports too many rows when it is created
+        if (config.method == SAMPLE_INDEX)
+            getSample();
+    }
+
+    const Sample & getSample() const
+    {
+        std::call_once(sampleOnce, [&] () { sample = this->makeSample(); });
+        return *sample;
+    }
+
+    std::shared_ptr<const Sample> makeSample() const
+    {
+        switch (config.method) {
+        case SAMPLE_INDEX:      return sampleByIndex();
+        case SAMPLE_HASH:       return sampleByHash();
+        case SAMPLE_RESERVOIR:  return sampleByReservoir();
+        }
+        throw MLDB::Exception("Unknown sampling method");
+    }
+
+    /// Number of rows asked for by the rows or fraction parameters
+    size_t getNumRequestedRows(size_t numRows) const
+    {
+        return config.rows != 0 ? config.rows : numRows * config.fraction;
+    }
+
+    /// Pick random positions in the list of all the rows of the dataset
+    std::shared_ptr<const Sample> sampleByIndex() const
+    {
+        auto result = std::make_shared<Sample>();
+
         // get all existing rows
         auto rows = matrix->getRowHashes();
 
-        unsigned numRows = config.rows != 0 ? config.rows
-                                            : rows.size() * config.fraction;
+        unsigned numRows = getNumRequestedRows(rows.size());
 
         if(!config.withReplacement && numRows > rows.size()) {
             throw MLDB::Exception("Requested more rows without replacement than "
                     "available number of rows in original dataset.");
         }
-        sampledRowsHash.reserve(numRows);
-        sampledRows.reserve(numRows);
+        result->sampledRowsHash.reserve(numRows);
+        result->sampledRows.reserve(numRows);
 
         // do the sampling
         std::mt19937 gen(config.seed);
         std::uniform_int_distribution<> dis(0, rows.size() - 1);
 
         unordered_set<unsigned> sampledIndexes;
-        while(sampledRows.size() < numRows) {
+        while(result->sampledRows.size() < numRows) {
             unsigned sample_index = dis(gen);
 
             // if we're not sampling with replacement, check if
@@ -145,12 +314,92 @@ struct SampledDataset::Itl
                 sampledIndexes.insert(sample_index);
             }
 
-            sampledRowsHash.emplace_back(rows[sample_index]);
+            result->add(matrix->getRowPath(rows[sample_index]));
+        }
+
+        return result;
+    }
+
+    bool inHashSample(const RowHash & row) const
+    {
+        return hashKeepsAll || sampleKey(row, config.seed) < hashThreshold;
+    }
+
+    /// Keep the rows whose hash falls within the fraction, in the order of
+    /// the dataset
+    std::shared_ptr<const Sample> sampleByHash() const
+    {
+        SourceParts parts(*dataset);
+        std::vector<std::vector<RowPath> > kept(parts.size());
+
+        auto doPart = [&] (size_t part)
+            {
+                parts.forEachRow(part, [&] (RowPath rowName)
+                                 {
+                                     if (inHashSample(rowName))
+                                         kept[part].emplace_back(std::move(rowName));
+                                 });
+            };
+
+        parallelMap(0, parts.size(), doPart);
+
+        auto result = std::make_shared<Sample>();
+        for (auto & part: kept) {
+            for (auto & rowName: part)
+                result->add(std::move(rowName), false /* addToIndex */);
+            part = std::vector<RowPath>();
+        }
+        return result;
+    }
 
-            auto rowName = matrix->getRowPath(rows[sample_index]);
-            sampledRows.emplace_back(rowName);
-            sampledRowsIndex.insert(rowName);
+    /// Keep the requested number of rows with the smallest sampleKey(),
+    /// which are a uniform sample without replacement.  Each part keeps
+    /// its own smallest rows, which are then merged.
+    std::shared_ptr<const Sample> sampleByReservoir() const
+    {
+        typedef std::pair<uint64_t, RowPath> Entry;
+
+        size_t numRows = getNumRequestedRows(matrix->getRowCount());
+
+        SourceParts parts(*dataset);
+        std::vector<std::vector<Entry> > reservoirs(parts.size());
+
+        auto doPart = [&] (size_t part)
+            {
+                // Max heap, so that the row to be replaced is at the front
+                std::vector<Entry> & reservoir = reservoirs[part];
+                parts.forEachRow(part, [&] (RowPath rowName)
+                    {
+                        uint64_t key = sampleKey(rowName, config.seed);
+                        if (reservoir.size() == numRows) {
+                            if (numRows == 0 || key >= reservoir.front().first)
+                                return;
+                            std::pop_heap(reservoir.begin(), reservoir.end());
+                            reservoir.pop_back();
+                        }
+                        reservoir.emplace_back(key, std::move(rowName));
+                        std::push_heap(reservoir.begin(), reservoir.end());
+                    });
+            };
+
+        parallelMap(0, parts.size(), doPart);
+
+        std::vector<Entry> entries;
+        for (auto & reservoir: reservoirs) {
+            entries.insert(entries.end(),
+                           std::make_move_iterator(reservoir.begin()),
+                           std::make_move_iterator(reservoir.end()));
+            reservoir = std::vector<Entry>();
         }
+
+        std::sort(entries.begin(), entries.end());
+        if (entries.size() > numRows)
+            entries.resize(numRows);
+
+        auto result = std::make_shared<Sample>();
+        for (auto & entry: entries)
+            result->add(std::move(entry.second));
+        return result;
     }
 
     virtual RowPath getRowPath(const RowHash & row) const
@@ -165,6 +414,8 @@ struct SampledDataset::Itl
     virtual std::vector<RowPath>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const
     {
+        const auto & sampledRows = getSample().sampledRows;
+
         std::vector<RowPath> rtn;
         rtn.reserve(sampledRows.size() - start);
 
@@ -181,8 +432,10 @@ struct SampledDataset::Itl
     virtual std::vector<RowHash>
     getRowHashes(ssize_t start = 0, ssize_t limit = -1) const
     {
+        const auto & sampledRowsHash = getSample().sampledRowsHash;
+
         std::vector<RowHash> rtn;
-        rtn.reserve(sampledRows.size() - start);
+        rtn.reserve(sampledRowsHash.size() - start);
 
         for(int i=start; i<sampledRowsHash.size(); i++) {
             rtn.emplace_back(sampledRowsHash[i]);
@@ -196,7 +449,11 @@ struct SampledDataset::Itl
 
     virtual bool knownRow(const RowPath & row) const
     {
-        return sampledRowsIndex.count(row);
+        // Decided from the row itself, so the sample isn't needed
+        if (config.method == SAMPLE_HASH)
+            return inHashSample(row) && matrix->knownRow(row);
+
+        return getSample().sampledRowsIndex.count(row);
     }
 
     virtual MatrixNamedRow getRow(const RowPath & rowName) const
@@ -232,7 +489,19 @@ struct SampledDataset::Itl
 
     virtual size_t getRowCount() const
     {
-        return sampledRows.size();
+        return getSample().sampledRows.size();
+    }
+
+    /// Fraction of the rows of the dataset actually in the sample, which
+    /// for the hash method is only close to the one asked for.  Sampling
+    /// a sample keeps a fraction of its fraction.
+    double getSampledFraction() const
+    {
+        size_t numRows = matrix->getRowCount();
+        double fraction = numRows
+            ? std::min(1.0, 1.0 * getRowCount() / numRows)
+            : 1.0;
+        return fraction * dataset->getSampledFraction();
     }
 
     virtual size_t getColumnCount() const
@@ -252,6 +521,16 @@ struct SampledDataset::Itl
     {
         auto col = index->getColumn(column);
 
+        if (config.method == SAMPLE_HASH) {
+            col.rows.erase(std::remove_if(col.rows.begin(), col.rows.end(),
+                                          [&] (const std::tuple<RowPath, CellValue, Date> & r)
+                                          {
+                                              return !inHashSample(std::get<0>(r));
+                                          }),
+                           col.rows.end());
+            return col;
+        }
+
         std::vector<std::tuple<RowPath, CellValue, Date> > allRows = std::move(col.rows);
         map<RowPath, unsigned> rowIndex;
         for(int i=0; i<allRows.size(); i++) {
@@ -260,7 +539,7 @@ struct SampledDataset::Itl
 
 
         // std::vector<std::tuple<RowPath, CellValue, Date> > rows;
-        for(auto rowName : sampledRows) {
+        for(auto rowName : getSample().sampledRows) {
             auto it = rowIndex.find(rowName);
             if(it == rowIndex.end())
                 throw MLDB::Exception("Unknown row in index");
@@ -338,6 +617,13 @@ getTimestampRange() const
     return itl->getTimestampRange();
 }
 
+double
+SampledDataset::
+getSampledFraction() const
+{
+    return itl->getSampledFraction();
+}
+
 std::shared_ptr<MatrixView>
 SampledDataset::
 getMatrixView() const
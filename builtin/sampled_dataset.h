@@ -17,6 +17,15 @@ namespace MLDB {
 /* SAMPLED DATASET CONFIG                                                    */
 /*****************************************************************************/
         
+/** How the rows of a sampled dataset are chosen. */
+enum SampleMethod {
+    SAMPLE_INDEX,     ///< Random positions in the list of all rows
+    SAMPLE_HASH,      ///< Each row kept or not depending on its hash
+    SAMPLE_RESERVOIR  ///< Exact number of rows picked in one scan
+};
+
+DECLARE_ENUM_DESCRIPTION(SampleMethod);
+
 struct SampledDatasetConfig {
 
     SampledDatasetConfig();
@@ -27,6 +36,7 @@ struct SampledDatasetConfig {
     unsigned rows;
     float fraction;
     bool withReplacement;
+    SampleMethod method;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(SampledDatasetConfig);
@@ -53,6 +63,8 @@ struct SampledDataset: public Dataset {
 
     virtual std::pair<Date, Date> getTimestampRange() const;
 
+    virtual double getSampledFraction() const;
+
     virtual std::shared_ptr<MatrixView> getMatrixView() const;
     virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
 
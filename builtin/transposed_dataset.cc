@@ -11,6 +11,13 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
+#include "mldb/base/parallel.h"
+#include "mldb/jml/utils/environment.h"
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 
@@ -32,9 +39,262 @@ TransposedDatasetConfigDescription()
 
     addField("dataset", &TransposedDatasetConfig::dataset,
              "Dataset to transpose");
+    addField("cacheIndex", &TransposedDatasetConfig::cacheIndex,
+             "If true, the columns of the dataset are read into memory the "
+             "first time that they are needed, and kept until the dataset "
+             "is committed to again.  This only applies to datasets that "
+             "keep track of their commits, such as tabular datasets.",
+             true);
 }
 
 
+/*****************************************************************************/
+/* TRANSPOSED INDEX                                                          */
+/*****************************************************************************/
+
+namespace {
+
+EnvOption<size_t> MLDB_TRANSPOSED_INDEX_BYTES
+("MLDB_TRANSPOSED_INDEX_BYTES", 1024 * 1024 * 1024);
+
+/** Each flattened column of a dataset with all of its values, which are the
+    rows of the transposed dataset.  Reading a column from the column index
+    of most datasets means scanning all of their rows, so this is built in
+    one pass over the rows.
+*/
+struct TransposedIndex {
+    typedef std::vector<std::tuple<ColumnPath, CellValue, Date> > Values;
+
+    std::vector<RowPath> rowNames;
+    std::unordered_map<RowHash, size_t> rowNumbers;
+    std::vector<Values> rows;
+    size_t bytes = 0;
+
+    const Values * find(const RowHash & row) const
+    {
+        auto it = rowNumbers.find(row);
+        if (it == rowNumbers.end())
+            return nullptr;
+        return &rows[it->second];
+    }
+
+    size_t addRow(const RowPath & rowName)
+    {
+        auto res = rowNumbers.emplace(rowName, rowNames.size());
+        if (res.second) {
+            rowNames.push_back(rowName);
+            rows.emplace_back();
+            bytes += sizeof(RowPath) + rowName.memusage() + sizeof(Values);
+        }
+        return res.first->second;
+    }
+};
+
+/** Build the index over the rows of the dataset in parallel.  Returns null
+    if it would take more than maxBytes.
+*/
+std::shared_ptr<const TransposedIndex>
+buildTransposedIndex(const Dataset & dataset, size_t maxBytes)
+{
+    auto result = std::make_shared<TransposedIndex>();
+    for (auto & c: dataset.getFlattenedColumnNames())
+        result->addRow(c);
+
+    // One value of a column of the dataset.  The number of the row in the
+    // result is filled in if the column is already known.
+    struct Entry {
+        ssize_t rowNumber;
+        RowPath rowName;
+        ColumnPath column;
+        CellValue value;
+        Date ts;
+    };
+
+    size_t numRows = dataset.getMatrixView()->getRowCount();
+    if (numRows == 0)
+        return result;
+
+    // Scan the dataset along the natural divisions of its row stream, or in
+    // fixed size blocks of row names if it doesn't have one
+    std::vector<std::shared_ptr<RowStream> > streams;
+    std::vector<size_t> offsets;
+    std::vector<RowPath> rowNames;
+    auto stream = dataset.getRowStream();
+    if (stream) {
+        streams = stream->parallelize(numRows, RowStream::AUTO, &offsets);
+    }
+    else {
+        static constexpr size_t ROWS_PER_BLOCK = 1024;
+        rowNames = dataset.getMatrixView()->getRowPaths();
+        numRows = rowNames.size();
+        for (size_t i = 0;  i < numRows;  i += ROWS_PER_BLOCK)
+            offsets.push_back(i);
+        offsets.push_back(numRows);
+    }
+
+    size_t numBlocks = offsets.size() - 1;
+    std::vector<std::vector<Entry> > blocks(numBlocks);
+    std::atomic<size_t> bytes(result->bytes);
+
+    auto doBlock = [&] (size_t b) -> bool
+        {
+            std::vector<Entry> & block = blocks[b];
+
+            for (size_t i = offsets[b];  i < offsets[b + 1];  ++i) {
+                RowPath rowName
+                    = streams.empty() ? rowNames[i] : streams[b]->next();
+                ExpressionValue row = dataset.getRowExpr(rowName);
+
+                size_t rowBytes = 0;
+                auto onAtom = [&] (const Path & columnName,
+                                   const Path & prefix,
+                                   const CellValue & val,
+                                   Date ts)
+                    {
+                        ColumnPath column = prefix + columnName;
+                        auto it = result->rowNumbers.find(column);
+                        Entry entry{ -1, rowName, ColumnPath(), val, ts };
+                        if (it == result->rowNumbers.end())
+                            entry.column = std::move(column);
+                        else entry.rowNumber = it->second;
+                        rowBytes += sizeof(std::tuple<ColumnPath, CellValue, Date>)
+                            + rowName.memusage() + val.memusage();
+                        block.emplace_back(std::move(entry));
+                        return true;
+                    };
+
+                row.forEachAtom(onAtom);
+
+                if ((bytes += rowBytes) > maxBytes)
+                    return false;
+            }
+
+            return true;
+        };
+
+    if (!parallelMapHaltable(0, numBlocks, doBlock))
+        return nullptr;
+
+    // Put the values in the order of the rows they came from
+    for (auto & block: blocks) {
+        for (auto & entry: block) {
+            size_t rowNumber = entry.rowNumber;
+            if (entry.rowNumber == -1)
+                rowNumber = result->addRow(entry.column);
+            result->rows[rowNumber].emplace_back(std::move(entry.rowName),
+                                                 std::move(entry.value),
+                                                 entry.ts);
+        }
+        block = std::vector<Entry>();
+    }
+
+    result->bytes = bytes;
+    return result;
+}
+
+/** Indexes shared between the transposed datasets over the same dataset,
+    such as those made by repeated queries over transpose(), with the
+    least recently used at the back.  An entry without an index records
+    that the dataset was too big to index at that generation.
+*/
+struct TransposedIndexCache {
+    struct Entry {
+        const Dataset * key = nullptr;
+        std::weak_ptr<Dataset> dataset;
+        uint64_t generation = 0;
+        std::shared_ptr<const TransposedIndex> index;
+        size_t bytes = 0;
+    };
+
+    std::mutex mutex;
+    std::list<Entry> entries;
+    std::map<const Dataset *, std::list<Entry>::iterator> lookup;
+    size_t bytes = 0;
+
+    /// Held while an index is built, so that the threads of a query which
+    /// all need it at once only build it once
+    std::mutex buildMutex;
+
+    void erase(std::list<Entry>::iterator it)
+    {
+        bytes -= it->bytes;
+        lookup.erase(it->key);
+        entries.erase(it);
+    }
+
+    /// Look for the index of the dataset at the given generation.  Returns
+    /// true if there is an entry, setting index to its index.
+    bool find(const std::shared_ptr<Dataset> & dataset, uint64_t generation,
+              std::shared_ptr<const TransposedIndex> & index)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = lookup.find(dataset.get());
+        if (it == lookup.end())
+            return false;
+        Entry & entry = *it->second;
+        if (entry.generation != generation
+            || entry.dataset.lock() != dataset) {
+            erase(it->second);
+            return false;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        index = entry.index;
+        return true;
+    }
+};
+
+TransposedIndexCache & transposedIndexCache()
+{
+    static TransposedIndexCache cache;
+    return cache;
+}
+
+/** Return the index of the dataset at the given generation, building it
+    if this is the first time it is needed.  Returns null if it is too big
+    to index.  The generation must be read before calling, so that if the
+    dataset is committed to while we scan it, the index isn't found again
+    under the later one.
+*/
+std::shared_ptr<const TransposedIndex>
+getTransposedIndex(const std::shared_ptr<Dataset> & dataset,
+                   uint64_t generation)
+{
+    size_t maxBytes = MLDB_TRANSPOSED_INDEX_BYTES;
+    if (maxBytes == 0)
+        return nullptr;
+
+    TransposedIndexCache & cache = transposedIndexCache();
+    std::shared_ptr<const TransposedIndex> result;
+    if (cache.find(dataset, generation, result))
+        return result;
+
+    std::unique_lock<std::mutex> buildGuard(cache.buildMutex);
+    if (cache.find(dataset, generation, result))
+        return result;
+
+    result = buildTransposedIndex(*dataset, maxBytes);
+
+    TransposedIndexCache::Entry entry;
+    entry.key = dataset.get();
+    entry.dataset = dataset;
+    entry.generation = generation;
+    entry.index = result;
+    entry.bytes = result ? result->bytes : 0;
+
+    std::unique_lock<std::mutex> guard(cache.mutex);
+    cache.bytes += entry.bytes;
+    cache.entries.emplace_front(std::move(entry));
+    cache.lookup[dataset.get()] = cache.entries.begin();
+
+    while (cache.bytes > maxBytes)
+        cache.erase(std::prev(cache.entries.end()));
+
+    return result;
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* TRANSPOSED INTERNAL REPRESENTATION                                        */
 /*****************************************************************************/
@@ -50,12 +310,48 @@ struct TransposedDataset::Itl
     std::shared_ptr<ColumnIndex> index;
     size_t columnCount;
 
-    Itl(MldbServer * server, std::shared_ptr<Dataset> dataset)
+    /// Do we keep the columns of the dataset in memory once read?
+    bool cacheIndex;
+
+    /// Index last returned by getIndex(), so that most calls don't need
+    /// to go to the shared cache
+    struct CurrentIndex {
+        uint64_t generation;
+        std::shared_ptr<const TransposedIndex> index;
+    };
+
+    mutable std::shared_ptr<const CurrentIndex> currentIndex;
+
+    Itl(MldbServer * server, std::shared_ptr<Dataset> dataset,
+        bool cacheIndex)
         : dataset(dataset),
           matrix(dataset->getMatrixView()),
           index(dataset->getColumnIndex()),
-          columnCount(dataset->getFlattenedColumnCount())
+          columnCount(dataset->getFlattenedColumnCount()),
+          cacheIndex(cacheIndex)
+    {
+    }
+
+    /** Return the in-memory index of the columns of the dataset, or null
+        if there isn't one, in which case the dataset is asked directly.
+    */
+    std::shared_ptr<const TransposedIndex> getIndex() const
     {
+        if (!cacheIndex)
+            return nullptr;
+        uint64_t generation = dataset->getGeneration();
+        if (generation == 0)
+            return nullptr;
+
+        auto current = std::atomic_load(&currentIndex);
+        if (current && current->generation == generation)
+            return current->index;
+
+        auto result = getTransposedIndex(dataset, generation);
+        std::atomic_store(&currentIndex,
+                          std::make_shared<const CurrentIndex>
+                          (CurrentIndex{ generation, result }));
+        return result;
     }
 
     struct TransposedRowStream : public RowStream {
@@ -63,17 +359,34 @@ struct TransposedDataset::Itl
         TransposedRowStream(TransposedDataset::Itl* source) : source(source)
         {
             matrix = source->matrix;
-            columns = matrix->getColumnPaths();
-            column_iterator = columns.begin();
+            transposedIndex = source->getIndex();
+            if (!transposedIndex)
+                columns = matrix->getColumnPaths();
+            column_iterator = getColumns().begin();
+        }
+
+        TransposedRowStream(const TransposedRowStream & other)
+            : matrix(other.matrix),
+              source(other.source),
+              transposedIndex(other.transposedIndex)
+        {
+            if (!transposedIndex)
+                columns = matrix->getColumnPaths();
+            column_iterator = getColumns().begin();
+        }
+
+        const vector<ColumnPath> & getColumns() const
+        {
+            return transposedIndex ? transposedIndex->rowNames : columns;
         }
 
         virtual std::shared_ptr<RowStream> clone() const{
-            auto ptr = std::make_shared<TransposedRowStream>(source);
+            auto ptr = std::make_shared<TransposedRowStream>(*this);
             return ptr;
         }
 
         virtual void initAt(size_t start){
-            column_iterator = column_iterator + start;
+            column_iterator = getColumns().begin() + start;
         }
 
         virtual RowPath next() {
@@ -96,6 +409,9 @@ struct TransposedDataset::Itl
         vector<ColumnPath> columns;
         std::shared_ptr<MatrixView> matrix;
         TransposedDataset::Itl* source;
+
+        /// If set, the columns come from here instead
+        std::shared_ptr<const TransposedIndex> transposedIndex;
     };
 
     static RowHash colToRow(ColumnHash col)
@@ -175,6 +491,17 @@ struct TransposedDataset::Itl
     virtual std::vector<RowPath>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const
     {
+        auto transposedIndex = getIndex();
+        if (transposedIndex) {
+            const auto & names = transposedIndex->rowNames;
+            size_t first = std::min<size_t>(start, names.size());
+            size_t last = names.size();
+            if (limit != -1)
+                last = std::min<size_t>(last, first + limit);
+            return vector<RowPath>(names.begin() + first,
+                                   names.begin() + last);
+        }
+
         vector<ColumnPath> cols = dataset->getFlattenedColumnNames();
 
         vector<RowPath> result;
@@ -199,6 +526,9 @@ struct TransposedDataset::Itl
 
     virtual bool knownRow(const RowPath & rowName) const
     {
+        auto transposedIndex = getIndex();
+        if (transposedIndex)
+            return transposedIndex->find(rowName);
         return index->knownColumn(rowToCol(rowName));
     }
 
@@ -219,6 +549,17 @@ struct TransposedDataset::Itl
 
     virtual MatrixNamedRow getRow(const RowPath & rowName) const
     {
+        auto transposedIndex = getIndex();
+        if (transposedIndex) {
+            if (auto values = transposedIndex->find(rowName)) {
+                MatrixNamedRow result;
+                result.rowName = rowName;
+                result.rowHash = rowName;
+                result.columns = *values;
+                return result;
+            }
+        }
+
         MatrixColumn col = index->getColumn(rowToCol(rowName));
         MatrixNamedRow result;
         result.rowName = colToRow(std::move(col.columnName));
@@ -229,6 +570,12 @@ struct TransposedDataset::Itl
 
     virtual ExpressionValue getRowExpr(const RowPath & rowName) const
     {
+        auto transposedIndex = getIndex();
+        if (transposedIndex) {
+            if (auto values = transposedIndex->find(rowName))
+                return ExpressionValue(*values);
+        }
+
         MatrixColumn col = index->getColumn(rowToCol(rowName));
         return std::move(col.rows);
     }
@@ -298,6 +645,9 @@ struct TransposedDataset::Itl
 
     virtual size_t getRowCount() const
     {
+        auto transposedIndex = getIndex();
+        if (transposedIndex)
+            return transposedIndex->rowNames.size();
         return dataset->getFlattenedColumnCount();
     }
 
@@ -330,7 +680,7 @@ TransposedDataset(MldbServer * owner,
     std::shared_ptr<Dataset> dataset = obtainDataset(owner, mergeConfig.dataset,
                                                      onProgress);
 
-    itl.reset(new Itl(server, dataset));
+    itl.reset(new Itl(server, dataset, mergeConfig.cacheIndex));
 }
 
 TransposedDataset::
@@ -338,7 +688,7 @@ TransposedDataset(MldbServer * owner,
                   std::shared_ptr<Dataset> dataset)
     : Dataset(owner)
 {
-    itl.reset(new Itl(server, dataset));
+    itl.reset(new Itl(server, dataset, true /* cacheIndex */));
 }
 
 TransposedDataset::
@@ -360,6 +710,13 @@ getTimestampRange() const
     return itl->getTimestampRange();
 }
 
+uint64_t
+TransposedDataset::
+getGeneration() const
+{
+    return itl->dataset->getGeneration();
+}
+
 std::shared_ptr<MatrixView>
 TransposedDataset::
 getMatrixView() const
@@ -18,7 +18,13 @@ namespace MLDB {
 /*****************************************************************************/
 
 struct TransposedDatasetConfig {
+    TransposedDatasetConfig()
+        : cacheIndex(true)
+    {
+    }
+
     PolyConfigT<const Dataset> dataset;
+    bool cacheIndex;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(TransposedDatasetConfig);
@@ -44,6 +50,9 @@ struct TransposedDataset: public Dataset {
 
     virtual std::pair<Date, Date> getTimestampRange() const;
 
+    /** The transposition changes whenever the underlying dataset does. */
+    virtual uint64_t getGeneration() const;
+
     virtual std::shared_ptr<MatrixView> getMatrixView() const;
     virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
     virtual std::shared_ptr<RowStream> getRowStream() const;
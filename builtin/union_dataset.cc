@@ -121,9 +121,79 @@ struct UnionDataset::Itl
         return idx;
     }
 
+    /** Stream over the rows of one part of a child dataset, as returned
+        by the parallelize() of the child's row stream, which prefixes
+        the row names with the index of the child within the union.
+    */
+    struct UnionChildRowStream : public RowStream {
+
+        UnionChildRowStream(size_t datasetIndex,
+                            std::shared_ptr<RowStream> stream)
+            : datasetIndex(datasetIndex), stream(std::move(stream))
+        {
+        }
+
+        virtual std::shared_ptr<RowStream> clone() const override
+        {
+            return make_shared<UnionChildRowStream>(datasetIndex,
+                                                    stream->clone());
+        }
+
+        virtual void initAt(size_t start) override
+        {
+            stream->initAt(start);
+        }
+
+        virtual RowPath next() override
+        {
+            return PathElement(datasetIndex) + stream->next();
+        }
+
+        virtual const RowPath & rowName(RowPath & storage) const override
+        {
+            RowPath sub = stream->rowName(storage);
+            return storage = PathElement(datasetIndex) + sub;
+        }
+
+        virtual bool supportsExtendedInterface() const override
+        {
+            return stream->supportsExtendedInterface();
+        }
+
+        virtual void advance() override
+        {
+            stream->advance();
+        }
+
+        virtual void advanceBy(size_t n) override
+        {
+            stream->advanceBy(n);
+        }
+
+        virtual void
+        extractColumns(size_t numRows,
+                       const std::vector<ColumnPath> & columnNames,
+                       CellValue * output) override
+        {
+            stream->extractColumns(numRows, columnNames, output);
+        }
+
+        virtual void
+        extractNumbers(size_t numRows,
+                       const std::vector<ColumnPath> & columnNames,
+                       double * output) override
+        {
+            stream->extractNumbers(numRows, columnNames, output);
+        }
+
+        size_t datasetIndex;
+        std::shared_ptr<RowStream> stream;
+    };
+
     struct UnionRowStream : public RowStream {
 
-        UnionRowStream(const UnionDataset::Itl* source) : source(source), datasetIndex(0)
+        UnionRowStream(const UnionDataset::Itl* source)
+            : source(source), datasetIndex(0), subRowIndex(0), subNumRow(0)
         {
         }
 
@@ -135,35 +205,21 @@ struct UnionDataset::Itl
         /* set where the stream should start*/
         virtual void initAt(size_t start) override
         {
-            datasetIndex = 0;
-            size_t currentTotal = 0;
-            std::shared_ptr<Dataset> currentDataset = source->datasets[0];
-            size_t currentRowCount = currentDataset->getRowCount();
-            while (currentTotal + currentRowCount < start) {
-                currentTotal += currentRowCount;
-                ++datasetIndex;
-                currentDataset = source->datasets[datasetIndex];
-                currentRowCount = currentDataset->getRowCount();
+            size_t index = 0;
+            size_t rowCount = source->datasets[0]->getRowCount();
+            while (start >= rowCount && index + 1 < source->datasets.size()) {
+                start -= rowCount;
+                ++index;
+                rowCount = source->datasets[index]->getRowCount();
             }
-            currentSubRowStream = currentDataset->getRowStream();
-            subRowIndex = start - currentTotal;
-            currentSubRowStream->initAt(subRowIndex);
-            subNumRow = currentRowCount;
+            startDataset(index, start, rowCount);
         }
 
         virtual RowPath next() override
         {
             RowPath mynext = PathElement(datasetIndex) + currentSubRowStream->next();
             ++subRowIndex;
-            if (subRowIndex == subNumRow) {
-                ++datasetIndex;
-                if (datasetIndex < source->datasets.size()) {
-                    currentSubRowStream = source->datasets[datasetIndex]->getRowStream();
-                    currentSubRowStream->initAt(0);
-                    subRowIndex = 0;
-                    subNumRow = source->datasets[datasetIndex]->getRowCount();
-                }
-            }
+            nextDatasetIfDone();
             return mynext;
         }
 
@@ -173,6 +229,153 @@ struct UnionDataset::Itl
             return storage = PathElement(datasetIndex) + sub;
         }
 
+        /** Split into the parallel streams of each of the datasets, one
+            after the other, so that the union parallelizes along the
+            same natural boundaries as the datasets that it is made of.
+            When a number of streams is asked for, it is shared between
+            the datasets according to their number of rows.
+        */
+        virtual std::vector<std::shared_ptr<RowStream> >
+        parallelize(int64_t rowStreamTotalRows,
+                    ssize_t approxNumberOfChildStreams,
+                    std::vector<size_t> * streamOffsets) const override
+        {
+            ExcAssert(rowStreamTotalRows > 0);
+
+            std::vector<std::shared_ptr<RowStream> > streams;
+            if (streamOffsets)
+                streamOffsets->clear();
+
+            size_t startAt = 0;
+            for (size_t i = 0;  i < source->datasets.size();  ++i) {
+                size_t rowCount = source->datasets[i]->getRowCount();
+                if (rowCount == 0)
+                    continue;
+
+                ssize_t numChildStreams = AUTO;
+                if (approxNumberOfChildStreams != AUTO) {
+                    numChildStreams
+                        = std::max<ssize_t>
+                        (1, approxNumberOfChildStreams * rowCount
+                            / rowStreamTotalRows);
+                }
+
+                std::vector<size_t> childOffsets;
+                auto childStreams = source->datasets[i]->getRowStream()
+                    ->parallelize(rowCount, numChildStreams, &childOffsets);
+                ExcAssertEqual(childOffsets.size(), childStreams.size() + 1);
+
+                for (size_t j = 0;  j < childStreams.size();  ++j) {
+                    if (streamOffsets)
+                        streamOffsets->push_back(startAt + childOffsets[j]);
+                    streams.emplace_back
+                        (std::make_shared<UnionChildRowStream>
+                         (i, std::move(childStreams[j])));
+                }
+
+                startAt += rowCount;
+            }
+
+            if (streamOffsets)
+                streamOffsets->push_back(startAt);
+
+            ExcAssertEqual(startAt, rowStreamTotalRows);
+
+            return streams;
+        }
+
+        virtual bool supportsExtendedInterface() const override
+        {
+            for (auto & d: source->datasets) {
+                auto stream = d->getRowStream();
+                if (!stream || !stream->supportsExtendedInterface())
+                    return false;
+            }
+            return true;
+        }
+
+        virtual void advance() override
+        {
+            currentSubRowStream->advance();
+            ++subRowIndex;
+            nextDatasetIfDone();
+        }
+
+        virtual void advanceBy(size_t n) override
+        {
+            forEachPart(n, [&] (size_t partRows)
+                        {
+                            currentSubRowStream->advanceBy(partRows);
+                        });
+        }
+
+        virtual void
+        extractColumns(size_t numRows,
+                       const std::vector<ColumnPath> & columnNames,
+                       CellValue * output) override
+        {
+            forEachPart(numRows, [&] (size_t partRows)
+                        {
+                            currentSubRowStream->extractColumns
+                                (partRows, columnNames, output);
+                            output += partRows * columnNames.size();
+                        });
+        }
+
+        virtual void
+        extractNumbers(size_t numRows,
+                       const std::vector<ColumnPath> & columnNames,
+                       double * output) override
+        {
+            forEachPart(numRows, [&] (size_t partRows)
+                        {
+                            currentSubRowStream->extractNumbers
+                                (partRows, columnNames, output);
+                            output += partRows * columnNames.size();
+                        });
+        }
+
+        /// Start streaming the given dataset at the given row
+        void startDataset(size_t index, size_t rowIndex, size_t rowCount)
+        {
+            datasetIndex = index;
+            subRowIndex = rowIndex;
+            subNumRow = rowCount;
+            currentSubRowStream = source->datasets[index]->getRowStream();
+            currentSubRowStream->initAt(rowIndex);
+        }
+
+        /// Once the current dataset is finished, move on to the next one
+        /// that has rows, if there is one
+        void nextDatasetIfDone()
+        {
+            if (subRowIndex < subNumRow)
+                return;
+            for (size_t index = datasetIndex + 1;
+                 index < source->datasets.size();  ++index) {
+                size_t rowCount = source->datasets[index]->getRowCount();
+                if (rowCount > 0) {
+                    startDataset(index, 0, rowCount);
+                    return;
+                }
+            }
+        }
+
+        /// Move forward by n rows, calling onPart with the number of rows
+        /// to take from the current dataset before moving on to the next
+        template<typename Fn>
+        void forEachPart(size_t n, const Fn & onPart)
+        {
+            while (n > 0) {
+                size_t numRows = std::min(n, subNumRow - subRowIndex);
+                ExcAssertGreater(numRows, 0);
+                onPart(numRows);
+                subRowIndex += numRows;
+                n -= numRows;
+                nextDatasetIfDone();
+            }
+        }
+
         const UnionDataset::Itl* source;
         size_t datasetIndex;
         size_t subRowIndex;
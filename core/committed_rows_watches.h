@@ -0,0 +1,85 @@
+/** committed_rows_watches.h                                       -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Functions that are called with the rows committed to a dataset, for the
+    implementation of Dataset::watchCommittedRows().
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include <map>
+#include <mutex>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COMMITTED ROWS WATCHES                                                    */
+/*****************************************************************************/
+
+/** Set of the functions watching a dataset for committed rows.  Each is
+    kept until the handle returned when it's added is destroyed, which can
+    be done from within the function itself.  Once the handle has been
+    destroyed, the function is no longer running and won't be called again.
+*/
+
+struct CommittedRowsWatches {
+
+    CommittedRowsWatches()
+        : itl(std::make_shared<Itl>())
+    {
+    }
+
+    std::shared_ptr<void> add(Dataset::OnCommittedRows onRows)
+    {
+        std::unique_lock<std::recursive_mutex> guard(itl->mutex);
+        uint64_t id = itl->nextId++;
+        itl->watches[id] = std::move(onRows);
+
+        // The handle holds the list, so it can be destroyed after the
+        // dataset that it watches
+        std::shared_ptr<Itl> list = itl;
+        auto remove = [list, id] (void *)
+            {
+                std::unique_lock<std::recursive_mutex> guard(list->mutex);
+                list->watches.erase(id);
+            };
+        return std::shared_ptr<void>(nullptr, remove);
+    }
+
+    bool empty() const
+    {
+        std::unique_lock<std::recursive_mutex> guard(itl->mutex);
+        return itl->watches.empty();
+    }
+
+    /** Call each of the functions with the rows.  This holds the lock, so
+        that handles destroyed on other threads wait until it's done.
+    */
+    void trigger(const std::shared_ptr<Dataset> & rows) const
+    {
+        std::unique_lock<std::recursive_mutex> guard(itl->mutex);
+        // Functions may remove watches, so the next one is looked up by id
+        for (uint64_t next = 0;;) {
+            auto it = itl->watches.lower_bound(next);
+            if (it == itl->watches.end())
+                break;
+            next = it->first + 1;
+            auto fn = it->second;
+            fn(rows);
+        }
+    }
+
+private:
+    struct Itl {
+        std::recursive_mutex mutex;
+        uint64_t nextId = 0;
+        std::map<uint64_t, Dataset::OnCommittedRows> watches;
+    };
+
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
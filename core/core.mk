@@ -5,6 +5,8 @@ LIBMLDB_CORE_SOURCES:= \
 	recorder.cc \
 	function.cc \
 	value_function.cc \
+	memory_account.cc \
+	run_progress.cc \
 
 LIBMLDB_CORE_LINK:= \
 	sql_expression rest_entity rest
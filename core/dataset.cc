@@ -10,6 +10,7 @@
 #include "mldb/core/dataset.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/table_expression_operations.h"
 #include "mldb/types/tuple_description.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/server/analytics.h"
@@ -21,6 +22,8 @@
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/server/bucket.h"
 #include "mldb/server/parallel_merge_sort.h"
+#include "mldb/server/query_spill.h"
+#include "mldb/core/memory_account.h"
 #include "mldb/jml/utils/environment.h"
 #include "mldb/ml/jml/buckets.h"
 #include "mldb/base/parallel.h"
@@ -279,6 +282,191 @@ getRowColumnCount(const RowPath & row) const
 }
 
 
+/*****************************************************************************/
+/* COLUMN VALUE SET                                                          */
+/*****************************************************************************/
+
+namespace {
+
+/// Sets smaller than this are only held in the hash set
+static constexpr size_t MIN_BLOOM_FILTER_VALUES = 64;
+
+/// Bloom filter bits per value, which with three probes gives about a
+/// 3% false positive rate
+static constexpr size_t BLOOM_FILTER_BITS_PER_VALUE = 8;
+
+/// Bit positions to probe in the Bloom filter for a value, from its hash
+template<typename Fn>
+bool forEachBloomBit(uint64_t hash, uint64_t mask, Fn && onBit)
+{
+    // Double hashing; the second hash is made odd so that the probes
+    // don't coincide
+    uint64_t h1 = hash;
+    uint64_t h2 = ((hash >> 32) | (hash << 32)) * 0x9e3779b97f4a7c15ULL | 1;
+    for (unsigned i = 0;  i < 3;  ++i) {
+        if (!onBit((h1 + i * h2) & mask))
+            return false;
+    }
+    return true;
+}
+
+} // file scope
+
+ColumnValueSet::
+ColumnValueSet(std::vector<CellValue> valuesIn)
+    : bloomMask(0)
+{
+    values.reserve(valuesIn.size());
+    for (auto & v: valuesIn) {
+        if (v.empty())
+            continue;
+        if (minValue.empty() || v < minValue)
+            minValue = v;
+        if (maxValue.empty() || maxValue < v)
+            maxValue = v;
+        values.insert(std::move(v));
+    }
+
+    if (values.size() < MIN_BLOOM_FILTER_VALUES)
+        return;
+
+    size_t numBits = 64;
+    while (numBits < values.size() * BLOOM_FILTER_BITS_PER_VALUE)
+        numBits *= 2;
+    bloomMask = numBits - 1;
+    bloomBits.resize(numBits / 64);
+
+    for (auto & v: values) {
+        forEachBloomBit(v.hash(), bloomMask, [&] (uint64_t bit)
+                        {
+                            bloomBits[bit / 64] |= 1ULL << (bit % 64);
+                            return true;
+                        });
+    }
+}
+
+bool
+ColumnValueSet::
+contains(const CellValue & value) const
+{
+    if (!bloomBits.empty()
+        && !forEachBloomBit(value.hash(), bloomMask, [&] (uint64_t bit)
+                            {
+                                return bloomBits[bit / 64] & (1ULL << (bit % 64));
+                            }))
+        return false;
+    return values.count(value);
+}
+
+
+/*****************************************************************************/
+/* COLUMN PREDICATE                                                          */
+/*****************************************************************************/
+
+bool
+ColumnPredicate::
+matches(const CellValue & value) const
+{
+    if (value.empty())
+        return false;
+
+    switch (op) {
+    case EQUAL:         return value == values.at(0);
+    case LESS:          return value <  values.at(0);
+    case LESS_EQUAL:    return value <= values.at(0);
+    case GREATER:       return value >  values.at(0);
+    case GREATER_EQUAL: return value >= values.at(0);
+    case IN:
+        for (auto & v: values) {
+            if (value == v)
+                return true;
+        }
+        return false;
+    case BETWEEN:
+        return value >= values.at(0) && value <= values.at(1);
+    case IN_SET:
+        return valueSet->contains(value);
+    }
+
+    throw HttpReturnException(500, "Unknown column predicate operation");
+}
+
+bool
+ColumnPredicate::
+mayMatchRange(const CellValue & minValue, const CellValue & maxValue) const
+{
+    ExcAssert(!minValue.empty() && !maxValue.empty());
+
+    auto inRange = [&] (const CellValue & v)
+        {
+            return !(v < minValue) && !(maxValue < v);
+        };
+
+    switch (op) {
+    case EQUAL:         return inRange(values.at(0));
+    case LESS:          return minValue <  values.at(0);
+    case LESS_EQUAL:    return minValue <= values.at(0);
+    case GREATER:       return maxValue >  values.at(0);
+    case GREATER_EQUAL: return maxValue >= values.at(0);
+    case IN:
+        for (auto & v: values) {
+            if (inRange(v))
+                return true;
+        }
+        return false;
+    case BETWEEN:
+        return maxValue >= values.at(0) && minValue <= values.at(1);
+    case IN_SET:
+        return valueSet->size() != 0
+            && maxValue >= valueSet->minValue
+            && minValue <= valueSet->maxValue;
+    }
+
+    throw HttpReturnException(500, "Unknown column predicate operation");
+}
+
+Utf8String
+ColumnPredicate::
+print() const
+{
+    static const char * const opNames[]
+        = { "=", "<", "<=", ">", ">=", "IN", "BETWEEN", "IN" };
+
+    Utf8String result = columnName.toUtf8String() + " " + opNames[op] + " ";
+    if (op == IN_SET)
+        return result + "(set of " + std::to_string(valueSet->size())
+            + " values)";
+    if (op == BETWEEN)
+        return result + jsonEncodeUtf8(values.at(0)) + " AND "
+            + jsonEncodeUtf8(values.at(1));
+    if (op == IN)
+        result += "(";
+    for (size_t i = 0;  i < values.size();  ++i) {
+        if (i != 0)
+            result += ", ";
+        result += jsonEncodeUtf8(values[i]);
+    }
+    if (op == IN)
+        result += ")";
+    return result;
+}
+
+
+/*****************************************************************************/
+/* GEO DISTANCE PREDICATE                                                    */
+/*****************************************************************************/
+
+Utf8String
+GeoDistancePredicate::
+print() const
+{
+    return "geo_distance(" + latitudeColumn.toUtf8String() + ", "
+        + longitudeColumn.toUtf8String() + ", " + jsonEncodeUtf8(lat)
+        + ", " + jsonEncodeUtf8(lon) + ") " + (inclusive ? "<= " : "< ")
+        + jsonEncodeUtf8(distance);
+}
+
+
 /*****************************************************************************/
 /* COLUMN INDEX                                                              */
 /*****************************************************************************/
@@ -322,6 +510,15 @@ getColumnStats(const ColumnPath & column, ColumnStats & stats) const
         stats.values[v].rowCount_ += 1;
     }
 
+    // Values are ordered with nulls first
+    auto it = stats.values.begin();
+    if (it != stats.values.end() && it->first.empty())
+        ++it;
+    if (it != stats.values.end()) {
+        stats.minValue_ = it->first;
+        stats.maxValue_ = stats.values.rbegin()->first;
+    }
+
     stats.isNumeric_ = isNumeric && !col.empty();
     stats.rowCount_ = rows.size();
     stats.atMostOne_ = oneOnly;
@@ -370,6 +567,29 @@ getColumnValues(const ColumnPath & column,
     return result;
 }
 
+bool
+ColumnIndex::
+forEachColumnValue(const ColumnPath & column,
+                   const OnColumnValue & onValue,
+                   bool processInParallel) const
+{
+    auto col = getColumn(column);
+
+    for (auto & r: col.rows) {
+        if (!onValue(std::get<0>(r), std::get<1>(r), std::get<2>(r)))
+            return false;
+    }
+
+    return true;
+}
+
+bool
+ColumnIndex::
+columnHasOneValuePerRow(const ColumnPath & column) const
+{
+    return false;
+}
+
 std::vector<CellValue>
 ColumnIndex::
 getColumnDense(const ColumnPath & column) const
@@ -608,6 +828,21 @@ getTimestampRange() const
     return result;
 }
 
+Json::Value
+Dataset::
+getMemoryUsage() const
+{
+    throw HttpReturnException(400, "Dataset type '" + getType()
+                              + "' doesn't report its memory usage");
+}
+
+double
+Dataset::
+getSampledFraction() const
+{
+    return 1.0;
+}
+
 Date
 Dataset::
 quantizeTimestamp(Date timestamp) const
@@ -784,6 +1019,61 @@ getRowExpr(const RowPath & row) const
     return std::move(flattened.columns);
 }
 
+std::function<ExpressionValue (const RowPath & row)>
+Dataset::
+getProjectedRowExpr(const std::vector<ColumnPath> & columns) const
+{
+    return [=] (const RowPath & row) { return this->getRowExpr(row); };
+}
+
+ExpressionValue
+Dataset::
+getRowEmbedding(const RowPath & row,
+                const std::vector<ColumnPath> & columns,
+                StorageType storage) const
+{
+    if (storage != ST_FLOAT32 && storage != ST_FLOAT64)
+        throw HttpReturnException(400, "Row embeddings must be of type "
+                                  "float32 or float64");
+
+    std::unordered_map<ColumnPath, size_t> index;
+    for (size_t i = 0;  i < columns.size();  ++i)
+        index.emplace(columns[i], i);
+
+    std::vector<double> values(columns.size(),
+                               std::numeric_limits<double>::quiet_NaN());
+    std::vector<Date> valueTs(columns.size(), Date::negativeInfinity());
+    Date ts = Date::negativeInfinity();
+
+    // The latest value of each column is the one that is kept
+    auto onAtom = [&] (Path & columnName, CellValue & val, Date atomTs)
+        {
+            auto it = index.find(columnName);
+            if (it != index.end() && !val.empty()
+                && atomTs >= valueTs[it->second]) {
+                values[it->second] = val.toDouble();
+                valueTs[it->second] = atomTs;
+            }
+            ts.setMax(atomTs);
+            return true;
+        };
+
+    ExpressionValue expr = getRowExpr(row);
+    expr.forEachAtomDestructive(onAtom);
+
+    if (storage == ST_FLOAT32)
+        return ExpressionValue(std::vector<float>(values.begin(), values.end()),
+                               ts);
+    return ExpressionValue(std::move(values), ts);
+}
+
+std::pair<Date, Date>
+Dataset::
+getRowTimestampRange(const RowPath & row) const
+{
+    return { Date::notADate(), Date::notADate() };
+}
+
 std::vector<MatrixNamedRow>
 Dataset::
 queryStructured(const SelectExpression & select,
@@ -836,6 +1126,10 @@ queryStructuredExpr(const SelectExpression & select,
     std::vector<NamedRowValue> output;
     std::shared_ptr<ExpressionValueInfo> structureInfo;
 
+    // The output rows are charged to the running query while they are
+    // collected
+    MemoryCharge outputCharge;
+
     if (!having->isConstantTrue() && groupBy.clauses.empty())
         throw HttpReturnException(400, "HAVING expression requires a GROUP BY expression");
 
@@ -857,6 +1151,8 @@ queryStructuredExpr(const SelectExpression & select,
             {
                 row_.rowName = getValidatedRowName(calc.at(0));
                 row_.rowHash = row_.rowName;
+                if (outputCharge.active())
+                    outputCharge.add(namedRowValueMemusage(row_));
                 output.push_back(std::move(row_));
                 return true;
             };
@@ -877,6 +1173,8 @@ queryStructuredExpr(const SelectExpression & select,
         // Otherwise do it grouped...
         auto processor = [&] (NamedRowValue & row_)
             {
+                if (outputCharge.active())
+                    outputCharge.add(namedRowValueMemusage(row_));
                 output.push_back(std::move(row_));
                 return true;
             };
@@ -1017,25 +1315,190 @@ generateFilteredColumnExpression(const Dataset & dataset,
         };
 }
 
-static GenerateRowsWhereFunction
-generateVariableEqualsConstant(const Dataset & dataset,
-                               const Utf8String& alias,
-                               const ReadColumnExpression & variable,
-                               const ConstantExpression & constant)
+bool
+extractColumnPredicate(const Utf8String & alias,
+                       const SqlExpression & where,
+                       ColumnPredicate & predicate)
 {
-    ColumnPath columnName(removeTableName(alias,variable.columnName));
-    CellValue constantValue(constant.constant.getAtom());
+    auto getVariable = [] (const SqlExpression & expression)
+        {
+            return dynamic_cast<const ReadColumnExpression *>(&expression);
+        };
 
-    auto filter = [=] (const CellValue & val)
+    // Constants that can be compared against; a null would never match
+    auto getConstant = [] (const SqlExpression & expression, CellValue & value)
         {
-            return val == constantValue;
+            auto constant
+                = dynamic_cast<const ConstantExpression *>(&expression);
+            if (!constant || !constant->constant.isAtom()
+                || constant->constant.empty())
+                return false;
+            value = constant->constant.getAtom();
+            return true;
         };
 
-    return generateFilteredColumnExpression
-        (dataset, columnName, filter,
-         "generate rows where var '" + variable.columnName.toUtf8String()
-         + "' matches value '"
-         + constantValue.toString() + "'");
+    if (auto comparison = dynamic_cast<const ComparisonExpression *>(&where)) {
+        static const std::map<std::string, std::pair<ColumnPredicate::Op,
+                                                     ColumnPredicate::Op> >
+            ops = {
+                // op, then op with the arguments reversed
+                { "=",  { ColumnPredicate::EQUAL, ColumnPredicate::EQUAL } },
+                { "==", { ColumnPredicate::EQUAL, ColumnPredicate::EQUAL } },
+                { "<",  { ColumnPredicate::LESS, ColumnPredicate::GREATER } },
+                { "<=", { ColumnPredicate::LESS_EQUAL,
+                          ColumnPredicate::GREATER_EQUAL } },
+                { ">",  { ColumnPredicate::GREATER, ColumnPredicate::LESS } },
+                { ">=", { ColumnPredicate::GREATER_EQUAL,
+                          ColumnPredicate::LESS_EQUAL } }
+            };
+
+        auto it = ops.find(comparison->op);
+        if (it == ops.end())
+            return false;
+
+        CellValue value;
+        const ReadColumnExpression * variable;
+        ColumnPredicate::Op op;
+        if ((variable = getVariable(*comparison->lhs))
+            && getConstant(*comparison->rhs, value)) {
+            op = it->second.first;
+        }
+        else if ((variable = getVariable(*comparison->rhs))
+                 && getConstant(*comparison->lhs, value)) {
+            op = it->second.second;
+        }
+        else return false;
+
+        predicate = ColumnPredicate(removeTableName(alias, variable->columnName),
+                                    op, { value });
+        return true;
+    }
+
+    if (auto in = dynamic_cast<const InExpression *>(&where)) {
+        const ReadColumnExpression * variable = getVariable(*in->expr);
+        if (!variable || in->isNegative || in->kind != InExpression::TUPLE
+            || !in->tuple)
+            return false;
+
+        std::vector<CellValue> values;
+        for (auto & c: in->tuple->clauses) {
+            CellValue value;
+            if (getConstant(*c, value))
+                values.emplace_back(std::move(value));
+            else if (!c->isConstant())
+                return false;
+            // a null constant never matches, so it can be left out
+        }
+
+        predicate = ColumnPredicate(removeTableName(alias, variable->columnName),
+                                    ColumnPredicate::IN, std::move(values));
+        return true;
+    }
+
+    if (auto between = dynamic_cast<const BetweenExpression *>(&where)) {
+        const ReadColumnExpression * variable = getVariable(*between->expr);
+        CellValue lower, upper;
+        if (!variable || between->notBetween
+            || !getConstant(*between->lower, lower)
+            || !getConstant(*between->upper, upper))
+            return false;
+
+        predicate = ColumnPredicate(removeTableName(alias, variable->columnName),
+                                    ColumnPredicate::BETWEEN,
+                                    { std::move(lower), std::move(upper) });
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<const SqlExpression *>
+splitConjunction(const SqlExpression & where)
+{
+    std::vector<const SqlExpression *> result;
+
+    std::function<void (const SqlExpression &)> split
+        = [&] (const SqlExpression & expr)
+        {
+            auto boolean
+                = dynamic_cast<const BooleanOperatorExpression *>(&expr);
+            if (boolean && boolean->op == "AND" && boolean->lhs
+                && boolean->rhs) {
+                split(*boolean->lhs);
+                split(*boolean->rhs);
+            }
+            else if (!expr.isConstantTrue()) {
+                result.push_back(&expr);
+            }
+        };
+
+    split(where);
+    return result;
+}
+
+bool
+extractGeoDistancePredicate(const Utf8String & alias,
+                            const SqlExpression & where,
+                            GeoDistancePredicate & predicate)
+{
+    auto comparison = dynamic_cast<const ComparisonExpression *>(&where);
+    if (!comparison)
+        return false;
+
+    // Numbers that the distance can be compared against
+    auto getNumber = [] (const SqlExpression & expression, double & value)
+        {
+            if (!expression.isConstant())
+                return false;
+            ExpressionValue constant = expression.constantValue();
+            if (!constant.isAtom() || !constant.getAtom().isNumber())
+                return false;
+            value = constant.getAtom().toDouble();
+            return true;
+        };
+
+    const SqlExpression * distance;
+    bool inclusive;
+    if (comparison->op == "<" || comparison->op == "<=") {
+        distance = comparison->lhs.get();
+        inclusive = comparison->op == "<=";
+        if (!getNumber(*comparison->rhs, predicate.distance))
+            return false;
+    }
+    else if (comparison->op == ">" || comparison->op == ">=") {
+        distance = comparison->rhs.get();
+        inclusive = comparison->op == ">=";
+        if (!getNumber(*comparison->lhs, predicate.distance))
+            return false;
+    }
+    else return false;
+
+    auto function = dynamic_cast<const FunctionCallExpression *>(distance);
+    if (!function || function->functionName != "geo_distance"
+        || function->args.size() != 4)
+        return false;
+
+    // The distance is the same with the two points swapped
+    auto & args = function->args;
+    for (int columns: { 0, 2 }) {
+        auto lat = dynamic_cast<const ReadColumnExpression *>
+            (args[columns].get());
+        auto lon = dynamic_cast<const ReadColumnExpression *>
+            (args[columns + 1].get());
+        if (!lat || !lon)
+            continue;
+        int point = 2 - columns;
+        if (!getNumber(*args[point], predicate.lat)
+            || !getNumber(*args[point + 1], predicate.lon))
+            continue;
+
+        predicate.latitudeColumn = removeTableName(alias, lat->columnName);
+        predicate.longitudeColumn = removeTableName(alias, lon->columnName);
+        predicate.inclusive = inclusive;
+        return true;
+    }
+
+    return false;
 }
 
 static GenerateRowsWhereFunction
@@ -1446,6 +1909,51 @@ generateRowsWhere(const SqlBindingScope & scope,
                         GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
             }
 
+            // When only one side can be generated without scanning the
+            // table, evaluate the other side on the rows that it generates
+            bool lhsIndexed
+                = lhsGen.complexity < GenerateRowsWhereFunction::UNFILTERED_TABLESCAN;
+            bool rhsIndexed
+                = rhsGen.complexity < GenerateRowsWhereFunction::UNFILTERED_TABLESCAN;
+
+            if (lhsIndexed || rhsIndexed) {
+                GenerateRowsWhereFunction gen = lhsIndexed ? lhsGen : rhsGen;
+                const SqlExpression & filterExpression
+                    = lhsIndexed ? *boolean->rhs : *boolean->lhs;
+
+                SqlExpressionDatasetScope dsScope(*this, alias);
+                auto filterBound = filterExpression.bind(dsScope);
+                bool needsColumns = filterExpression.getUnbound().needsRow();
+
+                return {[=] (ssize_t numToGenerate, Any token,
+                             const BoundParameters & params,
+                             std::function<bool (const Json::Value &)> onProgress)
+                        -> std::pair<std::vector<RowPath>, Any>
+                        {
+                            auto rows = gen(-1, Any(), params, onProgress).first;
+                            auto matrix = this->getMatrixView();
+
+                            std::vector<RowPath> filtered;
+                            for (auto & r: rows) {
+                                MatrixNamedRow row;
+                                if (needsColumns)
+                                    row = matrix->getRow(r);
+                                else {
+                                    row.rowHash = row.rowName = r;
+                                }
+
+                                auto rowScope = dsScope.getRowScope(row, &params);
+                                if (filterBound(rowScope, GET_LATEST).isTrue())
+                                    filtered.emplace_back(std::move(r));
+                            }
+
+                            return { std::move(filtered), Any() };
+                        },
+                        "filter rows of " + gen.explain + " by "
+                        + filterExpression.print(),
+                        GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+            }
+
         }
         else if (boolean->op == "OR") {
             GenerateRowsWhereFunction lhsGen
@@ -1638,8 +2146,6 @@ generateRowsWhere(const SqlBindingScope & scope,
         auto crhs = getConstant(*comparison->rhs);
         auto flhs = getFunction(*comparison->lhs);
         auto frhs = getFunction(*comparison->rhs);
-        auto vlhs = getVariable(*comparison->lhs);
-        auto vrhs = getVariable(*comparison->rhs);
         auto alhs = getArith(*comparison->lhs);
 
         // Optimization for rowPath() == constant.  In this case, we can generate a
@@ -1789,15 +2295,87 @@ generateRowsWhere(const SqlBindingScope & scope,
             }
         }
 
-        // Optimization for variable == constant
-        if (vlhs && crhs && comparison->op == "=") {
-            return generateVariableEqualsConstant(*this, alias, *vlhs, *crhs);
-        }
-        if (vrhs && clhs && comparison->op == "=") {
-            return generateVariableEqualsConstant(*this, alias, *vrhs, *clhs);
+    }
+
+    // Push column IN (SELECT ...) down into the dataset as a predicate on
+    // the set of values returned by the subquery, so that rows that can't
+    // match are skipped without evaluating the where clause on them.
+    // The subquery is run in a scope of its own, which needs the server.
+    auto in = dynamic_cast<const InExpression *>(&where);
+    if (in && scope.getMldbServer()) {
+        const ReadColumnExpression * variable = getVariable(*in->expr);
+        if (variable && !in->isNegative
+            && in->kind == InExpression::SUBTABLE && in->subtable) {
+            ColumnPredicate predicate
+                (removeTableName(alias, variable->columnName),
+                 ColumnPredicate::IN_SET, {});
+
+            // Ask with an empty set whether the dataset can answer it at
+            // all; the subquery is only run once the rows are generated
+            predicate.valueSet
+                = std::make_shared<ColumnValueSet>(std::vector<CellValue>());
+            GenerateRowsWhereFunction probe
+                = generateRowsWherePredicate(predicate);
+
+            if (probe) {
+                MldbServer * server = scope.getMldbServer();
+                std::shared_ptr<SelectSubtableExpression> subtable
+                    = in->subtable;
+
+                return {[=] (ssize_t numToGenerate, Any token,
+                             const BoundParameters & params,
+                             std::function<bool (const Json::Value &)> onProgress)
+                        {
+                            SqlExpressionMldbScope subtableScope(server);
+                            auto subtableValues
+                                = InExpression::getSubtableValues
+                                (*subtable, subtableScope);
+
+                            // Only atoms can be equal to the value of a
+                            // column
+                            std::vector<CellValue> values;
+                            values.reserve(subtableValues->size());
+                            for (auto & v: *subtableValues) {
+                                if (v.isAtom())
+                                    values.emplace_back(v.getAtom());
+                            }
+                            subtableValues.reset();
+
+                            ColumnPredicate withValues = predicate;
+                            withValues.valueSet
+                                = std::make_shared<ColumnValueSet>
+                                (std::move(values));
+
+                            return this->generateRowsWherePredicate(withValues)
+                                (numToGenerate, token, params, onProgress);
+                        },
+                        "generate rows where "
+                        + variable->columnName.toUtf8String() + " IN ("
+                        + subtable->print() + ") with " + probe.explain,
+                        probe.complexity};
+            }
         }
     }
 
+    // Push simple predicates on a single column down into the dataset
+    ColumnPredicate predicate;
+    if (extractColumnPredicate(alias, where, predicate)) {
+        GenerateRowsWhereFunction generator
+            = generateRowsWherePredicate(predicate);
+        if (generator)
+            return generator;
+    }
+
+    // Push geo_distance(lat, lon, constant, constant) < constant down into
+    // datasets with a spatial index
+    GeoDistancePredicate geoPredicate;
+    if (extractGeoDistancePredicate(alias, where, geoPredicate)) {
+        GenerateRowsWhereFunction generator
+            = generateRowsWithinDistance(geoPredicate);
+        if (generator)
+            return generator;
+    }
+
     auto isType = getIsType(where);
 
     if (isType) {
@@ -1985,6 +2563,37 @@ generateRowsWhere(const SqlBindingScope & scope,
             "scan table filtering by where expression"};
 }
 
+GenerateRowsWhereFunction
+Dataset::
+generateRowsWherePredicate(const ColumnPredicate & predicate) const
+{
+    // The column index returns every value of the column, not just the
+    // latest one for each row.  That gives the same result as the where
+    // clause for equality, but not for ranges, so those are left to the
+    // table scan unless the dataset knows better.
+    if (predicate.op != ColumnPredicate::EQUAL
+        && predicate.op != ColumnPredicate::IN
+        && predicate.op != ColumnPredicate::IN_SET)
+        return GenerateRowsWhereFunction();
+
+    auto filter = [=] (const CellValue & val)
+        {
+            return predicate.matches(val);
+        };
+
+    return generateFilteredColumnExpression
+        (*this, predicate.columnName, filter,
+         "generate rows where " + predicate.print()
+         + " using the column index");
+}
+
+GenerateRowsWhereFunction
+Dataset::
+generateRowsWithinDistance(const GeoDistancePredicate & predicate) const
+{
+    return GenerateRowsWhereFunction();
+}
+
 /**
 
 As queryBasic always sort by the orderby, the result will NOT be deterministic if the orderby
@@ -2088,7 +2697,8 @@ queryBasic(const SqlBindingScope & scope,
                             auto orderByRowScope
                                 = orderByScope.getRowScope(rowScope, outputRow);
                             
-                            sortFields = boundOrderBy.apply(orderByRowScope);
+                            sortFields
+                                = boundOrderBy.applyWithSortKey(orderByRowScope);
                         }
                         else {
                             ExpressionValue selectOutput
@@ -2101,7 +2711,7 @@ queryBasic(const SqlBindingScope & scope,
                                 = orderByScope.getRowScope(rowScope, outputRow);
 
                             sortFields
-                                = boundOrderBy.apply(orderByRowScope);
+                                = boundOrderBy.applyWithSortKey(orderByRowScope);
 
                             
                         }
@@ -2151,7 +2761,8 @@ queryBasic(const SqlBindingScope & scope,
                 auto compareRows = [&] (const SortedRow & row1,
                                         const SortedRow & row2)
                     {
-                        return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
+                        return boundOrderBy.lessWithSortKey(std::get<0>(row1),
+                                                            std::get<0>(row2));
                     };
 
                 parallelQuickSortRecursive<SortedRow>(rowsSorted.begin(), rowsSorted.end(), compareRows);
@@ -2298,6 +2909,23 @@ commit()
 {
 }
 
+uint64_t
+Dataset::
+getGeneration() const
+{
+    return 0;
+}
+
+std::shared_ptr<void>
+Dataset::
+watchCommittedRows(OnCommittedRows onRows)
+{
+    throw HttpReturnException(400, "Dataset type can't tell which rows are "
+                              "added by a commit",
+                              "datasetType",
+                              config_ ? config_->type : Utf8String());
+}
+
 BoundFunction
 Dataset::
 overrideFunction(const Utf8String&,
@@ -15,6 +15,7 @@
 #include "mldb/types/url.h"
 #include "mldb/core/recorder.h"
 #include <set>
+#include <unordered_set>
 
 // NOTE TO MLDB DEVELOPERS: This is an API header file.  No includes
 // should be added, especially value_description.h.
@@ -140,11 +141,186 @@ struct ColumnStats {
 
     std::map<CellValue, CellValueStats> values;
 
+    /// Smallest and largest non-null values of the column; null if the
+    /// column has no values
+    CellValue minValue_;
+    CellValue maxValue_;
+
     bool isNumeric_;
     bool atMostOne_;
     uint64_t rowCount_;
 };
 
+
+/*****************************************************************************/
+/* COLUMN VALUE SET                                                          */
+/*****************************************************************************/
+
+/** Set of values for a predicate that tests against too many of them to
+    compare one by one, such as the values returned by the subquery of
+    column IN (SELECT ...).  Sets with more than a few values put a Bloom
+    filter in front of the hash set, so that most of the values that
+    aren't in the set are rejected from a small bit array that stays in
+    the cache, rather than by a probe of the hash set.
+*/
+
+struct ColumnValueSet {
+    ColumnValueSet(std::vector<CellValue> values);
+
+    /// Is the non-null value one of those in the set?
+    bool contains(const CellValue & value) const;
+
+    size_t size() const { return values.size(); }
+
+    /// Smallest and largest values in the set; null if it's empty
+    CellValue minValue, maxValue;
+
+private:
+    std::unordered_set<CellValue> values;
+
+    /// Bits of the Bloom filter, or empty if there isn't one
+    std::vector<uint64_t> bloomBits;
+
+    /// Number of bits in the Bloom filter, minus one
+    uint64_t bloomMask;
+};
+
+
+/*****************************************************************************/
+/* COLUMN PREDICATE                                                          */
+/*****************************************************************************/
+
+/** A simple predicate on the value of a single column, such as
+    x > 3 or x IN (1, 2, 3).  These are extracted from the where clause and
+    pushed down into the dataset, which can then answer them from its
+    indexes rather than by evaluating the where clause on every row.
+
+    As with the SQL comparison operators, a null value never matches.
+*/
+
+struct ColumnPredicate {
+    enum Op {
+        EQUAL,
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+        IN,             ///< Equal to one of the values
+        BETWEEN,        ///< Between the two values, inclusive
+        IN_SET          ///< Equal to one of the values of valueSet
+    };
+
+    ColumnPredicate()
+        : op(EQUAL)
+    {
+    }
+
+    ColumnPredicate(ColumnPath columnName, Op op,
+                    std::vector<CellValue> values)
+        : columnName(std::move(columnName)), op(op),
+          values(std::move(values))
+    {
+    }
+
+    /// Column on which the predicate operates, relative to the dataset
+    ColumnPath columnName;
+
+    /// Operation that the value is tested with
+    Op op;
+
+    /// Value to compare against; several values for IN, lower and upper
+    /// bound for BETWEEN
+    std::vector<CellValue> values;
+
+    /// Values to compare against for IN_SET
+    std::shared_ptr<const ColumnValueSet> valueSet;
+
+    /// Does the given value match the predicate?
+    bool matches(const CellValue & value) const;
+
+    /** Could the predicate match any value v with minValue <= v <= maxValue?
+        This is used to skip over a block of values from its minimum and
+        maximum only.  Both bounds must be non-null.
+    */
+    bool mayMatchRange(const CellValue & minValue,
+                       const CellValue & maxValue) const;
+
+    /// Return a human readable version, for explanations
+    Utf8String print() const;
+};
+
+/** Extract a predicate on a single column out of a where expression of
+    the form column op constant, constant op column,
+    column IN (constant, ...) or column BETWEEN constant AND constant.
+    The alias is removed from the column name.  Returns false if the
+    expression doesn't have that form.
+*/
+bool extractColumnPredicate(const Utf8String & alias,
+                            const SqlExpression & where,
+                            ColumnPredicate & predicate);
+
+/** Split a where expression into the expressions that are ANDed together
+    at its top level, leaving out those that are constant true.  Datasets
+    that forward queries to an external database use it to push down the
+    parts they can translate, and evaluate the others themselves.  The
+    pointers are into the where expression.
+*/
+std::vector<const SqlExpression *>
+splitConjunction(const SqlExpression & where);
+
+
+/*****************************************************************************/
+/* GEO DISTANCE PREDICATE                                                    */
+/*****************************************************************************/
+
+/** A predicate that the point given by a latitude and a longitude column,
+    in degrees, is within a distance of a fixed point, such as
+    geo_distance(lat, lon, 45.5, -73.6) < 1000.  Distances are in meters,
+    as returned by geo_distance().  Rows where either column is null never
+    match.
+*/
+
+struct GeoDistancePredicate {
+    GeoDistancePredicate()
+        : lat(0), lon(0), distance(0), inclusive(false)
+    {
+    }
+
+    /// Columns holding the point of each row, relative to the dataset
+    ColumnPath latitudeColumn;
+    ColumnPath longitudeColumn;
+
+    /// Point that the distance is measured from
+    double lat;
+    double lon;
+
+    /// Distance to compare against, in meters
+    double distance;
+
+    /// Does a point at exactly the distance match (<= rather than <)?
+    bool inclusive;
+
+    /// Does a point at the given distance from (lat, lon) match?
+    bool matches(double pointDistance) const
+    {
+        return inclusive ? pointDistance <= distance : pointDistance < distance;
+    }
+
+    /// Return a human readable version, for explanations
+    Utf8String print() const;
+};
+
+/** Extract a geo distance predicate out of a where expression of the form
+    geo_distance(column, column, constant, constant) < constant, or the
+    same with <=, with the arguments of geo_distance() in either order or
+    with the comparison reversed.  The alias is removed from the column
+    names.  Returns false if the expression doesn't have that form.
+*/
+bool extractGeoDistancePredicate(const Utf8String & alias,
+                                 const SqlExpression & where,
+                                 GeoDistancePredicate & predicate);
+
+
 /*****************************************************************************/
 /* COLUMN INDEX                                                              */
 /*****************************************************************************/
@@ -198,6 +374,33 @@ struct ColumnIndex {
     getColumnValues(const ColumnPath & column,
                     const std::function<bool (const CellValue &)> & filter = nullptr) const;
 
+    /** Function called by forEachColumnValue() for each value of a column.
+        Returning false stops the iteration.
+    */
+    typedef std::function<bool (const RowPath & row,
+                                const CellValue & value,
+                                Date ts)> OnColumnValue;
+
+    /** Call onValue for each row, value and timestamp of the column, in no
+        particular order, without materializing the column as getColumn()
+        does.  The column is scanned in chunks of rows; if processInParallel
+        is true, several chunks may be scanned at once on different threads
+        and onValue must be thread safe.
+
+        Returns false if onValue stopped the iteration.  Will throw if the
+        column is unknown.  Default implementation is based on getColumn.
+    */
+    virtual bool
+    forEachColumnValue(const ColumnPath & column,
+                       const OnColumnValue & onValue,
+                       bool processInParallel = false) const;
+
+    /** Return true if no row has more than one value for the column, in
+        which case forEachColumnValue() calls onValue at most once per row.
+        Default returns false, as it can't be known without a scan.
+    */
+    virtual bool columnHasOneValuePerRow(const ColumnPath & column) const;
+
     /** Is this column known? */
     virtual bool knownColumn(const ColumnPath & column) const = 0;
 
@@ -507,6 +710,40 @@ struct Dataset: public MldbEntity {
     */
     virtual ExpressionValue getRowExpr(const RowPath & row) const;
 
+    /** Return a function that returns rows as getRowExpr() does, for
+        callers that only read the given columns.  The rows it returns
+        must hold every top level column named by the first element of one
+        of them, so that reading any of the columns gives the same result
+        as on the whole row; they may hold other columns too.  Datasets
+        with columnar storage override it to only decode the columns that
+        are read.  Default returns getRowExpr().
+    */
+    virtual std::function<ExpressionValue (const RowPath & row)>
+    getProjectedRowExpr(const std::vector<ColumnPath> & columns) const;
+
+    /** Return the values of the given columns of a row as an embedding of
+        the given storage type (ST_FLOAT32 or ST_FLOAT64), in the order of
+        the columns, with NaN for those that are missing or null.  This is
+        for callers that only want the row as a vector of numbers; datasets
+        with numeric columnar storage override it to copy the values
+        straight into the embedding rather than building a structured row
+        that would then be flattened again.  Default builds on
+        getRowExpr().
+    */
+    virtual ExpressionValue
+    getRowEmbedding(const RowPath & row,
+                    const std::vector<ColumnPath> & columns,
+                    StorageType storage = ST_FLOAT64) const;
+
+    /** Return the earliest and latest timestamps of the cells of the given
+        row, without reading its values, or notADate() for both if they
+        aren't known.  This allows a query with a WHEN clause to skip the
+        rows whose cells would all be filtered out.  Datasets that index
+        their timestamps override it.  Default returns notADate() for both.
+    */
+    virtual std::pair<Date, Date>
+    getRowTimestampRange(const RowPath & row) const;
+
 
     /** Commit changes to the database.  Default is a no-op.
 
@@ -517,6 +754,31 @@ struct Dataset: public MldbEntity {
     */
     virtual void commit();
 
+    /** Return a number that changes every time that data which was
+        committed to the dataset becomes visible to queries, so that
+        results computed from the dataset can be cached for as long as it
+        stays the same.  Datasets that don't keep track of this return
+        zero, meaning that their results can't be cached.  Default
+        returns zero.
+    */
+    virtual uint64_t getGeneration() const;
+
+    /// Called with a dataset holding rows that were committed
+    typedef std::function<void (const std::shared_ptr<Dataset> & rows)>
+        OnCommittedRows;
+
+    /** Call onRows with a dataset holding just the rows added by each
+        commit, for datasets to which rows are only ever added, so that
+        what is computed from them can be maintained without reading them
+        all again.  It may first be called, before this returns, with the
+        rows that were committed before.  It's called until the returned
+        handle is destroyed, which must be done before this dataset is.
+        Default throws, as the dataset can't tell which rows a commit
+        added.
+    */
+    virtual std::shared_ptr<void>
+    watchCommittedRows(OnCommittedRows onRows);
+
     /** Select from the database. */
     virtual std::vector<MatrixNamedRow>
     queryStructured(const SelectExpression & select,
@@ -530,7 +792,12 @@ struct Dataset: public MldbEntity {
                     ssize_t limit,
                     Utf8String alias = "") const;
 
-    std::tuple<std::vector<NamedRowValue>, std::shared_ptr<ExpressionValueInfo> >
+    /** Select from the database, keeping the structure of the output
+        rows.  This is what queries with a single dataset in their FROM
+        clause run; datasets which can run them better than by iterating
+        over their rows override it.
+    */
+    virtual std::tuple<std::vector<NamedRowValue>, std::shared_ptr<ExpressionValueInfo> >
     queryStructuredExpr(const SelectExpression & select,
                     const WhenExpression & when,
                     const SqlExpression & where,
@@ -632,6 +899,31 @@ struct Dataset: public MldbEntity {
                       ssize_t offset,
                       ssize_t limit) const;
 
+    /** Return a function that generates the rows for which a simple
+        predicate on a single column holds.  This is called by
+        generateRowsWhere() for where clauses (or parts of an AND) that have
+        the form of a comparison or IN between a column and constants.
+
+        Datasets can override to answer from their own indexes and skip
+        over data that can't match.  Returning an empty function means to
+        fall back to scanning the table.  The default implementation
+        filters the values returned by the column index.
+    */
+    virtual GenerateRowsWhereFunction
+    generateRowsWherePredicate(const ColumnPredicate & predicate) const;
+
+    /** Return a function that generates the rows whose point is within a
+        distance of another point.  This is called by generateRowsWhere()
+        for where clauses (or parts of an AND) of the form
+        geo_distance(lat, lon, constant, constant) < constant.
+
+        Datasets with a spatial index can override to answer from it.
+        Returning an empty function, as the default implementation does,
+        means to fall back to scanning the table.
+    */
+    virtual GenerateRowsWhereFunction
+    generateRowsWithinDistance(const GeoDistancePredicate & predicate) const;
+
     /** Perform the guts of a select statement.  This will perform a single-
         table SELECT, with the given WHERE clause, ORDER BY, offset and limit.
         
@@ -691,6 +983,23 @@ struct Dataset: public MldbEntity {
     */
     virtual std::pair<Date, Date> getTimestampRange() const;
 
+    /** Return a breakdown of the memory held by the dataset, which must
+        contain at least a totalBytes field with the number of bytes used.
+        This is what GET /v1/datasets/<id>/memory returns.
+
+        The default throws, as most dataset types either hold no data of
+        their own or have no way of knowing how much memory it takes.
+    */
+    virtual Json::Value getMemoryUsage() const;
+
+    /** When the dataset is a sample of the rows of a larger one, return
+        the fraction of its rows that are in the sample, so that aggregates
+        over the sample can be scaled up to estimates over all of them.
+        This is what the estimate_* aggregators use.  The default returns
+        1.0, meaning that the dataset is complete.
+    */
+    virtual double getSampledFraction() const;
+
     /** Perform any internal quantization on the given timestamp.  This should
         transform a timestamp into exactly the timestamp that would be read
         back from the dataset on a query, were it recorded into the dataset.
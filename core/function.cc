@@ -15,6 +15,8 @@
 #include "mldb/types/map_description.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/rest/rest_request_router.h"
+#include "mldb/base/parallel.h"
+#include "mldb/arch/metrics.h"
 
 
 using namespace std;
@@ -88,12 +90,46 @@ checkInputCompatibility(const std::vector<std::shared_ptr<ExpressionValueInfo> >
 /* FUNCTION APPLIER                                                          */
 /*****************************************************************************/
 
+namespace {
+
+MetricHistogram & functionCallSeconds
+    = MetricsRegistry::global().histogram
+    ("mldb_function_call_duration_seconds",
+     "Time taken by each application of a function");
+
+MetricHistogram & functionBatchSeconds
+    = MetricsRegistry::global().histogram
+    ("mldb_function_batch_duration_seconds",
+     "Time taken by each batch application of a function");
+
+MetricCounter & functionBatchInputs
+    = MetricsRegistry::global().counter
+    ("mldb_function_batch_inputs_total",
+     "Number of inputs to the batch applications of functions");
+
+} // file scope
+
 ExpressionValue
 FunctionApplier::
 apply(const ExpressionValue & input) const
 { 
     ExcAssert(function);
-    return function->apply(*this, input);
+    auto start = std::chrono::steady_clock::now();
+    ExpressionValue result = function->apply(*this, input);
+    functionCallSeconds.recordSince(start);
+    return result;
+}
+
+std::vector<ExpressionValue>
+FunctionApplier::
+applyBatch(std::vector<ExpressionValue> inputs) const
+{
+    ExcAssert(function);
+    functionBatchInputs.add(inputs.size());
+    auto start = std::chrono::steady_clock::now();
+    auto result = function->applyBatch(*this, std::move(inputs));
+    functionBatchSeconds.recordSince(start);
+    return result;
 }
 
 
@@ -138,6 +174,30 @@ bind(SqlBindingScope & outerContext,
     return result;
 }
 
+std::vector<ExpressionValue>
+Function::
+applyBatch(const FunctionApplier & applier,
+           std::vector<ExpressionValue> inputs) const
+{
+    // Inputs are handed out in chunks, so that the scheduling overhead
+    // stays small compared to the cost of cheap functions
+    static constexpr size_t CHUNK_SIZE = 64;
+
+    std::vector<ExpressionValue> outputs(inputs.size());
+
+    auto doChunk = [&] (size_t first, size_t last)
+        {
+            for (size_t i = first;  i < last;  ++i)
+                outputs[i] = apply(applier, inputs[i]);
+        };
+
+    if (inputs.size() <= CHUNK_SIZE)
+        doChunk(0, inputs.size());
+    else parallelMapChunked(0, inputs.size(), CHUNK_SIZE, doChunk);
+
+    return outputs;
+}
+
 FunctionInfo
 Function::
 getFunctionInfo() const
@@ -112,6 +112,11 @@ struct FunctionApplier {
 
     /// Apply the function to the given context
     ExpressionValue apply(const ExpressionValue & input) const;
+
+    /// Apply the function to each of the inputs, returning the outputs in
+    /// the same order
+    std::vector<ExpressionValue>
+    applyBatch(std::vector<ExpressionValue> inputs) const;
 };
 
 
@@ -201,6 +206,16 @@ struct Function: public MldbEntity {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                                   const ExpressionValue & context) const = 0;
 
+    /** Used by the FunctionApplier to apply the function to many inputs at
+        once.  The default applies each input separately, in parallel
+        over chunks of inputs.  Functions which can do better on a batch
+        (for example by scoring a whole matrix at once) should override it.
+        Like apply(), this may be called from multiple threads at once.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               std::vector<ExpressionValue> inputs) const;
+
     friend class FunctionApplier;
 };
 
@@ -0,0 +1,222 @@
+/** memory_account.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Accounting of the memory used by running queries and procedure runs.
+*/
+
+#include "mldb/core/memory_account.h"
+#include "mldb/rest/cancellation_exception.h"
+#include "mldb/types/date.h"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+thread_local MemoryAccount * currentAccount = nullptr;
+
+/// Every account that exists, in the order they were created
+struct Registry {
+    std::mutex mutex;
+    std::vector<const MemoryAccount *> accounts;
+};
+
+Registry & getRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MEMORY ACCOUNT                                                            */
+/*****************************************************************************/
+
+MemoryAccount::
+MemoryAccount(std::string type,
+              Utf8String name,
+              size_t limit,
+              MemoryAccount * parent)
+    : type(std::move(type)),
+      name(std::move(name)),
+      limit(limit),
+      parent(parent),
+      started(Date::now()),
+      sampleTag(std::make_shared<std::string>
+                (this->type + " " + this->name.rawString())),
+      bytes_(0),
+      peakBytes_(0),
+      limitExceeded_(false)
+{
+    Registry & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    registry.accounts.push_back(this);
+}
+
+MemoryAccount::
+~MemoryAccount()
+{
+    Registry & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    registry.accounts.erase(std::find(registry.accounts.begin(),
+                                      registry.accounts.end(),
+                                      this));
+}
+
+void
+MemoryAccount::
+charge(size_t bytes)
+{
+    for (MemoryAccount * account = this;  account;
+         account = account->parent) {
+        size_t newBytes = account->bytes_.fetch_add(bytes) + bytes;
+
+        if (account->limit && newBytes > account->limit) {
+            // Give back what was charged on the way up, including to this
+            // one, as the charge never happened
+            for (MemoryAccount * a = this;  a != account->parent;
+                 a = a->parent)
+                a->bytes_ -= bytes;
+
+            account->limitExceeded_ = true;
+            throw CancellationException
+                (account->type + " " + account->name.rawString()
+                 + " was cancelled as it went over its memory limit of "
+                 + std::to_string(account->limit) + " bytes");
+        }
+
+        size_t peak = account->peakBytes_;
+        while (newBytes > peak
+               && !account->peakBytes_.compare_exchange_weak(peak, newBytes))
+            ;
+    }
+}
+
+void
+MemoryAccount::
+release(size_t bytes)
+{
+    for (MemoryAccount * account = this;  account;
+         account = account->parent)
+        account->bytes_ -= bytes;
+}
+
+Json::Value
+MemoryAccount::
+getStats() const
+{
+    Json::Value result;
+    result["type"] = type;
+    result["name"] = name;
+    result["started"] = started.printIso8601();
+    result["bytes"] = (Json::UInt)bytes_;
+    result["peakBytes"] = (Json::UInt)peakBytes_;
+    if (limit)
+        result["limitBytes"] = (Json::UInt)limit;
+    if (limitExceeded_)
+        result["limitExceeded"] = true;
+    return result;
+}
+
+MemoryAccount *
+MemoryAccount::
+current()
+{
+    return currentAccount;
+}
+
+Json::Value
+MemoryAccount::
+getRunningStats(const std::string & type, const Utf8String & name)
+{
+    Json::Value result(Json::arrayValue);
+
+    Registry & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    for (auto * account: registry.accounts) {
+        if (!type.empty() && account->type != type)
+            continue;
+        if (!name.empty() && account->name != name)
+            continue;
+        result.append(account->getStats());
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* MEMORY ACCOUNT SCOPE                                                      */
+/*****************************************************************************/
+
+MemoryAccountScope::
+MemoryAccountScope(MemoryAccount * account)
+    : previous(currentAccount),
+      tagScope(account ? account->sampleTag : nullptr)
+{
+    currentAccount = account;
+}
+
+MemoryAccountScope::
+~MemoryAccountScope()
+{
+    currentAccount = previous;
+}
+
+
+/*****************************************************************************/
+/* MEMORY CHARGE                                                             */
+/*****************************************************************************/
+
+MemoryCharge::
+MemoryCharge(MemoryAccount * account)
+    : account(account), held(0)
+{
+}
+
+MemoryCharge::
+~MemoryCharge()
+{
+    releaseAll();
+}
+
+void
+MemoryCharge::
+add(size_t bytes)
+{
+    if (!account)
+        return;
+    account->charge(bytes);
+    held += bytes;
+}
+
+void
+MemoryCharge::
+release(size_t bytes)
+{
+    if (!account)
+        return;
+    held -= bytes;
+    account->release(bytes);
+}
+
+void
+MemoryCharge::
+releaseAll()
+{
+    if (!account)
+        return;
+    account->release(held.exchange(0));
+}
+
+} // namespace MLDB
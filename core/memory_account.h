@@ -0,0 +1,171 @@
+/** memory_account.h                                               -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Accounting of the memory used by running queries and procedure runs.
+*/
+
+#pragma once
+
+#include "mldb/types/string.h"
+#include "mldb/types/date.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/arch/sampling_profiler.h"
+#include <atomic>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MEMORY ACCOUNT                                                            */
+/*****************************************************************************/
+
+/** Memory used by a running query or procedure run.  The places that hold
+    large amounts of intermediate data, such as the rows being sorted or
+    the groups of a GROUP BY, charge their memory to the account of the
+    query or procedure that they run within.  This is an estimate of the
+    largest users of memory, not an exact count of every allocation.
+
+    Each thread has a current account, which is set with a
+    MemoryAccountScope by whatever starts the query or procedure run.
+    Work that is spread over other threads charges the account that was
+    current on the thread that started it.  An account that is created
+    while another is current charges its parent too, so that the queries
+    run by a procedure count towards the memory of the procedure.
+
+    When an account has a limit and a charge takes it over that limit, the
+    charge fails with a CancellationException, which cancels the work in
+    the same way as a user cancelling it would.
+
+    The accounts that exist at any one time are listed by
+    getRunningStats().
+*/
+
+struct MemoryAccount {
+
+    /** Create an account for a running query or procedure run, with the
+        given type ("query" or "procedure") and name.  A limit of zero
+        means no limit.  The parent defaults to the account current on
+        this thread.
+    */
+    MemoryAccount(std::string type,
+                  Utf8String name,
+                  size_t limit = 0,
+                  MemoryAccount * parent = current());
+
+    ~MemoryAccount();
+
+    MemoryAccount(const MemoryAccount & other) = delete;
+    void operator = (const MemoryAccount & other) = delete;
+
+    const std::string type;
+    const Utf8String name;
+    const size_t limit;
+    MemoryAccount * const parent;
+    const Date started;
+
+    /// "<type> <name>", which tags the profiler samples of the work
+    /// charging the account (see SamplingProfiler)
+    const std::shared_ptr<const std::string> sampleTag;
+
+    /** Charge the given number of bytes to the account and its parents.
+        If this takes any of them over their limit, nothing is charged and
+        a CancellationException is thrown.
+    */
+    void charge(size_t bytes);
+
+    /** Give back bytes that were charged before. */
+    void release(size_t bytes);
+
+    /** Bytes currently charged. */
+    size_t bytes() const { return bytes_; }
+
+    /** Most bytes that have been charged at once. */
+    size_t peakBytes() const { return peakBytes_; }
+
+    /** True if a charge has failed due to the limit. */
+    bool limitExceeded() const { return limitExceeded_; }
+
+    /** Return the type, name, start time, bytes, peak and limit of the
+        account.
+    */
+    Json::Value getStats() const;
+
+    /** Return the account current on this thread, or null if there is
+        none.
+    */
+    static MemoryAccount * current();
+
+    /** Return an array with the getStats() of each account that exists,
+        oldest first.  If type or name are given, only the accounts with
+        that type or name are returned.
+    */
+    static Json::Value getRunningStats(const std::string & type = "",
+                                       const Utf8String & name = Utf8String());
+
+private:
+    std::atomic<size_t> bytes_;
+    std::atomic<size_t> peakBytes_;
+    std::atomic<bool> limitExceeded_;
+};
+
+
+/*****************************************************************************/
+/* MEMORY ACCOUNT SCOPE                                                      */
+/*****************************************************************************/
+
+/** Make the given account the current one of this thread for the lifetime
+    of the object, restoring the previous one afterwards.  Its sample tag
+    is current for as long.
+*/
+
+struct MemoryAccountScope {
+    MemoryAccountScope(MemoryAccount * account);
+    ~MemoryAccountScope();
+
+private:
+    MemoryAccount * previous;
+    SampleTagScope tagScope;
+};
+
+
+/*****************************************************************************/
+/* MEMORY CHARGE                                                             */
+/*****************************************************************************/
+
+/** Bytes charged to an account by one data structure, which are all
+    released when the object is destroyed, including when it is unwound by
+    an exception.  An object without an account (as when nothing is
+    current) does nothing.  It is safe to use from multiple threads.
+*/
+
+struct MemoryCharge {
+    MemoryCharge(MemoryAccount * account = MemoryAccount::current());
+    ~MemoryCharge();
+
+    MemoryCharge(const MemoryCharge & other) = delete;
+    void operator = (const MemoryCharge & other) = delete;
+
+    /** True if there is an account to charge.  This allows the caller to
+        skip estimating the size of things that won't be charged.
+    */
+    bool active() const { return account; }
+
+    /** Charge the given number of bytes; see MemoryAccount::charge(). */
+    void add(size_t bytes);
+
+    /** Give back the given number of bytes. */
+    void release(size_t bytes);
+
+    /** Give back all of the bytes charged through this object. */
+    void releaseAll();
+
+    MemoryAccount * const account;
+
+private:
+    std::atomic<size_t> held;
+};
+
+} // namespace MLDB
@@ -16,7 +16,13 @@
 #include "mldb/core/dataset.h"
 #include "mldb/core/plugin.h"
 #include "mldb/core/function.h"
+#include "mldb/core/memory_account.h"
+#include "mldb/core/run_progress.h"
+#include "mldb/sql/query_profile.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/rest/cancellation_exception.h"
 
 
 using namespace std;
@@ -39,6 +45,9 @@ ProcedureRunConfigDescription()
 
     addField("id", &ProcedureRunConfig::id, "ID of run");
     addField("params", &ProcedureRunConfig::params, "Parameters of run");
+    addField("profile", &ProcedureRunConfig::profile,
+             "Record the profile of the queries run by the procedure in "
+             "the details of the run", false);
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(ProcedureRunState);
@@ -61,6 +70,13 @@ ProcedureRunStatusDescription()
              "Timestamp at which the run finished");
 }
 
+namespace {
+
+EnvOption<size_t> MLDB_PROCEDURE_MEMORY_LIMIT
+("MLDB_PROCEDURE_MEMORY_LIMIT", 0);
+
+} // file scope
+
 ProcedureRun::
 ProcedureRun(Procedure * owner,
              ProcedureRunConfig config,
@@ -69,15 +85,79 @@ ProcedureRun(Procedure * owner,
     runStarted = Date::now();
     ExcAssert(owner);
     this->config.reset(new ProcedureRunConfig(std::move(config)));
+
+    // The memory used by the run is charged to its own account, which is
+    // also reported with its progress
+    MemoryAccount account("procedure",
+                          getMemoryAccountName(owner, this->config->id),
+                          MLDB_PROCEDURE_MEMORY_LIMIT);
+    MemoryAccountScope scope(&account);
+
+    // Procedures count what they process into the current RunProgress,
+    // whose throughput and stages are reported with the progress too
+    RunProgress runProgress(account.name, &account);
+    if (this->config->profile)
+        runProgress.countHardware();
+    RunProgressScope runProgressScope(&runProgress);
+
+    auto onRunProgress = [&] (const Json::Value & progress)
+        {
+            if (progress.type() != Json::objectValue)
+                return onProgress(progress);
+            Json::Value withMemory = progress;
+            withMemory["memory"] = account.getStats();
+            withMemory["telemetry"] = runProgress.getStats();
+            return onProgress(withMemory);
+        };
+
+    std::unique_ptr<QueryProfiler> profiler;
+    if (this->config->profile) {
+        profiler.reset(new QueryProfiler([&] () -> int64_t
+                                         {
+                                             return account.bytes();
+                                         }));
+    }
+
     try {
-        RunOutput output = owner->run(*this->config, onProgress);
+        QueryProfileScope profileScope(profiler.get());
+        RunOutput output = owner->run(*this->config, onRunProgress);
         this->results = std::move(output.results);
         this->details = std::move(output.details);
+    } catch (const CancellationException & exc) {
+        runFinished = Date::now();
+        // Going over the memory limit cancels the work of the run, but it
+        // finishes with an error rather than as if a user cancelled it
+        if (account.limitExceeded())
+            throw HttpReturnException(400, exc.what(),
+                                      "memory", account.getStats());
+        throw;
     } catch (...) {
         runFinished = Date::now();
         throw;
     }
     runFinished = Date::now();
+
+    if (profiler) {
+        // The profile goes alongside whatever details the procedure gave
+        Json::Value details = this->details.asJson();
+        if (!details.isNull() && !details.isObject()) {
+            Json::Value wrapped;
+            wrapped["output"] = details;
+            details = wrapped;
+        }
+        details["profile"] = jsonEncode(profiler->finish(0));
+        this->details = details;
+    }
+}
+
+Utf8String
+ProcedureRun::
+getMemoryAccountName(const Procedure * owner, const Utf8String & runId)
+{
+    Utf8String procedureId;
+    if (owner->getConfigPtr())
+        procedureId = owner->getId();
+    return "procedures/" + procedureId + "/runs/" + runId;
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(ProcedureRun);
@@ -45,6 +45,7 @@ constexpr char GENERIC_OUTPUT_DS_DESC[] =
 struct ProcedureRunConfig {
     Utf8String id;
     Any params;
+    bool profile = false;  ///< Record the profile of the run in its details
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ProcedureRunConfig);
@@ -71,6 +72,12 @@ struct ProcedureRun {
                  ProcedureRunConfig config,
                  const std::function<bool (const Json::Value & progress)> & onProgress);
 
+    /** Name of the memory account of a run while it is running, which is
+        its path under /v1.
+    */
+    static Utf8String getMemoryAccountName(const Procedure * owner,
+                                           const Utf8String & runId);
+
     std::shared_ptr<ProcedureRunConfig> config;
     Date runStarted;
     Date runFinished;
@@ -0,0 +1,236 @@
+/** run_progress.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Throughput, stage and ETA telemetry of procedure runs.
+*/
+
+#include "mldb/core/run_progress.h"
+#include "mldb/core/memory_account.h"
+#include <algorithm>
+#include <time.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+thread_local RunProgress * currentProgress = nullptr;
+
+/// Every RunProgress that exists, in the order they were created
+struct Registry {
+    std::mutex mutex;
+    std::vector<const RunProgress *> runs;
+};
+
+Registry & getRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+/// CPU time used by all of the threads of the process
+double processCpuSeconds()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == -1)
+        return 0.0;
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+double rate(uint64_t count, double seconds)
+{
+    return seconds > 0 ? count / seconds : 0.0;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* RUN PROGRESS                                                              */
+/*****************************************************************************/
+
+RunProgress::
+RunProgress(Utf8String name, const MemoryAccount * account)
+    : name(std::move(name)),
+      account(account),
+      started(Date::now()),
+      expectedRows_(0),
+      expectedBytes_(0)
+{
+    Registry & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    registry.runs.push_back(this);
+}
+
+RunProgress::
+~RunProgress()
+{
+    Registry & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    registry.runs.erase(std::find(registry.runs.begin(),
+                                  registry.runs.end(),
+                                  this));
+}
+
+void
+RunProgress::
+countHardware()
+{
+    if (PerfCounterGroup::available())
+        counters_.reset(new ProcessPerfCounters());
+}
+
+RunProgress::Mark
+RunProgress::
+mark() const
+{
+    Mark result;
+    result.date = Date::now();
+    result.rows = rows();
+    result.bytes = bytes();
+    result.cpuSeconds = processCpuSeconds();
+    if (account)
+        result.memoryBytes = account->bytes();
+    if (counters_)
+        result.counters = counters_->read();
+    return result;
+}
+
+void
+RunProgress::
+startStage(const std::string & stage)
+{
+    Mark now = mark();
+
+    std::unique_lock<std::mutex> guard(stagesMutex);
+    if (!stages.empty() && !stages.back().finished) {
+        stages.back().end = now;
+        stages.back().finished = true;
+    }
+    Stage newStage;
+    newStage.name = stage;
+    newStage.start = now;
+    stages.emplace_back(std::move(newStage));
+}
+
+Json::Value
+RunProgress::
+getStats() const
+{
+    Mark now = mark();
+    double elapsed = now.date.secondsSince(started);
+
+    Json::Value result;
+    result["started"] = started.printIso8601();
+    result["elapsedSeconds"] = elapsed;
+    result["rows"] = (Json::UInt)now.rows;
+    result["bytes"] = (Json::UInt)now.bytes;
+    result["rowsPerSecond"] = rate(now.rows, elapsed);
+    result["bytesPerSecond"] = rate(now.bytes, elapsed);
+    if (account) {
+        result["memoryBytes"] = (Json::UInt)account->bytes();
+        result["peakMemoryBytes"] = (Json::UInt)account->peakBytes();
+    }
+
+    // The ETA assumes the rate so far holds for the rest of the run
+    uint64_t expectedBytes = expectedBytes_, expectedRows = expectedRows_;
+    double fraction = -1;
+    if (expectedBytes)
+        fraction = (double)now.bytes / expectedBytes;
+    else if (expectedRows)
+        fraction = (double)now.rows / expectedRows;
+    if (fraction >= 0) {
+        fraction = std::min(fraction, 1.0);
+        if (expectedBytes)
+            result["expectedBytes"] = (Json::UInt)expectedBytes;
+        if (expectedRows)
+            result["expectedRows"] = (Json::UInt)expectedRows;
+        result["percent"] = 100.0 * fraction;
+        if (fraction > 0)
+            result["etaSeconds"] = elapsed * (1.0 - fraction) / fraction;
+    }
+
+    Json::Value stagesOut(Json::arrayValue);
+    std::unique_lock<std::mutex> guard(stagesMutex);
+    for (auto & stage: stages) {
+        const Mark & end = stage.finished ? stage.end : now;
+        double seconds = end.date.secondsSince(stage.start.date);
+        double cpuSeconds = end.cpuSeconds - stage.start.cpuSeconds;
+        uint64_t rows = end.rows - stage.start.rows;
+        uint64_t bytes = end.bytes - stage.start.bytes;
+
+        Json::Value s;
+        s["name"] = stage.name;
+        s["started"] = stage.start.date.printIso8601();
+        s["seconds"] = seconds;
+        s["finished"] = stage.finished;
+        s["rows"] = (Json::UInt)rows;
+        s["bytes"] = (Json::UInt)bytes;
+        s["rowsPerSecond"] = rate(rows, seconds);
+        s["bytesPerSecond"] = rate(bytes, seconds);
+        s["cpuSeconds"] = cpuSeconds;
+        // In cores; more than one when the stage runs on several threads
+        s["cpuUtilization"] = seconds > 0 ? cpuSeconds / seconds : 0.0;
+        if (account)
+            s["memoryBytes"] = (Json::Int)end.memoryBytes;
+        if (counters_) {
+            PerfCounts counts = end.counters - stage.start.counters;
+            Json::Value & c = s["counters"];
+            c["instructions"] = (Json::UInt)counts.instructions;
+            c["cycles"] = (Json::UInt)counts.cycles;
+            c["llcMisses"] = (Json::UInt)counts.llcMisses;
+            c["branchMisses"] = (Json::UInt)counts.branchMisses;
+            c["dtlbMisses"] = (Json::UInt)counts.dtlbMisses;
+            c["ipc"] = counts.ipc();
+        }
+        stagesOut.append(s);
+    }
+    if (!stages.empty() && !stages.back().finished)
+        result["stage"] = stages.back().name;
+    result["stages"] = stagesOut;
+
+    return result;
+}
+
+RunProgress *
+RunProgress::
+current()
+{
+    return currentProgress;
+}
+
+Json::Value
+RunProgress::
+getRunningStats(const Utf8String & name)
+{
+    Registry & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    for (auto * run: registry.runs) {
+        if (run->name == name)
+            return run->getStats();
+    }
+    return Json::Value();
+}
+
+
+/*****************************************************************************/
+/* RUN PROGRESS SCOPE                                                        */
+/*****************************************************************************/
+
+RunProgressScope::
+RunProgressScope(RunProgress * progress)
+    : previous(currentProgress)
+{
+    currentProgress = progress;
+}
+
+RunProgressScope::
+~RunProgressScope()
+{
+    currentProgress = previous;
+}
+
+} // namespace MLDB
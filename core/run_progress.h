@@ -0,0 +1,148 @@
+/** run_progress.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Throughput, stage and ETA telemetry of procedure runs.
+*/
+
+#pragma once
+
+#include "mldb/arch/metrics.h"
+#include "mldb/arch/perf_counters.h"
+#include "mldb/types/string.h"
+#include "mldb/types/date.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace MLDB {
+
+struct MemoryAccount;
+
+
+/*****************************************************************************/
+/* RUN PROGRESS                                                              */
+/*****************************************************************************/
+
+/** Telemetry of a running procedure: the rows and bytes it has processed,
+    the stage it's in, and for each stage how long it took, its throughput,
+    its CPU utilization and the memory charged to the run.
+
+    Rows and bytes are counted into per-thread shards of lock-free
+    counters, so the threads doing the work never wait on each other or on
+    whoever reads the telemetry; the totals are only summed when
+    getStats() is called.  Changing stage takes a lock, as it happens only
+    a handful of times per run.
+
+    The run sets its RunProgress as current with a RunProgressScope; the
+    procedure gets it with current() on the thread that runs it and passes
+    the pointer to the threads it starts.
+*/
+
+struct RunProgress {
+
+    /** Create the telemetry of the run with the given name; the memory
+        reported is that charged to the given account, if any.
+    */
+    RunProgress(Utf8String name, const MemoryAccount * account = nullptr);
+
+    ~RunProgress();
+
+    RunProgress(const RunProgress &) = delete;
+    void operator = (const RunProgress &) = delete;
+
+    const Utf8String name;
+    const MemoryAccount * const account;
+    const Date started;
+
+    /** Finish the current stage, if any, and start the named one. */
+    void startStage(const std::string & stage);
+
+    /** Also record the hardware counters of the threads of the process
+        over each stage, if they can be read.  This must be called before
+        the first stage starts.
+    */
+    void countHardware();
+
+    /** Set how many rows or bytes the run is expected to process in all,
+        from which the ETA is estimated.  Zero means unknown.  Bytes are
+        used in preference to rows when both are known.
+    */
+    void setExpectedRows(uint64_t rows) { expectedRows_ = rows; }
+    void setExpectedBytes(uint64_t bytes) { expectedBytes_ = bytes; }
+
+    /** Count processed rows and bytes. */
+    MLDB_ALWAYS_INLINE void addRows(uint64_t n = 1) { rows_.add(n); }
+    MLDB_ALWAYS_INLINE void addBytes(uint64_t n) { bytes_.add(n); }
+
+    uint64_t rows() const { return rows_.value(); }
+    uint64_t bytes() const { return bytes_.value(); }
+
+    /** Return the telemetry as an object with the totals, rates, current
+        stage, ETA and an entry for each stage.
+    */
+    Json::Value getStats() const;
+
+    /** Return the RunProgress current on this thread, or null. */
+    static RunProgress * current();
+
+    /** Return the getStats() of the running run with the given name, or
+        null if there is none.
+    */
+    static Json::Value getRunningStats(const Utf8String & name);
+
+private:
+    MetricCounter rows_;
+    MetricCounter bytes_;
+    std::atomic<uint64_t> expectedRows_;
+    std::atomic<uint64_t> expectedBytes_;
+
+    /// Counters at the start and end of a stage
+    struct Mark {
+        Date date;
+        uint64_t rows = 0;
+        uint64_t bytes = 0;
+        double cpuSeconds = 0.0;
+        int64_t memoryBytes = 0;
+        PerfCounts counters;
+    };
+
+    struct Stage {
+        std::string name;
+        Mark start;
+        Mark end;
+        bool finished = false;
+    };
+
+    mutable std::mutex stagesMutex;
+    std::vector<Stage> stages;
+
+    /// Null unless countHardware() was called and the counters can be read
+    std::unique_ptr<ProcessPerfCounters> counters_;
+
+    Mark mark() const;
+};
+
+
+/*****************************************************************************/
+/* RUN PROGRESS SCOPE                                                        */
+/*****************************************************************************/
+
+/** Make the given RunProgress the current one of this thread for the
+    lifetime of the object, restoring the previous one afterwards.
+*/
+
+struct RunProgressScope {
+    RunProgressScope(RunProgress * progress);
+    ~RunProgressScope();
+
+    RunProgressScope(const RunProgressScope &) = delete;
+    void operator = (const RunProgressScope &) = delete;
+
+private:
+    RunProgress * previous;
+};
+
+} // namespace MLDB
@@ -10,7 +10,7 @@
 #include <iostream>
 #include "base/exc_assert.h"
 #include "mldb/arch/exception.h"
-#include "mldb/base/parse_context.h"
+#include "mldb/arch/string_scan.h"
 
 #include "http_parsers.h"
 
@@ -22,12 +22,107 @@ using namespace MLDB;
 /* HTTP PARSER :: BUFFER STATE                                              */
 /****************************************************************************/
 
-struct HttpParser::BufferState : public ParseContext {
+/* A cursor over the contiguous data being parsed, with the subset of the
+   ParseContext interface that the parsers need.  As the data is always in
+   a single block, it can be scanned many bytes at a time instead of going
+   through ParseContext one character at a time. */
+
+struct HttpParser::BufferState {
     BufferState(const char * start, size_t length, bool fromBuffer);
 
+    /* Saves the position of the state and reverts back to it on destruction,
+       unless it was ignored. */
+    struct Revert_Token {
+        Revert_Token(BufferState & state)
+            : state_(&state), pos_(state.cur_)
+        {
+        }
+
+        ~Revert_Token()
+        {
+            if (state_) {
+                state_->cur_ = pos_;
+            }
+        }
+
+        void ignore()
+        {
+            state_ = nullptr;
+        }
+
+        /* revert to the current position of the state instead */
+        void update()
+        {
+            pos_ = state_->cur_;
+        }
+
+    private:
+        BufferState * state_;
+        const char * pos_;
+    };
+
     /* skip as many characters as possible until character "c" is found */
     bool skip_to_char(char c, bool throwOnEol);
 
+    bool match_literal_str(const char * str, size_t len);
+    void expect_literal(char c);
+
+    bool eof()
+        const
+        {
+            return cur_ == end_;
+        }
+
+    char operator * ()
+        const
+        {
+            if (eof()) {
+                throw MLDB::Exception("unexpected EOF");
+            }
+            return *cur_;
+        }
+
+    BufferState & operator ++ ()
+        {
+            if (eof()) {
+                throw MLDB::Exception("unexpected EOF");
+            }
+            ++cur_;
+            return *this;
+        }
+
+    void operator ++ (int)
+        {
+            operator ++ ();
+        }
+
+    BufferState & operator += (size_t steps)
+        {
+            if (steps > readahead_available()) {
+                throw MLDB::Exception("unexpected EOF");
+            }
+            cur_ += steps;
+            return *this;
+        }
+
+    size_t readahead_available()
+        const
+        {
+            return end_ - cur_;
+        }
+
+    size_t total_buffered()
+        const
+        {
+            return end_ - start_;
+        }
+
+    size_t get_offset()
+        const
+        {
+            return cur_ - start_;
+        }
+
     const char * start()
         const
         {
@@ -37,7 +132,7 @@ struct HttpParser::BufferState : public ParseContext {
     const char * get_offset_ptr()
         const
         {
-            return start_ + get_offset();
+            return cur_;
         }
 
     bool from_buffer()
@@ -48,6 +143,8 @@ struct HttpParser::BufferState : public ParseContext {
 
 private:
     const char * start_;
+    const char * end_;
+    const char * cur_;
     bool fromBuffer_;
 };
 
@@ -139,9 +236,10 @@ HttpParser::
 clear()
     noexcept
 {
+    // The buffer is not cleared, as it may hold data following the end of
+    // the message that was just parsed
     expectBody_ = true;
     stage_ = 0;
-    buffer_.clear();
     expect100Continue_ = false;
     remainingBody_ = 0;
     useChunkedEncoding_ = false;
@@ -163,6 +261,11 @@ feed(const char * bufferData, size_t bufferSize)
     // std::cerr << ("data: /"
     //          + ML::hexify_string(string(bufferData, bufferSize))
     //          + "/\n");
+    if (paused_) {
+        buffer_.append(bufferData, bufferSize);
+        return;
+    }
+
     auto state = prepareParsing(bufferData, bufferSize, buffer_);
     // cerr << ("state: " + to_string(stage_)
     //          + "; dataSize: " + to_string(dataSize) + "\n");
@@ -170,7 +273,7 @@ feed(const char * bufferData, size_t bufferSize)
     /* We loop as long as there are bytes available for parsing and as long as
        the parsing stages change. */
     bool stageDone(true);
-    while (stageDone && state.readahead_available() > 0) {
+    while (stageDone && !paused_ && state.readahead_available() > 0) {
         if (stage_ == 0) {
             stageDone = parseFirstLine(state);
             if (stageDone) {
@@ -218,6 +321,16 @@ feed(const char * bufferData, size_t bufferSize)
     }
 }
 
+void
+HttpParser::
+resume()
+{
+    paused_ = false;
+    if (!buffer_.empty()) {
+        feed("", 0);
+    }
+}
+
 bool
 HttpParser::
 parseHeaders(BufferState & state)
@@ -225,9 +338,7 @@ parseHeaders(BufferState & state)
     string multiline;
     unsigned int numLines(0);
 
-    std::unique_ptr<ParseContext::Revert_Token> token;
-
-    token.reset(new ParseContext::Revert_Token(state));
+    BufferState::Revert_Token token(state);
 
     /* header line parsing */
     while (*state != '\r' || numLines > 0) {
@@ -263,8 +374,7 @@ parseHeaders(BufferState & state)
                 multiline.clear();
                 numLines = 0;
             }
-            token->ignore();
-            token.reset(new ParseContext::Revert_Token(state));
+            token.update();
         }
     }
     if (state.get_offset() + 1 == state.total_buffered()) {
@@ -272,7 +382,7 @@ parseHeaders(BufferState & state)
     }
     state++;
     state.expect_literal('\n');
-    token->ignore();
+    token.ignore();
 
     if (onHeader) {
         onHeader("\r\n", 2);
@@ -285,67 +395,60 @@ void
 HttpParser::
 handleHeader(const char * data, size_t dataSize)
 {
-    size_t ptr(0);
     bool skipHeader(!onHeader);
 
-    auto skipToChar = [&] (char c) {
-        while (ptr < dataSize) {
-            if (data[ptr] == c)
-                return true;
-            ptr++;
-        }
+    /* The line ends with "\r\n" and parseHeaders has made sure that it
+       contains a ':'. */
+    const char * end = data + dataSize;
+    const char * nameEnd = (const char *) ::memchr(data, ':', dataSize);
+    if (!nameEnd) {
+        nameEnd = end;
+    }
+    size_t nameSize = nameEnd - data;
+    while (nameSize > 0 && data[nameSize - 1] == ' ') {
+        nameSize--;
+    }
+    const char * value = std::min(nameEnd + 1, end);
+    while (value < end && *value == ' ') {
+        value++;
+    }
+    const char * valueEnd = std::max(value, end - 2);
 
-        return false;
-    };
-    auto skipChar = [&] (char c) {
-        while (ptr < dataSize && data[ptr] == c) {
-            ptr++;
-        }
-    };
-    auto matchString = [&] (const char * testString, size_t len) {
-        bool result;
-        if (dataSize >= (ptr + len)
-            && ::strncasecmp(data + ptr, testString, len) == 0) {
-            ptr += len;
-            result = true;
-        }
-        else {
-            result = false;
-        }
-        return result;
+    auto nameIs = [&] (const char * name) {
+        return ::strncasecmp(data, name, nameSize) == 0;
     };
-
-    auto skipToValue = [&] () {
-        skipChar(' ');
-        skipToChar(':');
-        ptr++;
-        skipChar(' ');
+    auto valueStartsWith = [&] (const char * testString, size_t len) {
+        return (size_t(valueEnd - value) >= len
+                && ::strncasecmp(value, testString, len) == 0);
     };
 
-    if (matchString("Connection", 10)) {
-        skipToValue();
-        if (matchString("close", 5)) {
+    /* The headers that the parser acts upon all have names of a different
+       length, which is thus a perfect hash of them: a header is known after
+       comparing its name with a single candidate. */
+    switch (nameSize) {
+    case 10:
+        if (nameIs("Connection") && valueStartsWith("close", 5)) {
             requireClose_ = true;
         }
-    }
-    else if (matchString("Content-Length", 14)) {
-        skipToValue();
-        remainingBody_ = antoi(data + ptr, data + dataSize - 2);
-    }
-    else if (matchString("Transfer-Encoding", 15)) {
-        skipToValue();
-        if (matchString("chunked", 7)) {
+        break;
+    case 14:
+        if (nameIs("Content-Length")) {
+            remainingBody_ = antoi(value, valueEnd);
+        }
+        break;
+    case 17:
+        if (nameIs("Transfer-Encoding") && valueStartsWith("chunked", 7)) {
             useChunkedEncoding_ = true;
         }
-    }
-    else if (matchString("Expect", 6)) {
-        skipToValue();
-        if (matchString("100-continue", 12)) {
+        break;
+    case 6:
+        if (nameIs("Expect") && valueStartsWith("100-continue", 12)) {
             if (onExpect100Continue) {
                 expect100Continue_ = true;
                 skipHeader = true;
             }
         }
+        break;
     }
 
     if (!skipHeader) {
@@ -370,7 +473,7 @@ parseChunkedBody(BufferState & state)
 
     /* we loop as long as there are chunks to process */
     while (chunkSize != 0) {
-        ParseContext::Revert_Token token(state);
+        BufferState::Revert_Token token(state);
         const char * sizeStart = state.get_offset_ptr();
         if (!state.skip_to_char('\r', false)) {
             return false;
@@ -411,7 +514,7 @@ bool
 HttpParser::
 parseBlockBody(BufferState & state)
 {
-    ParseContext::Revert_Token token(state);
+    BufferState::Revert_Token token(state);
 
     size_t chunkSize = min<size_t>(state.readahead_available(), remainingBody_);
     // cerr << "toSend: " + to_string(chunkSize) + "\n";
@@ -443,8 +546,8 @@ finalizeParsing()
 
 HttpParser::BufferState::
 BufferState(const char * start, size_t length, bool fromBuffer)
-    : ParseContext(ParseContext::CONSOLE, start, start + length),
-      start_(start), fromBuffer_(fromBuffer)
+    : start_(start), end_(start + length), cur_(start),
+      fromBuffer_(fromBuffer)
 {
 }
 
@@ -452,19 +555,53 @@ bool
 HttpParser::BufferState::
 skip_to_char(char c, bool throwOnEol)
 {
+    if (!throwOnEol) {
+        const char * found
+            = (const char *) ::memchr(cur_, c, readahead_available());
+        cur_ = found ? found : end_;
+        return found != nullptr;
+    }
+
     while (!eof()) {
-        if (operator *() == c) {
+        cur_ += findAnyOf(cur_, readahead_available(), c, '\r', '\n');
+        if (eof()) {
+            break;
+        }
+        if (*cur_ == c) {
             return true;
         }
-        else if (throwOnEol && match_eol(false)) {
+        /* a '\r' is only the end of a line when followed by a '\n' */
+        if (*cur_ == '\n' || (cur_ + 1 < end_ && cur_[1] == '\n')) {
             throw MLDB::Exception("unexpected end of line");
         }
-        operator ++();
+        ++cur_;
     }
 
     return false;
 }
 
+bool
+HttpParser::BufferState::
+match_literal_str(const char * str, size_t len)
+{
+    if (readahead_available() < len || ::memcmp(cur_, str, len) != 0) {
+        return false;
+    }
+    cur_ += len;
+    return true;
+}
+
+void
+HttpParser::BufferState::
+expect_literal(char c)
+{
+    if (eof() || *cur_ != c) {
+        throw MLDB::Exception("expected '%c', got '%c'",
+                              c, (eof() ? '\0' : *cur_));
+    }
+    ++cur_;
+}
+
 
 /****************************************************************************/
 /* HTTP RESPONSE PARSER                                                     */
@@ -481,7 +618,7 @@ parseFirstLine(BufferState & state)
         return false;
     }
 
-    ParseContext::Revert_Token token(state);
+    BufferState::Revert_Token token(state);
     if (!state.match_literal_str("HTTP/", 5)) {
         throw MLDB::Exception("version must start with 'HTTP/'");
     }
@@ -530,7 +667,7 @@ parseFirstLine(BufferState & state)
 {
     /* request line parsing */
 
-    ParseContext::Revert_Token token(state);
+    BufferState::Revert_Token token(state);
     size_t methodStart = state.get_offset();
     if (!state.skip_to_char(' ', true)) {
         return false;
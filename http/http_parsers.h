@@ -45,6 +45,7 @@ struct HttpParser {
 
     HttpParser()
         noexcept
+        : paused_(false)
     {
         clear();
     }
@@ -57,6 +58,25 @@ struct HttpParser {
     /* Feed the parsing with a data chunk of a specied size. */
     void feed(const char * data, size_t size);
 
+    /* Stop parsing at the end of the current message, keeping any data
+       that follows it for when parsing is resumed.  This is meant to be
+       called from onDone, so that pipelined requests can be handled one
+       at a time.  Data fed while paused is kept as well. */
+    void pause()
+    {
+        paused_ = true;
+    }
+
+    /* Resume parsing after a call to pause(), parsing the data that was
+       kept until the next message is done or the data runs out. */
+    void resume();
+
+    bool isPaused()
+        const
+    {
+        return paused_;
+    }
+
     /* XXX */
     virtual bool parseFirstLine(BufferState & state) = 0;
 
@@ -105,6 +125,7 @@ private:
     bool expect100Continue_;
     bool useChunkedEncoding_;
     bool requireClose_;
+    bool paused_;
 };
 
 
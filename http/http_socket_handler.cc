@@ -10,6 +10,7 @@
 #include "boost/asio/error.hpp"
 #include "mldb/arch/exception.h"
 #include "mldb/io/tcp_socket.h"
+#include "mldb/jml/utils/environment.h"
 #include "http_socket_handler.h"
 
 using namespace std;
@@ -17,6 +18,16 @@ using namespace MLDB;
 
 namespace MLDB {
 
+namespace {
+
+EnvOption<double> MLDB_HTTP_KEEP_ALIVE_TIMEOUT
+    ("MLDB_HTTP_KEEP_ALIVE_TIMEOUT", 60.0);
+
+EnvOption<size_t> MLDB_HTTP_MAX_REQUESTS_PER_CONNECTION
+    ("MLDB_HTTP_MAX_REQUESTS_PER_CONNECTION", 0);
+
+} // file scope
+
 
 /*****************************************************************************/
 /* HTTP RESPONSE                                                             */
@@ -68,7 +79,10 @@ HttpResponse(int responseCode,
 
 HttpSocketHandler::
 HttpSocketHandler(TcpSocket socket)
-    : TcpSocketHandler(std::move(socket))
+    : TcpSocketHandler(std::move(socket)),
+      keepAliveTimeout_(MLDB_HTTP_KEEP_ALIVE_TIMEOUT),
+      maxRequests_(MLDB_HTTP_MAX_REQUESTS_PER_CONNECTION),
+      numRequests_(0), closeAfterResponse_(false), idleGeneration_(0)
 {
     parser_.onRequestStart = [&] (const char * methodData, size_t methodSize,
                                   const char * urlData, size_t urlSize,
@@ -87,6 +101,12 @@ HttpSocketHandler(TcpSocket socket)
         this->onData(data, dataSize);
     };
     parser_.onDone = [&] (bool shouldClose) {
+        // Hold back any pipelined requests until this one is answered
+        parser_.pause();
+        numRequests_++;
+        closeAfterResponse_ = (shouldClose
+                               || (maxRequests_ > 0
+                                   && numRequests_ >= maxRequests_));
         this->onDone(shouldClose);
     };
 }
@@ -96,6 +116,25 @@ HttpSocketHandler::
 bootstrap()
 {
     disableNagle();
+    std::unique_lock<std::mutex> guard(parserLock_);
+    waitForRequest();
+}
+
+void
+HttpSocketHandler::
+waitForRequest()
+{
+    // Must be called with the parser lock held
+    if (keepAliveTimeout_ > 0) {
+        uint64_t generation = ++idleGeneration_;
+        auto onTimeout = [=] () {
+            std::unique_lock<std::mutex> guard(parserLock_);
+            if (generation == idleGeneration_ && !parser_.isPaused()) {
+                requestClose();
+            }
+        };
+        requestTimeout(keepAliveTimeout_, onTimeout);
+    }
     requestReceive();
 }
 
@@ -103,9 +142,39 @@ void
 HttpSocketHandler::
 onReceivedData(const char * data, size_t size)
 {
+    std::unique_lock<std::mutex> guard(parserLock_);
+    ++idleGeneration_;
+    cancelTimeout();
+
     try {
         parser_.feed(data, size);
-        requestReceive();
+        if (!parser_.isPaused()) {
+            // The request isn't complete yet; the keep-alive timeout only
+            // applies between requests
+            requestReceive();
+        }
+    }
+    catch (const MLDB::Exception & exc) {
+        requestClose();
+    }
+}
+
+void
+HttpSocketHandler::
+onResponseDone(bool close)
+{
+    std::unique_lock<std::mutex> guard(parserLock_);
+
+    if (close || closeAfterResponse_) {
+        requestClose();
+        return;
+    }
+
+    try {
+        parser_.resume();
+        if (!parser_.isPaused()) {
+            waitForRequest();
+        }
     }
     catch (const MLDB::Exception & exc) {
         requestClose();
@@ -141,23 +210,23 @@ HttpLegacySocketHandler::
 send(std::string str,
      NextAction action, OnWriteFinished onWriteFinished)
 {
-    if (str.size() > 0) {
-        auto onWritten = [=] (const boost::system::error_code & ec,
-                              size_t) {
-            if (onWriteFinished) {
-                onWriteFinished();
-            }
-            if (action == NEXT_CLOSE || action == NEXT_RECYCLE) {
-                requestClose();
-            }
-        };
-        requestWrite(str, onWritten);
+    bool responseDone = (action != NEXT_CONTINUE);
+    if (str.empty() && !responseDone) {
+        return;
     }
-    else {
-        if (action == NEXT_CLOSE || action == NEXT_RECYCLE) {
-            requestClose();
+
+    // Even an empty write goes through the queue, so that the connection
+    // is only closed or recycled once everything before it has been sent
+    auto onWritten = [=] (const boost::system::error_code & ec,
+                          size_t) {
+        if (onWriteFinished) {
+            onWriteFinished();
         }
-    }
+        if (responseDone) {
+            onResponseDone(ec || action == NEXT_CLOSE);
+        }
+    };
+    requestWrite(std::move(str), onWritten);
 }
 
 void
@@ -165,9 +234,19 @@ HttpLegacySocketHandler::
 putResponseOnWire(const HttpResponse & response,
                   std::function<void ()> onSendFinished,
                   NextAction next)
+{
+    putResponseOnWire(HttpResponse(response), std::move(onSendFinished),
+                      next);
+}
+
+void
+HttpLegacySocketHandler::
+putResponseOnWire(HttpResponse && response,
+                  std::function<void ()> onSendFinished,
+                  NextAction next)
 {
     string responseStr;
-    responseStr.reserve(16384 + response.body.length());
+    responseStr.reserve(1024);
 
     responseStr.append("HTTP/1.1 ");
     responseStr.append(to_string(response.responseCode));
@@ -185,7 +264,12 @@ putResponseOnWire(const HttpResponse & response,
         responseStr.append("Content-Length: ");
         responseStr.append(to_string(response.body.length()));
         responseStr.append("\r\n");
-        responseStr.append("Connection: Keep-Alive\r\n");
+        if (next == NEXT_CLOSE || closeAfterResponse()) {
+            responseStr.append("Connection: close\r\n");
+        }
+        else {
+            responseStr.append("Connection: Keep-Alive\r\n");
+        }
     }
 
     for (auto & h: response.extraHeaders) {
@@ -196,9 +280,18 @@ putResponseOnWire(const HttpResponse & response,
     }
 
     responseStr.append("\r\n");
-    responseStr.append(response.body);
 
-    send(std::move(responseStr), std::move(next), std::move(onSendFinished));
+    if (!response.sendBody) {
+        send(std::move(responseStr), next, std::move(onSendFinished));
+        return;
+    }
+
+    // A response with a body is complete once the body has been sent
+    if (next == NEXT_CONTINUE) {
+        next = NEXT_RECYCLE;
+    }
+    requestWrite(std::move(responseStr));
+    send(std::move(response.body), next, std::move(onSendFinished));
 }
 
 void
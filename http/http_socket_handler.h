@@ -11,6 +11,7 @@
 #include "mldb/http/http_header.h"
 #include "mldb/http/http_parsers.h"
 #include "mldb/io/tcp_socket_handler.h"
+#include <mutex>
 
 
 namespace MLDB {
@@ -19,11 +20,37 @@ namespace MLDB {
 /* HTTP CONNECTION HANDLER                                                  */
 /****************************************************************************/
 
-/* A base class for handling HTTP connections. */
+/* A base class for handling HTTP connections.
+
+   Requests are handled one at a time, in the order they were received.
+   Once a request has been parsed, parsing stops and no more data is read
+   from the socket until the subclass calls onResponseDone(), so that the
+   responses to pipelined requests are sent in order; any following
+   requests already received are then parsed and handled in turn.
+
+   Connections are kept alive between requests unless the client or the
+   subclass asks for them to be closed.  An idle connection is closed
+   after MLDB_HTTP_KEEP_ALIVE_TIMEOUT seconds (default 60), and a
+   connection is closed after MLDB_HTTP_MAX_REQUESTS_PER_CONNECTION
+   requests (default 0, meaning no limit).  Zero disables either. */
 
 struct HttpSocketHandler : public TcpSocketHandler {
     HttpSocketHandler(TcpSocket socket);
 
+    /* Set the number of seconds an idle connection is kept open for, or 0
+       to keep it open until the client closes it. */
+    void setKeepAliveTimeout(double seconds)
+    {
+        keepAliveTimeout_ = seconds;
+    }
+
+    /* Set the number of requests after which the connection is closed, or
+       0 for no limit. */
+    void setMaxRequestsPerConnection(size_t maxRequests)
+    {
+        maxRequests_ = maxRequests;
+    }
+
     /* Callback used when to report the request line. */
     virtual void onRequestStart(const char * methodData, size_t methodSize,
                                 const char * urlData, size_t urlSize,
@@ -42,9 +69,23 @@ struct HttpSocketHandler : public TcpSocketHandler {
        when the body is larger than 0 byte. */
     virtual void onData(const char * data, size_t dataSize) = 0;
 
-    /* Callback used to report the end of a response. */
+    /* Callback used to report the end of a request. */
     virtual void onDone(bool requireClose) = 0;
 
+protected:
+    /* Returns whether the connection will be closed once the response to
+       the current request has been sent, because the client asked for it
+       or the connection has reached its maximum number of requests. */
+    bool closeAfterResponse() const
+    {
+        return closeAfterResponse_;
+    }
+
+    /* To be called once the response to the current request has been
+       fully written, to either close the connection or go on with the
+       next request. */
+    void onResponseDone(bool close);
+
 private:
     /* TcpSocketHandler interface */
     virtual void bootstrap();
@@ -52,7 +93,18 @@ private:
     virtual void onReceiveError(const boost::system::error_code & ec,
                                 size_t bufferSize);
 
+    /* Wait for the next request, closing the connection if none arrives
+       within the keep-alive timeout. */
+    void waitForRequest();
+
+    std::mutex parserLock_;
     HttpRequestParser parser_;
+
+    double keepAliveTimeout_;
+    size_t maxRequests_;
+    size_t numRequests_;
+    bool closeAfterResponse_;
+    uint64_t idleGeneration_;
 };
 
 
@@ -104,9 +156,11 @@ struct HttpResponse {
 struct HttpLegacySocketHandler : public HttpSocketHandler {
     /** Action to perform once we've finished sending. */
     enum NextAction {
-        NEXT_CLOSE,
-        NEXT_RECYCLE,
-        NEXT_CONTINUE
+        NEXT_CLOSE,     ///< The response is done; close the connection
+        NEXT_RECYCLE,   ///< The response is done; handle the next request
+        NEXT_CONTINUE   ///< More of the response is to be sent, or for
+                        ///< putResponseOnWire() with a body, the same as
+                        ///< NEXT_RECYCLE
     };
 
     /* Type of function called when a write operation has finished. */
@@ -117,6 +171,14 @@ struct HttpLegacySocketHandler : public HttpSocketHandler {
     virtual void handleHttpPayload(const HttpHeader & header,
                                    const std::string & payload) = 0;
 
+    /** Send the given response.  The header and body are queued as
+        separate writes, which are put on the wire with a single gathered
+        write, so that the body doesn't need to be copied.
+    */
+    void putResponseOnWire(HttpResponse && response,
+                           std::function<void ()> onSendFinished
+                           = std::function<void ()>(),
+                           NextAction next = NEXT_CONTINUE);
     void putResponseOnWire(const HttpResponse & response,
                            std::function<void ()> onSendFinished
                            = std::function<void ()>(),
@@ -416,3 +416,44 @@ BOOST_AUTO_TEST_CASE( http_request_parser_test )
     BOOST_CHECK_EQUAL(statusLine, "GET|/poiltruc?blablabla|HTTP/1.1");
 }
 #endif
+
+#if 1
+/* Test that the headers that the parser acts upon are recognized whatever
+ * their case and spacing, but only under their exact name. */
+BOOST_AUTO_TEST_CASE( http_request_parser_known_headers_test )
+{
+    string body;
+    bool done(false);
+    bool shouldClose(false);
+
+    HttpRequestParser parser;
+    parser.onData = [&] (const char * data, size_t size) {
+        body.append(data, size);
+    };
+    parser.onDone = [&] (bool doClose) {
+        shouldClose = doClose;
+        done = true;
+    };
+
+    parser.feed("POST / HTTP/1.1\r\n"
+                "Connection-Type: close\r\n"
+                "Content-Length-Max: 12\r\n"
+                "content-length : 4\r\n"
+                "\r\n"
+                "abcd");
+    BOOST_CHECK(done);
+    BOOST_CHECK(!shouldClose);
+    BOOST_CHECK_EQUAL(body, "abcd");
+
+    done = false;
+    body.clear();
+    parser.feed("POST / HTTP/1.1\r\n"
+                "TRANSFER-ENCODING: chunked\r\n"
+                "connection:Close\r\n"
+                "\r\n"
+                "3\r\nabc\r\n0\r\n\r\n");
+    BOOST_CHECK(done);
+    BOOST_CHECK(shouldClose);
+    BOOST_CHECK_EQUAL(body, "abc");
+}
+#endif
@@ -7,6 +7,9 @@
    Benchmark utility for testing the ASIO-based http services.
 */
 
+#include <sys/resource.h>
+#include <unistd.h>
+#include <atomic>
 #include <iostream>
 #include <string>
 
@@ -22,12 +25,63 @@
 #include "mldb/http/http_socket_handler.h"
 #include "mldb/io/port_range_service.h"
 #include "mldb/io/tcp_acceptor.h"
+#include "mldb/http/http_parsers.h"
+#include "mldb/types/date.h"
 
 
 using namespace std;
 using namespace boost;
 using namespace MLDB;
 
+namespace {
+
+std::atomic<uint64_t> numRequests(0);
+
+/* seconds of CPU time used by the process */
+double cpuTime()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+            + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0);
+}
+
+/* Parse the same small request over and over on a single core, to measure
+   the cost of HttpRequestParser alone. */
+void benchParser(unsigned int count)
+{
+    string request("POST /v1/functions/f/application HTTP/1.1\r\n"
+                   "Host: localhost:20000\r\n"
+                   "User-Agent: python-requests/2.9.1\r\n"
+                   "Accept-Encoding: gzip, deflate\r\n"
+                   "Accept: */*\r\n"
+                   "Connection: keep-alive\r\n"
+                   "Content-Type: application/json\r\n"
+                   "Content-Length: 22\r\n"
+                   "\r\n"
+                   "{\"input\": {\"x\": 1234}}");
+    string requests;
+    for (unsigned int i = 0; i < 1000; i++) {
+        requests += request;
+    }
+
+    uint64_t numParsed(0);
+    HttpRequestParser parser;
+    parser.onHeader = [&] (const char * data, size_t size) {};
+    parser.onData = [&] (const char * data, size_t size) {};
+    parser.onDone = [&] (bool doClose) { numParsed++; };
+
+    Date start = Date::now();
+    for (unsigned int i = 0; i < count; i += 1000) {
+        parser.feed(requests.c_str(), requests.size());
+    }
+    double elapsed = Date::now() - start;
+    ::printf("parsed %lu requests in %f seconds: %f requests/sec\n",
+             numParsed, elapsed, numParsed / elapsed);
+}
+
+} // file scope
+
 struct MyHandler : public HttpLegacySocketHandler {
     MyHandler(TcpSocket && socket);
 
@@ -46,6 +100,7 @@ MyHandler::
 handleHttpPayload(const HttpHeader & header,
                   const std::string & payload)
 {
+    numRequests++;
     HttpResponse response(200, "text/plain", "pong");
 
     // static string responseStr("HTTP/1.1 200 OK\r\n"
@@ -64,6 +119,7 @@ main(int argc, char * argv[])
     using namespace boost::program_options;
     unsigned int concurrency(0);
     unsigned int port(20000);
+    unsigned int parserRequests(0);
 
     options_description all_opt;
     all_opt.add_options()
@@ -71,6 +127,8 @@ main(int argc, char * argv[])
          "Number of concurrent requests (mandatory)")
         ("port,p", value(&port),
          "port to listen on (20000)")
+        ("parser-requests", value(&parserRequests),
+         "only measure the parsing of this many requests, on one core")
         ("help,H", "show help");
 
     variables_map vm;
@@ -85,6 +143,11 @@ main(int argc, char * argv[])
         return 1;
     }
 
+    if (parserRequests > 0) {
+        benchParser(parserRequests);
+        return 0;
+    }
+
     ExcAssert(concurrency > 0);
 
     EventLoop loop;
@@ -100,7 +163,23 @@ main(int argc, char * argv[])
     cerr << ("service accepting connections on port "
              + to_string(acceptor.effectiveTCPv4Port())
              + "\n");
+    /* Report the rate of requests, as well as the rate per core, ie per
+       second of CPU time used by the service */
+    uint64_t lastRequests(0);
+    double lastCpuTime(cpuTime());
+    Date lastReport = Date::now();
     while (true) {
-        ::sleep(1234567);
+        ::sleep(10);
+        uint64_t requests = numRequests;
+        double cpu = cpuTime();
+        Date now = Date::now();
+        if (requests > lastRequests) {
+            ::printf("%f requests/sec, %f requests/sec per core\n",
+                     (requests - lastRequests) / (now - lastReport),
+                     (requests - lastRequests) / (cpu - lastCpuTime));
+        }
+        lastRequests = requests;
+        lastCpuTime = cpu;
+        lastReport = now;
     }
 }
@@ -2,6 +2,7 @@
 
 $(eval $(call test,http_header_test,http,boost manual))
 $(eval $(call test,MLDB-1016-http-connection-overflow,http,boost))
+$(eval $(call test,tcp_socket_handler_backpressure_test,http,boost))
 $(eval $(call test,http_parsers_test,http,boost valgrind))
 $(eval $(call test,tcp_acceptor_test+http,http,boost))
 $(eval $(call test,tcp_acceptor_threaded_test+http,http,boost))
@@ -11,7 +11,10 @@
 #define BOOST_TEST_DYN_LINK
 
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <boost/test/unit_test.hpp>
 #include <boost/asio.hpp>
 #include "base/exc_assert.h"
@@ -191,3 +194,112 @@ BOOST_AUTO_TEST_CASE( tcp_acceptor_http_100_continue )
 
     pool.shutdown();
 }
+
+/* Read from the socket until the peer closes the connection or the given
+   number of bytes has been received. */
+static string
+receiveUntil(asio::ip::tcp::socket & socket, size_t size)
+{
+    string result;
+    char recvBuffer[1024];
+    while (result.size() < size) {
+        boost::system::error_code ec;
+        size_t nBytes = socket.read_some(asio::buffer(recvBuffer,
+                                                      sizeof(recvBuffer)),
+                                         ec);
+        if (ec) {
+            break;
+        }
+        result.append(recvBuffer, nBytes);
+    }
+    return result;
+}
+
+/* Test that pipelined requests are answered in order, and that the
+   connection is closed after the maximum number of requests */
+BOOST_AUTO_TEST_CASE( tcp_acceptor_http_pipelining )
+{
+    EventLoop loop;
+    AsioThreadPool pool(loop);
+
+    auto onNewConnection = [&] (TcpSocket && socket) {
+        auto handler = std::make_shared<MyHandler>(std::move(socket));
+        handler->setMaxRequestsPerConnection(2);
+        return handler;
+    };
+
+    TcpAcceptor acceptor(loop, onNewConnection);
+    acceptor.listen(0, "localhost");
+
+    auto address = asio::ip::address::from_string("127.0.0.1");
+    asio::ip::tcp::endpoint serverEndpoint(address,
+                                           acceptor.effectiveTCPv4Port());
+
+    string keepAliveResponse("HTTP/1.1 200 OK\r\n"
+                             "Content-Type: text/plain\r\n"
+                             "Content-Length: 4\r\n"
+                             "Connection: Keep-Alive\r\n"
+                             "\r\n"
+                             "pong");
+    string closeResponse("HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "Content-Length: 4\r\n"
+                         "Connection: close\r\n"
+                         "\r\n"
+                         "pong");
+
+    {
+        auto socket = asio::ip::tcp::socket(loop.impl().ioService());
+        socket.connect(serverEndpoint);
+
+        /* Three requests in a single write; only the first two are
+           answered. */
+        string request;
+        for (int i = 0;  i < 3;  ++i) {
+            request += ("GET /ping HTTP/1.1\r\n"
+                        "Host: *\r\n"
+                        "\r\n");
+        }
+        asio::write(socket, asio::buffer(request));
+
+        string response = receiveUntil(socket, size_t(-1));
+        BOOST_CHECK_EQUAL(response, keepAliveResponse + closeResponse);
+    }
+
+    pool.shutdown();
+}
+
+/* Test that connections are accepted and answered by all of the reactors */
+BOOST_AUTO_TEST_CASE( tcp_acceptor_http_reactors )
+{
+    EventLoop loop;
+    AsioThreadPool pool(loop);
+
+    std::mutex threadsLock;
+    std::set<std::thread::id> threads;
+
+    auto onNewConnection = [&] (TcpSocket && socket) {
+        std::unique_lock<std::mutex> guard(threadsLock);
+        threads.insert(std::this_thread::get_id());
+        return std::make_shared<MyHandler>(std::move(socket));
+    };
+
+    TcpAcceptor acceptor(loop, onNewConnection, 4);
+    BOOST_CHECK_EQUAL(acceptor.numReactors(), 4);
+    acceptor.listen(0, "localhost");
+    BOOST_REQUIRE_GT(acceptor.effectiveTCPv4Port(), 0);
+
+    for (int i = 0;  i < 64;  ++i) {
+        HttpRestProxy proxy("http://localhost:"
+                            + to_string(acceptor.effectiveTCPv4Port()));
+        auto resp = proxy.get("/v1/ping");
+        BOOST_REQUIRE_EQUAL(resp.code(), 200);
+    }
+
+    // The kernel spreads the connections by hashing their addresses, so
+    // more than one reactor gets some of them
+    BOOST_CHECK_GT(threads.size(), 1);
+
+    acceptor.shutdown();
+    pool.shutdown();
+}
@@ -0,0 +1,144 @@
+// This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+/* tcp_socket_handler_backpressure_test.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Test that writes requested from a producer thread reach the peer in
+   order, and that waitForWriteSpace() bounds the data queued for it.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <boost/system/error_code.hpp>
+#include <boost/test/unit_test.hpp>
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include "mldb/utils/testing/watchdog.h"
+#include "mldb/io/asio_thread_pool.h"
+#include "mldb/io/event_loop.h"
+#include "mldb/io/port_range_service.h"
+#include "mldb/io/tcp_acceptor.h"
+#include "mldb/io/tcp_socket_handler.h"
+
+using namespace std;
+using namespace ML;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_write_backpressure )
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    Watchdog watchdog(30.0);
+
+    static constexpr size_t BLOCK_SIZE = 100000;
+    static constexpr int NUM_BLOCKS = 200;
+    static constexpr size_t MAX_PENDING = 500000;
+
+    std::atomic<size_t> maxPendingSeen(0);
+    std::thread producer;
+
+    struct TestHandler : TcpSocketHandler {
+        TestHandler(TcpSocket && socket,
+                    std::atomic<size_t> & maxPendingSeen,
+                    std::thread & producer)
+            : TcpSocketHandler(std::move(socket)),
+              maxPendingSeen(maxPendingSeen), producer(producer)
+        {
+        }
+
+        virtual void bootstrap()
+        {
+            requestReceive();
+        }
+
+        virtual void onReceivedData(const char * data, size_t size)
+        {
+            // Produce the response from another thread, as a query would,
+            // so that it can be throttled without blocking the event loop
+            auto produce = [this] () {
+                for (int i = 0;  i < NUM_BLOCKS;  ++i) {
+                    requestWrite(string(BLOCK_SIZE, 'a' + i % 26));
+                    waitForWriteSpace(MAX_PENDING);
+                    size_t pending = bytesPendingWrite();
+                    if (pending > maxPendingSeen)
+                        maxPendingSeen = pending;
+                }
+                requestWrite("", [this] (const boost::system::error_code &,
+                                         size_t) { requestClose(); });
+            };
+            producer = std::thread(produce);
+        }
+
+        virtual void onReceiveError(const boost::system::error_code & ec,
+                                    size_t)
+        {
+        }
+
+        std::atomic<size_t> & maxPendingSeen;
+        std::thread & producer;
+    };
+
+    auto onMakeNewHandler = [&] (TcpSocket && socket) {
+        return std::make_shared<TestHandler>(std::move(socket),
+                                             maxPendingSeen, producer);
+    };
+
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+    TcpAcceptor acceptor(eventLoop, onMakeNewHandler);
+
+    acceptor.listen(0);
+    int port = acceptor.effectiveTCPv4Port();
+
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == -1)
+        throw MLDB::Exception(errno, "socket");
+
+    struct sockaddr_in addr = { AF_INET, htons(port), { INADDR_ANY } };
+    int res = connect(s, reinterpret_cast<const sockaddr *>(&addr),
+                      sizeof(addr));
+    if (res == -1)
+        throw MLDB::Exception(errno, "connect");
+
+    res = write(s, "go", 2);
+    ExcAssertEqual(res, 2);
+
+    // Read slowly at first so that the producer has to wait for us, and
+    // check that each byte belongs to the block it was written in
+    size_t bytesRead = 0;
+    size_t errors = 0;
+    vector<char> buf(65536);
+
+    while (true) {
+        if (bytesRead < BLOCK_SIZE * 20)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        int res = read(s, &buf[0], buf.size());
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == 0)
+            break;
+        if (res == -1)
+            throw MLDB::Exception(errno, "read");
+
+        for (int i = 0;  i < res;  ++i, ++bytesRead) {
+            char expected = 'a' + (bytesRead / BLOCK_SIZE) % 26;
+            errors += buf[i] != expected;
+        }
+    }
+
+    close(s);
+    producer.join();
+
+    BOOST_CHECK_EQUAL(bytesRead, BLOCK_SIZE * NUM_BLOCKS);
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK_LE(maxPendingSeen.load(), MAX_PENDING);
+
+    threadPool.shutdown();
+}
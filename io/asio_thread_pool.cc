@@ -13,6 +13,7 @@
 #include "mldb/watch/watch_impl.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/io/event_loop_impl.h"
+#include "mldb/arch/memory_arenas.h"
 #include <thread>
 
 
@@ -69,6 +70,9 @@ struct AsioThreadPool::Impl {
     
     void run(int threadNum)
     {
+        // Request and response buffers come from their own arena
+        bindThreadToArena(MEMORY_ARENA_REST);
+
         //cerr << "starting thread " << threadNum << endl;
         Date after = Date::now();
 
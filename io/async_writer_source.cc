@@ -8,7 +8,9 @@
 */
 
 #include <fcntl.h>
+#include <limits.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include <poll.h>
 #include <unistd.h>
 
@@ -48,6 +50,7 @@ AsyncWriterSource(const OnClosed & onClosed,
       bytesSent_(0),
       bytesReceived_(0),
       msgsSent_(0),
+      writeCalls_(0),
       onClosed_(onClosed),
       onReceivedData_(onReceivedData)
 {
@@ -241,50 +244,57 @@ flush()
         return;
     }
 
-    auto popWrite = [&] () {
-        if (queue_.size() == 0) {
-            return false;
-        }
-        auto writes = queue_.pop_front(1);
-        ExcAssert(writes.size() > 0);
-        currentWrite_ = move(writes[0]);
-        return true;
-    };
+    /* Queued messages are sent together with a single writev call, in
+       batches of at most IOV_MAX messages, so that many small messages
+       don't each cost a system call. */
+    errno = 0;
 
-    if (currentWrite_.message.empty()) {
-        if (!popWrite()) {
-            return;
+    while (fd_ != -1) {
+        if (currentWrites_.size() < IOV_MAX) {
+            auto writes = queue_.pop_front(IOV_MAX - currentWrites_.size());
+            for (auto & write: writes) {
+                currentWrites_.emplace_back(move(write));
+            }
         }
-        if (currentWrite_.message.empty()) {
+        if (currentWrites_.empty()) {
+            break;
+        }
+        if (currentWrites_.front().message.empty()) {
             ExcAssert(closing_);
+            currentWrites_.pop_front();
             handleClosing(false, true);
-            return;
+            break;
         }
-    }
 
-    ssize_t remaining(currentWrite_.message.size() - currentWrite_.sent);
-
-    errno = 0;
+        /* the messages following a close request are never sent */
+        struct iovec iov[IOV_MAX];
+        int numIov(0);
+        for (const AsyncWrite & write: currentWrites_) {
+            if (numIov == IOV_MAX || write.message.empty()) {
+                break;
+            }
+            iov[numIov].iov_base = (void *) (write.message.c_str() + write.sent);
+            iov[numIov].iov_len = write.message.size() - write.sent;
+            numIov++;
+        }
 
-    while (true) {
-        const char * data = currentWrite_.message.c_str() + currentWrite_.sent;
-        ssize_t len = ::write(fd_, data, remaining);
+        ssize_t len = ::writev(fd_, iov, numIov);
         if (len > 0) {
-            currentWrite_.sent += len;
-            remaining -= len;
+            writeCalls_++;
             bytesSent_ += len;
-            if (remaining == 0) {
-                msgsSent_++;
-                handleWriteResult(0, move(currentWrite_));
-                if (!popWrite()) {
-                    break;
-                }
-                if (currentWrite_.message.empty()) {
-                    ExcAssert(closing_);
-                    handleClosing(false, true);
-                    break;
+            while (len > 0) {
+                AsyncWrite & write = currentWrites_.front();
+                size_t sent = std::min<size_t>(len,
+                                               write.message.size()
+                                               - write.sent);
+                write.sent += sent;
+                len -= sent;
+                if (write.sent == write.message.size()) {
+                    msgsSent_++;
+                    AsyncWrite written(move(write));
+                    currentWrites_.pop_front();
+                    handleWriteResult(0, move(written));
                 }
-                remaining = currentWrite_.message.size();
             }
         }
         else if (len < 0) {
@@ -292,8 +302,11 @@ flush()
             if (errno == EWOULDBLOCK || errno == EAGAIN) {
                 break;
             }
-            handleWriteResult(errno, move(currentWrite_));
-            if (errno == EPIPE || errno == EBADF) {
+            int error = errno;
+            AsyncWrite failed(move(currentWrites_.front()));
+            currentWrites_.pop_front();
+            handleWriteResult(error, move(failed));
+            if (error == EPIPE || error == EBADF) {
                 handleClosing(true, true);
                 break;
             }
@@ -301,7 +314,7 @@ flush()
                 /* This exception indicates a lack of code in the handling of
                    errno. In a perfect world, it should never ever be
                    thrown. */
-                throw MLDB::Exception(errno, "unhandled write error");
+                throw MLDB::Exception(error, "unhandled write error");
             }
         }
     }
@@ -359,6 +372,12 @@ emptyMessageQueue()
 {
     std::vector<std::string> messages;
 
+    /* messages taken from the queue but not entirely sent come first */
+    for (auto & write: currentWrites_) {
+        messages.emplace_back(move(write.message));
+    }
+    currentWrites_.clear();
+
     auto writes = queue_.pop_front(0);
     for (auto & write: writes) {
         messages.emplace_back(move(write.message));
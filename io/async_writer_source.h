@@ -10,6 +10,7 @@
 #pragma once
 
 #include <atomic>
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -116,6 +117,11 @@ struct AsyncWriterSource : public EpollLoop
     size_t msgsSent() const
     { return msgsSent_; }
 
+    /* number of write system calls that sent data, each of which gathers
+       as many queued messages as possible */
+    size_t writeCalls() const
+    { return writeCalls_; }
+
 protected:
     /* set the "main" file descriptor, for which epoll events are monitored
      * and the onWriteResult, onReceivedData and onClosed callbacks are
@@ -190,11 +196,15 @@ private:
 
     bool queueEnabled_;
     TypedMessageQueue<AsyncWrite> queue_;
-    AsyncWrite currentWrite_;
+
+    /* messages taken from the queue and being written, in order; only the
+       first one may have been partially sent */
+    std::deque<AsyncWrite> currentWrites_;
 
     uint64_t bytesSent_;
     uint64_t bytesReceived_;
     size_t msgsSent_;
+    size_t writeCalls_;
 
     OnClosed onClosed_;
     OnWriteResult onWriteResult_;
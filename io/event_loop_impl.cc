@@ -17,6 +17,26 @@ using namespace MLDB;
 /* EVENT LOOP IMPL                                                          */
 /****************************************************************************/
 
+namespace {
+
+thread_local boost::asio::io_service * dedicatedService = nullptr;
+
+} // file scope
+
+void
+EventLoopImpl::
+setDedicatedService(boost::asio::io_service * ioService)
+{
+    dedicatedService = ioService;
+}
+
+bool
+EventLoopImpl::
+isDedicatedService(const boost::asio::io_service & ioService)
+{
+    return dedicatedService == &ioService;
+}
+
 void
 EventLoopImpl::
 run()
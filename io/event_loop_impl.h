@@ -31,6 +31,15 @@ struct EventLoopImpl {
         ioService_.post(jobFn);
     }
 
+    /** Record that the calling thread is the only one running the given
+        io_service, or nullptr if it no longer is. */
+    static void setDedicatedService(boost::asio::io_service * ioService);
+
+    /** Returns whether the calling thread is the only one running the given
+        io_service, in which case it must never block waiting for one of
+        its handlers to run. */
+    static bool isDedicatedService(const boost::asio::io_service & ioService);
+
 private:
     std::unique_ptr<boost::asio::io_service::work> work_;
     boost::asio::io_service ioService_;
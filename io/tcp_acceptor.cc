@@ -5,13 +5,19 @@
    Copyright (c) 2015 Datacratic.  All rights reserved.
 */
 
+#include <pthread.h>
+#include <string.h>
+#include <algorithm>
 #include <iostream>
 #include <mutex>
+#include <thread>
 
+#include <boost/asio/io_service.hpp>
 #include "mldb/arch/exception.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/io/tcp_acceptor_impl.h"
 #include "event_loop.h"
+#include "event_loop_impl.h"
 #include "port_range_service.h"
 #include "tcp_socket_handler.h"
 #include "tcp_acceptor.h"
@@ -20,16 +26,95 @@ using namespace std;
 using namespace MLDB;
 
 
+/****************************************************************************/
+/* TCP ACCEPTOR :: REACTOR                                                  */
+/****************************************************************************/
+
+/* An event loop served by a single thread, pinned to a core. The io_service
+ * is run and stopped directly rather than through EventLoop::run() and
+ * terminate(), so that stopping the reactor before its thread has started
+ * is not lost. */
+
+struct TcpAcceptor::Reactor {
+    Reactor(int reactorNum)
+        : work(loop.impl().ioService())
+    {
+        thread = std::thread([&] () { this->run(); });
+
+        int numCores = std::thread::hardware_concurrency();
+        if (numCores <= 0) {
+            return;
+        }
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(reactorNum % numCores, &cpus);
+
+        // Failure to pin is not fatal; the thread just moves around
+        int res = pthread_setaffinity_np(thread.native_handle(),
+                                         sizeof(cpus), &cpus);
+        if (res != 0) {
+            cerr << "warning: couldn't pin reactor " << reactorNum
+                 << ": " << strerror(res) << endl;
+        }
+    }
+
+    ~Reactor()
+    {
+        stop();
+    }
+
+    void run()
+    {
+        auto & ioService = loop.impl().ioService();
+        EventLoopImpl::setDedicatedService(&ioService);
+        while (!ioService.stopped()) {
+            boost::system::error_code err;
+            ioService.run(err);
+            if (err) {
+                cerr << "reactor ioService error " << err.message() << endl;
+            }
+        }
+    }
+
+    void stop()
+    {
+        if (thread.joinable()) {
+            loop.impl().ioService().stop();
+            thread.join();
+        }
+    }
+
+    EventLoop loop;
+    boost::asio::io_service::work work;
+    std::thread thread;
+};
+
+
 /****************************************************************************/
 /* TCP ACCEPTOR                                                             */
 /****************************************************************************/
 
 TcpAcceptor::
-TcpAcceptor(EventLoop & eventLoop, const OnNewConnection & onNewConnection)
+TcpAcceptor(EventLoop & eventLoop, const OnNewConnection & onNewConnection,
+            int numReactors)
     : eventLoop_(eventLoop),
-      onNewConnection_(onNewConnection),
-      impl_(new TcpAcceptorImpl(eventLoop_, *this))
+      onNewConnection_(onNewConnection)
 {
+    if (numReactors < 0) {
+        numReactors = std::max<int>(std::thread::hardware_concurrency(), 1);
+    }
+
+    if (numReactors == 0) {
+        impls_.emplace_back(new TcpAcceptorImpl(eventLoop_, *this));
+    }
+    else {
+        for (int i = 0;  i < numReactors;  i++) {
+            reactors_.emplace_back(new Reactor(i));
+            impls_.emplace_back(new TcpAcceptorImpl(reactors_.back()->loop,
+                                                    *this));
+        }
+    }
 }
 
 TcpAcceptor::
@@ -42,28 +127,39 @@ void
 TcpAcceptor::
 listen(const PortRange & portRange, const string & hostname, int backlog)
 {
-    impl_->listen(portRange, hostname, backlog);
+    bool reusePort = !reactors_.empty();
+    impls_[0]->listen(portRange, hostname, backlog, reusePort);
+
+    // The other reactors share the port(s) that the first one obtained
+    for (size_t i = 1;  i < impls_.size();  i++) {
+        impls_[i]->listenLike(*impls_[0], backlog);
+    }
 }
 
 int
 TcpAcceptor::
 effectiveTCPv4Port() const
 {
-    return impl_->effectiveTCPv4Port();
+    return impls_[0]->effectiveTCPv4Port();
 }
 
 int
 TcpAcceptor::
 effectiveTCPv6Port() const
 {
-    return impl_->effectiveTCPv6Port();
+    return impls_[0]->effectiveTCPv6Port();
 }
 
 void
 TcpAcceptor::
 shutdown()
 {
-    impl_->shutdown();
+    for (auto & impl: impls_) {
+        impl->shutdown();
+    }
+    for (auto & reactor: reactors_) {
+        reactor->stop();
+    }
 }
 
 std::shared_ptr<TcpSocketHandler>
@@ -75,15 +171,16 @@ onNewConnection(TcpSocket && socket)
 
 void
 TcpAcceptor::
-associate(std::shared_ptr<TcpSocketHandler> handler)
+associate(std::shared_ptr<TcpSocketHandler> handler, EventLoop & handlerLoop)
 {
+    EventLoop * loop = &handlerLoop;
     auto doAssociate = [=] () {
         std::unique_lock<std::mutex> guard(associatedHandlersLock_);
-        associatedHandlers_.insert(std::move(handler));
+        associatedHandlers_[handler.get()] = { handler, loop };
         handler->setAcceptor(this);
         handler->bootstrap();
     };
-    eventLoop_.post(doAssociate);
+    handlerLoop.post(doAssociate);
 }
 
 std::shared_ptr<TcpSocketHandler>
@@ -92,24 +189,35 @@ findHandlerPtr(TcpSocketHandler * handler)
     const
 {
     std::unique_lock<std::mutex> guard(associatedHandlersLock_);
-    for (auto & handlerPtr: associatedHandlers_) {
-        if (handlerPtr.get() == handler) {
-            return handlerPtr;
-        }
+    auto it = associatedHandlers_.find(handler);
+    if (it == associatedHandlers_.end()) {
+        throw MLDB::Exception("socket handler not found");
     }
 
-    throw MLDB::Exception("socket handler not found");
+    return it->second.handler;
 }
 
-/* FIXME: inefficient implementation */
 void
 TcpAcceptor::
 dissociate(TcpSocketHandler * handler)
 {
-    auto handlerPtr = findHandlerPtr(handler);
+    std::shared_ptr<TcpSocketHandler> handlerPtr;
+    EventLoop * loop;
+    {
+        std::unique_lock<std::mutex> guard(associatedHandlersLock_);
+        auto it = associatedHandlers_.find(handler);
+        if (it == associatedHandlers_.end()) {
+            throw MLDB::Exception("socket handler not found");
+        }
+        handlerPtr = it->second.handler;
+        loop = it->second.loop;
+    }
+
+    /* The handler is released from its own loop, once the operation that
+       caused it to be dissociated has returned. */
     auto doDissociate = [=] {
         std::unique_lock<std::mutex> guard(associatedHandlersLock_);
-        associatedHandlers_.erase(handlerPtr);
+        associatedHandlers_.erase(handlerPtr.get());
     };
-    eventLoop_.post(doDissociate);
+    loop->post(doDissociate);
 }
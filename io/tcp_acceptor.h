@@ -8,10 +8,11 @@
 #pragma once
 
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
-#include <set>
 #include <string>
+#include <vector>
 #include "mldb/io/tcp_socket.h"
 
 
@@ -29,7 +30,20 @@ struct TcpAcceptorImpl;
 /****************************************************************************/
 
 /* A class that listens on TCP ports and invokes a handler factory function
- * upon connection. */
+ * upon connection.
+ *
+ * By default, connections are accepted and handled on the given event loop.
+ * When "numReactors" is positive, the acceptor instead runs that many event
+ * loops of its own ("reactors"), each served by a single thread pinned to a
+ * core. Each reactor has its own listening socket, bound to the same port
+ * with SO_REUSEPORT, so that the kernel spreads the incoming connections
+ * among them. A connection is handled for its whole lifetime on the reactor
+ * that accepted it, which avoids contending for a single reactor. A negative
+ * value requests one reactor per core.
+ *
+ * Note that with SO_REUSEPORT, another process of the same user which also
+ * uses it may end up sharing a port taken from a range; a fixed port avoids
+ * that. */
 
 struct TcpAcceptor {
     /* A type of function that is invoked upon connection and which returns a
@@ -38,7 +52,8 @@ struct TcpAcceptor {
         OnNewConnection;
 
     TcpAcceptor(EventLoop & eventLoop,
-                const OnNewConnection & onNewConnection);
+                const OnNewConnection & onNewConnection,
+                int numReactors = 0);
     ~TcpAcceptor();
 
     /* Starts listening on either of the given ports (in ascending order) and
@@ -47,8 +62,8 @@ struct TcpAcceptor {
                 const std::string & hostname = "localhost",
                 int backlog = 128);
 
-    /* Shutdowns the worker threads (except the main listening thread) as well
-     * as the listening socket. */
+    /* Shutdowns the worker threads (except the main listening thread),
+     * including those of the reactors, as well as the listening sockets. */
     void shutdown();
 
     /* Returns the port used effectively for listening. -1 indicates that the
@@ -59,25 +74,47 @@ struct TcpAcceptor {
     virtual std::shared_ptr<TcpSocketHandler> onNewConnection(TcpSocket
                                                               && socket);
 
-    /* Associate and retain ownership of the given handler. For internal
-       purpose only. */
-    void associate(std::shared_ptr<TcpSocketHandler> handler);
+    /* Returns the number of reactors, or 0 if connections are handled by
+     * the event loop given to the constructor. */
+    int numReactors() const
+    {
+        return reactors_.size();
+    }
+
+    /* Associate and retain ownership of the given handler, which is
+       bootstrapped and runs on the given event loop. For internal purpose
+       only. */
+    void associate(std::shared_ptr<TcpSocketHandler> handler,
+                   EventLoop & handlerLoop);
 
     /* Dissociate and the given handler. For internal purpose only. */
     void dissociate(TcpSocketHandler * handler);
 
-    /* Associate and retain ownership of the given handler. For internal
+    /* Returns the shared pointer owning the given handler. For internal
        purpose only. */
     std::shared_ptr<TcpSocketHandler> findHandlerPtr(TcpSocketHandler
                                                      * handler) const;
 
 private:
+    struct Reactor;
+
+    struct AssociatedHandler {
+        std::shared_ptr<TcpSocketHandler> handler;
+        EventLoop * loop;
+    };
+
     EventLoop & eventLoop_;
     OnNewConnection onNewConnection_;
-    std::unique_ptr<TcpAcceptorImpl> impl_;
+
+    /* Declared before the handlers and the acceptors, so that the event
+       loops outlive the sockets using them. */
+    std::vector<std::unique_ptr<Reactor> > reactors_;
+
+    /* One per reactor, or a single one accepting on eventLoop_. */
+    std::vector<std::unique_ptr<TcpAcceptorImpl> > impls_;
 
     mutable std::mutex associatedHandlersLock_;
-    std::set<std::shared_ptr<TcpSocketHandler> > associatedHandlers_;
+    std::map<TcpSocketHandler *, AssociatedHandler> associatedHandlers_;
 };
 
 } // namespace MLDB
@@ -29,6 +29,9 @@ using namespace MLDB;
 
 static asio::ip::tcp::resolver::iterator endIterator;
 
+typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+    ReusePort;
+
 
 /****************************************************************************/
 /* TCP ACCEPTOR IMPL                                                        */
@@ -53,7 +56,8 @@ TcpAcceptorImpl::
 
 void
 TcpAcceptorImpl::
-listen(const PortRange & portRange, const string & hostname, int backlog)
+listen(const PortRange & portRange, const string & hostname, int backlog,
+       bool reusePort)
 {
     ExcAssert(!hostname.empty());
 
@@ -68,13 +72,13 @@ listen(const PortRange & portRange, const string & hostname, int backlog)
         auto ep = result.endpoint();
         if (ep.protocol() == asio::ip::tcp::v4()) {
             if (!v4Endpoint_.isOpen()) {
-                v4Endpoint_.open(ep, portRange, backlog);
+                v4Endpoint_.open(ep, portRange, backlog, reusePort);
                 accept(v4Endpoint_);
             }
         }
         else if (ep.protocol() == asio::ip::tcp::v6()) {
             if (!v6Endpoint_.isOpen()) {
-                v6Endpoint_.open(ep, portRange, backlog);
+                v6Endpoint_.open(ep, portRange, backlog, reusePort);
                 accept(v6Endpoint_);
             }
         }
@@ -85,6 +89,20 @@ listen(const PortRange & portRange, const string & hostname, int backlog)
     }
 }
 
+void
+TcpAcceptorImpl::
+listenLike(const TcpAcceptorImpl & other, int backlog)
+{
+    if (other.v4Endpoint_.isOpen()) {
+        v4Endpoint_.openLike(other.v4Endpoint_, backlog);
+        accept(v4Endpoint_);
+    }
+    if (other.v6Endpoint_.isOpen()) {
+        v6Endpoint_.openLike(other.v6Endpoint_, backlog);
+        accept(v6Endpoint_);
+    }
+}
+
 void
 TcpAcceptorImpl::
 shutdown()
@@ -110,7 +128,7 @@ accept(TcpAcceptorImpl::Endpoint & endpoint)
             TcpSocket frontSocket(std::move(nextSocket));
             auto newConn
                 = frontAcceptor_.onNewConnection(std::move(frontSocket));
-            frontAcceptor_.associate(std::move(newConn));
+            frontAcceptor_.associate(std::move(newConn), eventLoop_);
             accept(endpoint);
         }
     };
@@ -137,7 +155,7 @@ TcpAcceptorImpl::Endpoint::
 void
 TcpAcceptorImpl::Endpoint::
 open(const asio::ip::tcp::endpoint & asioEndpoint,
-     const PortRange & portRange, int backlog)
+     const PortRange & portRange, int backlog, bool reusePort)
 {
     /* Exception safety: we close the socket if we could not bind it
        appropriately */
@@ -152,6 +170,9 @@ open(const asio::ip::tcp::endpoint & asioEndpoint,
             acceptorPtr.reset(new asio::ip::tcp::acceptor(ioService_));
             acceptorPtr->open(bindEndpoint.protocol());
             acceptorPtr->set_option(asio::socket_base::reuse_address(true));
+            if (reusePort) {
+                acceptorPtr->set_option(ReusePort(true));
+            }
             bindEndpoint.port(i);
             system::error_code ec;
             acceptorPtr->bind(bindEndpoint, ec);
@@ -179,6 +200,31 @@ open(const asio::ip::tcp::endpoint & asioEndpoint,
     }
 }
 
+void
+TcpAcceptorImpl::Endpoint::
+openLike(const Endpoint & other, int backlog)
+{
+    ExcAssert(!isOpen_);
+    ExcAssert(other.isOpen_);
+
+    auto cleanupAcceptor = ScopeExit([&] () noexcept { if (!isOpen_) { acceptor_.close(); } });
+
+    auto bindEndpoint = other.acceptor_.local_endpoint();
+    acceptor_.open(bindEndpoint.protocol());
+    acceptor_.set_option(asio::socket_base::reuse_address(true));
+    acceptor_.set_option(ReusePort(true));
+
+    system::error_code ec;
+    acceptor_.bind(bindEndpoint, ec);
+    if (ec) {
+        throw MLDB::Exception("error binding socket to shared port "
+                              + to_string(bindEndpoint.port())
+                              + ": " + ec.message());
+    }
+    acceptor_.listen(backlog);
+    isOpen_ = true;
+}
+
 void
 TcpAcceptorImpl::Endpoint::
 close()
@@ -37,9 +37,14 @@ struct TcpAcceptorImpl {
     virtual ~TcpAcceptorImpl();
 
     /* Starts listening on the first available of the given ports (in
-     * ascending order) and interface. */
+     * ascending order) and interface. With "reusePort", the sockets are
+     * opened with SO_REUSEPORT so that other acceptors can share them. */
     void listen(const PortRange & portRange, const std::string & hostname,
-                int backlog);
+                int backlog, bool reusePort = false);
+
+    /* Starts listening on the same addresses and ports as "other", which
+     * must have been opened with "reusePort". */
+    void listenLike(const TcpAcceptorImpl & other, int backlog);
 
     /* Shutdowns the worker threads (except the main listening thread) as well
      * as the listening socket. */
@@ -64,7 +69,8 @@ private:
 
         void open(const boost::asio::ip::tcp::endpoint & resolverEntry,
                   const PortRange & portRange,
-                  int backlog);
+                  int backlog, bool reusePort);
+        void openLike(const Endpoint & other, int backlog);
         void close();
         void accept();
         bool isOpen()
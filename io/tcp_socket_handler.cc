@@ -63,6 +63,20 @@ requestReceive()
     impl_->requestReceive();
 }
 
+void
+TcpSocketHandler::
+requestTimeout(double seconds, OnTimeout onTimeout)
+{
+    impl_->requestTimeout(seconds, std::move(onTimeout));
+}
+
+void
+TcpSocketHandler::
+cancelTimeout()
+{
+    impl_->cancelTimeout();
+}
+
 void
 TcpSocketHandler::
 requestWrite(string data, OnWritten onWritten)
@@ -70,6 +84,21 @@ requestWrite(string data, OnWritten onWritten)
     impl_->requestWrite(std::move(data), std::move(onWritten));
 }
 
+size_t
+TcpSocketHandler::
+bytesPendingWrite()
+    const
+{
+    return impl_->bytesPendingWrite();
+}
+
+void
+TcpSocketHandler::
+waitForWriteSpace(size_t maxPending)
+{
+    impl_->waitForWriteSpace(maxPending);
+}
+
 void
 TcpSocketHandler::
 disableNagle()
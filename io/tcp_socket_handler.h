@@ -37,6 +37,7 @@ struct TcpSocket;
 
 struct TcpSocketHandler {
     typedef std::function<void ()> OnClose;
+    typedef std::function<void ()> OnTimeout;
     typedef std::function<void (const boost::system::error_code &,
                                 size_t)> OnWritten;
 
@@ -62,12 +63,34 @@ struct TcpSocketHandler {
     /* Request the closing of the connection via the handling thread. */
     void requestClose(OnClose onClose = nullptr);
 
-    /* Request the sending of a given payload. */
+    /* Request the sending of a given payload.  Payloads that are queued
+       while a previous one is being written are sent together in a single
+       gathered write. */
     void requestWrite(std::string data, OnWritten onWritten = nullptr);
 
     /* Request the reading of any available data from the socket. */
     void requestReceive();
 
+    /* Request that onTimeout be invoked via the handling thread once the
+       given number of seconds has elapsed, replacing any timeout requested
+       previously.  It is not invoked if cancelTimeout() is called or the
+       connection is closed before then. */
+    void requestTimeout(double seconds, OnTimeout onTimeout);
+
+    /* Cancel the timeout requested with requestTimeout(), if any. */
+    void cancelTimeout();
+
+    /* Number of bytes requested for writing that have not yet been written
+       to the socket. */
+    size_t bytesPendingWrite() const;
+
+    /* Block the calling thread until no more than maxPending bytes are
+       waiting to be written, or the connection is closed.  This allows a
+       producer to be throttled to the speed of the peer.  It must not be
+       called from the only thread running the event loop, except on a
+       reactor of TcpAcceptor, where it returns immediately. */
+    void waitForWriteSpace(size_t maxPending);
+
     /* Virtual base method called when data has been read from the associated
        socket. */
     virtual void onReceivedData(const char * buffer, size_t bufferSize) = 0;
@@ -5,10 +5,14 @@
    Copyright (c) 2015 Datacratic.  All rights reserved.
 */
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 #include <boost/asio/write.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/system/error_code.hpp>
 #include "mldb/io/tcp_socket.h"
+#include "event_loop_impl.h"
 #include "tcp_socket_impl.h"
 #include "tcp_socket_handler_impl.h"
 
@@ -24,9 +28,11 @@ using namespace MLDB;
 TcpSocketHandlerImpl::
 TcpSocketHandlerImpl(TcpSocketHandler & handler, TcpSocket && socket)
     : handler_(handler), socket_(std::move(socket.impl().socket)),
+      timer_(socket_.get_io_service()),
       recvBufferSize_(262144),
       recvBuffer_(new char[recvBufferSize_]),
-      closed_(false)
+      closed_(false),
+      writeQueue_(std::make_shared<WriteQueue>())
 {
     onReadSome_ = [&] (const system::error_code & ec, size_t bufferSize) {
         if (ec) {
@@ -43,6 +49,7 @@ TcpSocketHandlerImpl(TcpSocketHandler & handler, TcpSocket && socket)
 TcpSocketHandlerImpl::
 ~TcpSocketHandlerImpl()
 {
+    markClosed();
 }
 
 void
@@ -51,6 +58,18 @@ close()
 {
     socket_.close();
     closed_ = true;
+    system::error_code ec;
+    timer_.cancel(ec);
+    markClosed();
+}
+
+void
+TcpSocketHandlerImpl::
+markClosed()
+{
+    std::unique_lock<std::mutex> guard(writeQueue_->lock);
+    writeQueue_->closed = true;
+    writeQueue_->spaceAvailable.notify_all();
 }
 
 void
@@ -76,24 +95,112 @@ requestReceive()
 
 void
 TcpSocketHandlerImpl::
-requestWrite(string data, TcpSocketHandler::OnWritten onWritten)
+requestTimeout(double seconds, TcpSocketHandler::OnTimeout onTimeout)
 {
-    auto dataPtr = std::make_shared<std::string>(std::move(data));
-    auto writeCompleteCond = [=] (const system::error_code & ec,
-                                  std::size_t written) {
-        return written == dataPtr->size();
+    auto onTimer = [=] (const system::error_code & ec) {
+        if (ec != asio::error::operation_aborted && !closed_) {
+            onTimeout();
+        }
     };
+    timer_.expires_from_now(posix_time::microseconds(seconds * 1000000));
+    timer_.async_wait(onTimer);
+}
+
+void
+TcpSocketHandlerImpl::
+cancelTimeout()
+{
+    system::error_code ec;
+    timer_.cancel(ec);
+}
+
+void
+TcpSocketHandlerImpl::
+requestWrite(string data, TcpSocketHandler::OnWritten onWritten)
+{
+    std::unique_lock<std::mutex> guard(writeQueue_->lock);
+    writeQueue_->bytesPending += data.size();
+    writeQueue_->entries.push_back({ std::move(data), std::move(onWritten) });
+    if (!writeQueue_->writing && !writeQueue_->closed) {
+        writeQueue_->writing = true;
+        startWrite();
+    }
+}
+
+void
+TcpSocketHandlerImpl::
+startWrite()
+{
+    static constexpr size_t MAX_GATHERED_WRITES = 64;
+
+    std::shared_ptr<WriteQueue> queue = writeQueue_;
+
+    // Entries stay in place until they are written, as a deque doesn't
+    // move its elements when others are added at the back
+    size_t numEntries = std::min(queue->entries.size(), MAX_GATHERED_WRITES);
+    std::vector<asio::const_buffer> writeBuffers;
+    writeBuffers.reserve(numEntries);
+    for (size_t i = 0;  i < numEntries;  ++i) {
+        const std::string & data = queue->entries[i].data;
+        writeBuffers.emplace_back(data.c_str(), data.size());
+    }
+
     auto onWriteComplete = [=] (const system::error_code & ec,
                                 size_t written)
-        mutable
     {
-        if (onWritten) {
-            onWritten(ec, written);
+        std::unique_lock<std::mutex> guard(queue->lock);
+        std::vector<WriteQueue::Entry> done;
+        done.reserve(numEntries);
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            done.emplace_back(std::move(queue->entries.front()));
+            queue->entries.pop_front();
+            queue->bytesPending -= done.back().data.size();
+        }
+
+        // Once closed, this object may no longer exist, so no further
+        // write can be started; the remaining entries are dropped.
+        if (!queue->entries.empty() && !queue->closed) {
+            startWrite();
+        }
+        else {
+            queue->writing = false;
+        }
+        queue->spaceAvailable.notify_all();
+        guard.unlock();
+
+        for (auto & entry: done) {
+            if (entry.onWritten) {
+                entry.onWritten(ec, ec ? 0 : entry.data.size());
+            }
         }
-        (void) dataPtr;
     };
-    asio::const_buffers_1 writeBuffer(dataPtr->c_str(), dataPtr->size());
-    async_write(socket_, writeBuffer, writeCompleteCond, onWriteComplete);
+
+    async_write(socket_, writeBuffers, onWriteComplete);
+}
+
+size_t
+TcpSocketHandlerImpl::
+bytesPendingWrite()
+    const
+{
+    std::unique_lock<std::mutex> guard(writeQueue_->lock);
+    return writeQueue_->bytesPending;
+}
+
+void
+TcpSocketHandlerImpl::
+waitForWriteSpace(size_t maxPending)
+{
+    // On a reactor, the writes can only complete on this very thread
+    if (EventLoopImpl::isDedicatedService(socket_.get_io_service())) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(writeQueue_->lock);
+    while (writeQueue_->bytesPending > maxPending && writeQueue_->writing
+           && !writeQueue_->closed) {
+        writeQueue_->spaceAvailable.wait(guard);
+    }
 }
 
 void
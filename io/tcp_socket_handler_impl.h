@@ -9,7 +9,12 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include "mldb/io/tcp_socket_handler.h"
 
@@ -50,6 +55,21 @@ struct TcpSocketHandlerImpl {
     /* Request the reading of any available data from the socket. */
     void requestReceive();
 
+    /* Request that onTimeout be invoked after the given delay. */
+    void requestTimeout(double seconds,
+                        TcpSocketHandler::OnTimeout onTimeout);
+
+    /* Cancel the pending timeout, if any. */
+    void cancelTimeout();
+
+    /* Number of bytes requested for writing that have not yet been written
+       to the socket. */
+    size_t bytesPendingWrite() const;
+
+    /* Block until no more than maxPending bytes are waiting to be written,
+       or the connection is closed. */
+    void waitForWriteSpace(size_t maxPending);
+
     TcpSocketHandlerImpl(const TcpSocketHandlerImpl & other) = delete;
     TcpSocketHandlerImpl &
         operator = (const TcpSocketHandlerImpl & other) = delete;
@@ -57,6 +77,7 @@ struct TcpSocketHandlerImpl {
 private:
     TcpSocketHandler & handler_;
     boost::asio::ip::tcp::socket socket_;
+    boost::asio::deadline_timer timer_;
 
     size_t recvBufferSize_;
 
@@ -66,6 +87,37 @@ private:
                                size_t bufferSize)> OnReadSome;
     OnReadSome onReadSome_;
     std::atomic<bool> closed_;
+
+    /* Writes are queued and performed one at a time, so that they are put
+       on the wire in the order they were requested even when requested
+       from several threads.  The queue is shared with the completion
+       handlers, which may run after the handler has been destroyed. */
+    struct WriteQueue {
+        WriteQueue()
+            : writing(false), closed(false), bytesPending(0)
+        {
+        }
+
+        struct Entry {
+            std::string data;
+            TcpSocketHandler::OnWritten onWritten;
+        };
+
+        std::mutex lock;
+        std::condition_variable spaceAvailable;
+        std::deque<Entry> entries;
+        bool writing;
+        bool closed;
+        size_t bytesPending;
+    };
+
+    std::shared_ptr<WriteQueue> writeQueue_;
+
+    /* Start writing the entries at the front of the queue, up to
+       MAX_GATHERED_WRITES of them at once.  The queue lock must be held. */
+    void startWrite();
+
+    void markClosed();
 };
 
 } // namespace MLDB
@@ -197,14 +197,17 @@ void doBench(const string & label,
     }
 
     double totalTime = lastRead - start;
-    ::printf("%s,%d,%zu,%zu,%d,%f,%f,%f,%f,%f\n",
+    /* number of messages sent by each write system call */
+    double coalescing = double(writer->msgsSent()) / writer->writeCalls();
+    ::printf("%s,%d,%zu,%zu,%d,%f,%f,%f,%f,%f,%zu,%f\n",
              label.c_str(),
              numMessages, msgSize, bytesRead, numMissed,
              (lastWrite - start),
              (lastWriteResult - start),
              totalTime,
              (double(numMessages) / totalTime),
-             (double(totalBytes) / totalTime));
+             (double(totalBytes) / totalTime),
+             writer->writeCalls(), coalescing);
 
     readerLoop.shutdown();
     writerLoop.shutdown();
@@ -226,7 +229,7 @@ int main()
 {
     ::printf("label,msgs_count,msg_size,bytes_xfer,miss_count,"
              "delta_last_write,delta_last_written,delta_last_read,"
-             "msg_rate,byte_rate\n");
+             "msg_rate,byte_rate,write_calls,msgs_per_write\n");
 
     benchFunction("pipe", makePipePair);
     benchFunction("unix", makeUnixSocketPair);
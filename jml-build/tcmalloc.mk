@@ -1,4 +1,12 @@
-ifeq ($(TCMALLOC_ENABLED),1)
+# jemalloc takes precedence over tcmalloc when both are enabled.  It's the
+# one that arch/memory_arenas.h can give separate arenas to subsystems with.
+ifeq ($(JEMALLOC_ENABLED),1)
+
+MEMORY_ALLOC_LIBRARY?=jemalloc
+CXXFLAGS += -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc -fno-builtin-free
+CFLAGS += -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc -fno-builtin-free
+
+else ifeq ($(TCMALLOC_ENABLED),1)
 
 MEMORY_ALLOC_LIBRARY?=tcmalloc
 CXXFLAGS += -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc -fno-builtin-free
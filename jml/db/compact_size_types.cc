@@ -142,7 +142,14 @@ unsigned long long decode_compact(Store_Reader & store)
        and finding the first 1 bit in the result. */
     store.must_have(1);
 
-    int len = compact_decode_length(*store);
+    // Most sizes fit in the first byte, which then has its top bit clear
+    unsigned char firstChar = *store;
+    if (firstChar < 0x80) {
+        store.skip(1);
+        return firstChar;
+    }
+
+    int len = compact_decode_length(firstChar);
 
     //cerr << "marker = " << int(marker) << endl;
     //cerr << "len = " << len << endl;
@@ -14,6 +14,7 @@
 #include "portable_iarchive.h"
 #include "mldb/jml/utils/file_functions.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/compressor.h"
 #include <boost/scoped_ptr.hpp>
 #include <iostream>
 #include <algorithm>
@@ -73,7 +74,7 @@ struct Binary_Input::Buffer_Source
 struct Binary_Input::Stream_Source
     : public Binary_Input::Source {
 
-    enum { DEFAULT_BUF_SIZE = 4096 };
+    enum { DEFAULT_BUF_SIZE = 65536 };
 
     Stream_Source(std::istream & stream)
         : stream(stream), buf_start(0), buf_size(0)
@@ -235,7 +236,8 @@ void Binary_Input::open(const std::string & filename)
 {
     if (endsWith(filename, ".gz")
         || endsWith(filename, ".bz2")
-        || endsWith(filename, ".xz")) {
+        || endsWith(filename, ".xz")
+        || MLDB::Compressor::filenameToCompression(filename) != "") {
         source.reset(new Stream_Source(new MLDB::filter_istream(filename)));
         offset_ = 0;
         pos_ = end_ = 0;
@@ -251,6 +253,19 @@ void Binary_Input::open(const std::string & filename)
 
 void Binary_Input::open(std::istream & stream)
 {
+    // A memory mapped file is read in place from the current position,
+    // rather than being copied through a buffer.  The stream needs to
+    // outlive the input, as it owns the mapping.
+    auto * filtered = dynamic_cast<MLDB::filter_istream *>(&stream);
+    if (filtered && filtered->mapped().first) {
+        std::streamoff pos = stream.tellg();
+        size_t size = filtered->mapped().second;
+        if (pos >= 0 && pos <= size) {
+            open(filtered->mapped().first + pos, size - pos);
+            return;
+        }
+    }
+
     offset_ = 0;
     pos_ = end_ = 0;
     source.reset(new Stream_Source(stream));
@@ -242,12 +242,7 @@ public:
         compact_size_t sz(*this);
 
         std::vector<T, A> v;
-        v.reserve(sz);
-        for (unsigned i = 0;  i < sz;  ++i) {
-            T t;
-            *this >> t;
-            v.push_back(t);
-        }
+        load_elements(v, sz, is_fixed_width_serializable<T>());
         vec.swap(v);
     }
 
@@ -326,10 +321,7 @@ public:
 
         arr.resize(sizes);
 
-        size_t ne = arr.num_elements();
-        T * el = arr.data();
-        for (unsigned i = 0;  i < ne;  ++i, ++el)
-            *this >> *el;
+        load_array(arr.data(), arr.num_elements());
     }
 
     void load_binary(void * address, size_t size)
@@ -340,6 +332,60 @@ public:
         skip(size);
     }
 
+    /** Load n values saved with portable_bin_oarchive::save_array().  This
+        is a copy, as the serialization order is the native byte order.
+        Big arrays are copied a block at a time, so that a stream source
+        doesn't need to buffer all of the array at once.
+    */
+    template<typename T>
+    void load_array(T * values, size_t n)
+    {
+        load_array_impl(values, n, is_fixed_width_serializable<T>());
+    }
+
+private:
+    enum { ARRAY_BLOCK_SIZE = 1 << 20 };
+
+    template<typename T>
+    void load_array_impl(T * values, size_t n, std::true_type)
+    {
+        char * p = reinterpret_cast<char *>(values);
+        size_t bytes = n * sizeof(T);
+        while (bytes) {
+            size_t todo = std::min<size_t>(bytes, ARRAY_BLOCK_SIZE);
+            load_binary(p, todo);
+            p += todo;
+            bytes -= todo;
+        }
+    }
+
+    template<typename T>
+    void load_array_impl(T * values, size_t n, std::false_type)
+    {
+        for (size_t i = 0;  i < n;  ++i)
+            *this >> values[i];
+    }
+
+    template<class T, class A>
+    void load_elements(std::vector<T, A> & v, size_t sz, std::true_type)
+    {
+        v.resize(sz);
+        load_array(v.data(), sz);
+    }
+
+    template<class T, class A>
+    void load_elements(std::vector<T, A> & v, size_t sz, std::false_type)
+    {
+        v.reserve(sz);
+        for (size_t i = 0;  i < sz;  ++i) {
+            T t;
+            *this >> t;
+            v.emplace_back(std::move(t));
+        }
+    }
+
+public:
+
     // Anything with a serialize() method gets to be serialized
     template<typename T>
     void load(T & obj,
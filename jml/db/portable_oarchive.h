@@ -185,8 +185,7 @@ public:
     {
         compact_size_t size(vec.size());
         size.serialize(*this);
-        for (unsigned i = 0;  i < vec.size();  ++i)
-            *this << vec[i];
+        save_elements(vec, is_fixed_width_serializable<T>());
     }
 
     template<class K, class V, class L, class A>
@@ -234,10 +233,7 @@ public:
             dim.serialize(*this);
         }
 
-        size_t ne = arr.num_elements();
-        const T * el = arr.data();
-        for (unsigned i = 0;  i < ne;  ++i, ++el)
-            *this << *el;
+        save_array(arr.data(), arr.num_elements());
     }
 
     template<typename T1, typename T2>
@@ -259,6 +255,17 @@ public:
             throw Exception("Error writing to stream");
     }
 
+    /** Save n values.  Values of a fixed width type are written as one
+        block, as the serialization order is the native byte order; others
+        are saved one by one.  Either way, the result is the same as saving
+        each value in turn.
+    */
+    template<typename T>
+    void save_array(const T * values, size_t n)
+    {
+        save_array_impl(values, n, is_fixed_width_serializable<T>());
+    }
+
     /** Warning: doesn't do byte order conversions or anything like that. */
     template<typename T>
     void save_binary(const T & val)
@@ -285,6 +292,33 @@ public:
     size_t offset() const { return offset_; }
 
 private:
+    template<typename T>
+    void save_array_impl(const T * values, size_t n, std::true_type)
+    {
+        save_binary(values, n * sizeof(T));
+    }
+
+    template<typename T>
+    void save_array_impl(const T * values, size_t n, std::false_type)
+    {
+        for (size_t i = 0;  i < n;  ++i)
+            *this << values[i];
+    }
+
+    template<class T, class A>
+    void save_elements(const std::vector<T, A> & vec, std::true_type)
+    {
+        save_array(vec.data(), vec.size());
+    }
+
+    // Also covers std::vector<bool>, which has no data()
+    template<class T, class A>
+    void save_elements(const std::vector<T, A> & vec, std::false_type)
+    {
+        for (size_t i = 0;  i < vec.size();  ++i)
+            *this << vec[i];
+    }
+
     std::ostream * stream;
     std::shared_ptr<std::ostream> owned_stream;
     size_t offset_;
@@ -17,6 +17,7 @@
 #define __db__serialization_order_h__
 
 #include <stdint.h>
+#include <type_traits>
 #include "mldb/compiler/compiler.h"
 
 namespace ML {
@@ -104,6 +105,25 @@ MLDB_ALWAYS_INLINE int64_t serialization_order(int64_t val)
     return val;
 }
 
+/** Types that are saved as their bytes in serialization order, so that an
+    array of them is saved as a block which can be copied in one go.  Longs
+    aren't, as they are saved as compact integers, and nor is bool, as any
+    non-zero byte loads as true.
+*/
+template<typename T>
+struct is_fixed_width_serializable : std::false_type {
+};
+
+template<> struct is_fixed_width_serializable<char> : std::true_type {};
+template<> struct is_fixed_width_serializable<signed char> : std::true_type {};
+template<> struct is_fixed_width_serializable<unsigned char> : std::true_type {};
+template<> struct is_fixed_width_serializable<short> : std::true_type {};
+template<> struct is_fixed_width_serializable<unsigned short> : std::true_type {};
+template<> struct is_fixed_width_serializable<int> : std::true_type {};
+template<> struct is_fixed_width_serializable<unsigned int> : std::true_type {};
+template<> struct is_fixed_width_serializable<float> : std::true_type {};
+template<> struct is_fixed_width_serializable<double> : std::true_type {};
+
 } // namespace DB
 } // namespace ML
 
@@ -15,12 +15,15 @@
 #include "mldb/jml/utils/guard.h"
 #include "mldb/jml/db/persistent.h"
 #include "mldb/jml/db/compact_size_types.h"
+#include "mldb/vfs/filter_streams.h"
 #include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
 
 #include <sstream>
 #include <boost/multi_array.hpp>
 #include "mldb/ml/algebra/matrix_ops.h"
 #include "mldb/jml/stats/distribution.h"
+#include "mldb/jml/utils/vector_utils.h"
 
 
 using namespace ML;
@@ -142,3 +145,101 @@ BOOST_AUTO_TEST_CASE( test_distribution )
     dist.push_back(2.0);
     test_serialize_reconstitute(dist);
 }
+
+BOOST_AUTO_TEST_CASE( test_vectors )
+{
+    std::vector<float> floats;
+    test_serialize_reconstitute(floats);
+    for (unsigned i = 0;  i < 1000;  ++i)
+        floats.push_back(i * 1.5 - 100);
+    test_serialize_reconstitute(floats);
+
+    std::vector<bool> bools = { true, false, false, true };
+    test_serialize_reconstitute(bools);
+
+    std::vector<std::string> strings = { "hello", "", "world" };
+    test_serialize_reconstitute(strings);
+
+    std::vector<unsigned long> longs = { 0, 1, 128, 1ULL << 40 };
+    test_serialize_reconstitute(longs);
+}
+
+BOOST_AUTO_TEST_CASE( test_vector_format )
+{
+    // A vector of a fixed width type is written in one block, which must
+    // give the same bytes as writing each element in turn
+    std::vector<int> ints = { 1, -1, 1 << 20, -(1 << 30) };
+
+    ostringstream bulk;
+    {
+        DB::Store_Writer writer(bulk);
+        writer << ints;
+    }
+
+    ostringstream oneByOne;
+    {
+        DB::Store_Writer writer(oneByOne);
+        writer << compact_size_t(ints.size());
+        for (int i: ints)
+            writer << i;
+    }
+
+    BOOST_CHECK_EQUAL(bulk.str(), oneByOne.str());
+}
+
+BOOST_AUTO_TEST_CASE( test_big_vector_through_stream )
+{
+    // Bigger than a block, so that it's read from the stream in parts
+    std::vector<double> doubles(500000);
+    for (unsigned i = 0;  i < doubles.size();  ++i)
+        doubles[i] = i / 7.0;
+
+    ostringstream stream_out;
+    {
+        DB::Store_Writer writer(stream_out);
+        writer << doubles << std::string("END");
+    }
+
+    istringstream stream_in(stream_out.str());
+    DB::Store_Reader reader(stream_in);
+    std::vector<double> result;
+    std::string s;
+    reader >> result >> s;
+
+    BOOST_CHECK(result == doubles);
+    BOOST_CHECK_EQUAL(s, "END");
+}
+
+BOOST_AUTO_TEST_CASE( test_mapped_stream )
+{
+    string tmp_filename = "tmp/serialize_reconstitute_test_mapped";
+    boost::filesystem::create_directory("tmp");
+    Call_Guard guard(std::bind(&delete_file, tmp_filename));
+
+    std::vector<float> floats(100000);
+    for (unsigned i = 0;  i < floats.size();  ++i)
+        floats[i] = i;
+
+    {
+        DB::Store_Writer writer(tmp_filename);
+        writer << std::string("header") << floats;
+    }
+
+    // Start from the middle of the file, as the reader must begin where
+    // the stream is positioned
+    MLDB::filter_istream stream(tmp_filename, { { "mapped", "true" } });
+    BOOST_REQUIRE(stream.mapped().first);
+    std::string header;
+    {
+        DB::Store_Reader reader(stream);
+        reader >> header;
+        BOOST_CHECK_EQUAL(reader.offset(), header.size() + 1);
+    }
+    stream.seekg(header.size() + 1);
+
+    DB::Store_Reader reader(stream);
+    std::vector<float> result;
+    reader >> result;
+    BOOST_CHECK(result == floats);
+    BOOST_CHECK_EQUAL(reader.avail(), 0);
+}
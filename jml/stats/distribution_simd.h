@@ -14,6 +14,7 @@
 #include "distribution.h"
 #include "mldb/arch/simd_vector.h"
 #include "mldb/compiler/compiler.h"
+#include <algorithm>
 
 namespace MLDB {
 
@@ -184,6 +185,259 @@ min_max(distribution<float, std::vector<float> > & minValues,
                          this->size());
 }
 
+/* The same operators on temporaries write their result over the
+   temporary instead of allocating another one, so that in an expression
+   like a * b + c * k only the first operation allocates.
+*/
+
+inline distribution<float>
+operator + (distribution<float> && d1, const distribution<float> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("+", d1.size(), d2.size());
+    SIMD::vec_add(d1.data(), d2.data(), d1.data(), d1.size());
+    return std::move(d1);
+}
+
+inline distribution<float>
+operator + (const distribution<float> & d1, distribution<float> && d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("+", d1.size(), d2.size());
+    SIMD::vec_add(d1.data(), d2.data(), d2.data(), d1.size());
+    return std::move(d2);
+}
+
+inline distribution<float>
+operator + (distribution<float> && d1, distribution<float> && d2)
+{
+    return std::move(d1) + d2;
+}
+
+inline distribution<float>
+operator - (distribution<float> && d1, const distribution<float> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("-", d1.size(), d2.size());
+    SIMD::vec_minus(d1.data(), d2.data(), d1.data(), d1.size());
+    return std::move(d1);
+}
+
+inline distribution<float>
+operator - (const distribution<float> & d1, distribution<float> && d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("-", d1.size(), d2.size());
+    SIMD::vec_minus(d1.data(), d2.data(), d2.data(), d1.size());
+    return std::move(d2);
+}
+
+inline distribution<float>
+operator - (distribution<float> && d1, distribution<float> && d2)
+{
+    return std::move(d1) - d2;
+}
+
+inline distribution<float>
+operator * (distribution<float> && d1, const distribution<float> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("*", d1.size(), d2.size());
+    SIMD::vec_prod(d1.data(), d2.data(), d1.data(), d1.size());
+    return std::move(d1);
+}
+
+inline distribution<float>
+operator * (const distribution<float> & d1, distribution<float> && d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("*", d1.size(), d2.size());
+    SIMD::vec_prod(d1.data(), d2.data(), d2.data(), d1.size());
+    return std::move(d2);
+}
+
+inline distribution<float>
+operator * (distribution<float> && d1, distribution<float> && d2)
+{
+    return std::move(d1) * d2;
+}
+
+inline distribution<float>
+operator * (distribution<float> && d, float factor)
+{
+    SIMD::vec_scale(d.data(), factor, d.data(), d.size());
+    return std::move(d);
+}
+
+inline distribution<float>
+operator * (float factor, distribution<float> && d)
+{
+    return std::move(d) * factor;
+}
+
+inline distribution<double>
+operator + (distribution<double> && d1, const distribution<double> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("+", d1.size(), d2.size());
+    SIMD::vec_add(d1.data(), d2.data(), d1.data(), d1.size());
+    return std::move(d1);
+}
+
+inline distribution<double>
+operator + (const distribution<double> & d1, distribution<double> && d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("+", d1.size(), d2.size());
+    SIMD::vec_add(d1.data(), d2.data(), d2.data(), d1.size());
+    return std::move(d2);
+}
+
+inline distribution<double>
+operator + (distribution<double> && d1, distribution<double> && d2)
+{
+    return std::move(d1) + d2;
+}
+
+inline distribution<double>
+operator - (distribution<double> && d1, const distribution<double> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("-", d1.size(), d2.size());
+    SIMD::vec_minus(d1.data(), d2.data(), d1.data(), d1.size());
+    return std::move(d1);
+}
+
+inline distribution<double>
+operator - (const distribution<double> & d1, distribution<double> && d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("-", d1.size(), d2.size());
+    SIMD::vec_minus(d1.data(), d2.data(), d2.data(), d1.size());
+    return std::move(d2);
+}
+
+inline distribution<double>
+operator - (distribution<double> && d1, distribution<double> && d2)
+{
+    return std::move(d1) - d2;
+}
+
+inline distribution<double>
+operator * (distribution<double> && d1, const distribution<double> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("*", d1.size(), d2.size());
+    SIMD::vec_prod(d1.data(), d2.data(), d1.data(), d1.size());
+    return std::move(d1);
+}
+
+inline distribution<double>
+operator * (const distribution<double> & d1, distribution<double> && d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("*", d1.size(), d2.size());
+    SIMD::vec_prod(d1.data(), d2.data(), d2.data(), d1.size());
+    return std::move(d2);
+}
+
+inline distribution<double>
+operator * (distribution<double> && d1, distribution<double> && d2)
+{
+    return std::move(d1) * d2;
+}
+
+inline distribution<double>
+operator * (distribution<double> && d, double factor)
+{
+    SIMD::vec_scale(d.data(), factor, d.data(), d.size());
+    return std::move(d);
+}
+
+inline distribution<double>
+operator * (double factor, distribution<double> && d)
+{
+    return std::move(d) * factor;
+}
+
+/* Elementwise max and min, like those in distribution_ops.h. */
+
+inline distribution<float>
+max(const distribution<float> & d1, const distribution<float> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("max", d1.size(), d2.size());
+    distribution<float> result(d1.size());
+    SIMD::vec_max(d1.data(), d2.data(), result.data(), d1.size());
+    return result;
+}
+
+inline distribution<float>
+max(const distribution<float> & dist, float val)
+{
+    distribution<float> result(dist.size());
+    SIMD::vec_max(dist.data(), val, result.data(), dist.size());
+    return result;
+}
+
+inline distribution<float>
+min(const distribution<float> & d1, const distribution<float> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("min", d1.size(), d2.size());
+    distribution<float> result(d1.size());
+    SIMD::vec_min(d1.data(), d2.data(), result.data(), d1.size());
+    return result;
+}
+
+inline distribution<float>
+min(const distribution<float> & dist, float val)
+{
+    distribution<float> result(dist.size());
+    SIMD::vec_min(dist.data(), val, result.data(), dist.size());
+    return result;
+}
+
+inline distribution<double>
+max(const distribution<double> & d1, const distribution<double> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("max", d1.size(), d2.size());
+    distribution<double> result(d1.size());
+    SIMD::vec_max(d1.data(), d2.data(), result.data(), d1.size());
+    return result;
+}
+
+inline distribution<double>
+max(const distribution<double> & dist, double val)
+{
+    distribution<double> result(dist.size());
+    SIMD::vec_max(dist.data(), val, result.data(), dist.size());
+    return result;
+}
+
+inline distribution<double>
+min(const distribution<double> & d1, const distribution<double> & d2)
+{
+    if (d1.size() != d2.size())
+        wrong_sizes_exception("min", d1.size(), d2.size());
+    distribution<double> result(d1.size());
+    SIMD::vec_min(d1.data(), d2.data(), result.data(), d1.size());
+    return result;
+}
+
+inline distribution<double>
+min(const distribution<double> & dist, double val)
+{
+    distribution<double> result(dist.size());
+    SIMD::vec_min(dist.data(), val, result.data(), dist.size());
+    return result;
+}
+
+// Like distribution_ops.h, so that these don't hide the scalar versions
+using std::max;
+using std::min;
+
 template<class Underlying>
 distribution<float, Underlying>
 exp(const distribution<float, Underlying> & dist)
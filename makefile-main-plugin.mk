@@ -7,6 +7,7 @@ toolchain ?= gcc
 PYTHON_ENABLED:=1
 DOCUMENTATION_ENABLED:=1
 TCMALLOC_ENABLED?=1
+JEMALLOC_ENABLED?=0
 
 DOCKER_REGISTRY:=quay.io/
 DOCKER_USER:=datacratic/
@@ -10,7 +10,13 @@ LIBALGEBRA_SOURCES := \
 
 $(eval $(call add_sources,$(LIBALGEBRA_SOURCES)))
 
-LIBALGEBRA_LINK :=	utils lapack blas db
+# The BLAS and LAPACK implementation to link against, which can be a
+# multithreaded one like openblas, mkl_rt or blis.  Its number of threads is
+# controlled at run time with MLDB_BLAS_THREADS.
+BLAS_LIBRARY ?= blas
+LAPACK_LIBRARY ?= lapack
+
+LIBALGEBRA_LINK :=	utils $(LAPACK_LIBRARY) $(BLAS_LIBRARY) db base
 
 $(eval $(call library,algebra,$(LIBALGEBRA_SOURCES),$(LIBALGEBRA_LINK)))
 
@@ -18,6 +18,7 @@
 #include "multi_array_utils.h"
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/ml/algebra/lapack.h"
+#include "mldb/base/parallel.h"
 #include <cmath>
 
 using namespace std;
@@ -864,6 +865,443 @@ run_irls(const distribution<float> & correct,
     }
 }
 
+
+/*****************************************************************************/
+/* STREAMING IRLS                                                            */
+/*****************************************************************************/
+
+namespace {
+
+/** Same algorithm as irls() in least_squares.h, but with the examples in
+    blocks that are streamed from the given function.  The least squares
+    step of each iteration needs X W X^T and X W z, which are summed over
+    the blocks; everything else is per example.  As the new eta and mu
+    for an iteration can only be found with another pass over the data,
+    each pass computes the deviance of the previous iteration's parameters
+    along with the sums for the next one.
+*/
+template<class Link, class Dist>
+distribution<double>
+irls_streaming(const IRLS_Stream & stream, size_t nv,
+               const Link & link,
+               const Dist & dist,
+               const Regressor & regressor)
+{
+    typedef distribution<double> Vector;
+
+    static const int max_iter = 20;           // from GLMlab
+    static const float tolerence = 5e-5;      // from GLMlab
+
+    struct Pass {
+        Pass(size_t nv)
+            : xTwx(boost::extents[nv][nv]), xTwz(nv, 0.0),
+              correct_total(0.0), deviance(0.0)
+        {
+            std::fill(xTwx.data(), xTwx.data() + nv * nv, 0.0);
+        }
+
+        boost::multi_array<double, 2> xTwx;
+        Vector xTwz;
+        double correct_total;   ///< Sum of squares of the targets
+        double deviance;        ///< Deviance of the parameters passed
+    };
+
+    auto checkFinite = [] (const Vector & v, const char * what)
+        {
+            for (unsigned i = 0;  i < v.size();  ++i)
+                if (!std::isfinite(v[i]))
+                    throw Exception(format("%s[%d] = %f", what, i, v[i]));
+        };
+
+    // Pass over the data with the given parameters, or with the initial
+    // estimate from the targets if there are none yet
+    auto doPass = [&] (const Vector * b)
+        {
+            Pass result(nv);
+
+            auto onBlock = [&] (const boost::multi_array<double, 2> & x,
+                                const Vector & y,
+                                const Vector & weights)
+            {
+                size_t nx = x.shape()[1];
+                if (x.shape()[0] != nv || y.size() != nx
+                    || weights.size() != nx)
+                    throw Exception("incompatible data sizes");
+                if (nx == 0)
+                    return;
+
+                Vector mu, eta;
+                if (!b) {
+                    mu = (y + 0.5) / 2;
+                    checkFinite(mu, "mu");
+                    eta = link.forward(mu);
+                    result.correct_total += (y * y).total();
+                }
+                else {
+                    eta = (*b) * x;
+                    checkFinite(eta, "eta");
+                    mu = link.inverse(eta);
+                    checkFinite(mu, "mu");
+                    result.deviance += dist.deviance(y, mu, weights);
+                }
+
+                Vector deta_dmu = link.diff(mu);
+                checkFinite(deta_dmu, "deta_dmu");
+                Vector var = dist.variance(mu);
+                checkFinite(var, "var");
+                Vector fit_weights = weights / (deta_dmu * deta_dmu * var);
+                checkFinite(fit_weights, "fit_weights");
+
+                Vector z = eta + (y - mu) * deta_dmu;
+
+                boost::multi_array<double, 2> xTwx
+                    = weighted_square(x, fit_weights);
+                const double * from = xTwx.data();
+                double * to = result.xTwx.data();
+                for (size_t i = 0;  i < nv * nv;  ++i)
+                    to[i] += from[i];
+
+                result.xTwz += diag_mult(x, fit_weights, z);
+            };
+
+            stream(onBlock);
+
+            return result;
+        };
+
+    Vector b(nv, 0.0);
+    Pass pass = doPass(nullptr);
+
+    int iter = 0;
+    double rdev = std::sqrt(pass.correct_total);  // residual deviance
+    double rdev2 = 0;                             // last residual deviance
+
+    while (fabs(rdev - rdev2) > tolerence && iter < max_iter) {
+        b = regressor.calc(pass.xTwx, pass.xTwz);
+        pass = doPass(&b);
+
+        rdev2 = rdev;
+        rdev = pass.deviance;
+        ++iter;
+    }
+
+    return b;
+}
+
+} // file scope
+
+distribution<double>
+perform_irls_streaming(const IRLS_Stream & stream,
+                       size_t nv,
+                       Link_Function link_function,
+                       Regularization regularization,
+                       double regularization_factor,
+                       int maxIter,
+                       double epsilon)
+{
+    std::unique_ptr<Regressor> regressor;
+    if (regularization == Regularization_l2)
+        regressor.reset(new Ridge_Regressor(regularization_factor));
+    else if (regularization == Regularization_l1)
+        regressor.reset(new Lasso_Regressor(regularization_factor, maxIter,
+                                            epsilon));
+    else if (regularization == Regularization_none)
+        regressor.reset(new Least_Squares_Regressor());
+    else throw Exception("Unknown regularization method in "
+                         "perform_irls_streaming");
+
+    switch (link_function) {
+
+    case LOGIT:
+        return irls_streaming(stream, nv, Logit_Link<double>(),
+                              Binomial_Dist<double>(), *regressor);
+
+    case LOG:
+        return irls_streaming(stream, nv, Logarithm_Link<double>(),
+                              Binomial_Dist<double>(), *regressor);
+
+    case LINEAR:
+        return irls_streaming(stream, nv, Linear_Link<double>(),
+                              Normal_Dist<double>(), *regressor);
+
+    case PROBIT:
+        return irls_streaming(stream, nv, Probit_Link<double>(),
+                              Binomial_Dist<double>(), *regressor);
+
+    case COMP_LOG_LOG:
+        return irls_streaming(stream, nv, Comp_Log_Log_Link<double>(),
+                              Binomial_Dist<double>(), *regressor);
+
+    default:
+        throw Exception(format("perform_irls_streaming(): function %d "
+                               "not implemented", link_function));
+    }
+}
+
+
+/*****************************************************************************/
+/* SPARSE IRLS                                                               */
+/*****************************************************************************/
+
+void
+IRLS_Sparse_Matrix::
+init(size_t nv,
+     const std::vector<std::vector<std::pair<int, float> > > & rows)
+{
+    nx = rows.size();
+    starts.clear();
+    starts.resize(nv + 1, 0);
+
+    for (auto & row: rows) {
+        for (auto & entry: row) {
+            if (entry.first < 0 || entry.first >= nv)
+                throw Exception(format("IRLS_Sparse_Matrix::init(): "
+                                       "variable %d out of range",
+                                       entry.first));
+            if (entry.second != 0.0)
+                starts[entry.first + 1] += 1;
+        }
+    }
+
+    for (size_t v = 0;  v < nv;  ++v)
+        starts[v + 1] += starts[v];
+
+    examples.resize(starts[nv]);
+    values.resize(starts[nv]);
+
+    std::vector<size_t> pos(starts.begin(), starts.end() - 1);
+    for (size_t x = 0;  x < nx;  ++x) {
+        for (auto & entry: rows[x]) {
+            if (entry.second == 0.0)
+                continue;
+            size_t i = pos[entry.first]++;
+            examples[i] = x;
+            values[i] = entry.second;
+        }
+    }
+}
+
+namespace {
+
+/** Same outer loop as irls() in least_squares.h, with the least squares
+    step of each iteration replaced by a coordinate descent over the
+    non-zero entries of each variable.  The residuals of the working
+    response are updated as each weight changes, so that a pass over the
+    variables costs O(nnz).  The weights are kept from one iteration to
+    the next as a warm start.
+*/
+template<class Link, class Dist>
+distribution<double>
+irls_sparse(const distribution<double> & y,
+            const IRLS_Sparse_Matrix & x,
+            const distribution<double> & weights,
+            const Link & link,
+            const Dist & dist,
+            Regularization regularization,
+            double lambda,
+            int maxIter,
+            double epsilon)
+{
+    typedef distribution<double> Vector;
+
+    static const int max_iter = 20;           // from GLMlab
+    static const float tolerence = 5e-5;      // from GLMlab
+
+    size_t nx = x.nx;
+    size_t nv = x.nv();
+
+    if (y.size() != nx || weights.size() != nx)
+        throw Exception("incompatible data sizes");
+
+    auto checkFinite = [] (const Vector & v, const char * what)
+        {
+            for (unsigned i = 0;  i < v.size();  ++i)
+                if (!std::isfinite(v[i]))
+                    throw Exception(format("%s[%d] = %f", what, i, v[i]));
+        };
+
+    Vector b(nv, 0.0);
+    Vector eta_b(nx, 0.0);    // b . x for each example
+    Vector r(nx, 0.0);        // residual of the working response
+    Vector h(nv, 0.0);        // weighted sum of squares of each variable
+
+    // Thresholds of the coordinate update, as in lasso_regression()
+    double halflambda = lambda / 2.0;
+
+    auto updateVariable = [&] (size_t v, const Vector & fit_weights)
+        {
+            if (h[v] == 0.0)
+                return 0.0;
+
+            double g = 0.0;
+            for (size_t i = x.starts[v];  i < x.starts[v + 1];  ++i) {
+                int ex = x.examples[i];
+                g += fit_weights[ex] * x.values[i] * r[ex];
+            }
+
+            double u = g + h[v] * b[v];
+            double bv;
+
+            if (regularization == Regularization_l1) {
+                if (u > halflambda)
+                    bv = (u - halflambda) / h[v];
+                else if (u < -halflambda)
+                    bv = (u + halflambda) / h[v];
+                else bv = 0.0;
+            }
+            else if (regularization == Regularization_l2)
+                bv = u / (h[v] + lambda);
+            else bv = u / h[v];
+
+            double delta = bv - b[v];
+            if (delta == 0.0)
+                return 0.0;
+
+            for (size_t i = x.starts[v];  i < x.starts[v + 1];  ++i)
+                r[x.examples[i]] -= delta * x.values[i];
+            b[v] = bv;
+
+            return fabs(delta);
+        };
+
+    auto descend = [&] (const Vector & fit_weights)
+        {
+            auto doSquares = [&] (size_t first, size_t last)
+            {
+                for (size_t v = first;  v < last;  ++v) {
+                    double total = 0.0;
+                    for (size_t i = x.starts[v];  i < x.starts[v + 1];  ++i) {
+                        double val = x.values[i];
+                        total += fit_weights[x.examples[i]] * val * val;
+                    }
+                    h[v] = total;
+                }
+            };
+
+            if (nv > 0)
+                MLDB::parallelMapChunked(0, nv, 4096, doSquares);
+
+            // Alternate between a pass over all of the variables and passes
+            // over only those that are non-zero, until a full pass doesn't
+            // move anything.  With L1 most weights stay at zero, so the
+            // second kind of pass is much cheaper.
+            int iter = 0;
+            while (iter < maxIter) {
+                double max_step = 0.0;
+                std::vector<int> active;
+                for (size_t v = 0;  v < nv;  ++v) {
+                    max_step = std::max(max_step,
+                                        updateVariable(v, fit_weights));
+                    if (b[v] != 0.0)
+                        active.push_back(v);
+                }
+                ++iter;
+
+                if (max_step < epsilon)
+                    break;
+
+                while (iter < maxIter) {
+                    max_step = 0.0;
+                    for (int v: active)
+                        max_step = std::max(max_step,
+                                            updateVariable(v, fit_weights));
+                    ++iter;
+                    if (max_step < epsilon)
+                        break;
+                }
+            }
+        };
+
+    Vector mu = (y + 0.5) / 2;
+    checkFinite(mu, "mu");
+    Vector eta = link.forward(mu);
+
+    int iter = 0;
+    double rdev = std::sqrt((y * y).total());  // residual deviance
+    double rdev2 = 0;                          // last residual deviance
+
+    while (fabs(rdev - rdev2) > tolerence && iter < max_iter) {
+        Vector deta_dmu = link.diff(mu);
+        checkFinite(deta_dmu, "deta_dmu");
+        Vector var = dist.variance(mu);
+        checkFinite(var, "var");
+        Vector fit_weights = weights / (deta_dmu * deta_dmu * var);
+        checkFinite(fit_weights, "fit_weights");
+
+        Vector z = eta + (y - mu) * deta_dmu;
+
+        r = z - eta_b;
+        descend(fit_weights);
+        eta_b = z - r;
+
+        eta = eta_b;
+        checkFinite(eta, "eta");
+        mu = link.inverse(eta);
+        checkFinite(mu, "mu");
+
+        rdev2 = rdev;
+        rdev = dist.deviance(y, mu, weights);
+        ++iter;
+    }
+
+    return b;
+}
+
+} // file scope
+
+distribution<double>
+perform_irls_sparse(const distribution<double> & correct,
+                    const IRLS_Sparse_Matrix & outputs,
+                    const distribution<double> & w,
+                    Link_Function link_function,
+                    Regularization regularization,
+                    double regularization_factor,
+                    int maxIter,
+                    double epsilon)
+{
+    if (regularization != Regularization_none
+        && regularization != Regularization_l1
+        && regularization != Regularization_l2)
+        throw Exception("Unknown regularization method in "
+                        "perform_irls_sparse");
+
+    // A negative factor means auto-determined for the dense regressors,
+    // which can't be done here; use the same initial value as they do
+    double lambda = regularization_factor < 0.0 ? 1e-5 : regularization_factor;
+
+    switch (link_function) {
+
+    case LOGIT:
+        return irls_sparse(correct, outputs, w, Logit_Link<double>(),
+                           Binomial_Dist<double>(), regularization, lambda,
+                           maxIter, epsilon);
+
+    case LOG:
+        return irls_sparse(correct, outputs, w, Logarithm_Link<double>(),
+                           Binomial_Dist<double>(), regularization, lambda,
+                           maxIter, epsilon);
+
+    case LINEAR:
+        return irls_sparse(correct, outputs, w, Linear_Link<double>(),
+                           Normal_Dist<double>(), regularization, lambda,
+                           maxIter, epsilon);
+
+    case PROBIT:
+        return irls_sparse(correct, outputs, w, Probit_Link<double>(),
+                           Binomial_Dist<double>(), regularization, lambda,
+                           maxIter, epsilon);
+
+    case COMP_LOG_LOG:
+        return irls_sparse(correct, outputs, w, Comp_Log_Log_Link<double>(),
+                           Binomial_Dist<double>(), regularization, lambda,
+                           maxIter, epsilon);
+
+    default:
+        throw Exception(format("perform_irls_sparse(): function %d "
+                               "not implemented", link_function));
+    }
+}
+
 double apply_link_inverse(double val, Link_Function func)
 {
     switch (func) {
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <vector>
+#include <functional>
 #include <boost/multi_array.hpp>
 #include "mldb/jml/stats/distribution.h"
 #include "mldb/jml/db/persistent.h"
@@ -364,6 +365,99 @@ perform_irls(const distribution<double> & correct,
              bool condition = true);
 
 
+/** Function called for each block of examples of a streamed IRLS, with the
+    nv x nb matrix of the block's variables, and its nb targets and
+    weights.
+*/
+typedef std::function<void (const boost::multi_array<double, 2> & outputs,
+                            const distribution<double> & correct,
+                            const distribution<double> & w)> IRLS_Block;
+
+/** Make one pass over all of the examples of a streamed IRLS, calling the
+    given function with each block in turn.  Every pass must give the same
+    examples in the same order.
+*/
+typedef std::function<void (const IRLS_Block & onBlock)> IRLS_Stream;
+
+/** Perform an IRLS over examples that are streamed in blocks instead of
+    being held in one matrix.  Each iteration only needs the weighted
+    products of the variables with themselves and with the targets, which
+    are summed up block by block, so the memory needed is a block plus
+    an nv x nv matrix.  There is one pass over the data per iteration,
+    plus one.  The result is the same as perform_irls() without
+    conditioning, other than rounding.
+*/
+distribution<double>
+perform_irls_streaming(const IRLS_Stream & stream,
+                       size_t nv,
+                       Link_Function link_function,
+                       Regularization = Regularization_l2,
+                       double regularization_factor = 1e-5,
+                       int maxIter = 20,
+                       double epsilon = 1e-4);
+
+
+/*****************************************************************************/
+/* SPARSE IRLS                                                               */
+/*****************************************************************************/
+
+/** The nv x nx matrix of the variables of an IRLS, of which only the
+    non-zero entries are stored.  They are grouped by variable (row of the
+    matrix), so that the entries of variable v are at indexes
+    starts[v] to starts[v + 1] of examples and values.
+*/
+struct IRLS_Sparse_Matrix {
+    IRLS_Sparse_Matrix()
+        : nx(0)
+    {
+    }
+
+    /** Initialize from the non-zero entries of each example, which are
+        (variable, value) pairs.  Zero values are skipped.
+    */
+    void init(size_t nv,
+              const std::vector<std::vector<std::pair<int, float> > >
+                  & examples);
+
+    size_t nv() const { return starts.empty() ? 0 : starts.size() - 1; }
+    size_t nnz() const { return values.size(); }
+
+    size_t nx;
+    std::vector<size_t> starts;
+    std::vector<int> examples;
+    std::vector<float> values;
+};
+
+/** Perform an IRLS over a sparse matrix of variables.  Rather than solving
+    each least squares step directly, which needs an nv x nv matrix, each
+    step runs a cyclic coordinate descent on the weighted least squares
+    problem
+
+        sum_x fit_weights[x] (z[x] - b . outputs[x])^2 + penalty(b)
+
+    where penalty(b) is regularization_factor times |b|_1 for L1 and
+    |b|_2^2 for L2 (the same objective as lasso_regression()).  A
+    coordinate descent pass only touches the non-zero entries, and the
+    per example and per variable parts of each iteration run in parallel.
+    The descent stops when no weight moves by more than epsilon, or after
+    maxIter passes.
+
+    The memory needed is that of the non-zero entries plus a few vectors
+    of nv or nx entries, which makes it suitable for problems with a very
+    large number of mostly absent variables (for example hashed features).
+    The variables aren't centered, so that they stay sparse.
+*/
+distribution<double>
+perform_irls_sparse(const distribution<double> & correct,
+                    const IRLS_Sparse_Matrix & outputs,
+                    const distribution<double> & w,
+                    Link_Function link_function,
+                    Regularization = Regularization_l2,
+                    double regularization_factor = 1e-5,
+                    int maxIter = 1000,
+                    double epsilon = 1e-4);
+
+
 } // namespace ML
 
 
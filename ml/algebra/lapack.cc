@@ -13,6 +13,10 @@
 #include <cmath>
 #include "mldb/arch/threads.h"
 #include "mldb/arch/exception.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/jml/utils/environment.h"
+#include <atomic>
+#include <mutex>
 #include <iostream>
 
 
@@ -135,21 +139,36 @@ extern "C" {
                  int * info);
 
     /* Matrix multiply */
-    void sgemm_(const int * m, const int * n, const int * k, const float * alpha,
-                const float * A, const int * lda, const float * b,
-                const int * ldb, const float * beta, float * c, const int * ldc,
-                int * info);
+    void sgemm_(const char * transa, const char * transb,
+                const int * m, const int * n, const int * k,
+                const float * alpha, const float * A, const int * lda,
+                const float * b, const int * ldb, const float * beta,
+                float * c, const int * ldc);
 
     /* Matrix multiply */
-    void dgemm_(const int * m, const int * n, const int * k, const double * alpha,
-                const double * A, const int * lda, const double * b,
-                const int * ldb, const double * beta, double * c, const int * ldc,
-                int * info);
+    void dgemm_(const char * transa, const char * transb,
+                const int * m, const int * n, const int * k,
+                const double * alpha, const double * A, const int * lda,
+                const double * b, const int * ldb, const double * beta,
+                double * c, const int * ldc);
 
     /* Elementary reflector.  Used to detect version 3.2 of the LAPACK.  Most
        important thing is that if n < 0, it will return zero in tau. */
     void slarfp_(const int * n, float * alpha, float * X, const int * incx,
                  float * tau);
+
+    /* Thread control of the multithreaded implementations, which are null
+       when we aren't linked against them. */
+    void openblas_set_num_threads(int num_threads) __attribute__((__weak__));
+    int openblas_get_num_threads() __attribute__((__weak__));
+    int openblas_set_num_threads_local(int num_threads)
+        __attribute__((__weak__));
+    void MKL_Set_Num_Threads(int num_threads) __attribute__((__weak__));
+    int MKL_Get_Max_Threads() __attribute__((__weak__));
+    int MKL_Set_Num_Threads_Local(int num_threads) __attribute__((__weak__));
+    void bli_thread_set_num_threads(long num_threads)
+        __attribute__((__weak__));
+    long bli_thread_get_num_threads() __attribute__((__weak__));
 } // extern "C"
 
 namespace ML {
@@ -157,6 +176,71 @@ namespace LAPack {
 
 namespace {
 
+MLDB::EnvOption<int, true /* trace */>
+MLDB_BLAS_THREADS("MLDB_BLAS_THREADS", MLDB::numCpus());
+
+/* Number of threads set for the calls that aren't made from a thread pool
+   job. */
+std::atomic<int> configuredThreads(1);
+
+void setBackendThreads(int numThreads)
+{
+    if (openblas_set_num_threads)
+        openblas_set_num_threads(numThreads);
+    else if (MKL_Set_Num_Threads)
+        MKL_Set_Num_Threads(numThreads);
+    else if (bli_thread_set_num_threads)
+        bli_thread_set_num_threads(numThreads);
+}
+
+/* Makes the calls to the implementation from a thread pool job use a
+   single thread while it exists.  The setting is local to the thread where
+   the implementation allows it.  Otherwise, it is changed for all threads
+   while any job is calling the implementation, since the other calls are
+   then likely to be from other jobs as well. */
+struct Threads_Scope {
+    Threads_Scope()
+        : previous(-1), global(false)
+    {
+        if (configuredThreads == 1 || !MLDB::ThreadPool::inJob())
+            return;
+
+        if (openblas_set_num_threads_local)
+            previous = openblas_set_num_threads_local(1);
+        else if (MKL_Set_Num_Threads_Local)
+            previous = MKL_Set_Num_Threads_Local(1);
+        else {
+            global = true;
+            std::unique_lock<std::mutex> guard(lock);
+            if (jobsCalling++ == 0)
+                setBackendThreads(1);
+        }
+    }
+
+    ~Threads_Scope()
+    {
+        if (previous != -1) {
+            if (openblas_set_num_threads_local)
+                openblas_set_num_threads_local(previous);
+            else MKL_Set_Num_Threads_Local(previous);
+        }
+        else if (global) {
+            std::unique_lock<std::mutex> guard(lock);
+            if (--jobsCalling == 0)
+                setBackendThreads(configuredThreads);
+        }
+    }
+
+    int previous;
+    bool global;
+
+    static std::mutex lock;
+    static int jobsCalling;
+};
+
+std::mutex Threads_Scope::lock;
+int Threads_Scope::jobsCalling = 0;
+
 
 struct Init {
     Init()
@@ -175,12 +259,46 @@ struct Init {
 
         dlamch_("e");
         slamch_("e");
+
+        setNumThreads(MLDB_BLAS_THREADS);
     }
 } init;
 
 
 } // file scope
 
+const char * backend()
+{
+    if (openblas_get_num_threads)
+        return "openblas";
+    else if (MKL_Get_Max_Threads)
+        return "mkl";
+    else if (bli_thread_get_num_threads)
+        return "blis";
+    return "reference";
+}
+
+int numThreads()
+{
+    if (MLDB::ThreadPool::inJob())
+        return 1;
+    return configuredThreads;
+}
+
+bool setNumThreads(int numThreads)
+{
+    if (!openblas_set_num_threads && !MKL_Set_Num_Threads
+        && !bli_thread_set_num_threads)
+        return false;
+
+    numThreads = std::max(numThreads, 1);
+    std::unique_lock<std::mutex> guard(Threads_Scope::lock);
+    configuredThreads = numThreads;
+    if (Threads_Scope::jobsCalling == 0)
+        setBackendThreads(numThreads);
+    return true;
+}
+
 int ilaenv(int ispec, const char * routine, const char * opts,
            int n1, int n2, int n3, int n4)
 {
@@ -190,6 +308,7 @@ int ilaenv(int ispec, const char * routine, const char * opts,
 int gels(char trans, int m, int n, int nrhs, float * A, int lda, float * B,
          int ldb)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     float ws_return;
@@ -215,6 +334,7 @@ int gels(char trans, int m, int n, int nrhs, float * A, int lda, float * B,
 int gels(char trans, int m, int n, int nrhs, double * A, int lda, double * B,
          int ldb)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     double ws_return;
@@ -240,6 +360,7 @@ int gels(char trans, int m, int n, int nrhs, double * A, int lda, double * B,
 int gelsd(int m, int n, int nrhs, float * A, int lda, float * B, int ldb,
           float * S, float rcond, int & rank)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     float ws_return;
@@ -275,6 +396,7 @@ int gelsd(int m, int n, int nrhs, float * A, int lda, float * B, int ldb,
 int gelsd(int m, int n, int nrhs, double * A, int lda, double * B, int ldb,
           double * S, double rcond, int & rank)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     double ws_return;
@@ -310,6 +432,7 @@ int gelsd(int m, int n, int nrhs, double * A, int lda, double * B, int ldb,
 int gglse(int m, int n, int p, float * A, int lda, float * B, int ldb,
           float * c, float * d, float * result)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     float ws_return;
@@ -334,6 +457,7 @@ int gglse(int m, int n, int p, float * A, int lda, float * B, int ldb,
 int gglse(int m, int n, int p, double * A, int lda, double * B, int ldb,
           double * c, double * d, double * result)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     double ws_return;
@@ -359,6 +483,7 @@ int gglse(int m, int n, int p, double * A, int lda, double * B, int ldb,
 int gebrd(int m, int n, double * A, int lda,
           double * D, double * E, double * tauq, double * taup)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     double ws_return;
@@ -382,6 +507,7 @@ int gebrd(int m, int n, double * A, int lda,
 int orgbr(const char * vect, int m, int n, int k,
           double * A, int lda, const double * tau)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     double ws_return;
@@ -408,6 +534,7 @@ int bdsdc(const char * uplo, const char * compq, int n,
           double * VT, int ldvt,
           double * Q, int * iq)
 {
+    Threads_Scope scope;
     int workspace_size;
     switch (*compq) {
     case 'N': workspace_size = 2 * n;  break;
@@ -435,6 +562,7 @@ int gesvd(const char * jobu, const char * jobvt, int m, int n,
           double * A, int lda, double * S, double * U, int ldu,
           double * VT, int ldvt)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     double ws_return;
@@ -459,6 +587,7 @@ int gesdd(const char * jobz, int m, int n,
           float * A, int lda, float * S, float * U, int ldu,
           float * vt, int ldvt)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     float ws_return;
@@ -485,6 +614,7 @@ int gesdd(const char * jobz, int m, int n,
           double * A, int lda, double * S, double * U, int ldu,
           double * vt, int ldvt)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     double ws_return;
@@ -510,6 +640,7 @@ int gesdd(const char * jobz, int m, int n,
 int gesv(int n, int nrhs, double * A, int lda, int * pivots, double * B,
          int ldb)
 {
+    Threads_Scope scope;
     int info = 0;
     dgesv_(&n, &nrhs, A, &lda, pivots, B, &ldb, &info);
     return info;
@@ -517,6 +648,7 @@ int gesv(int n, int nrhs, double * A, int lda, int * pivots, double * B,
 
 int spotrf(char uplo, int n, float * A, int lda)
 {
+    Threads_Scope scope;
     int info = 0;
     spotrf_(&uplo, &n, A, &lda, &info);
     return info;
@@ -524,6 +656,7 @@ int spotrf(char uplo, int n, float * A, int lda)
 
 int dpotrf(char uplo, int n, double * A, int lda)
 {
+    Threads_Scope scope;
     int info = 0;
     dpotrf_(&uplo, &n, A, &lda, &info);
     return info;
@@ -531,6 +664,7 @@ int dpotrf(char uplo, int n, double * A, int lda)
 
 int geqp3(int m, int n, float * A, int lda, int * jpvt, float * tau)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     float ws_return;
@@ -553,6 +687,7 @@ int geqp3(int m, int n, float * A, int lda, int * jpvt, float * tau)
 
 int geqp3(int m, int n, double * A, int lda, int * jpvt, double * tau)
 {
+    Threads_Scope scope;
     int info = 0;
     int workspace_size = -1;
     double ws_return;
@@ -573,6 +708,26 @@ int geqp3(int m, int n, double * A, int lda, int * jpvt, double * tau)
     return info;
 }
 
+int gemm(char transa, char transb, int m, int n, int k, float alpha,
+         const float * A, int lda, const float * b, int ldb,
+         float beta, float * C, int ldc)
+{
+    Threads_Scope scope;
+    sgemm_(&transa, &transb, &m, &n, &k, &alpha, A, &lda, b, &ldb, &beta,
+           C, &ldc);
+    return 0;
+}
+
+int gemm(char transa, char transb, int m, int n, int k, double alpha,
+         const double * A, int lda, const double * b, int ldb,
+         double beta, double * C, int ldc)
+{
+    Threads_Scope scope;
+    dgemm_(&transa, &transb, &m, &n, &k, &alpha, A, &lda, b, &ldb, &beta,
+           C, &ldc);
+    return 0;
+}
+
 } // namespace LAPack
 } // namespace ML
 
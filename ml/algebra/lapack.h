@@ -32,6 +32,25 @@ fortran(const boost::multi_array<Float, 2> & A)
     return X;
 }
 
+/** Name of the BLAS and LAPACK implementation that we are linked against,
+    as chosen with the BLAS_LIBRARY and LAPACK_LIBRARY make variables:
+    "openblas", "mkl", "blis" or "reference" for one that isn't
+    multithreaded.
+*/
+const char * backend();
+
+/** Number of threads that the implementation uses for one call.  This is
+    set from the MLDB_BLAS_THREADS environment variable, which defaults to
+    the number of CPUs, and is always 1 for the reference implementation.
+    Calls made from a job of a ThreadPool use a single thread, as the
+    pool already keeps all of the CPUs busy.
+*/
+int numThreads();
+
+/** Set the number of threads that the implementation uses for one call,
+    returning false if it isn't multithreaded. */
+bool setNumThreads(int numThreads);
+
 /** Information on the LAPACK library.  Normally used internally.  See the man
     page for ilaenv for details. */
 int ilaenv(int ispec, const char * routine, const char * opts,
@@ -120,7 +139,9 @@ int geqp3(int m, int n, float * A, int lda, int * jpvt, float * tau);
 int geqp3(int m, int n, double * A, int lda, int * jpvt, double * tau);
 
 
-/** Generalized matrix multiply */
+/** Generalized matrix multiply, C = alpha op(A) op(b) + beta C, where op
+    transposes if trans is 'T'.  As in BLAS, the matrices are column
+    major. */
 int gemm(char transa, char transb, int m, int n, int k, float alpha,
          const float * A, int lda, const float * b, int ldb,
          float beta, float * C, int ldc);
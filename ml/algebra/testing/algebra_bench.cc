@@ -0,0 +1,124 @@
+// This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+/* algebra_bench.cc
+
+   Benchmark of the BLAS and LAPACK implementation that we are linked
+   against, with one thread and with all of them, and from the jobs of a
+   thread pool.  Select the implementation with the BLAS_LIBRARY and
+   LAPACK_LIBRARY make variables.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/ml/algebra/lapack.h"
+#include "mldb/arch/timers.h"
+#include "mldb/base/thread_pool.h"
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace ML;
+using namespace std;
+
+namespace {
+
+vector<double> randomMatrix(int m, int n, int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    vector<double> result(m * n);
+    for (auto & v: result)
+        v = dist(rng);
+    return result;
+}
+
+void bench(const std::string & what, int numThreads,
+           const std::function<void ()> & fn)
+{
+    LAPack::setNumThreads(numThreads);
+    fn();  // warm up
+
+    MLDB::Timer timer;
+    int n = 0;
+    do {
+        fn();
+        ++n;
+    } while (timer.elapsed_wall() < 1.0);
+
+    cerr << what << " " << LAPack::numThreads() << " threads: "
+         << 1000.0 * timer.elapsed_wall() / n << "ms per call, "
+         << timer.elapsed_cpu() / timer.elapsed_wall() << " cores" << endl;
+}
+
+void gemm(int n)
+{
+    vector<double> A = randomMatrix(n, n, 1), B = randomMatrix(n, n, 2);
+    vector<double> C(n * n);
+    LAPack::gemm('N', 'N', n, n, n, 1.0, A.data(), n, B.data(), n,
+                 0.0, C.data(), n);
+}
+
+void gesdd(int n)
+{
+    vector<double> A = randomMatrix(n, n, 3);
+    vector<double> S(n), U(n * n), VT(n * n);
+    int res = LAPack::gesdd("S", n, n, A.data(), n, S.data(), U.data(), n,
+                            VT.data(), n);
+    BOOST_CHECK_EQUAL(res, 0);
+}
+
+void leastSquares(int m, int n)
+{
+    vector<double> A = randomMatrix(m, n, 4), b = randomMatrix(m, 1, 5);
+    int res = LAPack::gels('N', m, n, 1, A.data(), m, b.data(), m);
+    BOOST_CHECK_EQUAL(res, 0);
+}
+
+void benchAll(int numThreads)
+{
+    bench("gemm 1024", numThreads, [] () { gemm(1024); });
+    bench("gesdd 512", numThreads, [] () { gesdd(512); });
+    bench("gels 4096x256", numThreads, [] () { leastSquares(4096, 256); });
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_algebra )
+{
+    cerr << "backend " << LAPack::backend() << ", "
+         << LAPack::numThreads() << " threads by default" << endl;
+
+    int defaultThreads = LAPack::numThreads();
+
+    benchAll(1);
+    benchAll(MLDB::numCpus());
+
+    /* Jobs of a thread pool use a single thread each, so that we don't
+       have numCpus() squared threads. */
+    LAPack::setNumThreads(MLDB::numCpus());
+    MLDB::ThreadPool pool;
+
+    MLDB::Timer timer;
+    int numJobs = 4 * MLDB::numCpus();
+    std::atomic<int> multithreaded(0);
+    for (int i = 0;  i < numJobs;  ++i) {
+        pool.add([&] () {
+                if (LAPack::numThreads() != 1)
+                    ++multithreaded;
+                gemm(512);
+            });
+    }
+    pool.waitForAll();
+    BOOST_CHECK_EQUAL(multithreaded, 0);
+
+    cerr << "gemm 512 in " << numJobs << " jobs: "
+         << 1000.0 * timer.elapsed_wall() / numJobs << "ms per call, "
+         << timer.elapsed_cpu() / timer.elapsed_wall() << " cores" << endl;
+
+    LAPack::setNumThreads(defaultThreads);
+}
@@ -2,3 +2,4 @@
 
 $(eval $(call test,least_squares_test,algebra utils arch,boost))
 $(eval $(call test,remove_dependent_test,algebra,boost))
+$(eval $(call test,algebra_bench,algebra base arch,boost manual))
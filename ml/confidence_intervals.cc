@@ -162,6 +162,15 @@ bootstrapMeanTwoSidedBound(const vector<double>& sample, int replications,
         );
 }
 
+pair<double,double>
+ConfidenceIntervals::
+normalTwoSidedBound(double estimate, double standardError) const
+{
+    normal s;
+    double z = quantile(s, 1-alpha_/2.0);
+    return make_pair(estimate - z * standardError, estimate + z * standardError);
+}
+
 void ConfidenceIntervals::assertClopperPearson() const
 {
     if (method != CLOPPER_PEARSON)
@@ -55,6 +55,12 @@ namespace MLDB
                 int resampleSize) const;
         std::pair<double,double> bootstrapMeanTwoSidedBound(const std::vector<double>& sample, int replications,
                 int resampleSize) const;
+
+        /** Two sided bound on a quantity estimated from a large sample,
+            like a mean or a sum, from the estimate and its standard error.
+            This uses the normal approximation whatever the method.
+        */
+        std::pair<double,double> normalTwoSidedBound(double estimate, double standardError) const;
         
         void serialize(ML::DB::Store_Writer & store) const;
         void reconstitute(ML::DB::Store_Reader & store);
@@ -578,7 +578,7 @@ void
 DenseClassifierScorer::
 load(const std::string & filename)
 {
-    filter_istream stream(filename);
+    filter_istream stream(filename, { { "mapped", "true" } });
     ML::DB::Store_Reader store(stream);
     reconstitute(store);
 }
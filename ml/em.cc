@@ -13,9 +13,11 @@
 #include "mldb/arch/math_builtins.h"
 
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
 
 #include <random>
 #include <mutex>
+#include <atomic>
 
 #include "mldb/ml/algebra/matrix_ops.h"
 #include "mldb/ml/algebra/least_squares.h"
@@ -34,69 +36,84 @@ double distance(const distribution<double> & x,
     return (x - y).two_norm();
 }
 
-double gaussianDistance(const distribution<double> & pt,
-                        const distribution<double> & origin,
-                        const MatrixType& covarianceMatrix, 
-                        const  MatrixType & invertCovarianceMatrix,
-                        float determinant)
+namespace {
+
+/** Chunk size for passes over all of the points.  Big enough that the
+    per-chunk accumulators are cheap to merge, small enough to share the
+    work between the threads. */
+size_t pointChunkSize(size_t npoints)
 {
-    auto xToU = pt - origin;
-    auto variance = invertCovarianceMatrix * xToU ;
+    return std::max<size_t>(1024, npoints / 256);
+}
 
-    double value_exponent = -0.5f*xToU.dotprod(variance);
-    double determinantCovMatrix = determinant;
+/** Sufficient statistics of the clusters over a chunk of points, which
+    are summed into those of the whole set of points once the chunk is
+    done. */
+struct ClusterSums {
+    ClusterSums(int nbClusters, int dim, int covDim)
+        : weights(nbClusters, 0.0),
+          sums(boost::extents[nbClusters][dim]),
+          covariances(boost::extents[nbClusters][covDim][dim])
+    {
+        std::fill(sums.data(), sums.data() + sums.num_elements(), 0.0);
+        std::fill(covariances.data(),
+                  covariances.data() + covariances.num_elements(), 0.0);
+    }
 
-    if (determinantCovMatrix < 0)
-      determinantCovMatrix = fabs(determinantCovMatrix);
+    distribution<double> weights;                 ///< Total responsibility
+    boost::multi_array<double, 2> sums;          ///< Weighted sum of points
+    boost::multi_array<double, 3> covariances;   ///< Weighted (co)variances
 
-    double distance
-        = (1.0f / (pow(2.0f * 3.14159, pt.size() / 2.0f)
-                   * sqrt(determinantCovMatrix))) 
-        * exp(value_exponent);
-    
-    return distance;
+    void add(const ClusterSums & other)
+    {
+        weights += other.weights;
+        SIMD::vec_add(sums.data(), other.sums.data(), sums.data(),
+                      sums.num_elements());
+        SIMD::vec_add(covariances.data(), other.covariances.data(),
+                      covariances.data(), covariances.num_elements());
+    }
+};
 
+/** Turn the log densities of a point for each cluster into the
+    normalized weights of the point for each cluster.  Subtracting the
+    largest one first avoids underflowing to zero for all of the clusters
+    in high dimensions. */
+void softAssign(double * logDensities, int nbClusters, int best_cluster)
+{
+    double most = logDensities[best_cluster];
+    for (int i = 0;  i < nbClusters;  ++i)
+        logDensities[i] -= most;
+    SIMD::vec_exp(logDensities, logDensities, nbClusters);
+    double totalWeight = SIMD::vec_sum(logDensities, nbClusters);
+    SIMD::vec_scale(logDensities, 1.0 / totalWeight, logDensities,
+                    nbClusters);
 }
 
+} // file scope
 
-boost::multi_array<double, 2>
-EstimateCovariance(int i,
-                   const std::vector<distribution<double>> & points, 
-                   const  MatrixType& distanceMatrix,
-                   double totalWeight,
-                   distribution<double> average)
+double
+EstimationMaximisation::Cluster::
+logDensity(const double * point, double * work, EM_Covariance covariance) const
 {
-    boost::multi_array<double, 2> variant;
+    int dim = centroid.size();
 
-    if (totalWeight < 0.000001f)
-      return variant;
+    SIMD::vec_minus(point, centroid.data(), work, dim);
 
-    variant.resize(boost::extents[average.size()][average.size()]);
-    for (int n = 0; n < distanceMatrix.shape()[0]; ++n)
-    {
-        distribution<double> pt = points[n] - average;
-        double distance = distanceMatrix[n][i];
-        int dim = average.size();
-        MatrixType variantPt(boost::extents[dim][dim]);
-
-	    for (unsigned i = 0;  i < dim;  ++i)
-	    {
-	        for (unsigned j = 0;  j < dim;  ++j)
-	        {
-	            variantPt[i][j] = pt[i]*pt[j] * distance;    
-	        }
-	    }
-
-        if (n == 0) {                                    
-            variant = std::move(variantPt);
-        }
-        else {
-            variant = std::move(variant + variantPt);
-        }
+    double mahalanobis;
+    if (covariance == EM_COVARIANCE_DIAGONAL) {
+        mahalanobis = SIMD::vec_accum_prod3(work, work,
+                                            invertVariances.data(), dim);
+    }
+    else {
+        mahalanobis = 0.0;
+        for (int i = 0;  i < dim;  ++i)
+            mahalanobis += work[i]
+                * SIMD::vec_dotprod_dp(&invertCovarianceMatrix[i][0],
+                                       work, dim);
     }
 
-    variant = variant / totalWeight;
-    return variant;
+    return -0.5 * (dim * log(2.0 * M_PI) + logPseudoDeterminant)
+        - 0.5 * mahalanobis;
 }
 
 void
@@ -167,80 +184,158 @@ train(const std::vector<distribution<double>> & points,
         clusters[i].invertCovarianceMatrix
             .resize(boost::extents[numdimensions][numdimensions]);
         clusters[i].invertCovarianceMatrix = clusters[i].covarianceMatrix;
+        clusters[i].invertVariances = distribution<double>(numdimensions, 1.0);
         clusters[i].pseudoDeterminant = 1.0f; 
+        clusters[i].logPseudoDeterminant = 0.0;
     }
 
+    size_t chunkSize = pointChunkSize(npoints);
+
+    // For a diagonal covariance, only the first row of each cluster's
+    // covariance sums is used, for the variances
+    int covDim = (covariance == EM_COVARIANCE_FULL ? numdimensions : 1);
+
     for (int iter = 0;  iter < maxIterations;  ++iter) {
 
         // How many have changed cluster?  Used to know when the cluster
         // contents are stable
         std::atomic<int> changes(0);
 
-        //Step 1: assign each point to a distribution in the mixture
-
-        auto findNewCluster = [&] (int i) {
-            
-            int best_cluster = this->assign(points[i], distanceMatrix, i);
+        //Step 1: assign each point to a distribution in the mixture, and
+        //sum up the weighted points for the new means.  Each chunk of points
+        //adds into its own sums, which are merged at the end of the chunk.
+        ClusterSums totals(nbClusters, numdimensions, 0);
+        std::mutex totalsLock;
+
+        auto assignChunk = [&] (size_t first, size_t last) {
+            ClusterSums chunk(nbClusters, numdimensions, 0);
+            distribution<double> work(numdimensions);
+
+            for (size_t i = first;  i < last;  ++i) {
+                double * weights = &distanceMatrix[i][0];
+                int best_cluster
+                    = logDensities(points[i].data(), weights, work.data());
+                softAssign(weights, nbClusters, best_cluster);
+
+                if (best_cluster != in_cluster[i]) {
+                    ++changes;
+                    in_cluster[i] = best_cluster;
+                }
 
-            if (best_cluster != in_cluster[i]) {
-                ++changes;
-                in_cluster[i] = best_cluster;
+                for (int cluster = 0;  cluster < nbClusters;  ++cluster) {
+                    double weight = weights[cluster];
+                    if (weight == 0.0)
+                        continue;
+                    chunk.weights[cluster] += weight;
+                    SIMD::vec_add(&chunk.sums[cluster][0], weight,
+                                  points[i].data(), &chunk.sums[cluster][0],
+                                  numdimensions);
+                }
             }
+
+            std::unique_lock<std::mutex> guard(totalsLock);
+            totals.add(chunk);
         };
 
-        for (int i = 0; i < points.size(); ++i)
-            findNewCluster(i);
+        MLDB::parallelMapChunked(0, npoints, chunkSize, assignChunk);
 
         //Step 2: maximizing distribution's parameters 
-        for (auto & c : clusters) {
+        for (int cluster = 0; cluster < clusters.size(); ++cluster) {
+            auto & c = clusters[cluster];
+            c.totalWeight = totals.weights[cluster];
+
             // If no member, we want to leave it there
-            std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
-            c.totalWeight = 0.0f;
+            if (c.totalWeight > 0.000001f) {
+                for (int j = 0;  j < numdimensions;  ++j)
+                    c.centroid[j] = totals.sums[cluster][j] / c.totalWeight;
+            }
+            else std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
         }
 
-        std::vector<std::mutex> locks(clusters.size());
+        //calculate covariance matrix, in the same way
+        ClusterSums deviations(nbClusters, numdimensions, covDim);
+        std::mutex deviationsLock;
+
+        auto addDeviations = [&] (size_t first, size_t last) {
+            ClusterSums chunk(nbClusters, numdimensions, covDim);
+            distribution<double> pt(numdimensions);
+
+            for (size_t i = first;  i < last;  ++i) {
+                for (int cluster = 0;  cluster < nbClusters;  ++cluster) {
+                    double weight = distanceMatrix[i][cluster];
+                    if (weight == 0.0)
+                        continue;
+
+                    SIMD::vec_minus(points[i].data(),
+                                    clusters[cluster].centroid.data(),
+                                    pt.data(), numdimensions);
+
+                    if (covariance == EM_COVARIANCE_DIAGONAL) {
+                        double * variances = &chunk.covariances[cluster][0][0];
+                        SIMD::vec_add_sqr(variances, weight, pt.data(),
+                                          variances, numdimensions);
+                        continue;
+                    }
+
+                    for (int j = 0;  j < numdimensions;  ++j) {
+                        double * row = &chunk.covariances[cluster][j][0];
+                        SIMD::vec_add(row, weight * pt[j], pt.data(), row,
+                                      numdimensions);
+                    }
+                }
+            }
+
+            std::unique_lock<std::mutex> guard(deviationsLock);
+            deviations.add(chunk);
+        };
 
-        auto addToMeanForPoint = [&] (int i) {
+        MLDB::parallelMapChunked(0, npoints, chunkSize, addDeviations);
+
+        auto updateCovariance = [&] (int i) {
+            auto & c = clusters[i];
+
+            // Keep the last estimate for a cluster with no members
+            if (c.totalWeight < 0.000001f)
+                return;
+
+            if (covariance == EM_COVARIANCE_DIAGONAL) {
+                //Calculate the inverse and pseudo determinant of the
+                //variances, skipping the small ones like below
+                distribution<double> variances(numdimensions);
+                double logPseudoDeterminant = 0.0;
+                for (int j = 0;  j < numdimensions;  ++j) {
+                    variances[j] = deviations.covariances[i][0][j]
+                        / c.totalWeight;
+                    if (variances[j] < 0.0001f) {
+                        c.invertVariances[j] = 0.0f;
+                    }
+                    else {
+                        logPseudoDeterminant += log(variances[j]);
+                        c.invertVariances[j] = 1.0f / variances[j];
+                    }
+                }
 
-            auto point = points[i];
-            for (int cluster = 0; cluster < clusters.size(); ++cluster) {
-                double distance = distanceMatrix[i][cluster];
-                clusters[cluster].centroid += point * distance;
-                clusters[cluster].totalWeight += distance;
+                c.covarianceMatrix = diag(variances);
+                c.invertCovarianceMatrix = diag(c.invertVariances);
+                c.logPseudoDeterminant = logPseudoDeterminant;
+                c.pseudoDeterminant = exp(logPseudoDeterminant);
+                return;
             }
-        };
 
-        // calculate mean
-        for (int i = 0; i < points.size(); ++i) {
-            addToMeanForPoint(i);
-        }
+            c.covarianceMatrix.resize(boost::extents[numdimensions][numdimensions]);
+            for (int j = 0;  j < numdimensions;  ++j)
+                for (int k = 0;  k < numdimensions;  ++k)
+                    c.covarianceMatrix[j][k]
+                        = deviations.covariances[i][j][k] / c.totalWeight;
 
-        //normalizeMean
-        for (int cluster = 0; cluster < clusters.size(); ++cluster) {
-            if (clusters[cluster].totalWeight > 0.000001f)
-                {
-                    clusters[cluster].centroid
-                        = clusters[cluster].centroid
-                        / clusters[cluster].totalWeight;
-                }
-        }
-	     
-        //calculate covariant matrix
-        for (int i = 0; i < clusters.size(); ++i) {
-            clusters[i].covarianceMatrix
-                = EstimateCovariance(i, points, distanceMatrix,
-                                     clusters[i].totalWeight,
-                                     clusters[i].centroid);
-            ExcAssertEqual(clusters[i].covarianceMatrix.shape()[0],
-                           clusters[i].covarianceMatrix.shape()[1]);
-
-            auto svdMatrix = clusters[i].covarianceMatrix;
+            auto svdMatrix = c.covarianceMatrix;
             MatrixType VT,U;
             distribution<double> svalues;
             ML::svd_square(svdMatrix, VT, U, svalues);
 
-            //Remove small values and calculate pseudo determinant
-            double pseudoDeterminant = 1.0f;
+            //Remove small values and calculate pseudo determinant.  It's
+            //kept as a log as the product of many dimensions can overflow.
+            double logPseudoDeterminant = 0.0;
             auto invertSingularValues = svalues;
             for (int i = 0; i < svalues.size(); ++i) {
 
@@ -249,7 +344,7 @@ train(const std::vector<distribution<double>> & points,
                     invertSingularValues[i] = 0.0f;
                 }
                 else {
-                    pseudoDeterminant *= svalues[i];
+                    logPseudoDeterminant += log(svalues[i]);
                     invertSingularValues[i] = 1.0f / svalues[i];
                 }
             }
@@ -260,10 +355,13 @@ train(const std::vector<distribution<double>> & points,
             // like this
             // MatrixType pseudoCovariant = U * diag(svalues) * VT;
             
-            clusters[i].invertCovarianceMatrix
+            c.invertCovarianceMatrix
                 = transpose(VT) * diag(invertSingularValues) * transpose(U);
-            clusters[i].pseudoDeterminant = pseudoDeterminant;
-        }
+            c.logPseudoDeterminant = logPseudoDeterminant;
+            c.pseudoDeterminant = exp(logPseudoDeterminant);
+        };
+
+        MLDB::parallelMap(0, nbClusters, updateCovariance);
     }
 }
 
@@ -286,44 +384,34 @@ assign(const distribution<double> & point,
         throw MLDB::Exception("Did you train your em?");
 
     distribution<double> distances(clusters.size());
-    for (int i=0; i < clusters.size(); ++i) {
-        distances[i]
-            = gaussianDistance(point, clusters[i].centroid,
-                               clusters[i].covarianceMatrix,
-                               clusters[i].invertCovarianceMatrix,
-                               clusters[i].pseudoDeterminant);
-    }
+    distribution<double> work(point.size());
 
-    double distMin = 0;
-    int best_cluster = -1;
-    double totalWeight = 0.0f;
+    int best_cluster = logDensities(point.data(), distances.data(),
+                                    work.data());
 
-    for (int i=0; i < clusters.size(); ++i) {
+    if (pIndex >= 0) {
+        softAssign(distances.data(), clusters.size(), best_cluster);
+        for (int i=0; i < clusters.size(); ++i)
+            distanceMatrix[pIndex][i] = distances[i];
+    }
+
+    return best_cluster;
+}
 
-        double distance = distances[i];
+int
+EstimationMaximisation::
+logDensities(const double * point,
+             double * logDensities,
+             double * work) const
+{
+    int best_cluster = 0;
 
-        if (pIndex >= 0) {
-            totalWeight += distance;
-            distanceMatrix[pIndex][i] = distance;
-        }	    
-        
-        if (distances[i] > distMin) {
-            distMin = distances[i];
+    for (int i=0; i < clusters.size(); ++i) {
+        logDensities[i] = clusters[i].logDensity(point, work, covariance);
+        if (logDensities[i] > logDensities[best_cluster])
             best_cluster = i;
-        }
     }
 
-    if (pIndex >= 0 && totalWeight > 0) {
-        for (int i=0; i < clusters.size(); ++i) {
-            distanceMatrix[pIndex][i] /= totalWeight;
-        }
-    }
-
-    // Most likely these are points with all distance at 0, often during the
-    // first iteration
-    if (best_cluster == -1)
-        best_cluster = 0;
-    
     return best_cluster;
 }
 
@@ -332,8 +420,9 @@ EstimationMaximisation::
 serialize(ML::DB::Store_Writer & store) const
 {
     std::string name = "em";
-    int version = 1;
+    int version = 2;
     store << name << version;
+    store << (int) covariance;
     store << (int) clusters.size();
     for (auto & c : clusters) {
         store << c.totalWeight;
@@ -341,6 +430,7 @@ serialize(ML::DB::Store_Writer & store) const
         store << c.covarianceMatrix;
         store << c.invertCovarianceMatrix;
         store << c.pseudoDeterminant;
+        store << c.logPseudoDeterminant;
     }
     store << columnNames;
 }
@@ -356,8 +446,17 @@ reconstitute(ML::DB::Store_Reader & store)
         throw MLDB::Exception("invalid name when loading a EM object");  
     int version;
     store >> version;
-    if (version != 1)
+    if (version < 1 || version > 2)
         throw MLDB::Exception("invalid EM version");
+
+    // Version 1 only had full covariance matrices
+    covariance = EM_COVARIANCE_FULL;
+    if (version >= 2) {
+        int covarianceType;
+        store >> covarianceType;
+        covariance = (EM_Covariance)covarianceType;
+    }
+
     int nbClusters;
     store >> nbClusters;
     clusters.clear();
@@ -369,6 +468,16 @@ reconstitute(ML::DB::Store_Reader & store)
         store >> clusters[i].covarianceMatrix;
         store >> clusters[i].invertCovarianceMatrix;
         store >> clusters[i].pseudoDeterminant;
+        if (version >= 2)
+            store >> clusters[i].logPseudoDeterminant;
+        else clusters[i].logPseudoDeterminant
+                 = log(fabs(clusters[i].pseudoDeterminant));
+
+        int dim = clusters[i].centroid.size();
+        clusters[i].invertVariances.resize(dim);
+        for (int j = 0;  j < dim;  ++j)
+            clusters[i].invertVariances[j]
+                = clusters[i].invertCovarianceMatrix[j][j];
     }    
 
     store >> columnNames;
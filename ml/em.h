@@ -14,18 +14,40 @@
 
 namespace ML {
 
+/** Form of the covariance matrix of each cluster. */
+enum EM_Covariance {
+    EM_COVARIANCE_FULL,      ///< Full d x d covariance matrix
+    EM_COVARIANCE_DIAGONAL   ///< Only the variance of each dimension
+};
+
 struct EstimationMaximisation
 {
+    EstimationMaximisation()
+        : covariance(EM_COVARIANCE_FULL)
+    {
+    }
+
     struct Cluster {
         double totalWeight;
         distribution<double> centroid;
         boost::multi_array<double, 2> covarianceMatrix;
         boost::multi_array<double, 2> invertCovarianceMatrix;
         double pseudoDeterminant;
+        double logPseudoDeterminant;
+
+        /// Diagonal of invertCovarianceMatrix, for diagonal covariances
+        distribution<double> invertVariances;
+
+        /** Log of the density of the cluster's gaussian at the given
+            point.  work needs space for one value per dimension.
+        */
+        double logDensity(const double * point, double * work,
+                          EM_Covariance covariance) const;
     };
 
     std::vector<Cluster> clusters;
     std::vector<MLDB::Utf8String> columnNames;
+    EM_Covariance covariance;
 
     void
     train(const std::vector<distribution<double>> & points,
@@ -40,6 +62,15 @@ struct EstimationMaximisation
            int pIndex) const;
     int
     assign(const distribution<double> & point) const;
+
+    /** Log of the density of each cluster at the given point, with work
+        as scratch space for one value per dimension.  Returns the index
+        of the most likely cluster.
+    */
+    int
+    logDensities(const double * point,
+                 double * logDensities,
+                 double * work) const;
   
     void serialize(ML::DB::Store_Writer & store) const;
     void reconstitute(ML::DB::Store_Reader & store);
@@ -79,6 +79,7 @@ configure(const Configuration & config, vector<string> & unparsedKeys)
     config.findAndRemove(output_function, "output_function", unparsedKeys);
     config.findAndRemove(short_circuit_window, "short_circuit_window", unparsedKeys);
     config.findAndRemove(trace_training_acc, "trace_training_acc", unparsedKeys);
+    config.findAndRemove(weak_learner.device, "device", unparsedKeys);
 }
 
 void
@@ -19,6 +19,11 @@
 #include "training_index.h"
 #include "evaluation.h"
 #include "stump_predict.h"
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include "mldb/arch/sse2_exp.h"
+#endif
 
 namespace ML {
 
@@ -71,6 +76,54 @@ struct Boosting_Predict {
 };
 
 
+/** Update a block of consecutive weights of a binary symmetric problem with
+    the loss function, where pred[i] is the prediction for example i and
+    corr[i] its label.  Returns the total of the updated weights. */
+template<class Fn>
+float update_weights_block(const Fn & fn, const float * pred, const int * corr,
+                           float * weights, size_t n)
+{
+    float total = 0.0;
+    for (size_t i = 0;  i < n;  ++i) {
+        weights[i] = fn(0, corr[i], pred[i], weights[i]);
+        total += weights[i];
+    }
+    return total;
+}
+
+/** The exponential loss calculates four of the exponentials at once. */
+inline float update_weights_block(const Boosting_Loss & fn, const float * pred,
+                                  const int * corr, float * weights, size_t n)
+{
+    size_t i = 0;
+    float total = 0.0;
+
+#if defined(__SSE2__)
+    using namespace MLDB::SIMD;
+
+    v4sf totals = vec_splat(0.0f);
+    for (;  i + 4 <= n;  i += 4) {
+        float margins[4];
+        for (unsigned j = 0;  j < 4;  ++j)
+            margins[j] = (corr[i + j] == 0 ? -pred[i + j] : pred[i + j]);
+        v4sf w = _mm_loadu_ps(weights + i) * sse2_expf(pack(margins));
+        _mm_storeu_ps(weights + i, w);
+        totals = totals + w;
+    }
+
+    float subtotals[4];
+    unpack(totals, subtotals);
+    total = (subtotals[0] + subtotals[1]) + (subtotals[2] + subtotals[3]);
+#endif
+
+    for (;  i < n;  ++i) {
+        weights[i] = fn(0, corr[i], pred[i], weights[i]);
+        total += weights[i];
+    }
+    return total;
+}
+
+
 /*****************************************************************************/
 /* WEIGHTS UPDATERS                                                          */
 /*****************************************************************************/
@@ -124,8 +177,26 @@ struct Binsym_Updater {
         *weight_begin = fn(0, corr, (*pred_it) * cl_weight, *weight_begin);
         return *weight_begin * 2.0;
     }
+
+    /* Update a block of n consecutive weights once the predictions are
+       known.  See update_weights_block(). */
+    float operator () (const float * pred, const int * corr,
+                       float * weights, size_t n) const
+    {
+        return update_weights_block(fn, pred, corr, weights, n) * 2.0;
+    }
 }; 
 
+/** Tells if the updater can update blocks of binary symmetric weights at
+    once. */
+template<class Updater>
+struct Updates_Weight_Blocks : public std::false_type {
+};
+
+template<class Fn>
+struct Updates_Weight_Blocks<Binsym_Updater<Fn> > : public std::true_type {
+};
+
 template<class Fn>
 struct Normal_Updater {
     Normal_Updater(size_t nl, const Fn & fn = Fn())
@@ -228,19 +299,79 @@ struct Update_Weights {
                                  BY_EXAMPLE,
                                  IC_VALUE | IC_EXAMPLE);
         
-        double total = 0.0;
-
         Index_Iterator ex_start
             = (start_x == 0
                ? index.begin()
                : std::lower_bound(index.begin(), index.end(), start_x,
                                   Find_Example()));
         
-        Index_Iterator ex_end   = index.end();
-
         const std::vector<Label> & labels
             = data.index().labels(stump.predicted());
 
+        return update_examples(Updates_Weight_Blocks<Updater>(),
+                               stump, opt_info, cl_weight, weights,
+                               ex_start, index.end(), labels,
+                               start_x, end_x);
+    }
+
+    /** Apply the stump to the weights of the binary symmetric examples
+        from start_x to end_x by blocks: the predictions for a block are
+        made first, and the weights are then updated all at once. */
+    float update_examples(std::true_type,
+                          const Stump & stump,
+                          const Optimization_Info & opt_info,
+                          float cl_weight,
+                          boost::multi_array<float, 2> & weights,
+                          Index_Iterator ex_start, Index_Iterator ex_end,
+                          const std::vector<Label> & labels,
+                          int start_x, int end_x) const
+    {
+        if (weights.shape()[1] != 1)
+            return update_examples(std::false_type(), stump, opt_info,
+                                   cl_weight, weights, ex_start, ex_end,
+                                   labels, start_x, end_x);
+
+        enum { BLOCK_SIZE = 256 };
+        float pred[BLOCK_SIZE];
+        int corr[BLOCK_SIZE];
+
+        double total = 0.0;
+
+        for (unsigned x0 = start_x;  x0 < end_x;  x0 += BLOCK_SIZE) {
+            unsigned n = std::min<unsigned>(BLOCK_SIZE, end_x - x0);
+
+            for (unsigned i = 0;  i < n;  ++i) {
+                unsigned x = x0 + i;
+
+                /* Find the number of examples that we have. */
+                Index_Iterator ex_range = ex_start;
+                while (ex_range != ex_end && ex_range->example() == x)
+                    ++ex_range;
+
+                pred[i] = stump.predict(0, ex_start, ex_range) * cl_weight;
+                corr[i] = labels[x];
+                ex_start = ex_range;
+            }
+
+            total += updater(pred, corr, &weights[x0][0], n);
+        }
+
+        return total;
+    }
+
+    /** Apply the stump to the weights of the examples from start_x to
+        end_x one example at a time. */
+    float update_examples(std::false_type,
+                          const Stump & stump,
+                          const Optimization_Info & opt_info,
+                          float cl_weight,
+                          boost::multi_array<float, 2> & weights,
+                          Index_Iterator ex_start, Index_Iterator ex_end,
+                          const std::vector<Label> & labels,
+                          int start_x, int end_x) const
+    {
+        double total = 0.0;
+
         int advance = (weights.shape()[1] == 1 ? 0 : 1);
 
         for (unsigned x = start_x;  x < end_x;  ++x) {
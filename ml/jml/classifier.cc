@@ -8,6 +8,7 @@
 */
 
 #include "mldb/ml/jml/classifier.h"
+#include "mldb/ml/jml/compiled_forest.h"
 #include "classifier_persist_impl.h"
 #include "mldb/arch/threads.h"
 #include "mldb/jml/utils/file_functions.h"
@@ -21,6 +22,7 @@
 #include "mldb/base/exc_assert.h"
 #include "mldb/jml/math/xdiv.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/jml/utils/environment.h"
 
 
 using namespace std;
@@ -30,6 +32,14 @@ using namespace ML::DB;
 
 namespace ML {
 
+namespace {
+
+/// Do we compile decision trees and forests when optimizing?
+EnvOption<bool> MLDB_CLASSIFIER_COMPILE_FORESTS
+("MLDB_CLASSIFIER_COMPILE_FORESTS", true);
+
+} // file scope
+
 
 /*****************************************************************************/
 /* OUTPUT_ENCODING                                                           */
@@ -404,6 +414,9 @@ optimize(const std::vector<Feature> & features)
 
     optimize_impl(result);
 
+    if (MLDB_CLASSIFIER_COMPILE_FORESTS)
+        result.compiled = Compiled_Forest::compile(*this, features);
+
     return result;
 }
 
@@ -543,6 +556,61 @@ predict(int label,
     return optimized_predict_impl(label, fv, info, context);
 }
 
+void
+Classifier_Impl::
+predict_batch(const float * features,
+              size_t num_rows,
+              size_t stride,
+              const Optimization_Info & info,
+              float * output,
+              PredictionContext * context) const
+{
+    int nl = label_count();
+
+    if (info.compiled) {
+        // Scores are accumulated in double precision, like the optimized
+        // predict; convert a block at a time
+        static constexpr size_t BLOCK_ROWS = 256;
+        std::vector<double> scores(std::min(num_rows, BLOCK_ROWS) * nl);
+
+        for (size_t r0 = 0;  r0 < num_rows;  r0 += BLOCK_ROWS) {
+            size_t nr = std::min(BLOCK_ROWS, num_rows - r0);
+            info.compiled->predict_batch(features + r0 * stride, nr, stride,
+                                         scores.data());
+            std::copy(scores.begin(), scores.begin() + nr * nl,
+                      output + r0 * nl);
+        }
+        return;
+    }
+
+    if (predict_is_optimized() && info) {
+        float fv[info.features_out()];
+        for (size_t i = 0;  i < num_rows;  ++i) {
+            info.apply(features + i * stride, fv);
+            Label_Dist result = optimized_predict_impl(fv, info, context);
+            ExcAssertEqual(result.size(), nl);
+            std::copy(result.begin(), result.end(), output + i * nl);
+        }
+        return;
+    }
+
+    // Not optimized; missing features are left out of the feature set
+    std::vector<std::pair<Feature, float> > row;
+    for (size_t i = 0;  i < num_rows;  ++i) {
+        const float * values = features + i * stride;
+        row.clear();
+        for (unsigned j = 0;  j < info.from_features.size();  ++j) {
+            if (!isnan(values[j]))
+                row.emplace_back(info.from_features[j], values[j]);
+        }
+
+        Mutable_Feature_Set fset(row.begin(), row.end());
+        Label_Dist result = predict(fset, context);
+        ExcAssertEqual(result.size(), nl);
+        std::copy(result.begin(), result.end(), output + i * nl);
+    }
+}
+
 bool
 Classifier_Impl::
 optimize_impl(Optimization_Info & info)
@@ -997,7 +1065,8 @@ operator >> (DB::Store_Reader & store, Classifier & classifier)
 
 void Classifier::load(const std::string & filename)
 {
-    MLDB::filter_istream stream(filename);
+    // Uncompressed files are mapped, and read in place by the store
+    MLDB::filter_istream stream(filename, { { "mapped", "true" } });
     Store_Reader store(stream);
     reconstitute(store);
 }
@@ -1005,8 +1074,8 @@ void Classifier::load(const std::string & filename)
 void Classifier::
 load(const std::string & filename, std::shared_ptr<const Feature_Space> fs)
 {
-    MLDB::filter_istream stream(filename);
-    Store_Reader store(filename);
+    MLDB::filter_istream stream(filename, { { "mapped", "true" } });
+    Store_Reader store(stream);
     reconstitute(store, fs);
 }
 
@@ -55,6 +55,8 @@ typedef distribution<float> Label_Dist;
 /* OPTIMIZATION_INFO                                                         */
 /*****************************************************************************/
 
+struct Compiled_Forest;
+
 /** A structure that provides information on optimization to a classifier. */
 
 struct Optimization_Info {
@@ -67,6 +69,10 @@ struct Optimization_Info {
 
     std::map<Feature, int> feature_to_optimized_index;
 
+    /// The classifier compiled for the from_features, if it's made only
+    /// of decision trees.  Used by Classifier_Impl::predict_batch().
+    std::shared_ptr<const Compiled_Forest> compiled;
+
     int features_in() const
     {
         if (!initialized)
@@ -360,6 +366,23 @@ public:
                           const Optimization_Info & info,
                           PredictionContext * context = 0) const;
 
+    /** Predict all labels for num_rows dense feature vectors at once.  Row
+        i has the info.from_features, missing ones being NaN, starting at
+        features + i * stride; its label_count() outputs are written to
+        output + i * label_count().
+
+        The default uses the compiled forest in the info if there is one,
+        and otherwise predicts each row in turn, with the optimized predict
+        if there is one.  Classifiers which can do better over a whole
+        batch should override it.
+    */
+    virtual void predict_batch(const float * features,
+                               size_t num_rows,
+                               size_t stride,
+                               const Optimization_Info & info,
+                               float * output,
+                               PredictionContext * context = 0) const;
+
     //protected:
 
     /** Function to override to perform the optimization.  Default will
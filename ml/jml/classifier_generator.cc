@@ -193,6 +193,23 @@ generate(Thread_Context & context,
                     recursion + 1);
 }
 
+bool
+Classifier_Generator::
+can_stream() const
+{
+    return false;
+}
+
+std::shared_ptr<Classifier_Impl>
+Classifier_Generator::
+generate_streaming(Thread_Context & context,
+                   const Example_Stream & data,
+                   const std::vector<Feature> & features) const
+{
+    throw Exception("Classifier_Generator::generate_streaming(): "
+                    + type() + " can't train from a stream of examples");
+}
+
 std::ostream &
 Classifier_Generator::
 log(const std::string & module, int level) const
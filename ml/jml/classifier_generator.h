@@ -12,6 +12,7 @@
 #include "config_options.h"
 #include "mldb/ml/jml/feature_space.h"
 #include "training_data.h"
+#include "example_stream.h"
 #include "mldb/jml/utils/configuration.h"
 #include "mldb/ml/jml/classifier.h"
 #include "mldb/ml/jml/thread_context.h"
@@ -99,6 +100,23 @@ public:
              float & Z,
              int recursion = 0) const;
 
+    /** Can this generator train with generate_streaming()?  Default is
+        false, as most generators need all of the training data, or an
+        index over it, at once.
+    */
+    virtual bool can_stream() const;
+
+    /** Generate a classifier from examples that are read in blocks from
+        the given stream, rather than held in a Training_Data, so that
+        only a block of them at a time needs to be in memory.  The weights
+        are by example, as for the generate() method that takes a
+        distribution.  Default throws; see can_stream().
+    */
+    virtual std::shared_ptr<Classifier_Impl>
+    generate_streaming(Thread_Context & context,
+                       const Example_Stream & data,
+                       const std::vector<Feature> & features) const;
+
     /** What type of generator is it? */
     virtual std::string type() const;
 
@@ -0,0 +1,341 @@
+/** compiled_forest.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Decision trees and forests compiled into flat arrays for fast predict.
+*/
+
+#include "mldb/ml/jml/compiled_forest.h"
+#include "mldb/ml/jml/committee.h"
+#include "mldb/ml/jml/decision_tree.h"
+#include "mldb/arch/exception.h"
+#include <algorithm>
+#include <limits>
+#include <map>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COMPILED FOREST                                                           */
+/*****************************************************************************/
+
+struct Compiled_Forest::Compiler {
+    Compiler(Compiled_Forest & forest, const std::vector<Feature> & features)
+        : forest(forest)
+    {
+        // Like Optimization_Info::apply(), the last of any duplicates wins
+        for (unsigned i = 0;  i < features.size();  ++i)
+            feature_index[features[i]] = i;
+    }
+
+    Compiled_Forest & forest;
+    std::map<Feature, int> feature_index;
+
+    bool add(const Classifier_Impl & classifier, double weight)
+    {
+        if (auto committee = dynamic_cast<const Committee *>(&classifier)) {
+            // Same order as Committee::optimized_predict_impl(): the bias
+            // first, then each of the classifiers
+            if (!add_leaf_tree(committee->bias, weight))
+                return false;
+
+            for (unsigned i = 0;  i < committee->classifiers.size();  ++i) {
+                if (committee->weights[i] == 0.0) continue;
+                if (!add(*committee->classifiers[i],
+                         weight * committee->weights[i]))
+                    return false;
+            }
+            return true;
+        }
+
+        if (auto tree = dynamic_cast<const Decision_Tree *>(&classifier))
+            return add_tree(tree->tree.root, weight);
+
+        return false;
+    }
+
+    /** Add the given leaf values, returning their index or -1 if there
+        are the wrong number of them.
+    */
+    int add_leaf(const distribution<float> & pred)
+    {
+        if (pred.size() != forest.label_count_)
+            return -1;
+        int result = forest.leaves.size() / forest.label_count_;
+        forest.leaves.insert(forest.leaves.end(), pred.begin(), pred.end());
+        return result;
+    }
+
+    /** Add n nodes, with predictions of zero, returning the first. */
+    uint32_t add_nodes(size_t n)
+    {
+        uint32_t result = forest.nodes.size();
+        forest.nodes.resize(result + n);
+        forest.preds.resize(forest.nodes.size() * forest.label_count_, 0.0f);
+        return result;
+    }
+
+    /** Record the prediction of the given node, for explanations. */
+    void set_pred(uint32_t index, const distribution<float> & pred)
+    {
+        if (pred.size() != forest.label_count_) {
+            forest.can_explain_ = false;
+            return;
+        }
+        std::copy(pred.begin(), pred.end(),
+                  forest.preds.begin() + index * forest.label_count_);
+    }
+
+    static Node leaf_node(int leaf)
+    {
+        Node result;
+        result.threshold = 0.0f;
+        result.feature = 0;
+        result.op = Split::LESS;
+        result.next = ~leaf;
+        return result;
+    }
+
+    bool add_leaf_tree(const distribution<float> & pred, double weight)
+    {
+        int leaf = add_leaf(pred);
+        if (leaf == -1)
+            return false;
+        uint32_t index = add_nodes(1);
+        forest.roots.push_back(index);
+        forest.weights.push_back(weight);
+        forest.bias_trees.push_back(true);
+        forest.nodes[index] = leaf_node(leaf);
+        set_pred(index, pred);
+        return true;
+    }
+
+    bool add_tree(const Tree::Ptr & root, double weight)
+    {
+        forest.roots.push_back(add_nodes(1));
+        forest.weights.push_back(weight);
+        forest.bias_trees.push_back(false);
+
+        // Breadth first, so that the top levels which every row goes
+        // through are together at the start
+        std::vector<std::pair<Tree::Ptr, uint32_t> > pending;
+        pending.emplace_back(root, forest.roots.back());
+
+        for (size_t i = 0;  i < pending.size();  ++i) {
+            Tree::Ptr ptr = pending[i].first;
+            uint32_t index = pending[i].second;
+
+            // A missing child contributes nothing, like in
+            // Decision_Tree::predict_recursive_impl()
+            if (!ptr) {
+                forest.nodes[index] = leaf_node(0);
+                continue;
+            }
+
+            if (!ptr.node()) {
+                int leaf = add_leaf(ptr.leaf()->pred);
+                if (leaf == -1)
+                    return false;
+                forest.nodes[index] = leaf_node(leaf);
+                set_pred(index, ptr.leaf()->pred);
+                continue;
+            }
+
+            const Tree::Node & node = *ptr.node();
+            auto it = feature_index.find(node.split.feature());
+            if (it == feature_index.end())
+                return false;
+
+            uint32_t first = forest.nodes.size();
+            if (first > (uint32_t)std::numeric_limits<int32_t>::max() - 3)
+                return false;
+
+            Node & compiled = forest.nodes[index];
+            compiled.threshold = node.split.split_val();
+            compiled.feature = it->second;
+            compiled.op = node.split.op();
+            compiled.next = first;
+            set_pred(index, node.pred);
+
+            add_nodes(3);
+            pending.emplace_back(node.child_false, first + false);
+            pending.emplace_back(node.child_true, first + true);
+            pending.emplace_back(node.child_missing, first + MISSING);
+        }
+
+        return true;
+    }
+};
+
+std::shared_ptr<const Compiled_Forest>
+Compiled_Forest::
+compile(const Classifier_Impl & classifier,
+        const std::vector<Feature> & features)
+{
+    // Feature indexes need to fit in the node
+    if (features.size() >= (1U << 30))
+        return nullptr;
+
+    auto result = std::make_shared<Compiled_Forest>();
+    result->label_count_ = classifier.label_count();
+    result->feature_count_ = features.size();
+    if (result->label_count_ <= 0)
+        return nullptr;
+
+    // Leaf 0 is the one for missing children
+    result->leaves.resize(result->label_count_, 0.0f);
+
+    Compiler compiler(*result, features);
+    if (!compiler.add(classifier, 1.0))
+        return nullptr;
+
+    return result;
+}
+
+void
+Compiled_Forest::
+predict(const float * features, double * output) const
+{
+    int nl = label_count_;
+    std::fill(output, output + nl, 0.0);
+
+    for (size_t t = 0;  t < roots.size();  ++t) {
+        uint32_t n = roots[t];
+        while (nodes[n].next >= 0) {
+            const Node & node = nodes[n];
+            n = node.next + node.branch(features[node.feature]);
+        }
+
+        const float * leaf = &leaves[~nodes[n].next * nl];
+        double weight = weights[t];
+        for (int i = 0;  i < nl;  ++i)
+            output[i] += leaf[i] * weight;
+    }
+}
+
+void
+Compiled_Forest::
+predict_batch(const float * features, size_t num_rows, size_t stride,
+              double * output) const
+{
+    static constexpr size_t BLOCK_ROWS = 16;
+
+    int nl = label_count_;
+
+    for (size_t r0 = 0;  r0 < num_rows;  r0 += BLOCK_ROWS) {
+        size_t nr = std::min(BLOCK_ROWS, num_rows - r0);
+        const float * rows = features + r0 * stride;
+        double * out = output + r0 * nl;
+        std::fill(out, out + nr * nl, 0.0);
+
+        for (size_t t = 0;  t < roots.size();  ++t) {
+            uint32_t current[BLOCK_ROWS];
+            std::fill(current, current + nr, roots[t]);
+
+            // Step every row down one level per pass, until each one is
+            // at a leaf.  The rows are independent, so their loads and
+            // comparisons can all be in flight at once.
+            for (bool any = true;  any;) {
+                any = false;
+                for (size_t r = 0;  r < nr;  ++r) {
+                    const Node & node = nodes[current[r]];
+                    if (node.next < 0)
+                        continue;
+                    current[r] = node.next
+                        + node.branch(rows[r * stride + node.feature]);
+                    any = true;
+                }
+            }
+
+            double weight = weights[t];
+            for (size_t r = 0;  r < nr;  ++r) {
+                const float * leaf = &leaves[~nodes[current[r]].next * nl];
+                for (int i = 0;  i < nl;  ++i)
+                    out[r * nl + i] += leaf[i] * weight;
+            }
+        }
+    }
+}
+
+void
+Compiled_Forest::
+explain_batch(const float * features, size_t num_rows, size_t stride,
+              const int * labels, double * bias, double * contributions,
+              bool * used) const
+{
+    static constexpr size_t BLOCK_ROWS = 16;
+
+    if (!can_explain_)
+        throw Exception("Compiled_Forest::explain_batch(): the trees don't "
+                        "have predictions to explain with");
+
+    int nl = label_count_;
+    int nf = feature_count_;
+
+    for (size_t r0 = 0;  r0 < num_rows;  r0 += BLOCK_ROWS) {
+        size_t nr = std::min(BLOCK_ROWS, num_rows - r0);
+        const float * rows = features + r0 * stride;
+        double * rowBias = bias + r0;
+        double * rowContributions = contributions + r0 * nf;
+        bool * rowUsed = used + r0 * nf;
+
+        std::fill(rowBias, rowBias + nr, 0.0);
+        std::fill(rowContributions, rowContributions + nr * nf, 0.0);
+        std::fill(rowUsed, rowUsed + nr * nf, false);
+
+        // Offset of each row's label in the predictions of a node
+        int label[BLOCK_ROWS];
+        for (size_t r = 0;  r < nr;  ++r) {
+            label[r] = nl < 2 ? 0 : labels[r0 + r];
+            if (label[r] < 0 || label[r] >= nl)
+                throw Exception("Compiled_Forest::explain_batch(): "
+                                "no label");
+        }
+
+        for (size_t t = 0;  t < roots.size();  ++t) {
+            // Like Committee::explain(), the bias isn't explained
+            if (bias_trees[t])
+                continue;
+
+            double weight = weights[t];
+            uint32_t current[BLOCK_ROWS];
+            std::fill(current, current + nr, roots[t]);
+
+            for (size_t r = 0;  r < nr;  ++r)
+                rowBias[r] += weight * preds[roots[t] * nl + label[r]];
+
+            // Same stepping as predict_batch(), crediting each step to
+            // the feature of the node it comes from
+            for (bool any = true;  any;) {
+                any = false;
+                for (size_t r = 0;  r < nr;  ++r) {
+                    const Node & node = nodes[current[r]];
+                    if (node.next < 0)
+                        continue;
+                    uint32_t child = node.next
+                        + node.branch(rows[r * stride + node.feature]);
+
+                    // A missing child isn't on the path; it's leaf 0
+                    if (nodes[child].next != ~0) {
+                        float delta = preds[child * nl + label[r]]
+                            - preds[current[r] * nl + label[r]];
+                        rowContributions[r * nf + node.feature]
+                            += weight * delta;
+                        rowUsed[r * nf + node.feature] = true;
+                    }
+
+                    current[r] = child;
+                    any = true;
+                }
+            }
+        }
+    }
+}
+
+} // namespace ML
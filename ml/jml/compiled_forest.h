@@ -0,0 +1,140 @@
+/** compiled_forest.h                                              -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Decision trees and forests compiled into flat arrays for fast predict.
+*/
+
+#pragma once
+
+#include "mldb/ml/jml/feature.h"
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+
+namespace ML {
+
+class Classifier_Impl;
+
+
+/*****************************************************************************/
+/* COMPILED FOREST                                                           */
+/*****************************************************************************/
+
+/** A decision tree, or a committee of them such as the one produced by
+    bagging, compiled into a flat array of nodes that predict from dense
+    feature vectors.
+
+    Each tree's nodes are laid out breadth first, and the three children
+    of a node (false, true and missing, in the order that Split::apply()
+    returns) are next to each other, so that each node holds only its
+    feature, its threshold and where its children start.  Choosing a
+    child is done with arithmetic rather than branches.  The bias of each
+    committee is kept as a tree with a single leaf, so that outputs are
+    accumulated in exactly the same order as the optimized predict of the
+    classifier it came from.
+
+    predict_batch() evaluates a block of rows together against each tree
+    in turn, stepping all of their paths down one level at a time.  That
+    keeps the tree's nodes in cache and gives the processor independent
+    loads and comparisons to overlap, which is where the time goes when
+    walking trees.
+
+    The prediction of every node, and not only of the leaves, is kept on
+    the side so that explanations can be read off the same paths: see
+    explain_batch().
+
+    Once compiled, it doesn't depend on the classifier any more and is
+    safe to use from multiple threads.
+*/
+
+struct Compiled_Forest {
+
+    /** Compile the given classifier for dense feature vectors with the
+        given features, in that order.  Returns null if the classifier
+        isn't made of only decision trees and committees, or if it uses a
+        feature that isn't in the list.
+    */
+    static std::shared_ptr<const Compiled_Forest>
+    compile(const Classifier_Impl & classifier,
+            const std::vector<Feature> & features);
+
+    /** Number of outputs per row. */
+    int label_count() const { return label_count_; }
+
+    /** Number of features in each input row. */
+    int feature_count() const { return feature_count_; }
+
+    /** Number of trees, including one for each bias. */
+    size_t tree_count() const { return roots.size(); }
+
+    /** Number of nodes, including leaves, over all of the trees. */
+    size_t node_count() const { return nodes.size(); }
+
+    /** Predict one row of feature_count() features, missing ones being
+        NaN, writing label_count() outputs.
+    */
+    void predict(const float * features, double * output) const;
+
+    /** Predict num_rows rows, with row i starting at features + i * stride.
+        Row i's outputs are written to output + i * label_count().
+    */
+    void predict_batch(const float * features, size_t num_rows,
+                       size_t stride, double * output) const;
+
+    /** Can explain_batch() be used?  False for trees whose nodes don't
+        have a prediction for each label.
+    */
+    bool can_explain() const { return can_explain_; }
+
+    /** Explain the predictions of num_rows rows laid out as for
+        predict_batch(), row i for label labels[i] (ignored for
+        regressions), the same way as Decision_Tree::explain() and
+        Committee::explain() do: the prediction of the root of each tree
+        goes to the bias, and the change in prediction from each node on
+        the path to the next goes to the feature that the node split on.
+        The biases of committees aren't part of explanations.
+
+        Row i's bias is written to bias[i].  Its contributions, one per
+        feature, are written to contributions + i * feature_count(), and
+        whether each feature is on one of its paths (and so would be in
+        the Explanation) to used + i * feature_count().
+    */
+    void explain_batch(const float * features, size_t num_rows,
+                       size_t stride, const int * labels, double * bias,
+                       double * contributions, bool * used) const;
+
+private:
+    struct Node {
+        float threshold;       ///< Value to split on
+        uint32_t feature:30;   ///< Index in the dense feature vector
+        uint32_t op:2;         ///< Split::Op
+        int32_t next;          ///< First child; ~leaf index for a leaf
+
+        /** Return which of the children to go to for the given value:
+            false (0), true (1) or missing (2).  Same as Split::apply().
+        */
+        int branch(float val) const
+        {
+            int all = (val < threshold) | ((val == threshold) << 1) | 4;
+            int result = (all >> op) & 1;
+            return val != val ? 2 : result;
+        }
+    };
+
+    struct Compiler;
+
+    int label_count_ = 0;
+    int feature_count_ = 0;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> roots;    ///< Root node of each tree
+    std::vector<double> weights;    ///< Weight of each tree
+    std::vector<float> leaves;      ///< label_count_ outputs per leaf
+    std::vector<float> preds;       ///< label_count_ predictions per node
+    std::vector<bool> bias_trees;   ///< Is each tree the bias of a committee
+    bool can_explain_ = true;
+};
+
+} // namespace ML
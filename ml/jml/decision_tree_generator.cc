@@ -130,6 +130,7 @@ configure(const Configuration & config, vector<string> & unparsedKeys)
     config.findAndRemove(update_alg, "update_alg", unparsedKeys);
     config.findAndRemove(random_feature_propn, "random_feature_propn", unparsedKeys);
     config.findAndRemove(verbosity, "verbosity", unparsedKeys);
+    config.findAndRemove(device, "device", unparsedKeys);
 }
 
 void
@@ -141,6 +142,7 @@ defaults()
     max_depth = -1;
     update_alg = Stump::PROB;
     random_feature_propn = 1.0;
+    device = TD_CPU;
 }
 
 Config_Options
@@ -156,7 +158,9 @@ options() const
         .add("update_alg", update_alg,
              "select the type of output that the tree gives")
         .add("random_feature_propn", random_feature_propn, "0.0-1.0",
-             "proportion of the features to enable (for random forests)");
+             "proportion of the features to enable (for random forests)")
+        .add("device", device,
+             "device to train binary problems on: cpu, cuda or auto");
     
     return result;
 }
@@ -749,6 +753,11 @@ int get_advance(const AddDimension &)
     return 0;
 }
 
+const float * device_weights(const AddDimension & weights)
+{
+    return weights.vals.data();
+}
+
 template<typename W, typename Z>
 struct TreeTrainer {
     Tree & tree;
@@ -762,6 +771,9 @@ struct TreeTrainer {
     std::shared_ptr<const Feature_Space> feature_space;
     bool validate;
 
+    /// Device to find the splits on, or null for the CPU
+    std::shared_ptr<const Stump_Training_Device> device;
+
     TreeTrainer(Tree & tree,
                 int max_depth,
                 const vector<Feature> & features,
@@ -980,6 +992,7 @@ struct TreeTrainer {
 
         Accum accum(*feature_space, nl, trace);
         SplitTrainer splitTrainer;
+        splitTrainer.device = device;
     
         if (binary_weights.empty())
             splitTrainer.test_all
@@ -1145,6 +1158,7 @@ train_recursive(Thread_Context & context,
         TreeTrainer<W, Z> trainer(tree, max_depth, features, advance,
                                   predicted, trace, update_alg, feature_space,
                                   validate);
+        trainer.device = get_stump_training_device(device);
         return trainer.train(context, data, weights, in_class, binary_weights, depth);
     }
     else {
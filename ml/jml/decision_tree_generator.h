@@ -13,6 +13,7 @@
 #include "classifier_generator.h"
 #include "decision_tree.h"
 #include "stump.h"
+#include "stump_training_device.h"
 
 
 namespace ML {
@@ -72,6 +73,7 @@ public:
     int trace;
     Stump::Update update_alg;
     float random_feature_propn;
+    Training_Device device;
 
     /* Once init has been called, we clone our potential models from this
        one. */
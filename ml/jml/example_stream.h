@@ -0,0 +1,55 @@
+/* example_stream.h                                                -*- C++ -*-
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Training examples that are read in blocks rather than held in memory.
+*/
+
+#pragma once
+
+#include "feature_set.h"
+#include "mldb/ml/jml/feature_space.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* EXAMPLE_STREAM                                                            */
+/*****************************************************************************/
+
+/** A set of training examples that can be read as many times as needed,
+    a block at a time, instead of being held in memory as a Training_Data.
+    This allows generators that need only a few passes over the data, and
+    no index over it, to train on data sets that don't fit in memory; see
+    Classifier_Generator::generate_streaming().
+
+    The label is a feature of each example, as in a Training_Data.
+*/
+
+struct Example_Stream {
+    virtual ~Example_Stream()
+    {
+    }
+
+    /** Feature space that the examples are in. */
+    virtual std::shared_ptr<const Feature_Space> feature_space() const = 0;
+
+    /** Called with each block of examples, and the weight of each of
+        them.  The examples are sorted.
+    */
+    typedef std::function<void (const std::vector<Mutable_Feature_Set> & examples,
+                                const std::vector<float> & weights)>
+        On_Block;
+
+    /** Call on_block for each block of examples in turn, from the calling
+        thread.  Every call gives the same examples in the same order.
+    */
+    virtual void for_each_block(const On_Block & on_block) const = 0;
+};
+
+} // namespace ML
@@ -12,6 +12,7 @@
 #include "null_feature_space.h"
 #include "mldb/ml/jml/dense_features.h"
 #include "mldb/ml/algebra/irls.h"
+#include "mldb/ml/algebra/matrix_ops.h"
 #include <boost/timer.hpp>
 #include "training_index.h"
 
@@ -236,6 +237,67 @@ optimized_predict_impl(int label,
     return do_predict_impl(label, features_c, &feature_indexes[0]);
 }
 
+void
+GLZ_Classifier::
+predict_batch(const float * features_c,
+              size_t num_rows,
+              size_t stride,
+              const Optimization_Info & info,
+              float * output,
+              PredictionContext * context) const
+{
+    if (!optimized_ || !info) {
+        Classifier_Impl::predict_batch(features_c, num_rows, stride, info,
+                                       output, context);
+        return;
+    }
+
+    int nl = label_count();
+    int nv = features.size();
+    int nx = nv + add_bias;
+
+    // Column of each variable in the input rows, rather than in the
+    // optimized vector; like Optimization_Info::apply(), the last input
+    // with a feature wins
+    std::vector<int> optimized_to_input(info.features_out(), -1);
+    for (unsigned i = 0;  i < info.indexes.size();  ++i)
+        if (info.indexes[i] != -1)
+            optimized_to_input[info.indexes[i]] = i;
+
+    std::vector<int> input_indexes(nv);
+    for (unsigned j = 0;  j < nv;  ++j) {
+        input_indexes[j] = optimized_to_input[feature_indexes[j]];
+        ExcAssertNotEqual(input_indexes[j], -1);
+    }
+
+    boost::multi_array<float, 2> W(boost::extents[nl][nx]);
+    for (unsigned l = 0;  l < nl;  ++l)
+        std::copy(weights[l].begin(), weights[l].begin() + nx, &W[l][0]);
+
+    static constexpr size_t BLOCK_ROWS = 64;
+
+    for (size_t r0 = 0;  r0 < num_rows;  r0 += BLOCK_ROWS) {
+        size_t nr = std::min(BLOCK_ROWS, num_rows - r0);
+
+        boost::multi_array<float, 2> X(boost::extents[nr][nx]);
+        for (size_t i = 0;  i < nr;  ++i) {
+            const float * row = features_c + (r0 + i) * stride;
+            for (unsigned j = 0;  j < nv;  ++j)
+                X[i][j] = decode_value(row[input_indexes[j]], features[j]);
+            if (add_bias)
+                X[i][nv] = 1.0;
+        }
+
+        boost::multi_array<double, 2> accum
+            = multiply_transposed<double>(X, W);
+
+        for (size_t i = 0;  i < nr;  ++i)
+            for (unsigned l = 0;  l < nl;  ++l)
+                output[(r0 + i) * nl + l]
+                    = apply_link_inverse(accum[i][l], link);
+    }
+}
+
 float
 GLZ_Classifier::
 decode_value(float feat_val, const Feature_Spec & spec) const
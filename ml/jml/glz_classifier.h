@@ -98,6 +98,12 @@ public:
     /** Turn a feature set into a decoded dense vector */
     distribution<float> decode(const Feature_Set & features) const;
 
+    /** Decode the value of a single feature for the given variable, as
+        decode() does for each entry of its result.  Missing values decode
+        to zero.
+    */
+    float decode_value(float feat_val, const Feature_Spec & spec) const;
+
     using Classifier_Impl::predict;
 
     /** Predict the score for all classes. */
@@ -150,6 +156,16 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    /** Batch predict, as one matrix product of the decoded features with
+        the weights for each block of rows.
+    */
+    virtual void predict_batch(const float * features,
+                               size_t num_rows,
+                               size_t stride,
+                               const Optimization_Info & info,
+                               float * output,
+                               PredictionContext * context = 0) const;
+
 #ifndef MLDB_TESTING_GLZ_CLASSIFIER
 protected:
 #endif
@@ -177,8 +193,6 @@ protected:
              const int * indexes,
              int label) const;
 
-    float decode_value(float feat_val, const Feature_Spec & spec) const;
-
 public:
     virtual Explanation explain(const Feature_Set & feature_set,
                                 const ML::Label & label,
@@ -17,9 +17,11 @@
 #include "mldb/ml/algebra/matrix_ops.h"
 #include "mldb/ml/algebra/lapack.h"
 #include "mldb/ml/algebra/least_squares.h"
+#include "mldb/ml/algebra/irls.h"
 #include "mldb/arch/timers.h"
 #include "mldb/base/parallel.h"
 #include "mldb/jml/utils/string_functions.h"
+#include <algorithm>
 #include <cassert>
 
 using namespace std;
@@ -57,6 +59,7 @@ configure(const Configuration & config, vector<string> & unparsedKeys)
     config.findAndRemove(max_regularization_iteration, "max_regularization_iteration", unparsedKeys);
     config.findAndRemove(regularization_epsilon, "regularization_epsilon", unparsedKeys);
     config.findAndRemove(feature_proportion, "feature_proportion", unparsedKeys);
+    config.findAndRemove(sparse_density, "sparse_density", unparsedKeys);
 }
 
 void
@@ -74,6 +77,7 @@ defaults()
     max_regularization_iteration = 1000;
     regularization_epsilon = 1e-4;
     feature_proportion = 1.0;
+    sparse_density = 0.05;
 }
 
 Config_Options
@@ -110,7 +114,12 @@ options() const
              " stability (but much slower training)")
         .add("feature_proportion", feature_proportion, "0 to 1",
              "use only a (random) portion of available features when training"
-             " classifier");
+             " classifier")
+        .add("sparse_density", sparse_density, "0 to 1",
+             "when the proportion of non-zero values in the training data is"
+             " below this, train with a sparse solver that doesn't need a"
+             " dense copy of the data; the features are then scaled but not"
+             " centered by normalize.  0 to never use it");
 
     return result;
 }
@@ -200,61 +209,55 @@ generate(Thread_Context & thread_context,
     return make_sp(current.make_copy());
 }
 
-float
-GLZ_Classifier_Generator::
-train_weighted(Thread_Context & thread_context,
-               const Training_Data & data,
-               const boost::multi_array<float, 2> & weights,
-               const std::vector<Feature> & unfiltered,
-               GLZ_Classifier & result) const
-{
-    /* Algorithm:
-       1.  Convert training data to a dense format;
-       2.  Train on each column
-    */
-
-    result = model;
-    result.features.clear();
-    result.add_bias = add_bias;
-    result.link = (do_decode ? link_function : LINEAR);
+namespace {
 
-    Feature predicted = model.predicted();
-    
+/** Add the variables for the given features to the GLZ, using the index
+    to find out how each one occurs in the training data.  Templated so
+    that it can use either a Dataset_Index, or the statistics gathered by
+    a pass over a stream of examples.
+*/
+template<class Index>
+void add_variables(const GLZ_Classifier_Generator & generator,
+                   Thread_Context & thread_context,
+                   const Index & index,
+                   const Feature_Space & fs,
+                   const std::vector<Feature> & unfiltered,
+                   GLZ_Classifier & result)
+{
     for (unsigned i = 0;  i < unfiltered.size();  ++i) {
-        if (unfiltered[i] == model.predicted())
+        if (unfiltered[i] == generator.model.predicted())
             continue;  // don't use the label to predict itself
 
         // If we don't want to use all features then take a random subset
-        if (feature_proportion < 1.0
-            && thread_context.random01() > feature_proportion)
+        if (generator.feature_proportion < 1.0
+            && thread_context.random01() > generator.feature_proportion)
             continue;
 
-        auto info = data.feature_space()->info(unfiltered[i]);
+        auto info = fs.info(unfiltered[i]);
 
         GLZ_Classifier::Feature_Spec spec(unfiltered[i]);
 
         if (info.categorical()) {
             // One for each category.  Missing takes care of itself as it
             // means that we just have none set.
-            for (auto & v: data.index().freqs(unfiltered[i])) {
+            for (auto & v: index.freqs(unfiltered[i])) {
                 spec.value = v.first;
                 spec.type = GLZ_Classifier::Feature_Spec::VALUE_EQUALS;
-                spec.category = data.feature_space()
-                    ->print(unfiltered[i], v.first);
+                spec.category = fs.print(unfiltered[i], v.first);
                 result.features.push_back(spec);
             }
         }
         else {
             // Can't use a feature that has multiple occurrences
-            if (!data.index().only_one(unfiltered[i])) continue;
+            if (!index.only_one(unfiltered[i])) continue;
 
-            if (data.index().exactly_one(unfiltered[i])) {
+            if (index.exactly_one(unfiltered[i])) {
                 // Feature that's always there but constant has no information
-                if (data.index().constant(unfiltered[i])) continue;
+                if (index.constant(unfiltered[i])) continue;
                 result.features.push_back(spec);
             }
             else {
-                if (!data.index().constant(unfiltered[i])) {
+                if (!index.constant(unfiltered[i])) {
                     spec.type = GLZ_Classifier::Feature_Spec::VALUE_IF_PRESENT;
                     result.features.push_back(spec);
                 }
@@ -263,6 +266,192 @@ train_weighted(Thread_Context & thread_context,
             }
         }
     }
+}
+
+/** Statistics of how each feature occurs over a stream of examples, with
+    the parts of the Dataset_Index interface that add_variables() needs.
+*/
+struct Streamed_Feature_Stats {
+    struct Entry {
+        Entry()
+            : seen(0), found_in(0), found_twice(0),
+              last_example(-1), in_this_ex(0),
+              min_value(INFINITY), max_value(-INFINITY),
+              categorical(false)
+        {
+        }
+
+        size_t seen;          ///< Number of times this feature seen
+        size_t found_in;      ///< Number of examples feature is found
+        size_t found_twice;   ///< Number of examples more than one instance
+        ssize_t last_example; ///< Last example number we were found in
+        size_t in_this_ex;    ///< Number of times in this example
+        float min_value;      ///< Minimum value found
+        float max_value;      ///< Maximum value found
+        bool categorical;
+        std::map<float, size_t> freqs;  ///< Only for categorical features
+    };
+
+    Streamed_Feature_Stats(const Feature_Space & fs,
+                           const std::vector<Feature> & features)
+        : example_count(0)
+    {
+        for (auto & f: features)
+            entries[f].categorical = !!fs.info(f).categorical();
+    }
+
+    std::map<Feature, Entry> entries;
+    size_t example_count;
+
+    void add(const Feature_Set & example)
+    {
+        ssize_t x = example_count++;
+
+        for (auto it = example.begin(), end = example.end();
+             it != end;  ++it) {
+            auto found = entries.find((*it).first);
+            if (found == entries.end())
+                continue;
+
+            Entry & entry = found->second;
+            float value = (*it).second;
+
+            // Missing values aren't indexed, like in Index_Entry::insert()
+            if (std::isnan(value))
+                continue;
+
+            entry.seen += 1;
+            if (entry.last_example != x) {
+                entry.found_in += 1;
+                entry.last_example = x;
+                entry.in_this_ex = 0;
+            }
+            if (++entry.in_this_ex == 2)
+                entry.found_twice += 1;
+
+            entry.min_value = std::min(entry.min_value, value);
+            entry.max_value = std::max(entry.max_value, value);
+
+            if (entry.categorical)
+                entry.freqs[value] += 1;
+        }
+    }
+
+    const Entry & get(const Feature & feature) const
+    {
+        auto it = entries.find(feature);
+        if (it == entries.end())
+            throw Exception("Streamed_Feature_Stats: feature not known");
+        return it->second;
+    }
+
+    const std::map<float, size_t> & freqs(const Feature & feature) const
+    {
+        return get(feature).freqs;
+    }
+
+    bool only_one(const Feature & feature) const
+    {
+        return get(feature).found_twice == 0;
+    }
+
+    bool exactly_one(const Feature & feature) const
+    {
+        const Entry & entry = get(feature);
+        return entry.seen == example_count
+            && entry.found_in == example_count
+            && entry.found_twice == 0;
+    }
+
+    bool constant(const Feature & feature) const
+    {
+        const Entry & entry = get(feature);
+        return entry.min_value == entry.max_value;
+    }
+};
+
+/** Decodes examples into the index and value of each of the non-zero
+    entries that GLZ_Classifier::decode() would give, in variable order.
+    Only the features in the example are looked up, so the cost doesn't
+    depend on the number of variables.
+*/
+struct Sparse_Decoder {
+    Sparse_Decoder(const GLZ_Classifier & glz, bool add_bias)
+        : glz(glz), add_bias(add_bias)
+    {
+        for (unsigned i = 0;  i < glz.features.size();  ++i)
+            index.emplace_back(glz.features[i].feature, i);
+        std::sort(index.begin(), index.end());
+    }
+
+    const GLZ_Classifier & glz;
+    bool add_bias;
+
+    /// Variable of each feature, sorted by feature
+    std::vector<std::pair<Feature, int> > index;
+
+    void decode(const Feature_Set & example,
+                std::vector<std::pair<int, float> > & result) const
+    {
+        result.clear();
+
+        auto compare = [] (const std::pair<Feature, int> & entry,
+                           const Feature & feature)
+            {
+                return entry.first < feature;
+            };
+
+        for (auto it = example.begin(), end = example.end();
+             it != end;  ++it) {
+            Feature feature = (*it).first;
+            float value = (*it).second;
+
+            // Like decode(), only the first occurrence of a feature counts
+            if (it != example.begin() && it.feature() == (it - 1).feature())
+                continue;
+
+            for (auto found = std::lower_bound(index.begin(), index.end(),
+                                               feature, compare);
+                 found != index.end() && found->first == feature;
+                 ++found) {
+                int v = found->second;
+                float decoded = glz.decode_value(value, glz.features[v]);
+                if (decoded != 0.0)
+                    result.emplace_back(v, decoded);
+            }
+        }
+
+        std::sort(result.begin(), result.end());
+
+        if (add_bias)
+            result.emplace_back(glz.features.size(), 1.0);
+    }
+};
+
+} // file scope
+
+float
+GLZ_Classifier_Generator::
+train_weighted(Thread_Context & thread_context,
+               const Training_Data & data,
+               const boost::multi_array<float, 2> & weights,
+               const std::vector<Feature> & unfiltered,
+               GLZ_Classifier & result) const
+{
+    /* Algorithm:
+       1.  Convert training data to a dense format;
+       2.  Train on each column
+    */
+
+    result = model;
+    result.features.clear();
+    result.add_bias = add_bias;
+    result.link = (do_decode ? link_function : LINEAR);
+
+    Feature predicted = model.predicted();
+
+    add_variables(*this, thread_context, data.index(), *data.feature_space(),
+                  unfiltered, result);
     
     size_t nl = result.label_count();        // Number of labels
     bool regression_problem = (nl == 1);
@@ -291,10 +480,41 @@ train_weighted(Thread_Context & thread_context,
 
     /* Get the labels by example. */
     const vector<Label> & labels = data.index().labels(predicted);
-    
+
+    /* Find out how sparse the data is.  If it's sparse enough, we keep
+       only the non-zero values and never build the dense matrix. */
+    bool sparse = sparse_density > 0.0 && !condition;
+    IRLS_Sparse_Matrix sparse_data;
+
+    if (sparse) {
+        std::vector<std::vector<std::pair<int, float> > > rows(nx2);
+        Sparse_Decoder decoder(result, add_bias);
+
+        auto onSparseIndex = [&] (int index)
+            {
+                decoder.decode(data[indexes[index]], rows[index]);
+            };
+
+        MLDB::parallelMap(0, nx2, onSparseIndex);
+
+        size_t nnz = 0;
+        for (auto & row: rows)
+            nnz += row.size();
+
+        double density = (nx2 * nv == 0) ? 1.0 : (double)nnz / nx2 / nv;
+        sparse = density < sparse_density;
+
+        cerr << "density: " << density << (sparse ? " (sparse)" : "")
+             << endl;
+
+        if (sparse)
+            sparse_data.init(nv, rows);
+    }
+
     // Use double precision, we have enough memory (<= 1GB)
     // NOTE: always on due to issues with convergence
-    boost::multi_array<double, 2> dense_data(boost::extents[nv][nx2]);  // training data, dense
+    boost::multi_array<double, 2>
+        dense_data(boost::extents[sparse ? 0 : nv][nx2]);  // training data, dense
         
     distribution<double> model(nx2, 0.0);  // to initialise weights, correct
     vector<distribution<double> > w(nl, model);       // weights for each label
@@ -307,16 +527,18 @@ train_weighted(Thread_Context & thread_context,
         {
             int x = indexes[index];
 
-            distribution<float> decoded = result.decode(data[x]);
-            if (add_bias) decoded.push_back(1.0);
-            
-            //cerr << "x = " << x << "  decoded = " << decoded << endl;
-            
-            /* Record the values of the variables. */
-            assert(decoded.size() == nv);
-            for (unsigned v = 0;  v < decoded.size();  ++v) {
-                if (!isfinite(decoded[v])) decoded[v] = 0.0;
-                dense_data[v][index] = decoded[v];
+            if (!sparse) {
+                distribution<float> decoded = result.decode(data[x]);
+                if (add_bias) decoded.push_back(1.0);
+
+                //cerr << "x = " << x << "  decoded = " << decoded << endl;
+
+                /* Record the values of the variables. */
+                assert(decoded.size() == nv);
+                for (unsigned v = 0;  v < decoded.size();  ++v) {
+                    if (!isfinite(decoded[v])) decoded[v] = 0.0;
+                    dense_data[v][index] = decoded[v];
+                }
             }
             
             /* Record the correct label. */
@@ -345,7 +567,7 @@ train_weighted(Thread_Context & thread_context,
     distribution<double> means(nv), stds(nv, 1.0);
 
     /* Scale */
-    for (unsigned v = 0;  v < nv && normalize;  ++v) {
+    for (unsigned v = 0;  v < nv && normalize && !sparse;  ++v) {
 
         double total = 0.0;
 
@@ -378,6 +600,41 @@ train_weighted(Thread_Context & thread_context,
         stds[v] = std;
     }
 
+    /* Scale the sparse data.  Centering would make it dense, so the means
+       are left in (and so are zero as far as the bias is concerned). */
+    if (normalize && sparse && nv > 0) {
+        auto doScale = [&] (size_t first, size_t last)
+            {
+                for (size_t v = first;  v < last;  ++v) {
+                    size_t b = sparse_data.starts[v];
+                    size_t e = sparse_data.starts[v + 1];
+
+                    double total = 0.0, total_sqr = 0.0;
+                    for (size_t i = b;  i < e;  ++i) {
+                        total += sparse_data.values[i];
+                        total_sqr += sparse_data.values[i]
+                            * sparse_data.values[i];
+                    }
+
+                    double mean = total / nx2;
+                    double std
+                        = sqrt(std::max(0.0, total_sqr / nx2 - mean * mean));
+
+                    // Includes the bias column
+                    if (std == 0.0)
+                        std = 1.0;
+
+                    double std_recip = 1.0 / std;
+                    for (size_t i = b;  i < e;  ++i)
+                        sparse_data.values[i] *= std_recip;
+
+                    stds[v] = std;
+                }
+            };
+
+        MLDB::parallelMapChunked(0, nv, 4096, doScale);
+    }
+
     cerr << "normalization: " << t.elapsed() << endl;
     t.restart();
 
@@ -392,7 +649,13 @@ train_weighted(Thread_Context & thread_context,
         //     << " w = " << w[l] << endl;
             
         distribution<double> trained
-            = perform_irls(correct[l], dense_data, w[l], link_function,
+            = sparse
+            ? perform_irls_sparse(correct[l], sparse_data, w[l],
+                                  link_function, regularization,
+                                  regularization_factor,
+                                  max_regularization_iteration,
+                                  regularization_epsilon)
+            : perform_irls(correct[l], dense_data, w[l], link_function,
                            regularization, regularization_factor, max_regularization_iteration, regularization_epsilon, 
                            condition);
 
@@ -426,6 +689,250 @@ train_weighted(Thread_Context & thread_context,
 }
 
 
+bool
+GLZ_Classifier_Generator::
+can_stream() const
+{
+    return !condition;
+}
+
+std::shared_ptr<Classifier_Impl>
+GLZ_Classifier_Generator::
+generate_streaming(Thread_Context & thread_context,
+                   const Example_Stream & data,
+                   const std::vector<Feature> & features) const
+{
+    if (!can_stream())
+        throw Exception("GLZ_Classifier_Generator::generate_streaming(): "
+                        "the condition option needs all of the training "
+                        "data at once");
+
+    GLZ_Classifier current(model);
+
+    train_streaming(thread_context, data, features, current);
+
+    return make_sp(current.make_copy());
+}
+
+void
+GLZ_Classifier_Generator::
+train_streaming(Thread_Context & thread_context,
+                const Example_Stream & data,
+                const std::vector<Feature> & unfiltered,
+                GLZ_Classifier & result) const
+{
+    /* Algorithm (the same as train_weighted(), but with a pass over the
+       stream instead of each use of the dense training data):
+       1.  Find out how each feature occurs, and the total weight;
+       2.  Find the mean and standard deviation of each variable;
+       3.  Run a streamed IRLS on each label.
+    */
+
+    result = model;
+    result.features.clear();
+    result.add_bias = add_bias;
+    result.link = (do_decode ? link_function : LINEAR);
+
+    Feature predicted = model.predicted();
+
+    Timer t;
+
+    Streamed_Feature_Stats stats(*data.feature_space(), unfiltered);
+    double total = 0.0;
+
+    auto onStatsBlock = [&] (const std::vector<Mutable_Feature_Set> & examples,
+                             const std::vector<float> & weights)
+        {
+            ExcAssertEqual(examples.size(), weights.size());
+            for (unsigned i = 0;  i < examples.size();  ++i) {
+                stats.add(examples[i]);
+                total += weights[i];
+            }
+        };
+
+    data.for_each_block(onStatsBlock);
+
+    add_variables(*this, thread_context, stats, *data.feature_space(),
+                  unfiltered, result);
+
+    size_t nl = result.label_count();        // Number of labels
+    bool regression_problem = (nl == 1);
+    size_t nv = result.features.size();      // Number of variables
+    if (add_bias) ++nv;
+
+    // Weights are normalized like in Classifier_Generator::generate()
+    if (abs(total) < 1e-10)
+        throw Exception("GLZ_Classifier_Generator::train_streaming(): "
+                        "zero or nearly zero example weights total");
+    float norm = 1.0 / (total * nl);
+
+    cerr << "stats: " << t.elapsed() << endl;
+    t.restart();
+
+    distribution<double> means(nv, 0.0), std_recips(nv, 1.0), stds(nv, 1.0);
+
+    typedef std::function<void (const boost::multi_array<double, 2> & x,
+                                const distribution<float> & labels,
+                                const distribution<double> & w)> On_Decoded;
+
+    // Decode each block of examples with a non-zero weight into its
+    // (normalized) variables, labels and weights
+    auto forEachDecoded = [&] (const On_Decoded & onDecoded)
+        {
+            auto onBlock = [&] (const std::vector<Mutable_Feature_Set> & examples,
+                                const std::vector<float> & weights)
+            {
+                std::vector<int> indexes;
+                indexes.reserve(examples.size());
+                for (unsigned i = 0;  i < examples.size();  ++i) {
+                    float w = weights[i] * norm;
+                    if ((weights[i] < 0.0) || weights[i] > 1e10)
+                        throw Exception("GLZ_Classifier_Generator::"
+                                        "train_streaming(): weight "
+                                        "out of range");
+                    if (w > 0.0)
+                        indexes.push_back(i);
+                }
+
+                size_t nb = indexes.size();
+                boost::multi_array<double, 2> x(boost::extents[nv][nb]);
+                distribution<float> labels(nb);
+                distribution<double> w(nb);
+
+                auto onIndex = [&] (int index)
+                {
+                    const Mutable_Feature_Set & example
+                        = examples[indexes[index]];
+
+                    distribution<float> decoded = result.decode(example);
+                    if (add_bias) decoded.push_back(1.0);
+
+                    assert(decoded.size() == nv);
+                    for (unsigned v = 0;  v < decoded.size();  ++v) {
+                        if (!isfinite(decoded[v])) decoded[v] = 0.0;
+                        x[v][index] = (decoded[v] - means[v]) * std_recips[v];
+                    }
+
+                    labels[index] = example.value(predicted);
+                    w[index] = float(weights[indexes[index]] * norm);
+                };
+
+                MLDB::parallelMap(0, nb, onIndex);
+
+                onDecoded(x, labels, w);
+            };
+
+            data.for_each_block(onBlock);
+        };
+
+    /* Scale */
+    if (normalize) {
+        distribution<double> totals(nv, 0.0), std_totals(nv, 0.0);
+        size_t nx2 = 0;
+
+        auto onTotals = [&] (const boost::multi_array<double, 2> & x,
+                             const distribution<float> &,
+                             const distribution<double> &)
+            {
+                size_t nb = x.shape()[1];
+                for (unsigned v = 0;  v < nv;  ++v)
+                    for (unsigned j = 0;  j < nb;  ++j)
+                        totals[v] += x[v][j];
+                nx2 += nb;
+            };
+
+        forEachDecoded(onTotals);
+
+        distribution<double> pending_means = totals / nx2;
+
+        auto onStds = [&] (const boost::multi_array<double, 2> & x,
+                           const distribution<float> &,
+                           const distribution<double> &)
+            {
+                size_t nb = x.shape()[1];
+                for (unsigned v = 0;  v < nv;  ++v)
+                    for (unsigned j = 0;  j < nb;  ++j)
+                        std_totals[v]
+                            += (x[v][j] - pending_means[v])
+                            *  (x[v][j] - pending_means[v]);
+            };
+
+        forEachDecoded(onStds);
+
+        for (unsigned v = 0;  v < nv;  ++v) {
+            double mean = pending_means[v];
+            double std = sqrt(std_totals[v] / nx2);
+
+            if (std == 0.0 && mean == 1.0) {
+                // bias column
+                std = 1.0;
+                mean = 0.0;
+            }
+            else if (std == 0.0)
+                std = 1.0;
+
+            means[v] = mean;
+            stds[v] = std;
+            std_recips[v] = 1.0 / std;
+        }
+    }
+
+    cerr << "normalization: " << t.elapsed() << endl;
+    t.restart();
+
+    int nlr = nl;
+    if (nl == 2) nlr = 1;
+
+    /* Perform a GLZ for each label. */
+    result.weights.clear();
+    double extra_bias = 0.0;
+    for (unsigned l = 0;  l < nlr;  ++l) {
+
+        auto stream = [&] (const IRLS_Block & onBlock)
+            {
+                auto onDecoded = [&] (const boost::multi_array<double, 2> & x,
+                                      const distribution<float> & labels,
+                                      const distribution<double> & w)
+                {
+                    distribution<double> correct(labels.size());
+                    for (unsigned j = 0;  j < labels.size();  ++j)
+                        correct[j] = regression_problem
+                            ? labels[j] : (double)(labels[j] == l);
+                    onBlock(x, correct, w);
+                };
+
+                forEachDecoded(onDecoded);
+            };
+
+        distribution<double> trained
+            = perform_irls_streaming(stream, nv, link_function,
+                                     regularization, regularization_factor,
+                                     max_regularization_iteration,
+                                     regularization_epsilon);
+
+        trained /= stds;
+
+        extra_bias = - (trained.dotprod(means));
+
+        if (extra_bias != 0.0) {
+            if (!add_bias)
+                throw Exception("extra bias but nowhere to put it");
+            trained.back() += extra_bias;
+        }
+
+        result.weights.push_back(trained.cast<float>());
+    }
+
+    cerr << "irls: " << t.elapsed() << endl;
+
+    if (nl == 2) {
+        // weights for second label are the mirror of those of the first
+        // label
+        result.weights.push_back(-1.0F * result.weights.front());
+    }
+}
+
+
 /*****************************************************************************/
 /* REGISTRATION                                                              */
 /*****************************************************************************/
@@ -60,6 +60,18 @@ public:
              float & Z,
              int) const override;
 
+    /** GLZs can stream, unless the condition option is set. */
+    virtual bool can_stream() const override;
+
+    /** Generate a classifier from a stream of examples.  This is the same
+        algorithm as generate(), with an IRLS that sums up what it needs
+        a block at a time; see perform_irls_streaming().
+    */
+    virtual std::shared_ptr<Classifier_Impl>
+    generate_streaming(Thread_Context & context,
+                       const Example_Stream & data,
+                       const std::vector<Feature> & features) const override;
+
     bool add_bias;          ///< Do we add and learn a bias term?
     bool do_decode;         ///< Do we run a decoder at all?
     bool normalize;         ///< Do we normalize the feature matrix beforehand?
@@ -68,6 +80,7 @@ public:
     int max_regularization_iteration; ///< Maximum number of iterations in regularization
     double regularization_epsilon; ///< Epsilon to use when looking for convergence in regularization
     bool condition;         ///< Do we condition the feature matrix beforehand?
+    float sparse_density;   ///< Below this proportion of non-zeros, use sparse IRLS
 
     Link_Function link_function;
     float feature_proportion;
@@ -82,6 +95,11 @@ public:
                          const boost::multi_array<float, 2> & weights,
                          const std::vector<Feature> & features,
                          GLZ_Classifier & result) const;
+
+    void train_streaming(Thread_Context & thread_context,
+                         const Example_Stream & data,
+                         const std::vector<Feature> & features,
+                         GLZ_Classifier & result) const;
 };
 
 
@@ -30,6 +30,7 @@ LIBBOOSTING_SOURCES := \
         weighted_training.cc \
         transformed_classifier.cc \
         stump_training.cc \
+        stump_training_device.cc \
         config_options.cc \
         stump_regress.cc \
         boosted_stumps_generator.cc \
@@ -47,6 +48,7 @@ LIBBOOSTING_SOURCES := \
         feature_transform.cc \
         transform_list.cc \
         committee.cc \
+        compiled_forest.cc \
         boosting_training.cc \
         null_classifier_generator.cc \
 	tree.cc \
@@ -57,7 +59,7 @@ LIBBOOSTING_SOURCES := \
 	label.cc \
 	buckets.cc
 
-LIBBOOSTING_LINK :=	utils db algebra arch judy boost_regex
+LIBBOOSTING_LINK :=	utils db algebra arch judy boost_regex dl
 
 #$(eval $(call set_compile_option,perceptron_generator.cc perceptron.cc,-ffast-math))
 
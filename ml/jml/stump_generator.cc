@@ -80,6 +80,7 @@ configure(const Configuration & config, vector<string> & unparsedKeys)
     config.findAndRemove(trace, "trace", unparsedKeys);
     config.findAndRemove(update_alg, "update_alg", unparsedKeys);
     config.findAndRemove(ignore_highest, "ignore_highest", unparsedKeys);
+    config.findAndRemove(device, "device", unparsedKeys);
 }
 
 void
@@ -92,6 +93,7 @@ defaults()
     trace = 0;
     update_alg = Stump::NORMAL;
     ignore_highest = 0.0;
+    device = TD_CPU;
 }
 
 Config_Options
@@ -108,6 +110,8 @@ options() const
              "select the harshness of the update algorithm")
         .add("ignore_highest", ignore_highest, "0.0<=N<1.0",
              "ignore the examples witht the highest N% of weights")
+        .add("device", device,
+             "device to train binary problems on: cpu, cuda or auto")
         .add("trace", trace, "0-",
              "trace training (very detailed) to given level");
 
@@ -490,6 +494,7 @@ train_all(Thread_Context & context,
             
             Accum accum(feature_space, fair, committee_size, update_alg, trace);
             Trainer trainer(trace);
+            trainer.device = get_stump_training_device(device);
             
             Trainer::Test_All_Job<Accum, LW_Array<const float>,
                                   distribution<float> >
@@ -503,6 +508,7 @@ train_all(Thread_Context & context,
             
             Accum accum(feature_space, fair, committee_size, update_alg);
             Trainer trainer;
+            trainer.device = get_stump_training_device(device);
 
             Trainer::Test_All_Job<Accum, LW_Array<const float>, distribution<float> >
                 job(features, data, model.predicted(), weights,
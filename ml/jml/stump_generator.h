@@ -14,6 +14,7 @@
 
 #include "classifier_generator.h"
 #include "stump.h"
+#include "stump_training_device.h"
 
 
 namespace ML {
@@ -75,6 +76,7 @@ public:
     int committee_size;
     Stump::Update update_alg;
     float feature_prop;
+    Training_Device device;
 
     /* Once init has been called, we clone our potential models from this
        one. */
@@ -18,6 +18,7 @@
 #include "mldb/jml/utils/pair_utils.h"
 #include "stump.h"
 #include "stump_training.h"
+#include "stump_training_device.h"
 #include "training_index.h"
 #include "mldb/jml/utils/guard.h"
 #include "mldb/ml/jml/thread_context.h"
@@ -54,6 +55,11 @@ struct LW_Array {
     MLDB_ALWAYS_INLINE T * operator [] (size_t i) const { return base + i * stride; }
 };
 
+inline const float * device_weights(const LW_Array<const float> & weights)
+{
+    return weights.stride == 1 ? weights.base : nullptr;
+}
+
 /*****************************************************************************/
 /* TRACING                                                                   */
 /*****************************************************************************/
@@ -173,6 +179,9 @@ struct Stump_Trainer {
 
     mutable Tracer tracer;  ///< Object to which we trace
 
+    /// Device to accumulate buckets on, or null for the CPU
+    std::shared_ptr<const Stump_Training_Device> device;
+
     /** This is an object used for example weights which acts as a vector
         of all 1s.  It specifies that each example counts for the same
         amount, without needing to use any memory.
@@ -1110,8 +1119,13 @@ struct Stump_Trainer {
             // to deal with that.
             nb = index.bucket_count();
             buckets.resize(nb, w_empty);
+
+            bool on_device
+                = device
+                && accumulate_on_device(*device, index, weights, ex_weights,
+                                        data.example_count(), buckets, w);
             
-            for (unsigned i = 0;  i < index.size();  ++i) {
+            for (unsigned i = 0;  !on_device && i < index.size();  ++i) {
                 int example = index[i].example();
 
                 if (ex_weights[example] == 0.0) continue;
@@ -4,20 +4,21 @@
    CUDA version of stump training code.
 */
 
-#include "arch/exception.h"
-#include "compiler/compiler.h"
+#include "mldb/arch/exception.h"
+#include "mldb/compiler/compiler.h"
 #include <cstdio>
 #include <iostream>
+#include <memory>
 #include <boost/timer.hpp>
 #include <boost/utility.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/shared_array.hpp>
 #include "stump_training_cuda.h"
 #include "fixed_point_accum.h"
-#include "arch/cuda/device_data.h"
-#include "arch/bit_range_ops.h"
-#include "arch/bitops.h"
-#include "math/xdiv.h"
+#include "mldb/arch/cuda/device_data.h"
+#include "mldb/arch/bit_range_ops.h"
+#include "mldb/arch/bitops.h"
+#include "mldb/jml/math/xdiv.h"
 #include "bit_compressed_index.h"
 
 using namespace std;
@@ -26,6 +27,8 @@ typedef ML::CUDA::Test_Buckets_Binsym::Float Float;
 typedef ML::CUDA::Test_Buckets_Binsym::TwoBuckets TwoBuckets;
 typedef ML::shift_t shift_t;
 
+static const bool debug = false;
+
 /** Execution kernel
 
     Parameters:
@@ -600,14 +603,14 @@ struct Test_Buckets_Binsym::Context {
             d_w_label.sync(w_label);
         }
 
-#if 1
+#if 0
         cerr << "final results: " << endl;
         for (unsigned i = 0;  i < 2 /*num_buckets*/;  ++i)
             cerr << "bucket " << i << ": 0: " << accum[i][0]
                  << "  1: " << accum[i][1] << endl;
-#endif
         cerr << "w_label: 0: " << w_label[0][0] << " 1: " << w_label[0][1]
              << endl;
+#endif
     }
 };
 
@@ -620,12 +623,14 @@ struct Test_Buckets_Binsym::Plan {
          uint32_t size,
          const float * weights,
          const float * ex_weights,
+         uint32_t num_examples,
          int num_buckets,
          bool on_device,
          bool compressed)
         : buckets(buckets), examples(examples), labels(labels),
           divisors(divisors), size(size), weights(weights),
-          ex_weights(ex_weights), num_buckets(num_buckets),
+          ex_weights(ex_weights), num_examples(num_examples),
+          num_buckets(num_buckets),
           on_device(on_device), compressed(compressed)
           
     {
@@ -650,8 +655,10 @@ struct Test_Buckets_Binsym::Plan {
         // How many of these thread blocks?
         grid = dim3( rudiv(size, threads.x * num_todo));
         
-        cerr << "num_todo = " << num_todo << endl;
-        cerr << "grid: x = " << grid.x << endl;
+        if (debug) {
+            cerr << "num_todo = " << num_todo << endl;
+            cerr << "grid: x = " << grid.x << endl;
+        }
         
         // If there aren't enough buckets, then create some more and merge
         // them together at the end.
@@ -664,9 +671,10 @@ struct Test_Buckets_Binsym::Plan {
             buckets_to_allocate = num_buckets * bucket_expansion;
         }
         
-        cerr << "num_buckets = " << num_buckets << " bucket_expansion = "
-             << bucket_expansion << " buckets_to_allocate = "
-             << buckets_to_allocate << endl;
+        if (debug)
+            cerr << "num_buckets = " << num_buckets << " bucket_expansion = "
+                 << bucket_expansion << " buckets_to_allocate = "
+                 << buckets_to_allocate << endl;
 
         // How much shared memory?
         //
@@ -679,7 +687,8 @@ struct Test_Buckets_Binsym::Plan {
         // parallelism.
         shared_mem_size = sizeof(TwoBuckets) * (buckets_to_allocate + 1);
         
-        cerr << "shared_mem_size = " << shared_mem_size << endl;
+        if (debug)
+            cerr << "shared_mem_size = " << shared_mem_size << endl;
         
         if (compressed) {
             d_compressed_index.init(compressed_index.data.get(),
@@ -692,8 +701,9 @@ struct Test_Buckets_Binsym::Plan {
             d_divisors.init(divisors, size);
         }
 
-        d_weights.init(weights, size);
-        d_ex_weights.init(ex_weights, size);
+        // Indexed by example number, not by index entry
+        d_weights.init(weights, num_examples);
+        d_ex_weights.init(ex_weights, num_examples);
 
         // set texture parameters
         cudaError_t err;
@@ -724,6 +734,7 @@ struct Test_Buckets_Binsym::Plan {
     uint32_t size;
     const float * weights;
     const float * ex_weights;
+    uint32_t num_examples;
     int num_buckets;
     bool on_device;
     bool compressed;
@@ -748,11 +759,11 @@ struct Test_Buckets_Binsym::Plan {
 
     bool use_texture;
 
-    boost::shared_ptr<Context>
+    std::shared_ptr<Context>
     executeHost(TwoBuckets * accum,
                 TwoBuckets & w_label) const
     {
-        boost::shared_ptr<Context> result(new Context());
+        std::shared_ptr<Context> result(new Context());
         //result->plan = this;
 
         // Get the data structures
@@ -779,11 +790,11 @@ struct Test_Buckets_Binsym::Plan {
         return result;
     }
 
-    boost::shared_ptr<Context>
+    std::shared_ptr<Context>
     executeDevice(TwoBuckets * accum,
                   TwoBuckets & w_label) const
     {
-        boost::shared_ptr<Context> result(new Context());
+        std::shared_ptr<Context> result(new Context());
         //result->plan = this;
 
         // Get the data structures
@@ -821,7 +832,7 @@ struct Test_Buckets_Binsym::Plan {
         return result;
     }
 
-    boost::shared_ptr<Context>
+    std::shared_ptr<Context>
     execute(TwoBuckets * accum,
             TwoBuckets & w_label) const
     {
@@ -836,7 +847,7 @@ struct Test_Buckets_Binsym::Plan {
     }
 };
 
-boost::shared_ptr<Test_Buckets_Binsym::Plan>
+std::shared_ptr<Test_Buckets_Binsym::Plan>
 Test_Buckets_Binsym::
 plan(const uint16_t * buckets,
      const uint32_t * examples, // or 0 if example num == i
@@ -845,16 +856,18 @@ plan(const uint16_t * buckets,
      uint32_t size,
      const float * weights,
      const float * ex_weights,
+     uint32_t num_examples,
      int num_buckets,
      bool on_device,
      bool compressed) const
 {
-    return boost::shared_ptr<Test_Buckets_Binsym::Plan>
+    return std::shared_ptr<Test_Buckets_Binsym::Plan>
         (new Plan(buckets, examples, labels, divisors, size, weights,
-                  ex_weights, num_buckets, on_device, compressed));
+                  ex_weights, num_examples, num_buckets, on_device,
+                  compressed));
 }
 
-boost::shared_ptr<Test_Buckets_Binsym::Context>
+std::shared_ptr<Test_Buckets_Binsym::Context>
 Test_Buckets_Binsym::
 execute(const Plan & plan,
         TwoBuckets * accum,
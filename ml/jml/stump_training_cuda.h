@@ -13,6 +13,8 @@
 #define __jml__stump_training_cuda_h__
 
 #include "fixed_point_accum.h"
+#include <memory>
+#include <stdint.h>
 
 namespace ML {
 namespace CUDA {
@@ -38,6 +40,7 @@ struct Test_Buckets_Binsym {
          uint32_t size,
          const float * weights,
          const float * ex_weights,
+         uint32_t num_examples,  // number of weights and ex_weights
          int num_buckets,
          bool on_device,
          bool compressed) const;
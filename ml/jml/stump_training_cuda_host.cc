@@ -7,8 +7,12 @@
 */
 
 #include "stump_training_cuda.h"
+#include "stump_training_device.h"
 #include "mldb/arch/bit_range_ops.h"
 #include "mldb/arch/tick_counter.h"
+#include <cuda_runtime.h>
+#include <iostream>
+#include <mutex>
 
 typedef ML::CUDA::Test_Buckets_Binsym::Float Float;
 typedef ML::CUDA::Test_Buckets_Binsym::TwoBuckets TwoBuckets;
@@ -87,5 +91,77 @@ void executeHost(TwoBuckets * accum,
     }
 }
 
+
+
+/*****************************************************************************/
+/* CUDA_STUMP_TRAINING_DEVICE                                                */
+/*****************************************************************************/
+
+/** Runs the bucket accumulation of stump training on the CUDA device,
+    using Test_Buckets_Binsym.
+*/
+
+struct CUDA_Stump_Training_Device : public Stump_Training_Device {
+
+    /** The kernels read the weights through global textures, so only one
+        accumulation can be running at once. */
+    mutable std::mutex lock;
+
+    virtual std::string name() const
+    {
+        return "cuda";
+    }
+
+    virtual bool accumulate_binsym(const Joint_Index & index,
+                                   const float * weights,
+                                   const float * ex_weights,
+                                   size_t num_examples,
+                                   int num_buckets,
+                                   TwoBuckets * accum,
+                                   TwoBuckets & w_label) const
+    {
+        // The buckets are accumulated in 16kb of shared memory, along with
+        // the label totals
+        if (num_buckets >= 1024 || index.empty())
+            return false;
+
+        try {
+            std::unique_lock<std::mutex> guard(lock);
+
+            Test_Buckets_Binsym tester;
+            auto plan = tester.plan(index.buckets(), index.examples(),
+                                    index.labels_as_int(), index.divisors(),
+                                    index.size(), weights, ex_weights,
+                                    num_examples, num_buckets,
+                                    true /* on device */,
+                                    false /* compressed */);
+            auto context = tester.execute(*plan, accum, w_label);
+            tester.synchronize(*context);
+            return true;
+        } catch (const std::exception & exc) {
+            std::cerr << "warning: CUDA stump training failed; training on "
+                      << "the CPU instead: " << exc.what() << std::endl;
+            return false;
+        }
+    }
+};
+
+namespace {
+
+/** Make the device available when this library is loaded, if there is a
+    CUDA device to run on. */
+struct Register_CUDA_Device {
+    Register_CUDA_Device()
+    {
+        int count = 0;
+        if (cudaGetDeviceCount(&count) != cudaSuccess || count == 0)
+            return;
+        register_stump_training_device
+            (std::make_shared<CUDA_Stump_Training_Device>());
+    }
+} register_cuda_device;
+
+} // file scope
+
 } // namespace CUDA
 } // namespace ML
@@ -0,0 +1,92 @@
+/* stump_training_device.cc
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Registry of the devices that stumps can be trained on.
+*/
+
+#include "stump_training_device.h"
+#include <dlfcn.h>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* STUMP_TRAINING_DEVICE                                                     */
+/*****************************************************************************/
+
+namespace {
+
+std::mutex devices_lock;
+std::map<std::string, std::shared_ptr<const Stump_Training_Device> > devices;
+
+std::once_flag cuda_loaded;
+std::string cuda_error;
+
+/** Load the CUDA training library, which registers its device when it's
+    loaded if there is a CUDA device to run on.  It's never unloaded, since
+    the device it registers lives in it.
+*/
+void load_cuda()
+{
+    void * handle = dlopen("libboosting_cuda.so", RTLD_NOW | RTLD_GLOBAL);
+    if (!handle)
+        cuda_error = dlerror();
+}
+
+} // file scope
+
+void register_stump_training_device(std::shared_ptr<const Stump_Training_Device> device)
+{
+    std::unique_lock<std::mutex> guard(devices_lock);
+    devices[device->name()] = std::move(device);
+}
+
+std::shared_ptr<const Stump_Training_Device>
+get_stump_training_device(Training_Device device)
+{
+    if (device == TD_CPU)
+        return nullptr;
+
+    std::call_once(cuda_loaded, load_cuda);
+
+    {
+        std::unique_lock<std::mutex> guard(devices_lock);
+        auto it = devices.find("cuda");
+        if (it != devices.end())
+            return it->second;
+    }
+
+    if (device == TD_CUDA) {
+        static std::atomic<bool> warned(false);
+        if (!warned.exchange(true)) {
+            cerr << "warning: no CUDA device for stump training; training "
+                 << "on the CPU instead";
+            if (!cuda_error.empty())
+                cerr << " (" << cuda_error << ")";
+            cerr << endl;
+        }
+    }
+
+    return nullptr;
+}
+
+const Enum_Opt<ML::Training_Device>
+Enum_Info<ML::Training_Device>::OPT[3] = {
+    { "cpu",      ML::TD_CPU   },
+    { "cuda",     ML::TD_CUDA  },
+    { "auto",     ML::TD_AUTO  } };
+
+const char * Enum_Info<ML::Training_Device>::NAME
+   = "Training_Device";
+
+} // namespace ML
@@ -0,0 +1,154 @@
+/* stump_training_device.h                                         -*- C++ -*-
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Devices other than the CPU, such as GPUs, that can do the bucket
+   accumulation of stump training.
+*/
+
+#pragma once
+
+#include "stump_training_bin.h"
+#include "training_index_iterators.h"
+#include "mldb/jml/stats/distribution.h"
+#include "mldb/jml/utils/enum_info.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace ML {
+
+
+/** Which device to train stumps and decision trees on.  This is passed
+    under the key "device" in the training params. */
+enum Training_Device {
+    TD_CPU,    ///< Always train on the CPU
+    TD_CUDA,   ///< Train on a CUDA device, warning if there isn't one
+    TD_AUTO    ///< Train on a CUDA device if there is one
+};
+
+
+/*****************************************************************************/
+/* STUMP_TRAINING_DEVICE                                                     */
+/*****************************************************************************/
+
+/** A device that accumulates the weight in each bucket of a real feature,
+    which is the inner loop of stump training.  Only binary symmetric
+    problems are offloaded; everything else stays on the CPU.
+*/
+
+struct Stump_Training_Device {
+    virtual ~Stump_Training_Device()
+    {
+    }
+
+    typedef FixedPointAccum64 TwoBuckets[2];
+
+    /** Name of the device, under which it's registered. */
+    virtual std::string name() const = 0;
+
+    /** For each entry of the index, add weights[example] *
+        ex_weights[example] * divisor to accum[bucket][label] and to
+        w_label[label].  Both weight arrays have num_examples entries.
+
+        Returns false if the device can't do it, in which case nothing is
+        accumulated and the caller does it on the CPU instead.  May be
+        called from several threads at once.
+    */
+    virtual bool accumulate_binsym(const Joint_Index & index,
+                                   const float * weights,
+                                   const float * ex_weights,
+                                   size_t num_examples,
+                                   int num_buckets,
+                                   TwoBuckets * accum,
+                                   TwoBuckets & w_label) const = 0;
+};
+
+/** Make the given device available for training.  This is done when the
+    library implementing it is loaded.
+*/
+void register_stump_training_device(std::shared_ptr<const Stump_Training_Device> device);
+
+/** Return the device to train on, or null to train on the CPU.  The first
+    time a CUDA device is asked for, the CUDA library is loaded if it's
+    there; if it isn't, or there is no CUDA device, training falls back
+    to the CPU.
+*/
+std::shared_ptr<const Stump_Training_Device>
+get_stump_training_device(Training_Device device);
+
+
+/*****************************************************************************/
+/* DEVICE ACCUMULATION                                                       */
+/*****************************************************************************/
+
+/** Pointer to the weights as one float per example, or null if they
+    aren't stored like that; overloaded for each weights type that can be.
+*/
+template<class Weights>
+const float * device_weights(const Weights & weights)
+{
+    return nullptr;
+}
+
+inline const float * device_weights(const distribution<float> & weights)
+{
+    return weights.data();
+}
+
+/** Accumulate the buckets of a real feature on the device, returning
+    false if they need to be accumulated on the CPU instead.  Only the
+    binary symmetric overload below does anything.
+*/
+template<class W, class Weights, class ExampleWeights>
+bool accumulate_on_device(const Stump_Training_Device & device,
+                          const Joint_Index & index,
+                          const Weights & weights,
+                          const ExampleWeights & ex_weights,
+                          size_t num_examples,
+                          std::vector<W> & buckets,
+                          W & w)
+{
+    return false;
+}
+
+template<class Weights, class ExampleWeights>
+bool accumulate_on_device(const Stump_Training_Device & device,
+                          const Joint_Index & index,
+                          const Weights & weights,
+                          const ExampleWeights & ex_weights,
+                          size_t num_examples,
+                          std::vector<W_binsym> & buckets,
+                          W_binsym & w)
+{
+    typedef Stump_Training_Device::TwoBuckets TwoBuckets;
+
+    const float * w_data = device_weights(weights);
+    const float * ex_data = device_weights(ex_weights);
+    if (!w_data || !ex_data)
+        return false;
+
+    int nb = buckets.size();
+    std::unique_ptr<TwoBuckets[]> accum(new TwoBuckets[nb]);
+    TwoBuckets w_label;
+
+    if (!device.accumulate_binsym(index, w_data, ex_data, num_examples, nb,
+                                  accum.get(), w_label))
+        return false;
+
+    // Same as W_binsymT::add() and transfer(), which index by !label
+    for (unsigned l = 0;  l < 2;  ++l) {
+        for (int b = 0;  b < nb;  ++b)
+            buckets[b](0, true, !l) += accum[b][l];
+        w(0, MISSING, !l) -= w_label[l];
+        w(0, true, !l) += w_label[l];
+    }
+
+    return true;
+}
+
+} // namespace ML
+
+DECLARE_ENUM_INFO(ML::Training_Device, 3);
@@ -0,0 +1,185 @@
+/** compiled_forest_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test that compiled forests predict the same as the classifiers they came
+    from.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "mldb/ml/jml/compiled_forest.h"
+#include "mldb/ml/jml/committee.h"
+#include "mldb/ml/jml/null_classifier.h"
+#include "mldb/ml/jml/decision_tree_generator.h"
+#include "mldb/ml/jml/training_data.h"
+#include "mldb/ml/jml/dense_features.h"
+#include "mldb/ml/jml/feature_info.h"
+#include "mldb/jml/utils/smart_ptr_utils.h"
+
+using namespace ML;
+using namespace std;
+
+BOOST_AUTO_TEST_CASE( test_compiled_forest_matches_committee )
+{
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    fs.add_feature("feature1", REAL);
+    fs.add_feature("feature2", REAL);
+    fs.add_feature("feature3", REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+    Feature label = fs.features()[0];
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+    Training_Data data(fsp);
+    int nfv = 2000;
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        float f1 = uniform(rng), f2 = uniform(rng), f3 = uniform(rng);
+        distribution<float> features;
+        features.push_back(f1 > f2 || uniform(rng) < 0.1);
+        features.push_back(f1);
+        features.push_back(f2);
+        features.push_back(f3);
+        data.add_example(fs.encode(features));
+    }
+
+    Configuration config;
+    config.parse_string("trace=0\nmax_depth=6\n", "inbuilt config file");
+
+    Decision_Tree_Generator generator;
+    vector<string> unparsedKeys;
+    generator.configure(config, unparsedKeys);
+    generator.init(fsp, label);
+
+    vector<Feature> features = fs.features();
+    features.erase(features.begin(), features.begin() + 1);
+
+    Thread_Context context;
+
+    // Bag some trees, with an inner committee to check that weights and
+    // biases are combined the same way
+    auto trainTree = [&] ()
+        {
+            distribution<float> weights(nfv);
+            for (auto & w: weights)
+                w = uniform(rng) < 0.6;
+            return generator.generate(context, data, weights, features);
+        };
+
+    auto inner = std::make_shared<Committee>(fsp, label);
+    inner->add(trainTree(), 0.5);
+    inner->add(trainTree(), 0.25);
+    inner->bias[1] = 0.125;
+
+    Committee forest(fsp, label);
+    for (unsigned i = 0;  i < 5;  ++i)
+        forest.add(trainTree(), 1.0 / 6);
+    forest.add(inner, 0.75);
+    forest.add(trainTree(), 0.0);
+    forest.bias[0] = 0.0625;
+
+    // The dense vectors have the features in a different order, with one
+    // that isn't used
+    vector<Feature> dense = { features[2], fs.features()[0], features[0],
+                              features[1] };
+
+    Optimization_Info info = forest.optimize(dense);
+    auto compiled = Compiled_Forest::compile(forest, dense);
+    BOOST_REQUIRE(compiled);
+    BOOST_CHECK_EQUAL(compiled->label_count(), 2);
+    BOOST_CHECK_EQUAL(compiled->feature_count(), 4);
+    BOOST_CHECK_EQUAL(compiled->tree_count(), 9);
+
+    size_t nrows = 500;
+    size_t stride = 5;
+    vector<float> rows(nrows * stride);
+    for (auto & v: rows)
+        v = uniform(rng) < 0.1 ? NAN : uniform(rng);
+
+    vector<double> batch(nrows * 2);
+    compiled->predict_batch(rows.data(), nrows, stride, batch.data());
+
+    // Optimizing compiles the forest, which the batch predict then uses
+    BOOST_REQUIRE(info.compiled);
+    vector<float> classifierBatch(nrows * 2);
+    forest.predict_batch(rows.data(), nrows, stride, info,
+                         classifierBatch.data());
+
+    for (size_t i = 0;  i < nrows;  ++i) {
+        const float * row = &rows[i * stride];
+        Label_Dist expected = forest.predict(row, info);
+
+        double output[2];
+        compiled->predict(row, output);
+
+        for (unsigned l = 0;  l < 2;  ++l) {
+            BOOST_CHECK_EQUAL((float)output[l], expected[l]);
+            BOOST_CHECK_EQUAL(batch[i * 2 + l], output[l]);
+            BOOST_CHECK_EQUAL(classifierBatch[i * 2 + l], expected[l]);
+            BOOST_CHECK_CLOSE(output[l], forest.predict(l, row, info), 1e-3);
+        }
+    }
+
+    // A tree on its own works too
+    auto tree = trainTree();
+    Optimization_Info treeInfo = tree->optimize(dense);
+    auto compiledTree = Compiled_Forest::compile(*tree, dense);
+    BOOST_REQUIRE(compiledTree);
+    for (size_t i = 0;  i < nrows;  ++i) {
+        const float * row = &rows[i * stride];
+        Label_Dist expected = tree->predict(row, treeInfo);
+        double output[2];
+        compiledTree->predict(row, output);
+        BOOST_CHECK_EQUAL((float)output[0], expected[0]);
+        BOOST_CHECK_EQUAL((float)output[1], expected[1]);
+    }
+
+    // Explanations give the same bias and the same contribution for each
+    // feature as those of the committee, which leave out its biases
+    BOOST_REQUIRE(compiled->can_explain());
+    vector<int> labels(nrows);
+    for (size_t i = 0;  i < nrows;  ++i)
+        labels[i] = i % 2;
+    vector<double> bias(nrows), contributions(nrows * 4);
+    std::unique_ptr<bool[]> used(new bool[nrows * 4]);
+    compiled->explain_batch(rows.data(), nrows, stride, labels.data(),
+                            bias.data(), contributions.data(), used.get());
+
+    for (size_t i = 0;  i < nrows;  ++i) {
+        const float * row = &rows[i * stride];
+        Mutable_Feature_Set fset;
+        for (unsigned f = 0;  f < 4;  ++f) {
+            if (!std::isnan(row[f]))
+                fset.add(dense[f], row[f]);
+        }
+        fset.sort();
+
+        Explanation expected = forest.explain(fset, labels[i]);
+        BOOST_CHECK_SMALL(bias[i] - expected.bias, 1e-5);
+        for (unsigned f = 0;  f < 4;  ++f) {
+            auto it = expected.feature_weights.find(dense[f]);
+            BOOST_CHECK_EQUAL(used[i * 4 + f],
+                              it != expected.feature_weights.end());
+            double weight = it == expected.feature_weights.end()
+                ? 0.0 : it->second;
+            BOOST_CHECK_SMALL(contributions[i * 4 + f] - weight, 1e-5);
+        }
+    }
+
+    // Features that aren't given, or classifiers other than trees, can't be
+    // compiled
+    BOOST_CHECK(!Compiled_Forest::compile(forest, { features[0] }));
+    Null_Classifier null(fsp, label);
+    BOOST_CHECK(!Compiled_Forest::compile(null, dense));
+}
@@ -17,6 +17,7 @@
 #include <vector>
 #include <stdint.h>
 #include <iostream>
+#include <random>
 
 #include "mldb/ml/jml/glz_classifier_generator.h"
 #include "mldb/ml/jml/training_data.h"
@@ -278,3 +279,293 @@ BOOST_AUTO_TEST_CASE( test_decode_value )
         //BOOST_CHECK_THROW(do_decode(NaN, VALUE), Exception);
     }
 }
+
+BOOST_AUTO_TEST_CASE( test_glz_classifier_predict_batch )
+{
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    fs.add_feature("feature1", REAL);
+    fs.add_feature("feature2", REAL);
+    fs.add_feature("feature3", REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+
+    Training_Data data(fsp);
+
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        distribution<float> features;
+        features.push_back(i % 3 == 0);
+        features.push_back(i % 3 == 0 ? 1.0 + (i % 7) * 0.1 : -(i % 11) * 0.1);
+        features.push_back((i % 5) * 0.25);
+        features.push_back((i % 13) * 0.5 - 3.0);
+        data.add_example(fs.encode(features));
+    }
+
+    Configuration config;
+    config.parse_string("verbosity=0\n", "inbuilt config file");
+
+    GLZ_Classifier_Generator generator;
+    vector<string> unparsedKeys;
+    generator.configure(config, unparsedKeys);
+    generator.init(fsp, fs.features()[0]);
+
+    distribution<float> training_weights(nfv, 1);
+
+    vector<Feature> features = fs.features();
+    features.erase(features.begin(), features.begin() + 1);
+
+    Thread_Context context;
+
+    std::shared_ptr<Classifier_Impl> classifier
+        = generator.generate(context, data, training_weights, features);
+
+    // Rows have the features in a different order, and a padding column,
+    // so that the batch needs to map them back to the right variables
+    vector<Feature> dense = { features[2], features[0], features[1] };
+    Optimization_Info info = classifier->optimize(dense);
+    BOOST_REQUIRE(info);
+    BOOST_CHECK(!info.compiled);
+
+    size_t nrows = 150;
+    size_t stride = 4;
+    vector<float> rows(nrows * stride);
+    for (size_t i = 0;  i < rows.size();  ++i)
+        rows[i] = (i % 4 == 3) ? 1000.0 : ((i * 7919) % 100) * 0.02 - 1.0;
+
+    vector<float> batch(nrows * 2);
+    classifier->predict_batch(rows.data(), nrows, stride, info, batch.data());
+
+    for (size_t i = 0;  i < nrows;  ++i) {
+        Label_Dist expected = classifier->predict(&rows[i * stride], info);
+        BOOST_REQUIRE_EQUAL(expected.size(), 2);
+        BOOST_CHECK_CLOSE(batch[i * 2], expected[0], 1e-3);
+        BOOST_CHECK_CLOSE(batch[i * 2 + 1], expected[1], 1e-3);
+    }
+}
+
+namespace {
+
+/** Stream of the examples of a Training_Data, in blocks of the given
+    size, to check that streamed training gives the same as the index.
+*/
+struct Test_Example_Stream : public Example_Stream {
+    Test_Example_Stream(const Training_Data & data,
+                        const distribution<float> & weights,
+                        size_t block_size)
+        : data(data), weights(weights), block_size(block_size)
+    {
+    }
+
+    const Training_Data & data;
+    distribution<float> weights;
+    size_t block_size;
+
+    virtual std::shared_ptr<const Feature_Space> feature_space() const
+    {
+        return data.feature_space();
+    }
+
+    virtual void for_each_block(const On_Block & on_block) const
+    {
+        for (size_t first = 0;  first < data.example_count();
+             first += block_size) {
+            size_t last = std::min(first + block_size, data.example_count());
+            std::vector<Mutable_Feature_Set> examples(last - first);
+            std::vector<float> block_weights(last - first);
+            for (size_t x = first;  x < last;  ++x) {
+                for (auto it = data[x].begin(), end = data[x].end();
+                     it != end;  ++it)
+                    examples[x - first].add((*it).first, (*it).second);
+                examples[x - first].sort();
+                block_weights[x - first] = weights[x];
+            }
+            on_block(examples, block_weights);
+        }
+    }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_glz_classifier_streaming )
+{
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    fs.add_feature("feature1", REAL);
+    fs.add_feature("feature2", REAL);
+    fs.add_feature("feature3", REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+
+    Training_Data data(fsp);
+
+    float NaN = std::numeric_limits<float>::quiet_NaN();
+
+    // Noisy labels so that the model doesn't separate them perfectly, and
+    // a feature that is sometimes missing
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        distribution<float> features;
+        bool label = (i % 3 == 0) != (i % 17 == 0);
+        features.push_back(label);
+        features.push_back((i % 3 == 0) * 0.5 + (i % 7) * 0.1);
+        features.push_back(i % 4 == 0 ? NaN : (i % 5) * 0.25);
+        features.push_back((i % 13) * 0.5 - 3.0);
+        data.add_example(fs.encode(features));
+    }
+
+    distribution<float> training_weights(nfv);
+    for (unsigned i = 0;  i < nfv;  ++i)
+        training_weights[i] = 1 + i % 3;
+
+    vector<Feature> features = fs.features();
+    features.erase(features.begin(), features.begin() + 1);
+
+    for (string link: { "logit", "linear" }) {
+        cerr << "link " << link << endl;
+
+        Configuration config;
+        config.parse_string("verbosity=0\nlink_function=" + link + "\n",
+                            "inbuilt config file");
+
+        GLZ_Classifier_Generator generator;
+        vector<string> unparsedKeys;
+        generator.configure(config, unparsedKeys);
+        generator.init(fsp, fs.features()[0]);
+        BOOST_CHECK(generator.can_stream());
+
+        Thread_Context context;
+        auto expected = std::dynamic_pointer_cast<GLZ_Classifier>
+            (generator.generate(context, data, training_weights, features));
+
+        Test_Example_Stream stream(data, training_weights, 77);
+        auto streamed = std::dynamic_pointer_cast<GLZ_Classifier>
+            (generator.generate_streaming(context, stream, features));
+
+        BOOST_REQUIRE(expected);
+        BOOST_REQUIRE(streamed);
+        BOOST_REQUIRE_EQUAL(streamed->features.size(),
+                            expected->features.size());
+        BOOST_REQUIRE_EQUAL(streamed->weights.size(),
+                            expected->weights.size());
+
+        for (unsigned l = 0;  l < expected->weights.size();  ++l) {
+            BOOST_REQUIRE_EQUAL(streamed->weights[l].size(),
+                                expected->weights[l].size());
+            for (unsigned v = 0;  v < expected->weights[l].size();  ++v)
+                BOOST_CHECK_CLOSE(streamed->weights[l][v],
+                                  expected->weights[l][v], 1e-2);
+        }
+    }
+
+    // Conditioning needs the whole matrix
+    Configuration config;
+    config.parse_string("verbosity=0\ncondition=true\n", "inbuilt config file");
+    GLZ_Classifier_Generator generator;
+    vector<string> unparsedKeys;
+    generator.configure(config, unparsedKeys);
+    generator.init(fsp, fs.features()[0]);
+    BOOST_CHECK(!generator.can_stream());
+}
+
+BOOST_AUTO_TEST_CASE( test_glz_classifier_sparse )
+{
+    // Many features of which each example has only a few non-zero, so
+    // that the sparse solver is selected
+    int nf = 40;
+
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    for (unsigned f = 0;  f < nf;  ++f)
+        fs.add_feature(MLDB::format("feature%d", f), REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+
+    Training_Data data(fsp);
+
+    // Only the first 10 features have anything to do with the label, and
+    // the labels are drawn so that they aren't separable
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> pick(0, nf - 1);
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        distribution<float> features(nf + 1, 0.0);
+        float score = -1.0;
+        for (unsigned k = 0;  k < 3;  ++k) {
+            int f = pick(rng);
+            features[f + 1] = 0.5 + uniform(rng);
+            if (f < 10)
+                score += (f % 2 ? 2.0 : -2.0) * features[f + 1];
+        }
+        features[0] = uniform(rng) < 1.0 / (1.0 + exp(-score));
+        data.add_example(fs.encode(features));
+    }
+
+    distribution<float> training_weights(nfv, 1);
+
+    vector<Feature> features = fs.features();
+    features.erase(features.begin(), features.begin() + 1);
+
+    auto train = [&] (const std::string & options)
+        {
+            Configuration config;
+            config.parse_string("verbosity=0\nnormalize=false\n" + options,
+                                "inbuilt config file");
+
+            GLZ_Classifier_Generator generator;
+            vector<string> unparsedKeys;
+            generator.configure(config, unparsedKeys);
+            generator.init(fsp, fs.features()[0]);
+
+            Thread_Context context;
+            auto result = std::dynamic_pointer_cast<GLZ_Classifier>
+                (generator.generate(context, data, training_weights,
+                                    features));
+            BOOST_REQUIRE(result);
+            return result;
+        };
+
+    auto logLikelihood = [&] (const GLZ_Classifier & glz)
+        {
+            double result = 0.0;
+            for (unsigned x = 0;  x < nfv;  ++x) {
+                int label = data[x][fs.features()[0]];
+                result += log(std::max(1e-9f, glz.predict(data[x], 0)[label]));
+            }
+            return result;
+        };
+
+    // For least squares, the solution is unique and both solvers find it
+    auto dense = train("link_function=linear\nsparse_density=0\n");
+    auto sparse = train("link_function=linear\nsparse_density=0.5\n");
+
+    BOOST_REQUIRE_EQUAL(sparse->features.size(), dense->features.size());
+
+    for (unsigned x = 0;  x < nfv;  ++x) {
+        Label_Dist expected = dense->predict(data[x], 0);
+        Label_Dist found = sparse->predict(data[x], 0);
+        BOOST_REQUIRE_EQUAL(found.size(), expected.size());
+        for (unsigned l = 0;  l < expected.size();  ++l)
+            BOOST_CHECK_LT(fabs(found[l] - expected[l]), 0.02);
+    }
+
+    // For the logit the dense solver stops a little short of the maximum
+    // likelihood, so the sparse one should fit at least as well
+    dense = train("sparse_density=0\n");
+    sparse = train("sparse_density=0.5\n");
+
+    BOOST_CHECK_GE(logLikelihood(*sparse), logLikelihood(*dense) - 1.0);
+    BOOST_CHECK_GE(sparse->accuracy(data).first,
+                   dense->accuracy(data).first - 0.01);
+
+    // An L1 regularization keeps most of the weights of the features that
+    // have nothing to do with the label at zero
+    auto l1 = train("sparse_density=0.5\nregularization=l1\n"
+                    "regularization_factor=0.005\n");
+
+    int num_zero = 0;
+    for (unsigned f = 10;  f < nf;  ++f)
+        num_zero += (l1->weights[0][f] == 0.0);
+
+    BOOST_CHECK_GE(num_zero, 20);
+    BOOST_CHECK_GT(l1->accuracy(data).first, 0.75);
+}
@@ -82,6 +82,7 @@ void run_test(const uint16_t * buckets,
                       size,
                       weights,
                       ex_weights,
+                      size /* num examples */,
                       num_buckets,
                       on_device,
                       compressed);
@@ -0,0 +1,95 @@
+/* stump_training_device_bench.cc
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Compare training boosted stumps and decision trees on the CPU and on a
+   CUDA device, using the letters dataset.
+*/
+
+#include "mldb/ml/jml/dense_features.h"
+#include "mldb/ml/jml/training_data.h"
+#include "mldb/ml/jml/feature_info.h"
+#include "mldb/ml/jml/boosted_stumps_generator.h"
+#include "mldb/ml/jml/decision_tree_generator.h"
+#include "mldb/ml/jml/stump_training_device.h"
+#include "mldb/arch/timers.h"
+#include <iostream>
+
+using namespace std;
+using namespace ML;
+
+/** Train with the given generator on each device in turn, and print how
+    long it took and how accurate the result is. */
+void bench(const std::string & name,
+           Classifier_Generator & generator,
+           const std::string & config_str,
+           const Training_Data & data,
+           Feature label,
+           const std::vector<Feature> & features)
+{
+    for (Training_Device device: { TD_CPU, TD_CUDA }) {
+        Configuration config;
+        config.parse_string(config_str + "\ndevice="
+                            + enum_value(device) + "\n",
+                            "bench config");
+        vector<string> unparsedKeys;
+        generator.configure(config, unparsedKeys);
+        generator.init(data.feature_space(), label);
+
+        Thread_Context context;
+        Timer timer;
+        auto classifier = generator.generate(context, data, data, features);
+        double elapsed = timer.elapsed_wall();
+
+        cout << name << " on " << enum_value(device) << ": "
+             << elapsed << "s, training accuracy "
+             << classifier->accuracy(data).first << endl;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    string filename = argc > 1 ? argv[1] : "mldb/jml/letters.dat.gz";
+
+    auto letters_fs = std::make_shared<Dense_Feature_Space>();
+    Dense_Training_Data letters;
+    letters.init(filename, letters_fs);
+
+    vector<Feature> letters_features = letters_fs->features();
+    Feature letters_label = letters_features.at(0);
+
+    // Only binary problems are trained on the device, so tell the first
+    // half of the alphabet from the second
+    auto fs = std::make_shared<Dense_Feature_Space>();
+    fs->add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    for (unsigned i = 1;  i < letters_features.size();  ++i)
+        fs->add_feature(letters_fs->print(letters_features[i]), REAL);
+
+    Training_Data data(fs);
+    for (unsigned x = 0;  x < letters.example_count();  ++x) {
+        distribution<float> values;
+        values.push_back(letters[x].value(letters_label) < 13);
+        for (unsigned i = 1;  i < letters_features.size();  ++i)
+            values.push_back(letters[x].value(letters_features[i]));
+        data.add_example(fs->encode(values));
+    }
+
+    vector<Feature> features = fs->features();
+    Feature label = features[0];
+    features.erase(features.begin());
+
+    if (!get_stump_training_device(TD_AUTO))
+        cout << "no CUDA device: both runs are on the CPU" << endl;
+
+    cout << data.example_count() << " examples, " << features.size()
+         << " features" << endl;
+
+    Boosted_Stumps_Generator boosted_stumps;
+    bench("boosted_stumps", boosted_stumps, "max_iter=200\nmin_iter=200",
+          data, label, features);
+
+    Decision_Tree_Generator decision_tree;
+    bench("decision_tree", decision_tree, "max_depth=12",
+          data, label, features);
+}
@@ -0,0 +1,161 @@
+/** stump_training_device_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test that stumps and decision trees trained with the bucket accumulation
+    done by a device are the same as those trained on the CPU.  The device
+    here runs on the host, so that no GPU is needed.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <random>
+#include <vector>
+
+#include "mldb/ml/jml/stump_training_device.h"
+#include "mldb/ml/jml/boosted_stumps_generator.h"
+#include "mldb/ml/jml/decision_tree_generator.h"
+#include "mldb/ml/jml/training_data.h"
+#include "mldb/ml/jml/dense_features.h"
+#include "mldb/ml/jml/feature_info.h"
+#include "mldb/jml/utils/smart_ptr_utils.h"
+
+using namespace ML;
+using namespace std;
+
+/** Does the same as the CUDA device's host fallback. */
+struct Host_Device : public Stump_Training_Device {
+    mutable std::atomic<int> calls;
+
+    Host_Device()
+        : calls(0)
+    {
+    }
+
+    virtual std::string name() const
+    {
+        return "cuda";
+    }
+
+    virtual bool accumulate_binsym(const Joint_Index & index,
+                                   const float * weights,
+                                   const float * ex_weights,
+                                   size_t num_examples,
+                                   int num_buckets,
+                                   TwoBuckets * accum,
+                                   TwoBuckets & w_label) const
+    {
+        ++calls;
+
+        for (int b = 0;  b < num_buckets;  ++b)
+            accum[b][0] = accum[b][1] = 0.0;
+        w_label[0] = w_label[1] = 0.0;
+
+        for (unsigned i = 0;  i < index.size();  ++i) {
+            int example = index.examples() ? index.examples()[i] : i;
+            BOOST_REQUIRE(example < num_examples);
+            float weight = ex_weights[example];
+            if (weight == 0.0) continue;
+            weight *= weights[example];
+            if (weight == 0.0) continue;
+
+            int label = index.labels_as_int()[i];
+            float divisor = index.divisors() ? index.divisors()[i] : 1.0f;
+            float to_add = weight * divisor;
+
+            accum[index.buckets()[i]][label] += to_add;
+            w_label[label] += to_add;
+        }
+
+        return true;
+    }
+};
+
+BOOST_AUTO_TEST_CASE( test_device_matches_cpu )
+{
+    auto device = std::make_shared<Host_Device>();
+    register_stump_training_device(device);
+
+    BOOST_CHECK(!get_stump_training_device(TD_CPU));
+    BOOST_CHECK_EQUAL(get_stump_training_device(TD_AUTO), device);
+    BOOST_CHECK_EQUAL(get_stump_training_device(TD_CUDA), device);
+
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    fs.add_feature("feature1", REAL);
+    fs.add_feature("feature2", REAL);
+    fs.add_feature("feature3", REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+    Feature label = fs.features()[0];
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+    Training_Data data(fsp);
+    int nfv = 1000;
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        float f1 = uniform(rng), f2 = uniform(rng), f3 = uniform(rng);
+        distribution<float> features;
+        features.push_back(f1 > f2 || uniform(rng) < 0.1);
+        features.push_back(f1);
+        features.push_back(uniform(rng) < 0.2 ? NAN : f2);
+        features.push_back(f3);
+        data.add_example(fs.encode(features));
+    }
+
+    vector<Feature> features = fs.features();
+    features.erase(features.begin());
+
+    vector<distribution<float> > rows;
+    for (unsigned i = 0;  i < 100;  ++i)
+        rows.push_back({ uniform(rng), uniform(rng), uniform(rng) });
+
+    auto train = [&] (Classifier_Generator & generator,
+                      const std::string & config_str)
+        {
+            Configuration config;
+            config.parse_string(config_str, "inbuilt config file");
+            vector<string> unparsedKeys;
+            generator.configure(config, unparsedKeys);
+            generator.init(fsp, label);
+
+            Thread_Context context;
+            distribution<float> weights(nfv, 1.0);
+            return generator.generate(context, data, weights, features);
+        };
+
+    auto check = [&] (const Classifier_Impl & cpu,
+                      const Classifier_Impl & onDevice)
+        {
+            for (auto & row: rows) {
+                distribution<float> values = { 0.0 };
+                values.insert(values.end(), row.begin(), row.end());
+                auto example = fs.encode(values);
+                BOOST_CHECK_EQUAL(cpu.predict(1, *example),
+                                  onDevice.predict(1, *example));
+            }
+        };
+
+    Decision_Tree_Generator decision_tree;
+    auto cpuTree = train(decision_tree, "max_depth=5\ndevice=cpu\n");
+    BOOST_CHECK_EQUAL(device->calls, 0);
+    auto deviceTree = train(decision_tree, "max_depth=5\ndevice=auto\n");
+    BOOST_CHECK_GT(device->calls, 0);
+    BOOST_CHECK_EQUAL(cpuTree->print(), deviceTree->print());
+    check(*cpuTree, *deviceTree);
+
+    device->calls = 0;
+    Boosted_Stumps_Generator boosted_stumps;
+    auto cpuStumps = train(boosted_stumps, "max_iter=20\nmin_iter=20\ndevice=cpu\n");
+    BOOST_CHECK_EQUAL(device->calls, 0);
+    auto deviceStumps = train(boosted_stumps, "max_iter=20\nmin_iter=20\ndevice=cuda\n");
+    BOOST_CHECK_GT(device->calls, 0);
+    BOOST_CHECK_EQUAL(cpuStumps->print(), deviceStumps->print());
+    check(*cpuStumps, *deviceStumps);
+}
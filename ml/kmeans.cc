@@ -10,10 +10,51 @@
 #include "kmeans.h"
 
 #include <random>
+#include <algorithm>
 #include "mldb/jml/utils/smart_ptr_utils.h"
 
 namespace ML {
 
+namespace {
+
+// Unfortunately, std::atomic can't be copied or moved, so we need
+// a wrapper to put it in a vector
+struct AI: public std::atomic<int> {
+    AI(int n = 0)
+        : std::atomic<int>(n)
+    {
+    }
+
+    AI & operator = (const AI & other) noexcept
+    {
+        store(other.load());
+        return *this;
+    }
+};
+
+/** Uniform number in [0, 1) that depends only on its arguments, so that
+    points can be sampled in parallel and still give the same result for
+    the same seed.  This is the splitmix64 finalizer. */
+double hashUniform(uint64_t seed, uint64_t round, uint64_t i)
+{
+    uint64_t z = seed * 0x9e3779b97f4a7c15ULL
+        + round * 0xc2b2ae3d27d4eb4fULL + i;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z = z ^ (z >> 31);
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/** Chunk size for passes over all of the points.  Big enough that the
+    per-chunk accumulators are cheap to merge, small enough to share the
+    work between the threads. */
+size_t pointChunkSize(size_t npoints)
+{
+    return std::max<size_t>(1024, npoints / 256);
+}
+
+} // file scope
+
 void
 KMeans::
 train(const std::vector<distribution<float>> & points,
@@ -23,20 +64,43 @@ train(const std::vector<distribution<float>> & points,
       int randomSeed
       )
 {
-    using namespace std;
-
     if (nbClusters < 2)
         throw MLDB::Exception("kmeans training requires at least 2 clusters");
     if (points.size() == 0)
         throw MLDB::Exception("kmeans training requires at least 1 datapoint");
+    if (miniBatchSize < 0)
+        throw MLDB::Exception("kmeans mini batch size must be positive");
 
-    mt19937 rng;
+    std::mt19937 rng;
     rng.seed(randomSeed);
 
     int npoints = points.size();
     in_cluster.resize(npoints, -1);
     clusters.resize(nbClusters);
 
+    switch (initialization) {
+    case KMEANS_INIT_FARTHEST_SAMPLE:
+        initFarthestSample(points, nbClusters, rng);
+        break;
+    case KMEANS_INIT_PARALLEL:
+        initParallel(points, nbClusters, randomSeed, rng);
+        break;
+    default:
+        throw MLDB::Exception("unknown kmeans initialization");
+    }
+
+    if (miniBatchSize > 0)
+        trainMiniBatch(points, in_cluster, maxIterations, rng);
+    else trainLloyd(points, in_cluster, maxIterations);
+}
+
+void
+KMeans::
+initFarthestSample(const std::vector<distribution<float> > & points,
+                   int nbClusters, std::mt19937 & rng)
+{
+    using namespace std;
+
     // Smart initialization of the centroids
     // FIXME http://en.wikipedia.org/wiki/K-means%2B%2B#Initialization_algorithm
     clusters[0].centroid = points[rng() % points.size()];
@@ -60,11 +124,7 @@ train(const std::vector<distribution<float>> & points,
 
                 if (dist < distMin) {
                     distMin = dist;
-                    // cerr << "NEW MIN" << endl;
                 }
-                // cerr << "point " << j << " norm " << points[randomIdx].two_norm() << endl;
-                // cerr << "cluster " << k << " norm " << clusters[k].centroid.two_norm() << endl;
-                // cerr << "distance " << dist << endl;
             }
             if (distMin > distMax) {
                 distMax = distMin;
@@ -76,46 +136,251 @@ train(const std::vector<distribution<float>> & points,
             bestPoint = rng() % points.size();
         }
         clusters[i].centroid = points[bestPoint];
-        // cerr << "norm of best init centroid " << clusters[i].centroid.two_norm() << endl;
     }
+}
 
+void
+KMeans::
+initParallel(const std::vector<distribution<float> > & points,
+             int nbClusters, int randomSeed, std::mt19937 & rng)
+{
+    using namespace std;
 
-    for (int iter = 0;  iter < maxIterations;  ++iter) {
+    // k-means|| from Bahmani et al, "Scalable k-means++", VLDB 2012.  A few
+    // passes over the points each sample about 2 * nbClusters candidates
+    // with probability proportional to their squared distance to the
+    // candidates so far.  The candidates, weighted by the number of points
+    // closest to them, are then reduced to nbClusters with k-means++.
 
-        // How many have changed cluster?  Used to know when the cluster
-        // contents are stable
-        std::atomic<int> changes(0);
+    int npoints = points.size();
+    int numRounds = 5;
+    double oversampling = 2.0 * nbClusters;
+    double minDist = metric->minDistance();
+
+    auto cost = [&] (float dist) -> double
+        {
+            double d = dist - minDist;
+            return d * d;
+        };
 
-        // Unfortunately, std::atomic can't be copied or moved, so we need
-        // a wrapper to put it in a vector
-        struct AI: public std::atomic<int> {
-            AI(int n = 0)
-                : std::atomic<int>(n)
+    std::vector<distribution<float> > candidates;
+    candidates.push_back(points[rng() % npoints]);
+
+    // Cost of each point to its closest candidate, and which one it is
+    std::vector<double> closestCost(npoints);
+    std::vector<int> closestCandidate(npoints, 0);
+
+    auto updateClosest = [&] (size_t firstCandidate)
+        {
+            auto doChunk = [&] (size_t first, size_t last)
             {
-            }
+                for (size_t i = first;  i < last;  ++i) {
+                    for (size_t c = firstCandidate;  c < candidates.size();  ++c) {
+                        double d = cost(metric->distance(points[i], candidates[c]));
+                        if (c == 0 || d < closestCost[i]) {
+                            closestCost[i] = d;
+                            closestCandidate[i] = c;
+                        }
+                    }
+                }
+            };
 
-            AI & operator = (const AI & other) noexcept
+            MLDB::parallelMapChunked(0, npoints, pointChunkSize(npoints),
+                                     doChunk);
+        };
+
+    updateClosest(0);
+
+    for (int round = 0;  round < numRounds;  ++round) {
+        double totalCost = 0.0;
+        for (auto & c: closestCost)
+            totalCost += c;
+
+        // All points are on a candidate; there is nothing left to sample
+        if (totalCost == 0.0)
+            break;
+
+        std::vector<int> sampled;
+        std::mutex sampledLock;
+
+        auto sampleChunk = [&] (size_t first, size_t last)
             {
-                store(other.load());
-                return *this;
+                std::vector<int> chunkSampled;
+                for (size_t i = first;  i < last;  ++i) {
+                    if (hashUniform(randomSeed, round, i) * totalCost
+                        < oversampling * closestCost[i])
+                        chunkSampled.push_back(i);
+                }
+                std::unique_lock<std::mutex> guard(sampledLock);
+                sampled.insert(sampled.end(),
+                               chunkSampled.begin(), chunkSampled.end());
+            };
+
+        MLDB::parallelMapChunked(0, npoints, pointChunkSize(npoints),
+                                 sampleChunk);
+
+        // Chunks finish in any order; sort to stay deterministic
+        std::sort(sampled.begin(), sampled.end());
+
+        size_t firstNew = candidates.size();
+        for (int i: sampled)
+            candidates.push_back(points[i]);
+
+        updateClosest(firstNew);
+
+        cerr << "kmeans|| round " << round << ": " << candidates.size()
+             << " candidates" << endl;
+    }
+
+    std::vector<double> weights(candidates.size(), 0.0);
+    for (int c: closestCandidate)
+        weights[c] += 1.0;
+
+    // Weighted k-means++ over the candidates
+    int numCandidates = candidates.size();
+    std::vector<double> candidateCost(numCandidates, INFINITY);
+    std::vector<bool> chosen(numCandidates, false);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    auto choose = [&] (const std::vector<double> & probs) -> int
+        {
+            double total = 0.0;
+            for (unsigned i = 0;  i < probs.size();  ++i)
+                if (!chosen[i])
+                    total += probs[i];
+            if (total == 0.0)
+                return -1;
+            double r = uniform(rng) * total;
+            int last = -1;
+            for (unsigned i = 0;  i < probs.size();  ++i) {
+                if (chosen[i] || probs[i] == 0.0)
+                    continue;
+                last = i;
+                r -= probs[i];
+                if (r < 0.0)
+                    break;
             }
+            return last;
         };
 
+    std::vector<double> probs(numCandidates);
+    for (int i = 0;  i < nbClusters;  ++i) {
+        int c = -1;
+        if (i == 0)
+            c = choose(weights);
+        else {
+            for (int j = 0;  j < numCandidates;  ++j)
+                probs[j] = weights[j] * candidateCost[j];
+            c = choose(probs);
+        }
+
+        if (c == -1) {
+            // Fewer distinct candidates than clusters; like the other
+            // initialization, we reuse random points
+            clusters[i].centroid = points[rng() % npoints];
+            continue;
+        }
+
+        chosen[c] = true;
+        clusters[i].centroid = candidates[c];
+
+        auto updateCost = [&] (size_t first, size_t last)
+            {
+                for (size_t j = first;  j < last;  ++j) {
+                    double d = cost(metric->distance(candidates[j],
+                                                     candidates[c]));
+                    candidateCost[j] = std::min(candidateCost[j], d);
+                }
+            };
+
+        MLDB::parallelMapChunked(0, numCandidates, 256, updateCost);
+    }
+}
+
+void
+KMeans::
+trainLloyd(const std::vector<distribution<float> > & points,
+           std::vector<int> & in_cluster,
+           int maxIterations)
+{
+    using namespace std;
+
+    int npoints = points.size();
+    int nbClusters = clusters.size();
+    size_t chunkSize = pointChunkSize(npoints);
+
+    // With a metric we use Hamerly's bounds ("Making k-means even faster",
+    // SDM 2010) to skip the points which can't have changed cluster.
+    // upper is a bound on the distance from each point to its centroid,
+    // lower on its distance to all of the other centroids.
+    bool prune = metric->satisfiesTriangleInequality();
+    std::vector<float> upper(npoints, INFINITY), lower(npoints, 0.0);
+
+    // Half of the distance from each centroid to the closest other one
+    std::vector<float> halfClosest(nbClusters, 0.0);
+
+    // How far each centroid moved in the last iteration
+    std::vector<float> moved(nbClusters, 0.0);
+
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+
+        if (prune) {
+            auto doCluster = [&] (size_t c)
+                {
+                    float closest = INFINITY;
+                    for (int c2 = 0;  c2 < nbClusters;  ++c2) {
+                        if (c2 == c)
+                            continue;
+                        closest = std::min<float>
+                            (closest,
+                             metric->distance(clusters[c].centroid,
+                                              clusters[c2].centroid));
+                    }
+                    halfClosest[c] = closest / 2;
+                };
+
+            MLDB::parallelMap(0, nbClusters, doCluster);
+        }
+
+        // How many have changed cluster?  Used to know when the cluster
+        // contents are stable
+        std::atomic<int> changes(0);
+
+        // How many didn't need their distances calculated
+        std::atomic<int> skipped(0);
+
         std::vector<AI> clusterNumMembers(nbClusters);
 
-        auto findNewCluster = [&] (int i) {
+        auto findNewCluster = [&] (size_t first, size_t last) {
+
+            for (size_t i = first;  i < last;  ++i) {
+                int current = in_cluster[i];
+
+                if (prune && current != -1) {
+                    float bound = std::max(halfClosest[current], lower[i]);
+                    if (upper[i] > bound) {
+                        upper[i] = metric->distance(points[i],
+                                                    clusters[current].centroid);
+                    }
+                    if (upper[i] <= bound) {
+                        ++skipped;
+                        ++clusterNumMembers[current];
+                        continue;
+                    }
+                }
 
-            int best_cluster = this->assign(points[i]);
+                int best_cluster = this->assign(points[i], upper[i], lower[i]);
 
-            if (best_cluster != in_cluster[i]) {
-                ++changes;
-                in_cluster[i] = best_cluster;
-            }
+                if (best_cluster != current) {
+                    ++changes;
+                    in_cluster[i] = best_cluster;
+                }
 
-            ++clusterNumMembers[best_cluster];
+                ++clusterNumMembers[best_cluster];
+            }
         };
 
-        MLDB::parallelMap(0, points.size(), findNewCluster);
+        MLDB::parallelMapChunked(0, npoints, chunkSize, findNewCluster);
 
         for (unsigned i = 0;  i < nbClusters;  ++i)
             clusters[i].nbMembers = clusterNumMembers[i];
@@ -139,50 +404,83 @@ train(const std::vector<distribution<float>> & points,
         printDebug("assoc", iter);
 #endif
 
-        // std::cerr << "\niter " << iter << std::endl;
+        cerr << "done clustering iter " << iter
+             << ": " << changes << " changes, " << skipped
+             << " points skipped" << endl;
 
-        // Calculate means
+        cerr << "nb of items per cluster" << endl << "[ ";
         for (auto & c : clusters)
-            // If no member, we want to leave it there
-            if (c.nbMembers > 0)
-                std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
+            cerr << c.nbMembers << " ";
+        cerr << "]" << endl;
 
-        std::vector<std::mutex> locks(clusters.size());
+        if (changes == 0)
+            break;
 
-        auto addToMeanForPoint = [&] (int i) {
-            int cluster = in_cluster[i];
-            auto point = points[i];
+        // Calculate means.  Each chunk of points adds into its own sums,
+        // which are merged at the end of the chunk; this avoids taking a
+        // lock for each point.
+        std::vector<distribution<float> > sums(nbClusters);
+        std::mutex sumsLock;
+
+        auto addToMeans = [&] (size_t first, size_t last) {
+            std::vector<distribution<float> > chunkSums(nbClusters);
+
+            for (size_t i = first;  i < last;  ++i) {
+                int cluster = in_cluster[i];
+                auto & sum = chunkSums[cluster];
+                if (sum.empty())
+                    sum.resize(points[i].size(), 0.0);
+                metric->contributeToAverage(sum, points[i], 1. / (double) clusters[cluster].nbMembers);
+            }
 
-            {
-                // cerr << "cluster du point i " << cluster << endl;
-                std::unique_lock<std::mutex> guard(locks[cluster]);
-                // cerr << "patate pour mich" << endl;
-                metric->contributeToAverage(clusters[cluster].centroid, point, 1. / (double) clusters[cluster].nbMembers);
+            std::unique_lock<std::mutex> guard(sumsLock);
+            for (int c = 0;  c < nbClusters;  ++c) {
+                if (chunkSums[c].empty())
+                    continue;
+                if (sums[c].empty())
+                    sums[c] = std::move(chunkSums[c]);
+                else sums[c] += chunkSums[c];
             }
         };
 
-        MLDB::parallelMap(0, points.size(), addToMeanForPoint);
+        MLDB::parallelMapChunked(0, npoints, chunkSize, addToMeans);
 
-        // for (int i=0; i < clusters.size(); ++i) {
-            // cerr << "cluster " << i << " had " << clusters[i].nbMembers
-                 // << " members\n";
-            // cerr << "centroid " << clusters[i].centroid << endl;
-        // }
+        // If no member, we want to leave it there
+        for (int c = 0;  c < nbClusters;  ++c) {
+            if (clusters[c].nbMembers == 0) {
+                moved[c] = 0.0;
+                continue;
+            }
+            if (prune)
+                moved[c] = metric->distance(clusters[c].centroid, sums[c]);
+            clusters[c].centroid = std::move(sums[c]);
+        }
 
-        cerr << "done clustering iter " << iter
-             << ": " << changes << " changes" << endl;
+        if (prune) {
+            // A point's distance to another centroid can only have gone
+            // down by as much as the ones that moved the most
+            int mostMoved = std::max_element(moved.begin(), moved.end())
+                - moved.begin();
+            float maxMoved = moved[mostMoved];
+            float secondMoved = 0.0;
+            for (int c = 0;  c < nbClusters;  ++c)
+                if (c != mostMoved)
+                    secondMoved = std::max(secondMoved, moved[c]);
+
+            auto updateBounds = [&] (size_t first, size_t last)
+                {
+                    for (size_t i = first;  i < last;  ++i) {
+                        int c = in_cluster[i];
+                        upper[i] += moved[c];
+                        lower[i] -= (c == mostMoved ? secondMoved : maxMoved);
+                    }
+                };
+
+            MLDB::parallelMapChunked(0, npoints, chunkSize, updateBounds);
+        }
 
-        cerr << "nb of items per cluster" << endl << "[ ";
         for (auto & c : clusters)
-            cerr << c.nbMembers << " ";
-        cerr << "]" << endl;
-
-        if (changes == 0)
-            break;
-        else
-            for (auto & c : clusters)
-                c.nbMembers = 0;
-
+            c.nbMembers = 0;
 
 #if KMEANS_DEBUG
         printDebug("average", iter);
@@ -191,6 +489,67 @@ train(const std::vector<distribution<float>> & points,
     }
 }
 
+void
+KMeans::
+trainMiniBatch(const std::vector<distribution<float> > & points,
+               std::vector<int> & in_cluster,
+               int maxIterations, std::mt19937 & rng)
+{
+    using namespace std;
+
+    // Mini-batch k-means from Sculley, "Web-scale k-means clustering",
+    // WWW 2010.  Each iteration assigns a random batch of points, and moves
+    // each centroid towards its points with a learning rate of one over the
+    // number of points it has been assigned so far.
+
+    int npoints = points.size();
+    int nbClusters = clusters.size();
+
+    std::vector<int> counts(nbClusters, 0);
+    std::vector<int> batch(miniBatchSize), batchCluster(miniBatchSize);
+
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+        for (auto & b: batch)
+            b = rng() % npoints;
+
+        auto assignChunk = [&] (size_t first, size_t last)
+            {
+                for (size_t j = first;  j < last;  ++j)
+                    batchCluster[j] = this->assign(points[batch[j]]);
+            };
+
+        MLDB::parallelMapChunked(0, miniBatchSize, 64, assignChunk);
+
+        for (int j = 0;  j < miniBatchSize;  ++j) {
+            int c = batchCluster[j];
+            double eta = 1.0 / ++counts[c];
+            clusters[c].centroid *= 1.0 - eta;
+            metric->contributeToAverage(clusters[c].centroid,
+                                        points[batch[j]], eta);
+        }
+    }
+
+    // Final pass to assign all of the points to the centroids
+    std::vector<AI> clusterNumMembers(nbClusters);
+
+    auto assignChunk = [&] (size_t first, size_t last)
+        {
+            for (size_t i = first;  i < last;  ++i) {
+                in_cluster[i] = this->assign(points[i]);
+                ++clusterNumMembers[in_cluster[i]];
+            }
+        };
+
+    MLDB::parallelMapChunked(0, npoints, pointChunkSize(npoints),
+                             assignChunk);
+
+    for (int c = 0;  c < nbClusters;  ++c)
+        clusters[c].nbMembers = clusterNumMembers[c];
+
+    cerr << "done mini-batch clustering of " << maxIterations
+         << " batches of " << miniBatchSize << endl;
+}
+
 distribution<float>
 KMeans::
 centroidDistances(const distribution<float> & point) const
@@ -205,19 +564,33 @@ centroidDistances(const distribution<float> & point) const
 int
 KMeans::
 assign(const distribution<float> & point) const
+{
+    float bestDist, secondDist;
+    return assign(point, bestDist, secondDist);
+}
+
+int
+KMeans::
+assign(const distribution<float> & point,
+       float & distMin, float & distSecond) const
 {
     using namespace std;
     if (clusters.size() == 0)
         throw MLDB::Exception("Did you train your kmeans?");
 
-    float distMin = INFINITY;
+    distMin = INFINITY;
+    distSecond = INFINITY;
     int best_cluster = -1;
-    auto distances = centroidDistances(point);
     for (int i=0; i < clusters.size(); ++i) {
-        if (distances[i] < distMin) {
-            distMin = distances[i];
+        float dist = metric->distance(point, clusters[i].centroid);
+        if (dist < distMin) {
+            distSecond = distMin;
+            distMin = dist;
             best_cluster = i;
         }
+        else if (dist < distSecond) {
+            distSecond = dist;
+        }
     }
     // Those are points with infinty distance or nan distance maybe
     // Let's put them in cluster 0
@@ -9,10 +9,13 @@
 
 #include <vector>
 #include <mutex>
+#include <random>
 #include "mldb/jml/stats/distribution.h"
 #include "mldb/jml/db/persistent.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/parallel.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/base/exc_assert.h"
 #include <boost/math/special_functions/fpclassify.hpp>
 
 
@@ -43,13 +46,24 @@ public:
 
     // For serialization
     virtual std::string tag() const = 0;
+
+    // Does distance() obey the triangle inequality?  If so, training can
+    // use bounds to skip most of the distance calculations.
+    virtual bool satisfiesTriangleInequality() const { return false; }
+
+    // Smallest value distance() can return; the k-means|| initialization
+    // samples points by their distance above this value.
+    virtual double minDistance() const { return 0.0; }
 };
 
 class KMeansEuclideanMetric : public KMeansMetric {
 public:
     double distance(const distribution<float> & x,
                     const distribution<float> & y) const
-    { return (x - y).two_norm(); }
+    {
+        ExcAssertEqual(x.size(), y.size());
+        return sqrt(SIMD::vec_euclid(x.data(), y.data(), x.size()));
+    }
 
     distribution<float>
     average(const std::vector<distribution<float>> & points) const
@@ -70,6 +84,8 @@ public:
     }
 
     std::string tag() const { return "EuclideanMetric"; }
+
+    bool satisfiesTriangleInequality() const { return true; }
 };
 
 /*
@@ -92,14 +108,20 @@ public:
     double distance(const distribution<float> & x,
                     const distribution<float> & y) const
     {
-        bool x_zero = !x.any();
-        bool y_zero = !y.any();
+        ExcAssertEqual(x.size(), y.size());
+
+        // Dot product and both norms in a single pass
+        double xy, xx, yy;
+        SIMD::vec_dotprod_norms_dp(x.data(), y.data(), x.size(),
+                                   xy, xx, yy);
+        bool x_zero = xx == 0.0;
+        bool y_zero = yy == 0.0;
         if (x_zero && y_zero) {
             return -1.;
         } else if (x_zero || y_zero) {
             return 2.;
         } else
-            return -x.dotprod(y) / y.two_norm() / x.two_norm();
+            return -xy / sqrt(yy) / sqrt(xx);
     }
 
     // Not perfect but probably does the trick
@@ -123,6 +145,8 @@ public:
     }
 
     std::string tag() const { return "CosineMetric"; }
+
+    double minDistance() const { return -1.0; }
 };
 
 
@@ -130,10 +154,18 @@ public:
 /* KMEANS                                                                    */
 /*****************************************************************************/
 
+/** How the initial centroids are chosen. */
+enum KMeansInitialization {
+    KMEANS_INIT_FARTHEST_SAMPLE,  ///< Farthest of a random sample of points
+    KMEANS_INIT_PARALLEL          ///< k-means|| (Bahmani et al, 2012)
+};
+
 struct KMeans {
 
     KMeans(KMeansMetric * metric = new KMeansEuclideanMetric())
-        : metric(metric)
+        : metric(metric),
+          initialization(KMEANS_INIT_FARTHEST_SAMPLE),
+          miniBatchSize(0)
     {
     }
 
@@ -144,7 +176,15 @@ struct KMeans {
 
     std::vector<Cluster> clusters;
     std::shared_ptr<KMeansMetric> metric;
-    
+
+    /// How to choose the initial centroids
+    KMeansInitialization initialization;
+
+    /// If non-zero, each iteration updates the centroids from a random
+    /// sample of this many points (Sculley, 2010) instead of doing a full
+    /// pass over the points.
+    int miniBatchSize;
+
     void train(const std::vector<distribution<float> > & points,
                std::vector<int> & in_cluster,
                int nclusters=100,
@@ -156,10 +196,27 @@ struct KMeans {
     // Find the closest cluster to `point` and returns its index
     int assign(const distribution<float> & point) const;
 
+    // Same as assign(), but also returns the distance to the closest and
+    // second closest clusters
+    int assign(const distribution<float> & point,
+               float & bestDist, float & secondDist) const;
+
     void serialize(ML::DB::Store_Writer & store) const;
     void reconstitute(ML::DB::Store_Reader & store);
     void save(const std::string & filename) const;
     void load(const std::string & filename);
+
+private:
+    void initFarthestSample(const std::vector<distribution<float> > & points,
+                            int nbClusters, std::mt19937 & rng);
+    void initParallel(const std::vector<distribution<float> > & points,
+                      int nbClusters, int randomSeed, std::mt19937 & rng);
+    void trainLloyd(const std::vector<distribution<float> > & points,
+                    std::vector<int> & in_cluster,
+                    int maxIterations);
+    void trainMiniBatch(const std::vector<distribution<float> > & points,
+                        std::vector<int> & in_cluster,
+                        int maxIterations, std::mt19937 & rng);
 };
 
 } // namespace ML
@@ -205,6 +205,32 @@ struct Dense_Layer : public Layer {
                 Parameters & gradient,
                 Parameters * dgradient,
                 double example_weight) const;    
+
+    /** Minibatch propagation.  The activations of the whole batch are
+        calculated with a single matrix multiply, starting from the bias,
+        and the transfer function is applied as they are copied out.  The
+        gradients are calculated with matrix multiplies in the same way.
+    */
+    virtual void fprop_batch(int num_examples,
+                             const float * inputs,
+                             float * temp_space,
+                             float * outputs) const;
+
+    virtual void bprop_batch(int num_examples,
+                             const float * inputs,
+                             const float * outputs,
+                             const float * temp_space,
+                             const float * output_errors,
+                             float * input_errors,
+                             Parameters & gradient,
+                             const float * example_weights) const;
+
+    /** Copy a batch of inputs into X, replacing the missing values in the
+        same way as activation().  Returns false if the missing values
+        can't be handled by replacing the inputs, in which case the batch
+        needs to be propagated one example at a time.
+    */
+    bool batch_inputs(int num_examples, const float * inputs, Float * X) const;
     
     /** Add in our parameters to the params object. */
     virtual void add_parameters(Parameters & params);
@@ -14,6 +14,7 @@
 #include "mldb/jml/db/persistent.h"
 #include "mldb/arch/demangle.h"
 #include "mldb/ml/algebra/matrix_ops.h"
+#include "mldb/ml/algebra/lapack.h"
 #include "mldb/arch/simd_vector.h"
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/ml/jml/registry.h"
@@ -561,25 +562,26 @@ bbprop(const F * inputs,
         if (input_errors) input_errors[i] = 0.0;
 
         if (!was_missing) {
-            if (inputs[i] == 0.0) continue;
-
-            dweights.update_row(i, dbias, inputs[i] * example_weight);
-
             if (input_errors)
                 input_errors[i]
                     = SIMD::vec_dotprod_dp(&weights[i][0],
                                            &dbias[0], no);
             
-            if (ddweights)
-                ddweights->update_row(i, ddbias,
-                                      inputs[i] * inputs[i] * example_weight);
-            
             if (d2input_errors)
                 d2input_errors[i]
                     = SIMD::vec_accum_prod3(&weights[i][0],
                                             &weights[i][0],
                                             ddbias,
                                             no);
+
+            // The weight updates are multiplied by the input
+            if (inputs[i] == 0.0) continue;
+
+            dweights.update_row(i, dbias, inputs[i] * example_weight);
+
+            if (ddweights)
+                ddweights->update_row(i, ddbias,
+                                      inputs[i] * inputs[i] * example_weight);
         }
         else if (missing_values == MV_NONE)
             throw Exception("MV_NONE but missing value");
@@ -664,6 +666,159 @@ bbprop(const double * inputs,
                           example_weight);
 }
 
+template<typename Float>
+bool
+Dense_Layer<Float>::
+batch_inputs(int num_examples, const float * inputs, Float * X) const
+{
+    int ni = this->inputs();
+    size_t n = (size_t)num_examples * ni;
+
+    for (size_t j = 0;  j < n;  ++j) {
+        if (!isnan(inputs[j])) {
+            X[j] = inputs[j];
+            continue;
+        }
+
+        switch (missing_values) {
+        case MV_NONE:
+            throw Exception("missing value with MV_NONE");
+        case MV_ZERO:
+            X[j] = 0.0;  break;
+        case MV_INPUT:
+        case MV_DENSE:
+            // These have their own parameters, which are only handled
+            // per example
+            return false;
+        default:
+            throw Exception("unknown missing values");
+        }
+    }
+
+    return true;
+}
+
+namespace {
+
+inline void transfer_row(const Transfer_Function & transfer_function,
+                         float * activations, float * outputs, int no)
+{
+    transfer_function.transfer(activations, outputs, no);
+}
+
+inline void transfer_row(const Transfer_Function & transfer_function,
+                         double * activations, float * outputs, int no)
+{
+    transfer_function.transfer(activations, activations, no);
+    std::copy(activations, activations + no, outputs);
+}
+
+} // file scope
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fprop_batch(int num_examples,
+            const float * inputs,
+            float * temp_space,
+            float * outputs) const
+{
+    int ni = this->inputs(), no = this->outputs();
+    if (num_examples == 0)
+        return;
+
+    std::vector<Float> X((size_t)num_examples * ni);
+    if (!batch_inputs(num_examples, inputs, &X[0])) {
+        Layer::fprop_batch(num_examples, inputs, temp_space, outputs);
+        return;
+    }
+
+    // The matrices are row major, which BLAS sees as their transpose.  So
+    // we calculate act' = weights' X' + act' with act initialized to the
+    // bias.
+    std::vector<Float> act((size_t)num_examples * no);
+    for (int x = 0;  x < num_examples;  ++x)
+        std::copy(bias.begin(), bias.end(), &act[(size_t)x * no]);
+
+    if (ni > 0)
+        LAPack::gemm('N', 'N', no, num_examples, ni, 1.0,
+                     weights.data(), no, &X[0], ni, 1.0, &act[0], no);
+
+    for (int x = 0;  x < num_examples;  ++x)
+        transfer_row(*transfer_function, &act[(size_t)x * no],
+                     outputs + (size_t)x * no, no);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+bprop_batch(int num_examples,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    int ni = this->inputs(), no = this->outputs();
+    if (num_examples == 0)
+        return;
+
+    std::vector<Float> X((size_t)num_examples * ni);
+    if (!batch_inputs(num_examples, inputs, &X[0])) {
+        Layer::bprop_batch(num_examples, inputs, outputs, temp_space,
+                           output_errors, input_errors, gradient,
+                           example_weights);
+        return;
+    }
+
+    // Error with respect to the activation of each unit, which is the
+    // output error multiplied by the transfer derivative
+    std::vector<Float> dact((size_t)num_examples * no);
+    float derivs[no];
+    for (int x = 0;  x < num_examples;  ++x) {
+        transfer_function->derivative(outputs + (size_t)x * no, derivs, no);
+        for (unsigned o = 0;  o < no;  ++o)
+            dact[(size_t)x * no + o]
+                = derivs[o] * output_errors[(size_t)x * no + o];
+    }
+
+    if (input_errors) {
+        // input_errors = dact weights'
+        std::vector<Float> errors((size_t)num_examples * ni);
+        if (no > 0)
+            LAPack::gemm('T', 'N', ni, num_examples, no, 1.0,
+                         weights.data(), no, &dact[0], no, 0.0,
+                         &errors[0], ni);
+        for (size_t j = 0;  j < errors.size();  ++j)
+            input_errors[j] = isnan(inputs[j]) ? 0.0 : errors[j];
+    }
+
+    // Weight the examples; the bias gradient is then the sum of the rows
+    std::vector<Float> dbias(no, 0.0);
+    for (int x = 0;  x < num_examples;  ++x) {
+        Float * row = &dact[(size_t)x * no];
+        for (unsigned o = 0;  o < no;  ++o) {
+            row[o] *= example_weights[x];
+            dbias[o] += row[o];
+        }
+    }
+    gradient.vector(1, "bias").update(&dbias[0], 1.0);
+
+    if (ni == 0)
+        return;
+
+    // dweights = X' dact
+    std::vector<Float> dweights((size_t)ni * no);
+    LAPack::gemm('N', 'T', no, ni, num_examples, 1.0,
+                 &dact[0], no, &X[0], ni, 0.0, &dweights[0], no);
+
+    Matrix_Parameter & gweights = gradient.matrix(0, "weights");
+    for (unsigned i = 0;  i < ni;  ++i)
+        gweights.update_row(i, &dweights[(size_t)i * no], 1.0);
+}
+
 namespace {
 
 template<typename Float>
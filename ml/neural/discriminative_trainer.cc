@@ -122,6 +122,54 @@ train_example(const float * data,
     return make_pair(sqrt(error), outputs[0]);
 }
 
+double
+Discriminative_Trainer::
+train_batch(int num_examples,
+            const float * data,
+            const float * labels,
+            const float * weights,
+            Parameters_Copy<double> & updates,
+            float * outputs) const
+{
+    int no = layer->outputs();
+
+    /* fprop */
+
+    std::vector<float> temp_space
+        (num_examples * layer->fprop_temporary_space_required());
+    std::vector<float> batch_outputs(num_examples * no);
+
+    layer->fprop_batch(num_examples, data, temp_space.data(), &batch_outputs[0]);
+
+    /* error */
+
+    std::vector<float> derrors(num_examples * no);
+    double total_rmse = 0.0;
+
+    for (unsigned x = 0;  x < num_examples;  ++x) {
+        double error = 0.0;
+        for (unsigned o = 0;  o < no;  ++o) {
+            size_t i = x * no + o;
+            float e = labels[i] - batch_outputs[i];
+            error += e * e;
+            // TODO: get the loss function to do this...
+            derrors[i] = -2.0 * e;
+        }
+        total_rmse += sqrt(error);
+        outputs[x] = batch_outputs[x * no];
+    }
+
+    /* bprop */
+
+    layer->bprop_batch(num_examples, data, &batch_outputs[0], temp_space.data(),
+                       &derrors[0],
+                       0 /* don't calculate input errors */,
+                       updates,
+                       weights);
+
+    return total_rmse;
+}
+
 namespace {
 
 struct Train_Examples_Job {
@@ -170,33 +218,30 @@ struct Train_Examples_Job {
         Parameters_Copy<double> local_updates(*trainer.layer);
         local_updates.fill(0.0);
 
-        double total_rmse_local = 0.0;
+        // Gather the examples into a minibatch
+        int ni = trainer.layer->inputs(), no = trainer.layer->outputs();
+        int nx = last - first;
 
-        //cerr << "training from " << first << " to " << last << endl;
+        std::vector<float> batch_data(nx * ni), batch_labels(nx * no);
+        std::vector<float> batch_weights(nx, 1.0);
 
         for (unsigned ix = first; ix < last;  ++ix) {
             int x = examples[ix];
+            std::copy(data[x], data[x] + ni, &batch_data[(ix - first) * ni]);
 
-            double rmse_contribution;
-            double output;
+            distribution<float> target = output_encoder.target(labels[x]);
+            std::copy(target.begin(), target.end(),
+                      &batch_labels[(ix - first) * no]);
 
-            float weight = 1.0;
             if (weights.size())
-                weight = weights.at(x);
-
-            //cerr << "x " << x << " weight " << weight << endl;
-
-            std::tie(rmse_contribution, output)
-                = trainer.train_example(data[x],
-                                        labels[x],
-                                        local_updates,
-                                        output_encoder,
-                                        weight);
-            
-            outputs[ix] = output;
-            total_rmse_local += rmse_contribution;
+                batch_weights[ix - first] = weights.at(x);
         }
 
+        double total_rmse_local
+            = trainer.train_batch(nx, &batch_data[0], &batch_labels[0],
+                                  &batch_weights[0], local_updates,
+                                  &outputs[first]);
+
         Guard guard(updates_lock);
         total_rmse += total_rmse_local;
         updates.values += local_updates.values;
@@ -476,12 +521,24 @@ struct Test_Examples_Job {
     {
         double local_error_rmse = 0.0;
 
+        // Propagate the examples as a single minibatch
+        const Layer & layer = *trainer.layer;
+        int ni = layer.inputs(), no = layer.outputs();
+        int nx = last - first;
+
+        std::vector<float> batch_data(nx * ni), batch_outputs(nx * no);
+        std::vector<float> temp_space(nx * layer.fprop_temporary_space_required());
+
+        for (unsigned x = first;  x < last;  ++x)
+            std::copy(data[x], data[x] + ni, &batch_data[(x - first) * ni]);
+
+        layer.fprop_batch(nx, &batch_data[0], temp_space.data(),
+                          &batch_outputs[0]);
+
         for (unsigned x = first;  x < last;  ++x) {
-            distribution<float> output(trainer.layer->outputs());
-            trainer.layer->apply(data[x], &output[0]);
-            
-            outputs[x] = output[0];
-            local_error_rmse += pow(labels[x] - output[0], 2);
+            float output = batch_outputs[(x - first) * no];
+            outputs[x] = output;
+            local_error_rmse += pow(labels[x] - output, 2);
         }
 
         Guard guard(update_lock);
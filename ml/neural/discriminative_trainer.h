@@ -52,6 +52,20 @@ public:
                   Parameters_Copy<double> & updates,
                   float weight = 1.0) const;
 
+    /** Train a minibatch of num_examples examples at once, using the
+        minibatch propagation of the layer.  data is a num_examples x
+        inputs() matrix and labels a num_examples x outputs() matrix of
+        targets.  The first output of each example is written to outputs,
+        and the sum of the RMSE of the examples is returned.
+    */
+    double
+    train_batch(int num_examples,
+                const float * data,
+                const float * labels,
+                const float * weights,
+                Parameters_Copy<double> & updates,
+                float * outputs) const;
+
     std::pair<double, double>
     train_iter(const std::vector<distribution<float> > & data,
                const std::vector<Label> & labels,
@@ -391,6 +391,41 @@ bbprop(const double * inputs,
                                    example_weight);
 }
 
+void
+Layer::
+fprop_batch(int num_examples,
+            const float * inputs,
+            float * temp_space,
+            float * outputs) const
+{
+    size_t ni = this->inputs(), no = this->outputs();
+    size_t nt = fprop_temporary_space_required();
+
+    for (int x = 0;  x < num_examples;  ++x)
+        fprop(inputs + x * ni, temp_space + x * nt, nt, outputs + x * no);
+}
+
+void
+Layer::
+bprop_batch(int num_examples,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    size_t ni = this->inputs(), no = this->outputs();
+    size_t nt = fprop_temporary_space_required();
+
+    for (int x = 0;  x < num_examples;  ++x)
+        bprop(inputs + x * ni, outputs + x * no, temp_space + x * nt, nt,
+              output_errors + x * no,
+              input_errors ? input_errors + x * ni : 0,
+              gradient, example_weights[x]);
+}
+
 void
 Layer::
 validate() const
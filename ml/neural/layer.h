@@ -602,6 +602,71 @@ public:
     ///@}
 
 
+    /*************************************************************************/
+    /* MINIBATCH                                                             */
+    /*************************************************************************/
+
+    /** \name Minibatch Propagation
+
+        These functions perform the forward and backward propagation over
+        a whole minibatch of examples at once, which allows layers to
+        use matrix-matrix operations instead of one matrix-vector operation
+        per example.
+
+        The inputs, outputs and errors are row-major matrices with one row
+        per example.  The temporary space has num_examples *
+        fprop_temporary_space_required() elements, but its layout is up to
+        the layer; it is only passed back to the bprop_batch() of the same
+        layer.
+
+        The default implementations call fprop() and bprop() once per
+        example.
+
+        @{
+    */
+
+    /** Forward propagation of num_examples examples.
+
+        \param inputs      num_examples x inputs() matrix of inputs
+        \param temp_space  num_examples * fprop_temporary_space_required()
+                           elements of temporary space
+        \param outputs     num_examples x outputs() matrix in which the
+                           outputs will be stored
+    */
+    virtual void fprop_batch(int num_examples,
+                             const float * inputs,
+                             float * temp_space,
+                             float * outputs) const;
+
+    /** Backward propagation of num_examples examples.  The gradient has
+        the sum over the examples of example_weights[x] * dE/dparam added
+        to it.
+
+        \param inputs      the inputs passed to fprop_batch()
+        \param outputs     the outputs calculated by fprop_batch()
+        \param temp_space  the temporary space filled in by fprop_batch()
+        \param output_errors num_examples x outputs() matrix with the
+                           derivative of the error with respect to each
+                           output
+        \param input_errors num_examples x inputs() matrix in which the
+                           derivative of the error with respect to each
+                           input is stored, or null if not needed.  Unlike
+                           bprop(), it may not overlap with output_errors.
+        \param gradient    parameters to be updated
+        \param example_weights num_examples weights, one per example
+    */
+    virtual void bprop_batch(int num_examples,
+                             const float * inputs,
+                             const float * outputs,
+                             const float * temp_space,
+                             const float * output_errors,
+                             float * input_errors,
+                             Parameters & gradient,
+                             const float * example_weights) const;
+
+    ///@}
+
+
 protected:
     std::string name_;
     size_t inputs_, outputs_;
@@ -271,6 +271,24 @@ struct Layer_Stack : public Layer {
                         Parameters * dgradient,
                         double example_weight) const;
 
+    /** Minibatch propagation through each of the layers in turn.  The
+        temporary space holds, for each layer, the temporary space of the
+        layer followed by its outputs (except for the last layer).
+    */
+    virtual void fprop_batch(int num_examples,
+                             const float * inputs,
+                             float * temp_space,
+                             float * outputs) const;
+
+    virtual void bprop_batch(int num_examples,
+                             const float * inputs,
+                             const float * outputs,
+                             const float * temp_space,
+                             const float * output_errors,
+                             float * input_errors,
+                             Parameters & gradient,
+                             const float * example_weights) const;
+
     virtual void random_fill(float limit, Thread_Context & context);
 
     virtual void zero_fill();
@@ -588,6 +588,90 @@ bbprop(const double * inputs,
                    d2input_errors, gradient, dgradient, example_weight);
 }
 
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+fprop_batch(int num_examples,
+            const float * inputs,
+            float * temp_space,
+            float * outputs) const
+{
+    const float * curr_inputs = inputs;
+
+    for (unsigned i = 0;  i < size();  ++i) {
+        size_t layer_temp_space_size
+            = num_examples * layers_[i]->fprop_temporary_space_required();
+
+        float * curr_outputs
+            = (i == size() - 1
+               ? outputs
+               : temp_space + layer_temp_space_size);
+
+        layers_[i]->fprop_batch(num_examples, curr_inputs, temp_space,
+                                curr_outputs);
+
+        curr_inputs = curr_outputs;
+
+        temp_space += layer_temp_space_size;
+        if (i != size() - 1)
+            temp_space += num_examples * layers_[i]->outputs();
+    }
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+bprop_batch(int num_examples,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    const float * curr_temp_space
+        = temp_space + num_examples * fprop_temporary_space_required();
+
+    const float * curr_outputs = outputs;
+
+    // The errors kept between the layers.  The input and output errors
+    // of a layer can't overlap, so we alternate between two buffers.
+    std::vector<float> errors1(num_examples * max_internal_width());
+    std::vector<float> errors2(num_examples * max_internal_width());
+
+    for (int i = size() - 1;  i >= 0;  --i) {
+        curr_temp_space
+            -= num_examples * layers_[i]->fprop_temporary_space_required();
+
+        const float * curr_inputs
+            = (i == 0
+               ? inputs
+               : curr_temp_space - num_examples * layers_[i]->inputs());
+
+        const float * curr_output_errors
+            = (i == size() - 1 ? output_errors : &errors1[0]);
+
+        float * curr_input_errors
+            = (i == 0 ? input_errors : &errors2[0]);
+
+        layers_[i]->bprop_batch(num_examples, curr_inputs, curr_outputs,
+                                curr_temp_space, curr_output_errors,
+                                curr_input_errors,
+                                gradient.subparams(i, layers_[i]->name()),
+                                example_weights);
+
+        errors1.swap(errors2);
+
+        curr_outputs = curr_inputs;
+        if (i != 0)
+            curr_temp_space -= num_examples * layers_[i]->inputs();
+    }
+
+    if (curr_temp_space != temp_space)
+        throw Exception("Layer_Stack::bprop_batch(): out of sync");
+}
+
 template<class LayerT>
 void
 Layer_Stack<LayerT>::
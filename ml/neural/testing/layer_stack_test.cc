@@ -413,3 +413,94 @@ BOOST_AUTO_TEST_CASE( test_bprop_three_nonlinear_layers )
 
     bprop_test<double>(layers, context, 0.1);
 }
+
+/** Check that the minibatch propagation gives the same outputs, input
+    errors and gradient as propagating the examples one at a time. */
+void batch_test(const Layer & layer, Thread_Context & context,
+                bool with_missing, double tolerance = 1e-4)
+{
+    int nx = 17, ni = layer.inputs(), no = layer.outputs();
+    size_t nt = layer.fprop_temporary_space_required();
+
+    vector<float> inputs(nx * ni), output_errors(nx * no), weights(nx);
+    for (unsigned i = 0;  i < inputs.size();  ++i) {
+        if (with_missing && i % 7 == 3)
+            inputs[i] = numeric_limits<float>::quiet_NaN();
+        else inputs[i] = context.random01() * 2.0 - 1.0;
+    }
+    for (auto & e: output_errors)
+        e = context.random01() * 2.0 - 1.0;
+    for (auto & w: weights)
+        w = context.random01();
+
+    // One at a time
+    vector<float> outputs1(nx * no), input_errors1(nx * ni);
+    Parameters_Copy<double> gradient1(layer);
+    gradient1.fill(0.0);
+
+    for (unsigned x = 0;  x < nx;  ++x) {
+        vector<float> temp_space(nt);
+        layer.fprop(&inputs[x * ni], temp_space.data(), nt, &outputs1[x * no]);
+        layer.bprop(&inputs[x * ni], &outputs1[x * no], temp_space.data(), nt,
+                    &output_errors[x * no], &input_errors1[x * ni],
+                    gradient1, weights[x]);
+    }
+
+    // As a minibatch
+    vector<float> outputs2(nx * no), input_errors2(nx * ni);
+    vector<float> temp_space(nx * nt);
+    Parameters_Copy<double> gradient2(layer);
+    gradient2.fill(0.0);
+
+    layer.fprop_batch(nx, &inputs[0], temp_space.data(), &outputs2[0]);
+    layer.bprop_batch(nx, &inputs[0], &outputs2[0], temp_space.data(),
+                      &output_errors[0], &input_errors2[0], gradient2,
+                      &weights[0]);
+
+    for (unsigned i = 0;  i < outputs1.size();  ++i)
+        BOOST_CHECK_LE(fabs(outputs1[i] - outputs2[i]), tolerance);
+    for (unsigned i = 0;  i < input_errors1.size();  ++i)
+        BOOST_CHECK_LE(fabs(input_errors1[i] - input_errors2[i]), tolerance);
+
+    BOOST_REQUIRE_EQUAL(gradient1.values.size(), gradient2.values.size());
+    for (unsigned i = 0;  i < gradient1.values.size();  ++i)
+        BOOST_CHECK_LE(fabs(gradient1.values[i] - gradient2.values[i]),
+                       tolerance);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_one_layer )
+{
+    Thread_Context context;
+    Dense_Layer<float> layer("test", 5, 10, TF_TANH, MV_NONE, context);
+    batch_test(layer, context, false);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_three_layers )
+{
+    Thread_Context context;
+    Dense_Layer<float> layer1("test1", 5, 10, TF_TANH, MV_ZERO, context);
+    Dense_Layer<float> layer2("test2", 10, 20, TF_LOGSIG, MV_NONE, context);
+    Dense_Layer<float> layer3("test3", 20, 3, TF_IDENTITY, MV_NONE, context);
+
+    Layer_Stack<Dense_Layer<float> > layers("test_layers");
+    layers.add(make_unowned_sp(layer1));
+    layers.add(make_unowned_sp(layer2));
+    layers.add(make_unowned_sp(layer3));
+
+    batch_test(layers, context, false);
+    batch_test(layers, context, true);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_missing_per_example )
+{
+    // These missing values are handled one example at a time
+    Thread_Context context;
+    Dense_Layer<double> layer1("test1", 5, 10, TF_TANH, MV_DENSE, context);
+    Dense_Layer<double> layer2("test2", 10, 4, TF_TANH, MV_INPUT, context);
+
+    Layer_Stack<Dense_Layer<double> > layers("test_layers");
+    layers.add(make_unowned_sp(layer1));
+    layers.add(make_unowned_sp(layer2));
+
+    batch_test(layers, context, true);
+}
@@ -5,4 +5,106 @@
     This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
 */
 
-#include "randomforest.h"
\ No newline at end of file
+#include "randomforest.h"
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARTITION DATA                                                            */
+/*****************************************************************************/
+
+PartitionData::Histograms
+PartitionData::
+buildHistograms() const
+{
+    // Each chunk of rows needs a histogram of its own, so we only cut up
+    // partitions that are big enough to make it pay, and then only as
+    // much as is needed to keep all of the cores busy.
+    static constexpr size_t MIN_ROWS_PER_CHUNK = 65536;
+
+    int nf = features.size();
+
+    size_t activeFeatures = 0;
+    for (auto & f: features)
+        activeFeatures += f.active;
+
+    size_t numChunks = 1;
+    if (activeFeatures > 0) {
+        size_t wantedChunks
+            = (numCpus() + activeFeatures - 1) / activeFeatures;
+        numChunks = std::max<size_t>(1, std::min(wantedChunks,
+                                                 rows.size() / MIN_ROWS_PER_CHUNK));
+    }
+
+    size_t rowsPerChunk = (rows.size() + numChunks - 1) / numChunks;
+
+    std::vector<Histograms> chunks(numChunks, Histograms(nf));
+
+    // Each job accumulates one feature over one chunk of rows
+    auto doJob = [&] (size_t job)
+        {
+            int f = job % nf;
+            size_t chunk = job / nf;
+
+            if (!features[f].active)
+                return;
+
+            std::vector<W> & w = chunks[chunk][f];
+            w.resize(features[f].buckets.numBuckets);
+
+            const BucketList & buckets = features[f].buckets;
+
+            size_t first = chunk * rowsPerChunk;
+            size_t last = std::min(rows.size(), first + rowsPerChunk);
+
+            for (size_t i = first;  i < last;  ++i) {
+                const Row & r = rows[i];
+                w[buckets[r.exampleNum]][r.label] += r.weight;
+            }
+        };
+
+    parallelMap(0, nf * numChunks, doJob);
+
+    Histograms & result = chunks[0];
+
+    if (numChunks > 1) {
+        auto mergeFeature = [&] (int f)
+            {
+                if (!features[f].active)
+                    return;
+                for (size_t c = 1;  c < numChunks;  ++c) {
+                    const std::vector<W> & w = chunks[c][f];
+                    for (size_t j = 0;  j < w.size();  ++j)
+                        result[f][j] += w[j];
+                }
+            };
+
+        parallelMap(0, nf, mergeFeature);
+    }
+
+    return std::move(result);
+}
+
+void
+PartitionData::
+subtractHistograms(Histograms & parent,
+                   const Histograms & side,
+                   const std::vector<Feature> & features)
+{
+    ExcAssertEqual(parent.size(), features.size());
+    ExcAssertEqual(side.size(), features.size());
+
+    for (size_t f = 0;  f < features.size();  ++f) {
+        if (!features[f].active) {
+            std::vector<W>().swap(parent[f]);
+            continue;
+        }
+
+        ExcAssertEqual(parent[f].size(), side[f].size());
+        for (size_t j = 0;  j < side[f].size();  ++j)
+            parent[f][j] -= side[f][j];
+    }
+}
+
+} // namespace MLDB
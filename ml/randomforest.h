@@ -247,6 +247,31 @@ struct PartitionData {
 
     typedef WT<ML::FixedPointAccum64> W;
 
+    /** Histogram of the weight of each label in each bucket, for each of
+        the features of the partition.  Features that weren't active when
+        it was built have an empty entry.
+
+        The weights are fixed point, which makes adding and subtracting
+        them exact.  That means that the histogram of one side of a split
+        can be computed as the parent's histogram minus that of the other
+        side, and comes out identical to building it from the rows.
+    */
+    typedef std::vector<std::vector<W> > Histograms;
+
+    /** Build the histograms of all active features from the rows.  Large
+        partitions are cut into chunks of rows that are accumulated into
+        separate histograms in parallel, and then added together.
+    */
+    Histograms buildHistograms() const;
+
+    /** Subtract the histograms of one side of a split from those of its
+        parent, in place, leaving those of the other side.  Entries for
+        features that aren't active in the given partition are freed.
+    */
+    static void subtractHistograms(Histograms & parent,
+                                   const Histograms & side,
+                                   const std::vector<Feature> & features);
+
     /** Split the partition here. */
     std::pair<PartitionData, PartitionData>
     split(int featureToSplitOn, int splitValue, const W & wLeft, const W & wRight, const W & wAll)
@@ -357,8 +382,10 @@ struct PartitionData {
         return { std::move(left), std::move(right) };
     }
 
-    /** Test all features for a split.  Returns the feature number,
-        the bucket number and the goodness of the split.
+    /** Test all features for a split, using the given histograms of this
+        partition.  Returns the feature number, the bucket number and the
+        goodness of the split.  Features whose examples are all in the same
+        bucket are made inactive.
 
         Outputs
         - Z score of split
@@ -369,15 +396,13 @@ struct PartitionData {
         - W total (in case no split is found)
     */
     std::tuple<double, int, int, W, W, W>
-    testAll(int depth)
+    testAll(int depth, const Histograms & w)
     {
         bool debug = false;
 
         int nf = features.size();
 
-        // For each feature, for each bucket, for each label
-        // weight for each bucket and last valid bucket
-        std::vector< std::vector<W> > w(nf);
+        // Last non-empty bucket of each feature
         std::vector< int > maxSplits(nf);
 
         size_t totalNumBuckets = 0;
@@ -386,8 +411,25 @@ struct PartitionData {
         for (unsigned i = 0;  i < nf;  ++i) {
             if (!features[i].active)
                 continue;
+            ExcAssertEqual(w[i].size(), features[i].buckets.numBuckets);
+
+            int maxBucket = -1;
+            int numNonEmpty = 0;
+            for (unsigned j = 0;  j < w[i].size();  ++j) {
+                if (w[i][j].empty())
+                    continue;
+                maxBucket = j;
+                ++numNonEmpty;
+            }
+
+            // If all examples were in a single bucket, then the
+            // feature is no longer active.
+            if (numNonEmpty < 2)
+                features[i].active = false;
+
+            maxSplits[i] = maxBucket;
+
             ++activeFeatures;
-            w[i].resize(features[i].buckets.numBuckets);
             totalNumBuckets += features[i].buckets.numBuckets;
         }
 
@@ -398,49 +440,8 @@ struct PartitionData {
         }
 
         W wAll;
-
-        auto doFeature = [&] (int i)
-            {
-                int maxBucket = -1;
-
-                if (i == nf) {
-                    for (auto & r: rows) {
-                        wAll[r.label] += r.weight;
-                    }
-                    return;
-                }
-
-                if (!features[i].active)
-                    return;
-                bool twoBuckets = false;
-                int lastBucket = -1;
-
-                for (size_t j = 0;  j < rows.size();  ++j) {
-                    auto & r = rows[j];
-                    int bucket = features[i].buckets[r.exampleNum];
-
-                    twoBuckets = twoBuckets
-                        || (lastBucket != -1 && bucket != lastBucket);
-                    lastBucket = bucket;
-
-                    w[i][bucket][r.label] += r.weight;
-                    maxBucket = std::max(maxBucket, bucket);
-                }
-
-                // If all examples were in a single bucket, then the
-                // feature is no longer active.
-                if (!twoBuckets)
-                    features[i].active = false;
-
-                maxSplits[i] = maxBucket;
-            };
-
-        if (depth < 4 || true) {
-            parallelMap(0, nf + 1, doFeature);
-        }
-        else {
-            for (unsigned i = 0;  i <= nf;  ++i)
-                doFeature(i);
+        for (auto & r: rows) {
+            wAll[r.label] += r.weight;
         }
 
         // We have no impurity in our bucket.  Time to stop
@@ -599,6 +600,17 @@ struct PartitionData {
 
     ML::Tree::Ptr train(int depth, int maxDepth,
                         ML::Tree & tree)
+    {
+        return train(depth, maxDepth, tree, Histograms());
+    }
+
+    /** Train the tree under this partition.  The histograms of the
+        partition are passed if the parent computed them, or are empty
+        if they need to be built from the rows.
+    */
+    ML::Tree::Ptr train(int depth, int maxDepth,
+                        ML::Tree & tree,
+                        Histograms histograms)
     {
         if (rows.empty())
             return ML::Tree::Ptr();
@@ -608,6 +620,9 @@ struct PartitionData {
         if (depth >= maxDepth)
             return getLeaf(tree);
 
+        if (histograms.empty())
+            histograms = buildHistograms();
+
         double bestScore;
         int bestFeature;
         int bestSplit;
@@ -616,7 +631,7 @@ struct PartitionData {
         W wAll;
         
         std::tie(bestScore, bestFeature, bestSplit, wLeft, wRight, wAll)
-            = testAll(depth);
+            = testAll(depth, histograms);
 
         if (bestFeature == -1) {
             ML::Tree::Leaf * leaf = tree.new_leaf();
@@ -625,6 +640,12 @@ struct PartitionData {
             return leaf;
         }
 
+        // The split gives away our features, so keep what we need of
+        // the one we split on
+        const DatasetFeatureSpace::ColumnInfo * splitInfo
+            = features[bestFeature].info;
+        bool splitOrdinal = features[bestFeature].ordinal;
+
         std::pair<PartitionData, PartitionData> splits
             = split(bestFeature, bestSplit, wLeft, wRight, wAll);
 
@@ -633,16 +654,43 @@ struct PartitionData {
         //cerr << "left had " << splits.first.rows.size() << " rows" << endl;
         //cerr << "right had " << splits.second.rows.size() << " rows" << endl;
 
-        ML::Tree::Ptr left, right;
-        auto runLeft = [&] () { left = splits.first.train(depth + 1, maxDepth, tree); };
-        auto runRight = [&] () { right = splits.second.train(depth + 1, maxDepth, tree); };
-
         size_t leftRows = splits.first.rows.size();
         size_t rightRows = splits.second.rows.size();
 
         if (leftRows == 0 || rightRows == 0)
             throw MLDB::Exception("Invalid split in random forest");
 
+        // Only the smaller side's histograms are built from its rows; the
+        // larger side's are what is left of ours once they are taken
+        // away.  There's no need for them if the children will be leaves.
+        PartitionData & smaller
+            = leftRows < rightRows ? splits.first : splits.second;
+        Histograms smallerHistograms, largerHistograms;
+        if (depth + 1 < maxDepth) {
+            smallerHistograms = smaller.buildHistograms();
+            subtractHistograms(histograms, smallerHistograms,
+                               smaller.features);
+            largerHistograms = std::move(histograms);
+        }
+        Histograms().swap(histograms);
+
+        Histograms & leftHistograms
+            = leftRows < rightRows ? smallerHistograms : largerHistograms;
+        Histograms & rightHistograms
+            = leftRows < rightRows ? largerHistograms : smallerHistograms;
+
+        ML::Tree::Ptr left, right;
+        auto runLeft = [&] ()
+            {
+                left = splits.first.train(depth + 1, maxDepth, tree,
+                                          std::move(leftHistograms));
+            };
+        auto runRight = [&] ()
+            {
+                right = splits.second.train(depth + 1, maxDepth, tree,
+                                            std::move(rightHistograms));
+            };
+
         ThreadPool tp;
         // Put the smallest one on the thread pool, so that we have the highest
         // probability of running both on our thread in case of lots of work.
@@ -659,10 +707,10 @@ struct PartitionData {
 
         if (left && right) {
             ML::Tree::Node * node = tree.new_node();
-            ML::Feature feature = fs->getFeature(features[bestFeature].info->columnName);
+            ML::Feature feature = fs->getFeature(splitInfo->columnName);
             float splitVal = 0;
-            if (features[bestFeature].ordinal) {
-                auto splitCell = features[bestFeature].info->bucketDescriptions
+            if (splitOrdinal) {
+                auto splitCell = splitInfo->bucketDescriptions
                     .getSplit(bestSplit);
                 if (splitCell.isNumeric())
                     splitVal = splitCell.toDouble();
@@ -673,7 +721,7 @@ struct PartitionData {
             }
 
             ML::Split split(feature, splitVal,
-                            features[bestFeature].ordinal
+                            splitOrdinal
                             ? ML::Split::LESS : ML::Split::EQUAL);
             
             node->split = split;
@@ -10,6 +10,7 @@
 #include "mldb/arch/exception.h"
 #include "mldb/base/exc_assert.h"
 #include <boost/utility.hpp>
+#include <cstring>
 #include "mldb/vfs/filter_streams.h"
 
 
@@ -267,8 +268,8 @@ calculate()
         current.counts[label][false] -= weight;
         current.counts[label][true] += weight;
 
-        current.unweighted_counts[label][false] -= 1;
-        current.unweighted_counts[label][true] += 1;
+        current.unweighted_counts[label][false] -= entry.count;
+        current.unweighted_counts[label][true] += entry.count;
 
     }
     
@@ -379,4 +380,93 @@ toJson() const
     return result;
 }
 
+
+/*****************************************************************************/
+/* SCORE HISTOGRAM                                                           */
+/*****************************************************************************/
+
+ScoreHistogram::
+ScoreHistogram(int mantissaBits)
+    : mantissaBits(mantissaBits)
+{
+    if (mantissaBits < 1 || mantissaBits > 23)
+        throw MLDB::Exception("score histogram precision must be between "
+                              "1 and 23 bits");
+}
+
+float
+ScoreHistogram::
+roundScore(float score) const
+{
+    if (!std::isfinite(score))
+        return score;
+
+    // Round the magnitude to the nearest value with only mantissaBits bits
+    // of mantissa.  Carrying into the exponent gives the next binade, so
+    // this is monotonic in the score.
+    uint32_t bits;
+    std::memcpy(&bits, &score, sizeof(bits));
+    int dropped = 23 - mantissaBits;
+    uint32_t sign = bits & 0x80000000U;
+    uint32_t magnitude = bits & 0x7fffffffU;
+    if (dropped > 0) {
+        magnitude += 1U << (dropped - 1);
+        magnitude &= ~((1U << dropped) - 1);
+    }
+    bits = sign | magnitude;
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void
+ScoreHistogram::
+update(bool label, float score, double weight)
+{
+    Bin & bin = bins[roundScore(score)];
+    bin.weights[label] += weight;
+    bin.counts[label] += 1;
+}
+
+void
+ScoreHistogram::
+add(const ScoreHistogram & other)
+{
+    ExcAssertEqual(mantissaBits, other.mantissaBits);
+
+    for (auto & b: other.bins) {
+        Bin & bin = bins[b.first];
+        for (unsigned label = 0;  label < 2;  ++label) {
+            bin.weights[label] += b.second.weights[label];
+            bin.counts[label] += b.second.counts[label];
+        }
+    }
+}
+
+ScoredStats
+ScoreHistogram::
+toScoredStats() const
+{
+    ScoredStats result;
+    result.entries.reserve(bins.size() * 2);
+
+    for (auto & b: bins) {
+        for (unsigned label = 0;  label < 2;  ++label) {
+            if (b.second.counts[label] == 0)
+                continue;
+            ScoredStats::ScoredEntry entry;
+            entry.label = label;
+            entry.score = b.first;
+            entry.weight = b.second.weights[label];
+            entry.count = b.second.counts[label];
+            result.entries.push_back(entry);
+        }
+    }
+
+    result.sort();
+    result.calculate();
+    return result;
+}
+
 } // namespace MLDB
@@ -14,6 +14,7 @@
 #include "mldb/jml/utils/rng.h"
 #include "mldb/ext/jsoncpp/json.h"
 #include <cmath>
+#include <unordered_map>
 #include <boost/any.hpp>
 
 
@@ -201,6 +202,7 @@ struct ScoredStats {
         entry.label = label;
         entry.score = score;
         entry.weight = weight;
+        entry.count = 1;
         entry.key = key;
         
         if (isSorted && !entries.empty() && entry < entries.back())
@@ -214,6 +216,7 @@ struct ScoredStats {
         bool label;      ///< Label for the entry
         float score;     ///< Score for the entry
         float weight;
+        float count;     ///< Number of examples the entry stands for
 
         bool operator < (const ScoredEntry & other) const
         {
@@ -266,4 +269,55 @@ struct ScoredStats {
     Json::Value toJson() const;
 };
 
+
+/*****************************************************************************/
+/* SCORE HISTOGRAM                                                           */
+/*****************************************************************************/
+
+/** Streaming summary of scored examples, for when there are too many of
+    them to keep and sort in a ScoredStats.  Scores are rounded to a
+    relative precision of 2^-mantissaBits, and the total weight and count
+    of each label is kept per rounded score.  The memory used depends on
+    the number of distinct rounded scores rather than the number of
+    examples, and histograms can be added together in any order, so each
+    thread can have its own.
+
+    Examples whose scores round to the same value are tied, so the AUC and
+    the curve points are those of the exact calculation with the scores
+    rounded to that precision.
+*/
+
+struct ScoreHistogram {
+
+    ScoreHistogram(int mantissaBits = 12);
+
+    /** Update with the given values. */
+    void update(bool label, float score, double weight = 1.0);
+
+    /** Add the other histogram to this one.  They must have the same
+        precision.
+    */
+    void add(const ScoreHistogram & other);
+
+    /** Return the scored stats with one entry per label and rounded
+        score, sorted and with calculate() called.
+    */
+    ScoredStats toScoredStats() const;
+
+    /** Return the score rounded to the precision of the histogram. */
+    float roundScore(float score) const;
+
+    size_t size() const { return bins.size(); }
+
+    struct Bin {
+        double weights[2] = { 0.0, 0.0 };   ///< Total weight per label
+        double counts[2] = { 0.0, 0.0 };    ///< Number of examples per label
+    };
+
+    int mantissaBits;
+
+    /// Bins, indexed by the rounded score
+    std::unordered_map<float, Bin> bins;
+};
+
 } // namespace MLDB
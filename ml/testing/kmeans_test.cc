@@ -15,6 +15,8 @@
 #include "mldb/utils/testing/fixtures.h"
 #include <iostream>
 #include <stdlib.h>
+#include <random>
+#include <set>
 
 using namespace MLDB;
 using namespace ML;
@@ -103,3 +105,97 @@ BOOST_FIXTURE_TEST_CASE( test_kmeans, kmeans_test )
     test();
 
 }
+
+namespace {
+
+/** Euclidean metric which doesn't let training prune with the triangle
+    inequality, to compare with the pruned version. */
+struct UnprunedEuclideanMetric: public KMeansEuclideanMetric {
+    bool satisfiesTriangleInequality() const { return false; }
+};
+
+/** Points around numClusters well separated centres, in order. */
+vector<distribution<float> >
+makeBlobs(int numClusters, int nbPerClass, int numDims)
+{
+    std::mt19937 rng(3);
+    std::normal_distribution<float> noise;
+    vector<distribution<float> > result;
+    for (int k = 0;  k < numClusters;  ++k) {
+        distribution<float> centre(numDims);
+        for (auto & c: centre)
+            c = 100.0 * noise(rng);
+        for (int i = 0;  i < nbPerClass;  ++i) {
+            distribution<float> point = centre;
+            for (auto & c: point)
+                c += noise(rng);
+            result.push_back(point);
+        }
+    }
+    return result;
+}
+
+/** Check that each blob ended up in its own cluster. */
+void checkBlobs(const vector<int> & in_cluster, int numClusters,
+                int nbPerClass)
+{
+    std::set<int> seen;
+    for (int k = 0;  k < numClusters;  ++k) {
+        int cluster = in_cluster[k * nbPerClass];
+        for (int i = 0;  i < nbPerClass;  ++i)
+            BOOST_CHECK_EQUAL(in_cluster[k * nbPerClass + i], cluster);
+        seen.insert(cluster);
+    }
+    BOOST_CHECK_EQUAL(seen.size(), numClusters);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_kmeans_parallel_init_pruned )
+{
+    int numClusters = 20, nbPerClass = 50, numDims = 8;
+    auto data = makeBlobs(numClusters, nbPerClass, numDims);
+
+    KMeans pruned;
+    pruned.initialization = KMEANS_INIT_PARALLEL;
+    vector<int> in_cluster;
+    pruned.train(data, in_cluster, numClusters, 100);
+    checkBlobs(in_cluster, numClusters, nbPerClass);
+
+    // Pruning must not change the result
+    KMeans unpruned(new UnprunedEuclideanMetric());
+    unpruned.initialization = KMEANS_INIT_PARALLEL;
+    vector<int> in_cluster2;
+    unpruned.train(data, in_cluster2, numClusters, 100);
+    BOOST_CHECK(in_cluster == in_cluster2);
+
+    // Fewer distinct points than clusters
+    vector<distribution<float> > few(data.begin(), data.begin() + 3);
+    KMeans tiny;
+    tiny.initialization = KMEANS_INIT_PARALLEL;
+    vector<int> in_cluster3;
+    tiny.train(few, in_cluster3, 5, 10);
+    BOOST_CHECK_EQUAL(tiny.clusters.size(), 5);
+}
+
+BOOST_AUTO_TEST_CASE( test_kmeans_mini_batch )
+{
+    int numClusters = 10, nbPerClass = 200, numDims = 4;
+    auto data = makeBlobs(numClusters, nbPerClass, numDims);
+
+    for (auto metric: { (KMeansMetric *) new KMeansEuclideanMetric(),
+                        (KMeansMetric *) new KMeansCosineMetric() }) {
+        KMeans kmeans(metric);
+        kmeans.initialization = KMEANS_INIT_PARALLEL;
+        kmeans.miniBatchSize = 100;
+        vector<int> in_cluster;
+        kmeans.train(data, in_cluster, numClusters, 100);
+
+        checkBlobs(in_cluster, numClusters, nbPerClass);
+
+        int total = 0;
+        for (auto & c: kmeans.clusters)
+            total += c.nbMembers;
+        BOOST_CHECK_EQUAL(total, data.size());
+    }
+}
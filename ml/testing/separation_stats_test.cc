@@ -0,0 +1,94 @@
+/** separation_stats_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the exact and streaming calculation of separation stats.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/ml/separation_stats.h"
+#include <random>
+
+using namespace MLDB;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_round_score )
+{
+    ScoreHistogram histogram(10);
+
+    mt19937 rng(1);
+    uniform_real_distribution<float> scores(-100.0, 100.0);
+
+    for (unsigned i = 0;  i < 10000;  ++i) {
+        float s1 = scores(rng), s2 = scores(rng);
+        float r1 = histogram.roundScore(s1), r2 = histogram.roundScore(s2);
+
+        BOOST_CHECK_LE(fabs(r1 - s1), fabs(s1) / 2048.0);
+        if (s1 <= s2)
+            BOOST_CHECK_LE(r1, r2);
+        else BOOST_CHECK_GE(r1, r2);
+    }
+
+    BOOST_CHECK_EQUAL(histogram.roundScore(0.0), 0.0);
+    BOOST_CHECK_EQUAL(histogram.roundScore(0.5), 0.5);
+    BOOST_CHECK_EQUAL(histogram.roundScore(-0.75), -0.75);
+    BOOST_CHECK_EQUAL(histogram.roundScore(INFINITY), INFINITY);
+}
+
+BOOST_AUTO_TEST_CASE( test_streaming_same_as_exact )
+{
+    mt19937 rng(1);
+    normal_distribution<float> noise(0.0, 1.0);
+    uniform_real_distribution<float> weights(0.5, 2.0);
+
+    size_t numExamples = 200000;
+
+    for (bool onGrid: { true, false }) {
+        ScoredStats exact;
+        ScoreHistogram histogram1(12), histogram2(12);
+
+        for (unsigned i = 0;  i < numExamples;  ++i) {
+            bool label = i % 3 == 0;
+            float score = noise(rng) + label;
+
+            // Scores with few bits of mantissa aren't changed by rounding,
+            // so the results must be exactly the same
+            if (onGrid)
+                score = std::round(score * 16.0) / 16.0;
+
+            double weight = weights(rng);
+            exact.update(label, score, weight);
+            (i % 2 ? histogram1 : histogram2).update(label, score, weight);
+        }
+
+        exact.calculate();
+
+        histogram1.add(histogram2);
+        ScoredStats streamed = histogram1.toScoredStats();
+
+        if (onGrid) {
+            BOOST_CHECK_CLOSE(streamed.auc, exact.auc, 1e-6);
+            BOOST_CHECK_EQUAL(streamed.stats.size(), exact.stats.size());
+            BOOST_CHECK_CLOSE(streamed.bestF.f(), exact.bestF.f(), 1e-4);
+            BOOST_CHECK_EQUAL(streamed.bestF.threshold, exact.bestF.threshold);
+            BOOST_CHECK_CLOSE(streamed.bestMcc.mcc(), exact.bestMcc.mcc(), 1e-4);
+        }
+        else {
+            // Far fewer bins than examples
+            BOOST_CHECK_LT(histogram1.size(), numExamples / 4);
+            BOOST_CHECK_LT(fabs(streamed.auc - exact.auc), 1e-3);
+            BOOST_CHECK_LT(fabs(streamed.bestF.f() - exact.bestF.f()), 1e-3);
+        }
+
+        // The unweighted counts are the number of examples
+        BOOST_CHECK_EQUAL(streamed.stats.back().includedPopulation(false),
+                          numExamples);
+        BOOST_CHECK_CLOSE(streamed.stats.back().includedPopulation(),
+                          exact.stats.back().includedPopulation(), 1e-4);
+    }
+}
@@ -0,0 +1,440 @@
+/** hnsw_index.h                                                   -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Hierarchical Navigable Small World graph, for approximate nearest
+    neighbor search over large numbers of points.  See Malkov and Yashunin,
+    "Efficient and robust approximate nearest neighbor search using
+    Hierarchical Navigable Small World graphs", 2016.
+*/
+
+#pragma once
+
+#include "mldb/base/exc_assert.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/utils/lightweight_hash.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+/** Graph over the items 0 to size() - 1, where each item is linked to
+    items that are close to it.  Each item lives on level 0 and, with
+    exponentially decreasing probability, on some levels above it; a search
+    walks greedily down from the sparse top levels to find where to start
+    on level 0.
+
+    The index doesn't know about coordinates: inserting and searching are
+    passed a function giving the distance between two items, or between
+    an item and the query.
+
+    Items can be inserted from several threads at once, as long as
+    resize() isn't called at the same time.  Searching isn't safe while
+    items are being inserted.
+*/
+
+struct HnswIndex {
+
+    /** Create an index where each item is linked to at most maxNeighbors
+        others (2 * maxNeighbors on level 0), and where the search used to
+        find them looks at the buildSearchWidth closest candidates.  Higher
+        values give better recall, at the cost of a slower and larger
+        index.
+    */
+    HnswIndex(int maxNeighbors = 16, int buildSearchWidth = 200)
+        : maxNeighbors(maxNeighbors),
+          buildSearchWidth(buildSearchWidth),
+          entryPoint(-1), topLevel(-1)
+    {
+        ExcAssertGreater(maxNeighbors, 1);
+        ExcAssertGreater(buildSearchWidth, 0);
+    }
+
+    HnswIndex(const HnswIndex & other)
+        : maxNeighbors(other.maxNeighbors),
+          buildSearchWidth(other.buildSearchWidth),
+          links(other.links),
+          entryPoint(other.entryPoint),
+          topLevel(other.topLevel)
+    {
+    }
+
+    HnswIndex & operator = (const HnswIndex & other) = delete;
+
+    typedef std::function<float (int, int)> ItemDistance;
+    typedef std::function<float (int)> QueryDistance;
+
+    int maxNeighbors;
+    int buildSearchWidth;
+
+    /// Number of items the index has room for
+    size_t size() const
+    {
+        return links.size();
+    }
+
+    /** Make room for items up to n - 1.  Not thread safe. */
+    void resize(size_t n)
+    {
+        ExcAssertGreaterEqual(n, links.size());
+        links.resize(n);
+    }
+
+    /** Insert the given item, which must be less than size(), into the
+        index.  dist(x, y) returns the distance between items x and y.
+    */
+    void insert(int item, const ItemDistance & dist)
+    {
+        ExcAssertGreaterEqual(item, 0);
+        ExcAssertLess(item, links.size());
+
+        int level = randomLevel(item);
+
+        {
+            std::unique_lock<std::mutex> guard(lockFor(item));
+            ExcAssert(links[item].empty());
+            links[item].resize(level + 1);
+        }
+
+        // Inserting an item at a new top level changes the entry point,
+        // which other inserts need to wait for.
+        std::unique_lock<std::mutex> entryGuard(entryLock);
+        int entry = entryPoint;
+        int top = topLevel;
+
+        if (entry == -1) {
+            entryPoint = item;
+            topLevel = level;
+            return;
+        }
+
+        if (level <= top)
+            entryGuard.unlock();
+
+        auto distToItem = [&] (int other) { return dist(item, other); };
+
+        float entryDist = distToItem(entry);
+
+        for (int l = top;  l > level;  --l)
+            greedySearch<true>(distToItem, entry, entryDist, l);
+
+        // Choose the links on every level before linking anything back to
+        // the item.  Otherwise another insert could find it on an upper
+        // level and walk down to where it has no links yet.
+        int numLevels = std::min(top, level) + 1;
+        std::vector<std::vector<std::pair<float, int> > > selected(numLevels);
+
+        for (int l = numLevels - 1;  l >= 0;  --l) {
+            std::vector<std::pair<float, int> > candidates
+                = searchLevel<true>(distToItem, entry, entryDist,
+                                    buildSearchWidth, l);
+
+            std::vector<int> chosen
+                = selectNeighbors(candidates, maxNeighbors, dist);
+
+            for (auto & c: candidates) {
+                if (std::find(chosen.begin(), chosen.end(), c.second)
+                    != chosen.end())
+                    selected[l].push_back(c);
+            }
+
+            {
+                std::unique_lock<std::mutex> guard(lockFor(item));
+                links[item][l] = std::move(chosen);
+            }
+
+            entryDist = candidates[0].first;
+            entry = candidates[0].second;
+        }
+
+        for (int l = numLevels - 1;  l >= 0;  --l) {
+            for (auto & s: selected[l])
+                link(s.second, item, s.first, l, dist);
+        }
+
+        if (level > top) {
+            entryPoint = item;
+            topLevel = level;
+        }
+    }
+
+    /** Return the (approximately) n closest items within maximumDist of
+        the query, as (distance, item) pairs sorted by distance.  The
+        searchWidth closest candidates are explored; the higher it is, the
+        better the recall and the slower the search.
+    */
+    std::vector<std::pair<float, int> >
+    search(const QueryDistance & distance, int n, float maximumDist,
+           int searchWidth) const
+    {
+        std::vector<std::pair<float, int> > result;
+        if (entryPoint == -1 || n <= 0)
+            return result;
+
+        int entry = entryPoint;
+        float entryDist = distance(entry);
+
+        for (int l = topLevel;  l > 0;  --l)
+            greedySearch<false>(distance, entry, entryDist, l);
+
+        result = searchLevel<false>(distance, entry, entryDist,
+                                    std::max(searchWidth, n), 0);
+
+        size_t numWithin = 0;
+        while (numWithin < result.size() && numWithin < (size_t)n
+               && result[numWithin].first <= maximumDist)
+            ++numWithin;
+        result.resize(numWithin);
+
+        return result;
+    }
+
+    size_t memusage() const
+    {
+        size_t result = sizeof(*this)
+            + sizeof(links[0]) * links.capacity();
+        for (auto & l: links) {
+            result += sizeof(l[0]) * l.capacity();
+            for (auto & n: l)
+                result += sizeof(int) * n.capacity();
+        }
+        return result;
+    }
+
+    void serialize(DB::Store_Writer & store) const
+    {
+        using namespace ML::DB;
+        store << compact_size_t(1)  // version
+              << compact_size_t(maxNeighbors)
+              << compact_size_t(buildSearchWidth)
+              << compact_size_t(entryPoint + 1)
+              << compact_size_t(topLevel + 1)
+              << compact_size_t(links.size());
+        for (auto & l: links) {
+            store << compact_size_t(l.size());
+            for (auto & n: l) {
+                store << compact_size_t(n.size());
+                for (int i: n)
+                    store << compact_size_t(i);
+            }
+        }
+    }
+
+    void reconstitute(DB::Store_Reader & store)
+    {
+        using namespace ML::DB;
+        compact_size_t version(store);
+        if (version != 1)
+            throw MLDB::Exception("unknown HNSW index version %d",
+                                  (int)version);
+        maxNeighbors = compact_size_t(store);
+        buildSearchWidth = compact_size_t(store);
+        entryPoint = (int)compact_size_t(store) - 1;
+        topLevel = (int)compact_size_t(store) - 1;
+
+        links.clear();
+        links.resize(compact_size_t(store));
+        for (auto & l: links) {
+            l.resize(compact_size_t(store));
+            for (auto & n: l) {
+                n.resize(compact_size_t(store));
+                for (int & i: n)
+                    i = compact_size_t(store);
+            }
+        }
+    }
+
+private:
+    /// links[item][level] is the list of items that item is linked to
+    std::vector<std::vector<std::vector<int> > > links;
+
+    int entryPoint;
+    int topLevel;
+
+    std::mutex entryLock;
+
+    /// Items are locked by stripe, since there can be hundreds of millions
+    /// of them.  No more than one item lock is ever held at a time.
+    enum { NUM_LOCKS = 4096 };
+    std::mutex locks[NUM_LOCKS];
+
+    std::mutex & lockFor(int item)
+    {
+        return locks[item % NUM_LOCKS];
+    }
+
+    int maxLinks(int level) const
+    {
+        return level == 0 ? 2 * maxNeighbors : maxNeighbors;
+    }
+
+    /** Level of the given item.  This comes from hashing the item so that
+        the shape of the graph doesn't depend on which thread gets to an
+        item first.
+    */
+    int randomLevel(int item) const
+    {
+        uint64_t x = item + 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+
+        double uniform = ((x >> 11) + 1) * (1.0 / 9007199254740992.0);
+        double level = -std::log(uniform) / std::log(maxNeighbors);
+        return std::min<int>(level, 31);
+    }
+
+    /** Call onLink for each item that item is linked to on the given
+        level.  If Locked, the links are copied under the item's lock, as
+        they can be changed by concurrent inserts.
+    */
+    template<bool Locked, typename OnLink>
+    void forEachLink(int item, int level, const OnLink & onLink) const
+    {
+        if (Locked) {
+            std::vector<int> copy;
+            {
+                std::unique_lock<std::mutex> guard
+                    (const_cast<HnswIndex *>(this)->lockFor(item));
+                copy = links[item][level];
+            }
+            for (int n: copy)
+                onLink(n);
+        }
+        else {
+            for (int n: links[item][level])
+                onLink(n);
+        }
+    }
+
+    /** Move entry to the closest item to the query on the given level, by
+        following links as long as they get closer.
+    */
+    template<bool Locked, typename Distance>
+    void greedySearch(const Distance & distance, int & entry,
+                      float & entryDist, int level) const
+    {
+        for (bool changed = true;  changed;) {
+            changed = false;
+            forEachLink<Locked>(entry, level, [&] (int n)
+                {
+                    float d = distance(n);
+                    if (d < entryDist) {
+                        entryDist = d;
+                        entry = n;
+                        changed = true;
+                    }
+                });
+        }
+    }
+
+    /** Return the width closest items to the query on the given level
+        found from the entry point, sorted by distance.
+    */
+    template<bool Locked, typename Distance>
+    std::vector<std::pair<float, int> >
+    searchLevel(const Distance & distance, int entry, float entryDist,
+                int width, int level) const
+    {
+        typedef std::pair<float, int> Entry;
+
+        MLDB::Lightweight_Hash_Set<int> visited;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> >
+            candidates;
+        std::priority_queue<Entry> found;
+
+        visited.insert(entry);
+        candidates.emplace(entryDist, entry);
+        found.emplace(entryDist, entry);
+
+        while (!candidates.empty()) {
+            Entry current = candidates.top();
+            if (current.first > found.top().first)
+                break;
+            candidates.pop();
+
+            forEachLink<Locked>(current.second, level, [&] (int n)
+                {
+                    if (!visited.insert(n).second)
+                        return;
+                    float d = distance(n);
+                    if (found.size() < (size_t)width || d < found.top().first) {
+                        candidates.emplace(d, n);
+                        found.emplace(d, n);
+                        if (found.size() > (size_t)width)
+                            found.pop();
+                    }
+                });
+        }
+
+        std::vector<std::pair<float, int> > result(found.size());
+        for (size_t i = result.size();  i > 0;  --i) {
+            result[i - 1] = found.top();
+            found.pop();
+        }
+
+        return result;
+    }
+
+    /** Choose up to num of the candidates, which are sorted by distance to
+        an item, to link it to.  A candidate is left out when it's closer
+        to one already chosen than to the item, which keeps links going in
+        different directions rather than all into the closest cluster.
+    */
+    std::vector<int>
+    selectNeighbors(const std::vector<std::pair<float, int> > & candidates,
+                    int num, const ItemDistance & dist) const
+    {
+        std::vector<int> result;
+        for (auto & c: candidates) {
+            if (result.size() >= (size_t)num)
+                break;
+            bool keep = true;
+            for (int r: result) {
+                if (dist(c.second, r) < c.first) {
+                    keep = false;
+                    break;
+                }
+            }
+            if (keep)
+                result.push_back(c.second);
+        }
+        return result;
+    }
+
+    /** Add a link from item to newItem, which is distance away from it on
+        the given level, pruning the links of item if there are too many.
+    */
+    void link(int item, int newItem, float distance, int level,
+              const ItemDistance & dist)
+    {
+        std::unique_lock<std::mutex> guard(lockFor(item));
+        std::vector<int> & itemLinks = links[item][level];
+
+        if (itemLinks.size() < (size_t)maxLinks(level)) {
+            itemLinks.push_back(newItem);
+            return;
+        }
+
+        std::vector<std::pair<float, int> > candidates;
+        candidates.reserve(itemLinks.size() + 1);
+        candidates.emplace_back(distance, newItem);
+        for (int n: itemLinks)
+            candidates.emplace_back(dist(item, n), n);
+        std::sort(candidates.begin(), candidates.end());
+
+        itemLinks = selectNeighbors(candidates, maxLinks(level), dist);
+    }
+};
+
+} // namespace ML
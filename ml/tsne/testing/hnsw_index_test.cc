@@ -0,0 +1,203 @@
+/* hnsw_index_test.cc
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the HNSW approximate nearest neighbor index.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/ml/tsne/hnsw_index.h"
+#include "mldb/arch/simd_vector.h"
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace ML;
+using namespace std;
+
+namespace {
+
+struct Points {
+    Points(int numPoints, int numDims)
+        : numDims(numDims), coords(numPoints * numDims)
+    {
+        std::mt19937 rng(1);
+        std::normal_distribution<float> normal;
+        for (auto & c: coords)
+            c = normal(rng);
+    }
+
+    int numDims;
+    std::vector<float> coords;
+
+    const float * operator [] (int i) const
+    {
+        return &coords[i * numDims];
+    }
+
+    float dist(const float * p1, const float * p2) const
+    {
+        return sqrt(SIMD::vec_euclid(p1, p2, numDims));
+    }
+
+    HnswIndex::ItemDistance itemDistance() const
+    {
+        return [this] (int i, int j) { return dist((*this)[i], (*this)[j]); };
+    }
+
+    HnswIndex::QueryDistance queryDistance(const float * query) const
+    {
+        return [this,query] (int i) { return dist((*this)[i], query); };
+    }
+
+    /** Exact nearest neighbors, to compare with. */
+    std::vector<std::pair<float, int> >
+    bruteForce(const float * query, int n) const
+    {
+        std::vector<std::pair<float, int> > result;
+        for (size_t i = 0;  i < coords.size() / numDims;  ++i)
+            result.emplace_back(dist((*this)[i], query), i);
+        std::sort(result.begin(), result.end());
+        result.resize(n);
+        return result;
+    }
+};
+
+/** Proportion of the exact n nearest neighbors of each point that are
+    found by the index. */
+double recall(const HnswIndex & index, const Points & points,
+              const std::vector<std::vector<float> > & queries, int n)
+{
+    size_t numFound = 0;
+    for (auto & q: queries) {
+        auto exact = points.bruteForce(q.data(), n);
+        auto found = index.search(points.queryDistance(q.data()), n,
+                                  INFINITY, 64);
+        BOOST_REQUIRE_EQUAL(found.size(), n);
+        for (unsigned i = 1;  i < found.size();  ++i)
+            BOOST_REQUIRE_LE(found[i - 1].first, found[i].first);
+
+        for (auto & e: exact) {
+            for (auto & f: found) {
+                if (f.second == e.second) {
+                    ++numFound;
+                    break;
+                }
+            }
+        }
+    }
+    return 1.0 * numFound / (queries.size() * n);
+}
+
+std::vector<std::vector<float> >
+makeQueries(int numQueries, int numDims)
+{
+    std::mt19937 rng(2);
+    std::normal_distribution<float> normal;
+    std::vector<std::vector<float> > result(numQueries);
+    for (auto & q: result)
+        for (int i = 0;  i < numDims;  ++i)
+            q.push_back(normal(rng));
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_hnsw_empty )
+{
+    HnswIndex index;
+    BOOST_CHECK_EQUAL(index.size(), 0);
+    auto found = index.search([] (int) -> float { throw MLDB::Exception("no items"); },
+                              10, INFINITY, 64);
+    BOOST_CHECK(found.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_hnsw_recall_parallel )
+{
+    int numPoints = 5000, numDims = 16;
+    Points points(numPoints, numDims);
+
+    HnswIndex index(16, 100);
+    index.resize(numPoints);
+
+    // Insert from several threads, interleaving the items
+    int numThreads = 8;
+    std::vector<std::thread> threads;
+    for (int t = 0;  t < numThreads;  ++t) {
+        threads.emplace_back([&,t] ()
+            {
+                for (int i = t;  i < numPoints;  i += numThreads)
+                    index.insert(i, points.itemDistance());
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    auto queries = makeQueries(100, numDims);
+    double r = recall(index, points, queries, 10);
+    cerr << "recall at 10 is " << r << endl;
+    BOOST_CHECK_GT(r, 0.9);
+
+    // Each point is its own nearest neighbor
+    for (int i = 0;  i < 100;  ++i) {
+        auto found = index.search(points.queryDistance(points[i]), 1,
+                                  INFINITY, 64);
+        BOOST_REQUIRE_EQUAL(found.size(), 1);
+        BOOST_CHECK_EQUAL(found[0].second, i);
+        BOOST_CHECK_EQUAL(found[0].first, 0.0);
+    }
+
+    // Maximum distance is respected
+    auto found = index.search(points.queryDistance(queries[0].data()), 10,
+                              points.bruteForce(queries[0].data(), 3)[2].first,
+                              64);
+    BOOST_CHECK_LE(found.size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_hnsw_incremental_copy_serialize )
+{
+    int numPoints = 2000, numDims = 8;
+    Points points(numPoints, numDims);
+    auto queries = makeQueries(50, numDims);
+
+    // Half the points first, then copy and add the rest, as happens when an
+    // embedding dataset is committed twice
+    HnswIndex first;
+    first.resize(numPoints / 2);
+    for (int i = 0;  i < numPoints / 2;  ++i)
+        first.insert(i, points.itemDistance());
+
+    HnswIndex index(first);
+    index.resize(numPoints);
+    for (int i = numPoints / 2;  i < numPoints;  ++i)
+        index.insert(i, points.itemDistance());
+
+    BOOST_CHECK_GT(recall(index, points, queries, 10), 0.9);
+
+    std::ostringstream os;
+    {
+        DB::Store_Writer store(os);
+        index.serialize(store);
+    }
+
+    std::istringstream is(os.str());
+    DB::Store_Reader store(is);
+    HnswIndex reconstituted;
+    reconstituted.reconstitute(store);
+
+    BOOST_CHECK_EQUAL(reconstituted.size(), index.size());
+    BOOST_CHECK_EQUAL(reconstituted.maxNeighbors, index.maxNeighbors);
+
+    for (auto & q: queries) {
+        auto found1 = index.search(points.queryDistance(q.data()), 10,
+                                   INFINITY, 64);
+        auto found2 = reconstituted.search(points.queryDistance(q.data()), 10,
+                                           INFINITY, 64);
+        BOOST_CHECK(found1 == found2);
+    }
+}
@@ -16,7 +16,9 @@
 #include <boost/multi_array.hpp>
 
 #include "mldb/ml/tsne/tsne.h"
+#include "mldb/ml/tsne/tsne_interpolation.h"
 #include "mldb/arch/timers.h"
+#include "mldb/arch/exception_handler.h"
 #include <boost/assign/list_of.hpp>
 #include <limits>
 #include <boost/test/floating_point_comparison.hpp>
@@ -29,6 +31,7 @@
 #include "mldb/jml/utils/pair_utils.h"
 #include <iomanip>
 #include <set>
+#include <random>
 
 using namespace ML;
 using namespace std;
@@ -506,6 +509,108 @@ BOOST_AUTO_TEST_CASE( test_small_approx )
     cerr << "res = " << res << endl;
 }
 #endif
+BOOST_AUTO_TEST_CASE( test_interpolate_potentials )
+{
+    int nx = 500;
+
+    boost::multi_array<float, 2> Y(boost::extents[nx][2]);
+    std::mt19937 rng(1);
+    std::normal_distribution<float> coord(0.0, 5.0);
+    for (unsigned x = 0;  x < nx;  ++x)
+        for (unsigned i = 0;  i < 2;  ++i)
+            Y[x][i] = coord(rng);
+
+    boost::multi_array<double, 2> potentials;
+    tsneInterpolatePotentials(Y, potentials);
+
+    BOOST_REQUIRE_EQUAL(potentials.shape()[0], nx);
+    BOOST_REQUIRE_EQUAL(potentials.shape()[1], 4);
+
+    // Recover Z and Z * Frep as the gradient does, and compare with the
+    // exact values
+    double Z = 0.0, ZApprox = 0.0;
+
+    for (unsigned x = 0;  x < nx;  ++x) {
+        double exampleZ = 0.0, FrepZ[2] = { 0.0, 0.0 };
+        for (unsigned j = 0;  j < nx;  ++j) {
+            if (j == x)
+                continue;
+            double d0 = Y[j][0] - Y[x][0], d1 = Y[j][1] - Y[x][1];
+            double q = 1.0 / (1.0 + d0 * d0 + d1 * d1);
+            exampleZ += q;
+            FrepZ[0] += q * q * d0;
+            FrepZ[1] += q * q * d1;
+        }
+
+        const double * phi = &potentials[x][0];
+        double y0 = Y[x][0], y1 = Y[x][1];
+        double exampleZApprox
+            = (1.0 + y0 * y0 + y1 * y1) * phi[0]
+            - 2.0 * (y0 * phi[1] + y1 * phi[2]) + phi[3] - 1.0;
+
+        Z += exampleZ;
+        ZApprox += exampleZApprox;
+
+        BOOST_CHECK_LE(fabs(phi[1] - y0 * phi[0] - FrepZ[0]), 0.01 * exampleZ);
+        BOOST_CHECK_LE(fabs(phi[2] - y1 * phi[0] - FrepZ[1]), 0.01 * exampleZ);
+        BOOST_CHECK_LE(fabs(exampleZApprox - exampleZ), 0.1 * exampleZ);
+    }
+
+    BOOST_CHECK_LE(fabs(ZApprox - Z), 0.01 * Z);
+
+    // More intervals make the approximation much closer
+    tsneInterpolatePotentials(Y, potentials, 3, 200);
+    ZApprox = 0.0;
+    for (unsigned x = 0;  x < nx;  ++x) {
+        const double * phi = &potentials[x][0];
+        double y0 = Y[x][0], y1 = Y[x][1];
+        ZApprox += (1.0 + y0 * y0 + y1 * y1) * phi[0]
+            - 2.0 * (y0 * phi[1] + y1 * phi[2]) + phi[3] - 1.0;
+    }
+
+    BOOST_CHECK_LE(fabs(ZApprox - Z), 0.0001 * Z);
+}
+
+BOOST_AUTO_TEST_CASE( test_small_approx_interpolation )
+{
+    string input_file = "mldb/tsne/testing/mnist2500_X_min.txt.gz";
+
+    filter_istream stream(input_file);
+    ParseContext context(input_file, stream);
+
+    int nd = 784;
+    int nx = 100;
+
+    boost::multi_array<float, 2> data(boost::extents[nx][nd]);
+
+    for (unsigned i = 0;  i < nx;  ++i) {
+        for (unsigned j = 0;  j < nd;  ++j) {
+            data[i][j] = context.expect_float();
+            context.expect_whitespace();
+        }
+
+        context.expect_eol();
+    }
+
+    TSNE_Params params;
+    params.gradient = TSNE_GRADIENT_INTERPOLATION;
+
+    std::unique_ptr<Quadtree> qtree;
+
+    boost::multi_array<float, 2> reduction
+        = tsneApproxFromCoords(data, 2, params, TSNE_Callback(),
+                               nullptr, &qtree);
+
+    BOOST_REQUIRE(qtree);
+    for (unsigned i = 0;  i < nx;  ++i)
+        for (unsigned j = 0;  j < 2;  ++j)
+            BOOST_CHECK(isfinite(reduction[i][j]));
+
+    // Only two dimensional embeddings can be interpolated
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(tsneApproxFromCoords(data, 3, params), std::exception);
+}
+
 #if 1
 BOOST_AUTO_TEST_CASE( test_distance_to_probability_big )
 {
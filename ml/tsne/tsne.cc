@@ -16,7 +16,6 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/ml/algebra/matrix_ops.h"
 #include "mldb/arch/simd_vector.h"
-#include "mldb/arch/spinlock.h"
 
 #include "mldb/ml/algebra/lapack.h"
 #include <cmath>
@@ -33,6 +32,7 @@
 #include "mldb/jml/utils/guard.h"
 #include "mldb/jml/utils/environment.h"
 #include "quadtree.h"
+#include "tsne_interpolation.h"
 #include "vantage_point_tree.h"
 #include <fstream>
 #include <functional>
@@ -1173,9 +1173,7 @@ double sqr(double d)
 
 float pythag_dist(const float * d1, const float * d2, int nd)
 {
-    float diff[nd];
-    SIMD::vec_add(d1, -1.0f, d2, diff, nd);
-    return sqrtf(SIMD::vec_dotprod_dp(diff, diff, nd));
+    return sqrtf(SIMD::vec_euclid(d1, d2, nd));
 }
 
 #if 0
@@ -1280,8 +1278,6 @@ sparseProbsFromCoords(const std::function<float (int)> & dist,
                       double tolerance,
                       int toRemove)
 {
-    TsneSparseProbs result;
-
     // Check the variant
     if (toRemove != -1)
         ExcAssertEqual(dist(toRemove), 0);
@@ -1377,6 +1373,17 @@ sparseProbsFromCoords(const std::function<float (int)> & dist,
         }
     }
 
+    return sparseProbsFromNeighbours(std::move(exNeighbours), perplexity,
+                                     tolerance);
+}
+
+TsneSparseProbs
+sparseProbsFromNeighbours(std::vector<std::pair<float, int> > exNeighbours,
+                          double perplexity,
+                          double tolerance)
+{
+    TsneSparseProbs result;
+
     // Sort by index number
     sort_on_second_ascending(exNeighbours);
 
@@ -1478,6 +1485,39 @@ tsneApproxFromCoords(const boost::multi_array<float, 2> & coords,
     return embedding;
 }
 
+boost::multi_array<float, 2>
+tsneApproxFromNeighbours(const std::vector<std::vector<std::pair<float, int> > > & neighbours,
+                         int num_dims,
+                         const TSNE_Params & params,
+                         const TSNE_Callback & callback,
+                         std::unique_ptr<Quadtree> * qtreeOut)
+{
+    int nx = neighbours.size();
+
+    std::vector<TsneSparseProbs> probs(nx);
+
+    auto calcExample = [&] (int x)
+        {
+            for (auto & n: neighbours[x]) {
+                if (n.second == x)
+                    throw MLDB::Exception("tsneApproxFromNeighbours(): point %d "
+                                          "is its own neighbour", x);
+                if (n.second < 0 || n.second >= nx)
+                    throw MLDB::Exception("tsneApproxFromNeighbours(): point %d "
+                                          "has out of range neighbour %d",
+                                          x, n.second);
+            }
+
+            probs[x] = sparseProbsFromNeighbours(neighbours[x], params.perplexity,
+                                                 params.tolerance);
+        };
+
+    MLDB::parallelMap(0, nx, calcExample);
+
+    return tsneApproxFromSparse(symmetrize(probs), num_dims, params, callback,
+                                qtreeOut);
+}
+
 PythagDistFromCoords::
 PythagDistFromCoords(const boost::multi_array<float, 2> & coords)
     : coords(coords), sum_dist(coords.shape()[0]),
@@ -1723,6 +1763,12 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
         }
     }
 
+    bool interpolate = params.gradient == TSNE_GRADIENT_INTERPOLATION;
+    if (interpolate && nd != 2)
+        throw MLDB::Exception("tsneApproxFromSparse(): the interpolation "
+                              "gradient requires 2 output dimensions, not %d",
+                              nd);
+
     boost::multi_array<float, 2> Y = tsne_init(nx, nd, params.randomSeed);
 
     // Do we force calculations to be made exactly?
@@ -1747,6 +1793,12 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 
     boost::multi_array<float, 2> lastNormalizedY(boost::extents[nx][nd]);
 
+    // Repulsive potentials of each point, for the interpolation gradient
+    boost::multi_array<double, 2> potentials;
+
+    // Contribution of each example to Z
+    std::vector<double> exampleZValues(nx);
+
     double cost = INFINITY;
     double last_cost = INFINITY;
     
@@ -1829,13 +1881,25 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 #endif     
    
         // Create a new coordinate for each neighbour
-        std::vector<QCoord> pointCoords(nx);
+        std::vector<QCoord> pointCoords;
 
-        for (unsigned i = 0;  i < nx;  ++i) {
-            pointCoords[i] = QCoord(&Y[i][0], &Y[i][0] + nd);
+        // The quadtree is only needed for Barnes-Hut; the interpolation
+        // gradient gets all of the repulsive forces in one go.
+        const Quadtree * qtree = nullptr;
+
+        if (interpolate) {
+            tsneInterpolatePotentials(Y, potentials,
+                                      params.interpolation_points,
+                                      params.min_intervals);
         }
+        else {
+            pointCoords.resize(nx);
+            for (unsigned i = 0;  i < nx;  ++i) {
+                pointCoords[i] = QCoord(&Y[i][0], &Y[i][0] + nd);
+            }
 
-        Quadtree & qtree = updateQtree();
+            qtree = &updateQtree();
+        }
 
         // This accumulates the sum_j p[x][j] log Z*q[x][j] for each example.  From this and
         // Z, we can calculate the cost of each example.  Only relevant if calcC is true.
@@ -1850,12 +1914,6 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
         bool calcC = iter < 10 || (iter + 1) % 100 == 0 || iter == params.max_iter - 1;
         //calcC = true;
 
-        // Approximation for Z, accumulated here
-        Spinlock Zmutex;
-        std::vector<double> ZApproxValues;
-        ZApproxValues.reserve(nx);
-
-
         auto calcExample = [&] (int x)
             {
                 // Clear the updates
@@ -1901,6 +1959,12 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 
                     double factorAttr = pFactor * neighbours.probs[q] / (1.0 + D);
 
+                    // There is no quadtree traversal to give us the cell's
+                    // Q * Z for the cost, so use the exact one.
+                    if (interpolate && calcC)
+                        exampleCFactorPtr[x]
+                            -= pFactor * neighbours.probs[q] * log1p(D);
+
                     if (nd == 2) {
                         float dYj0 = y[0] - Y[j][0];
                         float dYj1 = y[1] - Y[j][1];
@@ -1960,14 +2024,24 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     return pointCoords.at(neighbours.indexes.at(point));
                 };
 
-                if (calcC) {
+                if (interpolate) {
+                    // Z * Frep = sum_j K^2 (y[j] - y) and
+                    // Zx = sum_j K (1 + |y - y[j]|^2) - 1 (for j == x)
+                    const double * phi = &potentials[x][0];
+                    FrepZ[x][0] = phi[1] - y[0] * phi[0];
+                    FrepZ[x][1] = phi[2] - y[1] * phi[0];
+                    exampleZ = (1.0 + y[0] * y[0] + y[1] * y[1]) * phi[0]
+                        - 2.0 * (y[0] * phi[1] + y[1] * phi[2])
+                        + phi[3] - 1.0;
+                }
+                else if (calcC) {
                     // Bring along the points of interest for the ride
                     vector<int> pointsOfInterest;
                     pointsOfInterest.reserve(neighbours.indexes.size());
                     for (unsigned i = 0;  i < neighbours.indexes.size();  ++i)
                         pointsOfInterest.push_back(i);
 
-                    calcRep(*qtree.root, 0, true /* inside */,
+                    calcRep(*qtree->root, 0, true /* inside */,
                             y, &FrepZ[x][0], exampleZ, nodesTouched, nd, exact,
                             onNode, pointsOfInterest, getPointCoord,
                             params.min_distance_ratio);
@@ -1985,52 +2059,34 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     //    cerr << "x = " << x << " factor " << exampleCFactor[x] << endl;
                     ExcAssert(isfinite(exampleCFactorPtr[x]));
                 } else {
-                    calcRep(*qtree.root, 0, true /* inside */,
+                    calcRep(*qtree->root, 0, true /* inside */,
                             y, &FrepZ[x][0], exampleZ, nodesTouched, nd, exact,
                             nullptr, {}, nullptr, params.min_distance_ratio);
                 }
 
-                {
-                    std::unique_lock<Spinlock> guard(Zmutex);
-                    ZApproxValues.push_back(exampleZ);
-                }
+                exampleZValues[x] = exampleZ;
 
                 //if (x == 1026)
                 //    cerr << "touched " << nodesTouched << " of " << numNodes << " nodes"
                 //         << endl;
             };
 
-#if 1
-        int totalThreads = std::max(1, std::min(16, MLDB::numCpus() / 2));
-
-        auto doThread = [&] (int n)
+        // Each example proceeds independently, so both the attractive and
+        // repulsive passes are spread over all cores.  The chunks are
+        // small since examples in dense areas of the quadtree take much
+        // longer than the others.
+        auto doChunk = [&] (size_t first, size_t last)
             {
-                int perThread = nx / totalThreads;
-                int start = n * perThread;
-                int end = start + perThread;
-                if (n == totalThreads)
-                    end = nx;
-
-                for (unsigned x = start;  x < end;  ++x)
+                for (size_t x = first;  x < last;  ++x)
                     calcExample(x);
-
-                //for (unsigned x = n;  x < nx;  x += totalThreads) {
-                //    calcExample(x);
-                //}
             };
 
-        MLDB::parallelMap(0, totalThreads, doThread);
-        //parallelMap(0, nx, calcExample);
-#else
-        // Each example proceeds more or less independently
-        for (unsigned x = 0;  x < nx;  ++x) {
-            calcExample(x);
-        }
-#endif
+        MLDB::parallelMapChunked(0, nx, 64, doChunk);
 
         // Sort from smallest to largest to accumulate.  This minimises
-        // rounding errors and makes the result independent of the order
-        // in which threads finish.
+        // rounding errors and makes the result independent of the way
+        // the work was split between threads.
+        std::vector<double> ZApproxValues(exampleZValues);
         std::sort(ZApproxValues.begin(), ZApproxValues.end());
         double ZApprox = std::accumulate(ZApproxValues.begin(),
                                          ZApproxValues.end(),
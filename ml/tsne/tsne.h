@@ -118,6 +118,12 @@ distances_to_probabilities(boost::multi_array<float, 2> & D,
 boost::multi_array<float, 2>
 pca(boost::multi_array<float, 2> & coords, int num_dims = 50);
 
+/** How the repulsive forces of the approximate t-SNE are calculated. */
+enum TSNE_Gradient {
+    TSNE_GRADIENT_BARNES_HUT,     ///< Barnes-Hut approximation over a quadtree
+    TSNE_GRADIENT_INTERPOLATION   ///< Grid interpolation and FFT (2D only)
+};
+
 struct TSNE_Params {
     
     TSNE_Params()
@@ -133,7 +139,10 @@ struct TSNE_Params {
           min_gain(0.01),
           min_prob(1e-12),
           min_distance_ratio(0.6),
-          max_coord_change(0.0005)
+          max_coord_change(0.0005),
+          gradient(TSNE_GRADIENT_BARNES_HUT),
+          interpolation_points(3),
+          min_intervals(50)
     {
     }
 
@@ -153,6 +162,10 @@ struct TSNE_Params {
 
     double min_distance_ratio;  // 0 means never approximate; 1 means approximate everything
     double max_coord_change;    // stop once no coordinate has changed its relative pos by this
+
+    TSNE_Gradient gradient;     // how the repulsive forces are calculated
+    int interpolation_points;   // interpolation nodes per interval for TSNE_GRADIENT_INTERPOLATION
+    int min_intervals;          // minimum grid intervals per dimension for TSNE_GRADIENT_INTERPOLATION
 };
 
 // Function that will be used as a callback to provide progress to a calling
@@ -188,6 +201,20 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & neighbours,
                      const TSNE_Callback & callback = TSNE_Callback(),
                      std::unique_ptr<Quadtree> * qtreeOut = nullptr);
 
+/** Barnes-Hut-SNE from the nearest neighbours of each example, for when
+    they are already known (for example from the index of an embedding
+    dataset).  neighbours[x] contains (distance, index) pairs for example
+    x, which must not include x itself.  The probabilities are calibrated
+    to the perplexity in params and symmetrized before running
+    tsneApproxFromSparse().
+*/
+boost::multi_array<float, 2>
+tsneApproxFromNeighbours(const std::vector<std::vector<std::pair<float, int> > > & neighbours,
+                         int num_dims,
+                         const TSNE_Params & params = TSNE_Params(),
+                         const TSNE_Callback & callback = TSNE_Callback(),
+                         std::unique_ptr<Quadtree> * qtreeOut = nullptr);
+
 boost::multi_array<float, 2>
 tsneApproxFromDense(const boost::multi_array<float, 2> & probs,
                     int num_dims,
@@ -315,6 +342,16 @@ sparseProbsFromCoords(const std::function<float (int)> & dist,
                       double tolerance = 1e-5,
                       int toRemove = -1);
 
+/** Calculate the sparse probabilities for an example from its nearest
+    neighbours, given as (distance, index) pairs which don't include the
+    example itself.  The probabilities have the given perplexity, and
+    the indexes are returned in ascending order.
+*/
+TsneSparseProbs
+sparseProbsFromNeighbours(std::vector<std::pair<float, int> > neighbours,
+                          double perplexity,
+                          double tolerance = 1e-5);
+
 /** Re-run t-SNE over the given high dimensional probability vector for a
     single example, figuring out where that example should be embedded in
     a fixed containing space from the main tsne computation.
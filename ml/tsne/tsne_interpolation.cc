@@ -0,0 +1,264 @@
+/** tsne_interpolation.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Interpolation based calculation of the t-SNE repulsive forces.
+*/
+
+#include "tsne_interpolation.h"
+#include "mldb/ext/pffft/pffft.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include <memory>
+#include <vector>
+#include <cmath>
+
+using namespace std;
+
+
+namespace ML {
+
+namespace {
+
+typedef std::unique_ptr<float, void (*) (void *)> AlignedFloats;
+
+/** Allocate a zeroed buffer with the alignment that pffft needs. */
+AlignedFloats allocAligned(size_t n)
+{
+    AlignedFloats result((float *)pffft_aligned_malloc(n * sizeof(float)),
+                         pffft_aligned_free);
+    if (!result)
+        throw MLDB::Exception("couldn't allocate %zd floats for FFT", n);
+    std::fill(result.get(), result.get() + n, 0.0f);
+    return result;
+}
+
+/** In-place 2 dimensional FFT of an M by M matrix of interleaved complex
+    numbers.  The rows and then the columns are transformed in parallel.
+    Like pffft, the backward transform is not scaled.
+*/
+void fft2d(PFFFT_Setup * setup, float * data, size_t M,
+           pffft_direction_t direction)
+{
+    auto doRows = [&] (size_t first, size_t last)
+        {
+            AlignedFloats work = allocAligned(2 * M);
+            for (size_t r = first;  r < last;  ++r) {
+                float * row = data + 2 * M * r;
+                pffft_transform_ordered(setup, row, row, work.get(), direction);
+            }
+        };
+
+    MLDB::parallelMapChunked(0, M, 16, doRows);
+
+    auto doColumns = [&] (size_t first, size_t last)
+        {
+            AlignedFloats work = allocAligned(2 * M);
+            AlignedFloats column = allocAligned(2 * M);
+            float * col = column.get();
+
+            for (size_t c = first;  c < last;  ++c) {
+                for (size_t r = 0;  r < M;  ++r) {
+                    col[2 * r] = data[2 * (M * r + c)];
+                    col[2 * r + 1] = data[2 * (M * r + c) + 1];
+                }
+
+                pffft_transform_ordered(setup, col, col, work.get(), direction);
+
+                for (size_t r = 0;  r < M;  ++r) {
+                    data[2 * (M * r + c)] = col[2 * r];
+                    data[2 * (M * r + c) + 1] = col[2 * r + 1];
+                }
+            }
+        };
+
+    MLDB::parallelMapChunked(0, M, 16, doColumns);
+}
+
+} // file scope
+
+void
+tsneInterpolatePotentials(const boost::multi_array<float, 2> & Y,
+                          boost::multi_array<double, 2> & potentials,
+                          int numPoints,
+                          int minIntervals)
+{
+    ExcAssertEqual(Y.shape()[1], 2);
+    ExcAssertGreaterEqual(numPoints, 1);
+    ExcAssertGreaterEqual(minIntervals, 1);
+
+    int nx = Y.shape()[0];
+
+    potentials.resize(boost::extents[nx][4]);
+
+    if (nx == 0)
+        return;
+
+    // The grid is square, so that the kernel is the same in both directions
+    float lo = Y[0][0], hi = Y[0][0];
+    for (unsigned x = 0;  x < nx;  ++x) {
+        for (unsigned i = 0;  i < 2;  ++i) {
+            lo = std::min(lo, Y[x][i]);
+            hi = std::max(hi, Y[x][i]);
+        }
+    }
+
+    double range = hi - lo;
+    int numIntervals = std::max<int>(minIntervals, std::ceil(range));
+    if (range == 0.0)
+        range = 1.0;
+    double width = range / numIntervals;
+
+    // Nodes are equally spaced by h across the whole grid, which makes the
+    // kernel between them Toeplitz and so a convolution.
+    size_t n1 = (size_t)numIntervals * numPoints;
+    double h = width / numPoints;
+
+    // Pad to at least twice the grid so that the circular convolution
+    // doesn't wrap around.  pffft needs multiples of 16.
+    size_t M = 16;
+    while (M < 2 * n1)
+        M *= 2;
+
+    // Position of the interpolation nodes within an interval, and the
+    // denominators of the Lagrange polynomials over them
+    std::vector<double> spacing(numPoints), denom(numPoints, 1.0);
+    for (unsigned k = 0;  k < numPoints;  ++k)
+        spacing[k] = (k + 0.5) / numPoints;
+    for (unsigned k = 0;  k < numPoints;  ++k)
+        for (unsigned l = 0;  l < numPoints;  ++l)
+            if (l != k)
+                denom[k] *= spacing[k] - spacing[l];
+
+    // For each point and dimension, the first grid node that it touches and
+    // the interpolation weights of that and the next numPoints-1 nodes
+    std::vector<int> firstNode(2 * nx);
+    std::vector<double> weights(2 * nx * numPoints);
+
+    auto doWeights = [&] (size_t first, size_t last)
+        {
+            for (size_t x = first;  x < last;  ++x) {
+                for (unsigned i = 0;  i < 2;  ++i) {
+                    double pos = (Y[x][i] - lo) / width;
+                    int interval = std::min<int>(pos, numIntervals - 1);
+                    double u = pos - interval;
+
+                    firstNode[2 * x + i] = interval * numPoints;
+                    double * w = &weights[(2 * x + i) * numPoints];
+                    for (unsigned k = 0;  k < numPoints;  ++k) {
+                        double v = 1.0;
+                        for (unsigned l = 0;  l < numPoints;  ++l)
+                            if (l != k)
+                                v *= u - spacing[l];
+                        w[k] = v / denom[k];
+                    }
+                }
+            }
+        };
+
+    MLDB::parallelMapChunked(0, nx, 1024, doWeights);
+
+    // Spread the charges onto the grid.  The kernel is real, so we can
+    // convolve two real charges at once as the real and imaginary parts of
+    // a single complex one.
+    AlignedFloats charges01 = allocAligned(2 * M * M);
+    AlignedFloats charges23 = allocAligned(2 * M * M);
+    float * c01 = charges01.get();
+    float * c23 = charges23.get();
+
+    for (unsigned x = 0;  x < nx;  ++x) {
+        double q1 = Y[x][0], q2 = Y[x][1], q3 = q1 * q1 + q2 * q2;
+        const double * w0 = &weights[2 * x * numPoints];
+        const double * w1 = w0 + numPoints;
+        for (unsigned k = 0;  k < numPoints;  ++k) {
+            size_t row = firstNode[2 * x] + k;
+            for (unsigned l = 0;  l < numPoints;  ++l) {
+                size_t idx = 2 * (row * M + firstNode[2 * x + 1] + l);
+                double w = w0[k] * w1[l];
+                c01[idx] += w;
+                c01[idx + 1] += w * q1;
+                c23[idx] += w * q2;
+                c23[idx + 1] += w * q3;
+            }
+        }
+    }
+
+    // Kernel between nodes, laid out with negative offsets wrapped around
+    // to the end of each dimension
+    AlignedFloats kernelValues = allocAligned(2 * M * M);
+    float * kernel = kernelValues.get();
+
+    auto offset = [&] (size_t a) -> double
+        {
+            return a < n1 ? a : (double)a - M;
+        };
+
+    for (size_t a = 0;  a < M;  ++a) {
+        if (a >= n1 && a <= M - n1)
+            continue;
+        for (size_t b = 0;  b < M;  ++b) {
+            if (b >= n1 && b <= M - n1)
+                continue;
+            double da = offset(a) * h, db = offset(b) * h;
+            double k = 1.0 / (1.0 + da * da + db * db);
+            kernel[2 * (a * M + b)] = k * k;
+        }
+    }
+
+    std::unique_ptr<PFFFT_Setup, void (*) (PFFFT_Setup *)>
+        setup(pffft_new_setup(M, PFFFT_COMPLEX), pffft_destroy_setup);
+    if (!setup)
+        throw MLDB::Exception("couldn't set up complex FFT of size %zd", M);
+
+    fft2d(setup.get(), kernel, M, PFFFT_FORWARD);
+    fft2d(setup.get(), c01, M, PFFFT_FORWARD);
+    fft2d(setup.get(), c23, M, PFFFT_FORWARD);
+
+    auto doMultiply = [&] (size_t first, size_t last)
+        {
+            for (size_t i = 2 * first * M;  i < 2 * last * M;  i += 2) {
+                float kr = kernel[i], ki = kernel[i + 1];
+                for (float * c: { c01, c23 }) {
+                    float cr = c[i], ci = c[i + 1];
+                    c[i] = cr * kr - ci * ki;
+                    c[i + 1] = cr * ki + ci * kr;
+                }
+            }
+        };
+
+    MLDB::parallelMapChunked(0, M, 16, doMultiply);
+
+    fft2d(setup.get(), c01, M, PFFFT_BACKWARD);
+    fft2d(setup.get(), c23, M, PFFFT_BACKWARD);
+
+    // Interpolate the potentials at the nodes back onto the points
+    double scale = 1.0 / ((double)M * M);
+
+    auto doInterpolate = [&] (size_t first, size_t last)
+        {
+            for (size_t x = first;  x < last;  ++x) {
+                double phi[4] = { 0.0, 0.0, 0.0, 0.0 };
+                const double * w0 = &weights[2 * x * numPoints];
+                const double * w1 = w0 + numPoints;
+                for (unsigned k = 0;  k < numPoints;  ++k) {
+                    size_t row = firstNode[2 * x] + k;
+                    for (unsigned l = 0;  l < numPoints;  ++l) {
+                        size_t idx = 2 * (row * M + firstNode[2 * x + 1] + l);
+                        double w = w0[k] * w1[l];
+                        phi[0] += w * c01[idx];
+                        phi[1] += w * c01[idx + 1];
+                        phi[2] += w * c23[idx];
+                        phi[3] += w * c23[idx + 1];
+                    }
+                }
+                for (unsigned c = 0;  c < 4;  ++c)
+                    potentials[x][c] = phi[c] * scale;
+            }
+        };
+
+    MLDB::parallelMapChunked(0, nx, 1024, doInterpolate);
+}
+
+} // namespace ML
@@ -0,0 +1,49 @@
+/** tsne_interpolation.h                                           -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Interpolation based calculation of the t-SNE repulsive forces.
+
+    See Linderman, Rachh, Hoskins, Steinerberger and Kluger, "Fast
+    interpolation-based t-SNE for improved visualization of single-cell
+    RNA-seq data", Nature Methods 16, 2019 (FIt-SNE).
+*/
+
+#pragma once
+
+#include <boost/multi_array.hpp>
+
+namespace ML {
+
+/** Calculate the potentials needed for the repulsive t-SNE gradient of a
+    two dimensional embedding Y (nx by 2), with
+
+        K(x, j) = 1 / (1 + ||Y[x] - Y[j]||^2)^2
+
+    we calculate, for each x, the following sums over all j (including
+    j == x, for which K is one):
+
+        potentials[x][0] = sum_j K(x, j)
+        potentials[x][1] = sum_j K(x, j) Y[j][0]
+        potentials[x][2] = sum_j K(x, j) Y[j][1]
+        potentials[x][3] = sum_j K(x, j) ||Y[j]||^2
+
+    From these both Z and Z * Frep can be recovered exactly.
+
+    The charges are spread with Lagrange polynomials of numPoints nodes
+    onto a regular grid covering Y, with at least minIntervals intervals
+    (and one interval per unit of distance) in each dimension.  The
+    kernel is then applied between the grid nodes as a convolution using
+    an FFT, and the result interpolated back onto the points.  The cost
+    is O(nx + G log G) for G grid nodes rather than O(nx log nx).
+
+    potentials is resized to nx by 4.
+*/
+void
+tsneInterpolatePotentials(const boost::multi_array<float, 2> & Y,
+                          boost::multi_array<double, 2> & potentials,
+                          int numPoints = 3,
+                          int minIntervals = 50);
+
+} // namespace ML
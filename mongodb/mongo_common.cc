@@ -144,6 +144,10 @@ MongoScope::
 doGetColumn(const Utf8String & tableName,
             const ColumnPath & columnName)
 {
+    if (columnName.empty())
+        readsAllColumns = true;
+    else columnsRead.insert(columnName);
+
     return {[=] (const SqlRowScope & scope, ExpressionValue & storage,
                  const VariableFilter & filter) -> const ExpressionValue &
         {
@@ -163,6 +167,8 @@ GetAllColumnsOutput
 MongoScope::
 doGetAllColumns(const Utf8String & tableName, const ColumnFilter & keep)
 {
+    readsAllColumns = true;
+
     std::vector<KnownColumn> columnsWithInfo;
 
     auto exec = [=] (const SqlRowScope & scope, const VariableFilter & filter)
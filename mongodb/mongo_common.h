@@ -45,7 +45,14 @@ struct MongoRowScope : SqlRowScope {
 
 struct MongoScope : SqlExpressionMldbScope {
 
-    MongoScope(MldbServer * server) : SqlExpressionMldbScope(server){}
+    MongoScope(MldbServer * server)
+        : SqlExpressionMldbScope(server), readsAllColumns(false) {}
+
+    /// Columns read by the expressions bound in this scope
+    std::set<ColumnPath> columnsRead;
+
+    /// Set once an expression bound in this scope reads the whole document
+    bool readsAllColumns;
 
     virtual ColumnGetter doGetColumn(const Utf8String & tableName,
                                      const ColumnPath & columnName) override;
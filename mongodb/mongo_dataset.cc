@@ -6,6 +6,8 @@
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <set>
+#include <cmath>
 
 #include "bsoncxx/oid.hpp"
 #include "bsoncxx/builder/stream/document.hpp"
@@ -145,6 +147,179 @@ struct MongoConnHolder {
     mongocxx::database db;
 };
 
+/** Return the MongoDB field path of the column, or an empty string if it
+    can't be written as one. */
+static string getFieldPath(const ColumnPath & column)
+{
+    string result;
+    for (size_t i = 0;  i < column.size();  ++i) {
+        string name = column[i].toUtf8String().rawString();
+        if (name.empty() || name[0] == '$' || name.find('.') != string::npos)
+            return string();
+        result += (i == 0 ? "" : ".") + name;
+    }
+    return result;
+}
+
+/** Can the value be compared in MongoDB, which only compares values of the
+    same type, with the same result as in MLDB? */
+static bool isComparable(const CellValue & value)
+{
+    if (value.isString())
+        return true;
+    if (value.isInteger())
+        return value.isInt64();
+    return value.isNumber() && std::isfinite(value.toDouble());
+}
+
+template<typename Context>
+static void appendCell(Context && context, const CellValue & value)
+{
+    if (value.isInteger())
+        context << (int64_t)value.toInt();
+    else if (value.isNumber())
+        context << value.toDouble();
+    else context << value.toUtf8String().rawString();
+}
+
+/** Return the filter document { field: { op: value } }. */
+static bsoncxx::document::value
+getFieldFilter(const string & field, const char * op, const CellValue & value)
+{
+    using bsoncxx::builder::stream::document;
+
+    document condition;
+    appendCell(condition << op, value);
+    document result;
+    result << field << bsoncxx::types::b_document{condition.view()};
+    return result.extract();
+}
+
+/** Translate a predicate of the where clause into a MongoDB filter that
+    matches at least all of the documents that it matches, and add it to
+    the filters.  The where clause is still evaluated on the documents
+    that are returned, so the filter only needs to leave out documents that
+    can't match.  Returns false if the predicate can't be translated.
+
+    MongoDB only compares values of the same type, while MLDB orders
+    values of different types; the ranges on numbers are thus written as
+    the negation of their complement, which keeps the values of the other
+    types.  Arrays are always kept by ranges, as in MongoDB they match if
+    any of their elements do while in MLDB they compare as greater than
+    any number.
+*/
+static bool
+getMongoFilter(const ColumnPredicate & predicate,
+               bsoncxx::builder::stream::array & filters)
+{
+    using bsoncxx::builder::stream::document;
+    using bsoncxx::builder::stream::array;
+
+    string field = getFieldPath(predicate.columnName);
+    if (field.empty() || predicate.op == ColumnPredicate::IN_SET)
+        return false;
+    for (auto & v: predicate.values) {
+        if (!isComparable(v))
+            return false;
+    }
+
+    if (predicate.op == ColumnPredicate::EQUAL
+        || predicate.op == ColumnPredicate::IN) {
+        array values;
+        for (auto & v: predicate.values) {
+            appendCell(values, v);
+            // Booleans are read as 1 and 0
+            if (v.isNumber() && v.toDouble() == 1)
+                values << true;
+            else if (v.isNumber() && v.toDouble() == 0)
+                values << false;
+            // Object ids are read as their string
+            else if (v.isAsciiString() && v.toString().size() == 24
+                     && v.toString().find_first_not_of("0123456789abcdefABCDEF")
+                        == string::npos)
+                values << bsoncxx::oid(v.toString());
+        }
+        document condition;
+        condition << "$in" << bsoncxx::types::b_array{values.view()};
+        document filter;
+        filter << field << bsoncxx::types::b_document{condition.view()};
+        filters << bsoncxx::types::b_document{filter.view()};
+        return true;
+    }
+
+    // Ranges are only translated for numbers
+    for (auto & v: predicate.values) {
+        if (!v.isNumber())
+            return false;
+    }
+
+    // Filters matching the numbers that fail the predicate
+    std::vector<bsoncxx::document::value> failing;
+    switch (predicate.op) {
+    case ColumnPredicate::LESS:
+        failing.push_back(getFieldFilter(field, "$gte", predicate.values.at(0)));
+        break;
+    case ColumnPredicate::LESS_EQUAL:
+        failing.push_back(getFieldFilter(field, "$gt", predicate.values.at(0)));
+        break;
+    case ColumnPredicate::GREATER:
+        failing.push_back(getFieldFilter(field, "$lte", predicate.values.at(0)));
+        break;
+    case ColumnPredicate::GREATER_EQUAL:
+        failing.push_back(getFieldFilter(field, "$lt", predicate.values.at(0)));
+        break;
+    case ColumnPredicate::BETWEEN:
+        failing.push_back(getFieldFilter(field, "$lt", predicate.values.at(0)));
+        failing.push_back(getFieldFilter(field, "$gt", predicate.values.at(1)));
+        break;
+    default:
+        return false;
+    }
+
+    array failingFilters;
+    for (auto & f: failing)
+        failingFilters << bsoncxx::types::b_document{f.view()};
+
+    document notFailing;
+    notFailing << "$nor" << bsoncxx::types::b_array{failingFilters.view()};
+    document isArray;
+    isArray << field + ".0" << bsoncxx::builder::stream::open_document
+            << "$exists" << true
+            << bsoncxx::builder::stream::close_document;
+
+    array alternatives;
+    alternatives << bsoncxx::types::b_document{notFailing.view()}
+                 << bsoncxx::types::b_document{isArray.view()};
+    document filter;
+    filter << "$or" << bsoncxx::types::b_array{alternatives.view()};
+    filters << bsoncxx::types::b_document{filter.view()};
+    return true;
+}
+
+/** Return a MongoDB projection that keeps the top level fields of the
+    given columns, or false if one of them can't be written as a field.
+*/
+static bool
+getMongoProjection(const std::set<ColumnPath> & columns,
+                   bsoncxx::builder::stream::document & projection)
+{
+    std::set<string> fields;
+    for (auto & c: columns) {
+        string field = c.empty() ? string() : getFieldPath(ColumnPath(c.front()));
+        if (field.empty())
+            return false;
+        fields.insert(field);
+    }
+
+    // The object id is the row name
+    projection << "_id" << 1;
+    for (auto & f: fields) {
+        if (f != "_id")
+            projection << f << 1;
+    }
+    return true;
+}
+
 struct MongoDataset: Dataset {
     MongoConnHolder connFindAll; // For the "find all where"
     MongoConnHolder connFindRow; // For the "find where rowName"
@@ -192,12 +367,38 @@ struct MongoDataset: Dataset {
                       ssize_t offset,
                       ssize_t limit) const override
     {
+        using bsoncxx::builder::stream::document;
+        using bsoncxx::builder::stream::array;
+
         bool useWhere = !where.isConstantTrue();
         MongoScope mongoScope(server);
         const auto whereBound = where.bind(mongoScope);
 
+        // Predicates that MongoDB can evaluate are pushed down, so that the
+        // documents that can't match aren't read.  The where clause is
+        // still evaluated on those that are returned.
+        array filters;
+        bool hasFilters = false;
+        for (const SqlExpression * expr: splitConjunction(where)) {
+            ColumnPredicate predicate;
+            if (extractColumnPredicate(alias, *expr, predicate)
+                && getMongoFilter(predicate, filters))
+                hasFilters = true;
+        }
+        document filter;
+        if (hasFilters)
+            filter << "$and" << bsoncxx::types::b_array{filters.view()};
+
+        // Only the fields read by the where clause are fetched
+        mongocxx::options::find opts;
+        document projection;
+        if (!mongoScope.readsAllColumns
+            && getMongoProjection(mongoScope.columnsRead, projection))
+            opts.projection(projection.view());
+
         using mongocxx::cursor;
-        shared_ptr<cursor> res(new cursor(connFindAll.db[collection].find({})));
+        shared_ptr<cursor> res(new cursor(connFindAll.db[collection].find(
+            filter.view(), opts)));
         shared_ptr<cursor::iterator> it(new cursor::iterator(res->begin()));
 
         return {[=] (ssize_t numToGenerate, Any token,
@@ -234,6 +435,32 @@ struct MongoDataset: Dataset {
     }
 
     ExpressionValue getRowExpr(const Path & rowName) const override
+    {
+        return getRowExprWithOptions(rowName, mongocxx::options::find());
+    }
+
+    /** Only the top level fields of the columns are fetched. */
+    std::function<ExpressionValue (const RowPath & row)>
+    getProjectedRowExpr(const std::vector<ColumnPath> & columns) const override
+    {
+        bsoncxx::builder::stream::document projection;
+        if (!getMongoProjection({ columns.begin(), columns.end() },
+                                projection))
+            return Dataset::getProjectedRowExpr(columns);
+
+        auto projectionDoc = std::make_shared<bsoncxx::document::value>
+            (projection.extract());
+        return [=] (const RowPath & rowName)
+            {
+                mongocxx::options::find opts;
+                opts.projection(projectionDoc->view());
+                return getRowExprWithOptions(rowName, opts);
+            };
+    }
+
+    ExpressionValue
+    getRowExprWithOptions(const Path & rowName,
+                          const mongocxx::options::find & opts) const
     {
         // This function is called by multiple threads. Connections are
         // allergic to threads so we must lock.
@@ -243,7 +470,7 @@ struct MongoDataset: Dataset {
         document queryDoc;
         queryDoc << "_id" << bsoncxx::oid(rowName.toUtf8String().rawString());
         {
-            auto cursor = connFindRow.db[collection].find(queryDoc.view());
+            auto cursor = connFindRow.db[collection].find(queryDoc.view(), opts);
             for (auto&& doc : cursor) {
                 auto oid = doc["_id"].get_oid();
                 Path rowName(oid.value.to_string());
@@ -14,6 +14,10 @@
 #include "mldb/rest/rest_request_router.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/parallel.h"
+
+#include <atomic>
+#include <cstdio>
 
 #include "mongo_common.h"
 
@@ -34,6 +38,7 @@ struct MongoImportConfig: ProcedureConfig {
 
     int64_t limit;
     int64_t offset;
+    int numConnections;
     bool ignoreParsingErrors;
     SelectExpression select;
     std::shared_ptr<SqlExpression> where;
@@ -43,6 +48,7 @@ struct MongoImportConfig: ProcedureConfig {
         uriConnectionScheme(""),
         limit(-1),
         offset(0),
+        numConnections(1),
         ignoreParsingErrors(false),
         select(SelectExpression::STAR),
         where(SqlExpression::TRUE),
@@ -72,6 +78,13 @@ MongoImportConfigDescription()
              "Maximum number of lines to process");
     addField("offset", &MongoImportConfig::offset,
              "Skip the first n lines.", int64_t(0));
+    addField("numConnections", &MongoImportConfig::numConnections,
+             "Number of connections to read the collection with at the same "
+             "time.  With more than one, the collection is split into that "
+             "many ranges of `_id`, which are read and recorded "
+             "concurrently.  This requires the `_id` of each record to be an "
+             "ObjectID, and can't be used along with `limit` or `offset`.",
+             1);
     addField("ignoreParsingErrors", &MongoImportConfig::ignoreParsingErrors,
              "If true, any record causing an error will be skipped. Any "
              "record with BSON regex or BSON internal data type will cause an "
@@ -93,6 +106,15 @@ MongoImportConfigDescription()
     {
         validateConnectionScheme(config->uriConnectionScheme);
         validateCollection(config->collection);
+        if (config->numConnections < 1) {
+            throw MLDB::Exception("mongodb.import: numConnections must be "
+                                  "at least 1");
+        }
+        if (config->numConnections > 1
+            && (config->limit != -1 || config->offset != 0)) {
+            throw MLDB::Exception("mongodb.import: numConnections can't be "
+                                  "used along with limit or offset");
+        }
     };
 }
 
@@ -113,14 +135,50 @@ struct MongoImportProcedure: public Procedure {
     }
     MongoImportConfig config;
 
+    /** Return the ObjectID that sorts before every ObjectID created at
+        the given time or later.
+    */
+    static bsoncxx::oid oidForTime(uint64_t secondsSinceEpoch)
+    {
+        char hex[25];
+        snprintf(hex, sizeof(hex), "%08x0000000000000000",
+                 (unsigned)secondsSinceEpoch);
+        return bsoncxx::oid(string(hex));
+    }
+
+    /** Return the creation time of the first record of the collection
+        when sorting by _id in the given direction, or -1 if the collection
+        is empty.
+    */
+    static int64_t getBoundTime(mongocxx::collection & coll, int direction)
+    {
+        using bsoncxx::builder::stream::document;
+
+        document sort;
+        sort << "_id" << direction;
+        mongocxx::options::find opts;
+        opts.sort(sort.view());
+        opts.limit(2); // Limit 1 yields error unset document::element
+
+        auto cursor = coll.find({}, opts);
+        for (auto&& doc : cursor) {
+            if (doc["_id"].type() != bsoncxx::type::k_oid) {
+                throw HttpReturnException(
+                    400,
+                    "mongodb.import: numConnections requires the key "
+                    "\"_id\" of the records to be ObjectIDs");
+            }
+            return doc["_id"].get_oid().value.get_time_t();
+        }
+        return -1;
+    }
+
     RunOutput run(const ProcedureRunConfig & run,
                   const std::function<bool (const Json::Value &)> & onProgress) const override
     {
         const auto runConfig = applyRunConfOverProcConf(config, run);
 
         mongocxx::uri mongoUri(runConfig.uriConnectionScheme);
-        mongocxx::client conn(mongoUri);
-        auto db = conn[mongoUri.database()];
 
         DEBUG_MSG(logger) << "\n"
             << "Db name:    " << mongoUri.database() << "\n"
@@ -130,7 +188,6 @@ struct MongoImportProcedure: public Procedure {
                                     nullptr, true /*overwrite*/);
 
         MongoScope mongoScope(server);
-        ExpressionValue storage;
         const auto whereBound  = runConfig.where->bind(mongoScope);
         const auto selectBound = runConfig.select.bind(mongoScope);
         const auto namedBound  = runConfig.named->bind(mongoScope);
@@ -141,7 +198,8 @@ struct MongoImportProcedure: public Procedure {
         // using incorrect default value to ease check
         bool useNamed = config.named != SqlExpression::TRUE;
 
-        auto processor = [&](Dataset & output,
+        auto processor = [&](Recorder & recorder,
+                             ExpressionValue & storage,
                              const bsoncxx::document::view & doc)
         {
             if (doc["_id"].type() != bsoncxx::type::k_oid) {
@@ -172,14 +230,51 @@ struct MongoImportProcedure: public Procedure {
                 }
             }
 
-            output.recordRowExpr(rowName, expr);
+            recorder.recordRowExprDestructive(std::move(rowName),
+                                              std::move(expr));
         };
 
-        auto offset = runConfig.offset;
-        auto limit = runConfig.limit;
-        int errors = 0;
-        size_t rowsInserted = 0;
+        std::atomic<int> errors(0);
+        std::atomic<size_t> rowsInserted(0);
+
+        auto processDoc = [&] (Recorder & recorder,
+                               ExpressionValue & storage,
+                               const bsoncxx::document::view & doc)
         {
+            if (++rowsInserted % 1000 == 0) {
+                DEBUG_MSG(logger) << "Processing " << rowsInserted
+                                  << "th document";
+            }
+            if (runConfig.ignoreParsingErrors) {
+                try {
+                    processor(recorder, storage, doc);
+                }
+                catch (const MLDB::Exception & exc) {
+                    int numErrors = ++errors;
+                    if (numErrors <= 100) {
+                        logger->error() << exc.what();
+                    }
+                    if (numErrors == 100) {
+                        logger->error() <<
+                            "100 errors logged, not logging them anymore.";
+                    }
+                }
+            }
+            else {
+                processor(recorder, storage, doc);
+            }
+        };
+
+        Dataset::MultiChunkRecorder chunkRecorder = output->getChunkRecorder();
+
+        if (runConfig.numConnections == 1) {
+            mongocxx::client conn(mongoUri);
+            auto db = conn[mongoUri.database()];
+            auto recorder = chunkRecorder.newChunk(0);
+            ExpressionValue storage;
+
+            auto offset = runConfig.offset;
+            auto limit = runConfig.limit;
             auto cursor = db[runConfig.collection].find({});
             for (auto&& doc : cursor) {
                 if (offset > 0) {
@@ -192,35 +287,80 @@ struct MongoImportProcedure: public Procedure {
                 else if (limit > 0) {
                     --limit;
                 }
-                if (++rowsInserted % 1000 == 0) {
-                    DEBUG_MSG(logger) << "Processing " << rowsInserted
-                                      << "th document";
-                }
-                if (runConfig.ignoreParsingErrors) {
-                    try {
-                        processor(*output.get(), doc);
+                processDoc(*recorder, storage, doc);
+            }
+            recorder->finishedChunk();
+        }
+        else {
+            // Split the range of creation times of the ObjectIDs into one
+            // range per connection, and read each with its own client as
+            // clients can't be shared between threads.
+            int64_t first, last;
+            {
+                mongocxx::client conn(mongoUri);
+                auto coll = conn[mongoUri.database()][runConfig.collection];
+                first = getBoundTime(coll, 1);
+                last = getBoundTime(coll, -1);
+            }
+
+            if (first != -1) {
+                uint64_t span = last - first + 1;
+                size_t numRanges = runConfig.numConnections;
+
+                auto doRange = [&] (size_t i)
+                {
+                    using bsoncxx::builder::stream::document;
+                    using bsoncxx::builder::stream::open_document;
+                    using bsoncxx::builder::stream::close_document;
+
+                    uint64_t begin = first + span * i / numRanges;
+                    uint64_t end = first + span * (i + 1) / numRanges;
+                    // The first and last ranges are left open, so that
+                    // records added while importing are handled the same
+                    // as by a single cursor.
+                    bool isFirst = i == 0, isLast = i == numRanges - 1;
+                    if (begin == end && !isFirst && !isLast)
+                        return;
+
+                    document filter;
+                    if (isFirst) {
+                        filter << "_id" << open_document
+                               << "$lt" << oidForTime(end)
+                               << close_document;
                     }
-                    catch (const MLDB::Exception & exc) {
-                        ++ errors;
-                        if (errors <= 100) {
-                            logger->error() << exc.what();
-                        }
-                        if (errors == 100) {
-                            logger->error() <<
-                                "100 errors logged, not logging them anymore.";
-                        }
+                    else if (isLast) {
+                        filter << "_id" << open_document
+                               << "$gte" << oidForTime(begin)
+                               << close_document;
                     }
-                }
-                else {
-                    processor(*output.get(), doc);
-                }
+                    else {
+                        filter << "_id" << open_document
+                               << "$gte" << oidForTime(begin)
+                               << "$lt" << oidForTime(end)
+                               << close_document;
+                    }
+
+                    mongocxx::client conn(mongoUri);
+                    auto db = conn[mongoUri.database()];
+                    auto recorder = chunkRecorder.newChunk(i);
+                    ExpressionValue storage;
+
+                    auto cursor = db[runConfig.collection].find(filter.view());
+                    for (auto&& doc : cursor) {
+                        processDoc(*recorder, storage, doc);
+                    }
+                    recorder->finishedChunk();
+                };
+
+                parallelMap(0, numRanges, doRange);
             }
-            DEBUG_MSG(logger) << "Fetched " << rowsInserted << " documents";
         }
-        output->commit();
+        DEBUG_MSG(logger) << "Fetched " << rowsInserted << " documents";
+
+        chunkRecorder.commit();
         Json::Value res = jsonEncode(output->getStatus());
-        res["numParsingErrors"] = errors;
-        res["numInsertedRows"] = rowsInserted;
+        res["numParsingErrors"] = errors.load();
+        res["numInsertedRows"] = rowsInserted.load();
         return RunOutput(res);
     }
 };
@@ -192,6 +192,41 @@ class MongodbPluginTest(MldbUnitTest):  # noqa
         for r in res[1:]:
             self.assertEqual(r[0], r[1])
 
+    @unittest.skipIf(not got_mongod, "mongod not available")
+    def test_import_connections(self):
+        """
+        Importing with several connections gives the same rows as with one.
+        """
+        for ds, conns in [('imported_one', 1), ('imported_many', 3)]:
+            mldb.post('/v1/procedures', {
+                'type' : 'mongodb.import',
+                'params' : {
+                    'uriConnectionScheme' : self.connection_scheme,
+                    'collection' : self.collection_name,
+                    'outputDataset' : {
+                        'id' : ds,
+                        'type' : 'sparse.mutable'
+                    },
+                    'numConnections' : conns
+                }
+            })
+        self.assertEqual(
+            mldb.query("SELECT * FROM imported_one ORDER BY rowName()"),
+            mldb.query("SELECT * FROM imported_many ORDER BY rowName()"))
+
+        msg = "can't be used along with limit or offset"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.post('/v1/procedures', {
+                'type' : 'mongodb.import',
+                'params' : {
+                    'uriConnectionScheme' : self.connection_scheme,
+                    'collection' : self.collection_name,
+                    'outputDataset' : 'imported_limit',
+                    'numConnections' : 2,
+                    'limit' : 2
+                }
+            })
+
     def test_invalid_connection_scheme(self):
         msg = 'the minimal uriConnectionScheme format is'
         with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
@@ -565,5 +600,48 @@ class MongodbPluginTest(MldbUnitTest):  # noqa
         mldb.get('/v1/functions/mongo_query_invalid/application',
                  input={'query' : query}).json()
 
+    @unittest.skipIf(not got_mongod, "mongod not available")
+    def test_dataset_pushdown(self):
+        # The where clause is partly evaluated by MongoDB, which must keep
+        # all of the documents that MLDB would match
+        coll = self.pymongo_db.pushdown_coll
+        values = [1, 2, 2.5, 3, 7, -4, True, False, 'a', 'b', 'zz', None,
+                  [1, 2], [5], {'y' : 3}]
+        for i, v in enumerate(values):
+            coll.insert_one({'x' : v, 'i' : i})
+
+        mldb.put('/v1/datasets/pushdown_mongo', {
+            'type' : 'mongodb.dataset',
+            'params' : {
+                'uriConnectionScheme' : self.connection_scheme,
+                'collection' : 'pushdown_coll',
+            }
+        })
+        mldb.post('/v1/procedures', {
+            'type' : 'mongodb.import',
+            'params' : {
+                'uriConnectionScheme' : self.connection_scheme,
+                'collection' : 'pushdown_coll',
+                'outputDataset' : {
+                    'id' : 'pushdown_imported',
+                    'type' : 'sparse.mutable'
+                },
+                'runOnCreation' : True
+            }
+        })
+
+        wheres = [
+            "x = 1", "x = 2", "x = 'b'", "x IN (0, 'a', 7)", "x > 2",
+            "x >= 2.5", "x < 3", "x <= -4", "x BETWEEN 1 AND 3",
+            "x > 2 AND i < 10", "x > 1 AND x < 'b'", "x.y = 3",
+            "x.0 >= 5", "i > 3 AND i <= 9 AND x != 2", "x < 'b'", "true"
+        ]
+        for where in wheres:
+            query = 'SELECT x, i FROM {} WHERE ' + where \
+                + ' ORDER BY rowName()'
+            self.assertEqual(mldb.query(query.format('pushdown_mongo')),
+                             mldb.query(query.format('pushdown_imported')),
+                             where)
+
 if __name__ == '__main__':
     mldb.run_tests()
@@ -86,6 +86,20 @@ AccuracyConfigDescription()
               "test set is very large and aggregate statistics for each unique score is "
               "sufficient, for instance to generate a ROC curve. This has no effect "
               "for other values of `mode`.", false);
+    addField("streaming", &AccuracyConfig::streaming,
+             "If `mode` is `boolean`, setting this parameter to `true` "
+             "summarizes the scores of the testing data in histograms as they "
+             "are calculated, rather than keeping and sorting all of them.  "
+             "This allows for testing sets too large to fit in memory, with "
+             "the scores rounded to `streamingPrecision`.  The output dataset "
+             "then has one row per rounded score rather than per example.  "
+             "This has no effect for other values of `mode`.", false);
+    addField("streamingPrecision", &AccuracyConfig::streamingPrecision,
+             "Relative precision to which scores are rounded when `streaming` "
+             "is set.  Examples whose scores are the same once rounded are "
+             "counted as tied, so the AUC and the statistics at each threshold "
+             "are those for the rounded scores.  The memory used grows with "
+             "the inverse of this number.", 0.001);
     addParent<ProcedureConfig>();
 
     onPostValidate = validateQuery(&AccuracyConfig::testingData,
@@ -120,6 +134,105 @@ getStatus() const
     return Any();
 }
 
+RunOutput
+runBooleanStreaming(AccuracyConfig & runAccuracyConf,
+                    BoundSelectQuery & selectQuery,
+                    std::shared_ptr<Dataset> output)
+{
+    double precision = runAccuracyConf.streamingPrecision;
+    if (!(precision > 0.0 && precision < 1.0))
+        throw HttpReturnException(400, "streamingPrecision must be between 0 "
+                                  "and 1 exclusive",
+                                  "streamingPrecision", precision);
+
+    int mantissaBits = std::min<int>(23, std::ceil(-std::log2(precision)));
+
+    PerThreadAccumulator<ScoreHistogram> accum([&] ()
+        {
+            return new ScoreHistogram(mantissaBits);
+        });
+    auto logger = MLDB::getMldbLog<AccuracyProcedure>();
+
+    auto processor = [&] (NamedRowValue & row,
+                          const std::vector<ExpressionValue> & scoreLabelWeight)
+        {
+            double score = scoreLabelWeight[0].toDouble();
+            bool label = scoreLabelWeight[1].asBool();
+            double weight = scoreLabelWeight[2].toDouble();
+
+            TRACE_MSG(logger) << "score=" << score << "; label=" << label << "; weight=" << weight;
+
+            accum.get().update(label, score, weight);
+
+            return true;
+        };
+
+    selectQuery.execute({processor,true/*processInParallel*/}, runAccuracyConf.testingData.stm->offset,
+             runAccuracyConf.testingData.stm->limit,
+             nullptr /* progress */);
+
+    // Now merge the histograms together
+    ScoreHistogram histogram(mantissaBits);
+    bool gotStuff = false;
+
+    accum.forEach([&] (ScoreHistogram * thrHistogram)
+                  {
+                      gotStuff = true;
+                      histogram.add(*thrHistogram);
+                  });
+
+    if (!gotStuff) {
+        throw MLDB::Exception(NO_DATA_ERR_MSG);
+    }
+
+    DEBUG_MSG(logger) << "streaming accuracy has " << histogram.size()
+                      << " distinct rounded scores";
+
+    ScoredStats stats = histogram.toScoredStats();
+
+    if(output) {
+        // We don't have the examples, so there is one row per threshold
+        const Date recordDate = Date::now();
+
+        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
+
+        for (unsigned i = 1;  i < stats.stats.size();  ++i) {
+            auto & bstats = stats.stats[i];
+            std::vector<std::tuple<RowPath, CellValue, Date> > row;
+
+            row.emplace_back(ColumnPath("index"), i, recordDate);
+            row.emplace_back(ColumnPath("score"), bstats.threshold, recordDate);
+            row.emplace_back(ColumnPath("count"),
+                             bstats.includedPopulation(false)
+                             - stats.stats[i - 1].includedPopulation(false),
+                             recordDate);
+            row.emplace_back(ColumnPath("truePositives"), bstats.truePositives(), recordDate);
+            row.emplace_back(ColumnPath("falsePositives"), bstats.falsePositives(), recordDate);
+            row.emplace_back(ColumnPath("trueNegatives"), bstats.trueNegatives(), recordDate);
+            row.emplace_back(ColumnPath("falseNegatives"), bstats.falseNegatives(), recordDate);
+            row.emplace_back(ColumnPath("accuracy"), bstats.accuracy(), recordDate);
+            row.emplace_back(ColumnPath("precision"), bstats.precision(), recordDate);
+            row.emplace_back(ColumnPath("recall"), bstats.recall(), recordDate);
+            row.emplace_back(ColumnPath("truePositiveRate"), bstats.truePositiveRate(), recordDate);
+            row.emplace_back(ColumnPath("falsePositiveRate"), bstats.falsePositiveRate(), recordDate);
+
+            rows.emplace_back(RowPath(std::to_string(i)), std::move(row));
+            if (rows.size() > 10000) {
+                output->recordRows(rows);
+                rows.clear();
+            }
+        }
+
+        output->recordRows(rows);
+
+        output->commit();
+    }
+
+    DEBUG_MSG(logger) << stats.toJson();
+
+    return Any(stats.toJson());
+}
+
 RunOutput
 runBoolean(AccuracyConfig & runAccuracyConf,
            BoundSelectQuery & selectQuery,
@@ -652,6 +765,8 @@ run(const ProcedureRunConfig & run,
                      runAccuracyConf.testingData.stm->orderBy,
                      calc);
 
+    if(runAccuracyConf.mode == CM_BOOLEAN && runAccuracyConf.streaming)
+        return runBooleanStreaming(runAccuracyConf, boundQuery, output);
     if(runAccuracyConf.mode == CM_BOOLEAN)
         return runBoolean(runAccuracyConf, boundQuery, output);
     if(runAccuracyConf.mode == CM_CATEGORICAL)
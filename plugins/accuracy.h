@@ -28,7 +28,8 @@ struct AccuracyConfig : public ProcedureConfig {
     static constexpr const char * name = "classifier.test";
 
     AccuracyConfig()
-          : mode(CM_BOOLEAN), uniqueScoresOnly(false)
+          : mode(CM_BOOLEAN), uniqueScoresOnly(false),
+            streaming(false), streamingPrecision(0.001)
     {
     }
 
@@ -40,6 +41,12 @@ struct AccuracyConfig : public ProcedureConfig {
 
     bool uniqueScoresOnly;
 
+    /// Summarize the scores in histograms rather than keeping them all
+    bool streaming;
+
+    /// Relative precision to which scores are rounded when streaming
+    double streamingPrecision;
+
     /// Dataset we output to
     Optional<PolyConfigT<Dataset> > outputDataset;
     static constexpr char const * defaultOutputDatasetType = "tabular";
@@ -23,6 +23,8 @@
 #include "mldb/utils/log.h"
 #include "mldb/rest/cancellation_exception.h"
 #include "progress.h"
+#include <algorithm>
+#include <atomic>
 #include <memory>
 
 using namespace std;
@@ -33,6 +35,7 @@ namespace MLDB {
 
 BucketizeProcedureConfig::
 BucketizeProcedureConfig()
+    : approximate(false)
 {
     outputDataset.withType("sparse.mutable");
 }
@@ -57,6 +60,14 @@ BucketizeProcedureConfigDescription()
              "\"a\" with rows where 0% < rank/count <= 50% "
              "and \"b\" with rows where 50% < rank/count <= 100% "
              "where rank is based on the orderBy parameter.");
+    addField("approximate", &BucketizeProcedureConfig::approximate,
+             "If true, the rank of each row is estimated from a sample of "
+             "the values of the order by expression instead of sorting all "
+             "of the rows, which is much faster on large datasets.  The "
+             "estimated ranks are typically within a fraction of a percent "
+             "of the exact ones, and rows with the same value always go to "
+             "the same bucket.  The order by clause must have a single "
+             "expression, and offset and limit can't be used.", false);
     addParent<ProcedureConfig>();
 
     onPostValidate = [&] (BucketizeProcedureConfig * cfg,
@@ -98,9 +109,100 @@ BucketizeProcedureConfigDescription()
             last = range;
         }
         MustContainFrom()(cfg->inputData, BucketizeProcedureConfig::name);
+        if (cfg->approximate) {
+            if (cfg->inputData.stm->orderBy.clauses.size() != 1) {
+                throw MLDB::Exception(
+                    "Approximate bucketize requires an order by clause with "
+                    "a single expression");
+            }
+            if (cfg->inputData.stm->offset != 0
+                || cfg->inputData.stm->limit != -1) {
+                throw MLDB::Exception(
+                    "Approximate bucketize can't be used with offset or "
+                    "limit");
+            }
+        }
     };
 }
 
+namespace {
+
+/// Number of values in the sample used to estimate the ranks
+constexpr size_t BUCKETIZE_SAMPLE_SIZE = 65536;
+
+/// Number of rows recorded at once by each thread
+constexpr size_t BUCKETIZE_RECORD_BATCH_SIZE = 1024;
+
+typedef tuple<ColumnPath, CellValue, Date> Cell;
+
+/** Each thread records its rows in batches into its own chunk of the
+    output dataset.
+*/
+struct BucketizeRecorder {
+    std::unique_ptr<Recorder> threadRecorder;
+    std::vector<std::pair<RowPath, std::vector<Cell> > > rows;
+
+    void record(RowPath rowName, const std::vector<Cell> & rowValue)
+    {
+        rows.emplace_back(std::move(rowName), rowValue);
+        if (rows.size() >= BUCKETIZE_RECORD_BATCH_SIZE)
+            flush();
+    }
+
+    void flush()
+    {
+        if (rows.empty())
+            return;
+        threadRecorder->recordRowsDestructive(std::move(rows));
+        rows.clear();
+    }
+
+    void finish()
+    {
+        flush();
+        threadRecorder->finishedChunk();
+    }
+};
+
+/** What each thread sees of the dataset in the first pass of the
+    approximate bucketize: the rows with the value of the order by
+    expression, and the sample of the values of those with the smallest
+    row hashes.  As the hashes are uniformly distributed, that's a uniform
+    sample of the rows, which is mergeable and doesn't depend on which
+    thread saw which row.
+*/
+struct BucketizeSampler {
+    std::vector<std::pair<RowPath, CellValue> > rows;
+
+    /// Max-heap on the row hash of the sampled values
+    std::vector<std::pair<uint64_t, CellValue> > sample;
+
+    Date maxTimestamp = Date::negativeInfinity();
+
+    static bool hashLess(const std::pair<uint64_t, CellValue> & p1,
+                         const std::pair<uint64_t, CellValue> & p2)
+    {
+        return p1.first < p2.first;
+    }
+
+    void add(const RowPath & rowName, RowHash rowHash, CellValue value)
+    {
+        uint64_t hash = rowHash.hash();
+        if (sample.size() < BUCKETIZE_SAMPLE_SIZE) {
+            sample.emplace_back(hash, value);
+            std::push_heap(sample.begin(), sample.end(), hashLess);
+        }
+        else if (hash < sample.front().first) {
+            std::pop_heap(sample.begin(), sample.end(), hashLess);
+            sample.back() = { hash, value };
+            std::push_heap(sample.begin(), sample.end(), hashLess);
+        }
+        rows.emplace_back(rowName, std::move(value));
+    }
+};
+
+} // file scope
+
 BucketizeProcedure::
 BucketizeProcedure(MldbServer * owner,
                  PolyConfig config,
@@ -116,6 +218,9 @@ run(const ProcedureRunConfig & run,
     const std::function<bool (const Json::Value &)> & onProgress) const
 {
     auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
+    if (runProcConf.approximate)
+        return runApproximate(runProcConf, onProgress);
+
     Progress bucketizeProgress;
     std::shared_ptr<Step> iterationStep = bucketizeProgress.steps({
         make_pair("iterating", "percentile"),
@@ -185,8 +290,9 @@ run(const ProcedureRunConfig & run,
     auto output = createDataset(server, runProcConf.outputDataset,
                                 nullptr, true /*overwrite*/);
 
-    typedef tuple<ColumnPath, CellValue, Date> Cell;
-    PerThreadAccumulator<vector<pair<RowPath, vector<Cell>>>> accum;
+    Dataset::MultiChunkRecorder recorder = output->getChunkRecorder();
+    PerThreadAccumulator<BucketizeRecorder> accum;
+    std::atomic<size_t> chunkNumber(0);
 
     auto bucketizeStep = iterationStep->nextStep(1);
     atomic<ssize_t> rowIndex(0);
@@ -199,14 +305,13 @@ run(const ProcedureRunConfig & run,
 
         auto applyFct = [&] (int64_t index) {
             ++ rowIndex;
-            auto & rows = accum.get();
-            rows.reserve(1024);
-            rows.emplace_back(orderedRowNames[index], rowValue);
-
-            if (rows.size() >= 1024) {
-                output->recordRows(rows);
-                rows.clear();
+            auto & threadAccum = accum.get();
+            if (!threadAccum.threadRecorder) {
+                threadAccum.threadRecorder
+                    = recorder.newChunk(chunkNumber.fetch_add(1));
             }
+            threadAccum.record(orderedRowNames[index], rowValue);
+
             if ((rowIndex.load() % 2048) == 0) {
                 float newVal = (float)(rowIndex.load()) / rowCount;
                 lock_guard<mutex> lock(progressMutex);
@@ -236,11 +341,184 @@ run(const ProcedureRunConfig & run,
     }
 
     // record remainder
-    accum.forEach([&] (vector<pair<RowPath, vector<Cell>>> * rows)
-    {
-        output->recordRows(*rows);
+    parallelMap(0, accum.threads.size(),
+                [&] (size_t n)
+                {
+                    auto & threadAccum = *accum.threads[n];
+                    if (threadAccum.threadRecorder)
+                        threadAccum.finish();
+                });
+
+    output->commit();
+    return output->getStatus();
+}
+
+RunOutput
+BucketizeProcedure::
+runApproximate(const BucketizeProcedureConfig & runProcConf,
+               const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    Progress bucketizeProgress;
+    std::shared_ptr<Step> iterationStep = bucketizeProgress.steps({
+        make_pair("sampling", "percentile"),
+        make_pair("bucketizing", "percentile")
     });
 
+    SqlExpressionMldbScope context(server);
+
+    auto boundDataset = runProcConf.inputData.stm->from->bind(context);
+
+    const auto & orderBy = runProcConf.inputData.stm->orderBy.clauses.at(0);
+    bool descending = orderBy.second == DESC;
+
+    SelectExpression select(SelectExpression::parse("1"));
+    vector<shared_ptr<SqlExpression> > calc = {
+        orderBy.first,
+        std::make_shared<FunctionCallExpression>
+            ("" /* tableName */, "latest_timestamp",
+             vector<shared_ptr<SqlExpression> >(1, orderBy.first))
+    };
+
+    // First pass: no order by, so that the rows are processed in parallel
+    // as they come without sorting them
+    PerThreadAccumulator<BucketizeSampler> samplers;
+    auto onRow = [&] (NamedRowValue & row,
+                      const vector<ExpressionValue> & calc)
+    {
+        auto & sampler = samplers.get();
+        Date ts = calc[1].getAtom().toTimestamp();
+        if (ts.isADate())
+            sampler.maxTimestamp.setMax(ts);
+        sampler.add(row.rowName, row.rowHash, calc[0].getAtom());
+        return true;
+    };
+
+    mutex progressMutex;
+    auto onProgress2 = [&](const Json::Value & progress) {
+        auto itProgress = jsonDecode<IterationProgress>(progress);
+        lock_guard<mutex> lock(progressMutex);
+        iterationStep->value = itProgress.percent;
+        return onProgress(jsonEncode(bucketizeProgress));
+    };
+
+    OrderByExpression noOrderBy;
+    if (!BoundSelectQuery(select,
+                          *boundDataset.dataset,
+                          boundDataset.asName,
+                          runProcConf.inputData.stm->when,
+                          *runProcConf.inputData.stm->where,
+                          noOrderBy,
+                          calc)
+        .execute({onRow, true/*processInParallel*/},
+                 0 /* offset */, -1 /* limit */,
+                 onProgress2)) {
+        throw CancellationException(std::string(BucketizeProcedureConfig::name) +
+                                    " procedure was cancelled");
+    }
+
+    // Merge the samples of the threads, keeping the values of the rows
+    // with the smallest hashes overall
+    std::vector<std::pair<uint64_t, CellValue> > merged;
+    Date globalMaxOrderByTimestamp = Date::negativeInfinity();
+    int64_t rowCount = 0;
+    for (auto & s: samplers.threads) {
+        merged.insert(merged.end(),
+                      std::make_move_iterator(s->sample.begin()),
+                      std::make_move_iterator(s->sample.end()));
+        s->sample.clear();
+        globalMaxOrderByTimestamp.setMax(s->maxTimestamp);
+        rowCount += s->rows.size();
+    }
+    if (merged.size() > BUCKETIZE_SAMPLE_SIZE) {
+        std::nth_element(merged.begin(),
+                         merged.begin() + BUCKETIZE_SAMPLE_SIZE,
+                         merged.end(),
+                         BucketizeSampler::hashLess);
+        merged.resize(BUCKETIZE_SAMPLE_SIZE);
+    }
+
+    std::vector<CellValue> sample;
+    sample.reserve(merged.size());
+    for (auto & m: merged)
+        sample.emplace_back(std::move(m.second));
+    merged.clear();
+    std::sort(sample.begin(), sample.end());
+
+    DEBUG_MSG(logger) << "Row count: " << rowCount << " sample size: "
+                      << sample.size();
+
+    struct Bucket {
+        float lowerBound;
+        float higherBound;
+        std::vector<Cell> rowValue;
+    };
+
+    std::vector<Bucket> buckets;
+    for (const auto & mappedRange: runProcConf.percentileBuckets) {
+        Bucket bucket;
+        bucket.lowerBound = mappedRange.second.first;
+        bucket.higherBound = mappedRange.second.second;
+        bucket.rowValue.emplace_back(ColumnPath("bucket"),
+                                     mappedRange.first,
+                                     globalMaxOrderByTimestamp);
+        buckets.emplace_back(std::move(bucket));
+    }
+
+    /* Return the bucket of the given value, or null if it's in none.  The
+       percentile of a value is the proportion of the sample that comes
+       before it in the order by, so it's in [0, 100).
+    */
+    auto getBucket = [&] (const CellValue & value) -> const Bucket *
+    {
+        size_t before = descending
+            ? sample.end() - std::upper_bound(sample.begin(), sample.end(),
+                                              value)
+            : std::lower_bound(sample.begin(), sample.end(), value)
+              - sample.begin();
+        float percentile = 100.0 * before / sample.size();
+        for (auto & b: buckets) {
+            if (percentile >= b.lowerBound && percentile < b.higherBound)
+                return &b;
+        }
+        return nullptr;
+    };
+
+    auto output = createDataset(server, runProcConf.outputDataset,
+                                nullptr, true /*overwrite*/);
+
+    // Second pass: assign the rows of each thread in parallel
+    auto bucketizeStep = iterationStep->nextStep(1);
+    Dataset::MultiChunkRecorder recorder = output->getChunkRecorder();
+    std::atomic<int64_t> rowsDone(0);
+
+    auto doThread = [&] (size_t n)
+    {
+        auto & rows = samplers.threads[n]->rows;
+        BucketizeRecorder threadAccum;
+        threadAccum.threadRecorder = recorder.newChunk(n);
+        for (size_t i = 0;  i < rows.size();  ++i) {
+            const Bucket * bucket = getBucket(rows[i].second);
+            if (bucket)
+                threadAccum.record(std::move(rows[i].first), bucket->rowValue);
+            if (i % 2048 == 2047) {
+                float newVal = (float)(rowsDone += 2048) / rowCount;
+                lock_guard<mutex> lock(progressMutex);
+                if (newVal > bucketizeStep->value)
+                    bucketizeStep->value = newVal;
+                if (!onProgress(jsonEncode(bucketizeProgress)))
+                    return false;
+            }
+        }
+        rows.clear();
+        threadAccum.finish();
+        return true;
+    };
+
+    if (!parallelMapHaltable(0, samplers.threads.size(), doThread)) {
+        throw CancellationException(std::string(BucketizeProcedureConfig::name) +
+                                    " procedure was cancelled");
+    }
+
     output->commit();
     return output->getStatus();
 }
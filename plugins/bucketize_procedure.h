@@ -23,6 +23,7 @@ struct BucketizeProcedureConfig : ProcedureConfig {
     InputQuery inputData;
     PolyConfigT<Dataset> outputDataset;
     std::map<std::string, std::pair<float, float>> percentileBuckets;
+    bool approximate;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(BucketizeProcedureConfig);
@@ -41,6 +42,14 @@ struct BucketizeProcedure: public Procedure {
     virtual Any getStatus() const;
 
     BucketizeProcedureConfig procedureConfig;
+
+private:
+    /** Assign the buckets from ranks estimated with a sample of the values
+        of the order by expression, rather than by sorting the rows.
+    */
+    RunOutput runApproximate(
+        const BucketizeProcedureConfig & runProcConf,
+        const std::function<bool (const Json::Value &)> & onProgress) const;
 };
 
 } // namespace MLDB
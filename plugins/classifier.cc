@@ -9,6 +9,7 @@
 
 #include "classifier.h"
 #include "mldb/ml/jml/classifier.h"
+#include "mldb/ml/jml/compiled_forest.h"
 #include "dataset_feature_space.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/core/dataset.h"
@@ -43,6 +44,10 @@
 #include "mldb/rest/in_process_rest_connection.h"
 #include "mldb/server/static_content_macro.h"
 #include "mldb/utils/log.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/core/run_progress.h"
+#include <mutex>
+#include <unistd.h>
 
 
 using namespace std;
@@ -116,6 +121,17 @@ ClassifierConfigDescription()
              "is a good number to use for unbalanced probabilities. "
              "See the [classifier configuration documentation](../ClassifierConf.md.html) for details.",
              0.5);
+    addField("streaming", &ClassifierConfig::streaming,
+             "If true, the training data is written to a compact cache on "
+             "local disk as it is extracted, rather than held in memory, "
+             "and the classifier is trained by reading it back a block at "
+             "a time.  This keeps the memory needed for training bounded, "
+             "at the expense of more passes over the data.  Only the "
+             "`glz` algorithm supports it, and not with its `condition` "
+             "option.  The cache goes in the directory given by the "
+             "`MLDB_CLASSIFIER_CACHE_DIR` environment variable, by default "
+             "`/tmp`, and is removed once training is done.",
+             false);
     addField("modelFileUrl", &ClassifierConfig::modelFileUrl,
              "URL where the model file (with extension '.cls') should be saved. "
              "This file can be loaded by the ![](%%doclink classifier function). "
@@ -154,6 +170,121 @@ getStatus() const
     return Any();
 }
 
+namespace {
+
+EnvOption<std::string>
+MLDB_CLASSIFIER_CACHE_DIR("MLDB_CLASSIFIER_CACHE_DIR", "/tmp");
+
+// Number of examples given to the classifier generator at once when
+// training in streaming mode
+constexpr size_t CACHE_BLOCK_SIZE = 4096;
+
+/** Training examples that were written to files on disk as they were
+    extracted, one per extraction thread, and are read back a block at a
+    time to train a classifier in streaming mode.
+
+    Each example is its number of features followed by the raw (feature,
+    value) pairs, with the label and weight first as in the in-memory
+    path.
+*/
+struct ClassifierTrainingCache: public ML::Example_Stream {
+
+    typedef std::pair<ML::Feature, float> Value;
+
+    struct File {
+        std::string filename;
+
+        /// Maps the thread's categorical labels onto the final ones
+        std::map<int, int> labelMapping;
+    };
+
+    std::vector<File> files;
+    std::shared_ptr<const ML::Feature_Space> featureSpace;
+    ClassifierMode mode;
+
+    /// Weight multiplier for each label, to equalize them
+    std::vector<double> labelFactors;
+
+    static void write(std::ostream & stream, const std::vector<Value> & features)
+    {
+        uint32_t n = features.size();
+        stream.write((const char *)&n, sizeof(n));
+        stream.write((const char *)features.data(), n * sizeof(Value));
+    }
+
+    /** Call onExample with each cached example, in order, with its label
+        mapped onto the final labels.
+    */
+    void forEachExample(const std::function<void (std::vector<Value> &)> & onExample) const
+    {
+        std::vector<Value> features;
+
+        for (auto & file: files) {
+            filter_istream stream(file.filename);
+
+            uint32_t n;
+            while (stream.read((char *)&n, sizeof(n))) {
+                features.resize(n);
+                if (!stream.read((char *)features.data(), n * sizeof(Value)))
+                    throw HttpReturnException
+                        (500, "Classifier training cache '" + file.filename
+                         + "' is truncated");
+                ExcAssertGreaterEqual(n, 2);
+                ExcAssertEqual(features[0].first, labelFeature);
+                ExcAssertEqual(features[1].first, weightFeature);
+
+                if (!file.labelMapping.empty()) {
+                    auto it = file.labelMapping.find(features[0].second);
+                    ExcAssert(it != file.labelMapping.end());
+                    features[0].second = it->second;
+                }
+
+                onExample(features);
+            }
+        }
+    }
+
+    virtual std::shared_ptr<const ML::Feature_Space> feature_space() const
+    {
+        return featureSpace;
+    }
+
+    virtual void for_each_block(const On_Block & onBlock) const
+    {
+        std::vector<ML::Mutable_Feature_Set> examples;
+        std::vector<float> weights;
+
+        auto flush = [&] ()
+            {
+                if (!examples.empty())
+                    onBlock(examples, weights);
+                examples.clear();
+                weights.clear();
+            };
+
+        auto onExample = [&] (std::vector<Value> & features)
+            {
+                float label = features[0].second;
+                float weight = features[1].second;
+
+                // Same weighting as the in-memory path
+                if (mode != CM_REGRESSION)
+                    weight *= labelFactors.at(label) * weight;
+
+                examples.emplace_back(std::move(features));
+                weights.push_back(weight);
+
+                if (examples.size() == CACHE_BLOCK_SIZE)
+                    flush();
+            };
+
+        forEachExample(onExample);
+        flush();
+    }
+};
+
+} // file scope
+
 RunOutput
 ClassifierProcedure::
 run(const ProcedureRunConfig & run,
@@ -232,6 +363,13 @@ run(const ProcedureRunConfig & run,
         = ML::get_trainer(runProcConf.algorithm,
                           classifierConfig);
 
+    if (runProcConf.streaming && !trainer->can_stream()) {
+        throw HttpReturnException
+            (400, "The '" + runProcConf.algorithm + "' classifier can't be "
+             "trained in streaming mode; set 'streaming' to false",
+             "algorithm", runProcConf.algorithm);
+    }
+
     labelInfo.set_biased(true);
 
     auto extractWithinExpression = [](std::shared_ptr<SqlExpression> expr)
@@ -271,6 +409,10 @@ run(const ProcedureRunConfig & run,
 
     Timer timer;
 
+    RunProgress * runProgress = RunProgress::current();
+    if (runProgress)
+        runProgress->startStage("extract");
+
     // TODO: it's not the feature space itself, but indeed the output of
     // the select expression that's important...
     auto featureSpace = std::make_shared<DatasetFeatureSpace>
@@ -331,6 +473,30 @@ run(const ProcedureRunConfig & run,
     struct ThreadAccum {
         std::vector<Fv> fvs;
 
+        // These are for streaming mode only, where the examples are
+        // written to a cache file instead of being kept in fvs.
+        std::string cacheFile;
+        std::unique_ptr<filter_ostream> cache;
+        std::set<ML::Feature> cachedFeatures;
+
+        void openCache()
+        {
+            static std::atomic<int> cacheNumber(0);
+            cacheFile = MLDB_CLASSIFIER_CACHE_DIR.get()
+                + "/mldb-classifier-train-" + std::to_string(getpid())
+                + "-" + std::to_string(cacheNumber++) + ".lz4";
+            cache.reset(new filter_ostream(cacheFile));
+        }
+
+        ~ThreadAccum()
+        {
+            // Training is done with the cache, or failed
+            if (!cacheFile.empty()) {
+                cache.reset();
+                ::unlink(cacheFile.c_str());
+            }
+        }
+
         // These are for categorical variables only.  Since we need to create a
         // stable label ordering to enable determinism in model training,
         // but we don't know the label alphabet ahead of time, we accumulate the
@@ -378,6 +544,8 @@ run(const ProcedureRunConfig & run,
     auto processor = [&] (NamedRowValue & row_,
                            const std::vector<ExpressionValue> & extraVals)
         {
+            if (runProgress)
+                runProgress->addRows();
             MatrixNamedRow row = row_.flattenDestructive();
             CellValue label = extraVals.at(0).getAtom();
             if (label.empty())
@@ -448,6 +616,20 @@ run(const ProcedureRunConfig & run,
                 unique_known_features.insert(std::get<0>(c));
             }
 
+            if (runProcConf.streaming) {
+                if (!thr.cache)
+                    thr.openCache();
+                ClassifierTrainingCache::write(*thr.cache, features);
+
+                // Missing values aren't indexed in the in-memory path
+                // either
+                for (unsigned i = 2;  i < features.size();  ++i) {
+                    if (!std::isnan(features[i].second))
+                        thr.cachedFeatures.insert(features[i].first);
+                }
+                return true;
+            }
+
             thr.fvs.emplace_back(row.rowName, std::move(features));
             return true;
         };
@@ -503,11 +685,161 @@ run(const ProcedureRunConfig & run,
         accum.forEach(onThread2);
     }
 
+    int nx = numRows;
+
+    if (nx == 0 && boundDataset.dataset->getMatrixView()->getRowHashes(0, 1).empty()) {
+        throw HttpReturnException(400, "Error training classifier: "
+                                  "No feature vectors were produced as dataset was empty",
+                                  "datasetConfig", boundDataset.dataset->config_,
+                                  "datasetName", boundDataset.dataset->config_->id,
+                                  "datasetStatus", boundDataset.dataset->getStatus());
+    }
+
+    if (nx == 0) {
+        throw HttpReturnException(400, "Error training classifier: "
+                                  "No feature vectors were produced as all rows were filtered by "
+                                    "WHEN, WHERE, OFFSET or LIMIT, or all labels were NULL (or "
+                                    "label column doesn't exist)",
+                                  "datasetConfig", boundDataset.dataset->config_,
+                                  "datasetName", boundDataset.dataset->config_->id,
+                                  "datasetStatus", boundDataset.dataset->getStatus(),
+                                  "whenClause", runProcConf.trainingData.stm->when,
+                                  "whereClause", runProcConf.trainingData.stm->where,
+                                  "offsetClause", runProcConf.trainingData.stm->offset,
+                                  "limitClause", runProcConf.trainingData.stm->limit);
+    }
+
+    auto saveClassifier = [&] (const ML::Classifier & classifier)
+        {
+            if (runProgress)
+                runProgress->startStage("save");
+            if (!runProcConf.modelFileUrl.empty()) {
+                try {
+                    classifier.save(runProcConf.modelFileUrl.toDecodedString());
+                }
+                MLDB_CATCH_ALL {
+                    rethrowHttpException(400, "Error saving classifier to '"
+                                         + runProcConf.modelFileUrl.toString() + "': "
+                                         + getExceptionString(),
+                                         "url", runProcConf.modelFileUrl);
+                }
+                INFO_MSG(logger) << "Saved classifier to " << runProcConf.modelFileUrl;
+            }
+
+
+            if(!runProcConf.functionName.empty()) {
+                PolyConfig clsFuncPC;
+                clsFuncPC.type = "classifier";
+                clsFuncPC.id = runProcConf.functionName;
+                clsFuncPC.params = ClassifyFunctionConfig(runProcConf.modelFileUrl);
+
+                createFunction(server, clsFuncPC, onProgress, true);
+            }
+        };
+
+    if (runProcConf.streaming) {
+        timer.restart();
+
+        auto cache = std::make_shared<ClassifierTrainingCache>();
+        cache->featureSpace = featureSpace;
+        cache->mode = runProcConf.mode;
+
+        std::set<ML::Feature> cachedFeatures;
+
+        auto onThread = [&] (ThreadAccum * acc)
+            {
+                if (!acc->cache)
+                    return;
+                acc->cache->close();
+                acc->cache.reset();
+                cache->files.push_back({ acc->cacheFile, acc->labelMapping });
+                cachedFeatures.insert(acc->cachedFeatures.begin(),
+                                      acc->cachedFeatures.end());
+            };
+
+        accum.forEach(onThread);
+
+        unsigned num_weight_labels = 1;
+        if (runProcConf.mode == CM_BOOLEAN)
+            num_weight_labels = 2;
+        else if (runProcConf.mode == CM_CATEGORICAL)
+            num_weight_labels = labelMapping.size();
+
+        // Check the examples and total the weight of each label, in one
+        // pass over the cache
+        std::vector<double> labelWeights(num_weight_labels);
+
+        auto onExample = [&] (std::vector<ClassifierTrainingCache::Value> & features)
+            {
+                float label = features[0].second;
+                float weight = features[1].second;
+
+                if (weight < 0)
+                    throw HttpReturnException(400, "classifier example weight cannot be negative");
+                if (!isfinite(weight))
+                    throw HttpReturnException(400, "classifier example weights must be finite");
+
+                if (runProcConf.mode == CM_REGRESSION) {
+                    if (!isfinite(label)) {
+                        throw HttpReturnException
+                            (400,
+                             "Regression labels must not be infinite or NaN.  Should you "
+                             "add a condition like `WHERE isfinite(label)` to your data, "
+                             "or preprocess your labels with `replace_not_finite(label, 0)`?");
+                    }
+                }
+                else labelWeights.at(label) += weight;
+            };
+
+        cache->forEachExample(onExample);
+
+        for (unsigned lbl = 0;  lbl < num_weight_labels;  ++lbl) {
+            double factor
+                = pow(labelWeights[lbl], -runProcConf.equalizationFactor);
+            INFO_MSG(logger) << "factor for class " << lbl << " = " << factor;
+            cache->labelFactors.push_back(factor);
+        }
+
+        INFO_MSG(logger) << "checked cached feature vectors in " << timer.elapsed();
+
+        cachedFeatures.erase(labelFeature);
+        cachedFeatures.erase(weightFeature);
+        std::vector<ML::Feature> trainingFeatures(cachedFeatures.begin(),
+                                                  cachedFeatures.end());
+
+        INFO_MSG(logger) << "Training with " << trainingFeatures.size() << " features";
+
+        timer.restart();
+        if (runProgress)
+            runProgress->startStage("train");
+
+        trainer->init(featureSpace, labelFeature);
+
+        ML::Thread_Context threadContext;
+        threadContext.seed(1 /* random seed */);
+
+        DEBUG_MSG(logger) << "training classifier";
+        ML::Classifier classifier
+            (trainer->generate_streaming(threadContext, *cache,
+                                         trainingFeatures));
+        DEBUG_MSG(logger) << "done training classifier";
+
+        INFO_MSG(logger) << "trained classifier in " << timer.elapsed();
+
+        saveClassifier(classifier);
+
+        DEBUG_MSG(logger) << "done saving classifier";
+
+        return RunOutput();
+    }
+
     // Now merge them together in parallel
 
     std::vector<Fv> fvs;
 
     timer.restart();
+    if (runProgress)
+        runProgress->startStage("index");
 
     parallelMergeSortRecursive(accum.threads, 0, accum.threads.size(),
                                [] (const std::shared_ptr<ThreadAccum> & t)
@@ -531,31 +863,7 @@ run(const ProcedureRunConfig & run,
         fvs = std::move(accum.threads[0]->fvs);
     }
 
-    ExcAssertEqual(fvs.size(), numRows);
-
-    int nx = numRows;
-
-    if (nx == 0 && boundDataset.dataset->getMatrixView()->getRowHashes(0, 1).empty()) {
-        throw HttpReturnException(400, "Error training classifier: "
-                                  "No feature vectors were produced as dataset was empty",
-                                  "datasetConfig", boundDataset.dataset->config_,
-                                  "datasetName", boundDataset.dataset->config_->id,
-                                  "datasetStatus", boundDataset.dataset->getStatus());
-    }
-
-    if (nx == 0) {
-        throw HttpReturnException(400, "Error training classifier: "
-                                  "No feature vectors were produced as all rows were filtered by "
-                                    "WHEN, WHERE, OFFSET or LIMIT, or all labels were NULL (or "
-                                    "label column doesn't exist)",
-                                  "datasetConfig", boundDataset.dataset->config_,
-                                  "datasetName", boundDataset.dataset->config_->id,
-                                  "datasetStatus", boundDataset.dataset->getStatus(),
-                                  "whenClause", runProcConf.trainingData.stm->when,
-                                  "whereClause", runProcConf.trainingData.stm->where,
-                                  "offsetClause", runProcConf.trainingData.stm->offset,
-                                  "limitClause", runProcConf.trainingData.stm->limit);
-    }
+    ExcAssertEqual(fvs.size(), nx);
 
     timer.restart();
 
@@ -654,7 +962,8 @@ run(const ProcedureRunConfig & run,
     }
 
     timer.restart();
-
+    if (runProgress)
+        runProgress->startStage("train");
 
     trainer->init(featureSpace, labelFeature);
 
@@ -690,28 +999,7 @@ run(const ProcedureRunConfig & run,
 
     INFO_MSG(logger) << "trained classifier in " << timer.elapsed();
 
-    if (!runProcConf.modelFileUrl.empty()) {
-        try {
-            classifier.save(runProcConf.modelFileUrl.toDecodedString());
-        }
-        MLDB_CATCH_ALL {
-            rethrowHttpException(400, "Error saving classifier to '"
-                                 + runProcConf.modelFileUrl.toString() + "': "
-                                 + getExceptionString(),
-                                 "url", runProcConf.modelFileUrl);
-        }
-        INFO_MSG(logger) << "Saved classifier to " << runProcConf.modelFileUrl;
-    }
-
-
-    if(!runProcConf.functionName.empty()) {
-        PolyConfig clsFuncPC;
-        clsFuncPC.type = "classifier";
-        clsFuncPC.id = runProcConf.functionName;
-        clsFuncPC.params = ClassifyFunctionConfig(runProcConf.modelFileUrl);
-
-        createFunction(server, clsFuncPC, onProgress, true);
-    }
+    saveClassifier(classifier);
 
     DEBUG_MSG(logger) << "done saving classifier";
 
@@ -740,6 +1028,65 @@ struct ClassifyFunction::Itl {
     std::shared_ptr<const DatasetFeatureSpace> featureSpace;
     ML::Feature_Info labelInfo;
     ClassifierMode mode;
+
+    /// Optimization for the dense feature vectors, which is done (and
+    /// any forest compiled) the first time the function is bound.
+    ML::Optimization_Info optInfo;
+    std::once_flag optimizeOnce;
+
+    /// Column of each feature of the dense feature vectors, and their
+    /// indexes in the order of their features, which is the order of an
+    /// ML::Explanation.  Set up along with optInfo.
+    std::vector<ColumnPath> denseColumns;
+    std::vector<int> denseExplainOrder;
+
+    /** Return the output of the function for the given label scores, as
+        produced by a batch predict.
+    */
+    ExpressionValue scoresOutput(const float * scores, Date ts) const
+    {
+        StructValue result;
+        result.reserve(1);
+
+        auto cat = labelInfo.categorical();
+        if (cat) {
+            vector<tuple<PathElement, ExpressionValue> > row;
+            for (unsigned i = 0;  i < classifier.label_count();  ++i) {
+                row.emplace_back(PathElement(cat->print(i)),
+                                 ExpressionValue(scores[i], ts));
+            }
+            result.emplace_back("scores", std::move(row));
+        }
+        else if (labelInfo.type() == ML::REAL) {
+            result.emplace_back("score", ExpressionValue(scores[0], ts));
+        }
+        else {
+            result.emplace_back("score", ExpressionValue(scores[1], ts));
+        }
+
+        return std::move(result);
+    }
+
+    /** Return the output of the explain function for a row explained by
+        the compiled forest, with one contribution per dense feature.
+    */
+    ExpressionValue explainOutput(double bias, const double * contributions,
+                                  const bool * used, Date ts) const
+    {
+        StructValue output;
+        output.reserve(2);
+        output.emplace_back("bias", ExpressionValue(bias, ts));
+
+        RowValue features;
+        for (int i: denseExplainOrder) {
+            if (used[i])
+                features.emplace_back(denseColumns[i], contributions[i], ts);
+        }
+
+        output.emplace_back("explanation", std::move(features));
+
+        return std::move(output);
+    }
 };
 
 ClassifyFunction::
@@ -906,7 +1253,27 @@ bind(SqlBindingScope & outerContext,
 
     std::unique_ptr<ClassifyFunctionApplier> result
         (new ClassifyFunctionApplier(this));
-    result->optInfo = itl->classifier.impl->optimize(features);
+    // The features are always the same, so the classifier only needs to
+    // be optimized once
+    std::call_once(itl->optimizeOnce, [&] ()
+                   {
+                       itl->optInfo = itl->classifier.impl->optimize(features);
+
+                       itl->denseColumns.resize(features.size());
+                       itl->denseExplainOrder.resize(features.size());
+                       for (unsigned i = 0;  i < features.size();  ++i) {
+                           itl->denseColumns[i] = ColumnPath::parse
+                               (itl->featureSpace->print(features[i]));
+                           itl->denseExplainOrder[i] = i;
+                       }
+                       std::stable_sort(itl->denseExplainOrder.begin(),
+                                        itl->denseExplainOrder.end(),
+                                        [&] (int i1, int i2)
+                                        {
+                                            return features[i1] < features[i2];
+                                        });
+                   });
+    result->optInfo = itl->optInfo;
 
     return std::move(result);
 }
@@ -927,6 +1294,13 @@ apply(const FunctionApplier & applier_,
     std::tie(dense, fset, ts)
         = getFeatureSet(context, applier.optInfo /* try to optimize */);
 
+    if (!dense.empty() && applier.optInfo.compiled) {
+        float scores[labelCount];
+        itl->classifier.impl->predict_batch(dense.data(), 1, dense.size(),
+                                            applier.optInfo, scores);
+        return itl->scoresOutput(scores, ts);
+    }
+
     StructValue result;
     result.reserve(1);
 
@@ -991,6 +1365,67 @@ apply(const FunctionApplier & applier_,
     return std::move(result);
 }
 
+std::vector<ExpressionValue>
+ClassifyFunction::
+applyBatch(const FunctionApplier & applier_,
+           std::vector<ExpressionValue> inputs) const
+{
+    auto & applier = (const ClassifyFunctionApplier &)applier_;
+    if (!applier.optInfo)
+        return Function::applyBatch(applier, std::move(inputs));
+
+    // Same chunking as Function::applyBatch(); each chunk is scored with
+    // one call to the classifier's batch predict
+    static constexpr size_t CHUNK_SIZE = 64;
+
+    const ML::Classifier_Impl & classifier = *itl->classifier.impl;
+    int nl = classifier.label_count();
+    int nf = itl->featureSpace->columnInfo.size();
+
+    std::vector<ExpressionValue> outputs(inputs.size());
+
+    auto doChunk = [&] (size_t first, size_t last)
+        {
+            std::vector<float> rows;
+            rows.reserve((last - first) * nf);
+            std::vector<size_t> denseInputs;
+            std::vector<Date> timestamps;
+
+            for (size_t i = first;  i < last;  ++i) {
+                std::vector<float> dense;
+                std::shared_ptr<ML::Mutable_Feature_Set> fset;
+                Date ts;
+                std::tie(dense, fset, ts)
+                    = getFeatureSet(inputs[i], true /* try to optimize */);
+
+                if (dense.empty()) {
+                    outputs[i] = apply(applier, inputs[i]);
+                    continue;
+                }
+
+                ExcAssertEqual(dense.size(), nf);
+                rows.insert(rows.end(), dense.begin(), dense.end());
+                denseInputs.push_back(i);
+                timestamps.push_back(ts);
+            }
+
+            std::vector<float> scores(denseInputs.size() * nl);
+            classifier.predict_batch(rows.data(), denseInputs.size(), nf,
+                                     applier.optInfo, scores.data());
+
+            for (size_t j = 0;  j < denseInputs.size();  ++j) {
+                outputs[denseInputs[j]]
+                    = itl->scoresOutput(&scores[j * nl], timestamps[j]);
+            }
+        };
+
+    if (inputs.size() <= CHUNK_SIZE)
+        doChunk(0, inputs.size());
+    else parallelMapChunked(0, inputs.size(), CHUNK_SIZE, doChunk);
+
+    return outputs;
+}
+
 FunctionInfo
 ClassifyFunction::
 getFunctionInfo() const
@@ -1108,21 +1543,75 @@ ExplainFunction::
 {
 }
 
+namespace {
+
+/** Return the label to explain for the compiled forest, which is ignored
+    for regressions.
+*/
+int explainLabel(const ExpressionValue & context,
+                 const DatasetFeatureSpace & featureSpace,
+                 bool isRegression)
+{
+    if (isRegression)
+        return 0;
+    CellValue label = context.getColumn("label").getAtom();
+    return featureSpace.encodeLabel(label, isRegression);
+}
+
+bool hasFeature(const std::vector<float> & dense)
+{
+    for (float f: dense) {
+        if (!isnanf(f))
+            return true;
+    }
+    return false;
+}
+
+const char * NO_FEATURES_MESSAGE
+    = "The specified features couldn't be found in the "
+    "classifier. At least one non-null feature column "
+    "must be provided.";
+
+} // file scope
+
 ExpressionValue
 ExplainFunction::
-apply(const FunctionApplier & applier,
+apply(const FunctionApplier & applier_,
       const ExpressionValue & context) const
 {
+    auto & applier = (const ClassifyFunctionApplier &)applier_;
+
     std::vector<float> dense;
     std::shared_ptr<ML::Mutable_Feature_Set> fset;
     Date ts;
 
+    // Forests of decision trees are explained from their compiled form,
+    // which walks each tree once rather than building up an explanation
+    // per tree
+    auto & compiled = applier.optInfo.compiled;
+    if (compiled && compiled->can_explain()) {
+        std::tie(dense, fset, ts) = getFeatureSet(context, true /* dense */);
+
+        if (!dense.empty()) {
+            if (!hasFeature(dense))
+                throw MLDB::Exception(NO_FEATURES_MESSAGE);
+
+            int label = explainLabel(context, *itl->featureSpace,
+                                     isRegression);
+            double bias;
+            std::vector<double> contributions(dense.size());
+            std::unique_ptr<bool[]> used(new bool[dense.size()]);
+            compiled->explain_batch(dense.data(), 1, dense.size(), &label,
+                                    &bias, contributions.data(), used.get());
+            return itl->explainOutput(bias, contributions.data(), used.get(),
+                                      ts);
+        }
+    }
+
     std::tie(dense, fset, ts) = getFeatureSet(context, false /* attempt to optimize */);
 
     if (fset->features.empty()) {
-        throw MLDB::Exception("The specified features couldn't be found in the "
-                            "classifier. At least one non-null feature column "
-                            "must be provided.");
+        throw MLDB::Exception(NO_FEATURES_MESSAGE);
     }
 
     CellValue label = context.getColumn("label").getAtom();
@@ -1150,6 +1639,76 @@ apply(const FunctionApplier & applier,
     return std::move(output);
 }
 
+std::vector<ExpressionValue>
+ExplainFunction::
+applyBatch(const FunctionApplier & applier_,
+           std::vector<ExpressionValue> inputs) const
+{
+    auto & applier = (const ClassifyFunctionApplier &)applier_;
+    auto & compiled = applier.optInfo.compiled;
+    if (!compiled || !compiled->can_explain())
+        return Function::applyBatch(applier, std::move(inputs));
+
+    // Same chunking as ClassifyFunction::applyBatch(); each chunk is
+    // explained with one pass over the trees
+    static constexpr size_t CHUNK_SIZE = 64;
+
+    int nf = itl->featureSpace->columnInfo.size();
+
+    std::vector<ExpressionValue> outputs(inputs.size());
+
+    auto doChunk = [&] (size_t first, size_t last)
+        {
+            std::vector<float> rows;
+            rows.reserve((last - first) * nf);
+            std::vector<int> labels;
+            std::vector<size_t> denseInputs;
+            std::vector<Date> timestamps;
+
+            for (size_t i = first;  i < last;  ++i) {
+                std::vector<float> dense;
+                std::shared_ptr<ML::Mutable_Feature_Set> fset;
+                Date ts;
+                std::tie(dense, fset, ts)
+                    = getFeatureSet(inputs[i], true /* try to optimize */);
+
+                // Rows without any features fail the same way as on
+                // their own
+                if (dense.empty() || !hasFeature(dense)) {
+                    outputs[i] = apply(applier, inputs[i]);
+                    continue;
+                }
+
+                ExcAssertEqual(dense.size(), nf);
+                rows.insert(rows.end(), dense.begin(), dense.end());
+                labels.push_back(explainLabel(inputs[i], *itl->featureSpace,
+                                              isRegression));
+                denseInputs.push_back(i);
+                timestamps.push_back(ts);
+            }
+
+            size_t nr = denseInputs.size();
+            std::vector<double> bias(nr);
+            std::vector<double> contributions(nr * nf);
+            std::unique_ptr<bool[]> used(new bool[nr * nf]);
+            compiled->explain_batch(rows.data(), nr, nf, labels.data(),
+                                    bias.data(), contributions.data(),
+                                    used.get());
+
+            for (size_t j = 0;  j < nr;  ++j) {
+                outputs[denseInputs[j]]
+                    = itl->explainOutput(bias[j], &contributions[j * nf],
+                                         &used[j * nf], timestamps[j]);
+            }
+        };
+
+    if (inputs.size() <= CHUNK_SIZE)
+        doChunk(0, inputs.size());
+    else parallelMapChunked(0, inputs.size(), CHUNK_SIZE, doChunk);
+
+    return outputs;
+}
+
 FunctionInfo
 ExplainFunction::
 getFunctionInfo() const
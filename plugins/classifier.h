@@ -40,7 +40,8 @@ struct ClassifierConfig : public ProcedureConfig {
 
     ClassifierConfig()
         : equalizationFactor(0.5),
-          mode(CM_BOOLEAN)
+          mode(CM_BOOLEAN),
+          streaming(false)
     {
     }
 
@@ -68,6 +69,9 @@ struct ClassifierConfig : public ProcedureConfig {
     /// What mode to run in
     ClassifierMode mode;
 
+    /// Train from a cache of the training data on disk instead of memory
+    bool streaming;
+
     // Function name
     Utf8String functionName;
 };
@@ -134,6 +138,15 @@ struct ClassifyFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Score a batch at once with the classifier's predict_batch(), when
+        it can take dense feature vectors.  Otherwise, or for inputs which
+        can't be made into a dense feature vector, it applies each
+        separately.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               std::vector<ExpressionValue> inputs) const;
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 
@@ -173,6 +186,10 @@ struct ExplainFunction: public ClassifyFunction {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               std::vector<ExpressionValue> inputs) const;
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 };
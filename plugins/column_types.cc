@@ -9,6 +9,7 @@
 #include "mldb/sql/cell_value.h"
 #include "mldb/sql/expression_value.h"
 #include "mldb/types/structure_description.h"
+#include "mldb/jml/db/persistent.h"
 
 
 
@@ -119,6 +120,32 @@ update(const ColumnTypes & other)
     numOther = numOther + other.numOther;
 }
 
+void
+ColumnTypes::
+serialize(ML::DB::Store_Writer & store) const
+{
+    unsigned char version = 0;
+    store << version << numNulls << numZeros << numIntegers
+          << minNegativeInteger << maxNegativeInteger
+          << minPositiveInteger << maxPositiveInteger
+          << numReals << numStrings << numBlobs << numOther;
+}
+
+void
+ColumnTypes::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    unsigned char version;
+    store >> version;
+    if (version != 0)
+        throw Exception("Unknown ColumnTypes serialization version %d",
+                        (int)version);
+    store >> numNulls >> numZeros >> numIntegers
+          >> minNegativeInteger >> maxNegativeInteger
+          >> minPositiveInteger >> maxPositiveInteger
+          >> numReals >> numStrings >> numBlobs >> numOther;
+}
+
 std::shared_ptr<ExpressionValueInfo>
 ColumnTypes::   
 getExpressionValueInfo() const
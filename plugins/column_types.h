@@ -10,6 +10,7 @@
 
 #include <memory>
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/jml/db/persistent_fwd.h"
 
 
 namespace MLDB {
@@ -69,6 +70,9 @@ struct ColumnTypes {
     uint64_t numStrings;
     uint64_t numBlobs;
     uint64_t numOther;  // timestamps, intervals
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ColumnTypes);
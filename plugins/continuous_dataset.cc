@@ -20,6 +20,7 @@
 #include "mldb/watch/watch.h"
 #include "mldb/watch/watch_impl.h"
 #include "mldb/server/mldb_server.h"
+#include "mldb/core/committed_rows_watches.h"
 #include "mldb/builtin/merged_dataset.h"
 #include "mldb/utils/log.h"
 
@@ -179,13 +180,94 @@ struct ContinuousDataset::Itl {
     /// rotated.
     WatchesT<std::shared_ptr<Dataset> > datasetWatches;
 
+    /// Watches for the rows of each rotated dataset; see
+    /// watchCommittedRows()
+    CommittedRowsWatches committedRowsWatches;
+
     /// Date of the last commit
     std::atomic<double> lastCommit;
 
     shared_ptr<spdlog::logger> logger;
 
-    /** Rotate the dataset, atomically, and add it to the metadata store. */
+    /// Protects spare
+    std::mutex spareMutex;
+
+    /// Storage dataset created ahead of time, ready to be swapped in at
+    /// the next rotation.  Null if it hasn't been created yet.
+    std::unique_ptr<Current> spare;
+
+    /** Run the createStorageDataset procedure to create a new, empty
+        storage dataset.
+    */
+    std::unique_ptr<Current> createCurrent()
+    {
+        ProcedureRunConfig runConfig;
+
+        auto storageOutput
+            = createStorageDataset->run(runConfig, nullptr /* progress */);
+
+        INFO_MSG(logger) << "output of storage is " << jsonEncode(storageOutput);
+
+        std::unique_ptr<Current> result(new Current());
+        result->dataset
+            = obtainDataset(server,
+                            storageOutput.results.getField("config")
+                            .convert<PolyConfig>(), nullptr);
+        result->hasData = false;
+        return result;
+    }
+
+    /** Return the spare storage dataset if there is one, or create one
+        if not.
+    */
+    std::unique_ptr<Current> takeSpare()
+    {
+        {
+            std::unique_lock<std::mutex> guard(spareMutex);
+            if (spare)
+                return std::move(spare);
+        }
+        return createCurrent();
+    }
+
+    /** Make sure that there is a spare storage dataset for the next
+        rotation, so that the rotation doesn't need to wait for the
+        createStorageDataset procedure to run.  A failure here isn't fatal;
+        the next rotation will simply create its own.
+    */
+    void prepareSpare()
+    {
+        {
+            std::unique_lock<std::mutex> guard(spareMutex);
+            if (spare)
+                return;
+        }
+
+        std::unique_ptr<Current> newSpare;
+        try {
+            newSpare = createCurrent();
+        } MLDB_CATCH_ALL {
+            WARNING_MSG(logger) << "error creating spare storage dataset: "
+                                << getExceptionString();
+            return;
+        }
+
+        std::unique_lock<std::mutex> guard(spareMutex);
+        if (!spare)
+            spare = std::move(newSpare);
+    }
+
+    /** Rotate the dataset, atomically, and add it to the metadata store.
+        Afterwards, the storage dataset for the next rotation is created
+        so that it can be swapped in without waiting.
+    */
     void rotate(Date commitStarted)
+    {
+        rotateItl(commitStarted);
+        prepareSpare();
+    }
+
+    void rotateItl(Date commitStarted)
     {
         if (lastCommit.load() > commitStarted.secondsSinceEpoch())
             return;
@@ -197,22 +279,11 @@ struct ContinuousDataset::Itl {
         if (lastCommit.load() > commitStarted.secondsSinceEpoch())
             return;
 
-        // First, create a new storage dataset to hold anything that comes
-        // along while we're rotating the old
+        // First, get a new storage dataset to hold anything that comes
+        // along while we're rotating the old.  This is normally the spare
+        // that was created after the last rotation.
+        std::unique_ptr<Current> newCurrent = takeSpare();
 
-        ProcedureRunConfig runConfig;
-
-        auto storageOutput
-            = createStorageDataset->run(runConfig, nullptr /* progress */);
-
-        INFO_MSG(logger) << "output of storage is " << jsonEncode(storageOutput);
-
-        std::unique_ptr<Current> newCurrent(new Current());
-        newCurrent->dataset
-            = obtainDataset(server,
-                            storageOutput.results.getField("config")
-                            .convert<PolyConfig>(), nullptr);
-        
         // Now, swap it in...
         auto old = current.replaceCustomCleanup(newCurrent.release());
 
@@ -280,11 +351,18 @@ struct ContinuousDataset::Itl {
         metadataDataset->recordRow(rowName, metadata);
 
         datasetWatches.trigger(savedDataset);
+        committedRowsWatches.trigger(savedDataset);
 
         // We now know that everything is committed up to lastCommit.
         lastCommit = commitStarted.secondsSinceEpoch();
     }
 
+    std::shared_ptr<void>
+    watchCommittedRows(Dataset::OnCommittedRows onRows)
+    {
+        return committedRowsWatches.add(std::move(onRows));
+    }
+
     virtual void commit()
     {
         // Force a write-out of the dataset.  We only exit once it's
@@ -386,6 +464,13 @@ commit()
 {
     return itl->commit();
 }
+
+std::shared_ptr<void>
+ContinuousDataset::
+watchCommittedRows(OnCommittedRows onRows)
+{
+    return itl->watchCommittedRows(std::move(onRows));
+}
     
 std::pair<Date, Date>
 ContinuousDataset::
@@ -61,6 +61,13 @@ struct ContinuousDataset: public Dataset {
     /** Commit changes to the database.  Default is a no-op. */
     virtual void commit();
 
+    /** Calls onRows with each storage dataset once it has been rotated
+        out and saved.  The rows of the rotations before this is called
+        aren't passed.
+    */
+    virtual std::shared_ptr<void>
+    watchCommittedRows(OnCommittedRows onRows);
+
     virtual std::pair<Date, Date> getTimestampRange() const;
     virtual Date quantizeTimestamp(Date timestamp) const;
 
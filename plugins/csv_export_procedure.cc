@@ -23,7 +23,14 @@
 #include "mldb/vfs/filter_streams.h"
 #include "csv_writer.h"
 #include "mldb/plugins/sql_config_validator.h"
+#include "mldb/base/thread_pool.h"
+#include <atomic>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 using namespace std;
 
@@ -61,6 +68,13 @@ CsvExportProcedureConfigDescription()
              "    [Built-in Functions](../sql/ValueExpression.md.html) documentation for the\n"
              "    complete list of aggregators.\n\n",
              false);
+    addField("numParts", &CsvExportProcedureConfig::numParts,
+             "Number of files to write the export to.  With more than one, "
+             "the number of each part is added before the extensions of "
+             "`dataFileUrl`: `out.csv.gz` is written to `out-00000.csv.gz`, "
+             "`out-00001.csv.gz`, and so on.  The rows are spread over the "
+             "parts in blocks, which are written in parallel; each part "
+             "has its own headers.", 1);
 
     addParent<ProcedureConfig>();
 
@@ -73,6 +87,9 @@ CsvExportProcedureConfigDescription()
         if (cfg->quoteChar.size() != 1) {
             throw MLDB::Exception("Quotechar must be 1 char long.");
         }
+        if (cfg->numParts < 1) {
+            throw MLDB::Exception("numParts must be at least 1.");
+        }
         MustContainFrom()(cfg->exportData, CsvExportProcedureConfig::name);
     };
 }
@@ -86,6 +103,50 @@ CsvExportProcedure(MldbServer * owner,
     procedureConfig = config.params.convert<CsvExportProcedureConfig>();
 }
 
+namespace {
+
+/// Number of rows that are formatted together by one thread
+constexpr size_t CSV_EXPORT_BATCH_ROWS = 1024;
+
+/** Return the URL of the given part of a multi-part export.  The part
+    number goes before the extensions of the file name, so that
+    out.csv.gz gives out-00000.csv.gz, out-00001.csv.gz, ...
+*/
+Url getPartUrl(const Url & url, int part, int numParts)
+{
+    if (numParts == 1)
+        return url;
+
+    std::string str = url.toDecodedString();
+    size_t lastSlash = str.rfind('/');
+    size_t dot = str.find('.', lastSlash == std::string::npos ? 0 : lastSlash);
+
+    char partStr[32];
+    snprintf(partStr, sizeof(partStr), "-%05d", part);
+    if (dot == std::string::npos)
+        str += partStr;
+    else str.insert(dot, partStr);
+    return Url(str);
+}
+
+/** One of the files the export is written to.  The batches are formatted
+    in parallel, and finish out of order; each is added here and written
+    once all of the batches before it in the file have been.
+*/
+struct CsvExportPart {
+    CsvExportPart(const Url & url)
+        : stream(url)
+    {
+    }
+
+    filter_ostream stream;
+    std::mutex mutex;
+    size_t nextBatch = 0;
+    std::map<size_t, std::string> pending;
+};
+
+} // file scope
+
 RunOutput
 CsvExportProcedure::
 run(const ProcedureRunConfig & run,
@@ -93,9 +154,10 @@ run(const ProcedureRunConfig & run,
 {
     auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
     SqlExpressionMldbScope context(server);
-    filter_ostream out(runProcConf.dataFileUrl);
-    CsvWriter csv(out, runProcConf.delimiter.at(0),
-                  runProcConf.quoteChar.at(0));
+
+    const char delimiter = runProcConf.delimiter.at(0);
+    const char quoteChar = runProcConf.quoteChar.at(0);
+    const int numParts = runProcConf.numParts;
 
     auto boundDataset = runProcConf.exportData.stm->from->bind(context);
 
@@ -109,18 +171,17 @@ run(const ProcedureRunConfig & run,
                          calc);
 
     const auto columnNames = bsq.getSelectOutputInfo()->allColumnNames();
-    vector<string> lineBuffer; // keeps the data that cannot be outputed
-                               // yet to the csv due to the ordering difference
-                               // between columnNames and the order in which
-                               // columns are in the bound select query execute
     const auto lineSize = columnNames.size();
-    lineBuffer.resize(columnNames.size());
     const auto columnNamesEnd = columnNames.end();
     const auto columnNamesBegin = columnNames.begin();
-    auto outputCsvLine = [&] (NamedRowValue & row_,
-                              const vector<ExpressionValue> & calc)
+
+    // lineBuffer keeps the data that cannot be outputed yet to the csv due
+    // to the ordering difference between columnNames and the order in which
+    // columns are in the bound select query execute
+    auto outputCsvLine = [&] (MatrixNamedRow & row,
+                              CsvWriter & csv,
+                              vector<string> & lineBuffer)
     {
-        MatrixNamedRow row = row_.flattenDestructive();
         ExcAssert(lineBuffer.size() == columnNames.size());
         size_t lineBufferIndex = 0; // position of the buffered value ready to
                                     // be outputed
@@ -203,19 +264,120 @@ run(const ProcedureRunConfig & run,
             outputLineBuffer();
         }
         csv.endl();
-        return true;
     };
 
-    if (runProcConf.headers) {
-        for (const auto & name: bsq.getSelectOutputInfo()->allColumnNames()) {
-            csv << name.toUtf8String();
+    std::vector<std::unique_ptr<CsvExportPart> > parts;
+    for (int i = 0;  i < numParts;  ++i) {
+        parts.emplace_back(new CsvExportPart
+                           (getPartUrl(runProcConf.dataFileUrl, i, numParts)));
+        if (runProcConf.headers) {
+            CsvWriter csv(parts.back()->stream, delimiter, quoteChar);
+            for (const auto & name: columnNames) {
+                csv << name.toUtf8String();
+            }
+            csv.endl();
         }
-        csv.endl();
     }
-    bsq.execute({outputCsvLine, false/*processInParallel*/},
-                runProcConf.exportData.stm->offset,
-                runProcConf.exportData.stm->limit,
-                onProgress);
+
+    // Batches are formatted on the thread pool while the query produces
+    // the next ones.  At most maxBatchesInFlight of them wait to be
+    // written, which bounds the memory used when the output is slower
+    // than the query.
+    ThreadPool tp;
+    const size_t maxBatchesInFlight = 2 * tp.numThreads() + numParts;
+    std::atomic<size_t> batchesWritten(0);
+    size_t batchesSubmitted = 0;
+
+    std::atomic<bool> hasExc(false);
+    std::exception_ptr exc;
+    std::mutex excMutex;
+
+    auto formatBatch = [&] (size_t batchNumber,
+                            std::shared_ptr<std::vector<MatrixNamedRow> > rows)
+    {
+        try {
+            std::ostringstream stream;
+            CsvWriter csv(stream, delimiter, quoteChar);
+            vector<string> lineBuffer(lineSize);
+            for (auto & row: *rows)
+                outputCsvLine(row, csv, lineBuffer);
+            rows.reset();
+
+            // The batches of a file are written in the order they were
+            // produced
+            CsvExportPart & part = *parts[batchNumber % numParts];
+            std::unique_lock<std::mutex> guard(part.mutex);
+            part.pending.emplace(batchNumber / numParts, stream.str());
+            while (!part.pending.empty()
+                   && part.pending.begin()->first == part.nextBatch) {
+                part.stream << part.pending.begin()->second;
+                part.pending.erase(part.pending.begin());
+                ++part.nextBatch;
+                ++batchesWritten;
+            }
+        } catch (...) {
+            std::unique_lock<std::mutex> guard(excMutex);
+            if (!hasExc) {
+                exc = std::current_exception();
+                hasExc = true;
+            }
+            // Don't leave the producer waiting for a batch that will never
+            // be written
+            ++batchesWritten;
+        }
+    };
+
+    auto batch = std::make_shared<std::vector<MatrixNamedRow> >();
+
+    auto submitBatch = [&] ()
+    {
+        if (batch->empty())
+            return;
+        while (batchesSubmitted - batchesWritten >= maxBatchesInFlight
+               && !hasExc) {
+            tp.work();
+            std::this_thread::yield();
+        }
+        size_t batchNumber = batchesSubmitted++;
+        tp.add(std::bind(formatBatch, batchNumber, std::move(batch)));
+        batch = std::make_shared<std::vector<MatrixNamedRow> >();
+        batch->reserve(CSV_EXPORT_BATCH_ROWS);
+    };
+
+    auto onRow = [&] (NamedRowValue & row_,
+                      const vector<ExpressionValue> & calc)
+    {
+        if (hasExc)
+            return false;
+        batch->emplace_back(row_.flattenDestructive());
+        if (batch->size() >= CSV_EXPORT_BATCH_ROWS)
+            submitBatch();
+        return true;
+    };
+
+    try {
+        bsq.execute({onRow, false/*processInParallel*/},
+                    runProcConf.exportData.stm->offset,
+                    runProcConf.exportData.stm->limit,
+                    onProgress);
+
+        if (!hasExc)
+            submitBatch();
+    } catch (...) {
+        // The batches refer to our stack, so they need to finish first
+        tp.waitForAll();
+        throw;
+    }
+    tp.waitForAll();
+
+    if (hasExc)
+        std::rethrow_exception(exc);
+
+    for (auto & part: parts) {
+        ExcAssert(part->pending.empty());
+        part->stream.close();
+    }
+
     RunOutput output;
     return output;
 }
@@ -8,6 +8,7 @@
 
 #include "csv_writer.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/arch/string_scan.h"
 
 namespace MLDB {
 
@@ -58,16 +59,20 @@ operator<< (const std::string & val)
     }
 
     {
-        // escaping
-        auto newVal = boost::replace_all_copy(val, quoteChar,
-                                                quoteChar + quoteChar);
-        if (val.find(delimiterChar) != std::string::npos
-            || newVal.size() != val.size())
-        {
-            out << quoteChar << newVal << quoteChar;
+        // escaping.  Most values contain neither the delimiter nor the
+        // quote, which is found out in one pass without copying them.
+        size_t pos = findEither(val.data(), val.size(),
+                                delimiterChar[0], quoteChar[0]);
+        if (pos == val.size()) {
+            out << val;
+        }
+        else if (val.find(quoteChar, pos) == std::string::npos) {
+            out << quoteChar << val << quoteChar;
         }
         else {
-            out << val;
+            auto newVal = boost::replace_all_copy(val, quoteChar,
+                                                  quoteChar + quoteChar);
+            out << quoteChar << newVal << quoteChar;
         }
     }
 
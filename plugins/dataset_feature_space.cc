@@ -12,6 +12,11 @@
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/utils/log.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include <list>
+#include <map>
+#include <mutex>
 
 using namespace std;
 
@@ -22,6 +27,59 @@ namespace MLDB {
 
 const ML::Feature labelFeature(0, 0, 0), weightFeature(0, 1, 0);
 
+namespace {
+
+EnvOption<size_t> MLDB_FEATURE_SPACE_CACHE_BYTES
+("MLDB_FEATURE_SPACE_CACHE_BYTES", 256 * 1024 * 1024);
+
+/** Approximate memory used by the buckets of a column. */
+size_t columnInfoBytes(const DatasetFeatureSpace::ColumnInfo & info)
+{
+    size_t result = sizeof(info);
+    result += (info.buckets.numEntries * info.buckets.entryBits + 63) / 64 * 8;
+    result += info.bucketDescriptions.numeric.splits.size() * sizeof(double);
+    for (auto & s: info.bucketDescriptions.strings.buckets)
+        result += sizeof(s) + s.rawLength();
+    return result;
+}
+
+/** Column information shared between feature spaces, with the least
+    recently used entries at the back.
+*/
+struct ColumnInfoCache {
+    typedef std::tuple<const Dataset *, ColumnPath, bool> Key;
+
+    struct Entry {
+        Key key;
+        std::weak_ptr<Dataset> dataset;
+        uint64_t generation = 0;
+        DatasetFeatureSpace::ColumnInfo info;
+        size_t bytes = 0;
+    };
+
+    std::mutex mutex;
+    std::list<Entry> entries;
+    std::map<Key, std::list<Entry>::iterator> index;
+    size_t bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    void erase(std::list<Entry>::iterator it)
+    {
+        bytes -= it->bytes;
+        index.erase(it->key);
+        entries.erase(it);
+    }
+};
+
+ColumnInfoCache & columnInfoCache()
+{
+    static ColumnInfoCache cache;
+    return cache;
+}
+
+} // file scope
+
 
 /*****************************************************************************/
 /* DATASET FEATURE SPACE                                                     */
@@ -58,7 +116,8 @@ DatasetFeatureSpace(std::shared_ptr<Dataset> dataset,
             const ColumnPath & columnName = filteredColumns[i];
             ColumnHash ch = columnName;
             int oldIndex = columnInfo[ch].index;
-            columnInfo[ch] = getColumnInfo(dataset, columnName, bucketize);
+            columnInfo[ch] = getCachedColumnInfo(dataset, columnName,
+                                                 bucketize);
             columnInfo[ch].index = oldIndex;
             return true;
         };
@@ -176,6 +235,99 @@ getColumnInfo(std::shared_ptr<Dataset> dataset,
     return result;
 }
 
+//static
+DatasetFeatureSpace::ColumnInfo
+DatasetFeatureSpace::
+getCachedColumnInfo(std::shared_ptr<Dataset> dataset,
+                    const ColumnPath & columnName,
+                    bool bucketize)
+{
+    size_t maxBytes = MLDB_FEATURE_SPACE_CACHE_BYTES;
+    if (maxBytes == 0)
+        return getColumnInfo(dataset, columnName, bucketize);
+
+    // Read the generation first, so that if the dataset is committed to
+    // while we scan it, the result isn't found again under the later one
+    uint64_t generation = dataset->getGeneration();
+    if (generation == 0)
+        return getColumnInfo(dataset, columnName, bucketize);
+
+    ColumnInfoCache & cache = columnInfoCache();
+    ColumnInfoCache::Key key(dataset.get(), columnName, bucketize);
+
+    {
+        std::unique_lock<std::mutex> guard(cache.mutex);
+        auto it = cache.index.find(key);
+        if (it != cache.index.end()) {
+            ColumnInfoCache::Entry & entry = *it->second;
+            if (entry.generation == generation
+                && entry.dataset.lock() == dataset) {
+                cache.hits += 1;
+                cache.entries.splice(cache.entries.begin(), cache.entries,
+                                     it->second);
+                return entry.info;
+            }
+            cache.erase(it->second);
+        }
+        cache.misses += 1;
+    }
+
+    ColumnInfo result = getColumnInfo(dataset, columnName, bucketize);
+
+    ColumnInfoCache::Entry entry;
+    entry.key = key;
+    entry.dataset = dataset;
+    entry.generation = generation;
+    entry.info = result;
+    entry.bytes = columnInfoBytes(result);
+    if (entry.bytes > maxBytes)
+        return result;
+
+    std::unique_lock<std::mutex> guard(cache.mutex);
+
+    // Another thread may have done the same column in the meantime
+    auto it = cache.index.find(key);
+    if (it != cache.index.end())
+        cache.erase(it->second);
+
+    cache.bytes += entry.bytes;
+    cache.entries.emplace_front(std::move(entry));
+    cache.index[key] = cache.entries.begin();
+
+    while (cache.bytes > maxBytes)
+        cache.erase(std::prev(cache.entries.end()));
+
+    return result;
+}
+
+//static
+Json::Value
+DatasetFeatureSpace::
+getColumnInfoCacheStats()
+{
+    ColumnInfoCache & cache = columnInfoCache();
+    std::unique_lock<std::mutex> guard(cache.mutex);
+
+    Json::Value result;
+    result["hits"] = (Json::UInt)cache.hits;
+    result["misses"] = (Json::UInt)cache.misses;
+    result["entries"] = (Json::UInt)cache.entries.size();
+    result["bytes"] = (Json::UInt)cache.bytes;
+    return result;
+}
+
+//static
+void
+DatasetFeatureSpace::
+clearColumnInfoCache()
+{
+    ColumnInfoCache & cache = columnInfoCache();
+    std::unique_lock<std::mutex> guard(cache.mutex);
+    cache.entries.clear();
+    cache.index.clear();
+    cache.bytes = 0;
+}
+
 float
 DatasetFeatureSpace::
 encodeFeatureValue(ColumnHash column, const CellValue & value) const
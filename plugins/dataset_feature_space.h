@@ -71,6 +71,29 @@ struct DatasetFeatureSpace: public ML::Feature_Space {
                                     const ColumnPath & columnName,
                                     bool bucketize);
 
+    /** Return the same as getColumnInfo(), but shared with earlier calls
+        for the same column of the same dataset at the same generation
+        (see Dataset::getGeneration()).  Bucketizing a column scans all of
+        its values, which each fold of classifier.experiment or each
+        procedure training on the same data would otherwise do again.
+
+        Up to MLDB_FEATURE_SPACE_CACHE_BYTES bytes (default 256MB) of
+        column information are kept, with the least recently used
+        evicted first; zero disables the cache.  Columns of datasets with
+        a generation of zero are never cached.
+    */
+    static ColumnInfo getCachedColumnInfo(std::shared_ptr<Dataset> dataset,
+                                          const ColumnPath & columnName,
+                                          bool bucketize);
+
+    /** Return the hits, misses, entries and bytes of the column
+        information cache.
+    */
+    static Json::Value getColumnInfoCacheStats();
+
+    /** Remove everything from the column information cache. */
+    static void clearColumnInfoCache();
+
     std::unordered_map<ColumnHash, ColumnInfo> columnInfo;
 
     ML::Feature_Info labelInfo;
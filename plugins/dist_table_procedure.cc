@@ -561,16 +561,30 @@ DistTableFunctionConfigDescription()
     addField("distTableFileUrl", &DistTableFunctionConfig::modelFileUrl,
              "URL of the model file (with extension '.dt') to load. "
              "This file is created by the ![](%%doclink experimental.distTable.train procedure).");
+    addField("snapshotInterval", &DistTableFunctionConfig::snapshotInterval,
+             "Number of seconds between each publication of the counts "
+             "updated through the `increment` route to the lookups.  With "
+             "the default of zero, an increment is visible to the lookups "
+             "as soon as it returns.  A positive value makes increments "
+             "cheaper under heavy update rates, at the cost of lookups "
+             "seeing counts up to that many seconds old.", 0.0);
 }
 
 DistTableFunction::
 DistTableFunction(MldbServer * owner,
                PolyConfig config,
                const std::function<bool (const Json::Value &)> & onProgress)
-    : Function(owner)
+    : Function(owner),
+      snapshot(snapshotLock),
+      shutdown(false)
 {
     functionConfig = config.params.convert<DistTableFunctionConfig>();
 
+    if (functionConfig.snapshotInterval < 0)
+        throw HttpReturnException
+            (400, "The snapshotInterval of a dist table function can't be "
+             "negative", "snapshotInterval", functionConfig.snapshotInterval);
+
     int version;
     int REQUIRED_VERSION = 2;
     int i_mode;
@@ -588,8 +602,16 @@ DistTableFunction(MldbServer * owner,
     if(mode != DT_MODE_BAG_OF_WORDS && mode != DT_MODE_FIXED_COLUMNS)
         throw MLDB::Exception("Unsupported DistTable mode");
 
+    DistTablesMap distTablesMap;
     store >> distTablesMap;
 
+    std::unique_ptr<Snapshot> initial(new Snapshot());
+    for (auto & t: distTablesMap) {
+        initial->tables[t.first] = std::make_shared<const DistTable>(t.second);
+        liveTables[t.first].reset(new LiveTable(std::move(t.second)));
+    }
+    snapshot.replace(initial.release());
+
     // build a cache of the names for quick access
     for(int i=0; i<DT_NUM_STATISTICS; i++)
         dtStatsNames[(DISTTABLE_STATISTICS)i] = print((DISTTABLE_STATISTICS)i);
@@ -601,6 +623,20 @@ DistTableFunction(MldbServer * owner,
     for(auto & stat : functionConfig.statistics) {
         activeStats.push_back(parseDistTableStatistic(stat));
     }
+
+    if (functionConfig.snapshotInterval > 0) {
+        auto runPublisher = [this] ()
+            {
+                auto interval = std::chrono::duration<double>
+                    (functionConfig.snapshotInterval);
+                std::unique_lock<std::mutex> guard(publisherMutex);
+                while (!publisherCond.wait_for(guard, interval,
+                                               [&] () { return shutdown; })) {
+                    publishSnapshot();
+                }
+            };
+        publisher = std::thread(runPublisher);
+    }
 }
 
 RestRequestMatchResult
@@ -648,39 +684,89 @@ DistTableFunction::
 increment(const vector<pair<Utf8String, Utf8String>> & keys,
           const vector<double> & outcomes) const
 {
-    // get exclusive access
-    boost::unique_lock<boost::shared_mutex> uniqueLock(_access);
-
+    // Check all the keys before modifying anything
+    vector<LiveTable *> tables;
     for(const auto & key : keys) {
         Path pKey(key.first);
-        auto table_it = distTablesMap.find(pKey);
-        if(table_it == distTablesMap.end())
+        auto table_it = liveTables.find(pKey);
+        if(table_it == liveTables.end())
             throw MLDB::Exception("Unknown dist table '"+
                         key.first.utf8String()+"'");
+        tables.push_back(table_it->second.get());
+    }
 
-        //for(double outcome : outcomes)
-        (*table_it).second.increment(key.second, outcomes);
+    for (size_t i = 0;  i < keys.size();  ++i) {
+        // only the shard being modified is locked
+        std::unique_lock<std::mutex> guard(tables[i]->mutex);
+        tables[i]->table.increment(keys[i].second, outcomes);
+        tables[i]->dirty = true;
     }
+
+    if (functionConfig.snapshotInterval == 0)
+        publishSnapshot();
 }
 
 void
 DistTableFunction::
-persist(const Url & modelFileUrl) const
+publishSnapshot() const
+{
+    std::unique_lock<std::mutex> guard(publishMutex);
+
+    auto current = snapshot();
+    std::unique_ptr<Snapshot> newSnapshot;
+
+    for (auto & t: liveTables) {
+        LiveTable & live = *t.second;
+        std::unique_lock<std::mutex> tableGuard(live.mutex);
+        if (!live.dirty)
+            continue;
+        if (!newSnapshot)
+            newSnapshot.reset(new Snapshot(*current));
+        newSnapshot->tables[t.first]
+            = std::make_shared<const DistTable>(live.table);
+        live.dirty = false;
+    }
+
+    // Nothing changed; readers can keep the current one
+    if (!newSnapshot)
+        return;
+
+    current.unlock();
+    // The old snapshot is freed once no lookup can still be reading it
+    snapshot.replace(newSnapshot.release());
+}
+
+DistTablesMap
+DistTableFunction::
+copyLiveTables() const
 {
-    // get exclusive access
-    DistTablesMap copiedMap;
-    {
-        boost::shared_lock<boost::shared_mutex> uniqueLock(_access);
-        copiedMap = DistTablesMap(distTablesMap);
+    DistTablesMap result;
+    for (auto & t: liveTables) {
+        std::unique_lock<std::mutex> guard(t.second->mutex);
+        result.insert(make_pair(t.first, t.second->table));
     }
+    return result;
+}
 
+void
+DistTableFunction::
+persist(const Url & modelFileUrl) const
+{
     DistTableProcedure::persist(modelFileUrl,
-            mode, copiedMap);
+            mode, copyLiveTables());
 }
 
 DistTableFunction::
 ~DistTableFunction()
 {
+    if (publisher.joinable()) {
+        {
+            std::unique_lock<std::mutex> guard(publisherMutex);
+            shutdown = true;
+        }
+        publisherCond.notify_all();
+        publisher.join();
+    }
 }
 
 Any
@@ -712,6 +798,10 @@ apply(const FunctionApplier & applier,
                                   "input", arg);
 
 
+    // Lookups read the latest published snapshot, without locking out
+    // the increments
+    auto tables = snapshot();
+
     RowValue rtnRow;
     // TODO should we cache column names
     auto onAtomFixedColumns =
@@ -720,11 +810,11 @@ apply(const FunctionApplier & applier,
              const CellValue & val,
              Date ts)
     {
-        auto st = distTablesMap.find(columnName);
-        if (st == distTablesMap.end())
+        auto st = tables->tables.find(columnName);
+        if (st == tables->tables.end())
             return true;
 
-        const DistTable & distTable = st->second;
+        const DistTable & distTable = *st->second;
         const auto & stats = distTable.getStats(val.toUtf8String());
         for (int i=0; i < distTable.outcome_names.size(); ++i) {
             for(DISTTABLE_STATISTICS sid : activeStats) {
@@ -748,7 +838,7 @@ apply(const FunctionApplier & applier,
         if (val.empty())
             return true;
 
-        const DistTable & distTable = distTablesMap.begin()->second;
+        const DistTable & distTable = *tables->tables.begin()->second;
         const auto & stats = distTable.getStats(columnName.toUtf8String());
         for (int i=0; i < distTable.outcome_names.size(); ++i) {
             for(DISTTABLE_STATISTICS sid : activeStats) {
@@ -763,17 +853,13 @@ apply(const FunctionApplier & applier,
         return true;
     };
 
-    // get reader lock
-    {
-        boost::shared_lock<boost::shared_mutex> lock(_access);
-        switch(mode) {
-            case DT_MODE_FIXED_COLUMNS:
-                arg.forEachAtom(onAtomFixedColumns);
-                break;
-            case DT_MODE_BAG_OF_WORDS:
-                arg.forEachAtom(onAtomBow);
-                break;
-        }
+    switch(mode) {
+        case DT_MODE_FIXED_COLUMNS:
+            arg.forEachAtom(onAtomFixedColumns);
+            break;
+        case DT_MODE_BAG_OF_WORDS:
+            arg.forEachAtom(onAtomBow);
+            break;
     }
 
     result.emplace_back("stats", ExpressionValue(std::move(rtnRow)));
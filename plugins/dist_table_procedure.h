@@ -16,7 +16,11 @@
 #include "mldb/jml/db/persistent_fwd.h"
 #include "mldb/types/optional.h"
 #include "mldb/types/string.h"
-#include <boost/thread/shared_mutex.hpp>
+#include "mldb/arch/rcu_protected.h"
+#include "mldb/arch/epoch_lock.h"
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 
 namespace MLDB {
@@ -200,12 +204,17 @@ struct DistTableProcedure: public Procedure {
 struct DistTableFunctionConfig {
     DistTableFunctionConfig(const Url & modelFileUrl = Url(),
             std::vector<Utf8String> statistics = { "count", "avg", "std", "min", "max" })
-        : statistics(statistics), modelFileUrl(modelFileUrl)
+        : statistics(statistics), modelFileUrl(modelFileUrl),
+          snapshotInterval(0)
     {
     }
 
     std::vector<Utf8String> statistics;
     Url modelFileUrl;
+
+    /// Seconds between publications of the snapshot read by lookups; zero
+    /// publishes it before each increment returns
+    double snapshotInterval;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(DistTableFunctionConfig);
@@ -237,16 +246,58 @@ struct DistTableFunction: public Function {
                   const RestRequest & request,
                   RestRequestParsingContext & context) const override;
 
-    mutable boost::shared_mutex _access;
-
     DistTableFunctionConfig functionConfig;
     DistTableMode mode;
 
     std::string dtStatsNames[DT_NUM_STATISTICS];
 
     std::vector<DISTTABLE_STATISTICS> activeStats;
-    mutable DistTablesMap distTablesMap;
 
+private:
+    /** Each dist table is a shard of the counts that are updated in place
+        by increment(), under the lock of the shard only.
+    */
+    struct LiveTable {
+        LiveTable(DistTable table)
+            : table(std::move(table)), dirty(false)
+        {
+        }
+
+        std::mutex mutex;
+        DistTable table;
+        bool dirty;  ///< Incremented since its last publication
+    };
+
+    /** Immutable copy of the dist tables, read by lookups without taking
+        any locks.  Tables that didn't change since the last publication
+        are shared with the previous snapshot.
+    */
+    struct Snapshot {
+        std::map<ColumnPath, std::shared_ptr<const DistTable> > tables;
+    };
+
+    /// Copy the dirty tables into a new snapshot and publish it
+    void publishSnapshot() const;
+
+    /// Copy of all the live tables, for persisting them
+    DistTablesMap copyLiveTables() const;
+
+    /// Set of tables is fixed on construction; only their contents change
+    std::map<ColumnPath, std::unique_ptr<LiveTable> > liveTables;
+
+    mutable EpochLock snapshotLock;
+    mutable RcuProtected<Snapshot, EpochLock> snapshot;
+
+    /// Serializes publications of the snapshot
+    mutable std::mutex publishMutex;
+
+    /// Thread publishing the snapshot every snapshotInterval seconds
+    std::thread publisher;
+    std::mutex publisherMutex;
+    std::condition_variable publisherCond;
+    bool shutdown;
+
+public:
     RestRequestRouter router;
 };
 
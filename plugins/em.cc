@@ -50,6 +50,20 @@ std::vector<double> tovector(boost::multi_array<double, 2>& m)
     return embedding;
 }
 
+DEFINE_ENUM_DESCRIPTION_NAMED(EMCovarianceDescription, ML::EM_Covariance);
+
+EMCovarianceDescription::
+EMCovarianceDescription()
+{
+    addValue("full", ML::EM_COVARIANCE_FULL,
+             "Each cluster has a full N by N covariance matrix, which can "
+             "represent clusters that are not axis-aligned.");
+    addValue("diagonal", ML::EM_COVARIANCE_DIAGONAL,
+             "Each cluster only has a variance per dimension.  Training and "
+             "scoring are linear in the number of dimensions instead of "
+             "quadratic, which makes it usable for many more dimensions.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(EMConfig);
 
 EMConfigDescription::
@@ -95,6 +109,10 @@ EMConfigDescription()
              "Maximum number of iterations to perform.  If no convergance is "
              "reached within this number of iterations, the current clustering "
              "will be returned.", 100);
+    addField("covariance", &EMConfig::covariance,
+             "Form of the covariance matrix of each cluster.  Diagonal "
+             "covariances allow for many more input dimensions.",
+             ML::EM_COVARIANCE_FULL);
     addField("functionName", &EMConfig::functionName,
              "If specified, a function of this name will be created using "
              "the training result.");
@@ -166,6 +184,7 @@ run(const ProcedureRunConfig & run,
                                   "does not filter all the rows");
 
     ML::EstimationMaximisation em;
+    em.covariance = emConfig.covariance;
     vector<int> inCluster;
 
     int numClusters = emConfig.numClusters;
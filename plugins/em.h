@@ -16,10 +16,13 @@
 #include "mldb/ml/value_descriptions.h"
 #include "metric_space.h"
 #include "mldb/types/optional.h"
+#include "mldb/ml/em.h"
 
 
 namespace MLDB {
 
+DECLARE_ENUM_DESCRIPTION_NAMED(EMCovarianceDescription, ML::EM_Covariance);
+
 
 /*****************************************************************************/
 /* EM CONFIG                                                                 */
@@ -31,7 +34,8 @@ struct EMConfig : public ProcedureConfig  {
     EMConfig()
         : numInputDimensions(-1),
           numClusters(10),
-          maxIterations(100)
+          maxIterations(100),
+          covariance(ML::EM_COVARIANCE_FULL)
     {
         centroids.withType("embedding");
     }
@@ -44,6 +48,7 @@ struct EMConfig : public ProcedureConfig  {
     int numInputDimensions;
     int numClusters;
     int maxIterations;
+    ML::EM_Covariance covariance;
     Url modelFileUrl;
 
     Utf8String functionName;
@@ -9,6 +9,7 @@
 
 #include "embedding.h"
 #include "mldb/ml/tsne/vantage_point_tree.h"
+#include "mldb/ml/tsne/hnsw_index.h"
 #include "mldb/arch/rcu_protected.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/arch/simd_vector.h"
@@ -27,6 +28,8 @@
 #include "mldb/server/dataset_context.h"
 #include "mldb/server/bucket.h"
 #include "mldb/utils/possibly_dynamic_buffer.h"
+#include "mldb/utils/float16.h"
+#include "mldb/vfs/fs_utils.h"
 #include <boost/algorithm/clamp.hpp>
 #include "mldb/utils/log.h"
 
@@ -55,6 +58,40 @@ operator >> (ML::DB::Store_Reader & store, Path & coords);
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+DEFINE_ENUM_DESCRIPTION(EmbeddingIndex);
+
+EmbeddingIndexDescription::
+EmbeddingIndexDescription()
+{
+    addValue("vptree", EMBEDDING_INDEX_VPTREE,
+             "Vantage point tree.  Searches are exact, but slow down to "
+             "nearly a scan of every row for high dimensional embeddings, "
+             "and the tree is rebuilt from scratch on each commit.");
+    addValue("hnsw", EMBEDDING_INDEX_HNSW,
+             "Hierarchical navigable small world graph.  Searches are "
+             "approximate but stay fast for large, high dimensional "
+             "embeddings.  The graph is built in parallel, and rows "
+             "recorded after a commit are added to it rather than "
+             "rebuilding it.");
+}
+
+DEFINE_ENUM_DESCRIPTION(EmbeddingStorage);
+
+EmbeddingStorageDescription::
+EmbeddingStorageDescription()
+{
+    addValue("float32", EMBEDDING_STORAGE_FLOAT32,
+             "Single precision floats, four bytes per coordinate.");
+    addValue("float16", EMBEDDING_STORAGE_FLOAT16,
+             "Half precision floats, two bytes per coordinate.  They keep "
+             "about three significant digits, and values are limited to "
+             "+/- 65504.");
+    addValue("int8", EMBEDDING_STORAGE_INT8,
+             "One byte per coordinate, which gives the coordinate as one "
+             "of 256 steps between the smallest and largest coordinates "
+             "of its row, plus eight bytes per row.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
 
 EmbeddingDatasetConfigDescription::
@@ -68,39 +105,347 @@ EmbeddingDatasetConfigDescription()
              "good for normalized embeddings like the SVD) and 'euclidean' "
              "(which is good for geometric embeddings like the t-SNE "
              "algorithm).", METRIC_EUCLIDEAN);
+    addField("index", &EmbeddingDatasetConfig::index,
+             "Index used for nearest neighbors queries.  'vptree' gives "
+             "exact results; 'hnsw' gives approximate results much faster "
+             "on large embeddings.", EMBEDDING_INDEX_VPTREE);
+    addField("hnswNeighbors", &EmbeddingDatasetConfig::hnswNeighbors,
+             "For the 'hnsw' index, the number of neighbors each row is "
+             "linked to (twice this for the bottom level of the graph).  "
+             "Higher values give better recall for high dimensional "
+             "embeddings, at the cost of memory and build time.", 16U);
+    addField("hnswConstructionWidth",
+             &EmbeddingDatasetConfig::hnswConstructionWidth,
+             "For the 'hnsw' index, the number of candidates looked at "
+             "to find the neighbors of each row as it's added.  Higher "
+             "values give a better graph, at the cost of build time.", 200U);
+    addField("hnswSearchWidth", &EmbeddingDatasetConfig::hnswSearchWidth,
+             "For the 'hnsw' index, the number of candidates looked at by "
+             "each nearest neighbors query (or the number of neighbors "
+             "asked for, if that is higher).  Higher values give better "
+             "recall, at the cost of query time.", 100U);
+    addField("storage", &EmbeddingDatasetConfig::storage,
+             "How the coordinates are stored.  'float32' keeps them as "
+             "they are recorded; 'float16' and 'int8' take a half and a "
+             "quarter of the memory, and the index and the values "
+             "returned are based on the rounded coordinates.",
+             EMBEDDING_STORAGE_FLOAT32);
+    addField("rerankFactor", &EmbeddingDatasetConfig::rerankFactor,
+             "For 'float16' and 'int8' storage, if this is not zero, "
+             "nearest neighbors queries look for this many times the "
+             "number of neighbors asked for with the rounded coordinates, "
+             "and return the closest of them by the distance between the "
+             "exact coordinates.  The exact coordinates are kept as well "
+             "as the rounded ones; once the dataset is loaded from its "
+             "dataFileUrl, they are only read from the file for these "
+             "candidates.", 0U);
+    addField("dataFileUrl", &EmbeddingDatasetConfig::dataFileUrl,
+             "URL of a file in which to persist the dataset.  If the file "
+             "exists when the dataset is created, the dataset is loaded "
+             "from it (memory mapping it if it is a local file) without "
+             "building its index again, and can't be recorded to.  "
+             "Otherwise, the dataset is saved to this file when it is "
+             "committed.");
 }
 
 
+/*****************************************************************************/
+/* EMBEDDING COORDS                                                          */
+/*****************************************************************************/
+
+/** Coordinates of the rows of an embedding, one row after the other in a
+    fixed number of bytes per row, in the format given by the storage.  The
+    bytes are either owned, as rows are recorded, or point into the
+    mapping of a saved dataset, which is kept alive with them.
+
+    An int8 row starts with two floats, the minimum and the scale of the
+    row, and is followed by one byte per coordinate which gives it as
+    minimum + byte * scale.
+*/
+struct EmbeddingCoords {
+    EmbeddingCoords(EmbeddingStorage storage = EMBEDDING_STORAGE_FLOAT32,
+                    size_t numDims = 0)
+        : storage(storage), numDims(numDims),
+          rowBytes(getRowBytes(storage, numDims)),
+          mappedData(nullptr), mappedRows(0)
+    {
+    }
+
+    EmbeddingStorage storage;
+    size_t numDims;
+    size_t rowBytes;
+
+    std::vector<char> owned;
+    const char * mappedData;
+    size_t mappedRows;
+    std::shared_ptr<const void> mapping;
+
+    static size_t getRowBytes(EmbeddingStorage storage, size_t numDims)
+    {
+        size_t result;
+        switch (storage) {
+        case EMBEDDING_STORAGE_FLOAT32:  result = 4 * numDims;  break;
+        case EMBEDDING_STORAGE_FLOAT16:  result = 2 * numDims;  break;
+        case EMBEDDING_STORAGE_INT8:     result = 8 + numDims;  break;
+        default:
+            throw HttpReturnException(500, "Unknown embedding storage",
+                                      "storage", (int)storage);
+        }
+
+        // Keep the floats of each row aligned
+        return (result + 3) & ~size_t(3);
+    }
+
+    size_t size() const
+    {
+        if (mapping)
+            return mappedRows;
+        return rowBytes ? owned.size() / rowBytes : 0;
+    }
+
+    const char * data() const
+    {
+        return mapping ? mappedData : owned.data();
+    }
+
+    /// Number of floats of buffer that get() needs
+    size_t bufferSize() const
+    {
+        return storage == EMBEDDING_STORAGE_FLOAT32 ? 0 : numDims;
+    }
+
+    /** Return the coordinates of the given row.  Floats are returned in
+        place; other storage is decoded into buffer, which has room for
+        bufferSize() floats.
+    */
+    const float * get(size_t row, float * buffer) const
+    {
+        const char * p = data() + row * rowBytes;
+
+        switch (storage) {
+        case EMBEDDING_STORAGE_FLOAT32:
+            return reinterpret_cast<const float *>(p);
+        case EMBEDDING_STORAGE_FLOAT16: {
+            const uint16_t * values = reinterpret_cast<const uint16_t *>(p);
+            for (size_t i = 0;  i < numDims;  ++i)
+                buffer[i] = float16ToFloat(values[i]);
+            return buffer;
+        }
+        case EMBEDDING_STORAGE_INT8: {
+            const float * header = reinterpret_cast<const float *>(p);
+            const uint8_t * values = reinterpret_cast<const uint8_t *>(p + 8);
+            for (size_t i = 0;  i < numDims;  ++i)
+                buffer[i] = header[0] + values[i] * header[1];
+            return buffer;
+        }
+        }
+        throw HttpReturnException(500, "Unknown embedding storage");
+    }
+
+    /** Return the given coordinate of the given row. */
+    float getCoord(size_t row, size_t dim) const
+    {
+        const char * p = data() + row * rowBytes;
+
+        switch (storage) {
+        case EMBEDDING_STORAGE_FLOAT32:
+            return reinterpret_cast<const float *>(p)[dim];
+        case EMBEDDING_STORAGE_FLOAT16:
+            return float16ToFloat(reinterpret_cast<const uint16_t *>(p)[dim]);
+        case EMBEDDING_STORAGE_INT8: {
+            const float * header = reinterpret_cast<const float *>(p);
+            return header[0] + ((const uint8_t *)p)[8 + dim] * header[1];
+        }
+        }
+        throw HttpReturnException(500, "Unknown embedding storage");
+    }
+
+    /** Add a row at the end.  If the coordinates can't be stored, nothing
+        is added and an exception is thrown.
+    */
+    void add(const float * coords)
+    {
+        float minimum = 0, scale = 0;
+        if (storage == EMBEDDING_STORAGE_INT8 && numDims > 0) {
+            minimum = coords[0];
+            float maximum = coords[0];
+            for (size_t i = 0;  i < numDims;  ++i) {
+                if (!isfinite(coords[i]))
+                    throw HttpReturnException
+                        (400, "Embedding coordinates stored as int8 must "
+                         "be finite",
+                         "coords", std::vector<float>(coords, coords + numDims));
+                minimum = std::min(minimum, coords[i]);
+                maximum = std::max(maximum, coords[i]);
+            }
+            scale = (maximum - minimum) / 255;
+        }
+
+        // Rows can't be added to a mapping, so they are copied first
+        if (mapping) {
+            owned.assign(mappedData, mappedData + mappedRows * rowBytes);
+            mapping.reset();
+            mappedData = nullptr;
+            mappedRows = 0;
+        }
+
+        size_t offset = owned.size();
+        owned.resize(offset + rowBytes);
+        char * p = owned.data() + offset;
+
+        switch (storage) {
+        case EMBEDDING_STORAGE_FLOAT32:
+            std::copy(coords, coords + numDims, reinterpret_cast<float *>(p));
+            break;
+        case EMBEDDING_STORAGE_FLOAT16: {
+            uint16_t * values = reinterpret_cast<uint16_t *>(p);
+            for (size_t i = 0;  i < numDims;  ++i) {
+                // Saturate rather than overflow to infinity; NaNs are
+                // left alone
+                float v = coords[i];
+                if (v > FLOAT16_MAX)
+                    v = FLOAT16_MAX;
+                else if (v < -FLOAT16_MAX)
+                    v = -FLOAT16_MAX;
+                values[i] = floatToFloat16(v);
+            }
+            break;
+        }
+        case EMBEDDING_STORAGE_INT8: {
+            float * header = reinterpret_cast<float *>(p);
+            header[0] = minimum;
+            header[1] = scale;
+            uint8_t * values = reinterpret_cast<uint8_t *>(p + 8);
+            float recip = scale == 0 ? 0 : 1.0f / scale;
+            for (size_t i = 0;  i < numDims;  ++i) {
+                long v = lrintf((coords[i] - minimum) * recip);
+                values[i] = std::max(0L, std::min(255L, v));
+            }
+            break;
+        }
+        }
+    }
+
+    /** Remove the last row, which must have been added with add(). */
+    void pop_back()
+    {
+        ExcAssert(!mapping);
+        ExcAssertGreaterEqual(owned.size(), rowBytes);
+        owned.resize(owned.size() - rowBytes);
+    }
+
+    /** Save the rows.  They are aligned within the file, so that they can
+        be used in place from a mapping of it.
+    */
+    void serialize(ML::DB::Store_Writer & store) const
+    {
+        size_t bytes = size() * rowBytes;
+        store << ML::DB::compact_size_t(bytes);
+        static const char padding[ALIGNMENT] = { 0 };
+        store.save_binary(padding, (ALIGNMENT - store.offset() % ALIGNMENT)
+                                   % ALIGNMENT);
+        store.save_array(data(), bytes);
+    }
+
+    /** Load the given number of rows saved with serialize().  If mapping
+        is set, the store reads from it, and the rows are used in place.
+    */
+    void reconstitute(ML::DB::Store_Reader & store, size_t numRows,
+                      std::shared_ptr<const void> mapping)
+    {
+        size_t bytes = ML::DB::compact_size_t(store);
+        if (bytes != numRows * rowBytes)
+            throw HttpReturnException
+                (400, "Embedding dataset file has the wrong number of bytes "
+                 "of coordinates",
+                 "bytes", bytes, "expected", numRows * rowBytes);
+        store.skip((ALIGNMENT - store.offset() % ALIGNMENT) % ALIGNMENT);
+
+        owned.clear();
+        if (mapping) {
+            this->mappedData = store.pos();
+            this->mappedRows = numRows;
+            this->mapping = std::move(mapping);
+            store.skip(bytes);
+        }
+        else {
+            this->mappedData = nullptr;
+            this->mappedRows = 0;
+            this->mapping.reset();
+            owned.resize(bytes);
+            store.load_array(owned.data(), bytes);
+        }
+    }
+
+private:
+    static constexpr size_t ALIGNMENT = 64;
+};
+
+
 /*****************************************************************************/
 /* EMBEDDING INTERNAL REPRESENTATION                                         */
 /*****************************************************************************/
 
 struct EmbeddingDatasetRepr {
-    EmbeddingDatasetRepr(MetricSpace metric)
-        : vpTree(new ML::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+    EmbeddingDatasetRepr(const EmbeddingDatasetConfig & config)
+        : config(config),
+          vpTree(new ML::VantagePointTreeT<int>()),
+          distance(DistanceMetric::create(config.metric))
     {
+        initIndex();
     }
 
     EmbeddingDatasetRepr(std::vector<ColumnPath> columnNames,
-                         MetricSpace metric)
-        : columnNames(std::move(columnNames)), columns(this->columnNames.size()),
+                         const EmbeddingDatasetConfig & config)
+        : config(config),
+          columnNames(std::move(columnNames)),
           vpTree(new ML::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+          distance(DistanceMetric::create(config.metric))
     {
         for (unsigned i = 0;  i < this->columnNames.size();  ++i) {
             columnIndex[this->columnNames[i]] = i;
         }
+        initCoords(config.storage, needsExact(config));
+        initIndex();
     }
 
     EmbeddingDatasetRepr(const EmbeddingDatasetRepr & other)
-        : columnNames(other.columnNames),
-          columns(other.columns),
+        : config(other.config),
+          columnNames(other.columnNames),
           columnIndex(other.columnIndex),
-          rows(other.rows),
+          rowNames(other.rowNames),
+          timestamps(other.timestamps),
+          coords(other.coords),
+          exact(other.exact),
           rowIndex(other.rowIndex),
-          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get()))
+          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get())),
+          hnsw(other.hnsw ? new ML::HnswIndex(*other.hnsw) : nullptr),
+          distance(other.distance->clone())
+    {
+    }
+
+    void initIndex()
+    {
+        if (config.index == EMBEDDING_INDEX_HNSW) {
+            hnsw.reset(new ML::HnswIndex(config.hnswNeighbors,
+                                         config.hnswConstructionWidth));
+        }
+    }
+
+    /** Exact coordinates are kept as well as the stored ones if they are
+        rounded and needed to rerank the neighbors. */
+    static bool needsExact(const EmbeddingDatasetConfig & config)
     {
+        return config.storage != EMBEDDING_STORAGE_FLOAT32
+            && config.rerankFactor > 0;
+    }
+
+    void initCoords(EmbeddingStorage storage, bool withExact)
+    {
+        coords = EmbeddingCoords(storage, columnNames.size());
+        if (withExact)
+            exact = EmbeddingCoords(EMBEDDING_STORAGE_FLOAT32,
+                                    columnNames.size());
     }
 
     // Unfortunately, both '0' and 'null' hash to the same thing.  To
@@ -128,37 +473,71 @@ struct EmbeddingDatasetRepr {
 
     bool initialized() const
     {
-        return !columns.empty();
+        return !columnNames.empty();
     }
 
-    struct Row {
-        Row(RowPath rowName, distribution<float> coords, Date timestamp)
-            : rowName(std::move(rowName)), coords(std::move(coords)),
-              timestamp(timestamp)
-        {
-        }
+    bool hasExact() const
+    {
+        return exact.numDims != 0;
+    }
 
-        RowPath rowName;
-        distribution<float> coords;
-        Date timestamp;
+    size_t rowCount() const
+    {
+        return rowNames.size();
+    }
 
-        void serialize(ML::DB::Store_Writer & store) const
-        {
-            store << rowName.toUtf8String() << coords << timestamp;
+    /** Add a row.  If it can't be added, nothing is changed and an
+        exception is thrown.
+    */
+    void addRow(const RowPath & rowName, const float * rowCoords, Date ts)
+    {
+        size_t n = columnNames.size();
+        size_t numRowsBefore = rowNames.size();
+
+        coords.add(rowCoords);
+        try {
+            if (hasExact())
+                exact.add(rowCoords);
+
+            // The metric caches what it needs of the stored coordinates,
+            // which are the ones the distances are calculated with
+            PossiblyDynamicBuffer<float> buffer(coords.bufferSize());
+            distance->addRow(numRowsBefore,
+                             coords.get(numRowsBefore, buffer.data()), n);
+
+            rowNames.push_back(rowName);
+            timestamps.push_back(ts);
+        } catch (const std::exception & exc) {
+            coords.pop_back();
+            if (exact.size() > numRowsBefore)
+                exact.pop_back();
+            throw;
         }
-    };
+    }
+
+    /** Return the values of the given column for all of the rows. */
+    std::vector<float> getColumnValues(int column) const
+    {
+        std::vector<float> result(rowCount());
+        for (size_t i = 0;  i < result.size();  ++i)
+            result[i] = coords.getCoord(i, column);
+        return result;
+    }
 
     float dist(unsigned row1, unsigned row2) const
     {
-        ExcAssertLess(row1, rows.size());
-        ExcAssertLess(row2, rows.size());
+        ExcAssertLess(row1, rowCount());
+        ExcAssertLess(row2, rowCount());
 
         if (row1 == row2)
             return 0.0f;
-        
+
+        PossiblyDynamicBuffer<float> buffer1(coords.bufferSize());
+        PossiblyDynamicBuffer<float> buffer2(coords.bufferSize());
         float result = distance->dist(row1, row2,
-                                      rows[row1].coords,
-                                      rows[row2].coords);
+                                      coords.get(row1, buffer1.data()),
+                                      coords.get(row2, buffer2.data()),
+                                      columnNames.size());
         
         ExcAssert(isfinite(result));
         return result;
@@ -166,12 +545,37 @@ struct EmbeddingDatasetRepr {
 
     float dist(unsigned row1, const distribution<float> & row2) const
     {
-        ExcAssertLess(row1, rows.size());
-        ExcAssertEqual(row2.size(), columns.size());
-        
+        ExcAssertLess(row1, rowCount());
+        ExcAssertEqual(row2.size(), columnNames.size());
+
+        PossiblyDynamicBuffer<float> buffer(coords.bufferSize());
         float result = distance->dist(row1, -1,
-                                      rows[row1].coords,
-                                      row2);
+                                      coords.get(row1, buffer.data()),
+                                      row2.data(), row2.size());
+        ExcAssert(isfinite(result));
+        return result;
+    }
+
+    /** Distance between the exact coordinates of two rows, for reranking.
+        The metric's cached values are for the stored coordinates, so the
+        rows are passed as unknown ones.
+    */
+    float exactDist(unsigned row1, unsigned row2) const
+    {
+        if (row1 == row2)
+            return 0.0f;
+        float result = distance->dist(-1, -1, exact.get(row1, nullptr),
+                                      exact.get(row2, nullptr),
+                                      columnNames.size());
+        ExcAssert(isfinite(result));
+        return result;
+    }
+
+    float exactDist(unsigned row1, const distribution<float> & row2) const
+    {
+        ExcAssertEqual(row2.size(), columnNames.size());
+        float result = distance->dist(-1, -1, exact.get(row1, nullptr),
+                                      row2.data(), row2.size());
         ExcAssert(isfinite(result));
         return result;
     }
@@ -183,33 +587,89 @@ struct EmbeddingDatasetRepr {
         bool first = true;
         Date earliest = Date::notADate(), latest = Date::notADate();
 
-        for (auto & r: rows) {
-            if (first && r.timestamp.isADate()) {
-                earliest = latest = r.timestamp;
+        for (auto & ts: timestamps) {
+            if (first && ts.isADate()) {
+                earliest = latest = ts;
                 first = false;
             }
             else {
-                earliest.setMin(r.timestamp);
-                latest.setMax(r.timestamp);
+                earliest.setMin(ts);
+                latest.setMax(ts);
             }
         }
 
         return { earliest, latest };
     }
     
+    EmbeddingDatasetConfig config;
+
     std::vector<ColumnPath> columnNames;
-    std::vector<std::vector<float> > columns;
     Lightweight_Hash<ColumnHash, int> columnIndex;
 
-    std::vector<Row> rows;
+    std::vector<RowPath> rowNames;
+    std::vector<Date> timestamps;
+
+    /// Coordinates of the rows, in the configured storage
+    EmbeddingCoords coords;
+
+    /// Exact coordinates of the rows, only if needsExact()
+    EmbeddingCoords exact;
+
     Lightweight_Hash<uint64_t, int> rowIndex;
     
     std::unique_ptr<ML::VantagePointTreeT<int> > vpTree;
+    std::unique_ptr<ML::HnswIndex> hnsw;
     std::unique_ptr<DistanceMetric> distance;
 
-    void save(const std::string & filename)
+    /** Search whichever index the dataset was configured with.  If
+        there are exact coordinates, more candidates are looked for with
+        the stored coordinates, and the closest by exactDist are
+        returned.
+    */
+    std::vector<std::pair<float, int> >
+    search(const std::function<float (int)> & dist,
+           const std::function<float (int)> & exactDist,
+           int numNeighbors, double maxDistance) const
+    {
+        if (!hasExact())
+            return searchIndex(dist, numNeighbors, maxDistance);
+
+        int numCandidates
+            = std::min<int64_t>((int64_t)numNeighbors * config.rerankFactor,
+                                rowCount());
+
+        // The stored distances are approximate, so maxDistance is only
+        // applied to the exact ones
+        auto candidates = searchIndex(dist, numCandidates, INFINITY);
+
+        std::vector<std::pair<float, int> > result;
+        result.reserve(candidates.size());
+        for (auto & c: candidates) {
+            float d = exactDist(c.second);
+            if (d <= maxDistance)
+                result.emplace_back(d, c.second);
+        }
+        std::sort(result.begin(), result.end());
+        if (result.size() > numNeighbors)
+            result.resize(numNeighbors);
+        return result;
+    }
+
+    std::vector<std::pair<float, int> >
+    searchIndex(const std::function<float (int)> & dist,
+                int numNeighbors, double maxDistance) const
+    {
+        if (hnsw)
+            return hnsw->search(dist, numNeighbors, maxDistance,
+                                config.hnswSearchWidth);
+        if (!vpTree)
+            return {};
+        return vpTree->search(dist, numNeighbors, maxDistance);
+    }
+
+    void save(const Url & dataFileUrl)
     {
-        filter_ostream stream(filename);
+        filter_ostream stream(dataFileUrl);
         ML::DB::Store_Writer store(stream);
         
         serialize(store);
@@ -217,39 +677,119 @@ struct EmbeddingDatasetRepr {
         // Make sure that we saved properly
         stream.close();
     }
+
     void serialize(ML::DB::Store_Writer & store) const;
+
+    /** Load the contents saved with serialize().  If mapping is set, the
+        store reads from it, and the coordinates are used in place.  The
+        index is loaded rather than built.
+    */
+    void reconstitute(ML::DB::Store_Reader & store,
+                      std::shared_ptr<const void> mapping);
 };
 
 const RowHash EmbeddingDatasetRepr::nullHashIn(RowPath("null"));
 
-ML::DB::Store_Writer &
-operator << (ML::DB::Store_Writer & store, const EmbeddingDatasetRepr::Row & row)
+void
+EmbeddingDatasetRepr::
+serialize(ML::DB::Store_Writer & store) const
 {
-    row.serialize(store);
-    return store;
+    store << string("EMBEDDING_DATASET")
+          << ML::DB::compact_size_t(3);  // version
+    store << columnNames
+          << ML::DB::compact_size_t(config.metric)
+          << ML::DB::compact_size_t(coords.storage)
+          << ML::DB::compact_size_t(hasExact());
+    store << ML::DB::compact_size_t(rowCount());
+    for (size_t i = 0;  i < rowCount();  ++i)
+        store << rowNames[i] << timestamps[i];
+    store << ML::DB::compact_size_t(hnsw ? EMBEDDING_INDEX_HNSW
+                                    : EMBEDDING_INDEX_VPTREE);
+    if (hnsw)
+        hnsw->serialize(store);
+    else ML::VantagePointTreeT<int>::serializePtr(store, vpTree.get());
+
+    // The coordinates go last, so that they can be aligned
+    coords.serialize(store);
+    if (hasExact())
+        exact.serialize(store);
 }
 
 void
 EmbeddingDatasetRepr::
-serialize(ML::DB::Store_Writer & store) const
+reconstitute(ML::DB::Store_Reader & store,
+             std::shared_ptr<const void> mapping)
 {
-    store << string("EMBEDDING_DATASET")
-          << ML::DB::compact_size_t(1);  // version
-    store << columnNames << columns << rows;
-    vpTree->serialize(store);
+    std::string magic;
+    store >> magic;
+    if (magic != "EMBEDDING_DATASET")
+        throw HttpReturnException(400, "File is not an embedding dataset file");
+    ML::DB::compact_size_t version(store);
+    if (version != 3)
+        throw HttpReturnException(400, "Unknown embedding dataset file version",
+                                  "version", (int)version);
+
+    store >> columnNames;
+    MetricSpace metric = (MetricSpace)(int)ML::DB::compact_size_t(store);
+    EmbeddingStorage storage
+        = (EmbeddingStorage)(int)ML::DB::compact_size_t(store);
+    bool withExact = ML::DB::compact_size_t(store);
+
+    // The index and the coordinates only make sense with the
+    // configuration they were saved with
+    if (metric != config.metric)
+        throw HttpReturnException
+            (400, "Embedding dataset file was saved with a different metric",
+             "fileMetric", metric, "metric", config.metric);
+    if (storage != config.storage)
+        throw HttpReturnException
+            (400, "Embedding dataset file was saved with a different storage",
+             "fileStorage", storage, "storage", config.storage);
+    if (needsExact(config) && !withExact)
+        throw HttpReturnException
+            (400, "Embedding dataset file was saved without the exact "
+             "coordinates needed for the rerankFactor parameter");
+
+    columnIndex.clear();
+    for (unsigned i = 0;  i < columnNames.size();  ++i)
+        columnIndex[columnNames[i]] = i;
+    initCoords(storage, withExact);
+
+    size_t numRows = ML::DB::compact_size_t(store);
+    rowNames.resize(numRows);
+    timestamps.resize(numRows);
+    rowIndex.clear();
+    for (size_t i = 0;  i < numRows;  ++i) {
+        store >> rowNames[i] >> timestamps[i];
+        rowIndex[getRowHashForIndex(rowNames[i])] = i;
+    }
+
+    EmbeddingIndex index = (EmbeddingIndex)(int)ML::DB::compact_size_t(store);
+    if (index != config.index)
+        throw HttpReturnException
+            (400, "Embedding dataset file was saved with a different index",
+             "fileIndex", index, "index", config.index);
+    if (index == EMBEDDING_INDEX_HNSW)
+        hnsw->reconstitute(store);
+    else vpTree.reset(ML::VantagePointTreeT<int>::reconstitutePtr(store));
+
+    coords.reconstitute(store, numRows, mapping);
+    if (withExact)
+        exact.reconstitute(store, numRows, mapping);
+
+    // The metric's cache of each row isn't saved, as it's quick to
+    // calculate
+    distance.reset(DistanceMetric::create(config.metric));
+    PossiblyDynamicBuffer<float> buffer(coords.bufferSize());
+    for (size_t i = 0;  i < numRows;  ++i)
+        distance->addRow(i, coords.get(i, buffer.data()), columnNames.size());
 }
 
 struct EmbeddingDataset::Itl
     : public MatrixView, public ColumnIndex {
-    Itl(MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr),
-          logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
-    {
-    }
-
-    // TODO: make it loadable...
-    Itl(const std::string & address, MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr), address(address),
+    Itl(const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr),
+          loaded(false),
           logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
     {
     }
@@ -259,7 +799,7 @@ struct EmbeddingDataset::Itl
         delete uncommitted.load();
     }
 
-    MetricSpace metric;
+    EmbeddingDatasetConfig config;
 
     GcLock lock;
     RcuProtected<EmbeddingDatasetRepr> committed;
@@ -268,7 +808,10 @@ struct EmbeddingDataset::Itl
     typedef std::mutex Mutex;
     Mutex mutex;
     std::atomic<EmbeddingDatasetRepr *> uncommitted;
-    std::string address;
+
+    /// Whether the dataset was loaded from its dataFileUrl, in which case
+    /// it can't be recorded to, as the file may be mapped
+    bool loaded;
 
     RestRequestRouter router;
 
@@ -284,10 +827,10 @@ struct EmbeddingDataset::Itl
         std::vector<RowPath> result;
 
         if (limit == -1)
-            limit = repr->rows.size();
+            limit = repr->rowCount();
 
-        for (unsigned i = start;  i < repr->rows.size() && i < start + limit;  ++i) {
-            result.emplace_back(repr->rows[i].rowName);
+        for (unsigned i = start;  i < repr->rowCount() && i < start + limit;  ++i) {
+            result.emplace_back(repr->rowNames[i]);
         }
 
         return result;
@@ -311,13 +854,13 @@ struct EmbeddingDataset::Itl
 
         virtual RowPath next() {
             auto repr = source->committed();     
-            return repr->rows[index++].rowName;
+            return repr->rowNames[index++];
         }
 
         virtual const RowPath & rowName(RowPath & storage) const
         {
             auto repr = source->committed();     
-            return repr->rows[index].rowName;
+            return repr->rowNames[index];
         }
 
         size_t index;
@@ -340,10 +883,10 @@ struct EmbeddingDataset::Itl
         std::vector<RowHash> result;
 
         if (limit == -1)
-            limit = repr->rows.size();
+            limit = repr->rowCount();
 
-        for (unsigned i = start;  i < repr->rows.size() && i < start + limit;  ++i) {
-            result.emplace_back(repr->rows[i].rowName);
+        for (unsigned i = start;  i < repr->rowCount() && i < start + limit;  ++i) {
+            result.emplace_back(repr->rowNames[i]);
         }
 
         return result;
@@ -377,22 +920,70 @@ struct EmbeddingDataset::Itl
         if (it == repr->rowIndex.end() || it->second == -1)
             return MatrixNamedRow();
         
-        const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
-
-        if (row.rowName != rowName)
+        int index = it->second;
+        if (repr->rowNames[index] != rowName)
             return MatrixNamedRow();
 
+        size_t n = repr->columnNames.size();
+        PossiblyDynamicBuffer<float> buffer(repr->coords.bufferSize());
+        const float * coords = repr->coords.get(index, buffer.data());
+
         MatrixNamedRow result;
         result.rowHash = result.rowName = rowName;
-        result.columns.reserve(row.coords.size());
+        result.columns.reserve(n);
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
-                                        row.timestamp);
+        for (unsigned i = 0;  i < n;  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
+                                        repr->timestamps[index]);
         }
         return result;
     }
 
+    ExpressionValue getRowEmbedding(const RowPath & rowName,
+                                    const std::vector<ColumnPath> & columnNames,
+                                    StorageType storage) const
+    {
+        if (storage != ST_FLOAT32 && storage != ST_FLOAT64)
+            throw HttpReturnException(400, "Row embeddings must be of type "
+                                      "float32 or float64");
+
+        const float NaN = std::numeric_limits<float>::quiet_NaN();
+        std::vector<float> values(columnNames.size(), NaN);
+        Date ts = Date::notADate();
+
+        auto repr = committed();
+        if (repr->initialized()) {
+            auto it = repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowName));
+            if (it != repr->rowIndex.end() && it->second != -1
+                && repr->rowNames[it->second] == rowName) {
+                int index = it->second;
+                ts = repr->timestamps[index];
+
+                // Usually all the columns are wanted, in order
+                if (columnNames == repr->columnNames) {
+                    const float * coords
+                        = repr->coords.get(index, values.data());
+                    if (coords != values.data())
+                        std::copy(coords, coords + values.size(),
+                                  values.begin());
+                }
+                else {
+                    for (size_t i = 0;  i < columnNames.size();  ++i) {
+                        auto cit = repr->columnIndex.find(columnNames[i]);
+                        if (cit != repr->columnIndex.end())
+                            values[i] = repr->coords.getCoord(index, cit->second);
+                    }
+                }
+            }
+        }
+
+        if (storage == ST_FLOAT64)
+            return ExpressionValue(std::vector<double>(values.begin(),
+                                                       values.end()),
+                                   ts);
+        return ExpressionValue(std::move(values), ts);
+    }
+
     virtual MatrixRow getRowByHash(const RowHash & rowHash) const
     {
         auto repr = committed();
@@ -403,16 +994,19 @@ struct EmbeddingDataset::Itl
         if (it == repr->rowIndex.end() || it->second == -1)
             return MatrixRow();
         
-        const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
+        int index = it->second;
+        size_t n = repr->columnNames.size();
+        PossiblyDynamicBuffer<float> buffer(repr->coords.bufferSize());
+        const float * coords = repr->coords.get(index, buffer.data());
 
         MatrixRow result;
         result.rowHash = rowHash;
-        result.rowName = row.rowName;
-        result.columns.reserve(row.coords.size());
+        result.rowName = repr->rowNames[index];
+        result.columns.reserve(n);
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
-                                        row.timestamp);
+        for (unsigned i = 0;  i < n;  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
+                                        repr->timestamps[index]);
         }
         return result;
     }
@@ -432,7 +1026,7 @@ struct EmbeddingDataset::Itl
         if (it == repr->rowIndex.end() || it->second == -1)
             throw HttpReturnException(400, "unknown row");
 
-        return repr->rows[it->second].rowName;
+        return repr->rowNames[it->second];
     }
 
     virtual bool knownColumn(const ColumnPath & column) const override
@@ -472,7 +1066,7 @@ struct EmbeddingDataset::Itl
         auto repr = committed();
         if (!repr->initialized())
             return 0;
-        return repr->rows.size();
+        return repr->rowCount();
     }
 
     virtual size_t getColumnCount() const override
@@ -494,7 +1088,7 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> columnVals = repr->getColumnValues(it->second);
 
         toStoreResult.isNumeric_ = true;
         toStoreResult.atMostOne_ = true;
@@ -519,15 +1113,15 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> columnVals = repr->getColumnValues(it->second);
 
         MatrixColumn result;
 
         result.columnHash = result.columnName = column;
 
         for (unsigned i = 0;  i < columnVals.size();  ++i) {
-            result.rows.emplace_back(repr->rows[i].rowName, columnVals[i],
-                                     repr->rows[i].timestamp);
+            result.rows.emplace_back(repr->rowNames[i], columnVals[i],
+                                     repr->timestamps[i]);
         }
         return result;
     }
@@ -543,7 +1137,7 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> columnVals = repr->getColumnValues(it->second);
 
         std::vector<CellValue> result(columnVals.begin(), columnVals.end());
 
@@ -562,7 +1156,7 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> columnVals = repr->getColumnValues(it->second);
         auto sortedVals = columnVals;
         std::sort(sortedVals.begin(), sortedVals.end());
         sortedVals.erase(std::unique(sortedVals.begin(), sortedVals.end()),
@@ -658,6 +1252,8 @@ struct EmbeddingDataset::Itl
     recordEmbedding(const std::vector<ColumnPath> & columnNames,
                     const std::vector<std::tuple<RowPath, std::vector<float>, Date> > & rows)
     {
+        checkWritable();
+
         auto repr = committed();
         std::unique_lock<Mutex> guard(mutex);
 
@@ -666,7 +1262,7 @@ struct EmbeddingDataset::Itl
         if (!uncommitted) {
             if (!repr->initialized()) {
                 // First commit; we just learnt the column names
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -684,10 +1280,16 @@ struct EmbeddingDataset::Itl
             uint64_t rowHash = EmbeddingDatasetRepr::getRowHashForIndex(rowName);
 
             const auto & vec = std::get<1>(r);
-            distribution<float> embedding(vec.begin(), vec.end());
             Date ts = std::get<2>(r);
 
-            int index = (*uncommitted).rows.size();
+            if (vec.size() != columnNames.size())
+                throw HttpReturnException
+                    (400, "Embedding row has the wrong number of coordinates",
+                     "rowName", rowName,
+                     "numCoords", vec.size(),
+                     "numColumns", columnNames.size());
+
+            int index = (*uncommitted).rowCount();
 
             if (!(*uncommitted).rowIndex.insert({ rowHash, index }).second) {
                 if ((*uncommitted).rowIndex[rowHash] == -1)
@@ -698,8 +1300,7 @@ struct EmbeddingDataset::Itl
                     DEBUG_MSG(logger) << "rowHash = " << RowHash(rowName);
                     // Check if it's a double record or a hash collision
                     RowPath oldName
-                        = (*uncommitted).rows.at((*uncommitted).rowIndex[rowHash])
-                        .rowName;
+                        = (*uncommitted).rowNames.at((*uncommitted).rowIndex[rowHash]);
                     if (oldName == rowName)
                         throw HttpReturnException
                             (400, "Row '" + rowName.toUtf8String()
@@ -715,19 +1316,11 @@ struct EmbeddingDataset::Itl
                 }
             }
 
-            size_t numRowsBefore = (*uncommitted).rows.size();
-        
             try {
-                // Update the row
-                (*uncommitted).rows.emplace_back(rowName, std::move(embedding),
-                                                 ts);
-                (*uncommitted).distance->addRow(numRowsBefore,
-                                                (*uncommitted).rows.back().coords);
+                (*uncommitted).addRow(rowName, vec.data(), ts);
             } catch (const std::exception & exc) {
                 // If there is an exception, keep the data structure consistent
                 (*uncommitted).rowIndex[rowHash] = -1;
-                if ((*uncommitted).rows.size() > numRowsBefore)
-                    (*uncommitted).rows.pop_back();
                 throw;
             }        
         }
@@ -737,6 +1330,8 @@ struct EmbeddingDataset::Itl
     recordRowItl(const RowPath & rowName,
                  const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
     {
+        checkWritable();
+
         auto repr = committed();
 
         uint64_t rowHash = EmbeddingDatasetRepr::getRowHashForIndex(rowName);
@@ -755,7 +1350,7 @@ struct EmbeddingDataset::Itl
 
         // Do it here before we acquire the lock in the case that it's initalized
         if (uncommitted) {
-            embedding.resize((*uncommitted).columns.size(),
+            embedding.resize((*uncommitted).columnNames.size(),
                              std::numeric_limits<float>::quiet_NaN());
 
             for (size_t i = 0;  i < vals.size();  ++i) {
@@ -785,20 +1380,20 @@ struct EmbeddingDataset::Itl
                 
                 //DEBUG_MSG(logger) << "columnNames = " << columnNames;
                 
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
             }
 
-            embedding.resize(repr->columns.size(),
+            embedding.resize(repr->columnNames.size(),
                              std::numeric_limits<float>::quiet_NaN());
         }
 
         if (embedding.empty()) {
             DEBUG_MSG(logger) << "embedding is empty";
             DEBUG_MSG(logger) << "repr->initialized = " << repr->initialized();
-            embedding.resize((*uncommitted).columns.size(),
+            embedding.resize((*uncommitted).columnNames.size(),
                              std::numeric_limits<float>::quiet_NaN());
 
             for (size_t i = 0;  i < vals.size();  ++i) {
@@ -816,7 +1411,7 @@ struct EmbeddingDataset::Itl
         // If this is the first record, then we need to count the number of
         // rows and set everything up.
 
-        int index = (*uncommitted).rows.size();
+        int index = (*uncommitted).rowCount();
 
         if (!(*uncommitted).rowIndex.insert({ rowHash, index }).second) {
             if ((*uncommitted).rowIndex[rowHash] == -1)
@@ -826,8 +1421,7 @@ struct EmbeddingDataset::Itl
                 DEBUG_MSG(logger) << "rowHash = " << RowHash(rowName);
                 // Check if it's a double record or a hash collision
                 const RowPath & oldName
-                    = (*uncommitted).rows.at((*uncommitted).rowIndex[rowHash])
-                    .rowName;
+                    = (*uncommitted).rowNames.at((*uncommitted).rowIndex[rowHash]);
                 if (oldName == rowName)
                     throw HttpReturnException
                         (400, "Row '" + rowName.toUtf8String()
@@ -844,23 +1438,24 @@ struct EmbeddingDataset::Itl
             }
         }
 
-        size_t numRowsBefore = (*uncommitted).rows.size();
-        
         try {
-            // Update the row
-            (*uncommitted).rows.emplace_back(rowName, std::move(embedding),
-                                             latestDate);
-            (*uncommitted).distance->addRow(numRowsBefore,
-                                            (*uncommitted).rows.back().coords);
+            (*uncommitted).addRow(rowName, embedding.data(), latestDate);
         } catch (const std::exception & exc) {
             // If there is an exception, keep the data structure consistent
             (*uncommitted).rowIndex[rowHash] = -1;
-            if ((*uncommitted).rows.size() > numRowsBefore)
-                (*uncommitted).rows.pop_back();
             throw;
         }        
     }
 
+    void checkWritable() const
+    {
+        if (loaded)
+            throw HttpReturnException
+                (400, "Embedding dataset loaded from its dataFileUrl can't "
+                 "be recorded to",
+                 "dataFileUrl", config.dataFileUrl);
+    }
+
     virtual void commit()
     {
         std::unique_lock<Mutex> guard(mutex);
@@ -870,24 +1465,99 @@ struct EmbeddingDataset::Itl
         if (!uncommitted)
             return;
 
-        for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-            (*uncommitted).columns[j].resize((*uncommitted).rows.size());
+        if ((*uncommitted).hnsw)
+            indexHnsw(*uncommitted);
+        else indexVpTree(*uncommitted);
+
+        committed.replace(uncommitted);
+        uncommitted = nullptr;
+
+        if (!config.dataFileUrl.empty()) {
+            INFO_MSG(logger) << "saving embedding to " << config.dataFileUrl;
+            Timer timer;
+            committed()->save(config.dataFileUrl);
+            INFO_MSG(logger) << "saved embedding in " << timer.elapsed();
+        }
+    }
+
+    /** Load the dataset from the given URL, which must have been saved
+        by commit().  If the file can be memory mapped, the coordinates
+        are used in place from the mapping.
+    */
+    void load(const Url & dataFileUrl)
+    {
+        Timer timer;
+
+        auto stream = std::make_shared<filter_istream>
+            (dataFileUrl, std::map<std::string, std::string>
+             { { "mapped", "true" } });
+
+        const char * mappedData;
+        size_t mappedLength;
+        std::tie(mappedData, mappedLength) = stream->mapped();
+
+        std::shared_ptr<const void> mapping;
+        std::unique_ptr<ML::DB::Store_Reader> store;
+        if (mappedData) {
+            mapping = std::shared_ptr<const void>(stream, mappedData);
+            store.reset(new ML::DB::Store_Reader(mappedData, mappedLength));
+        }
+        else {
+            store.reset(new ML::DB::Store_Reader(*stream));
+        }
 
-        // Create the column index; this is a standard matrix inversion
-        auto indexRow = [&] (size_t i)
+        std::unique_ptr<EmbeddingDatasetRepr> repr
+            (new EmbeddingDatasetRepr(config));
+        repr->reconstitute(*store, mapping);
+
+        std::unique_lock<Mutex> guard(mutex);
+        committed.replace(repr.release());
+        loaded = true;
+
+        INFO_MSG(logger) << "loaded " << committed()->rowCount()
+                         << " embedding rows from " << dataFileUrl
+                         << (mapping ? " (mapped)" : "")
+                         << " in " << timer.elapsed();
+    }
+
+    /** Add the rows recorded since the last commit to the HNSW graph,
+        which was copied from the last commit. */
+    void indexHnsw(EmbeddingDatasetRepr & repr)
+    {
+        auto & hnsw = *repr.hnsw;
+
+        // The graph was copied from the last commit, so only the rows
+        // recorded since need to be added to it
+        size_t first = hnsw.size();
+        size_t last = repr.rowCount();
+
+        INFO_MSG(logger) << "adding " << last - first
+                         << " rows to HNSW index";
+        Timer timer;
+
+        auto dist = [&] (int row1, int row2)
             {
-                for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-                    (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
+                return repr.dist(row1, row2);
             };
 
-        parallelMap(0, (*uncommitted).rows.size(), indexRow);
+        hnsw.resize(last);
+        parallelMapChunked(first, last, 256, [&] (size_t b, size_t e)
+            {
+                for (size_t i = b;  i < e;  ++i)
+                    hnsw.insert(i, dist);
+            });
+
+        INFO_MSG(logger) << "HNSW index done in " << timer.elapsed();
+    }
 
-        // Create the vantage point tree
+    /** Build the vantage point tree over all of the rows. */
+    void indexVpTree(EmbeddingDatasetRepr & repr)
+    {
         INFO_MSG(logger) << "creating vantage point tree";
         Timer timer;
         
         std::vector<int> items;
-        for (unsigned i = 0;  i < (*uncommitted).rows.size();  ++i) {
+        for (unsigned i = 0;  i < repr.rowCount();  ++i) {
             items.push_back(i);
         }
 
@@ -904,7 +1574,7 @@ struct EmbeddingDataset::Itl
                 {
                     int i = items[n];
 
-                    result[n] = (*uncommitted).dist(item, i);
+                    result[n] = repr.dist(item, i);
 
                     if (item == i)
                         ExcAssertEqual(result[n], 0.0);
@@ -926,17 +1596,9 @@ struct EmbeddingDataset::Itl
             };
         
         // Create the VP tree for indexed lookups on distance
-        (*uncommitted).vpTree.reset(ML::VantagePointTreeT<int>::createParallel(items, dist));
+        repr.vpTree.reset(ML::VantagePointTreeT<int>::createParallel(items, dist));
 
         INFO_MSG(logger) << "VP tree done in " << timer.elapsed();
-        
-        committed.replace(uncommitted);
-        uncommitted = nullptr;
-
-        if (!address.empty()) {
-            INFO_MSG(logger) << "saving embedding";
-            committed()->save(address);
-        }
     }
 
     vector<tuple<RowPath, RowHash, float> >
@@ -955,9 +1617,15 @@ struct EmbeddingDataset::Itl
             return result;
         };
 
+        auto exactDist = [&] (int item) -> float
+        {
+            return repr->exactDist(item, coord);
+        };
+
         //Timer timer;
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->search(dist, exactDist, numNeighbors,
+                                      maxDistance);
 
         //DEBUG_MSG(logger) << "neighbors took " << timer.elapsed();
 
@@ -965,8 +1633,8 @@ struct EmbeddingDataset::Itl
         
         vector<tuple<RowPath, RowHash, float> > result;
         for (auto & n: neighbors) {
-            result.emplace_back(repr->rows[n.second].rowName,
-                                repr->rows[n.second].rowName,
+            result.emplace_back(repr->rowNames[n.second],
+                                repr->rowNames[n.second],
                                 n.first);
         }
 
@@ -988,7 +1656,6 @@ struct EmbeddingDataset::Itl
                                       + "' in embedding");
         }
        
-        //const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
         
         auto dist = [&] (int item) -> float
             {
@@ -997,12 +1664,18 @@ struct EmbeddingDataset::Itl
                 return result;
             };
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto exactDist = [&] (int item) -> float
+            {
+                return repr->exactDist(item, it->second);
+            };
+
+        auto neighbors = repr->search(dist, exactDist, numNeighbors,
+                                      maxDistance);
 
         vector<tuple<RowPath, RowHash, float> > result;
         for (auto & n: neighbors) {
-            result.emplace_back(repr->rows[n.second].rowName,
-                                repr->rows[n.second].rowName,
+            result.emplace_back(repr->rowNames[n.second],
+                                repr->rowNames[n.second],
                                 n.first);
         }
 
@@ -1031,17 +1704,29 @@ EmbeddingDataset(MldbServer * owner,
     : Dataset(owner)
 {
     this->datasetConfig = config.params.convert<EmbeddingDatasetConfig>();
-#if 1
-    itl.reset(new Itl(datasetConfig.metric));
-#else // once persistence is done
-
-    if (!config.address.empty()) {
-        itl.reset(new Itl(config.address));
+    if (datasetConfig.index == EMBEDDING_INDEX_HNSW) {
+        if (datasetConfig.hnswNeighbors < 2)
+            throw HttpReturnException(400, "hnswNeighbors must be at least 2",
+                                      "hnswNeighbors",
+                                      datasetConfig.hnswNeighbors);
+        if (datasetConfig.hnswConstructionWidth < 1
+            || datasetConfig.hnswSearchWidth < 1)
+            throw HttpReturnException(400, "hnswConstructionWidth and "
+                                      "hnswSearchWidth must be positive");
     }
-    else {
-        itl.reset(new Itl());
+
+    if (datasetConfig.rerankFactor > 0
+        && datasetConfig.storage == EMBEDDING_STORAGE_FLOAT32)
+        throw HttpReturnException(400, "rerankFactor is only used with "
+                                  "float16 or int8 storage, as float32 "
+                                  "coordinates are exact");
+
+    itl.reset(new Itl(datasetConfig));
+
+    if (!datasetConfig.dataFileUrl.empty()
+        && tryGetUriObjectInfo(datasetConfig.dataFileUrl.toString()).exists) {
+        itl->load(datasetConfig.dataFileUrl);
     }
-#endif
 }
     
 EmbeddingDataset::
@@ -1158,6 +1843,97 @@ getRowInfo() const
     return itl->getRowInfo();
 }
 
+ExpressionValue
+EmbeddingDataset::
+getRowEmbedding(const RowPath & row,
+                const std::vector<ColumnPath> & columns,
+                StorageType storage) const
+{
+    return itl->getRowEmbedding(row, columns, storage);
+}
+
+
+/*****************************************************************************/
+/* EMBEDDING MATRIX VIEW                                                     */
+/*****************************************************************************/
+
+struct EmbeddingMatrixView::Itl {
+    Itl(RcuLocked<const EmbeddingDatasetRepr> repr)
+        : repr(std::move(repr))
+    {
+    }
+
+    RcuLocked<const EmbeddingDatasetRepr> repr;
+};
+
+EmbeddingMatrixView::
+EmbeddingMatrixView()
+{
+}
+
+EmbeddingMatrixView::
+EmbeddingMatrixView(EmbeddingMatrixView && other)
+    : itl(std::move(other.itl))
+{
+}
+
+EmbeddingMatrixView::
+~EmbeddingMatrixView()
+{
+}
+
+size_t
+EmbeddingMatrixView::
+rowCount() const
+{
+    return itl->repr->rowCount();
+}
+
+const std::vector<ColumnPath> &
+EmbeddingMatrixView::
+getColumnNames() const
+{
+    return itl->repr->columnNames;
+}
+
+int
+EmbeddingMatrixView::
+getRowIndex(const RowPath & row) const
+{
+    const EmbeddingDatasetRepr & repr = *itl->repr;
+    if (!repr.initialized())
+        return -1;
+    auto it = repr.rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(row));
+    if (it == repr.rowIndex.end() || it->second == -1
+        || repr.rowNames[it->second] != row)
+        return -1;
+    return it->second;
+}
+
+const float *
+EmbeddingMatrixView::
+getRowCoords(int index, float * buffer) const
+{
+    return itl->repr->coords.get(index, buffer);
+}
+
+Date
+EmbeddingMatrixView::
+getRowTimestamp(int index) const
+{
+    return itl->repr->timestamps[index];
+}
+
+EmbeddingMatrixView
+EmbeddingDataset::
+getEmbeddingView() const
+{
+    EmbeddingMatrixView result;
+    result.itl.reset(new EmbeddingMatrixView::Itl(itl->committed()));
+    return result;
+}
+
+
 static RegisterDatasetType<EmbeddingDataset, EmbeddingDatasetConfig>
 regEmbedding(builtinPackage(),
              "embedding",
@@ -1405,6 +2181,60 @@ regNearestNeighborsFunction(builtinPackage(),
 /* Read Pixels function                                                      */
 /*****************************************************************************/
 
+namespace {
+
+/** Copy the elements of an embedding into a row major array of floats, so
+    that the image functions can gather many of them by their offset rather
+    than looking each one up by its path.  Values that aren't a tensor of
+    numbers, like rows of rows, give an empty array and are read one element
+    at a time.
+*/
+std::vector<float> getDenseFloats(const ExpressionValue & embedding)
+{
+    std::vector<float> result;
+    if (!embedding.isEmbedding())
+        return result;
+
+    size_t length = 1;
+    for (auto & d: embedding.getEmbeddingShape())
+        length *= d;
+
+    try {
+        result.resize(length);
+        embedding.convertEmbedding(result.data(), length, ST_FLOAT32);
+    } catch (const std::exception & exc) {
+        result.clear();
+    }
+    return result;
+}
+
+/** Coordinates of a batch of positions, from an embedding or a row of
+    numbers.  As for a single position, they are truncated to integers.
+*/
+std::vector<int> getCoordinates(const ExpressionValue & val,
+                                const char * name)
+{
+    auto values = val.getEmbeddingDouble();
+    std::vector<int> result;
+    result.reserve(values.size());
+    for (double d: values) {
+        if (!std::isfinite(d))
+            throw HttpReturnException(400, "Coordinates must be numbers",
+                                      "coordinate", std::string(name),
+                                      "value", val);
+        result.push_back(boost::algorithm::clamp(d, -1e9, 1e9));
+    }
+    return result;
+}
+
+/** Are the coordinates given as arrays, for a batch of positions? */
+bool isBatch(const ExpressionValue & val)
+{
+    return val.isEmbedding() || val.isRow();
+}
+
+} // file scope
+
 DEFINE_STRUCTURE_DESCRIPTION(ReadPixelsFunctionConfig);
 
 ReadPixelsFunctionConfigDescription::
@@ -1452,6 +2282,7 @@ ReadPixelsFunction(MldbServer * owner,
     SqlRowScope scope;
     embedding = boundExpr(scope, GET_ALL);
     shape = embedding.getEmbeddingShape();
+    pixels = getDenseFloats(embedding);
 }
 
 ReadPixelsFunction::
@@ -1469,15 +2300,11 @@ struct ReadPixelsFunctionApplier
     }
 };
 
-ReadPixelsOutput
+ExpressionValue
 ReadPixelsFunction::
-applyT(const ApplierT & applier_, ReadPixelsInput input) const
-{   
-    ReadPixelsOutput output;    
-
+getPixel(int x, int y) const
+{
     //We clamp, we do not currently provide interpolation
-    int x = input.x.coerceToInteger().toInt();
-    int y = input.y.coerceToInteger().toInt();
     x = boost::algorithm::clamp(x, 0, shape[0]-1);
     y = boost::algorithm::clamp(y, 0, shape[1]-1);
 
@@ -1489,9 +2316,83 @@ applyT(const ApplierT & applier_, ReadPixelsInput input) const
     auto pValue = embedding.tryGetNestedColumn(columnPath, storage);
 
     if (pValue)
-        return {*pValue};
+        return *pValue;
     else
-        return {ExpressionValue(0, Date::negativeInfinity())};
+        return ExpressionValue(0, Date::negativeInfinity());
+}
+
+ExpressionValue
+ReadPixelsFunction::
+getPixels(const std::vector<int> & x, const std::vector<int> & y) const
+{
+    if (x.size() != y.size())
+        throw HttpReturnException(400, "image.readpixels needs as many x "
+                                  "as y coordinates",
+                                  "numX", x.size(),
+                                  "numY", y.size());
+    if (shape.size() < 2)
+        throw HttpReturnException(400, "image.readpixels needs a 2d "
+                                  "embedding for a batch of pixels",
+                                  "shape", std::vector<size_t>(shape.begin(),
+                                                               shape.end()));
+
+    // Each pixel is a number, or a tensor (like of channels) for an
+    // embedding of more than two dimensions
+    DimsVector pixelShape(shape.begin() + 2, shape.end());
+    size_t pixelSize = 1;
+    for (auto & d: pixelShape)
+        pixelSize *= d;
+
+    size_t n = x.size();
+    std::shared_ptr<float> buffer(new float[n * pixelSize],
+                                  [] (float * p) { delete[] p; });
+    float * out = buffer.get();
+
+    if (!pixels.empty()) {
+        // The embedding is indexed by [y][x], whereas the clamping is by
+        // the x and y dimensions: anything that falls outside of it is zero
+        size_t rowStride = shape[1] * pixelSize;
+        for (size_t i = 0;  i < n;  ++i, out += pixelSize) {
+            int xx = boost::algorithm::clamp(x[i], 0, shape[0]-1);
+            int yy = boost::algorithm::clamp(y[i], 0, shape[1]-1);
+            if ((size_t)yy >= shape[0] || (size_t)xx >= shape[1]) {
+                std::fill(out, out + pixelSize, 0.0f);
+                continue;
+            }
+            const float * in = pixels.data() + yy * rowStride + xx * pixelSize;
+            std::copy(in, in + pixelSize, out);
+        }
+    }
+    else {
+        for (size_t i = 0;  i < n;  ++i, out += pixelSize) {
+            ExpressionValue pixel = getPixel(x[i], y[i]);
+            if (pixel.isAtom()) {
+                std::fill(out, out + pixelSize, 0.0f);
+                out[0] = pixel.coerceToNumber().toDouble();
+                continue;
+            }
+            auto values = pixel.getEmbedding(pixelSize);
+            std::copy(values.begin(), values.end(), out);
+        }
+    }
+
+    DimsVector outputShape{ n };
+    outputShape.insert(outputShape.end(), pixelShape.begin(), pixelShape.end());
+    return ExpressionValue::embedding(Date::notADate(), buffer, ST_FLOAT32,
+                                      std::move(outputShape));
+}
+
+ReadPixelsOutput
+ReadPixelsFunction::
+applyT(const ApplierT & applier_, ReadPixelsInput input) const
+{
+    if (isBatch(input.x) || isBatch(input.y))
+        return { getPixels(getCoordinates(input.x, "x"),
+                           getCoordinates(input.y, "y")) };
+
+    int x = input.x.coerceToInteger().toInt();
+    int y = input.y.coerceToInteger().toInt();
+    return { getPixel(x, y) };
 }
     
 std::unique_ptr<FunctionApplierT<ReadPixelsInput, ReadPixelsOutput> >
@@ -1567,6 +2468,10 @@ ProximateVoxelsFunction(MldbServer * owner,
     auto boundExpr = functionConfig.expression->bind(context);
     SqlRowScope scope;
     embedding = boundExpr(scope, GET_ALL);
+    shape = embedding.getEmbeddingShape();
+    voxels = getDenseFloats(embedding);
+    if (shape.size() != 4)
+        voxels.clear();
 }
 
 ProximateVoxelsFunction::
@@ -1584,30 +2489,55 @@ struct ProximateVoxelsFunctionApplier
     }
 };
 
-ProximateVoxelsOutput
+size_t
 ProximateVoxelsFunction::
-applyT(const ApplierT & applier_, ProximateVoxelsInput input) const
+valuesPerPosition() const
 {
-    
-    ProximateVoxelsOutput output;
-
-    int x = input.x.coerceToInteger().toInt();
-    int y = input.y.coerceToInteger().toInt();
-    int z = input.z.coerceToInteger().toInt();
-    
-    auto shape = embedding.getEmbeddingShape();
+    size_t numChannels = shape.empty() ? 0 : shape.back();
+    return (N*2+1)*(N*2+1)*(N*2+1)*numChannels;
+}
 
+void
+ProximateVoxelsFunction::
+gatherVoxels(int x, int y, int z, float * p) const
+{
     size_t numChannels = shape.back();
-    const size_t num_values = (N*2+1)*(N*2+1)*(N*2+1)*numChannels;
 
-    std::shared_ptr<float> buffer(new float[num_values],
-                                  [] (float * p) { delete[] p; });
+    if (!voxels.empty()) {
+        // voxelize is z, y, x, channel; the channels of a voxel are
+        // contiguous
+        size_t zStride = shape[1] * shape[2] * numChannels;
+        size_t yStride = shape[2] * numChannels;
+        for (int i = -N; i <= N; ++i) {
+            for (int j = -N; j <= N; ++j) {
+                for (int k = -N; k <= N; ++k) {
+                    int ii = x + i;
+                    int jj = y + j;
+                    int kk = z + k;
+
+                    if (ii < 0 || jj < 0 || kk < 0
+                        || (size_t)kk >= shape[0] || (size_t)jj >= shape[1]
+                        || (size_t)ii >= shape[2])
+                        throw HttpReturnException
+                            (400, "image.proximatevoxels position is too "
+                             "close to the edge of the embedding",
+                             "x", x, "y", y, "z", z, "range", N,
+                             "shape", std::vector<size_t>(shape.begin(),
+                                                          shape.end()));
+
+                    const float * in = voxels.data()
+                        + kk * zStride + jj * yStride + ii * numChannels;
+                    p = std::copy(in, in + numChannels, p);
+                }
+            }
+        }
+        return;
+    }
 
-    float* p = buffer.get();
     for (int i = -N; i <= N; ++i) {
         for (int j = -N; j <= N; ++j) {
             for (int k = -N; k <= N; ++k) {
-                for (int c = 0; c < 3; ++c) {
+                for (int c = 0; c < (int)numChannels; ++c) {
 
                     int ii = x + i;
                     int jj = y + j;
@@ -1642,6 +2572,43 @@ applyT(const ApplierT & applier_, ProximateVoxelsInput input) const
             }
         }
     }
+}
+
+ProximateVoxelsOutput
+ProximateVoxelsFunction::
+applyT(const ApplierT & applier_, ProximateVoxelsInput input) const
+{
+    const size_t num_values = valuesPerPosition();
+
+    if (isBatch(input.x) || isBatch(input.y) || isBatch(input.z)) {
+        auto x = getCoordinates(input.x, "x");
+        auto y = getCoordinates(input.y, "y");
+        auto z = getCoordinates(input.z, "z");
+        if (x.size() != y.size() || x.size() != z.size())
+            throw HttpReturnException(400, "image.proximatevoxels needs as "
+                                      "many x, y and z coordinates",
+                                      "numX", x.size(),
+                                      "numY", y.size(),
+                                      "numZ", z.size());
+
+        size_t n = x.size();
+        std::shared_ptr<float> buffer(new float[n * num_values],
+                                      [] (float * p) { delete[] p; });
+        for (size_t i = 0;  i < n;  ++i)
+            gatherVoxels(x[i], y[i], z[i], buffer.get() + i * num_values);
+
+        return { ExpressionValue::embedding
+                (Date::notADate(), buffer, ST_FLOAT32,
+                 DimsVector{ n, num_values }) };
+    }
+
+    int x = input.x.coerceToInteger().toInt();
+    int y = input.y.coerceToInteger().toInt();
+    int z = input.z.coerceToInteger().toInt();
+
+    std::shared_ptr<float> buffer(new float[num_values],
+                                  [] (float * p) { delete[] p; });
+    gatherVoxels(x, y, z, buffer.get());
 
     auto tensor = ExpressionValue::embedding
         (Date::notADate(), buffer, ST_FLOAT32, DimsVector{ num_values });
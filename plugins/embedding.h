@@ -12,6 +12,7 @@
 #include "mldb/core/dataset.h"
 #include "mldb/core/value_function.h"
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/types/url.h"
 #include "metric_space.h"
 
 
@@ -22,18 +23,96 @@ namespace MLDB {
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+/** Index used for nearest neighbor queries on an embedding dataset. */
+enum EmbeddingIndex {
+    EMBEDDING_INDEX_VPTREE,  ///< Exact search with a vantage point tree
+    EMBEDDING_INDEX_HNSW     ///< Approximate search with an HNSW graph
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingIndex);
+
+/** How the coordinates of an embedding dataset are stored. */
+enum EmbeddingStorage {
+    EMBEDDING_STORAGE_FLOAT32,  ///< Single precision floats
+    EMBEDDING_STORAGE_FLOAT16,  ///< Half precision floats
+    EMBEDDING_STORAGE_INT8      ///< One byte per coordinate, scaled per row
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingStorage);
+
 struct EmbeddingDatasetConfig {
     EmbeddingDatasetConfig()
-        : metric(METRIC_EUCLIDEAN)
+        : metric(METRIC_EUCLIDEAN),
+          index(EMBEDDING_INDEX_VPTREE),
+          hnswNeighbors(16),
+          hnswConstructionWidth(200),
+          hnswSearchWidth(100),
+          storage(EMBEDDING_STORAGE_FLOAT32),
+          rerankFactor(0)
     {
     }
 
     MetricSpace metric;
+    EmbeddingIndex index;
+    unsigned hnswNeighbors;
+    unsigned hnswConstructionWidth;
+    unsigned hnswSearchWidth;
+    EmbeddingStorage storage;
+    unsigned rerankFactor;
+
+    /// If set, the dataset is saved here on commit and reloaded from here
+    /// (memory mapped where possible) if the file already exists.
+    Url dataFileUrl;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
 
 
+/*****************************************************************************/
+/* EMBEDDING MATRIX VIEW                                                     */
+/*****************************************************************************/
+
+/** Read-only view of the committed rows of an embedding dataset, for
+    callers that read the coordinates of many rows at once.  Rows are found
+    through the dataset's row index, and the coordinates of each row are
+    contiguous floats in the order of getColumnNames().
+
+    The view holds a read lock on the version of the dataset that was
+    committed when it was created, which stops it from being freed.  It
+    should be kept for one batch of lookups, and destroyed on the thread
+    that created it.
+*/
+
+struct EmbeddingMatrixView {
+    EmbeddingMatrixView();
+    EmbeddingMatrixView(EmbeddingMatrixView && other);
+    ~EmbeddingMatrixView();
+
+    /// Number of rows in the dataset
+    size_t rowCount() const;
+
+    /// Names of the columns, in the order of the coordinates of each row
+    const std::vector<ColumnPath> & getColumnNames() const;
+
+    /// Index of the given row, or -1 if it isn't in the dataset
+    int getRowIndex(const RowPath & row) const;
+
+    /** Coordinates of the row with the given index.  Coordinates stored
+        as floats are returned in place; others are decoded into buffer,
+        which must have room for getColumnNames().size() floats.
+    */
+    const float * getRowCoords(int index, float * buffer) const;
+
+    /// Timestamp of the row with the given index
+    Date getRowTimestamp(int index) const;
+
+private:
+    friend struct EmbeddingDataset;
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+
 /*****************************************************************************/
 /* EMBEDDING                                                                 */
 /*****************************************************************************/
@@ -76,6 +155,16 @@ struct EmbeddingDataset: public Dataset {
     
     virtual std::shared_ptr<RowValueInfo> getRowInfo() const;
 
+    virtual ExpressionValue
+    getRowEmbedding(const RowPath & row,
+                    const std::vector<ColumnPath> & columns,
+                    StorageType storage = ST_FLOAT64) const;
+
+    /** Return a view of the committed rows, to read the coordinates of
+        many rows without going through a row expression for each.
+    */
+    EmbeddingMatrixView getEmbeddingView() const;
+
     std::vector<std::tuple<RowPath, RowHash, float> >
     getNeighbors(const distribution<float> & coord, int numNeighbors,
                  double maxDistance) const;
@@ -198,6 +287,19 @@ struct ReadPixelsFunction
 
     ExpressionValue embedding;
     DimsVector shape;
+
+    /// Elements of the embedding in row major order, when it's a tensor
+    /// of numbers, so that batches of pixels can be gathered directly
+    std::vector<float> pixels;
+
+private:
+    /// Value at the given position, or zero outside of the image
+    ExpressionValue getPixel(int x, int y) const;
+
+    /// Pixels at each of the positions, as a float embedding of shape
+    /// [n] plus the shape of a pixel
+    ExpressionValue getPixels(const std::vector<int> & x,
+                              const std::vector<int> & y) const;
 };
 
 /*****************************************************************************/
@@ -250,8 +352,21 @@ struct ProximateVoxelsFunction
     ProximateVoxelsFunctionConfig functionConfig;
 
     ExpressionValue embedding;
+    DimsVector shape;
+
+    /// Elements of the embedding in row major order, when it's a tensor
+    /// of numbers, so that voxels can be gathered directly
+    std::vector<float> voxels;
 
     int N;
+
+private:
+    /// Number of values returned for each position
+    size_t valuesPerPosition() const;
+
+    /// Write the valuesPerPosition() values of the cube around the
+    /// position to out
+    void gatherVoxels(int x, int y, int z, float * out) const;
 };
 
 
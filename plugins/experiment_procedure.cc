@@ -22,6 +22,9 @@
 #include "mldb/plugins/sql_expression_extractors.h"
 #include "mldb/plugins/sparse_matrix_dataset.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/parallel.h"
+#include <mutex>
+#include <unistd.h>
 
 using namespace std;
 
@@ -174,6 +177,13 @@ ExperimentProcedureConfigDescription()
      addField("outputAccuracyDataset", &ExperimentProcedureConfig::outputAccuracyDataset,
               "If true, an output dataset for scored examples will created for each fold.",
               true);
+    addField("maxParallelFolds", &ExperimentProcedureConfig::maxParallelFolds,
+             "Maximum number of folds to train and test at the same time.  1 "
+             "(the default) runs the folds one after the other.  0 runs as "
+             "many at once as are expected to fit in half of the free memory, "
+             "estimated from the size of the input dataset.  Folds running "
+             "at the same time share the input dataset and the feature "
+             "columns calculated from it.", 1);
     addField("uniqueScoresOnly", &ExperimentProcedureConfig::uniqueScoresOnly,
               "If `outputAccuracyDataset` is set and `mode` is set to `boolean`, setting this parameter "
               "to `true` will output a single row per unique score. This is useful if the "
@@ -270,6 +280,35 @@ generateStatistics(const Json::Value & js,
 /* EXPERIMENT PROCEDURE                                                      */
 /*****************************************************************************/
 
+namespace {
+
+/** Number of folds to run at the same time when maxParallelFolds is
+    zero.  Each fold holds the features of its training rows in memory, so
+    we allow for 16 bytes per value of the input dataset and run as many
+    folds as fit in half of the memory that's currently free.
+*/
+int getAutoParallelFolds(MldbServer * server, const InputQuery & inputData,
+                         int numFolds)
+{
+    SqlExpressionMldbScope context(server);
+    auto boundDataset = inputData.stm->from->bind(context);
+    if (!boundDataset.dataset)
+        return 1;
+
+    auto matrix = boundDataset.dataset->getMatrixView();
+    double foldBytes
+        = 16.0 * matrix->getRowCount() * matrix->getColumnCount();
+    double freeBytes
+        = (double)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+
+    if (foldBytes <= 0.0)
+        return numFolds;
+
+    return std::max(1, (int)std::min<double>(numFolds, freeBytes / 2.0 / foldBytes));
+}
+
+} // file scope
+
 ExperimentProcedure::
 ExperimentProcedure(MldbServer * owner,
             PolyConfig config,
@@ -364,65 +403,120 @@ run(const ProcedureRunConfig & run,
 
     ExcAssertGreater(runProcConf.datasetFolds.size(), 0);
 
-    for(auto & datasetFold : runProcConf.datasetFolds) {
-        /***
-         * TRAIN
-         * **/
-        ClassifierConfig clsProcConf;
-        clsProcConf.trainingData = runProcConf.inputData;
-        clsProcConf.trainingData.stm->where = datasetFold.trainingWhere;
-        clsProcConf.trainingData.stm->limit = datasetFold.trainingLimit;
-        clsProcConf.trainingData.stm->offset = datasetFold.trainingOffset;
-        clsProcConf.trainingData.stm->orderBy = datasetFold.trainingOrderBy;
-
-        string baseUrl = runProcConf.modelFileUrlPattern.toString();
-        ML::replace_all(baseUrl, "$runid",
-                        MLDB::format("%s-%d", runProcConf.experimentName, (int)progress));
-        clsProcConf.modelFileUrl = Url(baseUrl);
-        clsProcConf.configuration = runProcConf.configuration;
-        clsProcConf.configurationFile = runProcConf.configurationFile;
-        clsProcConf.algorithm = runProcConf.algorithm;
-        clsProcConf.equalizationFactor = runProcConf.equalizationFactor;
-        clsProcConf.mode = runProcConf.mode;
-
-
-        clsProcConf.functionName = MLDB::format("%s_scorer_%d", runProcConf.experimentName, (int)progress);
-
-        if(progress == 0) {
-            PolyConfig clsProcPC;
-            clsProcPC.id = runProcConf.experimentName + "_trainer";
-            clsProcPC.type = "classifier.train";
-            clsProcPC.params = jsonEncode(clsProcConf);
-
-            INFO_MSG(logger) << " >>>>> Creating training procedure";
-            clsProcedure = createProcedure(server, clsProcPC, onProgress2, true);
-            resourcesToDelete.push_back("/v1/procedures/"+clsProcPC.id.utf8String());
-        }
+    int numFolds = runProcConf.datasetFolds.size();
 
-        if(!clsProcedure) {
-            throw MLDB::Exception("Was unable to create classifier.train procedure");
-        }
+    int maxParallelFolds = runProcConf.maxParallelFolds;
+    if (maxParallelFolds < 0) {
+        throw MLDB::Exception("maxParallelFolds must be zero or positive");
+    }
+    else if (maxParallelFolds == 0) {
+        maxParallelFolds = getAutoParallelFolds(server, runProcConf.inputData,
+                                                numFolds);
+    }
+    maxParallelFolds = std::min(maxParallelFolds, numFolds);
 
-        // create run configuration
-        ProcedureRunConfig clsProcRunConf;
-        clsProcRunConf.id = "run_"+to_string(progress);
-        clsProcRunConf.params = jsonEncode(clsProcConf);
-        Date trainStart = Date::now();
-        RunOutput output = clsProcedure->run(clsProcRunConf, onProgress2);
-        Date trainFinish = Date::now();
+    INFO_MSG(logger) << "running " << numFolds << " folds, "
+                     << maxParallelFolds << " at a time";
 
+    // The queries are shared between the procedure configurations, so each
+    // fold needs its own copy to set its WHERE clause on
+    auto copyQuery = [] (const InputQuery & query)
+        {
+            InputQuery result;
+            result.stm = std::make_shared<SelectStatement>(*query.stm);
+            return result;
+        };
 
-        /***
-         * scoring function
-         * created during the training so only add it to the cleanup list
-         * **/
+    auto getTrainingConfig = [&] (int foldNumber)
+        {
+            const DatasetFoldConfig & datasetFold
+                = runProcConf.datasetFolds[foldNumber];
+
+            ClassifierConfig clsProcConf;
+            clsProcConf.trainingData = copyQuery(runProcConf.inputData);
+            clsProcConf.trainingData.stm->where = datasetFold.trainingWhere;
+            clsProcConf.trainingData.stm->limit = datasetFold.trainingLimit;
+            clsProcConf.trainingData.stm->offset = datasetFold.trainingOffset;
+            clsProcConf.trainingData.stm->orderBy = datasetFold.trainingOrderBy;
+
+            string baseUrl = runProcConf.modelFileUrlPattern.toString();
+            ML::replace_all(baseUrl, "$runid",
+                            MLDB::format("%s-%d", runProcConf.experimentName, foldNumber));
+            clsProcConf.modelFileUrl = Url(baseUrl);
+            clsProcConf.configuration = runProcConf.configuration;
+            clsProcConf.configurationFile = runProcConf.configurationFile;
+            clsProcConf.algorithm = runProcConf.algorithm;
+            clsProcConf.equalizationFactor = runProcConf.equalizationFactor;
+            clsProcConf.mode = runProcConf.mode;
+
+            clsProcConf.functionName = MLDB::format("%s_scorer_%d", runProcConf.experimentName, foldNumber);
+
+            return clsProcConf;
+        };
 
-        resourcesToDelete.push_back("/v1/functions/" + clsProcConf.functionName.utf8String());
+    auto getAccuracyConfig = [&] (int foldNumber, bool onTestSet)
+        {
+            const DatasetFoldConfig & datasetFold
+                = runProcConf.datasetFolds[foldNumber];
+
+            // create config for the accuracy procedure
+            AccuracyConfig accuracyConfig;
+            accuracyConfig.mode = runProcConf.mode;
+            accuracyConfig.uniqueScoresOnly = runProcConf.uniqueScoresOnly;
+
+            if(runProcConf.outputAccuracyDataset && onTestSet) {
+                PolyConfigT<Dataset> outputPC;
+                outputPC.id = MLDB::format("%s_results_%d", runProcConf.experimentName, 
+                                                          foldNumber);
+                outputPC.type = "tabular";
+                accuracyConfig.outputDataset.emplace(outputPC);
+            }
 
-        /***
-         * accuracy
-         * **/
-        auto createAccuracyProcedure = [&] (AccuracyConfig & accuracyConf)
+            if(onTestSet) {
+                accuracyConfig.testingData =
+                    copyQuery(runProcConf.testingDataOverride
+                              ? *runProcConf.testingDataOverride
+                              : runProcConf.inputData);
+                accuracyConfig.testingData.stm->where = datasetFold.testingWhere;
+                accuracyConfig.testingData.stm->limit = datasetFold.testingLimit;
+                accuracyConfig.testingData.stm->offset = datasetFold.testingOffset;
+                accuracyConfig.testingData.stm->orderBy = datasetFold.testingOrderBy;
+            }
+            else {
+                accuracyConfig.testingData = copyQuery(runProcConf.inputData);
+                accuracyConfig.testingData.stm->where = datasetFold.trainingWhere;
+                accuracyConfig.testingData.stm->limit = datasetFold.trainingLimit;
+                accuracyConfig.testingData.stm->offset = datasetFold.trainingOffset;
+                accuracyConfig.testingData.stm->orderBy = datasetFold.trainingOrderBy;
+            }
+
+            return accuracyConfig;
+        };
+
+    /***
+     * Procedures
+     * They are created once from the first fold's configuration, and each
+     * fold runs them with its own.  Running a procedure doesn't modify it,
+     * so the folds can share them.
+     * **/
+    {
+        PolyConfig clsProcPC;
+        clsProcPC.id = runProcConf.experimentName + "_trainer";
+        clsProcPC.type = "classifier.train";
+        clsProcPC.params = jsonEncode(getTrainingConfig(0));
+
+        INFO_MSG(logger) << " >>>>> Creating training procedure";
+        clsProcedure = createProcedure(server, clsProcPC, onProgress2, true);
+        resourcesToDelete.push_back("/v1/procedures/"+clsProcPC.id.utf8String());
+    }
+
+    if(!clsProcedure) {
+        throw MLDB::Exception("Was unable to create classifier.train procedure");
+    }
+
+    std::shared_ptr<Procedure> accuracyTrainProc;
+
+    auto createAccuracyProcedure = [&] (const AccuracyConfig & accuracyConf)
         {
             PolyConfig accuracyProcPC;
             accuracyProcPC.id = runProcConf.experimentName + "_scorer";
@@ -430,22 +524,67 @@ run(const ProcedureRunConfig & run,
             accuracyProcPC.params = accuracyConf;
 
             INFO_MSG(logger) << " >>>>> Creating testing procedure";
-            accuracyProc = createProcedure(server, accuracyProcPC, onProgress2, true);
-
-            resourcesToDelete.push_back("/v1/procedures/"+accuracyProcPC.id.utf8String());
+            auto result = createProcedure(server, accuracyProcPC, onProgress2, true);
+            if (!result)
+                throw MLDB::Exception("Was unable to create accuracy procedure");
+            return result;
         };
 
+    accuracyProc = createAccuracyProcedure(getAccuracyConfig(0, true));
+    if(runProcConf.evalTrain)
+        accuracyTrainProc = createAccuracyProcedure(getAccuracyConfig(0, false));
+    resourcesToDelete.push_back("/v1/procedures/" + runProcConf.experimentName + "_scorer");
+
+    // setup score expression
+    string scoreExpr;
+    if     (runProcConf.mode == CM_BOOLEAN ||
+            runProcConf.mode == CM_REGRESSION)  scoreExpr = "\"%s\"({%s})[score] as score";
+    else if(runProcConf.mode == CM_CATEGORICAL) scoreExpr = "\"%s\"({%s})[scores] as score";
+    else throw MLDB::Exception("Classifier mode %d not implemented", runProcConf.mode);
+
+    std::mutex progressLock;
 
-        // setup score expression
-        string scoreExpr;
-        if     (runProcConf.mode == CM_BOOLEAN ||
-                runProcConf.mode == CM_REGRESSION)  scoreExpr = "\"%s\"({%s})[score] as score";
-        else if(runProcConf.mode == CM_CATEGORICAL) scoreExpr = "\"%s\"({%s})[scores] as score";
-        else throw MLDB::Exception("Classifier mode %d not implemented", runProcConf.mode);
+    struct FoldOutput {
+        Json::Value foldRez;
+        Json::Value duration;
+    };
+
+    std::vector<FoldOutput> foldOutputs(numFolds);
 
+    auto runFold = [&] (int foldNumber)
+    {
+        const DatasetFoldConfig & datasetFold
+            = runProcConf.datasetFolds[foldNumber];
+
+        auto onFoldProgress = [&] (const Json::Value & details)
+            {
+                Json::Value value;
+                value["foldNumber"] = foldNumber;
+                value["details"] = details;
+                std::unique_lock<std::mutex> guard(progressLock);
+                return onProgress(value);
+            };
+
+        /***
+         * TRAIN
+         * **/
+        ClassifierConfig clsProcConf = getTrainingConfig(foldNumber);
+
+        // create run configuration
+        ProcedureRunConfig clsProcRunConf;
+        clsProcRunConf.id = "run_"+to_string(foldNumber);
+        clsProcRunConf.params = jsonEncode(clsProcConf);
+        Date trainStart = Date::now();
+        RunOutput output = clsProcedure->run(clsProcRunConf, onFoldProgress);
+        Date trainFinish = Date::now();
+
+        /***
+         * accuracy
+         * **/
 
         // this lambda actually runs the accuracy procedure for the given config
-        auto runAccuracyFor = [&] (AccuracyConfig & accuracyConf)
+        auto runAccuracyFor = [&] (const std::shared_ptr<Procedure> & proc,
+                                   AccuracyConfig & accuracyConf)
         {
             auto features = extractNamedSubSelect("features", accuracyConf.testingData.stm->select);
             auto label = extractNamedSubSelect("label", accuracyConf.testingData.stm->select);
@@ -461,14 +600,11 @@ run(const ProcedureRunConfig & run,
 
             Timer timer;
 
-            if(!accuracyProc)
-                throw MLDB::Exception("Was unable to create accuracy procedure");
-
             ProcedureRunConfig accuracyProcRunConf;
-            accuracyProcRunConf.id = "run_"+to_string(progress);
+            accuracyProcRunConf.id = "run_"+to_string(foldNumber);
             accuracyProcRunConf.params = jsonEncode(accuracyConf);
             Date testStart = Date::now();
-            RunOutput accuracyOutput = accuracyProc->run(accuracyProcRunConf, onProgress2);
+            RunOutput accuracyOutput = proc->run(accuracyProcRunConf, onFoldProgress);
             Date testFinish = Date::now();
 
             INFO_MSG(logger) << "accuracy took " << timer.elapsed();
@@ -477,76 +613,34 @@ run(const ProcedureRunConfig & run,
                               testFinish.secondsSinceEpoch() - testStart.secondsSinceEpoch());
         };
 
+        auto accuracyConfig = getAccuracyConfig(foldNumber, true);
 
-        auto getAccuracyConfig = [&] (bool onTestSet)
-            {
-                // create config for the accuracy procedure
-                AccuracyConfig accuracyConfig;
-                accuracyConfig.mode = runProcConf.mode;
-                accuracyConfig.uniqueScoresOnly = runProcConf.uniqueScoresOnly;
-
-                if(runProcConf.outputAccuracyDataset && onTestSet) {
-                    PolyConfigT<Dataset> outputPC;
-                    outputPC.id = MLDB::format("%s_results_%d", runProcConf.experimentName, 
-                                                              (int)progress);
-                    outputPC.type = "tabular";
-
-                    {
-                        InProcessRestConnection connection;
-                        RestRequest request("DELETE", "/v1/datasets/"+outputPC.id.utf8String(),
-                                            RestParams(), "{}");
-                        server->handleRequest(connection, request);
-
-                        if(connection.responseCode != 204) {
-                            throw MLDB::Exception("HTTP error "+std::to_string(connection.responseCode)+
-                                " when trying to DELETE dataset '"+outputPC.id.utf8String()+"'");
-                        }
-                    }
-                    accuracyConfig.outputDataset.emplace(outputPC);
-                }
-
-                if(onTestSet) {
-                    accuracyConfig.testingData =
-                        runProcConf.testingDataOverride ? *runProcConf.testingDataOverride
-                                                        : runProcConf.inputData;
-                    accuracyConfig.testingData.stm->where = datasetFold.testingWhere;
-                    accuracyConfig.testingData.stm->limit = datasetFold.testingLimit;
-                    accuracyConfig.testingData.stm->offset = datasetFold.testingOffset;
-                    accuracyConfig.testingData.stm->orderBy = datasetFold.testingOrderBy;
-                }
-                else {
-                    accuracyConfig.testingData = runProcConf.inputData;
-                    accuracyConfig.testingData.stm->where = datasetFold.trainingWhere;
-                    accuracyConfig.testingData.stm->limit = datasetFold.trainingLimit;
-                    accuracyConfig.testingData.stm->offset = datasetFold.trainingOffset;
-                    accuracyConfig.testingData.stm->orderBy = datasetFold.trainingOrderBy;
-                }
-
-                return accuracyConfig;
-            };
-
-        auto accuracyConfig = getAccuracyConfig(true);
+        if (accuracyConfig.outputDataset) {
+            InProcessRestConnection connection;
+            RestRequest request("DELETE", "/v1/datasets/"+accuracyConfig.outputDataset->id.utf8String(),
+                                RestParams(), "{}");
+            server->handleRequest(connection, request);
 
-        // create empty testing procedure
-        if(progress == 0)
-            createAccuracyProcedure(accuracyConfig);
+            if(connection.responseCode != 204) {
+                throw MLDB::Exception("HTTP error "+std::to_string(connection.responseCode)+
+                    " when trying to DELETE dataset '"+accuracyConfig.outputDataset->id.utf8String()+"'");
+            }
+        }
 
         // run evaluation on testing
-        auto accuracyOutput = runAccuracyFor(accuracyConfig);
+        auto accuracyOutput = runAccuracyFor(accuracyProc, accuracyConfig);
 
         // run evaluation on training
         std::tuple<RunOutput, double> accuracyOutputTrain;
         if(runProcConf.evalTrain) {
-            auto accuracyTrainingConf = getAccuracyConfig(false);
-            createAccuracyProcedure(accuracyTrainingConf);
-            accuracyOutputTrain = runAccuracyFor(accuracyTrainingConf);
+            auto accuracyTrainingConf = getAccuracyConfig(foldNumber, false);
+            accuracyOutputTrain = runAccuracyFor(accuracyTrainProc, accuracyTrainingConf);
         }
 
         Json::Value duration;
         duration["train"] = trainFinish.secondsSinceEpoch() - trainStart.secondsSinceEpoch();
         duration["test"] = get<1>(accuracyOutput) + (runProcConf.evalTrain ? get<1>(accuracyOutputTrain)
                                                                            : 0);
-        durationStatsGen.accumStats(duration, "");
 
         // Add results
         Json::Value foldRez;
@@ -559,16 +653,45 @@ run(const ProcedureRunConfig & run,
 
         foldRez["resultsTest"] = jsonEncode(get<0>(accuracyOutput).results);
         foldRez["durationSecs"] = duration;
-        statsGen.accumStats(foldRez["resultsTest"], "");
 
         if(runProcConf.evalTrain) {
             foldRez["resultsTrain"] = jsonEncode(get<0>(accuracyOutputTrain).results);
-            statsGenTrain.accumStats(foldRez["resultsTrain"], "");
         }
 
-        test_eval_results.append(foldRez);
+        foldOutputs[foldNumber].foldRez = std::move(foldRez);
+        foldOutputs[foldNumber].duration = std::move(duration);
 
         progress ++;
+    };
+
+    // Each of the maxParallelFolds workers takes the next fold to run until
+    // they're all done
+    std::atomic<int> nextFold(0);
+
+    auto runFolds = [&] (int worker)
+        {
+            for (int foldNumber = nextFold++;  foldNumber < numFolds;
+                 foldNumber = nextFold++) {
+                runFold(foldNumber);
+            }
+        };
+
+    parallelMap(0, maxParallelFolds, runFolds);
+
+    for (int foldNumber = 0;  foldNumber < numFolds;  ++foldNumber) {
+        FoldOutput & fold = foldOutputs[foldNumber];
+
+        // scoring function created during the training, so only add it to
+        // the cleanup list
+        resourcesToDelete.push_back("/v1/functions/"
+                                    + fold.foldRez["functionName"].asString());
+
+        durationStatsGen.accumStats(fold.duration, "");
+        statsGen.accumStats(fold.foldRez["resultsTest"], "");
+        if(runProcConf.evalTrain)
+            statsGenTrain.accumStats(fold.foldRez["resultsTrain"], "");
+
+        test_eval_results.append(fold.foldRez);
     }
 
     /***
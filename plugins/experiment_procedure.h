@@ -71,7 +71,8 @@ struct ExperimentProcedureConfig : public ProcedureConfig {
           mode(CM_BOOLEAN),
           outputAccuracyDataset(true),
           uniqueScoresOnly(false),
-          evalTrain(false)
+          evalTrain(false),
+          maxParallelFolds(1)
     {
     }
 
@@ -110,6 +111,9 @@ struct ExperimentProcedureConfig : public ProcedureConfig {
     bool outputAccuracyDataset;
     bool uniqueScoresOnly;
     bool evalTrain;
+
+    /// How many folds to run at once; 0 means based on the memory free
+    int maxParallelFolds;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ExperimentProcedureConfig);
@@ -16,6 +16,12 @@
 #include "mldb/utils/runner.h"
 #include <boost/filesystem.hpp>
 #include "mldb/types/any_impl.h"
+#include "mldb/types/optional_description.h"
+#include "mldb/server/analytics.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/http/http_exception.h"
+#include "shared_memory_table.h"
+#include <unistd.h>
 
 
 using namespace std;
@@ -35,6 +41,18 @@ ExternalPythonProcedureConfigDescription()
             "Script resource configuration");
     addField("stdInData", &ExternalPythonProcedureConfig::stdInData,
             "What to send on the stdin of the python process");
+    addField("inputData", &ExternalPythonProcedureConfig::inputData,
+             "An optional SQL query whose result is given to the script "
+             "as a table in shared memory.  The path of the table's file "
+             "is in the `MLDB_INPUT_TABLE` environment variable of the "
+             "script.");
+    addField("outputDataset", &ExternalPythonProcedureConfig::outputDataset,
+             "An optional dataset into which the rows of the table that "
+             "the script writes in shared memory are recorded.  The script "
+             "must create the table's file at the path given in the "
+             "`MLDB_OUTPUT_TABLE` environment variable.  This may refer "
+             "either to an existing dataset, or a fully specified but "
+             "non-existing dataset which will be created by the procedure.");
 }
 
 
@@ -98,8 +116,38 @@ run(const ProcedureRunConfig & run,
         python_executable = "./virtualenv/bin/python";
     }
 
+    // The tables in shared memory are exchanged through files whose path
+    // is given to the script by env in its environment
+    vector<string> command;
+    string inputPath, outputPath;
+    ML::Call_Guard removeTables([&] ()
+        {
+            if (!inputPath.empty())
+                ::unlink(inputPath.c_str());
+            if (!outputPath.empty())
+                ::unlink(outputPath.c_str());
+        });
+
+    if (newProcConf.inputData.stm) {
+        SqlExpressionMldbScope context(server);
+        auto rows = std::get<0>(queryFromStatementExpr(*newProcConf.inputData.stm,
+                                                       context));
+        inputPath = newSharedMemoryTablePath("input");
+        writeSharedMemoryTable(inputPath, rows);
+        command = { "/usr/bin/env", "MLDB_INPUT_TABLE=" + inputPath };
+    }
+
+    if (newProcConf.outputDataset) {
+        outputPath = newSharedMemoryTablePath("output");
+        if (command.empty())
+            command = { "/usr/bin/env" };
+        command.push_back("MLDB_OUTPUT_TABLE=" + outputPath);
+    }
+
     string cmd = python_executable + " " + pluginRes->getElementLocation(MAIN);
-    RunResult runRes = execute(ML::split(cmd, ' '), stdout_sink,
+    for (auto & arg: ML::split(cmd, ' '))
+        command.push_back(arg);
+    RunResult runRes = execute(command, stdout_sink,
                                 stderr_sink, newProcConf.stdInData);
 
     cout << runRes.state << endl;
@@ -139,6 +187,29 @@ run(const ProcedureRunConfig & run,
     jsRes["stderr"] = output_stderr->str();
     jsRes["runResult"] = jsonEncode(runRes);
 
+    // Only record the output of a script that succeeded
+    if (newProcConf.outputDataset && runRes.state == RunResult::RETURNED
+        && runRes.returnCode == 0) {
+        if (!fs::exists(fs::path(outputPath))) {
+            throw HttpReturnException
+                (400, "The script didn't write the table for the output "
+                 "dataset to the path in MLDB_OUTPUT_TABLE",
+                 "stdout", stdout_str,
+                 "stderr", output_stderr->str());
+        }
+
+        PolyConfigT<Dataset> outputDataset = *newProcConf.outputDataset;
+        if (outputDataset.type.empty())
+            outputDataset.type = "sparse.mutable";
+        auto output = createDataset(server, outputDataset, nullptr,
+                                    true /*overwrite*/);
+
+        Dataset::MultiChunkRecorder recorder = output->getChunkRecorder();
+        recordSharedMemoryTable(outputPath, recorder,
+                                Date::negativeInfinity());
+        recorder.commit();
+    }
+
 
     return RunOutput(jsRes);
 }
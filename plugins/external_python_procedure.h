@@ -10,7 +10,10 @@
 #pragma once
 
 #include "mldb/core/procedure.h"
+#include "mldb/core/dataset.h"
+#include "mldb/sql/sql_expression.h"
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/types/optional.h"
 #include "mldb/server/plugin_resource.h"
 
 
@@ -25,6 +28,12 @@ struct ExternalPythonProcedureConfig: public ProcedureConfig {
 
     std::string stdInData;
     ScriptResource scriptConfig;
+
+    /// Query whose result is given to the script as a shared memory table
+    InputQuery inputData;
+
+    /// Dataset that the shared memory table written by the script goes into
+    Optional<PolyConfigT<Dataset> > outputDataset;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ExternalPythonProcedureConfig);
@@ -16,6 +16,7 @@
 #include "mldb/types/any_impl.h"
 #include "utils/json_utils.h"
 #include "mldb/ext/highwayhash.h"
+#include "mldb/ext/cityhash/src/city.h"
 #include "mldb/utils/log.h"
 
 using namespace std;
@@ -41,6 +42,18 @@ HashingModeDescription()
                                                      "the cell values");
 }
 
+DEFINE_ENUM_DESCRIPTION(HashingOutput);
+
+HashingOutputDescription::
+HashingOutputDescription()
+{
+    addValue("row",       HASHING_OUTPUT_ROW, "Row with one column per "
+                                              "bucket, named hashColumnN");
+    addValue("embedding", HASHING_OUTPUT_EMBEDDING, "Embedding of float32 "
+                                                    "values with one value "
+                                                    "per bucket");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(HashedColumnFeatureGeneratorConfig);
 
 HashedColumnFeatureGeneratorConfigDescription::
@@ -52,6 +65,16 @@ HashedColumnFeatureGeneratorConfigDescription()
     addField("mode", &HashedColumnFeatureGeneratorConfig::mode,
             "Hashing mode to use. Controls what gets hashed.",
             COLUMNS);
+    addField("output", &HashedColumnFeatureGeneratorConfig::output,
+             "Form of the output: a row of named columns, or an embedding, "
+             "which is much cheaper to produce and to pass to a classifier.",
+             HASHING_OUTPUT_ROW);
+    addField("signedHashing", &HashedColumnFeatureGeneratorConfig::signedHashing,
+             "If true, each feature adds 1 or -1 to a single bucket, with "
+             "the sign taken from its hash.  If false, each feature adds "
+             "alternately 1 and -1 to buckets taken from successive bits of "
+             "its hash, as in earlier versions.",
+             false);
 }
 
 /*****************************************************************************/
@@ -82,6 +105,12 @@ HashedColumnFeatureGenerator(MldbServer * owner,
 {
     functionConfig = config.params.convert<HashedColumnFeatureGeneratorConfig>();
 
+    if (functionConfig.numBits < 1 || functionConfig.numBits > 30) {
+        throw HttpReturnException(400, "feature_hasher numBits must be "
+                                  "between 1 and 30",
+                                  "numBits", functionConfig.numBits);
+    }
+
     for(int i=0; i<numBuckets(); i++) {
         outputColumns.emplace_back(ColumnPath(MLDB::format("hashColumn%d", i)),
                                    std::make_shared<Float32ValueInfo>(),
@@ -98,7 +127,8 @@ FeatureGeneratorOutput
 HashedColumnFeatureGenerator::
 call(FeatureGeneratorInput input) const
 {
-    distribution<float> result(numBuckets());
+    std::vector<float> result(numBuckets());
+    uint64_t mask = numBuckets() - 1;
 
     Lightweight_Hash_Set<uint64_t> doneHashes;
 
@@ -114,9 +144,16 @@ call(FeatureGeneratorInput input) const
             hash = columnName.hash();
         }
         else if(functionConfig.mode == COLUMNS_AND_VALUES) {
-            Utf8String str(columnName.toUtf8String() + "::" + val.toUtf8String());
-            // Keep sip hash so that old classifiers still work
-            hash = sipHash(defaultSeedStable.u64, str.rawData(), str.rawLength());
+            if (functionConfig.signedHashing) {
+                // Nothing depends on these hashes yet, so they can be made
+                // without building a string
+                hash = Hash128to64({ columnName.hash(), val.hash() });
+            }
+            else {
+                Utf8String str(columnName.toUtf8String() + "::" + val.toUtf8String());
+                // Keep sip hash so that old classifiers still work
+                hash = sipHash(defaultSeedStable.u64, str.rawData(), str.rawLength());
+            }
         }
         else {
             throw MLDB::Exception("Unsupported hashing mode");
@@ -127,6 +164,12 @@ call(FeatureGeneratorInput input) const
 
         // cerr << "got " << hash << endl;
 
+        if (functionConfig.signedHashing) {
+            // The sign comes from the top bit, which numBits never reaches
+            result[hash & mask] += (hash >> 63) ? -1 : 1;
+            return true;
+        }
+
         int bit = 0;
         for (int i = 0;  bit <= 63;  ++i, bit += functionConfig.numBits) {
             int bucket = (hash >> bit) & ((1ULL << functionConfig.numBits) - 1);
@@ -142,14 +185,17 @@ call(FeatureGeneratorInput input) const
 
     input.columns.forEachColumn(onColumn);
 
-    ExpressionValue foResult;
+    if (functionConfig.output == HASHING_OUTPUT_EMBEDDING)
+        return {ExpressionValue(std::move(result), ts)};
+
     RowValue rowVal;
+    rowVal.reserve(result.size());
     for(int i=0; i<result.size(); i++) {
-        rowVal.push_back(make_tuple(ColumnPath(MLDB::format("hashColumn%d", i)),
-                                    CellValue(result[i]), ts));
+        rowVal.emplace_back(outputColumns[i].columnName,
+                            CellValue(result[i]), ts);
     }
 
-    return {ExpressionValue(rowVal)};
+    return {ExpressionValue(std::move(rowVal))};
 }
 
 namespace {
@@ -28,14 +28,24 @@ enum HashingMode {
     COLUMNS_AND_VALUES
 };
 
+enum HashingOutput {
+    HASHING_OUTPUT_ROW,       ///< Row with one hashColumnN column per bucket
+    HASHING_OUTPUT_EMBEDDING  ///< Float32 embedding with one value per bucket
+};
+
+DECLARE_ENUM_DESCRIPTION(HashingOutput);
+
 struct HashedColumnFeatureGeneratorConfig {
     HashedColumnFeatureGeneratorConfig(int numBits = 8)
-        : numBits(numBits), mode(COLUMNS)
+        : numBits(numBits), mode(COLUMNS), output(HASHING_OUTPUT_ROW),
+          signedHashing(false)
     {
     }
 
     int numBits;
     HashingMode mode;
+    HashingOutput output;
+    bool signedHashing;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(HashedColumnFeatureGeneratorConfig);
@@ -10,9 +10,19 @@
 #include "mldb/core/value_function.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
+#include "mldb/http/http_client.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/io/legacy_event_loop.h"
+#include "mldb/base/parallel.h"
 #include "mldb/types/value_description.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/any_impl.h"
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <strings.h>
 
 
 namespace MLDB {
@@ -26,8 +36,12 @@ namespace MLDB {
 
 struct FetcherFunctionConfig {
     FetcherFunctionConfig()
+        : maxConcurrentFetches(16), maxCacheEntries(0)
     {
     }
+
+    int maxConcurrentFetches;
+    int maxCacheEntries;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(FetcherFunctionConfig);
@@ -38,6 +52,30 @@ FetcherFunctionConfigDescription::
 FetcherFunctionConfigDescription()
 {
     nullAccepted = true;
+
+    addField("maxConcurrentFetches", &FetcherFunctionConfig::maxConcurrentFetches,
+             "Maximum number of HTTP and HTTPS requests that are made at "
+             "the same time to any one host.  Requests over this number "
+             "wait for one of the connections to the host to be free.",
+             16);
+    addField("maxCacheEntries", &FetcherFunctionConfig::maxCacheEntries,
+             "Number of successfully fetched URLs whose content is kept, so "
+             "that fetching them again doesn't make a request.  The least "
+             "recently used are dropped first.  The default of 0 disables "
+             "the cache, so that every call fetches the URL.",
+             0);
+    onPostValidate = [] (FetcherFunctionConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->maxConcurrentFetches < 1)
+                throw HttpReturnException
+                    (400, "The 'maxConcurrentFetches' parameter of the "
+                     "fetcher function must be at least 1");
+            if (config->maxCacheEntries < 0)
+                throw HttpReturnException
+                    (400, "The 'maxCacheEntries' parameter of the fetcher "
+                     "function can't be negative");
+        };
 }
 
 struct FetcherArgs {
@@ -78,6 +116,251 @@ FetcherOutputDescription::FetcherOutputDescription()
              "successful.");
 }
 
+namespace {
+
+/** Fetch the given URL through a filter_istream, which works for any
+    scheme, but blocks the calling thread for the whole fetch.
+*/
+FetcherOutput fetchBlocking(const Utf8String & url)
+{
+    FetcherOutput result;
+    try {
+        filter_istream stream(url.rawString(), { { "mapped", "true" } });
+
+        FsObjectInfo info = stream.info();
+
+        const char * mappedAddr;
+        size_t mappedSize;
+        std::tie(mappedAddr, mappedSize) = stream.mapped();
+
+        CellValue blob;
+        if (mappedAddr) {
+            blob = CellValue::blob(mappedAddr, mappedSize);
+        }
+        else {
+            std::ostringstream streamo;
+            streamo << stream.rdbuf();
+            blob = CellValue::blob(streamo.str());
+        }
+
+        result.content = ExpressionValue(std::move(blob), info.lastModified);
+        result.error = ExpressionValue::null(Date::notADate());
+        return result;
+    }
+    MLDB_CATCH_ALL {
+        result.content = ExpressionValue::null(Date::notADate());
+        result.error = ExpressionValue(getExceptionString(), Date::now());
+    }
+    return result;
+}
+
+FetcherOutput fetchError(const std::string & error)
+{
+    FetcherOutput result;
+    result.content = ExpressionValue::null(Date::notADate());
+    result.error = ExpressionValue(error, Date::now());
+    return result;
+}
+
+/** Split an http or https URL into the base URL, with the scheme, host and
+    port, and the resource on that host.  Returns false for other URLs.
+*/
+bool splitHttpUrl(const std::string & url,
+                  std::string & base, std::string & resource)
+{
+    size_t schemeLength;
+    if (url.compare(0, 7, "http://") == 0)
+        schemeLength = 7;
+    else if (url.compare(0, 8, "https://") == 0)
+        schemeLength = 8;
+    else return false;
+
+    size_t end = url.find_first_of("/?#", schemeLength);
+    if (end == schemeLength)
+        return false;
+    base = url.substr(0, end);
+    if (end == std::string::npos)
+        resource = "/";
+    else if (url[end] == '/')
+        resource = url.substr(end);
+    else resource = "/" + url.substr(end);
+    return true;
+}
+
+/** Value of the given header in headers, which have one header per line,
+    or the empty string if it's not there.
+*/
+std::string getHeader(const std::string & headers, const char * name)
+{
+    size_t nameLength = strlen(name);
+    for (size_t start = 0;  start < headers.size();  ) {
+        size_t end = headers.find('\n', start);
+        if (end == std::string::npos)
+            end = headers.size();
+        if (end - start > nameLength
+            && headers[start + nameLength] == ':'
+            && strncasecmp(headers.data() + start, name, nameLength) == 0) {
+            size_t first = headers.find_first_not_of(" \t", start + nameLength + 1);
+            size_t last = headers.find_last_not_of(" \t\r", end - 1);
+            if (first == std::string::npos || first > last || last >= end)
+                return "";
+            return headers.substr(first, last - first + 1);
+        }
+        start = end + 1;
+    }
+    return "";
+}
+
+
+/*****************************************************************************/
+/* HTTP FETCH POOL                                                           */
+/*****************************************************************************/
+
+struct HttpFetchResponse {
+    HttpClientError error;
+    int status;
+    std::string headers;
+    std::string body;
+};
+
+/** Asynchronous HTTP client per host, so that the requests of all calls of
+    the function share a bounded number of kept-alive connections to each
+    host, and many requests can be waited for at once.
+*/
+struct HttpFetchPool {
+    HttpFetchPool(int numParallel)
+        : numParallel(numParallel)
+    {
+        loop.start();
+    }
+
+    /** Start a GET request of the given URL.  The returned future is
+        invalid if the request can't be made through the pool, in which
+        case it needs to be made some other way.
+    */
+    std::future<HttpFetchResponse> fetch(const std::string & url)
+    {
+        std::string base, resource;
+        if (!splitHttpUrl(url, base, resource))
+            return {};
+
+        HttpClient * client = getClient(base);
+        if (!client)
+            return {};
+
+        auto promise = std::make_shared<std::promise<HttpFetchResponse> >();
+        std::future<HttpFetchResponse> result = promise->get_future();
+
+        auto onResponse = [promise] (const HttpRequest & request,
+                                     HttpClientError error,
+                                     int status,
+                                     std::string && headers,
+                                     std::string && body)
+            {
+                promise->set_value({ error, status, std::move(headers),
+                                     std::move(body) });
+            };
+
+        if (!client->get(resource,
+                         std::make_shared<HttpClientSimpleCallbacks>(onResponse)))
+            return {};
+        return result;
+    }
+
+private:
+    /// Each client holds its connections and file descriptors for as long
+    /// as the function exists, so beyond this number of hosts the requests
+    /// are made without the pool
+    static constexpr size_t MAX_CLIENTS = 64;
+
+    HttpClient * getClient(const std::string & base)
+    {
+        std::unique_lock<std::mutex> guard(clientsLock);
+        auto it = clients.find(base);
+        if (it == clients.end()) {
+            if (clients.size() >= MAX_CLIENTS)
+                return nullptr;
+            std::unique_ptr<HttpClient> client
+                (new HttpClient(loop, base, numParallel));
+            it = clients.emplace(base, std::move(client)).first;
+        }
+        return it->second.get();
+    }
+
+    int numParallel;
+
+    /// The clients need the loop to be running when they are destroyed,
+    /// so it's declared first
+    LegacyEventLoop loop;
+
+    std::mutex clientsLock;
+    std::map<std::string, std::unique_ptr<HttpClient> > clients;
+};
+
+
+/*****************************************************************************/
+/* FETCH CACHE                                                               */
+/*****************************************************************************/
+
+/** Least recently used cache of the content of successful fetches. */
+struct FetchCache {
+    FetchCache(size_t maxEntries)
+        : maxEntries(maxEntries)
+    {
+    }
+
+    bool get(const Utf8String & url, FetcherOutput & output)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        auto it = index.find(url);
+        if (it == index.end())
+            return false;
+        entries.splice(entries.begin(), entries, it->second);
+        output.content = it->second->content;
+        output.error = ExpressionValue::null(Date::notADate());
+        return true;
+    }
+
+    void put(const Utf8String & url, const FetcherOutput & output)
+    {
+        if (output.content.empty())
+            return;
+        std::unique_lock<std::mutex> guard(lock);
+        auto it = index.find(url);
+        if (it != index.end()) {
+            it->second->content = output.content;
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+        entries.push_front({ url, output.content });
+        index[url] = entries.begin();
+        if (entries.size() > maxEntries) {
+            index.erase(entries.back().url);
+            entries.pop_back();
+        }
+    }
+
+private:
+    struct Entry {
+        Utf8String url;
+        ExpressionValue content;
+    };
+
+    size_t maxEntries;
+    std::mutex lock;
+
+    /// Most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<Utf8String, std::list<Entry>::iterator> index;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* FETCHER FUNCTION                                                          */
+/*****************************************************************************/
+
 struct FetcherFunction: public ValueFunctionT<FetcherArgs, FetcherOutput> {
     FetcherFunction(MldbServer * owner,
                     PolyConfig config,
@@ -85,44 +368,116 @@ struct FetcherFunction: public ValueFunctionT<FetcherArgs, FetcherOutput> {
         : BaseT(owner)
     {
         functionConfig = config.params.convert<FetcherFunctionConfig>();
+        pool.reset(new HttpFetchPool(functionConfig.maxConcurrentFetches));
+        if (functionConfig.maxCacheEntries > 0)
+            cache.reset(new FetchCache(functionConfig.maxCacheEntries));
     }
-    
+
     virtual FetcherOutput applyT(const ApplierT & applier,
                                  FetcherArgs args) const
     {
-        FetcherOutput result;
-        Utf8String url = args.url;
-        try {
-            filter_istream stream(url.rawString(), { { "mapped", "true" } });
-
-            FsObjectInfo info = stream.info();
-            
-            const char * mappedAddr;
-            size_t mappedSize;
-            std::tie(mappedAddr, mappedSize) = stream.mapped();
-
-            CellValue blob;
-            if (mappedAddr) {
-                blob = CellValue::blob(mappedAddr, mappedSize);
-            }
-            else {
-                std::ostringstream streamo;
-                streamo << stream.rdbuf();
-                blob = CellValue::blob(streamo.str());
-            }
+        return std::move(fetchAll({ std::move(args.url) })[0]);
+    }
 
-            result.content = ExpressionValue(std::move(blob), info.lastModified);
-            result.error = ExpressionValue::null(Date::notADate());
-            return result;
+    /** Fetch a whole batch at once, so that the HTTP requests are all in
+        flight together rather than one after the other.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               std::vector<ExpressionValue> inputs) const
+    {
+        std::vector<Utf8String> urls(inputs.size());
+        for (size_t i = 0;  i < inputs.size();  ++i) {
+            FetcherArgs args;
+            fromInput(&args, inputs[i]);
+            urls[i] = std::move(args.url);
         }
-        MLDB_CATCH_ALL {
-            result.content = ExpressionValue::null(Date::notADate());
-            result.error = ExpressionValue(getExceptionString(), Date::now());
+
+        std::vector<FetcherOutput> fetched = fetchAll(urls);
+
+        std::vector<ExpressionValue> outputs(inputs.size());
+        for (size_t i = 0;  i < inputs.size();  ++i)
+            outputs[i] = toOutput(&fetched[i]);
+        return outputs;
+    }
+
+    std::vector<FetcherOutput>
+    fetchAll(const std::vector<Utf8String> & urls) const
+    {
+        std::vector<FetcherOutput> result(urls.size());
+        std::vector<std::future<HttpFetchResponse> > pending(urls.size());
+        std::vector<size_t> blocking;
+
+        for (size_t i = 0;  i < urls.size();  ++i) {
+            if (cache && cache->get(urls[i], result[i]))
+                continue;
+            pending[i] = pool->fetch(urls[i].rawString());
+            if (!pending[i].valid())
+                blocking.push_back(i);
         }
+
+        // Other schemes are read in parallel while the requests progress
+        auto doBlocking = [&] (size_t n)
+            {
+                size_t i = blocking[n];
+                result[i] = fetchBlocking(urls[i]);
+                if (cache)
+                    cache->put(urls[i], result[i]);
+            };
+
+        if (blocking.size() == 1)
+            doBlocking(0);
+        else if (!blocking.empty())
+            parallelMap(0, blocking.size(), doBlocking);
+
+        for (size_t i = 0;  i < urls.size();  ++i) {
+            if (!pending[i].valid())
+                continue;
+            result[i] = fromResponse(urls[i], pending[i].get());
+            if (cache)
+                cache->put(urls[i], result[i]);
+        }
+
+        return result;
+    }
+
+    static FetcherOutput fromResponse(const Utf8String & url,
+                                      HttpFetchResponse response)
+    {
+        if (response.error != HttpClientError::None)
+            return fetchError("Error fetching " + url.rawString() + ": "
+                              + HttpClientCallbacks::errorMessage(response.error));
+
+        // The pool's clients don't follow redirects, unlike filter_istream
+        if (response.status >= 300 && response.status < 400)
+            return fetchBlocking(url);
+
+        if (response.status != 200)
+            return fetchError(MLDB::format("HTTP code %d fetching %s",
+                                           response.status,
+                                           url.rawString().c_str()));
+
+        Date lastModified;
+        std::string lastModifiedStr
+            = getHeader(response.headers, "last-modified");
+        if (!lastModifiedStr.empty()) {
+            try {
+                lastModified = Date::parse(lastModifiedStr,
+                                           "%a, %d %b %Y %H:%M:%S %Z");
+            } catch (const std::exception & exc) {
+            }
+        }
+
+        FetcherOutput result;
+        result.content = ExpressionValue(CellValue::blob(std::move(response.body)),
+                                         lastModified);
+        result.error = ExpressionValue::null(Date::notADate());
         return result;
     }
 
     FetcherFunctionConfig functionConfig;
+    std::unique_ptr<HttpFetchPool> pool;
+    std::unique_ptr<FetchCache> cache;
 };
 
 static RegisterFunctionType<FetcherFunction, FetcherFunctionConfig>
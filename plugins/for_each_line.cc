@@ -14,6 +14,8 @@
 #include <chrono>
 #include <thread>
 #include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "mldb/jml/utils/ring_buffer.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/thread_pool.h"
@@ -60,6 +62,23 @@ struct Processing {
 namespace MLDB {
 
 
+namespace {
+
+/** Give the kernel a hint about how a range of a mapped file will be
+    accessed.  The range doesn't need to be page aligned.  This is only
+    advice, so failures are ignored.
+*/
+void adviseMapped(const char * start, size_t length, int advice)
+{
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t misalignment = (size_t)start % pageSize;
+    ::madvise((void *)(start - misalignment), length + misalignment, advice);
+}
+
+} // file scope
+
+
+
 /*****************************************************************************/
 /* PARALLEL LINE PROCESSOR                                                   */
 /*****************************************************************************/
@@ -273,6 +292,20 @@ void forEachLineBlock(std::istream & stream,
         std::tie(mapped, mappedSize) = fistream->mapped();
     }
 
+    // Offset of the next block in the mapping.  Only the block that is
+    // scanning for lines touches it, and the next block is only scheduled
+    // once it's done, so it needs no synchronization.
+    int64_t mappedOffset = 0;
+    if (mapped) {
+        mappedOffset = stream.tellg();
+        if (mappedOffset < 0 || mappedOffset > mappedSize)
+            mapped = nullptr;
+    }
+    if (mapped) {
+        adviseMapped(mapped + mappedOffset, mappedSize - mappedOffset,
+                     MADV_SEQUENTIAL);
+    }
+
     std::atomic<int> hasExc(false);
     std::exception_ptr exc;
 
@@ -289,9 +322,11 @@ void forEachLineBlock(std::istream & stream,
             size_t myChunkNumber = 0;
             
             try {
-                //MLDB-1426
-                if (mapped && false) {
-                    const char * start = mapped + stream.tellg();
+                if (mapped) {
+                    // Split the mapping directly into line-aligned blocks;
+                    // the lines are passed to onLine straight from the
+                    // mapping without being copied.
+                    const char * start = mapped + mappedOffset;
                     const char * current = start;
                     const char * end = mapped + mappedSize;
 
@@ -305,20 +340,27 @@ void forEachLineBlock(std::istream & stream,
                             ++current;
                         }
                     }
-                
-                    if (current)
-                        stream.seekg(current - start, ios::cur);
+
+                    if (current) {
+                        mappedOffset = current - mapped;
+                    }
                     else {
                         // Last line has no newline
                         lineOffsets.push_back(end - start);
                         ++doneLines;
+                        mappedOffset = mappedSize;
                     }
-                    
+
                     myChunkNumber = chunkNumber++;
 
                     if (current && current < end &&
                         (maxLines == -1 || doneLines < maxLines)) // don't schedule a new block if we have enough lines
                         {
+                            // Start paging in the next block while we
+                            // process this one
+                            adviseMapped(current, std::min<size_t>(BLOCK_SIZE, end - current),
+                                         MADV_WILLNEED);
+
                             // Ready for another chunk
                             tp.add(doBlock);
                         } else if (current == end) {
@@ -474,6 +516,11 @@ void forEachLineBlock(std::istream & stream,
     if (hasExc) {
         std::rethrow_exception(exc);
     }
+
+    // Leave the stream where we stopped reading, as when reading through
+    // the stream
+    if (mapped)
+        stream.seekg(mappedOffset);
 }
 
 /*****************************************************************************/
@@ -496,6 +543,56 @@ void forEachChunk(std::istream & stream,
     std::atomic<int> hasExc(false);
     std::exception_ptr exc;
 
+    // Memory map if possible, in which case chunks point straight into
+    // the mapping rather than being read into a buffer
+    const char * mapped = nullptr;
+    size_t mappedSize = 0;
+    int64_t mappedOffset = 0;
+
+    filter_istream * fistream = dynamic_cast<filter_istream *>(&stream);
+    if (fistream)
+        std::tie(mapped, mappedSize) = fistream->mapped();
+    if (mapped) {
+        mappedOffset = stream.tellg();
+        if (mappedOffset < 0 || mappedOffset > mappedSize)
+            mapped = nullptr;
+    }
+    if (mapped) {
+        adviseMapped(mapped + mappedOffset, mappedSize - mappedOffset,
+                     MADV_SEQUENTIAL);
+    }
+
+    std::function<void ()> doMappedBlock = [&] ()
+        {
+            try {
+                if (stop)
+                    return;
+
+                // Only one chunk is being split at a time, since the next
+                // one is scheduled afterwards
+                const char * chunk = mapped + mappedOffset;
+                size_t bytesRead = std::min<size_t>(chunkLength,
+                                                    mappedSize - mappedOffset);
+                mappedOffset += bytesRead;
+
+                int myChunkNumber = chunkNumber++;
+
+                if (mappedOffset < mappedSize &&
+                    (maxChunks == -1 || chunkNumber < maxChunks)) {
+                    tp.add(doMappedBlock);
+                }
+
+                if (!onChunk(chunk, bytesRead, myChunkNumber)) {
+                    stop = true;
+                    return;
+                }
+            } MLDB_CATCH_ALL {
+                if (hasExc.fetch_add(1) == 0) {
+                    exc = std::current_exception();
+                }
+            }
+        };
+
     std::function<void ()> doBlock = [&] ()
         {
             try {
@@ -538,7 +635,9 @@ void forEachChunk(std::istream & stream,
             }
         };
     
-    tp.add(doBlock);
+    if (mapped)
+        tp.add(doMappedBlock);
+    else tp.add(doBlock);
     tp.waitForAll();
 
     // If there was an exception, rethrow it rather than returning
@@ -546,6 +645,9 @@ void forEachChunk(std::istream & stream,
     if (hasExc) {
         std::rethrow_exception(exc);
     }
+
+    if (mapped)
+        stream.seekg(mappedOffset);
 }
 
 } // namespace MLDB
@@ -95,7 +95,8 @@ forEachLineStr(const std::string & filename,
 
     If a filter_istream is passed, the code is optimized as it allows
     for the file to be memory mapped.  It should in that case be opened
-    with the "mapped" option.
+    with the "mapped" option; the blocks are then split directly over the
+    mapping and lines point into it, without copying.
 
     The startBlock and endBlock functions are called, in the context of
     the processing thread, at the beginning and end of the block
@@ -125,6 +126,9 @@ void forEachLineBlock(std::istream & stream,
 
     If any throw an exception, then the exception will be rethrown once all
     concurrent lambdas have finished executing.
+
+    As for forEachLineBlock, a filter_istream opened with the "mapped"
+    option has its chunks passed straight from the mapping.
 */
 void forEachChunk(std::istream & stream,
                   std::function<bool (const char * chunk,
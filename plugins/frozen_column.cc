@@ -6,6 +6,7 @@
 */
 
 #include "frozen_column.h"
+#include "frozen_memory.h"
 #include "tabular_dataset_column.h"
 #include "mldb/arch/bitops.h"
 #include "mldb/arch/bit_range_ops.h"
@@ -13,7 +14,13 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/utils/atomic_shared_ptr.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/sql/path.h"
+#include "mldb/types/date.h"
 #include <mutex>
+#include <cmath>
+#include <cstring>
 
 using namespace std;
 
@@ -36,8 +43,9 @@ struct TableFrozenColumn: public FrozenColumn {
         hasNulls = column.sparseIndexes.size() < numEntries;
         indexBits = ML::highest_bit(table.size() + hasNulls) + 1;
         size_t numWords = (indexBits * numEntries + 31) / 32;
-        uint32_t * data = new uint32_t[numWords];
-        storage = std::shared_ptr<uint32_t>(data, [] (uint32_t * p) { delete[] p; });
+        std::shared_ptr<uint32_t> block = allocateFrozenArray<uint32_t>(numWords);
+        uint32_t * data = block.get();
+        storage = std::move(block);
 
         if (!hasNulls) {
             // Contiguous rows
@@ -58,6 +66,37 @@ struct TableFrozenColumn: public FrozenColumn {
         }
     }
 
+    TableFrozenColumn(ML::DB::Store_Reader & store,
+                      const std::shared_ptr<const void> & mapping)
+    {
+        store >> indexBits >> numEntries >> firstEntry >> hasNulls;
+        columnTypes.reconstitute(store);
+        ML::DB::compact_size_t tableSize(store);
+        table.reserve(tableSize);
+        for (size_t i = 0;  i < tableSize;  ++i)
+            table.emplace_back(reconstituteCellValue(store));
+        size_t length;
+        storage = std::static_pointer_cast<const uint32_t>
+            (reconstituteFrozenBlock(store, mapping, length));
+        ExcAssertEqual(length, (indexBits * numEntries + 31) / 32 * 4);
+    }
+
+    virtual std::string format() const
+    {
+        return "Table";
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        store << indexBits << numEntries << firstEntry << hasNulls;
+        columnTypes.serialize(store);
+        store << ML::DB::compact_size_t(table.size());
+        for (auto & v: table)
+            serializeCellValue(store, v);
+        serializeFrozenBlock(store, storage.get(),
+                             (indexBits * numEntries + 31) / 32 * 4);
+    }
+
     virtual bool forEach(const ForEachRowFn & onRow) const
     {
         ML::Bit_Extractor<uint32_t> bits(storage.get());
@@ -140,6 +179,52 @@ struct TableFrozenColumn: public FrozenColumn {
         return true;
     }
 
+    virtual bool
+    forEachMatchingRow(const CellValue & value,
+                       const std::function<bool (size_t rowNum)> & onRow)
+        const
+    {
+        if (value.empty())
+            return true;
+        auto it = std::find(table.begin(), table.end(), value);
+        if (it == table.end())
+            return true;
+        uint32_t code = (it - table.begin()) + hasNulls;
+
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            if (bits.extract<uint32_t>(indexBits) == code
+                && !onRow(i + firstEntry))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual bool
+    forEachRowWhere(const std::function<bool (const CellValue &)> & filter,
+                    const std::function<bool (size_t rowNum)> & onRow) const
+    {
+        // Evaluate the filter once per distinct value
+        std::vector<uint8_t> codeMatches(table.size() + hasNulls, false);
+        bool anyMatches = false;
+        for (size_t i = 0;  i < table.size();  ++i) {
+            anyMatches = (codeMatches[i + hasNulls] = filter(table[i]))
+                || anyMatches;
+        }
+        if (!anyMatches)
+            return true;
+
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            if (codeMatches[bits.extract<uint32_t>(indexBits)]
+                && !onRow(i + firstEntry))
+                return false;
+        }
+
+        return true;
+    }
+
     std::shared_ptr<const uint32_t> storage;
     uint32_t indexBits;
     uint32_t numEntries;
@@ -203,6 +288,13 @@ struct TableFrozenColumnFormat: public FrozenColumnFormat {
     {
         return new TableFrozenColumn(column);
     }
+
+    virtual FrozenColumn *
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping) const override
+    {
+        return new TableFrozenColumn(store, mapping);
+    }
 };
 
 RegisterFrozenColumnFormatT<TableFrozenColumnFormat> regTable;
@@ -226,8 +318,9 @@ struct SparseTableFrozenColumn: public FrozenColumn {
         rowNumBits = ML::highest_bit(column.maxRowNumber - column.minRowNumber) + 1;
         numEntries = column.sparseIndexes.size();
         size_t numWords = ((indexBits + rowNumBits) * numEntries + 31) / 32;
-        uint32_t * data = new uint32_t[numWords];
-        storage = std::shared_ptr<uint32_t>(data, [] (uint32_t * p) { delete[] p; });
+        std::shared_ptr<uint32_t> block = allocateFrozenArray<uint32_t>(numWords);
+        uint32_t * data = block.get();
+        storage = std::move(block);
             
         ML::Bit_Writer<uint32_t> writer(data);
         for (auto & i: column.sparseIndexes) {
@@ -253,6 +346,41 @@ struct SparseTableFrozenColumn: public FrozenColumn {
 #endif
     }
 
+    SparseTableFrozenColumn(ML::DB::Store_Reader & store,
+                            const std::shared_ptr<const void> & mapping)
+    {
+        store >> rowNumBits >> indexBits >> numEntries
+              >> firstEntry >> lastEntry;
+        columnTypes.reconstitute(store);
+        ML::DB::compact_size_t tableSize(store);
+        table.reserve(tableSize);
+        for (size_t i = 0;  i < tableSize;  ++i)
+            table.emplace_back(reconstituteCellValue(store));
+        size_t length;
+        storage = std::static_pointer_cast<const uint32_t>
+            (reconstituteFrozenBlock(store, mapping, length));
+        ExcAssertEqual(length,
+                       ((indexBits + rowNumBits) * numEntries + 31) / 32 * 4);
+    }
+
+    virtual std::string format() const
+    {
+        return "SparseTable";
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        store << rowNumBits << indexBits << numEntries
+              << firstEntry << lastEntry;
+        columnTypes.serialize(store);
+        store << ML::DB::compact_size_t(table.size());
+        for (auto & v: table)
+            serializeCellValue(store, v);
+        serializeFrozenBlock(store, storage.get(),
+                             ((indexBits + rowNumBits) * numEntries + 31)
+                             / 32 * 4);
+    }
+
     virtual bool forEach(const ForEachRowFn & onRow) const
     {
         ML::Bit_Extractor<uint32_t> bits(storage.get());
@@ -374,6 +502,52 @@ struct SparseTableFrozenColumn: public FrozenColumn {
         return true;
     }
 
+    virtual bool
+    forEachMatchingRow(const CellValue & value,
+                       const std::function<bool (size_t rowNum)> & onRow)
+        const
+    {
+        if (value.empty())
+            return true;
+        auto it = std::find(table.begin(), table.end(), value);
+        if (it == table.end())
+            return true;
+        uint32_t code = it - table.begin();
+
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
+            uint32_t index = bits.extract<uint32_t>(indexBits);
+            if (index == code && !onRow(rowNum + firstEntry))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual bool
+    forEachRowWhere(const std::function<bool (const CellValue &)> & filter,
+                    const std::function<bool (size_t rowNum)> & onRow) const
+    {
+        // Evaluate the filter once per distinct value
+        std::vector<uint8_t> codeMatches(table.size(), false);
+        bool anyMatches = false;
+        for (size_t i = 0;  i < table.size();  ++i)
+            anyMatches = (codeMatches[i] = filter(table[i])) || anyMatches;
+        if (!anyMatches)
+            return true;
+
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
+            uint32_t index = bits.extract<uint32_t>(indexBits);
+            if (codeMatches[index] && !onRow(rowNum + firstEntry))
+                return false;
+        }
+
+        return true;
+    }
+
     virtual ColumnTypes getColumnTypes() const
     {
         return columnTypes;
@@ -438,6 +612,13 @@ struct SparseTableFrozenColumnFormat: public FrozenColumnFormat {
     {
         return new SparseTableFrozenColumn(column);
     }
+
+    virtual FrozenColumn *
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping) const override
+    {
+        return new SparseTableFrozenColumn(store, mapping);
+    }
 };
 
 RegisterFrozenColumnFormatT<SparseTableFrozenColumnFormat> regSparseTable;
@@ -559,8 +740,9 @@ struct IntegerFrozenColumn: public FrozenColumn {
         hasNulls = info.hasNulls;
         entryBits = info.entryBits;
         offset = info.offset;
-        uint64_t * data = new uint64_t[info.numWords];
-        storage = std::shared_ptr<uint64_t>(data, [] (uint64_t * p) { delete[] p; });
+        std::shared_ptr<uint64_t> block = allocateFrozenArray<uint64_t>(info.numWords);
+        uint64_t * data = block.get();
+        storage = std::move(block);
 
         if (!hasNulls) {
             // Contiguous rows
@@ -598,6 +780,30 @@ struct IntegerFrozenColumn: public FrozenColumn {
 #endif
     }
 
+    IntegerFrozenColumn(ML::DB::Store_Reader & store,
+                        const std::shared_ptr<const void> & mapping)
+    {
+        store >> entryBits >> numEntries >> firstEntry >> offset >> hasNulls;
+        columnTypes.reconstitute(store);
+        size_t length;
+        storage = std::static_pointer_cast<const uint64_t>
+            (reconstituteFrozenBlock(store, mapping, length));
+        ExcAssertEqual(length, (entryBits * numEntries + 63) / 64 * 8);
+    }
+
+    virtual std::string format() const
+    {
+        return "Integer";
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        store << entryBits << numEntries << firstEntry << offset << hasNulls;
+        columnTypes.serialize(store);
+        serializeFrozenBlock(store, storage.get(),
+                             (entryBits * numEntries + 63) / 64 * 8);
+    }
+
     bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
     {
         ML::Bit_Extractor<uint64_t> bits(storage.get());
@@ -755,108 +961,1384 @@ struct IntegerFrozenColumnFormat: public FrozenColumnFormat {
     {
         return new IntegerFrozenColumn(column);
     }
+
+    virtual FrozenColumn *
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping) const override
+    {
+        return new IntegerFrozenColumn(store, mapping);
+    }
 };
 
 RegisterFrozenColumnFormatT<IntegerFrozenColumnFormat> regInteger;
 
 
 /*****************************************************************************/
-/* FROZEN COLUMN FORMAT                                                      */
+/* RUN LENGTH TABLE FROZEN COLUMN                                            */
 /*****************************************************************************/
 
-namespace {
+/** Frozen column that stores runs of identical values, each as the row
+    number at which it starts and an index into a table of distinct values.
+    It's efficient for low cardinality columns (eg, categorical strings)
+    where values are repeated over many consecutive rows.
+*/
+struct RunLengthTableFrozenColumn: public FrozenColumn {
 
-typedef std::map<std::string, std::shared_ptr<FrozenColumnFormat> > Formats;
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+        {
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            hasNulls = column.sparseIndexes.size() < numEntries;
 
-atomic_shared_ptr<const Formats> & getFormats()
-{
-    static atomic_shared_ptr<const Formats> formats
-        (std::make_shared<Formats>());
-    return formats;
-}
+            // Count the runs.  Gaps in the sparse indexes are runs of nulls,
+            // which have index -1.
+            numRuns = 0;
+            int lastIndex = -2;
+            uint32_t expectedRow = 0;
+            for (auto & r: column.sparseIndexes) {
+                if (r.first != expectedRow && lastIndex != -1) {
+                    ++numRuns;
+                    lastIndex = -1;
+                }
+                if (r.second != lastIndex) {
+                    ++numRuns;
+                    lastIndex = r.second;
+                }
+                expectedRow = r.first + 1;
+            }
+            if (expectedRow < numEntries && lastIndex != -1)
+                ++numRuns;
 
+            indexBits = ML::highest_bit(column.indexedVals.size() + hasNulls) + 1;
+            rowNumBits = ML::highest_bit(numEntries) + 1;
+            numWords = ((indexBits + rowNumBits) * numRuns + 31) / 32;
 
-} // file scope
+            bytesRequired = sizeof(RunLengthTableFrozenColumn) + numWords * 4;
+            for (auto & v: column.indexedVals)
+                bytesRequired += v.memusage();
+        }
 
-FrozenColumnFormat::
-~FrozenColumnFormat()
-{
-}
+        /// Only worth considering when the average run is a few rows long
+        bool isFeasible() const
+        {
+            return numEntries > 0 && numRuns * 4 <= numEntries;
+        }
 
-std::shared_ptr<void>
-FrozenColumnFormat::
-registerFormat(std::shared_ptr<FrozenColumnFormat> format)
-{
-    std::string name = format->format();
-    auto & formats = getFormats();
-    for (;;) {
-        auto ptr = formats.load();
-        if (ptr->count(name)) {
-            throw HttpReturnException
-                (500, "Attempt to double-register frozen column format "
-                 + name);
+        operator ssize_t () const
+        {
+            return bytesRequired;
         }
-        auto newFormats = *ptr;
-        newFormats.emplace(name, format);
-        auto newFormatsPtr
-            = std::make_shared<Formats>(std::move(newFormats));
-        if (formats.compare_exchange_strong(ptr, newFormatsPtr)) {
 
-            auto deregister = [name] (void *)
-                {
-                    auto & formats = getFormats();
-                    for (;;) {
-                        auto ptr = formats.load();
-                        auto newFormats = *ptr;
-                        newFormats.erase(name);
-                        auto newFormatsPtr
-                            = std::make_shared<Formats>(std::move(newFormats));
-                        if (formats.compare_exchange_strong(ptr, newFormatsPtr))
-                            break;
-                    }
-                };
+        ssize_t bytesRequired;
+        size_t numEntries;
+        size_t numRuns;
+        size_t numWords;
+        bool hasNulls;
+        int indexBits;
+        int rowNumBits;
+    };
 
-            return std::shared_ptr<void>(format.get(), deregister);
+    RunLengthTableFrozenColumn(TabularDatasetColumn & column,
+                               const SizingInfo & info)
+        : table(std::move(column.indexedVals)),
+          columnTypes(column.columnTypes)
+    {
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+        numRuns = info.numRuns;
+        hasNulls = info.hasNulls;
+        indexBits = info.indexBits;
+        rowNumBits = info.rowNumBits;
+
+        std::shared_ptr<uint32_t> block = allocateFrozenArray<uint32_t>(info.numWords);
+        uint32_t * data = block.get();
+        storage = std::move(block);
+
+        // Codes are the index into the table, plus one if we have nulls
+        // (in which case a code of zero means null).
+        ML::Bit_Writer<uint32_t> writer(data);
+        size_t runsWritten = 0;
+        auto writeRun = [&] (uint32_t startRow, uint32_t code)
+            {
+                writer.write(startRow, rowNumBits);
+                writer.write(code, indexBits);
+                ++runsWritten;
+            };
+        
+        int lastIndex = -2;
+        uint32_t expectedRow = 0;
+        for (auto & r: column.sparseIndexes) {
+            if (r.first != expectedRow && lastIndex != -1) {
+                writeRun(expectedRow, 0);
+                lastIndex = -1;
+            }
+            if (r.second != lastIndex) {
+                writeRun(r.first, r.second + hasNulls);
+                lastIndex = r.second;
+            }
+            expectedRow = r.first + 1;
         }
+        if (expectedRow < numEntries && lastIndex != -1)
+            writeRun(expectedRow, 0);
+
+        ExcAssertEqual(runsWritten, numRuns);
     }
-}
 
+    RunLengthTableFrozenColumn(ML::DB::Store_Reader & store,
+                               const std::shared_ptr<const void> & mapping)
+    {
+        store >> indexBits >> rowNumBits >> numEntries >> numRuns
+              >> firstEntry >> hasNulls;
+        columnTypes.reconstitute(store);
+        ML::DB::compact_size_t tableSize(store);
+        table.reserve(tableSize);
+        for (size_t i = 0;  i < tableSize;  ++i)
+            table.emplace_back(reconstituteCellValue(store));
+        size_t length;
+        storage = std::static_pointer_cast<const uint32_t>
+            (reconstituteFrozenBlock(store, mapping, length));
+        ExcAssertEqual(length,
+                       ((indexBits + rowNumBits) * numRuns + 31) / 32 * 4);
+    }
 
-/*****************************************************************************/
-/* FROZEN COLUMN                                                             */
-/*****************************************************************************/
+    virtual std::string format() const
+    {
+        return "RunLengthTable";
+    }
 
-std::shared_ptr<FrozenColumn>
-FrozenColumn::
-freeze(TabularDatasetColumn & column,
-       const ColumnFreezeParameters & params)
-{
-    // Get the current list of formats
-    auto formats = getFormats().load();
-    
-    ssize_t bestBytes = FrozenColumnFormat::NOT_BEST;
-    const FrozenColumnFormat * bestFormat = nullptr;
-    std::shared_ptr<void> bestData;
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        store << indexBits << rowNumBits << numEntries << numRuns
+              << firstEntry << hasNulls;
+        columnTypes.serialize(store);
+        store << ML::DB::compact_size_t(table.size());
+        for (auto & v: table)
+            serializeCellValue(store, v);
+        serializeFrozenBlock(store, storage.get(),
+                             ((indexBits + rowNumBits) * numRuns + 31)
+                             / 32 * 4);
+    }
 
-    for (auto & f: *formats) {
-        std::shared_ptr<void> data;
-        if (f.second->isFeasible(column, params, data)) {
-            ssize_t bytes = f.second->columnSize(column, params, bestBytes,
-                                                 data);
-            if (bytes >= 0 && (bestBytes < 0 || bytes < bestBytes)) {
-                bestFormat = f.second.get();
-                bestData = std::move(data);
-                bestBytes = bytes;
+    /// Return the (start row, code) of the given run
+    std::pair<uint32_t, uint32_t> getRun(uint32_t n) const
+    {
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        bits.advance(n * (indexBits + rowNumBits));
+        uint32_t startRow = bits.extract<uint32_t>(rowNumBits);
+        uint32_t code = bits.extract<uint32_t>(indexBits);
+        return { startRow, code };
+    }
+
+    /** Call onRun for each run with (start row, end row, code), where
+        end row is exclusive.
+    */
+    template<typename Fn>
+    bool forEachRun(Fn && onRun) const
+    {
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+
+        if (numRuns == 0)
+            return true;
+
+        uint32_t startRow = bits.extract<uint32_t>(rowNumBits);
+        uint32_t code = bits.extract<uint32_t>(indexBits);
+
+        for (size_t i = 1;  i <= numRuns;  ++i) {
+            uint32_t nextStartRow = numEntries, nextCode = 0;
+            if (i < numRuns) {
+                nextStartRow = bits.extract<uint32_t>(rowNumBits);
+                nextCode = bits.extract<uint32_t>(indexBits);
             }
+            if (!onRun(startRow, nextStartRow, code))
+                return false;
+            startRow = nextStartRow;
+            code = nextCode;
         }
+
+        return true;
     }
 
-    if (!bestFormat) {
-        throw HttpReturnException(500, "No column format found for column");
+    const CellValue & valueForCode(uint32_t code) const
+    {
+        static const CellValue NULL_VALUE;
+        if (hasNulls) {
+            if (code == 0)
+                return NULL_VALUE;
+            return table[code - 1];
+        }
+        return table[code];
     }
 
-    return std::shared_ptr<FrozenColumn>
-        (bestFormat->freeze(column, params, std::move(bestData)));
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        auto onRun = [&] (uint32_t startRow, uint32_t endRow, uint32_t code)
+            {
+                if (hasNulls && code == 0 && !keepNulls)
+                    return true;
+                const CellValue & val = valueForCode(code);
+                for (uint32_t i = startRow;  i < endRow;  ++i) {
+                    if (!onRow(i + firstEntry, val))
+                        return false;
+                }
+                return true;
+            };
+
+        return forEachRun(onRun);
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries || numRuns == 0)
+            return result;
+
+        // Binary search for the last run starting at or before rowIndex
+        uint32_t first = 0;
+        uint32_t last = numRuns;
+        while (last - first > 1) {
+            uint32_t middle = (first + last) / 2;
+            if (getRun(middle).first <= rowIndex)
+                first = middle;
+            else last = middle;
+        }
+
+        return result = valueForCode(getRun(first).second);
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        size_t result
+            = sizeof(*this)
+            + ((indexBits + rowNumBits) * numRuns + 31) / 32 * 4;
+
+        for (auto & v: table)
+            result += v.memusage();
+
+        return result;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        if (hasNulls && !fn(CellValue()))
+            return false;
+        for (auto & v: table) {
+            if (!fn(v))
+                return false;
+        }
+        return true;
+    }
+
+    virtual bool
+    forEachMatchingRow(const CellValue & value,
+                       const std::function<bool (size_t rowNum)> & onRow)
+        const
+    {
+        if (value.empty())
+            return true;
+        auto it = std::find(table.begin(), table.end(), value);
+        if (it == table.end())
+            return true;
+        uint32_t matchCode = (it - table.begin()) + hasNulls;
+
+        auto onRun = [&] (uint32_t startRow, uint32_t endRow, uint32_t code)
+            {
+                if (code != matchCode)
+                    return true;
+                for (uint32_t i = startRow;  i < endRow;  ++i) {
+                    if (!onRow(i + firstEntry))
+                        return false;
+                }
+                return true;
+            };
+
+        return forEachRun(onRun);
+    }
+
+    virtual bool
+    forEachRowWhere(const std::function<bool (const CellValue &)> & filter,
+                    const std::function<bool (size_t rowNum)> & onRow) const
+    {
+        // Evaluate the filter once per distinct value
+        std::vector<uint8_t> codeMatches(table.size() + hasNulls, false);
+        bool anyMatches = false;
+        for (size_t i = 0;  i < table.size();  ++i) {
+            anyMatches = (codeMatches[i + hasNulls] = filter(table[i]))
+                || anyMatches;
+        }
+        if (!anyMatches)
+            return true;
+
+        auto onRun = [&] (uint32_t startRow, uint32_t endRow, uint32_t code)
+            {
+                if (!codeMatches[code])
+                    return true;
+                for (uint32_t i = startRow;  i < endRow;  ++i) {
+                    if (!onRow(i + firstEntry))
+                        return false;
+                }
+                return true;
+            };
+
+        return forEachRun(onRun);
+    }
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    std::shared_ptr<const uint32_t> storage;
+    uint8_t indexBits;
+    uint8_t rowNumBits;
+    uint32_t numEntries;
+    uint32_t numRuns;
+    uint64_t firstEntry;
+    bool hasNulls;
+    std::vector<CellValue> table;
+    ColumnTypes columnTypes;
+};
+
+struct RunLengthTableFrozenColumnFormat: public FrozenColumnFormat {
+
+    typedef RunLengthTableFrozenColumn::SizingInfo SizingInfo;
+
+    virtual ~RunLengthTableFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "RunLengthTable";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        auto info = std::make_shared<SizingInfo>(column);
+        if (!info->isFeasible())
+            return false;
+        cachedInfo = info;
+        return true;
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        return *std::static_pointer_cast<SizingInfo>(cachedInfo);
+    }
+    
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        return new RunLengthTableFrozenColumn
+            (column, *std::static_pointer_cast<SizingInfo>(cachedInfo));
+    }
+
+    virtual FrozenColumn *
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping) const override
+    {
+        return new RunLengthTableFrozenColumn(store, mapping);
+    }
+};
+
+RegisterFrozenColumnFormatT<RunLengthTableFrozenColumnFormat> regRunLengthTable;
+
+
+/*****************************************************************************/
+/* DOUBLE FROZEN COLUMN                                                      */
+/*****************************************************************************/
+
+/** Frozen column that stores each value as a contiguous array of doubles,
+    or of floats when that can be done without losing any precision.  Nulls
+    are stored as a NaN with a payload that can't be produced by the values
+    being stored.
+*/
+struct DoubleFrozenColumn: public FrozenColumn {
+
+    static constexpr uint64_t NULL_BITS_64 = 0x7ff800000000deadULL;
+    static constexpr uint32_t NULL_BITS_32 = 0x7fc0deadU;
+
+    static uint64_t bits(double d)
+    {
+        uint64_t result;
+        std::memcpy(&result, &d, 8);
+        return result;
+    }
+
+    static uint32_t bits(float f)
+    {
+        uint32_t result;
+        std::memcpy(&result, &f, 4);
+        return result;
+    }
+
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+        {
+            const ColumnTypes & types = column.columnTypes;
+
+            // Only real values (possibly mixed with integers that are
+            // exactly representable as doubles) and nulls.  Columns
+            // of only integers are better served by the integer format.
+            if (types.numStrings || types.numBlobs || types.numOther
+                || !types.numReals)
+                return;
+            if (types.hasPositiveIntegers()
+                && types.maxPositiveInteger >= (1ULL << 53))
+                return;
+            if (types.hasNegativeIntegers()
+                && types.minNegativeInteger <= -(1LL << 53))
+                return;
+
+            isFloat = true;
+            for (auto & v: column.indexedVals) {
+                double d = v.toDouble();
+                if (bits(d) == NULL_BITS_64 || bits((float)d) == NULL_BITS_32)
+                    return;  // clashes with our null representation
+                if (isFloat && !std::isnan(d) && (double)(float)d != d)
+                    isFloat = false;
+            }
+
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            hasNulls = column.sparseIndexes.size() < numEntries;
+            bytesRequired = sizeof(DoubleFrozenColumn)
+                + numEntries * (isFloat ? 4 : 8);
+        }
+
+        operator ssize_t () const
+        {
+            return bytesRequired;
+        }
+
+        ssize_t bytesRequired = -1;
+        size_t numEntries;
+        bool hasNulls;
+        bool isFloat;
+    };
+
+    DoubleFrozenColumn(TabularDatasetColumn & column, const SizingInfo & info)
+        : columnTypes(column.columnTypes)
+    {
+        ExcAssertNotEqual(info.bytesRequired, -1);
+
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+        hasNulls = info.hasNulls;
+        isFloat = info.isFloat;
+
+        if (isFloat) {
+            std::shared_ptr<float> block = allocateFrozenArray<float>(numEntries);
+            float * data = block.get();
+            storage = std::move(block);
+            fill(data, column, [] (double d) { return (float)d; },
+                 reinterpretFloat(NULL_BITS_32));
+        }
+        else {
+            std::shared_ptr<double> block = allocateFrozenArray<double>(numEntries);
+            double * data = block.get();
+            storage = std::move(block);
+            fill(data, column, [] (double d) { return d; },
+                 reinterpretDouble(NULL_BITS_64));
+        }
+    }
+
+    static float reinterpretFloat(uint32_t b)
+    {
+        float result;
+        std::memcpy(&result, &b, 4);
+        return result;
+    }
+
+    static double reinterpretDouble(uint64_t b)
+    {
+        double result;
+        std::memcpy(&result, &b, 8);
+        return result;
+    }
+
+    template<typename Float, typename Convert>
+    void fill(Float * data, const TabularDatasetColumn & column,
+              Convert && convert, Float nullValue)
+    {
+        std::vector<Float> converted;
+        converted.reserve(column.indexedVals.size());
+        for (auto & v: column.indexedVals)
+            converted.push_back(convert(v.toDouble()));
+
+        if (!hasNulls) {
+            for (size_t i = 0;  i < column.sparseIndexes.size();  ++i) {
+                ExcAssertEqual(column.sparseIndexes[i].first, i);
+                data[i] = converted[column.sparseIndexes[i].second];
+            }
+        }
+        else {
+            std::fill(data, data + numEntries, nullValue);
+            for (auto & r_i: column.sparseIndexes)
+                data[r_i.first] = converted[r_i.second];
+        }
+    }
+
+    DoubleFrozenColumn(ML::DB::Store_Reader & store,
+                       const std::shared_ptr<const void> & mapping)
+    {
+        store >> numEntries >> firstEntry >> hasNulls >> isFloat;
+        columnTypes.reconstitute(store);
+        size_t length;
+        storage = reconstituteFrozenBlock(store, mapping, length);
+        ExcAssertEqual(length, numEntries * (isFloat ? 4 : 8));
+    }
+
+    virtual std::string format() const
+    {
+        return "Double";
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        store << numEntries << firstEntry << hasNulls << isFloat;
+        columnTypes.serialize(store);
+        serializeFrozenBlock(store, storage.get(),
+                             numEntries * (isFloat ? 4 : 8));
+    }
+
+    const float * floats() const
+    {
+        return reinterpret_cast<const float *>(storage.get());
+    }
+
+    const double * doubles() const
+    {
+        return reinterpret_cast<const double *>(storage.get());
+    }
+
+    /// Return the value at the given (zero based) index, which may be NaN
+    /// for nulls.  Sets isNull if it's a null.
+    double getAtIndex(size_t i, bool & isNull) const
+    {
+        if (isFloat) {
+            float f = floats()[i];
+            isNull = hasNulls && bits(f) == NULL_BITS_32;
+            return f;
+        }
+        else {
+            double d = doubles()[i];
+            isNull = hasNulls && bits(d) == NULL_BITS_64;
+            return d;
+        }
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            bool isNull;
+            double d = getAtIndex(i, isNull);
+            if (isNull) {
+                if (keepNulls && !onRow(i + firstEntry, CellValue()))
+                    return false;
+            }
+            else if (!onRow(i + firstEntry, d))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+        bool isNull;
+        double d = getAtIndex(rowIndex, isNull);
+        if (isNull)
+            return result;
+        return result = d;
+    }
+
+    virtual void extractNumbers(size_t startRow, size_t numRows,
+                                double * output) const
+    {
+        // Rows outside of our range are null
+        while (numRows > 0 && startRow < firstEntry) {
+            *output++ = NAN;
+            ++startRow;
+            --numRows;
+        }
+
+        size_t start = startRow - firstEntry;
+        size_t n = start >= numEntries
+            ? 0 : std::min<size_t>(numRows, numEntries - start);
+
+        // Contiguous, branch-free conversion loops.  Our null sentinels are
+        // NaNs, so they are already converted correctly.
+        if (isFloat) {
+            const float * in = floats() + start;
+            for (size_t i = 0;  i < n;  ++i)
+                output[i] = in[i];
+        }
+        else {
+            const double * in = doubles() + start;
+            std::copy(in, in + n, output);
+        }
+
+        std::fill(output + n, output + numRows, NAN);
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        return sizeof(*this) + numEntries * (isFloat ? 4 : 8);
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        std::vector<double> allVals;
+        allVals.reserve(numEntries);
+        bool hasNaN = false;
+        bool foundNull = false;
+
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            bool isNull;
+            double d = getAtIndex(i, isNull);
+            if (isNull)
+                foundNull = true;
+            else if (std::isnan(d))
+                hasNaN = true;
+            else allVals.push_back(d);
+        }
+
+        if (foundNull && !fn(CellValue()))
+            return false;
+        if (hasNaN && !fn(std::numeric_limits<double>::quiet_NaN()))
+            return false;
+
+        std::sort(allVals.begin(), allVals.end());
+        auto endIt = std::unique(allVals.begin(), allVals.end());
+
+        for (auto it = allVals.begin();  it != endIt;  ++it) {
+            if (!fn(*it))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    std::shared_ptr<const void> storage;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+    bool hasNulls;
+    bool isFloat;
+    ColumnTypes columnTypes;
+};
+
+constexpr uint64_t DoubleFrozenColumn::NULL_BITS_64;
+constexpr uint32_t DoubleFrozenColumn::NULL_BITS_32;
+
+struct DoubleFrozenColumnFormat: public FrozenColumnFormat {
+
+    typedef DoubleFrozenColumn::SizingInfo SizingInfo;
+
+    virtual ~DoubleFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "Double";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        auto info = std::make_shared<SizingInfo>(column);
+        if (info->bytesRequired == -1)
+            return false;
+        cachedInfo = info;
+        return true;
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        return *std::static_pointer_cast<SizingInfo>(cachedInfo);
+    }
+    
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        return new DoubleFrozenColumn
+            (column, *std::static_pointer_cast<SizingInfo>(cachedInfo));
+    }
+
+    virtual FrozenColumn *
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping) const override
+    {
+        return new DoubleFrozenColumn(store, mapping);
+    }
+};
+
+RegisterFrozenColumnFormatT<DoubleFrozenColumnFormat> regDouble;
+
+
+/*****************************************************************************/
+/* TIMESTAMP FROZEN COLUMN                                                   */
+/*****************************************************************************/
+
+/** Frozen column for timestamp values.  Each timestamp is converted to an
+    integral number of ticks (seconds, milliseconds or microseconds, the
+    coarsest that represents every value exactly) and stored relative to
+    the earliest one (frame of reference), bit-packed.  Timestamps within a
+    chunk are normally close together, so this takes far fewer than the 64
+    bits per value of a double while still allowing random access.
+*/
+struct TimestampFrozenColumn: public FrozenColumn {
+
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+        {
+            const ColumnTypes & types = column.columnTypes;
+            if (types.numOther == 0 || types.numIntegers || types.numReals
+                || types.numStrings || types.numBlobs)
+                return;
+
+            static const int64_t resolutions[3] = { 1, 1000, 1000000 };
+
+            for (int64_t perSecond: resolutions) {
+                bool exact = true;
+                int64_t minTicks = std::numeric_limits<int64_t>::max();
+                int64_t maxTicks = std::numeric_limits<int64_t>::min();
+
+                for (auto & v: column.indexedVals) {
+                    if (!v.isTimestamp())
+                        return;  // time intervals
+                    double seconds = v.toTimestamp().secondsSinceEpoch();
+                    if (!std::isfinite(seconds)
+                        || std::abs(seconds) * perSecond >= (1LL << 53)) {
+                        exact = false;
+                        break;
+                    }
+                    int64_t ticks = std::llround(seconds * perSecond);
+                    if ((double)ticks / perSecond != seconds) {
+                        exact = false;
+                        break;
+                    }
+                    minTicks = std::min(minTicks, ticks);
+                    maxTicks = std::max(maxTicks, ticks);
+                }
+
+                if (!exact)
+                    continue;
+
+                ticksPerSecond = perSecond;
+                offset = column.indexedVals.empty() ? 0 : minTicks;
+                uint64_t range = column.indexedVals.empty()
+                    ? 0 : maxTicks - minTicks;
+                numEntries = column.maxRowNumber - column.minRowNumber + 1;
+                hasNulls = column.sparseIndexes.size() < numEntries;
+                entryBits = ML::highest_bit(range + hasNulls) + 1;
+                numWords = (entryBits * numEntries + 63) / 64;
+                bytesRequired = sizeof(TimestampFrozenColumn) + numWords * 8;
+                return;
+            }
+        }
+
+        operator ssize_t () const
+        {
+            return bytesRequired;
+        }
+
+        ssize_t bytesRequired = -1;
+        int64_t ticksPerSecond;
+        int64_t offset;
+        size_t numEntries;
+        bool hasNulls;
+        size_t numWords;
+        int entryBits;
+    };
+
+    TimestampFrozenColumn(TabularDatasetColumn & column,
+                          const SizingInfo & info)
+        : columnTypes(column.columnTypes)
+    {
+        ExcAssertNotEqual(info.bytesRequired, -1);
+
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+        hasNulls = info.hasNulls;
+        entryBits = info.entryBits;
+        offset = info.offset;
+        ticksPerSecond = info.ticksPerSecond;
+
+        std::shared_ptr<uint64_t> block = allocateFrozenArray<uint64_t>(info.numWords);
+        uint64_t * data = block.get();
+        storage = std::move(block);
+        std::fill(data, data + info.numWords, 0);
+
+        std::vector<uint64_t> encoded;
+        encoded.reserve(column.indexedVals.size());
+        for (auto & v: column.indexedVals) {
+            int64_t ticks = std::llround(v.toTimestamp().secondsSinceEpoch()
+                                         * ticksPerSecond);
+            encoded.push_back(ticks - offset + hasNulls);
+        }
+
+        for (auto & r_i: column.sparseIndexes) {
+            ML::Bit_Writer<uint64_t> writer(data);
+            writer.skip(r_i.first * entryBits);
+            writer.write(encoded[r_i.second], entryBits);
+        }
+    }
+
+    TimestampFrozenColumn(ML::DB::Store_Reader & store,
+                          const std::shared_ptr<const void> & mapping)
+    {
+        store >> entryBits >> numEntries >> firstEntry >> offset
+              >> ticksPerSecond >> hasNulls;
+        columnTypes.reconstitute(store);
+        size_t length;
+        storage = std::static_pointer_cast<const uint64_t>
+            (reconstituteFrozenBlock(store, mapping, length));
+        ExcAssertEqual(length, (entryBits * numEntries + 63) / 64 * 8);
+    }
+
+    virtual std::string format() const
+    {
+        return "Timestamp";
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        store << entryBits << numEntries << firstEntry << offset
+              << ticksPerSecond << hasNulls;
+        columnTypes.serialize(store);
+        serializeFrozenBlock(store, storage.get(),
+                             (entryBits * numEntries + 63) / 64 * 8);
+    }
+
+    CellValue decode(uint64_t val) const
+    {
+        int64_t ticks = (int64_t)(val - hasNulls) + offset;
+        return Date::fromSecondsSinceEpoch((double)ticks / ticksPerSecond);
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            uint64_t val = bits.extract<uint64_t>(entryBits);
+            if (hasNulls && val == 0) {
+                if (keepNulls && !onRow(i + firstEntry, CellValue()))
+                    return false;
+            }
+            else if (!onRow(i + firstEntry, decode(val)))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+        bits.advance(rowIndex * entryBits);
+        uint64_t val = bits.extract<uint64_t>(entryBits);
+        if (hasNulls && val == 0)
+            return result;
+        return result = decode(val);
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        return sizeof(*this) + (entryBits * numEntries + 63) / 64 * 8;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        std::vector<uint64_t> allVals;
+        allVals.reserve(numEntries);
+
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+        bool foundNull = false;
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            uint64_t val = bits.extract<uint64_t>(entryBits);
+            if (hasNulls && val == 0)
+                foundNull = true;
+            else allVals.push_back(val);
+        }
+
+        if (foundNull && !fn(CellValue()))
+            return false;
+
+        std::sort(allVals.begin(), allVals.end());
+        auto endIt = std::unique(allVals.begin(), allVals.end());
+
+        for (auto it = allVals.begin();  it != endIt;  ++it) {
+            if (!fn(decode(*it)))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    std::shared_ptr<const uint64_t> storage;
+    uint32_t entryBits;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+    int64_t offset;
+    int64_t ticksPerSecond;
+    bool hasNulls;
+    ColumnTypes columnTypes;
+};
+
+struct TimestampFrozenColumnFormat: public FrozenColumnFormat {
+
+    typedef TimestampFrozenColumn::SizingInfo SizingInfo;
+
+    virtual ~TimestampFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "Timestamp";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        auto info = std::make_shared<SizingInfo>(column);
+        if (info->bytesRequired == -1)
+            return false;
+        cachedInfo = info;
+        return true;
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        return *std::static_pointer_cast<SizingInfo>(cachedInfo);
+    }
+    
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        return new TimestampFrozenColumn
+            (column, *std::static_pointer_cast<SizingInfo>(cachedInfo));
+    }
+
+    virtual FrozenColumn *
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping) const override
+    {
+        return new TimestampFrozenColumn(store, mapping);
+    }
+};
+
+RegisterFrozenColumnFormatT<TimestampFrozenColumnFormat> regTimestamp;
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN FORMAT                                                      */
+/*****************************************************************************/
+
+namespace {
+
+typedef std::map<std::string, std::shared_ptr<FrozenColumnFormat> > Formats;
+
+atomic_shared_ptr<const Formats> & getFormats()
+{
+    static atomic_shared_ptr<const Formats> formats
+        (std::make_shared<Formats>());
+    return formats;
+}
+
+
+} // file scope
+
+FrozenColumnFormat::
+~FrozenColumnFormat()
+{
+}
+
+std::shared_ptr<void>
+FrozenColumnFormat::
+registerFormat(std::shared_ptr<FrozenColumnFormat> format)
+{
+    std::string name = format->format();
+    auto & formats = getFormats();
+    for (;;) {
+        auto ptr = formats.load();
+        if (ptr->count(name)) {
+            throw HttpReturnException
+                (500, "Attempt to double-register frozen column format "
+                 + name);
+        }
+        auto newFormats = *ptr;
+        newFormats.emplace(name, format);
+        auto newFormatsPtr
+            = std::make_shared<Formats>(std::move(newFormats));
+        if (formats.compare_exchange_strong(ptr, newFormatsPtr)) {
+
+            auto deregister = [name] (void *)
+                {
+                    auto & formats = getFormats();
+                    for (;;) {
+                        auto ptr = formats.load();
+                        auto newFormats = *ptr;
+                        newFormats.erase(name);
+                        auto newFormatsPtr
+                            = std::make_shared<Formats>(std::move(newFormats));
+                        if (formats.compare_exchange_strong(ptr, newFormatsPtr))
+                            break;
+                    }
+                };
+
+            return std::shared_ptr<void>(format.get(), deregister);
+        }
+    }
+}
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN                                                             */
+/*****************************************************************************/
+
+bool
+FrozenColumn::
+forEachMatchingRow(const CellValue & value,
+                   const std::function<bool (size_t rowNum)> & onRow) const
+{
+    if (value.empty())
+        return true;
+
+    auto onValue = [&] (size_t rowNum, const CellValue & val)
+        {
+            if (val != value)
+                return true;
+            return onRow(rowNum);
+        };
+
+    return forEach(onValue);
+}
+
+bool
+FrozenColumn::
+forEachRowWhere(const std::function<bool (const CellValue &)> & filter,
+                const std::function<bool (size_t rowNum)> & onRow) const
+{
+    auto onValue = [&] (size_t rowNum, const CellValue & val)
+        {
+            if (val.empty() || !filter(val))
+                return true;
+            return onRow(rowNum);
+        };
+
+    return forEach(onValue);
+}
+
+void
+FrozenColumn::
+extractNumbers(size_t startRow, size_t numRows, double * output) const
+{
+    for (size_t i = 0;  i < numRows;  ++i) {
+        CellValue val = get(startRow + i);
+        output[i] = val.empty() ? NAN : val.toDouble();
+    }
+}
+
+std::shared_ptr<FrozenColumn>
+FrozenColumn::
+freeze(TabularDatasetColumn & column,
+       const ColumnFreezeParameters & params)
+{
+    // Get the current list of formats
+    auto formats = getFormats().load();
+    
+    ssize_t bestBytes = FrozenColumnFormat::NOT_BEST;
+    const FrozenColumnFormat * bestFormat = nullptr;
+    std::shared_ptr<void> bestData;
+
+    for (auto & f: *formats) {
+        std::shared_ptr<void> data;
+        if (f.second->isFeasible(column, params, data)) {
+            ssize_t bytes = f.second->columnSize(column, params, bestBytes,
+                                                 data);
+            if (bytes >= 0 && (bestBytes < 0 || bytes < bestBytes)) {
+                bestFormat = f.second.get();
+                bestData = std::move(data);
+                bestBytes = bytes;
+            }
+        }
+    }
+
+    if (!bestFormat) {
+        throw HttpReturnException(500, "No column format found for column");
+    }
+
+    return std::shared_ptr<FrozenColumn>
+        (bestFormat->freeze(column, params, std::move(bestData)));
+}
+
+void
+FrozenColumn::
+serializeColumn(const FrozenColumn & column,
+                ML::DB::Store_Writer & store)
+{
+    store << column.format();
+    column.serialize(store);
+}
+
+std::shared_ptr<FrozenColumn>
+FrozenColumn::
+reconstitute(ML::DB::Store_Reader & store,
+             const std::shared_ptr<const void> & mapping)
+{
+    std::string formatName;
+    store >> formatName;
+
+    auto formats = getFormats().load();
+    auto it = formats->find(formatName);
+    if (it == formats->end()) {
+        throw HttpReturnException
+            (500, "Unknown frozen column format '" + formatName
+             + "' while reconstituting column");
+    }
+
+    return std::shared_ptr<FrozenColumn>
+        (it->second->reconstitute(store, mapping));
+}
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN SERIALIZATION                                               */
+/*****************************************************************************/
+
+void serializeFrozenBlock(ML::DB::Store_Writer & store,
+                          const void * data, size_t length)
+{
+    store << ML::DB::compact_size_t(length);
+    static const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    size_t pad = (8 - store.offset() % 8) % 8;
+    store.save_binary(padding, pad);
+    store.save_binary(data, length);
+}
+
+std::shared_ptr<const void>
+reconstituteFrozenBlock(ML::DB::Store_Reader & store,
+                        const std::shared_ptr<const void> & mapping,
+                        size_t & length)
+{
+    ML::DB::compact_size_t len(store);
+    length = len;
+    size_t pad = (8 - store.offset() % 8) % 8;
+    store.skip(pad);
+
+    if (mapping) {
+        // Point directly into the mapped memory, keeping the mapping alive
+        // for as long as the block is referenced.
+        store.must_have(length);
+        std::shared_ptr<const void> result(mapping, store.pos());
+        store.skip(length);
+        return result;
+    }
+
+    std::shared_ptr<void> result = allocateFrozenBlock(length);
+    store.load_binary(result.get(), length);
+    return result;
+}
+
+void serializeCellValue(ML::DB::Store_Writer & store, const CellValue & val)
+{
+    unsigned char type = val.cellType();
+    store << type;
+
+    switch (val.cellType()) {
+    case CellValue::EMPTY:
+        return;
+    case CellValue::INTEGER:
+        if (val.isInt64()) {
+            store << false << val.toInt();
+        }
+        else {
+            store << true << val.toUInt();
+        }
+        return;
+    case CellValue::FLOAT:
+        store << val.toDouble();
+        return;
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING:
+        store << std::string(val.stringChars(), val.toStringLength());
+        return;
+    case CellValue::TIMESTAMP:
+        store << val.toTimestamp();
+        return;
+    case CellValue::TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        std::tie(months, days, seconds) = val.toMonthDaySecond();
+        store << months << days << seconds;
+        return;
+    }
+    case CellValue::BLOB:
+        store << std::string((const char *)val.blobData(), val.blobLength());
+        return;
+    case CellValue::PATH:
+        store << val.coerceToPath().toUtf8String();
+        return;
+    case CellValue::NUM_CELL_TYPES:
+        break;
+    }
+
+    throw HttpReturnException(500, "Can't serialize unknown cell type");
+}
+
+CellValue reconstituteCellValue(ML::DB::Store_Reader & store)
+{
+    unsigned char type;
+    store >> type;
+
+    switch (type) {
+    case CellValue::EMPTY:
+        return CellValue();
+    case CellValue::INTEGER: {
+        bool isUnsigned;
+        store >> isUnsigned;
+        if (isUnsigned) {
+            uint64_t v;
+            store >> v;
+            return v;
+        }
+        int64_t v;
+        store >> v;
+        return v;
+    }
+    case CellValue::FLOAT: {
+        double d;
+        store >> d;
+        return d;
+    }
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING: {
+        std::string str;
+        store >> str;
+        return CellValue(str.data(), str.length(),
+                         type == CellValue::ASCII_STRING
+                         ? STRING_IS_VALID_ASCII
+                         : STRING_IS_VALID_UTF8_NOT_ASCII);
+    }
+    case CellValue::TIMESTAMP: {
+        Date d;
+        store >> d;
+        return d;
+    }
+    case CellValue::TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        store >> months >> days >> seconds;
+        return CellValue::fromMonthDaySecond(months, days, seconds);
+    }
+    case CellValue::BLOB: {
+        std::string blob;
+        store >> blob;
+        return CellValue::blob(std::move(blob));
+    }
+    case CellValue::PATH: {
+        Utf8String str;
+        store >> str;
+        return CellValue(Path::parse(str));
+    }
+    }
+
+    throw HttpReturnException(500, "Can't reconstitute unknown cell type "
+                              + std::to_string((int)type));
 }
 
 
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "column_types.h"
+#include "mldb/jml/db/persistent_fwd.h"
 #include <memory>
 
 
@@ -52,15 +53,98 @@ struct FrozenColumn {
     forEachDistinctValue(std::function<bool (const CellValue &)> fn)
         const = 0;
 
+    /** Call onRow for each row number within the column whose value is
+        equal to the given (non-null) value.  The default implementation
+        compares each value in turn; formats that store a table of distinct
+        values override it to look up the value once and compare table
+        indexes, without creating a CellValue per row.
+    */
+    virtual bool
+    forEachMatchingRow(const CellValue & value,
+                       const std::function<bool (size_t rowNum)> & onRow) const;
+
+    /** Call onRow for each row number within the column whose value
+        passes the filter, which is never called for nulls.  The default
+        implementation filters each value in turn; formats that store a
+        table of distinct values override it to call the filter once per
+        distinct value, and so return straight away when none pass.
+    */
+    virtual bool
+    forEachRowWhere(const std::function<bool (const CellValue &)> & filter,
+                    const std::function<bool (size_t rowNum)> & onRow) const;
+
     virtual ColumnTypes getColumnTypes() const = 0;
 
+    /** Extract numRows values as doubles into output, starting at the given
+        (chunk-relative) row number.  Nulls are returned as NaN, and
+        non-numeric values will throw.  The default implementation calls
+        get() for each row; numeric formats override it with a contiguous
+        loop.
+    */
+    virtual void extractNumbers(size_t startRow, size_t numRows,
+                                double * output) const;
+
+    /** Return the name of the format of this column, which must be the
+        same as the name of the FrozenColumnFormat that created it so that
+        it can be reconstituted.
+    */
+    virtual std::string format() const = 0;
+
+    /** Serialize the column (not including its format name) to the given
+        store.  Bulk storage should be written with serializeFrozenBlock()
+        so that it can be used in place when reloaded from a mapped file.
+    */
+    virtual void serialize(ML::DB::Store_Writer & store) const = 0;
+
     /** Freeze the given column into the best fitting frozen column type. */
     static std::shared_ptr<FrozenColumn>
     freeze(TabularDatasetColumn & column,
            const ColumnFreezeParameters & params);
+
+    /** Serialize the given column along with its format name, so that it
+        can be reconstituted with reconstitute().
+    */
+    static void serializeColumn(const FrozenColumn & column,
+                                ML::DB::Store_Writer & store);
+
+    /** Reconstitute a column written by serializeColumn().  If mapping is
+        non-null, then the store is reading directly from a memory region
+        that mapping keeps alive, and the column's bulk storage will point
+        into it rather than being copied.
+    */
+    static std::shared_ptr<FrozenColumn>
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping);
 };
 
 
+/*****************************************************************************/
+/* FROZEN COLUMN SERIALIZATION                                               */
+/*****************************************************************************/
+
+/** Write a block of raw bulk storage to the store.  The block is aligned to
+    an 8 byte boundary relative to the start of the store, so that it can
+    be accessed in place when the file is mapped.
+*/
+void serializeFrozenBlock(ML::DB::Store_Writer & store,
+                          const void * data, size_t length);
+
+/** Read back a block written with serializeFrozenBlock().  If mapping is
+    non-null, the returned pointer points directly into the mapped memory
+    and shares ownership with mapping; otherwise the block is copied.
+*/
+std::shared_ptr<const void>
+reconstituteFrozenBlock(ML::DB::Store_Reader & store,
+                        const std::shared_ptr<const void> & mapping,
+                        size_t & length);
+
+/// Serialize a single cell value, preserving its type
+void serializeCellValue(ML::DB::Store_Writer & store, const CellValue & val);
+
+/// Reconstitute a single cell value written by serializeCellValue()
+CellValue reconstituteCellValue(ML::DB::Store_Reader & store);
+
+
 /*****************************************************************************/
 /* FROZEN COLUMN FORMAT                                                        */
 /*****************************************************************************/
@@ -112,6 +196,14 @@ struct FrozenColumnFormat {
     freeze(TabularDatasetColumn & column,
            const ColumnFreezeParameters & params,
            std::shared_ptr<void> cachedInfo) const = 0;
+
+    /** Reconstitute a column of this format that was previously written
+        by its serialize() method.  See FrozenColumn::reconstitute() for
+        the meaning of mapping.
+    */
+    virtual FrozenColumn *
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping) const = 0;
     
     /** Register a new column format.  Returns a handle that, once released,
         will de-register the column format.
@@ -0,0 +1,335 @@
+/** frozen_memory.cc                                               -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Allocation of the bulk storage of frozen columns from huge page regions
+    placed on NUMA nodes.
+*/
+
+#include "frozen_memory.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/memory_arenas.h"
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<bool> MLDB_FROZEN_HUGE_PAGES("MLDB_FROZEN_HUGE_PAGES", false);
+EnvOption<std::string> MLDB_FROZEN_NUMA("MLDB_FROZEN_NUMA", "");
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/// Blocks larger than this get a region of their own
+constexpr size_t MAX_SHARED_BLOCK = HUGE_PAGE_SIZE / 4;
+
+/// Alignment of the blocks within a region, a cache line
+constexpr size_t BLOCK_ALIGNMENT = 64;
+
+size_t roundUp(size_t n, size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+/** Return the number of NUMA nodes, which is one more than the highest
+    online node.
+*/
+int getNumNodes()
+{
+    std::ifstream stream("/sys/devices/system/node/online");
+    std::string ranges;
+    if (!(stream >> ranges))
+        return 1;
+
+    // Format is like "0-1,3"; the highest node comes last
+    size_t pos = ranges.find_last_of("-,");
+    std::string last = pos == std::string::npos
+        ? ranges : ranges.substr(pos + 1);
+    try {
+        return std::stoi(last) + 1;
+    } catch (const std::exception &) {
+        return 1;
+    }
+}
+
+int getCurrentNode(int numNodes)
+{
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == -1
+        || node >= (unsigned)numNodes)
+        return 0;
+    return node;
+}
+
+/// A mapping that blocks are allocated from
+struct FrozenRegion;
+
+struct FrozenMemoryManager {
+    FrozenMemoryManager()
+        : numNodes(getNumNodes()), arenas(numNodes),
+          hugeTlbAvailable(true),
+          bytesAllocated(0), bytesMapped(0), hugePageBytes(0),
+          placementFailures(0),
+          bytesPerNode(new std::atomic<uint64_t>[numNodes])
+    {
+        for (int i = 0;  i < numNodes;  ++i)
+            bytesPerNode[i] = 0;
+
+        policy.hugePages = MLDB_FROZEN_HUGE_PAGES;
+        const std::string & placement = MLDB_FROZEN_NUMA.get();
+        if (placement == "local")
+            policy.placement = FROZEN_PLACEMENT_LOCAL;
+        else if (placement == "interleave")
+            policy.placement = FROZEN_PLACEMENT_INTERLEAVE;
+        else if (!placement.empty())
+            cerr << "warning: unknown MLDB_FROZEN_NUMA placement '"
+                 << placement << "'; expected 'local' or 'interleave'"
+                 << endl;
+    }
+
+    const int numNodes;
+
+    std::mutex policyMutex;
+    FrozenMemoryPolicy policy;
+
+    /// Region that small blocks are currently allocated from, per node
+    struct Arena {
+        std::mutex mutex;
+        std::shared_ptr<FrozenRegion> current;
+        size_t used = 0;
+    };
+
+    std::vector<Arena> arenas;
+
+    /// Cleared the first time that no reserved huge pages are left
+    std::atomic<bool> hugeTlbAvailable;
+
+    std::atomic<uint64_t> bytesAllocated;
+    std::atomic<uint64_t> bytesMapped;
+    std::atomic<uint64_t> hugePageBytes;
+    std::atomic<uint64_t> placementFailures;
+    std::unique_ptr<std::atomic<uint64_t>[]> bytesPerNode;
+
+    FrozenMemoryPolicy getPolicy()
+    {
+        std::unique_lock<std::mutex> guard(policyMutex);
+        return policy;
+    }
+
+    void setPolicy(const FrozenMemoryPolicy & newPolicy)
+    {
+        std::unique_lock<std::mutex> guard(policyMutex);
+        policy = newPolicy;
+    }
+
+    std::shared_ptr<FrozenRegion>
+    mapRegion(size_t length, const FrozenMemoryPolicy & policy, int node);
+
+    std::shared_ptr<void> allocate(size_t bytes);
+};
+
+/* Never destroyed, as frozen columns may outlive any static object */
+FrozenMemoryManager & getManager()
+{
+    static FrozenMemoryManager * manager = new FrozenMemoryManager();
+    return *manager;
+}
+
+struct FrozenRegion {
+    FrozenRegion(FrozenMemoryManager & manager, char * base, size_t length,
+                 bool huge, int node)
+        : manager(manager), base(base), length(length), huge(huge),
+          node(node)
+    {
+        account(1);
+    }
+
+    ~FrozenRegion()
+    {
+        account(-1);
+        munmap(base, length);
+    }
+
+    FrozenMemoryManager & manager;
+    char * base;
+    size_t length;
+    bool huge;
+    int node;   ///< Node the region is on, or -1 if interleaved
+
+    void account(int64_t sign)
+    {
+        manager.bytesMapped += sign * length;
+        if (huge)
+            manager.hugePageBytes += sign * length;
+        if (node >= 0)
+            manager.bytesPerNode[node] += sign * length;
+        else {
+            for (int i = 0;  i < manager.numNodes;  ++i)
+                manager.bytesPerNode[i] += sign * length / manager.numNodes;
+        }
+    }
+};
+
+std::shared_ptr<FrozenRegion>
+FrozenMemoryManager::
+mapRegion(size_t length, const FrozenMemoryPolicy & policy, int node)
+{
+    char * base = nullptr;
+    bool huge = false;
+
+    if (policy.hugePages) {
+        length = roundUp(length, HUGE_PAGE_SIZE);
+        if (hugeTlbAvailable) {
+            void * addr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                               -1, 0);
+            if (addr != MAP_FAILED) {
+                base = (char *)addr;
+                huge = true;
+            }
+            else hugeTlbAvailable = false;
+        }
+        if (!base) {
+            // No reserved huge pages, so we ask for transparent ones,
+            // which need the mapping to be aligned on a huge page
+            size_t padded = length + HUGE_PAGE_SIZE;
+            void * addr = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED)
+                throw std::bad_alloc();
+            char * start = (char *)addr;
+            base = (char *)roundUp((size_t)start, HUGE_PAGE_SIZE);
+            if (base != start)
+                munmap(start, base - start);
+            if (start + padded != base + length)
+                munmap(base + length, start + padded - (base + length));
+            madvise(base, length, MADV_HUGEPAGE);
+        }
+    }
+    else {
+        length = roundUp(length, sysconf(_SC_PAGESIZE));
+        void * addr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED)
+            throw std::bad_alloc();
+        base = (char *)addr;
+    }
+
+    // The policy is set before the pages are touched, so that they are
+    // allocated where we want them
+    int regionNode = node;
+    if (policy.placement != FROZEN_PLACEMENT_DEFAULT) {
+        constexpr size_t BITS = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask((numNodes + BITS - 1) / BITS);
+        int mode;
+        if (policy.placement == FROZEN_PLACEMENT_LOCAL) {
+            mask[node / BITS] |= 1UL << (node % BITS);
+            mode = MPOL_PREFERRED;
+        }
+        else {
+            for (int i = 0;  i < numNodes;  ++i)
+                mask[i / BITS] |= 1UL << (i % BITS);
+            mode = MPOL_INTERLEAVE;
+            regionNode = -1;
+        }
+        if (syscall(SYS_mbind, base, length, mode, mask.data(),
+                    numNodes + 1, 0) == -1)
+            ++placementFailures;
+    }
+
+    return std::make_shared<FrozenRegion>(*this, base, length, huge,
+                                          regionNode);
+}
+
+std::shared_ptr<void>
+FrozenMemoryManager::
+allocate(size_t bytes)
+{
+    FrozenMemoryPolicy currentPolicy = getPolicy();
+
+    if (!currentPolicy.enabled()) {
+        // From the frozen arena if there is one, so that these long lived
+        // blocks don't fragment the memory of queries
+        void * data = arenaAllocate(MEMORY_ARENA_FROZEN, bytes);
+        return std::shared_ptr<void>
+            (data, [] (void * p) { arenaFree(MEMORY_ARENA_FROZEN, p); });
+    }
+
+    bytes = roundUp(std::max<size_t>(bytes, 1), BLOCK_ALIGNMENT);
+    // Without a placement, pages go to the node of the thread that first
+    // touches them, which is the freezing thread
+    int node = currentPolicy.placement == FROZEN_PLACEMENT_INTERLEAVE
+        ? 0 : getCurrentNode(numNodes);
+
+    std::shared_ptr<FrozenRegion> region;
+    char * data;
+
+    if (bytes > MAX_SHARED_BLOCK) {
+        region = mapRegion(bytes, currentPolicy, node);
+        data = region->base;
+    }
+    else {
+        // Small blocks share regions, which are unmapped once all of their
+        // blocks have been freed
+        Arena & arena = arenas[node];
+        std::unique_lock<std::mutex> guard(arena.mutex);
+        if (!arena.current || arena.used + bytes > arena.current->length) {
+            arena.current = mapRegion(HUGE_PAGE_SIZE, currentPolicy, node);
+            arena.used = 0;
+        }
+        region = arena.current;
+        data = region->base + arena.used;
+        arena.used += bytes;
+    }
+
+    bytesAllocated += bytes;
+    return std::shared_ptr<void>
+        (data, [this, region, bytes] (void *) { bytesAllocated -= bytes; });
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PUBLIC INTERFACE                                                          */
+/*****************************************************************************/
+
+FrozenMemoryPolicy getFrozenMemoryPolicy()
+{
+    return getManager().getPolicy();
+}
+
+void setFrozenMemoryPolicy(const FrozenMemoryPolicy & policy)
+{
+    getManager().setPolicy(policy);
+}
+
+std::shared_ptr<void> allocateFrozenBlock(size_t bytes)
+{
+    return getManager().allocate(bytes);
+}
+
+FrozenMemoryStats getFrozenMemoryStats()
+{
+    FrozenMemoryManager & manager = getManager();
+    FrozenMemoryStats result;
+    result.bytesAllocated = manager.bytesAllocated;
+    result.bytesMapped = manager.bytesMapped;
+    result.hugePageBytes = manager.hugePageBytes;
+    result.placementFailures = manager.placementFailures;
+    for (int i = 0;  i < manager.numNodes;  ++i)
+        result.bytesPerNode.push_back(manager.bytesPerNode[i]);
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,86 @@
+/** frozen_memory.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Allocation of the bulk storage of frozen columns.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* FROZEN MEMORY POLICY                                                      */
+/*****************************************************************************/
+
+/// Which NUMA node the storage of frozen columns is placed on
+enum FrozenMemoryPlacement {
+    FROZEN_PLACEMENT_DEFAULT,    ///< Wherever the kernel's policy puts it
+    FROZEN_PLACEMENT_LOCAL,      ///< On the node of the freezing thread
+    FROZEN_PLACEMENT_INTERLEAVE  ///< Interleaved over all nodes
+};
+
+/** Controls how the storage of frozen columns is allocated.  The defaults
+    come from the MLDB_FROZEN_HUGE_PAGES and MLDB_FROZEN_NUMA environment
+    variables (the latter is one of "local" or "interleave").  When
+    neither is set, storage is allocated from the heap as usual.
+*/
+struct FrozenMemoryPolicy {
+    /** Allocate storage in 2MB regions, backed by huge pages if any are
+        reserved and by transparent huge pages otherwise.
+    */
+    bool hugePages = false;
+
+    FrozenMemoryPlacement placement = FROZEN_PLACEMENT_DEFAULT;
+
+    bool enabled() const
+    {
+        return hugePages || placement != FROZEN_PLACEMENT_DEFAULT;
+    }
+};
+
+FrozenMemoryPolicy getFrozenMemoryPolicy();
+
+/// Change the policy for storage that's allocated from now on
+void setFrozenMemoryPolicy(const FrozenMemoryPolicy & policy);
+
+
+/*****************************************************************************/
+/* FROZEN MEMORY ALLOCATION                                                  */
+/*****************************************************************************/
+
+/** Allocate a block of (uninitialized) storage for a frozen column,
+    aligned to at least 8 bytes, according to the current policy.  The
+    block is freed when the last reference to it is released.
+*/
+std::shared_ptr<void> allocateFrozenBlock(size_t bytes);
+
+template<typename T>
+std::shared_ptr<T> allocateFrozenArray(size_t numEntries)
+{
+    return std::static_pointer_cast<T>
+        (allocateFrozenBlock(numEntries * sizeof(T)));
+}
+
+/// Statistics about the storage allocated under a non-default policy
+struct FrozenMemoryStats {
+    uint64_t bytesAllocated = 0;   ///< Live blocks allocated from regions
+    uint64_t bytesMapped = 0;      ///< Memory mapped for the regions
+    uint64_t hugePageBytes = 0;    ///< Part of it backed by reserved huge pages
+    uint64_t placementFailures = 0;///< Regions the kernel wouldn't place
+
+    /** Memory mapped for the regions placed on each node.  Interleaved
+        regions are counted under all nodes, in equal shares.
+    */
+    std::vector<uint64_t> bytesPerNode;
+};
+
+FrozenMemoryStats getFrozenMemoryStats();
+
+} // namespace MLDB
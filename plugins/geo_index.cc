@@ -0,0 +1,546 @@
+/** geo_index.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Spatial index over the latitude and longitude columns of a dataset.
+*/
+
+#include "geo_index.h"
+#include "mldb/sql/builtin_functions.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/ext/s2/s2.h"
+#include "mldb/ext/s2/s2cap.h"
+#include "mldb/ext/s2/s2cellid.h"
+#include "mldb/ext/s2/s2latlng.h"
+#include "mldb/ext/s2/s2regioncoverer.h"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* GEO INDEX DATASET CONFIG                                                  */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(GeoIndexDatasetConfig);
+
+GeoIndexDatasetConfigDescription::
+GeoIndexDatasetConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("dataset", &GeoIndexDatasetConfig::dataset,
+             "Dataset whose rows are indexed");
+    addField("latitude", &GeoIndexDatasetConfig::latitude,
+             "Column holding the latitude of each row, in degrees",
+             ColumnPath(PathElement("lat")));
+    addField("longitude", &GeoIndexDatasetConfig::longitude,
+             "Column holding the longitude of each row, in degrees",
+             ColumnPath(PathElement("lon")));
+    addField("maxCells", &GeoIndexDatasetConfig::maxCells,
+             "Maximum number of cells of the index looked at for each "
+             "query.  More cells fit the area that is searched more "
+             "tightly, so fewer rows need their distance calculated, at "
+             "the cost of more lookups.",
+             16);
+}
+
+static RegisterDatasetType<GeoIndexDataset, GeoIndexDatasetConfig>
+regGeoIndex(builtinPackage(),
+            "geo.index",
+            "Spatial index over the latitude and longitude columns of "
+            "a dataset",
+            "datasets/GeoIndexDataset.md.html");
+
+
+/*****************************************************************************/
+/* GEO INDEX DATASET                                                         */
+/*****************************************************************************/
+
+struct GeoIndexDataset::Itl {
+
+    /// Point of a row of the dataset
+    struct Entry {
+        uint64_t cell;   ///< Id of the leaf S2 cell holding the point
+        double lat;
+        double lon;
+        RowPath row;
+    };
+
+    /// Points of the rows of the dataset, in order of cell
+    struct Index {
+        uint64_t generation;
+        std::vector<Entry> entries;
+    };
+
+    Itl(std::shared_ptr<Dataset> source, const GeoIndexDatasetConfig & config)
+        : source(std::move(source)), config(config)
+    {
+    }
+
+    /** Return the index, building it if the dataset has changed since it
+        was last built.
+    */
+    std::shared_ptr<const Index> getIndex() const
+    {
+        // Read before building, so that changes made while building cause
+        // it to be rebuilt on the next call
+        uint64_t generation = source->getGeneration();
+
+        std::unique_lock<std::mutex> guard(mutex);
+        if (!index || index->generation != generation)
+            index = build(generation);
+        return index;
+    }
+
+    std::shared_ptr<const Index> build(uint64_t generation) const
+    {
+        auto result = std::make_shared<Index>();
+        result->generation = generation;
+
+        auto columns = source->getColumnIndex();
+        if (!columns->knownColumn(config.latitude)
+            || !columns->knownColumn(config.longitude))
+            return result;
+
+        // As in the where clause, the latest value of each column is used
+        struct Point {
+            RowPath row;
+            CellValue lat, lon;
+            Date latTs = Date::negativeInfinity();
+            Date lonTs = Date::negativeInfinity();
+        };
+
+        std::unordered_map<RowHash, Point> points;
+
+        columns->forEachColumnValue
+            (config.latitude,
+             [&] (const RowPath & row, const CellValue & value, Date ts)
+             {
+                 Point & point = points[row];
+                 if (point.row.empty())
+                     point.row = row;
+                 if (ts >= point.latTs) {
+                     point.lat = value;
+                     point.latTs = ts;
+                 }
+                 return true;
+             });
+
+        columns->forEachColumnValue
+            (config.longitude,
+             [&] (const RowPath & row, const CellValue & value, Date ts)
+             {
+                 auto it = points.find(row);
+                 if (it != points.end() && ts >= it->second.lonTs) {
+                     it->second.lon = value;
+                     it->second.lonTs = ts;
+                 }
+                 return true;
+             });
+
+        // Rows without a number for both never match geo_distance() < x
+        for (auto & p: points) {
+            const Point & point = p.second;
+            if (!point.lat.isNumber() || !point.lon.isNumber())
+                continue;
+
+            Entry entry;
+            entry.lat = point.lat.toDouble();
+            entry.lon = point.lon.toDouble();
+            entry.cell = S2CellId::FromLatLng
+                (S2LatLng::FromDegrees(entry.lat, entry.lon).Normalized()).id();
+            entry.row = point.row;
+            result->entries.emplace_back(std::move(entry));
+        }
+
+        std::sort(result->entries.begin(), result->entries.end(),
+                  [] (const Entry & e1, const Entry & e2)
+                  {
+                      return e1.cell < e2.cell
+                          || (e1.cell == e2.cell
+                              && RowHash(e1.row) < RowHash(e2.row));
+                  });
+
+        return result;
+    }
+
+    /** Call onEntry with each point of the index within the distance of
+        (lat, lon), and with its distance.  Some points a little further
+        away may also be passed, so the caller needs to check the distance.
+    */
+    template<typename Fn>
+    void forEachWithin(const Index & index, double lat, double lon,
+                       double distance, Fn && onEntry) const
+    {
+        if (!(distance >= 0))
+            return;
+
+        // The cap is made a little bigger than the distance so that no
+        // point at exactly the distance is left out by rounding
+        double angle = distance / Builtins::EARTH_MEAN_RADIUS_METERS
+            * (1 + 1e-9) + 1e-12;
+
+        std::vector<std::pair<uint64_t, uint64_t> > ranges;
+        if (angle >= M_PI) {
+            ranges.emplace_back(0, std::numeric_limits<uint64_t>::max());
+        }
+        else {
+            S2Point center
+                = S2LatLng::FromDegrees(lat, lon).Normalized().ToPoint();
+            S2Cap cap = S2Cap::FromAxisAngle(center, S1Angle::Radians(angle));
+
+            S2RegionCoverer coverer;
+            coverer.set_max_cells(config.maxCells);
+            std::vector<S2CellId> covering;
+            coverer.GetCovering(cap, &covering);
+
+            for (auto & cell: covering)
+                ranges.emplace_back(cell.range_min().id(),
+                                    cell.range_max().id());
+        }
+
+        // The cells of a covering don't overlap, so each point is only
+        // passed once
+        for (auto & range: ranges) {
+            auto it = std::lower_bound
+                (index.entries.begin(), index.entries.end(), range.first,
+                 [] (const Entry & entry, uint64_t cell)
+                 {
+                     return entry.cell < cell;
+                 });
+
+            for (; it != index.entries.end() && it->cell <= range.second;
+                 ++it) {
+                onEntry(*it, Builtins::geoDistance(it->lat, it->lon, lat, lon));
+            }
+        }
+    }
+
+    std::vector<std::pair<RowPath, double> >
+    getNeighbors(double lat, double lon, int numNeighbors,
+                 double maxDistance) const
+    {
+        auto index = getIndex();
+        size_t n = index->entries.size();
+        if (numNeighbors <= 0 || n == 0 || !(maxDistance >= 0))
+            return {};
+
+        // Start with a cap that would hold twice as many points as needed
+        // if they were spread evenly, and grow it until it holds enough
+        double radius = Builtins::EARTH_MEAN_RADIUS_METERS
+            * std::acos(std::max(-1.0, 1.0 - 4.0 * numNeighbors / n));
+        double fullRadius = M_PI * Builtins::EARTH_MEAN_RADIUS_METERS;
+
+        std::vector<std::pair<double, const Entry *> > found;
+        for (;;) {
+            double searchRadius = std::min(radius, maxDistance);
+
+            found.clear();
+            forEachWithin(*index, lat, lon, searchRadius,
+                          [&] (const Entry & entry, double distance)
+                          {
+                              if (distance <= searchRadius)
+                                  found.emplace_back(distance, &entry);
+                          });
+
+            // Any point outside of the cap is further than those in it
+            if (found.size() >= numNeighbors || searchRadius == maxDistance
+                || radius >= fullRadius)
+                break;
+            radius *= 4;
+        }
+
+        std::sort(found.begin(), found.end(),
+                  [] (const std::pair<double, const Entry *> & p1,
+                      const std::pair<double, const Entry *> & p2)
+                  {
+                      return p1.first < p2.first
+                          || (p1.first == p2.first
+                              && RowHash(p1.second->row)
+                                 < RowHash(p2.second->row));
+                  });
+        if (found.size() > numNeighbors)
+            found.resize(numNeighbors);
+
+        std::vector<std::pair<RowPath, double> > result;
+        result.reserve(found.size());
+        for (auto & f: found)
+            result.emplace_back(f.second->row, f.first);
+        return result;
+    }
+
+    Any getStatus() const
+    {
+        Json::Value result;
+        std::unique_lock<std::mutex> guard(mutex);
+        result["indexed"] = !!index;
+        if (index) {
+            result["rowCount"] = (Json::UInt)index->entries.size();
+            result["generation"] = (Json::UInt)index->generation;
+        }
+        return result;
+    }
+
+    std::shared_ptr<Dataset> source;
+    GeoIndexDatasetConfig config;
+
+    /// Protects the index, which is replaced when the dataset changes
+    mutable std::mutex mutex;
+    mutable std::shared_ptr<const Index> index;
+};
+
+GeoIndexDataset::
+GeoIndexDataset(MldbServer * owner,
+                PolyConfig config,
+                const std::function<bool (const Json::Value &)> & onProgress)
+    : ForwardedDataset(owner)
+{
+    datasetConfig = config.params.convert<GeoIndexDatasetConfig>();
+    if (datasetConfig.maxCells < 1)
+        throw HttpReturnException(400, "maxCells of a geo.index dataset "
+                                  "must be at least 1",
+                                  "maxCells", datasetConfig.maxCells);
+
+    std::shared_ptr<Dataset> dataset
+        = obtainDataset(owner, datasetConfig.dataset, onProgress);
+    setUnderlying(dataset);
+
+    itl.reset(new Itl(dataset, datasetConfig));
+}
+
+GeoIndexDataset::
+~GeoIndexDataset()
+{
+}
+
+Any
+GeoIndexDataset::
+getStatus() const
+{
+    return itl->getStatus();
+}
+
+GenerateRowsWhereFunction
+GeoIndexDataset::
+generateRowsWhere(const SqlBindingScope & context,
+                  const Utf8String& alias,
+                  const SqlExpression & where,
+                  ssize_t offset,
+                  ssize_t limit) const
+{
+    // The where clause is analyzed here rather than by the underlying
+    // dataset, so that the parts on geo_distance() can use the index.
+    // Column predicates are still answered by the underlying dataset.
+    GenerateRowsWhereFunction generator
+        = Dataset::generateRowsWhere(context, alias, where, offset, limit);
+    if (generator.complexity < GenerateRowsWhereFunction::TABLESCAN)
+        return generator;
+
+    return ForwardedDataset::generateRowsWhere(context, alias, where,
+                                               offset, limit);
+}
+
+GenerateRowsWhereFunction
+GeoIndexDataset::
+generateRowsWithinDistance(const GeoDistancePredicate & predicate) const
+{
+    if (predicate.latitudeColumn != datasetConfig.latitude
+        || predicate.longitudeColumn != datasetConfig.longitude)
+        return ForwardedDataset::generateRowsWithinDistance(predicate);
+
+    auto itl = this->itl;
+
+    return {[=] (ssize_t numToGenerate, Any token,
+                 const BoundParameters & params,
+                 std::function<bool (const Json::Value &)> onProgress)
+            -> std::pair<std::vector<RowPath>, Any>
+            {
+                auto index = itl->getIndex();
+
+                std::vector<RowPath> rows;
+                itl->forEachWithin(*index, predicate.lat, predicate.lon,
+                                   predicate.distance,
+                                   [&] (const Itl::Entry & entry,
+                                        double distance)
+                                   {
+                                       if (predicate.matches(distance))
+                                           rows.push_back(entry.row);
+                                   });
+
+                return { std::move(rows), Any() };
+            },
+            "generate rows where " + predicate.print() + " using the geo index",
+            GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN};
+}
+
+std::vector<std::pair<RowPath, double> >
+GeoIndexDataset::
+getNeighbors(double lat, double lon, int numNeighbors,
+             double maxDistance) const
+{
+    return itl->getNeighbors(lat, lon, numNeighbors, maxDistance);
+}
+
+
+/*****************************************************************************/
+/* GEO NEIGHBORS FUNCTION                                                    */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(GeoNeighborsFunctionConfig);
+
+GeoNeighborsFunctionConfigDescription::
+GeoNeighborsFunctionConfigDescription()
+{
+    addField("defaultNumNeighbors",
+             &GeoNeighborsFunctionConfig::defaultNumNeighbors,
+             "Default number of neighbors to return. This can be overridden "
+             "when calling the function.", unsigned(10));
+    addField("defaultMaxDistance",
+             &GeoNeighborsFunctionConfig::defaultMaxDistance,
+             "Default maximum distance of the neighbors, in meters. This "
+             "can be overridden when calling the function.",
+             double(INFINITY));
+    addField("dataset", &GeoNeighborsFunctionConfig::dataset,
+             "Dataset in which to find neighbors.  This must be a "
+             "dataset of type `geo.index`.");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(GeoNeighborsInput);
+
+GeoNeighborsInputDescription::
+GeoNeighborsInputDescription()
+{
+    addField("lat", &GeoNeighborsInput::lat,
+             "Latitude of the point whose neighbors are sought, in degrees");
+    addField("lon", &GeoNeighborsInput::lon,
+             "Longitude of the point whose neighbors are sought, in degrees");
+    addField("numNeighbors", &GeoNeighborsInput::numNeighbors,
+             "Number of neighbors to find.  Passing null will use the "
+             "value in the config", CellValue());
+    addField("maxDistance", &GeoNeighborsInput::maxDistance,
+             "Maximum distance to accept, in meters.  Passing null will use "
+             "the value in the config", CellValue());
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(GeoNeighborsOutput);
+
+GeoNeighborsOutputDescription::
+GeoNeighborsOutputDescription()
+{
+    addField("neighbors", &GeoNeighborsOutput::neighbors,
+             "Row containing the row names of the nearest neighbors in "
+             "order of distance");
+    addField("distances", &GeoNeighborsOutput::distances,
+             "Row containing the nearest neighbors, each with its distance "
+             "in meters");
+}
+
+GeoNeighborsFunction::
+GeoNeighborsFunction(MldbServer * owner,
+                     PolyConfig config,
+                     const std::function<bool (const Json::Value &)> & onProgress)
+    : BaseT(owner)
+{
+    functionConfig = config.params.convert<GeoNeighborsFunctionConfig>();
+}
+
+GeoNeighborsFunction::
+~GeoNeighborsFunction()
+{
+}
+
+struct GeoNeighborsFunctionApplier
+    : public FunctionApplierT<GeoNeighborsInput, GeoNeighborsOutput> {
+
+    GeoNeighborsFunctionApplier(const Function * owner)
+        : FunctionApplierT<GeoNeighborsInput, GeoNeighborsOutput>(owner)
+    {
+        info = owner->getFunctionInfo();
+    }
+
+    std::shared_ptr<GeoIndexDataset> geoIndexDataset;
+};
+
+GeoNeighborsOutput
+GeoNeighborsFunction::
+applyT(const ApplierT & applier_, GeoNeighborsInput input) const
+{
+    auto & applier = static_cast<const GeoNeighborsFunctionApplier &>(applier_);
+
+    int numNeighbors = functionConfig.defaultNumNeighbors;
+    double maxDistance = functionConfig.defaultMaxDistance;
+
+    if (!input.numNeighbors.empty())
+        numNeighbors = input.numNeighbors.toInt();
+
+    if (!input.maxDistance.empty())
+        maxDistance = input.maxDistance.toDouble();
+
+    Date ts;
+    std::vector<std::pair<RowPath, double> > neighbors;
+
+    // A point without coordinates has no neighbors
+    if (!input.lat.empty() && !input.lon.empty()) {
+        neighbors = applier.geoIndexDataset
+            ->getNeighbors(input.lat.toDouble(), input.lon.toDouble(),
+                           numNeighbors, maxDistance);
+    }
+
+    std::vector<CellValue> neighborsOut;
+    RowValue distances;
+
+    distances.reserve(neighbors.size());
+    neighborsOut.reserve(neighbors.size());
+    for (auto & neighbor: neighbors) {
+        distances.emplace_back(neighbor.first, neighbor.second, ts);
+        neighborsOut.emplace_back(std::move(neighbor.first));
+    }
+
+    return {ExpressionValue(std::move(neighborsOut), ts),
+            ExpressionValue(std::move(distances))};
+}
+
+std::unique_ptr<FunctionApplierT<GeoNeighborsInput, GeoNeighborsOutput> >
+GeoNeighborsFunction::
+bindT(SqlBindingScope & outerContext,
+      const std::vector<std::shared_ptr<ExpressionValueInfo> > & input) const
+{
+    std::unique_ptr<GeoNeighborsFunctionApplier> result
+        (new GeoNeighborsFunctionApplier(this));
+
+    if (!functionConfig.dataset)
+        throw HttpReturnException
+            (400, "A dataset of type geo.index needs to be provided for "
+             "the geo.neighbors function");
+
+    auto boundDataset = functionConfig.dataset->bind(outerContext);
+
+    result->geoIndexDataset
+        = dynamic_pointer_cast<GeoIndexDataset>(boundDataset.dataset);
+    if (!result->geoIndexDataset) {
+        throw HttpReturnException
+            (400, "A dataset of type geo.index needs to be provided for "
+             "the geo.neighbors function; the provided dataset '"
+             + functionConfig.dataset->surface + "' is not one");
+    }
+
+    return std::move(result);
+}
+
+static RegisterFunctionType<GeoNeighborsFunction, GeoNeighborsFunctionConfig>
+regGeoNeighborsFunction(builtinPackage(),
+                        "geo.neighbors",
+                        "Return the rows of a geo.index dataset nearest to "
+                        "a point",
+                        "functions/GeoNeighborsFunction.md.html");
+
+} // namespace MLDB
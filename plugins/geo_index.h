@@ -0,0 +1,141 @@
+/** geo_index.h                                                    -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Spatial index over the latitude and longitude columns of a dataset,
+    used for queries on geo_distance() and nearest neighbors queries.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/core/value_function.h"
+#include "mldb/server/forwarded_dataset.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* GEO INDEX DATASET CONFIG                                                  */
+/*****************************************************************************/
+
+struct GeoIndexDatasetConfig {
+    GeoIndexDatasetConfig()
+        : latitude(PathElement("lat")), longitude(PathElement("lon")),
+          maxCells(16)
+    {
+    }
+
+    PolyConfigT<const Dataset> dataset;
+    ColumnPath latitude;
+    ColumnPath longitude;
+    int maxCells;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(GeoIndexDatasetConfig);
+
+
+/*****************************************************************************/
+/* GEO INDEX DATASET                                                         */
+/*****************************************************************************/
+
+/** Dataset with the same rows as another one, which indexes the point
+    given by two of its columns.  Where clauses (or parts of an AND) of the
+    form geo_distance(lat, lon, constant, constant) < constant only look at
+    the rows of the cells around the point, as do nearest neighbors
+    queries.
+
+    The index is built the first time that it's needed, and rebuilt when
+    the generation of the dataset changes.
+*/
+
+struct GeoIndexDataset: public ForwardedDataset {
+
+    GeoIndexDataset(MldbServer * owner,
+                    PolyConfig config,
+                    const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual ~GeoIndexDataset() override;
+
+    virtual Any getStatus() const override;
+
+    virtual GenerateRowsWhereFunction
+    generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String& alias,
+                      const SqlExpression & where,
+                      ssize_t offset,
+                      ssize_t limit) const override;
+
+    virtual GenerateRowsWhereFunction
+    generateRowsWithinDistance(const GeoDistancePredicate & predicate) const override;
+
+    /** Return the numNeighbors rows nearest to the point, with their
+        distance in meters, ignoring those further than maxDistance.  They
+        are in order of distance.
+    */
+    std::vector<std::pair<RowPath, double> >
+    getNeighbors(double lat, double lon, int numNeighbors,
+                 double maxDistance) const;
+
+private:
+    GeoIndexDatasetConfig datasetConfig;
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+
+/*****************************************************************************/
+/* GEO NEIGHBORS FUNCTION                                                    */
+/*****************************************************************************/
+
+struct GeoNeighborsFunctionConfig {
+    GeoNeighborsFunctionConfig()
+        : defaultNumNeighbors(10), defaultMaxDistance(INFINITY)
+    {
+    }
+
+    unsigned defaultNumNeighbors;
+    double defaultMaxDistance;
+    std::shared_ptr<TableExpression> dataset;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(GeoNeighborsFunctionConfig);
+
+struct GeoNeighborsInput {
+    CellValue lat;
+    CellValue lon;
+    CellValue numNeighbors; // positive integer or null
+    CellValue maxDistance;  // double or null
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(GeoNeighborsInput);
+
+struct GeoNeighborsOutput {
+    ExpressionValue neighbors;
+    ExpressionValue distances;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(GeoNeighborsOutput);
+
+struct GeoNeighborsFunction
+    : public ValueFunctionT<GeoNeighborsInput, GeoNeighborsOutput> {
+
+    GeoNeighborsFunction(MldbServer * owner,
+                         PolyConfig config,
+                         const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual ~GeoNeighborsFunction();
+
+    virtual GeoNeighborsOutput
+    applyT(const ApplierT & applier, GeoNeighborsInput input) const override;
+
+    virtual std::unique_ptr<ApplierT>
+    bindT(SqlBindingScope & outerContext,
+          const std::vector<std::shared_ptr<ExpressionValueInfo> > & input)
+        const override;
+
+    GeoNeighborsFunctionConfig functionConfig;
+};
+
+} // namespace MLDB
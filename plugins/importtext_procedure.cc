@@ -6,6 +6,7 @@
 */
 
 #include "importtext_procedure.h"
+#include "mldb/arch/arch.h"
 #include "mldb/arch/timers.h"
 #include "mldb/jml/utils/csv.h"
 #include "mldb/jml/utils/lightweight_hash.h"
@@ -17,12 +18,18 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/types/map_description.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
+#include "mldb/vfs/compressor.h"
+#include "mldb/core/run_progress.h"
 #include "mldb/plugins/progress.h"
 #include "mldb/jml/utils/vector_utils.h"
 #include "mldb/utils/log.h"
+#if MLDB_INTEL_ISA
+# include <emmintrin.h>
+#endif
 
 
 using namespace std;
@@ -30,12 +37,28 @@ using namespace std;
 
 namespace MLDB {
 
+DEFINE_ENUM_DESCRIPTION(ImportTextColumnType);
+
+ImportTextColumnTypeDescription::
+ImportTextColumnTypeDescription()
+{
+    addValue("auto", ITC_AUTO, "Infer the type of each value from its text");
+    addValue("string", ITC_STRING, "Values are always strings, even if they "
+             "look like numbers");
+    addValue("integer", ITC_INTEGER, "Values are signed 64 bit integers");
+    addValue("number", ITC_NUMBER, "Values are floating point numbers");
+    addValue("timestamp", ITC_TIMESTAMP, "Values are ISO 8601 timestamps");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(ImportTextConfig);
 
 ImportTextConfigDescription::ImportTextConfigDescription()
 {
     addField("dataFileUrl", &ImportTextConfig::dataFileUrl,
-             "URL of the text data to import");
+             "URL of the text data to import.  It may contain the wildcards "
+             "'*', '?' and '[...]' in its path, in which case all matching "
+             "files are imported into the dataset.  They must all have the "
+             "same header.");
     addField("outputDataset", &ImportTextConfig::outputDataset,
              "Dataset to record the data into.",
              PolyConfigT<Dataset>().withType("tabular"));
@@ -92,6 +115,18 @@ ImportTextConfigDescription::ImportTextConfigDescription()
              "If true, the indexes of the columns will be used to name them."
              "This cannot be set to true if headers is defined.",
              false);
+    addField("columnTypes", &ImportTextConfig::columnTypes,
+             "Declared type of some or all of the input columns, keyed by "
+             "column name.  Values of a declared column are converted "
+             "directly to that type rather than having their type inferred, "
+             "and a value that can't be converted is a bad line.  Values "
+             "are 'auto' (the default), 'string', 'integer', 'number' or "
+             "'timestamp'.");
+    addField("maxConcurrentFiles", &ImportTextConfig::maxConcurrentFiles,
+             "When dataFileUrl matches several files, the number of them "
+             "that are opened and read at the same time, so that the "
+             "latency of opening one file is hidden behind the parsing "
+             "of others.", 8);
 
     addParent<ProcedureConfig>();
     onUnknownField = [] (ImportTextConfig * config,
@@ -139,8 +174,9 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
 
     struct RowScope: public SqlRowScope {
         RowScope(const CellValue * row, Date ts, int64_t lineNumber,
-                 int64_t lineOffset)
-            : row(row), ts(ts), lineNumber(lineNumber), lineOffset(lineOffset)
+                 int64_t lineOffset, const Utf8String * dataFileUrl)
+            : row(row), ts(ts), lineNumber(lineNumber), lineOffset(lineOffset),
+              dataFileUrl(dataFileUrl)
         {
         }
 
@@ -149,6 +185,7 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
         int64_t lineNumber;
         int64_t lineOffset;
         const RowPath * rowName;
+        const Utf8String * dataFileUrl;  ///< File the row is from, if not the scope's
     };
 
     SqlCsvScope(MldbServer * server,
@@ -271,7 +308,7 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
                          const SqlRowScope & scope)
                     {
                         auto & row = scope.as<RowScope>();
-                        return ExpressionValue(row.lineNumber, fileTimestamp);
+                        return ExpressionValue(row.lineNumber, row.ts);
                     },
                     std::make_shared<IntegerValueInfo>()
                 };
@@ -285,7 +322,7 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
                         if(!row.rowName) {
                             throw MLDB::Exception("rowHash() not available in this scope");
                         }
-                        return ExpressionValue(row.rowName->hash(), fileTimestamp);
+                        return ExpressionValue(row.rowName->hash(), row.ts);
                     },
                     std::make_shared<IntegerValueInfo>()
                 };
@@ -294,7 +331,8 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
             return {[=] (const std::vector<ExpressionValue> & args,
                          const SqlRowScope & scope)
                     {
-                        return ExpressionValue(fileTimestamp, fileTimestamp);
+                        auto & row = scope.as<RowScope>();
+                        return ExpressionValue(row.ts, row.ts);
                     },
                     std::make_shared<TimestampValueInfo>()
                 };
@@ -303,7 +341,10 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
             return {[=] (const std::vector<ExpressionValue> & args,
                          const SqlRowScope & scope)
                     {
-                        return ExpressionValue(dataFileUrl, fileTimestamp);
+                        auto & row = scope.as<RowScope>();
+                        return ExpressionValue(row.dataFileUrl
+                                               ? *row.dataFileUrl : dataFileUrl,
+                                               row.ts);
                     },
                     std::make_shared<Utf8StringValueInfo>()
                 };
@@ -313,7 +354,7 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
                          const SqlRowScope & scope)
                     {
                         auto & row = scope.as<RowScope>();
-                        return ExpressionValue(row.lineOffset, fileTimestamp);
+                        return ExpressionValue(row.lineOffset, row.ts);
                     },
                     std::make_shared<IntegerValueInfo>()
                 };
@@ -323,9 +364,10 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
     }
 
     static RowScope bindRow(const CellValue * row, Date ts,
-                            int64_t lineNumber, int64_t lineOffset)
+                            int64_t lineNumber, int64_t lineOffset,
+                            const Utf8String * dataFileUrl = nullptr)
     {
-        return RowScope(row, ts, lineNumber, lineOffset);
+        return RowScope(row, ts, lineNumber, lineOffset, dataFileUrl);
     }
 };
 
@@ -393,6 +435,111 @@ MLDB_ALWAYS_INLINE bool isascii(int c)
     return (c & (~127)) == 0;
 }
 
+/** Return a pointer to the first occurrence of c in [p, end), or end if
+    there is none.  eightBit is set if any character before the returned
+    position is not ASCII.
+
+    Fields are scanned 16 bytes at a time using SSE2, so that long text
+    fields don't pay a few branches per character.
+*/
+MLDB_ALWAYS_INLINE const char *
+findFieldEnd(const char * p, const char * end, char c, bool & eightBit)
+{
+#if MLDB_INTEL_ISA
+    const __m128i cccc = _mm_set1_epi8(c);
+    for (; p + 16 <= end;  p += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *)p);
+        unsigned matches = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, cccc));
+        // The high bit of each byte is its non-ASCII flag
+        unsigned highBits = _mm_movemask_epi8(chars);
+        if (matches) {
+            int n = __builtin_ctz(matches);
+            eightBit = eightBit || (highBits & ((1U << n) - 1)) != 0;
+            return p + n;
+        }
+        eightBit = eightBit || highBits != 0;
+    }
+#endif
+
+    for (; p < end;  ++p) {
+        if (*p == c)
+            return p;
+        if (!isascii(*p))
+            eightBit = true;
+    }
+    return end;
+}
+
+/** Return true if any character in [p, end) is not ASCII. */
+MLDB_ALWAYS_INLINE bool
+hasNonAscii(const char * p, const char * end)
+{
+#if MLDB_INTEL_ISA
+    for (; p + 16 <= end;  p += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *)p);
+        if (_mm_movemask_epi8(chars))
+            return true;
+    }
+#endif
+
+    for (; p < end;  ++p) {
+        if (!isascii(*p))
+            return true;
+    }
+    return false;
+}
+
+/** Convert the text of a field of a column with a declared numeric or
+    timestamp type.  Returns an error message, or null on success.
+*/
+const char *
+parseTypedField(const char * start, size_t len, ImportTextColumnType type,
+                CellValue & result)
+{
+    // strtoll and strtod need a null terminated string
+    static constexpr size_t MAX_NUMBER_LEN = 64;
+
+    switch (type) {
+    case ITC_INTEGER: {
+        if (len >= MAX_NUMBER_LEN)
+            return "integer value is too long";
+        char buf[MAX_NUMBER_LEN];
+        std::copy(start, start + len, buf);
+        buf[len] = 0;
+        char * end;
+        errno = 0;
+        long long val = strtoll(buf, &end, 10);
+        if (end != buf + len || errno == ERANGE)
+            return "value in integer column is not an integer";
+        result = (int64_t)val;
+        return nullptr;
+    }
+    case ITC_NUMBER: {
+        if (len >= MAX_NUMBER_LEN)
+            return "numeric value is too long";
+        char buf[MAX_NUMBER_LEN];
+        std::copy(start, start + len, buf);
+        buf[len] = 0;
+        char * end;
+        double val = strtod(buf, &end);
+        if (end != buf + len)
+            return "value in number column is not a number";
+        result = val;
+        return nullptr;
+    }
+    case ITC_TIMESTAMP: {
+        Date val = Date::parseIso8601DateTime(start, len);
+        if (!val.isADate())
+            return "value in timestamp column is not a timestamp";
+        result = val;
+        return nullptr;
+    }
+    default:
+        ExcAssert(false);
+        return nullptr;
+    }
+}
+
 /** Parse a single row of CSV into an array of CellValues.
 
     Carefully designed to not perform any memory allocations in the
@@ -418,6 +565,8 @@ MLDB_ALWAYS_INLINE bool isascii(int c)
     Otherwise, it's the ASCII code point to put in place of them.
     - isTextLine: optimization to ignore separator and quote chars and get a single column per line
     - hasQuoteChar: should we use the quote char
+    - columnTypes: declared type of each column, or null if all types are
+    inferred
 */
 
 const char *
@@ -431,6 +580,7 @@ parseFixedWidthCsvRow(const char * & line,
                       int replaceInvalidCharactersWith,
                       bool isTextLine,
                       bool hasQuoteChar,
+                      const ImportTextColumnType * columnTypes,
                       shared_ptr<spdlog::logger> & logger)
 {
     ExcAssert(!(hasQuoteChar && isTextLine));
@@ -447,7 +597,7 @@ parseFixedWidthCsvRow(const char * & line,
     size_t colNum = 0;
 
     auto finishString = [encoding,replaceInvalidCharactersWith,&logger]
-        (const char * start, size_t len, bool eightBit)
+        (const char * start, size_t len, bool eightBit, bool inferType)
         {
             TRACE_MSG(logger)
                  << "finishing string " << string(start, len)
@@ -461,6 +611,8 @@ parseFixedWidthCsvRow(const char * & line,
                     ExcAssert(replaceInvalidCharactersWith < 256);
                     start = findInvalidAscii(start, len, buf, (char)replaceInvalidCharactersWith);
                 }
+                if (!inferType)
+                    return CellValue(start, len, STRING_IS_VALID_ASCII);
                 return CellValue::parse(start, len, STRING_IS_VALID_ASCII);
             }
 
@@ -497,6 +649,26 @@ parseFixedWidthCsvRow(const char * & line,
             }
         };
 
+    // Turn the text of the current field into its value, according to the
+    // column's declared type
+    auto finishField = [&] (const char * start, size_t len, bool eightBit)
+        -> const char *
+        {
+            ImportTextColumnType type
+                = columnTypes ? columnTypes[colNum] : ITC_AUTO;
+            if (type == ITC_AUTO || type == ITC_STRING) {
+                values[colNum++]
+                    = finishString(start, len, eightBit, type == ITC_AUTO);
+                return nullptr;
+            }
+            if (eightBit)
+                return "non-ASCII character in typed column";
+            const char * error
+                = parseTypedField(start, len, type, values[colNum]);
+            ++colNum;
+            return error;
+        };
+
     while (colNum < numColumns) {
 
         ExcAssert(line <= lineEnd);
@@ -531,48 +703,62 @@ parseFixedWidthCsvRow(const char * & line,
             bool eightBit = false;
             bool ok = false;
 
-            auto pushChar = [&] (char c)
+            // Append the (already checked for eight bit characters) range
+            // to the extracted string
+            auto pushChars = [&] (const char * first, size_t n)
                 {
-                    if (len == buflen) {
-                        std::unique_ptr<char[]> newBuf(new char[buflen * 2]);
+                    if (len + n > buflen) {
+                        size_t newLen = buflen * 2;
+                        while (len + n > newLen)
+                            newLen *= 2;
+                        std::unique_ptr<char[]> newBuf(new char[newLen]);
                         std::copy(s, s + len, newBuf.get());
                         sdynamic.swap(newBuf);
                         s = sdynamic.get();
-                        buflen *= 2;
+                        buflen = newLen;
                     }
 
+                    ExcAssertLessEqual(len + n, buflen);
+                    std::copy(first, first + n, s + len);
+                    len += n;
+                };
 
-                    ExcAssertLess(len, buflen);
+            auto pushChar = [&] (char c)
+                {
                     eightBit = eightBit || !isascii(c);
-                    s[len++] = c;
+                    pushChars(&c, 1);
                 };
 
-            for (; line < lineEnd;  ++line) {
-                c = *line;
-                if (c == quote) {
+            while (line < lineEnd) {
+                // Copy everything up to the next quote in one go
+                const char * next
+                    = findFieldEnd(line, lineEnd, quote, eightBit);
+                pushChars(line, next - line);
+                line = next;
+                if (line == lineEnd)
+                    break;
+
+                // We're on a quote
+                ++line;
+                if (line >= lineEnd) {
+                    ok = true;
+                    break;
+                }
+                else if (*line == separator) {
+                    ok = true;
                     ++line;
-                    if (line >= lineEnd) {
-                        ok = true;
-                        break;
-                    }
-                    else if (*line == separator) {
-                        ok = true;
-                        ++line;
-                        break;
-                    }
-                    else if (*line == quote) {
-                        // doubled quote; take a literal value
-                        pushChar(quote);
-                    }
-                    else {
-                        // Error
-                        errorMsg = "Garbage after closing quote";
-                        break;
-                    }
+                    break;
+                }
+                else if (*line == quote) {
+                    // doubled quote; take a literal value
+                    pushChar(quote);
                 }
                 else {
-                    pushChar(c);
+                    // Error
+                    errorMsg = "Garbage after closing quote";
+                    break;
                 }
+                ++line;
             }
 
             if (!ok)
@@ -581,9 +767,13 @@ parseFixedWidthCsvRow(const char * & line,
             if (errorMsg)
                 break;
 
-            values[colNum++] = finishString(s, len, eightBit);
+            errorMsg = finishField(s, len, eightBit);
+            if (errorMsg)
+                break;
         }
-        else if ((isdigit(c) || c == '-') && !isTextLine) {
+        else if ((isdigit(c) || c == '-') && !isTextLine
+                 && (!columnTypes || columnTypes[colNum] == ITC_AUTO
+                     || columnTypes[colNum] == ITC_INTEGER)) {
             // Special case for something that looks like a number, in order to
             // save on parsing it.  We short circuit out when we get to a length
             // where we could start to lose digits, and fall back on parsing the
@@ -620,27 +810,31 @@ parseFixedWidthCsvRow(const char * & line,
                 values[colNum++] = (int64_t)-num;
             else if (isInt)  // positive integer
                 values[colNum++] = num;
-            else // get it from the string
-                values[colNum++]
-                    = finishString(start, len, eightBit);
+            else { // get it from the string
+                errorMsg = finishField(start, len, eightBit);
+                if (errorMsg)
+                    break;
+            }
         }
         else {
             // likely a non-quoted string
 
             bool eightBit = !isascii(c);
-            size_t len = 1;
+            const char * fieldEnd;
 
-            for (; line < lineEnd;  ++line, ++len) {
-                c = *line;
-                if (c == separator && !isTextLine) {
-                    ++line;
-                    break;
-                }
-                if (!isascii(c))
-                    eightBit = true;
+            if (isTextLine) {
+                fieldEnd = lineEnd;
+                eightBit = eightBit || hasNonAscii(line, lineEnd);
+                line = lineEnd;
+            }
+            else {
+                fieldEnd = findFieldEnd(line, lineEnd, separator, eightBit);
+                line = fieldEnd == lineEnd ? lineEnd : fieldEnd + 1;
             }
 
-            values[colNum++] = finishString(start, len, eightBit);
+            errorMsg = finishField(start, fieldEnd - start, eightBit);
+            if (errorMsg)
+                break;
         }
     }
 
@@ -697,6 +891,8 @@ struct ImportTextProcedureWorkInstance
     bool hasQuoteChar = false;
     Date ts;
     bool isIdentitySelect;
+    // Declared type of each input column; empty if none were declared
+    vector<ImportTextColumnType> inputColumnTypes;
 
     BoundSqlExpression whereBound;
     BoundSqlExpression selectBound;
@@ -706,21 +902,125 @@ struct ImportTextProcedureWorkInstance
     size_t rowCount;
     uint64_t numLineErrors;
 
+    // Fields of the header row of the first file, which the header rows of
+    // the other files must match
+    vector<string> headerFields;
+
+    /*    Read the header row of a file, which may span several lines if
+          multi-line values are allowed  */
+    vector<string> readHeaderFields(std::istream & stream,
+                                    const std::string & filename,
+                                    const ImportTextConfig & config)
+    {
+        string header;
+        string prevHeader;
+        while(true) {
+            std::getline(stream, header);
+
+            if(!prevHeader.empty()) {
+                prevHeader += ' ' + header;
+                header.assign(std::move(prevHeader));
+            }
+
+            try {
+                ParseContext pcontext(filename,
+                                       header.c_str(), header.length(), 1, 0);
+                return expect_csv_row(pcontext, -1, separator);
+            }
+            catch (FileFinishInsideQuote & exp) {
+                if(config.allowMultiLines) {
+                    prevHeader.assign(std::move(header));
+                    continue;
+                }
+
+                throw exp;
+            }
+        }
+    }
+
+    /*    Open one of the files after the first when importing several,
+          and position it at the first line to import  */
+    std::unique_ptr<filter_istream>
+    openDataFile(const std::string & filename,
+                 const ImportTextConfig & config)
+    {
+        std::unique_ptr<filter_istream> stream
+            (new filter_istream(filename, { { "mapped", "true" } }));
+
+        if (!isTextLine && config.headers.empty()
+            && !config.autoGenerateHeaders) {
+            auto fields = readHeaderFields(*stream, filename, config);
+            if (fields != headerFields)
+                throw HttpReturnException
+                    (400, "Header of file doesn't match the header of the "
+                     "first file imported",
+                     "dataFileUrl", filename,
+                     "header", fields,
+                     "expectedHeader", headerFields);
+        }
+
+        std::string line;
+        for (size_t i = 0;  *stream && i < config.offset;  ++i) {
+            getline(*stream, line);
+        }
+
+        return stream;
+    }
+
     /*    Load a text file and filter according to the configuration  */
     void loadText(const ImportTextConfig& config,
                   std::shared_ptr<Dataset> dataset,
                   MldbServer * server,
                   const std::function<bool (const Json::Value &)> & onProgress)
     {
-        string filename = config.dataFileUrl.toDecodedString();
+        // A URL with wildcards imports all of the files it matches
+        vector<string> files;
+        std::map<string, int64_t> fileSizes;
+        string pattern = config.dataFileUrl.toDecodedString();
+        if (uriHasWildcards(pattern)) {
+            forEachUriObjectMatching
+                (pattern,
+                 [&] (const std::string & uri, const FsObjectInfo & info,
+                      const OpenUriObject &, int)
+                 {
+                     files.push_back(uri);
+                     fileSizes[uri] = info.size;
+                     return true;
+                 });
+            if (files.empty())
+                throw HttpReturnException(400, "No files match dataFileUrl",
+                                          "dataFileUrl", pattern);
+            std::sort(files.begin(), files.end());
+        }
+        else {
+            files.push_back(pattern);
+        }
+
+        string filename = files[0];
 
         // Ask for a memory mappable stream if possible
-        filter_istream stream(config.dataFileUrl, { { "mapped", "true" } });
+        filter_istream stream(filename, { { "mapped", "true" } });
 
         // Get the file timestamp out
         ts = stream.info().lastModified;
-
-        string header;
+        fileSizes[filename] = stream.info().size;
+
+        // The bytes read are counted after decompression, so the ETA can
+        // only come from the file sizes when none of them is compressed
+        RunProgress * runProgress = RunProgress::current();
+        if (runProgress && config.limit == -1) {
+            uint64_t totalBytes = 0;
+            for (auto & f: files) {
+                auto it = fileSizes.find(f);
+                if (it == fileSizes.end() || it->second < 0
+                    || !Compressor::filenameToCompression(f).empty()) {
+                    totalBytes = 0;
+                    break;
+                }
+                totalBytes += it->second;
+            }
+            runProgress->setExpectedBytes(totalBytes);
+        }
 
         if (config.delimiter.length() == 1) {
             separator = config.delimiter[0];
@@ -782,37 +1082,13 @@ struct ImportTextProcedureWorkInstance
 
             if (config.headers.empty()) {
 
-                vector<string> fields;
-
-                // Read header line
-                string prevHeader;
-                while(true) {
-                    std::getline(stream, header);
-
-                    if(!prevHeader.empty()) {
-                        prevHeader += ' ' + header;
-                        header.assign(std::move(prevHeader));
-                    }
-
-                    try {
-                        ParseContext pcontext(filename,
-                                               header.c_str(), header.length(), 1, 0);
-                        fields = expect_csv_row(pcontext, -1, separator);
-                        break;
-                    }
-                    catch (FileFinishInsideQuote & exp) {
-                        if(config.allowMultiLines) {
-                            prevHeader.assign(std::move(header));
-                            continue;
-                        }
-
-                        throw exp;
-                    }
-                }
+                vector<string> fields
+                    = readHeaderFields(stream, filename, config);
+                headerFields = fields;
 
                 if (config.autoGenerateHeaders) {
                     // Re-open stream
-                    stream.open(config.dataFileUrl, { { "mapped", "true" } });
+                    stream.open(filename, { { "mapped", "true" } });
                     auto nfields = fields.size();
                     for (ssize_t i = 0; i < nfields; ++i) {
                         inputColumnNames.emplace_back(i);
@@ -858,10 +1134,24 @@ struct ImportTextProcedureWorkInstance
                                           "columnName", c);
         }
 
+        if (!config.columnTypes.empty()) {
+            inputColumnTypes.resize(inputColumnNames.size(), ITC_AUTO);
+            for (auto & t: config.columnTypes) {
+                ColumnPath c = config.structuredColumnNames
+                    ? ColumnPath::parse(t.first) : ColumnPath(t.first);
+                auto it = inputColumnIndex.find(ColumnHash(c));
+                if (it == inputColumnIndex.end())
+                    throw HttpReturnException
+                        (400, "Column in columnTypes is not in the CSV file",
+                         "columnName", t.first,
+                         "inputColumnNames", inputColumnNames);
+                inputColumnTypes[it->second] = t.second;
+            }
+        }
+
         // Now we know the columns, we can bind our SQL expressions for the
         // select, where, named and timestamp parts of the expression.
-        SqlCsvScope scope(server, inputColumnNames, ts,
-                          Utf8String(config.dataFileUrl.toDecodedString()));
+        SqlCsvScope scope(server, inputColumnNames, ts, Utf8String(filename));
 
         selectBound = config.select.bind(scope);
         whereBound = config.where->bind(scope);
@@ -918,13 +1208,21 @@ struct ImportTextProcedureWorkInstance
             getline(stream, line);
         }
 
-        loadTextData(dataset, stream, config, scope, onProgress);
+        loadTextData(dataset, stream, files, config, scope, onProgress);
     }
 
-    /*    Load, filter and format all lines and process them  */
+    /// File being imported, for the functions that refer to it
+    struct DataFile {
+        Utf8String url;
+        Date ts;
+    };
+
+    /*    Load, filter and format all lines and process them.  The stream is
+          open on the first of the files; the others are opened here  */
     void
     loadTextData(std::shared_ptr<Dataset> dataset,
                  std::istream& stream,
+                 const std::vector<std::string> & files,
                  const ImportTextConfig& config,
                  SqlCsvScope& scope,
                  const std::function<bool (const Json::Value &)> & onProgress)
@@ -941,6 +1239,11 @@ struct ImportTextProcedureWorkInstance
         std::atomic<uint64_t> numSkipped(0);
         std::atomic<uint64_t> totalLinesProcessed(0);
 
+        // Telemetry of the run, counted from the threads parsing lines
+        RunProgress * runProgress = RunProgress::current();
+        if (runProgress)
+            runProgress->startStage("import");
+
         Timer timer;
 
         auto handleError = [&](const std::string & message,
@@ -1006,12 +1309,17 @@ struct ImportTextProcedureWorkInstance
 
         atomic<ssize_t> lineCount(0);
         atomic<ssize_t> byteCount(0);
-        auto onLine = [&] (const char * line,
-                           size_t length,
-                           int chunkNum,
-                           int64_t lineNum)
+        auto onFileLine = [&] (const DataFile & file,
+                               const char * line,
+                               size_t length,
+                               int chunkNum,
+                               int64_t lineNum)
         {
             byteCount += length + 1;
+            if (runProgress) {
+                runProgress->addRows();
+                runProgress->addBytes(length + 1);
+            }
             if (++lineCount % 1000 == 0) {
                 iterationStep->value = lineCount;
                 onProgress(jsonEncode(iterationStep));
@@ -1053,7 +1361,10 @@ struct ImportTextProcedureWorkInstance
                                             separator, quote, encoding,
                                             replaceInvalidCharactersWith,
                                             isTextLine,
-                                            hasQuoteChar, logger);
+                                            hasQuoteChar,
+                                            inputColumnTypes.empty()
+                                            ? nullptr : inputColumnTypes.data(),
+                                            logger);
 
                 if (errorMsg) {
                     if(config.allowMultiLines) {
@@ -1070,8 +1381,8 @@ struct ImportTextProcedureWorkInstance
                                            string(line, length));
                 }
 
-            auto row = scope.bindRow(&values[0], ts, actualLineNum,
-                                         0 /* todo: chunk ofs */);
+            auto row = scope.bindRow(&values[0], file.ts, actualLineNum,
+                                         0 /* todo: chunk ofs */, &file.url);
 
             ExpressionValue nameStorage;
             RowPath rowName(namedBound(row, nameStorage, GET_ALL)
@@ -1086,7 +1397,7 @@ struct ImportTextProcedureWorkInstance
             }
 
             // Get the timestamp for the row
-            Date rowTs = ts;
+            Date rowTs = file.ts;
             ExpressionValue tsStorage;
             rowTs = timestampBound(row, tsStorage, GET_ALL)
                     .coerceToTimestamp().toTimestamp();
@@ -1129,44 +1440,118 @@ struct ImportTextProcedureWorkInstance
         };
 
 
-        if(!config.allowMultiLines) {
-            forEachLineBlock(stream, onLine, config.limit,
-                             numCpus() /* parallelism */,
-                             startChunk, doneChunk);
-        }
-        else {
-            // very simplistic and not efficient way of doing multi-line. we send
-            // lines one by one to the 'onLine' function, and if
-            // we get an error that probably is caused by a multi-
-            // line string, we concat the current line with the next
-            // one and try again. 
-            startChunk(0, 0);
-
-            string line;
-            string t_line;
-            string prevLine;
-            int64_t lineNum = 0;
-            while(getline(stream, line)) {
-                // prepend previous line if we're tagging it along
-                if(!prevLine.empty()) {
-                    t_line.assign(std::move(line));
-                    line.assign(std::move(prevLine));
-                    line += ' ' + t_line;
-                }
+        bool multipleFiles = files.size() > 1;
 
-                if(!onLine(line.c_str(), line.size(),
-                           0 /* chunkNum */, lineNum)) {
-                    prevLine.assign(std::move(line));
-                } else {
-                    prevLine.erase();
-                    lineNum++;
+        // With several files, the limit applies to all of them together
+        // and chunks are numbered over all of them
+        std::atomic<int64_t> linesTaken(0);
+        std::atomic<int64_t> nextChunkNumber(0);
+
+        auto limitReached = [&] ()
+            {
+                return config.limit != -1 && linesTaken >= config.limit;
+            };
+
+        auto processFile = [&] (std::istream & stream, const DataFile & file)
+        {
+            auto onLine = [&] (const char * line,
+                               size_t length,
+                               int chunkNum,
+                               int64_t lineNum)
+            {
+                if (multipleFiles && config.limit != -1
+                    && linesTaken.fetch_add(1) >= config.limit)
+                    return true;
+                return onFileLine(file, line, length, chunkNum, lineNum);
+            };
+
+            auto startFileChunk = [&] (int64_t chunkNumber, size_t lineNumber)
+            {
+                return startChunk(multipleFiles ? nextChunkNumber++ : chunkNumber,
+                                  lineNumber);
+            };
+
+            if(!config.allowMultiLines) {
+                forEachLineBlock(stream, onLine, config.limit,
+                                 numCpus() /* parallelism */,
+                                 startFileChunk, doneChunk);
+            }
+            else {
+                // very simplistic and not efficient way of doing multi-line. we send
+                // lines one by one to the 'onLine' function, and if
+                // we get an error that probably is caused by a multi-
+                // line string, we concat the current line with the next
+                // one and try again. 
+                startFileChunk(0, 0);
+
+                string line;
+                string t_line;
+                string prevLine;
+                int64_t lineNum = 0;
+                while(getline(stream, line)) {
+                    // prepend previous line if we're tagging it along
+                    if(!prevLine.empty()) {
+                        t_line.assign(std::move(line));
+                        line.assign(std::move(prevLine));
+                        line += ' ' + t_line;
+                    }
+
+                    if(!onLine(line.c_str(), line.size(),
+                               0 /* chunkNum */, lineNum)) {
+                        prevLine.assign(std::move(line));
+                    } else {
+                        prevLine.erase();
+                        lineNum++;
+                    }
+
+                    if(config.limit > 0 && lineNum >= config.limit)
+                        break;
                 }
 
-                if(config.limit > 0 && lineNum >= config.limit)
-                    break;
+                doneChunk(0, lineNum);
             }
+        };
 
-            doneChunk(0, lineNum);
+        if (!multipleFiles) {
+            processFile(stream, DataFile{ Utf8String(files[0]), ts });
+        }
+        else {
+            // Keep several files open at once, so that opening and waiting
+            // for the first bytes of one overlaps with parsing the others,
+            // and small files don't leave the cores idle
+            ThreadPool tp(std::max(1, config.maxConcurrentFiles));
+            std::atomic<int> hasExc(false);
+            std::exception_ptr exc;
+
+            for (size_t i = 0;  i < files.size();  ++i) {
+                tp.add([&, i] ()
+                    {
+                        if (hasExc || limitReached())
+                            return;
+                        try {
+                            if (i == 0) {
+                                processFile(stream,
+                                            DataFile{ Utf8String(files[0]), ts });
+                                return;
+                            }
+
+                            auto fileStream = openDataFile(files[i], config);
+                            processFile(*fileStream,
+                                        DataFile{ Utf8String(files[i]),
+                                                  fileStream->info().lastModified });
+                        } MLDB_CATCH_ALL {
+                            if (hasExc.fetch_add(1) == 0) {
+                                exc = std::current_exception();
+                            }
+                        }
+                    });
+            }
+
+            tp.waitForAll();
+
+            if (hasExc) {
+                std::rethrow_exception(exc);
+            }
         }
 
         double wall = timer.elapsed_wall();
@@ -1228,6 +1613,8 @@ run(const ProcedureRunConfig & run,
     status["numLineErrors"] = instance.numLineErrors;
     status["rowCount"] = instance.rowCount;
 
+    if (RunProgress * runProgress = RunProgress::current())
+        runProgress->startStage("commit");
     dataset->commit();
 
     return Any(status);
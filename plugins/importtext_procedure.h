@@ -20,6 +20,17 @@
 namespace MLDB {
 
 
+/** Declared type of a column in an imported text file. */
+enum ImportTextColumnType {
+    ITC_AUTO,       ///< Infer the type of each value
+    ITC_STRING,     ///< Always a string, even if it looks like a number
+    ITC_INTEGER,    ///< Signed 64 bit integer
+    ITC_NUMBER,     ///< Floating point number
+    ITC_TIMESTAMP   ///< ISO 8601 timestamp
+};
+
+DECLARE_ENUM_DESCRIPTION(ImportTextColumnType);
+
 struct ImportTextConfig : public ProcedureConfig  {
     static constexpr const char * name = "import.text";
 
@@ -34,6 +45,7 @@ struct ImportTextConfig : public ProcedureConfig  {
           structuredColumnNames(false),
           allowMultiLines(false),
           autoGenerateHeaders(false),
+          maxConcurrentFiles(8),
           select(SelectExpression::STAR),
           where(SqlExpression::TRUE),
           named(SqlExpression::parse("lineNumber()")),
@@ -55,6 +67,8 @@ struct ImportTextConfig : public ProcedureConfig  {
     bool structuredColumnNames;
     bool allowMultiLines;
     bool autoGenerateHeaders;
+    std::map<Utf8String, ImportTextColumnType> columnTypes;
+    int maxConcurrentFiles;
 
     SelectExpression select;               ///< What to select from the CSV
     std::shared_ptr<SqlExpression> where;  ///< Filter for the CSV
@@ -20,6 +20,7 @@
 #include "mldb/sql/builtin_functions.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/arch/timers.h"
 #include "mldb/base/parse_context.h"
 #include "mldb/rest/cancellation_exception.h"
@@ -48,7 +49,8 @@ struct JSONImporterConfig : ProcedureConfig {
           select(SelectExpression::STAR),
           where(SqlExpression::TRUE),
           named(SqlExpression::TRUE), // Trick to ease comparison
-          arrays(PARSE_ARRAYS)
+          arrays(PARSE_ARRAYS),
+          maxConcurrentFiles(8)
     {
         outputDataset.withType("tabular");
     }
@@ -63,6 +65,7 @@ struct JSONImporterConfig : ProcedureConfig {
     std::shared_ptr<SqlExpression> where;
     std::shared_ptr<SqlExpression> named;
     JsonArrayHandling arrays;
+    int maxConcurrentFiles;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(JSONImporterConfig);
@@ -73,7 +76,9 @@ JSONImporterConfigDescription::
 JSONImporterConfigDescription()
 {
     addField("dataFileUrl", &JSONImporterConfig::dataFileUrl,
-             "URL to load text file from");
+             "URL to load text file from.  It may contain the wildcards "
+             "'*', '?' and '[...]' in its path, in which case all matching "
+             "files are imported into the dataset.");
     addField("outputDataset", &JSONImporterConfig::outputDataset,
              "Configuration for output dataset",
              PolyConfigT<Dataset>().withType("tabular"));
@@ -101,6 +106,11 @@ JSONImporterConfigDescription()
             "arrays containing atoms are sparsified with the values "
             "representing one-hot "
             "keys and boolean true values", PARSE_ARRAYS);
+    addField("maxConcurrentFiles", &JSONImporterConfig::maxConcurrentFiles,
+             "When dataFileUrl matches several files, the number of them "
+             "that are opened and read at the same time, so that the "
+             "latency of opening one file is hidden behind the parsing "
+             "of others.", 8);
 
     addParent<ProcedureConfig>();
 
@@ -200,6 +210,241 @@ struct JsonScope : SqlExpressionMldbScope {
 
 };
 
+
+/*****************************************************************************/
+/* JSON LINE ROW PARSER                                                      */
+/*****************************************************************************/
+
+/** Parser for the common case of a line that is an object containing only
+    scalars and nested objects, with no escapes in its strings.  It
+    produces the flattened row directly, without going through a
+    structured ExpressionValue, and interns the repeating column names
+    so that each line doesn't need to construct them.
+
+    Anything else (arrays, escapes, unusual numbers, malformed input) makes
+    parse() return false so that the line can go through the general
+    parser, which gives the same result or error as before.
+
+    One of these is kept per thread, and its buffers are reused from line
+    to line.
+*/
+
+struct JsonLineRowParser {
+
+    /// Flattened row produced by the last successful parse()
+    std::vector<std::tuple<ColumnPath, CellValue, Date> > row;
+
+    /** Parse the line into row.  Returns false if the line needs to go
+        through the general parser, in which case row is empty.
+    */
+    bool parse(const char * p, const char * e, Date timestamp)
+    {
+        row.clear();
+        key.clear();
+        skipWhitespace(p, e);
+        if (p == e || *p != '{' || !parseObject(++p, e, timestamp)) {
+            row.clear();
+            return false;
+        }
+        skipWhitespace(p, e);
+        if (p != e) {
+            row.clear();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    /// Nested key of the current value, with its elements separated by nulls
+    std::string key;
+
+    /// Column names seen so far, keyed by their nested key
+    std::unordered_map<std::string, ColumnPath> columns;
+
+    /// Past this many distinct names, the cache is restarted so that it
+    /// doesn't grow without bound on data with unique keys
+    static constexpr size_t MAX_CACHED_COLUMNS = 100000;
+
+    static void skipWhitespace(const char * & p, const char * e)
+    {
+        while (p != e && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            ++p;
+    }
+
+    /** Find the closing quote of a string that starts at p, which is just
+        after the opening quote.  Returns null if there is no closing quote
+        or if the string contains an escape.
+    */
+    static const char * scanString(const char * p, const char * e)
+    {
+        for (; p != e;  ++p) {
+            if (*p == '"')
+                return p;
+            if (*p == '\\')
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    const ColumnPath & currentColumn()
+    {
+        auto it = columns.find(key);
+        if (it != columns.end())
+            return it->second;
+
+        if (columns.size() >= MAX_CACHED_COLUMNS)
+            columns.clear();
+
+        std::vector<PathElement> elements;
+        for (size_t start = 0;  start <= key.size();) {
+            size_t end = key.find('\0', start);
+            if (end == std::string::npos)
+                end = key.size();
+            elements.emplace_back(key.data() + start, end - start);
+            start = end + 1;
+        }
+
+        return columns.emplace(key, ColumnPath(elements.data(),
+                                               elements.size()))
+            .first->second;
+    }
+
+    bool parseNumber(const char * & p, const char * e, Date timestamp)
+    {
+        const char * start = p;
+        bool isInteger = true;
+        if (*p == '-')
+            ++p;
+        for (; p != e;  ++p) {
+            if (*p >= '0' && *p <= '9')
+                continue;
+            if (*p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-')
+                isInteger = false;
+            else break;
+        }
+
+        // strtoll and strtod need a terminated string
+        char buf[64];
+        size_t len = p - start;
+        if (len == 0 || len >= sizeof(buf))
+            return false;
+        memcpy(buf, start, len);
+        buf[len] = 0;
+
+        char * endptr = nullptr;
+        errno = 0;
+        if (isInteger) {
+            long long val = strtoll(buf, &endptr, 10);
+            if (errno || endptr != buf + len)
+                return false;
+            row.emplace_back(currentColumn(), CellValue(val), timestamp);
+        }
+        else {
+            double val = strtod(buf, &endptr);
+            if (errno || endptr != buf + len)
+                return false;
+            row.emplace_back(currentColumn(), CellValue(val), timestamp);
+        }
+        return true;
+    }
+
+    bool matchLiteral(const char * & p, const char * e, const char * literal,
+                      size_t len)
+    {
+        if (e - p < (ssize_t)len || memcmp(p, literal, len) != 0)
+            return false;
+        p += len;
+        return true;
+    }
+
+    /// Parse the members of an object, with p just after its opening brace
+    bool parseObject(const char * & p, const char * e, Date timestamp)
+    {
+        size_t keyStart = key.size();
+
+        skipWhitespace(p, e);
+        if (p != e && *p == '}') {
+            ++p;
+            return true;
+        }
+
+        for (;;) {
+            skipWhitespace(p, e);
+            if (p == e || *p != '"')
+                return false;
+            const char * keyEnd = scanString(++p, e);
+            if (!keyEnd || keyEnd == p)
+                return false;
+
+            key.resize(keyStart);
+            if (keyStart != 0)
+                key += '\0';
+            key.append(p, keyEnd);
+            p = keyEnd + 1;
+
+            skipWhitespace(p, e);
+            if (p == e || *p != ':')
+                return false;
+            ++p;
+            skipWhitespace(p, e);
+            if (p == e)
+                return false;
+
+            switch (*p) {
+            case '{':
+                if (!parseObject(++p, e, timestamp))
+                    return false;
+                break;
+            case '"': {
+                const char * valueEnd = scanString(++p, e);
+                if (!valueEnd)
+                    return false;
+                row.emplace_back(currentColumn(),
+                                 CellValue(Utf8String(p, (size_t)(valueEnd - p))),
+                                 timestamp);
+                p = valueEnd + 1;
+                break;
+            }
+            case 't':
+                if (!matchLiteral(p, e, "true", 4))
+                    return false;
+                row.emplace_back(currentColumn(), CellValue(1), timestamp);
+                break;
+            case 'f':
+                if (!matchLiteral(p, e, "false", 5))
+                    return false;
+                row.emplace_back(currentColumn(), CellValue(0), timestamp);
+                break;
+            case 'n':
+                if (!matchLiteral(p, e, "null", 4))
+                    return false;
+                row.emplace_back(currentColumn(), CellValue(), timestamp);
+                break;
+            default:
+                if (*p != '-' && (*p < '0' || *p > '9'))
+                    return false;
+                if (!parseNumber(p, e, timestamp))
+                    return false;
+            }
+
+            skipWhitespace(p, e);
+            if (p == e)
+                return false;
+            if (*p == ',') {
+                ++p;
+                continue;
+            }
+            if (*p != '}')
+                return false;
+            ++p;
+            break;
+        }
+
+        key.resize(keyStart);
+        return true;
+    }
+};
+
 struct JSONImporter: public Procedure {
 
     JSONImporter(MldbServer * owner,
@@ -251,22 +496,33 @@ struct JSONImporter: public Procedure {
 
         std::atomic<int64_t> errors(0);
         std::atomic<int64_t> recordedLines(0);
-        int64_t lineOffset = 1;
-        std::string line;
-        std::string filename = runProcConf.dataFileUrl.toDecodedString();
-
-        filter_istream stream(filename);
-
-        Date timestamp = stream.info().lastModified;
+        int64_t lineOffset = 1 + config.offset;
+
+        // A URL with wildcards imports all of the files it matches
+        vector<string> files;
+        string pattern = runProcConf.dataFileUrl.toDecodedString();
+        if (uriHasWildcards(pattern)) {
+            forEachUriObjectMatching
+                (pattern,
+                 [&] (const std::string & uri, const FsObjectInfo &,
+                      const OpenUriObject &, int)
+                 {
+                     files.push_back(uri);
+                     return true;
+                 });
+            if (files.empty())
+                throw HttpReturnException(400, "No files match dataFileUrl",
+                                          "dataFileUrl", pattern);
+            std::sort(files.begin(), files.end());
+        }
+        else {
+            files.push_back(pattern);
+        }
 
         Timer timer;
 
-        // Skip those up to the offset
-        for (size_t i = 0;  stream && i < config.offset;  ++i, ++lineOffset) {
-            getline(stream, line);
-        }
-
-        auto handleError = [&](const std::string & message,
+        auto handleError = [&](const std::string & filename,
+                               const std::string & message,
                                int64_t lineNumber,
                                const std::string& line) {
             if (config.ignoreBadLines) {
@@ -288,6 +544,9 @@ struct JSONImporter: public Procedure {
             /// Recorder object for this thread that the dataset gives us
             /// to record into the dataset.
             std::unique_ptr<Recorder> threadRecorder;
+
+            /// Parser for lines that don't need the general parser
+            JsonLineRowParser rowParser;
         };
 
         PerThreadAccumulator<ThreadAccum> accum;
@@ -321,10 +580,35 @@ struct JSONImporter: public Procedure {
         bool keepGoing = true;
         mutex progressMutex;
 
-        auto onLine = [&] (const char * line,
-                           size_t lineLength,
-                           int64_t blockNumber,
-                           int64_t lineNumber)
+        bool multipleFiles = files.size() > 1;
+
+        // With several files, the limit applies to all of them together
+        // and chunks are numbered over all of them
+        std::atomic<int64_t> linesTaken(0);
+        std::atomic<int64_t> nextChunkNumber(0);
+
+        bool useRowParser = !useWhere && !useSelect && !useNamed;
+
+        // Count a line about to be recorded, reporting progress every so
+        // often
+        auto countRecordedLine = [&] ()
+        {
+            int numLines = recordedLines.fetch_add(1);
+            if (numLines % 10000 == 0) {
+                lock_guard<mutex> l(progressMutex);
+                if (numLines > iterationStep->value) {
+                    iterationStep->value = numLines;
+                }
+                keepGoing = onProgress(jsonEncode(progress));
+            }
+        };
+
+        auto onFileLine = [&] (const std::string & filename,
+                               Date timestamp,
+                               const char * line,
+                               size_t lineLength,
+                               int64_t blockNumber,
+                               int64_t lineNumber)
         {
             auto & threadAccum = accum.get();
 
@@ -332,14 +616,33 @@ struct JSONImporter: public Procedure {
 
             // MLDB-1111 empty lines are treated as error
             if(lineLength == 0)
-                return handleError("empty line", actualLineNum, "");
+                return handleError(filename, "empty line", actualLineNum, "");
+
+            // Without select, where or named the row is recorded as
+            // parsed, so simple lines can skip the general parser.
+            if (useRowParser) {
+                MLDB_TRACE_EXCEPTIONS(false);
+                bool parsed = false;
+                try {
+                    parsed = threadAccum.rowParser.parse
+                        (line, line + lineLength, timestamp);
+                } catch (const std::exception &) {
+                    // eg invalid UTF-8; the general parser reports it
+                }
+                if (parsed) {
+                    countRecordedLine();
+                    threadAccum.threadRecorder->recordRow
+                        (RowPath(actualLineNum), threadAccum.rowParser.row);
+                    return keepGoing;
+                }
+            }
 
             StreamingJsonParsingContext parser(filename, line, lineLength,
                                                actualLineNum);
 
             skipJsonWhitespace(*parser.context);
             if (parser.context->eof()) {
-                return handleError("empty line", actualLineNum, "");
+                return handleError(filename, "empty line", actualLineNum, "");
             }
 
             ExpressionValue expr;
@@ -347,12 +650,12 @@ struct JSONImporter: public Procedure {
                 expr = ExpressionValue::parseJson(parser, timestamp,
                                                   config.arrays);
             } catch (const std::exception & exc) {
-                return handleError(exc.what(), actualLineNum, string(line, lineLength));
+                return handleError(filename, exc.what(), actualLineNum, string(line, lineLength));
             }
 
             skipJsonWhitespace(*parser.context);
             if (!parser.context->eof()) {
-                return handleError("extra characters at end of line", actualLineNum, "");
+                return handleError(filename, "extra characters at end of line", actualLineNum, "");
             }
 
             RowPath rowName(actualLineNum);
@@ -377,14 +680,7 @@ struct JSONImporter: public Procedure {
 
             }
 
-            int numLines = recordedLines.fetch_add(1);
-            if (numLines % 10000 == 0) {
-                lock_guard<mutex> l(progressMutex);
-                if (numLines > iterationStep->value) {
-                    iterationStep->value = numLines;
-                }
-                keepGoing = onProgress(jsonEncode(progress));
-            }
+            countRecordedLine();
 
             threadAccum.threadRecorder->recordRowExprDestructive(
                 std::move(rowName), std::move(expr));
@@ -392,8 +688,74 @@ struct JSONImporter: public Procedure {
             return keepGoing;
         };
 
-        forEachLineBlock(stream, onLine, runProcConf.limit, 32,
-                         startChunk, doneChunk);
+        auto processFile = [&] (const std::string & filename)
+        {
+            filter_istream stream(filename);
+
+            Date timestamp = stream.info().lastModified;
+
+            // Skip those up to the offset
+            std::string line;
+            for (size_t i = 0;  stream && i < config.offset;  ++i) {
+                getline(stream, line);
+            }
+
+            auto onLine = [&] (const char * line,
+                               size_t lineLength,
+                               int64_t blockNumber,
+                               int64_t lineNumber)
+            {
+                if (multipleFiles && runProcConf.limit != -1
+                    && linesTaken.fetch_add(1) >= runProcConf.limit)
+                    return true;
+                return onFileLine(filename, timestamp, line, lineLength,
+                                  blockNumber, lineNumber);
+            };
+
+            auto startFileChunk = [&] (int64_t chunkNumber, size_t lineNumber)
+            {
+                return startChunk(multipleFiles ? nextChunkNumber++ : chunkNumber,
+                                  lineNumber);
+            };
+
+            forEachLineBlock(stream, onLine, runProcConf.limit, 32,
+                             startFileChunk, doneChunk);
+        };
+
+        if (!multipleFiles) {
+            processFile(files[0]);
+        }
+        else {
+            // Keep several files open at once, so that opening and waiting
+            // for the first bytes of one overlaps with parsing the others
+            ThreadPool tp(std::max(1, config.maxConcurrentFiles));
+            std::atomic<int> hasExc(false);
+            std::exception_ptr exc;
+
+            for (auto & file: files) {
+                tp.add([&] ()
+                    {
+                        if (hasExc || !keepGoing
+                            || (runProcConf.limit != -1
+                                && linesTaken >= runProcConf.limit))
+                            return;
+                        try {
+                            processFile(file);
+                        } MLDB_CATCH_ALL {
+                            if (hasExc.fetch_add(1) == 0) {
+                                exc = std::current_exception();
+                            }
+                        }
+                    });
+            }
+
+            tp.waitForAll();
+
+            if (hasExc) {
+                std::rethrow_exception(exc);
+            }
+        }
+
         if (!keepGoing) {
             throw MLDB::CancellationException("Procedure import.json cancelled");
         }
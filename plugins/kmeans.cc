@@ -36,6 +36,25 @@ using namespace std;
 
 namespace MLDB {
 
+DEFINE_ENUM_DESCRIPTION_NAMED(KMeansInitializationDescription,
+                              ML::KMeansInitialization);
+
+KMeansInitializationDescription::
+KMeansInitializationDescription()
+{
+    addValue("farthestSample", ML::KMEANS_INIT_FARTHEST_SAMPLE,
+             "Each centroid is the point farthest from the centroids so far "
+             "amongst a random sample of 100 points.  This is cheap, but "
+             "sequential in the number of clusters.");
+    addValue("kmeansParallel", ML::KMEANS_INIT_PARALLEL,
+             "k-means|| initialization.  A few parallel passes over the "
+             "points sample candidates with a probability proportional to "
+             "their squared distance to the candidates so far, which are "
+             "then reduced to the number of clusters with k-means++.  This "
+             "gives much better starting centroids for large numbers of "
+             "clusters.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(KmeansConfig);
 
 
@@ -80,6 +99,16 @@ KmeansConfigDescription()
              "Normally this will be Cosine for an orthonormal basis, and "
              "Euclidian for another basis",
              METRIC_COSINE);
+    addField("initialization", &KmeansConfig::initialization,
+             "How the initial centroids are chosen.",
+             ML::KMEANS_INIT_FARTHEST_SAMPLE);
+    addField("miniBatchSize", &KmeansConfig::miniBatchSize,
+             "If greater than zero, use mini-batch k-means: each iteration "
+             "moves the centroids using a random sample of this many rows "
+             "rather than all of them, and `maxIterations` iterations are "
+             "always performed.  This is much faster on large datasets, at "
+             "the cost of slightly worse clusters.  Zero (the default) "
+             "performs full iterations over all rows.", 0);
     addField("modelFileUrl", &KmeansConfig::modelFileUrl,
              "URL where the model file (with extension '.kms') should be saved. "
              "This file can be loaded by the ![](%%doclink kmeans function). "
@@ -96,8 +125,6 @@ KmeansConfigDescription()
                            validateFunction<KmeansConfig>());
 }
 
-// TODO: see http://www.eecs.tufts.edu/~dsculley/papers/fastkmeans.pdf
-
 namespace {
 
 ML::KMeansMetric * makeMetric(MetricSpace metric)
@@ -154,6 +181,11 @@ run(const ProcedureRunConfig & run,
         checkWritability(runProcConf.modelFileUrl.toDecodedString(), "modelFileUrl");
     }
 
+    if (runProcConf.miniBatchSize < 0) {
+        throw HttpReturnException(400, "kmeans.train miniBatchSize must not be negative",
+                                  "miniBatchSize", runProcConf.miniBatchSize);
+    }
+
     auto onProgress2 = [&] (const Json::Value & progress)
         {
             Json::Value value;
@@ -192,6 +224,8 @@ run(const ProcedureRunConfig & run,
 
     ML::KMeans kmeans;
     kmeans.metric.reset(makeMetric(runProcConf.metric));
+    kmeans.initialization = runProcConf.initialization;
+    kmeans.miniBatchSize = runProcConf.miniBatchSize;
 
     vector<int> inCluster;
 
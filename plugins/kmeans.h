@@ -17,10 +17,14 @@
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/types/optional.h"
 #include "metric_space.h"
+#include "mldb/ml/kmeans.h"
 
 
 namespace MLDB {
 
+DECLARE_ENUM_DESCRIPTION_NAMED(KMeansInitializationDescription,
+                               ML::KMeansInitialization);
+
 
 /*****************************************************************************/
 /* KMEANS CONFIG                                                             */
@@ -33,7 +37,9 @@ struct KmeansConfig : public ProcedureConfig {
         : numInputDimensions(-1),
           numClusters(10),
           maxIterations(100),
-          metric(METRIC_COSINE)
+          metric(METRIC_COSINE),
+          initialization(ML::KMEANS_INIT_FARTHEST_SAMPLE),
+          miniBatchSize(0)
     {
     }
 
@@ -47,6 +53,8 @@ struct KmeansConfig : public ProcedureConfig {
     int numClusters;
     int maxIterations;
     MetricSpace metric;
+    ML::KMeansInitialization initialization;
+    int miniBatchSize;
 
     Utf8String functionName;
 };
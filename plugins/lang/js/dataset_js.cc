@@ -9,6 +9,7 @@
 
 #include "dataset_js.h"
 #include "mldb/core/dataset.h"
+#include <cmath>
 
 
 using namespace std;
@@ -79,6 +80,15 @@ registerMe()
                    FunctionTemplate::New(isolate, getColumnPaths));
     prototmpl->Set(String::NewFromUtf8(isolate, "getTimestampRange"),
                    FunctionTemplate::New(isolate, getTimestampRange));
+
+    prototmpl->Set(String::NewFromUtf8(isolate, "getRowCount"),
+                   FunctionTemplate::New(isolate, getRowCount));
+    prototmpl->Set(String::NewFromUtf8(isolate, "getRowPaths"),
+                   FunctionTemplate::New(isolate, getRowPaths));
+    prototmpl->Set(String::NewFromUtf8(isolate, "getRows"),
+                   FunctionTemplate::New(isolate, getRows));
+    prototmpl->Set(String::NewFromUtf8(isolate, "getColumnArray"),
+                   FunctionTemplate::New(isolate, getColumnArray));
         
     return scope.Escape(fntmpl);
 }
@@ -235,5 +245,112 @@ getTimestampRange(const v8::FunctionCallbackInfo<v8::Value> & args)
     } HANDLE_JS_EXCEPTIONS(args);
 }
 
+void
+DatasetJS::
+getRowCount(const v8::FunctionCallbackInfo<v8::Value> & args)
+{
+    try {
+        Dataset * dataset = getShared(args.This());
+        args.GetReturnValue().Set(JS::toJS(dataset->getMatrixView()->getRowCount()));
+    } HANDLE_JS_EXCEPTIONS(args);
+}
+
+void
+DatasetJS::
+getRowPaths(const v8::FunctionCallbackInfo<v8::Value> & args)
+{
+    try {
+        Dataset * dataset = getShared(args.This());
+        auto start = JS::getArg<int64_t>(args, 0, int64_t(0), "start");
+        auto limit = JS::getArg<int64_t>(args, 1, -1, "limit");
+
+        args.GetReturnValue().Set
+            (JS::toJS(dataset->getMatrixView()->getRowPaths(start, limit)));
+    } HANDLE_JS_EXCEPTIONS(args);
+}
+
+void
+DatasetJS::
+getRows(const v8::FunctionCallbackInfo<v8::Value> & args)
+{
+    v8::Isolate* isolate = args.GetIsolate();
+    v8::EscapableHandleScope scope(isolate);
+    try {
+        Dataset * dataset = getShared(args.This());
+        auto start = JS::getArg<int64_t>(args, 0, int64_t(0), "start");
+        auto limit = JS::getArg<int64_t>(args, 1, 1000, "limit");
+
+        auto matrix = dataset->getMatrixView();
+        std::vector<RowPath> rowPaths = matrix->getRowPaths(start, limit);
+
+        // Same format as the argument of recordRows(), so that a chunk
+        // can be transformed and recorded into another dataset
+        v8::Local<v8::Array> result = v8::Array::New(isolate, rowPaths.size());
+        for (unsigned i = 0;  i < rowPaths.size();  ++i) {
+            MatrixNamedRow row = matrix->getRow(rowPaths[i]);
+            v8::Local<v8::Array> entry = v8::Array::New(isolate, 2);
+            entry->Set(0, JS::toJS(row.rowName));
+            entry->Set(1, JS::toJS(row.columns));
+            result->Set(i, entry);
+        }
+
+        args.GetReturnValue().Set(scope.Escape(result));
+    } HANDLE_JS_EXCEPTIONS(args);
+}
+
+void
+DatasetJS::
+getColumnArray(const v8::FunctionCallbackInfo<v8::Value> & args)
+{
+    v8::Isolate* isolate = args.GetIsolate();
+    v8::EscapableHandleScope scope(isolate);
+    try {
+        Dataset * dataset = getShared(args.This());
+        auto columnName = JS::getArg<ColumnPath>(args, 0, "columnName");
+
+        std::vector<CellValue> values
+            = dataset->getColumnIndex()->getColumnDense(columnName);
+
+        bool allUint32 = true, allNumbers = true;
+        for (auto & v: values) {
+            if (v.empty()) {
+                allUint32 = false;
+            }
+            else if (!v.isNumeric()) {
+                allUint32 = allNumbers = false;
+                break;
+            }
+            else if (!v.isInteger() || v.isNegativeNumber()
+                     || v.toUInt() > std::numeric_limits<uint32_t>::max()) {
+                allUint32 = false;
+            }
+        }
+
+        // Numeric columns are filled directly into the memory of a typed
+        // array, without creating a Javascript value per row
+        if (allUint32) {
+            auto buffer = v8::ArrayBuffer::New(isolate,
+                                               values.size() * sizeof(uint32_t));
+            uint32_t * data = (uint32_t *)buffer->GetContents().Data();
+            for (auto & v: values)
+                *data++ = v.toUInt();
+            args.GetReturnValue().Set
+                (scope.Escape(v8::Uint32Array::New(buffer, 0, values.size())));
+        }
+        else if (allNumbers) {
+            auto buffer = v8::ArrayBuffer::New(isolate,
+                                               values.size() * sizeof(double));
+            double * data = (double *)buffer->GetContents().Data();
+            for (auto & v: values)
+                *data++ = v.empty() ? NAN : v.toDouble();
+            args.GetReturnValue().Set
+                (scope.Escape(v8::Float64Array::New(buffer, 0, values.size())));
+        }
+        else {
+            args.GetReturnValue().Set(scope.Escape(JS::toJS(values)));
+        }
+    } HANDLE_JS_EXCEPTIONS(args);
+}
+
 } // namespace MLDB
 
@@ -65,6 +65,18 @@ struct DatasetJS: public JsObjectBase {
 
     static void
     getTimestampRange(const v8::FunctionCallbackInfo<v8::Value> & args);
+
+    static void
+    getRowCount(const v8::FunctionCallbackInfo<v8::Value> & args);
+
+    static void
+    getRowPaths(const v8::FunctionCallbackInfo<v8::Value> & args);
+
+    static void
+    getRows(const v8::FunctionCallbackInfo<v8::Value> & args);
+
+    static void
+    getColumnArray(const v8::FunctionCallbackInfo<v8::Value> & args);
 };
 
 } // namespace MLDB
@@ -13,13 +13,24 @@
 #include "mldb/sql/expression_value.h"
 #include "mldb/sql/sql_expression.h"
 
+#include "mldb/jml/utils/environment.h"
+
 #include <boost/algorithm/string.hpp>
+#include <list>
+#include <map>
+#include <mutex>
 
 using namespace std;
 
 
 namespace MLDB {
 
+namespace {
+
+EnvOption<int> MLDB_JSEVAL_CACHE_SIZE("MLDB_JSEVAL_CACHE_SIZE", 64);
+
+} // file scope
+
 struct JsFunctionData;
 
 /** Data for a JS function for each thread. */
@@ -40,6 +51,9 @@ struct JsFunctionThreadData {
     v8::Persistent<v8::Function> function;
     const JsFunctionData * data;
 
+    /// Arguments of the call, kept so they're not allocated for each row
+    mutable std::vector<v8::Handle<v8::Value> > argv;
+
     void initialize(const JsFunctionData & data);
 
     ExpressionValue run(const std::vector<ExpressionValue> & args,
@@ -150,7 +164,7 @@ run(const std::vector<ExpressionValue> & args,
 
     Date ts = Date::negativeInfinity();
 
-    std::vector<v8::Handle<v8::Value> > argv;
+    argv.clear();
     for (unsigned i = 2;  i < args.size();  ++i) {
         if (args[i].isRow()) {
             RowValue row;
@@ -219,6 +233,71 @@ runJsFunction(const std::vector<ExpressionValue> & args,
     return threadData->run(args, context);
 }
 
+/** Runners of the scripts that have been bound recently.  Creating a
+    runner sets up a plugin context, with its own isolate, and each thread
+    that runs it needs to compile the script.  Keeping them means that
+    binding the same script again, as when the same query is run over and
+    over, reuses the compiled script in every thread that has already run
+    it.
+*/
+struct JsFunctionCache {
+    typedef std::tuple<MldbServer *, std::string, Utf8String> Key;
+
+    std::mutex mutex;
+    std::list<std::pair<Key, std::shared_ptr<JsFunctionData> > > entries;
+    std::map<Key, decltype(entries)::iterator> index;
+
+    std::shared_ptr<JsFunctionData>
+    get(const Utf8String & name, MldbServer * server,
+        const std::string & params, const Utf8String & scriptSource)
+    {
+        int maxSize = MLDB_JSEVAL_CACHE_SIZE;
+
+        Key key(server, params, scriptSource);
+
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            entries.splice(entries.begin(), entries, it->second);
+            auto & runner = it->second->second;
+
+            // Nothing reads the logs of a jseval, so don't let them grow
+            // from one bind to the next
+            std::unique_lock<std::mutex> logGuard(runner->context->logMutex);
+            runner->context->logs.clear();
+            return runner;
+        }
+
+        auto runner = std::make_shared<JsFunctionData>();
+        runner->server = server;
+        runner->scriptSource = scriptSource;
+        runner->filenameForErrorMessages = "<<eval>>";
+        runner->context.reset(new JsPluginContext(name, runner->server,
+                                                  nullptr /* no plugin context */));
+
+        boost::split(runner->params, params,
+                     boost::is_any_of(","));
+
+        if (maxSize <= 0)
+            return runner;
+
+        entries.emplace_front(key, runner);
+        index[key] = entries.begin();
+        while (entries.size() > (size_t)maxSize) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+
+        return runner;
+    }
+};
+
+static JsFunctionCache & getJsFunctionCache()
+{
+    static JsFunctionCache cache;
+    return cache;
+}
+
 BoundFunction bindJsEval(const Utf8String & name,
                          const std::vector<BoundSqlExpression> & args,
                          const SqlBindingScope & context)
@@ -229,17 +308,11 @@ BoundFunction bindJsEval(const Utf8String & name,
     // 1.  Get the constant source value
     Utf8String scriptSource = args[0].constantValue().toUtf8String();
 
-    // 2.  Create the runner, including test compiling the script
-    auto runner = std::make_shared<JsFunctionData>();
-    runner->server = context.getMldbServer();
-    runner->scriptSource = scriptSource;
-    runner->filenameForErrorMessages = "<<eval>>";
-    runner->context.reset(new JsPluginContext(name, runner->server,
-                                              nullptr /* no plugin context */));
-                          
+    // 2.  Find or create the runner; the script is compiled in each thread
+    //     the first time it runs there
     string params = args[1].constantValue().toString();
-    boost::split(runner->params, params,
-                 boost::is_any_of(","));
+    auto runner = getJsFunctionCache().get(name, context.getMldbServer(),
+                                           params, scriptSource);
     
     // 3.  We don't know what it returns; TODO: allow it to be specified
     auto info = std::make_shared<AnyValueInfo>();
@@ -326,12 +326,10 @@ convert(const Json::Value & js)
     return bp::incref(convert_recur(js)->ptr());
 }
 
-static struct AtInit {
-    AtInit()
-    {
-        PyDateTime_IMPORT;
-    }
-} atInit;
+void initConverters()
+{
+    PyDateTime_IMPORT;
+}
 
 } // namespace Python
 
@@ -6,9 +6,8 @@
     
     Python converters for common types.
 
-    \todo Add a helper function to initialize the converters for the various
-    types. These should only be initialized once so use std::call_once.
-
+    initConverters() must be called once the interpreter has been started,
+    before any of the converters is used.
 */
 
 #pragma once
@@ -25,6 +24,11 @@ namespace MLDB {
 
 namespace Python {
 
+/** Set up what the converters need from the interpreter.  It's called
+    once, when the interpreter is started.
+*/
+void initConverters();
+
 /******************************************************************************/
 /*   PAIR CONVERTER                                                           */
 /******************************************************************************/
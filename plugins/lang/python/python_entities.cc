@@ -15,6 +15,10 @@
 #include "from_python_converter.h"
 #include "callback.h"
 #include <boost/python/to_python_converter.hpp>
+#include "mldb/server/mldb_server.h"
+#include "mldb/sql/expression_value.h"
+#include <cmath>
+#include <map>
 
 
 using namespace std;
@@ -67,6 +71,279 @@ createDataset(MldbPythonContext * mldbContext, const Json::Value & rawConfig)
 }
 
 
+/****************************************************************************/
+/* ColumnArrayPy                                                            */
+/****************************************************************************/
+
+size_t ColumnArrayPy::
+length() const
+{
+    return shape.empty() ? 0 : shape[0];
+}
+
+boost::python::object ColumnArrayPy::
+getShape() const
+{
+    boost::python::list result;
+    for (size_t dim: shape)
+        result.append(dim);
+    return boost::python::tuple(result);
+}
+
+boost::python::object ColumnArrayPy::
+arrayInterface() const
+{
+    boost::python::dict result;
+    result["version"] = 3;
+    result["shape"] = getShape();
+    result["typestr"] = typestr;
+    // read-only, since the array may be shared between several views
+    result["data"] = boost::python::make_tuple((size_t)data, true);
+    return result;
+}
+
+namespace {
+
+/** Releases the GIL while the query is running, so that other threads
+    can run Python code, and takes it back on destruction even when the
+    query throws.
+*/
+struct ReleaseGil {
+    ReleaseGil()
+        : threadState(PyThreadState_Get())
+    {
+        PyThreadState_Swap(NULL);
+        PyEval_ReleaseLock();
+    }
+
+    ~ReleaseGil()
+    {
+        PyEval_AcquireLock();
+        PyThreadState_Swap(threadState);
+    }
+
+    PyThreadState * threadState;
+};
+
+/** Values of one column of the result, indexed by row, as they are
+    collected from the rows.  Either atoms or embeddings are collected,
+    depending upon the first value of the column.
+*/
+struct ColumnValues {
+    Path name;
+    bool isEmbedding = false;
+    DimsVector shape;
+    std::vector<CellValue> atoms;
+    std::vector<const ExpressionValue *> embeddings;
+};
+
+template<typename T>
+std::shared_ptr<ColumnArrayPy>
+newColumnArray(std::vector<size_t> shape, const char * typestr,
+               T *& values)
+{
+    size_t n = 1;
+    for (size_t dim: shape)
+        n *= dim;
+
+    auto storage = std::make_shared<std::vector<T> >(n);
+    values = storage->data();
+
+    auto result = std::make_shared<ColumnArrayPy>();
+    result->data = storage->data();
+    result->storage = std::move(storage);
+    result->shape = std::move(shape);
+    result->typestr = typestr;
+    return result;
+}
+
+boost::python::object
+atomColumnToPython(const std::vector<CellValue> & atoms)
+{
+    bool allInts = true, allNumbers = true;
+    for (auto & cell: atoms) {
+        if (cell.empty()) {
+            allInts = false;
+        }
+        else if (!cell.isNumeric()) {
+            allInts = allNumbers = false;
+            break;
+        }
+        else if (!cell.isInt64()) {
+            allInts = false;
+        }
+    }
+
+    if (allInts) {
+        int64_t * values;
+        auto result = newColumnArray({ atoms.size() }, "<i8", values);
+        for (auto & cell: atoms)
+            *values++ = cell.toInt();
+        return boost::python::object(result);
+    }
+    else if (allNumbers) {
+        double * values;
+        auto result = newColumnArray({ atoms.size() }, "<f8", values);
+        for (auto & cell: atoms)
+            *values++ = cell.empty() ? NAN : cell.toDouble();
+        return boost::python::object(result);
+    }
+
+    boost::python::list result;
+    for (auto & cell: atoms)
+        result.append(jsonEncode(cell));
+    return result;
+}
+
+template<typename T>
+void fillEmbeddings(T * values, size_t rowLength, StorageType type,
+                    const std::vector<const ExpressionValue *> & embeddings)
+{
+    for (auto * embedding: embeddings) {
+        if (embedding)
+            embedding->convertEmbedding(values, rowLength, type);
+        else std::fill(values, values + rowLength, NAN);
+        values += rowLength;
+    }
+}
+
+boost::python::object
+embeddingColumnToPython(const ColumnValues & column)
+{
+    std::vector<size_t> shape = { column.embeddings.size() };
+    size_t rowLength = 1;
+    for (auto dim: column.shape) {
+        shape.push_back(dim);
+        rowLength *= dim;
+    }
+
+    bool allFloat32 = true;
+    for (auto * embedding: column.embeddings) {
+        if (embedding && embedding->getEmbeddingType() != ST_FLOAT32) {
+            allFloat32 = false;
+            break;
+        }
+    }
+
+    if (allFloat32) {
+        float * values;
+        auto result = newColumnArray(std::move(shape), "<f4", values);
+        fillEmbeddings(values, rowLength, ST_FLOAT32, column.embeddings);
+        return boost::python::object(result);
+    }
+
+    double * values;
+    auto result = newColumnArray(std::move(shape), "<f8", values);
+    fillEmbeddings(values, rowLength, ST_FLOAT64, column.embeddings);
+    return boost::python::object(result);
+}
+
+} // file scope
+
+boost::python::object ColumnArrayPy::
+queryColumns(MldbPythonContext * mldbContext, const Utf8String & query)
+{
+    std::vector<NamedRowValue> rows;
+    std::vector<ColumnValues> columns;
+
+    {
+        ReleaseGil releaseGil;
+
+        rows = mldbContext->getPyContext()->server->queryExpr(query);
+
+        std::map<Path, size_t> columnIndex;
+
+        auto getColumn = [&] (const Path & name, bool isEmbedding)
+            -> ColumnValues &
+            {
+                auto it = columnIndex.find(name);
+                if (it == columnIndex.end()) {
+                    it = columnIndex.emplace(name, columns.size()).first;
+                    columns.emplace_back();
+                    columns.back().name = name;
+                    columns.back().isEmbedding = isEmbedding;
+                }
+                ColumnValues & column = columns[it->second];
+                if (column.isEmbedding != isEmbedding) {
+                    throw HttpReturnException
+                        (400, "Column '" + name.toUtf8String()
+                         + "' has both embeddings and other values",
+                         "query", query);
+                }
+                return column;
+            };
+
+        for (size_t i = 0;  i < rows.size();  ++i) {
+            for (auto & c: rows[i].columns) {
+                const PathElement & name = std::get<0>(c);
+                const ExpressionValue & value = std::get<1>(c);
+
+                if (value.isEmbedding()) {
+                    ColumnValues & column = getColumn(name, true);
+                    DimsVector shape = value.getEmbeddingShape();
+                    if (column.embeddings.empty())
+                        column.shape = shape;
+                    else if (shape != column.shape) {
+                        throw HttpReturnException
+                            (400, "Embeddings of column '"
+                             + name.toUtf8String()
+                             + "' have different shapes",
+                             "query", query,
+                             "shape", std::vector<size_t>(column.shape.begin(),
+                                                          column.shape.end()),
+                             "otherShape", std::vector<size_t>(shape.begin(),
+                                                               shape.end()));
+                    }
+                    column.embeddings.resize(i + 1);
+                    column.embeddings[i] = &value;
+                }
+                else if (value.isRow()) {
+                    auto onAtom = [&] (const Path & columnName,
+                                       const Path & prefix,
+                                       const CellValue & val,
+                                       Date ts)
+                        {
+                            ColumnValues & column
+                                = getColumn(prefix + columnName, false);
+                            column.atoms.resize(i + 1);
+                            column.atoms[i] = val;
+                            return true;
+                        };
+                    value.forEachAtom(onAtom, name);
+                }
+                else {
+                    ColumnValues & column = getColumn(name, false);
+                    column.atoms.resize(i + 1);
+                    column.atoms[i] = value.getAtom();
+                }
+            }
+        }
+
+        for (auto & column: columns) {
+            column.atoms.resize(column.isEmbedding ? 0 : rows.size());
+            column.embeddings.resize(column.isEmbedding ? rows.size() : 0);
+        }
+    }
+
+    boost::python::list rowNames;
+    for (auto & row: rows)
+        rowNames.append(row.rowName.toUtf8String());
+
+    boost::python::object result
+        = boost::python::import("collections").attr("OrderedDict")();
+    result["_rowName"] = rowNames;
+
+    for (auto & column: columns) {
+        result[column.name.toUtf8String()]
+            = column.isEmbedding
+            ? embeddingColumnToPython(column)
+            : atomColumnToPython(column.atoms);
+    }
+
+    return result;
+}
+
+
 /****************************************************************************/
 /* PythonProcedure                                                           */
 /****************************************************************************/
@@ -14,6 +14,7 @@
 #include "mldb/core/dataset.h"
 #include "mldb/core/function.h"
 #include "mldb/core/procedure.h"
+#include <boost/python/object.hpp>
 
 
 using namespace std;
@@ -53,6 +54,49 @@ struct DatasetPy {
 };
 
 
+/****************************************************************************/
+/* ColumnArrayPy                                                            */
+/****************************************************************************/
+
+/** A column of a query result as a contiguous array of numbers, which is
+    exposed to Python through the __array_interface__ protocol so that
+    numpy.asarray() can use it in place, without creating a Python object
+    per value.  The first dimension is the row; embeddings have the shape
+    of the embedding as further dimensions.
+*/
+
+struct ColumnArrayPy {
+
+    /// Memory holding the values, which lives as long as the array
+    std::shared_ptr<const void> storage;
+
+    /// Pointer to the first value
+    const void * data = nullptr;
+
+    /// Shape of the array, with the number of rows first
+    std::vector<size_t> shape;
+
+    /// numpy type string of the values: "<f4", "<f8" or "<i8"
+    std::string typestr;
+
+    size_t length() const;
+
+    /** Return the __array_interface__ dictionary describing the array. */
+    boost::python::object arrayInterface() const;
+
+    boost::python::object getShape() const;
+
+    /** Run the query and return its columns, in order of their first
+        appearance, as an OrderedDict whose first entry is "_rowName"
+        with the list of row names.  Numeric columns and embeddings are
+        returned as column arrays, with null values as NaN.  Columns with
+        other values are returned as lists.
+    */
+    static boost::python::object
+    queryColumns(MldbPythonContext * c, const Utf8String & query);
+};
+
+
 /****************************************************************************/
 /* PythonProcedure                                                           */
 /****************************************************************************/
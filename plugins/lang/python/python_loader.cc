@@ -251,6 +251,7 @@ PythonPlugin(MldbServer * server,
              std::function<bool (const Json::Value & progress)> onProgress)
     : Plugin(server), initialGetStatus(true)
 {
+    initPythonInterpreter();
 
     PluginResource res = config.params.convert<PluginResource>();
     try {
@@ -491,6 +492,8 @@ handleTypeRoute(RestDirectory * server,
                 const RestRequest & request,
                 RestRequestParsingContext & context)
 {
+    initPythonInterpreter();
+
     if (context.resources.back() == "run") {
         auto scriptConfig = jsonDecodeStr<ScriptResource>(request.payload).toPluginConfig();
 
@@ -803,6 +806,9 @@ class mldb_wrapper(object):
                 'format' : 'table'
             }).json()
 
+        def query_columns(self, query):
+            return self._mldb.query_columns(query)
+
         def run_tests(self):
             import StringIO
             io_stream = StringIO.StringIO()
@@ -1019,187 +1025,211 @@ logArgs(boost::python::tuple args, boost::python::dict kwargs)
     return bp::object();
 }
 
-struct AtInit {
-    AtInit()
-    {
-        Py_Initialize();
-
-        PyEval_InitThreads();
-        mainThreadState = PyEval_SaveThread();
-        PyEval_AcquireThread(mainThreadState);
-
-        signal(SIGINT, SIG_DFL);
-
-        namespace bp = boost::python;
-
-        PyDateTime_IMPORT;
-        from_python_converter< Date, DateFromPython >();
-
-        from_python_converter< std::string, StringFromPyUnicode>();
-        from_python_converter< Utf8String,  Utf8StringPyConverter>();
-        bp::to_python_converter< Utf8String, Utf8StringPyConverter>();
-
-        from_python_converter< RowPath, StrConstructableIdFromPython<RowPath> >();
-        from_python_converter< ColumnPath, StrConstructableIdFromPython<ColumnPath> >();
-        from_python_converter< CellValue, CellValueConverter >();
-
-        from_python_converter< RowCellTuple,
-                               Tuple3ElemConverter<ColumnPath, CellValue, Date> >();
-
-        from_python_converter< std::vector<RowCellTuple>,
-                               VectorConverter<RowCellTuple>>();
-
-        from_python_converter< std::pair<RowPath, std::vector<RowCellTuple> >,
-                               PairConverter<RowPath, std::vector<RowCellTuple> > >();
-
-        from_python_converter< std::vector<std::pair<RowPath, std::vector<RowCellTuple> > >,
-                               VectorConverter<std::pair<RowPath, std::vector<RowCellTuple> > > >();
-
-        from_python_converter< ColumnCellTuple,
-                               Tuple3ElemConverter<RowPath, CellValue, Date> >();
-
-        from_python_converter< std::vector<ColumnCellTuple>,
-                               VectorConverter<ColumnCellTuple>>();
-
-        from_python_converter< std::pair<ColumnPath, std::vector<ColumnCellTuple> >,
-                               PairConverter<ColumnPath, std::vector<ColumnCellTuple> > >();
-
-        from_python_converter< std::vector<std::pair<ColumnPath, std::vector<ColumnCellTuple> > >,
-                               VectorConverter<std::pair<ColumnPath, std::vector<ColumnCellTuple> > > >();
-
-        from_python_converter<std::pair<string, string>,
-                        PairConverter<string, string> >();
-
-        bp::to_python_converter<std::pair<string, string>,
-                        PairConverter<string, string> >();
-        
-        from_python_converter< Path, PathConverter>();
-
-        from_python_converter< RestParams, RestParamsConverter>();
-        bp::to_python_converter< RestParams, RestParamsConverter>();
-
-        from_python_converter< Json::Value, JsonValueConverter>();
-        bp::to_python_converter< Json::Value, JsonValueConverter> ();
-
-        bp::class_<PythonRestRequest, std::shared_ptr<PythonRestRequest>, boost::noncopyable>("rest_request", bp::no_init)
-           .add_property("remaining",
-               make_getter(&PythonRestRequest::remaining,
-               bp::return_value_policy<bp::return_by_value>()))
-           .add_property("verb",
-               make_getter(&PythonRestRequest::verb,
-               bp::return_value_policy<bp::return_by_value>()))
-           .add_property("resource",
-               make_getter(&PythonRestRequest::resource,
-               bp::return_value_policy<bp::return_by_value>()))
-           .add_property("rest_params",
-               make_getter(&PythonRestRequest::restParams,
-               bp::return_value_policy<bp::return_by_value>()))
-           .add_property("payload",
-               make_getter(&PythonRestRequest::payload,
-               bp::return_value_policy<bp::return_by_value>()))
-           .add_property("content_type",
-               make_getter(&PythonRestRequest::contentType,
-               bp::return_value_policy<bp::return_by_value>()))
-           .add_property("content_length",
-               make_getter(&PythonRestRequest::contentLength,
-               bp::return_value_policy<bp::return_by_value>()))
-           .add_property("headers",
-               make_getter(&PythonRestRequest::headers,
-               bp::return_value_policy<bp::return_by_value>()))
-        ;
+/// Thread state of the thread that started the interpreter, or null if it
+/// hasn't been started
+PyThreadState * mainThreadState = nullptr;
+
+void startInterpreter()
+{
+    Py_Initialize();
+
+    PyEval_InitThreads();
+    mainThreadState = PyEval_SaveThread();
+    PyEval_AcquireThread(mainThreadState);
+
+    signal(SIGINT, SIG_DFL);
+
+    namespace bp = boost::python;
+
+    PyDateTime_IMPORT;
+    initConverters();
+    from_python_converter< Date, DateFromPython >();
+
+    from_python_converter< std::string, StringFromPyUnicode>();
+    from_python_converter< Utf8String,  Utf8StringPyConverter>();
+    bp::to_python_converter< Utf8String, Utf8StringPyConverter>();
+
+    from_python_converter< RowPath, StrConstructableIdFromPython<RowPath> >();
+    from_python_converter< ColumnPath, StrConstructableIdFromPython<ColumnPath> >();
+    from_python_converter< CellValue, CellValueConverter >();
+
+    from_python_converter< RowCellTuple,
+                           Tuple3ElemConverter<ColumnPath, CellValue, Date> >();
+
+    from_python_converter< std::vector<RowCellTuple>,
+                           VectorConverter<RowCellTuple>>();
+
+    from_python_converter< std::pair<RowPath, std::vector<RowCellTuple> >,
+                           PairConverter<RowPath, std::vector<RowCellTuple> > >();
+
+    from_python_converter< std::vector<std::pair<RowPath, std::vector<RowCellTuple> > >,
+                           VectorConverter<std::pair<RowPath, std::vector<RowCellTuple> > > >();
+
+    from_python_converter< ColumnCellTuple,
+                           Tuple3ElemConverter<RowPath, CellValue, Date> >();
+
+    from_python_converter< std::vector<ColumnCellTuple>,
+                           VectorConverter<ColumnCellTuple>>();
 
-        bp::class_<DatasetPy>("dataset", bp::no_init)
-            .def("record_row", &DatasetPy::recordRow)
-            .def("record_rows", &DatasetPy::recordRows)
-            .def("record_column", &DatasetPy::recordColumn)
-            .def("record_columns", &DatasetPy::recordColumns)
-            .def("commit", &DatasetPy::commit);
-
-        bp::class_<PythonPluginContext,
-            std::shared_ptr<PythonPluginContext>,
-            boost::noncopyable>
-            plugin("Plugin", bp::no_init);
-        bp::class_<PythonScriptContext,
-            std::shared_ptr<PythonScriptContext>,
-            boost::noncopyable>
-            script("Script", bp::no_init);
-        bp::class_<MldbPythonContext,
-             std::shared_ptr<MldbPythonContext>,
-            boost::noncopyable>
-             mldb("Mldb", bp::no_init);
-
-        script.add_property("args", &PythonContext::getArgs);
-        script.def("set_return", &PythonScriptContext::setReturnValue1);
-
-        plugin.add_property("args", &PythonContext::getArgs);
-        plugin.add_property("rest_params", &PythonPluginContext::getRestRequest);
-        plugin.def("serve_static_folder",
-                   &PythonPluginContext::serveStaticFolder);
-        plugin.def("serve_documentation_folder",
-                   &PythonPluginContext::serveDocumentationFolder);
-        plugin.def("get_plugin_dir",
-                   &PythonPluginContext::getPluginDirectory);
-        plugin.def("set_return", &PythonPluginContext::setReturnValue);
-        plugin.def("set_return", &PythonPluginContext::setReturnValue1);
-
-
-        mldb.def("set_return", &PythonContext::setReturnValue1);
-        mldb.def("log", bp::raw_function(logArgs, 1));
-        mldb.def("log", &MldbPythonContext::logUnicode);
-        mldb.def("log", &MldbPythonContext::logJsVal);
-        mldb.def("perform", perform); // for 5 args
-        mldb.def("perform", perform4); // for 4 args
-        mldb.def("perform", perform3); // for 3 args
-        mldb.def("perform", perform2); // for 2 args
-        mldb.def("read_lines", readLines);
-        mldb.def("read_lines", readLines1);
-        mldb.def("ls", ls);
-        mldb.def("get_http_bound_address", getHttpBoundAddress);
-        mldb.def("create_dataset",
-                   &DatasetPy::createDataset,
-                   bp::return_value_policy<bp::manage_new_object>());
-        mldb.def("create_procedure", &PythonProcedure::createPythonProcedure);
+    from_python_converter< std::pair<ColumnPath, std::vector<ColumnCellTuple> >,
+                           PairConverter<ColumnPath, std::vector<ColumnCellTuple> > >();
+
+    from_python_converter< std::vector<std::pair<ColumnPath, std::vector<ColumnCellTuple> > >,
+                           VectorConverter<std::pair<ColumnPath, std::vector<ColumnCellTuple> > > >();
+
+    from_python_converter<std::pair<string, string>,
+                    PairConverter<string, string> >();
+
+    bp::to_python_converter<std::pair<string, string>,
+                    PairConverter<string, string> >();
+    
+    from_python_converter< Path, PathConverter>();
+
+    from_python_converter< RestParams, RestParamsConverter>();
+    bp::to_python_converter< RestParams, RestParamsConverter>();
+
+    from_python_converter< Json::Value, JsonValueConverter>();
+    bp::to_python_converter< Json::Value, JsonValueConverter> ();
+
+    bp::class_<PythonRestRequest, std::shared_ptr<PythonRestRequest>, boost::noncopyable>("rest_request", bp::no_init)
+       .add_property("remaining",
+           make_getter(&PythonRestRequest::remaining,
+           bp::return_value_policy<bp::return_by_value>()))
+       .add_property("verb",
+           make_getter(&PythonRestRequest::verb,
+           bp::return_value_policy<bp::return_by_value>()))
+       .add_property("resource",
+           make_getter(&PythonRestRequest::resource,
+           bp::return_value_policy<bp::return_by_value>()))
+       .add_property("rest_params",
+           make_getter(&PythonRestRequest::restParams,
+           bp::return_value_policy<bp::return_by_value>()))
+       .add_property("payload",
+           make_getter(&PythonRestRequest::payload,
+           bp::return_value_policy<bp::return_by_value>()))
+       .add_property("content_type",
+           make_getter(&PythonRestRequest::contentType,
+           bp::return_value_policy<bp::return_by_value>()))
+       .add_property("content_length",
+           make_getter(&PythonRestRequest::contentLength,
+           bp::return_value_policy<bp::return_by_value>()))
+       .add_property("headers",
+           make_getter(&PythonRestRequest::headers,
+           bp::return_value_policy<bp::return_by_value>()))
+    ;
+
+    bp::class_<DatasetPy>("dataset", bp::no_init)
+        .def("record_row", &DatasetPy::recordRow)
+        .def("record_rows", &DatasetPy::recordRows)
+        .def("record_column", &DatasetPy::recordColumn)
+        .def("record_columns", &DatasetPy::recordColumns)
+        .def("commit", &DatasetPy::commit);
+
+    bp::class_<ColumnArrayPy, std::shared_ptr<ColumnArrayPy> >
+        ("column_array", bp::no_init)
+        .add_property("__array_interface__", &ColumnArrayPy::arrayInterface)
+        .add_property("shape", &ColumnArrayPy::getShape)
+        .def("__len__", &ColumnArrayPy::length);
+
+    bp::class_<PythonPluginContext,
+        std::shared_ptr<PythonPluginContext>,
+        boost::noncopyable>
+        plugin("Plugin", bp::no_init);
+    bp::class_<PythonScriptContext,
+        std::shared_ptr<PythonScriptContext>,
+        boost::noncopyable>
+        script("Script", bp::no_init);
+    bp::class_<MldbPythonContext,
+         std::shared_ptr<MldbPythonContext>,
+        boost::noncopyable>
+         mldb("Mldb", bp::no_init);
+
+    script.add_property("args", &PythonContext::getArgs);
+    script.def("set_return", &PythonScriptContext::setReturnValue1);
+
+    plugin.add_property("args", &PythonContext::getArgs);
+    plugin.add_property("rest_params", &PythonPluginContext::getRestRequest);
+    plugin.def("serve_static_folder",
+               &PythonPluginContext::serveStaticFolder);
+    plugin.def("serve_documentation_folder",
+               &PythonPluginContext::serveDocumentationFolder);
+    plugin.def("get_plugin_dir",
+               &PythonPluginContext::getPluginDirectory);
+    plugin.def("set_return", &PythonPluginContext::setReturnValue);
+    plugin.def("set_return", &PythonPluginContext::setReturnValue1);
+
+
+    mldb.def("set_return", &PythonContext::setReturnValue1);
+    mldb.def("log", bp::raw_function(logArgs, 1));
+    mldb.def("log", &MldbPythonContext::logUnicode);
+    mldb.def("log", &MldbPythonContext::logJsVal);
+    mldb.def("perform", perform); // for 5 args
+    mldb.def("perform", perform4); // for 4 args
+    mldb.def("perform", perform3); // for 3 args
+    mldb.def("perform", perform2); // for 2 args
+    mldb.def("read_lines", readLines);
+    mldb.def("read_lines", readLines1);
+    mldb.def("ls", ls);
+    mldb.def("get_http_bound_address", getHttpBoundAddress);
+    mldb.def("create_dataset",
+               &DatasetPy::createDataset,
+               bp::return_value_policy<bp::manage_new_object>());
+    mldb.def("create_procedure", &PythonProcedure::createPythonProcedure);
+    mldb.def("query_columns", &ColumnArrayPy::queryColumns);
 //         mldb.def("create_function", &PythonFunction::createPythonFunction);
 
-        mldb.add_property("script", &MldbPythonContext::getScript);
-        mldb.add_property("plugin", &MldbPythonContext::getPlugin);
+    mldb.add_property("script", &MldbPythonContext::getScript);
+    mldb.add_property("plugin", &MldbPythonContext::getPlugin);
 
-        mldb.def("debugSetPathOptimizationLevel",
-                 &MldbPythonContext::setPathOptimizationLevel);
+    mldb.def("debugSetPathOptimizationLevel",
+             &MldbPythonContext::setPathOptimizationLevel);
 
-        /****
-         *  Functions
-         *  **/
+    /****
+     *  Functions
+     *  **/
 
-        bp::class_<MLDB::Any, boost::noncopyable>("any", bp::no_init)
-            .def("as_json",   &MLDB::Any::asJson)
-            ;
+    bp::class_<MLDB::Any, boost::noncopyable>("any", bp::no_init)
+        .def("as_json",   &MLDB::Any::asJson)
+        ;
 
-        bp::class_<FunctionInfo, boost::noncopyable>("function_info", bp::no_init)
-            ;
-        
-        auto main_module = boost::python::import("__main__"); 
-        auto main_namespace = main_module.attr("__dict__");
+    bp::class_<FunctionInfo, boost::noncopyable>("function_info", bp::no_init)
+        ;
+    
+    auto main_module = boost::python::import("__main__"); 
+    auto main_namespace = main_module.attr("__dict__");
 
-        PyEval_ReleaseLock();
+    PyEval_ReleaseLock();
+}
 
+} // file scope
+
+void initPythonInterpreter()
+{
+    static std::once_flag once;
+    std::call_once(once, startInterpreter);
+}
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+        // The interpreter itself is only started when the type is first
+        // used, as most servers never need it
         registerPluginType<PythonPlugin, PluginResource>
             (builtinPackage(),
              "python",
              "Load plugins or run scripts written in the Python language",
              "lang/Python.md.html",
              &PythonPlugin::handleTypeRoute);
-
     }
 
     ~AtInit() {
+        if (!mainThreadState)
+            return;
         PyThreadState_Swap(mainThreadState);
         Py_Finalize();
     }
-
-    //in main thread
-    PyThreadState * mainThreadState;
-
 } atInit;
 
 
@@ -33,6 +33,8 @@ std::mutex PythonSubinterpreter::youShallNotPassMutex;
 PythonSubinterpreter::
 PythonSubinterpreter(bool isChild) : isChild(isChild)
 {
+    initPythonInterpreter();
+
     if(!isChild) {
         lock = std::unique_ptr<std::lock_guard<std::mutex>>(
                 new std::lock_guard<std::mutex>(PythonSubinterpreter::youShallNotPassMutex));
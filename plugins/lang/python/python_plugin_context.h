@@ -34,10 +34,19 @@
 namespace MLDB {
 
 
+/** Start the Python interpreter, unless that has already been done.  This
+    happens the first time something needs Python rather than when MLDB
+    starts.  It must be called without holding the GIL.
+*/
+void initPythonInterpreter();
+
+
 /****************************************************************************/
 /* PythonSubinterpreter                                                     */
 /****************************************************************************/
 
+/** Each one starts the interpreter if that hasn't been done yet. */
+
 struct PythonSubinterpreter {
 
     PythonSubinterpreter(bool isChild=false);
@@ -20,6 +20,9 @@
 #include "mldb/plugins/sql_expression_extractors.h"
 #include "mldb/plugins/sparse_matrix_dataset.h"
 #include "mldb/server/bound_queries.h"
+#include "mldb/server/per_thread_accumulator.h"
+#include "mldb/base/parallel.h"
+#include <atomic>
 
 using namespace std;
 
@@ -137,7 +140,26 @@ run(const ProcedureRunConfig & run,
     ColumnPath keyColumnName(runProcConf.keyColumnName);
     ColumnPath valueColumnName(runProcConf.valueColumnName);
 
-    std::mutex recordMutex;
+    // Each thread records its output rows in batches into its own chunk
+    // of the output dataset
+    Dataset::MultiChunkRecorder recorder = outputDataset->getChunkRecorder();
+
+    struct ThreadAccum {
+        std::unique_ptr<Recorder> threadRecorder;
+        std::vector<std::pair<RowPath, RowValue> > rows;
+
+        void flush()
+        {
+            if (rows.empty())
+                return;
+            threadRecorder->recordRowsDestructive(std::move(rows));
+            rows.clear();
+        }
+    };
+
+    PerThreadAccumulator<ThreadAccum> accum;
+    std::atomic<size_t> chunkNumber(0);
+
     auto processor = [&] (NamedRowValue & row_,
                            const std::vector<ExpressionValue> & extraVals)
         {
@@ -165,19 +187,24 @@ run(const ProcedureRunConfig & run,
                 expr.forEachAtom(onAtom, ColumnPath());
             }
 
+            auto & threadAccum = accum.get();
+            if (!threadAccum.threadRecorder) {
+                threadAccum.threadRecorder
+                    = recorder.newChunk(chunkNumber.fetch_add(1));
+            }
+
             // Melted
             for(auto & col : row.columns) {
-                // TODO. should I call recordRow twice instead of doing a vector copy here?
                 RowValue currOutputRow(fixedOutputRows);
 
                 currOutputRow.emplace_back(keyColumnName, get<0>(col).toUtf8String(), rowTs);
                 currOutputRow.emplace_back(valueColumnName, get<1>(col), rowTs);
 
-                RowPath rowName = row.rowName + std::get<0>(col);
-
-                std::unique_lock<std::mutex> guard(recordMutex);
-                outputDataset->recordRow(rowName, currOutputRow);
+                threadAccum.rows.emplace_back(row.rowName + std::get<0>(col),
+                                              std::move(currOutputRow));
             }
+            if (threadAccum.rows.size() >= 1024)
+                threadAccum.flush();
             return true;
         };
 
@@ -193,6 +220,17 @@ run(const ProcedureRunConfig & run,
                  runProcConf.inputData.stm->limit,
                  nullptr /* progress */);
 
+    // Record what's left of each thread's rows
+    parallelMap(0, accum.threads.size(),
+                [&] (size_t n)
+                {
+                    auto & threadAccum = *accum.threads[n];
+                    if (!threadAccum.threadRecorder)
+                        return;
+                    threadAccum.flush();
+                    threadAccum.threadRecorder->finishedChunk();
+                });
+
     outputDataset->commit();
 
     return RunOutput();
@@ -62,40 +62,48 @@ create(MetricSpace space)
 /* EUCLIDEAN DISTANCE METRIC                                                 */
 /*****************************************************************************/
 
+DistanceMetric *
+EuclideanDistanceMetric::
+clone() const
+{
+    return new EuclideanDistanceMetric(*this);
+}
+
 void
 EuclideanDistanceMetric::
-addRow(int rowNum, const distribution<float> & coords)
+addRow(int rowNum, const float * coords, size_t n)
 {
     //cerr << "addRow " << rowNum << endl;
     ExcAssertEqual(rowNum, sum_dist.size());
-    sum_dist.push_back(coords.dotprod(coords));
-    ExcAssert(isfinite(sum_dist.back()));
+    // Checked before it's added, so that a failed row leaves no trace
+    double sum = ML::SIMD::vec_dotprod_dp(coords, coords, n);
+    ExcAssert(isfinite(sum));
+    sum_dist.push_back(sum);
 }
 
 float
 EuclideanDistanceMetric::
-calc(const distribution<float> & coords1,
-     const distribution<float> & coords2)
+calc(const float * coords1,
+     const float * coords2,
+     size_t n)
 {
-    return sqrt(ML::SIMD::vec_euclid(coords1.data(), coords2.data(), coords1.size()));
-    return (coords2 - coords1).two_norm();
+    return sqrt(ML::SIMD::vec_euclid(coords1, coords2, n));
 }
 
 float
 EuclideanDistanceMetric::
 dist(int rowNum1, int rowNum2,
-     const distribution<float> & coords1,
-     const distribution<float> & coords2) const
+     const float * coords1,
+     const float * coords2,
+     size_t n) const
 {
-    ExcAssertEqual(coords1.size(), coords2.size());
-
     if (rowNum1 == -1 || rowNum2 == -1) {
-        return calc(coords1, coords2);
+        return calc(coords1, coords2, n);
     }
 
     // Make sure dist(x,y) == dist(y,x) irrespective of rounding
     if (rowNum2 < rowNum1)
-        return dist(rowNum2, rowNum1, coords2, coords1);
+        return dist(rowNum2, rowNum1, coords2, coords1, n);
 
     // Make sure dist(x,x) == 0 irrespective of rounding
     if (rowNum1 == rowNum2)
@@ -114,9 +122,7 @@ dist(int rowNum1, int rowNum2,
     */
         
     // Use the optimized version, since we know the sum
-    float dpResult = -2.0 * ML::SIMD::vec_dotprod_dp(&coords1[0],
-                                                     &coords2[0],
-                                                     coords1.size());
+    float dpResult = -2.0 * ML::SIMD::vec_dotprod_dp(coords1, coords2, n);
     ExcAssert(isfinite(dpResult));
 
 
@@ -136,12 +142,19 @@ dist(int rowNum1, int rowNum2,
 /* COSINE DISTANCE METRIC                                                    */
 /*****************************************************************************/
 
+DistanceMetric *
+CosineDistanceMetric::
+clone() const
+{
+    return new CosineDistanceMetric(*this);
+}
+
 void
 CosineDistanceMetric::
-addRow(int rowNum, const distribution<float> & coords)
+addRow(int rowNum, const float * coords, size_t n)
 {
     ExcAssertEqual(rowNum, two_norm_recip.size());
-    float twonorm = coords.two_norm();
+    float twonorm = sqrt(ML::SIMD::vec_dotprod_dp(coords, coords, n));
 
     // If it's zero, we store the non-finite reciprocal, and the distance
     // it and any vector with a finite reciprocal is 1.
@@ -150,20 +163,20 @@ addRow(int rowNum, const distribution<float> & coords)
         two_norm_recip.push_back(1.0 / 0.0);
         return;
         throw HttpReturnException(400, "Attempt to add zero magnitude vector to cosine distance",
-                                  "coords", coords,
+                                  "coords", distribution<float>(coords, coords + n),
                                   "twoNorm", twonorm);
     }
 
     if (!isfinite(twonorm))
         throw HttpReturnException(400, "Attempt to add vector with non-finite two norm "
                                   "to cosine distance",
-                                  "coords", coords,
+                                  "coords", distribution<float>(coords, coords + n),
                                   "twoNorm", twonorm);
     float recip = 1.0 / twonorm;
     if (!isfinite(recip))
         throw HttpReturnException(400, "Attempt to add vector with non-finite two norm reciprocal "
                                   "to cosine distance",
-                                  "coords", coords,
+                                  "coords", distribution<float>(coords, coords + n),
                                   "twoNorm", twonorm,
                                   "recip", recip);
     
@@ -172,48 +185,32 @@ addRow(int rowNum, const distribution<float> & coords)
 
 float
 CosineDistanceMetric::
-calc(const distribution<float> & coords1,
-     const distribution<float> & coords2)
+calc(const float * coords1,
+     const float * coords2,
+     size_t n)
 {
-    if ((coords1 == coords2).all())
+    if (std::equal(coords1, coords1 + n, coords2))
         return 0.0;
 
-    double norm1 = coords1.two_norm();
-    double norm2 = coords2.two_norm();
-
-    if (norm1 == 0.0 && norm2 == 0.0) {
-        return 0.0;
-    }
-    
-    if (norm1 == 0.0 || norm2 == 0.0) {
-        return 1.0;
-
-        throw HttpReturnException(400, "Error: can't calculate cosine distance between "
-                                  "zero length vectors",
-                                  "vec1", coords1,
-                                  "vec2", coords2,
-                                  "vec1norm", norm1,
-                                  "vec2norm", norm2);
-    }
-    
-    return std::max(1 - (coords1.dotprod(coords2) / (norm1 * norm2)), 0.0);
+    // One pass over both vectors for the dot product and both norms,
+    // rather than one pass for each of them.
+    return ML::SIMD::vec_cosine_distance(coords1, coords2, n);
 }
 
 float
 CosineDistanceMetric::
 dist(int rowNum1, int rowNum2,
-     const distribution<float> & coords1,
-     const distribution<float> & coords2) const
+     const float * coords1,
+     const float * coords2,
+     size_t n) const
 {
-    ExcAssertEqual(coords1.size(), coords2.size());
-
     if (rowNum1 == -1 || rowNum2 == -1) {
-        return calc(coords1, coords2);
+        return calc(coords1, coords2, n);
     }
 
     // Make sure dist(x,y) == dist(y,x) irrespective of rounding
     if (rowNum2 < rowNum1)
-        return dist(rowNum2, rowNum1, coords2, coords1);
+        return dist(rowNum2, rowNum1, coords2, coords1, n);
 
     // Make sure dist(x,x) == 0 irrespective of rounding
     if (rowNum1 == rowNum2)
@@ -228,7 +225,8 @@ dist(int rowNum1, int rowNum2,
         return 1.0;
     }
 
-    float result = 1.0 - coords1.dotprod(coords2) * two_norm_recip.at(rowNum1) * two_norm_recip.at(rowNum2);
+    float result = 1.0 - ML::SIMD::vec_dotprod_dp(coords1, coords2, n)
+        * two_norm_recip.at(rowNum1) * two_norm_recip.at(rowNum2);
     if (result < 0.0) {
         result = 0.0;
 #if 0
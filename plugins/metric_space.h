@@ -33,16 +33,21 @@ struct DistanceMetric {
     {
     }
 
-    /** Add a row, caching information about it. */
-    virtual void addRow(int rowNum, const distribution<float> & coords) = 0;
+    /** Add a row of n coordinates, caching information about it. */
+    virtual void addRow(int rowNum, const float * coords, size_t n) = 0;
 
-    /** Calculate the distance between two rows.  If either of them have
-        a known number, it is passed in rowNum, otherwise that rowNum
-        will be -1.
+    /** Calculate the distance between two rows of n coordinates.  If
+        either of them have a known number, it is passed in rowNum,
+        otherwise that rowNum will be -1.
     */
     virtual float dist(int rowNum1, int rowNum2,
-                       const distribution<float> & coords1,
-                       const distribution<float> & coords2) const = 0;
+                       const float * coords1,
+                       const float * coords2,
+                       size_t n) const = 0;
+
+    /** Return a copy of this metric, including what it cached about the
+        rows already added. */
+    virtual DistanceMetric * clone() const = 0;
 
     /** Factor for distance metric objects. */
     static DistanceMetric * create(MetricSpace space);
@@ -55,19 +60,23 @@ struct DistanceMetric {
 
 struct EuclideanDistanceMetric: public DistanceMetric {
 
-    void addRow(int rowNum, const distribution<float> & coords);
+    void addRow(int rowNum, const float * coords, size_t n);
+
+    DistanceMetric * clone() const;
 
     float dist(int rowNum1, int rowNum2,
-               const distribution<float> & coords1,
-               const distribution<float> & coords2) const;
+               const float * coords1,
+               const float * coords2,
+               size_t n) const;
 
     /// Pre cached ||vec||^2 for each row, to allow optimization of the
     /// calculation.
     std::vector<double> sum_dist;
 
     /// Static method to perform the calculation, with no caching
-    static float calc(const distribution<float> & coords1,
-                      const distribution<float> & coords2);
+    static float calc(const float * coords1,
+                      const float * coords2,
+                      size_t n);
 };
 
 
@@ -77,19 +86,23 @@ struct EuclideanDistanceMetric: public DistanceMetric {
 
 struct CosineDistanceMetric: public DistanceMetric {
 
-    void addRow(int rowNum, const distribution<float> & coords);
+    void addRow(int rowNum, const float * coords, size_t n);
+
+    DistanceMetric * clone() const;
 
     float dist(int rowNum1, int rowNum2,
-               const distribution<float> & coords1,
-               const distribution<float> & coords2) const;
+               const float * coords1,
+               const float * coords2,
+               size_t n) const;
 
     /// Pre-cached reciprocal of the two norm of each vector, to allow
     /// optimization of the calculation.
     std::vector<double> two_norm_recip;
     
     /// Static method to perform the calculation, with no caching
-    static float calc(const distribution<float> & coords1,
-                      const distribution<float> & coords2);
+    static float calc(const float * coords1,
+                      const float * coords2,
+                      size_t n);
 };
 
 
@@ -9,6 +9,7 @@
 
 #include "mldb/core/value_function.h"
 #include "mldb/ext/libstemmer/libstemmer.h"
+#include "mldb/utils/frozen_string_set.h"
 #include <mutex>
 
 
@@ -53,8 +54,7 @@ struct ApplyStopWordsFunction: public ValueFunctionT<Words, Words> {
     
     virtual Words call(Words input) const override;
 
-    std::map<std::string, std::set<std::string> > stopwords;
-    std::set<std::string> * selected_stopwords;
+    const FrozenStringSet * selected_stopwords;
 
     ApplyStopWordsFunctionConfig functionConfig;
 };
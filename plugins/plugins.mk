@@ -12,6 +12,7 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	script_procedure.cc \
 	permuter_procedure.cc \
 	external_python_procedure.cc \
+	shared_memory_table.cc \
 	experiment_procedure.cc \
 	docker_plugin.cc \
 	continuous_dataset.cc \
@@ -29,13 +30,20 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	importtext_procedure.cc \
 	tabular_dataset.cc \
 	frozen_column.cc \
+	frozen_memory.cc \
+	tiered_frozen_column.cc \
 	column_types.cc \
 	tabular_dataset_column.cc \
 	tabular_dataset_chunk.cc \
+	tabular_file.cc \
+	tabular_file_procedures.cc \
+	tabular_replica_dataset.cc \
+	sharded_dataset.cc \
 	randomforest_procedure.cc \
 	classifier.cc \
 	sql_functions.cc \
 	embedding.cc \
+	geo_index.cc \
 	svd.cc \
 	kmeans.cc \
 	probabilizer.cc \
@@ -58,7 +66,9 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 # Needed so that Python plugin can find its header
 $(eval $(call set_compile_option,python_plugin_loader.cc,-I$(PYTHON_INCLUDE_PATH)))
 
-$(eval $(call library,mldb_builtin_plugins,$(LIBMLDB_BUILTIN_PLUGIN_SOURCES),datacratic_sqlite ml mldb_lang_plugins mldb_algo_plugins mldb_misc_plugins mldb_ui_plugins tsne svm libstemmer edlib algebra svdlibc uap))
+$(eval $(call set_compile_option,geo_index.cc,$(S2_COMPILE_OPTIONS) $(S2_WARNING_OPTIONS)))
+
+$(eval $(call library,mldb_builtin_plugins,$(LIBMLDB_BUILTIN_PLUGIN_SOURCES),datacratic_sqlite ml mldb_lang_plugins mldb_algo_plugins mldb_misc_plugins mldb_ui_plugins tsne svm libstemmer edlib algebra svdlibc uap lz4 s2))
 $(eval $(call library_forward_dependency,mldb_builtin_plugins,mldb_lang_plugins mldb_algo_plugins mldb_misc_plugins mldb_ui_plugins))
 
 $(eval $(call include_sub_make,lang))
@@ -5,6 +5,7 @@
 */
 
 #include "pooling_function.h"
+#include "embedding.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/any_impl.h"
@@ -14,6 +15,9 @@
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/jml/utils/profile.h"
 #include "mldb/jml/stats/distribution.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/base/parallel.h"
+#include <limits>
 
 using namespace std;
 
@@ -100,6 +104,9 @@ PoolingFunction(MldbServer * owner,
     boundEmbeddingDataset = functionConfig.embeddingDataset->bind(context);
     
     columnNames = boundEmbeddingDataset.dataset->getRowInfo()->allColumnNames();
+
+    embedding = std::dynamic_pointer_cast<EmbeddingDataset>
+        (boundEmbeddingDataset.dataset);
 }
 
 struct PoolingFunctionApplier: public FunctionApplierT<PoolingInput, PoolingOutput> {
@@ -122,6 +129,14 @@ applyT(const ApplierT & applier_, PoolingInput input) const
 
     auto & applier = static_cast<const PoolingFunctionApplier &>(applier_);
 
+    if (embedding) {
+        EmbeddingMatrixView view = embedding->getEmbeddingView();
+        PoolingOutput output;
+        if (view.getColumnNames() == columnNames
+            && poolEmbedding(view, input.words, output))
+            return output;
+    }
+
     size_t num_embed_cols = columnNames.size() * functionConfig.aggregators.size();
 
     Date outputTs = input.words.getEffectiveTimestamp();
@@ -161,6 +176,128 @@ applyT(const ApplierT & applier_, PoolingInput input) const
 
     return {ExpressionValue(std::move(outputEmbedding), outputTs)};
 }
+
+bool
+PoolingFunction::
+poolEmbedding(const EmbeddingMatrixView & view,
+              const ExpressionValue & words,
+              PoolingOutput & output) const
+{
+    if (!words.isRow())
+        return false;
+
+    size_t n = columnNames.size();
+    Date outputTs = words.getEffectiveTimestamp();
+
+    // Like rowName() IN (KEYS OF $words), each row is pooled once however
+    // many times its word appears.  Sorting also makes the gather walk
+    // the rows in the order they are stored.
+    std::vector<int> rows;
+    auto onWord = [&] (const PathElement & word, const ExpressionValue &)
+        {
+            int index = view.getRowIndex(RowPath(word));
+            if (index != -1)
+                rows.push_back(index);
+            return true;
+        };
+    words.forEachColumn(onWord);
+
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    std::vector<double> outputEmbedding;
+    outputEmbedding.reserve(n * functionConfig.aggregators.size());
+
+    if (rows.empty()) {
+        outputEmbedding.resize(n * functionConfig.aggregators.size(), 0.0);
+        output.embedding = ExpressionValue(std::move(outputEmbedding), outputTs);
+        return true;
+    }
+
+    bool needSums = false, needMinMax = false;
+    for (auto & agg: functionConfig.aggregators) {
+        if (agg == "avg" || agg == "sum")
+            needSums = true;
+        else needMinMax = true;
+    }
+
+    std::vector<double> sums;
+    std::vector<float> mins, maxs;
+    if (needSums)
+        sums.resize(n, 0.0);
+    if (needMinMax) {
+        mins.resize(n, std::numeric_limits<float>::infinity());
+        maxs.resize(n, -std::numeric_limits<float>::infinity());
+    }
+
+    // Only used if the embedding's coordinates aren't stored as floats
+    std::vector<float> buffer(n);
+
+    for (int index: rows) {
+        const float * coords = view.getRowCoords(index, buffer.data());
+        if (needSums)
+            SIMD::vec_add(sums.data(), coords, sums.data(), n);
+        if (needMinMax)
+            SIMD::vec_min_max_el(coords, mins.data(), maxs.data(), n);
+        outputTs.setMax(view.getRowTimestamp(index));
+    }
+
+    for (auto & agg: functionConfig.aggregators) {
+        if (agg == "avg") {
+            for (double v: sums)
+                outputEmbedding.push_back(v / rows.size());
+        }
+        else if (agg == "sum")
+            outputEmbedding.insert(outputEmbedding.end(),
+                                   sums.begin(), sums.end());
+        else if (agg == "min")
+            outputEmbedding.insert(outputEmbedding.end(),
+                                   mins.begin(), mins.end());
+        else outputEmbedding.insert(outputEmbedding.end(),
+                                    maxs.begin(), maxs.end());
+    }
+
+    output.embedding = ExpressionValue(std::move(outputEmbedding), outputTs);
+    return true;
+}
+
+std::vector<ExpressionValue>
+PoolingFunction::
+applyBatch(const FunctionApplier & applier_,
+           std::vector<ExpressionValue> inputs) const
+{
+    if (!embedding)
+        return Function::applyBatch(applier_, std::move(inputs));
+
+    auto & applier = static_cast<const PoolingFunctionApplier &>(applier_);
+
+    // Same chunking as Function::applyBatch(); each chunk of inputs is
+    // pooled against a single view of the embedding
+    static constexpr size_t CHUNK_SIZE = 64;
+
+    std::vector<ExpressionValue> outputs(inputs.size());
+
+    auto doChunk = [&] (size_t first, size_t last)
+        {
+            EmbeddingMatrixView view = embedding->getEmbeddingView();
+            bool useView = view.getColumnNames() == columnNames;
+
+            for (size_t i = first;  i < last;  ++i) {
+                PoolingInput input;
+                fromInput(&input, inputs[i]);
+                PoolingOutput output;
+                if (!useView || !poolEmbedding(view, input.words, output))
+                    output = applyT(applier, std::move(input));
+                outputs[i] = toOutput(&output);
+            }
+        };
+
+    if (inputs.size() <= CHUNK_SIZE)
+        doChunk(0, inputs.size());
+    else parallelMapChunked(0, inputs.size(), CHUNK_SIZE, doChunk);
+
+    return outputs;
+}
     
 std::unique_ptr<FunctionApplierT<PoolingInput, PoolingOutput> >
 PoolingFunction::
@@ -38,6 +38,9 @@ DECLARE_STRUCTURE_DESCRIPTION(PoolingFunctionConfig);
 /* POOLING FUNCTION                                                          */
 /*****************************************************************************/
 
+struct EmbeddingDataset;
+struct EmbeddingMatrixView;
+
 struct PoolingInput {
     ExpressionValue words;
 };
@@ -58,6 +61,13 @@ struct PoolingFunction: public ValueFunctionT<PoolingInput, PoolingOutput> {
     virtual PoolingOutput applyT(const ApplierT & applier, 
                                  PoolingInput input) const override;
     
+    /** Pool each input's words with one view of the embedding dataset per
+        chunk of inputs, when it is an embedding dataset.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               std::vector<ExpressionValue> inputs) const override;
+
     virtual std::unique_ptr<FunctionApplierT<PoolingInput, PoolingOutput> >
     bindT(SqlBindingScope & outerContext,
           const std::vector<std::shared_ptr<ExpressionValueInfo> > & input)
@@ -71,6 +81,20 @@ struct PoolingFunction: public ValueFunctionT<PoolingInput, PoolingOutput> {
     std::vector<ColumnPath> columnNames;
 
     SelectExpression select;
+
+    /// Set when embeddingDataset is of type embedding, whose rows can then
+    /// be pooled directly instead of through the query
+    std::shared_ptr<EmbeddingDataset> embedding;
+
+private:
+    /** Pool the coordinates of the rows of the view named by the keys of
+        words into output.  The view must have the same columns as
+        columnNames.  Returns false if words isn't a row, in which case
+        the query has to be run instead.
+    */
+    bool poolEmbedding(const EmbeddingMatrixView & view,
+                       const ExpressionValue & words,
+                       PoolingOutput & output) const;
 };
 
 } // namespace MLDB
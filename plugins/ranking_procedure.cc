@@ -20,7 +20,10 @@
 #include "mldb/types/date.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/plugins/sql_config_validator.h"
+#include "mldb/sql/t_digest.h"
+#include "mldb/http/http_exception.h"
 #include <memory>
+#include <cmath>
 
 using namespace std;
 
@@ -32,7 +35,10 @@ DEFINE_ENUM_DESCRIPTION(RankingType);
 RankingTypeDescription::
 RankingTypeDescription()
 {
-    //addValue("percentile", PERCENTILE);
+    addValue("percentile", PERCENTILE,
+             "Gives the percentage of the rows that sort at or before the "
+             "row, ranging from 100 / n to 100, where n is the number of "
+             "rows.");
     addValue("index", INDEX, 
              "Gives an integer index ranging from 0 to n - 1, where "
              "n is the number of rows.");
@@ -40,7 +46,8 @@ RankingTypeDescription()
 
 RankingProcedureConfig::
 RankingProcedureConfig() :
-    rankingType(RankingType::INDEX), rankingColumnName("rank")
+    rankingType(RankingType::INDEX), rankingColumnName("rank"),
+    approximate(false)
 {
     outputDataset.withType("sparse.mutable");
 }
@@ -58,11 +65,15 @@ RankingProcedureConfigDescription()
              GENERIC_OUTPUT_DS_DESC,
              PolyConfigT<Dataset>().withType("sparse.mutable"));
     addField("rankingType", &RankingProcedureConfig::rankingType,
-             "The type of the rank to output. The only accepted value is "
-             "`index`. It generates an integer based rank ranging from 0 to "
-             "n - 1.", INDEX);
+             "The type of the rank to output: `index` for an integer rank "
+             "or `percentile` for a percentile rank.", INDEX);
     addField("rankingColumnName", &RankingProcedureConfig::rankingColumnName,
              "The name to give to the ranking column.", string("rank"));
+    addField("approximate", &RankingProcedureConfig::approximate,
+             "If true, the ranks are approximated from a sketch of the "
+             "distribution of the order by value, without sorting the rows. "
+             "This requires a single numeric order by clause, and no offset "
+             "or limit.", false);
     addParent<ProcedureConfig>();
     onPostValidate = validateQuery(&RankingProcedureConfig::inputData,
                                    MustContainFrom());
@@ -77,6 +88,30 @@ RankingProcedure(MldbServer * owner,
     procedureConfig = config.params.convert<RankingProcedureConfig>();
 }
 
+typedef tuple<ColumnPath, CellValue, Date> Cell;
+typedef vector<pair<RowPath, vector<Cell> > > RankedRows;
+
+/** Rank of the row that is at the given fraction (between 0 and 1) of the
+    sorted rows, which is (index + 1) / rowCount for an exact rank.
+*/
+static CellValue
+getRankAtFraction(RankingType rankingType, double fraction, int64_t rowCount)
+{
+    if (rankingType == RankingType::PERCENTILE)
+        return fraction * 100.0;
+    ExcAssert(rankingType == RankingType::INDEX);
+    int64_t index = std::ceil(fraction * rowCount - 1e-9) - 1;
+    return std::max<int64_t>(0, std::min(index, rowCount - 1));
+}
+
+static CellValue
+getRank(RankingType rankingType, int64_t index, int64_t rowCount)
+{
+    if (rankingType == RankingType::INDEX)
+        return index;
+    return getRankAtFraction(rankingType, (index + 1.0) / rowCount, rowCount);
+}
+
 RunOutput
 RankingProcedure::
 run(const ProcedureRunConfig & run,
@@ -85,107 +120,258 @@ run(const ProcedureRunConfig & run,
     auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
     SqlExpressionMldbScope context(server);
 
-    auto boundDataset = runProcConf.inputData.stm->from->bind(context);
+    const SelectStatement & stm = *runProcConf.inputData.stm;
+    auto boundDataset = stm.from->bind(context);
 
     SelectExpression select(SelectExpression::parse("1"));
     vector<shared_ptr<SqlExpression> > calc;
 
     // We calculate an expression with the timestamp of the order by
     // clause.  First, we need to calculate each of the order by clauses
-    for (auto & c: runProcConf.inputData.stm->orderBy.clauses) {
+    for (auto & c: stm.orderBy.clauses) {
         auto whenClause = std::make_shared<FunctionCallExpression>
             ("" /* tableName */, "latest_timestamp",
              vector<shared_ptr<SqlExpression> >(1, c.first));
         calc.emplace_back(whenClause);
     }
 
-    vector<RowPath> orderedRowNames;
-    Date globalMaxOrderByTimestamp = Date::negativeInfinity();
-    auto getSize = [&] (NamedRowValue & row,
-                        const vector<ExpressionValue> & calc)
-    {
-        for (auto & c: calc) {
-            auto ts = c.getAtom().toTimestamp();
-            if (ts.isADate()) {
-                globalMaxOrderByTimestamp.setMax(c.getAtom().toTimestamp());
+    const ColumnPath columnName(runProcConf.rankingColumnName);
+    RankingType rankingType = runProcConf.rankingType;
+
+    // Every rank is stamped with the latest timestamp of the order by
+    // clauses over all rows
+    auto getMaxTimestamp = [] (const vector<ExpressionValue> & calc,
+                               size_t numClauses)
+        {
+            Date result = Date::negativeInfinity();
+            for (size_t i = 0;  i < numClauses;  ++i) {
+                auto ts = calc[i].getAtom().toTimestamp();
+                if (ts.isADate())
+                    result.setMax(ts);
             }
-        }
+            return result;
+        };
 
-        orderedRowNames.emplace_back(row.rowName);
-        return true;
+    struct RowStats {
+        int64_t rowCount = 0;
+        Date maxTimestamp = Date::negativeInfinity();
+        TDigest digest;      ///< Non-null order by values, when approximate
+        int64_t numNulls = 0;
     };
 
-    BoundSelectQuery(select,
-                     *boundDataset.dataset,
-                     boundDataset.asName,
-                     runProcConf.inputData.stm->when,
-                     *runProcConf.inputData.stm->where,
-                     runProcConf.inputData.stm->orderBy,
-                     calc)
-        .execute({getSize,false/*processInParallel*/},
-                 runProcConf.inputData.stm->offset,
-                 runProcConf.inputData.stm->limit,
-                 onProgress);
-
-    int64_t rowCount = orderedRowNames.size();
-
-    auto output = createDataset(server, runProcConf.outputDataset,
-                                nullptr, true /*overwrite*/);
+    // Rows recorded from multiple threads, in batches
+    PerThreadAccumulator<RankedRows> accum;
+    std::shared_ptr<Dataset> output;
 
-    typedef tuple<ColumnPath, CellValue, Date> Cell;
-    PerThreadAccumulator<vector<pair<RowPath, vector<Cell> > > > accum;
-    const ColumnPath columnName(runProcConf.rankingColumnName);
-    function<void(int64_t)> applyFct;
-    float countD100 = (rowCount) / 100.0;
-    if (false) {
-    //if (runProcConf.rankingType == RankingType::PERCENTILE) {
-        // Improper implementation, see
-        // https://en.wikipedia.org/wiki/Percentile_rank
-        applyFct = [&](int64_t idx)
+    auto recordRank = [&] (const RowPath & rowName, CellValue rank, Date ts)
         {
-            vector<Cell> rowValue;
-            rowValue.emplace_back(columnName,
-                                  (idx + 1) / countD100,
-                                  globalMaxOrderByTimestamp);
-
             auto & rows = accum.get();
-            rows.emplace_back(orderedRowNames[idx], rowValue);
+            rows.emplace_back(rowName, vector<Cell>());
+            rows.back().second.emplace_back(columnName, std::move(rank), ts);
 
             if (rows.size() >= 1024) {
                 output->recordRows(rows);
                 rows.clear();
             }
         };
-    }
-    else {
-        ExcAssert(runProcConf.rankingType == RankingType::INDEX);
-        applyFct = [&](int64_t idx)
+
+    auto finish = [&] ()
         {
-            vector<Cell> rowValue;
-            rowValue.emplace_back(columnName,
-                                  idx,
-                                  globalMaxOrderByTimestamp);
+            // record remainder
+            accum.forEach([&] (RankedRows * rows)
+                          {
+                              output->recordRows(*rows);
+                          });
+            output->commit();
+            return output->getStatus();
+        };
 
-            auto & rows = accum.get();
-            rows.emplace_back(orderedRowNames[idx], rowValue);
+    if (runProcConf.approximate) {
+        // The ranks come from a t-digest of the order by value built in a
+        // first parallel pass, and are assigned in a second parallel pass,
+        // so the rows are never sorted or held in memory.
+        if (stm.offset != 0 || stm.limit != -1)
+            throw HttpReturnException
+                (400, "Approximate ranking doesn't support an offset or a "
+                 "limit in its inputData");
+        if (stm.orderBy.clauses.size() != 1)
+            throw HttpReturnException
+                (400, "Approximate ranking requires exactly one order by "
+                 "clause in its inputData",
+                 "orderBy", stm.orderBy.surface);
+
+        calc.push_back(stm.orderBy.clauses[0].first);
+        bool ascending = stm.orderBy.clauses[0].second == ASC;
+
+        // Null values sort before everything else, and NaN before all
+        // the other numbers
+        auto getValue = [] (const ExpressionValue & val) -> double
+            {
+                if (!val.isNumber())
+                    throw HttpReturnException
+                        (400, "Approximate ranking requires a numeric order "
+                         "by value",
+                         "value", val);
+                double d = val.toDouble();
+                return std::isnan(d) ? -INFINITY : d;
+            };
+
+        BoundSelectQuery query(select,
+                               *boundDataset.dataset,
+                               boundDataset.asName,
+                               stm.when, *stm.where,
+                               ORDER_BY_NOTHING,
+                               calc);
+
+        PerThreadAccumulator<RowStats> threadStats;
+
+        auto onSketchRow = [&] (RowPath & rowName, ExpressionValue & val,
+                                vector<ExpressionValue> & calc, int rowNum)
+            {
+                RowStats & stats = threadStats.get();
+                ++stats.rowCount;
+                stats.maxTimestamp.setMax(getMaxTimestamp(calc, 1));
+                if (calc[1].empty())
+                    ++stats.numNulls;
+                else stats.digest.add(getValue(calc[1]));
+                return true;
+            };
+
+        query.executeExpr(onSketchRow, true /* processInParallel */,
+                          0 /* offset */, -1 /* limit */, onProgress);
+
+        RowStats stats;
+        threadStats.forEach([&] (RowStats * s)
+                            {
+                                stats.rowCount += s->rowCount;
+                                stats.maxTimestamp.setMax(s->maxTimestamp);
+                                stats.numNulls += s->numNulls;
+                                stats.digest.merge(s->digest);
+                            });
+        stats.digest.compress();
+
+        int64_t rowCount = stats.rowCount;
+        double numValues = rowCount - stats.numNulls;
+
+        output = createDataset(server, runProcConf.outputDataset,
+                               nullptr, true /*overwrite*/);
+
+        auto onRankRow = [&] (RowPath & rowName, ExpressionValue & val,
+                              vector<ExpressionValue> & calc, int rowNum)
+            {
+                // Fraction of the rows that sort at or before this one
+                double fraction;
+                if (calc[1].empty()) {
+                    fraction = ascending ? stats.numNulls : rowCount;
+                }
+                else {
+                    double below = stats.digest.cdf(getValue(calc[1]));
+                    fraction = ascending
+                        ? stats.numNulls + below * numValues
+                        : (1.0 - below) * numValues;
+                }
+                recordRank(rowName,
+                           getRankAtFraction(rankingType, fraction / rowCount,
+                                             rowCount),
+                           stats.maxTimestamp);
+                return true;
+            };
+
+        query.executeExpr(onRankRow, true /* processInParallel */,
+                          0 /* offset */, -1 /* limit */, onProgress);
+
+        return finish();
+    }
 
-            if (rows.size() >= 1024) {
-                output->recordRows(rows);
-                rows.clear();
-            }
-        };
+    BoundSelectQuery orderedQuery(select,
+                                  *boundDataset.dataset,
+                                  boundDataset.asName,
+                                  stm.when, *stm.where,
+                                  stm.orderBy,
+                                  calc);
+
+    size_t numClauses = calc.size();
+
+    if (stm.offset != 0 || stm.limit != -1) {
+        // The row count and the timestamp only cover the rows within the
+        // offset and the limit, so those rows are kept until the end
+        vector<RowPath> orderedRowNames;
+        Date globalMaxOrderByTimestamp = Date::negativeInfinity();
+        auto onRow = [&] (RowPath & rowName, ExpressionValue & val,
+                          vector<ExpressionValue> & calc, int rowNum)
+            {
+                globalMaxOrderByTimestamp
+                    .setMax(getMaxTimestamp(calc, numClauses));
+                orderedRowNames.emplace_back(std::move(rowName));
+                return true;
+            };
+
+        orderedQuery.executeExpr(onRow, false /*processInParallel*/,
+                                 stm.offset, stm.limit, onProgress);
+
+        int64_t rowCount = orderedRowNames.size();
+
+        output = createDataset(server, runProcConf.outputDataset,
+                               nullptr, true /*overwrite*/);
+
+        parallelMap(0, rowCount, [&] (int64_t idx)
+                    {
+                        recordRank(orderedRowNames[idx],
+                                   getRank(rankingType, idx, rowCount),
+                                   globalMaxOrderByTimestamp);
+                    });
+
+        return finish();
     }
 
+    // Otherwise, the row count and the timestamp come from a first
+    // parallel pass over the rows, and the ranks are recorded as the rows
+    // come out of the sort.  The sort itself spills to disk when it goes
+    // over the query memory budget, so only a batch of ranked rows is held
+    // here.
+    PerThreadAccumulator<RowStats> threadStats;
+    auto onCountRow = [&] (RowPath & rowName, ExpressionValue & val,
+                           vector<ExpressionValue> & calc, int rowNum)
+        {
+            RowStats & stats = threadStats.get();
+            ++stats.rowCount;
+            stats.maxTimestamp.setMax(getMaxTimestamp(calc, numClauses));
+            return true;
+        };
+
+    BoundSelectQuery(select,
+                     *boundDataset.dataset,
+                     boundDataset.asName,
+                     stm.when, *stm.where,
+                     ORDER_BY_NOTHING,
+                     calc)
+        .executeExpr(onCountRow, true /* processInParallel */,
+                     0 /* offset */, -1 /* limit */, onProgress);
+
+    int64_t rowCount = 0;
+    Date globalMaxOrderByTimestamp = Date::negativeInfinity();
+    threadStats.forEach([&] (RowStats * s)
+                        {
+                            rowCount += s->rowCount;
+                            globalMaxOrderByTimestamp.setMax(s->maxTimestamp);
+                        });
+
+    output = createDataset(server, runProcConf.outputDataset,
+                           nullptr, true /*overwrite*/);
+
+    int64_t idx = 0;
+    auto onOrderedRow = [&] (RowPath & rowName, ExpressionValue & val,
+                             vector<ExpressionValue> & calc, int rowNum)
+        {
+            recordRank(rowName, getRank(rankingType, idx++, rowCount),
+                       globalMaxOrderByTimestamp);
+            return true;
+        };
 
-    parallelMap(0, rowCount, applyFct);
+    orderedQuery.executeExpr(onOrderedRow, false /*processInParallel*/,
+                             0 /* offset */, -1 /* limit */, onProgress);
 
-    // record remainder
-    accum.forEach([&] (vector<pair<RowPath, vector<Cell> > > * rows)
-    {
-        output->recordRows(*rows);
-    });
-    output->commit();
-    return output->getStatus();
+    return finish();
 }
 
 Any
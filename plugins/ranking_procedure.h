@@ -28,6 +28,7 @@ struct RankingProcedureConfig : ProcedureConfig {
     PolyConfigT<Dataset> outputDataset;
     RankingType rankingType;
     std::string rankingColumnName;
+    bool approximate;
 
 };
 DECLARE_STRUCTURE_DESCRIPTION(RankingProcedureConfig);
@@ -0,0 +1,800 @@
+/** sharded_dataset.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Dataset partitioned over shards, with scatter/gather query execution.
+*/
+
+#include "sharded_dataset.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/builtin/sub_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/http/http_rest_proxy.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/base/parallel.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/tuple_description.h"
+#include "mldb/types/pair_description.h"
+#include <algorithm>
+#include <mutex>
+#include <set>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SHARDED DATASET CONFIG                                                    */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(ShardedDatasetConfig);
+
+ShardedDatasetConfigDescription::
+ShardedDatasetConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("shards", &ShardedDatasetConfig::shards,
+             "Datasets holding the shards.  Each is either the id of a "
+             "dataset on this server or the URI of a dataset on another "
+             "MLDB server, of the form http://host:port/v1/datasets/<id>.  "
+             "Rows are recorded into the shard given by the hash of their "
+             "name, so the list can't change once rows have been recorded.");
+}
+
+
+/*****************************************************************************/
+/* SHARDED DATASET INTERNAL                                                  */
+/*****************************************************************************/
+
+namespace {
+
+/// Number of rows buffered for a remote shard before they are sent
+static constexpr size_t REMOTE_RECORD_BATCH = 1000;
+
+/// Prefix of the names of the columns that carry partial results
+static const char * INTERNAL_PREFIX = "__mldb_";
+
+Utf8String quoteIdentifier(const Utf8String & id)
+{
+    std::string result = "\"";
+    for (char c: id.rawString()) {
+        if (c == '"')
+            result += '"';
+        result += c;
+    }
+    result += '"';
+    return Utf8String(std::move(result));
+}
+
+Utf8String internalColumn(const std::string & kind, size_t index,
+                          const std::string & suffix = "")
+{
+    return "\"" + string(INTERNAL_PREFIX) + kind + "_" + to_string(index)
+        + suffix + "\"";
+}
+
+NamedRowValue toNamedRow(MatrixNamedRow && row)
+{
+    NamedRowValue result;
+    result.rowName = std::move(row.rowName);
+    result.rowHash = result.rowName;
+    ExpressionValue val(std::move(row.columns));
+    val.mergeToRowDestructive(result.columns);
+    return result;
+}
+
+/// How the partial results of an aggregator are merged
+enum MergeKind {
+    MERGE_COUNT,
+    MERGE_SUM,
+    MERGE_MIN,
+    MERGE_MAX,
+    MERGE_AVG
+};
+
+bool getMergeKind(const Utf8String & functionName, MergeKind & kind)
+{
+    static const std::map<std::string, MergeKind> kinds = {
+        { "count", MERGE_COUNT }, { "vertical_count", MERGE_COUNT },
+        { "sum", MERGE_SUM }, { "vertical_sum", MERGE_SUM },
+        { "min", MERGE_MIN }, { "vertical_min", MERGE_MIN },
+        { "max", MERGE_MAX }, { "vertical_max", MERGE_MAX },
+        { "avg", MERGE_AVG }, { "vertical_avg", MERGE_AVG }
+    };
+
+    std::string name = functionName.rawString();
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    auto it = kinds.find(name);
+    if (it == kinds.end())
+        return false;
+    kind = it->second;
+    return true;
+}
+
+/** True if the expression only reads the internal columns, which means
+    that it was fully rewritten in terms of partial results.
+*/
+/** True if an ORDER BY clause reads a column renamed by the SELECT, which
+    the shards couldn't compute alongside the selected columns.
+*/
+bool ordersByRenamedColumn(const SelectExpression & select,
+                           const OrderByExpression & orderBy)
+{
+    std::set<ColumnPath> renamed;
+    for (auto & c: select.clauses) {
+        auto named = std::dynamic_pointer_cast<NamedColumnExpression>(c);
+        if (!named)
+            continue;
+        auto read = std::dynamic_pointer_cast<ReadColumnExpression>
+            (named->expression);
+        if (!read || read->columnName != named->alias)
+            renamed.insert(named->alias);
+    }
+
+    for (auto & c: orderBy.clauses) {
+        for (auto & v: c.first->variableNames()) {
+            if (renamed.count(v.first.name))
+                return true;
+        }
+    }
+    return false;
+}
+
+bool onlyReadsInternalColumns(const SqlExpression & expr)
+{
+    if (!expr.wildcards().empty())
+        return false;
+    for (auto & v: expr.variableNames()) {
+        if (v.first.name.empty()
+            || !v.first.name.at(0).toUtf8String().startsWith(INTERNAL_PREFIX))
+            return false;
+    }
+    return true;
+}
+
+} // file scope
+
+struct ShardedDataset::Itl {
+
+    struct Shard {
+        Utf8String spec;
+
+        /// Id of the dataset on the server that holds it
+        Utf8String datasetId;
+
+        /// Dataset of a shard on this server; null for a remote one
+        std::shared_ptr<Dataset> local;
+
+        /// Connections to the server of a remote shard
+        std::unique_ptr<HttpRestProxy> proxy;
+
+        /// Rows waiting to be sent to a remote shard
+        std::mutex bufferMutex;
+        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > buffer;
+    };
+
+    Itl(MldbServer * server, const ShardedDatasetConfig & config,
+        const std::function<bool (const Json::Value &)> & onProgress)
+        : server(server)
+    {
+        if (config.shards.empty())
+            throw HttpReturnException(400, "Sharded dataset needs at least "
+                                      "one shard");
+
+        for (auto & spec: config.shards) {
+            std::unique_ptr<Shard> shard(new Shard());
+            shard->spec = spec;
+
+            const std::string & str = spec.rawString();
+            if (str.find("://") != string::npos) {
+                auto pos = str.find("/v1/datasets/");
+                if (pos == string::npos
+                    || pos + 13 == str.size()
+                    || str.find('/', pos + 13) != string::npos)
+                    throw HttpReturnException
+                        (400, "Remote shard URI must be of the form "
+                         "http://host:port/v1/datasets/<id>",
+                         "shard", spec);
+                shard->datasetId = str.substr(pos + 13);
+                shard->proxy.reset(new HttpRestProxy(str.substr(0, pos)));
+            }
+            else {
+                PolyConfig shardConfig;
+                shardConfig.id = spec;
+                shard->datasetId = spec;
+                shard->local = obtainDataset(server, shardConfig, onProgress);
+            }
+
+            shards.emplace_back(std::move(shard));
+        }
+    }
+
+    MldbServer * server;
+    std::vector<std::unique_ptr<Shard> > shards;
+
+    /// All of the rows of the shards, for queries that can't be run on
+    /// the shards themselves
+    mutable std::mutex gatheredMutex;
+    mutable std::shared_ptr<Dataset> gathered;
+
+    Shard & getShard(const RowPath & rowName) const
+    {
+        return *shards[rowName.hash() % shards.size()];
+    }
+
+    void throwRemoteError(const Shard & shard, const std::string & what,
+                          const HttpRestResponse & response) const
+    {
+        int code = response.code() ? response.code() : 500;
+        throw HttpReturnException(code, "Error " + what + " shard "
+                                  + shard.spec + ": "
+                                  + (response.errorCode()
+                                     ? response.errorMessage()
+                                     : response.body()),
+                                  "shard", shard.spec);
+    }
+
+    void sendBuffered(Shard & shard) const
+    {
+        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
+        {
+            std::unique_lock<std::mutex> guard(shard.bufferMutex);
+            rows.swap(shard.buffer);
+        }
+        if (rows.empty())
+            return;
+
+        auto response = shard.proxy->post
+            ("/v1/datasets/" + shard.datasetId.rawString() + "/multirows",
+             HttpRestContent(jsonEncodeStr(rows), "application/json"));
+        if (response.code() < 200 || response.code() >= 300)
+            throwRemoteError(shard, "recording rows into", response);
+    }
+
+    void record(Shard & shard,
+                std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows) const
+    {
+        if (shard.local) {
+            shard.local->recordRows(rows);
+            return;
+        }
+
+        bool full;
+        {
+            std::unique_lock<std::mutex> guard(shard.bufferMutex);
+            for (auto & r: rows)
+                shard.buffer.emplace_back(std::move(r));
+            full = shard.buffer.size() >= REMOTE_RECORD_BATCH;
+        }
+        if (full)
+            sendBuffered(shard);
+    }
+
+    void commit()
+    {
+        auto onShard = [&] (size_t i)
+            {
+                Shard & shard = *shards[i];
+                if (shard.local) {
+                    shard.local->commit();
+                    return;
+                }
+                sendBuffered(shard);
+                auto response = shard.proxy->post
+                    ("/v1/datasets/" + shard.datasetId.rawString()
+                     + "/commit");
+                if (response.code() < 200 || response.code() >= 300)
+                    throwRemoteError(shard, "committing", response);
+            };
+
+        parallelMap(0, shards.size(), onShard);
+
+        std::unique_lock<std::mutex> guard(gatheredMutex);
+        gathered.reset();
+    }
+
+    std::vector<MatrixNamedRow>
+    runQuery(const Shard & shard, const Utf8String & query) const
+    {
+        if (shard.local)
+            return server->query(query);
+
+        auto response = shard.proxy->get("/v1/query",
+                                         { { "q", query.rawString() },
+                                           { "format", "full" } });
+        if (response.code() != 200)
+            throwRemoteError(shard, "querying", response);
+
+        auto rows = jsonDecodeStr<std::vector<MatrixNamedRow> >(response.body());
+        for (auto & r: rows)
+            r.rowHash = r.rowName;
+        return rows;
+    }
+
+    /** Run a query on every shard in parallel.  The query is given the
+        quoted name of the shard's dataset to put in its FROM clause.
+    */
+    std::vector<std::vector<MatrixNamedRow> >
+    scatter(const std::function<Utf8String (const Utf8String &)> & makeQuery) const
+    {
+        std::vector<std::vector<MatrixNamedRow> > results(shards.size());
+
+        auto onShard = [&] (size_t i)
+            {
+                results[i] = runQuery(*shards[i],
+                                      makeQuery(quoteIdentifier(shards[i]->datasetId)));
+            };
+
+        parallelMap(0, shards.size(), onShard);
+
+        return results;
+    }
+
+    std::shared_ptr<Dataset> getGathered() const
+    {
+        std::unique_lock<std::mutex> guard(gatheredMutex);
+        if (gathered)
+            return gathered;
+
+        auto results = scatter([] (const Utf8String & dataset)
+                               {
+                                   return "SELECT * NAMED rowPath() FROM "
+                                       + dataset;
+                               });
+
+        std::vector<NamedRowValue> rows;
+        for (auto & shardRows: results)
+            for (auto & r: shardRows)
+                rows.emplace_back(toNamedRow(std::move(r)));
+
+        gathered = std::make_shared<SubDataset>(server, std::move(rows));
+        return gathered;
+    }
+
+    /** The FROM, WHEN and WHERE clauses of a query on a shard. */
+    static Utf8String
+    fromClause(const Utf8String & dataset, const Utf8String & alias,
+               const WhenExpression & when, const SqlExpression & where)
+    {
+        Utf8String result = " FROM " + dataset;
+        if (!alias.empty())
+            result += " AS " + quoteIdentifier(alias);
+        if (!when.when->isConstantTrue())
+            result += " WHEN " + when.when->surface;
+        if (!where.isConstantTrue())
+            result += " WHERE " + where.surface;
+        return result;
+    }
+
+    /** Run a query which neither groups nor aggregates.  The shards run
+        it with the offset and limit added together, and return the values
+        of the ORDER BY clauses as extra columns, which are used to merge
+        their results in order.
+    */
+    std::tuple<std::vector<NamedRowValue>, std::shared_ptr<ExpressionValueInfo> >
+    queryUngrouped(const SelectExpression & select,
+                   const WhenExpression & when,
+                   const SqlExpression & where,
+                   const OrderByExpression & orderBy,
+                   const std::shared_ptr<SqlExpression> & rowName,
+                   ssize_t offset,
+                   ssize_t limit,
+                   const Utf8String & alias) const
+    {
+        Utf8String selectClause = select.surface;
+        for (size_t i = 0;  i < orderBy.clauses.size();  ++i) {
+            selectClause += ", " + orderBy.clauses[i].first->surface
+                + " AS " + internalColumn("order", i);
+        }
+
+        auto makeQuery = [&] (const Utf8String & dataset)
+            {
+                Utf8String result = "SELECT " + selectClause
+                    + " NAMED " + rowName->surface
+                    + fromClause(dataset, alias, when, where);
+                if (!orderBy.clauses.empty())
+                    result += " ORDER BY " + orderBy.surface;
+                if (limit != -1)
+                    result += " LIMIT " + to_string(offset + limit);
+                return result;
+            };
+
+        auto results = scatter(makeQuery);
+
+        // Split off the ORDER BY values from each row
+        struct Row {
+            MatrixNamedRow row;
+            std::vector<std::vector<CellValue> > order;
+        };
+
+        std::vector<Row> rows;
+        for (auto & shardRows: results) {
+            for (auto & r: shardRows) {
+                Row row;
+                row.order.resize(orderBy.clauses.size());
+                auto isOrder = [&] (const std::tuple<ColumnPath, CellValue, Date> & col)
+                    {
+                        static const std::string prefix
+                            = string(INTERNAL_PREFIX) + "order_";
+                        const std::string & first
+                            = std::get<0>(col).at(0).toUtf8String().rawString();
+                        if (first.compare(0, prefix.size(), prefix) != 0)
+                            return false;
+                        size_t i = std::stoul(first.substr(prefix.size()));
+                        row.order.at(i).push_back(std::get<1>(col));
+                        return true;
+                    };
+                r.columns.erase(std::remove_if(r.columns.begin(),
+                                               r.columns.end(), isOrder),
+                                r.columns.end());
+                row.row = std::move(r);
+                rows.emplace_back(std::move(row));
+            }
+        }
+
+        // Same order as the query on a single dataset, which breaks ties
+        // with the row hash
+        if (!orderBy.clauses.empty()) {
+            auto compare = [&] (const Row & r1, const Row & r2)
+                {
+                    for (size_t i = 0;  i < orderBy.clauses.size();  ++i) {
+                        if (r1.order[i] == r2.order[i])
+                            continue;
+                        bool less = r1.order[i] < r2.order[i];
+                        return orderBy.clauses[i].second == ASC ? less : !less;
+                    }
+                    return r1.row.rowHash < r2.row.rowHash;
+                };
+            std::stable_sort(rows.begin(), rows.end(), compare);
+        }
+
+        std::vector<NamedRowValue> output;
+        size_t end = limit == -1
+            ? rows.size() : std::min<size_t>(rows.size(), offset + limit);
+        for (size_t i = offset;  i < end;  ++i)
+            output.emplace_back(toNamedRow(std::move(rows[i].row)));
+
+        return std::make_tuple<std::vector<NamedRowValue>,
+                               std::shared_ptr<ExpressionValueInfo> >
+            (std::move(output), std::make_shared<UnknownRowValueInfo>());
+    }
+
+    /** Run a query which groups or aggregates.  The shards group their
+        rows by the GROUP BY clauses, returning a partial result for each
+        of the aggregators; the partial results of each group are then
+        merged here by a query which aggregates them, and which also does
+        the HAVING, ORDER BY, OFFSET and LIMIT.
+
+        Returns false if there are aggregators whose partial results can't
+        be merged, or expressions which can't be rewritten in terms of the
+        partial results.
+    */
+    bool queryGrouped(std::tuple<std::vector<NamedRowValue>, std::shared_ptr<ExpressionValueInfo> > & result,
+                      const SelectExpression & select,
+                      const WhenExpression & when,
+                      const SqlExpression & where,
+                      const OrderByExpression & orderBy,
+                      const TupleExpression & groupBy,
+                      const std::shared_ptr<SqlExpression> & having,
+                      const std::shared_ptr<SqlExpression> & rowName,
+                      ssize_t offset,
+                      ssize_t limit,
+                      const Utf8String & alias) const
+    {
+        bool withGroupBy = !groupBy.clauses.empty();
+
+        std::vector<std::shared_ptr<SqlExpression> > aggregators
+            = select.findAggregators(withGroupBy);
+        for (auto & a: findAggregators(having, withGroupBy))
+            aggregators.push_back(a);
+        for (auto & a: orderBy.findAggregators(withGroupBy))
+            aggregators.push_back(a);
+        for (auto & a: findAggregators(rowName, withGroupBy))
+            aggregators.push_back(a);
+
+        // Group keys and aggregators are replaced by these expressions,
+        // reading and merging the partial results
+        std::map<Utf8String, std::shared_ptr<SqlExpression> > replacements;
+        std::vector<Utf8String> partials;
+        TupleExpression mergeGroupBy;
+
+        for (size_t i = 0;  i < groupBy.clauses.size();  ++i) {
+            auto & key = groupBy.clauses[i];
+            if (key->surface.empty())
+                return false;
+            partials.push_back(key->surface + " AS " + internalColumn("key", i));
+            auto read = SqlExpression::parse(internalColumn("key", i));
+            replacements[key->print()] = read;
+            mergeGroupBy.clauses.push_back(read);
+        }
+
+        for (auto & a: aggregators) {
+            Utf8String printed = a->print();
+            if (replacements.count(printed))
+                continue;
+
+            auto call = std::dynamic_pointer_cast<FunctionCallExpression>(a);
+            MergeKind kind;
+            if (!call || !call->tableName.empty() || call->args.size() != 1
+                || call->surface.empty() || call->args[0]->surface.empty()
+                || !getMergeKind(call->functionName, kind))
+                return false;
+
+            size_t i = partials.size();
+            Utf8String column = internalColumn("agg", i);
+            Utf8String merge;
+            switch (kind) {
+            case MERGE_COUNT:
+            case MERGE_SUM:
+                partials.push_back(call->surface + " AS " + column);
+                merge = "sum(" + column + ")";
+                break;
+            case MERGE_MIN:
+                partials.push_back(call->surface + " AS " + column);
+                merge = "min(" + column + ")";
+                break;
+            case MERGE_MAX:
+                partials.push_back(call->surface + " AS " + column);
+                merge = "max(" + column + ")";
+                break;
+            case MERGE_AVG: {
+                Utf8String sum = internalColumn("agg", i, "_sum");
+                Utf8String count = internalColumn("agg", i, "_count");
+                partials.push_back("sum(" + call->args[0]->surface + ") AS "
+                                   + sum);
+                partials.push_back("count(" + call->args[0]->surface + ") AS "
+                                   + count);
+                merge = "sum(" + sum + ") / sum(" + count + ")";
+                break;
+            }
+            }
+
+            replacements[printed] = SqlExpression::parse(merge);
+        }
+
+        std::function<std::shared_ptr<SqlExpression> (const std::shared_ptr<SqlExpression> &)> rewrite;
+
+        TransformArgs rewriteArgs
+            = [&] (const std::vector<std::shared_ptr<SqlExpression> > & args)
+            {
+                std::vector<std::shared_ptr<SqlExpression> > result;
+                for (auto & a: args)
+                    result.push_back(rewrite(a));
+                return result;
+            };
+
+        rewrite = [&] (const std::shared_ptr<SqlExpression> & expr)
+            {
+                auto it = replacements.find(expr->print());
+                if (it != replacements.end())
+                    return it->second;
+                return expr->transform(rewriteArgs);
+            };
+
+        std::vector<std::shared_ptr<SqlRowExpression> > mergeClauses;
+        for (auto & c: select.clauses) {
+            if (std::dynamic_pointer_cast<WildcardExpression>(c))
+                return false;
+            auto clause = std::dynamic_pointer_cast<SqlRowExpression>(rewrite(c));
+            if (!clause || !onlyReadsInternalColumns(*clause))
+                return false;
+            mergeClauses.push_back(clause);
+        }
+        SelectExpression mergeSelect(std::move(mergeClauses));
+
+        auto mergeHaving = rewrite(having);
+        auto mergeRowName = rewrite(rowName);
+        OrderByExpression mergeOrderBy = orderBy.transform(rewriteArgs);
+        if (!onlyReadsInternalColumns(*mergeHaving)
+            || !onlyReadsInternalColumns(*mergeRowName))
+            return false;
+        for (auto & c: mergeOrderBy.clauses) {
+            if (!onlyReadsInternalColumns(*c.first))
+                return false;
+        }
+
+        auto makeQuery = [&] (const Utf8String & dataset)
+            {
+                Utf8String result = "SELECT ";
+                for (size_t i = 0;  i < partials.size();  ++i)
+                    result += (i == 0 ? "" : ", ") + partials[i];
+                result += fromClause(dataset, alias, when, where);
+                if (withGroupBy)
+                    result += " GROUP BY " + groupBy.surface;
+                return result;
+            };
+
+        auto results = scatter(makeQuery);
+
+        // The partial results of a group have the same name on each shard
+        std::vector<NamedRowValue> rows;
+        for (size_t i = 0;  i < results.size();  ++i) {
+            for (size_t j = 0;  j < results[i].size();  ++j) {
+                NamedRowValue row = toNamedRow(std::move(results[i][j]));
+                row.rowName = PathElement(i) + PathElement(j);
+                row.rowHash = row.rowName;
+                rows.emplace_back(std::move(row));
+            }
+        }
+
+        auto merged = std::make_shared<SubDataset>(server, std::move(rows));
+        result = merged->queryStructuredExpr
+            (mergeSelect, WhenExpression::TRUE, *SqlExpression::TRUE,
+             mergeOrderBy, mergeGroupBy, mergeHaving, mergeRowName,
+             offset, limit, "" /* alias */);
+        return true;
+    }
+};
+
+
+/*****************************************************************************/
+/* SHARDED DATASET                                                           */
+/*****************************************************************************/
+
+ShardedDataset::
+ShardedDataset(MldbServer * owner,
+               PolyConfig config,
+               const std::function<bool (const Json::Value &)> & onProgress)
+    : Dataset(owner)
+{
+    auto shardedConfig = config.params.convert<ShardedDatasetConfig>();
+    itl.reset(new Itl(server, shardedConfig, onProgress));
+}
+
+ShardedDataset::
+~ShardedDataset()
+{
+}
+
+Any
+ShardedDataset::
+getStatus() const
+{
+    vector<Any> result;
+    for (auto & s: itl->shards) {
+        if (s->local)
+            result.emplace_back(s->local->getStatus());
+        else result.emplace_back(s->spec);
+    }
+    return result;
+}
+
+void
+ShardedDataset::
+recordRowItl(const RowPath & rowName,
+             const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
+{
+    itl->record(itl->getShard(rowName), { { rowName, vals } });
+}
+
+void
+ShardedDataset::
+recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows)
+{
+    std::vector<std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > >
+        byShard(itl->shards.size());
+    for (auto & r: rows) {
+        validateNames(r.first, r.second);
+        byShard[r.first.hash() % byShard.size()].push_back(r);
+    }
+
+    for (size_t i = 0;  i < byShard.size();  ++i) {
+        if (!byShard[i].empty())
+            itl->record(*itl->shards[i], std::move(byShard[i]));
+    }
+}
+
+void
+ShardedDataset::
+commit()
+{
+    itl->commit();
+}
+
+std::tuple<std::vector<NamedRowValue>, std::shared_ptr<ExpressionValueInfo> >
+ShardedDataset::
+queryStructuredExpr(const SelectExpression & select,
+                    const WhenExpression & when,
+                    const SqlExpression & where,
+                    const OrderByExpression & orderBy,
+                    const TupleExpression & groupBy,
+                    const std::shared_ptr<SqlExpression> having,
+                    const std::shared_ptr<SqlExpression> rowName,
+                    ssize_t offset,
+                    ssize_t limit,
+                    Utf8String alias) const
+{
+    ExcAssert(having);
+    ExcAssert(rowName);
+
+    // The shards are sent the text of the clauses, so that they can parse
+    // them again
+    bool hasSurfaces = !select.surface.empty()
+        && (when.when->isConstantTrue() || !when.when->surface.empty())
+        && (where.isConstantTrue() || !where.surface.empty())
+        && (orderBy.clauses.empty() || !orderBy.surface.empty())
+        && (groupBy.clauses.empty() || !groupBy.surface.empty());
+    for (auto & c: orderBy.clauses)
+        hasSurfaces = hasSurfaces && !c.first->surface.empty();
+
+    if (hasSurfaces && select.distinctExpr.empty()) {
+        bool withGroupBy = !groupBy.clauses.empty();
+        bool aggregates = !select.findAggregators(withGroupBy).empty()
+            || !findAggregators(having, withGroupBy).empty()
+            || !orderBy.findAggregators(withGroupBy).empty()
+            || !findAggregators(rowName, withGroupBy).empty();
+
+        if (!withGroupBy && !aggregates) {
+            if (!having->isConstantTrue())
+                throw HttpReturnException(400, "HAVING expression requires "
+                                          "a GROUP BY expression");
+            if (!rowName->surface.empty()
+                && !ordersByRenamedColumn(select, orderBy))
+                return itl->queryUngrouped(select, when, where, orderBy,
+                                           rowName, offset, limit, alias);
+        }
+        else {
+            std::tuple<std::vector<NamedRowValue>, std::shared_ptr<ExpressionValueInfo> > result;
+            if (itl->queryGrouped(result, select, when, where, orderBy,
+                                  groupBy, having, rowName, offset, limit,
+                                  alias))
+                return result;
+        }
+    }
+
+    return itl->getGathered()->queryStructuredExpr
+        (select, when, where, orderBy, groupBy, having, rowName,
+         offset, limit, alias);
+}
+
+std::shared_ptr<MatrixView>
+ShardedDataset::
+getMatrixView() const
+{
+    return itl->getGathered()->getMatrixView();
+}
+
+std::shared_ptr<ColumnIndex>
+ShardedDataset::
+getColumnIndex() const
+{
+    return itl->getGathered()->getColumnIndex();
+}
+
+std::shared_ptr<RowStream>
+ShardedDataset::
+getRowStream() const
+{
+    return itl->getGathered()->getRowStream();
+}
+
+std::pair<Date, Date>
+ShardedDataset::
+getTimestampRange() const
+{
+    return itl->getGathered()->getTimestampRange();
+}
+
+KnownColumn
+ShardedDataset::
+getKnownColumnInfo(const ColumnPath & columnName) const
+{
+    return itl->getGathered()->getKnownColumnInfo(columnName);
+}
+
+namespace {
+
+RegisterDatasetType<ShardedDataset, ShardedDatasetConfig>
+regSharded(builtinPackage(),
+           "sharded",
+           "Dataset partitioned by row over shards on this or other servers",
+           "datasets/ShardedDataset.md.html");
+
+} // file scope
+
+} // namespace MLDB
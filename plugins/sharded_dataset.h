@@ -0,0 +1,86 @@
+/** sharded_dataset.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Dataset whose rows are partitioned by row hash over a set of shard
+    datasets, which may live on other MLDB servers.  Simple queries are
+    run on the shards, and their partial results merged here.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SHARDED DATASET CONFIG                                                    */
+/*****************************************************************************/
+
+struct ShardedDatasetConfig {
+    /// Either the id of a dataset on this server, or the URI of a dataset
+    /// on another one, as http://host:port/v1/datasets/<id>
+    std::vector<Utf8String> shards;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ShardedDatasetConfig);
+
+
+/*****************************************************************************/
+/* SHARDED DATASET                                                           */
+/*****************************************************************************/
+
+struct ShardedDataset: public Dataset {
+
+    ShardedDataset(MldbServer * owner,
+                   PolyConfig config,
+                   const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual ~ShardedDataset() override;
+
+    virtual Any getStatus() const override;
+
+    virtual void recordRowItl(const RowPath & rowName,
+                              const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) override;
+
+    virtual void recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows) override;
+
+    /** Send the rows still buffered for remote shards, and commit every
+        shard.
+    */
+    virtual void commit() override;
+
+    /** Run the query on the shards, and merge their results, if it only
+        selects, filters and orders rows, or groups them with aggregators
+        whose partial results can be merged.  Other queries are run here,
+        over a copy of all of the rows of the shards.
+    */
+    virtual std::tuple<std::vector<NamedRowValue>, std::shared_ptr<ExpressionValueInfo> >
+    queryStructuredExpr(const SelectExpression & select,
+                        const WhenExpression & when,
+                        const SqlExpression & where,
+                        const OrderByExpression & orderBy,
+                        const TupleExpression & groupBy,
+                        const std::shared_ptr<SqlExpression> having,
+                        const std::shared_ptr<SqlExpression> rowName,
+                        ssize_t offset,
+                        ssize_t limit,
+                        Utf8String alias = "") const override;
+
+    /** These operate on a copy of all of the rows of the shards, made on
+        first use and kept until the next commit.
+    */
+    virtual std::shared_ptr<MatrixView> getMatrixView() const override;
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const override;
+    virtual std::shared_ptr<RowStream> getRowStream() const override;
+    virtual std::pair<Date, Date> getTimestampRange() const override;
+    virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const override;
+
+private:
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
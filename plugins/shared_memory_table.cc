@@ -0,0 +1,478 @@
+/** shared_memory_table.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Exchange of tables with other processes through files in shared memory.
+*/
+
+#include "shared_memory_table.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/jml/utils/guard.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/types/any_impl.h"
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <random>
+#include <map>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+using namespace std;
+
+namespace fs = boost::filesystem;
+
+
+namespace MLDB {
+
+namespace {
+
+const char tableMagic[8] = { 'M', 'L', 'D', 'B', 'T', 'B', 'L', '1' };
+
+/// Buffers are aligned as in Apache Arrow
+constexpr uint64_t bufferAlignment = 64;
+
+/// Space for the magic string, header offset and header length
+constexpr uint64_t prefixLength = 64;
+
+/// Number of rows recorded in each chunk
+constexpr uint64_t rowsPerChunk = 1024;
+
+uint64_t alignBuffer(uint64_t offset)
+{
+    return (offset + bufferAlignment - 1) / bufferAlignment * bufferAlignment;
+}
+
+Json::Value bufferJson(uint64_t offset, uint64_t length)
+{
+    Json::Value result(Json::arrayValue);
+    result.append(Json::UInt(offset));
+    result.append(Json::UInt(length));
+    return result;
+}
+
+/// A column being written, with the rows it has a value in
+struct ColumnToWrite {
+    ColumnToWrite()
+        : allIntegers(true), allNumbers(true), allBlobs(true),
+          validityOffset(0), offsetsOffset(0), dataOffset(0), dataLength(0)
+    {
+    }
+
+    Utf8String name;
+    std::vector<std::pair<uint64_t, CellValue> > values;
+    bool allIntegers, allNumbers, allBlobs;
+
+    uint64_t validityOffset, offsetsOffset, dataOffset, dataLength;
+
+    bool isBinary() const
+    {
+        return !allNumbers;
+    }
+
+    std::string getType() const
+    {
+        if (allIntegers)
+            return "int64";
+        if (allNumbers)
+            return "float64";
+        if (allBlobs)
+            return "large_binary";
+        return "large_utf8";
+    }
+};
+
+/// Bytes written for a value of a large_utf8 or large_binary column
+std::string getBytes(const CellValue & value)
+{
+    if (value.isBlob())
+        return std::string((const char *)value.blobData(), value.blobLength());
+    return value.toUtf8String().rawString();
+}
+
+/// A mapped file that is unmapped when the last reference goes away
+std::shared_ptr<const char>
+mapFile(int fd, size_t length, int prot, const std::string & path)
+{
+    void * addr = mmap(nullptr, length, prot, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        throw MLDB::Exception(errno, "mapping shared memory table " + path);
+    return std::shared_ptr<const char>
+        ((const char *)addr,
+         [length] (const char * p) { munmap((void *)p, length); });
+}
+
+} // file scope
+
+std::string newSharedMemoryTablePath(const std::string & prefix)
+{
+    static std::atomic<uint64_t> counter(0);
+    static const uint64_t nonce = std::random_device()();
+
+    fs::path dir("/dev/shm");
+    if (!fs::is_directory(dir))
+        dir = fs::temp_directory_path();
+
+    return (dir / ("mldb-" + prefix + "-" + std::to_string(getpid())
+                   + "-" + std::to_string(nonce) + "-"
+                   + std::to_string(counter++))).string();
+}
+
+void writeSharedMemoryTable(const std::string & path,
+                            const std::vector<NamedRowValue> & rows)
+{
+    uint64_t numRows = rows.size();
+
+    std::vector<ColumnToWrite> columns;
+    std::map<ColumnPath, size_t> columnIndex;
+
+    for (uint64_t i = 0;  i < numRows;  ++i) {
+        MatrixNamedRow row = rows[i].flatten();
+        for (auto & c: row.columns) {
+            const CellValue & value = std::get<1>(c);
+            if (value.empty())
+                continue;
+
+            auto it = columnIndex.insert({ std::get<0>(c), columns.size() })
+                .first;
+            if (it->second == columns.size()) {
+                columns.emplace_back();
+                columns.back().name = std::get<0>(c).toUtf8String();
+            }
+
+            ColumnToWrite & column = columns[it->second];
+            column.allIntegers = column.allIntegers && value.isInt64();
+            column.allNumbers = column.allNumbers && value.isNumber();
+            column.allBlobs = column.allBlobs && value.isBlob();
+            if (!column.values.empty() && column.values.back().first == i)
+                column.values.back().second = value;
+            else column.values.emplace_back(i, value);
+        }
+    }
+
+    // Lay out the buffers, then the header
+    uint64_t offset = prefixLength;
+    auto allocate = [&] (uint64_t length)
+        {
+            uint64_t result = offset;
+            offset = alignBuffer(offset + length);
+            return result;
+        };
+
+    uint64_t validityLength = (numRows + 7) / 8;
+    uint64_t offsetsLength = (numRows + 1) * sizeof(int64_t);
+
+    uint64_t rowNamesLength = 0;
+    for (auto & r: rows)
+        rowNamesLength += r.rowName.toUtf8String().rawLength();
+    uint64_t rowNamesOffsetsOffset = allocate(offsetsLength);
+    uint64_t rowNamesDataOffset = allocate(rowNamesLength);
+
+    Json::Value header;
+    header["numRows"] = Json::UInt(numRows);
+    header["rowNames"]["type"] = "large_utf8";
+    header["rowNames"]["offsets"]
+        = bufferJson(rowNamesOffsetsOffset, offsetsLength);
+    header["rowNames"]["data"] = bufferJson(rowNamesDataOffset, rowNamesLength);
+    header["columns"] = Json::Value(Json::arrayValue);
+
+    for (auto & column: columns) {
+        column.validityOffset = allocate(validityLength);
+        if (column.isBinary()) {
+            for (auto & v: column.values)
+                column.dataLength += getBytes(v.second).size();
+            column.offsetsOffset = allocate(offsetsLength);
+        }
+        else column.dataLength = numRows * sizeof(int64_t);
+        column.dataOffset = allocate(column.dataLength);
+
+        Json::Value info;
+        info["name"] = column.name.rawString();
+        info["type"] = column.getType();
+        info["nullCount"] = Json::UInt(numRows - column.values.size());
+        info["validity"] = bufferJson(column.validityOffset, validityLength);
+        if (column.isBinary())
+            info["offsets"] = bufferJson(column.offsetsOffset, offsetsLength);
+        info["data"] = bufferJson(column.dataOffset, column.dataLength);
+        header["columns"].append(info);
+    }
+
+    std::string headerStr = header.toStringNoNewLine();
+    uint64_t headerOffset = offset;
+    uint64_t length = headerOffset + headerStr.size();
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd == -1)
+        throw MLDB::Exception(errno, "creating shared memory table " + path);
+    ML::Call_Guard closeFd([&] () { ::close(fd); });
+    ML::Call_Guard removeFile([&] () { ::unlink(path.c_str()); });
+
+    if (ftruncate(fd, length) == -1)
+        throw MLDB::Exception(errno, "sizing shared memory table " + path);
+
+    // The file is zero filled by ftruncate, so only the values that are not
+    // null need to be written
+    std::shared_ptr<const char> mapped
+        = mapFile(fd, length, PROT_READ | PROT_WRITE, path);
+    char * mem = const_cast<char *>(mapped.get());
+
+    memcpy(mem, tableMagic, 8);
+    memcpy(mem + 8, &headerOffset, 8);
+    uint64_t headerLength = headerStr.size();
+    memcpy(mem + 16, &headerLength, 8);
+    memcpy(mem + headerOffset, headerStr.data(), headerStr.size());
+
+    auto writeRowNames = [&] ()
+        {
+            int64_t * offsets = (int64_t *)(mem + rowNamesOffsetsOffset);
+            int64_t pos = 0;
+            for (uint64_t i = 0;  i < numRows;  ++i) {
+                offsets[i] = pos;
+                Utf8String name = rows[i].rowName.toUtf8String();
+                memcpy(mem + rowNamesDataOffset + pos, name.rawData(),
+                       name.rawLength());
+                pos += name.rawLength();
+            }
+            offsets[numRows] = pos;
+        };
+
+    auto writeColumn = [&] (size_t n)
+        {
+            if (n == columns.size()) {
+                writeRowNames();
+                return;
+            }
+
+            const ColumnToWrite & column = columns[n];
+            uint8_t * validity = (uint8_t *)(mem + column.validityOffset);
+            for (auto & v: column.values)
+                validity[v.first / 8] |= 1 << (v.first % 8);
+
+            if (column.allIntegers) {
+                int64_t * data = (int64_t *)(mem + column.dataOffset);
+                for (auto & v: column.values)
+                    data[v.first] = v.second.toInt();
+            }
+            else if (column.allNumbers) {
+                double * data = (double *)(mem + column.dataOffset);
+                for (auto & v: column.values)
+                    data[v.first] = v.second.toDouble();
+            }
+            else {
+                // Rows without a value have an empty range of the data
+                int64_t * offsets = (int64_t *)(mem + column.offsetsOffset);
+                int64_t pos = 0;
+                uint64_t row = 0;
+                for (auto & v: column.values) {
+                    for (;  row <= v.first;  ++row)
+                        offsets[row] = pos;
+                    std::string bytes = getBytes(v.second);
+                    memcpy(mem + column.dataOffset + pos, bytes.data(),
+                           bytes.size());
+                    pos += bytes.size();
+                }
+                for (;  row <= numRows;  ++row)
+                    offsets[row] = pos;
+            }
+        };
+
+    parallelMap(0, columns.size() + 1, writeColumn);
+
+    mapped.reset();
+
+    // The other process only gets to read it
+    if (fchmod(fd, 0400) == -1)
+        throw MLDB::Exception(errno, "protecting shared memory table " + path);
+
+    removeFile.clear();
+}
+
+uint64_t recordSharedMemoryTable(const std::string & path,
+                                 Dataset::MultiChunkRecorder & recorder,
+                                 Date timestamp)
+{
+    auto invalid = [&] (const std::string & reason)
+        {
+            return HttpReturnException(400, "Invalid shared memory table: "
+                                       + reason, "path", path);
+        };
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw MLDB::Exception(errno, "opening shared memory table " + path);
+    ML::Call_Guard closeFd([&] () { ::close(fd); });
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        throw MLDB::Exception(errno, "reading shared memory table " + path);
+    uint64_t length = st.st_size;
+    if (length < 24)
+        throw invalid("file is too short");
+
+    std::shared_ptr<const char> mapped = mapFile(fd, length, PROT_READ, path);
+    const char * mem = mapped.get();
+
+    if (memcmp(mem, tableMagic, 8) != 0)
+        throw invalid("wrong magic string");
+    uint64_t headerOffset, headerLength;
+    memcpy(&headerOffset, mem + 8, 8);
+    memcpy(&headerLength, mem + 16, 8);
+    if (headerOffset > length || headerLength > length - headerOffset)
+        throw invalid("header is outside of the file");
+
+    Json::Value header
+        = Json::parse(std::string(mem + headerOffset, headerLength));
+    uint64_t numRows = header["numRows"].asUInt();
+
+    // Return the start of a buffer, which must be in the file and hold at
+    // least minLength bytes
+    auto getBuffer = [&] (const Json::Value & buffer, uint64_t minLength,
+                          const std::string & what)
+        {
+            if (!buffer.isArray() || buffer.size() != 2)
+                throw invalid("buffer for " + what + " is not [offset, length]");
+            uint64_t offset = buffer[0].asUInt();
+            uint64_t bufferLength = buffer[1].asUInt();
+            if (offset > length || bufferLength > length - offset)
+                throw invalid("buffer for " + what + " is outside of the file");
+            if (bufferLength < minLength)
+                throw invalid("buffer for " + what + " is too short");
+            if (offset % 8 != 0)
+                throw invalid("buffer for " + what + " is not aligned");
+            return std::make_pair(mem + offset, bufferLength);
+        };
+
+    /// The values of a column, as views into the file
+    struct ColumnToRead {
+        ColumnPath name;
+        std::string type;
+        const uint8_t * validity;
+        const char * data;
+        uint64_t dataLength;
+        const int64_t * largeOffsets;
+        const int32_t * offsets;
+
+        bool isValid(uint64_t row) const
+        {
+            return !validity || (validity[row / 8] & (1 << (row % 8)));
+        }
+
+        std::pair<int64_t, int64_t> getRange(uint64_t row) const
+        {
+            if (largeOffsets)
+                return { largeOffsets[row], largeOffsets[row + 1] };
+            return { offsets[row], offsets[row + 1] };
+        }
+    };
+
+    auto getColumn = [&] (const Json::Value & info, const std::string & what)
+        {
+            ColumnToRead result;
+            result.type = info["type"].asString();
+            result.validity = nullptr;
+            result.largeOffsets = nullptr;
+            result.offsets = nullptr;
+
+            if (!info["validity"].isNull()) {
+                result.validity = (const uint8_t *)getBuffer
+                    (info["validity"], (numRows + 7) / 8, what).first;
+            }
+
+            bool isNumber = result.type == "int64" || result.type == "float64";
+            bool isLarge = result.type == "large_utf8"
+                || result.type == "large_binary";
+            bool hasOffsets = isLarge || result.type == "utf8"
+                || result.type == "binary";
+            if (!isNumber && !hasOffsets)
+                throw invalid("unknown type '" + result.type + "' for " + what);
+
+            auto data = getBuffer(info["data"],
+                                  isNumber ? numRows * sizeof(int64_t) : 0,
+                                  what);
+            result.data = data.first;
+            result.dataLength = data.second;
+
+            if (hasOffsets) {
+                auto offsets = getBuffer(info["offsets"],
+                                         (numRows + 1) * (isLarge ? 8 : 4),
+                                         what);
+                if (isLarge)
+                    result.largeOffsets = (const int64_t *)offsets.first;
+                else result.offsets = (const int32_t *)offsets.first;
+
+                for (uint64_t i = 0;  i < numRows;  ++i) {
+                    auto range = result.getRange(i);
+                    if (range.first < 0 || range.first > range.second
+                        || (uint64_t)range.second > result.dataLength)
+                        throw invalid("offsets for " + what + " are out of range");
+                }
+            }
+
+            return result;
+        };
+
+    ColumnToRead rowNames = getColumn(header["rowNames"], "row names");
+    if (rowNames.type != "utf8" && rowNames.type != "large_utf8")
+        throw invalid("row names are not strings");
+
+    std::vector<ColumnToRead> columns;
+    for (auto & info: header["columns"]) {
+        Utf8String name = info["name"].asString();
+        columns.emplace_back(getColumn(info, "column " + name.rawString()));
+        columns.back().name = ColumnPath::parse(name);
+    }
+
+    auto getValue = [&] (const ColumnToRead & column, uint64_t row)
+        {
+            if (column.type == "int64")
+                return CellValue(((const int64_t *)column.data)[row]);
+            else if (column.type == "float64")
+                return CellValue(((const double *)column.data)[row]);
+
+            auto range = column.getRange(row);
+            const char * start = column.data + range.first;
+            size_t size = range.second - range.first;
+            if (column.type == "binary" || column.type == "large_binary")
+                return CellValue::blob(start, size);
+            return CellValue(Utf8String(start, size));
+        };
+
+    typedef std::vector<std::tuple<ColumnPath, CellValue, Date> > Cells;
+
+    auto recordChunk = [&] (size_t chunk)
+        {
+            std::vector<std::pair<RowPath, Cells> > rows;
+            uint64_t end = std::min(numRows, (chunk + 1) * rowsPerChunk);
+            for (uint64_t i = chunk * rowsPerChunk;  i < end;  ++i) {
+                if (!rowNames.isValid(i))
+                    throw invalid("row names can't be null");
+                auto range = rowNames.getRange(i);
+                RowPath rowName = RowPath::parse
+                    (Utf8String(rowNames.data + range.first,
+                                (size_t)(range.second - range.first)));
+
+                Cells cells;
+                for (auto & column: columns) {
+                    if (column.isValid(i))
+                        cells.emplace_back(column.name, getValue(column, i),
+                                           timestamp);
+                }
+                rows.emplace_back(std::move(rowName), std::move(cells));
+            }
+
+            auto chunkRecorder = recorder.newChunk(chunk);
+            chunkRecorder->recordRowsDestructive(std::move(rows));
+            chunkRecorder->finishedChunk();
+        };
+
+    parallelMap(0, (numRows + rowsPerChunk - 1) / rowsPerChunk, recordChunk);
+
+    return numRows;
+}
+
+} // namespace MLDB
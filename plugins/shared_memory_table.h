@@ -0,0 +1,70 @@
+/** shared_memory_table.h                                          -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Exchange of tables with other processes through files in shared memory,
+    in which the columns are laid out as in Apache Arrow so that the other
+    process can map them and use them in place.
+
+    A file holds, in little endian order:
+
+    - 8 bytes: the magic string "MLDBTBL1";
+    - 8 bytes: the offset of the header;
+    - 8 bytes: the length of the header;
+    - the buffers, each of which starts at a multiple of 64 bytes;
+    - the header, which is a JSON object describing the table.
+
+    The header looks like
+
+        { "numRows": 2,
+          "rowNames": { "type": "large_utf8",
+                        "offsets": [ 64, 24 ], "data": [ 128, 8 ] },
+          "columns": [ { "name": "x", "type": "float64", "nullCount": 0,
+                         "validity": [ 192, 1 ], "data": [ 256, 16 ] } ] }
+
+    where each buffer is given as its offset in the file and its length
+    in bytes.  Columns are of type int64, float64, large_utf8 or
+    large_binary, with the same buffers as the Arrow type of that name:
+    a validity bitmap with the least significant bit first, where a bit
+    set means that the value is not null, and either the values or an
+    array of numRows + 1 int64 offsets into the data.  Reading also
+    accepts utf8 and binary columns, which have int32 offsets, and columns
+    without a validity bitmap, which have no nulls.
+
+    Names of rows and columns are in the format of flattened MLDB names,
+    as in the output of a query.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/sql/expression_value.h"
+
+
+namespace MLDB {
+
+/** Return the path of a file that doesn't exist yet in the directory
+    that shared memory tables are created in, which is /dev/shm if it
+    exists or the temporary directory otherwise.
+*/
+std::string newSharedMemoryTablePath(const std::string & prefix);
+
+/** Write the rows as a table into a new file at the given path, which
+    is made read-only once it is written.  A column of a row with several
+    values keeps the last one.  Columns where every value is an integer
+    are written as int64, those where every value is a number as float64,
+    those where every value is a blob as large_binary and the others as
+    large_utf8.
+*/
+void writeSharedMemoryTable(const std::string & path,
+                            const std::vector<NamedRowValue> & rows);
+
+/** Read the table in the given file, as written by another process, and
+    record its rows with the given timestamp into the recorder, in
+    parallel.  The recorder still needs to be committed.  Returns the
+    number of rows.
+*/
+uint64_t recordSharedMemoryTable(const std::string & path,
+                                 Dataset::MultiChunkRecorder & recorder,
+                                 Date timestamp);
+
+} // namespace MLDB
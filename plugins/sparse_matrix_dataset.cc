@@ -19,6 +19,7 @@
 #include "mldb/base/parallel.h"
 #include "mldb/base/thread_pool.h"
 #include "mldb/utils/atomic_shared_ptr.h"
+#include "mldb/utils/blocked_bloom_filter.h"
 #include "mldb/server/parallel_merge_sort.h"
 #include "mldb/utils/log.h"
 #include <mutex>
@@ -92,13 +93,7 @@ struct SparseMatrixDataset::Itl
         this->inverse  = std::move(inverse);
         this->values = std::move(values);
 
-        auto newDefaultTransaction = std::make_shared<ReadTransaction>();
-        newDefaultTransaction->matrix = this->matrix->startReadTransaction();
-        newDefaultTransaction->inverse = this->inverse->startReadTransaction();
-        newDefaultTransaction->values = this->values->startReadTransaction();
-        newDefaultTransaction->epoch = this->epoch;
-
-        setDefaultTransaction(newDefaultTransaction);
+        setDefaultTransaction(newReadTransaction());
     }
     
     ~Itl()
@@ -118,6 +113,10 @@ struct SparseMatrixDataset::Itl
         std::shared_ptr<MatrixReadTransaction> matrix;
         std::shared_ptr<MatrixReadTransaction> inverse;
         std::shared_ptr<MatrixReadTransaction> values;
+
+        /// Earliest and latest timestamp of any cell; notADate() if none
+        Date earliestTs = Date::notADate();
+        Date latestTs = Date::notADate();
     };
 
     struct WriteTransaction: public ReadTransaction {
@@ -132,8 +131,39 @@ struct SparseMatrixDataset::Itl
         std::shared_ptr<MatrixWriteTransaction> matrix;
         std::shared_ptr<MatrixWriteTransaction> inverse;
         std::shared_ptr<MatrixWriteTransaction> values;
+
+        /// Range of the timestamps recorded within this transaction.  It
+        /// is empty (earliest after latest) until something is recorded.
+        Date recordedEarliestTs = Date::positiveInfinity();
+        Date recordedLatestTs = Date::negativeInfinity();
+
+        void recordTimestamp(Date ts)
+        {
+            if (std::isnan(ts.secondsSinceEpoch()))
+                return;
+            recordedEarliestTs.setMin(ts);
+            recordedLatestTs.setMax(ts);
+        }
     };
 
+    /// Timestamp range of everything committed so far, empty (earliest
+    /// after latest) if nothing has been.  Protected by rootLock.
+    Date committedEarliestTs = Date::positiveInfinity();
+    Date committedLatestTs = Date::negativeInfinity();
+
+    /// Add the range of timestamps of a transaction to the committed one
+    void commitTimestampRange(const WriteTransaction & trans)
+    {
+        committedEarliestTs.setMin(trans.recordedEarliestTs);
+        committedLatestTs.setMax(trans.recordedLatestTs);
+    }
+
+    std::pair<Date, Date> getTimestampRange() const
+    {
+        auto trans = getReadTransaction();
+        return { trans->earliestTs, trans->latestTs };
+    }
+
     struct SparseRowStream : public RowStream {
 
         SparseRowStream(SparseMatrixDataset::Itl* source) : source(source)
@@ -256,13 +286,63 @@ struct SparseMatrixDataset::Itl
         // Wait for the thread pool work to finish
         tp.waitForAll();
 
+        commitTimestampRange(trans);
+
+        setDefaultTransaction(newReadTransaction());
+    }
+
+    /** Commit the writes of several transactions at once, in the order
+        given, under a single epoch.  This is used to commit the chunks of
+        a chunk recorder together, so that the result doesn't depend upon
+        which of them finished first.
+    */
+    void commitWrites(const std::vector<std::shared_ptr<WriteTransaction> > & chunks)
+    {
+        if (chunks.empty())
+            return;
+
+        std::unique_lock<RootLock> guard(rootLock);
+        ++epoch;
+
+        // Each matrix is committed in its own thread, with the chunks
+        // going in one after the other
+        ThreadPool tp;
+
+        auto commitAll = [&] (std::shared_ptr<MatrixWriteTransaction>
+                              WriteTransaction::* trans)
+            {
+                tp.add([&chunks,trans] ()
+                       {
+                           for (auto & c: chunks)
+                               ((*c).*trans)->commit();
+                       });
+            };
+
+        commitAll(&WriteTransaction::matrix);
+        commitAll(&WriteTransaction::inverse);
+        commitAll(&WriteTransaction::values);
+
+        tp.waitForAll();
+
+        for (auto & c: chunks)
+            commitTimestampRange(*c);
+
+        setDefaultTransaction(newReadTransaction());
+    }
+
+    /// Return a read transaction at the current committed state
+    std::shared_ptr<ReadTransaction> newReadTransaction() const
+    {
         auto result = std::make_shared<ReadTransaction>();
         result->matrix = matrix->startReadTransaction();
         result->inverse = inverse->startReadTransaction();
         result->values = values->startReadTransaction();
         result->epoch = epoch;
-
-        setDefaultTransaction(std::move(result));
+        if (committedEarliestTs <= committedLatestTs) {
+            result->earliestTs = committedEarliestTs;
+            result->latestTs = committedLatestTs;
+        }
+        return result;
     }
 
     void optimize()
@@ -284,16 +364,15 @@ struct SparseMatrixDataset::Itl
         
         tp.waitForAll();
 
-        auto result = std::make_shared<ReadTransaction>();
-        result->matrix = matrix->startReadTransaction();
-        result->inverse = inverse->startReadTransaction();
-        result->values = values->startReadTransaction();
-        result->epoch = epoch;
-
-        setDefaultTransaction(std::move(result));
+        setDefaultTransaction(newReadTransaction());
     }
 
     Date decodeTs(int64_t ts) const
+    {
+        return decodeTs(ts, timeQuantumSeconds);
+    }
+
+    static Date decodeTs(int64_t ts, double timeQuantumSeconds)
     {
         if (ts == -1)
             return Date::negativeInfinity();
@@ -784,6 +863,7 @@ struct SparseMatrixDataset::Itl
         entries.reserve(vals.size());
         for (auto & v: vals) {
             uint64_t ts = encodeTs(std::get<2>(v), timeQuantumSeconds);
+            trans.recordTimestamp(decodeTs(ts, timeQuantumSeconds));
             uint32_t tag;
             uint64_t val;
             std::tie(val, tag) = encodeVal(std::get<1>(v), trans);
@@ -832,6 +912,7 @@ struct SparseMatrixDataset::Itl
                            Date ts)
             {
                 uint64_t tsi = encodeTs(ts, timeQuantumSeconds);
+                trans.recordTimestamp(decodeTs(tsi, timeQuantumSeconds));
                 uint32_t tag;
                 uint64_t vali;
                 std::tie(vali, tag) = encodeVal(val, trans);
@@ -996,6 +1077,13 @@ getKnownColumnInfo(const ColumnPath & columnName) const
     return itl->getKnownColumnInfo(columnName);
 }
 
+std::pair<Date, Date>
+SparseMatrixDataset::
+getTimestampRange() const
+{
+    return itl->getTimestampRange();
+}
+
 void
 SparseMatrixDataset::
 commit()
@@ -1056,6 +1144,302 @@ enum CommitMode {
     WRITE_FAST
 };
 
+/*****************************************************************************/
+/* FROZEN COLUMN                                                             */
+/*****************************************************************************/
+
+/** One field (rowcol, timestamp, value or tag) of all of the entries of a
+    frozen matrix, stored in as few bytes as possible.  A field with the
+    same value everywhere, like a timestamp when everything was recorded
+    at once, takes no space per entry.  Otherwise it's stored either as
+    its value or as an index into a table of the distinct values when
+    that's smaller, using 1, 2, 4 or 8 bytes per entry.
+*/
+
+struct FrozenColumn {
+
+    FrozenColumn() = default;
+
+    FrozenColumn(const std::vector<uint64_t> & values)
+    {
+        if (values.empty())
+            return;
+
+        std::vector<uint64_t> distinct = values;
+        parallelRadixSort(distinct, [] (uint64_t v) { return v; });
+        distinct.erase(std::unique(distinct.begin(), distinct.end()),
+                       distinct.end());
+
+        if (distinct.size() == 1) {
+            table = std::move(distinct);
+            return;
+        }
+
+        int rawWidth = bytesFor(distinct.back());
+        int indexWidth = bytesFor(distinct.size() - 1);
+        
+        if (values.size() * indexWidth + distinct.size() * sizeof(uint64_t)
+            < values.size() * rawWidth) {
+            width = indexWidth;
+            storage.resize(values.size() * width);
+            for (size_t i = 0;  i < values.size();  ++i) {
+                set(i, std::lower_bound(distinct.begin(), distinct.end(),
+                                        values[i])
+                    - distinct.begin());
+            }
+            table = std::move(distinct);
+        }
+        else {
+            width = rawWidth;
+            storage.resize(values.size() * width);
+            for (size_t i = 0;  i < values.size();  ++i)
+                set(i, values[i]);
+        }
+    }
+
+    uint64_t operator [] (size_t i) const
+    {
+        uint64_t v;
+        switch (width) {
+        case 0: v = 0;  break;
+        case 1: v = storage[i];  break;
+        case 2: v = ((const uint16_t *)storage.data())[i];  break;
+        case 4: v = ((const uint32_t *)storage.data())[i];  break;
+        default: v = ((const uint64_t *)storage.data())[i];  break;
+        }
+        return table.empty() ? v : table[v];
+    }
+
+    size_t memUsage() const
+    {
+        return storage.capacity() + table.capacity() * sizeof(uint64_t);
+    }
+
+private:
+    static int bytesFor(uint64_t maxValue)
+    {
+        if (maxValue <= std::numeric_limits<uint8_t>::max())
+            return 1;
+        if (maxValue <= std::numeric_limits<uint16_t>::max())
+            return 2;
+        if (maxValue <= std::numeric_limits<uint32_t>::max())
+            return 4;
+        return 8;
+    }
+
+    void set(size_t i, uint64_t v)
+    {
+        switch (width) {
+        case 1: storage[i] = v;  break;
+        case 2: ((uint16_t *)storage.data())[i] = v;  break;
+        case 4: ((uint32_t *)storage.data())[i] = v;  break;
+        default: ((uint64_t *)storage.data())[i] = v;  break;
+        }
+    }
+
+    /// Bytes per entry in storage; 0 means a single value in table
+    int width = 0;
+
+    /// Value or table index of each entry, of width bytes each
+    std::vector<uint8_t> storage;
+
+    /// Distinct values, that storage indexes into if not empty
+    std::vector<uint64_t> table;
+};
+
+
+/*****************************************************************************/
+/* FROZEN ROWS                                                               */
+/*****************************************************************************/
+
+/** Immutable compressed version of the rows of a matrix, that committed
+    data is moved into by optimize().  The row keys are sorted, with the
+    entries of each row stored contiguously after those of the previous
+    row (compressed sparse row for the matrix, compressed sparse column for
+    its inverse), so that reading a row is a binary search followed by a
+    sequential read.  Each field of the entries is a FrozenColumn.
+
+    Entries with metadata, which are in the values matrix only, are kept
+    as BaseEntry objects so that the names and strings they hold can be
+    passed to the callback without being copied.
+*/
+
+struct FrozenRows {
+
+    typedef std::unordered_map<uint64_t, compact_vector<BaseEntry, 1> > RowsEntry;
+
+    /** Freeze the entries of the given frozen rows, if any, and of the
+        given rows entries.  Rows that are in more than one of them have
+        their entries in that order.
+    */
+    FrozenRows(const FrozenRows * previous,
+               const std::vector<const RowsEntry *> & entries)
+    {
+        size_t numRows = previous ? previous->keys.size() : 0;
+        for (auto * e: entries)
+            numRows += e->size();
+
+        keys.reserve(numRows);
+        if (previous)
+            keys = previous->keys;
+        for (auto * e: entries) {
+            for (auto & r: *e)
+                keys.push_back(r.first);
+        }
+        parallelRadixSort(keys, [] (uint64_t k) { return k; });
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        keys.shrink_to_fit();
+
+        filter = BlockedBloomFilter(keys.size());
+        for (uint64_t key: keys)
+            filter.insert(key);
+
+        std::vector<uint64_t> rowOffsets, rowcols, timestamps, vals, tags;
+        rowOffsets.reserve(keys.size() + 1);
+
+        auto addEntry = [&] (const BaseEntry & entry)
+            {
+                if (!entry.metadata.empty()) {
+                    metadataIndex.push_back(rowcols.size());
+                    metadataEntries.push_back(entry);
+                }
+                rowcols.push_back(entry.rowcol);
+                timestamps.push_back(entry.timestamp);
+                vals.push_back(entry.val);
+                tags.push_back(entry.tag);
+                return true;
+            };
+
+        // Rows of previous are a subset of ours, in the same order
+        size_t previousRow = 0;
+
+        for (uint64_t key: keys) {
+            rowOffsets.push_back(rowcols.size());
+            if (previous && previousRow < previous->keys.size()
+                && previous->keys[previousRow] == key) {
+                previous->iterateRowAt(previousRow++, addEntry);
+            }
+            for (auto * e: entries) {
+                auto it = e->find(key);
+                if (it == e->end())
+                    continue;
+                for (auto & entry: it->second)
+                    addEntry(entry);
+            }
+        }
+        rowOffsets.push_back(rowcols.size());
+        numEntries = rowcols.size();
+
+        offsets = FrozenColumn(rowOffsets);
+
+        if (metadataEntries.size() == numEntries) {
+            // Everything is in metadataEntries
+            metadataIndex.clear();
+        }
+        else {
+            rowcol = FrozenColumn(rowcols);
+            timestamp = FrozenColumn(timestamps);
+            val = FrozenColumn(vals);
+            tag = FrozenColumn(tags);
+        }
+
+        metadataIndex.shrink_to_fit();
+        metadataEntries.shrink_to_fit();
+    }
+
+    size_t rowCount() const
+    {
+        return keys.size();
+    }
+
+    bool knownRow(uint64_t rowNum) const
+    {
+        return filter.mayContain(rowNum)
+            && std::binary_search(keys.begin(), keys.end(), rowNum);
+    }
+
+    bool iterateRow(uint64_t rowNum,
+                    const std::function<bool (const BaseEntry & entry)> & onEntry) const
+    {
+        if (!filter.mayContain(rowNum))
+            return true;
+
+        auto it = std::lower_bound(keys.begin(), keys.end(), rowNum);
+        if (it == keys.end() || *it != rowNum)
+            return true;
+
+        return iterateRowAt(it - keys.begin(), onEntry);
+    }
+
+    /** Iterate over the entries of the row with the given index in keys. */
+    bool iterateRowAt(size_t row,
+                      const std::function<bool (const BaseEntry & entry)> & onEntry) const
+    {
+        size_t first = offsets[row], last = offsets[row + 1];
+
+        if (metadataEntries.size() == numEntries) {
+            for (size_t i = first;  i < last;  ++i) {
+                if (!onEntry(metadataEntries[i]))
+                    return false;
+            }
+            return true;
+        }
+
+        size_t m = std::lower_bound(metadataIndex.begin(), metadataIndex.end(),
+                                    first)
+            - metadataIndex.begin();
+
+        BaseEntry entry;
+        for (size_t i = first;  i < last;  ++i) {
+            if (m < metadataIndex.size() && metadataIndex[m] == i) {
+                if (!onEntry(metadataEntries[m++]))
+                    return false;
+                continue;
+            }
+            entry.rowcol = rowcol[i];
+            entry.timestamp = timestamp[i];
+            entry.val = val[i];
+            entry.tag = tag[i];
+            if (!onEntry(entry))
+                return false;
+        }
+
+        return true;
+    }
+
+    size_t memUsage() const
+    {
+        return keys.capacity() * sizeof(uint64_t) + filter.memUsage()
+            + offsets.memUsage() + rowcol.memUsage() + timestamp.memUsage()
+            + val.memUsage() + tag.memUsage()
+            + metadataIndex.capacity() * sizeof(uint64_t)
+            + metadataEntries.capacity() * sizeof(BaseEntry);
+    }
+
+    /// Sorted keys of the rows
+    std::vector<uint64_t> keys;
+
+    /// Filter over the keys, so that looking up an absent row (which is
+    /// frequent for the inverse and values matrices) is a single memory
+    /// access rather than a binary search
+    BlockedBloomFilter filter;
+
+    /// Index of the first entry of each row, plus the number of entries
+    FrozenColumn offsets;
+
+    size_t numEntries = 0;
+
+    /// Fields of the entries
+    FrozenColumn rowcol, timestamp, val, tag;
+
+    /// Sorted indexes of the entries with metadata, unless all have it
+    std::vector<uint64_t> metadataIndex;
+
+    /// Entries with metadata, in the order of metadataIndex
+    std::vector<BaseEntry> metadataEntries;
+};
+
+
 /*****************************************************************************/
 /* MUTABLE BASE MATRIX                                                       */
 /*****************************************************************************/
@@ -1068,7 +1452,7 @@ struct MutableBaseData {
     {
     }
 
-    typedef std::unordered_map<uint64_t, compact_vector<BaseEntry, 1> > RowsEntry;
+    typedef FrozenRows::RowsEntry RowsEntry;
 
     struct Rows {
         Rows()
@@ -1077,26 +1461,31 @@ struct MutableBaseData {
         }
 
         Rows(Rows && other) noexcept
-            : entries(std::move(other.entries)),
+            : frozen(std::move(other.frozen)),
+              entries(std::move(other.entries)),
               cachedRowCount(other.cachedRowCount.load())
         {
         }
 
         Rows(const Rows & other)
-            : entries(other.entries),
+            : frozen(other.frozen),
+              entries(other.entries),
               cachedRowCount(other.cachedRowCount.load())
         {
         }
 
-        Rows(std::vector<std::shared_ptr<const RowsEntry> > entries,
+        Rows(std::shared_ptr<const FrozenRows> frozen,
+             std::vector<std::shared_ptr<const RowsEntry> > entries,
              int64_t cachedRowCount)
-            : entries(std::move(entries)),
+            : frozen(std::move(frozen)),
+              entries(std::move(entries)),
               cachedRowCount(cachedRowCount)
         {
         }
 
         Rows & operator = (Rows && other) noexcept
         {
+            this->frozen = std::move(other.frozen);
             this->entries = std::move(other.entries);
             this->cachedRowCount = other.cachedRowCount.load();
             return *this;
@@ -1104,18 +1493,30 @@ struct MutableBaseData {
 
         Rows & operator = (const Rows & other)
         {
+            this->frozen = other.frozen;
             this->entries = other.entries;
             this->cachedRowCount = other.cachedRowCount.load();
             return *this;
         }
 
+        /// Rows as of the last optimize(), which come before the entries
+        std::shared_ptr<const FrozenRows> frozen;
         std::vector<std::shared_ptr<const RowsEntry> > entries;
         mutable std::atomic<int64_t> cachedRowCount;
         mutable std::mutex rowCountMutex;
+
+        /// Number of frozen rows and rows entries that rows are spread over
+        size_t numParts() const
+        {
+            return entries.size() + (frozen != nullptr);
+        }
         
         bool iterateRow(uint64_t rowNum,
                         const std::function<bool (const BaseEntry & entry)> & onEntry) const
         {
+            if (frozen && !frozen->iterateRow(rowNum, onEntry))
+                return false;
+
             for (auto & e: entries) {
                 auto it = e->find(rowNum);
                 if (it != e->end()) {
@@ -1131,8 +1532,19 @@ struct MutableBaseData {
 
         bool iterateRows(const std::function<bool (uint64_t row)> & onRow) const
         {
+            if (frozen && entries.empty()) {
+                for (uint64_t row: frozen->keys) {
+                    if (!onRow(row))
+                        return false;
+                }
+                return true;
+            }
+
             std::vector<uint64_t> allRows;
 
+            if (frozen)
+                allRows = frozen->keys;
+
             for (auto & e: entries) {
                 for (auto & r: *e) {
                     allRows.emplace_back(r.first);
@@ -1140,9 +1552,9 @@ struct MutableBaseData {
             }
 
             std::vector<uint64_t>::iterator end;
-            if (entries.size() > 1) {
+            if (numParts() > 1) {
                 //if we haven't commited the entries yet there can be duplicates
-                parallelQuickSortRecursive(allRows);
+                parallelRadixSort(allRows, [] (uint64_t row) { return row; });
                 end = std::unique(allRows.begin(), allRows.end());
             }
             else{
@@ -1159,6 +1571,9 @@ struct MutableBaseData {
 
         bool knownRow(uint64_t rowNum) const
         {
+            if (frozen && frozen->knownRow(rowNum))
+                return true;
+
             for (auto & e: entries) {
                 if (e->count(rowNum))
                     return true;
@@ -1169,10 +1584,10 @@ struct MutableBaseData {
         
         size_t rowCount() const
         {
-            if (entries.empty())
+            if (numParts() == 0)
                 return 0;
-            if (entries.size() == 1)
-                return entries.back()->size();
+            if (numParts() == 1)
+                return frozen ? frozen->rowCount() : entries.back()->size();
             int64_t r = cachedRowCount.load();
             if (r != -1)
                 return r;
@@ -1181,6 +1596,9 @@ struct MutableBaseData {
             std::unique_lock<std::mutex> guard(rowCountMutex);
             std::vector<uint64_t> allRows;
 
+            if (frozen)
+                allRows = frozen->keys;
+
             for (auto & e: entries) {
                 for (auto & r: *e) {
                     allRows.emplace_back(r.first);
@@ -1189,9 +1607,9 @@ struct MutableBaseData {
 
             int64_t rowCount = 0;
 
-            if (entries.size() > 1) {
+            if (numParts() > 1) {
                 //if we haven't commited the entries yet there can be duplicates
-                parallelQuickSortRecursive(allRows);
+                parallelRadixSort(allRows, [] (uint64_t row) { return row; });
                 rowCount = std::unique(allRows.begin(), allRows.end()) - allRows.begin();
             }
             else{
@@ -1202,38 +1620,29 @@ struct MutableBaseData {
             return rowCount;
         }
 
+        /** Return rows with everything, including the writes that
+            aren't readable yet, moved into new frozen rows.
+        */
         Rows optimize(std::vector<std::shared_ptr<RowsEntry> > & nonReadableWrites) const
         {
             Rows result;
 
-            RowsEntry newEntries;
-
-            if (!entries.empty()) {
-                newEntries = *entries.front();
+            std::vector<const RowsEntry *> toFreeze;
+            for (auto & e: entries)
+                toFreeze.push_back(e.get());
+            for (auto & w: nonReadableWrites)
+                toFreeze.push_back(w.get());
 
-                for (unsigned i = 1;  i < entries.size();  ++i) {
-                    auto & e = entries[i];
-                    for (auto & v: *e) {
-                        auto & vec = newEntries[v.first];
-                        vec.insert(vec.end(), v.second.begin(), v.second.end());
-                    }
-                }
+            if (frozen && toFreeze.empty()) {
+                result.frozen = frozen;
             }
-
-            for (auto & w: nonReadableWrites) {
-
-                auto & e = *w;
-                for (auto & v: e) {
-                    auto & vec = newEntries[v.first];
-                    vec.insert(vec.end(),
-                               std::make_move_iterator(v.second.begin()),
-                               std::make_move_iterator(v.second.end()));
-                }
+            else {
+                result.frozen = std::make_shared<FrozenRows>(frozen.get(),
+                                                             toFreeze);
             }
 
             nonReadableWrites.clear();
 
-            result.entries.emplace_back(new RowsEntry(std::move(newEntries)));
             return result;
         }
 
@@ -1245,6 +1654,12 @@ struct MutableBaseData {
 
             void initAt(size_t start)
             {
+                // Streams are only used over a single part
+                if (source->frozen) {
+                    frozenRow = start;
+                    return;
+                }
+
                 entriesIter = source->entries.begin();
                
                 subIter = (*entriesIter)->begin();
@@ -1266,6 +1681,9 @@ struct MutableBaseData {
 
             virtual uint64_t next()
             {
+                if (source->frozen)
+                    return source->frozen->keys[frozenRow++];
+
                 uint64_t value = subIter->first;
                 subIter++;
                 if (subIter == (*entriesIter)->end())  {
@@ -1280,17 +1698,21 @@ struct MutableBaseData {
 
             virtual uint64_t current() const
             {
+                if (source->frozen)
+                    return source->frozen->keys[frozenRow];
+
                 return subIter->first;
             }
 
             std::vector<std::shared_ptr<const RowsEntry> >::const_iterator entriesIter;
             RowsEntry::const_iterator subIter;
+            size_t frozenRow = 0;
             const MutableBaseData::Rows* source;
         };
 
         bool isSingleReadEntry() const
         {
-            return entries.size() == 1;
+            return numParts() == 1;
         }
 
     };
@@ -1305,9 +1727,10 @@ struct MutableBaseData {
         {
         }
         
-        Repr(std::vector<std::shared_ptr<const RowsEntry> > entries,
+        Repr(std::shared_ptr<const FrozenRows> frozen,
+             std::vector<std::shared_ptr<const RowsEntry> > entries,
              int64_t cachedRowCount)
-            : rows(std::move(entries), cachedRowCount)
+            : rows(std::move(frozen), std::move(entries), cachedRowCount)
         {
         }
 
@@ -1352,7 +1775,8 @@ struct MutableBaseData {
             newRows = oldRows.entries;
         newRows.emplace_back(std::move(written));
 
-        auto newRepr = std::make_shared<Repr>(std::move(newRows),
+        auto newRepr = std::make_shared<Repr>(oldRows.frozen,
+                                              std::move(newRows),
                                               oldRows.cachedRowCount.load());
         repr.store(std::move(newRepr));
     }
@@ -1434,7 +1858,8 @@ struct MutableBaseData {
         //         << endl;
         //}
 
-        auto newRepr = std::make_shared<Repr>(std::move(newRows),
+        auto newRepr = std::make_shared<Repr>(oldRows.frozen,
+                                              std::move(newRows),
                                               oldRows.cachedRowCount.load());
         repr.store(std::move(newRepr));
     }
@@ -1751,6 +2176,7 @@ struct MutableSparseMatrixDataset::Itl
             mode = READ_FAST;
         else mode = WRITE_FAST;
 
+        this->commitMode = mode;
         SparseMatrixDataset::Itl::timeQuantumSeconds = timeQuantumSeconds;
         init(std::make_shared<MutableBaseMatrix>(mode),
              std::make_shared<MutableBaseMatrix>(mode),
@@ -1758,15 +2184,57 @@ struct MutableSparseMatrixDataset::Itl
              std::make_shared<MutableBaseMatrix>(mode));
     }
 
+    CommitMode commitMode;
+
+    /** Chunks that have been recorded by a chunk recorder but not yet
+        committed, indexed by chunk number.
+    */
+    struct ChunkWrites {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<WriteTransaction> > chunks;
+
+        void add(size_t chunkIndex, std::shared_ptr<WriteTransaction> trans)
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            if (chunkIndex >= chunks.size())
+                chunks.resize(chunkIndex + 1);
+            ExcAssert(!chunks[chunkIndex]);
+            chunks[chunkIndex] = std::move(trans);
+        }
+
+        /// Return the finished chunks in order, leaving none behind
+        std::vector<std::shared_ptr<WriteTransaction> > take()
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            std::vector<std::shared_ptr<WriteTransaction> > result;
+            for (auto & c: chunks) {
+                if (c)
+                    result.emplace_back(std::move(c));
+            }
+            chunks.clear();
+            return result;
+        }
+    };
+
     /** This is a recorder that is designed to have each thread record
         chunks in a deterministic manner.
+
+        When writes are only readable after a commit, the chunks are not
+        committed as they finish, but handed over to be committed in one
+        go, in the order of their chunk numbers, when the recorder is
+        committed.  Otherwise each chunk is committed as soon as it's
+        finished so that it can be read back.
     */
     struct ChunkRecorder: public Recorder {
-        ChunkRecorder(Itl * itl, shared_ptr<spdlog::logger> logger)
+        ChunkRecorder(Itl * itl, shared_ptr<spdlog::logger> logger,
+                      size_t chunkIndex,
+                      std::shared_ptr<ChunkWrites> writes)
             : itl(itl),
               readTransaction(itl->getReadTransaction()),
-              trans(*readTransaction),
-              logger(logger)
+              trans(std::make_shared<WriteTransaction>(*readTransaction)),
+              logger(logger),
+              chunkIndex(chunkIndex),
+              writes(std::move(writes))
         {
         }
 
@@ -1774,35 +2242,39 @@ struct MutableSparseMatrixDataset::Itl
 
         // Each chunk has its own transaction
         std::shared_ptr<ReadTransaction> readTransaction;
-        WriteTransaction trans;
+        std::shared_ptr<WriteTransaction> trans;
         shared_ptr<spdlog::logger> logger;
+        size_t chunkIndex;
+
+        // Where to put the chunk when finished; null to commit it directly
+        std::shared_ptr<ChunkWrites> writes;
 
         virtual void
         recordRowExpr(const RowPath & rowName,
                       const ExpressionValue & expr) override
         {
-            Itl::recordRowExprTrans(rowName, expr, trans, itl->timeQuantumSeconds);
+            Itl::recordRowExprTrans(rowName, expr, *trans, itl->timeQuantumSeconds);
         }
 
         virtual void
         recordRowExprDestructive(RowPath rowName,
                                  ExpressionValue expr) override
         {
-            Itl::recordRowExprTrans(rowName, expr, trans, itl->timeQuantumSeconds);
+            Itl::recordRowExprTrans(rowName, expr, *trans, itl->timeQuantumSeconds);
         }
 
         virtual void
         recordRow(const RowPath & rowName,
                   const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) override
         {
-            Itl::recordRowTrans(rowName, vals, trans, itl->timeQuantumSeconds, logger);
+            Itl::recordRowTrans(rowName, vals, *trans, itl->timeQuantumSeconds, logger);
         }
 
         virtual void
         recordRowDestructive(RowPath rowName,
                              std::vector<std::tuple<ColumnPath, CellValue, Date> > vals) override
         {
-            Itl::recordRowTrans(rowName, vals, trans, itl->timeQuantumSeconds, logger);
+            Itl::recordRowTrans(rowName, vals, *trans, itl->timeQuantumSeconds, logger);
         }
 
         virtual void
@@ -1837,7 +2309,10 @@ struct MutableSparseMatrixDataset::Itl
 
         virtual void finishedChunk() override
         {
-            itl->commitWrites(trans);
+            if (writes)
+                writes->add(chunkIndex, std::move(trans));
+            else itl->commitWrites(*trans);
+            trans.reset();
         }
     };
 };
@@ -1858,15 +2333,26 @@ Dataset::MultiChunkRecorder
 MutableSparseMatrixDataset::
 getChunkRecorder()
 {
+    Itl * itl = static_cast<Itl *>(this->itl.get());
+
+    std::shared_ptr<Itl::ChunkWrites> writes;
+    if (itl->commitMode == READ_ON_COMMIT)
+        writes = std::make_shared<Itl::ChunkWrites>();
+
     MultiChunkRecorder result;
-    result.newChunk = [=] (size_t)
+    result.newChunk = [=] (size_t chunkIndex)
         {
             return std::unique_ptr<Recorder>(
                 new MutableSparseMatrixDataset::Itl::ChunkRecorder(
-                    static_cast<Itl *>(itl.get()), logger));
+                    itl, logger, chunkIndex, writes));
         };
 
-    result.commit = [=] () { this->commit(); };
+    result.commit = [=] ()
+        {
+            if (writes)
+                itl->commitWrites(writes->take());
+            this->commit();
+        };
     return result;
 }
 
@@ -52,8 +52,10 @@ struct SparseMatrixDataset: public Dataset {
     /** Commit changes to the database. */
     virtual void commit() override;
 
-    // TODO: implement; the default version is very slow
-    //virtual std::pair<Date, Date> getTimestampRange() const;
+    /** The range is kept up to date as writes are committed, rather than
+        being calculated by a query over every cell.
+    */
+    virtual std::pair<Date, Date> getTimestampRange() const override;
 
     virtual Date quantizeTimestamp(Date timestamp) const override;
 
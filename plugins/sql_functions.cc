@@ -24,6 +24,7 @@
 #include "mldb/server/analytics.h"
 #include "mldb/utils/log.h"
 #include "mldb/rest/cancellation_exception.h"
+#include "mldb/core/run_progress.h"
 #include <memory>
 
 using namespace std;
@@ -33,6 +34,10 @@ using namespace std;
 namespace MLDB {
 
 namespace {
+
+/// Number of rows each thread of a transform records at once
+constexpr size_t TRANSFORM_RECORD_BATCH_SIZE = 256;
+
 inline std::vector<std::tuple<ColumnPath, CellValue, Date> >
 filterEmptyColumns(MatrixNamedRow & row) {
     // Nulls with non-finite timestamp are not recorded; they
@@ -684,6 +689,10 @@ run(const ProcedureRunConfig & run,
         createDataset(server, runProcConf.outputDataset, nullptr, true /*overwrite*/);
     bool skipEmptyRows = runProcConf.skipEmptyRows;
 
+    RunProgress * runProgress = RunProgress::current();
+    if (runProgress)
+        runProgress->startStage("transform");
+
     auto recordRowInOutputDataset = [&output, &skipEmptyRows] (MatrixNamedRow & row) {
         std::vector<std::tuple<ColumnPath, CellValue, Date> > cols
             = filterEmptyColumns(row);
@@ -714,6 +723,19 @@ run(const ProcedureRunConfig & run,
             /// to record into the dataset.
             std::unique_ptr<Recorder> threadRecorder;
 
+            /// Rows waiting to be recorded in one batch
+            std::vector<std::pair<RowPath, ExpressionValue> > pending;
+
+            void flush()
+            {
+                if (pending.empty())
+                    return;
+                std::vector<std::pair<RowPath, ExpressionValue> > rows;
+                rows.reserve(TRANSFORM_RECORD_BATCH_SIZE);
+                rows.swap(pending);
+                threadRecorder->recordRowsExprDestructive(std::move(rows));
+            }
+
             /// Special function to allow rapid insertion of fixed set of
             /// atom valued columns.  Only for isIdentitySelect.
             //std::function<void (RowPath rowName,
@@ -733,6 +755,8 @@ run(const ProcedureRunConfig & run,
                    ExpressionValue & row,
                    std::vector<ExpressionValue> & calc)
             {
+                if (runProgress)
+                    runProgress->addRows();
                 auto & threadAccum = accum.get();
                 if (!threadAccum.threadRecorder) {
                     threadAccum.threadRecorder = recorder.newChunk(chunkNumber.fetch_add(1));
@@ -760,8 +784,10 @@ run(const ProcedureRunConfig & run,
                 }
                 // TODO: could optimize slightly by finding rowName == rowName()
                 // and copying the existing rowPath in that case
-                threadAccum.threadRecorder->recordRowExprDestructive
-                    (calc[0].coerceToPath(), std::move(row));
+                threadAccum.pending.emplace_back(calc[0].coerceToPath(),
+                                                 std::move(row));
+                if (threadAccum.pending.size() >= TRANSFORM_RECORD_BATCH_SIZE)
+                    threadAccum.flush();
                 return true;
             };
 
@@ -785,12 +811,15 @@ run(const ProcedureRunConfig & run,
                 
             }
 
-        // Finish off the last bits of each thread
+        // Finish off the last bits of each thread.  Datasets that can
+        // freeze their chunks in the background do so, and the commit
+        // waits for them.
         parallelMap(0, accum.threads.size(),
                     [&] (size_t n)
                     {
                         auto & threadAccum = *accum.threads[n];
                         ExcAssert(threadAccum.threadRecorder.get());
+                        threadAccum.flush();
                         threadAccum.threadRecorder->finishedChunk();
                     });
     }
@@ -798,6 +827,8 @@ run(const ProcedureRunConfig & run,
         auto recordRowInOutputDataset
             = [&] (NamedRowValue & row_)
             {
+                if (runProgress)
+                    runProgress->addRows();
                 MatrixNamedRow row = row_.flattenDestructive();
                 std::vector<std::tuple<ColumnPath, CellValue, Date> > cols
                     = filterEmptyColumns(row);
@@ -834,6 +865,8 @@ run(const ProcedureRunConfig & run,
     }
 
     // Save the dataset we created
+    if (runProgress)
+        runProgress->startStage("commit");
     output->commit();
 
     return output->getStatus();
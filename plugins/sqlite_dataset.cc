@@ -19,6 +19,7 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/utils/log.h"
+#include <unordered_map>
 
 using namespace std;
 
@@ -120,6 +121,65 @@ struct SqliteSparseDataset::Itl
             : sqlite3pp::database(filename.empty() ? ("file::" + id + "?mode=memory&cache=shared").rawData() : filename.c_str())
         {
         }
+
+        /// Statements that have been prepared on this connection, by their
+        /// SQL.  Being members, they are finalized before the connection
+        /// is closed by the base class.
+        std::unordered_map<std::string, std::unique_ptr<sqlite3pp::query> > queries;
+        std::unordered_map<std::string, std::unique_ptr<sqlite3pp::command> > commands;
+
+        /// Most statements of each kind to keep prepared.  Queries with
+        /// an OFFSET or LIMIT are different each time, so this keeps them
+        /// from accumulating.
+        static constexpr size_t maxStatements = 256;
+
+        template<typename Statement>
+        Statement &
+        getStatement(std::unordered_map<std::string, std::unique_ptr<Statement> > & statements,
+                     const std::string & sql)
+        {
+            auto it = statements.find(sql);
+            if (it != statements.end())
+                return *it->second;
+            if (statements.size() >= maxStatements)
+                statements.clear();
+            std::unique_ptr<Statement> statement(new Statement(*this, sql.c_str()));
+            return *statements.emplace(sql, std::move(statement)).first->second;
+        }
+
+        /** Return the query for the given SQL, which is prepared the first
+            time that it is asked for on this connection.  It must be reset
+            once it's done with; see ResetOnExit.
+        */
+        sqlite3pp::query & query(const std::string & sql)
+        {
+            return getStatement(queries, sql);
+        }
+
+        /** Return the command for the given SQL; see query(). */
+        sqlite3pp::command & command(const std::string & sql)
+        {
+            return getStatement(commands, sql);
+        }
+    };
+
+    /** Resets a statement from the cache of the connection once it goes
+        out of scope, including when the results weren't read to the end,
+        so that it doesn't keep a read transaction open and can be run
+        again.
+    */
+    struct ResetOnExit {
+        ResetOnExit(sqlite3pp::statement & statement)
+            : statement(statement)
+        {
+        }
+
+        ~ResetOnExit()
+        {
+            statement.reset();
+        }
+
+        sqlite3pp::statement & statement;
     };
 
     struct Connection: public std::unique_ptr<Database> {
@@ -182,7 +242,9 @@ struct SqliteSparseDataset::Itl
 
     static void bindArg(sqlite3pp::statement & statement, int index, const RowPath & arg)
     {
-        int res = statement.bind(index, arg.toUtf8String().rawData());
+        // The string is temporary, so sqlite needs to take a copy
+        int res = statement.bind(index, arg.toUtf8String().rawData(),
+                                 false /* static */);
         ExcAssertEqual(res, SQLITE_OK);
     }
 
@@ -287,7 +349,8 @@ struct SqliteSparseDataset::Itl
             INFO_MSG(logger) << explainQuery << "\n" << explanation;
         }
 
-        sqlite3pp::query query(*db, queryStr.c_str());
+        sqlite3pp::query & query = db->query(queryStr);
+        ResetOnExit resetQuery(query);
 
         bindArgs(query, 1, std::forward<Args>(args)...);
 
@@ -442,13 +505,14 @@ struct SqliteSparseDataset::Itl
         return result;
     }
 
-    virtual int getRowNum(sqlite3pp::database & db, const RowPath & rowName)
+    virtual int getRowNum(Database & db, const RowPath & rowName)
     {
         RowHash rowHash(rowName);
         std::string rowNameStr = rowName.toUtf8String().rawString();
 
         {
-            sqlite3pp::command command(db,"INSERT OR IGNORE INTO rows VALUES (NULL, ?, ?)");
+            sqlite3pp::command & command = db.command("INSERT OR IGNORE INTO rows VALUES (NULL, ?, ?)");
+            ResetOnExit resetCommand(command);
             bindArg(command, 1, rowHash);
             bindArg(command, 2, rowNameStr.c_str());
             command.execute();
@@ -480,7 +544,8 @@ struct SqliteSparseDataset::Itl
 
 
 
-        sqlite3pp::query query(db, "SELECT rowNum FROM rows WHERE rowHash = ? LIMIT 1");
+        sqlite3pp::query & query = db.query("SELECT rowNum FROM rows WHERE rowHash = ? LIMIT 1");
+        ResetOnExit resetQuery(query);
         bindArg(query, 1, rowHash);
         for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
             return (*i).get<int>(0);
@@ -489,7 +554,7 @@ struct SqliteSparseDataset::Itl
         throw HttpReturnException(400, "Couldn't get a row number");
     }
 
-    virtual int getColNum(sqlite3pp::database & db, const ColumnPath & colName)
+    virtual int getColNum(Database & db, const ColumnPath & colName)
     {
         ColumnHash colHash(colName);
         auto it = colNumCache.find(colHash);
@@ -499,7 +564,8 @@ struct SqliteSparseDataset::Itl
         std::string colNameStr = colName.toUtf8String().rawString();
         
         {
-            sqlite3pp::command command(db,"INSERT OR IGNORE INTO cols VALUES (NULL, ?, ?)");
+            sqlite3pp::command & command = db.command("INSERT OR IGNORE INTO cols VALUES (NULL, ?, ?)");
+            ResetOnExit resetCommand(command);
             bindArg(command, 1, colHash);
             bindArg(command, 2, colNameStr.c_str());
             command.execute();
@@ -507,7 +573,8 @@ struct SqliteSparseDataset::Itl
 
         //dumpQuery(db, "SELECT * FROM cols");
 
-        sqlite3pp::query query(db, "SELECT colNum FROM cols WHERE colHash = ? AND colName = ? LIMIT 1");
+        sqlite3pp::query & query = db.query("SELECT colNum FROM cols WHERE colHash = ? AND colName = ? LIMIT 1");
+        ResetOnExit resetQuery(query);
         bindArgs(query, 1, colHash, colNameStr.c_str());
         for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
             int result = (*i).get<int>(0);
@@ -533,7 +600,8 @@ struct SqliteSparseDataset::Itl
 
         sqlite3pp::transaction trans(*db);
 
-        sqlite3pp::command command(*db, "INSERT OR IGNORE INTO vals VALUES (?, ?, ?, ?)");
+        sqlite3pp::command & command = db->command("INSERT OR IGNORE INTO vals VALUES (?, ?, ?, ?)");
+        ResetOnExit resetCommand(command);
 
         for (auto & r: rows) {
 
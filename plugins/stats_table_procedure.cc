@@ -29,6 +29,9 @@
 #include "mldb/base/parallel.h"
 #include "mldb/types/optional_description.h"
 #include "mldb/utils/log.h"
+#include "mldb/utils/json_utils.h"
+#include "mldb/ext/highwayhash.h"
+#include <limits>
 
 
 using namespace std;
@@ -85,7 +88,7 @@ increment(const CellValue & val, const vector<uint> & outcomes) {
     auto it = counts.find(key);
     if(it == counts.end()) {
         auto rtn = counts.emplace(
-            key, make_pair(1, vector<int64_t>(outcomes.begin(),
+            std::move(key), make_pair(1, vector<int64_t>(outcomes.begin(),
                                               outcomes.end())));
         // return inserted value
         return (*(rtn.first)).second;
@@ -118,32 +121,278 @@ save(const std::string & filename) const
     serialize(store);
 }
 
-void StatsTable::
-serialize(ML::DB::Store_Writer & store) const
-{
-    int version = 2;
-    store << string("MLDB Stats Table Binary")
-          << version << colName << outcome_names << counts << zeroCounts;
-}
+namespace {
 
-void StatsTable::
-reconstitute(ML::DB::Store_Reader & store)
+const std::string STATS_TABLE_MAGIC = "MLDB Stats Table Binary";
+
+/** Read the header of a serialized stats table, returning its version.
+    Version 2 holds a serialized StatsTable, and version 3 a
+    FrozenStatsTable.
+*/
+int reconstituteHeader(ML::DB::Store_Reader & store)
 {
     int version;
-    int REQUIRED_V = 2;
     std::string name;
     store >> name >> version;
-    if (name != "MLDB Stats Table Binary") {
+    if (name != STATS_TABLE_MAGIC) {
         throw HttpReturnException(400, "File does not appear to be a stats "
                                   "table model");
     }
-    if(version!=REQUIRED_V) {
+    if (version != 2 && version != 3) {
         throw HttpReturnException(400, MLDB::format(
-                    "invalid StatsTable version! exptected %d, got %d",
-                    REQUIRED_V, version));
+                    "invalid StatsTable version! exptected 2 or 3, got %d",
+                    version));
+    }
+    return version;
+}
+
+uint64_t hashKey(const char * key, size_t len)
+{
+    return highwayHash(defaultHashSeedStable.u64, key, len);
+}
+
+// The arrays are written as their raw bytes, and so in the byte order of
+// the machine that saved them
+template<typename T>
+void serializeArray(ML::DB::Store_Writer & store, const std::vector<T> & vals)
+{
+    store << (uint64_t)vals.size();
+    store.save_binary(vals.data(), vals.size() * sizeof(T));
+}
+
+template<typename T>
+void reconstituteArray(ML::DB::Store_Reader & store, std::vector<T> & vals)
+{
+    uint64_t size;
+    store >> size;
+    vals.resize(size);
+    store.load_binary(vals.data(), size * sizeof(T));
+}
+
+/** Read the counts of a version 2 stats table, which were written in the
+    same format as a std::unordered_map.
+*/
+void reconstituteCounts(ML::DB::Store_Reader & store,
+                        StatsTable::Counts & counts)
+{
+    ML::DB::compact_size_t numKeys(store);
+    StatsTable::Counts result;
+    result.reserve(numKeys);
+    for (size_t i = 0;  i < numKeys;  ++i) {
+        Utf8String key;
+        StatsTable::BucketCounts val;
+        store >> key >> val;
+        result.emplace(std::move(key), std::move(val));
+    }
+    counts.swap(result);
+}
+
+} // file scope
+
+void StatsTable::
+serialize(ML::DB::Store_Writer & store) const
+{
+    FrozenStatsTable(*this).serialize(store);
+}
+
+void StatsTable::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    int version = reconstituteHeader(store);
+    if (version == 2) {
+        store >> colName >> outcome_names;
+        reconstituteCounts(store, counts);
+        store >> zeroCounts;
+        return;
+    }
+
+    FrozenStatsTable frozen;
+    frozen.reconstituteContents(store);
+    *this = frozen.thaw();
+}
+
+
+/*****************************************************************************/
+/* FROZEN STATS TABLE                                                        */
+/*****************************************************************************/
+
+FrozenStatsTable::
+FrozenStatsTable()
+    : counts(1, 0)
+{
+}
+
+FrozenStatsTable::
+FrozenStatsTable(const StatsTable & table)
+    : colName(table.colName), outcome_names(table.outcome_names)
+{
+    size_t width = outcome_names.size() + 1;
+    size_t numKeys = table.counts.size();
+
+    size_t totalLength = 0;
+    for (auto & c: table.counts)
+        totalLength += c.first.rawLength();
+
+    keyOffsets.reserve(numKeys + 1);
+    keyData.reserve(totalLength);
+    counts.reserve((numKeys + 1) * width);
+
+    for (auto & c: table.counts) {
+        keyOffsets.push_back(keyData.size());
+        keyData.insert(keyData.end(), c.first.rawData(),
+                       c.first.rawData() + c.first.rawLength());
+        ExcAssertEqual(c.second.second.size(), outcome_names.size());
+        counts.push_back(c.second.first);
+        counts.insert(counts.end(), c.second.second.begin(),
+                      c.second.second.end());
     }
+    keyOffsets.push_back(keyData.size());
+    counts.resize((numKeys + 1) * width, 0);
 
-    store >> colName >> outcome_names >> counts >> zeroCounts;
+    buildIndex();
+}
+
+void
+FrozenStatsTable::
+buildIndex()
+{
+    size_t numKeys = size();
+    if (numKeys >= std::numeric_limits<uint32_t>::max())
+        throw HttpReturnException(400, "Too many keys in stats table");
+
+    size_t numSlots = 1;
+    while (numSlots < 2 * numKeys)
+        numSlots *= 2;
+
+    slots.clear();
+    slots.resize(numSlots, 0);
+
+    uint64_t mask = numSlots - 1;
+    for (size_t i = 0;  i < numKeys;  ++i) {
+        uint64_t hash = hashKey(keyData.data() + keyOffsets[i],
+                                keyOffsets[i + 1] - keyOffsets[i]);
+        uint64_t slot = hash & mask;
+        while (slots[slot] != 0)
+            slot = (slot + 1) & mask;
+        slots[slot] = (hash & 0xffffffff00000000ULL) | (i + 1);
+    }
+}
+
+const int64_t *
+FrozenStatsTable::
+getCounts(const CellValue & val) const
+{
+    size_t width = outcome_names.size() + 1;
+    const int64_t * notFound = counts.data() + size() * width;
+
+    if (slots.empty())
+        return notFound;
+
+    // Avoid copying the key if it's already a string
+    Utf8String storage;
+    const char * key;
+    size_t len;
+    if (val.isString()) {
+        key = val.stringChars();
+        len = val.toStringLength();
+    }
+    else {
+        storage = val.toUtf8String();
+        key = storage.rawData();
+        len = storage.rawLength();
+    }
+
+    uint64_t hash = hashKey(key, len);
+    uint64_t mask = slots.size() - 1;
+
+    for (uint64_t slot = hash & mask;  slots[slot] != 0;
+         slot = (slot + 1) & mask) {
+        uint64_t entry = slots[slot];
+        if ((entry ^ hash) >> 32)
+            continue;
+        size_t i = (entry & 0xffffffff) - 1;
+        if (keyOffsets[i + 1] - keyOffsets[i] == len
+            && std::equal(key, key + len, keyData.data() + keyOffsets[i]))
+            return counts.data() + i * width;
+    }
+
+    return notFound;
+}
+
+StatsTable
+FrozenStatsTable::
+thaw() const
+{
+    StatsTable result(colName, outcome_names);
+    size_t width = outcome_names.size() + 1;
+    result.counts.reserve(size());
+
+    for (size_t i = 0;  i < size();  ++i) {
+        Utf8String key(string(keyData.data() + keyOffsets[i],
+                              keyData.data() + keyOffsets[i + 1]));
+        const int64_t * row = counts.data() + i * width;
+        result.counts.emplace(std::move(key),
+                              make_pair(row[0],
+                                        vector<int64_t>(row + 1, row + width)));
+    }
+
+    return result;
+}
+
+void
+FrozenStatsTable::
+serialize(ML::DB::Store_Writer & store) const
+{
+    int version = 3;
+    store << STATS_TABLE_MAGIC << version;
+    serializeContents(store);
+}
+
+void
+FrozenStatsTable::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    int version = reconstituteHeader(store);
+    if (version == 3) {
+        reconstituteContents(store);
+        return;
+    }
+
+    StatsTable table;
+    store >> table.colName >> table.outcome_names;
+    reconstituteCounts(store, table.counts);
+    store >> table.zeroCounts;
+    *this = FrozenStatsTable(table);
+}
+
+void
+FrozenStatsTable::
+serializeContents(ML::DB::Store_Writer & store) const
+{
+    store << colName << outcome_names;
+    serializeArray(store, keyOffsets);
+    serializeArray(store, keyData);
+    serializeArray(store, slots);
+    serializeArray(store, counts);
+}
+
+void
+FrozenStatsTable::
+reconstituteContents(ML::DB::Store_Reader & store)
+{
+    store >> colName >> outcome_names;
+    reconstituteArray(store, keyOffsets);
+    reconstituteArray(store, keyData);
+    reconstituteArray(store, slots);
+    reconstituteArray(store, counts);
+
+    size_t width = outcome_names.size() + 1;
+    if (counts.size() != (size() + 1) * width
+        || (!keyOffsets.empty() && keyOffsets.back() != keyData.size())
+        || (slots.size() & (slots.size() - 1)) != 0
+        || slots.size() < size()) {
+        throw HttpReturnException(400, "Stats table model is corrupt");
+    }
 }
 
 
@@ -437,14 +686,14 @@ apply(const FunctionApplier & applier,
                 if(st == statsTables.end())
                     return true;
 
-                const auto & counts = st->second.getCounts(val);
+                const int64_t * counts = st->second.getCounts(val);
 
-                rtnRow.emplace_back(PathElement("trial") + columnName, counts.first, ts);
+                rtnRow.emplace_back(PathElement("trial") + columnName, counts[0], ts);
 
                 for(int lbl_idx=0; lbl_idx<st->second.outcome_names.size(); lbl_idx++) {
                     rtnRow.emplace_back(PathElement(st->second.outcome_names[lbl_idx])
                                         +columnName,
-                                        counts.second[lbl_idx],
+                                        counts[lbl_idx + 1],
                                         ts);
                 }
 
@@ -737,8 +986,6 @@ run(const ProcedureRunConfig & run,
         auto output = createDataset(server, outputDatasetConf, onProgress2,
                                     true /*overwrite*/);
 
-        uint64_t load_factor = std::ceil(statsTable.counts.load_factor());
-
         vector<ColumnPath> outcome_col_names;
         outcome_col_names.reserve(statsTable.outcome_names.size());
         for (int i=0; i < statsTable.outcome_names.size(); ++i)
@@ -747,34 +994,38 @@ run(const ProcedureRunConfig & run,
 
         typedef std::vector<std::tuple<ColumnPath, CellValue, Date>> Columns;
 
-        auto onBucketChunk = [&] (size_t i0, size_t i1)
+        // The counts have no buckets to split between threads, so the
+        // entries are split instead
+        std::vector<StatsTable::Counts::const_iterator> entries;
+        entries.reserve(statsTable.counts.size());
+        for (auto it = statsTable.counts.begin();
+             it != statsTable.counts.end();  ++it)
+            entries.push_back(it);
+
+        auto onEntryChunk = [&] (size_t i0, size_t i1)
         {
             std::vector<std::pair<RowPath, Columns>> rows;
-            rows.reserve((i1 - i0)*load_factor);
-            // for each bucket of the unordered_map in our chunk
+            rows.reserve(i1 - i0);
             for (size_t i = i0; i < i1; ++i) {
-                // for each item in the bucket
-                for (auto it = statsTable.counts.begin(i);
-                        it != statsTable.counts.end(i); ++it) {
-                    Columns columns;
-                    // number of trials
-                    columns.emplace_back(PathElement("trials"), it->second.first, date0);
-                    // coocurence with outcome for each outcome
-                    for (int i=0; i < statsTable.outcome_names.size(); ++i) {
-                        columns.emplace_back(
-                            outcome_col_names[i],
-                            it->second.second[i],
-                            date0);
-                    }
-                    rows.emplace_back(PathElement(it->first), columns);
+                auto it = entries[i];
+                Columns columns;
+                // number of trials
+                columns.emplace_back(PathElement("trials"), it->second.first, date0);
+                // coocurence with outcome for each outcome
+                for (int i=0; i < statsTable.outcome_names.size(); ++i) {
+                    columns.emplace_back(
+                        outcome_col_names[i],
+                        it->second.second[i],
+                        date0);
                 }
+                rows.emplace_back(PathElement(it->first), columns);
             }
             output->recordRows(rows);
             return true;
         };
 
-        parallelMapChunked(0, statsTable.counts.bucket_count(),
-                           256 /* chunksize */, onBucketChunk);
+        parallelMapChunked(0, entries.size(),
+                           256 /* chunksize */, onEntryChunk);
         output->commit();
     }
 
@@ -16,6 +16,7 @@
 #include "sql/sql_expression.h"
 #include "mldb/jml/db/persistent_fwd.h"
 #include "mldb/types/optional.h"
+#include "mldb/utils/flat_hash_map.h"
 
 
 namespace MLDB {
@@ -52,12 +53,80 @@ struct StatsTable {
     ColumnPath colName;
 
     std::vector<std::string> outcome_names;
-    std::unordered_map<Utf8String, BucketCounts> counts;
+
+    typedef FlatHashMap<Utf8String, BucketCounts> Counts;
+    Counts counts;
 
     BucketCounts zeroCounts;
 };
 
 
+/*****************************************************************************/
+/* FROZEN STATS TABLE                                                        */
+/*****************************************************************************/
+
+/** Read-only version of a StatsTable, used to look up the counts when
+    the table is applied.  The keys are interned back to back in a single
+    block and the counts packed into a single array with a fixed width
+    row per key, so there is no allocation per key and loading is a
+    handful of bulk reads.  Lookups go through an open addressed index
+    that is at most half full, and so usually probe a single slot before
+    comparing the key and reading its counts.
+*/
+struct FrozenStatsTable {
+
+    FrozenStatsTable();
+
+    FrozenStatsTable(const StatsTable & table);
+
+    /** Return the counts for the given key: the number of trials followed
+        by the number of occurrences of each outcome.  Keys that aren't in
+        the table have zero counts.  The pointer is valid as long as the
+        table is.
+    */
+    const int64_t * getCounts(const CellValue & val) const;
+
+    /// Number of keys in the table
+    size_t size() const
+    {
+        return keyOffsets.empty() ? 0 : keyOffsets.size() - 1;
+    }
+
+    /// Extract the contents back into a mutable StatsTable
+    StatsTable thaw() const;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
+    /** Serialize and reconstitute everything but the header, which is
+        shared with StatsTable.
+    */
+    void serializeContents(ML::DB::Store_Writer & store) const;
+    void reconstituteContents(ML::DB::Store_Reader & store);
+
+    ColumnPath colName;
+    std::vector<std::string> outcome_names;
+
+    /// Start of each key in keyData, plus the end of the last one
+    std::vector<uint64_t> keyOffsets;
+
+    /// Bytes of the keys, back to back
+    std::vector<char> keyData;
+
+    /// Index of the keys.  The top 32 bits are the top of the hash of
+    /// the key and the bottom 32 are one plus its index, or zero for
+    /// an empty slot.  Its size is a power of two.
+    std::vector<uint64_t> slots;
+
+    /// One row of 1 + outcome_names.size() counts per key, followed by
+    /// a row of zeros for keys that aren't found
+    std::vector<int64_t> counts;
+
+private:
+    void buildIndex();
+};
+
+
 
 
 /*****************************************************************************/
@@ -141,7 +210,7 @@ struct StatsTableFunction: public Function {
 
     StatsTableFunctionConfig functionConfig;
 
-    StatsTablesMap statsTables;
+    std::map<ColumnPath, FrozenStatsTable> statsTables;
 };
 
 
@@ -19,6 +19,7 @@
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/types/date.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/sql/sql_expression_operations.h"
 #include "mldb/plugins/sql_config_validator.h"
 #include "mldb/utils/log.h"
 #include "progress.h"
@@ -140,281 +141,287 @@ struct MostFrequents {
     }
 };
 
-// Simple handlers to enhance the lisibility of the run function.
-struct NumericRowHandler {
-    NumericRowHandler() = delete;
-    NumericRowHandler(BoundTableExpression & boundDataset,
+typedef std::unordered_map<CellValue, int64_t> ValueCounts;
+
+/** Record the statistics of a column, from the number of occurrences of
+    each of its non-null values in the numRows rows of the input.  As the
+    counts are exact, so are the statistics: they are those that the
+    count_distinct, min, max, avg and stddev aggregators would give, with
+    the quartiles and most frequent values from grouping by the column.
+*/
+static void
+recordValueStats(const ValueCounts & counts, int64_t numRows,
+                 const Path & rowName, Dataset & output, Date now)
+{
+    std::vector<std::pair<CellValue, int64_t> > values(counts.begin(),
+                                                       counts.end());
+    std::sort(values.begin(), values.end());
+
+    int64_t numNotNull = 0;
+    bool isNumeric = !values.empty();
+    for (auto & v: values) {
+        numNotNull += v.second;
+        if (!v.first.isNumber())
+            isNumeric = false;
+    }
+
+    ColumnPath value("value");
+    vector<Cell> toRecord;
+    toRecord.emplace_back(value + "num_null", numRows - numNotNull, now);
+    toRecord.emplace_back(value + "num_unique", (int64_t)values.size(), now);
+
+    if (!isNumeric) {
+        toRecord.emplace_back(value + "data_type", "categorical", now);
+        MostFrequents<Utf8String, 10> mostFrequents; // Keep top 10
+        for (auto & v: values)
+            mostFrequents.addItem(make_pair(v.second, v.first.toString()));
+        for (int i = 0; i < mostFrequents.currSize; ++ i) {
+            toRecord.emplace_back(
+                value + "most_frequent_items" + mostFrequents.top[i].second,
+                mostFrequents.top[i].first,
+                now);
+        }
+        output.recordRow(rowName, toRecord);
+        return;
+    }
+
+    // Same as the stddev aggregator, merging in each distinct value
+    int64_t n = 0;
+    double mean = 0, M2 = 0, total = 0;
+    const int NUM_QUARTILES = 3;
+    double quartiles[NUM_QUARTILES];
+    double quartilesThreshold[NUM_QUARTILES] = {numNotNull * 0.25,
+                                                numNotNull * 0.5,
+                                                numNotNull * 0.75};
+    int idx = 0;
+    MostFrequents<double, 10> mostFrequents; // Keep top 10
+
+    for (auto & v: values) {
+        double x = v.first.toDouble();
+        int64_t count = v.second;
+        total += x * count;
+
+        double delta = x - mean;
+        M2 += delta * delta * n * count / (n + count);
+        mean = (n * mean + count * x) / (n + count);
+        n += count;
+
+        while (idx < NUM_QUARTILES && quartilesThreshold[idx] < n) {
+            quartiles[idx] = x;
+            ++idx;
+        }
+        mostFrequents.addItem(make_pair(count, x));
+    }
+    ExcAssert(idx == NUM_QUARTILES);
+
+    double stddev = n < 2 ? std::nan("") : sqrt(M2 / (n - 1));
+
+    toRecord.emplace_back(value + "avg", total / n, now);
+    toRecord.emplace_back(value + "max", values.back().first.toDouble(), now);
+    toRecord.emplace_back(value + "min", values.front().first.toDouble(), now);
+    toRecord.emplace_back(value + "stddev", stddev, now);
+    toRecord.emplace_back(value + "data_type", "number", now);
+    toRecord.emplace_back(value + "1st_quartile", quartiles[0], now);
+    toRecord.emplace_back(value + "median", quartiles[1], now);
+    toRecord.emplace_back(value + "3rd_quartile", quartiles[2], now);
+    for (int i = 0; i < mostFrequents.currSize; ++ i) {
+        toRecord.emplace_back(
+            // CellValue::to_string returns "1" instead of "1.00000"
+            value + "most_frequent_items" + to_string(CellValue(mostFrequents.top[i].second)),
+            mostFrequents.top[i].first, now);
+    }
+    output.recordRow(rowName, toRecord);
+}
+
+/** Calculates the statistics of a column by streaming its values from
+    the dataset's column index, without reading any of the other columns.  That's only
+    possible when the input selects plain columns of the dataset, with no
+    WHERE, WHEN, GROUP BY, OFFSET or LIMIT, and when the dataset has at most
+    one value per row for the column, so that the values scanned are those
+    that the queries would see.
+*/
+struct ColumnScanHandler {
+    ColumnScanHandler() = delete;
+    ColumnScanHandler(const Dataset & dataset,
                       SummaryStatisticsProcedureConfig & config,
                       shared_ptr<Dataset> output,
-                      Date now,
-                      const std::function<bool (const Json::Value &)> & onProgress)
-        : first(true), boundDataset(boundDataset), config(config),
-          output(output), now(now), onProgress(onProgress) {}
-
-    const int AVG_IDX = 0;
-    const int MAX_IDX = 1;
-    const int MIN_IDX = 2;
-    const int NUM_NOT_NULL_IDX = 3;
-    const int NUM_NULL_IDX = 4;
-    const int NUM_UNIQUE_IDX = 5;
-    const int STDDEV_IDX = 6;
-
-    bool first;
-    BoundTableExpression & boundDataset;
-    SummaryStatisticsProcedureConfig & config;
+                      Date now)
+        : output(output), now(now), numRows(0)
+    {
+        const auto & stm = *config.inputData.stm;
+        if (stm.where->isConstantTrue()
+            && stm.when.when->isConstantTrue()
+            && stm.groupBy.clauses.empty()
+            && stm.offset == 0
+            && stm.limit == -1) {
+            columns = dataset.getColumnIndex();
+            numRows = dataset.getMatrixView()->getRowCount();
+        }
+    }
+
+    shared_ptr<ColumnIndex> columns;  ///< Null if the input isn't plain
     shared_ptr<Dataset> output;
     Date now;
-    std::function<bool (const Json::Value &)> onProgress;
+    int64_t numRows;
 
-    // Returns false if the column failed to be treated as numeric
-    bool recordStatsForColumn(const Utf8String & name, const Path & rowName) {
+    // Returns false if the column can't be scanned
+    bool recordStatsForColumn(const SqlExpression & expr, const Path & rowName)
+    {
+        auto read = dynamic_cast<const ReadColumnExpression *>(&expr);
+        if (!read)
+            return false;
+        return recordStatsForColumn(read->columnName, rowName);
+    }
 
-        int64_t numNotNull = 0;
-        bool isNumeric = false;
-        ColumnPath value("value");
-        auto onRow = [&] (NamedRowValue & row) {
+    bool recordStatsForColumn(const ColumnPath & column, const Path & rowName)
+    {
+        if (!columns
+            || !columns->knownColumn(column)
+            || !columns->columnHasOneValuePerRow(column))
+            return false;
 
-            // If the data is categorical, we don't even reach this point
+        // Count the occurrences of each value, on each thread separately
+        typedef ValueCounts Counts;
+        PerThreadAccumulator<Counts> threadCounts;
 
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                // Checks on the first row if the expected order is correct
-                ExcAssert(std::get<0>(cols[AVG_IDX]).toUtf8String() == "avg");
-                ExcAssert(std::get<0>(cols[MAX_IDX]).toUtf8String() == "max");
-                ExcAssert(std::get<0>(cols[MIN_IDX]).toUtf8String() == "min");
-                ExcAssert(std::get<0>(cols[NUM_NOT_NULL_IDX]).toUtf8String() == "num_not_null");
-                ExcAssert(std::get<0>(cols[NUM_NULL_IDX]).toUtf8String() == "num_null");
-                ExcAssert(std::get<0>(cols[NUM_UNIQUE_IDX]).toUtf8String() == "num_unique");
-                ExcAssert(std::get<0>(cols[STDDEV_IDX]).toUtf8String() == "stddev");
+        auto onValue = [&] (const RowPath &, const CellValue & val, Date)
+            {
+                if (!val.empty())
+                    threadCounts.get()[val] += 1;
+                return true;
+            };
 
-            }
+        columns->forEachColumnValue(column, onValue,
+                                    true /* process in parallel */);
 
-            vector<Cell> toRecord;
-            if (!std::get<1>(cols[MAX_IDX]).isNumber()) {
-                // If the column is empty, we reach this point (max is null)
-                auto theThing = std::get<1>(cols[MAX_IDX]);
-                return false;
-            }
-            isNumeric = true;
-            toRecord.emplace_back(value + "avg", std::get<1>(cols[AVG_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "max", std::get<1>(cols[MAX_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "min", std::get<1>(cols[MIN_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "num_null", std::get<1>(cols[NUM_NULL_IDX]).toInt(), now);
-            toRecord.emplace_back(value + "num_unique", std::get<1>(cols[NUM_UNIQUE_IDX]).toInt(), now);
-            toRecord.emplace_back(value + "stddev", std::get<1>(cols[STDDEV_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "data_type", "number", now);
-            output->recordRow(rowName, toRecord);
-            numNotNull = std::get<1>(cols[NUM_NOT_NULL_IDX]).toInt();
-
-            return true;
-        };
-
-        auto select = SelectExpression::parse(
-            "count_distinct(" + name + ") AS num_unique, "
-            "min(" + name + ") AS min, "
-            "max(" + name + ") AS max, "
-            "avg(" + name + ") AS avg, "
-            "sum(" + name + " IS NULL) AS num_null, "
-            "sum(" + name + " IS NOT NULL) AS num_not_null, "
-            "stddev(" + name + ") AS stddev"
-        );
-        vector<shared_ptr<SqlExpression>> aggregators =
-            select.findAggregators(!config.inputData.stm->groupBy.clauses.empty());
-
-        try {
-            // The first query is used to determine whether it's numeric or
-            // not, hence the special try/catch/failedProcessingQuery handling.
-            BoundGroupByQuery(select,
-                              *boundDataset.dataset,
-                              boundDataset.asName,
-                              config.inputData.stm->when,
-                              *config.inputData.stm->where,
-                              config.inputData.stm->groupBy,
-                              aggregators,
-                              *config.inputData.stm->having,
-                              *config.inputData.stm->rowName,
-                              config.inputData.stm->orderBy)
-                .execute({onRow, false /*processInParallel*/},
-                         0, // offset
-                         -1, // limit
-                         onProgress);
-        }
-        catch (const MLDB::Exception & exc) {
-            if (!isNumeric) {
-                // Categorical, the query doesn't work
-                return false;
-            }
-            throw;
-        }
-        if (!isNumeric) {
-            // empty col
-            return false;
-        }
+        Counts counts;
+        threadCounts.forEach([&] (Counts * c)
+                             {
+                                 for (auto & v: *c)
+                                     counts[v.first] += v.second;
+                             });
 
-        select = SelectExpression::parse("count(" + name + ") AS _0, "
-                                         + name + " AS _1");
-        auto groupBy = TupleExpression::parse(name);
-        auto orderBy = OrderByExpression::parse(name);
-        auto where = SqlExpression::parse(name + " IS NOT NULL");
-        const int NUM_QUARTILES = 3;
-        double quartiles[NUM_QUARTILES];
-        double quartilesThreshold[NUM_QUARTILES] = {numNotNull * 0.25,
-                                                    numNotNull * 0.5,
-                                                    numNotNull * 0.75};
-        int idx = 0;
-        int64_t count = 0;
-        MostFrequents<double, 10> mostFrequents; // Keep top 10
-        auto onRow2 = [&] (NamedRowValue & row) {
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                ExcAssert(std::get<0>(cols[0]).toUtf8String() == "_0");
-                ExcAssert(std::get<0>(cols[1]).toUtf8String() == "_1");
-                first = false;
-            }
-            int64_t currentCount = std::get<1>(cols[0]).toInt();
-            mostFrequents.addItem(make_pair(currentCount,
-                                            std::get<1>(cols[1]).toDouble()));
-            count += currentCount;
-            while (idx < NUM_QUARTILES && quartilesThreshold[idx] < count) {
-                quartiles[idx] = std::get<1>(cols[1]).toDouble();
-                ++idx;
-            }
-            return true;
-        };
-        BoundGroupByQuery(select,
-                        *boundDataset.dataset,
-                        boundDataset.asName,
-                        config.inputData.stm->when,
-                        *where,
-                        groupBy,
-                        aggregators,
-                        *config.inputData.stm->having,
-                        *config.inputData.stm->rowName,
-                        orderBy)
-            .execute({onRow2, false /*processInParallel*/},
-                    0, // offset
-                    -1, // limit
-                    onProgress);
-        ExcAssert(count == numNotNull);
-        ExcAssert(idx == NUM_QUARTILES);
-        vector<Cell> toRecord;
-        toRecord.emplace_back(value + "1st_quartile", quartiles[0], now);
-        toRecord.emplace_back(value + "median", quartiles[1], now);
-        toRecord.emplace_back(value + "3rd_quartile", quartiles[2], now);
-        for (int i = 0; i < mostFrequents.currSize; ++ i) {
-            toRecord.emplace_back(
-                // CellValue::to_string returns "1" instead of "1.00000"
-                value + "most_frequent_items" + to_string(CellValue(mostFrequents.top[i].second)),
-                mostFrequents.top[i].first, now);
-        }
-        output->recordRow(rowName, toRecord);
+        recordValueStats(counts, numRows, rowName, *output, now);
         return true;
     }
-
 };
 
-struct CategoricalRowHandler {
-    CategoricalRowHandler() = delete;
-    CategoricalRowHandler(BoundTableExpression & boundDataset,
-                          SummaryStatisticsProcedureConfig & config,
-                          shared_ptr<Dataset> output,
-                          Date now,
-                          const std::function<bool (const Json::Value &)> & onProgress)
-        : first(true), boundDataset(boundDataset), config(config),
-          output(output), now(now), onProgress(onProgress) {}
-
-    const int NUM_NULL_IDX = 0;
-    const int NUM_UNIQUE_IDX = 1;
+/** Calculates the statistics of all of the columns of the input in a
+    single parallel pass over the rows of its query.  Each thread counts
+    the occurrences of each value of each column, and those counts are
+    merged once the query is done.  Only the latest value of a column in a
+    row is counted, as when the column is read in an expression.
+*/
+struct RowScanHandler {
+    RowScanHandler() = delete;
+    RowScanHandler(BoundTableExpression & boundDataset,
+                   SummaryStatisticsProcedureConfig & config,
+                   const vector<shared_ptr<SqlExpression> > & calc,
+                   shared_ptr<Dataset> output,
+                   Date now)
+        : boundDataset(boundDataset), config(config), calc(calc),
+          output(output), now(now)
+    {
+    }
 
-    bool first;
     BoundTableExpression & boundDataset;
     SummaryStatisticsProcedureConfig & config;
+    const vector<shared_ptr<SqlExpression> > & calc;
     shared_ptr<Dataset> output;
     Date now;
-    std::function<bool (const Json::Value &)> onProgress;
-
-    void recordStatsForColumn(const Utf8String & name, const Path & rowName) {
-        ColumnPath value("value");
-        auto onRow = [&] (NamedRowValue & row) {
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                // Checks on the first row if the expected order is correct
-                ExcAssert(std::get<0>(cols[NUM_NULL_IDX]).toUtf8String() == "num_null");
-                ExcAssert(std::get<0>(cols[NUM_UNIQUE_IDX]).toUtf8String() == "num_unique");
-            }
-            vector<Cell> toRecord;
-            toRecord.emplace_back(value + "data_type", "categorical", now);
-            toRecord.emplace_back(value + "num_null", std::get<1>(cols[NUM_NULL_IDX]).toInt(), now);
-            toRecord.emplace_back(value + "num_unique", std::get<1>(cols[NUM_UNIQUE_IDX]).toInt(), now);
-            output->recordRow(rowName, toRecord);
-            return true;
-        };
 
-        auto select = SelectExpression::parse(
-            "count_distinct(" + name + ") AS num_unique, "
-            "sum(" + name + " IS NULL) AS num_null"
-        );
-        vector<shared_ptr<SqlExpression>> aggregators =
-            select.findAggregators(!config.inputData.stm->groupBy.clauses.empty());
-
-        BoundGroupByQuery(select,
-                        *boundDataset.dataset,
-                        boundDataset.asName,
-                        config.inputData.stm->when,
-                        *config.inputData.stm->where,
-                        config.inputData.stm->groupBy,
-                        aggregators,
-                        *config.inputData.stm->having,
-                        *config.inputData.stm->rowName,
-                        config.inputData.stm->orderBy)
-            .execute({onRow, false /*processInParallel*/},
-                    0, // offset
-                    -1, // limit
-                    onProgress);
-
-        select = SelectExpression::parse("count(" + name + ") AS _0, "
-                                         + name + " AS _1");
-        auto groupBy = TupleExpression::parse(name);
-        auto orderBy = OrderByExpression::parse("_0 DESC");
+    /// Columns of the output of the query with their output row names
+    std::vector<std::pair<ColumnPath, Path> > columns;
 
-        MostFrequents<Utf8String, 10> mostFrequents; // Keep top 10
-        auto onRow2 = [&] (NamedRowValue & row) {
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                ExcAssert(std::get<0>(cols[0]).toUtf8String() == "_0");
-                ExcAssert(std::get<0>(cols[1]).toUtf8String() == "_1");
-            }
-            if (MLDB_UNLIKELY(std::get<1>(cols[1]).empty())) {
-                // skipp null
-                return true;
-            }
-            mostFrequents.addItem(make_pair(std::get<1>(cols[0]).toInt(),
-                                            std::get<1>(cols[1]).toString()));
-            return true;
+    /// Index of each column in columns
+    std::unordered_map<ColumnPath, size_t> columnIndex;
+
+    void addColumn(const ColumnPath & column, const Path & rowName)
+    {
+        if (columnIndex.emplace(column, columns.size()).second)
+            columns.emplace_back(column, rowName);
+    }
+
+    void recordStats(const std::function<bool (const Json::Value &)> & onProgress)
+    {
+        if (columns.empty())
+            return;
+
+        struct ThreadStats {
+            int64_t numRows = 0;
+            std::vector<ValueCounts> counts;
         };
-        BoundGroupByQuery(select,
-                        *boundDataset.dataset,
-                        boundDataset.asName,
-                        config.inputData.stm->when,
-                        *config.inputData.stm->where,
-                        groupBy,
-                        aggregators,
-                        *config.inputData.stm->having,
-                        *config.inputData.stm->rowName,
-                        orderBy)
-            .execute({onRow2, false /*processInParallel*/},
-                    0, // offset
-                    -1, // limit
-                    onProgress);
-        vector<Cell> toRecord;
-        for (int i = 0; i < mostFrequents.currSize; ++ i) {
-            toRecord.emplace_back(
-                value + "most_frequent_items" + mostFrequents.top[i].second,
-                mostFrequents.top[i].first,
-                now);
-        }
-        output->recordRow(rowName, toRecord);
-        first = false;
+
+        PerThreadAccumulator<ThreadStats> threadStats;
+
+        auto onRow = [&] (RowPath & rowName,
+                          ExpressionValue & val,
+                          std::vector<ExpressionValue> & calcd,
+                          int rowNum)
+            {
+                ThreadStats & stats = threadStats.get();
+                if (stats.counts.empty())
+                    stats.counts.resize(columns.size());
+                ++stats.numRows;
+
+                auto onAtom = [&] (Path & columnName, CellValue & atom, Date)
+                    {
+                        if (atom.empty())
+                            return true;
+                        auto it = columnIndex.find(columnName);
+                        if (it != columnIndex.end())
+                            stats.counts[it->second][std::move(atom)] += 1;
+                        return true;
+                    };
+
+                val.getFilteredDestructive(GET_LATEST)
+                    .forEachAtomDestructive(onAtom);
+                return true;
+            };
+
+        const auto & stm = *config.inputData.stm;
+        BoundSelectQuery(stm.select,
+                         *boundDataset.dataset,
+                         boundDataset.asName,
+                         stm.when,
+                         *stm.where,
+                         stm.orderBy,
+                         calc)
+            .executeExpr(onRow,
+                         true /* processInParallel */,
+                         stm.offset,
+                         stm.limit,
+                         onProgress);
+
+        // Merge the counts of the threads, one column at a time in
+        // parallel
+        std::vector<ThreadStats *> allStats;
+        int64_t numRows = 0;
+        threadStats.forEach([&] (ThreadStats * stats)
+                            {
+                                allStats.push_back(stats);
+                                numRows += stats->numRows;
+                            });
+
+        auto onColumn = [&] (size_t i)
+            {
+                ValueCounts counts;
+                for (ThreadStats * stats: allStats) {
+                    if (stats->counts.empty())
+                        continue;
+                    if (counts.empty())
+                        counts.swap(stats->counts[i]);
+                    else {
+                        for (auto & v: stats->counts[i])
+                            counts[v.first] += v.second;
+                    }
+                    ValueCounts().swap(stats->counts[i]);
+                }
+                recordValueStats(counts, numRows, columns[i].second,
+                                 *output, now);
+            };
+
+        parallelMap(0, columns.size(), onColumn);
     }
 };
 
@@ -442,42 +449,20 @@ run(const ProcedureRunConfig & run,
         calc.emplace_back(whenClause);
     }
 
-    int num = 0;
-    float denum = 0;
-    {
-        BoundSelectQuery bsq(runProcConf.inputData.stm->select,
-                             *boundDataset.dataset,
-                             boundDataset.asName,
-                             runProcConf.inputData.stm->when,
-                             *runProcConf.inputData.stm->where,
-                             runProcConf.inputData.stm->orderBy,
-                             calc);
-        denum = bsq.getSelectOutputInfo()->allColumnNames().size();
-    }
-    auto onProgress2 = [&](const Json::Value & progress) {
-        Json::Value v;
-        v["percent"] = num / denum;
-        return onProgress(progress);
-    };
-
     Date now = Date::now();
     auto output = createDataset(server, runProcConf.outputDataset,
                                 nullptr, true /*overwrite*/);
 
 
-    NumericRowHandler nrh(boundDataset, runProcConf, output, now, onProgress2);
-    CategoricalRowHandler crh(boundDataset, runProcConf, output, now,
-                                onProgress);
-    auto record = [&] (const Utf8String & expr, const Path & alias) {
-        const Utf8String name = "\"" + expr + "\"";
-        if (!nrh.recordStatsForColumn(name, alias)) {
-            crh.recordStatsForColumn(name, alias);
-        }
-    };
+    std::unique_ptr<ColumnScanHandler> csh;
+    if (boundDataset.dataset)
+        csh.reset(new ColumnScanHandler(*boundDataset.dataset, runProcConf,
+                                        output, now));
+
+    // Columns which can't be scanned are done together by scanning the rows
+    RowScanHandler rsh(boundDataset, runProcConf, calc, output, now);
 
     for (const auto & clause: procedureConfig.inputData.stm->select.clauses) {
-        Utf8String surface;
-        Utf8String alias;
         if (clause->isWildcard()) {
             BoundSelectQuery bsq(SelectExpression::parse("*"),
                                 *boundDataset.dataset,
@@ -487,17 +472,20 @@ run(const ProcedureRunConfig & run,
                                 runProcConf.inputData.stm->orderBy,
                                 calc);
             for (const auto & colName: bsq.getSelectOutputInfo()->allColumnNames()) {
-                ++ num;
-                record(colName.toSimpleName(), colName);
+                if (!csh || !csh->recordStatsForColumn(colName, colName))
+                    rsh.addColumn(colName, colName);
             }
             continue;
         }
-        ++ num;
         // static_cast -> validated already from onPostValidate
         auto expr = static_cast<NamedColumnExpression *>(clause.get());
-        record(expr->getChildren()[0]->surface, expr->alias);
+        auto column = expr->getChildren()[0];
+        if (!csh || !csh->recordStatsForColumn(*column, expr->alias))
+            rsh.addColumn(expr->alias, expr->alias);
     }
 
+    rsh.recordStats(onProgress);
+
     output->commit();
     return output->getStatus();
 }
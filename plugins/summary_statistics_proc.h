@@ -4,7 +4,8 @@
  * Copyright (c) 2016 Datacratic Inc. All rights reserved.
  *
  * Generates column statistics based on an input query. The statistics are
- * computed from a sequence of mldb sql queries.
+ * computed in a single pass over the rows of the query, or over the values
+ * of each column for plain columns of a dataset.
  **/
 
 #pragma once
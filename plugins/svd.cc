@@ -21,6 +21,7 @@
 #include "mldb/ml/svd_utils.h"
 #include "mldb/jml/utils/vector_utils.h"
 #include "mldb/ext/svdlibc/svdlib.h"
+#include "mldb/ml/algebra/lapack.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/distribution_description.h"
 #include "mldb/types/optional_description.h"
@@ -35,6 +36,7 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/plugins/progress.h"
 #include "mldb/utils/log.h"
+#include <random>
 
 using namespace std;
 
@@ -55,6 +57,23 @@ T jsonDecodeFile(const std::string & filename, T * = 0)
     return result;
 }
 
+DEFINE_ENUM_DESCRIPTION(SvdAlgorithm);
+
+SvdAlgorithmDescription::
+SvdAlgorithmDescription()
+{
+    addValue("lanczos", SVD_LANCZOS,
+             "Lanczos iterations.  This is accurate for all of the singular "
+             "values, but single threaded.");
+    addValue("randomized", SVD_RANDOMIZED,
+             "Randomized SVD (Halko, Martinsson and Tropp, 2011).  The "
+             "matrix is multiplied by a random basis a few times, which is "
+             "done in parallel.  This is much faster for large numbers of "
+             "dense basis vectors, and accurate for the largest singular "
+             "values; use `oversampling` and `powerIterations` to trade "
+             "accuracy for speed.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(SvdConfig);
 
 SvdConfigDescription::
@@ -88,6 +107,18 @@ SvdConfigDescription()
              "The runtime goes up with the square of this parameter, "
              "in other words 10 times as many is 100 times as long to run.",
              2000);
+    addField("algorithm", &SvdConfig::algorithm,
+             "Algorithm used to calculate the singular values of the dense "
+             "basis.", SVD_LANCZOS);
+    addField("oversampling", &SvdConfig::oversampling,
+             "For the randomized algorithm, number of extra random vectors "
+             "used beyond `numSingularValues`.  Higher values give more "
+             "accurate singular vectors, especially the last ones.", 10);
+    addField("powerIterations", &SvdConfig::powerIterations,
+             "For the randomized algorithm, number of extra multiplications "
+             "by the matrix.  Each one makes the singular values decay faster, "
+             "which makes the result more accurate for matrices whose "
+             "singular values decay slowly, at the cost of one more pass.", 2);
     addField("outputColumn", &SvdConfig::outputColumn,
              "Base name of the column that will be written by the SVD.  "
              "It will be an embedding with numSingularValues elements.",
@@ -394,9 +425,143 @@ SvdBasisDescription()
     addField("modelTs", &SvdBasis::modelTs, "Timestamp of latest information incorporated into model");
 }
 
+namespace {
+
+/** Orthonormalize the rows of m in place, with two passes of modified
+    Gram-Schmidt.  Rows which are numerically in the span of the previous
+    ones are set to zero.
+*/
+void orthonormalizeRows(boost::multi_array<double, 2> & m)
+{
+    int nvecs = m.shape()[0];
+    int n = m.shape()[1];
+
+    for (int pass = 0;  pass < 2;  ++pass) {
+        for (int i = 0;  i < nvecs;  ++i) {
+            double * v = &m[i][0];
+            double before = sqrt(ML::SIMD::vec_dotprod(v, v, n));
+            for (int j = 0;  j < i;  ++j) {
+                const double * u = &m[j][0];
+                double d = ML::SIMD::vec_dotprod(v, u, n);
+                ML::SIMD::vec_add(v, -d, u, v, n);
+            }
+            double after = sqrt(ML::SIMD::vec_dotprod(v, v, n));
+            if (after <= 1e-10 * before)
+                std::fill(v, v + n, 0.0);
+            else ML::SIMD::vec_scale(v, 1.0 / after, v, n);
+        }
+    }
+}
+
+/** Multiply the symmetric matrix c by each of the row vectors of vecs.
+    This is done in parallel over chunks of rows of c.
+*/
+boost::multi_array<double, 2>
+multiplyRows(const boost::multi_array<float, 2> & c,
+             const boost::multi_array<double, 2> & vecs)
+{
+    int n = c.shape()[0];
+    int nvecs = vecs.shape()[0];
+    ExcAssertEqual(c.shape()[1], n);
+    ExcAssertEqual(vecs.shape()[1], n);
+
+    boost::multi_array<double, 2> result(boost::extents[nvecs][n]);
+
+    auto doChunk = [&] (size_t first, size_t last)
+        {
+            for (size_t i = first;  i < last;  ++i)
+                for (int j = 0;  j < nvecs;  ++j)
+                    result[j][i] = ML::SIMD::vec_dotprod_dp(&c[i][0], &vecs[j][0], n);
+        };
+
+    parallelMapChunked(0, n, 16, doChunk);
+
+    return result;
+}
+
+/** Randomized eigendecomposition of the symmetric positive semi-definite
+    matrix c, from Halko, Martinsson and Tropp, "Finding structure with
+    randomness", SIAM Review 2011.  Fills in the square roots of the
+    eigenvalues, which are its singular values as in svdLAS2A, in
+    decreasing order, and one eigenvector per row.
+*/
+void
+randomizedSvd(const boost::multi_array<float, 2> & c,
+              int numSingularValues, int oversampling, int powerIterations,
+              std::vector<double> & singularValues,
+              boost::multi_array<double, 2> & vectors)
+{
+    int n = c.shape()[0];
+    int l = std::min(numSingularValues + oversampling, n);
+
+    // Range finder: Q is an orthonormal basis for C^(q+1) Omega
+    std::mt19937 rng(1);
+    std::normal_distribution<double> normal;
+    boost::multi_array<double, 2> q(boost::extents[l][n]);
+    for (int i = 0;  i < l;  ++i)
+        for (int j = 0;  j < n;  ++j)
+            q[i][j] = normal(rng);
+
+    q = multiplyRows(c, q);
+    for (int i = 0;  i < powerIterations;  ++i) {
+        orthonormalizeRows(q);
+        q = multiplyRows(c, q);
+    }
+    orthonormalizeRows(q);
+
+    // Project onto the basis: B = Q' C Q, which is small (l x l)
+    boost::multi_array<double, 2> cq = multiplyRows(c, q);
+    std::vector<double> b(l * l);
+    for (int i = 0;  i < l;  ++i)
+        for (int j = 0;  j <= i;  ++j)
+            b[i * l + j] = b[j * l + i]
+                = 0.5 * (ML::SIMD::vec_dotprod(&q[i][0], &cq[j][0], n)
+                         + ML::SIMD::vec_dotprod(&q[j][0], &cq[i][0], n));
+
+    // B is symmetric, so its SVD gives us its eigenvectors in the columns
+    // of U.  We take the eigenvalues from u' B u, so that negative ones
+    // (from rounding) sort last and are dropped rather than taken as large
+    // singular values.
+    std::vector<double> bcopy = b, sv(l), u(l * l), vt(l * l);
+    int res = ML::LAPack::gesdd("S", l, l, bcopy.data(), l, sv.data(),
+                                u.data(), l, vt.data(), l);
+    if (res != 0)
+        throw HttpReturnException(500, "Randomized SVD failed to decompose "
+                                  "projected matrix",
+                                  "gesddResult", res);
+
+    std::vector<std::pair<double, int> > eigenvalues;
+    for (int k = 0;  k < l;  ++k) {
+        const double * uk = &u[k * l];
+        double lambda = 0.0;
+        for (int i = 0;  i < l;  ++i)
+            lambda += uk[i] * ML::SIMD::vec_dotprod(&b[i * l], uk, l);
+        eigenvalues.emplace_back(lambda, k);
+    }
+    std::sort(eigenvalues.rbegin(), eigenvalues.rend());
+
+    int nsv = std::min(numSingularValues, l);
+    singularValues.resize(nsv);
+    vectors.resize(boost::extents[nsv][n]);
+
+    for (int k = 0;  k < nsv;  ++k) {
+        singularValues[k] = sqrt(eigenvalues[k].first);  // NaN if negative
+        const double * uk = &u[eigenvalues[k].second * l];
+        double * v = &vectors[k][0];
+        std::fill(v, v + n, 0.0);
+        for (int i = 0;  i < l;  ++i)
+            ML::SIMD::vec_add(v, uk[i], &q[i][0], v, n);
+    }
+}
+
+} // file scope
+
 struct SvdTrainer {
     static SvdBasis calcSvdBasis(const ColumnCorrelations & correlations,
                                  int numSingularValues,
+                                 SvdAlgorithm algorithm,
+                                 int oversampling,
+                                 int powerIterations,
                                  shared_ptr<spdlog::logger> logger);
 
     static SvdBasis calcRightSingular(const ClassifiedColumns & columns,
@@ -409,6 +574,9 @@ SvdBasis
 SvdTrainer::
 calcSvdBasis(const ColumnCorrelations & correlations,
              int numSingularValues,
+             SvdAlgorithm algorithm,
+             int oversampling,
+             int powerIterations,
              shared_ptr<spdlog::logger> logger)
 {
 #if 0
@@ -437,30 +605,54 @@ calcSvdBasis(const ColumnCorrelations & correlations,
     //         << endl;
     //}
 
-    /**************************************************************
-     * multiplication of matrix B by vector x, where B = A'A,     *
-     * and A is nrow by ncol (nrow >> ncol). Hence, B is of order *
-     * n = ncol (y stores product vector).		              *
-     **************************************************************/
-
-    auto opb_fn = [&] (const double * x, double * y)
-    {
-        for (unsigned i = 0; i != ndims; i++) {
-            y[i] = ML::SIMD::vec_dotprod_dp(&correlations.correlations[i][0], x, ndims);
-        }
-    };
-
-    SVDParams params;
-    params.opb = opb_fn;
-    params.ierr = 0;
-    params.nrows = ndims;
-    params.ncols = ndims;
-    params.nvals = 0;
-    params.doU = false;
-    params.calcPrecision(params.ncols);
+    // Singular values, and the corresponding singular vectors (one per
+    // row), in decreasing order of singular value
+    std::vector<double> singularValues;
+    boost::multi_array<double, 2> singularVectors;
+
+    if (algorithm == SVD_RANDOMIZED) {
+        if (oversampling < 0 || powerIterations < 0)
+            throw HttpReturnException(400, "SVD oversampling and powerIterations "
+                                      "must not be negative",
+                                      "oversampling", oversampling,
+                                      "powerIterations", powerIterations);
+
+        randomizedSvd(correlations.correlations, numSingularValues,
+                      oversampling, powerIterations,
+                      singularValues, singularVectors);
+    }
+    else {
+        /**************************************************************
+         * multiplication of matrix B by vector x, where B = A'A,     *
+         * and A is nrow by ncol (nrow >> ncol). Hence, B is of order *
+         * n = ncol (y stores product vector).		              *
+         **************************************************************/
+
+        auto opb_fn = [&] (const double * x, double * y)
+        {
+            for (unsigned i = 0; i != ndims; i++) {
+                y[i] = ML::SIMD::vec_dotprod_dp(&correlations.correlations[i][0], x, ndims);
+            }
+        };
 
-    svdrec * svdResult = svdLAS2A(numSingularValues, params);
-    ML::Call_Guard cleanUp( [&](){ svdFreeSVDRec(svdResult); });
+        SVDParams params;
+        params.opb = opb_fn;
+        params.ierr = 0;
+        params.nrows = ndims;
+        params.ncols = ndims;
+        params.nvals = 0;
+        params.doU = false;
+        params.calcPrecision(params.ncols);
+
+        svdrec * svdResult = svdLAS2A(numSingularValues, params);
+        ML::Call_Guard cleanUp( [&](){ svdFreeSVDRec(svdResult); });
+
+        singularValues.assign(svdResult->S, svdResult->S + svdResult->d);
+        singularVectors.resize(boost::extents[svdResult->d][ndims]);
+        for (unsigned j = 0;  j < svdResult->d;  ++j)
+            std::copy(svdResult->Vt->value[j], svdResult->Vt->value[j] + ndims,
+                      &singularVectors[j][0]);
+    }
 
     INFO_MSG(logger) << "done SVD " << timer.elapsed();
 
@@ -470,30 +662,23 @@ calcSvdBasis(const ColumnCorrelations & correlations,
     // svalues = { 3.06081 2.01797 1.91045 1.39165 1.20556 1.0859 1.01295 0.973041 0.96686 0.795663 0.787847 0.753074 0.663018 0.58732 0.566861 0.53674 0.507972 0.481893 0.476135 0.451054 0.434212 0.428739 0.406749 0.396502 0.388368 0.383147 0.381553 0.34724 0.322744 0.311273 0.297784 0.285271 0.275972 0.272025 0.271609 0.265779 0.254749 0.244108 0.234286 0.229235 0.21586 0.208849 0.207129 0.194427 0.186311 0.184302 0.18284 0.170876 0.1612 0.153722 0.145908 0.145039 0.139881 0.136478 0.134853 0.131319 0.124427 0.112027 0.0839514 0.0766772 0.0687135 0.0484199 0.0354719 0.034498 9.62614e-05 7.98612e-05 7.48308e-05 6.6479e-05 5.5881e-05 5.00391e-05 4.59796e-05 4.33525e-05 3.0214e-05 2.67698e-05 2.66379e-05 1.749e-05 1.64916e-05 1.20429e-05 5.02268e-08 -nan -nan -nan -nan 2.46486e-09 -nan -nan -nan -nan -nan -nan -nan -nan -nan -nan -nan 1.61711e-08 }
 
     unsigned realD = 0;
-    while (realD < svdResult->d
-           && isfinite(svdResult->S[realD])
-           && svdResult->S[realD] / svdResult->S[0] > 1e-9)
+    while (realD < singularValues.size()
+           && isfinite(singularValues[realD])
+           && singularValues[realD] / singularValues[0] > 1e-9)
         ++realD;
 
-    INFO_MSG(logger) << "skipped " << svdResult->d - realD << " bad singular values";
-    ExcAssertLessEqual(realD, svdResult->d);
+    INFO_MSG(logger) << "skipped " << singularValues.size() - realD << " bad singular values";
+    ExcAssertLessEqual(realD, singularValues.size());
     ExcAssertLessEqual(realD, numSingularValues);
-    svdResult->d = realD;
-
-     INFO_MSG(logger) << "got " << svdResult->d << " singular values";
 
-    numSingularValues = svdResult->d;
+     INFO_MSG(logger) << "got " << realD << " singular values";
 
-
-#if 0
-    cerr    << "Vt rows " << svdResult->Vt->rows << endl
-            << "Vt cols " << svdResult->Vt->cols << endl;
-#endif
+    numSingularValues = realD;
 
     SvdBasis result;
     result.modelTs = correlations.modelTs;
     result.singularValues.resize(numSingularValues);
-    std::copy(svdResult->S, svdResult->S + numSingularValues,
+    std::copy(singularValues.begin(), singularValues.begin() + numSingularValues,
               result.singularValues.begin());
 
     INFO_MSG(logger) << "svalues = " << result.singularValues;
@@ -512,7 +697,7 @@ calcSvdBasis(const ColumnCorrelations & correlations,
         distribution<float> & d = result.columns[i].singularVector;
         d.resize(numSingularValues);
         for (unsigned j = 0;  j < numSingularValues;  ++j)
-            d[j] = svdResult->Vt->value[j][i];
+            d[j] = singularVectors[j][i];
 
         ColumnPath columnName = result.columns[i].columnName;
         CellValue cellValue = result.columns[i].cellValue;
@@ -782,6 +967,9 @@ run(const ProcedureRunConfig & run,
     ColumnCorrelations correlations = calculateCorrelations(columnIndex, numBasisVectors);
     SvdBasis svd = SvdTrainer::calcSvdBasis(correlations,
                                             runProcConf.numSingularValues,
+                                            runProcConf.algorithm,
+                                            runProcConf.oversampling,
+                                            runProcConf.powerIterations,
                                             logger);
 
 #if 0
@@ -8,8 +8,10 @@
 #include "tabular_dataset.h"
 #include "column_types.h"
 #include "frozen_column.h"
+#include "frozen_memory.h"
 #include "tabular_dataset_column.h"
 #include "tabular_dataset_chunk.h"
+#include "tabular_file.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/ml/jml/training_index_entry.h"
@@ -18,14 +20,25 @@
 #include "mldb/base/thread_pool.h"
 #include "mldb/base/scope.h"
 #include "mldb/server/bucket.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/sql/sql_batch_program.h"
+#include "mldb/rest/cancellation_exception.h"
 #include "mldb/server/parallel_merge_sort.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/utils/atomic_shared_ptr.h"
+#include "mldb/utils/blocked_bloom_filter.h"
 #include "mldb/jml/utils/floating_point.h"
 #include "mldb/utils/log.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/types/url.h"
+#include "mldb/rest/rest_request_router.h"
+#include "mldb/core/committed_rows_watches.h"
 #include <mutex>
+#include <array>
+#include <unordered_map>
+#include <random>
 
 using namespace std;
 
@@ -63,39 +76,57 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     TabularDataStore(TabularDatasetConfig config,
                      shared_ptr<spdlog::logger> logger)
-        : rowCount(0), config(std::move(config)),
+        : committed(std::make_shared<Committed>()),
+          frozenChunks(nullptr), columnsInitialized(false),
+          loadedFromFile(false), config(std::move(config)),
+          generation(1), instance(std::random_device()()),
           backgroundJobsActive(0), logger(logger)
     {
     }
 
+    ~TabularDataStore()
+    {
+        // Chunk recorders freeze their chunks in the background, which
+        // may still be going on if the dataset was never committed
+        while (backgroundJobsActive)
+            ThreadPool::instance().work();
+        delete takeFrozenChunks();
+    }
+
+    struct Committed;
+
+    /// Chunks are shared between the committed states that contain them
+    typedef std::vector<std::shared_ptr<const TabularDatasetChunk> > Chunks;
+
     /** A stream of row names used to incrementally query available rows
-        without creating an entire list in memory.
+        without creating an entire list in memory.  It streams the rows
+        that were committed when it was created.
     */
     struct TabularDataStoreRowStream : public RowStream {
 
-        TabularDataStoreRowStream(TabularDataStore * store)
-            : store(store)
+        TabularDataStoreRowStream(std::shared_ptr<const Committed> data)
+            : data(std::move(data))
         {
         }
 
         virtual std::shared_ptr<RowStream> clone() const override
         {
-            return std::make_shared<TabularDataStoreRowStream>(store);
+            return std::make_shared<TabularDataStoreRowStream>(data);
         }
 
         virtual void initAt(size_t start) override
         {
             size_t sum = 0;
-            chunkiter = store->chunks.begin();
-            while (chunkiter != store->chunks.end()
-                   && start >= sum + chunkiter->rowCount())  {
-                sum += chunkiter->rowCount();
+            chunkiter = data->chunks.begin();
+            while (chunkiter != data->chunks.end()
+                   && start >= sum + (*chunkiter)->rowCount())  {
+                sum += (*chunkiter)->rowCount();
                 ++chunkiter;
             }
 
-            if (chunkiter != store->chunks.end()) {
+            if (chunkiter != data->chunks.end()) {
                 rowIndex = (start - sum);
-                rowCount = chunkiter->rowCount();
+                rowCount = (*chunkiter)->rowCount();
             }
         }
 
@@ -112,16 +143,16 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 streamOffsets->clear();
 
             ssize_t startAt = 0;
-            for (auto it = store->chunks.begin();  it != store->chunks.end();
+            for (auto it = data->chunks.begin();  it != data->chunks.end();
                  ++it) {
                 if (streamOffsets)
                     streamOffsets->push_back(startAt);
-                startAt += it->rowCount();
+                startAt += (*it)->rowCount();
 
-                auto stream = std::make_shared<TabularDataStoreRowStream>(store);
+                auto stream = std::make_shared<TabularDataStoreRowStream>(data);
                 stream->chunkiter = it;
                 stream->rowIndex = 0;
-                stream->rowCount = it->rowCount();
+                stream->rowCount = (*it)->rowCount();
 
                 streams.emplace_back(stream);
             }
@@ -144,7 +175,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
         virtual const RowPath & rowName(RowPath & storage) const override
         {
-            return chunkiter->getRowPath(rowIndex, storage);
+            return (*chunkiter)->getRowPath(rowIndex, storage);
         }
 
         virtual RowPath next() override
@@ -163,9 +194,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             rowIndex++;
             if (rowIndex == rowCount) {
                 ++chunkiter;
-                if (chunkiter != store->chunks.end()) {
+                if (chunkiter != data->chunks.end()) {
                     rowIndex = 0;
-                    rowCount = chunkiter->rowCount();
+                    rowCount = (*chunkiter)->rowCount();
                     ExcAssertGreater(rowCount, 0);
                 }
             }
@@ -191,8 +222,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             std::vector<int> columnIndexes;
             columnIndexes.reserve(columnNames.size());
             for (auto & c: columnNames) {
-                auto it = store->columnIndex.find(c.oldHash());
-                if (it == store->columnIndex.end()) {
+                auto it = data->columnIndex.find(c.oldHash());
+                if (it == data->columnIndex.end()) {
                     columnIndexes.emplace_back(-1);
                 }
                 else {
@@ -207,7 +238,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 columns.reserve(columnNames.size());
                 for (size_t i = 0;  i < columnNames.size();  ++i) {
                     columns.push_back
-                        (chunkiter->maybeGetColumn(columnIndexes[i],
+                        ((*chunkiter)->maybeGetColumn(columnIndexes[i],
                                                    columnNames[i]));
                     if (!columns.back())
                         throw HttpReturnException
@@ -234,12 +265,51 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             }
         }
 
+        /** Extract numbers column by column, so that each column can
+            use its contiguous extraction rather than a virtual call and
+            a CellValue per value.
+        */
         virtual void
         extractNumbers(size_t numValues,
                        const std::vector<ColumnPath> & columnNames,
                        double * output) override
         {
-            return extractT<double>(numValues, columnNames, output);
+            std::vector<int> columnIndexes;
+            columnIndexes.reserve(columnNames.size());
+            for (auto & c: columnNames) {
+                auto it = data->columnIndex.find(c.oldHash());
+                columnIndexes.emplace_back
+                    (it == data->columnIndex.end() ? -1 : it->second);
+            }
+
+            size_t numColumns = columnNames.size();
+            std::vector<double> buffer;
+
+            for (size_t n = 0;  n < numValues;) {
+                ExcAssert(chunkiter != data->chunks.end());
+                ExcAssertLess(rowIndex, rowCount);
+                size_t toDo = std::min(numValues - n, rowCount - rowIndex);
+                buffer.resize(toDo);
+
+                for (size_t i = 0;  i < numColumns;  ++i) {
+                    const FrozenColumn * column
+                        = (*chunkiter)->maybeGetColumn(columnIndexes[i],
+                                                    columnNames[i]);
+                    if (column) {
+                        column->extractNumbers(rowIndex, toDo, buffer.data());
+                    }
+                    else {
+                        // Sparse column with no values in this chunk
+                        std::fill(buffer.begin(), buffer.end(), NAN);
+                    }
+                    for (size_t j = 0;  j < toDo;  ++j)
+                        output[(n + j) * numColumns + i] = buffer[j];
+                }
+
+                n += toDo;
+                rowIndex += toDo - 1;
+                advance();
+            }
         }
 
         virtual void
@@ -250,21 +320,12 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             return extractT<CellValue>(numValues, columnNames, output);
         }
 
-        TabularDataStore* store;
-        std::vector<TabularDatasetChunk>::const_iterator chunkiter;
+        std::shared_ptr<const Committed> data;
+        Chunks::const_iterator chunkiter;
         size_t rowIndex;   ///< Number of row within this chunk
         size_t rowCount;   ///< Total number of rows within this chunk
     };
 
-    int64_t rowCount;
-
-    /// This indexes column names to their index, using new (fast) hash
-    Lightweight_Hash<uint64_t, int> columnIndex;
-
-    /// Same index, but using the old (slow) hash.  Useful only for when
-    /// we are forced to lookup on ColumnHash.
-    Lightweight_Hash<ColumnHash, int> columnHashIndex;
-
     struct ColumnEntry {
         ColumnEntry()
             : rowCount(0)
@@ -281,18 +342,12 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         std::vector<std::pair<uint32_t, std::shared_ptr<const FrozenColumn> > > chunks;
     };
 
-    /// List of all columns in the dataset
-    std::vector<ColumnEntry> columns;
-    
     /// List of the names of the fixed columns in the dataset
     std::vector<ColumnPath> fixedColumns;
 
     /// Index of just the fixed columns
     Lightweight_Hash<uint64_t, int> fixedColumnIndex;
 
-    /// List of all chunks in the dataset
-    std::vector<TabularDatasetChunk> chunks;
-
     /** This structure handles a list of chunks that allows for them to be
         recorded in parallel.  It's used for the old recordRow interface.
         Most datasets should instead use the chunk oriented interface, and
@@ -354,29 +409,183 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     atomic_shared_ptr<ChunkList> mutableChunks;
 
     // Everything below here is protected by the dataset lock
-    std::vector<TabularDatasetChunk> frozenChunks;
 
     static int getRowShard(RowHash rowHash)
     {
         return (rowHash.hash() >> 23) % ROW_INDEX_SHARDS;
     }
 
-    /// Index from rowHash to (chunk, indexInChunk) when line number not used for rowName
     static constexpr size_t ROW_INDEX_SHARDS=32;
-    Lightweight_Hash<RowHash, std::pair<int, int> > rowIndex
-        [ROW_INDEX_SHARDS];
+
+    /** Part of the row index, covering the rows of one or more
+        consecutive commits.  See Committed::rowIndex.
+    */
+    struct RowIndexRun {
+        /// Index from rowHash to (chunk, indexInChunk) when line number not
+        /// used for rowName
+        Lightweight_Hash<RowHash, std::pair<int, int> > shards
+            [ROW_INDEX_SHARDS];
+
+        /// Filter over the row hashes of each shard, so that lookups of
+        /// rows that aren't in this run don't need to probe it
+        BlockedBloomFilter filters[ROW_INDEX_SHARDS];
+
+        /// Number of rows in the run
+        size_t rowCount = 0;
+    };
+
+    /** What has been committed to the dataset.  It's never changed once
+        it's been published: a commit builds a new one off to the side,
+        sharing the chunks and most of the row index with the one before,
+        and then swaps it in.  Readers load it once per call and hold on to
+        it for as long as they use what's in it, so they see a consistent
+        dataset without taking any lock.
+    */
+    struct Committed {
+        int64_t rowCount = 0;
+
+        /// This indexes column names to their index, using new (fast) hash
+        Lightweight_Hash<uint64_t, int> columnIndex;
+
+        /// Same index, but using the old (slow) hash.  Useful only for when
+        /// we are forced to lookup on ColumnHash.
+        Lightweight_Hash<ColumnHash, int> columnHashIndex;
+
+        /// List of all columns in the dataset
+        std::vector<ColumnEntry> columns;
+
+        /// The fixed columns of the chunks
+        std::vector<ColumnPath> fixedColumns;
+
+        /// List of all chunks in the dataset
+        Chunks chunks;
+
+        /** Index of the rows, as runs that are never changed.  A commit
+            adds a run for its rows and merges it with the runs before it
+            for as long as they're no more than twice as big, so there are
+            a logarithmic number of runs to look in, and each row is copied
+            a logarithmic number of times over all of the commits.
+        */
+        std::vector<std::shared_ptr<const RowIndexRun> > rowIndex;
+
+        Date earliestTs = Date::notADate(), latestTs = Date::notADate();
+
+        std::pair<int, int> tryLookupRow(RowHash rowHash) const
+        {
+            int shard = getRowShard(rowHash);
+            for (auto & run: rowIndex) {
+                if (!run->filters[shard].mayContain(rowHash.hash()))
+                    continue;
+                auto it = run->shards[shard].find(rowHash);
+                if (it != run->shards[shard].end())
+                    return it->second;
+            }
+            return { -1, -1 };
+        }
+
+        std::pair<int, int> lookupRow(const RowPath & rowName) const
+        {
+            auto result = tryLookupRow(rowName);
+            if (result.first == -1)
+                throw HttpReturnException
+                    (400, "Row not found in tabular dataset: "
+                     + rowName.toUtf8String(),
+                     "rowName", rowName);
+            return result;
+        }
+    };
+
+    /// What readers see.  It's replaced with the dataset lock held.
+    atomic_shared_ptr<const Committed> committed;
+
+    /// Row hashes of a chunk with their index in the chunk, by row shard
+    typedef std::vector<std::pair<RowHash, uint32_t> > ShardEntries;
+    typedef std::array<ShardEntries, ROW_INDEX_SHARDS> RowPartitions;
+
+    /** Partition the row names of the chunk by row index shard.  This is
+        the part of building the row index that only depends on the
+        chunk, so it's done as soon as a chunk is frozen rather than
+        during commit.
+    */
+    static RowPartitions partitionRows(const TabularDatasetChunk & chunk)
+    {
+        RowPartitions result;
+        for (unsigned j = 0;  j < chunk.rowCount();  ++j) {
+            RowPath rowNameStorage;
+            const RowPath & rowName = chunk.getRowPath(j, rowNameStorage);
+            RowHash rowHash = rowName;
+            result[getRowShard(rowHash)].emplace_back(rowHash, j);
+        }
+        return result;
+    }
+
+    /** Entry in the list of chunks that have been frozen but not yet
+        committed.  Owns the rest of the list after it.
+    */
+    struct FrozenChunkEntry {
+        FrozenChunkEntry(TabularDatasetChunk chunk)
+            : chunk(std::move(chunk)), next(nullptr)
+        {
+            rowPartitions = partitionRows(this->chunk);
+        }
+
+        ~FrozenChunkEntry()
+        {
+            // Iterative, so that a long list doesn't overflow the stack
+            while (next) {
+                FrozenChunkEntry * n = next;
+                next = n->next;
+                n->next = nullptr;
+                delete n;
+            }
+        }
+
+        TabularDatasetChunk chunk;
+        RowPartitions rowPartitions;
+        FrozenChunkEntry * next;
+    };
+
+    /// Lock-free stack of frozen, uncommitted chunks.  Freezing threads
+    /// push onto it without taking any lock; commit() takes the whole
+    /// list at once.
+    std::atomic<FrozenChunkEntry *> frozenChunks;
+
+    /// Atomically take ownership of the list of frozen chunks
+    FrozenChunkEntry * takeFrozenChunks()
+    {
+        return frozenChunks.exchange(nullptr);
+    }
+
+    /// Set once the fixed columns are known, which is from the first row
+    /// recorded or when the dataset is loaded
+    bool columnsInitialized;
+
+    /// Set when the dataset was loaded from its dataFileUrl, in which case
+    /// it's read-only
+    bool loadedFromFile;
+
     std::string filename;
-    Date earliestTs, latestTs;
 
     std::mutex datasetMutex;
 
+    /// Batch programs compiled from where expressions, by alias and
+    /// expression.  Null for those which can't be compiled.
+    mutable std::mutex batchProgramsMutex;
+    mutable std::unordered_map<Utf8String,
+                               std::shared_ptr<const SqlBatchProgram> >
+        batchPrograms;
+
+    /// Number of expressions after which the batch programs are forgotten
+    static constexpr size_t MAX_BATCH_PROGRAMS = 1000;
+
     TabularDatasetConfig config;
 
     // Return the value of the column for all rows
     virtual MatrixColumn getColumn(const ColumnPath & column) const override
     {
-        auto it = columnIndex.find(column.oldHash());
-        if (it == columnIndex.end()) {
+        auto data = committed.load();
+        auto it = data->columnIndex.find(column.oldHash());
+        if (it == data->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given hash",
                                       "columnHash", column,
                                       "knownColumns", getColumnPaths());
@@ -385,9 +594,10 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         MatrixColumn result;
         result.columnHash = result.columnName = column;
 
-        for (auto & c: columns[it->second].chunks) {
-            chunks.at(c.first).addToColumn(it->second, column, result.rows,
-                                           false /* dense */);
+        for (auto & c: data->columns[it->second].chunks) {
+            data->chunks.at(c.first)->addToColumn(it->second, column,
+                                                  result.rows,
+                                                  false /* dense */);
         }
         
         return result;
@@ -396,14 +606,15 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     virtual std::vector<CellValue>
     getColumnDense(const ColumnPath & column) const override
     {
-        auto it = columnIndex.find(column.oldHash());
-        if (it == columnIndex.end()) {
+        auto data = committed.load();
+        auto it = data->columnIndex.find(column.oldHash());
+        if (it == data->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given name",
                                       "columnName", column,
                                       "knownColumns", getColumnPaths());
         }
 
-        const ColumnEntry & entry = columns[it->second];
+        const ColumnEntry & entry = data->columns[it->second];
 
         std::vector<CellValue> result;
         result.reserve(entry.rowCount);
@@ -423,11 +634,73 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         return result;
     }
 
+    virtual bool
+    forEachColumnValue(const ColumnPath & column,
+                       const OnColumnValue & onValue,
+                       bool processInParallel) const override
+    {
+        auto data = committed.load();
+        auto it = data->columnIndex.find(column.oldHash());
+        if (it == data->columnIndex.end()) {
+            throw HttpReturnException(400, "Tabular dataset contains no column with given name",
+                                      "columnName", column,
+                                      "knownColumns", getColumnPaths());
+        }
+
+        const ColumnEntry & entry = data->columns[it->second];
+
+        std::atomic<bool> stopped(false);
+
+        // Each chunk with a non-null value is scanned on its own
+        auto onChunk = [&] (size_t i)
+            {
+                const TabularDatasetChunk & chunk
+                    = *data->chunks.at(entry.chunks[i].first);
+
+                auto onRow = [&] (size_t rowNum, const CellValue & val)
+                {
+                    if (stopped)
+                        return false;
+                    if (val.empty())
+                        return true;
+                    RowPath rowNameStorage;
+                    const RowPath & rowName
+                        = chunk.getRowPath(rowNum, rowNameStorage);
+                    Date ts = chunk.timestamps->get(rowNum)
+                        .mustCoerceToTimestamp();
+                    if (!onValue(rowName, val, ts)) {
+                        stopped = true;
+                        return false;
+                    }
+                    return true;
+                };
+
+                entry.chunks[i].second->forEach(onRow);
+            };
+
+        if (processInParallel)
+            parallelMap(0, entry.chunks.size(), onChunk);
+        else {
+            for (size_t i = 0;  i < entry.chunks.size() && !stopped;  ++i)
+                onChunk(i);
+        }
+
+        return !stopped;
+    }
+
+    virtual bool
+    columnHasOneValuePerRow(const ColumnPath & column) const override
+    {
+        // Row names are unique and each row has a single value per column
+        return true;
+    }
+
     virtual std::tuple<BucketList, BucketDescriptions>
     getColumnBuckets(const ColumnPath & column, int maxNumBuckets) const override
     {
-        auto it = columnIndex.find(column.oldHash());
-        if (it == columnIndex.end()) {
+        auto data = committed.load();
+        auto it = data->columnIndex.find(column.oldHash());
+        if (it == data->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given name",
                                       "columnName", column,
                                       "knownColumns", getColumnPaths());
@@ -435,8 +708,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
         std::atomic<size_t> totalRows(0);
 
-        std::vector<std::vector<double> > numerics(chunks.size());
-        std::vector<std::vector<Utf8String> > strings(chunks.size());
+        std::vector<std::vector<double> > numerics(data->chunks.size());
+        std::vector<std::vector<Utf8String> > strings(data->chunks.size());
         std::atomic<bool> hasNulls(false);
 
         auto onChunk = [&] (size_t i)
@@ -461,14 +734,14 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                     return true;
                 };
 
-                chunks[i].columns[it->second]->forEachDistinctValue(onValue);
+                data->chunks[i]->columns[it->second]->forEachDistinctValue(onValue);
 
-                totalRows += chunks[i].rowCount();
+                totalRows += data->chunks[i]->rowCount();
             };
         
-        parallelMap(0, chunks.size(), onChunk);
+        parallelMap(0, data->chunks.size(), onChunk);
 
-        DEBUG_MSG(logger) << chunks.size() << " chunks and " << totalRows << " rows";
+        DEBUG_MSG(logger) << data->chunks.size() << " chunks and " << totalRows << " rows";
 
         auto sortedNumerics = parallelMergeSortUnique(numerics, ML::safe_less<double>());
         auto sortedStrings = parallelMergeSortUnique(strings);
@@ -494,10 +767,10 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                     return true;
                 };
                 
-                chunks[i].columns[it->second]->forEachDense(onRow);
+                data->chunks[i]->columns[it->second]->forEachDense(onRow);
             };
         
-        for (size_t i = 0;  i < chunks.size();  ++i)
+        for (size_t i = 0;  i < data->chunks.size();  ++i)
             onChunk2(i);
 
         if (numWritten != totalRows) {
@@ -516,19 +789,20 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     virtual uint64_t getColumnRowCount(const ColumnPath & column) const override
     {
-        return rowCount;
+        return committed.load()->rowCount;
     }
 
     virtual bool knownColumn(const ColumnPath & column) const override
     {
-        return columnIndex.count(column.oldHash());
+        return committed.load()->columnIndex.count(column.oldHash());
     }
 
     virtual std::vector<ColumnPath> getColumnPaths() const override
     {
+        auto data = committed.load();
         std::vector<ColumnPath> result;
-        result.reserve(columns.size());
-        for (auto & c: columns)
+        result.reserve(data->columns.size());
+        for (auto & c: data->columns)
             result.push_back(c.columnName);
         return result;
     }
@@ -536,8 +810,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     // TODO: we know more than this...
     virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const
     {
-        auto it = columnIndex.find(columnName.oldHash());
-        if (it == columnIndex.end()) {
+        auto data = committed.load();
+        auto it = data->columnIndex.find(columnName.oldHash());
+        if (it == data->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given hash",
                                       "columnName", columnName,
                                       "knownColumns", getColumnPaths());
@@ -545,7 +820,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
         ColumnTypes types;
 
-        const ColumnEntry & entry = columns.at(it->second);
+        const ColumnEntry & entry = data->columns.at(it->second);
 
         // Go through each chunk with a non-null value
         for (auto & c: entry.chunks) {
@@ -570,15 +845,16 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     std::vector<T>
     getRowPathsT(ssize_t start, ssize_t limit) const
     {
+        auto data = committed.load();
         std::vector<T> result;
         if (limit == -1)
-            result.reserve(std::min<ssize_t>(0, rowCount - start));
+            result.reserve(std::min<ssize_t>(0, data->rowCount - start));
         else result.reserve(limit);
 
         size_t n = 0;
-        for (size_t chunk = 0;  chunk < chunks.size();
-             n += chunks[chunk++].rowCount()) {
-            const TabularDatasetChunk & c = chunks[chunk];
+        for (size_t chunk = 0;  chunk < data->chunks.size();
+             n += data->chunks[chunk++]->rowCount()) {
+            const TabularDatasetChunk & c = *data->chunks[chunk];
 
             if (limit != -1 && n >= start + limit)
                 break;
@@ -610,103 +886,123 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         return getRowPathsT<RowHash>(start, limit);
     }
 
-    std::pair<int, int> tryLookupRow(const RowPath & rowName) const
-    {
-        int shard = getRowShard(rowName);
-        auto it = rowIndex[shard].find(rowName);
-        if (it == rowIndex[shard].end())
-            return { -1, -1 };
-        return it->second;
-    }
-    
-    std::pair<int, int> lookupRow(const RowPath & rowName) const
-    {
-        auto result = tryLookupRow(rowName);
-        if (result.first == -1)
-            throw HttpReturnException
-                (400, "Row not found in tabular dataset: "
-                 + rowName.toUtf8String(),
-                 "rowName", rowName);
-        return result;
-    }
-
     virtual bool knownRow(const RowPath & rowName) const override
     {
-        int chunkIndex;
-        int rowIndex;
-
-        std::tie(chunkIndex, rowIndex) = tryLookupRow(rowName);
-        return chunkIndex >= 0;
+        return committed.load()->tryLookupRow(rowName).first >= 0;
     }
 
     virtual MatrixNamedRow getRow(const RowPath & rowName) const override
     {
+        auto data = committed.load();
+        auto row = data->lookupRow(rowName);
+
         MatrixNamedRow result;
         result.rowHash = rowName;
         result.rowName = rowName;
-
-        int shard = getRowShard(result.rowHash);
-
-        auto it = rowIndex[shard].find(rowName);
-        if (it == rowIndex[shard].end()) {
-            throw HttpReturnException
-                (400, "Row not found in tabular dataset: "
-                 + rowName.toUtf8String(),
-                 "rowName", rowName);
-        }
-
-        result.columns
-            = chunks.at(it->second.first)
-            .getRow(it->second.second, fixedColumns);
+        result.columns = data->chunks.at(row.first)
+            ->getRow(row.second, data->fixedColumns);
         return result;
     }
 
     virtual ExpressionValue getRowExpr(const RowPath & rowName) const
     {
-        RowHash rowHash(rowName);
-        int shard = getRowShard(rowHash);
-        auto it = rowIndex[shard].find(rowHash);
-        if (it == rowIndex[shard].end()) {
-            throw HttpReturnException
-                (400, "Row not found in tabular dataset: "
-                 + rowName.toUtf8String(),
-                 "rowName", rowName);
+        auto data = committed.load();
+        auto row = data->lookupRow(rowName);
+        return data->chunks.at(row.first)
+            ->getRowExpr(row.second, data->fixedColumns);
+    }
+
+    /** Return a function that gets rows with only the given columns, and
+        those under them.  The fixed columns to read are found once here,
+        rather than for each row.
+    */
+    std::function<ExpressionValue (const RowPath &)>
+    getProjectedRowExpr(const std::vector<ColumnPath> & columnNames) const
+    {
+        auto data = committed.load();
+        std::set<PathElement> columnsRead;
+        for (auto & c: columnNames)
+            columnsRead.insert(c[0]);
+
+        std::vector<size_t> fixedColumnsRead;
+        for (size_t i = 0;  i < data->fixedColumns.size();  ++i) {
+            if (columnsRead.count(data->fixedColumns[i][0]))
+                fixedColumnsRead.push_back(i);
         }
 
-        return chunks.at(it->second.first)
-            .getRowExpr(it->second.second, fixedColumns);
+        // The rows are those committed when the function was made
+        return [=] (const RowPath & rowName)
+            {
+                auto row = data->lookupRow(rowName);
+                return data->chunks.at(row.first)
+                    ->getProjectedRowExpr(row.second, data->fixedColumns,
+                                          fixedColumnsRead, columnsRead);
+            };
+    }
+
+    ExpressionValue getRowEmbedding(const RowPath & rowName,
+                                    const std::vector<ColumnPath> & columnNames,
+                                    StorageType storage) const
+    {
+        if (storage != ST_FLOAT32 && storage != ST_FLOAT64)
+            throw HttpReturnException(400, "Row embeddings must be of type "
+                                      "float32 or float64");
+
+        auto data = committed.load();
+        auto row = data->lookupRow(rowName);
+
+        // Columns we don't know are looked up by name in the sparse columns
+        std::vector<size_t> columnIndexes(columnNames.size(), -1);
+        for (size_t i = 0;  i < columnNames.size();  ++i) {
+            auto cit = data->columnIndex.find(columnNames[i].oldHash());
+            if (cit != data->columnIndex.end())
+                columnIndexes[i] = cit->second;
+        }
+
+        std::vector<double> values(columnNames.size());
+        Date ts = data->chunks.at(row.first)
+            ->getRowEmbedding(row.second, columnIndexes, columnNames,
+                              values.data());
+
+        if (storage == ST_FLOAT32)
+            return ExpressionValue(std::vector<float>(values.begin(),
+                                                      values.end()),
+                                   ts);
+        return ExpressionValue(std::move(values), ts);
     }
 
     virtual RowPath getRowPath(const RowHash & rowHash) const override
     {
-        int shard = getRowShard(rowHash);
-        auto it = rowIndex[shard].find(rowHash);
-        if (it == rowIndex[shard].end()) {
+        auto data = committed.load();
+        auto row = data->tryLookupRow(rowHash);
+        if (row.first == -1) {
             throw HttpReturnException(400, "Row not found in tabular dataset");
         }
 
-        return chunks.at(it->second.first).getRowPath(it->second.second);
+        return data->chunks.at(row.first)->getRowPath(row.second);
     }
 
     virtual ColumnPath getColumnPath(ColumnHash column) const override
     {
-        auto it = columnHashIndex.find(column);
-        if (it == columnHashIndex.end())
+        auto data = committed.load();
+        auto it = data->columnHashIndex.find(column);
+        if (it == data->columnHashIndex.end())
             throw HttpReturnException(400, "Tabular dataset contains no column with given hash",
                                       "columnHash", column,
                                       "knownColumns", getColumnPaths());
-        return columns[it->second].columnName;
+        return data->columns[it->second].columnName;
     }
 
     virtual const ColumnStats &
     getColumnStats(const ColumnPath & column, ColumnStats & stats) const override
     {
+        auto data = committed.load();
         // WARNING: we don't calculate the correct value here; we don't
         // correctly record the row counts.  We should probably remove it
         // from the interface, since it's hard for any dataset to get it
         // right.
-        auto it = columnIndex.find(column.oldHash());
-        if (it == columnIndex.end()) {
+        auto it = data->columnIndex.find(column.oldHash());
+        if (it == data->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given hash",
                                       "columnPath", column,
                                       "knownColumns", getColumnPaths());
@@ -716,7 +1012,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
         bool isNumeric = true;
 
-        for (auto & c: columns.at(it->second).chunks) {
+        for (auto & c: data->columns.at(it->second).chunks) {
 
             auto onValue = [&] (const CellValue & value)
                 {
@@ -727,26 +1023,53 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 };
                                 
             c.second->forEachDistinctValue(onValue);
+
+            // The bounds come straight from the zone maps of the chunks
+            const ColumnZoneMap * zoneMap
+                = data->chunks.at(c.first)->maybeGetZoneMap(it->second, column);
+            if (!zoneMap || zoneMap->minValue.empty())
+                continue;
+            if (stats.minValue_.empty() || zoneMap->minValue < stats.minValue_)
+                stats.minValue_ = zoneMap->minValue;
+            if (stats.maxValue_.empty() || stats.maxValue_ < zoneMap->maxValue)
+                stats.maxValue_ = zoneMap->maxValue;
         }
 
-        stats.isNumeric_ = isNumeric && !chunks.empty();
-        stats.rowCount_ = rowCount;
+        stats.isNumeric_ = isNumeric && !data->chunks.empty();
+        stats.rowCount_ = data->rowCount;
         return stats;
     }
 
     virtual size_t getRowCount() const override
     {
-        return rowCount;
+        return committed.load()->rowCount;
     }
 
     virtual size_t getColumnCount() const override
     {
-        return columns.size();
+        return committed.load()->columns.size();
     }
 
     virtual std::pair<Date, Date> getTimestampRange() const
     {
-        return { earliestTs, latestTs };
+        auto data = committed.load();
+        return { data->earliestTs, data->latestTs };
+    }
+
+    /** All of the cells of a row share its timestamp, which is read
+        without touching any of the columns.
+    */
+    std::pair<Date, Date> getRowTimestampRange(const RowPath & rowName) const
+    {
+        auto data = committed.load();
+        int chunkIndex;
+        int rowIndex;
+        std::tie(chunkIndex, rowIndex) = data->tryLookupRow(rowName);
+        if (chunkIndex < 0)
+            return { Date::notADate(), Date::notADate() };
+
+        Date ts = data->chunks[chunkIndex]->getRowTimestamp(rowIndex);
+        return { ts, ts };
     }
 
     GenerateRowsWhereFunction
@@ -759,46 +1082,437 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         return result;
     }
 
+    /** Generate the rows matching a predicate on a single column.  Each
+        chunk answers from its frozen column; those that store a table of
+        distinct values test the predicate once per value and skip the
+        chunk entirely when none match.
+    */
+    GenerateRowsWhereFunction
+    generateRowsWherePredicate(const ColumnPredicate & predicate) const
+    {
+        auto data = committed.load();
+        // A column that's not known is null everywhere, and so matches no
+        // rows at all.
+        auto it = data->columnIndex.find(predicate.columnName.oldHash());
+        int index = it == data->columnIndex.end() ? -1 : it->second;
+
+        return {[=] (ssize_t numToGenerate, Any token,
+                     const BoundParameters & params,
+                     std::function<bool (const Json::Value &)> onProgress)
+                -> std::pair<std::vector<RowPath>, Any>
+                {
+                    if (index == -1)
+                        return { {}, Any() };
+
+                    auto filter = [&] (const CellValue & val)
+                        {
+                            return predicate.matches(val);
+                        };
+
+                    std::vector<std::vector<RowPath> > chunkRows(data->chunks.size());
+
+                    auto onChunk = [&] (size_t i)
+                        {
+                            const TabularDatasetChunk & chunk = *data->chunks[i];
+                            const FrozenColumn * column
+                                = chunk.maybeGetColumn(index,
+                                                       predicate.columnName);
+                            if (!column)
+                                return;
+
+                            // Skip chunks whose zone map shows that no
+                            // value can match
+                            const ColumnZoneMap * zoneMap
+                                = chunk.maybeGetZoneMap(index,
+                                                        predicate.columnName);
+                            if (zoneMap && !zoneMap->mayMatch(predicate))
+                                return;
+
+                            std::vector<RowPath> & output = chunkRows[i];
+                            auto onRow = [&] (size_t rowNum)
+                                {
+                                    output.emplace_back(chunk.getRowPath(rowNum));
+                                    return true;
+                                };
+
+                            if (predicate.op == ColumnPredicate::EQUAL)
+                                column->forEachMatchingRow(predicate.values[0],
+                                                           onRow);
+                            else column->forEachRowWhere(filter, onRow);
+                        };
+
+                    parallelMap(0, data->chunks.size(), onChunk);
+
+                    // Concatenating chunks in order keeps the output
+                    // deterministic
+                    std::vector<RowPath> rows;
+                    for (auto & r: chunkRows)
+                        rows.insert(rows.end(),
+                                    std::make_move_iterator(r.begin()),
+                                    std::make_move_iterator(r.end()));
+
+                    return { std::move(rows), Any() };
+                },
+                "tabular dataset rows where " + predicate.print(),
+                GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN};
+    }
+
+    /** Scope used to evaluate a batch of rows of a single chunk in the
+        vectorized execution path.  Columns are extracted straight from
+        the frozen columns of the chunk.
+    */
+    struct ChunkBatchScope: public SqlBatchScope {
+        ChunkBatchScope(const Committed & data,
+                        const TabularDatasetChunk & chunk,
+                        size_t startRow, size_t numRows)
+            : SqlBatchScope(numRows), data(data), chunk(chunk),
+              startRow(startRow)
+        {
+        }
+
+        const Committed & data;
+        const TabularDatasetChunk & chunk;
+        size_t startRow;  ///< First row of the batch within the chunk
+
+        virtual void getColumn(const ColumnPath & columnName,
+                               SqlBatchValues & output) const override
+        {
+            const FrozenColumn * column = nullptr;
+            auto it = data.columnIndex.find(columnName.oldHash());
+            if (it != data.columnIndex.end())
+                column = chunk.maybeGetColumn(it->second, columnName);
+
+            if (!column) {
+                // Column is unknown, or sparse and not in this chunk
+                std::fill(output.values, output.values + numRows, 0.0);
+                std::fill(output.states, output.states + numRows,
+                          (uint8_t)SqlBatchValues::NULLVAL);
+                return;
+            }
+
+            // Only purely numeric columns whose values are all exactly
+            // representable as doubles can be processed in batch; the
+            // rest go through the scalar path.
+            static constexpr uint64_t MAX_EXACT_INTEGER = 1ULL << 53;
+            ColumnTypes types = column->getColumnTypes();
+            bool isNumeric
+                = types.numStrings == 0 && types.numBlobs == 0
+                && types.numOther == 0
+                && (!types.hasPositiveIntegers()
+                    || types.maxPositiveInteger <= MAX_EXACT_INTEGER)
+                && (!types.hasNegativeIntegers()
+                    || types.minNegativeInteger
+                       >= -(int64_t)MAX_EXACT_INTEGER);
+
+            if (!isNumeric) {
+                std::fill(output.values, output.values + numRows, 0.0);
+                std::fill(output.states, output.states + numRows,
+                          (uint8_t)SqlBatchValues::SCALAR);
+                return;
+            }
+
+            column->extractNumbers(startRow, numRows, output.values);
+
+            for (size_t i = 0;  i < numRows;  ++i) {
+                if (MLDB_LIKELY(!std::isnan(output.values[i]))) {
+                    output.states[i] = SqlBatchValues::VALUE;
+                    continue;
+                }
+                // Nulls are extracted as NaN; tell them apart from real
+                // NaN values, which need the scalar path.
+                bool isNull = types.numReals == 0
+                    || column->get(startRow + i).empty();
+                output.values[i] = 0.0;
+                output.states[i] = isNull
+                    ? SqlBatchValues::NULLVAL : SqlBatchValues::SCALAR;
+            }
+        }
+    };
+
+    /** Return the batch program compiled from the given where expression,
+        compiling it the first time it's asked for.  Returns null if it
+        can't be compiled.
+    */
+    std::shared_ptr<const SqlBatchProgram>
+    getBatchProgram(const Utf8String & alias,
+                    const SqlExpression & where,
+                    SqlBindingScope & scope) const
+    {
+        Utf8String key = alias + "\n" + where.print();
+
+        std::unique_lock<std::mutex> guard(batchProgramsMutex);
+        auto it = batchPrograms.find(key);
+        if (it != batchPrograms.end())
+            return it->second;
+
+        if (batchPrograms.size() >= MAX_BATCH_PROGRAMS)
+            batchPrograms.clear();
+
+        auto program = SqlBatchProgram::compile(where, scope);
+        batchPrograms[key] = program;
+        return program;
+    }
+
+    /** Generate the rows matching the where expression by evaluating it
+        with its vectorized execution path on batches of rows of each
+        chunk.  Returns an empty function if the where expression doesn't
+        support batch execution.
+    */
+    GenerateRowsWhereFunction
+    generateRowsWhereBatch(const Dataset & dataset,
+                           const Utf8String & alias,
+                           const SqlExpression & where) const
+    {
+        // Rows are generated from what was committed when the function was
+        // made, so that the pages given by the token stay consistent
+        auto data = committed.load();
+
+        SqlExpressionDatasetScope dsScope(dataset, alias);
+        BoundSqlExpression whereBound = where.bind(dsScope);
+
+        if (!whereBound.batchExec)
+            return GenerateRowsWhereFunction();
+
+        // Numeric expressions are compiled into a batch program, which is
+        // faster than their batchExec closures.  Others use those.
+        auto program = getBatchProgram(alias, where, dsScope);
+        auto runBatch = [=] (const SqlBatchScope & scope,
+                             SqlBatchValues & output)
+            {
+                if (program)
+                    program->run(scope, output);
+                else whereBound.batchExec(scope, output);
+            };
+
+        return {[=] (ssize_t numToGenerate, Any token,
+                     const BoundParameters & params,
+                     std::function<bool (const Json::Value &)> onProgress)
+                {
+                    ssize_t start = 0;
+                    ssize_t limit = numToGenerate;
+
+                    ExcAssertNotEqual(limit, 0);
+
+                    if (!token.empty())
+                        start = token.convert<size_t>();
+
+                    size_t end = std::max<ssize_t>(start, data->rowCount);
+                    if (limit != -1)
+                        end = std::min<size_t>(end, start + limit);
+
+                    // Offset of the first row of each chunk
+                    std::vector<size_t> chunkStarts(1, 0);
+                    for (auto & c: data->chunks)
+                        chunkStarts.push_back(chunkStarts.back() + c->rowCount());
+
+                    std::vector<std::vector<RowPath> > chunkRows(data->chunks.size());
+                    std::atomic<size_t> rowsDone(0);
+
+                    auto onChunk = [&] (size_t i)
+                        {
+                            const TabularDatasetChunk & chunk = *data->chunks[i];
+                            size_t first
+                                = std::max<size_t>(start, chunkStarts[i])
+                                - chunkStarts[i];
+                            size_t last
+                                = std::min<size_t>(end, chunkStarts[i + 1]);
+                            if (last <= chunkStarts[i] + first)
+                                return true;
+                            last -= chunkStarts[i];
+
+                            std::vector<RowPath> & output = chunkRows[i];
+                            SqlBatchValues result;
+
+                            for (size_t b = first;  b < last;
+                                 b += SQL_BATCH_SIZE) {
+                                size_t n = std::min(SQL_BATCH_SIZE, last - b);
+                                ChunkBatchScope batch(*data, chunk, b, n);
+                                runBatch(batch, result);
+
+                                for (size_t j = 0;  j < n;  ++j) {
+                                    bool keep;
+                                    if (result.states[j] == SqlBatchValues::VALUE)
+                                        keep = result.values[j] != 0.0;
+                                    else if (result.states[j]
+                                             == SqlBatchValues::NULLVAL)
+                                        keep = false;
+                                    else {
+                                        // Fall back to the scalar path
+                                        MatrixNamedRow row;
+                                        row.rowName = chunk.getRowPath(b + j);
+                                        row.rowHash = row.rowName;
+                                        row.columns
+                                            = chunk.getRow(b + j, data->fixedColumns);
+                                        auto rowScope
+                                            = dsScope.getRowScope(row, &params);
+                                        keep = whereBound(rowScope, GET_LATEST)
+                                            .isTrue();
+                                    }
+
+                                    if (keep)
+                                        output.emplace_back(chunk.getRowPath(b + j));
+                                }
+                            }
+
+                            size_t done = (rowsDone += last - first);
+                            if (onProgress) {
+                                Json::Value progress;
+                                progress["percent"]
+                                    = (float)done / (end - start);
+                                if (!onProgress(progress))
+                                    return false;
+                            }
+                            return true;
+                        };
+
+                    if (!parallelMapHaltable(0, data->chunks.size(), onChunk))
+                        throw CancellationException
+                            ("row where generation was cancelled");
+
+                    // Chunks are concatenated in order, which keeps the
+                    // output deterministic without needing a sort
+                    std::vector<RowPath> rowsToKeep;
+                    for (auto & rows: chunkRows)
+                        rowsToKeep.insert(rowsToKeep.end(),
+                                          std::make_move_iterator(rows.begin()),
+                                          std::make_move_iterator(rows.end()));
+
+                    Any newToken;
+                    if (limit != -1 && end - start == (size_t)limit)
+                        newToken = end;
+
+                    return make_pair(std::move(rowsToKeep),
+                                     std::move(newToken));
+                },
+                "vectorized scan table filtering by where expression"};
+    }
+
+    /** Add the given chunks to the content of the dataset and extend the
+        column and row indexes with them.  This is done both for the first
+        commit and for those after it, which append to what's already
+        there and cost in proportion to the new chunks.  If partitions has
+        an entry per chunk, those are used for the row index instead of
+        recalculating them.
+
+        Nothing that readers can see is changed: the new contents are
+        built off to the side, sharing what they can with the current
+        ones, and published at the end.  If it throws, for example on a
+        duplicate row name, the dataset is left as it was.
+    */
     void finalize(std::vector<TabularDatasetChunk> & inputChunks,
-                  uint64_t totalRows)
+                  uint64_t totalRows,
+                  std::vector<RowPartitions> partitions
+                      = std::vector<RowPartitions>())
     {
-        // NOTE: must be called with the lock held
+        // NOTE: must be called with the lock held, so that commits don't
+        // race with each other
+
+        Timer rowIndexTimer;
+
+        auto old = committed.load();
+        auto result = std::make_shared<Committed>();
+
+        std::vector<RowPartitions> toInsert(std::move(partitions));
+        if (toInsert.size() != inputChunks.size()) {
+            toInsert.clear();
+            toInsert.resize(inputChunks.size());
 
-        rowCount = totalRows;
+            auto partitionChunk = [&] (int chunkNum)
+                {
+                    toInsert[chunkNum] = partitionRows(inputChunks[chunkNum]);
+                };
         
-        chunks.reserve(inputChunks.size());
+            parallelMap(0, inputChunks.size(), partitionChunk);
+        }
+
+        // Index of the first of the new chunks
+        size_t firstChunk = old->chunks.size();
+
+        result->rowCount = old->rowCount + totalRows;
+        result->fixedColumns = fixedColumns;
+
+        // The chunks that are already there are shared, not copied
+        result->chunks = old->chunks;
+        result->chunks.reserve(firstChunk + inputChunks.size());
 
         for (auto & c: inputChunks) {
-            chunks.emplace_back(std::move(c));
+            result->chunks.emplace_back
+                (std::make_shared<TabularDatasetChunk>(std::move(c)));
         }
 
-        columns.reserve(fixedColumns.size());
-        for (size_t i = 0;  i < fixedColumns.size();  ++i) {
-            const ColumnPath & c = fixedColumns[i];
-            ColumnEntry entry;
-            entry.columnName = c;
-            columns.emplace_back(entry);
-            columnIndex[c.oldHash()] = i;
-            columnHashIndex[c] = i;
-        }
-
-        // Create the column index.  This should be rapid, as there shouldn't
-        // be too many columns.
-        for (size_t i = 0;  i < chunks.size();  ++i) {
-            const TabularDatasetChunk & chunk = chunks[i];
-            ExcAssertEqual(fixedColumns.size(), chunk.columns.size());
-            for (size_t j = 0;  j < chunk.columns.size();  ++j) {
-                columns[j].chunks.emplace_back(i, chunk.columns[j]);
+        const Chunks & chunks = result->chunks;
+
+        // The timestamp range comes from those of the chunks, rather than
+        // a scan of all of the rows
+        Date earliest = Date::positiveInfinity();
+        Date latest = Date::negativeInfinity();
+        if (old->earliestTs <= old->latestTs) {
+            earliest = old->earliestTs;
+            latest = old->latestTs;
+        }
+        for (size_t i = firstChunk;  i < chunks.size();  ++i) {
+            const TabularDatasetChunk & c = *chunks[i];
+            if (c.earliestTs <= c.latestTs) {
+                earliest.setMin(c.earliestTs);
+                latest.setMax(c.latestTs);
             }
+        }
+        if (earliest <= latest) {
+            result->earliestTs = earliest;
+            result->latestTs = latest;
+        }
+
+        std::vector<ColumnEntry> & columns = result->columns;
+        auto & columnIndex = result->columnIndex;
+        auto & columnHashIndex = result->columnHashIndex;
+
+        if (old->columns.empty()) {
+            columns.reserve(fixedColumns.size());
+            for (size_t i = 0;  i < fixedColumns.size();  ++i) {
+                const ColumnPath & c = fixedColumns[i];
+                ColumnEntry entry;
+                entry.columnName = c;
+                columns.emplace_back(entry);
+                columnIndex[c.oldHash()] = i;
+                columnHashIndex[c] = i;
+            }
+        }
+        else {
+            columns = old->columns;
+            columnIndex = old->columnIndex;
+            columnHashIndex = old->columnHashIndex;
+        }
+
+        // Extend the column index.  The fixed columns are independent of
+        // each other, so they are merged in parallel.
+        for (size_t i = firstChunk;  i < chunks.size();  ++i)
+            ExcAssertEqual(fixedColumns.size(), chunks[i]->columns.size());
+
+        auto indexFixedColumn = [&] (size_t j)
+            {
+                auto & entries = columns[j].chunks;
+                entries.reserve(chunks.size());
+                for (size_t i = firstChunk;  i < chunks.size();  ++i)
+                    entries.emplace_back(i, chunks[i]->columns[j]);
+            };
+
+        if (!fixedColumns.empty())
+            parallelMap(0, fixedColumns.size(), indexFixedColumn);
+
+        // Sparse columns are added to a shared index, which is rapid as
+        // there shouldn't be too many of them.
+        for (size_t i = firstChunk;  i < chunks.size();  ++i) {
+            const TabularDatasetChunk & chunk = *chunks[i];
             for (auto & c: chunk.sparseColumns) {
-                auto it = columnIndex.insert(make_pair(c.first.oldHash(),
+                const ColumnPath & columnName = c.first.path();
+                auto it = columnIndex.insert(make_pair(columnName.oldHash(),
                                                        columns.size()))
                     .first;
                 if (it->second == columns.size()) {
                     ColumnEntry entry;
-                    entry.columnName = c.first;
+                    entry.columnName = columnName;
                     columns.emplace_back(entry);
-                    columnHashIndex[c.first] = it->second;
+                    columnHashIndex[columnName] = it->second;
                 }
                 columns[it->second].chunks.emplace_back(i, c.second);
             }
@@ -807,73 +1521,268 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         ExcAssertEqual(columns.size(), columnIndex.size());
         ExcAssertEqual(columns.size(), columnHashIndex.size());
 
-        // We create the row index in multiple chunks
+        // The new rows go in a run of their own.  We build it without
+        // locks: each shard is filled by a single task from every chunk's
+        // partition, so no two tasks ever write to the same shard.
+        auto run = std::make_shared<RowIndexRun>();
 
-        std::mutex rowIndexLock[ROW_INDEX_SHARDS];
-
-        Timer rowIndexTimer;
-
-        auto indexChunk = [&] (int chunkNum)
+        auto indexShard = [&] (int shard)
             {
-                std::vector<std::pair<RowHash, uint32_t> >
-                    toInsert[ROW_INDEX_SHARDS];
-                
-                // First, extract and sort them
-                for (unsigned j = 0;  j < chunks[chunkNum].rowCount();  ++j) {
-                    RowPath rowNameStorage;
-                    const RowPath & rowName
-                        = chunks[chunkNum].getRowPath(j, rowNameStorage);
-                    RowHash rowHash = rowName;
-                    
-                    int shard = getRowShard(rowHash);
-                    toInsert[shard].emplace_back(rowHash, j);
-                }
-
-                // Secondly, add them to the row index
-                for (size_t i = 0;  i < ROW_INDEX_SHARDS;  ++i) {
-                    size_t shard = (i + chunkNum) % ROW_INDEX_SHARDS;
-                    std::unique_lock<std::mutex> guard(rowIndexLock[shard]);
-                    
-                    for (auto & e: toInsert[shard]) {
+                size_t shardSize = 0;
+                for (auto & partitions: toInsert)
+                    shardSize += partitions[shard].size();
+                run->shards[shard].reserve(4 * shardSize / 3);
+                run->filters[shard] = BlockedBloomFilter(shardSize);
+
+                for (size_t chunkNum = 0;  chunkNum < toInsert.size();
+                     ++chunkNum) {
+                    for (auto & e: toInsert[chunkNum][shard]) {
                         RowHash rowHash = e.first;
                         int32_t indexInChunk = e.second;
+                        int chunkIndex = firstChunk + chunkNum;
                         
-                        if (!rowIndex[shard].insert({rowHash,
-                                        { chunkNum, indexInChunk }}).second) {
+                        run->filters[shard].insert(rowHash.hash());
+                        if (old->tryLookupRow(rowHash).first != -1
+                            || !run->shards[shard].insert
+                                   ({rowHash, { chunkIndex, indexInChunk }})
+                                   .second) {
                             throw HttpReturnException
                                 (400, "Duplicate row name in tabular dataset",
                                  "rowName",
-                                 chunks[chunkNum].getRowPath(indexInChunk));
+                                 chunks[chunkIndex]->getRowPath(indexInChunk));
                         }
                     }
+
+                    // Release the memory as we go
+                    ShardEntries().swap(toInsert[chunkNum][shard]);
                 }
             };
-        
-        parallelMap(0, chunks.size(), indexChunk);
-        
-#if 0
-        //cerr << "creating row index" << endl;
-        rowIndex.reserve(4 * totalRows / 3);
-        //cerr << "rowIndex capacity is " << rowIndex.capacity() << endl;
-        for (unsigned i = 0;  i < chunks.size();  ++i) {
-            for (unsigned j = 0;  j < chunks[i].rowCount();  ++j) {
-                RowPath rowNameStorage;
-                if (!rowIndex.insert({ chunks[i].getRowPath(j, rowNameStorage),
-                                { i, j } }).second)
-                    throw HttpReturnException
-                        (400, "Duplicate row name in tabular dataset",
-                         "rowName", chunks[i].getRowPath(j));
+
+        parallelMap(0, ROW_INDEX_SHARDS, indexShard);
+        run->rowCount = totalRows;
+
+        result->rowIndex = old->rowIndex;
+        result->rowIndex.emplace_back(std::move(run));
+        mergeRowIndexRuns(result->rowIndex);
+
+        committed.store(std::move(result));
+
+        INFO_MSG(logger) << "indexing took " << rowIndexTimer.elapsed();
+    }
+
+    /** Merge the last run of the row index into the ones before it, for as
+        long as they're no more than twice as big.  That keeps the sizes of
+        the runs more than doubling from the last to the first, so there
+        are at most a logarithmic number of them.
+    */
+    static void
+    mergeRowIndexRuns(std::vector<std::shared_ptr<const RowIndexRun> > & runs)
+    {
+        while (runs.size() > 1
+               && runs[runs.size() - 2]->rowCount
+                  <= 2 * runs.back()->rowCount) {
+            const RowIndexRun & first = *runs[runs.size() - 2];
+            const RowIndexRun & second = *runs.back();
+
+            auto merged = std::make_shared<RowIndexRun>();
+            merged->rowCount = first.rowCount + second.rowCount;
+
+            auto mergeShard = [&] (int shard)
+                {
+                    auto & index = merged->shards[shard];
+                    auto & filter = merged->filters[shard];
+                    size_t shardSize = first.shards[shard].size()
+                        + second.shards[shard].size();
+                    index.reserve(4 * shardSize / 3);
+                    filter = BlockedBloomFilter(shardSize);
+                    for (auto * from: { &first, &second }) {
+                        for (auto & e: from->shards[shard]) {
+                            index.insert(e);
+                            filter.insert(e.first.hash());
+                        }
+                    }
+                };
+
+            parallelMap(0, ROW_INDEX_SHARDS, mergeShard);
+
+            runs.pop_back();
+            runs.back() = std::move(merged);
+        }
+    }
+
+    /** Save the committed contents of the dataset to the given URL, in a
+        format that can be reloaded by load().  See TabularFileWriter.
+    */
+    void save(const Url & dataFileUrl) const
+    {
+        Timer saveTimer;
+
+        auto data = committed.load();
+
+        TabularFileWriter writer(dataFileUrl, data->fixedColumns,
+                                 data->earliestTs, data->latestTs,
+                                 data->chunks.size());
+        for (auto & c: data->chunks)
+            writer.writeChunk(*c);
+        writer.close();
+
+        INFO_MSG(logger) << "saved " << data->rowCount << " rows in "
+                         << data->chunks.size() << " chunks to " << dataFileUrl
+                         << " in " << saveTimer.elapsed();
+    }
+
+    /** Write the committed contents of the dataset to the given stream, in
+        the same format as save().  What's written is the snapshot current
+        when it's called; commits made while it runs aren't included.
+    */
+    void save(std::ostream & stream) const
+    {
+        auto data = committed.load();
+
+        TabularFileWriter writer(stream, data->fixedColumns,
+                                 data->earliestTs, data->latestTs,
+                                 data->chunks.size());
+        for (auto & c: data->chunks)
+            writer.writeChunk(*c);
+        writer.close();
+    }
+
+    /** Return the memory breakdown of TabularDataset::getMemoryUsage(),
+        for the currently committed snapshot.
+    */
+    Json::Value getMemoryUsage() const
+    {
+        auto data = committed.load();
+        const auto & columns = data->columns;
+
+        Json::Value result;
+
+        // By frozen column format, over all the chunks
+        std::map<std::string, std::pair<size_t, uint64_t> > formats;
+
+        uint64_t columnBytes = 0;
+        Json::Value & columnsOut = result["columns"];
+        columnsOut = Json::Value(Json::arrayValue);
+        for (auto & c: columns) {
+            std::map<std::string, uint64_t> columnFormats;
+            uint64_t bytes = 0;
+            for (auto & chunk: c.chunks) {
+                if (!chunk.second)
+                    continue;
+                size_t mem = chunk.second->memusage();
+                std::string format = chunk.second->format();
+                columnFormats[format] += mem;
+                formats[format].first += 1;
+                formats[format].second += mem;
+                bytes += mem;
+            }
+            Json::Value column;
+            column["columnName"] = jsonEncode(c.columnName);
+            column["totalBytes"] = (Json::UInt)bytes;
+            column["chunks"] = (Json::UInt)c.chunks.size();
+            column["rowCount"] = (Json::UInt)c.rowCount;
+            for (auto & f: columnFormats)
+                column["formats"][f.first] = (Json::UInt)f.second;
+            columnsOut.append(std::move(column));
+            columnBytes += bytes;
+        }
+
+        uint64_t chunkBytes = 0, rowNameBytes = 0, timestampBytes = 0;
+        for (auto & c: data->chunks) {
+            chunkBytes += c->memusage();
+            rowNameBytes += c->rowNamesMemusage();
+            timestampBytes += c->timestamps->memusage();
+        }
+
+        // Everything in the chunks except the column values, row names
+        // and timestamps: the chunk structures and sparse column keys
+        uint64_t chunkOverhead
+            = chunkBytes - columnBytes - rowNameBytes - timestampBytes;
+
+        uint64_t rowIndexBytes = 0, rowFilterBytes = 0;
+        for (auto & run: data->rowIndex) {
+            for (size_t i = 0;  i < ROW_INDEX_SHARDS;  ++i) {
+                rowIndexBytes += run->shards[i].capacity()
+                    * sizeof(std::pair<RowHash, std::pair<int, int> >);
+                rowFilterBytes += run->filters[i].memUsage();
             }
         }
-#endif
-        INFO_MSG(logger) << "row index took " << rowIndexTimer.elapsed();
 
+        uint64_t columnIndexBytes
+            = (data->columnIndex.capacity() + fixedColumnIndex.capacity())
+              * sizeof(std::pair<uint64_t, int>)
+            + data->columnHashIndex.capacity()
+              * sizeof(std::pair<ColumnHash, int>)
+            + columns.capacity() * sizeof(ColumnEntry)
+            + data->fixedColumns.capacity() * sizeof(ColumnPath);
+        for (auto & c: columns) {
+            columnIndexBytes += c.chunks.capacity()
+                * sizeof(std::pair<uint32_t, std::shared_ptr<const FrozenColumn> >);
+        }
+
+        Json::Value & formatsOut = result["formats"];
+        formatsOut = Json::Value(Json::objectValue);
+        for (auto & f: formats) {
+            formatsOut[f.first]["columns"] = (Json::UInt)f.second.first;
+            formatsOut[f.first]["totalBytes"] = (Json::UInt)f.second.second;
+        }
+
+        Json::Value & indexes = result["indexes"];
+        indexes["rowIndex"] = (Json::UInt)rowIndexBytes;
+        indexes["rowFilter"] = (Json::UInt)rowFilterBytes;
+        indexes["columnIndex"] = (Json::UInt)columnIndexBytes;
+
+        uint64_t totalBytes = chunkBytes + rowIndexBytes + rowFilterBytes
+            + columnIndexBytes;
+
+        result["totalBytes"] = (Json::UInt)totalBytes;
+        result["rowCount"] = (Json::UInt)data->rowCount;
+        result["chunks"] = (Json::UInt)data->chunks.size();
+        result["columnBytes"] = (Json::UInt)columnBytes;
+        result["rowNames"] = (Json::UInt)rowNameBytes;
+        result["timestamps"] = (Json::UInt)timestampBytes;
+        result["chunkOverhead"] = (Json::UInt)chunkOverhead;
+        return result;
+    }
+
+    /** Load the contents of the dataset from the given URL, which must have
+        been written by save().  If the file can be memory mapped, the
+        frozen columns point directly into the mapping, which stays alive
+        for as long as any of them is referenced.
+    */
+    void load(const Url & dataFileUrl)
+    {
+        Timer loadTimer;
+
+        TabularFileReader reader(dataFileUrl);
+
+        std::unique_lock<std::mutex> guard(datasetMutex);
+
+        initialize(std::move(reader.columnNames));
+
+        std::vector<TabularDatasetChunk> loadedChunks;
+        loadedChunks.reserve(reader.numChunks);
+        uint64_t totalRows = 0;
+        for (size_t i = 0;  i < reader.numChunks;  ++i) {
+            loadedChunks.emplace_back(reader.readChunk());
+            totalRows += loadedChunks.back().rowCount();
+        }
+
+        finalize(loadedChunks, totalRows);
+        loadedFromFile = true;
+
+        auto data = committed.load();
+        INFO_MSG(logger) << "loaded " << data->rowCount << " rows in "
+                         << data->chunks.size() << " chunks from " << dataFileUrl
+                         << (reader.isMapped() ? " (mapped)" : "")
+                         << " in " << loadTimer.elapsed();
     }
 
     void initialize(vector<ColumnPath> columnNames)
     {
-        ExcAssert(this->fixedColumns.empty());
+        ExcAssert(!columnsInitialized);
         this->fixedColumns = std::move(columnNames);
+        columnsInitialized = true;
 
         for (size_t i = 0;  i < fixedColumns.size();  ++i) {
             if (!fixedColumnIndex.insert(make_pair(fixedColumns[i].oldHash(), i))
@@ -1084,13 +1993,16 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             }
         }
 
+        /** Freeze the chunk in the background, so that the thread can go
+            on recording while it's done; commit() waits for it.  The next
+            row recorded starts a new chunk.
+        */
         virtual void finishedChunk() override
         {
             if (!chunk || chunk->rowCount() == 0)
                 return;
-            ColumnFreezeParameters params;
-            auto frozen = chunk->freeze(params);
-            store->addFrozenChunk(std::move(frozen));
+            store->freezeChunkInBackground(std::move(chunk));
+            chunk.reset();
         }
 
         virtual
@@ -1148,13 +2060,18 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         }
     };
 
-    void commit()
+    /** Commit the rows recorded since the last commit.  If anything is
+        watching for committed rows, returns a store holding just the rows
+        that were added, which the caller passes to the watches once the
+        commit is finished.
+    */
+    std::shared_ptr<TabularDataStore> commit()
     {
         // No mutable chunks anymore.  Atomically swap out the old pointer.
         auto oldMutableChunks = mutableChunks.exchange(nullptr);
 
         if (!oldMutableChunks)
-            return;  // a parallel commit beat us to it
+            return nullptr;  // a parallel commit beat us to it
 
         for (auto & c: *oldMutableChunks) {
             // Wait for us to have the only reference to the chunk
@@ -1184,38 +2101,101 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         // apart from this thread.  So we can perform operations unlocked
         // on it without any problem.
 
-        // Freeze all of the uncommitted chunks
-        std::atomic<size_t> totalRows(0);
+        // Collect all of the frozen chunks
+        std::unique_ptr<FrozenChunkEntry> frozenList(takeFrozenChunks());
+        std::vector<TabularDatasetChunk> committedChunks;
+        std::vector<RowPartitions> partitions;
+        size_t totalRows = 0;
 
-        for (auto & c: frozenChunks)
-            totalRows += c.rowCount();
+        for (auto e = frozenList.get();  e;  e = e->next) {
+            totalRows += e->chunk.rowCount();
+            committedChunks.emplace_back(std::move(e->chunk));
+            partitions.emplace_back(std::move(e->rowPartitions));
+        }
+        frozenList.reset();
+
+        size_t firstChunk = committed.load()->chunks.size();
+        finalize(committedChunks, totalRows, std::move(partitions));
+        ++generation;
+
+        std::shared_ptr<TabularDataStore> added;
+        if (!committedRowsWatches.empty())
+            added = shareChunks(firstChunk);
 
-        finalize(frozenChunks, totalRows);
+        auto data = committed.load();
+        uint64_t rowCount = data->rowCount;
 
         size_t mem = 0;
-        for (auto & c: chunks) {
-            mem += c.memusage();
+        for (auto & c: data->chunks) {
+            mem += c->memusage();
         }
 
         size_t columnMem = 0;
-        for (auto & c: columns) {
+        for (auto & c: data->columns) {
             size_t bytesUsed = 0;
             for (auto & chunk: c.chunks) {
                 bytesUsed += chunk.second->memusage();
             }
             TRACE_MSG(logger) << "column " << c.columnName << " used "
                  << bytesUsed << " bytes at "
-                 << 1.0 * bytesUsed / totalRows << " per row";
+                 << 1.0 * bytesUsed / rowCount << " per row";
             columnMem += bytesUsed;
         }
 
         INFO_MSG(logger) << "total mem usage is " << mem << " bytes" << " for "
-             << totalRows << " rows and " << columns.size() << " columns for "
+             << rowCount << " rows and " << data->columns.size() << " columns for "
              << 1.0 * mem / rowCount << " bytes/row";
         INFO_MSG(logger) << "column memory is " << columnMem;
 
+        if (getFrozenMemoryPolicy().enabled()) {
+            FrozenMemoryStats stats = getFrozenMemoryStats();
+            INFO_MSG(logger) << "frozen memory regions use " << stats.bytesMapped
+                 << " bytes, " << stats.hugePageBytes << " on huge pages, "
+                 << "per node " << jsonEncodeStr(stats.bytesPerNode);
+        }
+
+        if (!config.dataFileUrl.empty())
+            save(config.dataFileUrl);
+
+        return added;
     }
 
+    /** Return a store holding the committed chunks from firstChunk on,
+        which shares their columns, or null if there are none.  Must be
+        called with the lock held.
+    */
+    std::shared_ptr<TabularDataStore> shareChunks(size_t firstChunk)
+    {
+        auto data = committed.load();
+        const Chunks & chunks = data->chunks;
+
+        if (firstChunk >= chunks.size())
+            return nullptr;
+
+        auto result = std::make_shared<TabularDataStore>
+            (TabularDatasetConfig(), logger);
+        result->initialize(fixedColumns);
+
+        std::vector<TabularDatasetChunk> shared;
+        uint64_t totalRows = 0;
+        for (size_t i = firstChunk;  i < chunks.size();  ++i) {
+            shared.emplace_back(chunks[i]->share());
+            totalRows += chunks[i]->rowCount();
+        }
+        result->finalize(shared, totalRows);
+        return result;
+    }
+
+    /// Watches for the rows added by each commit; see watchCommittedRows()
+    CommittedRowsWatches committedRowsWatches;
+
+    /// Incremented each time a commit makes new chunks visible
+    std::atomic<uint64_t> generation;
+
+    /// Random number that tells this dataset apart from another one of the
+    /// same name, for example once it has been created again
+    const uint32_t instance;
+
     /// The number of background jobs that we're currently waiting for
     std::atomic<size_t> backgroundJobsActive;
     shared_ptr<spdlog::logger> logger;
@@ -1248,8 +2228,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     void addFrozenChunk(TabularDatasetChunk frozen)
     {
         ExcAssertNotEqual(frozen.rowCount(), 0);
-        std::unique_lock<std::mutex> guard(datasetMutex);
-        frozenChunks.emplace_back(std::move(frozen));
+        auto entry = new FrozenChunkEntry(std::move(frozen));
+        entry->next = frozenChunks.load(std::memory_order_relaxed);
+        while (!frozenChunks.compare_exchange_weak(entry->next, entry)) ;
     }
 
     std::shared_ptr<MutableTabularDatasetChunk>
@@ -1272,21 +2253,30 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     {
         // Must be done with the dataset lock held
         if (!mutableChunks.load()) {
-            //need to create the mutable chunk
-            vector<ColumnPath> columnNames;
-
-            //The first recorded row will determine the columns
-            Lightweight_Hash<uint64_t, int> inputColumnIndex;
-            for (unsigned i = 0;  i < vals.size();  ++i) {
-                const ColumnPath & c = std::get<0>(vals[i]);
-                uint64_t ch(c.oldHash());
-                if (!inputColumnIndex.insert(make_pair(ch, i)).second)
-                    throw HttpReturnException(400, "Duplicate column name in tabular dataset entry",
-                                              "columnName", c.toUtf8String());
-                columnNames.push_back(c);
-            }
+            if (loadedFromFile)
+                throw HttpReturnException
+                    (400, "Tabular dataset was loaded from its dataFileUrl "
+                     "and is read-only, cannot add more rows",
+                     "dataFileUrl", config.dataFileUrl);
+
+            // Rows recorded after a commit keep the columns of the first
+            // ones, so that the new chunks can be appended to the others
+            if (!columnsInitialized) {
+                vector<ColumnPath> columnNames;
+
+                //The first recorded row will determine the columns
+                Lightweight_Hash<uint64_t, int> inputColumnIndex;
+                for (unsigned i = 0;  i < vals.size();  ++i) {
+                    const ColumnPath & c = std::get<0>(vals[i]);
+                    uint64_t ch(c.oldHash());
+                    if (!inputColumnIndex.insert(make_pair(ch, i)).second)
+                        throw HttpReturnException(400, "Duplicate column name in tabular dataset entry",
+                                                  "columnName", c.toUtf8String());
+                    columnNames.push_back(c);
+                }
 
-            initialize(std::move(columnNames));
+                initialize(std::move(columnNames));
+            }
 
             auto newChunks = std::make_shared<ChunkList>(NUM_PARALLEL_CHUNKS);
 
@@ -1352,9 +2342,6 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     void recordRow(RowPath rowName,
                    Vals&& vals)
     {
-        if (rowCount > 0)
-            HttpReturnException(400, "Tabular dataset has already been committed, cannot add more rows");
-
         auto mc = mutableChunks.load();
 
         if (!mc) {
@@ -1409,9 +2396,15 @@ TabularDataset(MldbServer * owner,
                const std::function<bool (const Json::Value &)> & onProgress)
     : Dataset(owner)
 {
+    auto tabularConfig = config.params.convert<TabularDatasetConfig>();
     itl = make_shared<TabularDataStore>(
-            config.params.convert<TabularDatasetConfig>(),
+            tabularConfig,
             MLDB::getMldbLog<TabularDataset>());
+
+    if (!tabularConfig.dataFileUrl.empty()
+        && tryGetUriObjectInfo(tabularConfig.dataFileUrl.toString()).exists) {
+        itl->load(tabularConfig.dataFileUrl);
+    }
 }
 
 TabularDataset::
@@ -1424,8 +2417,21 @@ TabularDataset::
 getStatus() const
 {
     Json::Value status;
-    status["rowCount"] = itl->rowCount;
-    status["columnCount"] = itl->columns.size();
+    status["rowCount"] = itl->committed.load()->rowCount;
+    status["columnCount"] = itl->getColumnCount();
+
+    // Placement of the storage of all frozen columns of the process, when
+    // it's allocated from huge page or NUMA regions
+    if (getFrozenMemoryPolicy().enabled()) {
+        FrozenMemoryStats stats = getFrozenMemoryStats();
+        Json::Value & memory = status["frozenMemory"];
+        memory["bytesAllocated"] = stats.bytesAllocated;
+        memory["bytesMapped"] = stats.bytesMapped;
+        memory["hugePageBytes"] = stats.hugePageBytes;
+        memory["placementFailures"] = stats.placementFailures;
+        for (auto & b: stats.bytesPerNode)
+            memory["bytesPerNode"].append(b);
+    }
     return status;
 }
 
@@ -1436,6 +2442,13 @@ getTimestampRange() const
     return itl->getTimestampRange();
 }
 
+Json::Value
+TabularDataset::
+getMemoryUsage() const
+{
+    return itl->getMemoryUsage();
+}
+
 std::shared_ptr<MatrixView>
 TabularDataset::
 getMatrixView() const
@@ -1455,7 +2468,7 @@ TabularDataset::
 getRowStream() const 
 { 
     return std::make_shared<TabularDataStore::TabularDataStoreRowStream>
-        (itl.get()); 
+        (itl->committed.load()); 
 } 
 
 ExpressionValue
@@ -1465,6 +2478,32 @@ getRowExpr(const RowPath & row) const
     return itl->getRowExpr(row);
 }
 
+std::pair<Date, Date>
+TabularDataset::
+getRowTimestampRange(const RowPath & row) const
+{
+    return itl->getRowTimestampRange(row);
+}
+
+std::function<ExpressionValue (const RowPath & row)>
+TabularDataset::
+getProjectedRowExpr(const std::vector<ColumnPath> & columns) const
+{
+    // Keep the store alive for as long as the function is
+    auto store = itl;
+    auto getRow = store->getProjectedRowExpr(columns);
+    return [store, getRow] (const RowPath & row) { return getRow(row); };
+}
+
+ExpressionValue
+TabularDataset::
+getRowEmbedding(const RowPath & row,
+                const std::vector<ColumnPath> & columns,
+                StorageType storage) const
+{
+    return itl->getRowEmbedding(row, columns, storage);
+}
+
 GenerateRowsWhereFunction
 TabularDataset::
 generateRowsWhere(const SqlBindingScope & context,
@@ -1477,9 +2516,26 @@ generateRowsWhere(const SqlBindingScope & context,
         = itl->generateRowsWhere(context, where, offset, limit);
     if (!fn)
         fn = Dataset::generateRowsWhere(context, alias, where, offset, limit);
+
+    // A plain scan evaluating the where expression row by row can be
+    // replaced by a vectorized one if the expression supports it
+    if (fn.complexity == GenerateRowsWhereFunction::TABLESCAN) {
+        GenerateRowsWhereFunction batched
+            = itl->generateRowsWhereBatch(*this, alias, where);
+        if (batched)
+            return batched;
+    }
+
     return fn;
 }
 
+GenerateRowsWhereFunction
+TabularDataset::
+generateRowsWherePredicate(const ColumnPredicate & predicate) const
+{
+    return itl->generateRowsWherePredicate(predicate);
+}
+
 KnownColumn
 TabularDataset::
 getKnownColumnInfo(const ColumnPath & columnName) const
@@ -1491,7 +2547,133 @@ void
 TabularDataset::
 commit()
 {
-    return itl->commit();
+    auto added = itl->commit();
+    if (added) {
+        std::shared_ptr<TabularDataset> rows(new TabularDataset(server));
+        rows->itl = std::move(added);
+        itl->committedRowsWatches.trigger(rows);
+    }
+}
+
+std::shared_ptr<void>
+TabularDataset::
+watchCommittedRows(OnCommittedRows onRows)
+{
+    std::shared_ptr<void> result;
+    std::shared_ptr<TabularDataStore> existing;
+    {
+        // Under the lock, so that each row is either in the existing
+        // rows or in those added by a commit that the watch sees
+        std::unique_lock<std::mutex> guard(itl->datasetMutex);
+        result = itl->committedRowsWatches.add(onRows);
+        existing = itl->shareChunks(0);
+    }
+
+    if (existing) {
+        std::shared_ptr<TabularDataset> rows(new TabularDataset(server));
+        rows->itl = std::move(existing);
+        onRows(rows);
+    }
+
+    return result;
+}
+
+TabularDataset::
+TabularDataset(MldbServer * owner)
+    : Dataset(owner)
+{
+}
+
+uint64_t
+TabularDataset::
+getGeneration() const
+{
+    return itl->generation;
+}
+
+void
+TabularDataset::
+save(const Url & dataFileUrl) const
+{
+    itl->save(dataFileUrl);
+}
+
+namespace {
+
+/** Stream buffer that sends what is written to it as the chunks of an HTTP
+    response.
+*/
+struct ResponseStreamBuf: public std::streambuf {
+    ResponseStreamBuf(RestConnection & connection)
+        : connection(connection), buffer(BUFFER_SIZE)
+    {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    virtual int_type overflow(int_type c) override
+    {
+        send();
+        if (c != traits_type::eof()) {
+            *pptr() = c;
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    virtual int sync() override
+    {
+        send();
+        return 0;
+    }
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1024 * 1024;
+
+    void send()
+    {
+        // An empty chunk would end the response
+        if (pptr() != pbase())
+            connection.sendPayload(std::string(pbase(), pptr()));
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    RestConnection & connection;
+    std::vector<char> buffer;
+};
+
+} // file scope
+
+RestRequestMatchResult
+TabularDataset::
+handleRequest(RestConnection & connection,
+              const RestRequest & request,
+              RestRequestParsingContext & context) const
+{
+    if (context.remaining == "/replication" && request.verb == "GET") {
+        Json::Value result;
+        result["generation"] = itl->generation.load();
+        result["instance"] = itl->instance;
+        connection.sendResponse(200, result);
+        return RestRequestRouter::MR_YES;
+    }
+    else if (context.remaining == "/replication/data"
+             && request.verb == "GET") {
+        // Hold off commits until the chunks have all been sent, so that
+        // they are those of the generation in the header
+        std::unique_lock<std::mutex> guard(itl->datasetMutex);
+        connection.sendHttpResponseHeader
+            (200, "application/octet-stream",
+             RestConnection::CHUNKED_ENCODING,
+             { { "X-MLDB-Generation", std::to_string(itl->generation) },
+               { "X-MLDB-Instance", std::to_string(itl->instance) } });
+        ResponseStreamBuf buf(connection);
+        std::ostream stream(&buf);
+        itl->save(stream);
+        connection.finishResponse();
+        return RestRequestRouter::MR_YES;
+    }
+
+    return Dataset::handleRequest(connection, request, context);
 }
 
 Dataset::MultiChunkRecorder
@@ -1558,6 +2740,12 @@ TabularDatasetConfigDescription()
              "'error' (default), or 'add' which will allow an unlimited "
              "number of sparse columns to be added.",
              UC_ERROR);
+    addField("dataFileUrl", &TabularDatasetConfig::dataFileUrl,
+             "URL of a file in which to persist the dataset.  If the file "
+             "exists when the dataset is created, the dataset is loaded "
+             "from it (memory mapping it if it is a local file) and can't "
+             "be recorded to.  Otherwise, the dataset is saved to this file "
+             "when it is committed.");
 }
 
 namespace {
@@ -33,6 +33,10 @@ struct TabularDatasetConfig {
     TabularDatasetConfig();
 
     UnknownColumnAction unknownColumns;
+
+    /// If set, the dataset is saved here on commit and reloaded from here
+    /// (memory mapped where possible) if the file already exists.
+    Url dataFileUrl;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(TabularDatasetConfig);
@@ -54,9 +58,29 @@ struct TabularDataset : public Dataset {
     virtual std::shared_ptr<RowStream> getRowStream() const;
 
     virtual ExpressionValue getRowExpr(const RowPath & row) const;
+
+    /** Only the frozen columns that are read are decoded. */
+    virtual std::function<ExpressionValue (const RowPath & row)>
+    getProjectedRowExpr(const std::vector<ColumnPath> & columns) const;
+
+    virtual ExpressionValue
+    getRowEmbedding(const RowPath & row,
+                    const std::vector<ColumnPath> & columns,
+                    StorageType storage = ST_FLOAT64) const;
     
     virtual std::pair<Date, Date> getTimestampRange() const;
 
+    /** Break down the memory of the committed rows by column and by
+        frozen column format, with that of the row names, the timestamps
+        and the row and column indexes.  Rows which aren't committed yet
+        aren't counted.
+    */
+    virtual Json::Value getMemoryUsage() const;
+
+    /** Read from the row's timestamp, without reading any columns. */
+    virtual std::pair<Date, Date>
+    getRowTimestampRange(const RowPath & row) const;
+
     virtual GenerateRowsWhereFunction
     generateRowsWhere(const SqlBindingScope & context,
                       const Utf8String& alias,
@@ -64,11 +88,47 @@ struct TabularDataset : public Dataset {
                       ssize_t offset,
                       ssize_t limit) const;
 
+    virtual GenerateRowsWhereFunction
+    generateRowsWherePredicate(const ColumnPredicate & predicate) const;
+
     virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const;
 
     /** Commit changes to the database. */
     virtual void commit();
 
+    /** Return the number of commits that made new data visible, plus
+        one.
+    */
+    virtual uint64_t getGeneration() const;
+
+    /** Rows are only ever added to tabular datasets, so after each commit
+        that adds rows onRows is called with a tabular dataset holding
+        those rows, which shares their storage with this one.
+    */
+    virtual std::shared_ptr<void>
+    watchCommittedRows(OnCommittedRows onRows);
+
+    /** Save the committed contents of the dataset to the given file, which
+        can be reloaded through the dataFileUrl parameter or the
+        import.tabular procedure.
+    */
+    void save(const Url & dataFileUrl) const;
+
+    /** Serves the routes used by tabular.replica datasets to copy the
+        committed contents of this one:
+
+        - GET routes/replication returns the current generation, and a
+          number that changes when a dataset of the same name is created
+          again;
+        - GET routes/replication/data returns the committed chunks, in the
+          format written by save(), with the generation they belong to in
+          the X-MLDB-Generation header and that number in X-MLDB-Instance.
+    */
+    virtual RestRequestMatchResult
+    handleRequest(RestConnection & connection,
+                  const RestRequest & request,
+                  RestRequestParsingContext & context) const;
+
     virtual MultiChunkRecorder getChunkRecorder();
 
     virtual void recordRowItl(const RowPath & rowName, const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals);
@@ -6,10 +6,245 @@
 */
 
 #include "tabular_dataset_chunk.h"
+#include "tiered_frozen_column.h"
 #include "mldb/sql/expression_value.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/core/dataset.h"
+#include <sstream>
+#include <algorithm>
+#include <limits>
 
 namespace MLDB {
 
+
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+ColumnZoneMap
+ColumnZoneMap::
+fromColumn(const TabularDatasetColumn & column, size_t rowCount)
+{
+    ColumnZoneMap result;
+
+    // Nulls aren't recorded in the column, so the distinct values are
+    // exactly the non-null values
+    for (auto & v: column.indexedVals) {
+        if (result.minValue.empty() || v < result.minValue)
+            result.minValue = v;
+        if (result.maxValue.empty() || result.maxValue < v)
+            result.maxValue = v;
+    }
+
+    result.numDistinct = column.indexedVals.size();
+    result.numNulls = rowCount - column.sparseIndexes.size();
+    return result;
+}
+
+ColumnZoneMap
+ColumnZoneMap::
+fromFrozenColumn(const FrozenColumn & column, size_t rowCount)
+{
+    ColumnZoneMap result;
+
+    auto onValue = [&] (const CellValue & v)
+        {
+            if (v.empty())
+                return true;
+            ++result.numDistinct;
+            if (result.minValue.empty() || v < result.minValue)
+                result.minValue = v;
+            if (result.maxValue.empty() || result.maxValue < v)
+                result.maxValue = v;
+            return true;
+        };
+
+    column.forEachDistinctValue(onValue);
+
+    size_t numValues = 0;
+    auto onRow = [&] (size_t rowNum, const CellValue & v)
+        {
+            numValues += !v.empty();
+            return true;
+        };
+
+    column.forEach(onRow);
+
+    result.numNulls = rowCount - numValues;
+    return result;
+}
+
+bool
+ColumnZoneMap::
+mayMatch(const ColumnPredicate & predicate) const
+{
+    // Predicates never match nulls, so a column with only nulls can't match
+    if (minValue.empty())
+        return false;
+    return predicate.mayMatchRange(minValue, maxValue);
+}
+
+void
+ColumnZoneMap::
+serialize(ML::DB::Store_Writer & store) const
+{
+    serializeCellValue(store, minValue);
+    serializeCellValue(store, maxValue);
+    store << ML::DB::compact_size_t(numNulls)
+          << ML::DB::compact_size_t(numDistinct);
+}
+
+void
+ColumnZoneMap::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    minValue = reconstituteCellValue(store);
+    maxValue = reconstituteCellValue(store);
+    numNulls = ML::DB::compact_size_t(store);
+    numDistinct = ML::DB::compact_size_t(store);
+}
+
+
+/*****************************************************************************/
+/* FROZEN ROW NAMES                                                          */
+/*****************************************************************************/
+
+namespace {
+
+void writeLength(std::string & out, size_t n)
+{
+    while (n >= 128) {
+        out += (char)(n | 128);
+        n >>= 7;
+    }
+    out += (char)n;
+}
+
+size_t readLength(const char * & p)
+{
+    size_t result = 0;
+    for (int shift = 0;;  shift += 7) {
+        unsigned char c = *p++;
+        result |= size_t(c & 127) << shift;
+        if (c < 128)
+            return result;
+    }
+}
+
+/* Encode a path as the length and bytes of each of its elements, so that
+   the element boundaries survive without needing escaping.
+*/
+void encodeRowName(const Path & name, std::string & out)
+{
+    out.clear();
+    for (size_t i = 0;  i < name.size();  ++i) {
+        auto v = name.getStringView(i);
+        writeLength(out, v.second);
+        out.append(v.first, v.second);
+    }
+}
+
+} // file scope
+
+FrozenRowNames::
+FrozenRowNames(const std::vector<Path> & names)
+    : numNames(names.size())
+{
+    ExcAssertLess(names.size(), (size_t)std::numeric_limits<uint32_t>::max());
+
+    std::vector<std::string> keys(names.size());
+    for (size_t i = 0;  i < names.size();  ++i)
+        encodeRowName(names[i], keys[i]);
+
+    std::vector<uint32_t> order(names.size());
+    for (size_t i = 0;  i < order.size();  ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [&] (uint32_t i1, uint32_t i2) { return keys[i1] < keys[i2]; });
+
+    sortedPosition.resize(names.size());
+    blockOffsets.reserve((names.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+    const std::string * previous = nullptr;
+    for (size_t pos = 0;  pos < order.size();  ++pos) {
+        sortedPosition[order[pos]] = pos;
+        const std::string & key = keys[order[pos]];
+
+        // The first name of each block is stored whole, so that the block
+        // can be decoded by itself
+        size_t shared = 0;
+        if (pos % BLOCK_SIZE == 0) {
+            ExcAssertLess(data.size(),
+                          (size_t)std::numeric_limits<uint32_t>::max());
+            blockOffsets.push_back(data.size());
+        }
+        else {
+            size_t maxShared = std::min(key.size(), previous->size());
+            while (shared < maxShared && key[shared] == (*previous)[shared])
+                ++shared;
+            writeLength(data, shared);
+        }
+        writeLength(data, key.size() - shared);
+        data.append(key, shared, std::string::npos);
+        previous = &key;
+    }
+
+    data.shrink_to_fit();
+}
+
+Path
+FrozenRowNames::
+get(size_t index) const
+{
+    Path result;
+    get(index, result);
+    return result;
+}
+
+const Path &
+FrozenRowNames::
+get(size_t index, Path & storage) const
+{
+    ExcAssertLess(index, numNames);
+    size_t pos = sortedPosition[index];
+
+    // Decoding the block needs a buffer, which is kept per thread so that
+    // it doesn't need to be allocated each time
+    static thread_local std::string key;
+    key.clear();
+
+    const char * p = data.data() + blockOffsets[pos / BLOCK_SIZE];
+    for (size_t i = 0;  i <= pos % BLOCK_SIZE;  ++i) {
+        size_t shared = i == 0 ? 0 : readLength(p);
+        size_t length = readLength(p);
+        key.resize(shared);
+        key.append(p, length);
+        p += length;
+    }
+
+    PathBuilder builder;
+    for (const char * e = key.data(), * end = e + key.size();  e < end;) {
+        size_t length = readLength(e);
+        builder.add(e, length);
+        e += length;
+    }
+    return storage = builder.extract();
+}
+
+size_t
+FrozenRowNames::
+memusage() const
+{
+    return sizeof(*this)
+        + sortedPosition.capacity() * sizeof(uint32_t)
+        + blockOffsets.capacity() * sizeof(uint32_t)
+        + data.capacity();
+}
+
+
 /*****************************************************************************/
 /* TABULAR DATASET CHUNK                                                     */
 /*****************************************************************************/
@@ -21,22 +256,22 @@ memusage() const
     using namespace std;
     size_t result = sizeof(*this);
     size_t before = result;
-    for (auto & c: columns)
-        result += c->memusage();
+    for (auto & c: columns) {
+        if (c)
+            result += c->memusage();
+    }
         
     //cerr << columns.size() << " columns took " << result - before << endl;
     before = result;
         
     for (auto & c: sparseColumns)
-        result += c.first.memusage() + c.second->memusage();
+        result += sizeof(c.first) + c.second->memusage();
 
     //cerr << sparseColumns.size() << " sparse columns took "
     //     << result - before << endl;
     before = result;
 
-    for (auto & r: rowNames)
-        result += r.memusage();
-    result += integerRowNames.capacity() * sizeof(uint64_t);
+    result += rowNamesMemusage();
 
     //cerr << rowNames.size() << " row names took "
     //     << result - before << endl;
@@ -51,6 +286,14 @@ memusage() const
     return result;
 }
 
+size_t
+TabularDatasetChunk::
+rowNamesMemusage() const
+{
+    return rowNames.memusage()
+        + integerRowNames.capacity() * sizeof(uint64_t);
+}
+
 const FrozenColumn *
 TabularDatasetChunk::
 maybeGetColumn(size_t columnIndex, const PathElement & columnName) const
@@ -59,7 +302,10 @@ maybeGetColumn(size_t columnIndex, const PathElement & columnName) const
         return columns[columnIndex].get();
     }
     else {
-        auto it = sparseColumns.find(columnName);
+        ColumnId id = ColumnNameDictionary::instance().find(columnName);
+        if (!id)
+            return nullptr;
+        auto it = sparseColumns.find(id);
         if (it == sparseColumns.end())
             return nullptr;
         return it->second.get();
@@ -74,7 +320,7 @@ getRowPath(size_t index) const
     if (rowNames.empty()) {
         return PathElement(integerRowNames.at(index));
     }
-    else return rowNames.at(index);
+    else return rowNames.get(index);
 }
 
 /// Return a reference to the rowName, stored in storage if it's a temp
@@ -85,7 +331,7 @@ getRowPath(size_t index, RowPath & storage) const
     if (rowNames.empty()) {
         return storage = PathElement(integerRowNames.at(index));
     }
-    else return rowNames.at(index);
+    else return rowNames.get(index, storage);
 }
 
 const FrozenColumn *
@@ -96,13 +342,34 @@ maybeGetColumn(size_t columnIndex, const Path & columnName) const
         return columns.at(columnIndex).get();
     }
     else {
-        auto it = sparseColumns.find(columnName);
+        ColumnId id = ColumnNameDictionary::instance().find(columnName);
+        if (!id)
+            return nullptr;
+        auto it = sparseColumns.find(id);
         if (it == sparseColumns.end())
             return nullptr;
         return it->second.get();
     }
 }
 
+const ColumnZoneMap *
+TabularDatasetChunk::
+maybeGetZoneMap(size_t columnIndex, const Path & columnName) const
+{
+    if (columnIndex < columnZoneMaps.size()) {
+        return &columnZoneMaps[columnIndex];
+    }
+    else {
+        ColumnId id = ColumnNameDictionary::instance().find(columnName);
+        if (!id)
+            return nullptr;
+        auto it = sparseColumnZoneMaps.find(id);
+        if (it == sparseColumnZoneMaps.end())
+            return nullptr;
+        return &it->second;
+    }
+}
+
 /// Get the row with the given index
 std::vector<std::tuple<ColumnPath, CellValue, Date> >
 TabularDatasetChunk::
@@ -113,6 +380,8 @@ getRow(size_t index, const std::vector<ColumnPath> & fixedColumnNames) const
     result.reserve(columns.size());
     Date ts = timestamps->get(index).mustCoerceToTimestamp();
     for (size_t i = 0;  i < columns.size();  ++i) {
+        if (!columns[i])
+            continue;  // not read; see TabularChunkFilter
         CellValue val = columns[i]->get(index);
         if (val.empty())
             continue;
@@ -123,7 +392,7 @@ getRow(size_t index, const std::vector<ColumnPath> & fixedColumnNames) const
         CellValue val = c.second->get(index);
         if (val.empty())
             continue;
-        result.emplace_back(c.first, std::move(val), ts);
+        result.emplace_back(c.first.path(), std::move(val), ts);
 
     }
     return result;
@@ -139,6 +408,8 @@ getRowExpr(size_t index, const std::vector<ColumnPath> & fixedColumnNames) const
     result.reserve(columns.size());
     Date ts = timestamps->get(index).mustCoerceToTimestamp();
     for (size_t i = 0;  i < columns.size();  ++i) {
+        if (!columns[i])
+            continue;  // not read; see TabularChunkFilter
         CellValue val = columns[i]->get(index);
         if (val.empty())
             continue;
@@ -149,12 +420,99 @@ getRowExpr(size_t index, const std::vector<ColumnPath> & fixedColumnNames) const
         CellValue val = c.second->get(index);
         if (val.empty())
             continue;
-        result.emplace_back(c.first, std::move(val), ts);
+        result.emplace_back(c.first.path(), std::move(val), ts);
 
     }
     return std::move(result);
 }
 
+ExpressionValue
+TabularDatasetChunk::
+getProjectedRowExpr(size_t index, const std::vector<ColumnPath> & fixedColumnNames,
+                    const std::vector<size_t> & fixedColumnsRead,
+                    const std::set<PathElement> & columnsRead) const
+{
+    ExcAssertLess(index, rowCount());
+    std::vector<std::tuple<ColumnPath, CellValue, Date> > result;
+    result.reserve(fixedColumnsRead.size());
+    Date ts = timestamps->get(index).mustCoerceToTimestamp();
+    for (size_t i: fixedColumnsRead) {
+        if (!columns[i])
+            continue;  // not read; see TabularChunkFilter
+        CellValue val = columns[i]->get(index);
+        if (val.empty())
+            continue;
+        result.emplace_back(fixedColumnNames[i], std::move(val), ts);
+    }
+
+    for (auto & c: sparseColumns) {
+        const ColumnPath & columnName = c.first.path();
+        if (!columnsRead.count(columnName[0]))
+            continue;
+        CellValue val = c.second->get(index);
+        if (val.empty())
+            continue;
+        result.emplace_back(columnName, std::move(val), ts);
+    }
+    return std::move(result);
+}
+
+Date
+TabularDatasetChunk::
+getRowEmbedding(size_t index,
+                const std::vector<size_t> & columnIndexes,
+                const std::vector<ColumnPath> & columnNames,
+                double * values) const
+{
+    ExcAssertLess(index, rowCount());
+    ExcAssertEqual(columnIndexes.size(), columnNames.size());
+    for (size_t i = 0;  i < columnNames.size();  ++i) {
+        const FrozenColumn * col = maybeGetColumn(columnIndexes[i],
+                                                  columnNames[i]);
+        CellValue val;
+        if (col)
+            val = col->get(index);
+        values[i] = val.empty()
+            ? std::numeric_limits<double>::quiet_NaN()
+            : val.toDouble();
+    }
+    return timestamps->get(index).mustCoerceToTimestamp();
+}
+
+void
+TabularDatasetChunk::
+calcTimestampRange()
+{
+    Date earliest = Date::positiveInfinity();
+    Date latest = Date::negativeInfinity();
+
+    // Timestamps are stored as seconds since the epoch, so it's enough to
+    // look at the distinct values
+    auto onValue = [&] (const CellValue & v)
+        {
+            Date ts = v.mustCoerceToTimestamp();
+            earliest.setMin(ts);
+            latest.setMax(ts);
+            return true;
+        };
+
+    if (timestamps)
+        timestamps->forEachDistinctValue(onValue);
+
+    if (earliest <= latest) {
+        earliestTs = earliest;
+        latestTs = latest;
+    }
+    else earliestTs = latestTs = Date::notADate();
+}
+
+Date
+TabularDatasetChunk::
+getRowTimestamp(size_t index) const
+{
+    return timestamps->get(index).mustCoerceToTimestamp();
+}
+
 void
 TabularDatasetChunk::
 addToColumn(int columnIndex,
@@ -166,7 +524,8 @@ addToColumn(int columnIndex,
     if (columnIndex < columns.size())
         col = columns[columnIndex].get();
     else {
-        auto it = sparseColumns.find(colName);
+        ColumnId id = ColumnNameDictionary::instance().find(colName);
+        auto it = id ? sparseColumns.find(id) : sparseColumns.end();
         if (it == sparseColumns.end()) {
             if (dense) {
                 for (unsigned i = 0;  i < rowCount();  ++i) {
@@ -190,6 +549,297 @@ addToColumn(int columnIndex,
     }
 }
 
+namespace {
+
+/* Version 2 chunks store each column in its own section, prefixed by its
+   length, so that a reader can skip the columns it doesn't need.  The
+   length has a fixed width so that the section can be written to a buffer
+   first, at the same alignment (modulo 8) that the frozen blocks within it
+   will have in the file.
+*/
+
+void serializeSection(ML::DB::Store_Writer & store,
+                      const std::function<void (ML::DB::Store_Writer &)> & write)
+{
+    static const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    size_t pad = (store.offset() + sizeof(uint64_t)) % 8;
+
+    std::ostringstream buffer;
+    {
+        ML::DB::Store_Writer sectionStore(buffer);
+        sectionStore.save_binary(padding, pad);
+        write(sectionStore);
+    }
+
+    std::string data = buffer.str();
+    uint64_t length = data.size() - pad;
+    store.save_binary(&length, sizeof(length));
+    store.save_binary(data.data() + pad, length);
+}
+
+uint64_t reconstituteSectionLength(ML::DB::Store_Reader & store)
+{
+    uint64_t length;
+    store.load_binary(&length, sizeof(length));
+    return length;
+}
+
+/* Allow the columns of a chunk that's held in memory to be made cold.
+   Chunks read from a mapped file are left alone, as their pages are
+   already released by the kernel when they are cold.
+*/
+void makeTiered(TabularDatasetChunk & chunk)
+{
+    for (auto & c: chunk.columns)
+        c = makeTieredFrozenColumn(std::move(c));
+    for (auto & c: chunk.sparseColumns)
+        c.second = makeTieredFrozenColumn(std::move(c.second));
+    chunk.timestamps = makeTieredFrozenColumn(std::move(chunk.timestamps));
+}
+
+} // file scope
+
+void
+TabularDatasetChunk::
+serialize(ML::DB::Store_Writer & store) const
+{
+    // Version 1 adds the zone maps; version 2 puts all of the zone maps
+    // first and each column in its own section
+    unsigned char version = 2;
+    store << version;
+
+    store << ML::DB::compact_size_t(columns.size());
+    for (auto & z: columnZoneMaps)
+        z.serialize(store);
+
+    // Fix the order of the sparse columns, as it's the order of their
+    // sections
+    std::vector<ColumnId> sparseOrder;
+    sparseOrder.reserve(sparseColumns.size());
+    store << ML::DB::compact_size_t(sparseColumns.size());
+    for (auto & c: sparseColumns) {
+        sparseOrder.push_back(c.first);
+        store << c.first.path().toUtf8String();
+        sparseColumnZoneMaps.at(c.first).serialize(store);
+    }
+
+    for (auto & c: columns) {
+        serializeSection(store, [&] (ML::DB::Store_Writer & store)
+                         {
+                             FrozenColumn::serializeColumn(*c, store);
+                         });
+    }
+
+    for (auto & id: sparseOrder) {
+        serializeSection(store, [&] (ML::DB::Store_Writer & store)
+                         {
+                             FrozenColumn::serializeColumn
+                                 (*sparseColumns.at(id), store);
+                         });
+    }
+
+    serializeSection(store, [&] (ML::DB::Store_Writer & store)
+        {
+            store << ML::DB::compact_size_t(rowNames.size());
+            RowPath storage;
+            for (size_t i = 0;  i < rowNames.size();  ++i)
+                store << rowNames.get(i, storage).toUtf8String();
+
+            store << ML::DB::compact_size_t(integerRowNames.size());
+            for (auto & r: integerRowNames)
+                store << r;
+
+            FrozenColumn::serializeColumn(*timestamps, store);
+        });
+}
+
+TabularDatasetChunk
+TabularDatasetChunk::
+reconstitute(ML::DB::Store_Reader & store,
+             const std::shared_ptr<const void> & mapping)
+{
+    TabularDatasetChunk result;
+    bool read = reconstitute(store, mapping, TabularChunkFilter(), result);
+    ExcAssert(read);
+    return result;
+}
+
+bool
+TabularDatasetChunk::
+reconstitute(ML::DB::Store_Reader & store,
+             const std::shared_ptr<const void> & mapping,
+             const TabularChunkFilter & filter,
+             TabularDatasetChunk & result)
+{
+    unsigned char version;
+    store >> version;
+    if (version > 2)
+        throw HttpReturnException(500, "Unknown tabular dataset chunk version "
+                                  + std::to_string((int)version));
+
+    auto readColumn = [&] (size_t i)
+        {
+            return filter.readColumn.empty() || filter.readColumn.at(i);
+        };
+
+    auto readSparseColumn = [&] (ColumnId id)
+        {
+            return !filter.readSparseColumn || filter.readSparseColumn(id.path());
+        };
+
+    if (version < 2) {
+        // Older chunks can't be read piecewise, so they are read in full
+        // and then filtered
+        result = reconstituteUnsectioned(store, mapping, version);
+        if (filter.readChunk && !filter.readChunk(result))
+            return false;
+
+        for (size_t i = 0;  i < result.columns.size();  ++i) {
+            if (!readColumn(i))
+                result.columns[i].reset();
+        }
+        for (auto it = result.sparseColumns.begin();
+             it != result.sparseColumns.end();) {
+            if (readSparseColumn(it->first))
+                ++it;
+            else it = result.sparseColumns.erase(it);
+        }
+        if (!mapping)
+            makeTiered(result);
+        return true;
+    }
+
+    ML::DB::compact_size_t numColumns(store);
+    result = TabularDatasetChunk(numColumns);
+    for (auto & z: result.columnZoneMaps)
+        z.reconstitute(store);
+
+    ML::DB::compact_size_t numSparseColumns(store);
+    std::vector<ColumnId> sparseOrder;
+    sparseOrder.reserve(numSparseColumns);
+    result.sparseColumnZoneMaps.reserve(numSparseColumns);
+    for (size_t i = 0;  i < numSparseColumns;  ++i) {
+        Utf8String name;
+        store >> name;
+        ColumnId columnName
+            = ColumnNameDictionary::instance().intern(Path::parse(name));
+        sparseOrder.push_back(columnName);
+        result.sparseColumnZoneMaps[columnName].reconstitute(store);
+    }
+
+    bool skipChunk = filter.readChunk && !filter.readChunk(result);
+
+    for (size_t i = 0;  i < numColumns;  ++i) {
+        uint64_t length = reconstituteSectionLength(store);
+        if (skipChunk || !readColumn(i))
+            store.skip(length);
+        else result.columns[i] = FrozenColumn::reconstitute(store, mapping);
+    }
+
+    result.sparseColumns.reserve(numSparseColumns);
+    for (auto & id: sparseOrder) {
+        uint64_t length = reconstituteSectionLength(store);
+        if (skipChunk || !readSparseColumn(id))
+            store.skip(length);
+        else result.sparseColumns[id]
+                 = FrozenColumn::reconstitute(store, mapping);
+    }
+
+    uint64_t length = reconstituteSectionLength(store);
+    if (skipChunk) {
+        store.skip(length);
+        return false;
+    }
+
+    ML::DB::compact_size_t numRowNames(store);
+    std::vector<Path> rowNames;
+    rowNames.reserve(numRowNames);
+    for (size_t i = 0;  i < numRowNames;  ++i) {
+        Utf8String name;
+        store >> name;
+        rowNames.emplace_back(Path::parse(name));
+    }
+    result.rowNames = FrozenRowNames(rowNames);
+
+    ML::DB::compact_size_t numIntegerRowNames(store);
+    result.integerRowNames.resize(numIntegerRowNames);
+    for (auto & r: result.integerRowNames)
+        store >> r;
+
+    result.timestamps = FrozenColumn::reconstitute(store, mapping);
+    result.calcTimestampRange();
+
+    if (!mapping)
+        makeTiered(result);
+
+    return true;
+}
+
+TabularDatasetChunk
+TabularDatasetChunk::
+reconstituteUnsectioned(ML::DB::Store_Reader & store,
+                        const std::shared_ptr<const void> & mapping,
+                        int version)
+{
+    bool hasZoneMaps = version >= 1;
+    ML::DB::compact_size_t numColumns(store);
+    TabularDatasetChunk result(numColumns);
+    for (size_t i = 0;  i < numColumns;  ++i) {
+        result.columns[i] = FrozenColumn::reconstitute(store, mapping);
+        if (hasZoneMaps)
+            result.columnZoneMaps[i].reconstitute(store);
+    }
+
+    ML::DB::compact_size_t numSparseColumns(store);
+    result.sparseColumns.reserve(numSparseColumns);
+    result.sparseColumnZoneMaps.reserve(numSparseColumns);
+    for (size_t i = 0;  i < numSparseColumns;  ++i) {
+        Utf8String name;
+        store >> name;
+        ColumnId columnName
+            = ColumnNameDictionary::instance().intern(Path::parse(name));
+        result.sparseColumns[columnName]
+            = FrozenColumn::reconstitute(store, mapping);
+        if (hasZoneMaps)
+            result.sparseColumnZoneMaps[columnName].reconstitute(store);
+    }
+
+    ML::DB::compact_size_t numRowNames(store);
+    std::vector<Path> rowNames;
+    rowNames.reserve(numRowNames);
+    for (size_t i = 0;  i < numRowNames;  ++i) {
+        Utf8String name;
+        store >> name;
+        rowNames.emplace_back(Path::parse(name));
+    }
+    result.rowNames = FrozenRowNames(rowNames);
+
+    ML::DB::compact_size_t numIntegerRowNames(store);
+    result.integerRowNames.resize(numIntegerRowNames);
+    for (auto & r: result.integerRowNames)
+        store >> r;
+
+    result.timestamps = FrozenColumn::reconstitute(store, mapping);
+    result.calcTimestampRange();
+
+    // Chunks written before zone maps existed get them recomputed from
+    // their columns
+    if (!hasZoneMaps) {
+        for (size_t i = 0;  i < numColumns;  ++i) {
+            result.columnZoneMaps[i]
+                = ColumnZoneMap::fromFrozenColumn(*result.columns[i],
+                                                  result.rowCount());
+        }
+        for (auto & c: result.sparseColumns) {
+            result.sparseColumnZoneMaps[c.first]
+                = ColumnZoneMap::fromFrozenColumn(*c.second,
+                                                  result.rowCount());
+        }
+    }
+
+    return result;
+}
+
 
 /*****************************************************************************/
 /* MUTABLE TABULAR DATASET CHUNK                                             */
@@ -215,20 +865,32 @@ freeze(const ColumnFreezeParameters & params)
 
     ExcAssert(!isFrozen);
 
-    TabularDatasetChunk result;
-    result.columns.resize(columns.size());
+    TabularDatasetChunk result(columns.size());
     result.sparseColumns.reserve(sparseColumns.size());
+    result.sparseColumnZoneMaps.reserve(sparseColumns.size());
 
-    for (unsigned i = 0;  i < columns.size();  ++i)
+    // The zone maps are taken before freezing, while the distinct values
+    // are still directly accessible
+    for (unsigned i = 0;  i < columns.size();  ++i) {
+        result.columnZoneMaps[i]
+            = ColumnZoneMap::fromColumn(columns[i], rowCount_);
         result.columns[i] = columns[i].freeze(params);
-    for (auto & c: sparseColumns)
+    }
+    for (auto & c: sparseColumns) {
+        result.sparseColumnZoneMaps.emplace
+            (c.first, ColumnZoneMap::fromColumn(c.second, rowCount_));
         result.sparseColumns.emplace(c.first, c.second.freeze(params));
+    }
 
     result.timestamps = timestamps.freeze(params);
+    result.calcTimestampRange();
 
-    result.rowNames = std::move(rowNames);
+    result.rowNames = FrozenRowNames(rowNames);
+    std::vector<Path>().swap(rowNames);
     result.integerRowNames = std::move(integerRowNames);
 
+    makeTiered(result);
+
     isFrozen = true;
 
     return result;
@@ -281,8 +943,8 @@ add(RowPath & rowName,
     }
 
     for (auto & e: extra) {
-        auto it = sparseColumns.emplace(std::move(e.first), TabularDatasetColumn()).first;
-        it->second.add(numRows, std::move(e.second));
+        ColumnId id = ColumnNameDictionary::instance().intern(e.first);
+        sparseColumns[id].add(numRows, std::move(e.second));
     }
 
     ++rowCount_;
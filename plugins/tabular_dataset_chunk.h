@@ -8,9 +8,13 @@
 #pragma once
 
 #include <unordered_map>
+#include <functional>
+#include <set>
 #include "frozen_column.h"
 #include "mldb/sql/path.h"
+#include "mldb/sql/column_name_dictionary.h"
 #include "mldb/types/date.h"
+#include "mldb/utils/flat_hash_map.h"
 #include "tabular_dataset_column.h"
 #include <mutex>
 
@@ -20,11 +24,138 @@ namespace MLDB {
 struct PathElement;
 struct Path;
 struct ExpressionValue;
+struct ColumnPredicate;
+
+
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+/** Summary of the values of one column within one chunk, computed when the
+    chunk is frozen.  This allows a whole chunk to be skipped when a
+    predicate can't match anything between its minimum and maximum value.
+*/
+
+struct ColumnZoneMap {
+    ColumnZoneMap()
+        : numNulls(0), numDistinct(0)
+    {
+    }
+
+    /// Summarize a column that is about to be frozen
+    static ColumnZoneMap fromColumn(const TabularDatasetColumn & column,
+                                    size_t rowCount);
+
+    /// Summarize an already frozen column, for chunks saved without maps
+    static ColumnZoneMap fromFrozenColumn(const FrozenColumn & column,
+                                          size_t rowCount);
+
+    CellValue minValue;    ///< Minimum non-null value; null if all are null
+    CellValue maxValue;    ///< Maximum non-null value; null if all are null
+    uint64_t numNulls;     ///< Number of rows where the column is null
+    uint64_t numDistinct;  ///< Number of distinct non-null values
+
+    /** Could the predicate match any row within the chunk?  If this returns
+        false, the chunk can be skipped.
+    */
+    bool mayMatch(const ColumnPredicate & predicate) const;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+};
+
+
+/*****************************************************************************/
+/* FROZEN ROW NAMES                                                          */
+/*****************************************************************************/
+
+/** Row names of a chunk, front coded.  The names are sorted and split into
+    blocks of BLOCK_SIZE; within a block each name is stored as the length
+    of the prefix it shares with the one before followed by the rest of
+    it, so that names with common prefixes (URLs, keys with a common
+    namespace) are stored once.  Decoding a name reads at most one block.
+*/
+
+struct FrozenRowNames {
+    FrozenRowNames()
+        : numNames(0)
+    {
+    }
+
+    FrozenRowNames(const std::vector<Path> & names);
+
+    static constexpr size_t BLOCK_SIZE = 16;
+
+    size_t size() const
+    {
+        return numNames;
+    }
+
+    bool empty() const
+    {
+        return numNames == 0;
+    }
+
+    /// Return an owned copy of the name of the given row
+    Path get(size_t index) const;
+
+    /** Decode the name of the given row into storage, returning it.  This
+        doesn't allocate unless the name is too long to be stored inline
+        within the path.
+    */
+    const Path & get(size_t index, Path & storage) const;
+
+    size_t memusage() const;
+
+    void swap(FrozenRowNames & other) noexcept
+    {
+        std::swap(numNames, other.numNames);
+        sortedPosition.swap(other.sortedPosition);
+        blockOffsets.swap(other.blockOffsets);
+        data.swap(other.data);
+    }
+
+private:
+    size_t numNames;
+
+    /// Position of each row's name in sorted order
+    std::vector<uint32_t> sortedPosition;
+
+    /// Offset within data of the start of each block
+    std::vector<uint32_t> blockOffsets;
+
+    /// Encoded blocks
+    std::string data;
+};
+
 
 /*****************************************************************************/
 /* TABULAR DATASET CHUNK                                                     */
 /*****************************************************************************/
 
+struct TabularDatasetChunk;
+
+/** Selects which parts of a serialized chunk are read by
+    TabularDatasetChunk::reconstitute(), so that a reader that only needs
+    some of the columns, or only some of the chunks, doesn't need to
+    reconstitute the rest.
+*/
+
+struct TabularChunkFilter {
+    /// Which dense columns, by index, to read; all of them if empty
+    std::vector<bool> readColumn;
+
+    /// Which sparse columns to read; all of them if null
+    std::function<bool (const Path & columnName)> readSparseColumn;
+
+    /** Called before the columns of the chunk are read.  Only its zone
+        maps can be relied upon to be set.  Returning false skips the
+        chunk.
+    */
+    std::function<bool (const TabularDatasetChunk & chunk)> readChunk;
+};
+
+
 /** This represents a frozen chunk of a dataset: a fixed number of rows,
     each named, with a set of columns (either dense or sparse) attached.
 */
@@ -32,7 +163,8 @@ struct ExpressionValue;
 struct TabularDatasetChunk {
 
     TabularDatasetChunk(size_t numColumns = 0)
-        : columns(numColumns)
+        : columns(numColumns), columnZoneMaps(numColumns),
+          earliestTs(Date::notADate()), latestTs(Date::notADate())
     {
     }
 
@@ -51,9 +183,31 @@ struct TabularDatasetChunk {
     {
         columns.swap(other.columns);
         sparseColumns.swap(other.sparseColumns);
+        columnZoneMaps.swap(other.columnZoneMaps);
+        sparseColumnZoneMaps.swap(other.sparseColumnZoneMaps);
         rowNames.swap(other.rowNames);
         integerRowNames.swap(other.integerRowNames);
         std::swap(timestamps, other.timestamps);
+        std::swap(earliestTs, other.earliestTs);
+        std::swap(latestTs, other.latestTs);
+    }
+
+    /** Return a chunk with the same rows as this one, which shares its
+        frozen columns rather than copying them.
+    */
+    TabularDatasetChunk share() const
+    {
+        TabularDatasetChunk result;
+        result.columns = columns;
+        result.sparseColumns = sparseColumns;
+        result.columnZoneMaps = columnZoneMaps;
+        result.sparseColumnZoneMaps = sparseColumnZoneMaps;
+        result.rowNames = rowNames;
+        result.integerRowNames = integerRowNames;
+        result.timestamps = timestamps;
+        result.earliestTs = earliestTs;
+        result.latestTs = latestTs;
+        return result;
     }
 
     size_t rowCount() const
@@ -63,6 +217,9 @@ struct TabularDatasetChunk {
 
     size_t memusage() const;
 
+    /// Part of memusage() taken by the row names
+    size_t rowNamesMemusage() const;
+
     const FrozenColumn *
     maybeGetColumn(size_t columnIndex, const PathElement & columnName) const;
 
@@ -76,13 +233,39 @@ struct TabularDatasetChunk {
     maybeGetColumn(size_t columnIndex, const Path & columnName) const;
 
     std::vector<std::shared_ptr<FrozenColumn> > columns;
-    std::unordered_map<Path, std::shared_ptr<FrozenColumn>, PathNewHasher> sparseColumns;
+
+    /// Sparse columns, keyed by their interned name so that the name is
+    /// stored once per process rather than once per chunk
+    FlatHashMap<ColumnId, std::shared_ptr<FrozenColumn>, ColumnIdHasher> sparseColumns;
+
+    /// Zone map of each column, in the same order as columns
+    std::vector<ColumnZoneMap> columnZoneMaps;
+
+    /// Zone map of each sparse column
+    FlatHashMap<ColumnId, ColumnZoneMap, ColumnIdHasher> sparseColumnZoneMaps;
+
+    /** Return the zone map for the given column, or null if the column
+        isn't present in this chunk.
+    */
+    const ColumnZoneMap *
+    maybeGetZoneMap(size_t columnIndex, const Path & columnName) const;
+
 private:
-    std::vector<Path> rowNames;
+    FrozenRowNames rowNames;
     std::vector<uint64_t> integerRowNames;
 public:
     std::shared_ptr<FrozenColumn> timestamps;
 
+    /// Earliest and latest timestamp of the rows of the chunk, or
+    /// notADate() if it has none
+    Date earliestTs, latestTs;
+
+    /// Set earliestTs and latestTs from the timestamps column
+    void calcTimestampRange();
+
+    /// Return the timestamp of the row with the given index
+    Date getRowTimestamp(size_t index) const;
+
     /// Get the row with the given index
     std::vector<std::tuple<ColumnPath, CellValue, Date> >
     getRow(size_t index, const std::vector<Path> & fixedColumnNames) const;
@@ -91,11 +274,62 @@ public:
     ExpressionValue
     getRowExpr(size_t index, const std::vector<Path> & fixedColumnNames) const;
 
+    /** Get the row with the given index, with only the fixed columns whose
+        indexes are in fixedColumnsRead and the sparse columns whose name
+        starts with an element of columnsRead.  See
+        Dataset::getProjectedRowExpr().
+    */
+    ExpressionValue
+    getProjectedRowExpr(size_t index, const std::vector<Path> & fixedColumnNames,
+                        const std::vector<size_t> & fixedColumnsRead,
+                        const std::set<PathElement> & columnsRead) const;
+
+    /** Write the values of the given columns of the row with the given
+        index into values as numbers, leaving NaN for nulls, and return the
+        row's timestamp.  Columns are given by their index and name, as for
+        maybeGetColumn().
+    */
+    Date getRowEmbedding(size_t index,
+                         const std::vector<size_t> & columnIndexes,
+                         const std::vector<Path> & columnNames,
+                         double * values) const;
+
     /// Add the given column to the column with the given index
     void addToColumn(int columnIndex,
                      const Path & colName,
                      std::vector<std::tuple<Path, CellValue, Date> > & rows,
                      bool dense) const;
+
+    /// Serialize the chunk, including all of its frozen columns
+    void serialize(ML::DB::Store_Writer & store) const;
+
+    /** Reconstitute a chunk written by serialize().  See
+        FrozenColumn::reconstitute() for the meaning of mapping.
+    */
+    static TabularDatasetChunk
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping);
+
+    /** Reconstitute the parts of a chunk written by serialize() that pass
+        the filter into result.  Dense columns that aren't read are left
+        null, and sparse columns that aren't read are left out.  Returns
+        false if the filter skipped the whole chunk.  Either way, the store
+        is left at the end of the chunk.
+    */
+    static bool
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping,
+                 const TabularChunkFilter & filter,
+                 TabularDatasetChunk & result);
+
+private:
+    /// Reconstitute a chunk written before columns had their own sections
+    static TabularDatasetChunk
+    reconstituteUnsectioned(ML::DB::Store_Reader & store,
+                            const std::shared_ptr<const void> & mapping,
+                            int version);
+public:
+
     friend class MutableTabularDatasetChunk;
 };
 
@@ -132,8 +366,8 @@ struct MutableTabularDatasetChunk {
 
     bool isFrozen;
 
-    /// Set of sparse columns
-    std::unordered_map<Path, TabularDatasetColumn> sparseColumns;
+    /// Set of sparse columns, keyed by interned name
+    FlatHashMap<ColumnId, TabularDatasetColumn, ColumnIdHasher> sparseColumns;
 
     /// One per row, or empty if all are simple integers
     std::vector<Path> rowNames;
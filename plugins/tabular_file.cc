@@ -0,0 +1,187 @@
+/** tabular_file.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Columnar file format made of frozen tabular dataset chunks.
+*/
+
+#include "tabular_file.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/any_impl.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+static constexpr const char * FILE_MAGIC = "MLDB Tabular Dataset";
+static constexpr int FILE_VERSION = 0;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* TABULAR FILE WRITER                                                       */
+/*****************************************************************************/
+
+TabularFileWriter::
+TabularFileWriter(const Url & dataFileUrl,
+                  const std::vector<ColumnPath> & columnNames,
+                  Date earliestTs, Date latestTs,
+                  size_t numChunks)
+    : dataFileUrl(dataFileUrl), numChunks(numChunks), chunksWritten(0),
+      stream(new filter_ostream(dataFileUrl)),
+      output(stream.get()),
+      store(new ML::DB::Store_Writer(*output))
+{
+    writeHeader(columnNames, earliestTs, latestTs);
+}
+
+TabularFileWriter::
+TabularFileWriter(std::ostream & stream,
+                  const std::vector<ColumnPath> & columnNames,
+                  Date earliestTs, Date latestTs,
+                  size_t numChunks)
+    : numChunks(numChunks), chunksWritten(0),
+      output(&stream),
+      store(new ML::DB::Store_Writer(*output))
+{
+    writeHeader(columnNames, earliestTs, latestTs);
+}
+
+TabularFileWriter::
+~TabularFileWriter()
+{
+}
+
+void
+TabularFileWriter::
+writeChunk(const TabularDatasetChunk & chunk)
+{
+    ExcAssertLess(chunksWritten, numChunks);
+    chunk.serialize(*store);
+    ++chunksWritten;
+}
+
+void
+TabularFileWriter::
+close()
+{
+    if (chunksWritten != numChunks) {
+        throw HttpReturnException
+            (500, "Tabular file closed before all of its chunks were written",
+             "dataFileUrl", dataFileUrl,
+             "numChunks", numChunks,
+             "chunksWritten", chunksWritten);
+    }
+    store.reset();
+    if (stream)
+        stream->close();
+    else output->flush();
+}
+
+void
+TabularFileWriter::
+writeHeader(const std::vector<ColumnPath> & columnNames,
+            Date earliestTs, Date latestTs)
+{
+    *store << std::string(FILE_MAGIC) << FILE_VERSION;
+    *store << ML::DB::compact_size_t(columnNames.size());
+    for (auto & c: columnNames)
+        *store << c.toUtf8String();
+    *store << earliestTs << latestTs;
+    *store << ML::DB::compact_size_t(numChunks);
+}
+
+
+/*****************************************************************************/
+/* TABULAR FILE READER                                                       */
+/*****************************************************************************/
+
+TabularFileReader::
+TabularFileReader(const Url & dataFileUrl)
+    : dataFileUrl(dataFileUrl), numChunks(0), chunksRead_(0)
+{
+    stream = std::make_shared<filter_istream>
+        (dataFileUrl, std::map<std::string, std::string>
+         { { "mapped", "true" } });
+
+    const char * mappedData;
+    size_t mappedLength;
+    std::tie(mappedData, mappedLength) = stream->mapped();
+
+    if (mappedData) {
+        mapping = std::shared_ptr<const void>(stream, mappedData);
+        store.reset(new ML::DB::Store_Reader(mappedData, mappedLength));
+    }
+    else {
+        store.reset(new ML::DB::Store_Reader(*stream));
+    }
+
+    std::string magic;
+    int version;
+    *store >> magic >> version;
+    if (magic != FILE_MAGIC) {
+        throw HttpReturnException
+            (400, "File is not a tabular dataset file",
+             "dataFileUrl", dataFileUrl);
+    }
+    if (version != FILE_VERSION) {
+        throw HttpReturnException
+            (400, "Unknown tabular dataset file version",
+             "dataFileUrl", dataFileUrl,
+             "version", version);
+    }
+
+    ML::DB::compact_size_t numColumns(*store);
+    columnNames.reserve(numColumns);
+    for (size_t i = 0;  i < numColumns;  ++i) {
+        Utf8String name;
+        *store >> name;
+        columnNames.emplace_back(ColumnPath::parse(name));
+    }
+
+    *store >> earliestTs >> latestTs;
+
+    numChunks = ML::DB::compact_size_t(*store);
+}
+
+TabularFileReader::
+~TabularFileReader()
+{
+}
+
+TabularDatasetChunk
+TabularFileReader::
+readChunk()
+{
+    TabularDatasetChunk result;
+    bool read = readChunk(TabularChunkFilter(), result);
+    ExcAssert(read);
+    return result;
+}
+
+bool
+TabularFileReader::
+readChunk(const TabularChunkFilter & filter,
+          TabularDatasetChunk & chunk)
+{
+    if (chunksRead_ >= numChunks) {
+        throw HttpReturnException
+            (500, "Attempt to read past the last chunk of a tabular file",
+             "dataFileUrl", dataFileUrl,
+             "numChunks", numChunks);
+    }
+    ++chunksRead_;
+    return TabularDatasetChunk::reconstitute(*store, mapping, filter, chunk);
+}
+
+} // namespace MLDB
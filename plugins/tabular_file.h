@@ -0,0 +1,112 @@
+/** tabular_file.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Columnar file format made of frozen tabular dataset chunks.
+*/
+
+#pragma once
+
+#include "tabular_dataset_chunk.h"
+#include "mldb/types/url.h"
+#include "mldb/jml/db/persistent_fwd.h"
+#include <memory>
+#include <iosfwd>
+
+
+namespace MLDB {
+
+class filter_istream;
+class filter_ostream;
+
+
+/*****************************************************************************/
+/* TABULAR FILE                                                              */
+/*****************************************************************************/
+
+/** A tabular file holds the column names and timestamp range of a set of
+    rows, followed by the rows themselves as a sequence of serialized
+    TabularDatasetChunks.  Each chunk is a row group: its columns are
+    stored one after the other with their zone maps up front, so that a
+    reader can skip the columns it doesn't need and the chunks whose zone
+    maps show that they can't match.
+
+    The frozen column storage is written so that it can be used directly
+    from a memory mapped file.
+*/
+
+struct TabularFileWriter {
+    /** Open the file and write its header.  Exactly numChunks chunks must
+        then be written before the file is closed.
+    */
+    TabularFileWriter(const Url & dataFileUrl,
+                      const std::vector<ColumnPath> & columnNames,
+                      Date earliestTs, Date latestTs,
+                      size_t numChunks);
+
+    /** Write the file to the given stream, for example to send it to
+        another server, instead of opening it.  The stream must outlive the
+        writer.
+    */
+    TabularFileWriter(std::ostream & stream,
+                      const std::vector<ColumnPath> & columnNames,
+                      Date earliestTs, Date latestTs,
+                      size_t numChunks);
+
+    ~TabularFileWriter();
+
+    void writeChunk(const TabularDatasetChunk & chunk);
+
+    void close();
+
+private:
+    void writeHeader(const std::vector<ColumnPath> & columnNames,
+                     Date earliestTs, Date latestTs);
+
+    Url dataFileUrl;
+    size_t numChunks;
+    size_t chunksWritten;
+    std::unique_ptr<filter_ostream> stream;  ///< Null if writing to a stream
+    std::ostream * output;
+    std::unique_ptr<ML::DB::Store_Writer> store;
+};
+
+struct TabularFileReader {
+    /** Open the file and read its header.  If the file can be memory
+        mapped, the frozen columns of the chunks that are read point
+        directly into the mapping, which stays alive for as long as any of
+        them is referenced.
+    */
+    TabularFileReader(const Url & dataFileUrl);
+
+    ~TabularFileReader();
+
+    Url dataFileUrl;
+    std::vector<ColumnPath> columnNames;
+    Date earliestTs;
+    Date latestTs;
+    size_t numChunks;
+
+    /// Is the file being read from a memory mapping?
+    bool isMapped() const { return !!mapping; }
+
+    /// Number of chunks read or skipped so far
+    size_t chunksRead() const { return chunksRead_; }
+
+    /// Read the next chunk in full
+    TabularDatasetChunk readChunk();
+
+    /** Read the parts of the next chunk that pass the filter; see
+        TabularDatasetChunk::reconstitute().  Returns false if the chunk was
+        skipped.
+    */
+    bool readChunk(const TabularChunkFilter & filter,
+                   TabularDatasetChunk & chunk);
+
+private:
+    std::shared_ptr<filter_istream> stream;
+    std::shared_ptr<const void> mapping;
+    std::unique_ptr<ML::DB::Store_Reader> store;
+    size_t chunksRead_;
+};
+
+} // namespace MLDB
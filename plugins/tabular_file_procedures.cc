@@ -0,0 +1,420 @@
+/** tabular_file_procedures.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Procedures to export to and import from the columnar tabular file
+    format.
+*/
+
+#include "tabular_file_procedures.h"
+#include "tabular_file.h"
+#include "tabular_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/server/bound_queries.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/plugins/sql_config_validator.h"
+#include <unordered_set>
+#include <thread>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* TABULAR EXPORT PROCEDURE                                                  */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(TabularExportProcedureConfig);
+
+TabularExportProcedureConfigDescription::
+TabularExportProcedureConfigDescription()
+{
+    addField("exportData", &TabularExportProcedureConfig::exportData,
+             "An SQL query to select the data to be exported.  This could "
+             "be any query on an existing dataset.");
+    addField("dataFileUrl", &TabularExportProcedureConfig::dataFileUrl,
+             "URL where the tabular file should be written to.  If a file "
+             "already exists, it will be overwritten.");
+
+    addParent<ProcedureConfig>();
+
+    onPostValidate = [&] (TabularExportProcedureConfig * cfg,
+                          JsonParsingContext & context)
+    {
+        MustContainFrom()(cfg->exportData, TabularExportProcedureConfig::name);
+    };
+}
+
+TabularExportProcedure::
+TabularExportProcedure(MldbServer * owner,
+                       PolyConfig config,
+                       const std::function<bool (const Json::Value &)> & onProgress)
+    : Procedure(owner)
+{
+    procedureConfig = config.params.convert<TabularExportProcedureConfig>();
+}
+
+RunOutput
+TabularExportProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
+    SqlExpressionMldbScope context(server);
+
+    // The rows are frozen into a tabular dataset that isn't registered
+    // with the server, and which is then saved in its own format
+    TabularDatasetConfig tabularConfig;
+    tabularConfig.unknownColumns = UC_ADD;
+    PolyConfig datasetConfig;
+    datasetConfig.type = "tabular";
+    datasetConfig.params = tabularConfig;
+    auto dataset = std::make_shared<TabularDataset>(server, datasetConfig,
+                                                    onProgress);
+
+    auto boundDataset = runProcConf.exportData.stm->from->bind(context);
+
+    vector<shared_ptr<SqlExpression> > calc;
+    BoundSelectQuery bsq(runProcConf.exportData.stm->select,
+                         *boundDataset.dataset,
+                         boundDataset.asName,
+                         runProcConf.exportData.stm->when,
+                         *runProcConf.exportData.stm->where,
+                         runProcConf.exportData.stm->orderBy,
+                         calc);
+
+    std::atomic<uint64_t> rowCount(0);
+    auto recordRow = [&] (NamedRowValue & row_,
+                          const vector<ExpressionValue> & calc)
+        {
+            MatrixNamedRow row = row_.flattenDestructive();
+            dataset->recordRow(row.rowName, row.columns);
+            ++rowCount;
+            return true;
+        };
+
+    bsq.execute({recordRow, true /*processInParallel*/},
+                runProcConf.exportData.stm->offset,
+                runProcConf.exportData.stm->limit,
+                onProgress);
+
+    dataset->commit();
+    dataset->save(runProcConf.dataFileUrl);
+
+    Json::Value result;
+    result["rowCount"] = (int64_t)rowCount;
+    return RunOutput(result);
+}
+
+Any
+TabularExportProcedure::
+getStatus() const
+{
+    return Any();
+}
+
+
+/*****************************************************************************/
+/* TABULAR IMPORT PROCEDURE                                                  */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(TabularImportProcedureConfig);
+
+TabularImportProcedureConfigDescription::
+TabularImportProcedureConfigDescription()
+{
+    addField("dataFileUrl", &TabularImportProcedureConfig::dataFileUrl,
+             "URL of the tabular file to import, as written by the "
+             "export.tabular procedure or a tabular dataset's "
+             "`dataFileUrl`.  It may contain the wildcards '*', '?' and "
+             "'[...]' in its path, in which case all matching files are "
+             "imported.");
+    addField("outputDataset", &TabularImportProcedureConfig::outputDataset,
+             "Dataset to record the data into.",
+             PolyConfigT<Dataset>().withType("tabular"));
+    addField("columns", &TabularImportProcedureConfig::columns,
+             "Columns to import.  Only these columns are read from the "
+             "file.  If empty, all columns are imported.");
+    addField("where", &TabularImportProcedureConfig::where,
+             "Only rows matching this expression are imported.  It must be "
+             "`true` or a conjunction (with `AND`) of comparisons of a "
+             "column against a constant, `IN` tests against a list of "
+             "constants or `BETWEEN` tests.  Chunks of rows whose "
+             "statistics show that they can't match are skipped without "
+             "being read.",
+             SqlExpression::TRUE);
+    addParent<ProcedureConfig>();
+}
+
+namespace {
+
+/** Split a where expression into the column predicates it is a
+    conjunction of.  Anything else can't be used to skip chunks, and so
+    is rejected.
+*/
+void extractPredicates(const SqlExpression & where,
+                       std::vector<ColumnPredicate> & predicates)
+{
+    if (where.isConstantTrue())
+        return;
+
+    auto boolean = dynamic_cast<const BooleanOperatorExpression *>(&where);
+    if (boolean && boolean->op == "AND" && boolean->lhs && boolean->rhs) {
+        extractPredicates(*boolean->lhs, predicates);
+        extractPredicates(*boolean->rhs, predicates);
+        return;
+    }
+
+    ColumnPredicate predicate;
+    if (!extractColumnPredicate(Utf8String(), where, predicate)) {
+        throw HttpReturnException
+            (400, "The where clause of import.tabular must be a conjunction "
+             "of comparisons of columns against constants",
+             "where", where.print());
+    }
+    predicates.emplace_back(std::move(predicate));
+}
+
+} // file scope
+
+TabularImportProcedure::
+TabularImportProcedure(MldbServer * owner,
+                       PolyConfig config,
+                       const std::function<bool (const Json::Value &)> & onProgress)
+    : Procedure(owner)
+{
+    procedureConfig = config.params.convert<TabularImportProcedureConfig>();
+}
+
+RunOutput
+TabularImportProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
+
+    std::vector<ColumnPredicate> predicates;
+    extractPredicates(*runProcConf.where, predicates);
+
+    std::unordered_set<ColumnPath> outputColumns(runProcConf.columns.begin(),
+                                                 runProcConf.columns.end());
+    std::unordered_set<ColumnPath> predicateColumns;
+    for (auto & p: predicates)
+        predicateColumns.insert(p.columnName);
+
+    auto isOutputColumn = [&] (const ColumnPath & columnName)
+        {
+            return outputColumns.empty() || outputColumns.count(columnName);
+        };
+
+    auto isColumnRead = [&] (const ColumnPath & columnName)
+        {
+            return isOutputColumn(columnName)
+                || predicateColumns.count(columnName);
+        };
+
+    // A URL with wildcards imports all of the files it matches
+    vector<string> files;
+    string pattern = runProcConf.dataFileUrl.toDecodedString();
+    if (uriHasWildcards(pattern)) {
+        forEachUriObjectMatching
+            (pattern,
+             [&] (const std::string & uri, const FsObjectInfo &,
+                  const OpenUriObject &, int)
+             {
+                 files.push_back(uri);
+                 return true;
+             });
+        if (files.empty())
+            throw HttpReturnException(400, "No files match dataFileUrl",
+                                      "dataFileUrl", pattern);
+        std::sort(files.begin(), files.end());
+    }
+    else {
+        files.push_back(pattern);
+    }
+
+    auto outputDataset = createDataset(server, runProcConf.outputDataset,
+                                       onProgress, true /* overwrite */);
+    Dataset::MultiChunkRecorder recorder = outputDataset->getChunkRecorder();
+
+    std::atomic<uint64_t> rowCount(0);
+    uint64_t chunksRead = 0, chunksSkipped = 0;
+    size_t chunkNumber = 0;
+
+    std::atomic<int> hasExc(0);
+    std::exception_ptr exc;
+
+    ThreadPool tp;
+
+    // Chunks are read in order, but converted into rows in parallel.  The
+    // number waiting for conversion is bounded to bound the memory used.
+    const uint64_t maxChunksInFlight = 2 * tp.numThreads() + 1;
+
+    for (auto & file: files) {
+        TabularFileReader reader{Url(file)};
+
+        std::vector<size_t> predicateIndexes;
+        for (auto & p: predicates) {
+            auto it = std::find(reader.columnNames.begin(),
+                                reader.columnNames.end(),
+                                p.columnName);
+            predicateIndexes.push_back(it - reader.columnNames.begin());
+        }
+
+        TabularChunkFilter filter;
+        for (auto & c: reader.columnNames)
+            filter.readColumn.push_back(isColumnRead(c));
+        filter.readSparseColumn = isColumnRead;
+        filter.readChunk = [&] (const TabularDatasetChunk & chunk)
+            {
+                for (size_t i = 0;  i < predicates.size();  ++i) {
+                    // A column missing from the chunk is all nulls, which
+                    // never match
+                    const ColumnZoneMap * zoneMap
+                        = chunk.maybeGetZoneMap(predicateIndexes[i],
+                                                predicates[i].columnName);
+                    if (!zoneMap || !zoneMap->mayMatch(predicates[i]))
+                        return false;
+                }
+                return true;
+            };
+
+        std::vector<bool> isOutput;
+        for (auto & c: reader.columnNames)
+            isOutput.push_back(isOutputColumn(c));
+        auto columnNames = std::make_shared<std::vector<ColumnPath> >
+            (reader.columnNames);
+
+        for (size_t i = 0;  i < reader.numChunks && !hasExc;  ++i) {
+            auto chunk = std::make_shared<TabularDatasetChunk>();
+            if (!reader.readChunk(filter, *chunk)) {
+                ++chunksSkipped;
+                continue;
+            }
+            ++chunksRead;
+
+            auto processChunk = [=, &recorder, &rowCount, &predicates,
+                                 &isOutputColumn, &hasExc, &exc] ()
+                {
+                    try {
+                        // Resolve the columns once for the whole chunk
+                        std::vector<const FrozenColumn *> predicateColumns;
+                        for (size_t i = 0;  i < predicates.size();  ++i) {
+                            predicateColumns.push_back
+                                (chunk->maybeGetColumn
+                                 (predicateIndexes[i],
+                                  predicates[i].columnName));
+                        }
+
+                        std::vector<std::pair<ColumnPath, const FrozenColumn *> >
+                            columns;
+                        for (size_t i = 0;  i < chunk->columns.size();  ++i) {
+                            if (isOutput[i] && chunk->columns[i])
+                                columns.emplace_back((*columnNames)[i],
+                                                     chunk->columns[i].get());
+                        }
+                        for (auto & c: chunk->sparseColumns) {
+                            if (isOutputColumn(c.first.path()))
+                                columns.emplace_back(c.first.path(),
+                                                     c.second.get());
+                        }
+
+                        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
+                        rows.reserve(chunk->rowCount());
+
+                        for (size_t i = 0;  i < chunk->rowCount();  ++i) {
+                            bool matches = true;
+                            for (size_t j = 0;  j < predicates.size() && matches;  ++j) {
+                                matches = predicateColumns[j]
+                                    && predicates[j].matches
+                                           (predicateColumns[j]->get(i));
+                            }
+                            if (!matches)
+                                continue;
+
+                            Date ts = chunk->timestamps->get(i)
+                                .mustCoerceToTimestamp();
+
+                            std::vector<std::tuple<ColumnPath, CellValue, Date> > vals;
+                            vals.reserve(columns.size());
+                            for (auto & c: columns) {
+                                CellValue val = c.second->get(i);
+                                if (val.empty())
+                                    continue;
+                                vals.emplace_back(c.first, std::move(val), ts);
+                            }
+
+                            rows.emplace_back(chunk->getRowPath(i),
+                                              std::move(vals));
+                        }
+
+                        rowCount += rows.size();
+
+                        auto chunkRecorder = recorder.newChunk(chunkNumber);
+                        chunkRecorder->recordRowsDestructive(std::move(rows));
+                        chunkRecorder->finishedChunk();
+                    } MLDB_CATCH_ALL {
+                        if (hasExc.fetch_add(1) == 0)
+                            exc = std::current_exception();
+                    }
+                };
+
+            while (tp.jobsSubmitted() - tp.jobsFinished()
+                   >= maxChunksInFlight) {
+                tp.work();
+                std::this_thread::yield();
+            }
+
+            tp.add(std::move(processChunk));
+            ++chunkNumber;
+        }
+    }
+
+    tp.waitForAll();
+
+    if (hasExc)
+        std::rethrow_exception(exc);
+
+    recorder.commit();
+
+    Json::Value result;
+    result["rowCount"] = (int64_t)rowCount;
+    result["chunksRead"] = (int64_t)chunksRead;
+    result["chunksSkipped"] = (int64_t)chunksSkipped;
+    return RunOutput(result);
+}
+
+Any
+TabularImportProcedure::
+getStatus() const
+{
+    return Any();
+}
+
+
+namespace {
+
+RegisterProcedureType<TabularExportProcedure, TabularExportProcedureConfig>
+regTabularExport(builtinPackage(),
+                 "Exports the result of a query to a columnar tabular file",
+                 "procedures/TabularExportProcedure.md.html");
+
+RegisterProcedureType<TabularImportProcedure, TabularImportProcedureConfig>
+regTabularImport(builtinPackage(),
+                 "Imports a columnar tabular file, reading only the columns "
+                 "and chunks that are needed",
+                 "procedures/TabularImportProcedure.md.html");
+
+} // file scope
+
+} // namespace MLDB
@@ -0,0 +1,87 @@
+/** tabular_file_procedures.h                                      -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Procedures to export to and import from the columnar tabular file
+    format.
+*/
+
+#pragma once
+
+#include "mldb/core/procedure.h"
+#include "mldb/core/dataset.h"
+#include "mldb/sql/sql_expression.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* TABULAR EXPORT PROCEDURE                                                  */
+/*****************************************************************************/
+
+struct TabularExportProcedureConfig : ProcedureConfig {
+    static constexpr const char * name = "export.tabular";
+
+    InputQuery exportData;
+    Url dataFileUrl;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(TabularExportProcedureConfig);
+
+
+struct TabularExportProcedure: public Procedure {
+
+    TabularExportProcedure(
+        MldbServer * owner,
+        PolyConfig config,
+        const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual RunOutput run(
+        const ProcedureRunConfig & run,
+        const std::function<bool (const Json::Value &)> & onProgress) const;
+
+    virtual Any getStatus() const;
+
+    TabularExportProcedureConfig procedureConfig;
+};
+
+
+/*****************************************************************************/
+/* TABULAR IMPORT PROCEDURE                                                  */
+/*****************************************************************************/
+
+struct TabularImportProcedureConfig : ProcedureConfig {
+    static constexpr const char * name = "import.tabular";
+
+    TabularImportProcedureConfig()
+        : where(SqlExpression::TRUE)
+    {
+        outputDataset.withType("tabular");
+    }
+
+    Url dataFileUrl;
+    PolyConfigT<Dataset> outputDataset;
+    std::vector<ColumnPath> columns;
+    std::shared_ptr<SqlExpression> where;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(TabularImportProcedureConfig);
+
+
+struct TabularImportProcedure: public Procedure {
+
+    TabularImportProcedure(
+        MldbServer * owner,
+        PolyConfig config,
+        const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual RunOutput run(
+        const ProcedureRunConfig & run,
+        const std::function<bool (const Json::Value &)> & onProgress) const;
+
+    virtual Any getStatus() const;
+
+    TabularImportProcedureConfig procedureConfig;
+};
+
+} // namespace MLDB
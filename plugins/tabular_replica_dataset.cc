@@ -0,0 +1,439 @@
+/** tabular_replica_dataset.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Read-only copy of a tabular dataset on another MLDB server, which follows
+    its commits.
+*/
+
+#include "tabular_replica_dataset.h"
+#include "tabular_dataset.h"
+#include "mldb/arch/rcu_protected.h"
+#include "mldb/arch/timers.h"
+#include "mldb/http/http_rest_proxy.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/rest/rest_request_router.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/utils/log.h"
+#include <condition_variable>
+#include <thread>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* TABULAR REPLICA DATASET CONFIG                                            */
+/*****************************************************************************/
+
+TabularReplicaDatasetConfig::
+TabularReplicaDatasetConfig()
+    : pollInterval("1s")
+{
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(TabularReplicaDatasetConfig);
+
+TabularReplicaDatasetConfigDescription::
+TabularReplicaDatasetConfigDescription()
+{
+    addField("primary", &TabularReplicaDatasetConfig::primary,
+             "URI of the tabular dataset to copy, of the form "
+             "http://host:port/v1/datasets/<id>.");
+    addField("dataFileUrl", &TabularReplicaDatasetConfig::dataFileUrl,
+             "Prefix of the files that the copies of the primary are "
+             "written to.  The instance and generation of the primary are "
+             "appended to it for each copy, and the file of the previous copy is removed "
+             "once it has been replaced.  Local files are memory mapped.");
+    addField("pollInterval", &TabularReplicaDatasetConfig::pollInterval,
+             "How often to check whether the primary has been committed "
+             "since it was last copied.  A period of 0s means only copying "
+             "it on creation and on a POST to the sync route.",
+             TimePeriod("1s"));
+}
+
+
+/*****************************************************************************/
+/* TABULAR REPLICA DATASET                                                   */
+/*****************************************************************************/
+
+struct TabularReplicaDataset::Itl {
+    Itl(MldbServer * server, const TabularReplicaDatasetConfig & config)
+        : server(server), config(config), current(gcLock), shutdown(false),
+          logger(MLDB::getMldbLog<TabularReplicaDataset>())
+    {
+        if (config.dataFileUrl.empty())
+            throw HttpReturnException(400, "Tabular replica dataset needs a "
+                                      "dataFileUrl to copy the primary to");
+
+        const std::string & str = config.primary.rawString();
+        auto pos = str.find("/v1/datasets/");
+        if (str.find("://") == string::npos
+            || pos == string::npos
+            || pos + 13 == str.size()
+            || str.find('/', pos + 13) != string::npos)
+            throw HttpReturnException
+                (400, "Primary URI must be of the form "
+                 "http://host:port/v1/datasets/<id>",
+                 "primary", config.primary);
+        datasetResource = str.substr(pos);
+        proxy.reset(new HttpRestProxy(str.substr(0, pos)));
+
+        sync();
+
+        if (config.pollInterval.interval > 0)
+            pollThread = std::thread([this] () { this->runPoll(); });
+    }
+
+    ~Itl()
+    {
+        {
+            std::unique_lock<std::mutex> guard(pollMutex);
+            shutdown = true;
+        }
+        pollCondition.notify_all();
+        if (pollThread.joinable())
+            pollThread.join();
+    }
+
+    MldbServer * server;
+    TabularReplicaDatasetConfig config;
+
+    /// /v1/datasets/<id> of the primary, and connections to its server
+    std::string datasetResource;
+    std::unique_ptr<HttpRestProxy> proxy;
+
+    struct Current {
+        std::shared_ptr<Dataset> dataset;  ///< Loaded copy of the primary
+        uint64_t generation = 0;           ///< Generation of the primary
+        uint64_t instance = 0;             ///< Instance of the primary
+        Url dataFileUrl;                   ///< File holding the copy
+    };
+
+    GcLock gcLock;
+    RcuProtected<Current> current;
+
+    /// Only one copy is taken at a time
+    std::mutex syncMutex;
+
+    // The polling is done on its own thread, as a copy can take a while
+    std::thread pollThread;
+    std::mutex pollMutex;
+    std::condition_variable pollCondition;
+    bool shutdown;
+
+    shared_ptr<spdlog::logger> logger;
+
+    std::shared_ptr<Dataset> getDataset() const
+    {
+        auto myCurrent = current();
+        return myCurrent->dataset;
+    }
+
+    /** Return the generation and instance of the primary; see
+        TabularDataset::handleRequest().
+    */
+    std::pair<uint64_t, uint64_t> getPrimaryGeneration() const
+    {
+        auto response = proxy->get(datasetResource + "/routes/replication",
+                                   {}, {}, -1 /* timeout */,
+                                   false /* exceptions */);
+        if (response.code() != 200)
+            throw HttpReturnException
+                (response.code() ? response.code() : 502,
+                 "Couldn't get the generation of the primary of a tabular "
+                 "replica dataset",
+                 "primary", config.primary,
+                 "response", response.body());
+        auto body = response.jsonBody();
+        return { body["generation"].asUInt(), body["instance"].asUInt() };
+    }
+
+    /** Copy the primary if it has been committed since the last copy.
+        Returns true if a new copy was swapped in.
+    */
+    bool sync()
+    {
+        std::unique_lock<std::mutex> guard(syncMutex);
+
+        Url oldFile;
+        std::pair<uint64_t, uint64_t> oldGeneration;
+        {
+            auto myCurrent = current();
+            if (myCurrent->dataset) {
+                oldFile = myCurrent->dataFileUrl;
+                oldGeneration = { myCurrent->generation, myCurrent->instance };
+            }
+        }
+
+        if (!oldFile.empty() && getPrimaryGeneration() == oldGeneration)
+            return false;
+
+        Timer copyTimer;
+
+        // The generation copied is the one in the headers of the response,
+        // as the primary may have been committed again since we asked
+        std::unique_ptr<Current> newCurrent(new Current());
+        std::unique_ptr<filter_ostream> stream;
+        std::string error;
+        size_t bytes = 0;
+
+        auto onHeader = [&] (const HttpHeader & header)
+            {
+                if (header.responseCode() != 200)
+                    return true;
+                try {
+                    newCurrent->generation
+                        = std::stoull(header.getHeader("x-mldb-generation"));
+                    newCurrent->instance
+                        = std::stoull(header.getHeader("x-mldb-instance"));
+                    newCurrent->dataFileUrl
+                        = Url(config.dataFileUrl.toString() + "."
+                              + std::to_string(newCurrent->instance) + "."
+                              + std::to_string(newCurrent->generation));
+                    stream.reset(new filter_ostream(newCurrent->dataFileUrl));
+                } MLDB_CATCH_ALL {
+                    error = getExceptionString();
+                    return false;
+                }
+                return true;
+            };
+
+        auto onData = [&] (const std::string & data)
+            {
+                if (!stream) {
+                    error += data;
+                    return true;
+                }
+                try {
+                    stream->write(data.data(), data.size());
+                    bytes += data.size();
+                } MLDB_CATCH_ALL {
+                    error = getExceptionString();
+                    return false;
+                }
+                return true;
+            };
+
+        try {
+            auto response
+                = proxy->get(datasetResource + "/routes/replication/data",
+                             {}, {}, -1 /* timeout */, false /* exceptions */,
+                             onData, onHeader);
+            if (response.code() == 200 && stream && error.empty())
+                stream->close();
+            else if (error.empty())
+                error = "HTTP code " + std::to_string(response.code());
+        } MLDB_CATCH_ALL {
+            error = getExceptionString();
+        }
+
+        if (!error.empty()) {
+            stream.reset();
+            if (!newCurrent->dataFileUrl.empty())
+                tryEraseUriObject(newCurrent->dataFileUrl.toString());
+            throw HttpReturnException
+                (502, "Couldn't copy the primary of a tabular replica "
+                 "dataset",
+                 "primary", config.primary,
+                 "error", error);
+        }
+
+        // Load the copy, which memory maps it if it's a local file
+        PolyConfig tabularConfig;
+        tabularConfig.type = "tabular";
+        TabularDatasetConfig tabularParams;
+        tabularParams.dataFileUrl = newCurrent->dataFileUrl;
+        tabularConfig.params = tabularParams;
+        newCurrent->dataset
+            = std::make_shared<TabularDataset>(server, tabularConfig, nullptr);
+
+        INFO_MSG(logger) << "copied generation " << newCurrent->generation
+                         << " of " << config.primary << " (" << bytes
+                         << " bytes) in " << copyTimer.elapsed();
+
+        current.replace(newCurrent.release());
+
+        // Queries that are still running on the old copy keep its mapping,
+        // so this only removes its name
+        if (!oldFile.empty())
+            tryEraseUriObject(oldFile.toString());
+
+        return true;
+    }
+
+    void runPoll()
+    {
+        std::unique_lock<std::mutex> guard(pollMutex);
+        while (!shutdown) {
+            pollCondition.wait_for
+                (guard, std::chrono::duration<double>(config.pollInterval.interval));
+            if (shutdown)
+                break;
+
+            guard.unlock();
+            try {
+                sync();
+            } MLDB_CATCH_ALL {
+                // Keep serving the last copy; we'll try again next time
+                ERROR_MSG(logger) << "error copying primary "
+                                  << config.primary << ": "
+                                  << getExceptionString();
+            }
+            guard.lock();
+        }
+    }
+};
+
+TabularReplicaDataset::
+TabularReplicaDataset(MldbServer * owner,
+                      PolyConfig config,
+                      const std::function<bool (const Json::Value &)> & onProgress)
+    : Dataset(owner)
+{
+    itl.reset(new Itl(server,
+                      config.params.convert<TabularReplicaDatasetConfig>()));
+}
+
+TabularReplicaDataset::
+~TabularReplicaDataset()
+{
+}
+
+Any
+TabularReplicaDataset::
+getStatus() const
+{
+    auto myCurrent = itl->current();
+    Json::Value status = jsonEncode(myCurrent->dataset->getStatus());
+    status["primary"] = itl->config.primary;
+    status["generation"] = myCurrent->generation;
+    return status;
+}
+
+uint64_t
+TabularReplicaDataset::
+getGeneration() const
+{
+    auto myCurrent = itl->current();
+    return myCurrent->generation;
+}
+
+RestRequestMatchResult
+TabularReplicaDataset::
+handleRequest(RestConnection & connection,
+              const RestRequest & request,
+              RestRequestParsingContext & context) const
+{
+    if (context.remaining == "/sync" && request.verb == "POST") {
+        Json::Value result;
+        result["copied"] = itl->sync();
+        result["generation"] = getGeneration();
+        connection.sendResponse(200, result);
+        return RestRequestRouter::MR_YES;
+    }
+
+    return Dataset::handleRequest(connection, request, context);
+}
+
+std::shared_ptr<MatrixView>
+TabularReplicaDataset::
+getMatrixView() const
+{
+    return itl->getDataset()->getMatrixView();
+}
+
+std::shared_ptr<ColumnIndex>
+TabularReplicaDataset::
+getColumnIndex() const
+{
+    return itl->getDataset()->getColumnIndex();
+}
+
+std::shared_ptr<RowStream>
+TabularReplicaDataset::
+getRowStream() const
+{
+    return itl->getDataset()->getRowStream();
+}
+
+ExpressionValue
+TabularReplicaDataset::
+getRowExpr(const RowPath & row) const
+{
+    return itl->getDataset()->getRowExpr(row);
+}
+
+std::function<ExpressionValue (const RowPath & row)>
+TabularReplicaDataset::
+getProjectedRowExpr(const std::vector<ColumnPath> & columns) const
+{
+    return itl->getDataset()->getProjectedRowExpr(columns);
+}
+
+std::pair<Date, Date>
+TabularReplicaDataset::
+getTimestampRange() const
+{
+    return itl->getDataset()->getTimestampRange();
+}
+
+std::pair<Date, Date>
+TabularReplicaDataset::
+getRowTimestampRange(const RowPath & row) const
+{
+    return itl->getDataset()->getRowTimestampRange(row);
+}
+
+KnownColumn
+TabularReplicaDataset::
+getKnownColumnInfo(const ColumnPath & columnName) const
+{
+    return itl->getDataset()->getKnownColumnInfo(columnName);
+}
+
+GenerateRowsWhereFunction
+TabularReplicaDataset::
+generateRowsWhere(const SqlBindingScope & context,
+                  const Utf8String& alias,
+                  const SqlExpression & where,
+                  ssize_t offset,
+                  ssize_t limit) const
+{
+    auto dataset = itl->getDataset();
+    GenerateRowsWhereFunction fn
+        = dataset->generateRowsWhere(context, alias, where, offset, limit);
+
+    // The copy must stay alive for as long as its rows are generated, even
+    // if a newer one is swapped in
+    if (fn.exec) {
+        auto exec = std::move(fn.exec);
+        fn.exec = [dataset, exec] (ssize_t numToGenerate, Any token,
+                                   const BoundParameters & params,
+                                   std::function<bool (const Json::Value &)> onProgress)
+            {
+                return exec(numToGenerate, std::move(token), params,
+                            std::move(onProgress));
+            };
+    }
+    return fn;
+}
+
+namespace {
+
+RegisterDatasetType<TabularReplicaDataset, TabularReplicaDatasetConfig>
+regTabularReplica(builtinPackage(),
+                  "tabular.replica",
+                  "Read-only copy of a tabular dataset on another server",
+                  "datasets/TabularReplicaDataset.md.html");
+
+} // file scope
+
+} // namespace MLDB
@@ -0,0 +1,94 @@
+/** tabular_replica_dataset.h                                      -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Read-only copy of a tabular dataset on another MLDB server, which follows
+    its commits.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/types/url.h"
+#include "mldb/types/periodic_utils.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* TABULAR REPLICA DATASET CONFIG                                            */
+/*****************************************************************************/
+
+struct TabularReplicaDatasetConfig {
+    TabularReplicaDatasetConfig();
+
+    /// URI of the tabular dataset to copy, as http://host:port/v1/datasets/<id>
+    Utf8String primary;
+
+    /// Prefix of the local files that the copies are written to
+    Url dataFileUrl;
+
+    /// How often to check if the primary has been committed
+    TimePeriod pollInterval;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(TabularReplicaDatasetConfig);
+
+
+/*****************************************************************************/
+/* TABULAR REPLICA DATASET                                                   */
+/*****************************************************************************/
+
+/** Dataset holding a copy of the committed contents of a tabular dataset,
+    normally on another server.  The frozen chunks of the primary are
+    downloaded to a local file in the format of TabularFileWriter, which is
+    then memory mapped.  The primary is polled for its generation, and a new
+    copy is taken and swapped in each time it has been committed.
+*/
+
+struct TabularReplicaDataset: public Dataset {
+
+    TabularReplicaDataset(MldbServer * owner,
+                          PolyConfig config,
+                          const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual ~TabularReplicaDataset() override;
+
+    virtual Any getStatus() const override;
+
+    /** Returns the generation of the primary that is copied. */
+    virtual uint64_t getGeneration() const override;
+
+    /** A POST to routes/sync copies the primary straight away if it has
+        been committed since the last copy.
+    */
+    virtual RestRequestMatchResult
+    handleRequest(RestConnection & connection,
+                  const RestRequest & request,
+                  RestRequestParsingContext & context) const override;
+
+    virtual std::shared_ptr<MatrixView> getMatrixView() const override;
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const override;
+    virtual std::shared_ptr<RowStream> getRowStream() const override;
+    virtual ExpressionValue getRowExpr(const RowPath & row) const override;
+    virtual std::function<ExpressionValue (const RowPath & row)>
+    getProjectedRowExpr(const std::vector<ColumnPath> & columns) const override;
+    virtual std::pair<Date, Date> getTimestampRange() const override;
+    virtual std::pair<Date, Date>
+    getRowTimestampRange(const RowPath & row) const override;
+    virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const override;
+
+    virtual GenerateRowsWhereFunction
+    generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String& alias,
+                      const SqlExpression & where,
+                      ssize_t offset,
+                      ssize_t limit) const override;
+
+private:
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
@@ -25,15 +25,27 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/plugins/sql_config_validator.h"
+#include "mldb/server/per_thread_accumulator.h"
 #include "mldb/utils/log.h"
+#include "mldb/utils/flat_hash_map.h"
+#include <algorithm>
 
 using namespace std;
 
 namespace {
+
+typedef MLDB::TfidfFunction::TermTable TermTable;
+
+bool termLess(const std::pair<MLDB::Utf8String, uint64_t> & t1,
+              const std::pair<MLDB::Utf8String, uint64_t> & t2)
+{
+    return t1.first < t2.first;
+}
+
 void
 serialize(ML::DB::Store_Writer & store,
           uint64_t corpusSize,
-          const std::unordered_map<MLDB::Utf8String, uint64_t> & dfs)
+          const TermTable & dfs)
 {
     std::string name = "tfidf";
     int version = 0;
@@ -49,7 +61,7 @@ serialize(ML::DB::Store_Writer & store,
 void
 reconstitute(ML::DB::Store_Reader & store,
              uint64_t & corpusSize,
-             std::unordered_map<MLDB::Utf8String, uint64_t> & dfs)
+             TermTable & dfs)
 {
     std::string name;
     store >> name;
@@ -72,14 +84,18 @@ reconstitute(ML::DB::Store_Reader & store,
         uint64_t df;
         store >> term;
         store >> df;
-        dfs[term] = df;
+        dfs.emplace_back(std::move(term), df);
     }
+
+    // Files written before the terms were saved in order need sorting
+    if (!std::is_sorted(dfs.begin(), dfs.end(), termLess))
+        std::sort(dfs.begin(), dfs.end(), termLess);
 }
 
 void
 save(const std::string & filename,
      uint64_t corpusSize,
-     const std::unordered_map<MLDB::Utf8String, uint64_t> & dfs)
+     const TermTable & dfs)
 {
     MLDB::filter_ostream stream(filename);
     ML::DB::Store_Writer store(stream);
@@ -89,7 +105,7 @@ save(const std::string & filename,
 void
 load(const std::string & filename,
      uint64_t & corpusSize,
-     std::unordered_map<MLDB::Utf8String, uint64_t> & dfs)
+     TermTable & dfs)
 {
     MLDB::filter_istream stream(filename);
     ML::DB::Store_Reader store(stream);
@@ -153,6 +169,11 @@ TfidfConfigDescription()
              "If specified, an instance of the ![](%%doclink tfidf function) of this name will be created using "
              "the trained model. Note that to use this parameter, the `modelFileUrl` must "
              "also be provided.");
+    addField("minDocumentFrequency", &TfidfConfig::minDocumentFrequency,
+             "Terms that appear in fewer documents than this are left out of "
+             "the model file and the output dataset.  The tf-idf function "
+             "gives them a document frequency of zero.  The default keeps "
+             "every term.", (uint64_t)1);
     addParent<ProcedureConfig>();
 
     onPostValidate = chain(validateQuery(&TfidfConfig::trainingData,
@@ -197,16 +218,34 @@ run(const ProcedureRunConfig & run,
 
     auto boundDataset = runProcConf.trainingData.stm->from->bind(context);
 
-    //This will cummulate the number of documents each word is in
-    std::unordered_map<Utf8String, uint64_t> dfs;
+    // Each thread accumulates the number of documents each term is in
+    // into its own map, keyed on the column path, so that there is no
+    // locking and no conversion of the term to a string per occurrence.
+    // The maps are merged once the whole dataset has been seen.
+    typedef FlatHashMap<ColumnPath, uint64_t, PathNewHasher> TermCounts;
+    PerThreadAccumulator<TermCounts> accum;
     std::atomic<uint64_t> corpusSize(0);
 
     auto processor = [&] (NamedRowValue & row_)
         {
-            MatrixNamedRow row = row_.flattenDestructive();
-            for (auto& col : row.columns) {
-                Utf8String word = get<0>(col).toUtf8String();
-                dfs[word] += 1;
+            TermCounts & counts = accum.get();
+            for (auto & col: row_.columns) {
+                const PathElement & name = std::get<0>(col);
+                const ExpressionValue & val = std::get<1>(col);
+                if (val.empty() || val.isAtom()) {
+                    counts[ColumnPath(name)] += 1;
+                    continue;
+                }
+
+                auto onAtom = [&] (const ColumnPath & columnName,
+                                   const ColumnPath & prefix,
+                                   const CellValue & val,
+                                   Date ts)
+                    {
+                        counts[prefix + columnName] += 1;
+                        return true;
+                    };
+                val.forEachAtom(onAtom, ColumnPath(name));
             }
             ++corpusSize;
 
@@ -216,12 +255,34 @@ run(const ProcedureRunConfig & run,
     iterateDataset(runProcConf.trainingData.stm->select, *boundDataset.dataset, boundDataset.asName,
                    runProcConf.trainingData.stm->when,
                    *runProcConf.trainingData.stm->where,
-                   {processor,false/*processInParallel*/},
+                   {processor,true/*processInParallel*/},
                    runProcConf.trainingData.stm->orderBy,
                    runProcConf.trainingData.stm->offset,
                    runProcConf.trainingData.stm->limit,
                    onProgress);
 
+    // Merge into the largest of the per-thread maps, which avoids
+    // rehashing most of the terms
+    TermCounts merged;
+    accum.forEach([&] (TermCounts * counts)
+                  {
+                      if (counts->size() > merged.size())
+                          merged.swap(*counts);
+                      for (auto & c: *counts)
+                          merged[c.first] += c.second;
+                      counts->clear();
+                  });
+
+    TermTable dfs;
+    dfs.reserve(merged.size());
+    for (auto & c: merged) {
+        if (c.second < runProcConf.minDocumentFrequency)
+            continue;
+        dfs.emplace_back(c.first.toUtf8String(), c.second);
+    }
+    merged = TermCounts();
+    std::sort(dfs.begin(), dfs.end(), termLess);
+
     bool saved = false;
     if (!runProcConf.modelFileUrl.empty()) {
         try {
@@ -341,9 +402,7 @@ apply(const FunctionApplier & applier,
             Utf8String term = name.toUtf8String();
             uint64_t value = val.getAtom().toUInt();
             maxFrequency = std::max(value, maxFrequency);
-            const auto termFrequency = dfs.find(term);
-            if (termFrequency != dfs.end())
-                maxNt = std::max(maxNt, termFrequency->second); 
+            maxNt = std::max(maxNt, getDocumentFrequency(term));
             return true;
         };
 
@@ -425,8 +484,7 @@ apply(const FunctionApplier & applier,
             double frequency = val.getAtom().toDouble();
 
             double tf = tf_fct(frequency);
-            const auto docFrequency = dfs.find(term);
-            uint64_t docFrequencyInt = docFrequency != dfs.end() ? docFrequency->second : 0;
+            uint64_t docFrequencyInt = getDocumentFrequency(term);
             double idf = idf_fct(docFrequencyInt);
 
             DEBUG_MSG(logger)
@@ -445,6 +503,18 @@ apply(const FunctionApplier & applier,
     return std::move(outputRow);
 }
 
+uint64_t
+TfidfFunction::
+getDocumentFrequency(const Utf8String & term) const
+{
+    auto it = std::lower_bound(dfs.begin(), dfs.end(),
+                               std::make_pair(term, (uint64_t)0),
+                               termLess);
+    if (it == dfs.end() || it->first != term)
+        return 0;
+    return it->second;
+}
+
 FunctionInfo
 TfidfFunction::
 getFunctionInfo() const
@@ -40,12 +40,18 @@ DECLARE_ENUM_DESCRIPTION(IDFType);
 struct TfidfConfig : public ProcedureConfig {
     static constexpr const char * name = "tfidf.train";
 
+    TfidfConfig()
+        : minDocumentFrequency(1)
+    {
+    }
+
     InputQuery trainingData;
     Url modelFileUrl;
     Optional<PolyConfigT<Dataset> > output;
     static constexpr char const * defaultOutputDatasetType = "sparse.mutable";
 
     Utf8String functionName;
+    uint64_t minDocumentFrequency;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(TfidfConfig);
@@ -102,9 +108,17 @@ struct TfidfFunction: public Function {
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 
+    /** Return the number of documents of the corpus containing the term,
+        or zero if it's not in the model.
+    */
+    uint64_t getDocumentFrequency(const Utf8String & term) const;
+
+    /// Terms and their document frequencies, sorted by term
+    typedef std::vector<std::pair<Utf8String, uint64_t> > TermTable;
+
     TfidfFunctionConfig functionConfig;
     // document frequencies for terms
-    std::unordered_map<Utf8String, uint64_t> dfs;
+    TermTable dfs;
     uint64_t corpusSize;
 };
 
@@ -0,0 +1,546 @@
+/** tiered_frozen_column.cc                                        -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Implementation of frozen columns that leave memory when they are cold.
+*/
+
+#include "tiered_frozen_column.h"
+#include "frozen_memory.h"
+#include "mldb/sql/cell_value.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/ext/lz4/lz4.h"
+#include <condition_variable>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<double> MLDB_TABULAR_COLD_MINUTES
+("MLDB_TABULAR_COLD_MINUTES", 0);
+
+EnvOption<int64_t> MLDB_TABULAR_RESIDENT_BYTES
+("MLDB_TABULAR_RESIDENT_BYTES", 0);
+
+EnvOption<std::string> MLDB_TABULAR_SPILL_DIR
+("MLDB_TABULAR_SPILL_DIR", "");
+
+struct TieredFrozenColumn;
+
+/*****************************************************************************/
+/* TIERED COLUMN MANAGER                                                     */
+/*****************************************************************************/
+
+/** Keeps track of the tiered columns, and makes them cold in a background
+    thread according to the policy.  Accesses are stamped with a coarse
+    clock, in milliseconds, that's advanced by the thread and by each sweep
+    so that columns don't need to read the time on every access.
+*/
+struct TieredColumnManager {
+    TieredColumnManager()
+        : now(0), residentBytes(0), policyBudget(0), threadStarted(false),
+          start(std::chrono::steady_clock::now())
+    {
+        policy.coldSeconds = MLDB_TABULAR_COLD_MINUTES.get() * 60.0;
+        policy.residentBytes = MLDB_TABULAR_RESIDENT_BYTES;
+        policy.spillDirectory = MLDB_TABULAR_SPILL_DIR.get();
+        policyBudget = policy.residentBytes;
+    }
+
+    /// Coarse clock that column accesses are stamped with
+    std::atomic<int64_t> now;
+
+    /// Total memory of the resident columns
+    std::atomic<int64_t> residentBytes;
+
+    /// Copy of policy.residentBytes that can be read without the lock
+    std::atomic<int64_t> policyBudget;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    TieredColumnPolicy policy;
+    std::vector<std::weak_ptr<TieredFrozenColumn> > columns;
+    bool threadStarted;
+    std::chrono::steady_clock::time_point start;
+
+    int64_t tick()
+    {
+        int64_t result
+            = std::chrono::duration_cast<std::chrono::milliseconds>
+            (std::chrono::steady_clock::now() - start).count();
+        now = result;
+        return result;
+    }
+
+    TieredColumnPolicy getPolicy()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        return policy;
+    }
+
+    void setPolicy(const TieredColumnPolicy & newPolicy)
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            policy = newPolicy;
+            policyBudget = policy.residentBytes;
+        }
+        wakeup.notify_all();
+    }
+
+    void add(std::shared_ptr<TieredFrozenColumn> column)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        // Drop the columns that have been destroyed every time the list
+        // doubles, so that it stays proportional to the live ones
+        if (columns.size() == columns.capacity())
+            compact();
+        columns.emplace_back(std::move(column));
+        if (!threadStarted) {
+            std::thread([this] () { run(); }).detach();
+            threadStarted = true;
+        }
+    }
+
+    /// Called after a column was thawed, to enforce the budget promptly
+    void onThawed()
+    {
+        int64_t budget = policyBudget.load(std::memory_order_relaxed);
+        if (budget > 0 && residentBytes > budget)
+            wakeup.notify_all();
+    }
+
+    /// Return the live columns.  Must be called with the lock held.
+    std::vector<std::shared_ptr<TieredFrozenColumn> > live()
+    {
+        compact();
+        std::vector<std::shared_ptr<TieredFrozenColumn> > result;
+        result.reserve(columns.size());
+        for (auto & c: columns) {
+            if (auto p = c.lock())
+                result.emplace_back(std::move(p));
+        }
+        return result;
+    }
+
+    void compact()
+    {
+        columns.erase(std::remove_if(columns.begin(), columns.end(),
+                                     [] (const std::weak_ptr<TieredFrozenColumn> & c)
+                                     { return c.expired(); }),
+                      columns.end());
+    }
+
+    size_t sweep();
+
+    TieredColumnStats stats();
+
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        for (;;) {
+            wakeup.wait_for(guard, std::chrono::seconds(1));
+            guard.unlock();
+            try {
+                sweep();
+            } catch (const std::exception & exc) {
+                cerr << "error making tabular columns cold: " << exc.what()
+                     << endl;
+            }
+            guard.lock();
+        }
+    }
+};
+
+/* The manager is never destroyed, as columns may outlive any static
+   object and its thread runs until the process exits.
+*/
+TieredColumnManager * getManager()
+{
+    static TieredColumnManager * result = new TieredColumnManager();
+    return result;
+}
+
+
+/*****************************************************************************/
+/* TIERED FROZEN COLUMN                                                      */
+/*****************************************************************************/
+
+/** Frozen column that forwards to a resident column, and that can be made
+    cold by keeping only its lz4 compressed serialization, which is read
+    back into a new resident column the next time it's needed.  Frozen
+    columns are immutable, so the compressed form is made only once and
+    kept from then on.
+*/
+struct TieredFrozenColumn: public FrozenColumn {
+    TieredFrozenColumn(std::shared_ptr<FrozenColumn> column,
+                       TieredColumnManager * manager)
+        : manager(manager),
+          resident(std::move(column)),
+          residentBytes_(resident->memusage()),
+          lastAccess(this->manager->now.load()),
+          size_(resident->size()),
+          columnTypes(resident->getColumnTypes()),
+          format_(resident->format()),
+          compressedSize(0), serializedSize(0), spilled(false)
+    {
+        this->manager->residentBytes += residentBytes_;
+    }
+
+    ~TieredFrozenColumn()
+    {
+        if (std::atomic_load(&resident))
+            manager->residentBytes -= residentBytes_;
+    }
+
+    TieredColumnManager * manager;
+
+    /// The column itself, when it's resident
+    mutable std::shared_ptr<const FrozenColumn> resident;
+
+    /// Memory used by the resident column
+    mutable size_t residentBytes_;
+
+    /// Time of the last access, on the manager's clock
+    mutable std::atomic<int64_t> lastAccess;
+
+    size_t size_;
+    ColumnTypes columnTypes;
+    std::string format_;
+
+    /// Protects the transitions between resident and cold
+    mutable std::mutex mutex;
+
+    /// Compressed serialization of the column, once it's been made cold
+    std::shared_ptr<const char> compressed;
+    size_t compressedSize;
+    size_t serializedSize;
+    bool spilled;
+
+    bool isResident() const
+    {
+        return !!std::atomic_load(&resident);
+    }
+
+    void touch() const
+    {
+        int64_t t = manager->now.load(std::memory_order_relaxed);
+        if (lastAccess.load(std::memory_order_relaxed) != t)
+            lastAccess.store(t, std::memory_order_relaxed);
+    }
+
+    /// Return the resident column, thawing it if it's cold
+    std::shared_ptr<const FrozenColumn> pin() const
+    {
+        touch();
+        auto result = std::atomic_load(&resident);
+        if (result)
+            return result;
+        return thaw();
+    }
+
+    std::shared_ptr<const FrozenColumn> thaw() const
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto result = std::atomic_load(&resident);
+        if (result)
+            return result;
+
+        ExcAssert(compressed);
+
+        // The buffer is kept alive by the column, whose frozen blocks point
+        // into it like they would into a mapped file
+        std::shared_ptr<char> buffer
+            = allocateFrozenArray<char>(serializedSize);
+        int res = LZ4_decompress_safe(compressed.get(), buffer.get(),
+                                      compressedSize, serializedSize);
+        if (res != (int)serializedSize)
+            throw MLDB::Exception("error decompressing cold tabular column");
+
+        ML::DB::Store_Reader store(buffer.get(), serializedSize);
+        result = FrozenColumn::reconstitute(store, buffer);
+        residentBytes_ = result->memusage();
+        std::atomic_store(&resident, result);
+        manager->residentBytes += residentBytes_;
+        guard.unlock();
+
+        manager->onThawed();
+        return result;
+    }
+
+    /** Release the resident column, compressing it first if it's the first
+        time.  Returns false if it was already cold.
+    */
+    bool makeCold(const std::string & spillDirectory)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto column = std::atomic_load(&resident);
+        if (!column)
+            return false;
+
+        if (!compressed) {
+            std::ostringstream stream;
+            {
+                ML::DB::Store_Writer store(stream);
+                FrozenColumn::serializeColumn(*column, store);
+            }
+            std::string serialized = stream.str();
+            ExcAssertLess(serialized.size(), (size_t)LZ4_MAX_INPUT_SIZE);
+
+            std::string buffer(LZ4_compressBound(serialized.size()), '\0');
+            int res = LZ4_compress_default(serialized.data(), &buffer[0],
+                                           serialized.size(), buffer.size());
+            if (res <= 0)
+                throw MLDB::Exception("error compressing cold tabular column");
+            buffer.resize(res);
+
+            serializedSize = serialized.size();
+            compressedSize = res;
+            if (spillDirectory.empty()) {
+                auto data = std::make_shared<std::string>(std::move(buffer));
+                data->shrink_to_fit();
+                compressed = std::shared_ptr<const char>(data, data->data());
+            }
+            else {
+                compressed = spill(spillDirectory, buffer);
+                spilled = true;
+            }
+        }
+
+        std::atomic_store(&resident, std::shared_ptr<const FrozenColumn>());
+        manager->residentBytes -= residentBytes_;
+        return true;
+    }
+
+    /** Write the data to an unlinked file in the directory and map it, so
+        that its pages are owned by the kernel rather than by the heap.
+    */
+    static std::shared_ptr<const char>
+    spill(const std::string & directory, const std::string & data)
+    {
+        std::string path = directory + "/mldb-tabular-XXXXXX";
+        int fd = mkstemp(&path[0]);
+        if (fd == -1)
+            throw MLDB::Exception(errno, "creating tabular spill file in "
+                                  + directory);
+        unlink(path.c_str());
+
+        for (size_t done = 0;  done < data.size();) {
+            ssize_t res = ::write(fd, data.data() + done, data.size() - done);
+            if (res == -1) {
+                if (errno == EINTR)
+                    continue;
+                int err = errno;
+                ::close(fd);
+                throw MLDB::Exception(err, "writing tabular spill file");
+            }
+            done += res;
+        }
+
+        void * addr = mmap(nullptr, data.size(), PROT_READ, MAP_SHARED, fd, 0);
+        int err = errno;
+        ::close(fd);
+        if (addr == MAP_FAILED)
+            throw MLDB::Exception(err, "mapping tabular spill file");
+
+        size_t length = data.size();
+        return std::shared_ptr<const char>
+            ((const char *)addr,
+             [length] (const char * p) { munmap((void *)p, length); });
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        return pin()->get(rowIndex);
+    }
+
+    virtual size_t size() const
+    {
+        return size_;
+    }
+
+    virtual size_t memusage() const
+    {
+        if (isResident())
+            return sizeof(*this) + residentBytes_;
+        std::unique_lock<std::mutex> guard(mutex);
+        return sizeof(*this) + (spilled ? 0 : compressedSize);
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return pin()->forEach(onRow);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return pin()->forEachDense(onRow);
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        return pin()->forEachDistinctValue(std::move(fn));
+    }
+
+    virtual bool
+    forEachMatchingRow(const CellValue & value,
+                       const std::function<bool (size_t rowNum)> & onRow) const
+    {
+        return pin()->forEachMatchingRow(value, onRow);
+    }
+
+    virtual bool
+    forEachRowWhere(const std::function<bool (const CellValue &)> & filter,
+                    const std::function<bool (size_t rowNum)> & onRow) const
+    {
+        return pin()->forEachRowWhere(filter, onRow);
+    }
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    virtual void extractNumbers(size_t startRow, size_t numRows,
+                                double * output) const
+    {
+        pin()->extractNumbers(startRow, numRows, output);
+    }
+
+    virtual std::string format() const
+    {
+        return format_;
+    }
+
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        pin()->serialize(store);
+    }
+};
+
+size_t
+TieredColumnManager::
+sweep()
+{
+    std::vector<std::shared_ptr<TieredFrozenColumn> > current;
+    TieredColumnPolicy currentPolicy;
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        current = live();
+        currentPolicy = policy;
+    }
+
+    int64_t t = tick();
+    size_t result = 0;
+
+    if (currentPolicy.coldSeconds > 0) {
+        int64_t coldMs = currentPolicy.coldSeconds * 1000.0;
+        for (auto & c: current) {
+            if (c->isResident() && t - c->lastAccess.load() >= coldMs)
+                result += c->makeCold(currentPolicy.spillDirectory);
+        }
+    }
+
+    int64_t budget = currentPolicy.residentBytes;
+    if (budget > 0 && residentBytes > budget) {
+        // Least recently used first
+        std::vector<std::pair<int64_t, TieredFrozenColumn *> > order;
+        for (auto & c: current) {
+            if (c->isResident())
+                order.emplace_back(c->lastAccess.load(), c.get());
+        }
+        std::sort(order.begin(), order.end());
+        for (auto & c: order) {
+            if (residentBytes <= budget)
+                break;
+            result += c.second->makeCold(currentPolicy.spillDirectory);
+        }
+    }
+
+    return result;
+}
+
+TieredColumnStats
+TieredColumnManager::
+stats()
+{
+    std::vector<std::shared_ptr<TieredFrozenColumn> > current;
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        current = live();
+    }
+
+    TieredColumnStats result;
+    result.numColumns = current.size();
+    for (auto & c: current) {
+        std::unique_lock<std::mutex> guard(c->mutex);
+        if (c->isResident()) {
+            result.numResident += 1;
+            result.residentBytes += c->residentBytes_;
+        }
+        else {
+            result.coldBytes += c->compressedSize;
+            result.numSpilled += c->spilled;
+        }
+    }
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PUBLIC INTERFACE                                                          */
+/*****************************************************************************/
+
+TieredColumnPolicy getTieredColumnPolicy()
+{
+    return getManager()->getPolicy();
+}
+
+void setTieredColumnPolicy(const TieredColumnPolicy & policy)
+{
+    getManager()->setPolicy(policy);
+}
+
+std::shared_ptr<FrozenColumn>
+makeTieredFrozenColumn(std::shared_ptr<FrozenColumn> column)
+{
+    if (!column)
+        return column;
+    auto manager = getManager();
+    if (!manager->getPolicy().enabled())
+        return column;
+    auto result = std::make_shared<TieredFrozenColumn>(std::move(column),
+                                                       manager);
+    manager->add(result);
+    return result;
+}
+
+TieredColumnStats getTieredColumnStats()
+{
+    return getManager()->stats();
+}
+
+size_t sweepTieredColumns()
+{
+    return getManager()->sweep();
+}
+
+} // namespace MLDB
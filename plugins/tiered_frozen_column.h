@@ -0,0 +1,93 @@
+/** tiered_frozen_column.h                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Frozen columns that are compressed, or spilled to disk, when they
+    haven't been used for a while.
+*/
+
+#pragma once
+
+#include "frozen_column.h"
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* TIERED COLUMN POLICY                                                      */
+/*****************************************************************************/
+
+/** Controls when the columns of frozen tabular dataset chunks leave
+    memory.  The defaults come from the MLDB_TABULAR_COLD_MINUTES,
+    MLDB_TABULAR_RESIDENT_BYTES and MLDB_TABULAR_SPILL_DIR environment
+    variables; tiering is disabled unless one of the first two is set.
+*/
+
+struct TieredColumnPolicy {
+    /// Columns not accessed for this long are made cold; 0 means never
+    double coldSeconds = 0;
+
+    /** Budget for the memory of all resident tiered columns.  When it's
+        exceeded, the least recently used columns are made cold until it
+        isn't any more.  0 means no budget.
+    */
+    int64_t residentBytes = 0;
+
+    /** Directory where the compressed form of cold columns is written and
+        then mapped, so that it's paged in and out by the kernel rather
+        than staying in memory.  Empty means cold columns stay compressed
+        in memory.
+    */
+    std::string spillDirectory;
+
+    bool enabled() const
+    {
+        return coldSeconds > 0 || residentBytes > 0;
+    }
+};
+
+/// Return the policy that applies to newly tiered columns
+TieredColumnPolicy getTieredColumnPolicy();
+
+/** Change the policy.  It applies to the columns that were already tiered
+    from the next sweep on, but columns frozen while tiering was disabled
+    stay as they are.
+*/
+void setTieredColumnPolicy(const TieredColumnPolicy & policy);
+
+
+/*****************************************************************************/
+/* TIERED FROZEN COLUMN                                                      */
+/*****************************************************************************/
+
+/** Return a frozen column that behaves exactly like column, but that can be
+    made cold by the tiered column manager: it's serialized, compressed
+    with lz4 and its memory released, and is transparently decompressed
+    the next time it's accessed.  Columns are made cold once they haven't
+    been accessed for the cold period of the policy, or in least recently
+    used order when the resident columns are over budget.
+
+    If tiering is disabled, column is returned as-is.
+*/
+std::shared_ptr<FrozenColumn>
+makeTieredFrozenColumn(std::shared_ptr<FrozenColumn> column);
+
+/// Statistics about the tiered columns of the process
+struct TieredColumnStats {
+    uint64_t numColumns = 0;     ///< Number of live tiered columns
+    uint64_t numResident = 0;    ///< Number of them that are resident
+    uint64_t residentBytes = 0;  ///< Memory used by the resident columns
+    uint64_t coldBytes = 0;      ///< Compressed size of the cold columns
+    uint64_t numSpilled = 0;     ///< Number of cold columns on disk
+};
+
+TieredColumnStats getTieredColumnStats();
+
+/** Apply the policy to the tiered columns straight away, rather than
+    waiting for the manager's next sweep.  Returns the number of columns
+    that were made cold.
+*/
+size_t sweepTieredColumns();
+
+} // namespace MLDB
@@ -140,23 +140,21 @@ apply(const FunctionApplier & applier,
         auto foundIter = it;
         do {                        
             Utf8String subString(startIt, it);
-            bool found = false;
-            bool startFound = false;
-            for (auto& token : dictionary) {
 
-                if (token == subString) {
-                    //found an exact token, but there could be a longer one
-                    found = true;
-                }
-                else if (token.startsWith(subString)) {
-                    //found a token that starts with the sub string
-                    startFound = true;
-                }
-                else if (found || startFound) {
-                    //because its sorted, we can stop here
-                    break;
-                }
-            }
+            // The dictionary is sorted, so the tokens equal to the sub
+            // string come first among those which start with it
+            auto dictIt = std::lower_bound(dictionary.begin(), dictionary.end(),
+                                           subString);
+            auto dictEnd = dictIt;
+            while (dictEnd != dictionary.end() && *dictEnd == subString)
+                ++dictEnd;
+
+            //found an exact token, but there could be a longer one
+            bool found = dictEnd != dictIt;
+
+            //found a token that starts with the sub string
+            bool startFound = dictEnd != dictionary.end()
+                && dictEnd->startsWith(subString);
 
             if (found) {
                 endPos = pos;
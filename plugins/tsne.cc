@@ -9,6 +9,7 @@
 
 #include "tsne.h"
 #include "matrix.h"
+#include "embedding.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/core/dataset.h"
 #include "mldb/jml/stats/distribution.h"
@@ -38,6 +39,24 @@ using namespace std;
 
 namespace MLDB {
 
+DEFINE_ENUM_DESCRIPTION_NAMED(TsneGradientDescription, ML::TSNE_Gradient);
+
+TsneGradientDescription::
+TsneGradientDescription()
+{
+    addValue("barnesHut", ML::TSNE_GRADIENT_BARNES_HUT,
+             "Barnes-Hut approximation.  The repulsive forces from far away "
+             "cells of a quadtree over the embedding are approximated by "
+             "their center of mass.  Works for any number of output "
+             "dimensions.");
+    addValue("interpolation", ML::TSNE_GRADIENT_INTERPOLATION,
+             "Interpolation based approximation (FIt-SNE).  The points are "
+             "interpolated onto a regular grid, and the repulsive forces "
+             "between grid nodes are calculated with an FFT.  This is much "
+             "faster than Barnes-Hut for large numbers of points, but only "
+             "supports two output dimensions.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(TsneConfig);
 
 TsneConfigDescription::
@@ -80,6 +99,15 @@ TsneConfigDescription()
              "may jump over the best optimal point. In general, the learning rate "
              "should be between 100 and 1000.",
              500.0);
+    addField("gradient", &TsneConfig::gradient,
+             "Method used to calculate the repulsive forces in the gradient.",
+             ML::TSNE_GRADIENT_BARNES_HUT);
+    addField("neighborsDataset", &TsneConfig::neighborsDataset,
+             "If specified, an embedding dataset containing the rows of the "
+             "training data.  Its nearest neighbor index is used to find "
+             "the neighbors of each row for the perplexity calculation, "
+             "instead of building a new vantage point tree.  Neighbors that "
+             "are not part of the training data are ignored.");
     addField("modelFileUrl", &TsneConfig::modelFileUrl,
              "URL where the model file (with extension '.tsn') should be saved. "
              "This file can be loaded by the ![](%%doclink tsne.embedRow function). "
@@ -108,7 +136,7 @@ struct TsneItl {
 
     TsneItl(const Url & filename)
     {
-        filter_istream stream(filename);
+        filter_istream stream(filename, { { "mapped", "true" } });
         ML::DB::Store_Reader store(stream);
 
         reconstitute(store);
@@ -132,7 +160,8 @@ struct TsneItl {
         int64_t result = sizeof(*this);
         result += sizeof(float) * inputPath.shape()[0] * inputPath.shape()[1];
         result += sizeof(float) * outputPath.shape()[0] * outputPath.shape()[1];
-        result += vpTree->memusage();
+        if (vpTree)
+            result += vpTree->memusage();
         result += qtree->root->memusage();
         return result;
     }
@@ -241,6 +270,14 @@ run(const ProcedureRunConfig & run,
     itl->params.perplexity = runProcConf.perplexity;
     itl->params.tolerance = runProcConf.tolerance;
     itl->params.eta = runProcConf.learningRate;
+    itl->params.gradient = runProcConf.gradient;
+
+    if (runProcConf.gradient == ML::TSNE_GRADIENT_INTERPOLATION
+        && runProcConf.numOutputDimensions != 2)
+        throw HttpReturnException(400, "The interpolation gradient of t-SNE "
+                                  "requires numOutputDimensions to be 2",
+                                  "numOutputDimensions",
+                                  runProcConf.numOutputDimensions);
 
     DEBUG_MSG(logger) << "perplexity = " << itl->params.perplexity;
     DEBUG_MSG(logger) << "tolerance = " << itl->params.tolerance;
@@ -306,13 +343,68 @@ run(const ProcedureRunConfig & run,
     ExcAssertGreaterEqual(runProcConf.numOutputDimensions, 1);
 
     itl->outputPath.resize(boost::extents[rows.size()][runProcConf.numOutputDimensions]);
-    itl->outputPath
-        = ML::tsneApproxFromCoords(coords, runProcConf.numOutputDimensions,
-                                   itl->params, callback, &itl->vpTree,
-                                   &itl->qtree);
+
+    if (runProcConf.neighborsDataset) {
+        // Reuse the index of the embedding dataset to find the neighbors.
+        // The saved model then has no vantage point tree.
+        auto boundDataset = runProcConf.neighborsDataset->bind(context);
+        auto embedding
+            = dynamic_pointer_cast<EmbeddingDataset>(boundDataset.dataset);
+        if (!embedding) {
+            throw HttpReturnException
+                (400, "The neighborsDataset of t-SNE must be a dataset of type "
+                 "embedding",
+                 "neighborsDataset", runProcConf.neighborsDataset->surface);
+        }
+
+        std::unordered_map<RowHash, int> rowIndexes;
+        for (unsigned i = 0;  i < rows.size();  ++i)
+            rowIndexes[RowHash(std::get<1>(rows[i]))] = i;
+
+        std::vector<std::vector<std::pair<float, int> > >
+            neighbors(rows.size());
+
+        auto findNeighbors = [&] (size_t i)
+            {
+                // One more, since the row is its own closest neighbor
+                auto found = embedding->getRowNeighbors
+                    (std::get<1>(rows[i]), itl->params.numNeighbours + 1,
+                     INFINITY);
+
+                for (auto & n: found) {
+                    auto it = rowIndexes.find(std::get<1>(n));
+                    if (it == rowIndexes.end() || it->second == i)
+                        continue;
+                    neighbors[i].emplace_back(std::get<2>(n), it->second);
+                }
+
+                if (neighbors[i].empty()) {
+                    throw HttpReturnException
+                        (400, "Row '" + std::get<1>(rows[i]).toUtf8String()
+                         + "' has no neighbors from the training data in "
+                         "the neighborsDataset");
+                }
+            };
+
+        parallelMap(0, rows.size(), findNeighbors);
+
+        DEBUG_MSG(logger) << "found neighbors in "
+                          << runProcConf.neighborsDataset->surface;
+
+        itl->outputPath
+            = ML::tsneApproxFromNeighbours(neighbors,
+                                           runProcConf.numOutputDimensions,
+                                           itl->params, callback, &itl->qtree);
+    }
+    else {
+        itl->outputPath
+            = ML::tsneApproxFromCoords(coords, runProcConf.numOutputDimensions,
+                                       itl->params, callback, &itl->vpTree,
+                                       &itl->qtree);
+        ExcAssert(itl->vpTree);
+    }
 
     ExcAssert(itl->qtree);
-    ExcAssert(itl->vpTree);
 
     vector<ColumnPath> names = { ColumnPath("x"), ColumnPath("y"), ColumnPath("z") };
     if (runProcConf.numOutputDimensions <= 3)
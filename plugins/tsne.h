@@ -12,14 +12,18 @@
 #include "mldb/core/dataset.h"
 #include "mldb/core/procedure.h"
 #include "mldb/core/value_function.h"
+#include "mldb/sql/sql_expression.h"
 #include "matrix.h"
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/ml/tsne/tsne.h"
 
 
 namespace MLDB {
 
 struct TsneItl;
 
+DECLARE_ENUM_DESCRIPTION_NAMED(TsneGradientDescription, ML::TSNE_Gradient);
+
 struct TsneConfig : public ProcedureConfig {
     static constexpr const char * name = "tsne.train";
 
@@ -28,7 +32,8 @@ struct TsneConfig : public ProcedureConfig {
           numOutputDimensions(2),
           tolerance(1e-5),
           perplexity(30.0),
-          learningRate(500.0)
+          learningRate(500.0),
+          gradient(ML::TSNE_GRADIENT_BARNES_HUT)
     {
         output.withType("embedding");
     }
@@ -43,6 +48,10 @@ struct TsneConfig : public ProcedureConfig {
     double tolerance;
     double perplexity;
     double learningRate;
+    ML::TSNE_Gradient gradient;
+
+    /// Embedding dataset whose index gives the neighbors of each row
+    std::shared_ptr<TableExpression> neighborsDataset;
 
     Utf8String functionName;
 };
@@ -8,6 +8,8 @@
 #include "mldb/server/mldb_server.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/any_impl.h"
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 
@@ -24,6 +26,10 @@ ParseUserAgentFunctionConfigDescription()
     addField("regexFile", &ParseUserAgentFunctionConfig::regexFile,
         "User agent string parser YAML configuration file",
         string("/opt/bin/useragent-regexes.yaml"));
+    addField("cacheSize", &ParseUserAgentFunctionConfig::cacheSize,
+        "Number of distinct user agent strings whose parsed results are "
+        "kept, so that strings that are seen again don't need to be parsed "
+        "again.  Zero turns off the cache.", (int64_t)100000);
 }
 
 
@@ -64,7 +70,81 @@ ParsedUserAgentDescription::ParsedUserAgentDescription()
 /*****************************************************************************/
 /* USER AGENT PARSER FUNCTION                                                */
 /*****************************************************************************/
-                      
+
+/** Cache of parsed user agents.  A few user agent strings make up most of
+    the traffic, so most of the strings are found here instead of being
+    run through the list of regexes.
+
+    The cache is split into shards, each with its own lock.  A shard keeps
+    two generations of entries: lookups are done in both and move what is
+    found in the old one into the new one, and when the new one is full it
+    becomes the old one.  The strings that keep being seen stay in the
+    cache, and it never holds more than cacheSize entries.
+*/
+struct ParseUserAgentFunction::Cache {
+    struct Entry {
+        std::string osFamily;
+        std::string osVersion;
+        std::string browserFamily;
+        std::string browserVersion;
+        std::string deviceModel;
+        std::string deviceBrand;
+        bool isSpider;
+    };
+
+    static constexpr size_t NUM_SHARDS = 16;
+
+    Cache(size_t cacheSize)
+        : maxGenerationSize(std::max<size_t>(1, cacheSize / NUM_SHARDS / 2))
+    {
+    }
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<const Entry> > current;
+        std::unordered_map<std::string, std::shared_ptr<const Entry> > previous;
+    };
+
+    size_t maxGenerationSize;
+    Shard shards[NUM_SHARDS];
+
+    template<typename Parse>
+    std::shared_ptr<const Entry> get(const std::string & ua, Parse && parse)
+    {
+        Shard & shard = shards[std::hash<std::string>()(ua) % NUM_SHARDS];
+        {
+            std::unique_lock<std::mutex> guard(shard.mutex);
+            auto it = shard.current.find(ua);
+            if (it != shard.current.end())
+                return it->second;
+            it = shard.previous.find(ua);
+            if (it != shard.previous.end()) {
+                auto result = it->second;
+                shard.previous.erase(it);
+                insert(shard, ua, result);
+                return result;
+            }
+        }
+
+        // Parse without holding the lock
+        std::shared_ptr<const Entry> result = parse();
+
+        std::unique_lock<std::mutex> guard(shard.mutex);
+        insert(shard, ua, result);
+        return result;
+    }
+
+    void insert(Shard & shard, const std::string & ua,
+                std::shared_ptr<const Entry> entry)
+    {
+        if (shard.current.size() >= maxGenerationSize) {
+            shard.previous = std::move(shard.current);
+            shard.current.clear();
+        }
+        shard.current.emplace(ua, std::move(entry));
+    }
+};
+
 ParseUserAgentFunction::
 ParseUserAgentFunction(MldbServer * owner,
                        PolyConfig config,
@@ -74,6 +154,9 @@ ParseUserAgentFunction(MldbServer * owner,
     functionConfig = config.params.convert<ParseUserAgentFunctionConfig>();
 
     parser = make_shared<UaParser::UserAgentParser>(functionConfig.regexFile);
+
+    if (functionConfig.cacheSize > 0)
+        cache = std::make_shared<Cache>(functionConfig.cacheSize);
 }
 
     
@@ -84,21 +167,38 @@ call(UserAgentParserArgs input) const
     if(input.ua.empty())
         return ParsedUserAgent();
 
-    auto parsedResults = parser->parse(input.ua.toUtf8String().rawString());
+    std::string ua = input.ua.toUtf8String().stealRawString();
+
+    auto parse = [&] ()
+        {
+            auto parsedResults = parser->parse(ua);
+            auto entry = std::make_shared<Cache::Entry>();
+            entry->osFamily = std::move(parsedResults.os.family);
+            entry->osVersion = parsedResults.os.toVersionString();
+            entry->browserFamily = std::move(parsedResults.browser.family);
+            entry->browserVersion = parsedResults.browser.toVersionString();
+            entry->deviceModel = std::move(parsedResults.device.model);
+            entry->deviceBrand = std::move(parsedResults.device.brand);
+            entry->isSpider = parsedResults.isSpider();
+            return std::shared_ptr<const Cache::Entry>(std::move(entry));
+        };
+
+    std::shared_ptr<const Cache::Entry> parsed
+        = cache ? cache->get(ua, parse) : parse();
 
     Date ts = input.ua.getEffectiveTimestamp();
 
     ParsedUserAgent result;
-    result.os.family = ExpressionValue(std::move(Utf8String(parsedResults.os.family)), ts);
-    result.os.version = ExpressionValue(std::move(Utf8String(parsedResults.os.toVersionString())), ts);
+    result.os.family = ExpressionValue(Utf8String(parsed->osFamily), ts);
+    result.os.version = ExpressionValue(Utf8String(parsed->osVersion), ts);
 
-    result.browser.family = ExpressionValue(std::move(Utf8String(parsedResults.browser.family)), ts);
-    result.browser.version = ExpressionValue(std::move(Utf8String(parsedResults.browser.toVersionString())), ts);
+    result.browser.family = ExpressionValue(Utf8String(parsed->browserFamily), ts);
+    result.browser.version = ExpressionValue(Utf8String(parsed->browserVersion), ts);
 
-    result.device.model = ExpressionValue(std::move(Utf8String(parsedResults.device.model)), ts);
-    result.device.brand = ExpressionValue(std::move(Utf8String(parsedResults.device.brand)), ts);
+    result.device.model = ExpressionValue(Utf8String(parsed->deviceModel), ts);
+    result.device.brand = ExpressionValue(Utf8String(parsed->deviceBrand), ts);
 
-    result.isSpider = ExpressionValue(parsedResults.isSpider(), ts);
+    result.isSpider = ExpressionValue(parsed->isSpider, ts);
 
     return result;
 }
@@ -19,10 +19,12 @@ namespace MLDB {
 
 struct ParseUserAgentFunctionConfig {
     ParseUserAgentFunctionConfig()
-        : regexFile("/opt/bin/useragent-regexes.yaml")
+        : regexFile("/opt/bin/useragent-regexes.yaml"),
+          cacheSize(100000)
     {}
 
     std::string regexFile;
+    int64_t cacheSize;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ParseUserAgentFunctionConfig);
@@ -70,6 +72,10 @@ struct ParseUserAgentFunction: public ValueFunctionT<UserAgentParserArgs, Parsed
     std::shared_ptr<UaParser::UserAgentParser> parser;
 
     ParseUserAgentFunctionConfig functionConfig;
+
+private:
+    struct Cache;
+    std::shared_ptr<Cache> cache;
 };
 
 } // namespace MLDB
@@ -13,8 +13,12 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/jml/stats/distribution.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/http/http_exception.h"
 #include <boost/algorithm/string.hpp>
 #include "mldb/utils/log.h"
+#include <cstring>
 
 using namespace std;
 
@@ -80,7 +84,8 @@ struct Word2VecImporter: public Procedure {
         auto info = getUriObjectInfo(
             runProcConf.dataFileUrl.toDecodedString());
 
-        filter_istream stream(runProcConf.dataFileUrl);
+        filter_istream stream(runProcConf.dataFileUrl.toDecodedString(),
+                              { { "mapped", "true" } });
 
         std::string header;
         getline(stream, header);
@@ -103,22 +108,151 @@ struct Word2VecImporter: public Procedure {
             columnNames.emplace_back(MLDB::format("%06d", i));
         }
 
-        vector<tuple<RowPath, vector<float>, Date> > rows;
+        const char * mappedAddr;
+        size_t mappedSize;
+        std::tie(mappedAddr, mappedSize) = stream.mapped();
+
+        if (mappedAddr) {
+            importMapped(mappedAddr + header.size() + 1,
+                         mappedAddr + mappedSize,
+                         numWords, numDims, runProcConf, info.lastModified,
+                         columnNames, output.get());
+        }
+        else {
+            importStream(stream, numWords, numDims, runProcConf,
+                         info.lastModified, columnNames, output.get());
+        }
+
+        if (output)
+            output->commit();
+
+        RunOutput result;
+        return result;
+    }
+
+    typedef vector<tuple<RowPath, vector<float>, Date> > Rows;
+
+    /** Import from a file that is mapped into memory.  The start of each
+        word is found with a single pass that skips over the vectors, and
+        then the rows are decoded in parallel, one chunk per thread.  The
+        chunks are recorded in the order of the file.
+    */
+    void importMapped(const char * current, const char * end,
+                      int numWords, int numDims,
+                      const Word2VecImporterConfig & runProcConf,
+                      Date ts,
+                      const vector<ColumnPath> & columnNames,
+                      Dataset * output) const
+    {
+        size_t vectorBytes = numDims * sizeof(float);
+
+        // Position and length of each word to record.  Its vector follows
+        // the space after it.
+        vector<pair<const char *, size_t> > words;
+
+        for (unsigned i = 0;  i < numWords;  ++i) {
+            if (runProcConf.limit != -1 && words.size() >= runProcConf.limit)
+                break;
+
+            // The reference word2vec writes a newline after each vector
+            while (current < end && *current == '\n')
+                ++current;
+
+            const char * space
+                = (const char *)memchr(current, ' ', end - current);
+            if (!space || end - (space + 1) < vectorBytes)
+                throw HttpReturnException
+                    (400, "word2vec file is truncated at word "
+                     + std::to_string(i) + " of " + std::to_string(numWords),
+                     "dataFileUrl", runProcConf.dataFileUrl);
+
+            if (i >= runProcConf.offset)
+                words.emplace_back(current, space - current);
+
+            current = space + 1 + vectorBytes;
+        }
+
+        static constexpr size_t CHUNK_SIZE = 10000;
+        size_t numChunks = (words.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+        // Only a few chunks at a time are decoded, which bounds the memory
+        // used to hold them before they're recorded
+        size_t chunksPerBatch = 4 * numCpus();
+
+        for (size_t batch = 0;  batch < numChunks;  batch += chunksPerBatch) {
+            size_t batchEnd = std::min(numChunks, batch + chunksPerBatch);
+            vector<Rows> chunks(batchEnd - batch);
+
+            auto doChunk = [&] (size_t chunk)
+                {
+                    size_t first = chunk * CHUNK_SIZE;
+                    size_t last = std::min(words.size(), first + CHUNK_SIZE);
+
+                    Rows & rows = chunks[chunk - batch];
+                    rows.reserve(last - first);
+
+                    for (size_t i = first;  i < last;  ++i) {
+                        const char * word = words[i].first;
+                        size_t len = words[i].second;
+
+                        // No alignment is guaranteed, so copy the bytes
+                        vector<float> vec(numDims);
+                        memcpy(vec.data(), word + len + 1, vectorBytes);
+
+                        rows.emplace_back(RowPath(string(word, len)),
+                                          std::move(vec), ts);
+                    }
+                };
+
+            parallelMap(batch, batchEnd, doChunk);
+
+            for (auto & rows: chunks) {
+                if (output)
+                    output->recordEmbedding(columnNames, rows);
+            }
+
+            INFO_MSG(logger) << "recorded "
+                             << std::min(words.size(), batchEnd * CHUNK_SIZE)
+                             << " of " << words.size() << " words";
+        }
+    }
+
+    /** Import from a stream that can't be mapped, for example a
+        compressed or remote file.
+    */
+    void importStream(std::istream & stream,
+                      int numWords, int numDims,
+                      const Word2VecImporterConfig & runProcConf,
+                      Date ts,
+                      const vector<ColumnPath> & columnNames,
+                      Dataset * output) const
+    {
+        Rows rows;
         int64_t numRecorded = 0;
 
         for (unsigned i = 0;  i < numWords;  ++i) {
+            // The reference word2vec writes a newline after each vector
+            while (stream.peek() == '\n')
+                stream.get();
+
             std::string word;
             getline(stream, word, ' ');
 
             std::vector<float> vec(numDims);
             stream.read((char *)&vec[0], numDims * sizeof(float));
 
+            if (!stream)
+                throw HttpReturnException
+                    (400, "word2vec file is truncated at word "
+                     + std::to_string(i) + " of " + std::to_string(numWords),
+                     "dataFileUrl", runProcConf.dataFileUrl);
+
             if (i < runProcConf.offset)
                 continue;
             if (runProcConf.limit != -1 && numRecorded >= runProcConf.limit)
                 break;
 
-            rows.emplace_back(RowPath(word), std::move(vec), info.lastModified);
+            rows.emplace_back(RowPath(word), std::move(vec), ts);
             ++numRecorded;
 
             if (rows.size() == 10000) {
@@ -131,13 +265,8 @@ struct Word2VecImporter: public Procedure {
             TRACE_MSG(logger) << "got word " << word;
         }
 
-        if (output) {
+        if (output)
             output->recordEmbedding(columnNames, rows);
-            output->commit();
-        }
-
-        RunOutput result;
-        return result;
     }
 
     virtual Any getStatus() const
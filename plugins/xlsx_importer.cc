@@ -52,58 +52,457 @@ XlsxImporterConfigDescription()
              "Configuration for output dataset");
 }
 
-struct SharedStrings {
+/*****************************************************************************/
+/* XML STREAM PARSER                                                         */
+/*****************************************************************************/
 
+/** Pull parser for the XML of the parts of an xlsx file, which reads them
+    from the stream a block at a time so that the memory it uses doesn't
+    depend on their size.  It returns an event for each element start, end
+    and text, like a SAX parser driven by the caller.
 
-    void load(std::streambuf * buf, shared_ptr<spdlog::logger> logger)
+    It only does what's needed for the parts that Excel writes: elements
+    are named without their namespace prefix, the declaration, comments
+    and DTD are skipped, and entities and newlines are processed in text
+    and attributes like tinyxml2 does.  Well formedness isn't checked.
+*/
+struct XmlStreamParser {
+
+    enum Event {
+        START,   ///< Start of an element; name() and attr() are valid
+        END,     ///< End of an element; name() is valid
+        TEXT,    ///< Text or CDATA; text() is valid
+        DONE     ///< End of the document
+    };
+
+    XmlStreamParser(std::streambuf * stream, bool skipText = false)
+        : stream(stream), skipText(skipText), pos(0), end(0),
+          pendingEnd(false)
     {
-        std::ostringstream allText;
-        allText << buf;
+    }
 
-        unique_ptr<tinyxml2::XMLDocument> xml(new tinyxml2::XMLDocument());
-        xml->Parse(allText.str().c_str());
+    /// Return the next event of the document
+    Event next()
+    {
+        if (pendingEnd) {
+            // The element <x/> has a start and an end
+            pendingEnd = false;
+            return END;
+        }
 
-        //xml->Print();
+        for (;;) {
+            int c = peek();
+            if (c == EOF)
+                return DONE;
+
+            if (c != '<') {
+                text_.clear();
+                readUntil('<', text_, skipText);
+                if (!skipText)
+                    decode(text_, true /* entities */);
+                return TEXT;
+            }
 
-        using namespace tinyxml2;
+            ++pos;
+            c = peek();
+            if (c == '?') {
+                skipPast("?>");
+            }
+            else if (c == '!') {
+                ++pos;
+                if (startsWith("--")) {
+                    skipPast("-->");
+                }
+                else if (startsWith("[CDATA[")) {
+                    text_.clear();
+                    readPast("]]>", text_);
+                    decode(text_, false /* entities */);
+                    return TEXT;
+                }
+                else skipPast(">");
+            }
+            else if (c == '/') {
+                ++pos;
+                name_.clear();
+                readUntil('>', name_);
+                ++pos;
+                while (!name_.empty() && isspace(name_.back()))
+                    name_.pop_back();
+                removePrefix(name_);
+                return END;
+            }
+            else {
+                readStartTag();
+                return START;
+            }
+        }
+    }
 
-        XMLHandle handle(*xml);
+    /// Name of the element, without its namespace prefix
+    const std::string & name() const
+    {
+        return name_;
+    }
 
-        XMLElement * sst = handle.FirstChildElement("sst").ToElement();
+    /// Value of the given attribute of the element, or null if it has none
+    const char * attr(const char * attrName) const
+    {
+        for (size_t i = 0;  i < numAttrs;  ++i) {
+            if (attrs[i].first == attrName)
+                return attrs[i].second.c_str();
+        }
+        return nullptr;
+    }
 
-        if (!sst)
-            throw HttpReturnException(400, "xlsx file SharedStrings have no sst element");
+    /// Text, with its entities replaced
+    const std::string & text() const
+    {
+        return text_;
+    }
 
+private:
+    static constexpr size_t BUFFER_SIZE = 65536;
 
-        unsigned numStrings;
-        int res = sst->QueryUnsignedAttribute("uniqueCount", &numStrings);
-        if (res != XML_NO_ERROR)
-            throw HttpReturnException(400, "xlsx file SharedStrings have no uniqueCount");
+    std::streambuf * stream;
+    bool skipText;
+    char buffer[BUFFER_SIZE];
+    size_t pos, end;
+    bool pendingEnd;
 
-        DEBUG_MSG(logger) << "got " << numStrings << " unique strings";
+    std::string name_;
+    std::string text_;
+    /// Attributes of the element; only numAttrs of them are valid, so
+    /// that their strings are reused from one element to the next
+    std::vector<std::pair<std::string, std::string> > attrs;
+    size_t numAttrs = 0;
 
-        strings.reserve(numStrings);
+    bool fill()
+    {
+        if (pos < end)
+            return true;
+        pos = 0;
+        end = stream->sgetn(buffer, BUFFER_SIZE);
+        return end > 0;
+    }
 
+    int peek()
+    {
+        if (!fill())
+            return EOF;
+        return (unsigned char)buffer[pos];
+    }
 
+    int mustGet()
+    {
+        int c = peek();
+        if (c == EOF)
+            throw HttpReturnException(400, "xlsx file has truncated XML");
+        ++pos;
+        return c;
+    }
 
-        for (XMLNode * node = sst->FirstChildElement();  node;
-             node = node->NextSibling()) {
-            XMLHandle handle(*node);
+    /// Append everything up to the given character, which is not consumed
+    void readUntil(char delim, std::string & result, bool skip = false)
+    {
+        while (fill()) {
+            const char * start = buffer + pos;
+            const char * found
+                = (const char *)memchr(start, delim, end - pos);
+            size_t len = found ? found - start : end - pos;
+            if (!skip)
+                result.append(start, len);
+            pos += len;
+            if (found)
+                return;
+        }
+    }
+
+    /// Append everything up to the given string, which is consumed
+    void readPast(const char * delim, std::string & result,
+                  bool skip = false)
+    {
+        size_t len = strlen(delim);
+
+        // When skipping, only enough to recognize the delimiter is kept
+        std::string window;
+        std::string & out = skip ? window : result;
+        size_t start = out.size();
+
+        for (;;) {
+            out += (char)mustGet();
+            if (out.size() - start >= len
+                && out.compare(out.size() - len, len, delim) == 0) {
+                out.resize(out.size() - len);
+                return;
+            }
+            if (skip && window.size() > 2 * len)
+                window.erase(0, window.size() - len);
+        }
+    }
+
+    void skipPast(const char * delim)
+    {
+        std::string ignored;
+        readPast(delim, ignored, true /* skip */);
+    }
+
+    /// Consume the given string if it is next
+    bool startsWith(const char * str)
+    {
+        // Only our short markers are ever looked for, so the buffer is
+        // refilled if needed by moving what's left to its start
+        size_t len = strlen(str);
+        if (end - pos < len) {
+            memmove(buffer, buffer + pos, end - pos);
+            end -= pos;
+            pos = 0;
+            while (end < len) {
+                auto n = stream->sgetn(buffer + end, BUFFER_SIZE - end);
+                if (n <= 0)
+                    return false;
+                end += n;
+            }
+        }
+        if (strncmp(buffer + pos, str, len) != 0)
+            return false;
+        pos += len;
+        return true;
+    }
+
+    void skipSpace()
+    {
+        while (isspace(peek()))
+            ++pos;
+    }
+
+    void readStartTag()
+    {
+        name_.clear();
+        for (;;) {
+            int c = mustGet();
+            if (isspace(c) || c == '/' || c == '>') {
+                --pos;
+                break;
+            }
+            name_ += c;
+        }
+        removePrefix(name_);
+
+        numAttrs = 0;
+        for (;;) {
+            skipSpace();
+            int c = mustGet();
+            if (c == '>')
+                return;
+            if (c == '/') {
+                skipPast(">");
+                pendingEnd = true;
+                return;
+            }
+
+            if (numAttrs == attrs.size())
+                attrs.emplace_back();
+            auto & attr = attrs[numAttrs++];
+            attr.first.clear();
+            attr.second.clear();
+
+            for (; c != '=' && !isspace(c);  c = mustGet())
+                attr.first += c;
+            skipSpace();
+            if (c != '=' && mustGet() != '=')
+                throw HttpReturnException(400, "xlsx file has attribute "
+                                          "without a value in XML");
+            skipSpace();
+            char quote = mustGet();
+            if (quote != '"' && quote != '\'')
+                throw HttpReturnException(400, "xlsx file has unquoted "
+                                          "attribute value in XML");
+            readUntil(quote, attr.second);
+            mustGet();
+            decode(attr.second, true /* entities */);
+        }
+    }
+
+    static void removePrefix(std::string & name)
+    {
+        auto colon = name.find(':');
+        if (colon != std::string::npos)
+            name.erase(0, colon + 1);
+    }
+
+    /// Replace entities and normalize newlines, in place
+    static void decode(std::string & str, bool entities)
+    {
+        if (str.find_first_of(entities ? "&\r" : "\r") == std::string::npos)
+            return;
+
+        std::string result;
+        result.reserve(str.size());
+
+        for (size_t i = 0;  i < str.size();  ++i) {
+            char c = str[i];
+            if (c == '\r') {
+                result += '\n';
+                if (i + 1 < str.size() && str[i + 1] == '\n')
+                    ++i;
+                continue;
+            }
+            if (c != '&' || !entities) {
+                result += c;
+                continue;
+            }
+
+            size_t semi = str.find(';', i);
+            if (semi == std::string::npos) {
+                result += c;
+                continue;
+            }
+
+            const char * ent = str.c_str() + i + 1;
+            size_t len = semi - i - 1;
+
+            auto isEntity = [&] (const char * name)
+                {
+                    return len == strlen(name) && strncmp(ent, name, len) == 0;
+                };
+
+            if (isEntity("lt"))
+                result += '<';
+            else if (isEntity("gt"))
+                result += '>';
+            else if (isEntity("amp"))
+                result += '&';
+            else if (isEntity("quot"))
+                result += '"';
+            else if (isEntity("apos"))
+                result += '\'';
+            else if (len > 1 && ent[0] == '#') {
+                char * endp = nullptr;
+                unsigned long code = (ent[1] == 'x' || ent[1] == 'X')
+                    ? strtoul(ent + 2, &endp, 16)
+                    : strtoul(ent + 1, &endp, 10);
+                if (endp != ent + len || code > 0x10ffff) {
+                    result += c;
+                    continue;
+                }
+                appendUtf8(result, code);
+            }
+            else {
+                // Unknown entities are left as they are
+                result += c;
+                continue;
+            }
+            i = semi;
+        }
+
+        str = std::move(result);
+    }
+
+    static void appendUtf8(std::string & str, unsigned long code)
+    {
+        if (code < 0x80) {
+            str += char(code);
+        }
+        else if (code < 0x800) {
+            str += char(0xc0 | (code >> 6));
+            str += char(0x80 | (code & 0x3f));
+        }
+        else if (code < 0x10000) {
+            str += char(0xe0 | (code >> 12));
+            str += char(0x80 | ((code >> 6) & 0x3f));
+            str += char(0x80 | (code & 0x3f));
+        }
+        else {
+            str += char(0xf0 | (code >> 18));
+            str += char(0x80 | ((code >> 12) & 0x3f));
+            str += char(0x80 | ((code >> 6) & 0x3f));
+            str += char(0x80 | (code & 0x3f));
+        }
+    }
+};
+
+struct SharedStrings {
+
+    /** Load the shared strings as the XML is parsed.  The text of a string
+        is that of all of the <t> elements of its <si> element, which has
+        several of them for rich text, except for those of the phonetic
+        runs in <rPh>.
+    */
+    void load(std::streambuf * buf, shared_ptr<spdlog::logger> logger)
+    {
+        XmlStreamParser parser(buf);
+
+        bool sawSst = false;
+        unsigned numStrings = 0;
+
+        bool inString = false, inText = false, sawText = false;
+        int phoneticDepth = 0;
+        std::string text;
+
+        for (auto event = parser.next();  event != XmlStreamParser::DONE;
+             event = parser.next()) {
+
+            if (event == XmlStreamParser::TEXT) {
+                if (inText && !phoneticDepth)
+                    text += parser.text();
+                continue;
+            }
+
+            const std::string & name = parser.name();
+
+            if (event == XmlStreamParser::START) {
+                if (!sawSst) {
+                    if (name != "sst")
+                        continue;
+                    sawSst = true;
 
-            XMLElement * text = handle.FirstChildElement("t").ToElement();
+                    const char * count = parser.attr("uniqueCount");
+                    if (!count)
+                        throw HttpReturnException(400, "xlsx file SharedStrings have no uniqueCount");
+                    numStrings = std::stoul(count);
 
-            if (!text)
-                throw HttpReturnException(400, "xlsx file SharedStrings <si> element has no child <t> element");
+                    DEBUG_MSG(logger) << "got " << numStrings << " unique strings";
 
-            const char * t = text->GetText();
+                    strings.reserve(numStrings);
+                }
+                else if (name == "si") {
+                    inString = true;
+                    sawText = false;
+                    text.clear();
+                }
+                else if (inString && name == "rPh") {
+                    ++phoneticDepth;
+                }
+                else if (inString && name == "t") {
+                    inText = true;
+                    sawText = sawText || !phoneticDepth;
+                }
+            }
+            else {
+                if (name == "t") {
+                    inText = false;
+                }
+                else if (name == "rPh") {
+                    --phoneticDepth;
+                }
+                else if (name == "si" && inString) {
+                    if (!sawText)
+                        throw HttpReturnException(400, "xlsx file SharedStrings <si> element has no child <t> element");
 
-            Utf8String textStr(t ? t : "");
+                    Utf8String textStr(std::move(text));
 
-            DEBUG_MSG(logger) << "got string " << textStr;
+                    DEBUG_MSG(logger) << "got string " << textStr;
 
-            strings.emplace_back(std::move(textStr));
+                    strings.emplace_back(std::move(textStr));
+                    text = std::string();
+                    inString = false;
+                }
+            }
         }
 
+        if (!sawSst)
+            throw HttpReturnException(400, "xlsx file SharedStrings have no sst element");
+
         DEBUG_MSG(logger) << "read " << strings.size() << " unique strings";
 
         if (numStrings != strings.size()) {
@@ -481,185 +880,239 @@ struct Workbook {
 
 struct Sheet {
 
-    Sheet(std::streambuf * buf,
-          const Workbook & workbook,
-          const SharedStrings & strings,
-          const Styles & styles,
-          shared_ptr<spdlog::logger> logger)
-    {
-        std::ostringstream allText;
-        allText << buf;
-
-        unique_ptr<tinyxml2::XMLDocument> xml(new tinyxml2::XMLDocument());
-        xml->Parse(allText.str().c_str());
-
-        //cerr << "workbook sheet contents" << endl;
-
-        //xml->Print();
-
-        using namespace tinyxml2;
-
-        XMLHandle handle(*xml);
-
-        XMLElement * data
-            = handle.FirstChildElement("worksheet")
-            .FirstChildElement("sheetData")
-            .ToElement();
-
-        if (!data)
-            throw HttpReturnException(400, "xlsx worksheet has no sheetData element");
+    struct Row {
+        int64_t index;   ///< Row index, 1-based
+        std::vector<std::tuple<int64_t, CellValue> > columns;
+    };
 
-        for (XMLNode * node = data->FirstChildElement("row");  node;
-             node = node->NextSibling()) {
-            XMLElement * element = node->ToElement();
-            if (!element)
-                throw HttpReturnException(400, "xlsx worksheet Relationship entry is not an element");
+    /** Return the index of the last row of the sheet, which gives the
+        width of the row numbers in the row names.  Only the tags are
+        looked at, so this is much faster than reading the rows.  Returns
+        -1 if there are no rows.
+    */
+    static int64_t lastRowIndex(std::streambuf * buf)
+    {
+        XmlStreamParser parser(buf, true /* skip text */);
+
+        bool inSheetData = false;
+        int64_t result = -1;
+
+        for (auto event = parser.next();  event != XmlStreamParser::DONE;
+             event = parser.next()) {
+            if (event == XmlStreamParser::START) {
+                if (parser.name() == "sheetData")
+                    inSheetData = true;
+                else if (inSheetData && parser.name() == "row") {
+                    const char * r = parser.attr("r");
+                    result = CellValue::parse(std::string(r ? r : "")).toInt();
+                }
+            }
+            else if (event == XmlStreamParser::END
+                     && parser.name() == "sheetData") {
+                inSheetData = false;
+            }
+        }
 
-            auto readAttr = [&] (const std::string & attr) -> Utf8String
-                {
-                    const char * foundAttr
-                        = element->Attribute(attr.c_str());
-                    if (!foundAttr)
-                        return Utf8String();
-                    return Utf8String(foundAttr);
-                };
+        return result;
+    }
 
-            // What is the row index?
-            int64_t rowIndex = CellValue::parse(readAttr("r")).toInt();
+    /** Parse the rows of the sheet, calling onRow for each as soon as it
+        has been read, so that only one row is in memory at a time.
+    */
+    static void forEachRow(std::streambuf * buf,
+                           const Workbook & workbook,
+                           const SharedStrings & strings,
+                           const Styles & styles,
+                           shared_ptr<spdlog::logger> logger,
+                           const std::function<void (Row & row)> & onRow)
+    {
+        XmlStreamParser parser(buf);
 
-            Row row;
-            row.index = rowIndex;
+        bool sawSheetData = false, inSheetData = false;
+        bool inRow = false, inCell = false, inValue = false, hasValue = false;
 
-            int64_t colIndex = 0;
+        Row row;
+        int64_t colIndex = 0;
+        Utf8String type, style;
+        std::string cellid;
+        std::string contents;
 
-            for (XMLNode * colNode = element->FirstChildElement("c");  colNode;
-                 colNode = colNode->NextSibling()) {
+        auto readAttr = [&] (const char * attr) -> std::string
+            {
+                const char * foundAttr = parser.attr(attr);
+                if (!foundAttr)
+                    return std::string();
+                return std::string(foundAttr);
+            };
 
-                XMLElement * colElement = colNode->ToElement();
+        for (auto event = parser.next();  event != XmlStreamParser::DONE;
+             event = parser.next()) {
 
-                if (!colElement)
-                    throw HttpReturnException(400, "xlsx sheet column is not an element");
+            if (event == XmlStreamParser::TEXT) {
+                if (inValue)
+                    contents += parser.text();
+                continue;
+            }
 
-                auto readAttr = [&] (const std::string & attr) -> Utf8String
-                    {
-                        const char * foundAttr
-                            = colElement->Attribute(attr.c_str());
-                        if (!foundAttr)
-                            return Utf8String();
-                        return Utf8String(foundAttr);
-                    };
+            const std::string & name = parser.name();
 
-                Utf8String type = readAttr("t");
-                std::string cellid = readAttr("r").rawString();  // r stands for "reference"
-                Utf8String style = readAttr("s");
+            if (event == XmlStreamParser::START) {
+                if (!inSheetData) {
+                    if (name == "sheetData")
+                        sawSheetData = inSheetData = true;
+                }
+                else if (!inRow) {
+                    if (name != "row")
+                        continue;
+                    inRow = true;
+
+                    // What is the row index?
+                    row.index = CellValue::parse(readAttr("r")).toInt();
+                    row.columns.clear();
+                    colIndex = 0;
+                }
+                else if (!inCell) {
+                    if (name != "c")
+                        continue;
+                    inCell = true;
+                    hasValue = false;
+                    contents.clear();
+
+                    type = readAttr("t");
+                    cellid = readAttr("r");  // r stands for "reference"
+                    style = readAttr("s");
+                }
+                else if (name == "v" && !hasValue) {
+                    // Only the first <v> of the cell is used
+                    inValue = hasValue = true;
+                }
+                continue;
+            }
 
-                CellValue value;
-                Utf8String contents;
+            // End of an element
+            if (inValue && name == "v") {
+                inValue = false;
+            }
+            else if (inCell && name == "c") {
+                inCell = false;
+                finishCell(row, colIndex, type, cellid, style,
+                           hasValue, contents, workbook, strings, styles,
+                           logger);
+            }
+            else if (inRow && name == "row") {
+                inRow = false;
+                onRow(row);
+            }
+            else if (inSheetData && name == "sheetData") {
+                inSheetData = false;
+            }
+        }
 
-                XMLNode * v = colNode->FirstChildElement("v");
-                XMLElement * ve = v ? v->ToElement(): nullptr;
+        if (!sawSheetData)
+            throw HttpReturnException(400, "xlsx worksheet has no sheetData element");
+    }
 
-                if (ve) {
-                    if (ve->GetText())
-                        contents = ve->GetText();
+private:
+    /// Add the value of the cell that was just read to the row
+    static void finishCell(Row & row,
+                           int64_t & colIndex,
+                           const Utf8String & type,
+                           const std::string & cellid,
+                           const Utf8String & style,
+                           bool hasValue,
+                           const std::string & contents,
+                           const Workbook & workbook,
+                           const SharedStrings & strings,
+                           const Styles & styles,
+                           shared_ptr<spdlog::logger> logger)
+    {
+        CellValue value;
 
-                    TRACE_MSG(logger) << "type = " << type;
-                    TRACE_MSG(logger) << "style = " << style;
+        if (hasValue) {
+            TRACE_MSG(logger) << "type = " << type;
+            TRACE_MSG(logger) << "style = " << style;
 
-                    if (type == "s") {
-                        // shared string
-                        int index = std::stoi(contents.rawString());
-                        value = CellValue(strings.strings.at(index));
-                    }
-                    else if (!style.empty()) {
-                        int styleNum = CellValue::parse(style).toInt();
-                        const Styles::Style & style = styles.styles.at(styleNum);
-
-                        switch (style.repr) {
-                        case CellValue::TIMESTAMP: {
-                            double offset = CellValue::parse(contents).toDouble();
-                            value = workbook.baseDate.plusDays(offset);
-                            break;
-                        }
-                        case CellValue::TIMEINTERVAL: {
-                            uint16_t months = 0;
-                            uint16_t days = 0;
-                            uint16_t seconds = CellValue::parse(contents).toDouble();
-                            value = CellValue::fromMonthDaySecond(months, days, seconds);
-                            break;
-                        }
-                        case CellValue::FLOAT:  // fall through
-                        case CellValue::EMPTY: // fall through
-                            // These shouldn't occur
-                        case CellValue::INTEGER:
-                        case CellValue::ASCII_STRING:
-                        case CellValue::UTF8_STRING:
-                        default:
-                            value = CellValue::parse(contents);
-                        }
-                    }
-                    else if (type == "b" /* boolean */ || type.empty()) {
-                        // generic...
-                        value = CellValue::parse(contents);
-                    }
-                    else {
-                        // Probably a date... we should handle those
-                        INFO_MSG(logger) << "cell has unknown type";
-                        INFO_MSG(logger) << "type = " << type << " cellid = " << cellid
-                             << " s = " << style << " c " << contents;
-                    }
+            if (type == "s") {
+                // shared string
+                int index = std::stoi(contents);
+                value = CellValue(strings.strings.at(index));
+            }
+            else if (!style.empty()) {
+                int styleNum = CellValue::parse(style).toInt();
+                const Styles::Style & style = styles.styles.at(styleNum);
+
+                switch (style.repr) {
+                case CellValue::TIMESTAMP: {
+                    double offset = CellValue::parse(contents).toDouble();
+                    value = workbook.baseDate.plusDays(offset);
+                    break;
                 }
-
-                // Get the column out of it
-                std::string columnPart;
-
-                if (cellid.empty()) {
-                    ++colIndex;
+                case CellValue::TIMEINTERVAL: {
+                    uint16_t months = 0;
+                    uint16_t days = 0;
+                    uint16_t seconds = CellValue::parse(contents).toDouble();
+                    value = CellValue::fromMonthDaySecond(months, days, seconds);
+                    break;
                 }
-                else {
-                    colIndex = 0;
-                    size_t numLetters = 0;
-                    while (numLetters < cellid.length() && isalpha(cellid[numLetters]))
-                        ++numLetters;
-                    if (numLetters == 1) {
-                        colIndex = toupper(cellid[0]) - 'A';
-                    }
-                    else if (numLetters == 2) {
-                        colIndex
-                            = (toupper(cellid[0]) - 'A' + 1) * 26
-                            + toupper(cellid[1]) - 'A';
-                    }
-                    else if (numLetters == 3) {
-                        colIndex
-                            = (toupper(cellid[0]) - 'A' + 1) * 26 * 26
-                            + (toupper(cellid[1]) - 'A' + 1) * 26
-                            + toupper(cellid[2]) - 'A';
-                    }
-                    else if (numLetters == 4) {
-                        colIndex
-                            = (toupper(cellid[0]) - 'A' + 1) * 26 * 26 * 26
-                            + (toupper(cellid[0]) - 'A' + 1) * 26 * 26
-                            + (toupper(cellid[1]) - 'A' + 1) * 26
-                            + toupper(cellid[2]) - 'A';
-                    }
-                    else throw HttpReturnException(400, "Unable to parse Cell ID '" + cellid + "'");
+                case CellValue::FLOAT:  // fall through
+                case CellValue::EMPTY: // fall through
+                    // These shouldn't occur
+                case CellValue::INTEGER:
+                case CellValue::ASCII_STRING:
+                case CellValue::UTF8_STRING:
+                default:
+                    value = CellValue::parse(contents);
                 }
-
-                DEBUG_MSG(logger) << "cell " << cellid << " has value " << jsonEncodeStr(value);
-                DEBUG_MSG(logger) << "row " << rowIndex << " column " << colIndex;
-                row.columns.emplace_back(colIndex, std::move(value));
             }
-
-            rows.emplace_back(std::move(row));
+            else if (type == "b" /* boolean */ || type.empty()) {
+                // generic...
+                value = CellValue::parse(contents);
+            }
+            else {
+                // Probably a date... we should handle those
+                INFO_MSG(logger) << "cell has unknown type";
+                INFO_MSG(logger) << "type = " << type << " cellid = " << cellid
+                                 << " s = " << style << " c " << contents;
+            }
         }
-    }
 
-    struct Row {
-        int64_t index;   ///< Row index, 1-based
-        std::vector<std::tuple<int64_t, CellValue> > columns;
-    };
+        // Get the column out of it
+        if (cellid.empty()) {
+            ++colIndex;
+        }
+        else {
+            colIndex = 0;
+            size_t numLetters = 0;
+            while (numLetters < cellid.length() && isalpha(cellid[numLetters]))
+                ++numLetters;
+            if (numLetters == 1) {
+                colIndex = toupper(cellid[0]) - 'A';
+            }
+            else if (numLetters == 2) {
+                colIndex
+                    = (toupper(cellid[0]) - 'A' + 1) * 26
+                    + toupper(cellid[1]) - 'A';
+            }
+            else if (numLetters == 3) {
+                colIndex
+                    = (toupper(cellid[0]) - 'A' + 1) * 26 * 26
+                    + (toupper(cellid[1]) - 'A' + 1) * 26
+                    + toupper(cellid[2]) - 'A';
+            }
+            else if (numLetters == 4) {
+                colIndex
+                    = (toupper(cellid[0]) - 'A' + 1) * 26 * 26 * 26
+                    + (toupper(cellid[0]) - 'A' + 1) * 26 * 26
+                    + (toupper(cellid[1]) - 'A' + 1) * 26
+                    + toupper(cellid[2]) - 'A';
+            }
+            else throw HttpReturnException(400, "Unable to parse Cell ID '" + cellid + "'");
+        }
 
-    vector<Row> rows;
+        DEBUG_MSG(logger) << "cell " << cellid << " has value " << jsonEncodeStr(value);
+        DEBUG_MSG(logger) << "row " << row.index << " column " << colIndex;
+        row.columns.emplace_back(colIndex, std::move(value));
+    }
 
 }; // struct Sheet
 
@@ -753,16 +1206,26 @@ struct XlsxImporter: public Procedure {
             output = obtainDataset(server, runProcConf.output);
         }
 
-        // 4.  Load the worksheets, one by one
-        for (auto & sheetEntry: workbook.sheets) {
+        Dataset::MultiChunkRecorder recorder;
+        if (output)
+            recorder = output->getChunkRecorder();
+
+        // 4.  Load the worksheets, one by one, recording their rows as they
+        //     are read
+        for (size_t i = 0;  i < workbook.sheets.size();  ++i) {
+            auto & sheetEntry = workbook.sheets[i];
             Utf8String filename =
                 "archive+" + runProcConf.dataFileUrl.toDecodedString()
                 + "#xl/" + sheetEntry.filename;
-            filter_istream sheetStream(filename.rawString());
-
-            Sheet sheet(sheetStream.rdbuf(), workbook, strings, styles, logger);
 
-            DEBUG_MSG(logger) << "sheet had " << sheet.rows.size() << " rows";
+            // The row names have the row numbers padded to the width of
+            // the last one, which we need to know before recording any
+            int64_t maxRowIndex;
+            {
+                filter_istream sheetStream(filename.rawString());
+                maxRowIndex = Sheet::lastRowIndex(sheetStream.rdbuf());
+            }
+            int indexLength = MLDB::format("%d", (int)maxRowIndex).length();
 
             auto getColName = [] (int64_t colIndex)
                 {
@@ -783,26 +1246,41 @@ struct XlsxImporter: public Procedure {
                     return ColumnPath(result);
                 };
 
-            if (output && !sheet.rows.empty()) {
-                int maxRowIndex = sheet.rows.back().index;
-                int indexLength = MLDB::format("%d", maxRowIndex).length();
+            std::unique_ptr<Recorder> chunk;
+            if (output)
+                chunk = recorder.newChunk(i);
+
+            size_t numRows = 0;
+
+            auto onRow = [&] (Sheet::Row & row)
+                {
+                    ++numRows;
+                    if (!chunk)
+                        return;
 
-                for (auto & row: sheet.rows) {
-                    MatrixNamedRow outputRow;
-                    outputRow.rowHash = outputRow.rowName
-                        = RowPath(sheetEntry.name + MLDB::format(":%0*d", indexLength, row.index));
+                    RowPath rowName(sheetEntry.name + MLDB::format(":%0*d", indexLength, row.index));
+                    std::vector<std::tuple<ColumnPath, CellValue, Date> > columns;
+                    columns.reserve(row.columns.size());
 
                     for (auto & col: row.columns) {
-                        outputRow.columns.emplace_back(getColName(std::get<0>(col)),
-                                                       std::get<1>(col),
-                                                       workbook.timestamp);
+                        columns.emplace_back(getColName(std::get<0>(col)),
+                                             std::move(std::get<1>(col)),
+                                             workbook.timestamp);
                     }
 
-                    output->recordRow(outputRow.rowName, outputRow.columns);
-                }
-            }
+                    chunk->recordRowDestructive(std::move(rowName),
+                                                std::move(columns));
+                };
+
+            filter_istream sheetStream(filename.rawString());
+            Sheet::forEachRow(sheetStream.rdbuf(), workbook, strings, styles,
+                              logger, onRow);
+
+            DEBUG_MSG(logger) << "sheet had " << numRows << " rows";
         }
-        output->commit();
+
+        if (output)
+            recorder.commit();
         return RunOutput();
     }
 
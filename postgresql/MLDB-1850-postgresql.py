@@ -86,6 +86,32 @@ expected = [["_rowName","a","b","c"],
 
 assert res == expected
 
+mldb.log("From Postgres to MLDB with several connections")
+
+res = mldb.post('/v1/procedures', {
+    'type': 'postgresql.import',
+    'params': {
+        'databaseName' : 'mldb',
+        'port' : 5432,
+        'postgresqlQuery' : 'select * from mytable',
+        'partitionColumn' : 'b',
+        'numConnections' : 2,
+        'runOnCreation': True,
+        'outputDataset' : {
+                    'id' : 'out_partitioned',
+                    'type' : 'sparse.mutable'
+                }
+    }
+})
+
+res = mldb.query("select * from out_partitioned order by rowName()")
+
+expected = [["_rowName","a","b","c"],
+            ["1","alfalfa",1,3.5],
+            ["2","brigade",2,5.7]]
+
+assert res == expected
+
 mldb.log("Query Function")
 mldb.put('/v1/functions/query_from_postgres', {
     'type': 'postgresql.query',
@@ -139,4 +165,28 @@ expected = [["_rowName","a","b","c"],
 
 assert res == expected
 
+# The predicates on b and a are evaluated by PostgreSQL, those on c and on
+# the missing column by MLDB
+res = mldb.query("select b from postgresqldataset where b > 1")
+
+expected = [["_rowName","b"],
+            ["brigade",2]]
+
+assert res == expected
+
+res = mldb.query("select a, c from postgresqldataset "
+                 "where a IN ('alfalfa', 'brigade') and c < 4 and b >= 1")
+
+expected = [["_rowName","a","c"],
+            ["alfalfa","alfalfa",3.5]]
+
+assert res == expected
+
+res = mldb.query("select * from postgresqldataset where a > 'b' or d = 1")
+
+expected = [["_rowName","a","b","c"],
+            ["brigade","brigade",2,5.7]]
+
+assert res == expected
+
 mldb.script.set_return("success")
\ No newline at end of file
@@ -7,13 +7,17 @@
 #include "mldb/core/procedure.h"
 #include "mldb/core/function.h"
 #include "mldb/core/dataset.h"
+#include "mldb/server/dataset_context.h"
 #include "mldb/soa/credentials/credentials.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/base/parallel.h"
 
 #include <postgresql/libpq-fe.h>
 
 #include <unordered_set>
+#include <set>
+#include <map>
 
 using namespace std;
 
@@ -41,13 +45,31 @@ const int postgresqlDefaultPort = 5432;
 /* POSTGRESQL UTILS                                                          */
 /*****************************************************************************/
 namespace {
+// PostgreSQL type oids, from pg_type.h
+enum {
+    POSTGRESQL_NAME = 19,
+    POSTGRESQL_INT8 = 20,
+    POSTGRESQL_INT2 = 21,
+    POSTGRESQL_INT4 = 23,
+    POSTGRESQL_TEXT = 25,
+    POSTGRESQL_FLOAT8 = 701,
+    POSTGRESQL_VARCHAR = 1043
+};
+
 CellValue getCellValueFromPostgres(const PGresult *res, int i, int j)
 {
+    if (PQgetisnull(res, i, j)) {
+        return CellValue();
+    }
+
     int postgrestype = PQftype(res, j);
-    if (postgrestype == 23) {
+    if (postgrestype == POSTGRESQL_INT2 || postgrestype == POSTGRESQL_INT4) {
         return CellValue(atoi(PQgetvalue(res, i, j)));
     }
-    else if (postgrestype == 701) {
+    else if (postgrestype == POSTGRESQL_INT8) {
+        return CellValue((int64_t)atoll(PQgetvalue(res, i, j)));
+    }
+    else if (postgrestype == POSTGRESQL_FLOAT8) {
         return CellValue(atof(PQgetvalue(res, i, j)));
     }
     else {
@@ -80,6 +102,131 @@ pg_conn* startPostgresqlConnection(const string& databaseName, const string& hos
     return conn;
 }
 
+/** Run the query on the connection, calling onRow with the result of each
+    row as soon as it is received instead of waiting for the whole result
+    to be held in memory.
+*/
+void streamPostgresqlQuery(pg_conn * conn, const string & query,
+                           const std::function<void (const PGresult *)> & onRow)
+{
+    if (!PQsendQuery(conn, query.c_str()) || !PQsetSingleRowMode(conn)) {
+        throw HttpReturnException(400, "Could not query PostgreSQL database",
+                                  string(PQerrorMessage(conn)));
+    }
+
+    string errorMsg;
+    while (PGresult * resPtr = PQgetResult(conn)) {
+        std::unique_ptr<PGresult, void (*) (PGresult *)> res(resPtr, PQclear);
+        auto status = PQresultStatus(res.get());
+        if (status == PGRES_SINGLE_TUPLE) {
+            // Results are read until the end even after an error, so that
+            // the connection is left in a usable state
+            if (errorMsg.empty())
+                onRow(res.get());
+        }
+        else if (status != PGRES_TUPLES_OK) {
+            errorMsg = PQresultErrorMessage(res.get());
+        }
+    }
+
+    if (!errorMsg.empty())
+        throw HttpReturnException(400, "Could not query PostgreSQL database",
+                                  errorMsg);
+}
+
+
+/** Return the name quoted as a PostgreSQL identifier. */
+string quotePostgresqlIdentifier(pg_conn * conn, const string & name)
+{
+    std::unique_ptr<char, void (*) (void *)>
+        quoted(PQescapeIdentifier(conn, name.c_str(), name.size()),
+               PQfreemem);
+    if (!quoted) {
+        throw HttpReturnException(400, "Invalid PostgreSQL identifier",
+                                  string(PQerrorMessage(conn)));
+    }
+    return quoted.get();
+}
+
+/** Return the value quoted as a PostgreSQL string literal. */
+string quotePostgresqlLiteral(pg_conn * conn, const string & value)
+{
+    std::unique_ptr<char, void (*) (void *)>
+        quoted(PQescapeLiteral(conn, value.c_str(), value.size()),
+               PQfreemem);
+    if (!quoted) {
+        throw HttpReturnException(400, "Invalid PostgreSQL literal",
+                                  string(PQerrorMessage(conn)));
+    }
+    return quoted.get();
+}
+
+/** Translate a predicate on a column of the given PostgreSQL type into a
+    SQL condition that selects exactly the same rows, or return an empty
+    string if that can't be done.  Only predicates on integer columns
+    compared with numbers and on text columns compared with strings are
+    translated, as the other types are either not read into the same value
+    or don't compare the same way in PostgreSQL as they do in MLDB.
+*/
+string getPostgresqlCondition(pg_conn * conn,
+                              const ColumnPredicate & predicate,
+                              const string & column,
+                              Oid type)
+{
+    bool isInteger = type == POSTGRESQL_INT2 || type == POSTGRESQL_INT4
+        || type == POSTGRESQL_INT8;
+    bool isText = type == POSTGRESQL_TEXT || type == POSTGRESQL_VARCHAR
+        || type == POSTGRESQL_NAME;
+
+    std::vector<string> values;
+    for (auto & v: predicate.values) {
+        if (isInteger && v.isInteger()) {
+            values.push_back(v.toString());
+        }
+        else if (isInteger && v.isNumber() && std::isfinite(v.toDouble())) {
+            values.push_back(MLDB::format("%.17g", v.toDouble()));
+        }
+        else if (isText && v.isString()) {
+            values.push_back(quotePostgresqlLiteral
+                             (conn, v.toUtf8String().rawString()));
+        }
+        else return string();
+    }
+
+    // MLDB orders strings by their bytes
+    string lhs = isText && predicate.op != ColumnPredicate::EQUAL
+        && predicate.op != ColumnPredicate::IN
+        ? column + " COLLATE \"C\"" : column;
+
+    switch (predicate.op) {
+    case ColumnPredicate::EQUAL:
+        return lhs + " = " + values.at(0);
+    case ColumnPredicate::LESS:
+        return lhs + " < " + values.at(0);
+    case ColumnPredicate::LESS_EQUAL:
+        return lhs + " <= " + values.at(0);
+    case ColumnPredicate::GREATER:
+        return lhs + " > " + values.at(0);
+    case ColumnPredicate::GREATER_EQUAL:
+        return lhs + " >= " + values.at(0);
+    case ColumnPredicate::IN: {
+        // Only null values were given, which never match
+        if (values.empty())
+            return "FALSE";
+        string result = lhs + " IN (";
+        for (size_t i = 0;  i < values.size();  ++i)
+            result += (i == 0 ? "" : ", ") + values[i];
+        return result + ")";
+    }
+    case ColumnPredicate::BETWEEN:
+        return lhs + " BETWEEN " + values.at(0) + " AND " + values.at(1);
+    case ColumnPredicate::IN_SET:
+        break;
+    }
+
+    return string();
+}
+
 }
 
 /*****************************************************************************/
@@ -183,121 +330,220 @@ struct PostgresqlDataset: public Dataset {
         throw HttpReturnException(400, "PostgreSQL dataset is read-only");
     }
 
-    virtual GenerateRowsWhereFunction
-    generateRowsWhere(const SqlBindingScope & context,
-                      const Utf8String& alias,
-                      const SqlExpression & where,
-                      ssize_t offset,
-                      ssize_t limit) const override
+    /** Return the names and the type oids of the columns of the table. */
+    std::map<string, Oid> getTableColumns(pg_conn * conn) const
     {
+        string selectString = "SELECT * FROM " + config_.tableName + " LIMIT 0";
 
-        auto conn = startConnection();
-        string selectString = "SELECT ";
-        selectString += config_.primaryKey + 
-                        " FROM " + 
-                        config_.tableName +
-                        " WHERE " + 
-                        where.surface.rawString();
+        std::unique_ptr<PGresult, void (*) (PGresult *)>
+            res(PQexec(conn, selectString.c_str()), PQclear);
+        if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
+            throw HttpReturnException(400, "Could not select from postgreSQL: ",
+                                      string(PQresultErrorMessage(res.get())));
+        }
 
-        POSTGRESQL_VERBOSE(cerr << "postgress where select: " << endl);
-        POSTGRESQL_VERBOSE(cerr << selectString << endl);
+        std::map<string, Oid> result;
+        for (int j = 0; j < PQnfields(res.get()); j++) {
+            result[PQfname(res.get(), j)] = PQftype(res.get(), j);
+        }
+        return result;
+    }
 
-        auto res = PQexec(conn, selectString.c_str());
-        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-            string errorMsg(PQresultErrorMessage(res));
-            PQclear(res);
-            PQfinish(conn);
-            throw HttpReturnException(400, "Could not select from postgreSQL: ", errorMsg);
+    /** Return the quoted names of the columns of the table that need to be
+        selected to read the given columns.  Columns that are not in the
+        table are always null, so they don't need to be selected.
+    */
+    static std::vector<string>
+    getProjection(pg_conn * conn,
+                  const std::map<string, Oid> & tableColumns,
+                  const std::vector<ColumnPath> & columns)
+    {
+        std::set<string> names;
+        for (auto & c: columns) {
+            if (!c.empty())
+                names.insert(c.front().toUtf8String().rawString());
         }
-        
-        POSTGRESQL_VERBOSE(cerr << "keys fetched from " << config_.tableName << " sucessfully!" << endl;)
 
-        std::vector<RowPath> rowsToKeep;
+        std::vector<string> result;
+        for (auto & n: names) {
+            if (tableColumns.count(n))
+                result.push_back(quotePostgresqlIdentifier(conn, n));
+        }
+        return result;
+    }
 
-        int nfields = PQnfields(res);
-        int ntuples = PQntuples(res);
+    /** Return the fields of a row of the result from firstField onwards as
+        an expression value. */
+    static ExpressionValue
+    getRowFromPostgres(const PGresult * res, int i, int firstField)
+    {
+        std::vector<std::tuple<ColumnPath, CellValue, Date> > rowValues;
+        for (int j = firstField; j < PQnfields(res); j++) {
+            rowValues.emplace_back(ColumnPath(PQfname(res, j)), getCellValueFromPostgres(res, i, j), Date::notADate());
+            POSTGRESQL_VERBOSE(printf("[%d,%d] %s %s\n", i, j, PQgetvalue(res, i, j), PQfname(res, j));)
+        }
+        return ExpressionValue(rowValues);
+    }
 
-        POSTGRESQL_VERBOSE(cerr << ntuples << "," << nfields << endl;)
+    virtual GenerateRowsWhereFunction
+    generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String& alias,
+                      const SqlExpression & where,
+                      ssize_t offset,
+                      ssize_t limit) const override
+    {
+        std::shared_ptr<pg_conn> conn(startConnection(), PQfinish);
+        auto tableColumns = getTableColumns(conn.get());
+
+        // The predicates that PostgreSQL evaluates the same way as MLDB are
+        // pushed into the query, and the rest of the where clause is
+        // evaluated on the rows that it returns
+        SqlExpressionDatasetScope dsScope(*this, alias);
+        std::vector<string> conditions;
+        std::vector<BoundSqlExpression> residual;
+
+        for (const SqlExpression * expr: splitConjunction(where)) {
+            ColumnPredicate predicate;
+            if (extractColumnPredicate(alias, *expr, predicate)
+                && predicate.columnName.size() == 1) {
+                auto it = tableColumns.find
+                    (predicate.columnName.front().toUtf8String().rawString());
+                if (it != tableColumns.end()) {
+                    string condition = getPostgresqlCondition
+                        (conn.get(), predicate,
+                         quotePostgresqlIdentifier(conn.get(), it->first),
+                         it->second);
+                    if (!condition.empty()) {
+                        conditions.push_back(condition);
+                        continue;
+                    }
+                }
+            }
+            residual.push_back(expr->bind(dsScope));
+        }
 
-        if (nfields == 1) {
-            for(int i = 0; i < ntuples; i++) {
-                rowsToKeep.emplace_back(PQgetvalue(res, i, 0));        
+        // The residual filter needs the columns it reads
+        string selectString = "SELECT " + config_.primaryKey;
+        if (!residual.empty()) {
+            if (dsScope.readsAllColumns) {
+                selectString += ", *";
+            }
+            else {
+                auto projection
+                    = getProjection(conn.get(), tableColumns,
+                                    { dsScope.columnsRead.begin(),
+                                      dsScope.columnsRead.end() });
+                for (auto & c: projection)
+                    selectString += ", " + c;
             }
         }
+        selectString += " FROM " + config_.tableName;
+        for (size_t i = 0; i < conditions.size(); i++) {
+            selectString += (i == 0 ? " WHERE (" : " AND (")
+                + conditions[i] + ")";
+        }
 
-        PQclear(res);
-        PQfinish(conn);
+        conn.reset();
+
+        POSTGRESQL_VERBOSE(cerr << "postgress where select: " << endl);
+        POSTGRESQL_VERBOSE(cerr << selectString << endl);
 
         return {[=] (ssize_t numToGenerate, Any token,
                      const BoundParameters & params,
                      std::function<bool (const Json::Value &)> onProgress)
         {
-            ssize_t start = 0;
-            ssize_t limit = numToGenerate;
+            std::shared_ptr<pg_conn> conn(startConnection(), PQfinish);
 
-            ExcAssertNotEqual(limit, 0);
-            
-            if (!token.empty())
-                start = token.convert<size_t>();            
+            std::vector<RowPath> rowsToKeep;
+
+            auto onRow = [&] (const PGresult * res)
+            {
+                RowPath rowName(PQgetvalue(res, 0, 0));
+                if (!residual.empty()) {
+                    ExpressionValue row = getRowFromPostgres(res, 0, 1);
+                    auto rowScope = SqlExpressionDatasetScope::getRowScope
+                        (rowName, row, &params);
+                    for (auto & expr: residual) {
+                        if (!expr(rowScope, GET_LATEST).isTrue())
+                            return;
+                    }
+                }
+                rowsToKeep.emplace_back(std::move(rowName));
+            };
 
-            start += rowsToKeep.size();
-            Any newToken;
-            if (rowsToKeep.size() == limit)
-                newToken = start;
+            streamPostgresqlQuery(conn.get(), selectString, onRow);
 
-            return make_pair(std::move(rowsToKeep),
-                             std::move(newToken));
+            POSTGRESQL_VERBOSE(cerr << "keys fetched from " << config_.tableName << " sucessfully!" << endl;)
+
+            // All of the rows are returned at once
+            return make_pair(std::move(rowsToKeep), Any());
         },
         "PostgresqlDataset row generation"};
 
     }
 
-    /** Return a row as an expression value.  Default forwards to the matrix
-    view's getRow() function.
+    /** Return the given columns of a row, which is looked up by its primary
+        key.
     */
-    virtual ExpressionValue getRowExpr(const RowPath & row) const override
+    ExpressionValue getRowColumns(const RowPath & row,
+                                  const string & selectList) const
     {
-        auto conn = startConnection();
-        string selectString = "SELECT * FROM ";
+        std::shared_ptr<pg_conn> conn(startConnection(), PQfinish);
+        string selectString = "SELECT " + selectList + " FROM ";
         selectString += config_.tableName +
                         " WHERE " + 
                         config_.primaryKey + 
-                        " = '" + 
-                        row.toUtf8String().rawString()
-                        + "'";
+                        " = " +
+                        quotePostgresqlLiteral(conn.get(), row.toUtf8String().rawString());
 
         POSTGRESQL_VERBOSE(cerr << "postgress row select: " << endl;)
         POSTGRESQL_VERBOSE(cerr << selectString << endl;)
 
-        auto res = PQexec(conn, selectString.c_str());
-        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-            string errorMsg(PQresultErrorMessage(res));
-            PQclear(res);
-            PQfinish(conn);
-            throw HttpReturnException(400, "Could not select from postgreSQL: ", errorMsg);
+        std::unique_ptr<PGresult, void (*) (PGresult *)>
+            res(PQexec(conn.get(), selectString.c_str()), PQclear);
+        if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
+            throw HttpReturnException(400, "Could not select from postgreSQL: ",
+                                      string(PQresultErrorMessage(res.get())));
         }
 
         POSTGRESQL_VERBOSE(cerr << "row fetched from " << config_.tableName << " successfully!" << endl;)
 
-        int nfields = PQnfields(res);
-        int ntuples = PQntuples(res);
-
-        POSTGRESQL_VERBOSE(cerr << ntuples << "," << nfields << endl;)
+        POSTGRESQL_VERBOSE(cerr << PQntuples(res.get()) << "," << PQnfields(res.get()) << endl;)
 
-        std::vector<std::tuple<ColumnPath, CellValue, Date> > rowValues;
-        if (ntuples > 0) {
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
-            for(int j = 0; j < nfields; j++) {
-                rowValues.emplace_back(ColumnPath(PQfname(res, j)), getCellValueFromPostgres(res, 0, j), Date::Date::notADate());
-                POSTGRESQL_VERBOSE(printf("[%d,%d] %s %s\n", 0, j, PQgetvalue(res, 0, j), PQfname(res, j));)
-            }       
+        if (PQntuples(res.get()) > 0) {
+            return getRowFromPostgres(res.get(), 0, 0);
         }
 
-        PQclear(res);
-        PQfinish(conn);
+        return ExpressionValue(std::vector<std::tuple<ColumnPath, CellValue, Date> >());
+    }
 
-        return ExpressionValue(rowValues);
+    /** Return a row as an expression value.  Default forwards to the matrix
+    view's getRow() function.
+    */
+    virtual ExpressionValue getRowExpr(const RowPath & row) const override
+    {
+        return getRowColumns(row, "*");
+    }
 
+    /** Only the columns that are read are selected from the table. */
+    virtual std::function<ExpressionValue (const RowPath & row)>
+    getProjectedRowExpr(const std::vector<ColumnPath> & columns) const override
+    {
+        std::shared_ptr<pg_conn> conn(startConnection(), PQfinish);
+        auto projection = getProjection(conn.get(),
+                                        getTableColumns(conn.get()),
+                                        columns);
+
+        // Something needs to be selected for the query to be valid
+        string selectList = projection.empty() ? config_.primaryKey : "";
+        for (size_t i = 0; i < projection.size(); i++) {
+            selectList += (i == 0 ? "" : ", ") + projection[i];
+        }
+
+        return [=] (const RowPath & row)
+            {
+                return getRowColumns(row, selectList);
+            };
     }
 
     /** Return whether or not all columns names and info are known.
@@ -568,6 +814,8 @@ struct PostgresqlImportConfig: public ProcedureConfig {
     int port;
     string host;
     string postgresqlQuery;
+    string partitionColumn;
+    int numConnections;
 
     /// The output dataset.  Rows will be dumped into here via insertRows.
     PolyConfigT<Dataset> outputDataset;
@@ -577,6 +825,7 @@ struct PostgresqlImportConfig: public ProcedureConfig {
         port = postgresqlDefaultPort;
         host = "localhost";
         postgresqlQuery = "";
+        numConnections = 1;
 
         outputDataset.withType("sparse.mutable");
     }
@@ -593,6 +842,16 @@ PostgresqlImportConfigDescription()
     addField("port", &PostgresqlImportConfig::port, "Port of the database to connect to.", postgresqlDefaultPort);
     addField("host", &PostgresqlImportConfig::host, "Address of the database to connect to ");
     addField("postgresqlQuery", &PostgresqlImportConfig::postgresqlQuery, "Query to run in postgresql to get rows");
+    addField("partitionColumn", &PostgresqlImportConfig::partitionColumn,
+             "Integer column of the query, normally its primary key, used to "
+             "split it into ranges that are read at the same time by "
+             "different connections.  When set, it is also used as the "
+             "name of the rows, so it must be unique and not null.  When "
+             "empty, the query is read by a single connection and the rows are named "
+             "`row_0`, `row_1` and so on.");
+    addField("numConnections", &PostgresqlImportConfig::numConnections,
+             "Number of connections used to read the ranges of "
+             "`partitionColumn`.", 1);
 
     addField("outputDataset", &PostgresqlImportConfig::outputDataset,
              "Output dataset configuration.  This may refer either to an "
@@ -600,6 +859,19 @@ PostgresqlImportConfigDescription()
              "which will be created by the procedure.", PolyConfigT<Dataset>().withType("sparse.mutable"));
 
     addParent<ProcedureConfig>();
+
+    onPostValidate = [] (PostgresqlImportConfig * config,
+                         JsonParsingContext & context)
+    {
+        if (config->numConnections < 1) {
+            throw MLDB::Exception("postgresql.import: numConnections must "
+                                  "be at least 1");
+        }
+        if (config->numConnections > 1 && config->partitionColumn.empty()) {
+            throw MLDB::Exception("postgresql.import: partitionColumn must "
+                                  "be set to use more than one connection");
+        }
+    };
 }
 
 struct PostgresqlImportProcedure: public Procedure {
@@ -626,6 +898,62 @@ struct PostgresqlImportProcedure: public Procedure {
         return result;
     }
 
+    typedef std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > Rows;
+
+    /// Number of rows that are recorded at once
+    static constexpr size_t rowBatchSize = 1000;
+
+    /** Read the result of the query using a new connection, recording
+        the rows as they are received.  If keyColumn isn't empty, it is the
+        quoted name of the column whose value is used as the row name.
+    */
+    void importQuery(const PostgresqlImportConfig & config,
+                     const string & query,
+                     const string & keyColumn,
+                     Recorder & recorder) const
+    {
+        std::shared_ptr<pg_conn> conn(startConnection(config), PQfinish);
+
+        Rows rows;
+        size_t rowNum = 0;
+        int keyField = -1;
+
+        auto onRow = [&] (const PGresult * res)
+        {
+            int nfields = PQnfields(res);
+            if (!keyColumn.empty() && keyField == -1) {
+                keyField = PQfnumber(res, keyColumn.c_str());
+                if (keyField == -1) {
+                    throw HttpReturnException
+                        (400, "Partition column is not part of the result "
+                         "of the PostgreSQL query",
+                         "partitionColumn", config.partitionColumn);
+                }
+            }
+
+            std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
+            cols.reserve(nfields);
+            for (int j = 0; j < nfields; j++) {
+                cols.emplace_back(ColumnPath(PQfname(res, j)), getCellValueFromPostgres(res, 0, j), Date::Date::notADate());
+            }
+
+            if (keyField == -1)
+                rows.emplace_back(Path(string("row_" + std::to_string(rowNum))), std::move(cols));
+            else rows.emplace_back(Path(string(PQgetvalue(res, 0, keyField))), std::move(cols));
+            ++rowNum;
+
+            if (rows.size() == rowBatchSize) {
+                recorder.recordRowsDestructive(std::move(rows));
+                rows.clear();
+            }
+        };
+
+        streamPostgresqlQuery(conn.get(), query, onRow);
+
+        if (!rows.empty())
+            recorder.recordRowsDestructive(std::move(rows));
+    }
+
     virtual RunOutput run(const ProcedureRunConfig & run,
                           const std::function<bool (const Json::Value &)> & onProgress) const override
     {        
@@ -633,44 +961,86 @@ struct PostgresqlImportProcedure: public Procedure {
 
         auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
 
-        // Connect to Postgresl database
-        auto conn = startConnection(runProcConf);
-
         // Create the output
         std::shared_ptr<Dataset> output =
         createDataset(server, runProcConf.outputDataset, nullptr, true ); //overwrite
 
-        //query the rows
-        auto res = PQexec(conn, runProcConf.postgresqlQuery.c_str());
-        if (PQresultStatus(res) != PGRES_TUPLES_OK)
-        {
-            string errorMsg = PQresultErrorMessage(res);
-            PQclear(res);
-            PQfinish(conn);
-            throw HttpReturnException(400, "Could not query PostgreSQL database", errorMsg);
-        }
-
-        int nfields = PQnfields(res);
-        int ntuples = PQntuples(res);
+        Dataset::MultiChunkRecorder chunkRecorder = output->getChunkRecorder();
 
-        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
-        for(int i = 0; i < ntuples; i++) {
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
-            for(int j = 0; j < nfields; j++) {
-                cols.emplace_back(ColumnPath(PQfname(res, j)), getCellValueFromPostgres(res, i, j), Date::Date::notADate());
+        if (runProcConf.partitionColumn.empty()) {
+            auto recorder = chunkRecorder.newChunk(0);
+            importQuery(runProcConf, runProcConf.postgresqlQuery, "",
+                        *recorder);
+            recorder->finishedChunk();
+        }
+        else {
+            // Find the range of the partition column, to split it into
+            // one range per connection
+            std::shared_ptr<pg_conn> conn(startConnection(runProcConf), PQfinish);
+
+            std::unique_ptr<char, void (*) (void *)>
+                quoted(PQescapeIdentifier(conn.get(),
+                                          runProcConf.partitionColumn.c_str(),
+                                          runProcConf.partitionColumn.size()),
+                       PQfreemem);
+            if (!quoted) {
+                throw HttpReturnException(400, "Invalid partition column",
+                                          string(PQerrorMessage(conn.get())));
+            }
+            string key(quoted.get());
+            string subquery = "(" + runProcConf.postgresqlQuery + ") AS mldb_import";
+
+            string boundsQuery = "SELECT min(" + key + ")::int8, max("
+                + key + ")::int8 FROM " + subquery;
+            std::unique_ptr<PGresult, void (*) (PGresult *)>
+                bounds(PQexec(conn.get(), boundsQuery.c_str()), PQclear);
+            if (PQresultStatus(bounds.get()) != PGRES_TUPLES_OK) {
+                throw HttpReturnException(400, "Could not query PostgreSQL database",
+                                          string(PQresultErrorMessage(bounds.get())));
+            }
+            conn.reset();
+
+            // Both are null if there are no rows
+            if (!PQgetisnull(bounds.get(), 0, 0)) {
+                int64_t first = std::stoll(PQgetvalue(bounds.get(), 0, 0));
+                int64_t last = std::stoll(PQgetvalue(bounds.get(), 0, 1));
+
+                // The first and last ranges are left open, so that rows
+                // added in the meantime are still read
+                uint64_t width = uint64_t(last) - uint64_t(first);
+                size_t numRanges = runProcConf.numConnections;
+                if (width < numRanges)
+                    numRanges = width + 1;
+                uint64_t step = numRanges > 1 ? width / numRanges : 0;
+
+                auto doRange = [&] (size_t i)
+                {
+                    string query = "SELECT * FROM " + subquery;
+                    int64_t begin = uint64_t(first) + step * i;
+                    int64_t end = uint64_t(first) + step * (i + 1);
+                    if (numRanges == 1)
+                        ;
+                    else if (i == 0)
+                        query += " WHERE " + key + " < " + std::to_string(end);
+                    else if (i == numRanges - 1)
+                        query += " WHERE " + key + " >= " + std::to_string(begin);
+                    else query += " WHERE " + key + " >= " + std::to_string(begin)
+                             + " AND " + key + " < " + std::to_string(end);
+
+                    auto recorder = chunkRecorder.newChunk(i);
+                    importQuery(runProcConf, query, key, *recorder);
+                    recorder->finishedChunk();
+                };
+
+                parallelMap(0, numRanges, doRange);
             }
-            rows.emplace_back(Path(string("row_" + std::to_string(i))), std::move(cols));            
         }
 
-        output->recordRows(rows);
-
         // Save the dataset we created
-        output->commit();
+        chunkRecorder.commit();
 
         result = output->getStatus();
 
-        PQclear(res);
-        PQfinish(conn);
         return result;
     }
 };
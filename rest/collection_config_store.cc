@@ -9,6 +9,7 @@
 #include "mldb/rest/collection_config_store.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
 #include "mldb/vfs/filter_streams.h"
 
 
@@ -115,7 +116,16 @@ getAll() const
 {
     vector<pair<Utf8String, Json::Value> > result;
     for (const Utf8String & key: keys())
-        result.push_back(make_pair(key, get(key)));
+        result.emplace_back(key, Json::Value());
+
+    // Each entry is a separate object, which on S3 is a request of its own;
+    // reading them in parallel hides most of the latency at startup
+    auto readEntry = [&] (size_t i)
+        {
+            result[i].second = get(result[i].first);
+        };
+    parallelMap(0, result.size(), readEntry, 16 /* occupancy limit */);
+
     return result;
 }
 
@@ -0,0 +1,109 @@
+/** content_encoding.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Negotiation and application of the HTTP Content-Encoding of responses.
+*/
+
+#include "mldb/rest/content_encoding.h"
+#include "mldb/vfs/compressor.h"
+#include "mldb/arch/exception.h"
+#include <boost/algorithm/string.hpp>
+#include <cstdlib>
+#include <map>
+#include <memory>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Codings we can produce, fastest first
+const char * const SUPPORTED_ENCODINGS[] = { "zstd", "gzip" };
+
+} // file scope
+
+std::string
+chooseContentEncoding(const std::string & acceptEncoding)
+{
+    if (acceptEncoding.empty())
+        return "";
+
+    // Quality of each of the listed codings, and of "*" for the others
+    std::map<std::string, double> qualities;
+
+    vector<string> codings;
+    boost::split(codings, acceptEncoding, boost::is_any_of(","));
+
+    for (auto & c: codings) {
+        vector<string> params;
+        boost::split(params, c, boost::is_any_of(";"));
+
+        string name = boost::to_lower_copy(boost::trim_copy(params[0]));
+        if (name.empty())
+            continue;
+        if (name == "x-gzip")
+            name = "gzip";
+
+        double q = 1.0;
+        for (size_t i = 1;  i < params.size();  ++i) {
+            string param = boost::trim_copy(params[i]);
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q')
+                && param[1] == '=') {
+                q = strtod(param.c_str() + 2, nullptr);
+            }
+        }
+        qualities[name] = q;
+    }
+
+    for (const char * encoding: SUPPORTED_ENCODINGS) {
+        auto it = qualities.find(encoding);
+        if (it == qualities.end())
+            it = qualities.find("*");
+        if (it != qualities.end() && it->second > 0)
+            return encoding;
+    }
+
+    return "";
+}
+
+bool
+isCompressibleContentType(const std::string & contentType)
+{
+    string type = boost::to_lower_copy(contentType);
+    return type.find("text/") == 0
+        || type.find("json") != string::npos
+        || type.find("javascript") != string::npos
+        || type.find("xml") != string::npos
+        || type.find("application/x-www-form-urlencoded") == 0;
+}
+
+std::string
+encodeContent(const std::string & body,
+              const std::string & encoding,
+              int level)
+{
+    std::unique_ptr<Compressor> compressor
+        (Compressor::create(encoding, level));
+    if (!compressor)
+        throw MLDB::Exception("unknown content encoding '%s'",
+                              encoding.c_str());
+
+    std::string result;
+    auto onData = [&] (const char * data, size_t len) -> size_t
+        {
+            result.append(data, len);
+            return len;
+        };
+
+    compressor->compress(body.data(), body.size(), onData);
+    compressor->finish(onData);
+
+    return result;
+}
+
+} // namespace MLDB
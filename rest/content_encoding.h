@@ -0,0 +1,37 @@
+/** content_encoding.h                                             -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Negotiation and application of the HTTP Content-Encoding of responses.
+*/
+
+#pragma once
+
+#include <string>
+
+
+namespace MLDB {
+
+/** Return the content coding to use for a response to a request with the
+    given Accept-Encoding header.  This is the fastest of the codings we
+    can produce (zstd, then gzip) that the client accepts with a non-zero
+    quality, or the empty string for no encoding.
+*/
+std::string chooseContentEncoding(const std::string & acceptEncoding);
+
+/** Return whether a response with the given content type is worth
+    compressing.  Text, JSON, Javascript, XML and SVG are; images, archives
+    and other binary types usually are already compressed.
+*/
+bool isCompressibleContentType(const std::string & contentType);
+
+/** Compress a whole response body with the given content coding (as
+    returned by chooseContentEncoding()) and compression level.  Throws if
+    the coding is unknown.
+*/
+std::string encodeContent(const std::string & body,
+                          const std::string & encoding,
+                          int level);
+
+} // namespace MLDB
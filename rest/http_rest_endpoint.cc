@@ -10,15 +10,53 @@
 #include "mldb/base/exc_assert.h"
 #include "mldb/vfs/filter_streams.h"
 #include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include "mldb/io/tcp_acceptor.h"
 #include "http_rest_endpoint.h"
+#include "content_encoding.h"
 #include "mldb/utils/log.h"
+#include "mldb/jml/utils/environment.h"
 #include <iomanip>
 
 using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+/// Number of bytes of response that may be queued for a peer before the
+/// thread producing the response is made to wait for the peer to read it
+EnvOption<size_t> MLDB_HTTP_MAX_PENDING_WRITE_BYTES
+    ("MLDB_HTTP_MAX_PENDING_WRITE_BYTES", 4 * 1024 * 1024);
+
+/// Number of reactors (event loops with a thread pinned to a core) that
+/// accept and handle the connections; see TcpAcceptor.  Requests are
+/// handled on the reactor of their connection, so a slow request holds up
+/// the other connections of its reactor.  The default of 0 handles them on
+/// the thread pool of the service; -1 uses one reactor per core.
+EnvOption<int> MLDB_HTTP_REACTORS("MLDB_HTTP_REACTORS", 0);
+
+/// Responses with a compressible content type and a body at least this
+/// long are compressed with the fastest coding that the client accepts;
+/// 0 disables the compression.
+EnvOption<size_t> MLDB_HTTP_COMPRESSION_MIN_BYTES
+    ("MLDB_HTTP_COMPRESSION_MIN_BYTES", 1024);
+
+/// Compression level used for responses compressed on the fly.  This
+/// favours speed; precompressed static content uses higher levels.
+EnvOption<int> MLDB_HTTP_COMPRESSION_LEVEL("MLDB_HTTP_COMPRESSION_LEVEL", 1);
+
+bool hasHeader(const RestParams & headers, const std::string & name)
+{
+    for (auto & h: headers) {
+        if (boost::iequals(h.first, name))
+            return true;
+    }
+    return false;
+}
+
+} // file scope
+
 /****************************************************************************/
 /* HTTP REST ENDPOINT                                                       */
 /****************************************************************************/
@@ -29,7 +67,8 @@ HttpRestEndpoint(EventLoop & eventLoop, bool enableLogging)
     auto makeHandler = [&, enableLogging] (TcpSocket && socket) {
         return make_shared<RestConnectionHandler>(this, std::move(socket), enableLogging);
     };
-    acceptor_.reset(new TcpAcceptor(eventLoop, makeHandler));
+    acceptor_.reset(new TcpAcceptor(eventLoop, makeHandler,
+                                    MLDB_HTTP_REACTORS));
 }
 
 HttpRestEndpoint::
@@ -214,6 +253,20 @@ sendResponse(int code,
     for (auto & h: endpoint->extraHeaders)
         headers.push_back(h);
 
+    size_t minBytes = MLDB_HTTP_COMPRESSION_MIN_BYTES;
+    if (minBytes > 0 && body.size() >= minBytes
+        && isCompressibleContentType(contentType)
+        && !hasHeader(headers, "Content-Encoding")) {
+        std::string encoding
+            = chooseContentEncoding(httpHeader.tryGetHeader("accept-encoding"));
+        if (!encoding.empty()) {
+            body = encodeContent(body, encoding, MLDB_HTTP_COMPRESSION_LEVEL);
+            headers.push_back({"Content-Encoding", encoding});
+        }
+        if (!hasHeader(headers, "Vary"))
+            headers.push_back({"Vary", "Accept-Encoding"});
+    }
+
     logRequest(code);
     putResponseOnWire(HttpResponse(code,
                                    std::move(contentType), std::move(body),
@@ -246,7 +299,31 @@ sendHttpChunk(std::string chunk,
               NextAction next,
               OnWriteFinished onWriteFinished)
 {
-    HttpLegacySocketHandler::send(std::move(chunk), next, onWriteFinished);
+    // Each chunk is its length in hex, followed by the data; an empty
+    // chunk terminates the body
+    char header[32];
+    int headerLength = snprintf(header, sizeof(header), "%zx\r\n",
+                                chunk.size());
+
+    std::string framed;
+    framed.reserve(headerLength + chunk.size() + 4);
+    framed.append(header, headerLength);
+    framed.append(chunk);
+    framed.append("\r\n");
+    if (chunk.empty())
+        framed.append("\r\n");  // no trailers
+
+    HttpLegacySocketHandler::send(std::move(framed), next, onWriteFinished);
+
+    if (!chunk.empty())
+        waitForPeer();
+}
+
+void
+HttpRestEndpoint::RestConnectionHandler::
+waitForPeer()
+{
+    waitForWriteSpace(MLDB_HTTP_MAX_PENDING_WRITE_BYTES);
 }
 
 inline void
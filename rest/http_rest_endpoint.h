@@ -96,12 +96,20 @@ struct HttpRestEndpoint {
                                 std::string contentType,
                                 RestParams headers = RestParams());
 
-        /** Send an HTTP chunk with the appropriate headers back down the
-            wire. */
+        /** Send an HTTP chunk with the appropriate framing back down the
+            wire.  An empty chunk terminates the body.  Like waitForPeer(),
+            this blocks while too much data is waiting to be sent.
+        */
         void sendHttpChunk(std::string chunk,
                            NextAction next = NEXT_CONTINUE,
                            OnWriteFinished onWriteFinished = OnWriteFinished());
 
+        /** Block until the amount of data waiting to be sent to the peer
+            is below MLDB_HTTP_MAX_PENDING_WRITE_BYTES, so that a response
+            being streamed doesn't get ahead of the client reading it.
+        */
+        void waitForPeer();
+
     private:
         void logRequest(int code) const;
         HttpHeader httpHeader;
@@ -15,6 +15,7 @@
 #include "http_rest_endpoint.h"
 #include "http_rest_service.h"
 #include "mldb/utils/log.h"
+#include "mldb/arch/metrics.h"
 
 using namespace std;
 
@@ -40,6 +41,7 @@ sendResponse(int responseCode, std::string response, std::string contentType)
                        std::move(response), std::move(contentType));
     
     responseSent_ = true;
+    recordResponse(responseCode);
 }
 
 void
@@ -62,6 +64,7 @@ sendResponse(int responseCode,
     http->sendResponse(responseCode, response, std::move(contentType));
     
     responseSent_ = true;
+    recordResponse(responseCode);
 }
 
 void
@@ -82,6 +85,7 @@ sendErrorResponse(int responseCode, string error, string contentType)
     http->sendResponse(responseCode, std::move(error));
 
     responseSent_ = true;
+    recordResponse(responseCode);
 }
 
 void
@@ -101,6 +105,7 @@ sendErrorResponse(int responseCode, const Json::Value & error)
     http->sendResponse(responseCode, error);
 
     responseSent_ = true;
+    recordResponse(responseCode);
 }
 
 void
@@ -118,6 +123,7 @@ sendRedirect(int responseCode, std::string location)
                        { { "Location", std::move(location) } });
 
     responseSent_ = true;
+    recordResponse(responseCode);
 }
 
 void
@@ -136,6 +142,7 @@ sendHttpResponse(int responseCode,
     http->sendResponse(responseCode, std::move(response), std::move(contentType),
                        std::move(headers));
     responseSent_ = true;
+    recordResponse(responseCode);
 }
 
 void
@@ -165,10 +172,63 @@ sendHttpResponseHeader(int responseCode,
         keepAlive = false;
     }
 
+    headerCode = responseCode;
+
     http->sendResponseHeader(responseCode,
                              std::move(contentType), std::move(headers));
 }
 
+namespace {
+
+/// Latency histograms by verb and class of response code.  The resource
+/// isn't used as a label, as it would make far too many series.
+struct ResponseMetrics {
+    static constexpr int NUM_VERBS = 5;
+    static constexpr int NUM_CLASSES = 5;
+
+    ResponseMetrics()
+    {
+        static const char * verbs[NUM_VERBS]
+            = { "GET", "PUT", "POST", "DELETE", "other" };
+        static const char * classes[NUM_CLASSES]
+            = { "1xx", "2xx", "3xx", "4xx", "5xx" };
+        for (int i = 0;  i < NUM_VERBS;  ++i) {
+            for (int j = 0;  j < NUM_CLASSES;  ++j) {
+                histograms[i][j] = &MetricsRegistry::global().histogram
+                    ("mldb_http_request_duration_seconds",
+                     "Time from receiving an HTTP request to sending its "
+                     "response",
+                     { { "method", verbs[i] }, { "code", classes[j] } });
+            }
+        }
+    }
+
+    MetricHistogram * histograms[NUM_VERBS][NUM_CLASSES];
+
+    static int verbIndex(const std::string & verb)
+    {
+        if (verb == "GET")     return 0;
+        if (verb == "PUT")     return 1;
+        if (verb == "POST")    return 2;
+        if (verb == "DELETE")  return 3;
+        return 4;
+    }
+};
+
+} // file scope
+
+void
+HttpRestConnection::
+recordResponse(int responseCode) const
+{
+    static ResponseMetrics metrics;
+    int codeClass = std::min(std::max(responseCode / 100 - 1, 0),
+                             ResponseMetrics::NUM_CLASSES - 1);
+    double seconds = startDate.secondsUntil(Date::now());
+    metrics.histograms[ResponseMetrics::verbIndex(verb)][codeClass]
+        ->record(std::max(0.0, seconds) * 1e9);
+}
+
 bool
 HttpRestConnection::
 isConnected()
@@ -187,7 +247,10 @@ sendPayload(std::string payload)
         }
         http->sendHttpChunk(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE);
     }
-    else http->send(std::move(payload));
+    else {
+        http->send(std::move(payload));
+        http->waitForPeer();
+    }
 }
 
 void
@@ -195,7 +258,7 @@ HttpRestConnection::
 finishResponse()
 {
     if (chunkedEncoding) {
-        http->sendHttpChunk("", HttpLegacySocketHandler::NEXT_CLOSE);
+        http->sendHttpChunk("", HttpLegacySocketHandler::NEXT_RECYCLE);
     }
     else if (!keepAlive) {
         http->send("", HttpLegacySocketHandler::NEXT_CLOSE);
@@ -204,6 +267,7 @@ finishResponse()
     }
 
     responseSent_ = true;
+    recordResponse(headerCode);
 }
 
 std::shared_ptr<RestConnection>
@@ -273,6 +337,7 @@ init()
         {
             std::string requestId = this->getHttpRequestId();
             HttpRestConnection restConnection(connection, requestId, this);
+            restConnection.verb = header.verb;
             this->doHandleRequest(restConnection,
                                   RestRequest(header, payload));
         };
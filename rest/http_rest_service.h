@@ -51,7 +51,8 @@ struct HttpRestConnection: public RestConnection {
           responseSent_(false),
           startDate(Date::now()),
           chunkedEncoding(false),
-          keepAlive(true)
+          keepAlive(true),
+          headerCode(0)
     {
     }
 
@@ -62,6 +63,8 @@ struct HttpRestConnection: public RestConnection {
     Date startDate;
     bool chunkedEncoding;
     bool keepAlive;
+    std::string verb;  ///< Of the request, for the metrics
+    int headerCode;    ///< Code of a header sent by sendHttpResponseHeader
 
     /** Data that is maintained with the connection.  This is where control
         data required for asynchronous or long-running connections can be
@@ -127,6 +130,12 @@ struct HttpRestConnection: public RestConnection {
 
     virtual std::shared_ptr<RestConnection>
     captureInConnection(std::shared_ptr<void> piggyBack);
+
+private:
+    /** Record the latency of the request into the metrics, once its
+        response has been sent.
+    */
+    void recordResponse(int responseCode) const;
 };
 
 
@@ -188,6 +188,17 @@ public:
         }
     };
 
+    /** Register a type that the plugin with the given name provides
+        without loading the plugin, which is only done by calling load()
+        the first time that the type is used.  The plugin must register
+        the type itself when it is loaded.  Releasing the returned handle
+        forgets the type if it's still waiting to be loaded.
+    */
+    static std::shared_ptr<void>
+    registerDeferredType(const Utf8String & name,
+                         const Utf8String & provider,
+                         std::function<void ()> load);
+
     static RestRequestMatchResult
     handleDocRequest(RestDirectory * server,
                      const Utf8String & type,
@@ -185,6 +185,14 @@ struct PolyCollection<Entity>::Registry {
     std::map<Utf8String, Entry> registry;
     WatchesT<Utf8String> watches;
 
+    /// A type whose plugin hasn't been loaded yet
+    struct Deferred {
+        Utf8String provider;
+        std::function<void ()> load;
+    };
+
+    std::map<Utf8String, Deferred> deferred;
+
     void insert(const Utf8String & name,
                 const Utf8String & description,
                 const CreateEntity & createEntity,
@@ -197,17 +205,67 @@ struct PolyCollection<Entity>::Registry {
         if (!registry.insert(std::make_pair(name, Entry{ description, createEntity, docRoute, customRoute, config, registryFlags })).second) {
             throw HttpReturnException(400, "double-registering type " + name);
         }
+        // Watchers already know about deferred types
+        if (!deferred.erase(name))
+            watches.trigger(name);
+    }
+
+    void insertDeferred(const Utf8String & name,
+                        const Utf8String & provider,
+                        std::function<void ()> load)
+    {
+        std::unique_lock<std::recursive_mutex> guard(mutex);
+        if (registry.count(name))
+            return;
+        if (!deferred.insert(std::make_pair(name, Deferred{ provider, std::move(load) })).second)
+            throw HttpReturnException(400, "double-registering type " + name);
         watches.trigger(name);
     }
-    
-    const CreateEntity & lookup(const Utf8String & type)
+
+    void eraseDeferred(const Utf8String & name)
+    {
+        std::unique_lock<std::recursive_mutex> guard(mutex);
+        deferred.erase(name);
+    }
+
+    /** Return the entry of the given type, loading the plugin that
+        provides it first if that hasn't been done yet.
+    */
+    typename std::map<Utf8String, Entry>::iterator
+    find(const Utf8String & type)
     {
         std::unique_lock<std::recursive_mutex> guard(mutex);
         auto it = registry.find(type);
-        if (it == registry.end())
+        if (it != registry.end())
+            return it;
+
+        auto dit = deferred.find(type);
+        if (dit == deferred.end())
             throw HttpReturnException(400, "couldn't find type '" + type
                                       + "' in registry");
-        return it->second.create;
+
+        // Loading registers the plugin's types, which must happen
+        // without holding the lock as they may have other registries
+        // to register into
+        auto load = dit->second.load;
+        Utf8String provider = dit->second.provider;
+        guard.unlock();
+        load();
+        guard.lock();
+
+        it = registry.find(type);
+        if (it == registry.end()) {
+            deferred.erase(type);
+            throw HttpReturnException(400, "plugin '" + provider
+                                      + "' didn't register type '" + type
+                                      + "' which its manifest says it provides");
+        }
+        return it;
+    }
+
+    const CreateEntity & lookup(const Utf8String & type)
+    {
+        return find(type)->second.create;
     }
 
     RestRequestMatchResult
@@ -217,16 +275,7 @@ struct PolyCollection<Entity>::Registry {
                      const RestRequest & req,
                      const RestRequestParsingContext & cxt)
     {
-        std::unique_lock<std::recursive_mutex> guard(mutex);
-
-        using namespace std;
-        //cerr << "cxt.resources = " << cxt.resources << endl;
-
-        auto it = registry.find(type);
-        if (it == registry.end())
-            throw HttpReturnException(400, "couldn't find type '"
-                                      + type + "' in registry");
-        guard.unlock();
+        auto it = find(type);
 
         if (!it->second.docRoute) {
             connection.sendErrorResponse(404, "type " + type + " has no documentation registered");
@@ -241,13 +290,23 @@ struct PolyCollection<Entity>::Registry {
         try {
             std::unique_lock<std::recursive_mutex> guard(mutex);
 
+            Json::Value result;
+
+            // Listing types doesn't load the plugins of deferred ones
+            auto dit = deferred.find(type);
+            if (dit != deferred.end()) {
+                result["docRoute"] = "/v1/types/" + nounPlural + "/" + type + "/doc";
+                result["description"] = "Provided by plugin '"
+                    + dit->second.provider + "', which is loaded on first use";
+                result["flags"] = Json::Value(Json::arrayValue);
+                return result;
+            }
+
             auto it = registry.find(type);
             if (it == registry.end())
                 throw HttpReturnException(400, "couldn't find type '" + type
                                           + "' in registry");
             guard.unlock();
-
-            Json::Value result;
         
             if (it->second.configValueDescription) {
 
@@ -292,16 +351,7 @@ struct PolyCollection<Entity>::Registry {
                         const RestRequest & req,
                         const RestRequestParsingContext & cxt)
     {
-        std::unique_lock<std::recursive_mutex> guard(mutex);
-        
-        using namespace std;
-        //cerr << "cxt.resources = " << cxt.resources << endl;
-        
-        auto it = registry.find(type);
-        if (it == registry.end())
-            throw HttpReturnException(400, "couldn't find type '" + type
-                                      + "' in registry");
-        guard.unlock();
+        auto it = find(type);
 
         if (!it->second.customRoute) {
             connection.sendErrorResponse(404, "type " + type + " has no custom route handler registered");
@@ -316,6 +366,8 @@ struct PolyCollection<Entity>::Registry {
         std::vector<Utf8String> result;
         for (auto & r: registry)
             result.push_back(r.first);
+        for (auto & d: deferred)
+            result.push_back(d.first);
         return result;
     }
 
@@ -356,6 +408,21 @@ registerType(const Package & package,
     return nullptr;
 }
 
+template<typename Entity>
+std::shared_ptr<void>
+PolyCollection<Entity>::
+registerDeferredType(const Utf8String & name,
+                     const Utf8String & provider,
+                     std::function<void ()> load)
+{
+    getRegistry().insertDeferred(name, provider, std::move(load));
+    auto unregister = [=] (void *)
+        {
+            getRegistry().eraseDeferred(name);
+        };
+    return std::shared_ptr<void>(nullptr, unregister);
+}
+
 template<typename Entity>
 std::shared_ptr<Entity>
 PolyCollection<Entity>::
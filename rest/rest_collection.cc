@@ -646,7 +646,7 @@ initRoutes(RouteManager & manager)
 
 BackgroundTaskBase::
 BackgroundTaskBase()
-    : running(true), state(State::INITIALIZING)
+    : running(true), state(State::INITIALIZING), restoring(false)
 {
 }
 
@@ -677,6 +677,9 @@ cancel()
     }
     // cerr << "state is now CANCELLED " << handle << endl;
 
+    // A task that hasn't started yet finishes straight away as cancelled
+    start();
+
 #if 0
     // Give it one second to stop
     struct timespec timeToWait = { 1, 0 };
@@ -705,6 +708,36 @@ cancel()
     return old_state != State::CANCELLED;
 }
 
+void
+BackgroundTaskBase::
+deferStart(std::function<void ()> startFn)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    deferredStart = std::move(startFn);
+}
+
+void
+BackgroundTaskBase::
+start()
+{
+    std::function<void ()> startFn;
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        startFn.swap(deferredStart);
+    }
+    if (startFn)
+        startFn();
+}
+
+void
+BackgroundTaskBase::
+waitUntilFinished() const
+{
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
 void
 BackgroundTaskBase::
 setError(std::exception_ptr exc)
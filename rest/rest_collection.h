@@ -150,12 +150,31 @@ struct BackgroundTaskBase {
 
     Utf8String getState() const;
 
+    /** Hold off starting the task until start() is called; the given
+        function is what starts it.
+    */
+    void deferStart(std::function<void ()> startFn);
+
+    /** Start the task if its start was deferred.  Does nothing if it has
+        already been started.  May be called from multiple threads.
+    */
+    void start();
+
+    /** Block until the task is no longer running. */
+    void waitUntilFinished() const;
+
     typedef std::function<bool (const Json::Value &)> OnProgress;
 
     /** A task is running until it is CANCELLED, FINISHED or in ERROR state */
     std::atomic<bool>  running;
     std::atomic<State> state;
     WatchesT<bool> cancelledWatches;
+
+    /** The task restores an entry from the config store.  Instead of
+        finding it not ready, whatever needs the entry waits for it to be
+        restored, starting it first if it was deferred.
+    */
+    std::atomic<bool> restoring;
     
     /// Everything below here is protected by this mutex
     mutable std::mutex mutex;
@@ -163,6 +182,7 @@ struct BackgroundTaskBase {
     Json::Value progress;
     std::vector<OnProgress> onProgressFunctions;
     int64_t handle;  ///< Handle of the thread running task
+    std::function<void ()> deferredStart;  ///< Starts the task if deferred
 };
 
 
@@ -310,6 +330,13 @@ struct RestCollection : public RestCollectionBase {
                                                  WatchT<bool> cancel)>
         BackgroundThreadFunction;
 
+    /** How a background job is started. */
+    enum StartMode {
+        START_NOW,         ///< Start it straight away
+        RESTORE,           ///< Start it now; users of the entry wait for it
+        RESTORE_ON_ACCESS  ///< Start it when the entry is first needed
+    };
+
     /** Causes the given background job to be started in a thread.  The given
         progress function will be added to those updated on progress.  Once the
         job is finished, the given onDone function will be called unless null.
@@ -328,7 +355,8 @@ struct RestCollection : public RestCollectionBase {
                                   const OnProgress & onProgress = nullptr,
                                   const OnDone & onDone = nullptr,
                                   bool mustBeNewEntry = false,
-                                  Any config = Any());
+                                  Any config = Any(),
+                                  StartMode startMode = START_NOW);
 
     void finishedBackgroundJob(Key key,
                                std::shared_ptr<BackgroundTask> task,
@@ -441,6 +469,12 @@ protected:
     struct Impl;
     std::unique_ptr<Impl> impl;
 
+    /** Wait for the given task that restores the entry to finish, and
+        return the entry or throw the error that stopped it.
+    */
+    std::shared_ptr<Value>
+    waitForRestore(const Key & key, BackgroundTask & task) const;
+
     void throwEntryAlreadyExists(const Key & key) const MLDB_NORETURN;
     void throwEntryNotReady(const Key & key) const MLDB_NORETURN;
     void throwEntryDoesntExist(const Key & key) const MLDB_NORETURN;
@@ -488,8 +522,12 @@ struct RestConfigurableCollection: public RestCollection<Key, Value> {
 
     /** Load up any existing entities, getting them and their configuration from
         the store configured via attachConfig.
+
+        Entities are constructed in the background, all at once; one that
+        needs another waits for it to be constructed.  If onFirstAccess is
+        true, each one is only constructed when it's first needed.
     */
-    virtual void loadConfig();
+    virtual void loadConfig(bool onFirstAccess = false);
 
     /** Return whether this object has required persistence.  Default
         implementation returns true.
@@ -11,6 +11,7 @@
 #include "rest_collection.h"
 #include "mldb/watch/watch_impl.h"
 #include "mldb/arch/rcu_protected.h"
+#include "mldb/arch/epoch_lock.h"
 #include <future>
 #include "collection_config_store.h"
 #include "mldb/types/utility_descriptions.h"
@@ -66,8 +67,8 @@ struct RestCollection<Key, Value>::Impl {
     {
     }
 
-    mutable GcLock entriesLock;
-    RcuProtected<Entries> entries;
+    mutable EpochLock entriesLock;
+    RcuProtected<Entries, EpochLock> entries;
 
     /// Watches on the children
     WatchesT<ChildEvent> childWatches;
@@ -418,7 +419,7 @@ getKeys() const
     std::vector<Key> result;
 
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     auto es = impl->entries.getImmutable();
     for (auto & e: *es) {
@@ -433,7 +434,7 @@ RestCollection<Key, Value>::
 size() const
 {
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     auto es = impl->entries.getImmutable();
     return es->size();
@@ -445,7 +446,7 @@ RestCollection<Key, Value>::
 empty() const
 {
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     auto es = impl->entries.getImmutable();
     return es->empty();
@@ -520,12 +521,13 @@ addBackgroundJobInThread(Key key,
                          const OnProgress & onProgress,
                          const OnDone & onDone,
                          bool mustBeNewEntry,
-                         Any config)
+                         Any config,
+                         StartMode startMode)
 {
     using namespace std;
 
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     for (;;) {
         auto oldEntries = impl->entries();
@@ -545,6 +547,15 @@ addBackgroundJobInThread(Key key,
 
                 ExcAssert(task);
 
+                // A restore that hasn't been started is simply abandoned
+                bool notStarted;
+                {
+                    std::unique_lock<std::mutex> guard(task->mutex);
+                    notStarted = !!task->deferredStart;
+                }
+                if (notStarted)
+                    task->cancel();
+
                 std::unique_lock<std::mutex> guard(task->mutex);
 
                 // MLDB-748 - bail out if the task is not completed
@@ -606,28 +617,52 @@ addBackgroundJobInThread(Key key,
                 this->finishedBackgroundJob(std::move(keyCopy), std::move(taskCopy), mustBeNewEntry);
             };
 
+        auto startThread = [=] ()
+            {
+                // Cancelled before it was started, so there's nothing to run
+                if (task->state == BackgroundTaskBase::State::CANCELLED) {
+                    task->setFinished();
+                    auto taskCopy = task;
+                    Key keyCopy = key;
+                    this->finishedBackgroundJob(std::move(keyCopy), std::move(taskCopy), mustBeNewEntry);
+                    return;
+                }
+
+                std::thread thread(toRun);
+
+                auto handle = thread.native_handle();
+
+                task->setHandle(handle);
+
+                // The thread runs independently and cleans itself up
+                thread.detach();
+            };
+
         auto & entry = (*newEntries)[key];
         entry.underConstruction = task;
 
         if (onDone)
             task->onDoneFunctions.push_back(onDone);
 
+        task->restoring = startMode != START_NOW;
+
+        // It must be deferred before the task is visible, so that whoever
+        // needs it first can start it
+        if (startMode == RESTORE_ON_ACCESS)
+            task->deferStart(startThread);
+
         std::atomic_thread_fence(std::memory_order_release);
 
         if (impl->entries.cmp_xchg(oldEntries, newEntries, true)) {
             // Now we can start the task, since the commit succeeded
-            std::thread thread(toRun);
-
-            auto handle = thread.native_handle();
-
-            task->setHandle(handle);
-
-            // The thread runs independently and cleans itself up
-            thread.detach();
+            if (startMode != RESTORE_ON_ACCESS)
+                startThread();
             return;
         }
 
         // RCU failed because something raced us to update.  Try again.
+        // The deferred start refers to the task, so it must be let go of.
+        task->deferStart(nullptr);
     }
 }
 
@@ -692,7 +727,7 @@ addEntryItl(Key key,
         return false;
 
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     for (;;) {
         auto oldEntries = impl->entries();
@@ -758,7 +793,7 @@ replaceEntryItl(Key key,
         return false;
 
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     for (;;) {
         auto oldEntries = impl->entries();
@@ -812,7 +847,7 @@ deleteEntry(Key key)
     std::unique_lock<typename Impl::MutateMutex> mutateGuard(impl->mutateMutex);
 
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     for (;;) {
         auto oldEntries = impl->entries();
@@ -877,6 +912,10 @@ getEntry(Key key) const
 {
     auto v = tryGetEntry(key);
 
+    // Asking for an entry that's restored on first access restores it
+    if (v.second && v.second->restoring)
+        v.second->start();
+
     if (v.first || v.second)
         return v;
 
@@ -897,7 +936,7 @@ RestCollection<Key, Value>::
 tryGetEntry(Key key) const
 {
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     auto es = impl->entries.getImmutable();
 
@@ -913,19 +952,28 @@ std::shared_ptr<Value>
 RestCollection<Key, Value>::
 getExistingEntry(Key key) const
 {
-    // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    std::shared_ptr<BackgroundTask> task;
+    {
+        // NOTE: Should not be necessary... investigation needed
+        EpochLock::SharedGuard guard(impl->entriesLock);
 
-    auto es = impl->entries.getImmutable();
+        auto es = impl->entries.getImmutable();
 
-    auto it = es->find(key);
-    if (it != es->end() && it->second.value)
-        return it->second.value;
+        auto it = es->find(key);
+        if (it != es->end() && it->second.value)
+            return it->second.value;
 
-    if (it != es->end())
-        this->throwEntryNotReady(key);
-    else
-        this->throwEntryDoesntExist(key);
+        if (it == es->end())
+            this->throwEntryDoesntExist(key);
+
+        task = it->second.underConstruction;
+    }
+
+    // Wait outside of the lock, as restoring may take a while
+    if (task && task->restoring)
+        return waitForRestore(key, *task);
+
+    this->throwEntryNotReady(key);
 }
 
 template<typename Key, class Value>
@@ -933,16 +981,61 @@ std::shared_ptr<Value>
 RestCollection<Key, Value>::
 tryGetExistingEntry(Key key) const
 {
-    // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    std::shared_ptr<BackgroundTask> task;
+    {
+        // NOTE: Should not be necessary... investigation needed
+        EpochLock::SharedGuard guard(impl->entriesLock);
 
-    auto es = impl->entries.getImmutable();
+        auto es = impl->entries.getImmutable();
 
-    auto it = es->find(key);
-    if (it != es->end())
-        return it->second.value;
+        auto it = es->find(key);
+        if (it == es->end())
+            return nullptr;
+        if (it->second.value)
+            return it->second.value;
 
-    return nullptr;
+        task = it->second.underConstruction;
+    }
+
+    if (!task || !task->restoring)
+        return nullptr;
+
+    try {
+        return waitForRestore(key, *task);
+    } MLDB_CATCH_ALL {
+        return nullptr;
+    }
+}
+
+template<typename Key, class Value>
+std::shared_ptr<Value>
+RestCollection<Key, Value>::
+waitForRestore(const Key & key, BackgroundTask & task) const
+{
+    task.start();
+    task.waitUntilFinished();
+
+    if (task.value && task.state == BackgroundTaskBase::State::FINISHED)
+        return task.value;
+
+    std::exception_ptr exc;
+    {
+        std::unique_lock<std::mutex> guard(task.mutex);
+        exc = task.exc;
+    }
+
+    if (!exc)
+        this->throwEntryNotReady(key);
+
+    try {
+        std::rethrow_exception(exc);
+    } MLDB_CATCH_ALL {
+        rethrowHttpException(-1, nounSingular + " entry '"
+                             + restEncode(key) + "' could not be restored: "
+                             + getExceptionString(),
+                             "collection", this->nounPlural,
+                             "entry", key);
+    }
 }
 
 template<typename Key, class Value>
@@ -976,7 +1069,7 @@ RestCollection<Key, Value>::
 forEachEntry(const std::function<bool (Key key, Value & value)> & fn)
 {
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     auto es = impl->entries.getImmutable();
 
@@ -999,7 +1092,7 @@ RestCollection<Key, Value>::
 forEachEntry(const std::function<bool (Key key, const Value & value)> & fn) const
 {
     // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    EpochLock::SharedGuard guard(impl->entriesLock);
 
     auto es = impl->entries.getImmutable();
     for (auto & e: *es) {
@@ -1077,7 +1170,7 @@ watchElements(const Utf8String & spec, bool catchUp, Any info)
     // entry causing problems.  We need a better way to ask for this.
     if (spec == "*" || true) {
 
-        GcLock::SharedGuard guard(impl->entriesLock);
+        EpochLock::SharedGuard guard(impl->entriesLock);
         auto es = impl->entries.getImmutable();
 
         for (auto & e: *es) {
@@ -1384,7 +1477,7 @@ mustCreateSync(Config config,
     {
         // NOTE: Should not be necessary... investigation needed.  See
         // the comment above.
-        GcLock::SharedGuard guard(this->impl->entriesLock);
+        EpochLock::SharedGuard guard(this->impl->entriesLock);
 
         auto es = this->impl->entries.getImmutable();
 
@@ -1737,14 +1830,30 @@ template<typename Key, typename Value,
          typename Config, typename Status>
 void
 RestConfigurableCollection<Key, Value, Config, Status>::
-loadConfig()
+loadConfig(bool onFirstAccess)
 {
     if (!configStore) return;
 
     for (const auto & key_config: configStore->getAll()) {
         Key key = restDecode(key_config.first, (Key *)0);
         Config config = jsonDecode<Config>(key_config.second);
-        handlePut(key, config, false);
+
+        if (!backgroundCreate) {
+            handlePut(key, config, false);
+            continue;
+        }
+
+        // It's already in the store, so unlike a PUT there's nothing to save
+        setKey(config, key);
+        auto savedConfig = jsonEncode(config);
+        auto fn = std::bind(
+                &RestConfigurableCollection::constructCancellable,
+                this, std::move(config), std::placeholders::_1, std::placeholders::_2);
+        this->addBackgroundJobInThread(key, fn, nullptr, nullptr,
+                                       false /* must be new */, savedConfig,
+                                       onFirstAccess
+                                       ? Base::RESTORE_ON_ACCESS
+                                       : Base::RESTORE);
     }
 }
 
@@ -1940,7 +2049,7 @@ watchConfig(const Utf8String & spec, bool catchUp, Any info)
     // in an event between when it was created and when it was caught up
     auto res = configWatches.add(std::move(info), filter);
 
-    GcLock::SharedGuard guard(this->impl->entriesLock);
+    EpochLock::SharedGuard guard(this->impl->entriesLock);
 
     auto es = this->impl->entries.getImmutable();
     for (auto & e: *es) {
@@ -1987,7 +2096,7 @@ watchStatus(const Utf8String & spec, bool catchUp, Any info)
     // in an event between when it was created and when it was caught up
     auto res = statusWatches.add(std::move(info), filter);
 
-    GcLock::SharedGuard guard(this->impl->entriesLock);
+    EpochLock::SharedGuard guard(this->impl->entriesLock);
 
     auto es = this->impl->entries.getImmutable();
     for (auto & e: *es) {
@@ -30,25 +30,28 @@ namespace MLDB {
 
 PathSpec::
 PathSpec()
-    : type(NONE)
+    : type(NONE), match(MATCH_REGEX), captures(false), nonEmpty(false)
 {
 }
         
 PathSpec::
 PathSpec(const std::string & fullPath)
-    : type(STRING), path(fullPath)
+    : type(STRING), path(fullPath), match(MATCH_REGEX),
+      prefix(fullPath), captures(false), nonEmpty(false)
 {
 }
 
 PathSpec::
 PathSpec(const Utf8String & fullPath)
-    : type(STRING), path(fullPath)
+    : type(STRING), path(fullPath), match(MATCH_REGEX),
+      prefix(fullPath.rawString()), captures(false), nonEmpty(false)
 {
 }
 
 PathSpec::
 PathSpec(const char * fullPath)
-    : type(STRING), path(fullPath)
+    : type(STRING), path(fullPath), match(MATCH_REGEX),
+      prefix(fullPath), captures(false), nonEmpty(false)
 {
 }
 
@@ -56,8 +59,68 @@ PathSpec::
 PathSpec(Regex rex)
     : type(REGEX),
       path(rex.surface()),
-      rex(std::move(rex))
+      rex(std::move(rex)),
+      match(MATCH_REGEX),
+      captures(false),
+      nonEmpty(false)
 {
+    compile();
+}
+
+void
+PathSpec::
+compile()
+{
+    static const char * META = "\\^$.|?*+()[]{}";
+
+    const std::string & surface = path.rawString();
+
+    size_t literalEnd = surface.find_first_of(META);
+    if (literalEnd == std::string::npos)
+        literalEnd = surface.size();
+    std::string literal(surface, 0, literalEnd);
+    std::string rest(surface, literalEnd);
+
+    if (rex.flags() == Regex::DEFAULT_FLAGS) {
+        if (rest == "([^/]*)" || rest == "([^/]+)") {
+            match = MATCH_SEGMENT;
+            prefix = literal;
+            captures = true;
+            nonEmpty = rest == "([^/]+)";
+            return;
+        }
+        if (rest == ".*") {
+            match = MATCH_REST;
+            prefix = literal;
+            return;
+        }
+        if (rest.size() >= 4 && rest[0] == '('
+            && rest.compare(rest.size() - 3, 3, ".*)") == 0) {
+            std::string inner(rest, 1, rest.size() - 4);
+            if (inner.find_first_of(META) == std::string::npos) {
+                match = MATCH_REST;
+                prefix = literal;
+                groupPrefix = inner;
+                captures = true;
+                return;
+            }
+        }
+    }
+
+    // Fall back to the regex.  Only keep a prefix that every match must
+    // start with: none if there is an alternation or special flags, and
+    // not the last literal character if it's the subject of a quantifier.
+    match = MATCH_REGEX;
+    if (rex.flags() != Regex::DEFAULT_FLAGS
+        || surface.find('|') != std::string::npos) {
+        prefix.clear();
+    }
+    else {
+        if (!literal.empty() && !rest.empty()
+            && (rest[0] == '*' || rest[0] == '?' || rest[0] == '{'))
+            literal.resize(literal.size() - 1);
+        prefix = literal;
+    }
 }
 
 void
@@ -347,6 +410,71 @@ EnvOption<bool, true> TRACE_REST_REQUESTS("TRACE_REST_REQUESTS", false);
 
 } // file scope
 
+struct RestRequestRouter::RouteIndex {
+    RouteIndex(const std::vector<Route> & routes)
+        : numRoutes(routes.size()), nodes(1)
+    {
+        for (unsigned i = 0;  i < routes.size();  ++i) {
+            int node = 0;
+            for (char c: routes[i].path.prefix) {
+                auto it = nodes[node].children.find(c);
+                if (it == nodes[node].children.end()) {
+                    int child = nodes.size();
+                    nodes[node].children[c] = child;
+                    nodes.emplace_back();
+                    node = child;
+                }
+                else node = it->second;
+            }
+            nodes[node].routes.push_back(i);
+        }
+    }
+
+    /** Return the indexes of the routes whose prefix the given path starts
+        with, in the order in which they were added.
+    */
+    std::vector<unsigned> candidates(const std::string & path) const
+    {
+        std::vector<unsigned> result(nodes[0].routes);
+        int node = 0;
+        bool needSort = false;
+        for (char c: path) {
+            auto it = nodes[node].children.find(c);
+            if (it == nodes[node].children.end())
+                break;
+            node = it->second;
+            if (!nodes[node].routes.empty()) {
+                needSort = needSort || !result.empty();
+                result.insert(result.end(), nodes[node].routes.begin(),
+                              nodes[node].routes.end());
+            }
+        }
+        if (needSort)
+            std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    struct Node {
+        std::map<char, int> children;
+        std::vector<unsigned> routes;
+    };
+
+    size_t numRoutes;
+    std::vector<Node> nodes;
+};
+
+std::shared_ptr<const RestRequestRouter::RouteIndex>
+RestRequestRouter::
+getRouteIndex() const
+{
+    auto result = std::atomic_load(&routeIndex);
+    if (!result || result->numRoutes != subRoutes.size()) {
+        result = std::make_shared<RouteIndex>(subRoutes);
+        std::atomic_store(&routeIndex, result);
+    }
+    return result;
+}
+
 RestRequestMatchResult
 RestRequestRouter::
 processRequest(RestConnection & connection,
@@ -386,7 +514,10 @@ processRequest(RestConnection & connection,
         return rootHandler(connection, request, context);
     }
 
-    for (auto & sr: subRoutes) {
+    auto index = getRouteIndex();
+
+    for (unsigned i: index->candidates(context.remaining.rawString())) {
+        const Route & sr = subRoutes[i];
         if (debug)
             cerr << "  trying subroute " << sr.router->description << endl;
         try {
@@ -437,6 +568,9 @@ matchPath(RestRequestParsingContext & context) const
         else return false;
     }
     case PathSpec::REGEX: {
+        if (path.match != PathSpec::MATCH_REGEX)
+            return matchCompiledPath(context);
+
         MatchResults results;
         bool found
             = regex_search(context.remaining, results, path.rex,
@@ -461,6 +595,55 @@ matchPath(RestRequestParsingContext & context) const
     return true;
 }
 
+bool
+RestRequestRouter::Route::
+matchCompiledPath(RestRequestParsingContext & context) const
+{
+    const std::string & remaining = context.remaining.rawString();
+    const char * start = remaining.data();
+    const char * end = start + remaining.size();
+    const char * p = start;
+
+    auto matchLiteral = [&] (const std::string & literal)
+        {
+            if (end - p < (ssize_t)literal.size()
+                || literal.compare(0, literal.size(), p, literal.size()) != 0)
+                return false;
+            p += literal.size();
+            return true;
+        };
+
+    if (!matchLiteral(path.prefix))
+        return false;
+
+    const char * groupStart = p;
+
+    if (path.match == PathSpec::MATCH_SEGMENT) {
+        while (p < end && *p != '/')
+            ++p;
+        if (path.nonEmpty && p == groupStart)
+            return false;
+    }
+    else {
+        if (!matchLiteral(path.groupPrefix))
+            return false;
+        // As for the regex, . doesn't match line terminators
+        while (p < end && *p != '\n' && *p != '\r')
+            ++p;
+    }
+
+    // Same resources as the regex would have captured
+    context.resources.push_back
+        (Url::decodeUri(Utf8String(std::string(start, p))));
+    if (path.captures) {
+        context.resources.push_back
+            (Url::decodeUri(Utf8String(std::string(groupStart, p))));
+    }
+    context.remaining = Utf8String(std::string(p, end));
+
+    return true;
+}
+
 RestRequestMatchResult
 RestRequestRouter::Route::
 process(const RestRequest & request,
@@ -63,6 +63,31 @@ struct PathSpec {
     Regex rex;         ///< Parsed regex, if type == REGEX
     Utf8String desc;   ///< Description for help
 
+    /** How a regex path is matched.  The forms used by nearly all routes,
+        namely a literal prefix followed by one path segment or by the rest
+        of the path, optionally captured, are matched directly without
+        running the regex engine.
+    */
+    enum Match {
+        MATCH_REGEX,    ///< Run the regex
+        MATCH_SEGMENT,  ///< prefix followed by ([^/]*) or ([^/]+)
+        MATCH_REST      ///< prefix followed by (groupPrefix.*) or .*
+    } match;
+
+    /// Literal that any match must start with.  For a STRING path this is
+    /// the whole path; for MATCH_REGEX it may be shorter than the literal
+    /// part of the regex, and is only used to select candidate routes.
+    std::string prefix;
+
+    /// Literal at the start of the captured group, for MATCH_REST
+    std::string groupPrefix;
+
+    /// Is the variable part (and groupPrefix) captured in a group?
+    bool captures;
+
+    /// For MATCH_SEGMENT, must the segment contain at least one character?
+    bool nonEmpty;
+
     /// Return the number of captured elements for this specification.  This is the
     /// number of strings that will be appended to the resources field of the context
     /// object.
@@ -79,6 +104,10 @@ struct PathSpec {
     bool operator != (const PathSpec & other) const;
 
     bool operator < (const PathSpec & other) const;
+
+private:
+    /// Analyze the regex to see if it can be matched directly
+    void compile();
 };
 
 /// A shortcut way to construct a PathSpec that's a regular expression
@@ -498,6 +527,9 @@ struct RestRequestRouter {
 
         bool matchPath(RestRequestParsingContext & context) const;
 
+        /// matchPath() for a regex that was compiled to a direct match
+        bool matchCompiledPath(RestRequestParsingContext & context) const;
+
         RestRequestMatchResult process(const RestRequest & request,
                             RestRequestParsingContext & context,
                             RestConnection & connection) const;
@@ -601,6 +633,16 @@ struct RestRequestRouter {
     Utf8String description;
     bool terminal;
     Json::Value argHelp;
+
+private:
+    /** Trie of the literal prefixes of the subroutes, so that a request is
+        only tried against the routes whose prefix it starts with.  It's
+        built on first use and rebuilt when routes have been added since.
+    */
+    struct RouteIndex;
+    mutable std::shared_ptr<const RouteIndex> routeIndex;
+
+    std::shared_ptr<const RouteIndex> getRouteIndex() const;
 };
 
 /** Send an HTTP response in response to an exception. */
@@ -200,7 +200,10 @@ sendPayload(std::string payload)
         itl->http->sendHttpChunk(std::move(payload),
                                  HttpLegacySocketHandler::NEXT_CONTINUE);
     }
-    else itl->http->send(std::move(payload));
+    else {
+        itl->http->send(std::move(payload));
+        itl->http->waitForPeer();
+    }
 }
 
 void
@@ -208,7 +211,7 @@ RestServiceEndpoint::ConnectionId::
 finishResponse()
 {
     if (itl->chunkedEncoding) {
-        itl->http->sendHttpChunk("", HttpLegacySocketHandler::NEXT_CLOSE);
+        itl->http->sendHttpChunk("", HttpLegacySocketHandler::NEXT_RECYCLE);
     }
     else if (!itl->keepAlive) {
         itl->http->send("", HttpLegacySocketHandler::NEXT_CLOSE);
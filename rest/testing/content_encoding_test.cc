@@ -0,0 +1,81 @@
+/** content_encoding_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the negotiation of the content encoding of HTTP responses.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/rest/content_encoding.h"
+#include "mldb/vfs/compressor.h"
+#include <memory>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_choose_content_encoding )
+{
+    BOOST_CHECK_EQUAL(chooseContentEncoding(""), "");
+    BOOST_CHECK_EQUAL(chooseContentEncoding("identity"), "");
+    BOOST_CHECK_EQUAL(chooseContentEncoding("gzip, deflate"), "gzip");
+    BOOST_CHECK_EQUAL(chooseContentEncoding("x-gzip"), "gzip");
+
+    // The fastest accepted coding wins, whatever the order or quality
+    BOOST_CHECK_EQUAL(chooseContentEncoding("gzip, zstd"), "zstd");
+    BOOST_CHECK_EQUAL(chooseContentEncoding("gzip;q=1.0, ZSTD;q=0.5"), "zstd");
+
+    // A quality of zero means not acceptable
+    BOOST_CHECK_EQUAL(chooseContentEncoding("zstd;q=0, gzip"), "gzip");
+    BOOST_CHECK_EQUAL(chooseContentEncoding("gzip; q=0"), "");
+
+    // Wildcards cover the codings that aren't listed
+    BOOST_CHECK_EQUAL(chooseContentEncoding("*"), "zstd");
+    BOOST_CHECK_EQUAL(chooseContentEncoding("zstd;q=0, *"), "gzip");
+    BOOST_CHECK_EQUAL(chooseContentEncoding("br, *;q=0"), "");
+}
+
+BOOST_AUTO_TEST_CASE( test_compressible_content_type )
+{
+    BOOST_CHECK(isCompressibleContentType("application/json"));
+    BOOST_CHECK(isCompressibleContentType("text/html; charset=utf-8"));
+    BOOST_CHECK(isCompressibleContentType("application/javascript"));
+    BOOST_CHECK(isCompressibleContentType("image/svg+xml"));
+    BOOST_CHECK(!isCompressibleContentType("image/png"));
+    BOOST_CHECK(!isCompressibleContentType("application/pdf"));
+    BOOST_CHECK(!isCompressibleContentType(""));
+}
+
+BOOST_AUTO_TEST_CASE( test_encode_content )
+{
+    std::string body;
+    for (int i = 0;  i < 10000;  ++i)
+        body += "{\"row\":" + std::to_string(i) + ",\"value\":\"hello\"},";
+
+    for (std::string encoding: { "zstd", "gzip" }) {
+        std::string encoded = encodeContent(body, encoding, 1);
+        BOOST_CHECK_LT(encoded.size(), body.size() / 5);
+
+        std::unique_ptr<Decompressor> decompressor
+            (Decompressor::create(encoding));
+        BOOST_REQUIRE(decompressor);
+
+        std::string decoded;
+        auto onData = [&] (const char * data, size_t len) -> size_t
+            {
+                decoded.append(data, len);
+                return len;
+            };
+        decompressor->decompress(encoded.data(), encoded.size(), onData);
+        decompressor->finish(onData);
+        BOOST_CHECK(decoded == body);
+    }
+
+    BOOST_CHECK_THROW(encodeContent(body, "br", 1), std::exception);
+}
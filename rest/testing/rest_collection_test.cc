@@ -643,3 +643,124 @@ BOOST_AUTO_TEST_CASE( stress_test_collection_cancellation )
          << endl;
     BOOST_CHECK_EQUAL(created + underConstruction, deletedAfterCreation + cancelledBeforeCreation);
 }
+
+/** Config store that keeps everything in memory. */
+struct MemoryConfigStore: public CollectionConfigStore {
+    std::map<Utf8String, Json::Value> entries;
+
+    virtual std::vector<Utf8String> keys() const
+    {
+        std::vector<Utf8String> result;
+        for (auto & e: entries)
+            result.push_back(e.first);
+        return result;
+    }
+
+    virtual void set(Utf8String key, const Json::Value & config)
+    {
+        entries[key] = config;
+    }
+
+    virtual Json::Value get(Utf8String key) const
+    {
+        auto it = entries.find(key);
+        return it == entries.end() ? Json::Value() : it->second;
+    }
+
+    virtual std::vector<std::pair<Utf8String, Json::Value> > getAll() const
+    {
+        return { entries.begin(), entries.end() };
+    }
+
+    virtual void clear()
+    {
+        entries.clear();
+    }
+
+    virtual void erase(Utf8String key)
+    {
+        entries.erase(key);
+    }
+};
+
+/** Collection whose objects need the object named in their "dependsOn"
+    parameter to exist before they can be constructed.
+*/
+struct DependentTestCollection: public TestCollection {
+
+    mutable std::atomic<int> numConstructed;
+
+    DependentTestCollection()
+        : numConstructed(0)
+    {
+    }
+
+    ~DependentTestCollection()
+    {
+        this->shutdown();
+    }
+
+    std::shared_ptr<TestObject>
+    construct(TestConfig config, const OnProgress & onProgress) const
+    {
+        auto it = config.params.find("dependsOn");
+        if (it != config.params.end())
+            this->getExistingEntry(it->second);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ++numConstructed;
+        auto result = std::make_shared<TestObject>();
+        result->config.reset(new TestConfig(std::move(config)));
+        return result;
+    }
+};
+
+std::shared_ptr<MemoryConfigStore> makeRestoreConfigStore()
+{
+    auto store = std::make_shared<MemoryConfigStore>();
+    store->set("a", jsonEncode(TestConfig{"a", {{"dependsOn", "b"}}}));
+    store->set("b", jsonEncode(TestConfig{"b", {}}));
+    store->set("c", jsonEncode(TestConfig{"c", {}}));
+    return store;
+}
+
+BOOST_AUTO_TEST_CASE( test_restore_waits_for_dependencies )
+{
+    DependentTestCollection collection;
+    collection.attachConfig(makeRestoreConfigStore());
+    collection.loadConfig();
+
+    // Getting an entry being restored waits for it, including for the
+    // entry that it depends on
+    auto a = collection.getExistingEntry("a");
+    BOOST_REQUIRE(a);
+    BOOST_CHECK_EQUAL(a->config->id, "a");
+    BOOST_CHECK(collection.getExistingEntry("b"));
+    BOOST_CHECK(collection.getExistingEntry("c"));
+    BOOST_CHECK_EQUAL(collection.numConstructed, 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_restore_on_first_access )
+{
+    DependentTestCollection collection;
+    auto store = makeRestoreConfigStore();
+    collection.attachConfig(store);
+    collection.loadConfig(true /* on first access */);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK_EQUAL(collection.numConstructed, 0);
+    BOOST_CHECK_EQUAL(collection.getKeys().size(), 3);
+
+    // Restores a and the b it depends on, but not c
+    BOOST_CHECK(collection.getExistingEntry("a"));
+    BOOST_CHECK_EQUAL(collection.numConstructed, 2);
+    BOOST_CHECK(collection.tryGetExistingEntry("b"));
+    BOOST_CHECK_EQUAL(collection.numConstructed, 2);
+
+    // An entry that was never restored can be deleted or overwritten
+    collection.deleteEntry("c");
+    BOOST_CHECK(!collection.tryGetExistingEntry("c"));
+    collection.handlePutSync("c", TestConfig{"c", {{"x", "y"}}});
+    auto c = collection.getExistingEntry("c");
+    BOOST_CHECK_EQUAL(c->config->params["x"], "y");
+    BOOST_CHECK_EQUAL(collection.numConstructed, 3);
+}
@@ -117,3 +117,73 @@ BOOST_AUTO_TEST_CASE( test_hidden_route )
                                        "Not matching regex", callback,
                     Json::Value());
 }
+
+BOOST_AUTO_TEST_CASE( test_compiled_path_specs )
+{
+    BOOST_CHECK_EQUAL(Rx("/([^/]*)", "").match, PathSpec::MATCH_SEGMENT);
+    BOOST_CHECK_EQUAL(Rx("/items/([^/]+)", "").match, PathSpec::MATCH_SEGMENT);
+    BOOST_CHECK_EQUAL(Rx("/items/([^/]+)", "").prefix, "/items/");
+    BOOST_CHECK_EQUAL(Rx("/doc/(.*)", "").match, PathSpec::MATCH_REST);
+    BOOST_CHECK_EQUAL(Rx("/static(/.*)", "").groupPrefix, "/");
+    BOOST_CHECK_EQUAL(Rx("/autodoc/.*", "").match, PathSpec::MATCH_REST);
+    BOOST_CHECK(!Rx("/autodoc/.*", "").captures);
+
+    // Anything else falls back to the regex, with a conservative prefix
+    BOOST_CHECK_EQUAL(Rx("/([0-9a-z]{16})", "").match, PathSpec::MATCH_REGEX);
+    BOOST_CHECK_EQUAL(Rx("/([0-9a-z]{16})", "").prefix, "/");
+    BOOST_CHECK_EQUAL(Rx("/abc?", "").prefix, "/ab");
+    BOOST_CHECK_EQUAL(Rx("/a|/b", "").prefix, "");
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_route_matching )
+{
+    RestRequestRouter router;
+
+    auto respond = [] (const std::string & name)
+        {
+            return [=] (RestConnection & connection,
+                        const RestRequest & request,
+                        RestRequestParsingContext & context)
+            {
+                std::string response = name;
+                for (auto & r: context.resources)
+                    response += "|" + r.rawString();
+                response += "|" + context.remaining.rawString();
+                connection.sendResponse(200, response, "text/plain");
+                return RestRequestRouter::MR_YES;
+            };
+        };
+
+    router.addRoute("/items", "GET", "list", respond("list"), Json::Value());
+    router.addRoute(Rx("/items/([^/]+)", ""), "GET", "item",
+                    respond("item"), Json::Value());
+    router.addRoute(Rx("/items/([0-9]{3})/x", ""), "POST", "regex",
+                    respond("regex"), Json::Value());
+    router.addRoute(Rx("/doc/(.*)", ""), "GET", "doc",
+                    respond("doc"), Json::Value());
+    router.addRoute(Rx("/([^/]*)", ""), "GET", "any",
+                    respond("any"), Json::Value());
+
+    auto get = [&] (const std::string & verb, const std::string & resource)
+        {
+            RestRequest request;
+            request.verb = verb;
+            request.resource = resource;
+            InProcessRestConnection conn;
+            router.handleRequest(conn, request);
+            return conn.response;
+        };
+
+    BOOST_CHECK_EQUAL(get("GET", "/items"), "list|/items|");
+    BOOST_CHECK_EQUAL(get("GET", "/items/a%20b"), "item|/items/a b|a b|");
+    BOOST_CHECK_EQUAL(get("POST", "/items/123/x"),
+                      "regex|/items/123/x|123|");
+    BOOST_CHECK_EQUAL(get("GET", "/doc/a/b.html"),
+                      "doc|/doc/a/b.html|a/b.html|");
+    BOOST_CHECK_EQUAL(get("GET", "/other"), "any|/other|other|");
+
+    // A route added after the first request is still found
+    router.addRoute(Rx("/late/([^/]*)", ""), "GET", "late",
+                    respond("late"), Json::Value());
+    BOOST_CHECK_EQUAL(get("GET", "/late/x"), "late|/late/x|x|");
+}
@@ -0,0 +1,292 @@
+/** admission_control.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Admission control for the REST requests that do heavy work.
+*/
+
+#include "mldb/server/admission_control.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/types/date.h"
+#include <boost/algorithm/string.hpp>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<int> MLDB_ADMISSION_SLOTS("MLDB_ADMISSION_SLOTS", 0);
+
+EnvOption<int> MLDB_ADMISSION_QUERY_WEIGHT
+("MLDB_ADMISSION_QUERY_WEIGHT", 2);
+
+EnvOption<int> MLDB_ADMISSION_FUNCTION_WEIGHT
+("MLDB_ADMISSION_FUNCTION_WEIGHT", 4);
+
+EnvOption<int> MLDB_ADMISSION_PROCEDURE_WEIGHT
+("MLDB_ADMISSION_PROCEDURE_WEIGHT", 1);
+
+EnvOption<size_t> MLDB_ADMISSION_MAX_QUEUED
+("MLDB_ADMISSION_MAX_QUEUED", 4);
+
+EnvOption<size_t> MLDB_ADMISSION_MAX_PER_TENANT
+("MLDB_ADMISSION_MAX_PER_TENANT", 0);
+
+AdmissionControl::Config getEnvConfig()
+{
+    AdmissionControl::Config result;
+    result.slots = MLDB_ADMISSION_SLOTS;
+    result.weights[AdmissionControl::RC_QUERY] = MLDB_ADMISSION_QUERY_WEIGHT;
+    result.weights[AdmissionControl::RC_FUNCTION]
+        = MLDB_ADMISSION_FUNCTION_WEIGHT;
+    result.weights[AdmissionControl::RC_PROCEDURE]
+        = MLDB_ADMISSION_PROCEDURE_WEIGHT;
+    result.maxQueued = MLDB_ADMISSION_MAX_QUEUED;
+    result.maxPerTenant = MLDB_ADMISSION_MAX_PER_TENANT;
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ADMISSION CONTROL                                                         */
+/*****************************************************************************/
+
+struct AdmissionControl::Impl {
+    struct Class {
+        int share = 0;
+        size_t running = 0;
+        size_t queued = 0;
+        uint64_t admitted = 0;
+        uint64_t rejected = 0;
+        uint64_t waited = 0;      ///< Admitted after waiting in the queue
+        double waitSeconds = 0;   ///< Total time spent waiting
+        double maxWaitSeconds = 0;
+        std::condition_variable slotFreed;
+    };
+
+    Impl(const Config & config)
+        : config(config)
+    {
+        int totalWeight = 0;
+        for (int w: config.weights)
+            totalWeight += std::max(w, 0);
+
+        for (int i = 0;  i < RC_NUM_CLASSES;  ++i) {
+            int w = config.weights[i];
+            if (config.slots > 0 && w > 0) {
+                classes[i].share
+                    = std::max<int>(1, std::lround(1.0 * config.slots * w
+                                                   / totalWeight));
+            }
+        }
+    }
+
+    /** Return whether a request of the given class may start now.  Must
+        be called with the lock held. */
+    bool canRun(int cls) const
+    {
+        if (config.slots <= 0)
+            return true;
+        if (classes[cls].running < (size_t)classes[cls].share)
+            return true;
+
+        // Borrow a free slot, as long as nobody else is waiting for one
+        size_t totalRunning = 0, othersQueued = 0;
+        for (int i = 0;  i < RC_NUM_CLASSES;  ++i) {
+            totalRunning += classes[i].running;
+            if (i != cls)
+                othersQueued += classes[i].queued;
+        }
+        return totalRunning < (size_t)config.slots && othersQueued == 0;
+    }
+
+    void release(int cls, const std::string & tenant)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        classes[cls].running -= 1;
+        releaseTenant(tenant);
+
+        // A freed slot may go to any class, either through its share or by
+        // borrowing
+        for (auto & c: classes)
+            c.slotFreed.notify_all();
+    }
+
+    void releaseTenant(const std::string & tenant)
+    {
+        if (tenant.empty())
+            return;
+        auto it = tenants.find(tenant);
+        if (--it->second == 0)
+            tenants.erase(it);
+    }
+
+    Config config;
+    mutable std::mutex mutex;
+    Class classes[RC_NUM_CLASSES];
+    std::map<std::string, size_t> tenants;  ///< Requests running or queued
+    uint64_t rejectedTenant = 0;
+};
+
+AdmissionControl::
+AdmissionControl()
+    : AdmissionControl(getEnvConfig())
+{
+}
+
+AdmissionControl::
+AdmissionControl(const Config & config)
+    : impl(std::make_shared<Impl>(config))
+{
+}
+
+AdmissionControl::
+~AdmissionControl()
+{
+}
+
+AdmissionControl::RequestClass
+AdmissionControl::
+classify(const std::string & verb, const std::string & resource)
+{
+    vector<string> parts;
+    boost::split(parts, resource, boost::is_any_of("/"));
+
+    // Ignore the empty parts from the leading slash and any trailing one
+    if (!parts.empty() && parts.front().empty())
+        parts.erase(parts.begin());
+    if (!parts.empty() && parts.back().empty())
+        parts.pop_back();
+
+    if (parts.size() < 2 || parts[0] != "v1")
+        return RC_NONE;
+
+    const string & collection = parts[1];
+
+    if (verb == "GET") {
+        if (parts.size() == 2 && collection == "query")
+            return RC_QUERY;
+        if (parts.size() == 4 && collection == "datasets"
+            && parts[3] == "query")
+            return RC_QUERY;
+        if (parts.size() == 4 && collection == "functions"
+            && (parts[3] == "application" || parts[3] == "batch"))
+            return RC_FUNCTION;
+    }
+    else if (verb == "PUT" || verb == "POST") {
+        // Procedures may be run on creation, so creating one counts too
+        if (collection == "procedures"
+            && (parts.size() <= 3
+                || (parts[3] == "runs" && parts.size() <= 5)))
+            return RC_PROCEDURE;
+    }
+
+    return RC_NONE;
+}
+
+const char *
+AdmissionControl::
+className(RequestClass cls)
+{
+    switch (cls) {
+    case RC_QUERY:     return "query";
+    case RC_FUNCTION:  return "function";
+    case RC_PROCEDURE: return "procedure";
+    default:           return "none";
+    }
+}
+
+std::shared_ptr<void>
+AdmissionControl::
+admit(RequestClass cls, const std::string & tenant)
+{
+    ExcAssertLess(cls, RC_NUM_CLASSES);
+
+    std::unique_lock<std::mutex> guard(impl->mutex);
+    Impl::Class & c = impl->classes[cls];
+
+    if (!tenant.empty()) {
+        size_t & count = impl->tenants[tenant];
+        if (impl->config.maxPerTenant > 0
+            && count >= impl->config.maxPerTenant) {
+            impl->rejectedTenant += 1;
+            return nullptr;
+        }
+        count += 1;
+    }
+
+    // Requests already waiting go first
+    if (c.queued > 0 || !impl->canRun(cls)) {
+        if (c.queued >= impl->config.maxQueued) {
+            impl->releaseTenant(tenant);
+            c.rejected += 1;
+            return nullptr;
+        }
+
+        Date started = Date::now();
+        c.queued += 1;
+        c.slotFreed.wait(guard, [&] () { return impl->canRun(cls); });
+        c.queued -= 1;
+
+        double waited = Date::now().secondsSince(started);
+        c.waited += 1;
+        c.waitSeconds += waited;
+        c.maxWaitSeconds = std::max(c.maxWaitSeconds, waited);
+    }
+
+    c.running += 1;
+    c.admitted += 1;
+
+    auto impl = this->impl;
+    auto onRelease = [impl, cls, tenant] (void *)
+        {
+            impl->release(cls, tenant);
+        };
+
+    // The handle doesn't point to anything; only its deleter matters
+    return std::shared_ptr<void>((void *)this, onRelease);
+}
+
+Json::Value
+AdmissionControl::
+getStats() const
+{
+    std::unique_lock<std::mutex> guard(impl->mutex);
+
+    Json::Value result;
+    result["slots"] = impl->config.slots;
+    result["maxQueued"] = (Json::UInt)impl->config.maxQueued;
+    result["maxPerTenant"] = (Json::UInt)impl->config.maxPerTenant;
+    result["rejectedTenant"] = (Json::UInt)impl->rejectedTenant;
+    result["tenants"] = (Json::UInt)impl->tenants.size();
+
+    for (int i = 0;  i < RC_NUM_CLASSES;  ++i) {
+        const Impl::Class & c = impl->classes[i];
+        Json::Value & stats = result["classes"][className((RequestClass)i)];
+        stats["weight"] = impl->config.weights[i];
+        stats["share"] = c.share;
+        stats["running"] = (Json::UInt)c.running;
+        stats["queued"] = (Json::UInt)c.queued;
+        stats["admitted"] = (Json::UInt)c.admitted;
+        stats["rejected"] = (Json::UInt)c.rejected;
+        stats["waited"] = (Json::UInt)c.waited;
+        stats["meanWaitSeconds"] = c.waited ? c.waitSeconds / c.waited : 0.0;
+        stats["maxWaitSeconds"] = c.maxWaitSeconds;
+    }
+
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,97 @@
+/** admission_control.h                                            -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Admission control for the REST requests that do heavy work.
+*/
+
+#pragma once
+
+#include "mldb/ext/jsoncpp/json.h"
+#include <memory>
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ADMISSION CONTROL                                                         */
+/*****************************************************************************/
+
+/** Limits how many requests of each class run at once, so that a burst of
+    heavy queries or procedure runs can't take every worker and hold up
+    real-time function calls.
+
+    There are three classes of requests: interactive queries, function
+    applications and procedure runs (see classify()).  Each class has a
+    weight, and gets that share of the slots; MLDB_ADMISSION_SLOTS in total
+    (0, the default, means no limit).  A class may borrow free slots while
+    no other class is waiting, but it can always run up to its own share,
+    so a class which is under its share never waits behind another.
+
+    A request which can't run straight away waits in its class's queue.
+    While it waits it holds the thread which is handling it, so queues are
+    kept short: once MLDB_ADMISSION_MAX_QUEUED requests of a class are
+    waiting, further ones are rejected.  Requests may also be tagged with
+    a tenant, each of which may have at most MLDB_ADMISSION_MAX_PER_TENANT
+    requests running or waiting (0 is unlimited).
+
+    The counts of requests admitted, rejected and waiting, and the time
+    spent waiting, are kept even with no limit.  It is safe to use from
+    multiple threads.
+*/
+
+struct AdmissionControl {
+
+    enum RequestClass {
+        RC_QUERY,        ///< Interactive query
+        RC_FUNCTION,     ///< Application of a function
+        RC_PROCEDURE,    ///< Creation or run of a procedure
+        RC_NUM_CLASSES,
+        RC_NONE = RC_NUM_CLASSES  ///< Not subject to admission control
+    };
+
+    struct Config {
+        int slots = 0;                    ///< Total slots; 0 is no limit
+        int weights[RC_NUM_CLASSES] = { 2, 4, 1 };
+        size_t maxQueued = 4;             ///< Per class
+        size_t maxPerTenant = 0;          ///< 0 is no limit
+    };
+
+    /** Create with the configuration given by the MLDB_ADMISSION_*
+        environment variables. */
+    AdmissionControl();
+
+    AdmissionControl(const Config & config);
+
+    ~AdmissionControl();
+
+    /** Return the class of a request with the given verb and resource, or
+        RC_NONE if it isn't subject to admission control.
+    */
+    static RequestClass classify(const std::string & verb,
+                                 const std::string & resource);
+
+    /** Return the name of the given class, as used in the statistics. */
+    static const char * className(RequestClass cls);
+
+    /** Wait until a request of the given class from the given tenant (or
+        no tenant if empty) may run.  Returns a handle which frees its slot
+        when it's destroyed, or nullptr if the request is rejected because
+        its queue or tenant is full.
+    */
+    std::shared_ptr<void> admit(RequestClass cls, const std::string & tenant);
+
+    /** Return the configuration and statistics of each class.  This is
+        what GET /v1/admission returns.
+    */
+    Json::Value getStats() const;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace MLDB
@@ -15,6 +15,7 @@
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/sql/execution_pipeline.h"
+#include "mldb/sql/query_profile.h"
 #include <boost/algorithm/string.hpp>
 #include "mldb/server/bound_queries.h"
 #include "mldb/server/parallel_merge_sort.h"
@@ -173,6 +174,17 @@ void iterateDense(const SelectExpression & select,
     // This function lets us efficiently extract the embedding from each row
     auto extractEmbedding = boundSelect.info->extractDoubleEmbedding(columns);
 
+    // With a plain select * and nothing to filter or calculate, the
+    // dataset can give us the embedding directly without having to
+    // build the row first.
+    bool readEmbedding = select.isIdentitySelect(context)
+        && where.isConstantTrue()
+        && when.when->isConstantTrue()
+        && boundCalc.empty();
+
+    // Only the columns that are read are taken from the rows
+    auto getRow = context.getRowExprFunction(whenBound);
+
     // Get a list of rows that we run over
     // getRowPaths can return row names in an arbitrary order as long as it is deterministic.
     auto rows = matrix->getRowPaths();
@@ -184,7 +196,14 @@ void iterateDense(const SelectExpression & select,
 
             const RowPath & rowName = rows[rowNum];
 
-            auto row = from.getRowExpr(rowName);
+            if (readEmbedding) {
+                auto embedding
+                    = from.getRowEmbedding(rowName, columns, ST_FLOAT64)
+                    .getEmbeddingDouble(columns.size());
+                return processor(rowName, rowName, rowNum, embedding, {});
+            }
+
+            auto row = getRow(rowName);
 
             // Check it matches the where expression.  If not, we don't process
             // it.
@@ -410,13 +429,29 @@ queryFromStatementExpr(const SelectStatement & stm,
     BoundTableExpression table = stm.from->bind(scope);
     
     if (table.dataset) {
-        return table.dataset->queryStructuredExpr(stm.select, stm.when,
-                                              *stm.where,
-                                              stm.orderBy, stm.groupBy,
-                                              stm.having,
-                                              stm.rowName,
-                                              stm.offset, stm.limit, 
-                                              table.asName);
+        QueryProfiler * profiler = QueryProfiler::current();
+        double wallStart = profiler ? Date::now().secondsSinceEpoch() : 0.0;
+        double cpuStart = profiler ? QueryProfiler::processCpuTime() : 0.0;
+
+        auto result
+            = table.dataset->queryStructuredExpr(stm.select, stm.when,
+                                                 *stm.where,
+                                                 stm.orderBy, stm.groupBy,
+                                                 stm.having,
+                                                 stm.rowName,
+                                                 stm.offset, stm.limit,
+                                                 table.asName);
+
+        // The dataset runs the query itself, so it shows up in the profile
+        // as a single element
+        if (profiler) {
+            profiler->recordElement
+                ("DatasetQuery",
+                 std::get<0>(result).size(),
+                 Date::now().secondsSinceEpoch() - wallStart,
+                 QueryProfiler::processCpuTime() - cpuStart);
+        }
+        return result;
     }
     else if (table.table.runQuery && stm.from) {
 
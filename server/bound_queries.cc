@@ -12,6 +12,8 @@
 #include "mldb/base/parallel.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/server/parallel_merge_sort.h"
+#include "mldb/server/query_spill.h"
+#include "mldb/core/memory_account.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/sql/sql_expression_operations.h"
@@ -39,8 +41,6 @@ namespace MLDB {
 const int MIN_ROW_PER_TASK = 32;
 const int TASK_PER_THREAD = 8;
 
-__thread int QueryThreadTracker::depth = 0;
-
 
 /*****************************************************************************/
 /* BOUND SELECT QUERY                                                        */
@@ -160,7 +160,9 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         //STACK_PROFILE(UnorderedExecutor);
         DEBUG_MSG(logger) << "bound query unordered num buckets: " << numBuckets
                           << (processInParallel ? " multi-threaded"  : " single-threaded");
-        QueryThreadTracker parentTracker;
+
+        // Only the columns that the query reads are taken from the rows
+        auto getRow = context.getRowExprFunction(whenBound);
 
         // Get a list of rows that we run over
         // Ordering is arbitrary but deterministic
@@ -194,7 +196,7 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                     }
                 }
 
-                ExpressionValue row = dataset.getRowExpr(rows[rowNum]);
+                ExpressionValue row = getRow(rows[rowNum]);
                 auto output = processRow(rows[rowNum], row, rowNum, numPerBucket,
                                          selectStar);
 
@@ -260,7 +262,7 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                                     }
                                 }
                             }
-                            auto row = dataset.getRowExpr(rows[rowNum]);
+                            auto row = getRow(rows[rowNum]);
                             auto outputRow = processRow(rows[rowNum], row, rowNum,
                                                         numPerBucket, selectStar);
                             output[rowNum-offset] = std::move(outputRow);
@@ -298,14 +300,15 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         DEBUG_MSG(logger) << "UnorderedIterExecutor num buckets: " << numBuckets 
                           << (processInParallel ? " multi-threaded " : " single-threaded");
 
-        QueryThreadTracker parentTracker;
-
         // Simple case... no order by and no limit
 
         ExcAssertEqual(limit, -1);
         ExcAssertEqual(offset, 0);
         ExcAssert(numBuckets > 0);
 
+        // Only the columns that the query reads are taken from the rows
+        auto getRow = context.getRowExprFunction(whenBound);
+
         // Do we select *?  In that case we can avoid a lot of copying
         bool selectStar = boundSelect.expr->isIdentitySelect(context);
 
@@ -329,7 +332,7 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 stream->initAt(it);
                 for (;  it < stopIt; ++it) {
                     RowPath rowName = stream->next();
-                    auto row = dataset.getRowExpr(rowName);
+                    auto row = getRow(rowName);
 
                     auto output = processRow(rowName, row, it, numPerBucket, selectStar);
                     int bucketNumber
@@ -437,8 +440,6 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
     {
         //STACK_PROFILE(OrderedExecutor);
 
-        QueryThreadTracker parentTracker;
-
         // Get a list of rows that we run over
         // Ordering is arbitrary but deterministic
         auto rows = whereGenerator(-1, Any()).first;
@@ -450,6 +451,9 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
 
         auto boundOrderBy = newOrderBy.bindAll(orderByContext);
 
+        // Only the columns that the query reads are taken from the rows
+        auto getRow = context.getRowExprFunction(whenBound);
+
         // Two phases:
         // 1.  Generate rows that match the where expression, in the correct order
         // 2.  Select over those rows to get our result
@@ -464,11 +468,52 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
 
         std::atomic<int64_t> rowsAdded(0);
 
-        auto doWhere = [&] (int rowNum) -> bool
+        // Compare two rows according to the sort criteria
+        auto compareRows = [&] (const SortedRow & row1,
+                                const SortedRow & row2) -> bool
             {
-                QueryThreadTracker childTracker = parentTracker.child();
+                return boundOrderBy.lessWithSortKey(std::get<0>(row1),
+                                                    std::get<0>(row2));
+            };
+
+        // With a limit, only the first offset + limit rows in sort order can
+        // make it to the output.  Each thread then keeps its rows in a heap
+        // bounded to that size, with its worst row at the front, rather
+        // than accumulating every row.  The best of the worst rows of the
+        // full heaps is shared between the threads, and rows that sort
+        // after it are dropped straight away.  DISTINCT ON needs to see
+        // every row to skip the duplicates, so it keeps them all.
+        bool useTopK = limit > 0 && numDistinctOnClauses_ == 0;
+        size_t topK = useTopK ? offset + limit : 0;
+
+        std::mutex thresholdLock;
+        std::vector<ExpressionValue> sharedThreshold;  // under thresholdLock
+        std::atomic<uint64_t> thresholdGeneration(0);  // 0 means no threshold
+
+        // Each thread's copy of the shared threshold, to avoid taking the
+        // lock for every row
+        struct ThresholdCopy {
+            std::vector<ExpressionValue> sortFields;
+            uint64_t generation = 0;
+        };
+
+        PerThreadAccumulator<ThresholdCopy> thresholds;
 
-                auto row = dataset.getRowExpr(rows[rowNum]);
+        // Without a limit, every row is held until the end.  Once the rows
+        // of all of the threads take more than the memory budget, the
+        // thread that went over it writes its rows out to disk as a sorted
+        // run, and the runs are merged back in at the end.
+        size_t memoryBudget = useTopK ? 0 : getQueryMemoryBudget();
+        SpilledRowRuns spilled(compareRows);
+        std::atomic<size_t> bytesInMemory(0);
+        PerThreadAccumulator<size_t> threadBytes;
+
+        // The rows held in memory are charged to the running query
+        MemoryCharge rowsCharge;
+
+        auto doWhere = [&] (int rowNum) -> bool
+            {
+                auto row = getRow(rows[rowNum]);
 
                 if (onProgress && rowsAdded % 1000 == 0) {
                     Json::Value progress;
@@ -509,14 +554,72 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                     = orderByContext.getRowScope(rowContext, outputRow);
 
                 std::vector<ExpressionValue> sortFields
-                    = boundOrderBy.apply(orderByRowScope);
+                    = boundOrderBy.applyWithSortKey(orderByRowScope);
+
+                if (!useTopK) {
+                    SortedRows * sortedRows = &accum.get();
+                    sortedRows->emplace_back(std::move(sortFields),
+                                             std::move(outputRow),
+                                             std::move(calcd));
+
+                    if (memoryBudget || rowsCharge.active()) {
+                        size_t bytes
+                            = SpilledRowRuns::memusage(sortedRows->back());
+                        rowsCharge.add(bytes);
+                        size_t & held = threadBytes.get();
+                        held += bytes;
+                        if (memoryBudget
+                            && bytesInMemory.fetch_add(bytes) + bytes
+                               > memoryBudget) {
+                            bytesInMemory -= held;
+                            rowsCharge.release(held);
+                            held = 0;
+                            spilled.spill(*sortedRows);
+                        }
+                    }
+
+                    ++rowsAdded;
+                    return true;
+                }
 
-                SortedRows * sortedRows = &accum.get();
-                sortedRows->emplace_back(std::move(sortFields),
-                                         std::move(outputRow),
-                                         std::move(calcd));
+                ThresholdCopy & threshold = thresholds.get();
+                if (threshold.generation != thresholdGeneration) {
+                    std::unique_lock<std::mutex> guard(thresholdLock);
+                    threshold.sortFields = sharedThreshold;
+                    threshold.generation = thresholdGeneration;
+                }
 
                 ++rowsAdded;
+
+                if (threshold.generation != 0
+                    && !boundOrderBy.lessWithSortKey(sortFields,
+                                                     threshold.sortFields))
+                    return true;
+
+                SortedRows & heap = accum.get();
+                heap.emplace_back(std::move(sortFields),
+                                  std::move(outputRow),
+                                  std::move(calcd));
+                std::push_heap(heap.begin(), heap.end(), compareRows);
+
+                if (heap.size() > topK) {
+                    std::pop_heap(heap.begin(), heap.end(), compareRows);
+                    heap.pop_back();
+                }
+
+                if (heap.size() == topK) {
+                    const auto & worst = std::get<0>(heap.front());
+                    if (threshold.generation == 0
+                        || boundOrderBy.lessWithSortKey(worst, threshold.sortFields)) {
+                        std::unique_lock<std::mutex> guard(thresholdLock);
+                        if (thresholdGeneration == 0
+                            || boundOrderBy.lessWithSortKey(worst, sharedThreshold)) {
+                            sharedThreshold = worst;
+                            ++thresholdGeneration;
+                        }
+                    }
+                }
+
                 return true;
             };
 
@@ -529,85 +632,108 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         //cerr << "map took " << timer.elapsed() << endl;
         timer.restart();
         
-        // Compare two rows according to the sort criteria
-        auto compareRows = [&] (const SortedRow & row1,
-                                const SortedRow & row2) -> bool
-            {
-                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
-            };
-            
+        // With useTopK, the heaps are merged here into the overall first
+        // topK rows, as each heap holds the best rows of its thread.
         auto rowsSorted = parallelMergeSort(accum.threads, compareRows);
 
         //cerr << "shuffle took " << timer.elapsed() << endl;
         timer.restart(); 
 
-        // Now select only the required subset of sorted rows
-        if (limit == -1)
-            limit = rowsSorted.size();
+        // Go through the rows in order, merging in those that were spilled
+        // to disk if there are any.  onRow returns false to stop early.
+        auto forEachSorted = [&] (const std::function<bool (SortedRow &)> & onRow)
+            {
+                if (spilled.numRuns() > 0) {
+                    spilled.merge(rowsSorted, onRow);
+                    return;
+                }
+                for (auto & row: rowsSorted) {
+                    if (!onRow(row))
+                        return;
+                }
+            };
 
+        // Now select only the required subset of sorted rows
         ExcAssertGreaterEqual(offset, 0);
 
+        bool cancelled = false;
+        ssize_t i = 0;
+
         if (numDistinctOnClauses_ > 0) {
 
             std::vector<ExpressionValue> reference;
             reference.resize(numDistinctOnClauses_);
             ssize_t count = 0;
 
-            for (unsigned i = 0;  i < rowsSorted.size();  ++i) {
+            auto onRow = [&] (SortedRow & sorted)
+                {
+                    ssize_t rowNum = i++;
 
-                std::vector<ExpressionValue> & mark = std::get<0>(rowsSorted[i]);
+                    std::vector<ExpressionValue> & mark = std::get<0>(sorted);
 
-                if (i == 0) {
-                    std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
-                }
-                else {
+                    if (rowNum == 0) {
+                        std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
+                    }
+                    else {
 
-                    bool same = true;
-                    for (int i = 0; i < numDistinctOnClauses_; ++i){
-                        if (reference[i] != mark[i]) {
-                            same = false;
-                            break;
+                        bool same = true;
+                        for (int i = 0; i < numDistinctOnClauses_; ++i){
+                            if (reference[i] != mark[i]) {
+                                same = false;
+                                break;
+                            }
                         }
-                    }
 
-                    if (!same)
-                        std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
-                    else
-                        continue; //skip duplicates
-                }
+                        if (!same)
+                            std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
+                        else
+                            return true; //skip duplicates
+                    }
 
-                ++count;
+                    ++count;
 
-                if (count <= offset)
-                    continue;
+                    if (count <= offset)
+                        return true;
 
-                auto & row = std::get<1>(rowsSorted[i]);
-                auto & calcd = std::get<2>(rowsSorted[i]);
+                    auto & row = std::get<1>(sorted);
+                    auto & calcd = std::get<2>(sorted);
 
-                /* Finally, pass to the terminator to continue. */
-                if (!processor(row, calcd, i))
-                    return false;
+                    /* Finally, pass to the terminator to continue. */
+                    if (!processor(row, calcd, rowNum)) {
+                        cancelled = true;
+                        return false;
+                    }
 
-                if (count - offset == limit)
-                    break;
-            }
+                    return count - offset != limit;
+                };
 
+            forEachSorted(onRow);
         }
         else {
-            ssize_t begin = std::min<ssize_t>(offset, rowsSorted.size());
-            ssize_t end = std::min<ssize_t>(offset + limit, rowsSorted.size());
-            for (unsigned i = begin;  i < end;  ++i) {
+            auto onRow = [&] (SortedRow & sorted)
+                {
+                    ssize_t rowNum = i++;
+                    if (rowNum < offset)
+                        return true;
+                    if (limit != -1 && rowNum >= offset + limit)
+                        return false;
 
-                auto & row = std::get<1>(rowsSorted[i]);
-                auto & calcd = std::get<2>(rowsSorted[i]);
+                    auto & row = std::get<1>(sorted);
+                    auto & calcd = std::get<2>(sorted);
 
-                /* Finally, pass to the terminator to continue. */
-                if (!processor(row, calcd, i))
-                    return false;
-            }
+                    /* Finally, pass to the terminator to continue. */
+                    if (!processor(row, calcd, rowNum)) {
+                        cancelled = true;
+                        return false;
+                    }
+                    return true;
+                };
+
+            forEachSorted(onRow);
         }
 
-     
+        if (cancelled)
+            return false;
 
         cerr << "reduce took " << timer.elapsed() << endl;
 
@@ -687,7 +813,8 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
     {
         //STACK_PROFILE(RowHashOrderedExecutor_execute_bloc);
 
-        QueryThreadTracker parentTracker;
+        // Only the columns that the query reads are taken from the rows
+        auto getRow = context.getRowExprFunction(whenBound);
 
         Timer rowsTimer;
 
@@ -731,8 +858,6 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
                 //         << minRowNum << " maxRowNumNeeded " << maxRowNumNeeded
                 //         << " maxRowNum " << maxRowNum << endl;
 
-                QueryThreadTracker childTracker = parentTracker.child();
-
                 ExpressionValue row;
                 try {
                     // If we've gotten all past the maxRowNumNeeded, then we can stop
@@ -760,7 +885,7 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
 
                     //RowPath rowName = rows[rowNum];
 
-                    row = dataset.getRowExpr(rows[rowNum]);
+                    row = getRow(rows[rowNum]);
 
                     // Check it matches the where expression.  If not, we don't process
                     // it.
@@ -942,7 +1067,8 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
     {
         //STACK_PROFILE(RowHashOrderedExecutor_execute_iter);
 
-        QueryThreadTracker parentTracker;
+        // Only the columns that the query reads are taken from the rows
+        auto getRow = context.getRowExprFunction(whenBound);
 
         if (limit == 0)
           throw HttpReturnException(400, "limit must be non-zero");
@@ -1034,7 +1160,7 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
         int count = 0;
         for (auto & r : rowsMerged) {
 
-            ExpressionValue row = dataset.getRowExpr(r);
+            ExpressionValue row = getRow(r);
             auto rowContext = context.getRowScope(r, row);
 
             whenBound.filterInPlace(row, rowContext);
@@ -1094,6 +1220,10 @@ BoundSelectQuery(const SelectExpression & select,
         // Get a generator for the rows that match 
         auto whereGenerator = context->doCreateRowsWhereGenerator(where, 0, -1);
 
+        // Window functions are only allowed in the select and calc
+        // expressions, as they need the full set of rows
+        context->enableWindowFunctions();
+
         auto boundSelect = select.bind(*context);
 
         selectInfo = boundSelect.info;
@@ -1104,6 +1234,11 @@ BoundSelectQuery(const SelectExpression & select,
             boundCalc.emplace_back(c->bind(*context));
         }
 
+        if (context->hasWindowFunctions()) {
+            windowRowsGenerator = std::make_shared<GenerateRowsWhereFunction>
+                (context->doCreateRowsWhereGenerator(where, 0, -1));
+        }
+
         // Get a generator rows from the for the ordered, limited where expression
 
         // Remove any constants from the order by clauses
@@ -1219,6 +1354,7 @@ execute(std::function<bool (NamedRowValue & output,
     ExcAssert(processor);
 
     try {
+        runWindowFunctions();
         return executor->execute(processor, processInParallel, offset, limit, onProgress);
     } MLDB_CATCH_ALL {
         rethrowHttpException(KEEP_HTTP_CODE, "Execution error: "
@@ -1268,6 +1404,7 @@ executeExpr(std::function<bool (Path & rowName,
     ExcAssert(processor);
 
     try {
+        runWindowFunctions();
         return executor->executeExpr(processor, processInParallel,
                                      offset, limit, onProgress);
     } MLDB_CATCH_ALL {
@@ -1283,6 +1420,20 @@ executeExpr(std::function<bool (Path & rowName,
     }
 }
 
+void
+BoundSelectQuery::
+runWindowFunctions()
+{
+    if (!windowRowsGenerator)
+        return;
+
+    std::call_once(*windowFunctionsCalculated, [&] ()
+        {
+            auto rows = (*windowRowsGenerator)(-1, Any()).first;
+            context->runWindowFunctions(rows);
+        });
+}
+
 std::shared_ptr<ExpressionValueInfo>
 BoundSelectQuery::
 getSelectOutputInfo() const
@@ -1568,6 +1719,107 @@ struct GroupContext: public SqlExpressionDatasetScope {
 /* BOUND GROUP BY QUERY                                                      */
 /*****************************************************************************/
 
+namespace {
+
+/// Number of partitions that the groups are split into by hash, so that
+/// each partition can be merged across buckets independently
+const int GROUP_PARTITIONS = 64;
+
+typedef std::vector<ExpressionValue> RowKey;
+
+/** Hash of a cell that is consistent with the ordering used to compare
+    group keys, under which (for example) 1 and 1.0 are the same group.
+*/
+size_t groupKeyHash(const CellValue & cell)
+{
+    if (cell.isNumeric()) {
+        double d = cell.toDouble();
+        if (d == 0.0)
+            d = 0.0;  // -0.0 and 0.0 are the same group
+        return std::hash<double>()(d);
+    }
+    return cell.hash();
+}
+
+size_t groupKeyHash(const ExpressionValue & val)
+{
+    if (val.isAtom())
+        return groupKeyHash(val.getAtom());
+
+    // Rows are compared independently of the order of their columns,
+    // so the hashes of the atoms are combined with a sum.
+    size_t result = 0;
+    auto onAtom = [&] (const Path & columnName,
+                       const Path & prefix,
+                       const CellValue & cell,
+                       Date ts)
+        {
+            result += (prefix + columnName).hash() * 31 + groupKeyHash(cell);
+            return true;
+        };
+    val.forEachAtom(onAtom);
+    return result;
+}
+
+/** Group key with its hash, which is calculated once when the row is
+    first seen and then used for both the partition and the hash tables.
+*/
+struct HashedRowKey {
+    HashedRowKey(RowKey key)
+        : key(std::move(key)), hash(0)
+    {
+        for (auto & v: this->key)
+            hash = hash * 1000003 + groupKeyHash(v);
+    }
+
+    RowKey key;
+    size_t hash;
+
+    int partition() const
+    {
+        return (hash >> 32) % GROUP_PARTITIONS;
+    }
+};
+
+/** Rough number of bytes held in memory by a group, not counting what is
+    inside the state of its aggregators, which isn't visible from here.
+*/
+size_t groupMemusage(const HashedRowKey & key, const GroupMapValue & value)
+{
+    size_t result = sizeof(HashedRowKey) + sizeof(GroupMapValue)
+        + 4 * sizeof(void *)  // hash table node and bucket
+        + value.size() * sizeof(GroupMapValue::value_type);
+    for (auto & v: key.key)
+        result += expressionValueMemusage(v);
+    return result;
+}
+
+struct HashedRowKeyHash {
+    size_t operator () (const HashedRowKey & key) const
+    {
+        return key.hash;
+    }
+};
+
+/** Two keys are the same group if neither sorts before the other, which
+    is what the ordered map that used to hold the groups relied on.
+*/
+struct HashedRowKeyEquivalent {
+    bool operator () (const HashedRowKey & key1,
+                      const HashedRowKey & key2) const
+    {
+        if (key1.hash != key2.hash || key1.key.size() != key2.key.size())
+            return false;
+        for (size_t i = 0;  i < key1.key.size();  ++i) {
+            if (key1.key[i] < key2.key[i] || key2.key[i] < key1.key[i])
+                return false;
+        }
+        return true;
+    }
+};
+
+} // file scope
+
 BoundGroupByQuery::
 BoundGroupByQuery(const SelectExpression & select,
                   const Dataset & from,
@@ -1639,9 +1891,15 @@ execute(RowProcessor processor,
     std::vector<SortedRow> rowsSorted;
     std::atomic<ssize_t> groupsDone(0);
 
-    typedef std::vector<ExpressionValue> RowKey;
-    typedef std::map<RowKey, GroupMapValue> GroupByMapType;
-    std::vector<GroupByMapType> accum(numBuckets);
+    // Groups are aggregated in two phases.  First each bucket of rows
+    // aggregates into its own hash tables, one per partition of the group
+    // key hashes.  Then each partition is merged across the buckets in
+    // parallel with the others.
+    typedef std::unordered_map<HashedRowKey, GroupMapValue,
+                               HashedRowKeyHash, HashedRowKeyEquivalent>
+        GroupByMapType;
+    std::vector<std::vector<GroupByMapType> >
+        accum(numBuckets, std::vector<GroupByMapType>(GROUP_PARTITIONS));
 
     for (const auto & c: select.clauses) {
         if (c->isWildcard()) {
@@ -1666,20 +1924,45 @@ execute(RowProcessor processor,
     //we placed the orderby aggregators after the having aggregator in the list
     boundOrderBy = orderBy.bindAll(*groupContext);
 
+    // Compare two rows according to the sort criteria
+    auto compareRows = [&] (const SortedRow & row1,
+                            const SortedRow & row2)
+        {
+            return boundOrderBy.lessWithSortKey(std::get<0>(row1),
+                                                std::get<0>(row2));
+        };
+
+    // The ordered output rows are held until the end, and spilled to disk
+    // as sorted runs when they take more than the memory budget.  The
+    // aggregator state of the groups can't be written out, so it is
+    // always kept in memory.
+    size_t memoryBudget = getQueryMemoryBudget();
+    SpilledRowRuns spilled(compareRows);
+    size_t bytesInMemory = 0;
+
+    // The groups and the output rows held in memory are charged to the
+    // running query
+    MemoryCharge groupsCharge;
+    MemoryCharge rowsCharge(groupsCharge.account);
+
     // When we get a row, we record it under the group key
     auto onRow = [&] (NamedRowValue & row,
                       const std::vector<ExpressionValue> & calc,
                       int groupNum)
     {
-       GroupByMapType & map = accum[groupNum];
-       RowKey rowKey(calc.begin(), calc.begin() + groupBy.clauses.size());
+       HashedRowKey rowKey(RowKey(calc.begin(),
+                                  calc.begin() + groupBy.clauses.size()));
+       GroupByMapType & map = accum[groupNum][rowKey.partition()];
 
-       auto pair = map.insert({rowKey, GroupMapValue()});
+       auto pair = map.emplace(std::move(rowKey), GroupMapValue());
        auto & iter = pair.first;
        if (pair.second)
        {
           //initialize aggregator data
           groupContext->initializePerThreadAggregators(iter->second);
+
+          if (groupsCharge.active())
+              groupsCharge.add(groupMemusage(iter->first, iter->second));
        }
 
        groupContext->aggregateRow(iter->second, calc);
@@ -1689,17 +1972,23 @@ execute(RowProcessor processor,
             
     subSelect->execute(onRow, true /*processInParallel*/, 0, -1, onProgress);
   
-    //merge the maps in fixed order
-    GroupByMapType destMap;
-    std::vector<GroupByMapType>& threads = accum;
-    if (threads.size() > 0)
+    //merge each partition across the buckets, in fixed bucket order
+    std::vector<GroupByMapType> destMaps(GROUP_PARTITIONS);
+
+    auto mergePartition = [&] (int partition)
     {
-//        STACK_PROFILE(MergingBuckets);
-        for (auto & srcMap : threads)
-        {
+        GroupByMapType & destMap = destMaps[partition];
+        for (auto & bucket: accum) {
+            GroupByMapType & srcMap = bucket[partition];
             for (auto it = srcMap.begin(); it != srcMap.end(); ++it)
             {
-                auto pair = destMap.insert({it->first, GroupMapValue()});
+                if (accum.size() == 1) {
+                    // Nothing to merge with; take it as it is
+                    destMap.emplace(it->first, std::move(it->second));
+                    continue;
+                }
+
+                auto pair = destMap.emplace(it->first, GroupMapValue());
                 auto destiter = pair.first;
                 if (pair.second)
                 {
@@ -1709,22 +1998,41 @@ execute(RowProcessor processor,
 
                 groupContext->mergeThreadMap(destiter->second, it->second);
             }
+            srcMap.clear();
         }
+    };
+
+    parallelMap(0, GROUP_PARTITIONS, mergePartition);
+
+    // The groups are output in the order of their keys
+    std::vector<GroupByMapType::value_type *> groups;
+    for (auto & destMap: destMaps) {
+        for (auto & entry: destMap)
+            groups.push_back(&entry);
     }
 
-    if (destMap.empty() && groupContext->evaluateEmptyGroups
+    std::sort(groups.begin(), groups.end(),
+              [] (const GroupByMapType::value_type * group1,
+                  const GroupByMapType::value_type * group2)
+              {
+                  return group1->first.key < group2->first.key;
+              });
+
+    GroupByMapType::value_type emptyGroup { HashedRowKey(RowKey()),
+                                            GroupMapValue() };
+    if (groups.empty() && groupContext->evaluateEmptyGroups
         && groupBy.clauses.empty())
     {
-        auto pair = destMap.emplace(RowKey(), GroupMapValue());
-        groupContext->initializePerThreadAggregators(pair.first->second);
+        groupContext->initializePerThreadAggregators(emptyGroup.second);
+        groups.push_back(&emptyGroup);
     }
 
     //output rows
-    //each entry in the final map should be an output row for us   
-    for (auto it = destMap.begin(); it != destMap.end(); ++it)
+    //each group should be an output row for us
+    for (auto * group: groups)
     {
-        RowKey rowKey = it->first;
-        groupContext->aggData = it->second;
+        RowKey rowKey = group->first.key;
+        groupContext->aggData = group->second;
 
          // Create the context to evaluate the row name and order by
         NamedRowValue outputRow;
@@ -1756,94 +2064,130 @@ execute(RowProcessor processor,
         {
              //Else we add the result to the output rows
             std::vector<ExpressionValue> sortFields
-            = boundOrderBy.apply(rowContext);
+            = boundOrderBy.applyWithSortKey(rowContext);
 
             std::vector<ExpressionValue> calcd;
                 
             rowsSorted.emplace_back(std::move(sortFields),
                                     std::move(outputRow),
                                     std::move(calcd));
+
+            // Spill the output rows as a sorted run once they go over the
+            // memory budget
+            if (memoryBudget || rowsCharge.active()) {
+                size_t bytes = SpilledRowRuns::memusage(rowsSorted.back());
+                rowsCharge.add(bytes);
+                bytesInMemory += bytes;
+                if (memoryBudget && bytesInMemory > memoryBudget) {
+                    spilled.spill(rowsSorted);
+                    rowsCharge.release(bytesInMemory);
+                    bytesInMemory = 0;
+                }
+            }
         }           
     }
 
     if (boundOrderBy.empty())
         return {true, selectInfo};
 
-    // Compare two rows according to the sort criteria
-    auto compareRows = [&] (const SortedRow & row1,
-                            const SortedRow & row2)
-        {
-            return boundOrderBy.less(std::get<0>(row1),
-                                     std::get<0>(row2));
-        };
-
     // Sort our output rows
     std::sort(rowsSorted.begin(), rowsSorted.end(), compareRows);
 
-    // Now select only the required subset of sorted rows
-    if (limit == -1)
-        limit = rowsSorted.size();
+    // Go through the rows in order, merging in those that were spilled to
+    // disk if there are any.  onRow returns false to stop early.
+    auto forEachSorted = [&] (const std::function<bool (SortedRow &)> & onRow)
+        {
+            if (spilled.numRuns() > 0) {
+                spilled.merge(rowsSorted, onRow);
+                return;
+            }
+            for (auto & row: rowsSorted) {
+                if (!onRow(row))
+                    return;
+            }
+        };
 
+    // Now select only the required subset of sorted rows
     ExcAssertGreaterEqual(offset, 0);
 
+    bool cancelled = false;
+
     if (select.distinctExpr.size() > 0) {
 
         std::vector<ExpressionValue> reference;
         size_t numDistinctOnClauses = select.distinctExpr.size();
         reference.resize(numDistinctOnClauses);
         ssize_t count = 0;
+        bool first = true;
 
-        for (unsigned i = 0;  i < rowsSorted.size();  ++i) {
-
-            std::vector<ExpressionValue> & mark = std::get<0>(rowsSorted[i]);
+        auto onRow = [&] (SortedRow & sorted)
+            {
+                std::vector<ExpressionValue> & mark = std::get<0>(sorted);
 
-            if (i == 0) {
-                std::copy_n(mark.begin(), numDistinctOnClauses, reference.begin());
-            }
-            else {
+                if (first) {
+                    std::copy_n(mark.begin(), numDistinctOnClauses, reference.begin());
+                    first = false;
+                }
+                else {
 
-                bool same = true;
-                for (int i = 0; i < numDistinctOnClauses; ++i){
-                    if (reference[i] != mark[i]) {
-                        same = false;
-                        break;
+                    bool same = true;
+                    for (int i = 0; i < numDistinctOnClauses; ++i){
+                        if (reference[i] != mark[i]) {
+                            same = false;
+                            break;
+                        }
                     }
-                }
 
-                if (!same)
-                    std::copy_n(mark.begin(), numDistinctOnClauses, reference.begin());
-                else
-                    continue; //skip duplicates
-            }
-            ++count;
+                    if (!same)
+                        std::copy_n(mark.begin(), numDistinctOnClauses, reference.begin());
+                    else
+                        return true; //skip duplicates
+                }
+                ++count;
 
-            if (count <= offset)
-                continue;
+                if (count <= offset)
+                    return true;
 
-            auto & row = std::get<1>(rowsSorted[i]);
+                auto & row = std::get<1>(sorted);
 
-            /* Finally, pass to the terminator to continue. */
-            if (!processor(row))
-                return {false, selectInfo}; //early exis on processor error
+                /* Finally, pass to the terminator to continue. */
+                if (!processor(row)) {
+                    cancelled = true; //early exit on processor error
+                    return false;
+                }
 
-            if (count - offset == limit)
-                break;
-        }
+                return count - offset != limit;
+            };
 
+        forEachSorted(onRow);
     }
     else {
 
-        ssize_t begin = std::min<ssize_t>(offset, rowsSorted.size());
-        ssize_t end = std::min<ssize_t>(offset + limit, rowsSorted.size());
+        ssize_t i = 0;
 
-        for (unsigned i = begin;  i < end;  ++i) {
-            auto & row = std::get<1>(rowsSorted[i]);
+        auto onRow = [&] (SortedRow & sorted)
+            {
+                ssize_t rowNum = i++;
+                if (rowNum < offset)
+                    return true;
+                if (limit != -1 && rowNum >= offset + limit)
+                    return false;
 
-            /* Finally, pass to the terminator to continue. */
-            if (!processor(row))
-                return {false, selectInfo}; //early exis on processor error
-        } 
-    }  
+                auto & row = std::get<1>(sorted);
+
+                /* Finally, pass to the terminator to continue. */
+                if (!processor(row)) {
+                    cancelled = true; //early exit on processor error
+                    return false;
+                }
+                return true;
+            };
+
+        forEachSorted(onRow);
+    }
+
+    if (cancelled)
+        return {false, selectInfo};
 
     return {true, selectInfo};
 }
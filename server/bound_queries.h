@@ -10,6 +10,7 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/server/analytics.h"
 #include "mldb/utils/log_fwd.h"
+#include <mutex>
 
 
 
@@ -19,57 +20,6 @@ struct GroupContext;
 struct SqlExpressionDatasetScope;
 
 
-/** This object is designed to track whether a thread is executing a
-    query as a child thread (in which case it shouldn't create any
-    extra threads) or as a parent (in which case it could).
-
-*/
-struct QueryThreadTracker {
-
-    // Constructor for the parent thread
-    QueryThreadTracker()
-        : inParent(true)
-    {
-    }
-    
-    // Constructor for the child thread
-    QueryThreadTracker child() const
-    {
-        QueryThreadTracker result;
-        result.inParent = false;
-        ++depth;
-        return result;
-    }
-
-    // Destructor, which undoes the increment from the desctructor
-    ~QueryThreadTracker()
-    {
-        if (!inParent)
-            --depth;
-    }
-    
-    static bool inChildThread() { return depth > 0; }
-
-    bool inParent;
-    static __thread int depth;
-
-    QueryThreadTracker(const QueryThreadTracker &) = delete;
-    void operator = (const QueryThreadTracker &) = delete;
-
-    QueryThreadTracker(QueryThreadTracker && other)
-    {
-        *this = std::move(other);
-    }
-
-    QueryThreadTracker & operator = (QueryThreadTracker && other)
-    {
-        inParent = other.inParent;
-        other.inParent = true;  // to avoid depth being decremented
-        return *this;
-    }
-};
-
-
 /*****************************************************************************/
 /* BOUND SELECT QUERY                                                        */
 /*****************************************************************************/
@@ -134,6 +84,19 @@ struct BoundSelectQuery {
     std::shared_ptr<Executor> executor;
 
     std::shared_ptr<ExpressionValueInfo> getSelectOutputInfo() const;
+
+private:
+    /// Rows that match the where clause, over which window functions in
+    /// the select are calculated.  Only set if there are any.
+    std::shared_ptr<GenerateRowsWhereFunction> windowRowsGenerator;
+    /// Held by pointer, as a once_flag can't be moved and bound queries
+    /// are returned by value
+    std::unique_ptr<std::once_flag> windowFunctionsCalculated {
+        new std::once_flag()
+    };
+
+    /// Calculate the window functions, the first time we execute
+    void runWindowFunctions();
 };
 
 
@@ -108,6 +108,15 @@ CredentialRuleCollection(MLDB::MldbServer * server)
     : Base("credential", "credentials", server)
 {
     this->backgroundCreate = false;
+
+    // Rules that are added, replaced or deleted change the credentials
+    // that getCredential() has indexed
+    rulesChanged = watchElements("*", false /* catchUp */,
+                                 string("credentialIndex"));
+    rulesChanged.bind([] (const ChildEvent &)
+                      {
+                          CredentialProvider::invalidateCache();
+                      });
 }
 
 CredentialRuleCollection::
@@ -76,6 +76,10 @@ struct CredentialRuleCollection
 
     virtual std::shared_ptr<CredentialRuleConfig>
     getConfig(std::string key, const CredentialRule & value) const;
+
+    /** Watch on our rules that tells getCredential() that they changed.
+        It is owned by us so that it goes away before the watches. */
+    WatchT<ChildEvent> rulesChanged;
 };
 
 extern template class RestCollection<std::string, MLDB::CredentialRule>;
@@ -14,6 +14,7 @@
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/sql/cell_value_msgpack.h"
 #include "mldb/types/map_description.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/types/pointer_description.h"
@@ -66,6 +67,53 @@ registerDatasetType(const Package & package,
                                            docRoute, customRoute, config, registryFlags);
 }
 
+namespace {
+
+/** A response that is sent back with chunked encoding as it is written,
+    so that a large result never needs to be held as a single string.  The
+    connection blocks in sendPayload() when the client falls behind, which
+    throttles whoever is writing the response.
+*/
+struct StreamedResponse {
+    static constexpr size_t FLUSH_BYTES = 65536;
+
+    StreamedResponse(RestConnection & connection,
+                     const std::string & contentType)
+        : connection(connection)
+    {
+        connection.sendHttpResponseHeader(200, contentType,
+                                          RestConnection::CHUNKED_ENCODING);
+        buffer.reserve(FLUSH_BYTES * 2);
+    }
+
+    /// Send what has been written so far if it's large enough
+    void flushIfFull()
+    {
+        if (buffer.size() >= FLUSH_BYTES)
+            flush();
+    }
+
+    void flush()
+    {
+        if (buffer.empty())
+            return;
+        connection.sendPayload(std::move(buffer));
+        buffer.clear();
+        buffer.reserve(FLUSH_BYTES * 2);
+    }
+
+    void finish()
+    {
+        flush();
+        connection.finishResponse();
+    }
+
+    RestConnection & connection;
+    std::string buffer;
+};
+
+} // file scope
+
 void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   RestConnection & connection,
                   const std::string & format,
@@ -83,12 +131,21 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
     }
 
     if (format == "full" || format == "") {
-        connection.sendResponse(200, jsonEncodeStr(sparseOutput),
-                                "application/json");
+        StreamedResponse response(connection, "application/json");
+        response.buffer += '[';
+        for (size_t i = 0;  i < sparseOutput.size();  ++i) {
+            if (i != 0)
+                response.buffer += ',';
+            response.buffer += jsonEncodeStr(sparseOutput[i]);
+            sparseOutput[i] = MatrixNamedRow();
+            response.flushIfFull();
+        }
+        response.buffer += ']';
+        response.finish();
     }
     else if (format == "sparse") {
-        std::vector<std::vector<std::pair<ColumnPath, CellValue> > > output;
-        output.reserve(sparseOutput.size());
+        StreamedResponse response(connection, "application/json");
+        response.buffer += '[';
 
         for (auto & row: sparseOutput) {
 
@@ -106,11 +163,15 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
 
             std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
 
-            output.emplace_back(std::move(rowOut));
+            if (&row != &sparseOutput.front())
+                response.buffer += ',';
+            response.buffer += jsonEncodeStr(rowOut);
+            row = MatrixNamedRow();
+            response.flushIfFull();
         }
 
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+        response.buffer += ']';
+        response.finish();
     }
     else if (format == "soa") {
         // Structure of arrays; one array per column
@@ -250,6 +311,38 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         connection.sendResponse(200, jsonEncodeStr(output),
                                 "application/json");
     }
+    else if (format == "msgpack") {
+        // Same structure as the full format, but encoded as MessagePack
+        StreamedResponse response(connection, "application/msgpack");
+        MsgPackWriter writer(response.buffer);
+
+        writer.writeArrayHeader(sparseOutput.size());
+
+        for (auto & row: sparseOutput) {
+            writer.writeMapHeader(1 + rowNames + rowHashes);
+            if (rowNames) {
+                writer.writeString("rowName", 7);
+                writer.writePath(row.rowName);
+            }
+            if (rowHashes) {
+                writer.writeString("rowHash", 7);
+                writer.writeString(row.rowHash.toString());
+            }
+            writer.writeString("columns", 7);
+            writer.writeArrayHeader(row.columns.size());
+            for (auto & c: row.columns) {
+                writer.writeArrayHeader(3);
+                writer.writePath(std::get<0>(c));
+                writer.writeCellValue(std::get<1>(c));
+                writer.writeTimestamp(std::get<2>(c));
+            }
+
+            row = MatrixNamedRow();
+            response.flushIfFull();
+        }
+
+        response.finish();
+    }
     else {
         connection.sendErrorResponse(400, "Unknown output format '" + format + "'");
     }
@@ -308,6 +401,12 @@ initRoutes(RouteManager & manager)
                            &Dataset::getTimestampRange,
                            getDataset);
 
+    addRouteSyncJsonReturn(*manager.valueNode, "/memory", { "GET" },
+                           "Return the memory used by the dataset",
+                           "Breakdown of the bytes used by the dataset",
+                           &Dataset::getMemoryUsage,
+                           getDataset);
+
     //auto & matrix
     //    = manager.valueNode->addSubRouter("/matrix", "Operations on dataset as matrix");
 
@@ -14,6 +14,10 @@
 #include "mldb/http/http_exception.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/sql/sql_utils.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/server/per_thread_accumulator.h"
+#include "mldb/server/parallel_merge_sort.h"
+#include "mldb/base/parallel.h"
 
 using namespace std;
 
@@ -265,14 +269,16 @@ getReshaped(const std::unordered_map<ColumnHash, ColumnPath> & index,
 
 SqlExpressionDatasetScope::
 SqlExpressionDatasetScope(std::shared_ptr<Dataset> dataset, const Utf8String& alias)
-    : SqlExpressionMldbScope(dataset->server), dataset(*dataset), alias(alias)
+    : SqlExpressionMldbScope(dataset->server), dataset(*dataset), alias(alias),
+      readsAllColumns(false)
 {
      dataset->getChildAliases(childaliases);
 }
 
 SqlExpressionDatasetScope::
 SqlExpressionDatasetScope(const Dataset & dataset, const Utf8String& alias)
-    : SqlExpressionMldbScope(dataset.server), dataset(dataset), alias(alias)
+    : SqlExpressionMldbScope(dataset.server), dataset(dataset), alias(alias),
+      readsAllColumns(false)
 {
     dataset.getChildAliases(childaliases);
 }
@@ -281,7 +287,8 @@ SqlExpressionDatasetScope::
 SqlExpressionDatasetScope(const BoundTableExpression& boundDataset)
     : SqlExpressionMldbScope(boundDataset.dataset->server),
       dataset(*boundDataset.dataset),
-      alias(boundDataset.asName)
+      alias(boundDataset.asName),
+      readsAllColumns(false)
 {
     boundDataset.dataset->getChildAliases(childaliases);
 }
@@ -300,6 +307,10 @@ doGetColumn(const Utf8String & tableName,
     if (simplified.empty())
         simplified = columnName;
 
+    if (simplified.empty())
+        readsAllColumns = true;
+    else columnsRead.insert(simplified);
+
     //cerr << "doGetColumn: " << tableName << " " << columnName << endl;
     //cerr << columnName.size() << endl;
     //cerr << "alias " << alias << endl;
@@ -307,14 +318,21 @@ doGetColumn(const Utf8String & tableName,
     //    cerr << "  child " << c << endl;
     //cerr << "simplified = " << simplified << endl;
 
-    return {[=] (const SqlRowScope & context,
-                 ExpressionValue & storage,
-                 const VariableFilter & filter) -> const ExpressionValue &
+    ColumnGetter result
+        {[=] (const SqlRowScope & context,
+              ExpressionValue & storage,
+              const VariableFilter & filter) -> const ExpressionValue &
             {
                 auto & row = context.as<RowScope>();
                 return row.getColumn(simplified, filter, storage);
             },
             std::make_shared<AtomValueInfo>()};
+
+    // Datasets that support vectorized execution read the column under
+    // its name within the dataset
+    result.batchColumnName = simplified;
+
+    return result;
 }
 
 
@@ -328,8 +346,11 @@ doGetFunction(const Utf8String & tableName,
     // First, let the dataset either override or implement the function
     // itself.
     auto fnoverride = dataset.overrideFunction(tableName, functionName, argScope);
-    if (fnoverride)
+    if (fnoverride) {
+        // We don't know what it reads from the row
+        readsAllColumns = true;
         return fnoverride;
+    }
 
     if (functionName == "rowName") {
         return {[=] (const std::vector<ExpressionValue> & args,
@@ -380,6 +401,7 @@ doGetFunction(const Utf8String & tableName,
        in the current row.
     */
     if (functionName == "columnCount") {
+        readsAllColumns = true;
         return {[=] (const std::vector<ExpressionValue> & args,
                      const SqlRowScope & context)
                 {
@@ -423,6 +445,8 @@ doGetAllColumnsInternal(const Utf8String & tableName,
         && tableName != alias)
             throw HttpReturnException(400, "Unknown dataset " + tableName);
 
+    readsAllColumns = true;
+
     bool allWereKept = true;
     bool noneWereRenamed = true;
     std::unordered_map<ColumnHash, ColumnPath> index;
@@ -574,6 +598,49 @@ doCreateRowsWhereGenerator(const SqlExpression & where,
     return res;
 }
 
+std::function<ExpressionValue (const RowPath & row)>
+SqlExpressionDatasetScope::
+getRowExprFunction() const
+{
+    if (readsAllColumns) {
+        const Dataset & dataset = this->dataset;
+        return [&dataset] (const RowPath & row)
+            {
+                return dataset.getRowExpr(row);
+            };
+    }
+
+    return dataset.getProjectedRowExpr({ columnsRead.begin(),
+                                         columnsRead.end() });
+}
+
+std::function<ExpressionValue (const RowPath & row)>
+SqlExpressionDatasetScope::
+getRowExprFunction(const BoundWhenExpression & when) const
+{
+    auto getRow = getRowExprFunction();
+    if (!when.hasTimestampRange())
+        return getRow;
+
+    const Dataset & dataset = this->dataset;
+    Date earliest = when.earliest;
+    Date latest = when.latest;
+
+    return [&dataset, getRow, earliest, latest] (const RowPath & row)
+        {
+            Date rowEarliest, rowLatest;
+            std::tie(rowEarliest, rowLatest)
+                = dataset.getRowTimestampRange(row);
+
+            // This is what the WHEN clause would leave of the row.  An
+            // unknown range is not a date, and so compares false.
+            if (rowLatest < earliest || latest < rowEarliest)
+                return ExpressionValue(StructValue());
+
+            return getRow(row);
+        };
+}
+
 ColumnFunction
 SqlExpressionDatasetScope::
 doGetColumnFunction(const Utf8String & functionName)
@@ -632,6 +699,284 @@ doResolveTableName(const ColumnPath & fullColumnName, Utf8String &tableName) con
 }   
 
 
+/*****************************************************************************/
+/* WINDOW FUNCTIONS                                                          */
+/*****************************************************************************/
+
+struct SqlExpressionDatasetScope::BoundWindowFunction {
+    WindowFunctionType type;
+    WindowFrame frame;
+    Utf8String surface;
+
+    /// Argument of the function, unless it takes none
+    BoundSqlExpression arg;
+
+    /// The PARTITION BY expressions, ascending, then the ORDER BY ones
+    BoundOrderByExpression sortBy;
+    size_t numPartitionClauses;
+
+    /// Value for each row, by row hash, once calculated
+    std::unordered_map<uint64_t, ExpressionValue> values;
+    bool calculated = false;
+
+    /// What we know about each row
+    struct Entry {
+        std::vector<ExpressionValue> sortFields;
+        CellValue value;
+        Date ts;
+        uint64_t rowHash;
+    };
+
+    /// Sort the entries and calculate the function over each partition
+    void calculate(std::vector<std::vector<Entry> > & entries);
+};
+
+void
+SqlExpressionDatasetScope::BoundWindowFunction::
+calculate(std::vector<std::vector<Entry> > & entries)
+{
+    // Ties are broken by the row hash, so that ROWS frames over rows that
+    // sort equal are deterministic
+    auto compareEntries = [&] (const Entry & e1, const Entry & e2)
+        {
+            if (sortBy.lessWithSortKey(e1.sortFields, e2.sortFields))
+                return true;
+            if (sortBy.lessWithSortKey(e2.sortFields, e1.sortFields))
+                return false;
+            return e1.rowHash < e2.rowHash;
+        };
+
+    std::vector<Entry> sorted = parallelMergeSort(entries, compareEntries);
+
+    auto sameFields = [&] (const Entry & e1, const Entry & e2,
+                           size_t first, size_t last)
+        {
+            for (size_t i = first;  i < last;  ++i) {
+                if (e1.sortFields[i].compare(e2.sortFields[i]) != 0)
+                    return false;
+            }
+            return true;
+        };
+
+    // Rows of each partition are contiguous once sorted
+    std::vector<std::pair<size_t, size_t> > partitions;
+    for (size_t i = 0;  i < sorted.size();) {
+        size_t j = i + 1;
+        while (j < sorted.size()
+               && sameFields(sorted[i], sorted[j], 0, numPartitionClauses))
+            ++j;
+        partitions.emplace_back(i, j);
+        i = j;
+    }
+
+    size_t numSortClauses = sortBy.size();
+    std::vector<ExpressionValue> results(sorted.size());
+
+    auto doPartition = [&] (size_t p)
+        {
+            size_t begin, end;
+            std::tie(begin, end) = partitions[p];
+
+            std::vector<CellValue> values;
+            std::vector<Date> timestamps;
+            std::vector<double> orderKeys;
+            values.reserve(end - begin);
+            timestamps.reserve(end - begin);
+            orderKeys.reserve(end - begin);
+
+            for (size_t i = begin;  i < end;  ++i) {
+                Entry & entry = sorted[i];
+                values.emplace_back(std::move(entry.value));
+                timestamps.push_back(entry.ts);
+
+                if (frame.needsOrderValue()) {
+                    // RANGE offsets are distances in the value
+                    const ExpressionValue & order
+                        = entry.sortFields[numPartitionClauses];
+                    double key;
+                    if (order.isAtom() && order.getAtom().isNumber())
+                        key = order.getAtom().toDouble();
+                    else if (order.isAtom() && order.getAtom().isTimestamp())
+                        key = order.getAtom().toTimestamp().secondsSinceEpoch();
+                    else throw HttpReturnException
+                             (400, "A RANGE window frame with an offset needs "
+                              "its ORDER BY expression to be a number or a "
+                              "timestamp",
+                              "expression", surface,
+                              "value", order);
+                    if (sortBy.clauses[numPartitionClauses].dir == DESC)
+                        key = -key;
+                    orderKeys.push_back(key);
+                }
+                else {
+                    // Only which rows sort equal to each other matters
+                    bool peer = i > begin
+                        && sameFields(sorted[i - 1], entry,
+                                      numPartitionClauses, numSortClauses);
+                    orderKeys.push_back(i == begin ? 0 : orderKeys.back()
+                                        + (peer ? 0 : 1));
+                }
+            }
+
+            auto partitionResults
+                = calcWindowFunction(type, frame, values, timestamps,
+                                     orderKeys);
+            for (size_t i = begin;  i < end;  ++i)
+                results[i] = std::move(partitionResults[i - begin]);
+        };
+
+    parallelMap(0, partitions.size(), doPartition);
+
+    values.reserve(sorted.size());
+    for (size_t i = 0;  i < sorted.size();  ++i)
+        values.emplace(sorted[i].rowHash, std::move(results[i]));
+    calculated = true;
+}
+
+TableSample
+SqlExpressionDatasetScope::
+doGetTableSample()
+{
+    TableSample result;
+    result.fraction = dataset.getSampledFraction();
+    if (result.fraction < 1.0)
+        result.rows = dataset.getMatrixView()->getRowCount();
+    return result;
+}
+
+void
+SqlExpressionDatasetScope::
+enableWindowFunctions()
+{
+    if (!windowFunctions)
+        windowFunctions = std::make_shared
+            <std::vector<std::shared_ptr<BoundWindowFunction> > >();
+}
+
+bool
+SqlExpressionDatasetScope::
+hasWindowFunctions() const
+{
+    return windowFunctions && !windowFunctions->empty();
+}
+
+ColumnGetter
+SqlExpressionDatasetScope::
+doGetWindowFunction(const WindowFunctionExpression & expr)
+{
+    if (!windowFunctions)
+        return SqlExpressionMldbScope::doGetWindowFunction(expr);
+
+    auto bound = std::make_shared<BoundWindowFunction>();
+    bound->type = expr.type;
+    bound->frame = expr.frame;
+    bound->surface = expr.surface;
+    if (!expr.args.empty())
+        bound->arg = expr.args[0]->bind(*this);
+
+    OrderByExpression sortBy;
+    for (auto & p: expr.partitionBy)
+        sortBy.clauses.emplace_back(p, ASC);
+    sortBy.clauses.insert(sortBy.clauses.end(),
+                          expr.orderBy.clauses.begin(),
+                          expr.orderBy.clauses.end());
+    bound->sortBy = sortBy.bindAll(*this);
+    bound->numPartitionClauses = expr.partitionBy.size();
+
+    windowFunctions->push_back(bound);
+
+    std::shared_ptr<ExpressionValueInfo> info;
+    switch (expr.type) {
+    case WINDOW_COUNT:
+    case WINDOW_ROW_NUMBER:
+        info = std::make_shared<Uint64ValueInfo>();
+        break;
+    case WINDOW_SUM:
+    case WINDOW_AVG:
+        info = std::make_shared<Float64ValueInfo>();
+        break;
+    default:
+        info = std::make_shared<AtomValueInfo>();
+    }
+
+    return {[=] (const SqlRowScope & context,
+                 ExpressionValue & storage,
+                 const VariableFilter & filter) -> const ExpressionValue &
+            {
+                if (!bound->calculated)
+                    throw HttpReturnException
+                        (500, "Window function read before it was "
+                         "calculated",
+                         "expression", bound->surface);
+                auto & row = context.as<RowScope>();
+                auto it = bound->values.find(row.getRowHash().hash());
+                if (it == bound->values.end())
+                    return storage = ExpressionValue::null
+                        (Date::negativeInfinity());
+                return it->second;
+            },
+            info};
+}
+
+void
+SqlExpressionDatasetScope::
+runWindowFunctions(const std::vector<RowPath> & rows)
+{
+    if (!hasWindowFunctions())
+        return;
+
+    auto & functions = *windowFunctions;
+    typedef BoundWindowFunction::Entry Entry;
+
+    // One vector of entries per function, per thread
+    PerThreadAccumulator<std::vector<std::vector<Entry> > > accum
+        ([&] () { return new std::vector<std::vector<Entry> >
+                  (functions.size()); });
+
+    auto getRow = getRowExprFunction();
+
+    auto doRow = [&] (size_t n)
+        {
+            ExpressionValue row = getRow(rows[n]);
+            auto rowScope = getRowScope(rows[n], row);
+            uint64_t rowHash = RowHash(rows[n]).hash();
+
+            auto & threadEntries = accum.get();
+            for (size_t i = 0;  i < functions.size();  ++i) {
+                const BoundWindowFunction & fn = *functions[i];
+                Entry entry;
+                entry.sortFields = fn.sortBy.applyWithSortKey(rowScope);
+                if (fn.arg) {
+                    ExpressionValue storage;
+                    const ExpressionValue & value
+                        = fn.arg(rowScope, storage, GET_LATEST);
+                    if (!value.empty() && !value.isAtom())
+                        throw HttpReturnException
+                            (400, "The argument of a window function must "
+                             "be an atom",
+                             "expression", fn.surface,
+                             "value", value);
+                    entry.value = value.getAtom();
+                    entry.ts = value.getEffectiveTimestamp();
+                }
+                entry.rowHash = rowHash;
+                threadEntries[i].emplace_back(std::move(entry));
+            }
+        };
+
+    parallelMap(0, rows.size(), doRow);
+
+    for (size_t i = 0;  i < functions.size();  ++i) {
+        std::vector<std::vector<Entry> > entries;
+        accum.forEach([&] (std::vector<std::vector<Entry> > * thread)
+                      {
+                          entries.emplace_back(std::move((*thread)[i]));
+                      });
+        functions[i]->calculate(entries);
+    }
+}
+
+
 /*****************************************************************************/
 /* ROW EXPRESSION ORDER BY CONTEXT                                           */
 /*****************************************************************************/
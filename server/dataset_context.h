@@ -12,6 +12,7 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/sql/binding_contexts.h"
 #include <unordered_map>
+#include <set>
 
 
 namespace MLDB {
@@ -172,6 +173,31 @@ struct SqlExpressionDatasetScope: public SqlExpressionMldbScope {
     Utf8String alias;
     std::vector<Utf8String> childaliases;
 
+    /// Columns of the dataset read by the expressions bound in this scope
+    std::set<ColumnPath> columnsRead;
+
+    /// Set once an expression bound in this scope may read any column of
+    /// the row, for example through a wildcard or columnCount()
+    bool readsAllColumns;
+
+    /** Return a function that gets the rows of the dataset with at least
+        the columns read by the expressions bound so far, so that datasets
+        can skip the others; see Dataset::getProjectedRowExpr().  This must
+        be called once all of the expressions that read the rows have been
+        bound.
+    */
+    std::function<ExpressionValue (const RowPath & row)>
+    getRowExprFunction() const;
+
+    /** As above, for rows that will then be filtered by the given WHEN
+        clause.  Rows whose cells all have timestamps that the clause
+        filters out are returned empty without being read, when the
+        dataset knows their timestamp range; see
+        Dataset::getRowTimestampRange().
+    */
+    std::function<ExpressionValue (const RowPath & row)>
+    getRowExprFunction(const BoundWhenExpression & when) const;
+
     virtual ColumnGetter doGetColumn(const Utf8String & tableName,
                                        const ColumnPath & columnName);
 
@@ -199,6 +225,11 @@ struct SqlExpressionDatasetScope: public SqlExpressionMldbScope {
 
     virtual ColumnGetter
     doGetBoundParameter(const Utf8String & paramName);
+
+    /** The sampled fraction of the dataset, and its number of rows if it
+        is a sample.
+    */
+    virtual TableSample doGetTableSample() override;
     
     static RowScope getRowScope(const MatrixNamedRow & row,
                                 const BoundParameters * params = nullptr)
@@ -217,9 +248,34 @@ struct SqlExpressionDatasetScope: public SqlExpressionMldbScope {
     doResolveTableName(const ColumnPath & fullColumnName,
                        Utf8String & tableName) const;
 
+    /** Allow window functions to be bound in this scope.  Whoever does
+        this needs to call runWindowFunctions() before any row is
+        processed by the expressions bound here.
+    */
+    void enableWindowFunctions();
+
+    /** Have any window functions been bound in this scope? */
+    bool hasWindowFunctions() const;
+
+    /** Calculate the window functions that have been bound in this scope
+        over the given rows, and only those rows.  Rows are read in
+        parallel, and the partitions of each window are calculated in
+        parallel.
+    */
+    void runWindowFunctions(const std::vector<RowPath> & rows);
+
+    virtual ColumnGetter
+    doGetWindowFunction(const WindowFunctionExpression & expr) override;
+
 private:
     GetAllColumnsOutput doGetAllColumnsInternal(const Utf8String & tableName, const ColumnFilter& keep, bool atoms);
 
+    struct BoundWindowFunction;
+
+    /// Window functions bound so far; null unless they are enabled
+    std::shared_ptr<std::vector<std::shared_ptr<BoundWindowFunction> > >
+        windowFunctions;
+
 };
 
 
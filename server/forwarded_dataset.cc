@@ -121,6 +121,22 @@ commit()
     underlying->commit();
 }
 
+uint64_t
+ForwardedDataset::
+getGeneration() const
+{
+    ExcAssert(underlying);
+    return underlying->getGeneration();
+}
+
+std::shared_ptr<void>
+ForwardedDataset::
+watchCommittedRows(OnCommittedRows onRows)
+{
+    ExcAssert(underlying);
+    return underlying->watchCommittedRows(std::move(onRows));
+}
+
 std::vector<MatrixNamedRow>
 ForwardedDataset::
 queryStructured(const SelectExpression & select,
@@ -186,6 +202,22 @@ generateRowsWhere(const SqlBindingScope & context,
     return underlying->generateRowsWhere(context, alias, where, offset, limit);
 }
 
+GenerateRowsWhereFunction
+ForwardedDataset::
+generateRowsWherePredicate(const ColumnPredicate & predicate) const
+{
+    ExcAssert(underlying);
+    return underlying->generateRowsWherePredicate(predicate);
+}
+
+GenerateRowsWhereFunction
+ForwardedDataset::
+generateRowsWithinDistance(const GeoDistancePredicate & predicate) const
+{
+    ExcAssert(underlying);
+    return underlying->generateRowsWithinDistance(predicate);
+}
+
 BasicRowGenerator
 ForwardedDataset::
 queryBasic(const SqlBindingScope & context,
@@ -226,6 +258,30 @@ getTimestampRange() const
     return underlying->getTimestampRange();
 }
 
+Json::Value
+ForwardedDataset::
+getMemoryUsage() const
+{
+    ExcAssert(underlying);
+    return underlying->getMemoryUsage();
+}
+
+double
+ForwardedDataset::
+getSampledFraction() const
+{
+    ExcAssert(underlying);
+    return underlying->getSampledFraction();
+}
+
+std::pair<Date, Date>
+ForwardedDataset::
+getRowTimestampRange(const RowPath & row) const
+{
+    ExcAssert(underlying);
+    return underlying->getRowTimestampRange(row);
+}
+
 Date
 ForwardedDataset::
 quantizeTimestamp(Date timestamp) const
@@ -57,6 +57,11 @@ struct ForwardedDataset: public Dataset {
 
     virtual void commit();
 
+    virtual uint64_t getGeneration() const;
+
+    virtual std::shared_ptr<void>
+    watchCommittedRows(OnCommittedRows onRows);
+
     virtual std::vector<MatrixNamedRow>
     queryStructured(const SelectExpression & select,
                     const WhenExpression & when,
@@ -91,6 +96,12 @@ struct ForwardedDataset: public Dataset {
                       ssize_t offset,
                       ssize_t limit) const;
 
+    virtual GenerateRowsWhereFunction
+    generateRowsWherePredicate(const ColumnPredicate & predicate) const;
+
+    virtual GenerateRowsWhereFunction
+    generateRowsWithinDistance(const GeoDistancePredicate & predicate) const;
+
     virtual BasicRowGenerator
     queryBasic(const SqlBindingScope & context,
                const SelectExpression & select,
@@ -109,6 +120,13 @@ struct ForwardedDataset: public Dataset {
     virtual void getChildAliases(std::vector<Utf8String>&) const;
 
     virtual std::pair<Date, Date> getTimestampRange() const;
+
+    virtual Json::Value getMemoryUsage() const;
+
+    virtual double getSampledFraction() const;
+
+    virtual std::pair<Date, Date>
+    getRowTimestampRange(const RowPath & row) const;
     virtual Date quantizeTimestamp(Date timestamp) const;
 
     virtual std::shared_ptr<MatrixView> getMatrixView() const;
@@ -15,6 +15,9 @@
 #include "mldb/types/meta_value_description.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/types/map_description.h"
+#include "mldb/jml/utils/environment.h"
+#include <list>
+#include <mutex>
 
 
 
@@ -75,10 +78,6 @@ ExpressionValue
 Function::
 call(const ExpressionValue & input) const
 {
-    SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->server));
-    
-    auto info = this->getFunctionInfo();
-
 #if 0
     //cerr << "function info is " << jsonEncode(info) << endl;
 
@@ -127,6 +126,12 @@ call(const ExpressionValue & input) const
 
     //cerr << "inputContext = " << jsonEncode(inputContext) << endl;
 
+    MldbServer * owner = MldbEntity::getOwner(this->server);
+    if (owner->functions)
+        return owner->functions->getApplier(this)->apply(input);
+
+    SqlExpressionMldbScope outerContext(owner);
+    auto info = this->getFunctionInfo();
     auto applier = this->bind(outerContext, info.input);
     
     return applier->apply(input);
@@ -136,10 +141,134 @@ call(const ExpressionValue & input) const
 /* FUNCTION COLLECTION                                                       */
 /*****************************************************************************/
 
+namespace {
+
+EnvOption<int> MLDB_FUNCTION_APPLIER_CACHE_SIZE
+("MLDB_FUNCTION_APPLIER_CACHE_SIZE", 256);
+
+/** A function bound to its declared input, along with everything the
+    applier refers to.  Members are destroyed in reverse order, so the
+    applier goes before the scope it was bound in and the function.
+*/
+struct BoundFunctionApplier {
+    std::shared_ptr<Function> function;
+    std::unique_ptr<SqlExpressionMldbScope> scope;
+    std::unique_ptr<FunctionApplier> applier;
+};
+
+std::shared_ptr<BoundFunctionApplier>
+bindFunctionApplier(const Function * function,
+                    std::shared_ptr<Function> owned)
+{
+    auto result = std::make_shared<BoundFunctionApplier>();
+    result->function = std::move(owned);
+    result->scope.reset
+        (new SqlExpressionMldbScope(MldbEntity::getOwner(function->server)));
+    auto info = function->getFunctionInfo();
+    result->applier = function->bind(*result->scope, info.input);
+    return result;
+}
+
+std::shared_ptr<const FunctionApplier>
+getApplierPtr(std::shared_ptr<BoundFunctionApplier> bound)
+{
+    const FunctionApplier * applier = bound->applier.get();
+    return std::shared_ptr<const FunctionApplier>(std::move(bound), applier);
+}
+
+} // file scope
+
+struct FunctionCollection::ApplierCache {
+    typedef std::list<std::pair<Utf8String,
+                                std::shared_ptr<BoundFunctionApplier> > > Entries;
+
+    std::mutex mutex;
+    Entries entries;  ///< Most recently used first
+    std::map<Utf8String, Entries::iterator> index;
+
+    /** Remove the entry for the given function.  It's moved into garbage
+        so that it can be destroyed once the lock is released.
+    */
+    void erase(const Utf8String & id,
+               std::vector<std::shared_ptr<BoundFunctionApplier> > & garbage)
+    {
+        auto it = index.find(id);
+        if (it == index.end())
+            return;
+        garbage.emplace_back(std::move(it->second->second));
+        entries.erase(it->second);
+        index.erase(it);
+    }
+};
+
 FunctionCollection::
 FunctionCollection(MldbServer * server)
-    : PolyCollection<Function>("function", "functions", server)
+    : PolyCollection<Function>("function", "functions", server),
+      applierCache(new ApplierCache())
+{
+}
+
+FunctionCollection::
+~FunctionCollection()
+{
+}
+
+std::shared_ptr<const FunctionApplier>
+FunctionCollection::
+getApplier(const Function * function) const
+{
+    // Only functions which belong to this collection can be cached, since
+    // their id is what identifies them
+    std::shared_ptr<Function> current;
+    if (function->config_)
+        current = tryGetExistingEntity(function->getId());
+    if (current.get() != function)
+        return getApplierPtr(bindFunctionApplier(function, nullptr));
+
+    size_t maxSize = std::max<int>(MLDB_FUNCTION_APPLIER_CACHE_SIZE, 0);
+    if (maxSize == 0)
+        return getApplierPtr(bindFunctionApplier(function, std::move(current)));
+
+    const Utf8String & id = function->getId();
+    std::vector<std::shared_ptr<BoundFunctionApplier> > garbage;
+
+    {
+        std::unique_lock<std::mutex> guard(applierCache->mutex);
+        auto it = applierCache->index.find(id);
+        if (it != applierCache->index.end()) {
+            if (it->second->second->function == current) {
+                auto & entries = applierCache->entries;
+                entries.splice(entries.begin(), entries, it->second);
+                return getApplierPtr(it->second->second);
+            }
+            // The function was replaced under the same id
+            applierCache->erase(id, garbage);
+        }
+    }
+
+    // Bind without holding the lock, as it may take a while
+    auto bound = bindFunctionApplier(function, current);
+
+    std::unique_lock<std::mutex> guard(applierCache->mutex);
+    applierCache->erase(id, garbage);
+    applierCache->entries.emplace_front(id, bound);
+    applierCache->index[id] = applierCache->entries.begin();
+
+    while (applierCache->entries.size() > maxSize)
+        applierCache->erase(applierCache->entries.back().first, garbage);
+
+    return getApplierPtr(std::move(bound));
+}
+
+void
+FunctionCollection::
+handleDelete(Utf8String key)
 {
+    PolyCollection<Function>::handleDelete(key);
+
+    std::vector<std::shared_ptr<BoundFunctionApplier> > garbage;
+    std::unique_lock<std::mutex> guard(applierCache->mutex);
+    applierCache->erase(key, garbage);
 }
 
 void
@@ -233,47 +362,56 @@ applyBatch(const Function * function,
     Utf8String str;
     Utf8StringJsonPrintingContext printingContext(str);
 
-    SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->server));
-    
-    auto info = function->getFunctionInfo();
-    auto applier = function->bind(outerContext, info.input);
+    auto applier = getApplier(function);
     
     Date ts = Date::now();
 
-    auto doInput = [&] (const Json::Value & val)
+    auto parseInput = [&] (const Json::Value & val)
         {
             StructuredJsonParsingContext context(val);
-            ExpressionValue inputExpr
-                = ExpressionValue::parseJson(context, ts);
-            ExpressionValue output
-                = function->apply(*applier, std::move(inputExpr));
-            output.extractJson(printingContext);
+            return ExpressionValue::parseJson(context, ts);
         };
 
     if (inputs.isNull()) {
         connection.sendResponse(200, inputs, "application/json");
         return;
     }
-    else if (inputs.isArray()) {
-        printingContext.startArray(inputs.size());
+    else if (inputs.isArray() || inputs.isObject()) {
+        // Apply the whole batch at once, so that it can be done in
+        // parallel or by the function's own batch implementation
+        std::vector<ExpressionValue> batch;
+        batch.reserve(inputs.size());
         for (auto it = inputs.begin(), end = inputs.end();
              it != end;  ++it) {
-            printingContext.newArrayElement();
-            doInput(*it);
+            batch.emplace_back(parseInput(*it));
         }
-        printingContext.endArray();
-    }
-    else if (inputs.isObject()) {
-        printingContext.startObject();
-        for (auto it = inputs.begin(), end = inputs.end();
-             it != end;  ++it) {
-            printingContext.startMember(it.memberName());
-            doInput(*it);
+
+        std::vector<ExpressionValue> outputs
+            = applier->applyBatch(std::move(batch));
+        ExcAssertEqual(outputs.size(), inputs.size());
+
+        if (inputs.isArray()) {
+            printingContext.startArray(inputs.size());
+            for (auto & output: outputs) {
+                printingContext.newArrayElement();
+                output.extractJson(printingContext);
+            }
+            printingContext.endArray();
+        }
+        else {
+            size_t i = 0;
+            printingContext.startObject();
+            for (auto it = inputs.begin(), end = inputs.end();
+                 it != end;  ++it, ++i) {
+                printingContext.startMember(it.memberName());
+                outputs[i].extractJson(printingContext);
+            }
+            printingContext.endObject();
         }
-        printingContext.endObject();
     }
     else {
-        doInput(inputs);
+        ExpressionValue output = applier->apply(parseInput(inputs));
+        output.extractJson(printingContext);
     }
 
     connection.sendResponse(200, str.stealRawString(), "application/json");
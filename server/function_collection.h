@@ -22,6 +22,7 @@ namespace MLDB {
 
 struct FunctionCollection: public PolyCollection<Function> {
     FunctionCollection(MldbServer * server);
+    ~FunctionCollection();
 
     static void initRoutes(RouteManager & manager);
 
@@ -48,6 +49,29 @@ struct FunctionCollection: public PolyCollection<Function> {
                                const std::vector<Utf8String> & keepPins);
     
     FunctionInfo getFunctionInfo(const Function * function) const;
+
+    /** Return an applier for the function, bound to its declared input.
+
+        Binding can cost more than applying the function (sql.expression
+        functions that aren't prepared parse and bind their SQL each time),
+        so the appliers of functions in this collection are kept in a least
+        recently used cache of MLDB_FUNCTION_APPLIER_CACHE_SIZE entries.
+        The cache is keyed on the function's id and checked against the
+        function object itself, so putting a new configuration or deleting
+        the function invalidates it.
+
+        The applier keeps the function and its binding scope alive, so it
+        may be held for as long as needed.
+    */
+    std::shared_ptr<const FunctionApplier>
+    getApplier(const Function * function) const;
+
+protected:
+    virtual void handleDelete(Utf8String key);
+
+private:
+    struct ApplierCache;
+    std::unique_ptr<ApplierCache> applierCache;
 };
 
 extern template class PolyCollection<Function>;
@@ -0,0 +1,381 @@
+/** function_rpc_endpoint.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Binary RPC endpoint for low latency function application.
+*/
+
+#include "mldb/server/function_rpc_endpoint.h"
+#include "mldb/server/function_collection.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/core/function.h"
+#include "mldb/rest/asio_peer_server.h"
+#include "mldb/rest/rest_request_router.h"
+#include "mldb/sql/cell_value_msgpack.h"
+#include "mldb/sql/expression_value.h"
+#include "mldb/http/http_exception.h"
+#include <mutex>
+#include <set>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+enum Operation {
+    OP_BIND = 1,
+    OP_CALL = 2,
+    OP_RELEASE = 3
+};
+
+/** Read a value sent by the client.  Maps become rows and arrays of
+    scalars become embeddings; arrays holding anything else become rows
+    keyed by the index, as they do when parsed from JSON.
+*/
+ExpressionValue
+readExpressionValue(MsgPackReader & reader, Date ts)
+{
+    switch (reader.nextType()) {
+    case MsgPackReader::MAP: {
+        size_t n = reader.readMapHeader();
+        StructValue row;
+        row.reserve(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            PathElement name(reader.readString());
+            row.emplace_back(std::move(name), readExpressionValue(reader, ts));
+        }
+        return ExpressionValue(std::move(row));
+    }
+    case MsgPackReader::ARRAY: {
+        size_t n = reader.readArrayHeader();
+        std::vector<ExpressionValue> vals;
+        vals.reserve(n);
+        bool allAtoms = true;
+        for (size_t i = 0;  i < n;  ++i) {
+            vals.emplace_back(readExpressionValue(reader, ts));
+            allAtoms = allAtoms && vals.back().isAtom();
+        }
+
+        if (allAtoms) {
+            std::vector<CellValue> cells;
+            cells.reserve(n);
+            for (auto & v: vals)
+                cells.emplace_back(v.stealAtom());
+            return ExpressionValue(std::move(cells), ts);
+        }
+
+        StructValue row;
+        row.reserve(n);
+        for (size_t i = 0;  i < n;  ++i)
+            row.emplace_back(PathElement(i), std::move(vals[i]));
+        return ExpressionValue(std::move(row));
+    }
+    default:
+        return ExpressionValue(reader.readCellValue(), ts);
+    }
+}
+
+void
+writeEmbedding(MsgPackWriter & writer,
+               const std::vector<CellValue> & cells,
+               const DimsVector & shape,
+               size_t dim, size_t & pos)
+{
+    if (dim == shape.size()) {
+        writer.writeCellValue(cells.at(pos++));
+        return;
+    }
+
+    writer.writeArrayHeader(shape[dim]);
+    for (size_t i = 0;  i < shape[dim];  ++i)
+        writeEmbedding(writer, cells, shape, dim + 1, pos);
+}
+
+/** Write a value to be returned to the client, without its timestamp.
+    Embeddings are written as nested arrays following their shape.
+*/
+void
+writeExpressionValue(MsgPackWriter & writer, const ExpressionValue & val)
+{
+    if (val.isEmbedding()) {
+        size_t pos = 0;
+        writeEmbedding(writer, val.getEmbeddingCell(),
+                       val.getEmbeddingShape(), 0, pos);
+    }
+    else if (val.isRow()) {
+        writer.writeMapHeader(val.rowLength());
+        auto onColumn = [&] (const PathElement & columnName,
+                             const ExpressionValue & columnVal)
+            {
+                writer.writeString(columnName.toUtf8String());
+                writeExpressionValue(writer, columnVal);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+    }
+    else {
+        writer.writeCellValue(val.getAtom());
+    }
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* FUNCTION RPC ENDPOINT                                                     */
+/*****************************************************************************/
+
+const std::string FunctionRpcEndpoint::PEER_NAME = "mldb-function-rpc";
+
+struct FunctionRpcEndpoint::Impl {
+
+    /// A function bound once on behalf of the client, and applied to as
+    /// many inputs as it sends.  It keeps the function alive.
+    typedef std::shared_ptr<const FunctionApplier> Handle;
+
+    /// State of a single client connection.  Requests arrive one at a time
+    /// on the connection's strand, so no locking is needed here.
+    struct Connection {
+        Connection(Impl * owner, std::shared_ptr<PeerConnection> peer)
+            : owner(owner), peer(std::move(peer))
+        {
+        }
+
+        Impl * owner;
+        std::shared_ptr<PeerConnection> peer;
+        WatchT<PeerConnectionState> stateWatch;
+        std::vector<Handle> handles;
+        std::vector<uint64_t> freeHandles;
+
+        bool onRecv(std::string && frame)
+        {
+            std::string reply;
+            MsgPackWriter writer(reply);
+
+            try {
+                handleRequest(frame, writer);
+            } catch (const std::exception & exc) {
+                Json::Value error = extractException(exc, 400);
+                reply.clear();
+                writer.writeArrayHeader(2);
+                writer.writeInt(error.get("httpCode", 400).asInt());
+                writer.writeString(error["error"].asString());
+            }
+
+            peer->send(std::move(reply));
+            return true;
+        }
+
+        const Handle & getHandle(uint64_t handle)
+        {
+            if (handle >= handles.size() || !handles[handle])
+                throw HttpReturnException(404, "Unknown function handle "
+                                          + std::to_string(handle));
+            return handles[handle];
+        }
+
+        void handleRequest(const std::string & frame, MsgPackWriter & writer)
+        {
+            MsgPackReader reader(frame);
+            size_t len = reader.readArrayHeader();
+            if (len < 2)
+                throw HttpReturnException(400, "Function RPC requests must "
+                                          "have an operation and arguments");
+
+            int64_t op = reader.readInt();
+
+            if (((op == OP_BIND || op == OP_RELEASE) && len != 2)
+                || (op == OP_CALL && len != 3))
+                throw HttpReturnException(400, "Function RPC request has the "
+                                          "wrong number of arguments");
+
+            auto expectEnd = [&] ()
+                {
+                    if (!reader.eof())
+                        throw HttpReturnException
+                            (400, "Function RPC request has trailing data");
+                };
+
+            switch (op) {
+            case OP_BIND: {
+                Utf8String functionName = reader.readString();
+                expectEnd();
+                auto & functions = *owner->server->functions;
+                std::shared_ptr<Function> function
+                    = functions.getExistingEntity(functionName);
+                Handle bound = functions.getApplier(function.get());
+
+                uint64_t handle;
+                if (!freeHandles.empty()) {
+                    handle = freeHandles.back();
+                    freeHandles.pop_back();
+                    handles[handle] = std::move(bound);
+                }
+                else {
+                    handle = handles.size();
+                    handles.emplace_back(std::move(bound));
+                }
+
+                writer.writeArrayHeader(2);
+                writer.writeInt(0);
+                writer.writeUInt(handle);
+                break;
+            }
+            case OP_CALL: {
+                Handle bound = getHandle(reader.readUInt());
+                size_t numInputs = reader.readArrayHeader();
+                Date ts = Date::now();
+
+                std::vector<ExpressionValue> inputs;
+                inputs.reserve(numInputs);
+                for (size_t i = 0;  i < numInputs;  ++i) {
+                    if (reader.nextType() != MsgPackReader::MAP)
+                        throw HttpReturnException
+                            (400, "Function RPC inputs must be maps of "
+                             "argument name to value");
+                    inputs.emplace_back(readExpressionValue(reader, ts));
+                }
+                expectEnd();
+
+                std::vector<ExpressionValue> outputs
+                    = bound->applyBatch(std::move(inputs));
+
+                writer.writeArrayHeader(2);
+                writer.writeInt(0);
+                writer.writeArrayHeader(outputs.size());
+                for (auto & output: outputs)
+                    writeExpressionValue(writer, output);
+                break;
+            }
+            case OP_RELEASE: {
+                uint64_t handle = reader.readUInt();
+                expectEnd();
+                getHandle(handle);
+                handles[handle].reset();
+                freeHandles.push_back(handle);
+
+                writer.writeArrayHeader(2);
+                writer.writeInt(0);
+                writer.writeNil();
+                break;
+            }
+            default:
+                throw HttpReturnException(400, "Unknown function RPC operation "
+                                          + std::to_string(op));
+            }
+        }
+    };
+
+    Impl(MldbServer * server)
+        : server(server), shutdown_(false)
+    {
+    }
+
+    ~Impl()
+    {
+        shutdown();
+    }
+
+    MldbServer * server;
+    AsioPeerServer peerServer;
+    std::atomic<bool> shutdown_;
+
+    std::mutex connectionsMutex;
+    std::set<std::shared_ptr<Connection> > connections;
+
+    std::string bindTcp(PortRange const & portRange, const std::string & host)
+    {
+        peerServer.init(portRange, host);
+        peerServer.setNewConnectionHandler
+            (std::bind(&Impl::onNewConnection, this, std::placeholders::_1));
+
+        PeerInfo info;
+        info.peerName = PEER_NAME;
+        info.serviceType = "mldb-function-rpc";
+        return peerServer.listen(info).uri;
+    }
+
+    void onNewConnection(std::shared_ptr<PeerConnection> peer)
+    {
+        auto conn = std::make_shared<Connection>(this, std::move(peer));
+
+        {
+            std::unique_lock<std::mutex> guard(connectionsMutex);
+            if (shutdown_)
+                return;
+            connections.insert(conn);
+        }
+
+        // The connection can't be destroyed from within its own callback,
+        // so it's forgotten from another thread once it's closed
+        std::weak_ptr<Connection> weakConn = conn;
+        auto onStateChange = [this, weakConn] (PeerConnectionState state)
+            {
+                if (state != ST_CLOSED)
+                    return;
+                auto forget = [this, weakConn] ()
+                    {
+                        std::unique_lock<std::mutex> guard(connectionsMutex);
+                        connections.erase(weakConn.lock());
+                    };
+                peerServer.postWork(forget);
+            };
+
+        conn->stateWatch = conn->peer->stateWatches.add();
+        conn->stateWatch.bind(onStateChange);
+
+        Connection * c = conn.get();
+        conn->peer->startReading([c] (std::string && frame)
+                                 {
+                                     return c->onRecv(std::move(frame));
+                                 });
+    }
+
+    void shutdown()
+    {
+        if (shutdown_.exchange(true))
+            return;
+
+        peerServer.shutdown();
+
+        std::set<std::shared_ptr<Connection> > toClose;
+        {
+            std::unique_lock<std::mutex> guard(connectionsMutex);
+            toClose.swap(connections);
+        }
+
+        for (auto & c: toClose)
+            c->peer->shutdown();
+    }
+};
+
+FunctionRpcEndpoint::
+FunctionRpcEndpoint(MldbServer * server)
+    : impl(new Impl(server))
+{
+}
+
+FunctionRpcEndpoint::
+~FunctionRpcEndpoint()
+{
+}
+
+std::string
+FunctionRpcEndpoint::
+bindTcp(PortRange const & portRange, const std::string & host)
+{
+    return impl->bindTcp(portRange, host);
+}
+
+void
+FunctionRpcEndpoint::
+shutdown()
+{
+    impl->shutdown();
+}
+
+} // namespace MLDB
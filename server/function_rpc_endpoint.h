@@ -0,0 +1,75 @@
+/** function_rpc_endpoint.h                                       -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Binary RPC endpoint for low latency function application.
+*/
+
+#pragma once
+
+#include "mldb/io/port_range_service.h"
+#include <memory>
+#include <string>
+
+
+namespace MLDB {
+
+struct MldbServer;
+
+
+/*****************************************************************************/
+/* FUNCTION RPC ENDPOINT                                                     */
+/*****************************************************************************/
+
+/** Endpoint that applies functions over persistent binary connections,
+    avoiding the HTTP parsing and JSON encoding and decoding costs of
+    /v1/functions/<id>/application for callers that need to score in real
+    time.
+
+    Connections use the framing of AsioPeerServer: the client sends the
+    handshake "APSv1000", the length of the peer name as 8 space padded
+    decimal digits and then the peer name, which must be PEER_NAME.  After
+    that, each message in either direction is a 64 bit length in host
+    (little endian) byte order followed by that many bytes of payload.
+
+    Each request payload is a MessagePack array whose first element is
+    the operation:
+    - [1, "<function>"] binds the function, returning a handle that
+      stays valid until it is released or the connection is closed;
+    - [2, <handle>, [<input>, ...]] applies the bound function to each
+      of the inputs, which are maps from argument name to value;
+    - [3, <handle>] releases a handle.
+
+    Each request gets exactly one reply, in the order the requests were
+    sent, so that requests may be pipelined.  A reply is [0, <result>] on
+    success, where the result is the handle, the array of outputs or nil,
+    or [<code>, "<message>"] on error, with the same codes as the HTTP
+    interface.  One failing input fails the whole call.
+
+    Values are encoded as by MsgPackWriter, with maps for rows and arrays
+    for embeddings.  All inputs of a call take the time at which it was
+    received as their timestamp, and outputs are sent without timestamps.
+*/
+
+struct FunctionRpcEndpoint {
+    FunctionRpcEndpoint(MldbServer * server);
+    ~FunctionRpcEndpoint();
+
+    /// Name the peer must give when connecting
+    static const std::string PEER_NAME;
+
+    /** Listen on a port in the given range, returning the address that was
+        bound in host:port form.
+    */
+    std::string bindTcp(PortRange const & portRange, const std::string & host);
+
+    /** Stop listening and close all of the connections. */
+    void shutdown();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace MLDB
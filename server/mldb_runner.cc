@@ -9,6 +9,7 @@
 
 #include "mldb/arch/futex.h"
 #include "mldb/server/mldb_server.h"
+#include "mldb/server/function_rpc_endpoint.h"
 #include "mldb/server/plugin_resource.h"
 #include "mldb/http/http_rest_proxy.h"
 #include "mldb/server/credential_collection.h"
@@ -87,6 +88,7 @@ int main(int argc, char ** argv)
     // Defaults for operational characteristics
     string httpListenPort = "11700-18000";
     string httpListenHost = "0.0.0.0";
+    string functionRpcListenPort;  // empty means disabled
     string runScript;
     bool dontExitAfterScript = false;
 
@@ -134,6 +136,10 @@ int main(int argc, char ** argv)
         ("http-listen-host,h",
          value(&httpListenHost)->default_value(httpListenHost),
          "host to listen to")
+        ("function-rpc-listen-port",
+         value(&functionRpcListenPort),
+         "Port to listen on for binary function application RPC; "
+         "disabled if not set")
         ("static-assets-path",
          value(&staticAssetsPath)->default_value(staticAssetsPath),
          "directory to serve static assets from")
@@ -333,6 +339,14 @@ int main(int argc, char ** argv)
 
     server.start();
 
+    std::unique_ptr<FunctionRpcEndpoint> functionRpc;
+    if (!functionRpcListenPort.empty()) {
+        functionRpc.reset(new FunctionRpcEndpoint(&server));
+        string addr = functionRpc->bindTcp(PortRange(functionRpcListenPort),
+                                           httpListenHost);
+        cerr << "function RPC listening on " << addr << endl;
+    }
+
     cerr << "\n\nMLDB ready\n\n\n";
 
     if (!runScript.empty()) {
@@ -410,5 +424,7 @@ int main(int argc, char ** argv)
     }
 
     cerr << "shutting down" << endl;
+    if (functionRpc)
+        functionRpc->shutdown();
     server.shutdown();
 }
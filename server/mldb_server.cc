@@ -20,6 +20,7 @@
 #include "mldb/server/plugin_manifest.h"
 #include "mldb/sql/sql_expression.h"
 #include <signal.h>
+#include <mutex>
 
 #include "mldb/server/dataset_collection.h"
 #include "mldb/server/plugin_collection.h"
@@ -30,8 +31,19 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/server/analytics.h"
+#include "mldb/server/statement_cache.h"
+#include "mldb/server/query_result_cache.h"
+#include "mldb/server/admission_control.h"
+#include "mldb/core/memory_account.h"
+#include "mldb/sql/query_profile.h"
+#include "mldb/rest/cancellation_exception.h"
+#include "mldb/jml/utils/environment.h"
 #include "mldb/types/meta_value_description.h"
 #include "mldb/arch/simd.h"
+#include "mldb/arch/metrics.h"
+#include "mldb/arch/sampling_profiler.h"
+#include "mldb/arch/memory_arenas.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/utils/log.h"
 
 
@@ -48,6 +60,64 @@ bool supportsSystemRequirements() {
     return true;
 #endif
 }
+
+EnvOption<size_t> MLDB_QUERY_MEMORY_LIMIT("MLDB_QUERY_MEMORY_LIMIT", 0);
+
+/// Load plugins whose manifest lists the types they provide on first use
+EnvOption<bool> MLDB_LAZY_PLUGINS("MLDB_LAZY_PLUGINS", true);
+
+/// Restore persisted datasets, procedures and functions when first needed
+EnvOption<bool> MLDB_LAZY_RESTORE("MLDB_LAZY_RESTORE", false);
+
+/** Run a query with its own memory account, turning the cancellation when
+    it goes over its memory limit into an error for the caller.
+*/
+template<typename Fn>
+auto
+runWithMemoryAccount(const Utf8String & query, Fn && runQuery)
+    -> decltype(runQuery())
+{
+    MemoryAccount account("query", query, MLDB_QUERY_MEMORY_LIMIT);
+    MemoryAccountScope scope(&account);
+
+    try {
+        return runQuery();
+    } catch (const CancellationException & exc) {
+        if (!account.limitExceeded())
+            throw;
+        throw HttpReturnException(400, exc.what(),
+                                  "memory", account.getStats());
+    }
+}
+
+/// Time spent in each phase of GET /v1/query
+struct QueryPhaseMetrics {
+    QueryPhaseMetrics()
+        : parse(histogram("parse")),
+          execute(histogram("execute")),
+          encode(histogram("encode"))
+    {
+    }
+
+    static MetricHistogram & histogram(const std::string & phase)
+    {
+        return MetricsRegistry::global().histogram
+            ("mldb_query_phase_duration_seconds",
+             "Time spent in each phase of queries run through /v1/query",
+             { { "phase", phase } });
+    }
+
+    MetricHistogram & parse;
+    MetricHistogram & execute;
+    MetricHistogram & encode;
+};
+
+QueryPhaseMetrics & queryPhaseMetrics()
+{
+    static QueryPhaseMetrics result;
+    return result;
+}
+
 } // file scope
 
 
@@ -84,12 +154,77 @@ MldbServer(const std::string & serviceName,
            const std::string & httpBaseUrl)
     : ServicePeer(serviceName, "MLDB", "global", enableAccessLog),
       EventRecorder(serviceName, std::make_shared<NullEventService>()),
+      statements(std::make_shared<StatementCache>()),
+      queryResults(std::make_shared<QueryResultCache>()),
+      admission(std::make_shared<AdmissionControl>()),
       httpBaseUrl(httpBaseUrl), versionNode(nullptr),
       logger(getMldbLog<MldbServer>())
 {
     // Don't allow URIs without a scheme
     setGlobalAcceptUrisWithoutScheme(false);
 
+    auto addPoolGauge = [&] (const std::string & name,
+                             const std::string & help,
+                             std::function<double ()> read)
+        {
+            metricGauges.push_back
+                (MetricsRegistry::global().addGauge(name, help, {},
+                                                    std::move(read)));
+        };
+
+    addPoolGauge("mldb_thread_pool_jobs_submitted",
+                 "Number of jobs submitted to the thread pool",
+                 [] () { return ThreadPool::instance().jobsSubmitted(); });
+    addPoolGauge("mldb_thread_pool_jobs_finished",
+                 "Number of jobs of the thread pool that have finished",
+                 [] () { return ThreadPool::instance().jobsFinished(); });
+    addPoolGauge("mldb_thread_pool_jobs_running",
+                 "Number of jobs of the thread pool currently running",
+                 [] () { return ThreadPool::instance().jobsRunning(); });
+    addPoolGauge("mldb_thread_pool_queue_depth",
+                 "Number of jobs waiting in the queues of the thread pool",
+                 [] () { return ThreadPool::instance().queueDepth(); });
+    addPoolGauge("mldb_thread_pool_idle_seconds",
+                 "Time the threads of the thread pool have spent waiting "
+                 "for work",
+                 [] () { return ThreadPool::instance().idleSeconds(); });
+
+    // Refreshing the arena statistics is a few dozen mallctl() calls, so
+    // each gauge does it rather than sharing a snapshot
+    for (int i = 0;  i < NUM_MEMORY_ARENAS;  ++i) {
+        MemoryArena arena = (MemoryArena)i;
+        MetricLabels labels = { { "arena", memoryArenaName(arena) } };
+        auto addArenaGauge = [&] (const std::string & name,
+                                  const std::string & help,
+                                  uint64_t MemoryArenaStats::* field)
+            {
+                metricGauges.push_back
+                    (MetricsRegistry::global().addGauge
+                     (name, help, labels,
+                      [=] () -> double
+                      {
+                          refreshMemoryArenaStats();
+                          return getMemoryArenaStats(arena).*field;
+                      }));
+            };
+
+        addArenaGauge("mldb_memory_arena_allocated_bytes",
+                      "Bytes in live allocations of the allocator arena",
+                      &MemoryArenaStats::allocatedBytes);
+        addArenaGauge("mldb_memory_arena_active_bytes",
+                      "Bytes in the pages of the arena with live allocations",
+                      &MemoryArenaStats::activeBytes);
+        addArenaGauge("mldb_memory_arena_dirty_bytes",
+                      "Free bytes of the arena not yet returned to the OS",
+                      &MemoryArenaStats::dirtyBytes);
+        addArenaGauge("mldb_memory_arena_resident_bytes",
+                      "Resident bytes of the arena",
+                      &MemoryArenaStats::residentBytes);
+        addArenaGauge("mldb_memory_arena_mapped_bytes",
+                      "Bytes mapped from the OS by the arena",
+                      &MemoryArenaStats::mappedBytes);
+    }
+
     addRoutes();
 
     if (etcdUri != "")
@@ -153,6 +288,21 @@ initRoutes()
                     serviceInfoRoute,
                     Json::Value());
 
+    RestRequestRouter::OnProcessRequest metricsRoute
+        = [=] (RestConnection & connection,
+               const RestRequest & request,
+               const RestRequestParsingContext & context) {
+        connection.sendResponse(200, getMetrics(),
+                                MetricsRegistry::CONTENT_TYPE);
+        return RestRequestRouter::MR_YES;
+    };
+
+    router.addRoute("/metrics", "GET",
+                    "Return the internal metrics in the Prometheus text "
+                    "format",
+                    metricsRoute,
+                    Json::Value());
+
     // Push our this pointer in to make sure that it's available to sub
     // routes
     auto addObject = [=] (RestConnection & connection,
@@ -214,8 +364,86 @@ initRoutes()
                                      false),
             HybridParamDefault<bool>("sortColumns",
                                      "Do we sort the column names",
+                                     false),
+            HybridParamDefault<bool>("cache",
+                                     "Do we use the query result cache",
+                                     false),
+            HybridParamDefault<bool>("profile",
+                                     "Do we return the profile of the query "
+                                     "instead of its results",
                                      false));
 
+        addRouteSyncJsonReturn(versionNode, "/queryCache", {"GET"},
+                               "Get the statistics of the query result cache",
+                               "JSON description of the cache and its entries",
+                               &MldbServer::getQueryCacheStats,
+                               this);
+
+        addRouteSyncJsonReturn(versionNode, "/admission", {"GET"},
+                               "Get the statistics of the admission control",
+                               "JSON description of each class of requests",
+                               &MldbServer::getAdmissionStats,
+                               this);
+
+        addRouteSyncJsonReturn(versionNode, "/logging", {"GET"},
+                               "Get the statistics of the log queue",
+                               "JSON description of the log queue",
+                               &MldbServer::getLoggingStats,
+                               this);
+
+        addRouteSyncJsonReturn(versionNode, "/runningQueries", {"GET"},
+                               "Get the memory used by the running queries "
+                               "and procedure runs",
+                               "JSON array with the memory of each query "
+                               "and run",
+                               &MldbServer::getRunningQueries,
+                               this);
+
+        addRouteSyncJsonReturn(versionNode, "/memory", {"GET"},
+                               "Get the memory used by each dataset",
+                               "JSON object with the total and the memory "
+                               "of each dataset",
+                               &MldbServer::getMemoryUsage,
+                               this);
+
+        addRouteSyncJsonReturn(versionNode, "/allocator", {"GET"},
+                               "Get the statistics of the allocator arenas",
+                               "JSON object with the statistics of each "
+                               "arena",
+                               &MldbServer::getAllocatorStats,
+                               this);
+
+        addRouteSyncJsonReturn(versionNode, "/allocator/purge", {"POST"},
+                               "Return the free memory of the allocator "
+                               "arenas to the operating system",
+                               "JSON object with the statistics of each "
+                               "arena afterwards",
+                               &MldbServer::purgeAllocator,
+                               this,
+                               HybridParamDefault<std::string>
+                               ("arena",
+                                "Arena to purge: frozen, query or rest.  "
+                                "All of them when empty.",
+                                ""));
+
+        addRouteAsync(versionNode, "/profiler", {"POST"},
+                      "Sample the stacks of the threads of MLDB for a while "
+                      "and return them as folded stacks",
+                      &MldbServer::runSamplingProfiler, this,
+                      PassConnectionId(),
+                      HybridParamDefault<double>("seconds",
+                                                 "Number of seconds to "
+                                                 "sample for",
+                                                 10),
+                      HybridParamDefault<int>("frequency",
+                                              "Samples per second of CPU "
+                                              "time",
+                                              99),
+                      HybridParamDefault<std::string>("format",
+                                                      "Format of output: "
+                                                      "folded or json",
+                                                      "folded"));
+
         this->versionNode = &versionNode;
         return true;
     } else {
@@ -247,29 +475,304 @@ runHttpQuery(const Utf8String& query,
              bool createHeaders,
              bool rowNames,
              bool rowHashes,
-             bool sortColumns) const
+             bool sortColumns,
+             bool cache,
+             bool profile) const
 {
-    auto stm = SelectStatement::parse(query.rawString());
+    QueryPhaseMetrics & metrics = queryPhaseMetrics();
+
+    auto parseStart = std::chrono::steady_clock::now();
+    auto stm = statements->get(query);
+    metrics.parse.recordSince(parseStart);
+
     SqlExpressionMldbScope mldbContext(this);
 
     auto runQuery = [&] ()
         {
-            return queryFromStatement(stm, mldbContext);
+            return queryFromStatement(*stm, mldbContext);
         };
 
-    MLDB::runHttpQuery(runQuery,
+    auto runCachedQuery = [&] ()
+        {
+            // The cache only knows when the dataset changes, so only
+            // queries that read nothing else can use it
+            auto isUserFunction = [&] (const Utf8String & name)
+                {
+                    return !!functions->tryGetExistingEntity(name.rawString());
+                };
+            std::shared_ptr<Dataset> dataset;
+            if (cache && QueryResultCache::isCacheable(*stm, isUserFunction))
+                dataset = stm->from->bind(mldbContext).dataset;
+            if (!dataset)
+                return runQuery();
+            return queryResults->get(StatementCache::normalize(query),
+                                     dataset, runQuery);
+        };
+
+    auto runAccountedQuery = [&] ()
+        {
+            return runWithMemoryAccount(query, runCachedQuery);
+        };
+
+    if (profile) {
+        // A result from the cache would tell us nothing about the query
+        cache = false;
+
+        QueryProfiler profiler([] () -> int64_t
+            {
+                MemoryAccount * account = MemoryAccount::current();
+                return account ? account->bytes() : 0;
+            });
+        size_t rowCount;
+        {
+            QueryProfileScope scope(&profiler);
+            rowCount = runAccountedQuery().size();
+        }
+        connection.sendResponse(200, jsonEncodeStr(profiler.finish(rowCount)),
+                                "application/json");
+        return;
+    }
+
+    // Everything after the query has run is the encoding of its output
+    std::chrono::steady_clock::time_point encodeStart;
+    auto runTimedQuery = [&] ()
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto result = runAccountedQuery();
+            metrics.execute.recordSince(start);
+            encodeStart = std::chrono::steady_clock::now();
+            return result;
+        };
+
+    MLDB::runHttpQuery(runTimedQuery,
                        connection, format, createHeaders,
                        rowNames, rowHashes, sortColumns);
+    metrics.encode.recordSince(encodeStart);
+}
+
+std::string
+MldbServer::
+getMetrics() const
+{
+    return MetricsRegistry::global().exposition();
+}
+
+Json::Value
+MldbServer::
+getQueryCacheStats() const
+{
+    return queryResults->getStats();
+}
+
+Json::Value
+MldbServer::
+getAdmissionStats() const
+{
+    return admission->getStats();
+}
+
+Json::Value
+MldbServer::
+getLoggingStats() const
+{
+    LogStats stats = getLogStats();
+    Json::Value result;
+    result["queueSize"] = (Json::UInt)stats.queueSize;
+    result["written"] = (Json::UInt)stats.written;
+    result["dropped"] = (Json::UInt)stats.dropped;
+    return result;
+}
+
+Json::Value
+MldbServer::
+getRunningQueries() const
+{
+    return MemoryAccount::getRunningStats();
+}
+
+Json::Value
+MldbServer::
+getMemoryUsage() const
+{
+    std::vector<std::pair<uint64_t, Json::Value> > entries;
+    uint64_t totalBytes = 0;
+    size_t unknown = 0;
+
+    auto onDataset = [&] (Utf8String id, const PolyEntity & entity)
+        {
+            auto & dataset = static_cast<const Dataset &>(entity);
+            Json::Value entry;
+            entry["id"] = id;
+            entry["type"] = dataset.getType();
+            uint64_t bytes = 0;
+            try {
+                bytes = dataset.getMemoryUsage()["totalBytes"].asUInt();
+                entry["totalBytes"] = (Json::UInt)bytes;
+                totalBytes += bytes;
+            } catch (const std::exception &) {
+                // Dataset types which don't hold their own data, or don't
+                // know how much it takes, are listed without a size
+                entry["totalBytes"] = Json::Value();
+                ++unknown;
+            }
+            entries.emplace_back(bytes, std::move(entry));
+            return true;
+        };
+
+    datasets->forEachEntry(onDataset);
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [] (const std::pair<uint64_t, Json::Value> & e1,
+                         const std::pair<uint64_t, Json::Value> & e2)
+                     {
+                         return e1.first > e2.first;
+                     });
+
+    Json::Value result;
+    result["totalBytes"] = (Json::UInt)totalBytes;
+    result["unknownDatasets"] = (Json::UInt)unknown;
+    result["datasets"] = Json::Value(Json::arrayValue);
+    for (auto & e: entries)
+        result["datasets"].append(std::move(e.second));
+    return result;
+}
+
+Json::Value
+MldbServer::
+getAllocatorStats() const
+{
+    refreshMemoryArenaStats();
+
+    Json::Value result;
+    result["enabled"] = memoryArenasEnabled();
+    for (int i = 0;  i < NUM_MEMORY_ARENAS;  ++i) {
+        MemoryArenaStats stats = getMemoryArenaStats((MemoryArena)i);
+        Json::Value & arena = result["arenas"][memoryArenaName((MemoryArena)i)];
+        arena["allocatedBytes"] = (Json::UInt)stats.allocatedBytes;
+        arena["activeBytes"] = (Json::UInt)stats.activeBytes;
+        arena["dirtyBytes"] = (Json::UInt)stats.dirtyBytes;
+        arena["residentBytes"] = (Json::UInt)stats.residentBytes;
+        arena["mappedBytes"] = (Json::UInt)stats.mappedBytes;
+    }
+    return result;
+}
+
+Json::Value
+MldbServer::
+purgeAllocator(const std::string & arena) const
+{
+    if (arena.empty()) {
+        purgeAllMemoryArenas();
+        return getAllocatorStats();
+    }
+
+    for (int i = 0;  i < NUM_MEMORY_ARENAS;  ++i) {
+        if (arena == memoryArenaName((MemoryArena)i)) {
+            purgeMemoryArena((MemoryArena)i);
+            return getAllocatorStats();
+        }
+    }
+
+    throw HttpReturnException(400, "Unknown allocator arena '" + arena
+                              + "'; known arenas are frozen, query and rest");
+}
+
+void
+MldbServer::
+runSamplingProfiler(RestConnection & connection,
+                    double seconds,
+                    int frequency,
+                    const std::string & format) const
+{
+    if (format != "folded" && format != "json")
+        throw HttpReturnException(400, "Unknown profiler output format '"
+                                  + format + "'; use 'folded' or 'json'");
+
+    SamplingProfile profile;
+    try {
+        profile = SamplingProfiler::run(seconds, frequency);
+    } catch (const MLDB::Exception & exc) {
+        throw HttpReturnException(400, exc.what());
+    }
+
+    if (format == "folded") {
+        connection.sendResponse(200, profile.folded(), "text/plain");
+        return;
+    }
+
+    Json::Value result;
+    result["numSamples"] = (Json::UInt)profile.numSamples;
+    result["numDropped"] = (Json::UInt)profile.numDropped;
+    result["stacks"] = Json::Value(Json::arrayValue);
+    for (auto & s: profile.stacks) {
+        Json::Value stack;
+        stack["stack"] = s.first;
+        stack["count"] = (Json::UInt)s.second;
+        result["stacks"].append(stack);
+    }
+    connection.sendResponse(200, result);
+}
+
+void
+MldbServer::
+handleRequest(RestConnection & connection,
+              const RestRequest & request) const
+{
+    // In-process requests come from plugins and procedures which may hold
+    // a slot already, so making them wait could deadlock
+    AdmissionControl::RequestClass cls = AdmissionControl::RC_NONE;
+    if (!dynamic_cast<InProcessRestConnection *>(&connection))
+        cls = AdmissionControl::classify(request.verb, request.resource);
+
+    if (cls == AdmissionControl::RC_NONE) {
+        ServicePeer::handleRequest(connection, request);
+        return;
+    }
+
+    auto ticket = admission->admit
+        (cls, request.header.tryGetHeader("x-mldb-tenant"));
+    if (!ticket) {
+        Json::Value error;
+        error["error"] = "Too many " + string(AdmissionControl::className(cls))
+            + " requests are waiting; try again later";
+        error["httpCode"] = 503;
+        connection.sendHttpResponse(503, error.toStringNoNewLine(),
+                                    "application/json",
+                                    { { "Retry-After", "1" } });
+        return;
+    }
+
+    ServicePeer::handleRequest(connection, request);
 }
 
 std::vector<MatrixNamedRow>
 MldbServer::
 query(const Utf8String& query) const
 {
-    auto stm = SelectStatement::parse(query.rawString());
+    auto stm = statements->get(query);
     SqlExpressionMldbScope mldbContext(this);
 
-    return queryFromStatement(stm, mldbContext);
+    auto runQuery = [&] ()
+        {
+            return queryFromStatement(*stm, mldbContext);
+        };
+
+    return runWithMemoryAccount(query, runQuery);
+}
+
+std::vector<NamedRowValue>
+MldbServer::
+queryExpr(const Utf8String& query) const
+{
+    auto stm = statements->get(query);
+    SqlExpressionMldbScope mldbContext(this);
+
+    auto runQuery = [&] ()
+        {
+            return std::get<0>(queryFromStatementExpr(*stm, mldbContext));
+        };
+
+    return runWithMemoryAccount(query, runQuery);
 }
 
 Json::Value
@@ -326,10 +829,11 @@ initCollections(std::string credentialsPath,
     credentials = createCredentialCollection(this, *routeManager, makeCredentialStore());
     types = createTypeClassCollection(this, *routeManager);
 
+    // Plugins register types that the others need, so they're never lazy
     plugins->loadConfig();
-    datasets->loadConfig();
-    procedures->loadConfig();
-    functions->loadConfig();
+    datasets->loadConfig(MLDB_LAZY_RESTORE);
+    procedures->loadConfig(MLDB_LAZY_RESTORE);
+    functions->loadConfig(MLDB_LAZY_RESTORE);
 
     if (false) {
         logRequest = [&] (const HttpRestConnection & conn, const RestRequest & req)
@@ -376,6 +880,13 @@ shutdown()
 
     ServicePeer::shutdown();
 
+    // Plugins that were never used stay unloaded
+    deferredPluginTypes.clear();
+
+    for (uint64_t id: metricGauges)
+        MetricsRegistry::global().removeGauge(id);
+    metricGauges.clear();
+
     datasets.reset();
     procedures.reset();
     functions.reset();
@@ -418,6 +929,11 @@ scanPlugins(const std::string & dir_)
 
                 manifest.config.params = shlibConfig;
 
+                if (MLDB_LAZY_PLUGINS && !manifest.provides.empty()) {
+                    deferPlugin(manifest);
+                    return;
+                }
+
                 auto plugin = plugins->obtainEntitySync(manifest.config,
                                                         nullptr /* on progress */);
             } catch (const HttpReturnException & exc) {
@@ -478,6 +994,46 @@ scanPlugins(const std::string & dir_)
     }
 }
 
+void
+MldbServer::
+deferPlugin(const PluginManifest & manifest)
+{
+    DEBUG_MSG(logger) << "deferring loading of plugin " << manifest.config.id
+                      << " until first use";
+
+    PolyConfig config = manifest.config;
+    auto loaded = std::make_shared<std::once_flag>();
+
+    // This may be called from any thread that uses one of the types; if
+    // loading throws, the next use tries again
+    auto load = [this, config, loaded] ()
+        {
+            std::call_once(*loaded, [&] ()
+                {
+                    INFO_MSG(logger) << "loading plugin " << config.id
+                                     << " on first use";
+                    plugins->obtainEntitySync(config,
+                                              nullptr /* on progress */);
+                });
+        };
+
+    plugins->deferLoading(config.id, load);
+
+    const PluginProvides & provides = manifest.provides;
+    for (auto & type: provides.datasets)
+        deferredPluginTypes.emplace_back
+            (DatasetCollection::registerDeferredType(type, config.id, load));
+    for (auto & type: provides.procedures)
+        deferredPluginTypes.emplace_back
+            (ProcedureCollection::registerDeferredType(type, config.id, load));
+    for (auto & type: provides.functions)
+        deferredPluginTypes.emplace_back
+            (FunctionCollection::registerDeferredType(type, config.id, load));
+    for (auto & prefix: provides.sqlFunctionPrefixes)
+        deferredPluginTypes.emplace_back
+            (registerDeferredFunctions(prefix, load));
+}
+
 Utf8String
 MldbServer::
 getPackageDocumentationPath(const Package & package) const
@@ -21,6 +21,7 @@ namespace MLDB {
 struct PolyConfig;
 struct Utf8String;
 struct Package;
+struct PluginManifest;
 
 
 struct PluginCollection;
@@ -29,6 +30,9 @@ struct ProcedureCollection;
 struct FunctionCollection;
 struct CredentialRuleCollection;
 struct TypeClassCollection;
+struct StatementCache;
+struct AdmissionControl;
+struct QueryResultCache;
 
 struct Plugin;
 struct Dataset;
@@ -37,6 +41,7 @@ struct Function;
 struct CredentialRule;
 
 struct MatrixNamedRow;
+struct NamedRowValue;
 
 
 /*****************************************************************************/
@@ -107,11 +112,24 @@ struct MldbServer: public ServicePeer, public EventRecorder {
     std::shared_ptr<CredentialRuleCollection> credentials;
     std::shared_ptr<TypeClassCollection> types;
 
+    /// Parsed statements of the queries run through query() and
+    /// runHttpQuery()
+    std::shared_ptr<StatementCache> statements;
+
+    /// Results of the queries run through runHttpQuery() with caching
+    /// requested
+    std::shared_ptr<QueryResultCache> queryResults;
+
     /** Parse and perform an SQL query. */
     std::vector<MatrixNamedRow> query(const Utf8String& query) const;
 
+    /** Parse and perform an SQL query, returning its rows without
+        flattening them, so that embeddings stay as embeddings. */
+    std::vector<NamedRowValue> queryExpr(const Utf8String& query) const;
+
     /** Parse and perform an SQL query, returning the results
-        on the given HTTP connection.
+        on the given HTTP connection.  With profile set, the query is run
+        but its profile is returned instead of its results.
     */
     void runHttpQuery(const Utf8String& query,
                       RestConnection & connection,
@@ -119,7 +137,71 @@ struct MldbServer: public ServicePeer, public EventRecorder {
                       bool createHeaders,
                       bool rowNames,
                       bool rowHashes,
-                      bool sortColumns) const;
+                      bool sortColumns,
+                      bool cache,
+                      bool profile) const;
+
+    /** Return the statistics of the query result cache. */
+    Json::Value getQueryCacheStats() const;
+
+    /// Limits on the number of heavy requests that run at once
+    std::shared_ptr<AdmissionControl> admission;
+
+    /** Return the statistics of the admission control. */
+    Json::Value getAdmissionStats() const;
+
+    /** Return the size of the log queue and the number of messages that
+        were written out and dropped.  This is what GET /v1/logging
+        returns.
+    */
+    Json::Value getLoggingStats() const;
+
+    /** Return the memory used by each running query and procedure run,
+        as accounted by MemoryAccount.  This is what GET
+        /v1/runningQueries returns.
+    */
+    Json::Value getRunningQueries() const;
+
+    /** Return the memory used by each dataset, largest first, with the
+        total over those that report it.  This is what GET /v1/memory
+        returns; the breakdown for one dataset is under
+        /v1/datasets/<id>/memory.
+    */
+    Json::Value getMemoryUsage() const;
+
+    /** Return the statistics of the allocator arenas of the process (see
+        memory_arenas.h).  This is what GET /v1/allocator returns.
+    */
+    Json::Value getAllocatorStats() const;
+
+    /** Return the free memory of the given arena, or of all of them if
+        it's empty, to the OS, and return the statistics afterwards.  This
+        is what POST /v1/allocator/purge does.
+    */
+    Json::Value purgeAllocator(const std::string & arena) const;
+
+    /** Return the internal metrics in the Prometheus text format.  This
+        is what GET /metrics returns.
+    */
+    std::string getMetrics() const;
+
+    /** Run the SamplingProfiler for the given number of seconds and send
+        back the stacks it saw, either folded (for flame graphs) or as
+        JSON.  This is what POST /v1/profiler does.
+    */
+    void runSamplingProfiler(RestConnection & connection,
+                             double seconds,
+                             int frequency,
+                             const std::string & format) const;
+
+    /** Handle a request, first waiting for admission if it's one of the
+        classes of heavy requests (see AdmissionControl).  Requests which
+        can't be admitted get a 503 response.  In-process requests are
+        always let through, since they come from work that is already
+        running.
+    */
+    virtual void handleRequest(RestConnection & connection,
+                               const RestRequest & request) const override;
 
     /** Get a type info structure for the given type. */
     Json::Value
@@ -174,6 +256,17 @@ private:
     RestRequestRouter * versionNode;
     std::string cacheDirectory_;
     std::shared_ptr<spdlog::logger> logger;
+
+    /// Gauges we added to the metrics, removed on shutdown
+    std::vector<uint64_t> metricGauges;
+
+    /** Register the types provided by the plugin with the given manifest
+        so that the plugin is loaded on their first use.
+    */
+    void deferPlugin(const PluginManifest & manifest);
+
+    /// Handles of the types of plugins that are loaded on first use
+    std::vector<std::shared_ptr<void> > deferredPluginTypes;
 };
 
 } // namespace MLDB
@@ -9,10 +9,14 @@
 
 #include <thread>
 #include <algorithm>
+#include <array>
+#include <iterator>
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 #include "mldb/base/thread_pool.h"
+#include "mldb/base/parallel.h"
 
 
 namespace MLDB {
@@ -67,6 +71,69 @@ void parallelMergeSortRecursive(VecOfVecs & range, unsigned first, unsigned last
     }
 }
 
+/*****************************************************************************/
+/* PARALLEL MERGE                                                            */
+/*****************************************************************************/
+
+/** Return how many of the first k elements of the merge of the two sorted
+    ranges come from the first one, which is where the merge path crosses
+    the k-th diagonal.  On ties the first range goes first, as in
+    std::merge.
+*/
+template<class It1, class It2, class Compare>
+size_t mergePathSplit(It1 first1, size_t n1, It2 first2, size_t n2,
+                      size_t k, const Compare & cmp)
+{
+    size_t lo = k > n2 ? k - n2 : 0;
+    size_t hi = std::min(k, n1);
+    while (lo < hi) {
+        size_t i = (lo + hi) / 2;
+        if (!cmp(first2[k - i - 1], first1[i]))
+            lo = i + 1;
+        else hi = i;
+    }
+    return lo;
+}
+
+/** Merge two sorted vectors, which are emptied, into a new one.  The
+    output is split into parts of equal size, whose merges are run in
+    parallel; each part finds where it starts in the inputs by a binary
+    search along the merge path.  T must be default constructible.
+*/
+template<class T, class Compare = std::less<T> >
+std::vector<T>
+parallelMerge(std::vector<T> & v1, std::vector<T> & v2,
+              const Compare & cmp = std::less<T>(),
+              size_t minPartSize = 1 << 16)
+{
+    size_t n1 = v1.size(), n2 = v2.size(), n = n1 + n2;
+    std::vector<T> result(n);
+
+    size_t numParts = std::max<size_t>(1, std::min<size_t>(numCpus() * 2,
+                                                           n / minPartSize));
+
+    auto doPart = [&] (size_t part)
+        {
+            size_t k0 = n * part / numParts, k1 = n * (part + 1) / numParts;
+            size_t i0 = mergePathSplit(v1.begin(), n1, v2.begin(), n2, k0, cmp);
+            size_t i1 = mergePathSplit(v1.begin(), n1, v2.begin(), n2, k1, cmp);
+            std::merge(std::make_move_iterator(v1.begin() + i0),
+                       std::make_move_iterator(v1.begin() + i1),
+                       std::make_move_iterator(v2.begin() + (k0 - i0)),
+                       std::make_move_iterator(v2.begin() + (k1 - i1)),
+                       result.begin() + k0,
+                       cmp);
+        };
+
+    if (numParts == 1)
+        doPart(0);
+    else parallelMap(0, numParts, doPart);
+
+    v1.clear();
+    v2.clear();
+    return result;
+}
+
 template<class T, class Compare = std::less<T> >
 std::vector<T>
 parallelMergeSort(std::vector<std::vector<T> > & range,
@@ -76,7 +143,7 @@ parallelMergeSort(std::vector<std::vector<T> > & range,
     if (range.empty())
         return {};
 
-    auto sort = [&] (const std::vector<T> & v)
+    auto sort = [&] (std::vector<T> & v)
         {
             std::sort(v.begin(), v.end(), cmp);
         };
@@ -88,6 +155,12 @@ parallelMergeSort(std::vector<std::vector<T> > & range,
 
     auto merge = [&] (std::vector<T> & v1, std::vector<T> & v2)
         {
+            // Big merges are split between threads
+            if (v1.size() + v2.size() > threadThreshold * 16) {
+                v1 = parallelMerge(v1, v2, cmp);
+                return;
+            }
+
             size_t split = v1.size();
 
             v1.insert(v1.end(), 
@@ -194,6 +267,12 @@ parallelMergeSort(std::vector<std::shared_ptr<std::vector<T> > > & range,
     auto merge = [&] (std::shared_ptr<std::vector<T> > & v1,
                       std::shared_ptr<std::vector<T> > & v2)
         {
+            // Big merges are split between threads
+            if (v1->size() + v2->size() > threadThreshold * 16) {
+                *v1 = parallelMerge(*v1, *v2, cmp);
+                return;
+            }
+
             size_t split = v1->size();
 
             v1->insert(v1->end(), 
@@ -212,6 +291,153 @@ parallelMergeSort(std::vector<std::shared_ptr<std::vector<T> > > & range,
     return std::move(*range[0]);
 }
 
+/*****************************************************************************/
+/* PARALLEL RADIX SORT                                                       */
+/*****************************************************************************/
+
+/** Stable most significant digit first radix sort of [first, last) by the
+    bits of the 64 bit key below shift + 8, using buffer (of the same size)
+    as scratch space.  Each pass sorts on one byte; small ranges are
+    finished with a comparison sort.
+*/
+template<class T, class KeyFn>
+void radixSortRecursive(T * first, T * last, T * buffer,
+                        const KeyFn & key, int shift)
+{
+    size_t n = last - first;
+    if (n < 2 || shift < 0)
+        return;
+
+    if (n < 256) {
+        std::stable_sort(first, last,
+                         [&] (const T & v1, const T & v2)
+                         {
+                             return key(v1) < key(v2);
+                         });
+        return;
+    }
+
+    size_t starts[257] = { 0 };
+    for (T * p = first;  p != last;  ++p)
+        ++starts[((key(*p) >> shift) & 0xff) + 1];
+
+    // Skip bytes which are the same for all of the range
+    for (unsigned b = 1;  b <= 256;  ++b) {
+        if (starts[b] == n) {
+            radixSortRecursive(first, last, buffer, key, shift - 8);
+            return;
+        }
+    }
+
+    for (unsigned b = 1;  b <= 256;  ++b)
+        starts[b] += starts[b - 1];
+
+    size_t offsets[256];
+    std::copy(starts, starts + 256, offsets);
+    for (T * p = first;  p != last;  ++p)
+        buffer[offsets[(key(*p) >> shift) & 0xff]++] = std::move(*p);
+    std::move(buffer, buffer + n, first);
+
+    for (unsigned b = 0;  b < 256;  ++b) {
+        radixSortRecursive(first + starts[b], first + starts[b + 1],
+                           buffer + starts[b], key, shift - 8);
+    }
+}
+
+/** Sort vec by the 64 bit unsigned integer that key() gives for each
+    element, for example a RowHash or ColumnHash, keeping elements with
+    equal keys in their original order.  This is a most significant digit
+    first radix sort, whose first pass is split between threads; the
+    ranges of each value of the first byte are then sorted in parallel.
+    Leading bytes which are the same for every key are skipped, so small
+    integers sort as quickly as hashes.
+
+    The key function is called several times for each element, and so
+    should be cheap.  T must be default constructible.
+*/
+template<class T, class KeyFn>
+void parallelRadixSort(std::vector<T> & vec, const KeyFn & key,
+                       size_t threadThreshold = 1 << 16)
+{
+    size_t n = vec.size();
+    if (n < 2)
+        return;
+
+    std::vector<T> buffer(n);
+
+    if (n < threadThreshold) {
+        radixSortRecursive(vec.data(), vec.data() + n, buffer.data(), key, 56);
+        return;
+    }
+
+    size_t numChunks
+        = std::max<size_t>(1, std::min<size_t>(numCpus() * 4, n / 4096));
+    auto chunkStart = [&] (size_t chunk) { return n * chunk / numChunks; };
+
+    // Find the highest byte in which the keys differ
+    uint64_t key0 = key(vec[0]);
+    std::vector<uint64_t> diffs(numChunks, 0);
+    parallelMap(0, numChunks, [&] (size_t chunk)
+                {
+                    uint64_t diff = 0;
+                    for (size_t i = chunkStart(chunk);
+                         i < chunkStart(chunk + 1);  ++i)
+                        diff |= key(vec[i]) ^ key0;
+                    diffs[chunk] = diff;
+                });
+    uint64_t diff = 0;
+    for (uint64_t d: diffs)
+        diff |= d;
+    if (diff == 0)
+        return;  // all keys are equal
+    int shift = ((63 - __builtin_clzll(diff)) / 8) * 8;
+
+    // Count the values of that byte in each chunk, so that each of them
+    // knows where to scatter its elements
+    std::vector<std::array<size_t, 256> > counts(numChunks);
+    parallelMap(0, numChunks, [&] (size_t chunk)
+                {
+                    auto & c = counts[chunk];
+                    c.fill(0);
+                    for (size_t i = chunkStart(chunk);
+                         i < chunkStart(chunk + 1);  ++i)
+                        ++c[(key(vec[i]) >> shift) & 0xff];
+                });
+
+    size_t starts[257];
+    size_t total = 0;
+    for (unsigned b = 0;  b < 256;  ++b) {
+        starts[b] = total;
+        for (size_t chunk = 0;  chunk < numChunks;  ++chunk) {
+            size_t count = counts[chunk][b];
+            counts[chunk][b] = total;
+            total += count;
+        }
+    }
+    starts[256] = total;
+
+    parallelMap(0, numChunks, [&] (size_t chunk)
+                {
+                    auto & offsets = counts[chunk];
+                    for (size_t i = chunkStart(chunk);
+                         i < chunkStart(chunk + 1);  ++i) {
+                        size_t b = (key(vec[i]) >> shift) & 0xff;
+                        buffer[offsets[b]++] = std::move(vec[i]);
+                    }
+                });
+
+    parallelMap(0, 256, [&] (size_t b)
+                {
+                    std::move(buffer.begin() + starts[b],
+                              buffer.begin() + starts[b + 1],
+                              vec.begin() + starts[b]);
+                    radixSortRecursive(vec.data() + starts[b],
+                                       vec.data() + starts[b + 1],
+                                       buffer.data() + starts[b],
+                                       key, shift - 8);
+                });
+}
+
 /* taken from http://demin.ws/blog/english/2012/04/28/multithreaded-quicksort/ */
 
 template<class T, class Compare >
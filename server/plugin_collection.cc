@@ -84,8 +84,17 @@ initRoutes(RouteManager & manager)
             // Get the key
             auto key = manager.getKey(context);
 
-            // Look up the value
-            auto plugin = static_cast< Plugin * > (collection->getExistingEntry(key).get());
+            // Look up the value, loading it if that was deferred
+            auto entry = collection->tryGetExistingEntry(key);
+            if (!entry) {
+                auto plugins = dynamic_cast<PluginCollection *>(collection);
+                if (plugins && plugins->loadDeferred(key))
+                    entry = collection->tryGetExistingEntry(key);
+            }
+            if (!entry)
+                entry = collection->getExistingEntry(key);  // throws
+
+            auto plugin = static_cast< Plugin * > (entry.get());
 
             return plugin;
         };
@@ -185,6 +194,33 @@ getEntityStatus(const Plugin & plugin) const
     return plugin.getStatus();
 }
 
+void
+PluginCollection::
+deferLoading(const Utf8String & id, std::function<void ()> load)
+{
+    std::unique_lock<std::mutex> guard(deferredMutex);
+    deferred[id] = std::move(load);
+}
+
+bool
+PluginCollection::
+loadDeferred(const Utf8String & id)
+{
+    std::function<void ()> load;
+    {
+        std::unique_lock<std::mutex> guard(deferredMutex);
+        auto it = deferred.find(id);
+        if (it == deferred.end())
+            return false;
+        load = it->second;
+    }
+
+    // Loading adds the plugin to this collection, so it can't happen
+    // with the lock held
+    load();
+    return true;
+}
+
 template class PolyCollection<Plugin>;
 
 } // namespace MLDB
@@ -11,6 +11,8 @@
 
 #include "mldb/core/plugin.h"
 #include "mldb/rest/poly_collection.h"
+#include <map>
+#include <mutex>
 
 
 namespace MLDB {
@@ -25,6 +27,20 @@ struct PluginCollection: public PolyCollection<Plugin> {
     static void initRoutes(RouteManager & manager);
 
     virtual Any getEntityStatus(const Plugin & plugin) const;
+
+    /** Remember how to load the plugin with the given id, which hasn't
+        been loaded yet.  A request for one of its routes loads it.
+    */
+    void deferLoading(const Utf8String & id, std::function<void ()> load);
+
+    /** Load the plugin with the given id if its loading was deferred.
+        Returns false if it wasn't.
+    */
+    bool loadDeferred(const Utf8String & id);
+
+private:
+    std::mutex deferredMutex;
+    std::map<Utf8String, std::function<void ()> > deferred;
 };
 
 extern template class PolyCollection<Plugin>;
@@ -8,11 +8,28 @@
 
 #include "plugin_manifest.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/vector_description.h"
 
 
 namespace MLDB {
 
 
+DEFINE_STRUCTURE_DESCRIPTION(PluginProvides);
+
+PluginProvidesDescription::
+PluginProvidesDescription()
+{
+    addField("datasets", &PluginProvides::datasets,
+             "Dataset types registered by the plugin");
+    addField("procedures", &PluginProvides::procedures,
+             "Procedure types registered by the plugin");
+    addField("functions", &PluginProvides::functions,
+             "Function types registered by the plugin");
+    addField("sqlFunctionPrefixes", &PluginProvides::sqlFunctionPrefixes,
+             "Prefixes of the names of the SQL builtin functions registered "
+             "by the plugin");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(PluginManifest);
 
 PluginManifestDescription::
@@ -20,6 +37,10 @@ PluginManifestDescription()
 {
     addField("config", &PluginManifest::config,
              "Configuration of plugin loading");
+    addField("provides", &PluginManifest::provides,
+             "Types provided by the plugin.  If any are listed, the plugin "
+             "is loaded the first time one of them is used rather than "
+             "when MLDB starts");
 }
 
 
@@ -11,6 +11,7 @@
 
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/core/plugin.h"
+#include <vector>
 
 
 namespace MLDB {
@@ -20,8 +21,27 @@ namespace MLDB {
 /* PLUGIN MANIFEST                                                           */
 /*****************************************************************************/
 
+/** The types that a plugin provides.  When a manifest lists them, the
+    plugin is only loaded the first time that one of them is used.
+*/
+struct PluginProvides {
+    std::vector<Utf8String> datasets;
+    std::vector<Utf8String> procedures;
+    std::vector<Utf8String> functions;
+    std::vector<Utf8String> sqlFunctionPrefixes;
+
+    bool empty() const
+    {
+        return datasets.empty() && procedures.empty() && functions.empty()
+            && sqlFunctionPrefixes.empty();
+    }
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(PluginProvides);
+
 struct PluginManifest {
     PolyConfig config;
+    PluginProvides provides;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(PluginManifest);
@@ -13,6 +13,8 @@
 #include "mldb/utils/json_utils.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/server/procedure_collection.h"
+#include "mldb/core/memory_account.h"
+#include "mldb/core/run_progress.h"
 
 
 using namespace std;
@@ -231,6 +233,21 @@ getStatusLoading(Utf8String key, const BackgroundTask & task) const
     result.id = key;
     result.state = task.getState();
     result.progress = task.getProgress();
+
+    // The memory used is up to date even between progress updates
+    Json::Value memory = MemoryAccount::getRunningStats
+        ("procedure", ProcedureRun::getMemoryAccountName(procedure, key));
+    if (memory.size() == 1
+        && (result.progress.isNull() || result.progress.isObject()))
+        result.progress["memory"] = memory[0];
+
+    // As is the throughput, which is summed from its counters on demand
+    Json::Value telemetry = RunProgress::getRunningStats
+        (ProcedureRun::getMemoryAccountName(procedure, key));
+    if (!telemetry.isNull()
+        && (result.progress.isNull() || result.progress.isObject()))
+        result.progress["telemetry"] = telemetry;
+
     return result;
 }
 
@@ -0,0 +1,370 @@
+/** query_result_cache.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Cache of the results of queries on committed datasets.
+*/
+
+#include "mldb/server/query_result_cache.h"
+#include "mldb/core/dataset.h"
+#include "mldb/plugins/tabular_dataset_column.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/table_expression_operations.h"
+#include "mldb/jml/utils/environment.h"
+#include <list>
+#include <map>
+#include <set>
+#include <mutex>
+#include <unordered_map>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<size_t> MLDB_QUERY_RESULT_CACHE_BYTES
+("MLDB_QUERY_RESULT_CACHE_BYTES", 256 * 1024 * 1024);
+
+/** Results of a query held in frozen columns.  Each output column has a
+    frozen column of its values and one of their timestamps, indexed by
+    the row number.  The columns of each row are recorded in their
+    original order, so that the rows are given back exactly as they were.
+*/
+struct FrozenResult {
+    std::vector<RowHash> rowHashes;
+    std::vector<RowPath> rowNames;
+    std::vector<uint32_t> rowStarts;    ///< Index in cellColumns per row
+    std::vector<uint32_t> cellColumns;  ///< Column number of each cell
+    std::vector<ColumnPath> columnNames;
+    std::vector<std::shared_ptr<FrozenColumn> > values;
+    std::vector<std::shared_ptr<FrozenColumn> > timestamps;
+    size_t memusage = 0;
+
+    std::vector<MatrixNamedRow> thaw() const
+    {
+        std::vector<MatrixNamedRow> result(rowNames.size());
+        for (size_t i = 0;  i < result.size();  ++i) {
+            MatrixNamedRow & row = result[i];
+            row.rowHash = rowHashes[i];
+            row.rowName = rowNames[i];
+            row.columns.reserve(rowStarts[i + 1] - rowStarts[i]);
+            for (uint32_t j = rowStarts[i];  j < rowStarts[i + 1];  ++j) {
+                uint32_t col = cellColumns[j];
+                row.columns.emplace_back(columnNames[col],
+                                         values[col]->get(i),
+                                         timestamps[col]->get(i)
+                                         .toTimestamp());
+            }
+        }
+        return result;
+    }
+};
+
+/** Freeze the given results, returning null if they can't be frozen
+    because a row has more than one value for the same column.
+*/
+std::shared_ptr<const FrozenResult>
+freezeResult(const std::vector<MatrixNamedRow> & rows)
+{
+    auto result = std::make_shared<FrozenResult>();
+    result->rowHashes.reserve(rows.size());
+    result->rowNames.reserve(rows.size());
+    result->rowStarts.reserve(rows.size() + 1);
+
+    std::unordered_map<ColumnPath, uint32_t> columnIndex;
+    std::vector<TabularDatasetColumn> values, timestamps;
+    std::vector<int64_t> lastRow;
+
+    for (size_t i = 0;  i < rows.size();  ++i) {
+        const MatrixNamedRow & row = rows[i];
+        result->rowHashes.push_back(row.rowHash);
+        result->rowNames.push_back(row.rowName);
+        result->rowStarts.push_back(result->cellColumns.size());
+
+        for (auto & c: row.columns) {
+            auto it = columnIndex.emplace(std::get<0>(c),
+                                          result->columnNames.size()).first;
+            uint32_t col = it->second;
+            if (col == result->columnNames.size()) {
+                result->columnNames.push_back(std::get<0>(c));
+                values.emplace_back();
+                timestamps.emplace_back();
+                lastRow.push_back(-1);
+            }
+
+            if (lastRow[col] == (int64_t)i)
+                return nullptr;
+            lastRow[col] = i;
+
+            result->cellColumns.push_back(col);
+            values[col].add(i, std::get<1>(c));
+            timestamps[col].add(i, CellValue(std::get<2>(c)));
+        }
+    }
+    result->rowStarts.push_back(result->cellColumns.size());
+
+    ColumnFreezeParameters params;
+    size_t mem = sizeof(FrozenResult)
+        + result->rowHashes.capacity() * sizeof(RowHash)
+        + result->rowStarts.capacity() * sizeof(uint32_t)
+        + result->cellColumns.capacity() * sizeof(uint32_t);
+    for (auto & n: result->rowNames)
+        mem += n.memusage();
+    for (auto & n: result->columnNames)
+        mem += n.memusage();
+    for (size_t i = 0;  i < values.size();  ++i) {
+        result->values.emplace_back(values[i].freeze(params));
+        result->timestamps.emplace_back(timestamps[i].freeze(params));
+        mem += result->values.back()->memusage()
+            + result->timestamps.back()->memusage();
+    }
+    result->memusage = mem;
+
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* QUERY RESULT CACHE                                                        */
+/*****************************************************************************/
+
+struct QueryResultCache::Impl {
+    struct Entry {
+        std::string key;
+        std::weak_ptr<Dataset> dataset;
+        Utf8String datasetId;
+        uint64_t generation = 0;
+        std::shared_ptr<const FrozenResult> result;
+        Date created;
+        Date lastHit;
+        uint64_t hits = 0;
+    };
+
+    typedef std::list<Entry> Entries;
+
+    mutable std::mutex mutex;
+    Entries entries;  ///< Most recently used first
+    std::map<std::string, Entries::iterator> index;
+    size_t bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+
+    /** Remove the given entry.  Its results are moved into garbage so that
+        they can be freed once the lock is released.
+    */
+    void erase(Entries::iterator it,
+               std::vector<std::shared_ptr<const FrozenResult> > & garbage)
+    {
+        bytes -= it->result->memusage;
+        garbage.emplace_back(std::move(it->result));
+        index.erase(it->key);
+        entries.erase(it);
+    }
+};
+
+QueryResultCache::
+QueryResultCache()
+    : impl(new Impl())
+{
+}
+
+QueryResultCache::
+~QueryResultCache()
+{
+}
+
+std::vector<MatrixNamedRow>
+QueryResultCache::
+get(const std::string & key,
+    const std::shared_ptr<Dataset> & dataset,
+    const RunQuery & runQuery)
+{
+    size_t maxBytes = MLDB_QUERY_RESULT_CACHE_BYTES;
+    if (maxBytes == 0 || !dataset)
+        return runQuery();
+
+    // Read the generation before running the query, so that if it's
+    // committed to while we run, the results can't be found again under
+    // the later generation
+    uint64_t generation = dataset->getGeneration();
+    if (generation == 0)
+        return runQuery();
+
+    std::vector<std::shared_ptr<const FrozenResult> > garbage;
+
+    {
+        std::unique_lock<std::mutex> guard(impl->mutex);
+        auto it = impl->index.find(key);
+        if (it != impl->index.end()) {
+            Impl::Entry & entry = *it->second;
+            if (entry.generation == generation
+                && entry.dataset.lock() == dataset) {
+                entry.hits += 1;
+                entry.lastHit = Date::now();
+                impl->hits += 1;
+                impl->entries.splice(impl->entries.begin(), impl->entries,
+                                     it->second);
+                std::shared_ptr<const FrozenResult> result = entry.result;
+                guard.unlock();
+                return result->thaw();
+            }
+            impl->erase(it->second, garbage);
+        }
+        impl->misses += 1;
+    }
+
+    std::vector<MatrixNamedRow> rows = runQuery();
+
+    std::shared_ptr<const FrozenResult> frozen = freezeResult(rows);
+    if (!frozen || frozen->memusage > maxBytes)
+        return rows;
+
+    Impl::Entry entry;
+    entry.key = key;
+    entry.dataset = dataset;
+    if (dataset->getConfigPtr())
+        entry.datasetId = dataset->getId();
+    entry.generation = generation;
+    entry.result = std::move(frozen);
+    entry.created = Date::now();
+
+    std::unique_lock<std::mutex> guard(impl->mutex);
+
+    // Another thread may have run the same query in the meantime
+    auto it = impl->index.find(key);
+    if (it != impl->index.end())
+        impl->erase(it->second, garbage);
+
+    impl->bytes += entry.result->memusage;
+    impl->entries.emplace_front(std::move(entry));
+    impl->index[key] = impl->entries.begin();
+
+    while (impl->bytes > maxBytes) {
+        impl->erase(std::prev(impl->entries.end()), garbage);
+        impl->evictions += 1;
+    }
+
+    return rows;
+}
+
+Json::Value
+QueryResultCache::
+getStats() const
+{
+    std::unique_lock<std::mutex> guard(impl->mutex);
+
+    Json::Value result;
+    result["maxBytes"] = (Json::UInt)MLDB_QUERY_RESULT_CACHE_BYTES.get();
+    result["bytes"] = (Json::UInt)impl->bytes;
+    result["hits"] = (Json::UInt)impl->hits;
+    result["misses"] = (Json::UInt)impl->misses;
+    result["evictions"] = (Json::UInt)impl->evictions;
+
+    Json::Value & entries = result["entries"];
+    entries = Json::arrayValue;
+    for (auto & e: impl->entries) {
+        Json::Value entry;
+        entry["query"] = e.key;
+        entry["dataset"] = e.datasetId;
+        entry["generation"] = (Json::UInt)e.generation;
+        entry["rows"] = (Json::UInt)e.result->rowNames.size();
+        entry["columns"] = (Json::UInt)e.result->columnNames.size();
+        entry["bytes"] = (Json::UInt)e.result->memusage;
+        entry["hits"] = (Json::UInt)e.hits;
+        entry["created"] = e.created.printIso8601();
+        if (e.hits)
+            entry["lastHit"] = e.lastHit.printIso8601();
+        entries.append(entry);
+    }
+
+    return result;
+}
+
+void
+QueryResultCache::
+clear()
+{
+    Impl::Entries toFree;
+    {
+        std::unique_lock<std::mutex> guard(impl->mutex);
+        toFree.swap(impl->entries);
+        impl->index.clear();
+        impl->bytes = 0;
+    }
+}
+
+namespace {
+
+/// Builtins whose result depends on more than their arguments: the current
+/// time (jaccard_index() stamps its result with it), the contents of a URL
+/// or arbitrary Javascript
+const std::set<Utf8String> nonDeterministicBuiltins = {
+    "now", "jaccard_index", "fetcher", "jseval"
+};
+
+} // file scope
+
+bool
+QueryResultCache::
+isCacheable(const SelectStatement & stm,
+            const std::function<bool (const Utf8String &)> & isUserFunction)
+{
+    // Binding other table expressions, such as subselects or joins, would
+    // run them, so we only cache queries straight on a dataset
+    if (!dynamic_cast<const DatasetExpression *>(stm.from.get()))
+        return false;
+
+    bool result = true;
+
+    auto onNode = [&] (const SqlExpression & expr,
+                       const std::string & type,
+                       const Utf8String & arg,
+                       const std::vector<std::shared_ptr<SqlExpression> > &)
+        {
+            if (!result)
+                return false;
+
+            if (auto in = dynamic_cast<const InExpression *>(&expr)) {
+                if (in->subtable)
+                    result = false;
+            }
+            else if (auto call
+                     = dynamic_cast<const FunctionCallExpression *>(&expr)) {
+                // Functions qualified by a table name, like x.rowName(),
+                // only read the row
+                if (call->tableName.empty()
+                    && (nonDeterministicBuiltins.count(call->functionName)
+                        || isUserFunction(call->functionName)))
+                    result = false;
+            }
+            return result;
+        };
+
+    auto check = [&] (const SqlExpression * expr)
+        {
+            if (expr && result)
+                expr->traverse(onNode);
+        };
+
+    check(&stm.select);
+    check(stm.when.when.get());
+    check(stm.where.get());
+    for (auto & c: stm.orderBy.clauses)
+        check(c.first.get());
+    for (auto & c: stm.groupBy.clauses)
+        check(c.get());
+    check(stm.having.get());
+    check(stm.rowName.get());
+
+    return result;
+}
+
+} // namespace MLDB
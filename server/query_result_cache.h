@@ -0,0 +1,91 @@
+/** query_result_cache.h                                           -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Cache of the results of queries on committed datasets.
+*/
+
+#pragma once
+
+#include "mldb/sql/dataset_types.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include <functional>
+#include <memory>
+
+
+namespace MLDB {
+
+struct Dataset;
+struct SelectStatement;
+
+
+/*****************************************************************************/
+/* QUERY RESULT CACHE                                                        */
+/*****************************************************************************/
+
+/** Cache of the results of queries that select from a single dataset,
+    for queries which are run over and over against data that doesn't
+    change, for example rollups over historical data.
+
+    Entries are keyed by the normalized text of the query, and hold the
+    dataset and its generation (see Dataset::getGeneration()) at the time
+    they were computed.  An entry is used only while the query is run on
+    the same dataset at the same generation, so results are recomputed
+    after the dataset is committed to or replaced.  Datasets with a
+    generation of zero are never cached.
+
+    Nothing else that the query depends on is tracked, so queries that
+    read anything else, such as user functions, the current time or other
+    datasets within expressions, must not be cached; isCacheable() tells
+    which ones can be.
+
+    Results are held as compressed frozen columns, one for the values of
+    each output column and one for their timestamps.  They take up to
+    MLDB_QUERY_RESULT_CACHE_BYTES bytes (default 256MB) in total, with
+    the least recently used results evicted first; zero disables the
+    cache.  It is safe to use from multiple threads.
+*/
+
+struct QueryResultCache {
+    QueryResultCache();
+    ~QueryResultCache();
+
+    typedef std::function<std::vector<MatrixNamedRow> ()> RunQuery;
+
+    /** Return the results of the query with the given key on the given
+        dataset, either from the cache or by calling runQuery and caching
+        what it returns.  Results with more than one value for the same
+        column in a row aren't cached.
+    */
+    std::vector<MatrixNamedRow>
+    get(const std::string & key,
+        const std::shared_ptr<Dataset> & dataset,
+        const RunQuery & runQuery);
+
+    /** Tell whether the results of the statement depend on nothing but
+        the dataset it selects from, so that they can be cached.  They
+        don't when it selects from anything else than a dataset, when it
+        runs a subquery with IN (SELECT ...), when it calls a user function
+        (isUserFunction tells which names are), or when it calls a builtin
+        function that doesn't always give the same result, such as now()
+        or fetcher().
+    */
+    static bool
+    isCacheable(const SelectStatement & stm,
+                const std::function<bool (const Utf8String &)> & isUserFunction);
+
+    /** Return the statistics of the cache and of each of its entries.
+        This is what GET /v1/queryCache returns.
+    */
+    Json::Value getStats() const;
+
+    /** Remove all of the results from the cache. */
+    void clear();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace MLDB
@@ -0,0 +1,470 @@
+/** query_spill.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Spilling of the sorted intermediate rows of a query to disk.
+*/
+
+#include "mldb/server/query_spill.h"
+#include "mldb/plugins/frozen_column.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/http/http_exception.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<size_t> MLDB_QUERY_MEMORY_BUDGET
+("MLDB_QUERY_MEMORY_BUDGET", 4ULL * 1024 * 1024 * 1024);
+
+EnvOption<std::string> MLDB_QUERY_SPILL_DIR
+("MLDB_QUERY_SPILL_DIR", "/tmp");
+
+std::atomic<uint64_t> spilledRuns(0);
+
+enum SpilledValueType : unsigned char {
+    SV_ATOM,
+    SV_STRUCTURED,
+    SV_EMBEDDING,
+    SV_SUPERPOSITION
+};
+
+void serializePath(ML::DB::Store_Writer & store, const Path & path)
+{
+    store << ML::DB::compact_size_t(path.size());
+    for (size_t i = 0;  i < path.size();  ++i)
+        store << path[i].toUtf8String();
+}
+
+Path reconstitutePath(ML::DB::Store_Reader & store)
+{
+    ML::DB::compact_size_t size(store);
+    std::vector<PathElement> elements;
+    elements.reserve(size);
+    for (size_t i = 0;  i < size;  ++i) {
+        Utf8String element;
+        store >> element;
+        elements.emplace_back(std::move(element));
+    }
+    return Path(elements.begin(), elements.end());
+}
+
+void serializeRow(ML::DB::Store_Writer & store,
+                  const SpilledRowRuns::Row & row)
+{
+    auto serializeValues = [&] (const std::vector<ExpressionValue> & values)
+        {
+            store << ML::DB::compact_size_t(values.size());
+            for (auto & v: values)
+                serializeExpressionValue(store, v);
+        };
+
+    serializeValues(std::get<0>(row));
+
+    const NamedRowValue & output = std::get<1>(row);
+    serializePath(store, output.rowName);
+    store << output.rowHash;
+    store << ML::DB::compact_size_t(output.columns.size());
+    for (auto & col: output.columns) {
+        store << std::get<0>(col).toUtf8String();
+        serializeExpressionValue(store, std::get<1>(col));
+    }
+
+    serializeValues(std::get<2>(row));
+}
+
+SpilledRowRuns::Row reconstituteRow(ML::DB::Store_Reader & store)
+{
+    auto reconstituteValues = [&] ()
+        {
+            ML::DB::compact_size_t size(store);
+            std::vector<ExpressionValue> result;
+            result.reserve(size);
+            for (size_t i = 0;  i < size;  ++i)
+                result.emplace_back(reconstituteExpressionValue(store));
+            return result;
+        };
+
+    SpilledRowRuns::Row result;
+    std::get<0>(result) = reconstituteValues();
+
+    NamedRowValue & output = std::get<1>(result);
+    output.rowName = reconstitutePath(store);
+    store >> output.rowHash;
+    ML::DB::compact_size_t numColumns(store);
+    output.columns.reserve(numColumns);
+    for (size_t i = 0;  i < numColumns;  ++i) {
+        Utf8String name;
+        store >> name;
+        output.columns.emplace_back(PathElement(std::move(name)),
+                                    reconstituteExpressionValue(store));
+    }
+
+    std::get<2>(result) = reconstituteValues();
+    return result;
+}
+
+} // file scope
+
+void serializeExpressionValue(ML::DB::Store_Writer & store,
+                              const ExpressionValue & val)
+{
+    if (val.isAtom()) {
+        store << (unsigned char)SV_ATOM;
+        serializeCellValue(store, val.getAtom());
+        store << val.getEffectiveTimestamp();
+    }
+    else if (val.isSuperposition()) {
+        std::vector<const ExpressionValue *> values;
+        auto onValue = [&] (const ExpressionValue & v)
+            {
+                values.push_back(&v);
+                return true;
+            };
+        val.forEachSuperposedValue(onValue);
+
+        store << (unsigned char)SV_SUPERPOSITION
+              << ML::DB::compact_size_t(values.size());
+        for (auto * v: values)
+            serializeExpressionValue(store, *v);
+    }
+    else if (val.isEmbedding()) {
+        DimsVector shape = val.getEmbeddingShape();
+        store << (unsigned char)SV_EMBEDDING
+              << val.getEffectiveTimestamp()
+              << ML::DB::compact_size_t(shape.size());
+        for (auto & d: shape)
+            store << ML::DB::compact_size_t(d);
+        for (auto & cell: val.getEmbeddingCell())
+            serializeCellValue(store, cell);
+    }
+    else {
+        store << (unsigned char)SV_STRUCTURED
+              << ML::DB::compact_size_t(val.rowLength());
+        auto onColumn = [&] (const PathElement & columnName,
+                             const ExpressionValue & v)
+            {
+                store << columnName.toUtf8String();
+                serializeExpressionValue(store, v);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+    }
+}
+
+ExpressionValue reconstituteExpressionValue(ML::DB::Store_Reader & store)
+{
+    unsigned char type;
+    store >> type;
+
+    switch (type) {
+    case SV_ATOM: {
+        CellValue cell = reconstituteCellValue(store);
+        Date ts;
+        store >> ts;
+        return ExpressionValue(std::move(cell), ts);
+    }
+    case SV_STRUCTURED: {
+        ML::DB::compact_size_t size(store);
+        StructValue structured;
+        structured.reserve(size);
+        for (size_t i = 0;  i < size;  ++i) {
+            Utf8String name;
+            store >> name;
+            structured.emplace_back(PathElement(std::move(name)),
+                                    reconstituteExpressionValue(store));
+        }
+        return ExpressionValue(std::move(structured));
+    }
+    case SV_EMBEDDING: {
+        Date ts;
+        store >> ts;
+        ML::DB::compact_size_t numDims(store);
+        DimsVector shape;
+        size_t numCells = 1;
+        for (size_t i = 0;  i < numDims;  ++i) {
+            ML::DB::compact_size_t d(store);
+            shape.push_back(d);
+            numCells *= d;
+        }
+        std::vector<CellValue> cells;
+        cells.reserve(numCells);
+        for (size_t i = 0;  i < numCells;  ++i)
+            cells.emplace_back(reconstituteCellValue(store));
+        return ExpressionValue(std::move(cells), ts, std::move(shape));
+    }
+    case SV_SUPERPOSITION: {
+        ML::DB::compact_size_t size(store);
+        std::vector<ExpressionValue> values;
+        values.reserve(size);
+        for (size_t i = 0;  i < size;  ++i)
+            values.emplace_back(reconstituteExpressionValue(store));
+        return ExpressionValue::superpose(std::move(values));
+    }
+    }
+
+    throw HttpReturnException(500, "Can't reconstitute unknown spilled "
+                              "value type " + std::to_string((int)type));
+}
+
+size_t expressionValueMemusage(const ExpressionValue & val)
+{
+    size_t result = sizeof(ExpressionValue);
+
+    if (val.isAtom()) {
+        result += val.getAtom().memusage();
+    }
+    else if (val.isSuperposition()) {
+        auto onValue = [&] (const ExpressionValue & v)
+            {
+                result += expressionValueMemusage(v);
+                return true;
+            };
+        val.forEachSuperposedValue(onValue);
+    }
+    else if (val.isEmbedding()) {
+        size_t numCells = 1;
+        for (auto & d: val.getEmbeddingShape())
+            numCells *= d;
+        result += numCells * sizeof(CellValue);
+    }
+    else {
+        auto onColumn = [&] (const PathElement & columnName,
+                             const ExpressionValue & v)
+            {
+                result += columnName.memusage() + expressionValueMemusage(v);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+    }
+
+    return result;
+}
+
+size_t namedRowValueMemusage(const NamedRowValue & row)
+{
+    size_t result = sizeof(NamedRowValue) + row.rowName.memusage();
+    for (auto & col: row.columns) {
+        result += std::get<0>(col).memusage()
+            + expressionValueMemusage(std::get<1>(col));
+    }
+    return result;
+}
+
+size_t getQueryMemoryBudget()
+{
+    return MLDB_QUERY_MEMORY_BUDGET.get();
+}
+
+size_t setQueryMemoryBudget(size_t bytes)
+{
+    size_t result = MLDB_QUERY_MEMORY_BUDGET.get();
+    MLDB_QUERY_MEMORY_BUDGET.set(bytes);
+    return result;
+}
+
+uint64_t getQuerySpilledRuns()
+{
+    return spilledRuns;
+}
+
+
+/*****************************************************************************/
+/* SPILLED ROW RUNS                                                          */
+/*****************************************************************************/
+
+struct SpilledRowRuns::Impl {
+    Impl(Compare compare)
+        : compare(std::move(compare))
+    {
+    }
+
+    ~Impl()
+    {
+        for (auto & run: runs)
+            tryEraseUriObject(run.uri);
+    }
+
+    struct Run {
+        std::string uri;
+        size_t numRows;
+    };
+
+    Compare compare;
+    mutable std::mutex mutex;
+    std::vector<Run> runs;  // under mutex
+};
+
+SpilledRowRuns::
+SpilledRowRuns(Compare compare)
+    : impl(new Impl(std::move(compare)))
+{
+}
+
+SpilledRowRuns::
+~SpilledRowRuns()
+{
+}
+
+size_t
+SpilledRowRuns::
+memusage(const Row & row)
+{
+    size_t result = sizeof(Row);
+    for (auto & v: std::get<0>(row))
+        result += expressionValueMemusage(v);
+    result += namedRowValueMemusage(std::get<1>(row)) - sizeof(NamedRowValue);
+    for (auto & v: std::get<2>(row))
+        result += expressionValueMemusage(v);
+    return result;
+}
+
+void
+SpilledRowRuns::
+spill(std::vector<Row> & rows)
+{
+    if (rows.empty())
+        return;
+
+    static std::atomic<int> runNumber(0);
+    std::string uri = MLDB_QUERY_SPILL_DIR.get()
+        + "/mldb-query-spill-" + std::to_string(getpid())
+        + "-" + std::to_string(runNumber++) + ".lz4";
+
+    // Register it first so that it's cleaned up even if writing fails
+    {
+        std::unique_lock<std::mutex> guard(impl->mutex);
+        impl->runs.push_back({ uri, 0 });
+    }
+
+    std::sort(rows.begin(), rows.end(), impl->compare);
+
+    {
+        filter_ostream stream(uri);
+        ML::DB::Store_Writer store(stream);
+        for (auto & row: rows)
+            serializeRow(store, row);
+        stream.close();
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(impl->mutex);
+        for (auto & run: impl->runs) {
+            if (run.uri == uri)
+                run.numRows = rows.size();
+        }
+    }
+
+    ++spilledRuns;
+    rows.clear();
+    rows.shrink_to_fit();
+}
+
+size_t
+SpilledRowRuns::
+numRuns() const
+{
+    std::unique_lock<std::mutex> guard(impl->mutex);
+    return impl->runs.size();
+}
+
+bool
+SpilledRowRuns::
+merge(std::vector<Row> & inMemory,
+      const std::function<bool (Row & row)> & onRow)
+{
+    // Each run is read back one row at a time; the rows in memory are
+    // the last source.
+    struct Source {
+        std::unique_ptr<filter_istream> stream;
+        std::unique_ptr<ML::DB::Store_Reader> store;
+        size_t rowsLeft = 0;
+        Row current;
+    };
+
+    std::vector<Source> sources(impl->runs.size());
+    size_t inMemoryPos = 0;
+
+    // Get the next row of a source into its current row, returning false
+    // if it has no more
+    auto next = [&] (size_t i) -> bool
+        {
+            if (i == sources.size()) {
+                if (inMemoryPos == inMemory.size())
+                    return false;
+                return true;
+            }
+            Source & source = sources[i];
+            if (source.rowsLeft == 0)
+                return false;
+            source.current = reconstituteRow(*source.store);
+            --source.rowsLeft;
+            return true;
+        };
+
+    auto current = [&] (size_t i) -> Row &
+        {
+            if (i == sources.size())
+                return inMemory[inMemoryPos];
+            return sources[i].current;
+        };
+
+    // The heap has the source with the first row at the top, with ties
+    // going to the earliest source so that the order is deterministic.
+    auto after = [&] (size_t i1, size_t i2)
+        {
+            if (impl->compare(current(i2), current(i1)))
+                return true;
+            if (impl->compare(current(i1), current(i2)))
+                return false;
+            return i1 > i2;
+        };
+
+    std::priority_queue<size_t, std::vector<size_t>, decltype(after)>
+        heap(after);
+
+    for (size_t i = 0;  i < sources.size();  ++i) {
+        const Impl::Run & run = impl->runs[i];
+        sources[i].stream.reset(new filter_istream(run.uri));
+        sources[i].store.reset(new ML::DB::Store_Reader(*sources[i].stream));
+        sources[i].rowsLeft = run.numRows;
+        if (next(i))
+            heap.push(i);
+    }
+    if (next(sources.size()))
+        heap.push(sources.size());
+
+    while (!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
+
+        if (!onRow(current(i)))
+            return false;
+
+        if (i == sources.size())
+            ++inMemoryPos;
+        if (next(i))
+            heap.push(i);
+        else if (i < sources.size()) {
+            sources[i].store.reset();
+            sources[i].stream.reset();
+        }
+    }
+
+    return true;
+}
+
+} // namespace MLDB
@@ -0,0 +1,106 @@
+/** query_spill.h                                                  -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Spilling of the sorted intermediate rows of a query to disk, so that
+    queries that don't fit in memory finish slower rather than not at all.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+#include "mldb/jml/db/persistent_fwd.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/** Write an ExpressionValue in a compact binary form, that
+    reconstituteExpressionValue() reads back.  Embeddings are written as
+    their cells and shape, so they come back with atom storage.
+*/
+void serializeExpressionValue(ML::DB::Store_Writer & store,
+                              const ExpressionValue & val);
+
+ExpressionValue reconstituteExpressionValue(ML::DB::Store_Reader & store);
+
+/** Rough number of bytes of memory held by an ExpressionValue, used to
+    decide when a query has gone over its memory budget.
+*/
+size_t expressionValueMemusage(const ExpressionValue & val);
+
+/** Rough number of bytes of memory held by an output row. */
+size_t namedRowValueMemusage(const NamedRowValue & row);
+
+/** Budget in bytes for the sorted intermediate rows held in memory by a
+    single query, beyond which they are spilled to disk.  It is read from
+    the MLDB_QUERY_MEMORY_BUDGET environment variable, by default 4GB;
+    zero means no limit.
+*/
+size_t getQueryMemoryBudget();
+
+/** Change the query memory budget, for example in tests.  Returns the
+    previous budget.
+*/
+size_t setQueryMemoryBudget(size_t bytes);
+
+/** Total number of runs that queries have spilled to disk since the
+    process started.
+*/
+uint64_t getQuerySpilledRuns();
+
+
+/*****************************************************************************/
+/* SPILLED ROW RUNS                                                          */
+/*****************************************************************************/
+
+/** Sorted runs of query rows written to files, to be merged back together
+    in order at the end of the query.  A row is its sort fields, its
+    output and its calculated values, as used by ORDER BY.
+
+    The files are written through vfs to the directory given by the
+    MLDB_QUERY_SPILL_DIR environment variable (by default /tmp), which
+    may be any URI that can be written to and read back.  They are
+    removed when the object is destroyed.
+*/
+
+struct SpilledRowRuns {
+    typedef std::tuple<std::vector<ExpressionValue>,
+                       NamedRowValue,
+                       std::vector<ExpressionValue> >
+        Row;
+
+    typedef std::function<bool (const Row & row1, const Row & row2)> Compare;
+
+    SpilledRowRuns(Compare compare);
+    ~SpilledRowRuns();
+
+    /** Rough number of bytes held in memory by a row. */
+    static size_t memusage(const Row & row);
+
+    /** Sort the given rows, write them out as a new run and clear them.
+        It is safe to call from multiple threads at once.
+    */
+    void spill(std::vector<Row> & rows);
+
+    /** Number of runs that have been spilled. */
+    size_t numRuns() const;
+
+    /** Merge the spilled runs and the given rows that are still in memory
+        (which must already be sorted) in order, calling onRow for each.
+        If onRow returns false, the merge stops and false is returned.
+        Rows given to onRow may be moved from.
+    */
+    bool merge(std::vector<Row> & inMemory,
+               const std::function<bool (Row & row)> & onRow);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace MLDB
@@ -13,9 +13,14 @@ LIBMLDB_SOURCES:= \
 	procedure_collection.cc \
 	procedure_run_collection.cc \
 	function_collection.cc \
+	function_rpc_endpoint.cc \
 	credential_collection.cc \
 	type_collection.cc \
 	analytics.cc \
+	statement_cache.cc \
+	query_result_cache.cc \
+	query_spill.cc \
+	admission_control.cc \
 	plugin_resource.cc \
 	dataset_context.cc \
 	static_content_handler.cc \
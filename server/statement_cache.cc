@@ -0,0 +1,164 @@
+/** statement_cache.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Cache of parsed SQL statements for the query endpoint.
+*/
+
+#include "mldb/server/statement_cache.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/jml/utils/environment.h"
+#include <list>
+#include <map>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<int> MLDB_STATEMENT_CACHE_SIZE
+("MLDB_STATEMENT_CACHE_SIZE", 1024);
+
+} // file scope
+
+
+/*****************************************************************************/
+/* STATEMENT CACHE                                                           */
+/*****************************************************************************/
+
+struct StatementCache::Impl {
+    typedef std::list<std::pair<std::string,
+                                std::shared_ptr<const SelectStatement> > >
+        Entries;
+
+    mutable std::mutex mutex;
+    Entries entries;  ///< Most recently used first
+    std::map<std::string, Entries::iterator> index;
+};
+
+StatementCache::
+StatementCache()
+    : impl(new Impl())
+{
+}
+
+StatementCache::
+~StatementCache()
+{
+}
+
+std::shared_ptr<const SelectStatement>
+StatementCache::
+get(const Utf8String & query)
+{
+    int maxSize = MLDB_STATEMENT_CACHE_SIZE;
+    if (maxSize <= 0)
+        return std::make_shared<SelectStatement>
+            (SelectStatement::parse(query));
+
+    std::string key = normalize(query);
+
+    {
+        std::unique_lock<std::mutex> guard(impl->mutex);
+        auto it = impl->index.find(key);
+        if (it != impl->index.end()) {
+            impl->entries.splice(impl->entries.begin(), impl->entries,
+                                 it->second);
+            return it->second->second;
+        }
+    }
+
+    // Parse outside of the lock, so that a long query doesn't hold up the
+    // others.  The normalized text is parsed, so that the statement
+    // doesn't depend upon which of the equivalent queries got here first.
+    std::shared_ptr<const SelectStatement> result
+        = std::make_shared<SelectStatement>(SelectStatement::parse(key));
+
+    std::unique_lock<std::mutex> guard(impl->mutex);
+
+    // Another thread may have parsed the same query in the meantime
+    auto it = impl->index.find(key);
+    if (it != impl->index.end())
+        return it->second->second;
+
+    impl->entries.emplace_front(key, result);
+    impl->index[std::move(key)] = impl->entries.begin();
+
+    while (impl->entries.size() > (size_t)maxSize) {
+        impl->index.erase(impl->entries.back().first);
+        impl->entries.pop_back();
+    }
+
+    return result;
+}
+
+size_t
+StatementCache::
+size() const
+{
+    std::unique_lock<std::mutex> guard(impl->mutex);
+    return impl->entries.size();
+}
+
+void
+StatementCache::
+clear()
+{
+    std::unique_lock<std::mutex> guard(impl->mutex);
+    impl->index.clear();
+    impl->entries.clear();
+}
+
+std::string
+StatementCache::
+normalize(const Utf8String & query)
+{
+    const std::string & raw = query.rawString();
+
+    std::string result;
+    result.reserve(raw.size());
+
+    // Quotes are escaped by doubling them, which closes the quoted text
+    // and immediately opens it again, so toggling on each one is enough.
+    char quote = 0;
+    bool pendingSpace = false;
+
+    for (size_t i = 0;  i < raw.size();  ++i) {
+        char c = raw[i];
+
+        if (quote) {
+            result += c;
+            if (c == quote)
+                quote = 0;
+            continue;
+        }
+
+        // The end of a line comment is significant, so queries with
+        // comments are kept as they are
+        if ((c == '-' || c == '/') && i + 1 < raw.size()
+            && raw[i + 1] == (c == '-' ? '-' : '*'))
+            return raw;
+
+        if (isspace((unsigned char)c)) {
+            pendingSpace = !result.empty();
+            continue;
+        }
+
+        if (pendingSpace)
+            result += ' ';
+        pendingSpace = false;
+
+        if (c == '\'' || c == '"')
+            quote = c;
+        result += c;
+    }
+
+    return result;
+}
+
+} // namespace MLDB
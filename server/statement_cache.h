@@ -0,0 +1,68 @@
+/** statement_cache.h                                              -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Cache of parsed SQL statements for the query endpoint.
+*/
+
+#pragma once
+
+#include "mldb/types/string.h"
+#include <memory>
+
+
+namespace MLDB {
+
+struct SelectStatement;
+
+
+/*****************************************************************************/
+/* STATEMENT CACHE                                                           */
+/*****************************************************************************/
+
+/** Least recently used cache of parsed select statements, keyed by their
+    normalized text.  Clients such as dashboards tend to send the same
+    handful of queries over and over, and this saves parsing each of them
+    every time.
+
+    Only the parse is cached.  Binding depends on the datasets and
+    functions that the statement refers to, which may have been committed
+    to, replaced or deleted since the last time it ran, so it's redone on
+    every query.  A parsed statement doesn't depend on anything outside of
+    its own text, so entries never need to be invalidated.
+
+    The size is set with the MLDB_STATEMENT_CACHE_SIZE environment
+    variable; zero disables caching.  It is safe to use from multiple
+    threads.
+*/
+
+struct StatementCache {
+    StatementCache();
+    ~StatementCache();
+
+    /** Return the parsed statement for the given query, parsing it if it's
+        not already in the cache.  Parse errors are thrown and not cached.
+    */
+    std::shared_ptr<const SelectStatement> get(const Utf8String & query);
+
+    /** Return the number of statements held in the cache. */
+    size_t size() const;
+
+    /** Remove all of the statements from the cache. */
+    void clear();
+
+    /** Return the key under which the given query is cached.  Leading and
+        trailing whitespace are removed and runs of whitespace are
+        collapsed into a single space, except within string literals and
+        quoted identifiers.  Two queries with the same normalized text
+        always parse to the same statement.
+    */
+    static std::string normalize(const Utf8String & query);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace MLDB
@@ -21,8 +21,14 @@
 #include "mldb/core/mldb_entity.h"
 #include "static_content_macro.h"
 #include "mldb/base/scope.h"
+#include "mldb/rest/content_encoding.h"
+#include "mldb/ext/cityhash/src/city.h"
+#include "mldb/jml/utils/environment.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
 
 
 using namespace std;
@@ -31,6 +37,110 @@ namespace fs = boost::filesystem;
 
 namespace MLDB {
 
+namespace {
+
+/// Static files larger than this are served without being cached
+EnvOption<size_t> MLDB_STATIC_CACHE_MAX_FILE_BYTES
+    ("MLDB_STATIC_CACHE_MAX_FILE_BYTES", 16 * 1024 * 1024);
+
+/// Content codings that static files are precompressed with, and the
+/// level used for each.  Since the work is only done once per file, the
+/// levels favour size over speed.
+const std::pair<const char *, int> STATIC_ENCODINGS[] = {
+    { "zstd", 19 },
+    { "gzip", 9 }
+};
+
+/** Cache of the static files that have been served, with their ETag and
+    their precompressed variants.  Entries are checked against the
+    modification time and size of the file each time they are used, so
+    that files changed on disk are picked up.
+*/
+struct StaticFileCache {
+    struct Entry {
+        time_t mtime = 0;
+        off_t size = 0;
+        std::string etag;
+        std::string body;
+        std::map<std::string, std::string> encoded;  ///< by content coding
+    };
+
+    /** Return the entry for the given file, loading it if it isn't cached
+        or has changed.  The body has {{HTTP_BASE_URL}} replaced by the
+        given base URL.
+    */
+    std::shared_ptr<const Entry>
+    get(const std::string & filename, const struct stat & stats,
+        const std::string & mimeType, const std::string & httpBaseUrl)
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            auto it = entries.find(filename);
+            if (it != entries.end() && it->second->mtime == stats.st_mtime
+                && it->second->size == stats.st_size)
+                return it->second;
+        }
+
+        // Load and compress outside of the lock, so that a big file doesn't
+        // hold up the other requests
+        auto entry = std::make_shared<Entry>();
+        entry->mtime = stats.st_mtime;
+        entry->size = stats.st_size;
+
+        ML::File_Read_Buffer buf(filename);
+        entry->body.assign(buf.start(), buf.end());
+        boost::algorithm::replace_all(entry->body, "{{HTTP_BASE_URL}}",
+                                      httpBaseUrl);
+
+        char etag[32];
+        snprintf(etag, sizeof(etag), "\"%016llx\"",
+                 (unsigned long long)
+                 CityHash64(entry->body.data(), entry->body.size()));
+        entry->etag = etag;
+
+        if (isCompressibleContentType(mimeType)) {
+            for (auto & e: STATIC_ENCODINGS) {
+                std::string encoded = encodeContent(entry->body, e.first,
+                                                    e.second);
+                if (encoded.size() < entry->body.size())
+                    entry->encoded[e.first] = std::move(encoded);
+            }
+        }
+
+        if ((size_t)stats.st_size <= MLDB_STATIC_CACHE_MAX_FILE_BYTES) {
+            std::unique_lock<std::mutex> guard(mutex);
+            entries[filename] = entry;
+        }
+
+        return entry;
+    }
+
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<const Entry> > entries;
+};
+
+/** Return whether an If-None-Match header matches the given ETag. */
+bool etagMatches(const std::string & ifNoneMatch, const std::string & etag)
+{
+    if (ifNoneMatch.empty())
+        return false;
+    if (boost::trim_copy(ifNoneMatch) == "*")
+        return true;
+
+    vector<string> tags;
+    boost::split(tags, ifNoneMatch, boost::is_any_of(","));
+    for (auto & t: tags) {
+        string tag = boost::trim_copy(t);
+        if (tag.find("W/") == 0)
+            tag = string(tag, 2);
+        if (tag == etag)
+            return true;
+    }
+    return false;
+}
+
+} // file scope
+
 
 void renderMacro(hoedown_buffer *ob,
                  const hoedown_buffer *text,
@@ -183,7 +293,10 @@ getStaticRouteHandler(string dir, MldbServer * server, bool hideInternalEntities
     if (dir.find("://") == string::npos)
         dir = "file://" + dir;
 
-    return [dir, server, hideInternalEntities] (RestConnection & connection,
+    auto cache = std::make_shared<StaticFileCache>();
+
+    return [dir, server, hideInternalEntities, cache]
+        (RestConnection & connection,
                   const RestRequest & request,
                   const RestRequestParsingContext & context)
         {
@@ -197,8 +310,9 @@ getStaticRouteHandler(string dir, MldbServer * server, bool hideInternalEntities
 
             //cerr << "looking for " << filename << " for resource " << path << endl;
 
-            auto sendFile = [&connection, &server] (const std::string & filename,
-                                 const std::string & mimeType)
+            auto sendFile = [&connection, &request, &server, &cache]
+                (const std::string & filename,
+                 const std::string & mimeType)
                 {
                     if (!tryGetUriObjectInfo(filename)) {
                         connection.sendErrorResponse
@@ -211,12 +325,47 @@ getStaticRouteHandler(string dir, MldbServer * server, bool hideInternalEntities
                     if (filenameToLoad.find("file://") == 0)
                         filenameToLoad = string(filenameToLoad, 7);
 
+                    struct stat stats;
+                    if (::stat(filenameToLoad.c_str(), &stats) == -1) {
+                        connection.sendErrorResponse
+                        (404,
+                         "File '" + filename + "' doesn't exist", "text/plain");
+                        return RestRequestRouter::MR_YES;
+                    }
+
                     //cerr << "Loading file " << filename << " as " << filenameToLoad << endl;
-                    ML::File_Read_Buffer buf(filenameToLoad);
-            
-                    string result(buf.start(), buf.end());
-                    boost::algorithm::replace_all(result, "{{HTTP_BASE_URL}}", server->httpBaseUrl);
-                    connection.sendResponse(200, result, mimeType);
+                    auto entry = cache->get(filenameToLoad, stats, mimeType,
+                                            server->httpBaseUrl);
+
+                    string encoding = chooseContentEncoding
+                        (request.header.tryGetHeader("accept-encoding"));
+                    auto it = entry->encoded.find(encoding);
+                    const string * body = &entry->body;
+                    string etag = entry->etag;
+                    if (it != entry->encoded.end()) {
+                        body = &it->second;
+                        // Each encoding of the file is a different entity
+                        etag.insert(etag.size() - 1, "-" + encoding);
+                    }
+
+                    RestParams headers = {
+                        { "ETag", etag },
+                        { "Cache-Control", "no-cache" }
+                    };
+                    if (isCompressibleContentType(mimeType))
+                        headers.push_back({ "Vary", "Accept-Encoding" });
+                    if (body != &entry->body)
+                        headers.push_back({ "Content-Encoding", encoding });
+
+                    if (etagMatches(request.header.tryGetHeader("if-none-match"),
+                                    etag)) {
+                        connection.sendHttpResponse(304, "", mimeType,
+                                                    std::move(headers));
+                        return RestRequestRouter::MR_YES;
+                    }
+
+                    connection.sendHttpResponse(200, *body, mimeType,
+                                                std::move(headers));
                     return RestRequestRouter::MR_YES;
                 };
 
@@ -8,8 +8,10 @@
 */
 
 #include "credential_provider.h"
-#include "mldb/types/optional.h"
 #include "mldb/base/exc_assert.h"
+#include <atomic>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <iostream>
 
@@ -31,32 +33,124 @@ namespace {
 std::mutex providersLock;
 std::vector<std::shared_ptr<CredentialProvider> > providers;
 
+/** Index of the credentials of one type by their resource, as a trie over
+    its characters, which finds the longest resource that is a prefix of
+    the one asked for in time proportional to its length.
+*/
+struct CredentialTrie {
+
+    void insert(const StoredCredentials & stored)
+    {
+        Node * node = &root;
+        for (char c: stored.resource) {
+            auto & child = node->children[c];
+            if (!child)
+                child.reset(new Node());
+            node = child.get();
+        }
+
+        // When several have the same resource, the first one wins
+        if (!node->credential)
+            node->credential.reset(new Credential(stored.credential));
+    }
+
+    const Credential * match(const std::string & resource) const
+    {
+        const Node * node = &root;
+        const Credential * result = node->credential.get();
+        for (char c: resource) {
+            auto it = node->children.find(c);
+            if (it == node->children.end())
+                break;
+            node = it->second.get();
+            if (node->credential)
+                result = node->credential.get();
+        }
+        return result;
+    }
+
+private:
+    struct Node {
+        std::map<char, std::unique_ptr<Node> > children;
+        std::unique_ptr<Credential> credential;
+    };
+
+    Node root;
+};
+
+/* Incremented each time that the credentials change.  It's separate from
+   the locks, as providers may call invalidateCache() with their own locks
+   held while getCredential() holds providersLock to call them. */
+std::atomic<uint64_t> credentialsGeneration(0);
+
+std::mutex indexLock;
+uint64_t indexGeneration = 0;
+std::map<std::string, std::shared_ptr<const CredentialTrie> > indexes;
+
+std::shared_ptr<const CredentialTrie>
+buildIndex(const std::string & resourceType)
+{
+    auto result = std::make_shared<CredentialTrie>();
+
+    std::unique_lock<std::mutex> guard(providersLock);
+
+    // find all credentials matching the resource type
+    for (auto it = providers.begin(), end = providers.end();
+         it != end;  ++it) {
+        for (auto & stored: (*it)->getCredentialsOfType(resourceType)) {
+            ExcAssertEqual(resourceType, stored.resourceType);
+            result->insert(stored);
+        }
+    }
+
+    return result;
+}
+
 } // file scope
 
 void
 CredentialProvider::
 registerProvider(std::shared_ptr<CredentialProvider> provider)
 {
-    std::unique_lock<std::mutex> guard(providersLock);
-    providers.push_back(provider);
+    {
+        std::unique_lock<std::mutex> guard(providersLock);
+        providers.push_back(provider);
+    }
+    invalidateCache();
+}
+
+void
+CredentialProvider::
+invalidateCache()
+{
+    ++credentialsGeneration;
 }
 
 Credential
 getCredential(const std::string & resourceType,
               const std::string & resource)
 {
-    std::vector<StoredCredentials> candidates;
-    {
-        std::unique_lock<std::mutex> guard(providersLock);
+    // The generation is read before the credentials, so that a change
+    // while we build the index makes the next call rebuild it
+    uint64_t generation = credentialsGeneration;
 
-        // find all credentials matching the resource type
-        for (auto it = providers.begin(), end = providers.end();
-             it != end;  ++it) {
-            auto creds = (*it)->getCredentialsOfType(resourceType);
-            if (!creds.empty()) {
-                candidates.insert(candidates.end(), creds.begin(), creds.end());
-            }
+    std::shared_ptr<const CredentialTrie> index;
+    {
+        std::unique_lock<std::mutex> guard(indexLock);
+        if (indexGeneration != generation) {
+            indexes.clear();
+            indexGeneration = generation;
         }
+        auto it = indexes.find(resourceType);
+        if (it != indexes.end())
+            index = it->second;
+    }
+
+    if (!index) {
+        index = buildIndex(resourceType);
+        std::unique_lock<std::mutex> guard(indexLock);
+        if (indexGeneration == generation)
+            indexes[resourceType] = index;
     }
 
     // find the best match
@@ -65,22 +159,11 @@ getCredential(const std::string & resourceType,
     // is the prefix matching a resource URI better is the match.
     // In particular, this logic has no understanding of URI structure
     // like folders, buckets, filename, extension and so on.
-    Optional<StoredCredentials> bestMatch;
-    for (const auto & storedCredential : candidates) {
-        ExcAssertEqual(resourceType, storedCredential.resourceType);
-
-        if (resource.find(storedCredential.resource) != 0)
-            continue;  // not a prefix
-
-        // better match on path
-        if (!bestMatch || bestMatch->resource.find(storedCredential.resource)) {
-            bestMatch.reset(new StoredCredentials(storedCredential));
-        }
-    }
+    const Credential * bestMatch = index->match(resource);
 
     if (bestMatch) {
         // found credentials for the resource
-        return bestMatch->credential;
+        return *bestMatch;
     }
 
     throw MLDB::Exception("No credentials found for " + resourceType + " "
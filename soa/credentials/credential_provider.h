@@ -42,6 +42,14 @@ struct CredentialProvider {
        load time for all providers.
     */
     static void registerProvider(std::shared_ptr<CredentialProvider> provider);
+
+    /**
+       Signals that the credentials returned by a provider have changed.
+       getCredential() keeps an index of the credentials of each type,
+       which is rebuilt on the next call after this.  Providers whose
+       credentials can change after registration must call it.
+    */
+    static void invalidateCache();
 };
 
 
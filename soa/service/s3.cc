@@ -9,6 +9,7 @@
 
 #include <exception>
 #include <future>
+#include <mutex>
 
 #include "mldb/arch/exception.h"
 #include "mldb/base/exc_assert.h"
@@ -712,12 +713,17 @@ double
 S3Api::
 defaultBandwidthToServiceMbps = 20.0;
 
+unsigned
+S3Api::
+defaultMaxDownloadRequests = 30;
+
 S3Api::Range S3Api::Range::Full(0);
 
 S3Api::
 S3Api()
 {
     bandwidthToServiceMbps = defaultBandwidthToServiceMbps;
+    maxDownloadRequests = defaultMaxDownloadRequests;
 }
 
 S3Api::
@@ -730,7 +736,8 @@ S3Api(const string & accessKeyId,
       accessKey(accessKey),
       defaultProtocol(defaultProtocol),
       serviceUri(serviceUri),
-      bandwidthToServiceMbps(bandwidthToServiceMbps)
+      bandwidthToServiceMbps(bandwidthToServiceMbps),
+      maxDownloadRequests(defaultMaxDownloadRequests)
 {
 }
 
@@ -1962,12 +1969,67 @@ static double getBandwidth(const Credential & cred)
     else return S3Api::defaultBandwidthToServiceMbps;
 }
 
+namespace {
+
+/* S3Api objects already created, by the credential that they were created
+   with, so that opening many objects with the same credential shares one.
+   Credentials are few, so the entries are never removed. */
+std::mutex apisLock;
+std::map<std::string, std::shared_ptr<S3Api> > apis;
+
+} // file scope
+
 std::shared_ptr<S3Api> getS3ApiForUri(const string & uri)
 {
     // Get the credentials
     auto creds = getCredential("aws:s3", uri);
-    return std::make_shared<S3Api>(creds.id, creds.secret, getBandwidth(creds),
-                                   creds.protocol, creds.location);
+
+    unsigned maxDownloadRequests = S3Api::defaultMaxDownloadRequests;
+    if (creds.extra.isMember("maxDownloadRequests"))
+        maxDownloadRequests
+            = std::max(1U, (unsigned)creds.extra["maxDownloadRequests"].asUInt());
+
+    string key = creds.id + '\0' + creds.secret + '\0' + creds.protocol
+        + '\0' + creds.location + '\0' + std::to_string(getBandwidth(creds))
+        + '\0' + std::to_string(maxDownloadRequests);
+
+    std::unique_lock<std::mutex> guard(apisLock);
+    auto & result = apis[key];
+    if (!result) {
+        result = std::make_shared<S3Api>(creds.id, creds.secret,
+                                         getBandwidth(creds),
+                                         creds.protocol, creds.location);
+        result->maxDownloadRequests = maxDownloadRequests;
+    }
+    return result;
+}
+
+namespace {
+
+std::mutex downloadStatsMutex;
+double downloadBandwidthMbps = 0.0;
+
+} // file scope
+
+void recordS3Download(uint64_t bytes, double seconds)
+{
+    // Tiny downloads are dominated by latency and say nothing about the
+    // bandwidth
+    if (bytes < 1000000 || seconds <= 0.0)
+        return;
+
+    double mbps = bytes / seconds / 1000000.0;
+
+    std::unique_lock<std::mutex> guard(downloadStatsMutex);
+    if (downloadBandwidthMbps == 0.0)
+        downloadBandwidthMbps = mbps;
+    else downloadBandwidthMbps = 0.75 * downloadBandwidthMbps + 0.25 * mbps;
+}
+
+double getS3DownloadBandwidthMbps()
+{
+    std::unique_lock<std::mutex> guard(downloadStatsMutex);
+    return downloadBandwidthMbps;
 }
 
 } // namespace MLDB
@@ -67,6 +67,12 @@ struct S3Api : public AwsApi {
     */
     static double defaultBandwidthToServiceMbps;
 
+    /** Default maximum number of ranged GET requests a single download
+        keeps in flight.  The downloader adapts the actual number to the
+        throughput it gets, up to this limit.
+    */
+    static unsigned defaultMaxDownloadRequests;
+
     S3Api();
 
     /** Set up the API to called with the given credentials. */
@@ -88,6 +94,7 @@ struct S3Api : public AwsApi {
     std::string defaultProtocol;
     std::string serviceUri;
     double bandwidthToServiceMbps;
+    unsigned maxDownloadRequests;
 
     struct Range {
         static Range Full;
@@ -506,8 +513,19 @@ void registerS3Buckets(const std::string & accessKeyId,
     own credentials using registered credential providers, or one which was
     registered using registerS3Bucket or registerS3Buckets, or
     ~/.cloud_credentials, or S3_KEY_ID, S3_KEY and S3_BUCKETS environment
-    variables.
+    variables.  URIs with the same credentials share the same object, which
+    must not be modified.
 */
 std::shared_ptr<S3Api> getS3ApiForUri(const std::string & uri);
 
+/** Record that a download of the given number of bytes took the given
+    time.  This feeds getS3DownloadBandwidthMbps().
+*/
+void recordS3Download(uint64_t bytes, double seconds);
+
+/** Return the bandwidth achieved by recent S3 downloads, in megabytes per
+    second, or 0 if nothing has been downloaded yet.
+*/
+double getS3DownloadBandwidthMbps();
+
 } // namespace MLDB
@@ -7,13 +7,17 @@
 
 #include "sql_expression.h"
 #include "builtin_functions.h"
+#include "t_digest.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/jml/stats/distribution.h"
 #include "mldb/jml/utils/csv.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/base/optimized_path.h"
+#include "mldb/ml/confidence_intervals.h"
 #include <array>
 #include <unordered_set>
+#include <cmath>
+#include <limits>
 
 using namespace std;
 
@@ -135,17 +139,29 @@ struct AggregatorT {
 
         void process(const ExpressionValue * args, size_t nargs)
         {
-            checkArgsSize(nargs, 1);
+            checkArgsSize(nargs, State::nargs, State::maxArgs);
             const ExpressionValue & val = args[0];
 
             if (val.empty())
                 return;
 
+            // Any arguments after the row (like the quantile of
+            // approx_quantile) are passed as-is with each column
+            std::vector<ExpressionValue> columnArgs;
+            if (nargs > 1)
+                columnArgs.assign(args, args + nargs);
+
             // This must be a row...
             auto onColumn = [&] (const PathElement & columnName,
                                  const ExpressionValue & val)
                 {
-                    columns[columnName].process(&val, 1);
+                    if (nargs == 1) {
+                        columns[columnName].process(&val, 1);
+                    }
+                    else {
+                        columnArgs[0] = val;
+                        columns[columnName].process(columnArgs.data(), nargs);
+                    }
                     return true;
                 };
 
@@ -212,7 +228,7 @@ struct AggregatorT {
 
         void process(const ExpressionValue * args, size_t nargs)
         {
-            checkArgsSize(nargs, 1);
+            checkArgsSize(nargs, State::nargs, State::maxArgs);
 
             if (fallback.get()) {
                 fallback->process(args, nargs);
@@ -234,6 +250,11 @@ struct AggregatorT {
             // we need to pessimize.
             StructValue skipped;
 
+            // Any arguments after the row are passed as-is with each column
+            std::vector<ExpressionValue> columnArgs;
+            if (nargs > 1)
+                columnArgs.assign(args, args + nargs);
+
             auto onColumn = [&] (const PathElement & columnName,
                                  const ExpressionValue & val)
                 {
@@ -245,7 +266,13 @@ struct AggregatorT {
                     else {
                         // Names and number of columns matches.  We can go ahead
                         // and process everything on the fast path.
-                        columnState[n].process(&val, 1);
+                        if (nargs == 1) {
+                            columnState[n].process(&val, 1);
+                        }
+                        else {
+                            columnArgs[0] = val;
+                            columnState[n].process(columnArgs.data(), nargs);
+                        }
                     }
                     ++n;
                     return true;
@@ -264,6 +291,7 @@ struct AggregatorT {
             // need to be processed are in skipped).  Here we pessimize, and
             // then pass in a new value with just the unprocessed ones in it.
             vector<ExpressionValue> newArgs{ std::move(skipped) };
+            newArgs.insert(newArgs.end(), args + 1, args + nargs);
 
             fallback->process(newArgs.data(), newArgs.size());
         }
@@ -366,7 +394,7 @@ struct AggregatorT {
         // b) what is the best way to implement the query
         // First output: information about the row
         // Second output: is it dense (in other words, all rows are the same)?
-        checkArgsSize(args.size(), 1, name);
+        checkArgsSize(args.size(), State::nargs, State::maxArgs, name);
         ExcAssert(args[0].info);
 
         // Create a value info object for the output.  It has the same
@@ -449,7 +477,7 @@ struct AggregatorT {
 
         if (!state->isDetermined) {
             state->isDetermined = true;
-            checkArgsSize(nargs, 1);
+            checkArgsSize(nargs, State::nargs, State::maxArgs);
             state->isRow = args[0].isRow();
         }
 
@@ -1119,6 +1147,573 @@ struct StdDevAccum : public VarAccum {
 static RegisterAggregatorT<VarAccum> registerVarAgg("variance", "vertical_variance");
 static RegisterAggregatorT<StdDevAccum> registerStdDevAgg("stddev", "vertical_stddev");
 
+/** Approximate count of distinct values using HyperLogLog.  While there
+    are few distinct values their hashes are kept exactly, as in HLL++, so
+    small counts are exact.  Once there are more than maxSparse of them
+    they are folded into 2^precision registers of a byte each, which
+    bounds the memory used per group to 16kb with a standard error of
+    about 0.8%.
+*/
+struct ApproxDistinctAccum {
+    static constexpr int nargs = 1;
+    static constexpr int maxArgs = nargs;
+    static constexpr int precision = 14;
+    static constexpr size_t numRegisters = 1 << precision;
+    static constexpr size_t maxSparse = numRegisters / 16;
+
+    ApproxDistinctAccum()
+        : ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<IntegerValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 1);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        insert(val.getAtom().fastHash());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    void insert(uint64_t hash)
+    {
+        if (!registers.empty()) {
+            insertDense(hash);
+            return;
+        }
+
+        auto it = std::lower_bound(hashes.begin(), hashes.end(), hash);
+        if (it != hashes.end() && *it == hash)
+            return;
+        hashes.insert(it, hash);
+
+        if (hashes.size() > maxSparse)
+            densify();
+    }
+
+    void insertDense(uint64_t hash)
+    {
+        size_t index = hash >> (64 - precision);
+        uint64_t rest = hash << precision;
+        uint8_t rank = rest == 0
+            ? 64 - precision + 1
+            : __builtin_clzll(rest) + 1;
+        registers[index] = std::max(registers[index], rank);
+    }
+
+    void densify()
+    {
+        registers.resize(size_t(numRegisters), 0);
+        for (uint64_t h: hashes)
+            insertDense(h);
+        hashes.clear();
+        hashes.shrink_to_fit();
+    }
+
+    ExpressionValue extract()
+    {
+        if (registers.empty())
+            return ExpressionValue(hashes.size(), ts);
+
+        double m = numRegisters;
+        double alpha = 0.7213 / (1.0 + 1.079 / m);
+        double sum = 0.0;
+        size_t numZero = 0;
+        for (uint8_t r: registers) {
+            sum += std::ldexp(1.0, -r);
+            numZero += (r == 0);
+        }
+
+        double estimate = alpha * m * m / sum;
+
+        // Small range correction: linear counting is more accurate
+        if (estimate <= 2.5 * m && numZero != 0)
+            estimate = m * std::log(m / numZero);
+
+        return ExpressionValue((uint64_t)std::llround(estimate), ts);
+    }
+
+    void merge(ApproxDistinctAccum * src)
+    {
+        if (!src->registers.empty()) {
+            if (registers.empty())
+                densify();
+            for (size_t i = 0;  i < numRegisters;  ++i)
+                registers[i] = std::max(registers[i], src->registers[i]);
+        }
+        else {
+            for (uint64_t h: src->hashes)
+                insert(h);
+        }
+        ts.setMax(src->ts);
+    }
+
+    std::vector<uint64_t> hashes;    ///< Sorted distinct hashes, when sparse
+    std::vector<uint8_t> registers;  ///< HyperLogLog registers, when dense
+    Date ts;
+};
+
+static RegisterAggregatorT<ApproxDistinctAccum>
+registerApproxDistinct("approx_count_distinct",
+                       "vertical_approx_count_distinct");
+
+/** Approximate quantiles using a merging t-digest (see t_digest.h).  The
+    second argument is the quantile to return, divided by Scale (so
+    approx_percentile takes a percentage).
+*/
+template<int Scale>
+struct ApproxQuantileAccum {
+    static constexpr int nargs = 2;
+    static constexpr int maxArgs = nargs;
+
+    ApproxQuantileAccum()
+        : quantile(-1), ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<Float64ValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 2);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        if (quantile < 0) {
+            quantile = args[1].toDouble() / Scale;
+            if (!(quantile >= 0.0 && quantile <= 1.0))
+                throw HttpReturnException
+                    (400, "quantile must be between 0 and "
+                     + std::to_string(Scale),
+                     "quantile", args[1]);
+        }
+
+        double d = val.toDouble();
+        if (std::isnan(d))
+            return;
+
+        digest.add(d);
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract()
+    {
+        if (digest.empty())
+            return ExpressionValue::null(ts);
+        digest.compress();
+        return ExpressionValue(digest.quantile(quantile), ts);
+    }
+
+    void merge(ApproxQuantileAccum * src)
+    {
+        if (quantile < 0)
+            quantile = src->quantile;
+        digest.merge(src->digest);
+        ts.setMax(src->ts);
+    }
+
+    double quantile;   ///< Quantile to extract, or -1 if not yet known
+    TDigest digest;
+    Date ts;
+};
+
+static RegisterAggregatorT<ApproxQuantileAccum<1> >
+registerApproxQuantile("approx_quantile", "vertical_approx_quantile");
+static RegisterAggregatorT<ApproxQuantileAccum<100> >
+registerApproxPercentile("approx_percentile", "vertical_approx_percentile");
+
+/** Approximate most frequent values using the space-saving algorithm.  It
+    keeps counters for a fixed number of values; a value without a counter
+    takes over the one with the lowest count, and inherits its count as a
+    bound on its error.  The second argument is how many values to return
+    (10 by default), as a row of value to estimated count.
+*/
+struct TopKAccum {
+    static constexpr int nargs = 1;
+    static constexpr int maxArgs = 2;
+
+    /// How many more counters than values returned are kept, with a
+    /// minimum so that small values of k are still accurate
+    static constexpr size_t countersPerValue = 4;
+    static constexpr size_t minCounters = 100;
+
+    TopKAccum()
+        : k(0), ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<RowValueInfo>(std::vector<KnownColumn>(),
+                                              SCHEMA_OPEN);
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 1, 2);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        if (k == 0) {
+            int64_t requested = nargs > 1 ? args[1].toInt() : 10;
+            if (requested < 1)
+                throw HttpReturnException
+                    (400, "topk needs to return at least one value",
+                     "k", args[1]);
+            k = requested;
+        }
+
+        add(val.getAtom(), 1);
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    size_t capacity() const
+    {
+        return std::max<size_t>(k * countersPerValue, size_t(minCounters));
+    }
+
+    void add(const CellValue & value, uint64_t count)
+    {
+        auto it = counts.find(value);
+        if (it != counts.end()) {
+            it->second += count;
+            return;
+        }
+
+        if (counts.size() < capacity()) {
+            counts.emplace(value, count);
+            return;
+        }
+
+        auto smallest = counts.begin();
+        for (auto it = counts.begin();  it != counts.end();  ++it) {
+            if (it->second < smallest->second)
+                smallest = it;
+        }
+        uint64_t inherited = smallest->second;
+        counts.erase(smallest);
+        counts.emplace(value, inherited + count);
+    }
+
+    /// Sorted by decreasing count, then by value
+    std::vector<std::pair<CellValue, uint64_t> > sorted() const
+    {
+        std::vector<std::pair<CellValue, uint64_t> >
+            result(counts.begin(), counts.end());
+        std::sort(result.begin(), result.end(),
+                  [] (const std::pair<CellValue, uint64_t> & p1,
+                      const std::pair<CellValue, uint64_t> & p2)
+                  {
+                      return p1.second > p2.second
+                          || (p1.second == p2.second && p1.first < p2.first);
+                  });
+        return result;
+    }
+
+    ExpressionValue extract()
+    {
+        auto values = sorted();
+        if (values.size() > k)
+            values.resize(k);
+
+        StructValue result;
+        for (auto & v: values) {
+            result.emplace_back(PathElement(v.first.toUtf8String()),
+                                ExpressionValue(v.second, ts));
+        }
+        return ExpressionValue(std::move(result));
+    }
+
+    void merge(TopKAccum * src)
+    {
+        if (k == 0)
+            k = src->k;
+
+        // An absent value may have been seen as many times as the smallest
+        // counter of a full summary
+        auto smallest = [] (const TopKAccum & accum) -> uint64_t
+            {
+                if (accum.counts.size() < accum.capacity())
+                    return 0;
+                uint64_t result = -1;
+                for (auto & c: accum.counts)
+                    result = std::min(result, c.second);
+                return result;
+            };
+
+        uint64_t smallestHere = smallest(*this);
+        uint64_t smallestThere = smallest(*src);
+
+        std::unordered_map<CellValue, uint64_t> merged;
+        for (auto & c: counts) {
+            auto it = src->counts.find(c.first);
+            merged[c.first] = c.second
+                + (it == src->counts.end() ? smallestThere : it->second);
+        }
+        for (auto & c: src->counts) {
+            if (!counts.count(c.first))
+                merged[c.first] = c.second + smallestHere;
+        }
+
+        counts = std::move(merged);
+
+        if (counts.size() > capacity()) {
+            auto values = sorted();
+            values.resize(capacity());
+            counts = std::unordered_map<CellValue, uint64_t>
+                (values.begin(), values.end());
+        }
+
+        ts.setMax(src->ts);
+    }
+
+    size_t k;   ///< Number of values to return, or 0 if not yet known
+    std::unordered_map<CellValue, uint64_t> counts;
+    Date ts;
+};
+
+static RegisterAggregatorT<TopKAccum> registerTopK("topk", "vertical_topk");
+
+/** Estimates over all of the rows of a table from a sample of them, as
+    made by TABLESAMPLE or sample(), with a confidence interval around them.
+    The result is a row {estimate, lower, upper}.  The sampled fraction
+    comes from the scope that the aggregator is bound in; over a table
+    that isn't sampled, the estimate is exact and so are the bounds.  The
+    optional second argument is the confidence level of the interval,
+    0.95 by default.
+
+    The sample is treated as a simple random sample of the rows.  The
+    interval for a count is the Clopper-Pearson one on the proportion of
+    the sampled rows that are counted; those for sums and averages use the
+    normal approximation with the finite population correction, and are
+    null with fewer than two values to estimate the variance from.
+*/
+enum EstimateKind {
+    ESTIMATE_COUNT,   ///< estimate_count: number of non-null values
+    ESTIMATE_SUM,     ///< estimate_sum: sum of the values
+    ESTIMATE_AVG      ///< estimate_avg: average of the non-null values
+};
+
+struct EstimateAccum {
+    EstimateAccum()
+        : n(0), sum(0.0), sumSquares(0.0), confidence(-1),
+          ts(Date::negativeInfinity())
+    {
+    }
+
+    void process(const ExpressionValue * args, size_t nargs, bool numeric)
+    {
+        if (confidence < 0) {
+            confidence = nargs > 1 ? args[1].toDouble() : 0.95;
+            if (!(confidence > 0.0 && confidence < 1.0))
+                throw HttpReturnException
+                    (400, "confidence must be between 0 and 1",
+                     "confidence", args[1]);
+        }
+
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        if (numeric) {
+            double d = val.toDouble();
+            if (std::isnan(d))
+                return;
+            sum += d;
+            sumSquares += d * d;
+        }
+
+        n += 1;
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract(EstimateKind kind, const TableSample & sample)
+    {
+        double estimate;
+        switch (kind) {
+        case ESTIMATE_COUNT:  estimate = n;  break;
+        case ESTIMATE_SUM:    estimate = sum;  break;
+        case ESTIMATE_AVG:
+            if (n == 0)
+                return ExpressionValue::null(ts);
+            estimate = sum / n;
+            break;
+        default:
+            throw HttpReturnException(500, "Unknown kind of estimate");
+        }
+
+        double fraction = sample.fraction;
+        if (fraction >= 1.0 || sample.rows == 0)
+            return result(estimate, estimate, estimate);
+
+        ConfidenceIntervals intervals(1.0 - (confidence < 0 ? 0.95 : confidence));
+
+        // Number of rows of the whole table, and the correction for the
+        // variance of sampling without replacement
+        double numRows = sample.rows / fraction;
+        double correction = 1.0 - fraction;
+
+        auto variance = [] (double sum, double sumSquares, double count)
+            {
+                return std::max(0.0, (sumSquares - sum * sum / count)
+                                / (count - 1));
+            };
+
+        switch (kind) {
+        case ESTIMATE_COUNT: {
+            uint64_t counted = std::min<uint64_t>(n, sample.rows);
+            std::pair<double, double> bounds;
+            if (sample.rows <= std::numeric_limits<int>::max()) {
+                bounds = intervals.binomialTwoSidedBound(sample.rows, counted);
+            }
+            else {
+                // Too many rows for the exact interval, which is then
+                // indistinguishable from the normal one
+                double p = 1.0 * counted / sample.rows;
+                bounds = intervals.normalTwoSidedBound
+                    (p, sqrt(p * (1.0 - p) / sample.rows));
+            }
+            return result(n / fraction, bounds.first * numRows,
+                          bounds.second * numRows);
+        }
+        case ESTIMATE_SUM: {
+            // Rows outside of the group, or with a null, are zeros of the
+            // mean over all of the sampled rows
+            if (sample.rows < 2)
+                break;
+            double standardError = numRows
+                * sqrt(correction * variance(sum, sumSquares, sample.rows)
+                       / sample.rows);
+            auto bounds = intervals.normalTwoSidedBound(sum / fraction,
+                                                        standardError);
+            return result(sum / fraction, bounds.first, bounds.second);
+        }
+        case ESTIMATE_AVG: {
+            if (n < 2)
+                break;
+            double standardError
+                = sqrt(correction * variance(sum, sumSquares, n) / n);
+            auto bounds = intervals.normalTwoSidedBound(estimate, standardError);
+            return result(estimate, bounds.first, bounds.second);
+        }
+        }
+
+        if (kind == ESTIMATE_SUM)
+            estimate /= fraction;
+        return result(estimate, ExpressionValue::null(ts),
+                      ExpressionValue::null(ts));
+    }
+
+    ExpressionValue result(double estimate, double lower, double upper) const
+    {
+        return result(estimate, ExpressionValue(lower, ts),
+                      ExpressionValue(upper, ts));
+    }
+
+    ExpressionValue result(double estimate, ExpressionValue lower,
+                           ExpressionValue upper) const
+    {
+        StructValue result;
+        result.emplace_back(PathElement("estimate"),
+                            ExpressionValue(estimate, ts));
+        result.emplace_back(PathElement("lower"), std::move(lower));
+        result.emplace_back(PathElement("upper"), std::move(upper));
+        return ExpressionValue(std::move(result));
+    }
+
+    void merge(EstimateAccum * src)
+    {
+        if (confidence < 0)
+            confidence = src->confidence;
+        n += src->n;
+        sum += src->sum;
+        sumSquares += src->sumSquares;
+        ts.setMax(src->ts);
+    }
+
+    uint64_t n;           ///< Number of non-null values
+    double sum;           ///< Sum of the values, for sums and averages
+    double sumSquares;    ///< Sum of their squares, for the variance
+    double confidence;    ///< Confidence level, or -1 if not yet known
+    Date ts;
+};
+
+BoundAggregator estimate(EstimateKind kind,
+                         const Utf8String & name,
+                         const std::vector<BoundSqlExpression> & args,
+                         SqlBindingScope & scope)
+{
+    checkArgsSize(args.size(), 1, 2, name);
+
+    TableSample sample = scope.doGetTableSample();
+    bool numeric = kind != ESTIMATE_COUNT;
+
+    auto init = [] () -> std::shared_ptr<void>
+        {
+            return std::make_shared<EstimateAccum>();
+        };
+
+    auto process = [numeric] (const ExpressionValue * args,
+                              size_t nargs,
+                              void * data)
+        {
+            static_cast<EstimateAccum *>(data)->process(args, nargs, numeric);
+        };
+
+    auto extract = [kind, sample] (void * data) -> ExpressionValue
+        {
+            return static_cast<EstimateAccum *>(data)->extract(kind, sample);
+        };
+
+    auto merge = [] (void * data, void * src)
+        {
+            static_cast<EstimateAccum *>(data)
+                ->merge(static_cast<EstimateAccum *>(src));
+        };
+
+    auto bound = std::make_shared<Float64ValueInfo>();
+    std::vector<KnownColumn> columns = {
+        { PathElement("estimate"), bound, COLUMN_IS_DENSE },
+        { PathElement("lower"), bound, COLUMN_IS_DENSE },
+        { PathElement("upper"), bound, COLUMN_IS_DENSE }
+    };
+
+    return { init, process, extract, merge,
+             std::make_shared<RowValueInfo>(std::move(columns),
+                                            SCHEMA_CLOSED) };
+}
+
+template<EstimateKind Kind>
+BoundAggregator estimateEntry(const Utf8String & name,
+                              const std::vector<BoundSqlExpression> & args,
+                              SqlBindingScope & scope)
+{
+    return estimate(Kind, name, args, scope);
+}
+
+static auto registerEstimateCount
+    = registerAggregator("estimate_count", estimateEntry<ESTIMATE_COUNT>);
+static auto registerEstimateSum
+    = registerAggregator("estimate_sum", estimateEntry<ESTIMATE_SUM>);
+static auto registerEstimateAvg
+    = registerAggregator("estimate_avg", estimateEntry<ESTIMATE_AVG>);
+
+
 
 } // namespace Builtins
 } // namespace MLDB
@@ -20,6 +20,7 @@
 #include "mldb/base/parse_context.h"
 #include "mldb/sql/join_utils.h"
 #include "mldb/sql/binding_contexts.h"
+#include "mldb/sql/dense_embedding.h"
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/clamp.hpp>
 #include "mldb/ext/edlib/edlib/include/edlib.h"
@@ -59,6 +60,10 @@ namespace Builtins {
 
 typedef CellValue (*UnaryScalarFunction) (const CellValue & arg);
 
+/// Purely numeric version of a unary scalar function, used to provide a
+/// vectorized implementation.
+typedef double (*UnaryNumericFunction) (double arg);
+
 /// Register a builtin function that operates on unary scalars with a
 /// signature (Atom) -> Atom, to work on scalars, rows or
 /// embeddings.
@@ -68,6 +73,17 @@ struct RegisterBuiltinUnaryScalar {
     RegisterBuiltinUnaryScalar(const UnaryScalarFunction & function,
                                std::shared_ptr<ExpressionValueInfo> info,
                                Names&&... names)
+        : numericFunction(nullptr)
+    {
+        doRegister(function, std::move(info), std::forward<Names>(names)...);
+    }
+
+    template<typename... Names>
+    RegisterBuiltinUnaryScalar(const UnaryScalarFunction & function,
+                               UnaryNumericFunction numericFunction,
+                               std::shared_ptr<ExpressionValueInfo> info,
+                               Names&&... names)
+        : numericFunction(numericFunction)
     {
         doRegister(function, std::move(info), std::forward<Names>(names)...);
     }
@@ -167,11 +183,30 @@ struct RegisterBuiltinUnaryScalar {
     static BoundFunction
     bindScalar(const Utf8String & functionName,
                UnaryScalarFunction fn,
+               UnaryNumericFunction numeric,
                std::shared_ptr<ExpressionValueInfo> info,
                const std::vector<BoundSqlExpression> & args,
                const SqlBindingScope & scope)
     {
-        return wrap(functionName, fn, std::move(info), applyScalar);
+        BoundFunction result
+            = wrap(functionName, fn, std::move(info), applyScalar);
+        if (numeric)
+            result.batchExec = [=] (const std::vector<const SqlBatchValues *> & args,
+                                    size_t numRows,
+                                    SqlBatchValues & output)
+                {
+                    const SqlBatchValues & arg = *args.at(0);
+                    for (size_t i = 0;  i < numRows;  ++i) {
+                        // Adding 0.0 turns -0.0 into 0.0, like CellValue does
+                        double v = numeric(arg.values[i]) + 0.0;
+                        uint8_t state = arg.states[i];
+                        if (state == SqlBatchValues::VALUE && std::isnan(v))
+                            state = SqlBatchValues::SCALAR;
+                        output.values[i] = v;
+                        output.states[i] = state;
+                    }
+                };
+        return result;
     }
 
     static BoundFunction
@@ -221,6 +256,7 @@ struct RegisterBuiltinUnaryScalar {
                     std::string name,
                     Names&&... names)
     {
+        UnaryNumericFunction numeric = numericFunction;
         auto fn = [=] (const Utf8String & functionName,
                        const std::vector<BoundSqlExpression> & args,
                        SqlBindingScope & scope)
@@ -229,7 +265,7 @@ struct RegisterBuiltinUnaryScalar {
                 try {
                     checkArgsSize(args.size(), 1);
                     if (args[0].info->isScalar())
-                        return bindScalar(functionName, function,
+                        return bindScalar(functionName, function, numeric,
                                           std::move(info), args,
                                           scope);
                     else if (args[0].info->isEmbedding()) {
@@ -261,6 +297,7 @@ struct RegisterBuiltinUnaryScalar {
         doRegister(function, std::forward<Names>(names)...);
     }
 
+    UnaryNumericFunction numericFunction;
     std::vector<std::shared_ptr<void> > handles;
 };
 
@@ -281,7 +318,7 @@ struct RegisterBuiltinUnaryNumericScalar: public RegisterBuiltinUnaryScalar {
 
     template<typename... Names>
     RegisterBuiltinUnaryNumericScalar(Names&&... names)
-        : RegisterBuiltinUnaryScalar(&call,
+        : RegisterBuiltinUnaryScalar(&call, &Op::call,
                                      std::make_shared<Float64ValueInfo>(),
                                      std::forward<Names>(names)...)
     {
@@ -1593,12 +1630,17 @@ void normalize(distribution<double>& val, double p)
              return {[=] (const std::vector<ExpressionValue> & args,
                           const SqlRowScope & scope) -> ExpressionValue
                      {
-                         // Get it as an embedding
-                         distribution<double> val
-                             = args.at(0).getEmbeddingDouble();
                          Date ts = args.at(0).getEffectiveTimestamp();
                          double p = args.at(1).toDouble();
 
+                         // Get it as an embedding, copying dense ones
+                         // straight from their storage
+                         DenseEmbedding dense;
+                         distribution<double> val
+                             = dense.bind(args.at(0))
+                             ? dense.toDoubles<distribution<double> >()
+                             : args.at(0).getEmbeddingDouble();
+
                          normalize(val, p);
 
                          ExpressionValue result(std::move(val),
@@ -1661,12 +1703,25 @@ BoundFunction norm(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
-                // Get it as an embedding
-                distribution<double> val = args[0].getEmbeddingDouble();
                 Date ts = args[0].getEffectiveTimestamp();
-
                 double p = args[1].toDouble();
 
+                DenseEmbedding dense;
+                if (dense.bind(args[0])) {
+                    if (p == 0.0)
+                        return ExpressionValue(dense.countNonZero(), ts);
+                    else if (p == INFINITY)
+                        return ExpressionValue(dense.max(), ts);
+                    else if (p == 1)
+                        return ExpressionValue(dense.sum(), ts);
+                    else if (p == 2)
+                        return ExpressionValue(std::sqrt(dense.sumSquares()),
+                                               ts);
+                }
+
+                // Get it as an embedding
+                distribution<double> val = args[0].getEmbeddingDouble();
+
                 if (p == 0.0) {
                     return ExpressionValue((val != 0.0).count(), ts);
                 }
@@ -1829,34 +1884,28 @@ BoundFunction tokenize(const std::vector<BoundSqlExpression> & args)
                     options = args[1].extractT<TokenizeOptions>();
                 }
 
-                ParseContext pcontext(text.rawData(), text.rawData(), text.rawLength());
+                // Each distinct token becomes a column, made straight from
+                // its bytes
+                StructValue row;
 
-                std::unordered_map<Utf8String, int> bagOfWords;
-
-                tokenize(bagOfWords, pcontext, options);
-
-                RowValue row;
-                row.reserve(bagOfWords.size());
-
-                auto it = bagOfWords.begin();
-
-                while (it != bagOfWords.end()) {
-                    if (!options.value.empty()) {
-                        row.emplace_back(ColumnPath(it->first),
-                                         options.value,
-                                         ts);
-                        ++it;
-                    }
-                    else
+                auto onToken = [&] (const char * token, size_t len, int count)
                     {
-                        row.emplace_back(ColumnPath(it->first),
-                                         it->second,
-                                         ts);
-                        ++it;
-                    }
-                }
+                        if (!options.value.empty()) {
+                            row.emplace_back(PathElement(token, len),
+                                             ExpressionValue(options.value, ts));
+                        }
+                        else {
+                            row.emplace_back(PathElement(token, len),
+                                             ExpressionValue(count, ts));
+                        }
+                    };
+
+                tokenize_count(text.rawData(), text.rawLength(), options,
+                               onToken);
 
-                return ExpressionValue(std::move(row));
+                return ExpressionValue(std::move(row),
+                                       ExpressionValue::NOT_SORTED,
+                                       ExpressionValue::NO_DUPLICATES);
             },
             std::make_shared<UnknownRowValueInfo>()};
 }
@@ -1886,7 +1935,8 @@ BoundFunction token_extract(const std::vector<BoundSqlExpression> & args)
                     options = args[2].extractT<TokenizeOptions>();
                 }
                 
-                ParseContext pcontext(text.rawData(), text.rawData(), text.rawLength());
+                ParseContext pcontext("token_extract", text.rawData(),
+                                      text.rawLength());
 
                 ExpressionValue result;
 
@@ -1911,6 +1961,11 @@ BoundFunction horizontal_count(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
+                DenseEmbedding dense;
+                if (dense.bind(args.at(0)))
+                    return ExpressionValue(dense.length,
+                                           args[0].getEffectiveTimestamp());
+
                 size_t result = 0;
                 Date ts = Date::negativeInfinity();
 
@@ -1941,6 +1996,11 @@ BoundFunction horizontal_sum(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
+                DenseEmbedding dense;
+                if (dense.bind(args.at(0)))
+                    return ExpressionValue(dense.sum(),
+                                           args[0].getEffectiveTimestamp());
+
                 double result = 0;
                 Date ts = Date::negativeInfinity();
                 auto onAtom = [&] (const Path & columnName,
@@ -2010,6 +2070,11 @@ BoundFunction horizontal_avg(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
+                DenseEmbedding dense;
+                if (dense.bind(args.at(0)))
+                    return ExpressionValue(dense.sum() / dense.length,
+                                           args[0].getEffectiveTimestamp());
+
                 int64_t num_cols = 0;
                 double accum = 0;
                 Date ts = Date::negativeInfinity();
@@ -2045,6 +2110,13 @@ BoundFunction horizontal_min(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
+                // NaN elements are ordered as CellValues, so they go the
+                // long way
+                DenseEmbedding dense;
+                if (dense.bind(args.at(0)) && !dense.hasNaN())
+                    return ExpressionValue(dense.min(),
+                                           args[0].getEffectiveTimestamp());
+
                 CellValue min_val;
                 Date ts = Date::negativeInfinity();
 
@@ -2077,6 +2149,13 @@ BoundFunction horizontal_max(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
+                // NaN elements are ordered as CellValues, so they go the
+                // long way
+                DenseEmbedding dense;
+                if (dense.bind(args.at(0)) && !dense.hasNaN())
+                    return ExpressionValue(dense.max(),
+                                           args[0].getEffectiveTimestamp());
+
                 CellValue max_val;
                 Date ts = Date::negativeInfinity();
 
@@ -2227,6 +2306,21 @@ struct RegisterVectorOp {
                      const SqlRowScope & scope) -> ExpressionValue
                 {
                     checkArgsSize(args.size(), 2);
+
+                    // Dense embeddings of the same length don't need
+                    // their elements to be matched up by name
+                    DenseEmbedding dense1, dense2;
+                    if (dense1.bind(args[0]) && dense2.bind(args[1])
+                        && dense1.length == dense2.length) {
+                        auto d1 = dense1.toDoubles<distribution<double> >();
+                        auto d2 = dense2.toDoubles<distribution<double> >();
+                        return ExpressionValue
+                            (Op::apply(d1, d2),
+                             std::min(args[0].getEffectiveTimestamp(),
+                                      args[1].getEffectiveTimestamp()),
+                             args[0].getEmbeddingShape());
+                    }
+
                     distribution<double> embedding1, embedding2;
                     std::shared_ptr<const void> token;
                     Date ts;
@@ -98,6 +98,15 @@ unpackJson(RowValue & row,
            const Json::Value & val,
            const Date & ts);
 
+// https://en.wikipedia.org/w/index.php?title=Earth_radius&action=edit&section=16
+static constexpr double EARTH_MEAN_RADIUS_METERS = 6371008.8;
+
+/** Distance in meters between two points given by their latitude and
+    longitude in degrees, as calculated by geo_distance().  Spatial indexes
+    use it so that they match exactly the same points.
+*/
+double geoDistance(double lat1, double lon1, double lat2, double lon2);
+
 typedef BoundFunction (*BuiltinFunction) (const std::vector<BoundSqlExpression> &);
 
 struct RegisterBuiltin {
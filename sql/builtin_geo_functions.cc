@@ -24,9 +24,15 @@ namespace Builtins {
 
 static constexpr double EARTH_EQUATORIAL_RADIUS_METERS = 6378137.0;
 static constexpr double EARTH_POLAR_RADIUS_METERS      = 6356752.3;
+// EARTH_MEAN_RADIUS_METERS, which geo_distance() uses, is in builtin_functions.h
 
-// https://en.wikipedia.org/w/index.php?title=Earth_radius&action=edit&section=16
-static constexpr double EARTH_MEAN_RADIUS_METERS       = 6371008.8;
+double geoDistance(double lat1, double lon1, double lat2, double lon2)
+{
+    S2LatLng point1 = S2LatLng::FromDegrees(lat1, lon1).Normalized();
+    S2LatLng point2 = S2LatLng::FromDegrees(lat2, lon2).Normalized();
+
+    return point1.GetDistance(point2).radians() * EARTH_MEAN_RADIUS_METERS;
+}
 
 BoundFunction geo_distance(const std::vector<BoundSqlExpression> & args)
 {
@@ -51,13 +57,7 @@ BoundFunction geo_distance(const std::vector<BoundSqlExpression> & args)
                 double lat2 = args[2].getAtom().toDouble();
                 double lon2 = args[3].getAtom().toDouble();
 
-                S2LatLng point1 = S2LatLng::FromDegrees(lat1, lon1).Normalized();
-                S2LatLng point2 = S2LatLng::FromDegrees(lat2, lon2).Normalized();
-                
-                double dist = point1.GetDistance(point2).radians()
-                    * EARTH_MEAN_RADIUS_METERS;
-                
-                return ExpressionValue(dist, ts);
+                return ExpressionValue(geoDistance(lat1, lon1, lat2, lon2), ts);
             },
             outputInfo
             };
@@ -13,6 +13,8 @@
 #include "mldb/utils/possibly_dynamic_buffer.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/arch/simd_vector.h"
+#include <map>
+#include <memory>
 
 using namespace std;
 
@@ -21,13 +23,81 @@ using namespace std;
 namespace MLDB {
 namespace Builtins {
 
+namespace {
+
+/// Most FFT setups kept by each thread
+constexpr size_t MAX_CACHED_FFT_SETUPS = 16;
+
+/** Per-thread cache of the FFT setups and of the aligned work buffer that
+    the transform needs, so that applying fft() to each row of a query
+    doesn't pay for creating a setup or allocating.
+*/
+struct FftThreadCache {
+    struct DestroySetup {
+        void operator () (PFFFT_Setup * setup) const
+        {
+            pffft_destroy_setup(setup);
+        }
+    };
+
+    struct FreeAligned {
+        void operator () (float * p) const
+        {
+            pffft_aligned_free(p);
+        }
+    };
+
+    std::map<std::pair<size_t, pffft_transform_t>,
+             std::unique_ptr<PFFFT_Setup, DestroySetup> > setups;
+    std::unique_ptr<float, FreeAligned> work;
+    size_t workSize = 0;
+
+    /// Return the setup for the given size and type, or null if pffft
+    /// doesn't support it
+    PFFFT_Setup * getSetup(size_t n, pffft_transform_t type)
+    {
+        auto it = setups.find({n, type});
+        if (it != setups.end())
+            return it->second.get();
+
+        std::unique_ptr<PFFFT_Setup, DestroySetup>
+            setup(pffft_new_setup(n, type));
+        if (!setup)
+            return nullptr;
+        if (setups.size() >= MAX_CACHED_FFT_SETUPS)
+            setups.clear();
+        return setups.emplace(std::make_pair(n, type), std::move(setup))
+            .first->second.get();
+    }
+
+    /// Return an aligned work buffer of at least the given number of floats
+    float * getWork(size_t size)
+    {
+        if (size > workSize) {
+            work.reset((float *)pffft_aligned_malloc(size * sizeof(float)));
+            if (!work) {
+                workSize = 0;
+                throw std::bad_alloc();
+            }
+            workSize = size;
+        }
+        return work.get();
+    }
+};
+
+thread_local FftThreadCache fftCache;
+
+} // file scope
+
 ExpressionValue fft(const std::vector<ExpressionValue> & args,
                     const SqlRowScope & scope)
 {
     checkArgsSize(args.size(), 1, 3, "fft");
 
-    if (args[0].empty() || args[1].empty()) {
-        return ExpressionValue::null(calcTs(args[0], args[1]));
+    if (args[0].empty() || (args.size() > 1 && args[1].empty())) {
+        return ExpressionValue::null
+            (args.size() > 1 ? calcTs(args[0], args[1])
+                             : args[0].getEffectiveTimestamp());
     }
 
     Utf8String directionStr
@@ -59,17 +129,39 @@ ExpressionValue fft(const std::vector<ExpressionValue> & args,
     //cerr << "fft " << directionStr << " " << typeStr << " " << dimsVector << endl;
 
     // Either an embedding of size n (real numbers), or an embedding of size
-    // n x 2 (complex numbers).
+    // n x 2 (complex numbers).  Either can have an extra leading dimension,
+    // in which case each of its m entries is transformed separately.
+    bool complexInput;
+    size_t batchSize = 1;
+    size_t n;
 
-    if (dimsVector.size() != 1
-        && !(dimsVector.size() == 2 && dimsVector[1] == 2)) {
+    if (dimsVector.size() == 1) {
+        complexInput = false;
+        n = dimsVector[0];
+    }
+    else if (dimsVector.size() == 2 && dimsVector[1] == 2) {
+        complexInput = true;
+        n = dimsVector[0];
+    }
+    else if (dimsVector.size() == 2) {
+        complexInput = false;
+        batchSize = dimsVector[0];
+        n = dimsVector[1];
+    }
+    else if (dimsVector.size() == 3 && dimsVector[2] == 2) {
+        complexInput = true;
+        batchSize = dimsVector[0];
+        n = dimsVector[1];
+    }
+    else {
         throw HttpReturnException(400, "FFT requires either a flat embedding "
                                   "for real numbers, or a nx2 embedding for "
-                                  "complex numbers.");
+                                  "complex numbers, optionally with a leading "
+                                  "dimension to transform several at once.");
     }
 
-    size_t nel = std::accumulate(dimsVector.begin(), dimsVector.end(), (size_t)1,
-                                 std::multiplies<size_t>());
+    // Number of floats in each of the transforms
+    size_t nel = complexInput ? n * 2 : n;
     
     if (nel % 32 != 0) {
         // Comments from pffft.c:
@@ -82,9 +174,9 @@ ExpressionValue fft(const std::vector<ExpressionValue> & args,
         throw HttpReturnException(400, "FFT size must be a multiple of 32");
     }
 
-    size_t n = dimsVector[0];
+    DimsVector newShape;
 
-    if (dimsVector.size() == 1) {
+    if (!complexInput) {
         // Real valued input
         // This gives a complex output that is symmetrical about the mid
         // point of the range
@@ -94,44 +186,15 @@ ExpressionValue fft(const std::vector<ExpressionValue> & args,
                 (400, "Complex input is required for inverse or complex fft");
         }
 
-        PFFFT_Setup * setup = pffft_new_setup(n, type);
-
-        if (!setup) {
-            throw HttpReturnException(400, "Couldn't setup fft transform for size "
-                                      + to_string(dimsVector[0]));
-        }
-        Scope_Exit(pffft_destroy_setup(setup));
-
-        // Pffft
-        PossiblyDynamicBuffer<float> workspace(n + 3);
-
-        // Get a 16 byte aligned buffer
-        float * tmp = workspace.data();
-        while (((size_t)tmp & 15) != 0)
-            ++tmp;
-
-        std::shared_ptr<float>
-            data((float *)pffft_aligned_malloc(n * 2 * sizeof(float)),
-                 [] (float * p) {pffft_aligned_free(p); });
-    
-        args[0].convertEmbedding(data.get(), n, ST_FLOAT32);
-    
-        pffft_transform_ordered(setup, data.get(), data.get(), tmp,
-                                direction);
-        
         // From pffft.h
         // (for real transforms, both 0-frequency and half frequency
         // components, which are real, are assembled in the first entry as
         // F(0)+i*F(n/2+1). Note that the original fftpack did place
         // F(n/2+1) at the end of the arrays).
-        //data.get()[1] = 0;
 
         // We have two columns: one with the real, the other with the
         // imaginary.
-        DimsVector newShape({n/2, 2});
-        
-        return ExpressionValue::embedding(args[0].getEffectiveTimestamp(),
-                                          data, ST_FLOAT32, newShape);
+        newShape = {n/2, 2};
     }
     else {
         // Complex input, n x 2
@@ -139,65 +202,62 @@ ExpressionValue fft(const std::vector<ExpressionValue> & args,
             n *= 2;   // fft of real n -> n/2 x 2, so ifft of n x 2 -> n*2
         }
 
-        PFFFT_Setup * setup = pffft_new_setup(n, type);
-
-        if (!setup) {
-            throw HttpReturnException(400, "Couldn't setup complex fft transform for size "
-                                      + to_string(n));
+        if (direction == PFFFT_BACKWARD && type == PFFFT_REAL) {
+            newShape = { n };
         }
-        Scope_Exit(pffft_destroy_setup(setup));
+        else {
+            // We have two columns: one with the real, the other with the
+            // imaginary.
+            newShape = {nel / 2, 2};
+        }
+    }
 
-        PossiblyDynamicBuffer<float> workspace((n*2) + 3);
+    if (dimsVector.size() == 3 || (dimsVector.size() == 2 && !complexInput))
+        newShape.insert(newShape.begin(), batchSize);
 
-        // Get a 16 byte aligned buffer
-        float * tmp = workspace.data();
-        while (((size_t)tmp & 15) != 0)
-            ++tmp;
+    PFFFT_Setup * setup = fftCache.getSetup(n, type);
 
-        std::shared_ptr<float>
-            data((float *)pffft_aligned_malloc(nel * sizeof(float)),
-                 [] (float * p) {pffft_aligned_free(p); });
-    
-        args[0].convertEmbedding(data.get(), nel, ST_FLOAT32);
+    if (!setup) {
+        throw HttpReturnException(400, "Couldn't setup fft transform for size "
+                                  + to_string(n));
+    }
+
+    // The work buffer needs as many floats as there are in the transform
+    float * work = fftCache.getWork(nel);
+
+    std::shared_ptr<float>
+        data((float *)pffft_aligned_malloc(batchSize * nel * sizeof(float)),
+             [] (float * p) {pffft_aligned_free(p); });
+    if (!data)
+        throw std::bad_alloc();
     
-        pffft_transform_ordered(setup, data.get(), data.get(), tmp,
-                                direction);
+    args[0].convertEmbedding(data.get(), batchSize * nel, ST_FLOAT32);
 
-        DimsVector newShape;
-        size_t numToScale;
-        if (direction == PFFFT_FORWARD || type == PFFFT_COMPLEX) {
-            // We have two columns: one with the real, the other with the
-            // imaginary.
-            newShape = {n, 2};
-            numToScale = n * 2;
-        }
-        else {
-            newShape = { n };
-            numToScale = n;
-        }
+    // nel is a multiple of 32, so each of the transforms stays aligned
+    for (size_t i = 0;  i < batchSize;  ++i) {
+        float * p = data.get() + i * nel;
+        pffft_transform_ordered(setup, p, p, work, direction);
+    }
 
-        if (direction == PFFFT_BACKWARD) {
-            // The ifft doesn't rescale, so we do so here in order to
-            // ensure that ifft(fft(x)) = x
-            SIMD::vec_scale(data.get(), 1.0 / n, data.get(), numToScale);
-        }
-        
-        return ExpressionValue::embedding(args[0].getEffectiveTimestamp(),
-                                          data, ST_FLOAT32, newShape);
+    if (direction == PFFFT_BACKWARD) {
+        // The ifft doesn't rescale, so we do so here in order to
+        // ensure that ifft(fft(x)) = x
+        SIMD::vec_scale(data.get(), 1.0 / n, data.get(), batchSize * nel);
     }
+
+    return ExpressionValue::embedding(args[0].getEffectiveTimestamp(),
+                                      data, ST_FLOAT32, newShape);
 }
 
 BoundFunction bind_fft(const std::vector<BoundSqlExpression> & args)
 {
     checkArgsSize(args.size(), 1, 3, "fft");
 
-    if (args[0].info->isEmbedding()) {
+    if (args[0].info->isEmbedding()
+        && args[0].info->getEmbeddingShape().size() == 1) {
         auto shape
             = args[0].info->getEmbeddingShape();
 
-        if (shape.size() != 1)
-            throw HttpReturnException(500, "only 1d ffts are supported");
-
         return {
             fft,
             std::make_shared<EmbeddingValueInfo>(shape, ST_FLOAT32)
@@ -7,6 +7,7 @@
 
 #include "cell_value.h"
 #include "mldb/ext/highwayhash.h"
+#include "mldb/ext/xxhash/xxhash.h"
 #include "mldb/utils/json_utils.h"
 #include "mldb/types/dtoa.h"
 #include "mldb/http/http_exception.h"
@@ -198,7 +199,7 @@ initString(const char * stringValue, size_t len, bool isUtf8, bool check)
         void * mem = malloc(sizeof(StringRepr) + strLength + 1);
         longString = new (mem) StringRepr;
         std::copy(s, e, longString->repr);
-        longString->repr[strLength + 1] = 0;
+        longString->repr[strLength] = 0;
     }
 }
 
@@ -227,11 +228,8 @@ CellValue(const CellValue & other)
         || other.type == ST_UTF8_LONG_STRING
         || other.type == ST_LONG_BLOB
         || other.type == ST_LONG_PATH) {
-        void * mem = malloc(sizeof(StringRepr) + other.strLength + 1);
-        longString = new (mem) StringRepr;
-        std::copy(other.longString->repr, other.longString->repr + strLength,
-                  longString->repr);
-        longString->repr[strLength] = 0;
+        // The string is immutable, so we simply share it
+        longString->ref.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
@@ -594,7 +592,7 @@ coerceToTimestamp() const
     if (type == ST_EMPTY)
         return Date::notADate();
     if (isAsciiString()) {
-        return Date::parseIso8601DateTime(toString());
+        return Date::parseIso8601DateTime(stringChars(), toStringLength());
     }
     if (type == ST_TIMESTAMP)
         return *this;
@@ -611,7 +609,7 @@ mustCoerceToTimestamp() const
     if (type == ST_EMPTY)
         return Date::notADate();
     if (isAsciiString()) {
-        return Date::parseIso8601DateTime(toString());
+        return Date::parseIso8601DateTime(stringChars(), toStringLength());
     }
     if (type == ST_TIMESTAMP)
         return toTimestamp();
@@ -854,6 +852,50 @@ hash() const
     }
 }
 
+/// Finalizer of MurmurHash3, which mixes all of the bits of the value
+static inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t
+CellValue::
+fastHash() const
+{
+    // The type is mixed in since values of different types are never equal
+    static constexpr uint64_t typeMultiplier = 0x9e3779b97f4a7c15ULL;
+
+    switch (type) {
+    case ST_ASCII_SHORT_STRING:
+    case ST_UTF8_SHORT_STRING:
+    case ST_SHORT_BLOB:
+    case ST_SHORT_PATH:
+        return XXH64(shortString, strLength, type);
+    case ST_ASCII_LONG_STRING:
+    case ST_UTF8_LONG_STRING:
+    case ST_LONG_BLOB:
+    case ST_LONG_PATH:
+        return XXH64(longString->repr, strLength, type);
+    case ST_FLOAT:
+    case ST_TIMESTAMP: {
+        // -0.0 and 0.0 are equal
+        double d = floatVal == 0.0 ? 0.0 : floatVal;
+        uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        return mix64(bits ^ (type * typeMultiplier));
+    }
+    case ST_TIMEINTERVAL:
+        return mix64(bits1 ^ mix64(bits2 ^ (type * typeMultiplier)));
+    default:
+        return mix64(bits1 ^ (type * typeMultiplier));
+    }
+}
+
 int
 CellValue::
 compare(const CellValue & other) const
@@ -1156,7 +1198,8 @@ void
 CellValue::
 deleteString()
 {
-    if (longString) {
+    if (longString
+        && longString->ref.fetch_sub(1, std::memory_order_acq_rel) == 1) {
         longString->~StringRepr();
         free(longString);
     }
@@ -150,7 +150,7 @@ struct CellValue {
     MLDB_ALWAYS_INLINE ~CellValue()
     {
         if (type == ST_ASCII_LONG_STRING || type == ST_UTF8_LONG_STRING
-            || type == ST_LONG_BLOB)
+            || type == ST_LONG_BLOB || type == ST_LONG_PATH)
             deleteString();
     }
 
@@ -345,12 +345,21 @@ struct CellValue {
     PathElement coerceToPathElement() const;
     Path coerceToPath() const;
     
-    /** This is always the SIPhash of the toString() representation.
-        Only for blobs, which have no toString(), is it calculated
-        on the raw.
+    /** Stable hash of the value, which is the highway hash of its binary
+        representation (or of its path for paths) with a fixed seed.  It
+        doesn't change from one version to the next, and so can be used
+        for row hashes and anything that is persisted.
     */
     CellValueHash hash() const;
 
+    /** Fast hash of the value, for hash tables in memory, which is
+        consistent with operator == but may change from one version to
+        the next.  It mixes the bits of numbers and timestamps directly
+        and uses xxhash for strings, blobs and paths.  This is what
+        std::hash<CellValue> uses.
+    */
+    uint64_t fastHash() const;
+
     operator CellValueHash() const
     {
         return this->hash();
@@ -462,14 +471,19 @@ private:
         ST_LONG_PATH
     };
 
+    /** Storage for long strings, blobs and paths.  It is immutable once
+        constructed and shared between copies of the CellValue, so that
+        copying values out of a frozen column or a row doesn't copy the
+        string.  The last owner frees it.
+    */
     struct StringRepr {
         StringRepr() noexcept
-            : hash(0), ref(0)
+            : hash(0), ref(1)
         {
         }
 
         std::atomic<uint64_t> hash;
-        std::atomic<int> ref;
+        std::atomic<int> ref;   ///< Number of CellValues sharing this
         char repr[0];
     };
 
@@ -551,7 +565,7 @@ template<typename T> struct hash;
 template<>
 struct hash<MLDB::CellValue> : public std::unary_function<MLDB::CellValue, size_t>
 {
-    size_t operator()(const MLDB::CellValue & val) const { return val.hash(); }
+    size_t operator()(const MLDB::CellValue & val) const { return val.fastHash(); }
 };
 
 } // namespace std
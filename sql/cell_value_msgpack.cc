@@ -0,0 +1,687 @@
+/** cell_value_msgpack.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    MessagePack encoding of cell values.
+*/
+
+#include "cell_value_msgpack.h"
+#include "mldb/types/date.h"
+#include "mldb/base/exc_assert.h"
+#include <cmath>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MSGPACK WRITER                                                            */
+/*****************************************************************************/
+
+void
+MsgPackWriter::
+writeBigEndian(uint64_t val, int bytes)
+{
+    for (int i = bytes - 1;  i >= 0;  --i)
+        writeByte((val >> (i * 8)) & 0xff);
+}
+
+void
+MsgPackWriter::
+writeNil()
+{
+    writeByte(0xc0);
+}
+
+void
+MsgPackWriter::
+writeBool(bool val)
+{
+    writeByte(val ? 0xc3 : 0xc2);
+}
+
+void
+MsgPackWriter::
+writeInt(int64_t val)
+{
+    if (val >= 0) {
+        writeUInt(val);
+    }
+    else if (val >= -32) {
+        writeByte((uint8_t)(int8_t)val);  // negative fixint
+    }
+    else if (val >= INT8_MIN) {
+        writeByte(0xd0);
+        writeBigEndian((uint8_t)val, 1);
+    }
+    else if (val >= INT16_MIN) {
+        writeByte(0xd1);
+        writeBigEndian((uint16_t)val, 2);
+    }
+    else if (val >= INT32_MIN) {
+        writeByte(0xd2);
+        writeBigEndian((uint32_t)val, 4);
+    }
+    else {
+        writeByte(0xd3);
+        writeBigEndian((uint64_t)val, 8);
+    }
+}
+
+void
+MsgPackWriter::
+writeUInt(uint64_t val)
+{
+    if (val < 128) {
+        writeByte(val);  // positive fixint
+    }
+    else if (val <= UINT8_MAX) {
+        writeByte(0xcc);
+        writeBigEndian(val, 1);
+    }
+    else if (val <= UINT16_MAX) {
+        writeByte(0xcd);
+        writeBigEndian(val, 2);
+    }
+    else if (val <= UINT32_MAX) {
+        writeByte(0xce);
+        writeBigEndian(val, 4);
+    }
+    else {
+        writeByte(0xcf);
+        writeBigEndian(val, 8);
+    }
+}
+
+void
+MsgPackWriter::
+writeDouble(double val)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &val, sizeof(bits));
+    writeByte(0xcb);
+    writeBigEndian(bits, 8);
+}
+
+void
+MsgPackWriter::
+writeString(const char * str, size_t len)
+{
+    if (len < 32) {
+        writeByte(0xa0 | len);
+    }
+    else if (len <= UINT8_MAX) {
+        writeByte(0xd9);
+        writeBigEndian(len, 1);
+    }
+    else if (len <= UINT16_MAX) {
+        writeByte(0xda);
+        writeBigEndian(len, 2);
+    }
+    else {
+        ExcAssertLessEqual(len, UINT32_MAX);
+        writeByte(0xdb);
+        writeBigEndian(len, 4);
+    }
+    buffer.append(str, len);
+}
+
+void
+MsgPackWriter::
+writeString(const Utf8String & str)
+{
+    writeString(str.rawData(), str.rawLength());
+}
+
+void
+MsgPackWriter::
+writeBinary(const void * data, size_t len)
+{
+    if (len <= UINT8_MAX) {
+        writeByte(0xc4);
+        writeBigEndian(len, 1);
+    }
+    else if (len <= UINT16_MAX) {
+        writeByte(0xc5);
+        writeBigEndian(len, 2);
+    }
+    else {
+        ExcAssertLessEqual(len, UINT32_MAX);
+        writeByte(0xc6);
+        writeBigEndian(len, 4);
+    }
+    buffer.append((const char *)data, len);
+}
+
+void
+MsgPackWriter::
+writeExtHeader(int8_t type, size_t len)
+{
+    switch (len) {
+    case 1:  writeByte(0xd4);  break;
+    case 2:  writeByte(0xd5);  break;
+    case 4:  writeByte(0xd6);  break;
+    case 8:  writeByte(0xd7);  break;
+    case 16: writeByte(0xd8);  break;
+    default:
+        if (len <= UINT8_MAX) {
+            writeByte(0xc7);
+            writeBigEndian(len, 1);
+        }
+        else if (len <= UINT16_MAX) {
+            writeByte(0xc8);
+            writeBigEndian(len, 2);
+        }
+        else {
+            ExcAssertLessEqual(len, UINT32_MAX);
+            writeByte(0xc9);
+            writeBigEndian(len, 4);
+        }
+    }
+    writeByte((uint8_t)type);
+}
+
+void
+MsgPackWriter::
+writeTimestamp(Date ts)
+{
+    double s = ts.secondsSinceEpoch();
+    if (!std::isfinite(s)) {
+        writeNil();
+        return;
+    }
+
+    double seconds = std::floor(s);
+    int64_t nanos = std::llround((s - seconds) * 1e9);
+    if (nanos >= 1000000000) {
+        seconds += 1;
+        nanos -= 1000000000;
+    }
+
+    writeExtHeader(TIMESTAMP_EXT, 12);
+    writeBigEndian((uint32_t)nanos, 4);
+    writeBigEndian((uint64_t)(int64_t)seconds, 8);
+}
+
+void
+MsgPackWriter::
+writeArrayHeader(size_t numElements)
+{
+    if (numElements < 16) {
+        writeByte(0x90 | numElements);
+    }
+    else if (numElements <= UINT16_MAX) {
+        writeByte(0xdc);
+        writeBigEndian(numElements, 2);
+    }
+    else {
+        ExcAssertLessEqual(numElements, UINT32_MAX);
+        writeByte(0xdd);
+        writeBigEndian(numElements, 4);
+    }
+}
+
+void
+MsgPackWriter::
+writeMapHeader(size_t numElements)
+{
+    if (numElements < 16) {
+        writeByte(0x80 | numElements);
+    }
+    else if (numElements <= UINT16_MAX) {
+        writeByte(0xde);
+        writeBigEndian(numElements, 2);
+    }
+    else {
+        ExcAssertLessEqual(numElements, UINT32_MAX);
+        writeByte(0xdf);
+        writeBigEndian(numElements, 4);
+    }
+}
+
+void
+MsgPackWriter::
+writeCellValue(const CellValue & val)
+{
+    switch (val.cellType()) {
+    case CellValue::EMPTY:
+        writeNil();
+        return;
+    case CellValue::INTEGER:
+        if (val.isUnsignedInteger())
+            writeUInt(val.toUInt());
+        else writeInt(val.toInt());
+        return;
+    case CellValue::FLOAT:
+        writeDouble(val.toDouble());
+        return;
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING:
+        writeString(val.stringChars(), val.toStringLength());
+        return;
+    case CellValue::TIMESTAMP:
+        writeTimestamp(val.toTimestamp());
+        return;
+    case CellValue::TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        std::tie(months, days, seconds) = val.toMonthDaySecond();
+        uint64_t secondsBits;
+        std::memcpy(&secondsBits, &seconds, sizeof(secondsBits));
+        writeExtHeader(TIMEINTERVAL_EXT, 24);
+        writeBigEndian((uint64_t)months, 8);
+        writeBigEndian((uint64_t)days, 8);
+        writeBigEndian(secondsBits, 8);
+        return;
+    }
+    case CellValue::BLOB:
+        writeBinary(val.blobData(), val.blobLength());
+        return;
+    case CellValue::PATH:
+        writeString(val.toUtf8String());
+        return;
+    case CellValue::NUM_CELL_TYPES:
+        break;
+    }
+
+    throw MLDB::Exception("Unknown cell value type for MessagePack encoding");
+}
+
+void
+MsgPackWriter::
+writePath(const Path & path)
+{
+    writeString(path.toUtf8String());
+}
+
+
+/*****************************************************************************/
+/* MSGPACK READER                                                            */
+/*****************************************************************************/
+
+uint8_t
+MsgPackReader::
+peekByte() const
+{
+    if (p == end)
+        throw MLDB::Exception("MessagePack value truncated at offset %zd",
+                              offset());
+    return *p;
+}
+
+uint8_t
+MsgPackReader::
+readByte()
+{
+    uint8_t result = peekByte();
+    ++p;
+    return result;
+}
+
+uint64_t
+MsgPackReader::
+readBigEndian(int bytes)
+{
+    const char * data = readBytes(bytes);
+    uint64_t result = 0;
+    for (int i = 0;  i < bytes;  ++i)
+        result = (result << 8) | (uint8_t)data[i];
+    return result;
+}
+
+const char *
+MsgPackReader::
+readBytes(size_t len)
+{
+    if ((size_t)(end - p) < len)
+        throw MLDB::Exception("MessagePack value truncated at offset %zd: "
+                              "needed %zd bytes but only %zd are left",
+                              offset(), len, (size_t)(end - p));
+    const char * result = p;
+    p += len;
+    return result;
+}
+
+MsgPackReader::Type
+MsgPackReader::
+nextType() const
+{
+    uint8_t b = peekByte();
+    if (b <= 0x7f || b >= 0xe0)
+        return INTEGER;
+    if (b <= 0x8f)
+        return MAP;
+    if (b <= 0x9f)
+        return ARRAY;
+    if (b <= 0xbf)
+        return STRING;
+
+    switch (b) {
+    case 0xc0:
+        return NIL;
+    case 0xc2:
+    case 0xc3:
+        return BOOL;
+    case 0xc4: case 0xc5: case 0xc6:
+        return BINARY;
+    case 0xc7: case 0xc8: case 0xc9:
+    case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+        return EXT;
+    case 0xca: case 0xcb:
+        return FLOAT;
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+        return INTEGER;
+    case 0xd9: case 0xda: case 0xdb:
+        return STRING;
+    case 0xdc: case 0xdd:
+        return ARRAY;
+    case 0xde: case 0xdf:
+        return MAP;
+    }
+
+    throw MLDB::Exception("Invalid MessagePack type byte 0x%02x at offset %zd",
+                          (int)b, offset());
+}
+
+void
+MsgPackReader::
+readNil()
+{
+    if (readByte() != 0xc0)
+        throw MLDB::Exception("Expected MessagePack nil at offset %zd",
+                              offset() - 1);
+}
+
+bool
+MsgPackReader::
+readBool()
+{
+    uint8_t b = readByte();
+    if (b != 0xc2 && b != 0xc3)
+        throw MLDB::Exception("Expected MessagePack boolean at offset %zd",
+                              offset() - 1);
+    return b == 0xc3;
+}
+
+int64_t
+MsgPackReader::
+readInt()
+{
+    uint8_t b = peekByte();
+    if (b <= 0x7f || (b >= 0xcc && b <= 0xcf)) {
+        uint64_t val = readUInt();
+        if (val > (uint64_t)INT64_MAX)
+            throw MLDB::Exception("MessagePack integer %llu is too large to "
+                                  "be read as a signed integer",
+                                  (unsigned long long)val);
+        return val;
+    }
+
+    readByte();
+    if (b >= 0xe0)
+        return (int8_t)b;  // negative fixint
+
+    switch (b) {
+    case 0xd0:  return (int8_t)readBigEndian(1);
+    case 0xd1:  return (int16_t)readBigEndian(2);
+    case 0xd2:  return (int32_t)readBigEndian(4);
+    case 0xd3:  return (int64_t)readBigEndian(8);
+    }
+
+    throw MLDB::Exception("Expected MessagePack integer at offset %zd",
+                          offset() - 1);
+}
+
+uint64_t
+MsgPackReader::
+readUInt()
+{
+    uint8_t b = readByte();
+    if (b <= 0x7f)
+        return b;  // positive fixint
+
+    switch (b) {
+    case 0xcc:  return readBigEndian(1);
+    case 0xcd:  return readBigEndian(2);
+    case 0xce:  return readBigEndian(4);
+    case 0xcf:  return readBigEndian(8);
+    }
+
+    throw MLDB::Exception("Expected MessagePack unsigned integer at offset %zd",
+                          offset() - 1);
+}
+
+double
+MsgPackReader::
+readDouble()
+{
+    uint8_t b = readByte();
+    if (b == 0xca) {
+        uint32_t bits = readBigEndian(4);
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+    else if (b == 0xcb) {
+        uint64_t bits = readBigEndian(8);
+        double result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    throw MLDB::Exception("Expected MessagePack float at offset %zd",
+                          offset() - 1);
+}
+
+size_t
+MsgPackReader::
+readStringLength()
+{
+    uint8_t b = readByte();
+    if (b >= 0xa0 && b <= 0xbf)
+        return b & 0x1f;
+
+    switch (b) {
+    case 0xd9:  return readBigEndian(1);
+    case 0xda:  return readBigEndian(2);
+    case 0xdb:  return readBigEndian(4);
+    }
+
+    throw MLDB::Exception("Expected MessagePack string at offset %zd",
+                          offset() - 1);
+}
+
+Utf8String
+MsgPackReader::
+readString()
+{
+    size_t len = readStringLength();
+    const char * data = readBytes(len);
+    return Utf8String(std::string(data, len));
+}
+
+std::string
+MsgPackReader::
+readBinary()
+{
+    size_t len;
+    uint8_t b = readByte();
+    switch (b) {
+    case 0xc4:  len = readBigEndian(1);  break;
+    case 0xc5:  len = readBigEndian(2);  break;
+    case 0xc6:  len = readBigEndian(4);  break;
+    default:
+        throw MLDB::Exception("Expected MessagePack binary at offset %zd",
+                              offset() - 1);
+    }
+    const char * data = readBytes(len);
+    return std::string(data, len);
+}
+
+size_t
+MsgPackReader::
+readArrayHeader()
+{
+    uint8_t b = readByte();
+    if (b >= 0x90 && b <= 0x9f)
+        return b & 0x0f;
+    if (b == 0xdc)
+        return readBigEndian(2);
+    if (b == 0xdd)
+        return readBigEndian(4);
+
+    throw MLDB::Exception("Expected MessagePack array at offset %zd",
+                          offset() - 1);
+}
+
+size_t
+MsgPackReader::
+readMapHeader()
+{
+    uint8_t b = readByte();
+    if (b >= 0x80 && b <= 0x8f)
+        return b & 0x0f;
+    if (b == 0xde)
+        return readBigEndian(2);
+    if (b == 0xdf)
+        return readBigEndian(4);
+
+    throw MLDB::Exception("Expected MessagePack map at offset %zd",
+                          offset() - 1);
+}
+
+void
+MsgPackReader::
+readExtHeader(int8_t & type, size_t & len)
+{
+    uint8_t b = readByte();
+    switch (b) {
+    case 0xd4:  len = 1;  break;
+    case 0xd5:  len = 2;  break;
+    case 0xd6:  len = 4;  break;
+    case 0xd7:  len = 8;  break;
+    case 0xd8:  len = 16;  break;
+    case 0xc7:  len = readBigEndian(1);  break;
+    case 0xc8:  len = readBigEndian(2);  break;
+    case 0xc9:  len = readBigEndian(4);  break;
+    default:
+        throw MLDB::Exception("Expected MessagePack extension at offset %zd",
+                              offset() - 1);
+    }
+    type = (int8_t)readByte();
+}
+
+CellValue
+MsgPackReader::
+readCellValue()
+{
+    switch (nextType()) {
+    case NIL:
+        readNil();
+        return CellValue();
+    case BOOL:
+        return CellValue((int)readBool());
+    case INTEGER: {
+        uint8_t b = peekByte();
+        if (b <= 0x7f || (b >= 0xcc && b <= 0xcf))
+            return CellValue(readUInt());
+        return CellValue(readInt());
+    }
+    case FLOAT:
+        return CellValue(readDouble());
+    case STRING:
+        return CellValue(readString());
+    case BINARY:
+        return CellValue::blob(readBinary());
+    case EXT: {
+        size_t startOffset = offset();
+        int8_t type;
+        size_t len;
+        readExtHeader(type, len);
+
+        if (type == MsgPackWriter::TIMESTAMP_EXT) {
+            uint64_t nanos = 0;
+            int64_t seconds;
+            if (len == 4) {
+                seconds = readBigEndian(4);
+            }
+            else if (len == 8) {
+                uint64_t bits = readBigEndian(8);
+                nanos = bits >> 34;
+                seconds = bits & ((1ULL << 34) - 1);
+            }
+            else if (len == 12) {
+                nanos = readBigEndian(4);
+                seconds = (int64_t)readBigEndian(8);
+            }
+            else {
+                throw MLDB::Exception("Invalid MessagePack timestamp length "
+                                      "%zd at offset %zd", len, startOffset);
+            }
+            return CellValue(Date::fromSecondsSinceEpoch(seconds + nanos * 1e-9));
+        }
+        else if (type == MsgPackWriter::TIMEINTERVAL_EXT && len == 24) {
+            int64_t months = readBigEndian(8);
+            int64_t days = readBigEndian(8);
+            uint64_t secondsBits = readBigEndian(8);
+            double seconds;
+            std::memcpy(&seconds, &secondsBits, sizeof(seconds));
+            return CellValue::fromMonthDaySecond(months, days, seconds);
+        }
+
+        throw MLDB::Exception("Unknown MessagePack extension type %d "
+                              "of length %zd at offset %zd",
+                              (int)type, len, startOffset);
+    }
+    case ARRAY:
+    case MAP:
+        break;
+    }
+
+    throw MLDB::Exception("Expected a MessagePack scalar value at offset %zd "
+                          "but got an array or a map", offset());
+}
+
+Path
+MsgPackReader::
+readPath()
+{
+    return Path::parse(readString());
+}
+
+void
+MsgPackReader::
+skip()
+{
+    switch (nextType()) {
+    case ARRAY: {
+        size_t n = readArrayHeader();
+        for (size_t i = 0;  i < n;  ++i)
+            skip();
+        return;
+    }
+    case MAP: {
+        size_t n = readMapHeader();
+        for (size_t i = 0;  i < n * 2;  ++i)
+            skip();
+        return;
+    }
+    case EXT: {
+        int8_t type;
+        size_t len;
+        readExtHeader(type, len);
+        readBytes(len);
+        return;
+    }
+    default:
+        readCellValue();
+    }
+}
+
+} // namespace MLDB
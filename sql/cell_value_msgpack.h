@@ -0,0 +1,164 @@
+/** cell_value_msgpack.h                                          -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    MessagePack encoding of cell values, used as a binary wire format for
+    query results.
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include "mldb/sql/path.h"
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MSGPACK WRITER                                                            */
+/*****************************************************************************/
+
+/** Appends MessagePack (https://msgpack.org) encoded values to a string
+    buffer.  The caller is responsible for sending and clearing the buffer
+    as it fills up, which allows large results to be streamed without
+    ever being held in memory as a whole.
+
+    Cell values are mapped onto the native MessagePack types where one
+    exists:
+    - empty values are nil;
+    - integers are int or uint, in their most compact form;
+    - floating point numbers are float 64, including NaN and infinities;
+    - strings and paths are str, in UTF-8;
+    - blobs are bin;
+    - timestamps use the standard timestamp extension (type -1), in its
+      96 bit form.  Timestamps which aren't a date are nil;
+    - time intervals use the application extension type 1, holding the
+      months and days as big endian int64 followed by the seconds as a
+      big endian float 64.
+*/
+
+struct MsgPackWriter {
+    MsgPackWriter(std::string & buffer)
+        : buffer(buffer)
+    {
+    }
+
+    /// Extension type used for time intervals
+    static constexpr int8_t TIMEINTERVAL_EXT = 1;
+
+    /// Standard extension type used for timestamps
+    static constexpr int8_t TIMESTAMP_EXT = -1;
+
+    void writeNil();
+    void writeBool(bool val);
+    void writeInt(int64_t val);
+    void writeUInt(uint64_t val);
+    void writeDouble(double val);
+    void writeString(const char * str, size_t len);
+    void writeString(const Utf8String & str);
+    void writeBinary(const void * data, size_t len);
+    void writeTimestamp(Date ts);
+    void writeArrayHeader(size_t numElements);
+    void writeMapHeader(size_t numElements);
+    void writeExtHeader(int8_t type, size_t len);
+
+    void writeCellValue(const CellValue & val);
+    void writePath(const Path & path);
+
+    /// Number of bytes currently held in the buffer
+    size_t size() const { return buffer.size(); }
+
+private:
+    void writeByte(uint8_t b) { buffer.push_back((char)b); }
+    void writeBigEndian(uint64_t val, int bytes);
+
+    std::string & buffer;
+};
+
+
+/*****************************************************************************/
+/* MSGPACK READER                                                            */
+/*****************************************************************************/
+
+/** Reads MessagePack encoded values from a buffer, which must stay alive
+    for as long as the reader is used.  The inverse of MsgPackWriter:
+    readCellValue() accepts everything that writeCellValue() produces, plus
+    the other encodings a third party encoder may legitimately choose (float
+    32, the 32 and 64 bit timestamp forms, ...).  Booleans are read as the
+    integers 0 and 1, as they are when parsed from JSON.
+
+    Truncated or malformed input causes an exception to be thrown.
+*/
+
+struct MsgPackReader {
+    MsgPackReader(const char * start, const char * end)
+        : start(start), p(start), end(end)
+    {
+    }
+
+    MsgPackReader(const std::string & buffer)
+        : MsgPackReader(buffer.data(), buffer.data() + buffer.size())
+    {
+    }
+
+    /// The reader doesn't copy the data, so it can't read from a temporary
+    MsgPackReader(std::string && buffer) = delete;
+
+    /// Kind of the next value in the buffer, without consuming it
+    enum Type {
+        NIL,
+        BOOL,
+        INTEGER,
+        FLOAT,
+        STRING,
+        BINARY,
+        ARRAY,
+        MAP,
+        EXT
+    };
+
+    Type nextType() const;
+
+    bool eof() const { return p == end; }
+
+    /// Number of bytes consumed so far
+    size_t offset() const { return p - start; }
+
+    void readNil();
+    bool readBool();
+    int64_t readInt();
+    uint64_t readUInt();
+    double readDouble();
+    Utf8String readString();
+    std::string readBinary();
+    size_t readArrayHeader();
+    size_t readMapHeader();
+
+    /** Read a single scalar value, which may not be an array or a map. */
+    CellValue readCellValue();
+
+    /** Read a path, written as a string by MsgPackWriter::writePath(). */
+    Path readPath();
+
+    /** Skip over the next value, including the contents of an array or
+        a map.
+    */
+    void skip();
+
+private:
+    uint8_t peekByte() const;
+    uint8_t readByte();
+    uint64_t readBigEndian(int bytes);
+    const char * readBytes(size_t len);
+    size_t readStringLength();
+    void readExtHeader(int8_t & type, size_t & len);
+
+    const char * start;
+    const char * p;
+    const char * end;
+};
+
+} // namespace MLDB
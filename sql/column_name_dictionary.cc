@@ -0,0 +1,156 @@
+/** column_name_dictionary.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Process-wide dictionary of interned column names.
+*/
+
+#include "column_name_dictionary.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/base/exc_assert.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COLUMN NAME DICTIONARY                                                    */
+/*****************************************************************************/
+
+ColumnNameDictionary::Shard::
+Shard()
+    : numNames(0)
+{
+    for (auto & b: blocks)
+        b.store(nullptr, std::memory_order_relaxed);
+}
+
+ColumnNameDictionary::Shard::
+~Shard()
+{
+    for (auto & b: blocks)
+        delete[] b.load(std::memory_order_relaxed);
+}
+
+ColumnNameDictionary &
+ColumnNameDictionary::
+instance()
+{
+    // Deliberately leaked, so that names stay valid for objects destroyed
+    // during static destruction
+    static ColumnNameDictionary * result = new ColumnNameDictionary();
+    return *result;
+}
+
+ColumnNameDictionary::
+ColumnNameDictionary()
+{
+}
+
+ColumnNameDictionary::
+~ColumnNameDictionary()
+{
+}
+
+size_t
+ColumnNameDictionary::
+shardFor(const Path & name)
+{
+    return (name.newHash() >> 32) & (NUM_SHARDS - 1);
+}
+
+ColumnId
+ColumnNameDictionary::
+intern(const Path & name)
+{
+    size_t shardNum = shardFor(name);
+    Shard & shard = shards[shardNum];
+
+    std::unique_lock<std::mutex> guard(shard.mutex);
+
+    auto it = shard.index.find(&name);
+    if (it != shard.index.end())
+        return ColumnId(it->second);
+
+    uint32_t local = shard.numNames.load(std::memory_order_relaxed);
+
+    // The last slot would collide with ColumnId::NONE
+    if (local >= MAX_BLOCKS * BLOCK_SIZE - 1)
+        throw HttpReturnException(500, "Too many distinct column names");
+
+    size_t blockNum = local >> BLOCK_BITS;
+    Path * block = shard.blocks[blockNum].load(std::memory_order_relaxed);
+    if (!block) {
+        block = new Path[BLOCK_SIZE];
+        shard.blocks[blockNum].store(block, std::memory_order_release);
+    }
+
+    Path & stored = block[local & (BLOCK_SIZE - 1)];
+    stored = name;
+
+    uint32_t id = (local << SHARD_BITS) | shardNum;
+    shard.index.emplace(&stored, id);
+    shard.numNames.store(local + 1, std::memory_order_release);
+
+    return ColumnId(id);
+}
+
+ColumnId
+ColumnNameDictionary::
+find(const Path & name) const
+{
+    const Shard & shard = shards[shardFor(name)];
+
+    std::unique_lock<std::mutex> guard(shard.mutex);
+
+    auto it = shard.index.find(&name);
+    if (it == shard.index.end())
+        return ColumnId();
+    return ColumnId(it->second);
+}
+
+const Path &
+ColumnNameDictionary::
+getPath(ColumnId id) const
+{
+    ExcAssert(id);
+    const Shard & shard = shards[id.id & (NUM_SHARDS - 1)];
+    uint32_t local = id.id >> SHARD_BITS;
+    ExcAssertLess(local, shard.numNames.load(std::memory_order_acquire));
+
+    const Path * block
+        = shard.blocks[local >> BLOCK_BITS].load(std::memory_order_acquire);
+    return block[local & (BLOCK_SIZE - 1)];
+}
+
+size_t
+ColumnNameDictionary::
+size() const
+{
+    size_t result = 0;
+    for (auto & s: shards)
+        result += s.numNames.load(std::memory_order_relaxed);
+    return result;
+}
+
+size_t
+ColumnNameDictionary::
+memusage() const
+{
+    size_t result = sizeof(*this);
+    for (auto & s: shards) {
+        std::unique_lock<std::mutex> guard(s.mutex);
+        size_t numBlocks = (s.numNames + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        result += numBlocks * BLOCK_SIZE * sizeof(Path);
+        result += s.index.size() * (sizeof(void *) * 3);
+        for (auto & e: s.index)
+            result += e.first->memusage() - sizeof(Path);
+    }
+    return result;
+}
+
+} // namespace MLDB
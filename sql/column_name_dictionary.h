@@ -0,0 +1,155 @@
+/** column_name_dictionary.h                                      -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Process-wide dictionary of interned column names.
+*/
+
+#pragma once
+
+#include "mldb/sql/path.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COLUMN ID                                                                 */
+/*****************************************************************************/
+
+/** Compact identifier for a column name that has been interned in the
+    ColumnNameDictionary.  Two ids are equal if and only if they refer to
+    the same name, so comparing and hashing them is an integer operation.
+
+    Note that ids are only stable within a process; they must never be
+    serialized.  The ordering of ids is not the ordering of the names.
+*/
+
+struct ColumnId {
+    static constexpr uint32_t NONE = (uint32_t)-1;
+
+    ColumnId()
+        : id(NONE)
+    {
+    }
+
+    explicit ColumnId(uint32_t id)
+        : id(id)
+    {
+    }
+
+    /// Is this a valid id (ie, not default constructed)?
+    explicit operator bool () const { return id != NONE; }
+
+    bool operator == (const ColumnId & other) const { return id == other.id; }
+    bool operator != (const ColumnId & other) const { return id != other.id; }
+    bool operator <  (const ColumnId & other) const { return id < other.id; }
+
+    /// Return the name this id refers to.  It must be valid.
+    const Path & path() const;
+
+    uint32_t id;
+};
+
+struct ColumnIdHasher
+    : public std::unary_function<ColumnId, size_t>
+{
+    size_t operator()(const ColumnId & id) const
+    {
+        // Fibonacci hashing spreads the sequential ids over the buckets
+        return id.id * 0x9e3779b97f4a7c15ULL;
+    }
+};
+
+
+/*****************************************************************************/
+/* COLUMN NAME DICTIONARY                                                    */
+/*****************************************************************************/
+
+/** Table of interned column names.  Each name is stored exactly once per
+    process and referred to by its ColumnId.  Names are never removed, so
+    references returned by getPath() stay valid for the life of the
+    process.
+
+    The table is sharded by name hash to keep contention low when many
+    threads record rows at once.  Looking up the name of an id is lock
+    free.
+*/
+
+struct ColumnNameDictionary {
+
+    /// Return the process-wide dictionary
+    static ColumnNameDictionary & instance();
+
+    ColumnNameDictionary();
+    ~ColumnNameDictionary();
+
+    ColumnNameDictionary(const ColumnNameDictionary &) = delete;
+    void operator = (const ColumnNameDictionary &) = delete;
+
+    /// Return the id for the given name, adding it if it's not there yet
+    ColumnId intern(const Path & name);
+
+    /// Return the id for the given name, or an invalid id if it was never
+    /// interned.  Never modifies the dictionary.
+    ColumnId find(const Path & name) const;
+
+    /// Return the name for the given id, which must be valid
+    const Path & getPath(ColumnId id) const;
+
+    /// Number of names in the dictionary
+    size_t size() const;
+
+    /// Memory used by the names
+    size_t memusage() const;
+
+private:
+    static constexpr int SHARD_BITS = 4;
+    static constexpr int NUM_SHARDS = 1 << SHARD_BITS;
+    static constexpr int BLOCK_BITS = 10;
+    static constexpr size_t BLOCK_SIZE = 1 << BLOCK_BITS;
+    static constexpr size_t MAX_BLOCKS = 1 << (32 - SHARD_BITS - BLOCK_BITS);
+
+    /// The index is keyed on pointers into the blocks, so that each name
+    /// is only stored once
+    struct DerefHasher {
+        size_t operator () (const Path * p) const { return p->newHash(); }
+    };
+
+    struct DerefEqual {
+        bool operator () (const Path * p1, const Path * p2) const
+        {
+            return *p1 == *p2;
+        }
+    };
+
+    struct Shard {
+        Shard();
+        ~Shard();
+
+        mutable std::mutex mutex;
+        std::unordered_map<const Path *, uint32_t, DerefHasher, DerefEqual> index;
+        std::atomic<uint32_t> numNames;
+
+        /// Blocks of names; a block is never moved once allocated so that
+        /// getPath() can read without taking the mutex.
+        std::atomic<Path *> blocks[MAX_BLOCKS];
+    };
+
+    static size_t shardFor(const Path & name);
+
+    Shard shards[NUM_SHARDS];
+};
+
+inline const Path &
+ColumnId::
+path() const
+{
+    return ColumnNameDictionary::instance().getPath(*this);
+}
+
+} // namespace MLDB
@@ -0,0 +1,122 @@
+/** dense_embedding.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Direct access to embeddings that are stored as a contiguous array of
+    floats or doubles, so that numeric functions can run vectorized
+    kernels over them rather than visiting each element as a CellValue.
+*/
+
+#pragma once
+
+#include "expression_value.h"
+#include "mldb/arch/simd_vector.h"
+#include <algorithm>
+#include <cmath>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* DENSE EMBEDDING                                                           */
+/*****************************************************************************/
+
+/** View of the elements of a dense floating point embedding.  Exactly one
+    of floats and doubles is set once bind() has succeeded.  Sums are
+    always accumulated in double precision, like the generic paths that
+    convert each element to a double.
+*/
+
+struct DenseEmbedding {
+    const float * floats = nullptr;
+    const double * doubles = nullptr;
+    size_t length = 0;
+
+    /** Point to the elements of val, returning false if it isn't a
+        non-empty float or double embedding.
+    */
+    bool bind(const ExpressionValue & val)
+    {
+        StorageType type;
+        const void * data = val.tryGetDenseEmbedding(type, length);
+        if (!data || length == 0)
+            return false;
+        if (type == ST_FLOAT32)
+            floats = (const float *)data;
+        else doubles = (const double *)data;
+        return true;
+    }
+
+    double operator [] (size_t i) const
+    {
+        return floats ? floats[i] : doubles[i];
+    }
+
+    double sum() const
+    {
+        return floats
+            ? SIMD::vec_sum_dp(floats, length)
+            : SIMD::vec_sum(doubles, length);
+    }
+
+    double sumSquares() const
+    {
+        return floats
+            ? SIMD::vec_twonorm_sqr_dp(floats, length)
+            : SIMD::vec_twonorm_sqr_dp(doubles, length);
+    }
+
+    double dot(const DenseEmbedding & other) const
+    {
+        if (floats)
+            return other.floats
+                ? SIMD::vec_dotprod_dp(floats, other.floats, length)
+                : SIMD::vec_dotprod_dp(floats, other.doubles, length);
+        return other.floats
+            ? SIMD::vec_dotprod_dp(doubles, other.floats, length)
+            : SIMD::vec_dotprod_dp(doubles, other.doubles, length);
+    }
+
+    bool hasNaN() const
+    {
+        auto isNaN = [] (double v) { return std::isnan(v); };
+        return floats
+            ? std::any_of(floats, floats + length, isNaN)
+            : std::any_of(doubles, doubles + length, isNaN);
+    }
+
+    size_t countNonZero() const
+    {
+        auto nonZero = [] (double v) { return v != 0.0; };
+        return floats
+            ? std::count_if(floats, floats + length, nonZero)
+            : std::count_if(doubles, doubles + length, nonZero);
+    }
+
+    /// Same semantics as std::min_element, including for NaN
+    double min() const
+    {
+        return floats
+            ? *std::min_element(floats, floats + length)
+            : *std::min_element(doubles, doubles + length);
+    }
+
+    /// Same semantics as std::max_element, including for NaN
+    double max() const
+    {
+        return floats
+            ? *std::max_element(floats, floats + length)
+            : *std::max_element(doubles, doubles + length);
+    }
+
+    /// Return the elements converted to doubles, in any vector of doubles
+    template<typename Vector = std::vector<double> >
+    Vector toDoubles() const
+    {
+        if (doubles)
+            return Vector(doubles, doubles + length);
+        return Vector(floats, floats + length);
+    }
+};
+
+} // namespace MLDB
@@ -7,6 +7,7 @@
 
 #include "execution_pipeline.h"
 #include "execution_pipeline_impl.h"
+#include "query_profile.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/jml/utils/smart_ptr_utils.h"
@@ -393,6 +394,21 @@ takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
     return true;
 }
 
+/*****************************************************************************/
+/* BOUND PIPELINE ELEMENT                                                    */
+/*****************************************************************************/
+
+std::shared_ptr<ElementExecutor>
+BoundPipelineElement::
+start(const BoundParameters & getParam) const
+{
+    auto result = doStart(getParam);
+    if (MLDB_UNLIKELY(QueryProfiler::current() != nullptr))
+        return QueryProfiler::current()->wrapExecutor(*this, std::move(result));
+    return result;
+}
+
+
 /*****************************************************************************/
 /* PIPELINE ELEMENT                                                          */
 /*****************************************************************************/
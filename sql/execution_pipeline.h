@@ -246,9 +246,15 @@ struct BoundPipelineElement {
     {
     }
 
-    /** Start running the query */
+    /** Start running the query.  When a query is being profiled, the
+        executor is wrapped so that it records what it does.
+    */
+    std::shared_ptr<ElementExecutor>
+    start(const BoundParameters & getParam) const;
+
+    /** Start running the query; implemented by each element. */
     virtual std::shared_ptr<ElementExecutor>
-    start(const BoundParameters & getParam) const = 0;
+    doStart(const BoundParameters & getParam) const = 0;
 
     /** Return the scope that describes the output of this element. */
     virtual std::shared_ptr<PipelineExpressionScope>
@@ -18,6 +18,7 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/base/scope.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/parallel.h"
 
 using namespace std;
 
@@ -344,7 +345,7 @@ Bound(const GenerateRowsElement * parent,
 
 std::shared_ptr<ElementExecutor>
 GenerateRowsElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<GenerateRowsExecutor>();
     result->source = source_->start(getParam);
@@ -523,7 +524,7 @@ Bound(const SubSelectElement * parent,
 
 std::shared_ptr<ElementExecutor>
 SubSelectElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<SubSelectExecutor>(boundSelect, getParam);
     return result;
@@ -1362,7 +1363,7 @@ createOutputScope()
         
 std::shared_ptr<ElementExecutor>
 JoinElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     switch (condition_.style) {
 
@@ -1448,7 +1449,7 @@ Bound(std::shared_ptr<SqlBindingScope> outer)
 
 std::shared_ptr<ElementExecutor>
 RootElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>();
 }
@@ -1653,6 +1654,50 @@ bind() const
 }
 
 
+/*****************************************************************************/
+/* MORSELS                                                                   */
+/*****************************************************************************/
+
+/** Number of rows that are taken from the source of an element at once, so
+    that the expressions of the element can be evaluated over all of them in
+    parallel.
+*/
+static constexpr size_t PIPELINE_MORSEL_SIZE = 256;
+
+/** Take a morsel of up to PIPELINE_MORSEL_SIZE rows from the given source,
+    and call process on each of them in parallel.  The tasks are run on the
+    shared thread pool, so that they share the cores fairly with those of
+    nested queries and of other elements.  Rows for which process returns
+    false are replaced with null.  Returns false if the source had
+    nothing left to give.
+*/
+static bool
+takeMorsel(ElementExecutor & source,
+           std::vector<std::shared_ptr<PipelineResults> > & morsel,
+           const std::function<bool (PipelineResults &)> & process)
+{
+    morsel.clear();
+    while (morsel.size() < PIPELINE_MORSEL_SIZE) {
+        std::shared_ptr<PipelineResults> input = source.take();
+        if (!input)
+            break;
+        morsel.emplace_back(std::move(input));
+    }
+
+    auto onRow = [&] (size_t i)
+        {
+            if (!process(*morsel[i]))
+                morsel[i].reset();
+        };
+
+    if (morsel.size() == 1)
+        onRow(0);
+    else parallelMap(0, morsel.size(), onRow);
+
+    return !morsel.empty();
+}
+
+
 /*****************************************************************************/
 /* FILTER WHERE EXECUTOR                                                     */
 /*****************************************************************************/
@@ -1662,22 +1707,27 @@ FilterWhereElement::Executor::
 take()
 {
     while (true) {
-        std::shared_ptr<PipelineResults> input = source_->take();
+        if (morselDone_ == morsel_.size()) {
+            auto onRow = [&] (PipelineResults & input)
+                {
+                    // Evaluate the where expression, and keep the row only
+                    // if it's true
+                    ExpressionValue storage;
+                    return parent_->where_(input, storage, GET_LATEST)
+                        .isTrue();
+                };
 
-        // If nothing left to give, then return an empty vector
-        if (!input)
-            return input;
-                
-        // Evaluate the where expression...
-        ExpressionValue storage;
-        const ExpressionValue & pass = parent_->where_(*input, storage, GET_LATEST);
-                
-        // If it doesn't evaluate to true, then on to the next row
-        if (!pass.isTrue())
-            continue;
+            // If nothing left to give, then return an empty vector
+            if (!takeMorsel(*source_, morsel_, onRow))
+                return nullptr;
+            morselDone_ = 0;
+        }
 
-        // Otherwise, we have our result
-        return input;
+        // Rows that were filtered out are null; on to the next row
+        std::shared_ptr<PipelineResults> result
+            = std::move(morsel_[morselDone_++]);
+        if (result)
+            return result;
     }
 }
 
@@ -1685,6 +1735,8 @@ void
 FilterWhereElement::Executor::
 restart()
 {
+    morsel_.clear();
+    morselDone_ = 0;
     source_->restart();
 }
 
@@ -1704,7 +1756,7 @@ Bound(std::shared_ptr<BoundPipelineElement> source,
 
 std::shared_ptr<ElementExecutor>
 FilterWhereElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<Executor>();
     result->parent_ = this;
@@ -1762,26 +1814,30 @@ std::shared_ptr<PipelineResults>
 SelectElement::Executor::
 take()
 {
-    while (true) {
-        std::shared_ptr<PipelineResults> input = source->take();
+    if (morselDone == morsel.size()) {
+        auto onRow = [&] (PipelineResults & input)
+            {
+                // Run the select expression in this input's context
+                ExpressionValue selected = parent->select_(input, GET_ALL);
+                input.values.emplace_back(std::move(selected));
+                return true;
+            };
 
         // If nothing left to give, then return an empty vector
-        if (!input)
-            return input;
-
-        // Run the select expression in this input's context
-        ExpressionValue selected = parent->select_(*input, GET_ALL);
-
-        input->values.emplace_back(std::move(selected));
-
-        return input;
+        if (!takeMorsel(*source, morsel, onRow))
+            return nullptr;
+        morselDone = 0;
     }
+
+    return std::move(morsel[morselDone++]);
 }
 
 void
 SelectElement::Executor::
 restart()
 {
+    morsel.clear();
+    morselDone = 0;
     source->restart();
 }
 
@@ -1802,7 +1858,7 @@ Bound(std::shared_ptr<BoundPipelineElement> source,
 
 std::shared_ptr<ElementExecutor>
 SelectElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<Executor>();
     result->parent = this;
@@ -1927,7 +1983,7 @@ Bound(std::shared_ptr<BoundPipelineElement> source,
 
 std::shared_ptr<ElementExecutor>
 OrderByElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>(this,
                                       source_->start(getParam));
@@ -2201,7 +2257,7 @@ Bound(std::shared_ptr<BoundPipelineElement> source,
 
 std::shared_ptr<ElementExecutor>
 PartitionElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>
         (this, source_->start(getParam),
@@ -2287,7 +2343,7 @@ Bound(std::shared_ptr<BoundPipelineElement> source,
         
 std::shared_ptr<ElementExecutor>
 ParamsElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>(source_->start(getParam),
                                       getParam);
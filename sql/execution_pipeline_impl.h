@@ -116,7 +116,7 @@ struct GenerateRowsElement: public PipelineElement {
               std::shared_ptr<BoundPipelineElement> source);
 
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -214,7 +214,7 @@ struct SubSelectElement: public PipelineElement {
               std::shared_ptr<BoundPipelineElement> source);
 
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -418,7 +418,7 @@ struct JoinElement: public PipelineElement {
         createOutputScope();
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -459,7 +459,7 @@ struct RootElement: public PipelineElement {
         std::shared_ptr<PipelineExpressionScope> scope_;
 
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -533,6 +533,12 @@ struct FilterWhereElement: public PipelineElement {
         std::shared_ptr<ElementExecutor> source_;
         PipelineExpressionScope * context_;
 
+        /// Morsel of rows taken from the source, of which the first
+        /// morselDone_ have been returned; rows that were filtered out
+        /// are null
+        std::vector<std::shared_ptr<PipelineResults> > morsel_;
+        size_t morselDone_ = 0;
+
         virtual std::shared_ptr<PipelineResults> take();
 
         virtual void restart();
@@ -550,7 +556,7 @@ struct FilterWhereElement: public PipelineElement {
         BoundSqlExpression where_;
 
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -587,6 +593,11 @@ struct SelectElement: public PipelineElement {
         const Bound * parent;
         std::shared_ptr<ElementExecutor> source;
 
+        /// Morsel of rows taken from the source and selected, of which
+        /// the first morselDone have been returned
+        std::vector<std::shared_ptr<PipelineResults> > morsel;
+        size_t morselDone = 0;
+
         virtual std::shared_ptr<PipelineResults> take();
 
         virtual void restart();
@@ -602,7 +613,7 @@ struct SelectElement: public PipelineElement {
         std::shared_ptr<PipelineExpressionScope> outputScope_;
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -658,7 +669,7 @@ struct OrderByElement: public PipelineElement {
         BoundOrderByExpression orderBy_;
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -758,7 +769,7 @@ struct PartitionElement: public PipelineElement {
         int numValues_;
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
         
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -809,7 +820,7 @@ struct ParamsElement: public PipelineElement {
         std::shared_ptr<PipelineExpressionScope> outputScope_;
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -8,9 +8,11 @@
 */
 
 #include <unordered_set>
+#include <cstring>
 #include "expression_value.h"
 #include "sql_expression.h"
 #include "path.h"
+#include "value_block_cache.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/enum_description.h"
 #include "mldb/types/vector_description.h"
@@ -1930,9 +1932,11 @@ ExpressionValue(std::vector<CellValue> values,
 {
     // This avoids needing to reallocate... it essentially allows us to create
     // a shared_ptr that owns the storage of a vector
-    auto movedVals = std::make_shared<std::vector<CellValue> >(std::move(values));
+    auto movedVals = std::allocate_shared<std::vector<CellValue> >
+        (ValueBlockAllocator<std::vector<CellValue> >(), std::move(values));
     std::shared_ptr<CellValue> vals(movedVals, movedVals->data());
-    std::shared_ptr<Embedding> content(new Embedding());
+    auto content = std::allocate_shared<Embedding>
+        (ValueBlockAllocator<Embedding>());
     content->data_ = std::move(vals);
     content->storageType_ = ST_ATOM;
     content->dims_ = std::move(shape);
@@ -1950,9 +1954,11 @@ ExpressionValue(std::vector<float> values, Date ts,
 {
     // This avoids needing to reallocate... it essentially allows us to create
     // a shared_ptr that owns the storage of a vector
-    auto movedVals = std::make_shared<std::vector<float> >(std::move(values));
+    auto movedVals = std::allocate_shared<std::vector<float> >
+        (ValueBlockAllocator<std::vector<float> >(), std::move(values));
     std::shared_ptr<float> vals(movedVals, movedVals->data());
-    std::shared_ptr<Embedding> content(new Embedding());
+    auto content = std::allocate_shared<Embedding>
+        (ValueBlockAllocator<Embedding>());
     content->data_ = std::move(vals);
     content->storageType_ = ST_FLOAT32;
     content->dims_ = std::move(shape);
@@ -1971,9 +1977,11 @@ ExpressionValue(std::vector<int> values,
 {
     // This avoids needing to reallocate... it essentially allows us to create
     // a shared_ptr that owns the storage of a vector
-    auto movedVals = std::make_shared<std::vector<int> >(std::move(values));
+    auto movedVals = std::allocate_shared<std::vector<int> >
+        (ValueBlockAllocator<std::vector<int> >(), std::move(values));
     std::shared_ptr<int> vals(movedVals, movedVals->data());
-    std::shared_ptr<Embedding> content(new Embedding());
+    auto content = std::allocate_shared<Embedding>
+        (ValueBlockAllocator<Embedding>());
     content->data_ = std::move(vals);
     content->storageType_ = ST_INT32;
     content->dims_ = std::move(shape);
@@ -1991,9 +1999,11 @@ ExpressionValue(std::vector<double> values, Date ts,
 {
     // This avoids needing to reallocate... it essentially allows us to create
     // a shared_ptr that owns the storage of a vector
-    auto movedVals = std::make_shared<std::vector<double> >(std::move(values));
+    auto movedVals = std::allocate_shared<std::vector<double> >
+        (ValueBlockAllocator<std::vector<double> >(), std::move(values));
     std::shared_ptr<double> vals(movedVals, movedVals->data());
-    std::shared_ptr<Embedding> content(new Embedding());
+    auto content = std::allocate_shared<Embedding>
+        (ValueBlockAllocator<Embedding>());
     content->data_ = std::move(vals);
     content->storageType_ = ST_FLOAT64;
     content->dims_ = std::move(shape);
@@ -2012,7 +2022,8 @@ embedding(Date ts,
           DimsVector dims,
           std::shared_ptr<const EmbeddingMetadata> md)
 {
-    auto embeddingData = std::make_shared<Embedding>();
+    auto embeddingData = std::allocate_shared<Embedding>
+        (ValueBlockAllocator<Embedding>());
     embeddingData->data_ = std::move(data);
     embeddingData->storageType_ = storageType;
     embeddingData->dims_ = std::move(dims);
@@ -2036,6 +2047,19 @@ getEmbeddingType() const
     throw HttpReturnException(500, "Querying embedding type on non-embedding value");
 }
 
+const void *
+ExpressionValue::
+tryGetDenseEmbedding(StorageType & type, size_t & length) const
+{
+    if (type_ != Type::EMBEDDING)
+        return nullptr;
+    type = embedding_->storageType_;
+    if (type != ST_FLOAT32 && type != ST_FLOAT64)
+        return nullptr;
+    length = embedding_->length();
+    return embedding_->data_.get();
+}
+
 ExpressionValue
 ExpressionValue::
 superpose(std::vector<ExpressionValue> vals)
@@ -4113,7 +4137,8 @@ initStructured(Structured value, bool needsSorting, bool hasDuplicates) noexcept
         }
     }
 
-    initStructured(std::make_shared<Structured>(std::move(value)));
+    initStructured(std::allocate_shared<Structured>
+                   (ValueBlockAllocator<Structured>(), std::move(value)));
 }
 
 void
@@ -4333,6 +4358,100 @@ compare(const ExpressionValue & other) const
     throw HttpReturnException(400, "unknown ExpressionValue type");
 }
 
+// Append the big-endian bytes of a double, transformed so that the
+// order of the bytes is the numeric order.  NaNs aren't handled here.
+static void appendSortKeyDouble(std::string & key, double d)
+{
+    uint64_t bits;
+    d += 0.0;  // -0.0 compares equal to 0.0
+    std::memcpy(&bits, &d, sizeof(bits));
+    bits = (bits & (1ULL << 63)) ? ~bits : bits | (1ULL << 63);
+    for (int i = 7;  i >= 0;  --i)
+        key.push_back((char)(bits >> (i * 8)));
+}
+
+bool
+ExpressionValue::
+appendSortKey(std::string & key, bool descending) const
+{
+    // Leading byte of each type, in the order in which compare() puts them
+    enum Tag: uint8_t {
+        NULL_TAG = 1,     ///< ExpressionValue without a value
+        EMPTY_TAG = 2,    ///< Empty atom
+        NAN_TAG = 3,      ///< NaN, which is before all other numbers
+        NUMBER_TAG = 4,   ///< Followed by 8 bytes of the double
+        STRING_TAG = 5,   ///< Followed by the escaped characters
+        TIMESTAMP_TAG = 6 ///< Followed by 8 bytes of the seconds since epoch
+    };
+
+    size_t start = key.size();
+
+    if (type_ == Type::NONE) {
+        key.push_back(NULL_TAG);
+    }
+    else if (type_ != Type::ATOM) {
+        return false;
+    }
+    else {
+        switch (cell_.cellType()) {
+        case CellValue::EMPTY:
+            key.push_back(EMPTY_TAG);
+            break;
+        case CellValue::INTEGER:
+        case CellValue::FLOAT: {
+            if (!cell_.isExactDouble())
+                return false;
+            double d = cell_.toDouble();
+            if (std::isnan(d)) {
+                key.push_back(NAN_TAG);
+            }
+            else {
+                key.push_back(NUMBER_TAG);
+                appendSortKeyDouble(key, d);
+            }
+            break;
+        }
+        case CellValue::ASCII_STRING:
+        case CellValue::UTF8_STRING: {
+            // Strings are compared as chars, which may be signed, whereas
+            // memcmp compares unsigned bytes.  A zero byte is escaped as
+            // 0 0xff, and the string is terminated by 0 0 so that a
+            // prefix of a string sorts before it.
+            const uint8_t flip = std::is_signed<char>::value ? 0x80 : 0;
+            key.push_back(STRING_TAG);
+            const char * p = cell_.stringChars();
+            size_t len = cell_.toStringLength();
+            for (size_t i = 0;  i < len;  ++i) {
+                uint8_t c = (uint8_t)p[i] ^ flip;
+                key.push_back(c);
+                if (c == 0)
+                    key.push_back((char)0xff);
+            }
+            key.push_back(0);
+            key.push_back(0);
+            break;
+        }
+        case CellValue::TIMESTAMP: {
+            double seconds = cell_.toTimestamp().secondsSinceEpoch();
+            if (std::isnan(seconds))
+                return false;
+            key.push_back(TIMESTAMP_TAG);
+            appendSortKeyDouble(key, seconds);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    if (descending) {
+        for (size_t i = start;  i < key.size();  ++i)
+            key[i] = ~key[i];
+    }
+
+    return true;
+}
+
 bool
 ExpressionValue::
 operator == (const ExpressionValue & other) const
@@ -1026,6 +1026,15 @@ struct ExpressionValue {
     */
     StorageType getEmbeddingType() const;
 
+    /** Return a pointer to the elements of an embedding that's stored as
+        a contiguous array of ST_FLOAT32 or ST_FLOAT64, setting type and
+        length, so that numeric functions can run straight over it.
+        Returns null for any other value, which needs to be accessed in
+        the normal way.
+    */
+    const void * tryGetDenseEmbedding(StorageType & type,
+                                      size_t & length) const;
+
     /** Iterate over the child expression, with an ExpressionValue at each
         level.  Note that if isRow() is false, than this function will
         NOT call the callback; it's only called for row-valued values.
@@ -1162,6 +1171,18 @@ struct ExpressionValue {
 
     int compare(const ExpressionValue & other) const;
 
+    /** Append to key a binary encoding of the value, such that comparing
+        the keys of two values with memcmp gives the same order as
+        compare(), or the opposite one if descending is true.  Keys of
+        several values can be appended one after the other, as no key is
+        a prefix of another.
+
+        Only nulls, numbers which are exactly representable as doubles,
+        strings and timestamps can be encoded.  For anything else, false
+        is returned and the values need to be compared with compare().
+    */
+    bool appendSortKey(std::string & key, bool descending = false) const;
+
     bool operator == (const ExpressionValue & other) const;
     bool operator != (const ExpressionValue & other) const
     {
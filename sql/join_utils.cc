@@ -12,6 +12,7 @@
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/http/http_exception.h"
 #include <algorithm>
+#include <cmath>
 
 using namespace std;
 
@@ -525,5 +526,133 @@ AnnotatedJoinConditionStyleDescription()
     addValue("UNKNOWN", AnnotatedJoinCondition::UNKNOWN, "Unknown join type");
 }
 
-} // namespace MLDB
 
+/*****************************************************************************/
+/* JOIN ORDER PLANNER                                                        */
+/*****************************************************************************/
+
+int64_t
+JoinOrderPlanner::
+getClauseTables(const SqlExpression & expr,
+                const std::vector<std::set<Utf8String> > & tables)
+{
+    int64_t result = 0;
+
+    auto onPath = [&] (ColumnPath path) -> bool
+        {
+            for (size_t i = 0;  i < tables.size();  ++i) {
+                if (extractTableName(path, tables[i])) {
+                    result |= 1ULL << i;
+                    return true;
+                }
+            }
+            return false;
+        };
+
+    for (auto & var: expr.variableNames()) {
+        if (!onPath(var.first.name))
+            return -1;
+    }
+
+    for (auto & w: expr.wildcards()) {
+        if (!onPath(w.first.name))
+            return -1;
+    }
+
+    for (auto & func: expr.functionNames()) {
+        const Utf8String & tableName = func.first.scope;
+        if (tableName.empty())
+            continue;
+        bool found = false;
+        for (size_t i = 0;  i < tables.size() && !found;  ++i) {
+            if (tables[i].count(tableName)) {
+                result |= 1ULL << i;
+                found = true;
+            }
+        }
+        if (!found)
+            return -1;
+    }
+
+    return result;
+}
+
+double
+JoinOrderPlanner::
+estimateRows(uint32_t tables) const
+{
+    double result = 1.0;
+    for (size_t i = 0;  i < rowCounts.size();  ++i) {
+        if (tables & (1U << i))
+            result *= rowCounts[i];
+    }
+    for (auto & c: clauses) {
+        if ((c.tables & tables) == c.tables)
+            result *= c.selectivity;
+    }
+    return result;
+}
+
+double
+JoinOrderPlanner::
+estimateCost(const std::vector<int> & order) const
+{
+    double result = 0.0;
+    uint32_t tables = 0;
+    for (size_t i = 0;  i < order.size();  ++i) {
+        tables |= 1U << order[i];
+        if (i > 0)
+            result += estimateRows(tables);
+    }
+    return result;
+}
+
+std::vector<int>
+JoinOrderPlanner::
+bestOrder(double & cost) const
+{
+    int n = rowCounts.size();
+    ExcAssertLessEqual(n, MAX_TABLES);
+
+    std::vector<int> result;
+    if (n == 0) {
+        cost = 0.0;
+        return result;
+    }
+
+    // Dynamic programming over the subsets of tables: the best order for
+    // a subset is the best order for the subset without one of its tables,
+    // followed by that table.
+    uint32_t all = (1U << n) - 1;
+    std::vector<double> bestCost(all + 1, INFINITY);
+    std::vector<int8_t> lastTable(all + 1, -1);
+
+    for (int i = 0;  i < n;  ++i) {
+        bestCost[1U << i] = 0.0;
+        lastTable[1U << i] = i;
+    }
+
+    for (uint32_t tables = 1;  tables <= all;  ++tables) {
+        if (!(tables & (tables - 1)))
+            continue;  // single table
+        double rows = estimateRows(tables);
+        // Go down so that ties leave the last table written last
+        for (int i = n - 1;  i >= 0;  --i) {
+            if (!(tables & (1U << i)))
+                continue;
+            double c = bestCost[tables & ~(1U << i)] + rows;
+            if (c < bestCost[tables]) {
+                bestCost[tables] = c;
+                lastTable[tables] = i;
+            }
+        }
+    }
+
+    cost = bestCost[all];
+    for (uint32_t tables = all;  tables;  tables &= ~(1U << lastTable[tables]))
+        result.push_back(lastTable[tables]);
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+} // namespace MLDB
@@ -25,6 +25,12 @@ namespace MLDB {
 std::shared_ptr<SqlExpression>
 removeTableNameFromExpression(const SqlExpression & expr, const Utf8String & tableName);
 
+/** If the column name starts with one of the table names, remove it and
+    return true.
+*/
+bool
+extractTableName(ColumnPath & columnName, const std::set<Utf8String> & tables);
+
 
 /*****************************************************************************/
 /* ANNOTATED CLAUSE                                                          */
@@ -195,5 +201,61 @@ DECLARE_STRUCTURE_DESCRIPTION_NAMED(AnnotatedJoinConditionSideDescription,
 DECLARE_ENUM_DESCRIPTION_NAMED(AnnotatedJoinConditionStyleDescription,
                               AnnotatedJoinCondition::Style);
 
+
+/*****************************************************************************/
+/* JOIN ORDER PLANNER                                                        */
+/*****************************************************************************/
+
+/** Chooses the order in which to run a chain of inner joins, which can be
+    run in any order as they give the same rows.  Each order is costed by
+    the total estimated size of its intermediate joins, which is what
+    dominates the time and memory of the join.
+
+    The estimates use the row count of each table, and a selectivity for
+    each clause of the combined join condition; a clause applies to the
+    smallest intermediate join containing all of the tables it refers to.
+*/
+
+struct JoinOrderPlanner {
+
+    /// Largest number of tables whose order can be planned
+    static constexpr int MAX_TABLES = 16;
+
+    /// Estimated number of rows in each table
+    std::vector<double> rowCounts;
+
+    struct Clause {
+        uint32_t tables = 0;       ///< Bitmap of the tables it refers to
+        double selectivity = 1.0;  ///< Estimated fraction of rows kept
+    };
+
+    /// Clauses of the join condition
+    std::vector<Clause> clauses;
+
+    /** Return the bitmap of which of the given tables (each of them a set
+        of aliases) the expression refers to, or -1 if it refers to
+        something that is in none of them.
+    */
+    static int64_t
+    getClauseTables(const SqlExpression & expr,
+                    const std::vector<std::set<Utf8String> > & tables);
+
+    /** Estimated number of rows in the join of the given bitmap of
+        tables.
+    */
+    double estimateRows(uint32_t tables) const;
+
+    /** Estimated cost of joining the tables in the given order, each one
+        onto the join of those before it.
+    */
+    double estimateCost(const std::vector<int> & order) const;
+
+    /** Return the order of the tables with the lowest estimated cost,
+        and that cost in cost.  Ties are broken in favour of the tables
+        coming in the order they were given.
+    */
+    std::vector<int> bestOrder(double & cost) const;
+};
+
 } // namespace MLDB
 
@@ -0,0 +1,436 @@
+/** query_profile.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Profiling of query execution.
+*/
+
+#include "query_profile.h"
+#include "execution_pipeline.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/optional_description.h"
+#include "mldb/arch/demangle.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <time.h>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY PROFILE                                                             */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(PerfCounts);
+
+PerfCountsDescription::
+PerfCountsDescription()
+{
+    addField("instructions", &PerfCounts::instructions,
+             "Instructions retired");
+    addField("cycles", &PerfCounts::cycles,
+             "CPU cycles");
+    addField("llcMisses", &PerfCounts::llcMisses,
+             "Misses of the last level cache");
+    addField("branchMisses", &PerfCounts::branchMisses,
+             "Mispredicted branches");
+    addField("dtlbMisses", &PerfCounts::dtlbMisses,
+             "Misses of the data TLB on reads");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(QueryElementProfile);
+
+QueryElementProfileDescription::
+QueryElementProfileDescription()
+{
+    addField("index", &QueryElementProfile::index,
+             "Position of the element in the profile");
+    addField("source", &QueryElementProfile::source,
+             "Index of the element's source, or -1 if it has none", -1);
+    addField("element", &QueryElementProfile::element,
+             "Type of the element");
+    addField("numStarts", &QueryElementProfile::numStarts,
+             "Number of times the element was started");
+    addField("rowsIn", &QueryElementProfile::rowsIn,
+             "Number of rows produced by the source of the element");
+    addField("rowsOut", &QueryElementProfile::rowsOut,
+             "Number of rows produced by the element");
+    addField("wallTime", &QueryElementProfile::wallTime,
+             "Elapsed seconds producing rows, including the source");
+    addField("selfWallTime", &QueryElementProfile::selfWallTime,
+             "Elapsed seconds producing rows, excluding the source");
+    addField("cpuTime", &QueryElementProfile::cpuTime,
+             "CPU seconds of the process producing rows, including the "
+             "source");
+    addField("selfCpuTime", &QueryElementProfile::selfCpuTime,
+             "CPU seconds of the process producing rows, excluding the "
+             "source");
+    addField("parallelism", &QueryElementProfile::parallelism,
+             "Average number of busy threads while producing rows");
+    addField("memoryCharged", &QueryElementProfile::memoryCharged,
+             "Change in the bytes charged to the query while producing "
+             "rows");
+    addField("counters", &QueryElementProfile::counters,
+             "Hardware counters of the threads producing rows, including "
+             "the source.  Absent when they can't be read.");
+    addField("selfCounters", &QueryElementProfile::selfCounters,
+             "Hardware counters of the threads producing rows, excluding "
+             "the source.  Absent when they can't be read.");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(QueryExpressionProfile);
+
+QueryExpressionProfileDescription::
+QueryExpressionProfileDescription()
+{
+    addField("expression", &QueryExpressionProfile::expression,
+             "Text of the expression");
+    addField("evaluations", &QueryExpressionProfile::evaluations,
+             "Number of times it was evaluated");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(QueryProfile);
+
+QueryProfileDescription::
+QueryProfileDescription()
+{
+    addField("wallTime", &QueryProfile::wallTime,
+             "Elapsed seconds running the query");
+    addField("cpuTime", &QueryProfile::cpuTime,
+             "CPU seconds of the process while running the query");
+    addField("rowCount", &QueryProfile::rowCount,
+             "Number of rows in the output of the query");
+    addField("evaluations", &QueryProfile::evaluations,
+             "Total number of expression evaluations");
+    addField("elements", &QueryProfile::elements,
+             "Profile of each element of the query's pipeline");
+    addField("expressions", &QueryProfile::expressions,
+             "Expression evaluation counts, most evaluated first");
+    addField("counters", &QueryProfile::counters,
+             "Hardware counters of the threads of the process while running "
+             "the query.  Absent when they can't be read.");
+}
+
+
+/*****************************************************************************/
+/* QUERY PROFILER                                                            */
+/*****************************************************************************/
+
+namespace {
+
+thread_local QueryProfiler * currentProfiler = nullptr;
+
+uint64_t wallNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t cpuNanoseconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/// Turn "MLDB::FilterWhereElement::Bound" into "FilterWhereElement"
+Utf8String elementName(const BoundPipelineElement & element)
+{
+    std::string name = demangle(typeid(element));
+    if (name.compare(0, 6, "MLDB::") == 0)
+        name = name.substr(6);
+    static const std::string bound = "::Bound";
+    if (name.size() > bound.size()
+        && name.compare(name.size() - bound.size(), bound.size(), bound) == 0)
+        name.resize(name.size() - bound.size());
+    return Utf8String(name);
+}
+
+/** Measurements for one element.  They're atomic because an executor may
+    be used from more than one thread.
+*/
+struct ElementStats {
+    Utf8String name;
+    const void * source = nullptr;
+    std::atomic<uint64_t> numStarts = { 0 };
+    std::atomic<uint64_t> rowsOut = { 0 };
+    std::atomic<uint64_t> wallNs = { 0 };
+    std::atomic<uint64_t> cpuNs = { 0 };
+    std::atomic<int64_t> memoryCharged = { 0 };
+
+    std::atomic<uint64_t> instructions = { 0 };
+    std::atomic<uint64_t> cycles = { 0 };
+    std::atomic<uint64_t> llcMisses = { 0 };
+    std::atomic<uint64_t> branchMisses = { 0 };
+    std::atomic<uint64_t> dtlbMisses = { 0 };
+
+    void addCounters(const PerfCounts & counts)
+    {
+        instructions += counts.instructions;
+        cycles += counts.cycles;
+        llcMisses += counts.llcMisses;
+        branchMisses += counts.branchMisses;
+        dtlbMisses += counts.dtlbMisses;
+    }
+
+    PerfCounts getCounters() const
+    {
+        PerfCounts result;
+        result.instructions = instructions;
+        result.cycles = cycles;
+        result.llcMisses = llcMisses;
+        result.branchMisses = branchMisses;
+        result.dtlbMisses = dtlbMisses;
+        return result;
+    }
+};
+
+struct ProfiledExecutor: public ElementExecutor {
+    ProfiledExecutor(std::shared_ptr<ElementExecutor> inner,
+                     std::shared_ptr<ElementStats> stats,
+                     const std::function<int64_t ()> & getMemoryUsed,
+                     bool countHardware)
+        : inner(std::move(inner)), stats(std::move(stats)),
+          getMemoryUsed(getMemoryUsed), countHardware(countHardware)
+    {
+    }
+
+    virtual std::shared_ptr<PipelineResults> take()
+    {
+        // The counters are those of the thread that pulls the row, which
+        // is the one that does the work of all but the parallel elements
+        const PerfCounterGroup * counters
+            = countHardware ? &PerfCounterGroup::forThisThread() : nullptr;
+
+        int64_t memoryBefore = getMemoryUsed ? getMemoryUsed() : 0;
+        PerfCounts countsBefore;
+        if (counters)
+            countsBefore = counters->read();
+        uint64_t wallBefore = wallNanoseconds();
+        uint64_t cpuBefore = cpuNanoseconds();
+
+        auto result = inner->take();
+
+        if (counters)
+            stats->addCounters(counters->read() - countsBefore);
+        stats->cpuNs += cpuNanoseconds() - cpuBefore;
+        stats->wallNs += wallNanoseconds() - wallBefore;
+        if (getMemoryUsed)
+            stats->memoryCharged += getMemoryUsed() - memoryBefore;
+        if (result)
+            ++stats->rowsOut;
+        return result;
+    }
+
+    virtual void restart()
+    {
+        inner->restart();
+    }
+
+    std::shared_ptr<ElementExecutor> inner;
+    std::shared_ptr<ElementStats> stats;
+    std::function<int64_t ()> getMemoryUsed;
+    bool countHardware;
+};
+
+} // file scope
+
+struct QueryProfiler::Impl {
+    std::function<int64_t ()> getMemoryUsed;
+    uint64_t startWallNs;
+    uint64_t startCpuNs;
+
+    /// Null if the hardware counters can't be read
+    std::unique_ptr<ProcessPerfCounters> processCounters;
+
+    mutable std::mutex mutex;
+
+    /// Elements in the order they were first started.  An element starts
+    /// its source before it is itself wrapped, so sources come first.
+    std::vector<std::pair<const void *, std::shared_ptr<ElementStats> > >
+        elements;
+
+    std::map<Utf8String, std::shared_ptr<std::atomic<uint64_t> > > counters;
+};
+
+QueryProfiler::
+QueryProfiler(std::function<int64_t ()> getMemoryUsed)
+    : impl(new Impl())
+{
+    impl->getMemoryUsed = std::move(getMemoryUsed);
+    if (PerfCounterGroup::available())
+        impl->processCounters.reset(new ProcessPerfCounters());
+    impl->startWallNs = wallNanoseconds();
+    impl->startCpuNs = cpuNanoseconds();
+}
+
+QueryProfiler::
+~QueryProfiler()
+{
+}
+
+QueryProfiler *
+QueryProfiler::
+current()
+{
+    return currentProfiler;
+}
+
+std::shared_ptr<ElementExecutor>
+QueryProfiler::
+wrapExecutor(const BoundPipelineElement & element,
+             std::shared_ptr<ElementExecutor> executor)
+{
+    std::shared_ptr<ElementStats> stats;
+    {
+        std::unique_lock<std::mutex> guard(impl->mutex);
+        for (auto & e: impl->elements) {
+            if (e.first == &element) {
+                stats = e.second;
+                break;
+            }
+        }
+        if (!stats) {
+            stats = std::make_shared<ElementStats>();
+            stats->name = elementName(element);
+            stats->source = element.boundSource().get();
+            impl->elements.emplace_back(&element, stats);
+        }
+    }
+    ++stats->numStarts;
+
+    return std::make_shared<ProfiledExecutor>(std::move(executor),
+                                              std::move(stats),
+                                              impl->getMemoryUsed,
+                                              impl->processCounters != nullptr);
+}
+
+std::shared_ptr<std::atomic<uint64_t> >
+QueryProfiler::
+getEvaluationCounter(const Utf8String & expression)
+{
+    std::unique_lock<std::mutex> guard(impl->mutex);
+    auto & counter = impl->counters[expression];
+    if (!counter)
+        counter = std::make_shared<std::atomic<uint64_t> >(0);
+    return counter;
+}
+
+void
+QueryProfiler::
+recordElement(const Utf8String & element,
+              uint64_t rowsOut,
+              double wallTime,
+              double cpuTime)
+{
+    auto stats = std::make_shared<ElementStats>();
+    stats->name = element;
+    stats->numStarts = 1;
+    stats->rowsOut = rowsOut;
+    stats->wallNs = wallTime * 1e9;
+    stats->cpuNs = cpuTime * 1e9;
+
+    std::unique_lock<std::mutex> guard(impl->mutex);
+    impl->elements.emplace_back(stats.get(), stats);
+}
+
+QueryProfile
+QueryProfiler::
+finish(uint64_t rowCount) const
+{
+    QueryProfile result;
+    result.wallTime = (wallNanoseconds() - impl->startWallNs) / 1e9;
+    result.cpuTime = (cpuNanoseconds() - impl->startCpuNs) / 1e9;
+    result.rowCount = rowCount;
+    bool countHardware = impl->processCounters != nullptr;
+    if (countHardware)
+        result.counters.emplace(impl->processCounters->read());
+
+    std::unique_lock<std::mutex> guard(impl->mutex);
+
+    std::map<const void *, int> indexes;
+    for (auto & e: impl->elements) {
+        int index = indexes.size();
+        indexes[e.first] = index;
+    }
+
+    for (auto & e: impl->elements) {
+        const ElementStats & stats = *e.second;
+        QueryElementProfile element;
+        element.index = result.elements.size();
+        element.element = stats.name;
+        element.numStarts = stats.numStarts;
+        element.rowsOut = stats.rowsOut;
+        element.wallTime = element.selfWallTime = stats.wallNs / 1e9;
+        element.cpuTime = element.selfCpuTime = stats.cpuNs / 1e9;
+        element.memoryCharged = stats.memoryCharged;
+        if (countHardware) {
+            element.counters.emplace(stats.getCounters());
+            element.selfCounters.emplace(stats.getCounters());
+        }
+
+        auto it = indexes.find(stats.source);
+        if (stats.source && it != indexes.end()) {
+            const ElementStats & source = *impl->elements[it->second].second;
+            element.source = it->second;
+            element.rowsIn = source.rowsOut;
+            element.selfWallTime
+                = std::max(0.0, element.wallTime - source.wallNs / 1e9);
+            element.selfCpuTime
+                = std::max(0.0, element.cpuTime - source.cpuNs / 1e9);
+            if (countHardware)
+                *element.selfCounters
+                    = *element.counters - source.getCounters();
+        }
+        if (element.selfWallTime > 0)
+            element.parallelism = element.selfCpuTime / element.selfWallTime;
+
+        result.elements.emplace_back(std::move(element));
+    }
+
+    for (auto & c: impl->counters) {
+        uint64_t evaluations = c.second->load(std::memory_order_relaxed);
+        if (!evaluations)
+            continue;
+        result.evaluations += evaluations;
+        result.expressions.push_back({ c.first, evaluations });
+    }
+    std::stable_sort(result.expressions.begin(), result.expressions.end(),
+                     [] (const QueryExpressionProfile & e1,
+                         const QueryExpressionProfile & e2)
+                     {
+                         return e1.evaluations > e2.evaluations;
+                     });
+
+    return result;
+}
+
+double
+QueryProfiler::
+processCpuTime()
+{
+    return cpuNanoseconds() / 1e9;
+}
+
+
+/*****************************************************************************/
+/* QUERY PROFILE SCOPE                                                       */
+/*****************************************************************************/
+
+QueryProfileScope::
+QueryProfileScope(QueryProfiler * profiler)
+    : previous(currentProfiler)
+{
+    currentProfiler = profiler;
+}
+
+QueryProfileScope::
+~QueryProfileScope()
+{
+    currentProfiler = previous;
+}
+
+} // namespace MLDB
@@ -0,0 +1,156 @@
+/** query_profile.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Profiling of query execution, to find out where a query spends its time.
+*/
+
+#pragma once
+
+#include "mldb/types/value_description_fwd.h"
+#include "mldb/types/string.h"
+#include "mldb/types/optional.h"
+#include "mldb/arch/perf_counters.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+namespace MLDB {
+
+struct ElementExecutor;
+struct BoundPipelineElement;
+
+
+/*****************************************************************************/
+/* QUERY PROFILE                                                             */
+/*****************************************************************************/
+
+DECLARE_STRUCTURE_DESCRIPTION(PerfCounts);
+
+/** What was measured for one element of a query while it was profiled.
+
+    Elements pull their rows from their source, so the times of an element
+    include those of its source; the self times don't.  The CPU time is
+    that of the whole process, and so includes the worker threads an element
+    uses; its ratio to the wall time gives the parallelism of the element.
+
+    When the hardware counters can be read (see PerfCounterGroup), those of
+    the threads that ran the element are recorded too.
+*/
+struct QueryElementProfile {
+    int index = -1;             ///< Position in the profile
+    int source = -1;            ///< Index of the source element, or -1
+    Utf8String element;         ///< Type of the element
+    uint64_t numStarts = 0;     ///< Number of times it was started
+    uint64_t rowsIn = 0;        ///< Rows produced by the source
+    uint64_t rowsOut = 0;       ///< Rows produced by this element
+    double wallTime = 0.0;      ///< Seconds, including the source
+    double selfWallTime = 0.0;  ///< Seconds, excluding the source
+    double cpuTime = 0.0;       ///< Seconds, including the source
+    double selfCpuTime = 0.0;   ///< Seconds, excluding the source
+    double parallelism = 0.0;   ///< selfCpuTime / selfWallTime
+    int64_t memoryCharged = 0;  ///< Bytes charged to the query's memory
+    Optional<PerfCounts> counters;      ///< Including the source
+    Optional<PerfCounts> selfCounters;  ///< Excluding the source
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(QueryElementProfile);
+
+/** Number of times a bound expression was evaluated. */
+struct QueryExpressionProfile {
+    Utf8String expression;
+    uint64_t evaluations = 0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(QueryExpressionProfile);
+
+struct QueryProfile {
+    double wallTime = 0.0;             ///< Seconds from start to finish
+    double cpuTime = 0.0;              ///< Process CPU seconds
+    uint64_t rowCount = 0;             ///< Rows in the output
+    uint64_t evaluations = 0;          ///< Total expression evaluations
+    std::vector<QueryElementProfile> elements;
+    std::vector<QueryExpressionProfile> expressions;  ///< Most evaluated first
+    Optional<PerfCounts> counters;     ///< Of the whole process
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(QueryProfile);
+
+
+/*****************************************************************************/
+/* QUERY PROFILER                                                            */
+/*****************************************************************************/
+
+/** Collects a QueryProfile.  While a QueryProfileScope is active on a
+    thread, the executors of the pipeline elements started on that thread
+    are wrapped to record their timings, and expressions bound on it count
+    their evaluations.  None of that costs anything when not profiling.
+
+    Expressions keep counting for as long as they stay bound, which can
+    be after the profile is finished, for example for functions created
+    during a profiled run.
+*/
+struct QueryProfiler {
+
+    /** getMemoryUsed returns the number of bytes currently charged to the
+        query; it may be null, in which case that's not recorded.
+    */
+    QueryProfiler(std::function<int64_t ()> getMemoryUsed = nullptr);
+
+    ~QueryProfiler();
+
+    QueryProfiler(const QueryProfiler &) = delete;
+    void operator = (const QueryProfiler &) = delete;
+
+    /** Return the profiler active on this thread, or null. */
+    static QueryProfiler * current();
+
+    /** Wrap the executor of the given element so that it's profiled. */
+    std::shared_ptr<ElementExecutor>
+    wrapExecutor(const BoundPipelineElement & element,
+                 std::shared_ptr<ElementExecutor> executor);
+
+    /** Return the counter for evaluations of the given expression. */
+    std::shared_ptr<std::atomic<uint64_t> >
+    getEvaluationCounter(const Utf8String & expression);
+
+    /** Record work done outside of a pipeline, for example a query that
+        is run directly by a dataset.
+    */
+    void recordElement(const Utf8String & element,
+                       uint64_t rowsOut,
+                       double wallTime,
+                       double cpuTime);
+
+    /** Return the profile, with how long it has been running and the given
+        number of output rows.
+    */
+    QueryProfile finish(uint64_t rowCount) const;
+
+    /** Return the CPU time used by the process so far, in seconds. */
+    static double processCpuTime();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+
+/*****************************************************************************/
+/* QUERY PROFILE SCOPE                                                       */
+/*****************************************************************************/
+
+/** Makes the given profiler current on this thread while it's in scope. */
+struct QueryProfileScope {
+    QueryProfileScope(QueryProfiler * profiler);
+    ~QueryProfileScope();
+
+    QueryProfileScope(const QueryProfileScope &) = delete;
+    void operator = (const QueryProfileScope &) = delete;
+
+private:
+    QueryProfiler * previous;
+};
+
+} // namespace MLDB
@@ -8,11 +8,90 @@
 #include "mldb/http/http_exception.h"
 #include "mldb/sql/builtin_functions.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/jml/utils/environment.h"
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+EnvOption<int> MLDB_REGEX_CACHE_SIZE("MLDB_REGEX_CACHE_SIZE", 1024);
+
+/// Least recently used cache of compiled regexes, keyed by their surface
+struct RegexCache {
+    std::mutex mutex;
+    typedef std::list<std::pair<std::string, Regex> > Entries;
+    Entries entries;
+    std::unordered_map<std::string, Entries::iterator> index;
+
+    bool find(const std::string & key, Regex & result)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(key);
+        if (it == index.end())
+            return false;
+        entries.splice(entries.begin(), entries, it->second);
+        result = it->second->second;
+        return true;
+    }
+
+    void insert(const std::string & key, const Regex & regex, size_t maxSize)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (index.count(key))
+            return;
+        entries.emplace_front(key, regex);
+        index[key] = entries.begin();
+        while (entries.size() > maxSize) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+};
+
+RegexCache & getRegexCache()
+{
+    static RegexCache cache;
+    return cache;
+}
+
+// Most patterns computed per row are the same as the one before, so each
+// thread remembers the last one it saw to skip the shared cache
+thread_local std::pair<std::string, Regex> lastRegex;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* REGEX CACHE                                                               */
+/*****************************************************************************/
+
+Regex getCachedRegex(const Utf8String & regex)
+{
+    const std::string & key = regex.rawString();
+
+    if (lastRegex.second.initialized() && lastRegex.first == key)
+        return lastRegex.second;
+
+    int maxSize = MLDB_REGEX_CACHE_SIZE;
+    Regex result;
+    if (maxSize <= 0 || !getRegexCache().find(key, result)) {
+        result = Regex(regex);
+        if (maxSize > 0)
+            getRegexCache().insert(key, result, maxSize);
+    }
+
+    lastRegex.first = key;
+    lastRegex.second = result;
+    return result;
+}
+
+
 /*****************************************************************************/
 /* REGEX HELPER                                                              */
 /*****************************************************************************/
@@ -52,7 +131,7 @@ compile(const ExpressionValue & val) const
              "value", val);
     }
     try {
-        return Regex(std::move(regexStr));
+        return getCachedRegex(regexStr);
     } MLDB_CATCH_ALL {
         rethrowHttpException
             (400, "Error when compiling regex '"
@@ -131,6 +210,14 @@ apply(const std::vector<ExpressionValue> & args,
     if (args[0].empty() || args[1].empty())
         return ExpressionValue::null(calcTs(args[0], args[1]));
 
+    // Most strings can be rejected without copying them or running the
+    // regex
+    if (args[0].isString()) {
+        const CellValue & str = args[0].getAtom();
+        if (!regex.mayMatch(str.stringChars(), str.toStringLength()))
+            return ExpressionValue(false, calcTs(args[0], args[1]));
+    }
+
     bool result = regex_match(args[0].toUtf8String(), regex);
     return ExpressionValue(result, calcTs(args[0], args[1]));
 }
@@ -159,6 +246,14 @@ apply(const std::vector<ExpressionValue> & args,
     if (args[0].empty() || args[1].empty())
         return ExpressionValue::null(calcTs(args[0], args[1]));
 
+    // Most strings can be rejected without copying them or running the
+    // regex
+    if (args[0].isString()) {
+        const CellValue & str = args[0].getAtom();
+        if (!regex.mayMatch(str.stringChars(), str.toStringLength()))
+            return ExpressionValue(false, calcTs(args[0], args[1]));
+    }
+
     bool result = regex_search(args[0].toUtf8String(), regex);
     return ExpressionValue(result, calcTs(args[0], args[1]));
 }
@@ -173,6 +268,9 @@ ApplyLike(BoundSqlExpression e, bool isNegative)
     : isNegative(isNegative)
 {
     init(std::move(e), 1 /* argNumber */);
+
+    if (isPrecompiled && expr.constantValue().isString())
+        precompiledMatcher.init(expr.constantValue().toUtf8String());
 }
 
 /// Return the regex string that matches the same values as the given LIKE
@@ -237,6 +335,159 @@ Utf8String likeToRegex(const Utf8String& filterString)
     return regExFilter;
 }
 
+/*****************************************************************************/
+/* LIKE MATCHER                                                              */
+/*****************************************************************************/
+
+namespace {
+
+/// Number of bytes in the UTF-8 character with the given first byte
+inline size_t utf8CharLength(unsigned char c)
+{
+    if (c < 0xc0)
+        return 1;
+    if (c < 0xe0)
+        return 2;
+    if (c < 0xf0)
+        return 3;
+    return 4;
+}
+
+/// Match the segment starting at pos, returning where it finishes or -1
+ssize_t matchForward(const std::string & segment,
+                     const char * str, size_t len, size_t pos)
+{
+    for (char c: segment) {
+        if (pos >= len)
+            return -1;
+        if (c == '_')
+            pos += utf8CharLength(str[pos]);
+        else if (str[pos] != c)
+            return -1;
+        else ++pos;
+    }
+    return pos <= len ? pos : -1;
+}
+
+/// Match the segment finishing at end, returning where it starts or -1
+ssize_t matchBackward(const std::string & segment,
+                      const char * str, size_t end)
+{
+    for (auto it = segment.rbegin();  it != segment.rend();  ++it) {
+        if (end == 0)
+            return -1;
+        if (*it == '_') {
+            --end;
+            while (end > 0 && ((unsigned char)str[end] & 0xc0) == 0x80)
+                --end;
+        }
+        else if (str[--end] != *it)
+            return -1;
+    }
+    return end;
+}
+
+} // file scope
+
+LikeMatcher::
+LikeMatcher()
+    : initialized_(false)
+{
+}
+
+bool
+LikeMatcher::
+init(const Utf8String & pattern)
+{
+    const std::string & p = pattern.rawString();
+
+    // These make the translated regex do something else than a LIKE
+    // would, so for the results to be the same the regex has to be used
+    if (p.find_first_of("\\+?{}") != std::string::npos)
+        return false;
+
+    segments.clear();
+    hasWildcard.clear();
+
+    size_t start = 0;
+    for (;;) {
+        size_t end = p.find('%', start);
+        segments.emplace_back(p, start,
+                              end == std::string::npos
+                              ? std::string::npos : end - start);
+        hasWildcard.push_back(segments.back().find('_') != std::string::npos);
+        if (end == std::string::npos)
+            break;
+        start = end + 1;
+        // Several % in a row are the same as one
+        while (start < p.size() && p[start] == '%')
+            ++start;
+    }
+
+    initialized_ = true;
+    return true;
+}
+
+bool
+LikeMatcher::
+matches(const char * str, size_t len) const
+{
+    ExcAssert(initialized_);
+
+    if (segments.size() == 1)
+        return matchForward(segments[0], str, len, 0) == (ssize_t)len;
+
+    ssize_t pos = matchForward(segments.front(), str, len, 0);
+    if (pos == -1)
+        return false;
+    ssize_t end = matchBackward(segments.back(), str, len);
+    if (end < pos)
+        return false;
+
+    // Each segment in the middle is matched as early as it can be, which
+    // leaves the most room for the ones after it
+    for (size_t i = 1;  i + 1 < segments.size();  ++i) {
+        const std::string & segment = segments[i];
+
+        if (!hasWildcard[i]) {
+            const char * found
+                = (const char *)memmem(str + pos, end - pos,
+                                       segment.data(), segment.size());
+            if (!found)
+                return false;
+            pos = found - str + segment.size();
+            continue;
+        }
+
+        // Find the literal at the start of the segment to know where to
+        // try it
+        size_t prefixLen = segment.find('_');
+        ssize_t found = -1;
+        for (ssize_t at = pos;  at < end;) {
+            if (prefixLen > 0) {
+                const char * p
+                    = (const char *)memmem(str + at, end - at,
+                                           segment.data(), prefixLen);
+                if (!p)
+                    break;
+                at = p - str;
+            }
+            ssize_t segEnd = matchForward(segment, str, end, at);
+            if (segEnd != -1) {
+                found = segEnd;
+                break;
+            }
+            at += utf8CharLength(str[at]);
+        }
+        if (found == -1)
+            return false;
+        pos = found;
+    }
+
+    return true;
+}
+
+
 Regex
 ApplyLike::
 compile(const ExpressionValue & val) const
@@ -277,4 +528,43 @@ apply(const std::vector<ExpressionValue> & args,
     return ExpressionValue(result, args[0].getEffectiveTimestamp());
 }
 
+ExpressionValue
+ApplyLike::
+operator () (const std::vector<ExpressionValue> & args,
+             const SqlRowScope & scope)
+{
+    LikeMatcher rowMatcher;
+    const LikeMatcher * matcher = nullptr;
+
+    if (isPrecompiled) {
+        if (precompiledMatcher.initialized())
+            matcher = &precompiledMatcher;
+    }
+    else if (args.at(argNumber).isString()
+             && rowMatcher.init(args[argNumber].toUtf8String())) {
+        matcher = &rowMatcher;
+    }
+
+    if (!matcher)
+        return RegexHelper::operator () (args, scope);
+
+    checkArgsSize(args.size(), 2);
+
+    if (args[0].empty())
+        return args[0];
+
+    if (!args[0].isString()) {
+        throw HttpReturnException
+            (400, "LIKE expression must have string on left side");
+    }
+
+    const CellValue & str = args[0].getAtom();
+    bool result = matcher->matches(str.stringChars(), str.toStringLength());
+
+    if (isNegative)
+        result = !result;
+
+    return ExpressionValue(result, args[0].getEffectiveTimestamp());
+}
+
 } // namespace MLDB
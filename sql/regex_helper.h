@@ -5,6 +5,8 @@
     Helper classes for regex.
 */
 
+#pragma once
+
 #include "mldb/types/regex.h"
 #include "sql_expression.h"
 
@@ -50,8 +52,65 @@ struct RegexHelper {
                                   const SqlRowScope & scope,
                                   const Regex & regex) const = 0;
 
-    ExpressionValue operator () (const std::vector<ExpressionValue> & args,
-                                 const SqlRowScope & scope);
+    virtual ExpressionValue operator () (const std::vector<ExpressionValue> & args,
+                                         const SqlRowScope & scope);
+};
+
+
+/*****************************************************************************/
+/* REGEX CACHE                                                               */
+/*****************************************************************************/
+
+/** Return the compiled version of the given regex from a cache shared by
+    the whole process, compiling it if it's not there.  This makes regexes
+    that are computed for each row (and those that are used by more than
+    one query) only get compiled once.  The number of regexes kept is set
+    by the MLDB_REGEX_CACHE_SIZE environment variable (default 1024).
+
+    Throws if the regex doesn't compile, in which case nothing is cached.
+*/
+Regex getCachedRegex(const Utf8String & regex);
+
+
+/*****************************************************************************/
+/* LIKE MATCHER                                                              */
+/*****************************************************************************/
+
+/** Matches strings against the pattern of a LIKE expression without a
+    regex.  The pattern is split at its '%' characters into segments of
+    literal characters and '_'.  The first and last of them are matched at
+    the start and end of the string, and the others are found in order in
+    between, looking for the literals with memmem() so that strings that
+    don't match are rejected without looking at every character.  It
+    takes time that is linear in the length of the string for most
+    patterns.
+*/
+
+struct LikeMatcher {
+    LikeMatcher();
+
+    /** Set up to match the given LIKE pattern.  Returns false if the
+        pattern contains characters that the regex it is translated into
+        gives a special meaning to, in which case the regex needs to be
+        used instead.
+    */
+    bool init(const Utf8String & pattern);
+
+    /** Is this initialized? */
+    bool initialized() const { return initialized_; }
+
+    /** Does the given UTF-8 string match the whole pattern? */
+    bool matches(const char * str, size_t len) const;
+
+private:
+    /// Parts of the pattern between '%' characters.  There is only one if
+    /// the pattern has no '%'.
+    std::vector<std::string> segments;
+
+    /// Does each segment contain a '_'?
+    std::vector<char> hasWildcard;
+
+    bool initialized_;
 };
 
 
@@ -111,8 +170,16 @@ struct ApplyLike: public RegexHelper {
                                   const SqlRowScope & scope,
                                   const Regex & regex) const;
 
+    /// Uses a LikeMatcher instead of the regex whenever the pattern
+    /// allows it.
+    virtual ExpressionValue operator () (const std::vector<ExpressionValue> & args,
+                                         const SqlRowScope & scope);
+
     /// This inverts it, ie turns LIKE into NOT LIKE
     bool isNegative;
+
+    /// Matcher for a constant pattern, when it can be used
+    LikeMatcher precompiledMatcher;
 };
 
 
@@ -3,18 +3,21 @@
 SQL_TYPES_SOURCES := \
 	cell_value.cc \
 	path.cc \
+	column_name_dictionary.cc \
 	dataset_types.cc \
 	interval.cc \
+	cell_value_msgpack.cc \
 
 # make sure well optimized even for architectures with -Os normally
 $(eval $(call set_compile_option,path.cc cell_value.cc,-O3))
-$(eval $(call library,sql_types,$(SQL_TYPES_SOURCES),types utils value_description any json_diff highwayhash hash))
+$(eval $(call library,sql_types,$(SQL_TYPES_SOURCES),types utils value_description any json_diff highwayhash hash xxhash))
 
 
 SQL_EXPRESSION_SOURCES := \
 	cell_value.cc \
 	sql_expression.cc \
 	expression_value.cc \
+	value_block_cache.cc \
 	table_expression_operations.cc \
 	binding_contexts.cc \
 	builtin_functions.cc \
@@ -30,8 +33,12 @@ SQL_EXPRESSION_SOURCES := \
 	regex_helper.cc \
 	execution_pipeline.cc \
 	execution_pipeline_impl.cc \
+	query_profile.cc \
 	sql_utils.cc \
 	sql_expression_operations.cc \
+	window_functions.cc \
+	sql_batch_program.cc \
+	t_digest.cc \
 	eval_sql.cc \
 	expression_value_conversions.cc \
 	expression_value_description.cc
@@ -41,7 +48,7 @@ SQL_EXPRESSION_SOURCES := \
 $(eval $(call set_compile_option,cell_value.cc builtin_geo_functions.cc,$(S2_COMPILE_OPTIONS) $(S2_WARNING_OPTIONS)))
 
 # NOTE: the SQL library should NOT depend on MLDB.  See the comment in testing/testing.mk
-$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),sql_types utils value_description any ml json_diff highwayhash hash s2 edlib log pffft))
+$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),sql_types utils value_description any base ml json_diff highwayhash hash xxhash s2 edlib log pffft))
 
 $(eval $(call include_sub_make,sql_testing,testing,sql_testing.mk))
 
@@ -0,0 +1,350 @@
+/** sql_batch_program.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Compilation of numeric SQL expressions into batch programs.
+*/
+
+#include "sql_batch_program.h"
+#include "sql_expression_operations.h"
+#include "mldb/compiler/compiler.h"
+#include <unordered_map>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SQL BATCH PROGRAM                                                         */
+/*****************************************************************************/
+
+struct SqlBatchProgram::Compiler {
+    Compiler(SqlBindingScope & scope)
+        : scope(scope)
+    {
+    }
+
+    SqlBindingScope & scope;
+    SqlBatchProgram program;
+
+    /// Register holding each subexpression, by its printed form
+    std::unordered_map<Utf8String, int> subexpressions;
+
+    /// Register holding each column that's been extracted
+    std::map<ColumnPath, int> columns;
+
+    /** Add the instructions to calculate the expression, returning the
+        register with its result or -1 if it can't be compiled.
+    */
+    int add(const SqlExpression & expr)
+    {
+        Utf8String key = expr.print();
+        auto it = subexpressions.find(key);
+        if (it != subexpressions.end())
+            return it->second;
+
+        int result = doAdd(expr);
+        if (result != -1)
+            subexpressions[key] = result;
+        return result;
+    }
+
+    int emit(Instruction instruction)
+    {
+        program.instructions.emplace_back(std::move(instruction));
+        return program.instructions.size() - 1;
+    }
+
+    int emit(Opcode op, int lhs, int rhs = -1)
+    {
+        if (lhs == -1 || (rhs == -1 && op != NEG && op != NOT))
+            return -1;
+        Instruction instruction;
+        instruction.op = op;
+        instruction.lhs = lhs;
+        instruction.rhs = rhs;
+        return emit(std::move(instruction));
+    }
+
+    int addConstant(const ExpressionValue & val)
+    {
+        if (!val.empty() && !val.isNumber())
+            return -1;
+
+        // Same as the batchExec of a constant
+        Instruction instruction;
+        instruction.op = CONSTANT;
+        instruction.value = val.empty() ? 0.0 : val.toDouble();
+        bool exact = !std::isnan(instruction.value)
+            && (!val.isInteger()
+                || std::abs(instruction.value) <= (double)(1ULL << 53));
+        instruction.state = val.empty() ? SqlBatchValues::NULLVAL
+            : exact ? SqlBatchValues::VALUE
+            : SqlBatchValues::SCALAR;
+        return emit(std::move(instruction));
+    }
+
+    int addColumn(const ColumnPath & columnName)
+    {
+        auto getter = scope.doGetColumn("" /* tableName */, columnName);
+        if (getter.batchColumnName.empty())
+            return -1;
+
+        auto it = columns.find(getter.batchColumnName);
+        if (it != columns.end())
+            return it->second;
+
+        Instruction instruction;
+        instruction.op = COLUMN;
+        instruction.column = getter.batchColumnName;
+        int result = emit(std::move(instruction));
+        columns[getter.batchColumnName] = result;
+        return result;
+    }
+
+    int doAdd(const SqlExpression & expr)
+    {
+        if (expr.isConstant()) {
+            ExpressionValue val;
+            try {
+                val = expr.constantValue();
+            } MLDB_CATCH_ALL {
+                return -1;
+            }
+            return addConstant(val);
+        }
+
+        if (auto column = dynamic_cast<const ReadColumnExpression *>(&expr)) {
+            return addColumn(column->columnName);
+        }
+        else if (auto arith = dynamic_cast<const ArithmeticExpression *>(&expr)) {
+            const std::string & op = arith->op;
+            if (!arith->lhs)
+                return op == "-" ? emit(NEG, add(*arith->rhs)) : -1;
+
+            Opcode opcode;
+            if (op == "+")
+                opcode = ADD;
+            else if (op == "-")
+                opcode = SUB;
+            else if (op == "*")
+                opcode = MUL;
+            else if (op == "/")
+                opcode = DIV;
+            else return -1;
+
+            return emit(opcode, add(*arith->lhs), add(*arith->rhs));
+        }
+        else if (auto comp = dynamic_cast<const ComparisonExpression *>(&expr)) {
+            const std::string & op = comp->op;
+            Opcode opcode;
+            if (op == "=" || op == "==")
+                opcode = EQ;
+            else if (op == "!=")
+                opcode = NE;
+            else if (op == "<")
+                opcode = LT;
+            else if (op == "<=")
+                opcode = LE;
+            else if (op == ">")
+                opcode = GT;
+            else if (op == ">=")
+                opcode = GE;
+            else return -1;
+
+            return emit(opcode, add(*comp->lhs), add(*comp->rhs));
+        }
+        else if (auto boolean
+                 = dynamic_cast<const BooleanOperatorExpression *>(&expr)) {
+            const std::string & op = boolean->op;
+            if (!boolean->lhs)
+                return op == "NOT" ? emit(NOT, add(*boolean->rhs)) : -1;
+            if (op == "AND")
+                return emit(AND, add(*boolean->lhs), add(*boolean->rhs));
+            else if (op == "OR")
+                return emit(OR, add(*boolean->lhs), add(*boolean->rhs));
+            return -1;
+        }
+
+        return -1;
+    }
+};
+
+std::shared_ptr<const SqlBatchProgram>
+SqlBatchProgram::
+compile(const SqlExpression & expr, SqlBindingScope & scope)
+{
+    Compiler compiler(scope);
+    int result = compiler.add(expr);
+    if (result == -1)
+        return nullptr;
+
+    // The result is always the last instruction, as the expression itself
+    // can't be a subexpression of anything that came before it.
+    ExcAssertEqual(result, compiler.program.instructions.size() - 1);
+
+    return std::make_shared<SqlBatchProgram>(std::move(compiler.program));
+}
+
+// Combine the states of two operands of a null-propagating operator, as
+// in the batchExec of the operator.
+static inline uint8_t combineStates(uint8_t l, uint8_t r)
+{
+    if (l == SqlBatchValues::NULLVAL || r == SqlBatchValues::NULLVAL)
+        return SqlBatchValues::NULLVAL;
+    return l | r;
+}
+
+template<typename Op>
+static void runComparison(const SqlBatchValues & l, const SqlBatchValues & r,
+                          SqlBatchValues & output, size_t numRows, Op op)
+{
+    for (size_t i = 0;  i < numRows;  ++i) {
+        output.states[i] = combineStates(l.states[i], r.states[i]);
+        output.values[i] = op(l.values[i], r.values[i]);
+    }
+}
+
+template<typename Op>
+static void runArithmetic(const SqlBatchValues & l, const SqlBatchValues & r,
+                          SqlBatchValues & output, size_t numRows, Op op)
+{
+    for (size_t i = 0;  i < numRows;  ++i) {
+        // Adding 0.0 turns -0.0 into 0.0, like CellValue does
+        double v = op(l.values[i], r.values[i]) + 0.0;
+        uint8_t state = combineStates(l.states[i], r.states[i]);
+        // NaN results need the scalar path for their SQL semantics
+        if (state == SqlBatchValues::VALUE && std::isnan(v))
+            state = SqlBatchValues::SCALAR;
+        output.values[i] = v;
+        output.states[i] = state;
+    }
+}
+
+static void runBoolean(const SqlBatchValues & l, const SqlBatchValues & r,
+                       SqlBatchValues & output, size_t numRows, bool isOr)
+{
+    // The dominant value (false for AND, true for OR) wins over everything
+    // else, including rows that need the scalar path
+    auto isDominant = [&] (uint8_t state, double value)
+        {
+            return state == SqlBatchValues::VALUE && (value != 0.0) == isOr;
+        };
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        uint8_t ls = l.states[i], rs = r.states[i];
+        if (isDominant(ls, l.values[i]) || isDominant(rs, r.values[i])) {
+            output.values[i] = isOr;
+            output.states[i] = SqlBatchValues::VALUE;
+        }
+        else {
+            output.values[i] = !isOr;
+            output.states[i]
+                = (ls == SqlBatchValues::SCALAR || rs == SqlBatchValues::SCALAR)
+                ? SqlBatchValues::SCALAR
+                : (ls | rs);
+        }
+    }
+}
+
+void
+SqlBatchProgram::
+run(const SqlBatchScope & scope, SqlBatchValues & output) const
+{
+    size_t numRows = scope.numRows;
+
+    // The last instruction writes straight into the output
+    std::vector<SqlBatchValues> registers(instructions.size() - 1);
+    auto reg = [&] (int i) -> SqlBatchValues &
+        {
+            return i == (int)registers.size() ? output : registers[i];
+        };
+
+    for (size_t n = 0;  n < instructions.size();  ++n) {
+        const Instruction & instruction = instructions[n];
+        SqlBatchValues & out = reg(n);
+
+        switch (instruction.op) {
+        case COLUMN:
+            scope.getColumn(instruction.column, out);
+            break;
+        case CONSTANT:
+            std::fill(out.values, out.values + numRows, instruction.value);
+            std::fill(out.states, out.states + numRows, instruction.state);
+            break;
+        case ADD:
+            runArithmetic(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::plus<double>());
+            break;
+        case SUB:
+            runArithmetic(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::minus<double>());
+            break;
+        case MUL:
+            runArithmetic(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::multiplies<double>());
+            break;
+        case DIV:
+            runArithmetic(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::divides<double>());
+            break;
+        case NEG: {
+            const SqlBatchValues & arg = reg(instruction.lhs);
+            for (size_t i = 0;  i < numRows;  ++i) {
+                double v = -arg.values[i] + 0.0;
+                uint8_t state = arg.states[i];
+                if (state == SqlBatchValues::VALUE && std::isnan(v))
+                    state = SqlBatchValues::SCALAR;
+                out.values[i] = v;
+                out.states[i] = state;
+            }
+            break;
+        }
+        case EQ:
+            runComparison(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::equal_to<double>());
+            break;
+        case NE:
+            runComparison(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::not_equal_to<double>());
+            break;
+        case LT:
+            runComparison(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::less<double>());
+            break;
+        case LE:
+            runComparison(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::less_equal<double>());
+            break;
+        case GT:
+            runComparison(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::greater<double>());
+            break;
+        case GE:
+            runComparison(reg(instruction.lhs), reg(instruction.rhs), out,
+                          numRows, std::greater_equal<double>());
+            break;
+        case AND:
+            runBoolean(reg(instruction.lhs), reg(instruction.rhs), out,
+                       numRows, false /* isOr */);
+            break;
+        case OR:
+            runBoolean(reg(instruction.lhs), reg(instruction.rhs), out,
+                       numRows, true /* isOr */);
+            break;
+        case NOT: {
+            const SqlBatchValues & arg = reg(instruction.lhs);
+            for (size_t i = 0;  i < numRows;  ++i) {
+                out.values[i] = arg.values[i] == 0.0;
+                out.states[i] = arg.states[i];
+            }
+            break;
+        }
+        }
+    }
+}
+
+} // namespace MLDB
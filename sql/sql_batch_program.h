@@ -0,0 +1,81 @@
+/** sql_batch_program.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Numeric SQL expressions compiled into a flat program over batches of
+    rows.
+*/
+
+#pragma once
+
+#include "sql_expression.h"
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SQL BATCH PROGRAM                                                         */
+/*****************************************************************************/
+
+/** A numeric expression compiled into a list of instructions, each of
+    which runs a tight loop over a batch of rows.  It gives exactly the
+    same results as the batchExec closures of the bound expression it was
+    compiled from, including which rows are left to the scalar path, but
+    avoids their overhead: there is one dispatch per instruction rather
+    than a chain of std::function calls, each column is extracted once per
+    batch however many times it's used, repeated subexpressions are only
+    calculated once and constant subexpressions are calculated when the
+    program is compiled.
+
+    Only comparisons, arithmetic (+, -, * and /), AND, OR, NOT, constant
+    numbers and columns provided by the SqlBatchScope can be compiled;
+    anything else (for example a function call) needs to use the
+    interpreter instead.
+*/
+
+struct SqlBatchProgram {
+
+    /** Compile the given expression, whose columns are resolved with the
+        given scope, as it would be bound within it.  Returns null if
+        the expression can't be compiled, in which case the caller needs
+        to fall back to the bound expression.
+    */
+    static std::shared_ptr<const SqlBatchProgram>
+    compile(const SqlExpression & expr, SqlBindingScope & scope);
+
+    /** Run the program over the rows of the scope, writing the result into
+        output as the batchExec of the expression would.
+    */
+    void run(const SqlBatchScope & scope, SqlBatchValues & output) const;
+
+    /// Number of instructions in the program
+    size_t size() const { return instructions.size(); }
+
+private:
+    enum Opcode: uint8_t {
+        COLUMN,       ///< Extract column from the scope
+        CONSTANT,     ///< Fill in value and state
+        ADD, SUB, MUL, DIV,
+        NEG,
+        EQ, NE, LT, LE, GT, GE,
+        AND, OR,
+        NOT
+    };
+
+    struct Instruction {
+        Opcode op;
+        int lhs = -1;            ///< Register of the first operand
+        int rhs = -1;            ///< Register of the second operand
+        double value = 0.0;      ///< Value of a CONSTANT
+        uint8_t state = 0;       ///< State of a CONSTANT
+        ColumnPath column;       ///< Column of a COLUMN
+    };
+
+    struct Compiler;
+
+    /// Instruction i writes to register i; the last one is the result
+    std::vector<Instruction> instructions;
+};
+
+} // namespace MLDB
@@ -20,6 +20,7 @@
 #include "table_expression_operations.h"
 #include "interval.h"
 #include "tokenize.h"
+#include "query_profile.h"
 #include "mldb/core/dataset.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/server/dataset_context.h"
@@ -28,6 +29,9 @@
 
 #include <mutex>
 #include <numeric>
+#include <cstring>
+#include <cmath>
+#include <limits>
 
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
@@ -127,6 +131,21 @@ BoundSqlExpression(ExecFunction exec,
       info(std::move(info)),
       metadata(std::move(metadata))
 {
+    // While profiling, count how many times each expression is evaluated
+    QueryProfiler * profiler = QueryProfiler::current();
+    if (MLDB_UNLIKELY(profiler != nullptr) && this->exec && expr) {
+        auto counter = profiler->getEvaluationCounter
+            (expr->surface.empty() ? expr->print() : expr->surface);
+        ExecFunction inner = std::move(this->exec);
+        this->exec = [inner, counter] (const SqlRowScope & context,
+                                       ExpressionValue & storage,
+                                       const VariableFilter & filter)
+            -> const ExpressionValue &
+            {
+                counter->fetch_add(1, std::memory_order_relaxed);
+                return inner(context, storage, filter);
+            };
+    }
 }
 
 ExpressionValue
@@ -187,6 +206,11 @@ std::unordered_map<Utf8String, ExternalFunction> externalFunctions;
 std::recursive_mutex externalDatasetFunctionsMutex;
 std::unordered_map<Utf8String, ExternalDatasetFunction> externalDatasetFunctions;
 
+/// Prefixes of functions whose plugin hasn't been loaded yet, under
+/// externalFunctionsMutex
+std::vector<std::pair<Utf8String, std::shared_ptr<std::function<void ()> > > >
+deferredFunctions;
+
 
 } // file scope
 
@@ -217,13 +241,56 @@ ExternalFunction lookupFunction(const Utf8String & name)
     return res;
 }
 
+std::shared_ptr<void>
+registerDeferredFunctions(Utf8String prefix, std::function<void ()> load)
+{
+    auto entry = std::make_shared<std::function<void ()> >(std::move(load));
+
+    auto unregister = [=] (void *)
+        {
+            std::unique_lock<std::recursive_mutex> guard(externalFunctionsMutex);
+            for (auto it = deferredFunctions.begin();
+                 it != deferredFunctions.end();  ++it) {
+                if (it->second == entry) {
+                    deferredFunctions.erase(it);
+                    break;
+                }
+            }
+        };
+
+    std::unique_lock<std::recursive_mutex> guard(externalFunctionsMutex);
+    deferredFunctions.emplace_back(std::move(prefix), entry);
+    return std::shared_ptr<void>(nullptr, unregister);
+}
+
 ExternalFunction tryLookupFunction(const Utf8String & name)
 {
     std::unique_lock<std::recursive_mutex> guard(externalFunctionsMutex);
     auto it = externalFunctions.find(name);
-    if (it == externalFunctions.end())
-        return nullptr;
-    return it->second;
+    if (it != externalFunctions.end())
+        return it->second;
+
+    // Maybe it's provided by a plugin that isn't loaded yet.  Loading
+    // happens without the lock, as it registers the plugin's functions.
+    for (auto dit = deferredFunctions.begin();
+         dit != deferredFunctions.end();  ++dit) {
+        if (!name.startsWith(dit->first))
+            continue;
+        auto entry = *dit;
+        deferredFunctions.erase(dit);
+        guard.unlock();
+        try {
+            (*entry.second)();
+        } MLDB_CATCH_ALL {
+            // Let a later lookup try again
+            guard.lock();
+            deferredFunctions.emplace_back(std::move(entry));
+            throw;
+        }
+        return tryLookupFunction(name);
+    }
+
+    return nullptr;
 }
 
 BoundFunction
@@ -407,6 +474,16 @@ doGetBoundParameter(const Utf8String & paramName)
                               + " does not support bound parameters ($1... or $name)");
 }
 
+ColumnGetter
+SqlBindingScope::
+doGetWindowFunction(const WindowFunctionExpression & expr)
+{
+    throw HttpReturnException(400, "Window functions can only be used in the "
+                              "SELECT clause of a query over a single "
+                              "dataset, without a GROUP BY",
+                              "expression", expr.surface);
+}
+
 std::shared_ptr<Dataset>
 SqlBindingScope::
 doGetDataset(const Utf8String & datasetName)
@@ -423,6 +500,13 @@ doGetDatasetFromConfig(const Any & datasetConfig)
                               + " does not support getting datasets");
 }
 
+TableSample
+SqlBindingScope::
+doGetTableSample()
+{
+    return TableSample();
+}
+
 TableOperations
 SqlBindingScope::
 doGetTable(const Utf8String & tableName)
@@ -942,6 +1026,98 @@ static bool peekKeyword(ParseContext & context, const char * keyword)
     return matchKeyword(context, keyword);
 }
 
+/** Parse one end of the frame of a window function, like "2 PRECEDING" or
+    "CURRENT ROW".
+*/
+static WindowFrameBound
+parseWindowFrameBound(ParseContext & context, WindowFrameUnit unit)
+{
+    skip_whitespace(context);
+    if (matchKeyword(context, "UNBOUNDED PRECEDING"))
+        return WindowFrameBound(WindowFrameBound::UNBOUNDED_PRECEDING);
+    else if (matchKeyword(context, "UNBOUNDED FOLLOWING"))
+        return WindowFrameBound(WindowFrameBound::UNBOUNDED_FOLLOWING);
+    else if (matchKeyword(context, "CURRENT ROW"))
+        return WindowFrameBound(WindowFrameBound::CURRENT_ROW);
+
+    double offset;
+    if (unit == WINDOW_ROWS)
+        offset = context.expect_unsigned_long_long
+            (0, ULONG_LONG_MAX, "expected number of rows in window frame");
+    else offset = context.expect_double
+             (0, INFINITY, "expected non-negative offset in window frame");
+
+    if (matchKeyword(context, "PRECEDING"))
+        return WindowFrameBound(WindowFrameBound::PRECEDING, offset);
+    expectKeyword(context, "FOLLOWING");
+    return WindowFrameBound(WindowFrameBound::FOLLOWING, offset);
+}
+
+/** Parse the part of a window function after its OVER (, up to and
+    including the closing parenthesis:
+
+    [PARTITION BY expr, ...] [ORDER BY expr [ASC|DESC], ...]
+    [{ROWS|RANGE} {start | BETWEEN start AND end}]
+*/
+static std::shared_ptr<SqlExpression>
+parseWindowFunction(ParseContext & context,
+                    Utf8String functionName,
+                    std::vector<std::shared_ptr<SqlExpression> > args,
+                    bool allowUtf8)
+{
+    std::vector<std::shared_ptr<SqlExpression> > partitionBy;
+    if (matchKeyword(context, "PARTITION BY ")) {
+        do {
+            partitionBy.emplace_back
+                (SqlExpression::parse(context, 10 /* precedence */,
+                                      allowUtf8));
+            skip_whitespace(context);
+        } while (context.match_literal(','));
+    }
+
+    OrderByExpression orderBy;
+    if (matchKeyword(context, "ORDER BY ")) {
+        orderBy = OrderByExpression::parse(context, allowUtf8);
+    }
+
+    WindowFrame frame;
+    bool hasFrame = true;
+    if (matchKeyword(context, "ROWS "))
+        frame.unit = WINDOW_ROWS;
+    else if (matchKeyword(context, "RANGE "))
+        frame.unit = WINDOW_RANGE;
+    else hasFrame = false;
+
+    if (hasFrame) {
+        if (matchKeyword(context, "BETWEEN ")) {
+            frame.start = parseWindowFrameBound(context, frame.unit);
+            expectKeyword(context, "AND ");
+            frame.end = parseWindowFrameBound(context, frame.unit);
+        }
+        else {
+            frame.start = parseWindowFrameBound(context, frame.unit);
+            frame.end = WindowFrameBound(WindowFrameBound::CURRENT_ROW);
+        }
+
+        if (frame.start.type == WindowFrameBound::UNBOUNDED_FOLLOWING)
+            context.exception("A window frame can't start at UNBOUNDED "
+                              "FOLLOWING");
+        if (frame.end.type == WindowFrameBound::UNBOUNDED_PRECEDING)
+            context.exception("A window frame can't end at UNBOUNDED "
+                              "PRECEDING");
+        if (frame.needsOrderValue() && orderBy.clauses.size() != 1)
+            context.exception("A RANGE window frame with an offset needs "
+                              "exactly one ORDER BY expression");
+    }
+
+    skip_whitespace(context);
+    context.expect_literal(')', "expected ')' to close window definition");
+
+    return std::make_shared<WindowFunctionExpression>
+        (std::move(functionName), std::move(args), std::move(partitionBy),
+         std::move(orderBy), std::move(frame));
+}
+
 void matchSingleQuoteStringAscii(ParseContext & context, std::string& resultStr)
 {
     {
@@ -1431,8 +1607,31 @@ parse(ParseContext & context, int currentPrecedence, bool allowUtf8)
                          "of x.y.rowName()");
                 }
 
-                lhs = std::make_shared<FunctionCallExpression>
-                    (tableName, functionName, args);
+                // fn(args) OVER (...) is a window function.  OVER is only
+                // a keyword when it's followed by a parenthesis.
+                bool isWindowFunction = false;
+                {
+                    ParseContext::Revert_Token overToken(context);
+                    if (matchKeyword(context, "OVER")) {
+                        skip_whitespace(context);
+                        if (context.match_literal('(')) {
+                            overToken.ignore();
+                            isWindowFunction = true;
+                        }
+                    }
+                }
+
+                if (isWindowFunction) {
+                    if (!tableName.empty())
+                        context.exception("Window functions can't be "
+                                          "called on a table");
+                    lhs = parseWindowFunction(context, functionName,
+                                              std::move(args), allowUtf8);
+                }
+                else {
+                    lhs = std::make_shared<FunctionCallExpression>
+                        (tableName, functionName, args);
+                }
 
                 lhs->surface = ML::trim(token.captured());
                
@@ -2552,6 +2751,50 @@ apply(const SqlRowScope & context) const
     return sortFields;
 }
 
+std::vector<ExpressionValue>
+BoundOrderByExpression::
+applyWithSortKey(const SqlRowScope & context) const
+{
+    std::vector<ExpressionValue> sortFields = apply(context);
+
+    std::string key;
+    bool encoded = true;
+    for (unsigned i = 0;  i < clauses.size() && encoded;  ++i) {
+        encoded = sortFields[i].appendSortKey(key, clauses[i].dir == DESC);
+    }
+
+    if (encoded)
+        sortFields.emplace_back(CellValue::blob(std::move(key)),
+                                Date::negativeInfinity());
+    else sortFields.emplace_back();
+
+    return sortFields;
+}
+
+bool
+BoundOrderByExpression::
+lessWithSortKey(const std::vector<ExpressionValue> & vec1,
+                const std::vector<ExpressionValue> & vec2) const
+{
+    ExcAssertEqual(vec1.size(), clauses.size() + 1);
+    ExcAssertEqual(vec2.size(), clauses.size() + 1);
+
+    const ExpressionValue & key1 = vec1.back();
+    const ExpressionValue & key2 = vec2.back();
+
+    if (key1.empty() || key2.empty())
+        return less(vec1, vec2);
+
+    const CellValue & blob1 = key1.getAtom();
+    const CellValue & blob2 = key2.getAtom();
+    size_t len1 = blob1.blobLength(), len2 = blob2.blobLength();
+    int cmp = std::memcmp(blob1.blobData(), blob2.blobData(),
+                          std::min(len1, len2));
+    if (cmp != 0)
+        return cmp < 0;
+    return len1 < len2;
+}
+
 int
 BoundOrderByExpression::
 compare(const std::vector<ExpressionValue> & vec1,
@@ -3124,10 +3367,116 @@ parse(const Utf8String & expr,
     return select;
 }
 
+namespace {
+
+/** Bind a select expression where every clause is of the form "x AS y"
+    with a single element name, and no two names are the same.  The
+    output schema is then closed and known at bind time, so each row can
+    be built directly in its final sorted order.  This avoids building a
+    single column row for each clause and then merging, sorting and
+    deduplicating them, which dominates the cost of wide selects.
+
+    Returns an empty BoundSqlExpression if the clauses don't qualify.
+*/
+BoundSqlExpression
+bindNamedColumns(const SelectExpression & select,
+                 SqlBindingScope & context)
+{
+    const auto & clauses = select.clauses;
+
+    std::vector<const NamedColumnExpression *> named;
+    named.reserve(clauses.size());
+    for (auto & c: clauses) {
+        auto n = dynamic_cast<const NamedColumnExpression *>(c.get());
+        if (!n || n->alias.size() != 1 || n->alias[0].null())
+            return BoundSqlExpression();
+        named.push_back(n);
+    }
+
+    if (named.empty())
+        return BoundSqlExpression();
+
+    // Sort the clauses by output name, which is how a structured row
+    // stores its columns, and check that the names are unique
+    std::vector<size_t> order(named.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&] (size_t i1, size_t i2)
+              {
+                  return named[i1]->alias[0].compare(named[i2]->alias[0]) < 0;
+              });
+
+    for (size_t i = 1;  i < order.size();  ++i) {
+        if (named[order[i - 1]]->alias[0].compare(named[order[i]]->alias[0])
+            == 0)
+            return BoundSqlExpression();
+    }
+
+    // We bind in the original order, so that any side effects of binding
+    // happen in the same order as the generic path
+    std::vector<BoundSqlExpression> boundExprs(named.size());
+    for (size_t i = 0;  i < named.size();  ++i) {
+        boundExprs[i] = named[i]->expression->bind(context);
+        ExcAssert(boundExprs[i].info);
+    }
+
+    std::vector<KnownColumn> outputColumns;
+    outputColumns.reserve(named.size());
+    std::vector<PathElement> names;
+    names.reserve(named.size());
+    std::vector<BoundSqlExpression> sortedExprs;
+    sortedExprs.reserve(named.size());
+    for (size_t i: order) {
+        outputColumns.emplace_back(named[i]->alias, boundExprs[i].info,
+                                   COLUMN_IS_DENSE);
+        names.push_back(named[i]->alias[0]);
+        sortedExprs.emplace_back(std::move(boundExprs[i]));
+    }
+
+    // The known columns are returned in clause order, as in the generic
+    // path
+    std::vector<KnownColumn> clauseOrderColumns(named.size());
+    for (size_t i = 0;  i < order.size();  ++i)
+        clauseOrderColumns[order[i]] = outputColumns[i];
+
+    auto outputInfo = std::make_shared<RowValueInfo>
+        (std::move(clauseOrderColumns), SCHEMA_CLOSED);
+
+    auto exec = [=] (const SqlRowScope & context,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter) -> const ExpressionValue &
+        {
+            StructValue result;
+            result.reserve(sortedExprs.size());
+            for (size_t i = 0;  i < sortedExprs.size();  ++i) {
+                ExpressionValue valStorage;
+                const ExpressionValue & v
+                    = sortedExprs[i](context, valStorage, filter);
+                if (&v == &valStorage)
+                    result.emplace_back(names[i], std::move(valStorage));
+                else result.emplace_back(names[i], v);
+            }
+
+            return storage = ExpressionValue(std::move(result),
+                                             ExpressionValue::SORTED,
+                                             ExpressionValue::NO_DUPLICATES);
+        };
+
+    // Named clauses are never constant (see NamedColumnExpression::bind)
+    return BoundSqlExpression(exec, &select, outputInfo,
+                              false /* isConstant */);
+}
+
+} // file scope
+
 BoundSqlExpression
 SelectExpression::
 bind(SqlBindingScope & context) const
 {
+    BoundSqlExpression closed = bindNamedColumns(*this, context);
+    if (closed)
+        return closed;
+
     vector<BoundSqlExpression> boundClauses;
     for (auto & c: clauses)
         boundClauses.emplace_back(c->bind(context));
@@ -3343,6 +3692,69 @@ TableExpression::
 {
 }
 
+/** Parse what follows TABLESAMPLE after a dataset, which is either
+    (<n> PERCENT) or (<n> ROWS), optionally followed by REPEATABLE (<seed>)
+    to get the same sample every time.  It becomes a call to the sample()
+    dataset function under the alias of the dataset, with the hash method
+    for a percentage, so that the sample is made in one scan of the rows
+    without listing them, and the reservoir method for a number of rows.
+*/
+static std::shared_ptr<NamedDatasetExpression>
+parseTableSample(ParseContext & context,
+                 std::shared_ptr<NamedDatasetExpression> dataset)
+{
+    skip_whitespace(context);
+    context.expect_literal('(', "Expected '(' after TABLESAMPLE");
+    skip_whitespace(context);
+    double amount = context.expect_double();
+
+    StructValue options;
+    if (matchKeyword(context, "PERCENT")) {
+        if (!(amount > 0.0 && amount <= 100.0))
+            context.exception("TABLESAMPLE percentage must be more than 0 "
+                              "and at most 100");
+        options.emplace_back(PathElement("method"),
+                             ExpressionValue("hash", Date::notADate()));
+        options.emplace_back(PathElement("fraction"),
+                             ExpressionValue(amount / 100.0, Date::notADate()));
+    }
+    else if (matchKeyword(context, "ROWS")) {
+        if (amount < 1.0 || amount != std::floor(amount)
+            || amount > std::numeric_limits<unsigned>::max())
+            context.exception("TABLESAMPLE number of rows must be a "
+                              "positive integer");
+        options.emplace_back(PathElement("method"),
+                             ExpressionValue("reservoir", Date::notADate()));
+        options.emplace_back(PathElement("rows"),
+                             ExpressionValue((uint64_t)amount,
+                                             Date::notADate()));
+    }
+    else context.exception("Expected PERCENT or ROWS in TABLESAMPLE clause");
+
+    skip_whitespace(context);
+    context.expect_literal(')', "Expected ')' to close TABLESAMPLE clause");
+
+    if (matchKeyword(context, "REPEATABLE")) {
+        skip_whitespace(context);
+        context.expect_literal('(', "Expected '(' after REPEATABLE");
+        skip_whitespace(context);
+        unsigned long seed = context.expect_unsigned_long
+            (0, std::numeric_limits<unsigned>::max());
+        skip_whitespace(context);
+        context.expect_literal(')', "Expected ')' to close REPEATABLE clause");
+        options.emplace_back(PathElement("seed"),
+                             ExpressionValue((uint64_t)seed, Date::notADate()));
+    }
+
+    std::vector<std::shared_ptr<TableExpression> > args = { dataset };
+    auto result = std::make_shared<DatasetFunctionExpression>
+        ("sample", args,
+         std::make_shared<ConstantExpression>
+             (ExpressionValue(std::move(options))));
+    result->setDatasetAlias(dataset->getAs());
+    return result;
+}
+
 std::shared_ptr<TableExpression>
 TableExpression::
 parse(ParseContext & context, int currentPrecedence, bool allowUtf8)
@@ -3491,6 +3903,9 @@ parse(ParseContext & context, int currentPrecedence, bool allowUtf8)
                 expr->setDatasetAlias(asName);
             }
 
+            if (matchKeyword(context, "TABLESAMPLE"))
+                expr = parseTableSample(context, expr);
+
             result = expr;
             result->surface = ML::trim(token.captured());
         }
@@ -3704,19 +4119,10 @@ parse(ParseContext & context, bool allowUtf8) {
     return WhenExpression(result);
 }
 
+template<typename PassValue>
 static bool filterWhen(ExpressionValue & val,
-                       const SqlRowScope & rowScope,
-                       const BoundSqlExpression & boundWhen)
+                       const PassValue & passValue)
 {
-    auto passValue = [&] (Date timestamp)
-        {
-            auto tupleScope
-                = SqlExpressionWhenScope
-                ::getRowScope(rowScope, timestamp);
-
-            return boundWhen(tupleScope, GET_LATEST).isTrue();
-        };
-
     if (val.isEmbedding() || val.isAtom() || val.empty()) {
         // Don't deconstruct an embedding or an atom; either pass or not
         // based upon the timestamp (there is only a single timestamp)
@@ -3731,7 +4137,7 @@ static bool filterWhen(ExpressionValue & val,
     auto onColumn = [&] (const PathElement & columnName,
                          ExpressionValue val)
         {
-            bool keepThisOne = filterWhen(val, rowScope, boundWhen);
+            bool keepThisOne = filterWhen(val, passValue);
             if (keepThisOne) {
                 kept.emplace_back(std::move(columnName), std::move(val));
             }
@@ -3748,6 +4154,123 @@ static bool filterWhen(ExpressionValue & val,
     return !val.empty();
 }
 
+/** Narrow [earliest, latest] to the timestamps for which expr, a WHEN
+    clause, can be true.  Returns true if expr is exactly a test that the
+    timestamp is within the range, for any timestamp that is a date or
+    an infinity.  Only comparisons between value_timestamp() and constant
+    timestamps, and conjunctions of them, are understood; anything else
+    leaves the range as it is.
+*/
+static bool narrowWhenTimestampRange(const SqlExpression & expr,
+                                     Date & earliest, Date & latest)
+{
+    auto isValueTimestamp = [] (const SqlExpression & e)
+        {
+            auto fn = dynamic_cast<const FunctionCallExpression *>(&e);
+            return fn && fn->tableName.empty()
+                && fn->functionName == "value_timestamp"
+                && fn->args.empty();
+        };
+
+    auto getConstantTimestamp = [] (const SqlExpression & e, Date & ts)
+        {
+            if (!e.isConstant())
+                return false;
+            ExpressionValue val = e.constantValue();
+            if (!val.isAtom() || !val.getAtom().isTimestamp())
+                return false;
+            ts = val.getAtom().toTimestamp();
+            return !std::isnan(ts.secondsSinceEpoch());
+        };
+
+    // The first timestamp after ts and the last one before it
+    auto after = [] (Date ts)
+        {
+            return Date::fromSecondsSinceEpoch
+                (std::nextafter(ts.secondsSinceEpoch(), INFINITY));
+        };
+    auto before = [] (Date ts)
+        {
+            return Date::fromSecondsSinceEpoch
+                (std::nextafter(ts.secondsSinceEpoch(), -INFINITY));
+        };
+
+    auto atLeast = [&] (Date ts) { earliest.setMax(ts); };
+    auto atMost = [&] (Date ts) { latest.setMin(ts); };
+
+    // Nothing is after +infinity or before -infinity
+    auto nothing = [&] ()
+        {
+            earliest = Date::positiveInfinity();
+            latest = Date::negativeInfinity();
+        };
+
+    if (auto op = dynamic_cast<const BooleanOperatorExpression *>(&expr)) {
+        if (op->op != "AND" || !op->lhs || !op->rhs)
+            return false;
+        bool lhsExact = narrowWhenTimestampRange(*op->lhs, earliest, latest);
+        bool rhsExact = narrowWhenTimestampRange(*op->rhs, earliest, latest);
+        return lhsExact && rhsExact;
+    }
+
+    if (auto between = dynamic_cast<const BetweenExpression *>(&expr)) {
+        Date lower, upper;
+        if (between->notBetween
+            || !isValueTimestamp(*between->expr)
+            || !getConstantTimestamp(*between->lower, lower)
+            || !getConstantTimestamp(*between->upper, upper))
+            return false;
+        atLeast(lower);
+        atMost(upper);
+        return true;
+    }
+
+    auto comp = dynamic_cast<const ComparisonExpression *>(&expr);
+    if (!comp || !comp->lhs || !comp->rhs)
+        return false;
+
+    // Put value_timestamp() on the left hand side
+    std::string op = comp->op;
+    Date ts;
+    if (isValueTimestamp(*comp->lhs)
+        && getConstantTimestamp(*comp->rhs, ts)) {
+    }
+    else if (isValueTimestamp(*comp->rhs)
+             && getConstantTimestamp(*comp->lhs, ts)) {
+        if (op == "<")
+            op = ">";
+        else if (op == "<=")
+            op = ">=";
+        else if (op == ">")
+            op = "<";
+        else if (op == ">=")
+            op = "<=";
+    }
+    else return false;
+
+    if (op == "=" || op == "==") {
+        atLeast(ts);
+        atMost(ts);
+    }
+    else if (op == ">=")
+        atLeast(ts);
+    else if (op == "<=")
+        atMost(ts);
+    else if (op == ">") {
+        if (ts == Date::positiveInfinity())
+            nothing();
+        else atLeast(after(ts));
+    }
+    else if (op == "<") {
+        if (ts == Date::negativeInfinity())
+            nothing();
+        else atMost(before(ts));
+    }
+    else return false;
+
+    return true;
+}
+
 BoundWhenExpression
 WhenExpression::
 bind(SqlBindingScope & scope) const
@@ -3799,16 +4322,55 @@ bind(SqlBindingScope & scope) const
         return { filterInPlace, this };
     }
 
+    Date earliest = Date::negativeInfinity();
+    Date latest = Date::positiveInfinity();
+    bool isRange = narrowWhenTimestampRange(*when, earliest, latest);
+
     // Executing a when expression will filter the row by the expression,
     // applying it to each of the tuples
     std::function<void (ExpressionValue &, const SqlRowScope &)>
         filterInPlace = [=] (ExpressionValue & row,
                              const SqlRowScope & rowScope)
         {
-            filterWhen(row, rowScope, boundWhen);
+            auto passValue = [&] (Date timestamp)
+                {
+                    auto tupleScope
+                        = SqlExpressionWhenScope
+                        ::getRowScope(rowScope, timestamp);
+
+                    return boundWhen(tupleScope, GET_LATEST).isTrue();
+                };
+
+            filterWhen(row, passValue);
         };
 
-    return { filterInPlace, this };
+    // When the clause is exactly a range, it is tested directly on the
+    // timestamps.  A timestamp that's not a date compares differently, and
+    // so still goes through the expression.
+    if (isRange) {
+        filterInPlace = [=] (ExpressionValue & row,
+                             const SqlRowScope & rowScope)
+            {
+                auto passValue = [&] (Date timestamp)
+                    {
+                        if (MLDB_UNLIKELY(std::isnan
+                                          (timestamp.secondsSinceEpoch()))) {
+                            auto tupleScope
+                                = SqlExpressionWhenScope
+                                ::getRowScope(rowScope, timestamp);
+                            return boundWhen(tupleScope, GET_LATEST).isTrue();
+                        }
+                        return timestamp >= earliest && timestamp <= latest;
+                    };
+
+                filterWhen(row, passValue);
+            };
+    }
+
+    BoundWhenExpression result(filterInPlace, this);
+    result.earliest = earliest;
+    result.latest = latest;
+    return result;
 }
 
 Utf8String
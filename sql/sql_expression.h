@@ -75,6 +75,7 @@ struct MldbServer;
 struct BasicRowGenerator;
 struct WhenExpression;
 struct SqlExpressionDatasetScope;
+struct WindowFunctionExpression;
 struct TableOperations;
 struct RowStream;
 
@@ -127,6 +128,58 @@ struct BoundExpressionMetadata {
 DECLARE_STRUCTURE_DESCRIPTION(BoundExpressionMetadata);
 
 
+/*****************************************************************************/
+/* SQL BATCH                                                                 */
+/*****************************************************************************/
+
+/** Maximum number of rows that are processed in a single call to the
+    batch execution function of a bound expression.
+*/
+static constexpr size_t SQL_BATCH_SIZE = 1024;
+
+/** Numeric values of an expression over a batch of rows, used by the
+    vectorized execution path.  Each row has a state telling whether its
+    value is a plain number, a null, or whether it can't be represented
+    in this form (for example a NaN, which has different ordering
+    semantics in SQL than in IEEE arithmetic, or a string) and so that
+    row needs to be evaluated using the scalar path.
+*/
+struct SqlBatchValues {
+    enum State: uint8_t {
+        VALUE = 0,    ///< values[i] holds the number
+        NULLVAL = 1,  ///< The value is null
+        SCALAR = 2    ///< Row must be evaluated with the scalar path
+    };
+
+    double values[SQL_BATCH_SIZE];
+    uint8_t states[SQL_BATCH_SIZE];
+};
+
+/** Scope over which a batch of rows is evaluated.  It provides, for each
+    column, the values of the column over the rows in the batch.
+*/
+struct SqlBatchScope {
+    SqlBatchScope(size_t numRows = 0)
+        : numRows(numRows)
+    {
+    }
+
+    virtual ~SqlBatchScope()
+    {
+    }
+
+    /// Number of rows in the batch; at most SQL_BATCH_SIZE
+    size_t numRows;
+
+    /** Fill in the first numRows entries of output with the values of the
+        given column, which is named as it was returned from the binding
+        scope's doGetColumn() method.
+    */
+    virtual void getColumn(const ColumnPath & columnName,
+                           SqlBatchValues & output) const = 0;
+};
+
+
 /*****************************************************************************/
 /* BOUND ROW EXPRESSION                                                      */
 /*****************************************************************************/
@@ -152,6 +205,16 @@ struct BoundSqlExpression {
                                                    ExpressionValue & storage,
                                                    const VariableFilter & filter)> ExecFunction;
 
+    /** Function type to execute the expression over a batch of rows at
+        once, writing one numeric value per row into output.  This is an
+        optional, vectorized alternative to exec which is only provided by
+        expressions that can be evaluated purely numerically; callers must
+        fall back to exec when it is not set, and for each row whose
+        output state is SCALAR.
+    */
+    typedef std::function<void (const SqlBatchScope & scope,
+                                SqlBatchValues & output)> BatchExecFunction;
+
     BoundSqlExpression()
     {
     }
@@ -166,6 +229,9 @@ struct BoundSqlExpression {
     ExecFunction exec;
     std::shared_ptr<const SqlExpression> expr;
 
+    /// Vectorized version of exec.  May be empty; see BatchExecFunction.
+    BatchExecFunction batchExec;
+
     /// What kind of value does this return?
     std::shared_ptr<ExpressionValueInfo> info;
 
@@ -284,6 +350,10 @@ struct ColumnGetter {
     
     /// Function that describes the characteristics of the return type
     std::shared_ptr<ExpressionValueInfo> info;
+
+    /// If set, the column can also be read in batch form under this name
+    /// from a SqlBatchScope.
+    ColumnPath batchColumnName;
     
     /// Make it feel like it's just a callable function
     const ExpressionValue & operator () (const SqlRowScope & context,
@@ -355,6 +425,15 @@ struct BoundFunction {
     /// Extra metadata about the result
     BoundExpressionMetadata resultMetadata;
 
+    /** Optional vectorized version of exec, called with the batch values of
+        each argument.  Only valid when every argument was itself bound
+        with a batchExec.
+    */
+    typedef std::function<void (const std::vector<const SqlBatchValues *> & args,
+                                size_t numRows,
+                                SqlBatchValues & output)> BatchExec;
+    BatchExec batchExec;
+
     ExpressionValue operator () (const std::vector<ExpressionValue> & args,
                                  const SqlRowScope & context) const
     {
@@ -381,6 +460,15 @@ typedef std::function<BoundFunction(const Utf8String &,
 */
 std::shared_ptr<void> registerFunction(Utf8String name, ExternalFunction function);
 
+/** Register the functions with names starting with the given prefix as
+    provided by a plugin that hasn't been loaded yet.  When a function with
+    that prefix is looked up and not found, load() is called, which should
+    register it, before looking again.  The prefix is forgotten when the
+    returned value is destroyed.
+*/
+std::shared_ptr<void>
+registerDeferredFunctions(Utf8String prefix, std::function<void ()> load);
+
 /** Look up the given function.  Throws if not found. */
 ExternalFunction lookupFunction(const Utf8String & name);
 
@@ -549,6 +637,19 @@ typedef std::function<ExpressionValue (const ColumnPath & columnName,
 ColumnFunction;
 
 
+/*****************************************************************************/
+/* TABLE SAMPLE                                                              */
+/*****************************************************************************/
+
+/** How the rows that a scope runs over were sampled from a larger table,
+    for aggregators that estimate their result over the whole table.
+*/
+struct TableSample {
+    double fraction = 1.0;   ///< Fraction of the rows of the table sampled
+    uint64_t rows = 0;       ///< Number of rows in the sample
+};
+
+
 /*****************************************************************************/
 /* ROW EXPRESSION BINDING SCOPE                                              */
 /*****************************************************************************/
@@ -677,6 +778,15 @@ struct SqlBindingScope {
     virtual ColumnGetter
     doGetBoundParameter(const Utf8String & paramName);
 
+    /** Used to obtain the value of a window function for the current row.
+        A window function needs to see all of the rows of its partition
+        before any of them can be returned, so it's only available in
+        scopes that calculate them over all of their input before any row
+        is processed.  The default throws.
+    */
+    virtual ColumnGetter
+    doGetWindowFunction(const WindowFunctionExpression & expr);
+
     /** Used to obtain a dataset from a dataset name. */
     virtual std::shared_ptr<Dataset>
     doGetDataset(const Utf8String & datasetName);
@@ -689,6 +799,13 @@ struct SqlBindingScope {
     virtual TableOperations
     doGetTable(const Utf8String & tableName);
 
+    /** Return how the rows of the table that the scope runs over were
+        sampled, which for TABLESAMPLE or sample() is less than all of the
+        rows of the underlying dataset.  The default returns a fraction of
+        1, meaning that the rows are the whole table.
+    */
+    virtual TableSample doGetTableSample();
+
     /** Used to resolve the table name from a full identifier.
         This will split a variable identifier, with multiple dots,
         into a table name and a variable name, in the context of
@@ -1340,6 +1457,21 @@ struct BoundOrderByExpression {
         return compare(vec1, vec2, offset) == -1;
     }
 
+    /** Apply the order by expression to a row as apply() does, followed by
+        an extra field holding the binary sort key of the fields (see
+        ExpressionValue::appendSortKey()) as a blob.  The extra field is
+        null if one of the fields can't be encoded.
+    */
+    std::vector<ExpressionValue>
+    applyWithSortKey(const SqlRowScope & context) const;
+
+    /** Return if the first is less than the second, both of which come
+        from applyWithSortKey().  When both have a sort key, they are
+        compared with a single memcmp rather than field by field.
+    */
+    bool lessWithSortKey(const std::vector<ExpressionValue> & vec1,
+                         const std::vector<ExpressionValue> & vec2) const;
+
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(BoundOrderByExpression);
@@ -1659,6 +1791,23 @@ struct BoundWhenExpression {
 
     /// Expression that led to this bound expression
     const WhenExpression * expr;
+
+    /** Cells whose timestamp is before earliest or after latest are
+        always filtered out, which allows a dataset to skip reading the
+        rows whose cells all lie outside of the range.  The range is
+        unbounded unless the clause compares value_timestamp() with
+        constant timestamps, possibly within a conjunction.  It may be
+        empty (earliest after latest) if nothing can be kept.
+    */
+    Date earliest = Date::negativeInfinity();
+    Date latest = Date::positiveInfinity();
+
+    /// Does the clause restrict the timestamps that can be kept?
+    bool hasTimestampRange() const
+    {
+        return earliest != Date::negativeInfinity()
+            || latest != Date::positiveInfinity();
+    }
 };
 
 
@@ -17,6 +17,7 @@
 #include "mldb/base/scope.h"
 #include "mldb/sql/sql_utils.h"
 #include "mldb/jml/stats/distribution.h"
+#include "mldb/sql/dense_embedding.h"
 
 using namespace std;
 
@@ -25,6 +26,104 @@ using namespace std;
 namespace MLDB {
 
 
+/*****************************************************************************/
+/* CONSTANT FOLDING                                                          */
+/*****************************************************************************/
+
+// Vectorized version of a constant, which is only possible for numbers
+// and nulls.
+static BoundSqlExpression::BatchExecFunction
+batchConstant(const ExpressionValue & val)
+{
+    if (!val.empty() && !val.isNumber())
+        return nullptr;
+
+    double value = val.empty() ? 0.0 : val.toDouble();
+    // Integers that don't fit exactly into a double, like NaNs, need
+    // the scalar path to be compared correctly
+    bool exact = !std::isnan(value)
+        && (!val.isInteger() || std::abs(value) <= (double)(1ULL << 53));
+    uint8_t state = val.empty() ? SqlBatchValues::NULLVAL
+        : exact ? SqlBatchValues::VALUE
+        : SqlBatchValues::SCALAR;
+    return [=] (const SqlBatchScope & scope,
+                SqlBatchValues & output)
+        {
+            std::fill(output.values, output.values + scope.numRows, value);
+            std::fill(output.states, output.states + scope.numRows, state);
+        };
+}
+
+/** If the given expression only depends on constants, bind it to the
+    value it has, calculated once here rather than for every row.  Returns
+    false if it can't be folded, in which case it needs to be bound as
+    normal.
+
+    Errors are left to be raised when the expression is bound or run as
+    normal, so that for example a division by a constant zero isn't an
+    error for a query which doesn't have any rows to run it on.
+*/
+static bool
+bindFoldedConstant(const SqlExpression * expr,
+                   SqlBindingScope & scope,
+                   BoundSqlExpression & result)
+{
+    // Constant scopes are used to evaluate constants in the first place,
+    // including below
+    if (dynamic_cast<SqlExpressionConstantScope *>(&scope)
+        || !expr->isConstant())
+        return false;
+
+    SqlExpressionConstantScope constantScope;
+    BoundSqlExpression bound;
+    ExpressionValue val;
+    try {
+        bound = expr->bind(constantScope);
+        val = bound(constantScope.getRowScope(), GET_LATEST);
+    } MLDB_CATCH_ALL {
+        return false;
+    }
+
+    result = {[=] (const SqlRowScope &,
+                   ExpressionValue & storage,
+                   const VariableFilter & filter) -> const ExpressionValue &
+              {
+                  return storage = val;
+              },
+              expr,
+              bound.info,
+              true /* is constant */};
+    result.batchExec = batchConstant(val);
+    return true;
+}
+
+/** Tells if the expression gives the same value each time it's run on the
+    same row, so that two copies of it only need to be run once.  Function
+    calls can't be known to, for example rand(), and so aren't.
+*/
+static bool
+isRepeatable(const SqlExpression & expr)
+{
+    if (expr.getType() == "function")
+        return false;
+    for (auto & c: expr.getChildren()) {
+        if (!isRepeatable(*c))
+            return false;
+    }
+    return true;
+}
+
+/** Tells if the two operands of an operator are the same expression, which
+    only needs to be run once for each row.
+*/
+static bool
+sameOperands(const std::shared_ptr<SqlExpression> & lhs,
+             const std::shared_ptr<SqlExpression> & rhs)
+{
+    return lhs && rhs && lhs->print() == rhs->print() && isRepeatable(*lhs);
+}
+
+
 /*****************************************************************************/
 /* COMPARISON EXPRESSION                                                     */
 /*****************************************************************************/
@@ -53,12 +152,123 @@ static Date calcTs(const ExpressionValue & v1,
                     v2.getEffectiveTimestamp());
 }
 
+// Combine the states of two operands of a null-propagating operator.  A
+// null operand always gives a null, whatever the other one is.
+static inline uint8_t batchCombineStates(uint8_t l, uint8_t r)
+{
+    if (l == SqlBatchValues::NULLVAL || r == SqlBatchValues::NULLVAL)
+        return SqlBatchValues::NULLVAL;
+    return l | r;
+}
+
+// Vectorized version of a comparison.  Since both operands are plain
+// numbers (anything else is marked as SCALAR), comparing them as doubles
+// gives the same result as comparing the ExpressionValues.
+template<typename Op>
+static BoundSqlExpression::BatchExecFunction
+batchComparison(const BoundSqlExpression & boundLhs,
+                const BoundSqlExpression & boundRhs,
+                Op op)
+{
+    if (!boundLhs.batchExec || !boundRhs.batchExec)
+        return nullptr;
+
+    auto lhsExec = boundLhs.batchExec;
+    auto rhsExec = boundRhs.batchExec;
+
+    return [=] (const SqlBatchScope & scope, SqlBatchValues & output)
+        {
+            SqlBatchValues rhs;
+            lhsExec(scope, output);
+            rhsExec(scope, rhs);
+            for (size_t i = 0;  i < scope.numRows;  ++i) {
+                output.states[i]
+                    = batchCombineStates(output.states[i], rhs.states[i]);
+                output.values[i] = op(output.values[i], rhs.values[i]);
+            }
+        };
+}
+
+// Vectorized version of an arithmetic operator.  A NaN result needs to
+// be turned into a CellValue to get its SQL semantics, so those rows
+// are sent to the scalar path.
+template<typename Op>
+static BoundSqlExpression::BatchExecFunction
+batchArithmetic(const BoundSqlExpression & boundLhs,
+                const BoundSqlExpression & boundRhs,
+                Op op)
+{
+    if (!boundLhs.batchExec || !boundRhs.batchExec)
+        return nullptr;
+
+    auto lhsExec = boundLhs.batchExec;
+    auto rhsExec = boundRhs.batchExec;
+
+    return [=] (const SqlBatchScope & scope, SqlBatchValues & output)
+        {
+            SqlBatchValues rhs;
+            lhsExec(scope, output);
+            rhsExec(scope, rhs);
+            for (size_t i = 0;  i < scope.numRows;  ++i) {
+                // Adding 0.0 turns -0.0 into 0.0, like CellValue does
+                double v = op(output.values[i], rhs.values[i]) + 0.0;
+                uint8_t state
+                    = batchCombineStates(output.states[i], rhs.states[i]);
+                if (state == SqlBatchValues::VALUE && std::isnan(v))
+                    state = SqlBatchValues::SCALAR;
+                output.values[i] = v;
+                output.states[i] = state;
+            }
+        };
+}
+
+// Vectorized version of a unary numeric function
+static BoundSqlExpression::BatchExecFunction
+batchUnary(const BoundSqlExpression & boundArg,
+           double (*op) (double))
+{
+    if (!boundArg.batchExec)
+        return nullptr;
+
+    auto argExec = boundArg.batchExec;
+
+    return [=] (const SqlBatchScope & scope, SqlBatchValues & output)
+        {
+            argExec(scope, output);
+            for (size_t i = 0;  i < scope.numRows;  ++i) {
+                double v = op(output.values[i]) + 0.0;
+                if (output.states[i] == SqlBatchValues::VALUE && std::isnan(v))
+                    output.states[i] = SqlBatchValues::SCALAR;
+                output.values[i] = v;
+            }
+        };
+}
+
 BoundSqlExpression
 doComparison(const SqlExpression * expr,
              const BoundSqlExpression & boundLhs,
              const BoundSqlExpression & boundRhs,
-             bool (ExpressionValue::* op)(const ExpressionValue &) const)
+             bool (ExpressionValue::* op)(const ExpressionValue &) const,
+             bool sameOperands)
 {
+    if (sameOperands) {
+        // Run the operand once, and compare it with itself
+        return {[=] (const SqlRowScope & row, ExpressionValue & storage,
+                     const VariableFilter & filter)
+                -> const ExpressionValue &
+                {
+                    ExpressionValue lstorage;
+                    const ExpressionValue & l
+                        = boundLhs(row, lstorage, GET_LATEST);
+                    Date ts = l.getEffectiveTimestamp();
+                    if (l.empty())
+                        return storage = ExpressionValue::null(ts);
+                    return storage = ExpressionValue((l .* op)(l), ts);
+                },
+                expr,
+                std::make_shared<BooleanValueInfo>()};
+    }
+
     return {[=] (const SqlRowScope & row, ExpressionValue & storage,
                  const VariableFilter & filter)
             -> const ExpressionValue &
@@ -81,34 +291,62 @@ BoundSqlExpression
 ComparisonExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     auto boundLhs = lhs->bind(scope);
     auto boundRhs = rhs->bind(scope);
 
+    bool same = sameOperands(lhs, rhs);
+
+    BoundSqlExpression result;
+
     if (op == "=" || op == "==") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator ==);
+        result = doComparison(this, boundLhs, boundRhs,
+                              &ExpressionValue::operator ==,
+                              same);
+        result.batchExec = batchComparison(boundLhs, boundRhs,
+                                           std::equal_to<double>());
     }
     else if (op == "!=") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator !=);
+        result = doComparison(this, boundLhs, boundRhs,
+                              &ExpressionValue::operator !=,
+                              same);
+        result.batchExec = batchComparison(boundLhs, boundRhs,
+                                           std::not_equal_to<double>());
     }
     else if (op == ">") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator > );
+        result = doComparison(this, boundLhs, boundRhs,
+                              &ExpressionValue::operator >,
+                              same);
+        result.batchExec = batchComparison(boundLhs, boundRhs,
+                                           std::greater<double>());
     }
     else if (op == "<") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator < );
+        result = doComparison(this, boundLhs, boundRhs,
+                              &ExpressionValue::operator <,
+                              same);
+        result.batchExec = batchComparison(boundLhs, boundRhs,
+                                           std::less<double>());
     }
     else if (op == ">=") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator >=);
+        result = doComparison(this, boundLhs, boundRhs,
+                              &ExpressionValue::operator >=,
+                              same);
+        result.batchExec = batchComparison(boundLhs, boundRhs,
+                                           std::greater_equal<double>());
     }
     else if (op == "<=") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator <=);
+        result = doComparison(this, boundLhs, boundRhs,
+                              &ExpressionValue::operator <=,
+                              same);
+        result.batchExec = batchComparison(boundLhs, boundRhs,
+                                           std::less_equal<double>());
     }
     else throw HttpReturnException(400, "Unknown comparison op " + op);
+
+    return result;
 }
 
 Utf8String
@@ -180,6 +418,79 @@ struct BinaryOpHelper {
     struct RowScope;
     struct UnknownContext;
 
+    /** Apply the operation directly to the elements of embeddings stored
+        as floats or doubles, either with each other or with a number,
+        for operations that give the same result when done in double
+        precision as when done on each element as a CellValue.  Returns
+        false, leaving storage untouched, if it can't be done this way.
+    */
+    static bool applyDense(const ExpressionValue & lhs,
+                           const ExpressionValue & rhs,
+                           ExpressionValue & storage,
+                           const DimsVector & shape)
+    {
+        return applyDense(lhs, rhs, storage, shape,
+                          std::integral_constant<bool, Op::isDense>());
+    }
+
+    static bool applyDense(const ExpressionValue & lhs,
+                           const ExpressionValue & rhs,
+                           ExpressionValue & storage,
+                           const DimsVector & shape,
+                           std::false_type)
+    {
+        return false;
+    }
+
+    static bool applyDense(const ExpressionValue & lhs,
+                           const ExpressionValue & rhs,
+                           ExpressionValue & storage,
+                           const DimsVector & shape,
+                           std::true_type)
+    {
+        auto isNumber = [] (const ExpressionValue & val)
+            {
+                return val.isAtom() && val.getAtom().isNumber();
+            };
+
+        DenseEmbedding l, r;
+        bool ldense = l.bind(lhs), rdense = r.bind(rhs);
+        std::vector<double> result;
+
+        if (ldense && rdense) {
+            // Incompatible shapes are reported by the generic path
+            if (l.length != r.length)
+                return false;
+            result = l.toDoubles();
+            if (r.doubles) {
+                for (size_t i = 0;  i < result.size();  ++i)
+                    result[i] = Op::applyDense(result[i], r.doubles[i]);
+            }
+            else {
+                for (size_t i = 0;  i < result.size();  ++i)
+                    result[i] = Op::applyDense(result[i], r.floats[i]);
+            }
+        }
+        else if (ldense && isNumber(rhs)) {
+            double rval = rhs.getAtom().toDouble();
+            result = l.toDoubles();
+            for (double & v: result)
+                v = Op::applyDense(v, rval);
+        }
+        else if (rdense && isNumber(lhs)) {
+            double lval = lhs.getAtom().toDouble();
+            result = r.toDoubles();
+            for (double & v: result)
+                v = Op::applyDense(lval, v);
+        }
+        else return false;
+
+        Date ts = std::max(lhs.getEffectiveTimestamp(),
+                           rhs.getEffectiveTimestamp());
+        storage = ExpressionValue(std::move(result), ts, shape);
+        return true;
+    }
+
     static const ExpressionValue &
     genericApplyRowRowDynamic(const ExpressionValue & lhs,
                               const ExpressionValue & rhs,
@@ -353,6 +664,9 @@ struct BinaryOpHelper {
                           ExpressionValue & storage) const
         {
             // embedding * scalar
+            if (applyDense(lhs, rhs, storage, DimsVector()))
+                return storage;
+
             std::vector<CellValue> lcells = lhs.getEmbeddingCell();
             const CellValue & r = rhs.getAtom();
             for (auto & c: lcells)
@@ -470,6 +784,9 @@ struct BinaryOpHelper {
                        ExpressionValue & storage) const
         {
             // Scalar * embedding
+            if (applyDense(lhs, rhs, storage, DimsVector()))
+                return storage;
+
             std::vector<CellValue> rcells = rhs.getEmbeddingCell();
             const CellValue & l = lhs.getAtom();
             for (auto & c: rcells)
@@ -485,6 +802,9 @@ struct BinaryOpHelper {
                           ExpressionValue & storage) const
         {
             // embedding * embedding
+            if (applyDense(lhs, rhs, storage, lhs.getEmbeddingShape()))
+                return storage;
+
             std::vector<CellValue> lcells = lhs.getEmbeddingCell();
             std::vector<CellValue> rcells = rhs.getEmbeddingCell();
 
@@ -800,16 +1120,34 @@ struct BinaryOpHelper {
         
         return lhsContext.applyLhs(rhsContext, lhs, rhs, storage);
     }
+
+    // Both operands are the same expression, which is only run once
+    template<class LhsContext, class RhsContext>
+    static const ExpressionValue &
+    applySame(const LhsContext & lhsContext,
+              const RhsContext & rhsContext,
+              const SqlRowScope & row,
+              ExpressionValue & storage,
+              const VariableFilter & filter)
+    {
+        ExpressionValue lstorage;
+        const ExpressionValue & lhs = lhsContext(row, lstorage, filter);
+
+        return lhsContext.applyLhs(rhsContext, lhs, lhs, storage);
+    }
     
     template<class LhsContext, class RhsContext>
     static BoundSqlExpression
     bindAll(LhsContext lhsContext,
             RhsContext rhsContext,
-            const SqlExpression * expr)
+            const SqlExpression * expr,
+            bool sameOperands)
     {
         BoundSqlExpression result;
         result.info = lhsContext.getInfoLhs(rhsContext);
-        result.exec = std::bind(apply<LhsContext, RhsContext>,
+        result.exec = std::bind(sameOperands
+                                ? applySame<LhsContext, RhsContext>
+                                : apply<LhsContext, RhsContext>,
                                 lhsContext,
                                 rhsContext,
                                 std::placeholders::_1,
@@ -824,7 +1162,8 @@ struct BinaryOpHelper {
     static BoundSqlExpression
     bindRhs(LhsContext lhsContext,
             const SqlExpression * expr,
-            const BoundSqlExpression & boundRhs)
+            const BoundSqlExpression & boundRhs,
+            bool sameOperands)
     {
         int scalar = boundRhs.info->isScalar();
         int embedding = boundRhs.info->isEmbedding();
@@ -834,26 +1173,27 @@ struct BinaryOpHelper {
 
         if (total == 1 && scalar) {
             ScalarContext rhsContext(boundRhs);
-            return bindAll(lhsContext, rhsContext, expr);
+            return bindAll(lhsContext, rhsContext, expr, sameOperands);
         }
         else if (embedding && !scalar) {
             EmbeddingContext rhsContext(boundRhs);
-            return bindAll(lhsContext, rhsContext, expr);
+            return bindAll(lhsContext, rhsContext, expr, sameOperands);
         }
         else if (row && !scalar) {
             RowScope rhsContext(boundRhs);
-            return bindAll(lhsContext, rhsContext, expr);
+            return bindAll(lhsContext, rhsContext, expr, sameOperands);
         }
         else {
             UnknownContext rhsContext(boundRhs);
-            return bindAll(lhsContext, rhsContext, expr);
+            return bindAll(lhsContext, rhsContext, expr, sameOperands);
         }
     }
 
     static BoundSqlExpression
     bind(const SqlExpression * expr,
          const BoundSqlExpression & boundLhs,
-         const BoundSqlExpression & boundRhs)
+         const BoundSqlExpression & boundRhs,
+         bool sameOperands)
     {
         int scalar = boundLhs.info->isScalar();
         int embedding = boundLhs.info->isEmbedding();
@@ -863,19 +1203,19 @@ struct BinaryOpHelper {
 
         if (total == 1 && scalar) {
             ScalarContext lhsContext(boundLhs);
-            return bindRhs(lhsContext, expr, boundRhs);
+            return bindRhs(lhsContext, expr, boundRhs, sameOperands);
         }
         else if (embedding && !scalar) {
             EmbeddingContext lhsContext(boundLhs);
-            return bindRhs(lhsContext, expr, boundRhs);
+            return bindRhs(lhsContext, expr, boundRhs, sameOperands);
         }
         else if (row && !scalar) {
             RowScope lhsContext(boundLhs);
-            return bindRhs(lhsContext, expr, boundRhs);
+            return bindRhs(lhsContext, expr, boundRhs, sameOperands);
         }
         else {
             UnknownContext lhsContext(boundLhs);
-            return bindRhs(lhsContext, expr, boundRhs);
+            return bindRhs(lhsContext, expr, boundRhs, sameOperands);
         }
     }
 };
@@ -1177,6 +1517,14 @@ struct BinaryPlusOp {
         return binaryPlus(l, r);
     }
 
+    /// Numbers are operated on as doubles, so dense embeddings can be too
+    static constexpr bool isDense = true;
+
+    static double applyDense(double l, double r)
+    {
+        return l + r;
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1194,6 +1542,14 @@ struct BinaryMinusOp {
         return binaryMinus(l, r);
     }
 
+    /// Numbers are operated on as doubles, so dense embeddings can be too
+    static constexpr bool isDense = true;
+
+    static double applyDense(double l, double r)
+    {
+        return l - r;
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1211,6 +1567,14 @@ struct BinaryMultiplicationOp {
         return binaryMultiplication(l, r);
     }
 
+    /// Numbers are operated on as doubles, so dense embeddings can be too
+    static constexpr bool isDense = true;
+
+    static double applyDense(double l, double r)
+    {
+        return l * r;
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1228,6 +1592,14 @@ struct BinaryDivisionOp {
         return binaryDivision(l, r);
     }
 
+    /// Numbers are operated on as doubles, so dense embeddings can be too
+    static constexpr bool isDense = true;
+
+    static double applyDense(double l, double r)
+    {
+        return l / r;
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1245,6 +1617,9 @@ struct BinaryModulusOp {
         return binaryModulus(l, r);
     }
 
+    /// Integers are operated on as integers
+    static constexpr bool isDense = false;
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1257,29 +1632,54 @@ BoundSqlExpression
 ArithmeticExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     auto boundLhs = lhs ? lhs->bind(scope) : BoundSqlExpression();
     auto boundRhs = rhs->bind(scope);
 
+    bool same = sameOperands(lhs, rhs);
+
+    BoundSqlExpression result;
+
     if (op == "+" && lhs) {
-        return BinaryOpHelper<BinaryPlusOp>::bind(this, boundLhs, boundRhs);
+        result = BinaryOpHelper<BinaryPlusOp>
+            ::bind(this, boundLhs, boundRhs, same);
+        result.batchExec = batchArithmetic(boundLhs, boundRhs,
+                                           std::plus<double>());
+        return result;
     }
     else if (op == "-" && lhs) {
-        return BinaryOpHelper<BinaryMinusOp>::bind(this, boundLhs, boundRhs);
+        result = BinaryOpHelper<BinaryMinusOp>
+            ::bind(this, boundLhs, boundRhs, same);
+        result.batchExec = batchArithmetic(boundLhs, boundRhs,
+                                           std::minus<double>());
+        return result;
     }
     else if (op == "-" && !lhs) {
-        return doUnaryArithmetic<AtomValueInfo>(this, boundRhs, &unaryMinus);
+        result = doUnaryArithmetic<AtomValueInfo>(this, boundRhs, &unaryMinus);
+        result.batchExec = batchUnary(boundRhs,
+                                      [] (double v) -> double { return -v; });
+        return result;
     }
     else if (op == "*" && lhs) {
-        return BinaryOpHelper<BinaryMultiplicationOp>
-            ::bind(this, boundLhs, boundRhs);
+        result = BinaryOpHelper<BinaryMultiplicationOp>
+            ::bind(this, boundLhs, boundRhs, same);
+        result.batchExec = batchArithmetic(boundLhs, boundRhs,
+                                           std::multiplies<double>());
+        return result;
     }
     else if (op == "/" && lhs) {
-        return BinaryOpHelper<BinaryDivisionOp>
-            ::bind(this, boundLhs, boundRhs);
+        result = BinaryOpHelper<BinaryDivisionOp>
+            ::bind(this, boundLhs, boundRhs, same);
+        result.batchExec = batchArithmetic(boundLhs, boundRhs,
+                                           std::divides<double>());
+        return result;
     }
     else if (op == "%" && lhs) {
         return BinaryOpHelper<BinaryModulusOp>
-            ::bind(this, boundLhs, boundRhs);
+            ::bind(this, boundLhs, boundRhs, same);
     }
     else throw HttpReturnException(400, "Unknown arithmetic op " + op
                                    + (lhs ? " binary" : " unary"));
@@ -1423,6 +1823,10 @@ BoundSqlExpression
 BitwiseExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     auto boundLhs = lhs ? lhs->bind(scope) : BoundSqlExpression();
     auto boundRhs = rhs->bind(scope);
 
@@ -1519,15 +1923,27 @@ bind(SqlBindingScope & scope) const
                                   + "' didn't return info");
     }
 
-    return {[=] (const SqlRowScope & row,
-                 ExpressionValue & storage,
-                 const VariableFilter & filter) -> const ExpressionValue &
+    BoundSqlExpression result
+        {[=] (const SqlRowScope & row,
+              ExpressionValue & storage,
+              const VariableFilter & filter) -> const ExpressionValue &
             {
                 // TODO: allow it access to storage
                 return getVariable(row, storage, filter);
             },
             this,
             getVariable.info};
+
+    if (!getVariable.batchColumnName.empty()) {
+        ColumnPath batchColumnName = getVariable.batchColumnName;
+        result.batchExec = [=] (const SqlBatchScope & scope,
+                                SqlBatchValues & output)
+            {
+                scope.getColumn(batchColumnName, output);
+            };
+    }
+
+    return result;
 }
 
 Utf8String
@@ -1595,15 +2011,19 @@ bind(SqlBindingScope & scope) const
 {
     ExpressionValue val = constant;
 
-    return {[=] (const SqlRowScope &,
-                 ExpressionValue & storage,
-                 const VariableFilter & filter) -> const ExpressionValue &
+    BoundSqlExpression result
+        {[=] (const SqlRowScope &,
+              ExpressionValue & storage,
+              const VariableFilter & filter) -> const ExpressionValue &
             {
                 return storage=val;
             },
             this,
             constant.getSpecializedValueInfo(),
             true /* is constant */};
+    result.batchExec = batchConstant(val);
+
+    return result;
 }
 
 Utf8String
@@ -1921,88 +2341,195 @@ BooleanOperatorExpression::
 {
 }
 
+// Vectorized version of AND and OR.  The dominant value (false for AND,
+// true for OR) wins over everything else, including rows that need the
+// scalar path; then those rows, then nulls, as in the scalar version.
+static BoundSqlExpression::BatchExecFunction
+batchBoolean(const BoundSqlExpression & boundLhs,
+             const BoundSqlExpression & boundRhs,
+             bool isOr)
+{
+    if (!boundLhs.batchExec || !boundRhs.batchExec)
+        return nullptr;
+
+    auto lhsExec = boundLhs.batchExec;
+    auto rhsExec = boundRhs.batchExec;
+
+    return [=] (const SqlBatchScope & scope, SqlBatchValues & output)
+        {
+            SqlBatchValues rhs;
+            lhsExec(scope, output);
+            rhsExec(scope, rhs);
+
+            auto isDominant = [&] (uint8_t state, double value)
+                {
+                    return state == SqlBatchValues::VALUE
+                        && (value != 0.0) == isOr;
+                };
+
+            for (size_t i = 0;  i < scope.numRows;  ++i) {
+                uint8_t l = output.states[i], r = rhs.states[i];
+                if (isDominant(l, output.values[i])
+                    || isDominant(r, rhs.values[i])) {
+                    output.values[i] = isOr;
+                    output.states[i] = SqlBatchValues::VALUE;
+                }
+                else {
+                    output.values[i] = !isOr;
+                    output.states[i]
+                        = (l == SqlBatchValues::SCALAR || r == SqlBatchValues::SCALAR)
+                        ? SqlBatchValues::SCALAR
+                        : (l | r);
+                }
+            }
+        };
+}
+
+// Scalar version of AND, with the timestamp of the operand(s) which
+// decide the result
+static const ExpressionValue &
+booleanAnd(const ExpressionValue & l, const ExpressionValue & r,
+           ExpressionValue & storage)
+{
+    if (l.isFalse() && r.isFalse()) {
+        Date ts = std::min(l.getEffectiveTimestamp(),
+                           r.getEffectiveTimestamp());
+        return storage = ExpressionValue(false, ts);
+    }
+    else if (l.isFalse()) {
+        return storage = ExpressionValue(false, l.getEffectiveTimestamp());
+    }
+    else if (r.isFalse()) {
+        return storage = ExpressionValue(false, r.getEffectiveTimestamp());
+    }
+    else if (l.empty() && r.empty()) {
+        Date ts = std::min(l.getEffectiveTimestamp(),
+                           r.getEffectiveTimestamp());
+        return storage = ExpressionValue::null(ts);
+    }
+    else if (l.empty())
+        return storage = ExpressionValue::null(l.getEffectiveTimestamp());
+    else if (r.empty())
+        return storage = ExpressionValue::null(r.getEffectiveTimestamp());
+    Date ts = std::max(l.getEffectiveTimestamp(),
+                       r.getEffectiveTimestamp());
+    return storage = ExpressionValue(true, ts);
+}
+
+// Scalar version of OR, with the timestamp of the operand(s) which
+// decide the result
+static const ExpressionValue &
+booleanOr(const ExpressionValue & l, const ExpressionValue & r,
+          ExpressionValue & storage)
+{
+    if (l.isTrue() && r.isTrue()) {
+        Date ts = std::max(l.getEffectiveTimestamp(),
+                           r.getEffectiveTimestamp());
+        return storage = ExpressionValue(true, ts);
+    }
+    else if (l.isTrue()) {
+        return storage = ExpressionValue(true, l.getEffectiveTimestamp());
+    }
+    else if (r.isTrue()) {
+        return storage = ExpressionValue(true, r.getEffectiveTimestamp());
+    }
+    else if (l.empty() && r.empty()) {
+        Date ts = std::max(l.getEffectiveTimestamp(),
+                           r.getEffectiveTimestamp());
+        return storage = ExpressionValue::null(ts);
+    }
+    else if (l.empty())
+        return storage = ExpressionValue::null(l.getEffectiveTimestamp());
+    else if (r.empty())
+        return storage = ExpressionValue::null(r.getEffectiveTimestamp());
+    Date ts = std::min(l.getEffectiveTimestamp(),
+                       r.getEffectiveTimestamp());
+    return storage = ExpressionValue(false, ts);
+}
+
 BoundSqlExpression
 BooleanOperatorExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     auto boundLhs = lhs ? lhs->bind(scope) : BoundSqlExpression();
     auto boundRhs = rhs->bind(scope);
 
-    if (op == "AND" && lhs) {
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter) -> const ExpressionValue &
-                {
-                    ExpressionValue lstorage, rstorage;
-                    const ExpressionValue & l = boundLhs(row, lstorage, filter);
-                    const ExpressionValue & r = boundRhs(row, rstorage, filter);
-                    if (l.isFalse() && r.isFalse()) {
-                        Date ts = std::min(l.getEffectiveTimestamp(),
-                                           r.getEffectiveTimestamp());
-                        return storage = ExpressionValue(false, ts);
-                    }
-                    else if (l.isFalse()) {
-                        return storage = ExpressionValue(false, l.getEffectiveTimestamp());
-                    }
-                    else if (r.isFalse()) {
-                        return storage = ExpressionValue(false, r.getEffectiveTimestamp());
-                    }
-                    else if (l.empty() && r.empty()) {
-                        Date ts = std::min(l.getEffectiveTimestamp(),
-                                           r.getEffectiveTimestamp());
-                        return storage = ExpressionValue::null(ts);
-                    }
-                    else if (l.empty())
-                        return storage = ExpressionValue::null(l.getEffectiveTimestamp());
-                    else if (r.empty())
-                        return storage = ExpressionValue::null(r.getEffectiveTimestamp());
-                    Date ts = std::max(l.getEffectiveTimestamp(),
-                                       r.getEffectiveTimestamp());
-                    return storage = ExpressionValue(true, ts);
-                },
-                this,
-                std::make_shared<BooleanValueInfo>()};
-    }
-    else if (op == "OR" && lhs) {
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter)
-                -> const ExpressionValue &
-                {
-                    ExpressionValue lstorage, rstorage;
+    BoundSqlExpression result;
+
+    if ((op == "AND" || op == "OR") && lhs) {
+        bool isOr = op == "OR";
+        auto combine = isOr ? &booleanOr : &booleanAnd;
+
+        // If one side is constant (the other one isn't, or the whole
+        // expression would have been), it's calculated once here and only
+        // the other side is run for each row.
+        if (boundLhs.metadata.isConstant || boundRhs.metadata.isConstant) {
+            bool lhsConstant = boundLhs.metadata.isConstant;
+            const BoundSqlExpression & boundConstant
+                = lhsConstant ? boundLhs : boundRhs;
+            BoundSqlExpression boundOther = lhsConstant ? boundRhs : boundLhs;
+            ExpressionValue constant
+                = boundConstant(SqlExpressionConstantScope::getRowScope(),
+                                GET_LATEST);
 
-                    const ExpressionValue & l = boundLhs(row, lstorage, filter);
-                    const ExpressionValue & r = boundRhs(row, rstorage, filter);
+            // x AND false is always false, with the timestamp of the
+            // constant if it's the earliest possible one; x doesn't need
+            // to be run at all.  Both functions are symmetric, so the
+            // order of the operands doesn't matter.
+            if (!isOr && constant.isFalse()
+                && constant.getEffectiveTimestamp()
+                   == Date::negativeInfinity()) {
+                result = {[=] (const SqlRowScope & row,
+                               ExpressionValue & storage,
+                               const VariableFilter & filter)
+                          -> const ExpressionValue &
+                          {
+                              return storage = constant;
+                          },
+                          this,
+                          std::make_shared<BooleanValueInfo>()};
+                result.batchExec = batchConstant(constant);
+                return result;
+            }
 
-                    if (l.isTrue() && r.isTrue()) {
-                        Date ts = std::max(l.getEffectiveTimestamp(),
-                                           r.getEffectiveTimestamp());
-                        return storage = ExpressionValue(true, ts);
-                    }
-                    else if (l.isTrue()) {
-                        return storage = ExpressionValue(true, l.getEffectiveTimestamp());
-                    }
-                    else if (r.isTrue()) {
-                        return storage = ExpressionValue(true, r.getEffectiveTimestamp());
-                    }
-                    else if (l.empty() && r.empty()) {
-                        Date ts = std::max(l.getEffectiveTimestamp(),
-                                           r.getEffectiveTimestamp());
-                        return storage = ExpressionValue::null(ts);
-                    }
-                    else if (l.empty())
-                        return storage = ExpressionValue::null(l.getEffectiveTimestamp());
-                    else if (r.empty())
-                        return storage =ExpressionValue::null(r.getEffectiveTimestamp());
-                    Date ts = std::min(l.getEffectiveTimestamp(),
-                                       r.getEffectiveTimestamp());
-                    return storage = ExpressionValue(false, ts);
-                },
-                this,
-                std::make_shared<BooleanValueInfo>()};
+            result = {[=] (const SqlRowScope & row,
+                           ExpressionValue & storage,
+                           const VariableFilter & filter)
+                      -> const ExpressionValue &
+                      {
+                          ExpressionValue ostorage;
+                          const ExpressionValue & o
+                              = boundOther(row, ostorage, filter);
+                          return combine(o, constant, storage);
+                      },
+                      this,
+                      std::make_shared<BooleanValueInfo>()};
+        }
+        else {
+            result = {[=] (const SqlRowScope & row,
+                           ExpressionValue & storage,
+                           const VariableFilter & filter)
+                      -> const ExpressionValue &
+                      {
+                          ExpressionValue lstorage, rstorage;
+                          const ExpressionValue & l
+                              = boundLhs(row, lstorage, filter);
+                          const ExpressionValue & r
+                              = boundRhs(row, rstorage, filter);
+                          return combine(l, r, storage);
+                      },
+                      this,
+                      std::make_shared<BooleanValueInfo>()};
+        }
+        result.batchExec = batchBoolean(boundLhs, boundRhs, isOr);
+        return result;
     }
     else if (op == "NOT" && !lhs) {
-        return {[=] (const SqlRowScope & row,
+        result = {[=] (const SqlRowScope & row,
                      ExpressionValue & storage,
                      const VariableFilter & filter)
                 -> const ExpressionValue &
@@ -2015,6 +2542,18 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 std::make_shared<BooleanValueInfo>()};
+
+        if (boundRhs.batchExec) {
+            auto rhsExec = boundRhs.batchExec;
+            result.batchExec = [=] (const SqlBatchScope & scope,
+                                    SqlBatchValues & output)
+                {
+                    rhsExec(scope, output);
+                    for (size_t i = 0;  i < scope.numRows;  ++i)
+                        output.values[i] = output.values[i] == 0.0;
+                };
+        }
+        return result;
     }
     else throw HttpReturnException(400, "Unknown boolean op " + op
                              + (lhs ? " binary" : " unary"));
@@ -2094,6 +2633,10 @@ BoundSqlExpression
 IsTypeExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     auto boundExpr = expr->bind(scope);
 
     bool (ExpressionValue::* fn) () const;
@@ -2269,9 +2812,10 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 fn.resultMetadata};
     }
     else {
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter) -> const ExpressionValue &
+        BoundSqlExpression result
+            {[=] (const SqlRowScope & row,
+                  ExpressionValue & storage,
+                  const VariableFilter & filter) -> const ExpressionValue &
                 {
                     std::vector<ExpressionValue> evaluatedArgs;
                     evaluatedArgs.reserve(boundArgs.size());
@@ -2283,6 +2827,31 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 this,
                 fn.resultInfo,
                 fn.resultMetadata};
+
+        bool batchArgs = true;
+        for (auto & a: boundArgs)
+            batchArgs = batchArgs && a.batchExec;
+
+        if (fn.batchExec && batchArgs) {
+            std::vector<BoundSqlExpression::BatchExecFunction> argExecs;
+            for (auto & a: boundArgs)
+                argExecs.push_back(a.batchExec);
+            auto batchExec = fn.batchExec;
+
+            result.batchExec = [=] (const SqlBatchScope & scope,
+                                    SqlBatchValues & output)
+                {
+                    std::vector<SqlBatchValues> argValues(argExecs.size());
+                    std::vector<const SqlBatchValues *> args;
+                    for (size_t i = 0;  i < argExecs.size();  ++i) {
+                        argExecs[i](scope, argValues[i]);
+                        args.push_back(&argValues[i]);
+                    }
+                    batchExec(args, scope.numRows, output);
+                };
+        }
+
+        return result;
     }
 }
 
@@ -2376,6 +2945,131 @@ functionNames() const
 
     return result;
 }
+/*****************************************************************************/
+/* WINDOW FUNCTION EXPRESSION                                                */
+/*****************************************************************************/
+
+WindowFunctionExpression::
+WindowFunctionExpression(Utf8String functionName,
+                         std::vector<std::shared_ptr<SqlExpression> > args,
+                         std::vector<std::shared_ptr<SqlExpression> > partitionBy,
+                         OrderByExpression orderBy,
+                         WindowFrame frame)
+    : functionName(std::move(functionName)),
+      type(getWindowFunctionType(this->functionName)),
+      args(std::move(args)),
+      partitionBy(std::move(partitionBy)),
+      orderBy(std::move(orderBy)),
+      frame(std::move(frame))
+{
+    if (this->args.size() != getWindowFunctionArity(type))
+        throw HttpReturnException
+            (400, "Window function '" + this->functionName + "' takes "
+             + std::to_string(getWindowFunctionArity(type)) + " arguments",
+             "functionName", this->functionName,
+             "numArgs", this->args.size());
+}
+
+WindowFunctionExpression::
+~WindowFunctionExpression()
+{
+}
+
+BoundSqlExpression
+WindowFunctionExpression::
+bind(SqlBindingScope & scope) const
+{
+    auto getValue = scope.doGetWindowFunction(*this);
+
+    return {[=] (const SqlRowScope & row,
+                 ExpressionValue & storage,
+                 const VariableFilter & filter) -> const ExpressionValue &
+            {
+                return getValue(row, storage, filter);
+            },
+            this,
+            getValue.info};
+}
+
+Utf8String
+WindowFunctionExpression::
+print() const
+{
+    Utf8String result = "window(" + jsonEncodeUtf8(functionName);
+    for (auto & a: args)
+        result += "," + a->print();
+    result += ",partition(";
+    for (size_t i = 0;  i < partitionBy.size();  ++i) {
+        if (i > 0)
+            result += ",";
+        result += partitionBy[i]->print();
+    }
+    result += "),orderBy(" + orderBy.print() + "),"
+        + jsonEncodeUtf8(frame.print()) + ")";
+    return result;
+}
+
+std::shared_ptr<SqlExpression>
+WindowFunctionExpression::
+transform(const TransformArgs & transformArgs) const
+{
+    auto newChildren = transformArgs(getChildren());
+    auto result = std::make_shared<WindowFunctionExpression>(*this);
+
+    auto it = newChildren.begin();
+    for (auto & a: result->args)
+        a = *it++;
+    for (auto & p: result->partitionBy)
+        p = *it++;
+    for (auto & c: result->orderBy.clauses)
+        c.first = *it++;
+    ExcAssert(it == newChildren.end());
+
+    return result;
+}
+
+std::string
+WindowFunctionExpression::
+getType() const
+{
+    return "window";
+}
+
+Utf8String
+WindowFunctionExpression::
+getOperation() const
+{
+    return functionName;
+}
+
+std::vector<std::shared_ptr<SqlExpression> >
+WindowFunctionExpression::
+getChildren() const
+{
+    std::vector<std::shared_ptr<SqlExpression> > result = args;
+    result.insert(result.end(), partitionBy.begin(), partitionBy.end());
+    for (auto & c: orderBy.clauses)
+        result.push_back(c.first);
+    return result;
+}
+
+std::map<ScopedName, UnboundVariable>
+WindowFunctionExpression::
+variableNames() const
+{
+    std::map<ScopedName, UnboundVariable> result;
+
+    for (auto & c: getChildren()) {
+        auto childVars = (*c).variableNames();
+        for (auto & cv: childVars) {
+            result[cv.first].merge(std::move(cv.second));
+        }
+    }
+
+    return result;
+}
+
+
 /*****************************************************************************/
 /* FUNCTION CALL EXPRESSION                                                  */
 /*****************************************************************************/
@@ -2510,6 +3204,10 @@ BoundSqlExpression
 CaseExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     std::shared_ptr<ExpressionValueInfo> info;
 
     BoundSqlExpression boundElse;
@@ -2686,6 +3384,10 @@ BoundSqlExpression
 BetweenExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     BoundSqlExpression boundExpr  = expr->bind(scope);
     BoundSqlExpression boundLower = lower->bind(scope);
     BoundSqlExpression boundUpper = upper->bind(scope);
@@ -2813,10 +3515,64 @@ InExpression(std::shared_ptr<SqlExpression> expr,
     ExcAssert(kind == KEYS || kind == VALUES);
 }
 
+std::shared_ptr<std::unordered_set<ExpressionValue> >
+InExpression::
+getSubtableValues(const SelectSubtableExpression & subtable,
+                  SqlBindingScope & scope)
+{
+    // POTENTIAL OPT: a subquery with no GROUP BY could be run directly
+    // without binding, avoiding the need to create a subtable.
+
+    BoundTableExpression boundTable = subtable.bind(scope);
+
+    // We get all of the columns and make them into a set
+    static const OrderByExpression orderBy;
+    ssize_t offset = 0;
+    ssize_t limit = -1;
+
+    BasicRowGenerator generator
+        = boundTable.table.runQuery(scope, SelectExpression::STAR,
+                                    WhenExpression::TRUE,
+                                    *SqlExpression::TRUE,
+                                    orderBy,
+                                    offset, limit);
+
+    // This is a set of all values we can search for in our expression
+    auto valsPtr = std::make_shared<std::unordered_set<ExpressionValue> >();
+
+    // NOTE: this is where we REQUIRE that the subquery is non-
+    // correlated.  We can only pass a naked SqlRowScope like this
+    // to those that are non-correlated... if there are crashes in
+    // the generation, it's because we're executing a correlated
+    // subquery as if it were non-correlated, and it's trying to
+    // look up a variable in the wrong place.  The solution is to
+    // fix detection of non-correlated subqueries in bind().
+    SqlRowScope fakeRowScopeForConstantSubqueryGeneration;
+
+    // Generate all outputs of the query
+    std::vector<NamedRowValue> rowOutputs
+        = generator(-1, fakeRowScopeForConstantSubqueryGeneration);
+
+    // Scan them to add to our set
+    for (auto & row: rowOutputs) {
+        for (auto & col: row.columns) {
+            const ExpressionValue & val = std::get<1>(col);
+            if (!val.empty())
+                valsPtr->insert(val);
+        }
+    }
+
+    return valsPtr;
+}
+
 BoundSqlExpression
 InExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     BoundSqlExpression boundExpr  = expr->bind(scope);
 
     //cerr << "boundExpr: " << expr->print() << " has subtable " << subtable
@@ -2824,8 +3580,6 @@ bind(SqlBindingScope & scope) const
 
     switch (kind) {
     case SUBTABLE: {
-        BoundTableExpression boundTable = subtable->bind(scope);
-
         // TODO: we need to detect a correlated subquery.  This means that
         // the query depends upon variables from the surrounding scope.
         // This should be done with subtable->getUnbound(), but currently
@@ -2838,52 +3592,9 @@ bind(SqlBindingScope & scope) const
             throw HttpReturnException(500, "Correlated subqueries not supported yet");
         }
         else {
-            // POTENTIAL OPT: a subquery with no GROUP BY could be run directly
-            // without binding, avoiding the need to create a subtable.
-
             // non-corelated subquery; we can execute the subquery once and
-            // for all.  We do this by getting the first column and making
-            // it into a set
-
-            static const SelectExpression select = SelectExpression::STAR;
-            static const WhenExpression when = WhenExpression::TRUE;
-            static const OrderByExpression orderBy;
-            static const std::shared_ptr<SqlExpression> where = SqlExpression::TRUE;
-            ssize_t offset = 0;
-            ssize_t limit = -1;
-
-            BasicRowGenerator generator
-                = boundTable.table.runQuery(scope, SelectExpression::STAR,
-                                            WhenExpression::TRUE,
-                                            *SqlExpression::TRUE,
-                                            orderBy,
-                                            offset, limit);
-            
-            // This is a set of all values we can search for in our expression
-            auto valsPtr = std::make_shared<std::unordered_set<ExpressionValue> >();
-
-            // NOTE: this is where we REQUIRE that the subquery is non-
-            // correlated.  We can only pass a naked SqlRowScope like this
-            // to those that are non-correlated... if there are crashes in
-            // the generation, it's because we're executing a correlated
-            // subquery as if it were non-correlated, and it's trying to
-            // look up a variable in the wrong place.  The solution is to
-            // fix detection of non-correlated subqueries above.
-            SqlRowScope fakeRowScopeForConstantSubqueryGeneration;
-
-
-            // Generate all outputs of the query
-            std::vector<NamedRowValue> rowOutputs
-                = generator(-1, fakeRowScopeForConstantSubqueryGeneration);
-            
-            // Scan them to add to our set
-            for (auto & row: rowOutputs) {
-                for (auto & col: row.columns) {
-                    const ExpressionValue & val = std::get<1>(col);
-                    if (!val.empty())
-                        valsPtr->insert(val);
-                }
-            }
+            // for all.
+            auto valsPtr = getSubtableValues(*subtable, scope);
 
             auto exec = [=] (const SqlRowScope & rowScope,
                              ExpressionValue & storage,
@@ -3126,6 +3837,10 @@ BoundSqlExpression
 LikeExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     BoundSqlExpression boundLeft  = left->bind(scope);
     BoundSqlExpression boundRight  = right->bind(scope);
 
@@ -3231,6 +3946,10 @@ BoundSqlExpression
 CastExpression::
 bind(SqlBindingScope & scope) const
 {
+    BoundSqlExpression folded;
+    if (bindFoldedConstant(this, scope, folded))
+        return folded;
+
     BoundSqlExpression boundExpr  = expr->bind(scope);
 
     if (type == "string") {
@@ -7,6 +7,8 @@
 #pragma once
 
 #include "sql_expression.h"
+#include "window_functions.h"
+#include <unordered_set>
 
 
 namespace MLDB {
@@ -319,6 +321,14 @@ struct InExpression: public SqlExpression {
     virtual Utf8String getOperation() const;
     virtual std::vector<std::shared_ptr<SqlExpression> > getChildren() const;
 
+    /** Run the subquery of an IN (SELECT ...), which must not be
+        correlated, and return the set of non-null values in the columns of
+        all of its rows.
+    */
+    static std::shared_ptr<std::unordered_set<ExpressionValue> >
+    getSubtableValues(const SelectSubtableExpression & subtable,
+                      SqlBindingScope & scope);
+
     std::shared_ptr<SqlExpression> expr;
     std::shared_ptr<TupleExpression> tuple;
     std::shared_ptr<SelectSubtableExpression> subtable;
@@ -528,6 +538,48 @@ private:
                         BoundFunction& fn) const;
 };
 
+/** Represents a window function, like
+
+    sum(x) OVER (PARTITION BY y ORDER BY z ROWS BETWEEN 2 PRECEDING AND
+                 CURRENT ROW)
+
+    which is calculated over the frame of rows around the current one
+    within the rows that sort into the same partition.  These can only be
+    bound in a scope that runs them over all of its input; see
+    SqlBindingScope::doGetWindowFunction().
+*/
+struct WindowFunctionExpression: public SqlRowExpression {
+    WindowFunctionExpression(Utf8String functionName,
+                             std::vector<std::shared_ptr<SqlExpression> > args,
+                             std::vector<std::shared_ptr<SqlExpression> > partitionBy,
+                             OrderByExpression orderBy,
+                             WindowFrame frame);
+
+    virtual ~WindowFunctionExpression();
+
+    Utf8String functionName;
+    WindowFunctionType type;
+    std::vector<std::shared_ptr<SqlExpression> > args;
+    std::vector<std::shared_ptr<SqlExpression> > partitionBy;
+    OrderByExpression orderBy;
+    WindowFrame frame;
+
+    virtual BoundSqlExpression bind(SqlBindingScope & context) const override;
+
+    virtual Utf8String print() const override;
+
+    virtual std::shared_ptr<SqlExpression>
+    transform(const TransformArgs & transformArgs) const override;
+
+    virtual std::string getType() const override;
+    virtual Utf8String getOperation() const override;
+    virtual std::vector<std::shared_ptr<SqlExpression> > getChildren() const override;
+    virtual bool isConstant() const override { return false; }
+
+    virtual std::map<ScopedName, UnboundVariable>
+    variableNames() const override;
+};
+
 /** Represents extracting or rewriting an object. */
 struct ExtractExpression: public SqlRowExpression {
     ExtractExpression(std::shared_ptr<SqlExpression> from,
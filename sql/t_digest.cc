@@ -0,0 +1,192 @@
+/** t_digest.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Mergeable sketch of the distribution of a set of numbers.
+*/
+
+#include "t_digest.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* T DIGEST                                                                  */
+/*****************************************************************************/
+
+constexpr double TDigest::compression;
+constexpr size_t TDigest::maxBuffered;
+
+TDigest::
+TDigest()
+    : minValue(INFINITY), maxValue(-INFINITY), centroidWeight(0)
+{
+}
+
+void
+TDigest::
+add(double value, double weight)
+{
+    buffer.emplace_back(value, weight);
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+
+    if (buffer.size() >= maxBuffered)
+        compress();
+}
+
+void
+TDigest::
+merge(const TDigest & other)
+{
+    buffer.insert(buffer.end(), other.centroids.begin(),
+                  other.centroids.end());
+    buffer.insert(buffer.end(), other.buffer.begin(), other.buffer.end());
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+    compress();
+}
+
+double
+TDigest::
+k(double q)
+{
+    return compression / (2 * M_PI) * std::asin(2 * q - 1);
+}
+
+double
+TDigest::
+kInverse(double k)
+{
+    return (std::sin(k * 2 * M_PI / compression) + 1) / 2;
+}
+
+void
+TDigest::
+compress()
+{
+    if (buffer.empty())
+        return;
+
+    buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+    std::sort(buffer.begin(), buffer.end());
+
+    double total = 0;
+    for (auto & c: buffer)
+        total += c.second;
+
+    centroids.clear();
+
+    // Merge neighbouring centroids as long as the merged one doesn't
+    // span more than one unit of k
+    auto current = buffer[0];
+    double weightSoFar = 0;
+    double limit = total * kInverse(k(0) + 1);
+
+    for (size_t i = 1;  i < buffer.size();  ++i) {
+        const auto & next = buffer[i];
+        if (weightSoFar + current.second + next.second <= limit) {
+            double weight = current.second + next.second;
+            current.first += (next.first - current.first)
+                * next.second / weight;
+            current.second = weight;
+        }
+        else {
+            weightSoFar += current.second;
+            centroids.push_back(current);
+            limit = total * kInverse(k(weightSoFar / total) + 1);
+            current = next;
+        }
+    }
+    centroids.push_back(current);
+
+    centroidWeight = total;
+    buffer.clear();
+}
+
+double
+TDigest::
+totalWeight() const
+{
+    double result = centroidWeight;
+    for (auto & b: buffer)
+        result += b.second;
+    return result;
+}
+
+double
+TDigest::
+quantile(double q) const
+{
+    ExcAssert(buffer.empty());
+    ExcAssert(!centroids.empty());
+
+    if (q <= 0)
+        return minValue;
+    if (q >= 1)
+        return maxValue;
+    if (centroids.size() == 1)
+        return centroids[0].first;
+
+    double target = q * centroidWeight;
+
+    // Each centroid's mean sits at the middle of its weight; between
+    // those points (and the min and max at either end) we interpolate
+    double prevPosition = 0, prevValue = minValue;
+    double position = 0;
+    for (auto & c: centroids) {
+        double center = position + c.second / 2;
+        if (target < center) {
+            double frac = (target - prevPosition)
+                / (center - prevPosition);
+            return prevValue + frac * (c.first - prevValue);
+        }
+        prevPosition = center;
+        prevValue = c.first;
+        position += c.second;
+    }
+
+    double frac = (target - prevPosition) / (centroidWeight - prevPosition);
+    return prevValue + frac * (maxValue - prevValue);
+}
+
+double
+TDigest::
+cdf(double x) const
+{
+    ExcAssert(buffer.empty());
+    ExcAssert(!centroids.empty());
+
+    if (x < minValue)
+        return 0;
+    if (x >= maxValue)
+        return 1;
+
+    // The same piecewise linear function as quantile(), read the other
+    // way around
+    double prevPosition = 0, prevValue = minValue;
+    double position = 0;
+    for (auto & c: centroids) {
+        double center = position + c.second / 2;
+        if (x < c.first) {
+            double frac = (x - prevValue) / (c.first - prevValue);
+            return (prevPosition + frac * (center - prevPosition))
+                / centroidWeight;
+        }
+        prevPosition = center;
+        prevValue = c.first;
+        position += c.second;
+    }
+
+    double frac = (x - prevValue) / (maxValue - prevValue);
+    return (prevPosition + frac * (centroidWeight - prevPosition))
+        / centroidWeight;
+}
+
+} // namespace MLDB
@@ -0,0 +1,76 @@
+/** t_digest.h                                                     -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Mergeable sketch of the distribution of a set of numbers.
+*/
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* T DIGEST                                                                  */
+/*****************************************************************************/
+
+/** Merging t-digest, giving approximate quantiles and ranks of values in
+    a bounded amount of memory.  Values are buffered, and the buffer is
+    regularly merged into a bounded number of centroids that are small
+    near the extreme quantiles and larger near the median, so that the
+    error is smallest in the tails.
+
+    Digests built on separate parts of the data (for example one per
+    thread) can be merged together.  The const accessors need compress()
+    to have been called since the last value was added.
+*/
+
+struct TDigest {
+    /// Compression parameter; there are at most about this many centroids
+    static constexpr double compression = 100;
+    static constexpr size_t maxBuffered = 500;
+
+    TDigest();
+
+    /// Add a value, which must not be NaN
+    void add(double value, double weight = 1.0);
+
+    /// Add all of the values of another digest into this one
+    void merge(const TDigest & other);
+
+    /// Merge the buffered values into the centroids
+    void compress();
+
+    bool empty() const { return buffer.empty() && centroids.empty(); }
+
+    /// Total weight of the values that were added
+    double totalWeight() const;
+
+    /** Approximate value below which the given fraction (between 0 and 1)
+        of the weight lies.  The digest must not be empty.
+    */
+    double quantile(double q) const;
+
+    /** Approximate fraction (between 0 and 1) of the weight of the values
+        that are less than or equal to x.  This is the inverse of
+        quantile().  The digest must not be empty.
+    */
+    double cdf(double x) const;
+
+    double minValue, maxValue;
+
+private:
+    /// Scale function that maps a quantile onto the centroid index space
+    static double k(double q);
+    static double kInverse(double k);
+
+    std::vector<std::pair<double, double> > centroids;  ///< (mean, weight)
+    std::vector<std::pair<double, double> > buffer;     ///< Not yet merged
+    double centroidWeight;  ///< Weight of the centroids
+};
+
+} // namespace MLDB
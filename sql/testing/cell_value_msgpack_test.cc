@@ -0,0 +1,242 @@
+/** cell_value_msgpack_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the MessagePack encoding of cell values.
+*/
+
+#include "mldb/sql/cell_value_msgpack.h"
+#include "mldb/types/date.h"
+#include <cmath>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+using namespace MLDB;
+
+
+static std::string encode(const CellValue & val)
+{
+    std::string result;
+    MsgPackWriter writer(result);
+    writer.writeCellValue(val);
+    return result;
+}
+
+static std::string bytes(std::initializer_list<int> b)
+{
+    std::string result;
+    for (int c: b)
+        result.push_back((char)c);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_integers )
+{
+    BOOST_CHECK_EQUAL(encode(CellValue()), bytes({0xc0}));
+    BOOST_CHECK_EQUAL(encode(0), bytes({0x00}));
+    BOOST_CHECK_EQUAL(encode(127), bytes({0x7f}));
+    BOOST_CHECK_EQUAL(encode(128), bytes({0xcc, 0x80}));
+    BOOST_CHECK_EQUAL(encode(65536), bytes({0xce, 0x00, 0x01, 0x00, 0x00}));
+    BOOST_CHECK_EQUAL(encode(-1), bytes({0xff}));
+    BOOST_CHECK_EQUAL(encode(-32), bytes({0xe0}));
+    BOOST_CHECK_EQUAL(encode(-33), bytes({0xd0, 0xdf}));
+    BOOST_CHECK_EQUAL(encode(-129), bytes({0xd1, 0xff, 0x7f}));
+    BOOST_CHECK_EQUAL(encode(std::numeric_limits<int64_t>::min()),
+                      bytes({0xd3, 0x80, 0, 0, 0, 0, 0, 0, 0}));
+    BOOST_CHECK_EQUAL(encode(std::numeric_limits<uint64_t>::max()),
+                      bytes({0xcf, 0xff, 0xff, 0xff, 0xff,
+                             0xff, 0xff, 0xff, 0xff}));
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_floats )
+{
+    BOOST_CHECK_EQUAL(encode(1.5),
+                      bytes({0xcb, 0x3f, 0xf8, 0, 0, 0, 0, 0, 0}));
+
+    std::string nan = encode(std::nan(""));
+    BOOST_REQUIRE_EQUAL(nan.size(), 9);
+    BOOST_CHECK_EQUAL((unsigned char)nan[0], 0xcb);
+    BOOST_CHECK_EQUAL((unsigned char)nan[1] & 0x7f, 0x7f);
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_strings )
+{
+    BOOST_CHECK_EQUAL(encode("abc"), bytes({0xa3, 'a', 'b', 'c'}));
+
+    std::string longStr(40, 'x');
+    BOOST_CHECK_EQUAL(encode(longStr), bytes({0xd9, 40}) + longStr);
+
+    std::string veryLongStr(300, 'y');
+    BOOST_CHECK_EQUAL(encode(veryLongStr),
+                      bytes({0xda, 0x01, 0x2c}) + veryLongStr);
+
+    // UTF-8 strings are passed through as their raw bytes
+    Utf8String utf8("\xc3\xa9t\xc3\xa9");
+    BOOST_CHECK_EQUAL(encode(utf8),
+                      bytes({0xa5}) + utf8.rawString());
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_blobs )
+{
+    std::string data("\x00\x01\x02", 3);
+    BOOST_CHECK_EQUAL(encode(CellValue::blob(data)),
+                      bytes({0xc4, 0x03}) + data);
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_timestamps )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1.5);
+    BOOST_CHECK_EQUAL(encode(ts),
+                      bytes({0xc7, 12, 0xff,
+                             0x1d, 0xcd, 0x65, 0x00,
+                             0, 0, 0, 0, 0, 0, 0, 1}));
+
+    // Before the epoch, the seconds are negative and the nanoseconds
+    // still positive
+    Date before = Date::fromSecondsSinceEpoch(-0.5);
+    BOOST_CHECK_EQUAL(encode(before),
+                      bytes({0xc7, 12, 0xff,
+                             0x1d, 0xcd, 0x65, 0x00,
+                             0xff, 0xff, 0xff, 0xff,
+                             0xff, 0xff, 0xff, 0xff}));
+
+    std::string buf;
+    MsgPackWriter writer(buf);
+    writer.writeTimestamp(Date::notADate());
+    BOOST_CHECK_EQUAL(buf, bytes({0xc0}));
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_containers )
+{
+    std::string buf;
+    MsgPackWriter writer(buf);
+    writer.writeArrayHeader(3);
+    writer.writeArrayHeader(16);
+    writer.writeMapHeader(2);
+    writer.writeMapHeader(70000);
+    writer.writePath(Path("x"));
+
+    BOOST_CHECK_EQUAL(buf, bytes({0x93,
+                                  0xdc, 0x00, 0x10,
+                                  0x82,
+                                  0xdf, 0x00, 0x01, 0x11, 0x70,
+                                  0xa1, 'x'}));
+}
+
+static CellValue decode(const std::string & bytes)
+{
+    MsgPackReader reader(bytes);
+    CellValue result = reader.readCellValue();
+    BOOST_CHECK(reader.eof());
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_read_round_trip )
+{
+    std::vector<CellValue> vals = {
+        CellValue(), 0, 127, 128, 65536, -1, -32, -33, -129,
+        std::numeric_limits<int64_t>::min(),
+        std::numeric_limits<uint64_t>::max(),
+        1.5, -0.25, "abc", std::string(40, 'x'), std::string(300, 'y'),
+        Utf8String("\xc3\xa9t\xc3\xa9"),
+        CellValue::blob(std::string("\x00\x01\x02", 3)),
+        Date::fromSecondsSinceEpoch(1.5),
+        Date::fromSecondsSinceEpoch(-0.5),
+        CellValue::fromMonthDaySecond(1, 2, 3.5)
+    };
+
+    for (auto & v: vals) {
+        CellValue decoded = decode(encode(v));
+        BOOST_CHECK_EQUAL(decoded.cellType(), v.cellType());
+        BOOST_CHECK_EQUAL(decoded, v);
+    }
+
+    std::string nan = encode(std::nan(""));
+    BOOST_CHECK(std::isnan(decode(nan).toDouble()));
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_read_other_encodings )
+{
+    // Booleans are read as integers, as they are from JSON
+    BOOST_CHECK_EQUAL(decode(bytes({0xc3})), 1);
+    BOOST_CHECK_EQUAL(decode(bytes({0xc2})), 0);
+
+    // Non-minimal integers and float 32
+    BOOST_CHECK_EQUAL(decode(bytes({0xcd, 0x00, 0x05})), 5);
+    BOOST_CHECK_EQUAL(decode(bytes({0xd2, 0xff, 0xff, 0xff, 0xfe})), -2);
+    BOOST_CHECK_EQUAL(decode(bytes({0xca, 0x3f, 0xc0, 0, 0})), 1.5);
+
+    // 32 and 64 bit timestamp forms
+    BOOST_CHECK_EQUAL(decode(bytes({0xd6, 0xff, 0, 0, 0, 2})),
+                      Date::fromSecondsSinceEpoch(2));
+    BOOST_CHECK_EQUAL(decode(bytes({0xd7, 0xff,
+                                    0x77, 0x35, 0x94, 0x00,
+                                    0, 0, 0, 1})),
+                      Date::fromSecondsSinceEpoch(1.5));
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_read_containers )
+{
+    std::string buf;
+    MsgPackWriter writer(buf);
+    writer.writeMapHeader(2);
+    writer.writePath(Path("x"));
+    writer.writeArrayHeader(3);
+    writer.writeInt(1);
+    writer.writeString("two", 3);
+    writer.writeMapHeader(0);
+    writer.writePath(PathElement("a.b"));
+    writer.writeNil();
+    writer.writeBool(true);
+
+    MsgPackReader reader(buf);
+    BOOST_CHECK_EQUAL(reader.nextType(), MsgPackReader::MAP);
+    BOOST_CHECK_EQUAL(reader.readMapHeader(), 2);
+    BOOST_CHECK_EQUAL(reader.readPath(), Path("x"));
+    BOOST_CHECK_EQUAL(reader.nextType(), MsgPackReader::ARRAY);
+    size_t afterKey = reader.offset();
+    reader.skip();
+    BOOST_CHECK_EQUAL(reader.offset(), afterKey + 6);
+    BOOST_CHECK_EQUAL(reader.readPath(), Path(PathElement("a.b")));
+    BOOST_CHECK_EQUAL(reader.nextType(), MsgPackReader::NIL);
+    reader.readNil();
+    BOOST_CHECK(reader.readBool());
+    BOOST_CHECK(reader.eof());
+}
+
+BOOST_AUTO_TEST_CASE( test_msgpack_read_errors )
+{
+    // Truncated string
+    {
+        std::string buf = bytes({0xa3, 'a'});
+        MsgPackReader reader(buf);
+        BOOST_CHECK_THROW(reader.readCellValue(), std::exception);
+    }
+
+    // Wrong type
+    {
+        std::string buf = bytes({0x93, 1, 2, 3});
+        MsgPackReader reader(buf);
+        BOOST_CHECK_THROW(reader.readCellValue(), std::exception);
+    }
+
+    // Too large for a signed integer
+    {
+        std::string buf = encode(std::numeric_limits<uint64_t>::max());
+        MsgPackReader reader(buf);
+        BOOST_CHECK_THROW(reader.readInt(), std::exception);
+    }
+
+    // Invalid type byte
+    {
+        std::string buf = bytes({0xc1});
+        MsgPackReader reader(buf);
+        BOOST_CHECK_THROW(reader.nextType(), std::exception);
+    }
+}
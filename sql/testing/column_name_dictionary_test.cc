@@ -0,0 +1,89 @@
+/** column_name_dictionary_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the interned column name dictionary.
+*/
+
+#include "mldb/sql/column_name_dictionary.h"
+#include <thread>
+#include <vector>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_intern_basics )
+{
+    ColumnNameDictionary dict;
+
+    Path shortName("x");
+    Path longName = Path({PathElement("a rather long column name which "
+                                      "does not fit inline"),
+                          PathElement("second part")});
+
+    BOOST_CHECK(!dict.find(shortName));
+    BOOST_CHECK(!ColumnId());
+
+    ColumnId id1 = dict.intern(shortName);
+    ColumnId id2 = dict.intern(longName);
+
+    BOOST_CHECK(id1);
+    BOOST_CHECK(id2);
+    BOOST_CHECK(id1 != id2);
+    BOOST_CHECK_EQUAL(dict.intern(Path("x")).id, id1.id);
+    BOOST_CHECK_EQUAL(dict.find(longName).id, id2.id);
+    BOOST_CHECK_EQUAL(dict.getPath(id1), shortName);
+    BOOST_CHECK_EQUAL(dict.getPath(id2), longName);
+    BOOST_CHECK_EQUAL(dict.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_intern_many )
+{
+    ColumnNameDictionary dict;
+
+    // More names than fit in one block of any shard
+    vector<ColumnId> ids;
+    for (size_t i = 0;  i < 50000;  ++i)
+        ids.push_back(dict.intern(Path("col" + to_string(i))));
+
+    BOOST_CHECK_EQUAL(dict.size(), 50000);
+    for (size_t i = 0;  i < ids.size();  ++i) {
+        BOOST_CHECK_EQUAL(dict.getPath(ids[i]), Path("col" + to_string(i)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_intern_multithreaded )
+{
+    ColumnNameDictionary dict;
+
+    static constexpr int NTHREADS = 8;
+    static constexpr int NNAMES = 5000;
+    vector<vector<ColumnId> > ids(NTHREADS);
+
+    auto run = [&] (int t)
+        {
+            for (int i = 0;  i < NNAMES;  ++i) {
+                ColumnId id = dict.intern(Path("c" + to_string(i)));
+                BOOST_REQUIRE_EQUAL(dict.getPath(id), Path("c" + to_string(i)));
+                ids[t].push_back(id);
+            }
+        };
+
+    vector<std::thread> threads;
+    for (int t = 0;  t < NTHREADS;  ++t)
+        threads.emplace_back(run, t);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(dict.size(), NNAMES);
+    for (int t = 1;  t < NTHREADS;  ++t)
+        BOOST_CHECK(ids[t] == ids[0]);
+}
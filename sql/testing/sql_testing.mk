@@ -5,3 +5,7 @@
 $(eval $(call test,path_test,sql_types,boost valgrind))
 $(eval $(call test,path_benchmark,sql_types,boost))
 $(eval $(call test,eval_sql_test,sql_expression,boost))
+$(eval $(call test,column_name_dictionary_test,sql_types,boost))
+$(eval $(call test,value_block_cache_test,sql_expression,boost))
+$(eval $(call test,cell_value_msgpack_test,sql_types,boost))
+$(eval $(call test,window_functions_test,sql_expression,boost))
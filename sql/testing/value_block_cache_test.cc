@@ -0,0 +1,66 @@
+/** value_block_cache_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the per-thread value block cache.
+*/
+
+#include "mldb/sql/value_block_cache.h"
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_reuse )
+{
+    // A freed block is handed back for the next request in its size class
+    void * p1 = allocateValueBlock(40);
+    freeValueBlock(p1, 40);
+    void * p2 = allocateValueBlock(48);
+    BOOST_CHECK_EQUAL(p1, p2);
+    freeValueBlock(p2, 48);
+
+    // Large blocks aren't cached but still work
+    void * big = allocateValueBlock(100000);
+    BOOST_REQUIRE(big);
+    freeValueBlock(big, 100000);
+}
+
+BOOST_AUTO_TEST_CASE( test_allocate_shared )
+{
+    std::set<const void *> seen;
+    for (unsigned i = 0;  i < 100;  ++i) {
+        auto p = std::allocate_shared<std::vector<int> >
+            (ValueBlockAllocator<std::vector<int> >(), i, i);
+        BOOST_CHECK_EQUAL(p->size(), i);
+        seen.insert(p.get());
+    }
+
+    // All of them share the same recycled block
+    BOOST_CHECK_EQUAL(seen.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_cross_thread_free )
+{
+    vector<void *> blocks;
+    for (unsigned i = 0;  i < 1000;  ++i)
+        blocks.push_back(allocateValueBlock(i % 300));
+
+    std::thread t([&] ()
+                  {
+                      for (unsigned i = 0;  i < blocks.size();  ++i)
+                          freeValueBlock(blocks[i], i % 300);
+                  });
+    t.join();
+}
@@ -0,0 +1,209 @@
+/** window_functions_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the sliding window calculation of window functions, against a
+    brute force calculation of each frame.
+*/
+
+#include "mldb/sql/window_functions.h"
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+using namespace MLDB;
+
+
+namespace {
+
+/** Calculate the function over each frame separately. */
+std::vector<ExpressionValue>
+bruteForce(WindowFunctionType type,
+           const WindowFrame & frame,
+           const std::vector<CellValue> & values,
+           const std::vector<double> & orderKeys)
+{
+    size_t n = values.size();
+
+    // Is row j within the frame of row i?
+    auto after = [&] (const WindowFrameBound & bound, size_t i, size_t j)
+        {
+            switch (bound.type) {
+            case WindowFrameBound::UNBOUNDED_PRECEDING:  return true;
+            case WindowFrameBound::UNBOUNDED_FOLLOWING:  return false;
+            default:  break;
+            }
+            double offset = bound.type == WindowFrameBound::PRECEDING
+                ? -bound.offset
+                : bound.type == WindowFrameBound::FOLLOWING ? bound.offset : 0;
+            if (frame.unit == WINDOW_ROWS)
+                return (double)j >= (double)i + offset;
+            return orderKeys[j] >= orderKeys[i] + offset;
+        };
+
+    auto before = [&] (const WindowFrameBound & bound, size_t i, size_t j)
+        {
+            switch (bound.type) {
+            case WindowFrameBound::UNBOUNDED_PRECEDING:  return false;
+            case WindowFrameBound::UNBOUNDED_FOLLOWING:  return true;
+            default:  break;
+            }
+            double offset = bound.type == WindowFrameBound::PRECEDING
+                ? -bound.offset
+                : bound.type == WindowFrameBound::FOLLOWING ? bound.offset : 0;
+            if (frame.unit == WINDOW_ROWS)
+                return (double)j <= (double)i + offset;
+            return orderKeys[j] <= orderKeys[i] + offset;
+        };
+
+    std::vector<ExpressionValue> result;
+    for (size_t i = 0;  i < n;  ++i) {
+        double sum = 0;
+        uint64_t count = 0;
+        CellValue min, max;
+        for (size_t j = 0;  j < n;  ++j) {
+            if (!after(frame.start, i, j) || !before(frame.end, i, j))
+                continue;
+            if (values[j].empty())
+                continue;
+            if (count == 0 || values[j] < min)
+                min = values[j];
+            if (count == 0 || max < values[j])
+                max = values[j];
+            sum += values[j].toDouble();
+            ++count;
+        }
+
+        Date ts = Date::negativeInfinity();
+        if (type == WINDOW_COUNT)
+            result.emplace_back(count, ts);
+        else if (count == 0)
+            result.emplace_back(ExpressionValue::null(ts));
+        else if (type == WINDOW_SUM)
+            result.emplace_back(sum, ts);
+        else if (type == WINDOW_AVG)
+            result.emplace_back(sum / count, ts);
+        else if (type == WINDOW_MIN)
+            result.emplace_back(min, ts);
+        else result.emplace_back(max, ts);
+    }
+
+    return result;
+}
+
+void check(WindowFunctionType type,
+           const WindowFrame & frame,
+           const std::vector<CellValue> & values,
+           const std::vector<double> & orderKeys)
+{
+    std::vector<Date> timestamps(values.size(), Date::negativeInfinity());
+    auto result = calcWindowFunction(type, frame, values, timestamps,
+                                     orderKeys);
+    auto expected = bruteForce(type, frame, values, orderKeys);
+
+    BOOST_REQUIRE_EQUAL(result.size(), expected.size());
+    for (size_t i = 0;  i < result.size();  ++i) {
+        BOOST_CHECK_EQUAL(result[i].empty(), expected[i].empty());
+        if (result[i].empty() || expected[i].empty())
+            continue;
+        double r = result[i].getAtom().toDouble();
+        double e = expected[i].getAtom().toDouble();
+        BOOST_CHECK_CLOSE(r, e, 1e-9);
+        if (std::abs(r - e) > 1e-9 * std::abs(e)) {
+            cerr << "type " << type << " frame " << frame.print()
+                 << " row " << i << endl;
+        }
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_running_sum )
+{
+    // Default frame: peers of the current row are included
+    std::vector<CellValue> values = { 1, 2, 3, 4, 5 };
+    std::vector<double> orderKeys = { 0, 1, 1, 2, 3 };
+    std::vector<Date> timestamps(5, Date::negativeInfinity());
+
+    auto result = calcWindowFunction(WINDOW_SUM, WindowFrame(), values,
+                                     timestamps, orderKeys);
+    std::vector<double> expected = { 1, 6, 6, 10, 15 };
+    for (size_t i = 0;  i < 5;  ++i)
+        BOOST_CHECK_EQUAL(result[i].getAtom().toDouble(), expected[i]);
+
+    result = calcWindowFunction(WINDOW_ROW_NUMBER, WindowFrame(), values,
+                                timestamps, orderKeys);
+    for (size_t i = 0;  i < 5;  ++i)
+        BOOST_CHECK_EQUAL(result[i].getAtom().toInt(), i + 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_empty_frames_and_nulls )
+{
+    std::vector<CellValue> values = { 1, CellValue(), 3, CellValue() };
+    std::vector<double> orderKeys = { 0, 1, 2, 3 };
+
+    WindowFrame frame;
+    frame.unit = WINDOW_ROWS;
+    frame.start = WindowFrameBound(WindowFrameBound::PRECEDING, 3);
+    frame.end = WindowFrameBound(WindowFrameBound::PRECEDING, 2);
+
+    for (auto type: { WINDOW_SUM, WINDOW_COUNT, WINDOW_AVG,
+                      WINDOW_MIN, WINDOW_MAX })
+        check(type, frame, values, orderKeys);
+
+    std::vector<Date> timestamps(4, Date::negativeInfinity());
+    auto result = calcWindowFunction(WINDOW_MIN, frame, values,
+                                     timestamps, orderKeys);
+    BOOST_CHECK(result[0].empty());
+    BOOST_CHECK(result[1].empty());
+    BOOST_CHECK_EQUAL(result[2].getAtom(), 1);
+    BOOST_CHECK_EQUAL(result[3].getAtom(), 1);
+
+    result = calcWindowFunction(WINDOW_COUNT, frame, values,
+                                timestamps, orderKeys);
+    BOOST_CHECK_EQUAL(result[0].getAtom(), 0);
+
+    // An empty partition
+    result = calcWindowFunction(WINDOW_SUM, frame, {}, {}, {});
+    BOOST_CHECK(result.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_random_frames )
+{
+    boost::random::mt19937 rng(42);
+    boost::random::uniform_int_distribution<int> value(-50, 50);
+    boost::random::uniform_int_distribution<int> offset(0, 5);
+    boost::random::uniform_int_distribution<int> boundType(0, 4);
+    boost::random::uniform_int_distribution<int> step(0, 3);
+
+    for (unsigned iter = 0;  iter < 200;  ++iter) {
+        size_t n = iter % 40;
+        std::vector<CellValue> values;
+        std::vector<double> orderKeys;
+        double key = value(rng);
+        for (size_t i = 0;  i < n;  ++i) {
+            int v = value(rng);
+            if (v % 7 == 0)
+                values.emplace_back();
+            else values.emplace_back(v);
+            key += step(rng);
+            orderKeys.push_back(key);
+        }
+
+        WindowFrame frame;
+        frame.unit = iter % 2 ? WINDOW_ROWS : WINDOW_RANGE;
+        frame.start = WindowFrameBound
+            ((WindowFrameBound::Type)(boundType(rng) % 4), offset(rng));
+        frame.end = WindowFrameBound
+            ((WindowFrameBound::Type)(boundType(rng) % 4 + 1), offset(rng));
+
+        for (auto type: { WINDOW_SUM, WINDOW_COUNT, WINDOW_AVG,
+                          WINDOW_MIN, WINDOW_MAX })
+            check(type, frame, values, orderKeys);
+    }
+}
@@ -9,6 +9,9 @@
 #include "base/parse_context.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/pair_description.h"
+#include "mldb/ext/cityhash/src/city.h"
+#include <cstring>
+#include <deque>
 #include <queue>
 
 using namespace std;
@@ -82,14 +85,19 @@ TokenizeOptionsDescription()
     };
 }
 
+static void checkNGramRange(int min_range, int max_range)
+{
+    if(max_range<min_range || min_range<1 || max_range<1)
+        throw MLDB::Exception("ngramRange values must be bigger than 0 "
+                "and the second value needs to be equal or bigger than the first");
+}
+
 struct NGramer {
     NGramer(int min_range, int max_range)
         : min_range(min_range), max_range(max_range),
           count(0), buffer_pos(0)
     {
-        if(max_range<min_range || min_range<1 || max_range<1)
-            throw MLDB::Exception("ngramRange values must be bigger than 0 "
-                    "and the second value needs to be equal or bigger than the first");
+        checkNGramRange(min_range, max_range);
     
         buffer.resize(max_range);
     }
@@ -325,6 +333,305 @@ bool tokenize(std::unordered_map<Utf8String, int>& bagOfWords,
 }
 
 
+/*****************************************************************************/
+/* FAST TOKENIZER                                                            */
+/*****************************************************************************/
+
+namespace {
+
+/** Tokenizer for the usual case where the separators are characters of a
+    single byte, and the quote is empty or one such character.  As a
+    single byte UTF-8 character can't be part of a longer one, the text can
+    be split on bytes, and most tokens are ranges of the text that don't
+    need to be copied anywhere.  It gives the same tokens as
+    tokenize_exec().
+*/
+struct FastTokenizer {
+    /** Set up for the given separators and quote.  Returns false if they
+        need the generic tokenizer.
+    */
+    bool init(const Utf8String & splitchars, const Utf8String & quotechar)
+    {
+        std::fill(isSplit, isSplit + 256, false);
+        numSplit = 0;
+        for (char32_t c: splitchars) {
+            if (c >= 0x80)
+                return false;
+            if (!isSplit[c]) {
+                isSplit[c] = true;
+                splitChar = c;
+                ++numSplit;
+            }
+        }
+
+        quote = -1;
+        if (!quotechar.empty()) {
+            auto it = quotechar.begin();
+            char32_t c = *it;
+            if (++it != quotechar.end() || c >= 0x80 || isSplit[c])
+                return false;
+            quote = c;
+        }
+        return true;
+    }
+
+    /// Return the first separator in [p, e), or e if there is none
+    const char * findSplit(const char * p, const char * e) const
+    {
+        // memchr() is vectorized, so a single separator is found quickly
+        if (numSplit == 1) {
+            const char * found = (const char *)memchr(p, splitChar, e - p);
+            return found ? found : e;
+        }
+        while (p < e && !isSplit[(unsigned char)*p])
+            ++p;
+        return p;
+    }
+
+    /// Return whether the UTF-8 string has at least n characters
+    static bool hasLength(const char * str, size_t len, int n)
+    {
+        if (len < (size_t)n)
+            return false;
+        int result = 0;
+        for (size_t i = 0;  i < len && result < n;  ++i)
+            result += ((unsigned char)str[i] & 0xc0) != 0x80;
+        return result >= n;
+    }
+
+    /** Call onToken(str, len) for each token of [p, e) in order, until it
+        returns false.  Tokens which aren't a range of the text are put
+        together in buffer, and so are only valid until the next call.
+    */
+    template<typename Fn>
+    void forEachToken(const char * p, const char * e, int minTokenLength,
+                      Fn && onToken)
+    {
+        bool another = false;
+        while (another || p < e) {
+            const char * token;
+            size_t len;
+            const char * end;
+
+            if (quote != -1 && p < e && *p == quote) {
+                const char * start = p + 1;
+                const char * closing
+                    = (const char *)memchr(start, quote, e - start);
+                if (!closing)
+                    throw MLDB::Exception("string finished inside quote");
+                end = closing + 1;
+                if (end == e || isSplit[(unsigned char)*end]) {
+                    token = start;
+                    len = closing - start;
+                }
+                else {
+                    // The closing quote is dropped, and what follows it up
+                    // to the next separator is part of the token
+                    const char * rest = end;
+                    end = findSplit(rest, e);
+                    buffer.assign(start, closing);
+                    buffer.append(rest, end);
+                    token = buffer.data();
+                    len = buffer.size();
+                }
+            }
+            else {
+                end = findSplit(p, e);
+                token = p;
+                len = end - p;
+            }
+
+            // Skip the separator at the end, if there is one
+            another = end < e;
+            p = another ? end + 1 : end;
+
+            if (minTokenLength > 0 && !hasLength(token, len, minTokenLength))
+                continue;
+            if (!onToken(token, len))
+                return;
+        }
+    }
+
+    bool isSplit[256];
+    int numSplit;
+    unsigned char splitChar;
+    int quote;
+    std::string buffer;
+};
+
+/** Number of occurrences of each distinct token, in a hash table keyed on
+    the bytes of the tokens.  Keys that are given as stable (pointing into
+    the text, which outlives the table) are kept as pointers, and others
+    are copied when they are first seen.  It is cleared rather than freed
+    between uses, so that each thread reuses its memory.
+*/
+struct TokenCounter {
+    struct Entry {
+        uint64_t hash;
+        const char * str;
+        size_t len;
+        int count;  ///< Zero for an empty slot
+    };
+
+    void clear()
+    {
+        for (uint32_t slot: used)
+            entries[slot].count = 0;
+        used.clear();
+        copies.clear();
+    }
+
+    bool empty() const
+    {
+        return used.empty();
+    }
+
+    void add(const char * str, size_t len, bool stable)
+    {
+        if (used.size() * 2 >= entries.size())
+            grow();
+
+        uint64_t hash = CityHash64(str, len);
+        size_t mask = entries.size() - 1;
+        for (size_t slot = hash & mask;  ;  slot = (slot + 1) & mask) {
+            Entry & entry = entries[slot];
+            if (entry.count == 0) {
+                if (!stable) {
+                    copies.emplace_back(str, len);
+                    str = copies.back().data();
+                }
+                entry = { hash, str, len, 1 };
+                used.push_back(slot);
+                return;
+            }
+            if (entry.hash == hash && entry.len == len
+                && memcmp(entry.str, str, len) == 0) {
+                ++entry.count;
+                return;
+            }
+        }
+    }
+
+    template<typename Fn>
+    void forEach(Fn && onEntry) const
+    {
+        for (uint32_t slot: used) {
+            const Entry & entry = entries[slot];
+            onEntry(entry.str, entry.len, entry.count);
+        }
+    }
+
+private:
+    void grow()
+    {
+        std::vector<Entry> old(std::max<size_t>(64, entries.size() * 2),
+                               Entry{0, nullptr, 0, 0});
+        old.swap(entries);
+        size_t mask = entries.size() - 1;
+        for (uint32_t & slot: used) {
+            const Entry & entry = old[slot];
+            size_t newSlot = entry.hash & mask;
+            while (entries[newSlot].count != 0)
+                newSlot = (newSlot + 1) & mask;
+            entries[newSlot] = entry;
+            slot = newSlot;
+        }
+    }
+
+    std::vector<Entry> entries;
+    std::vector<uint32_t> used;       ///< Slots in use, in insertion order
+    std::deque<std::string> copies;   ///< Storage for the unstable keys
+};
+
+} // file scope
+
+bool tokenize_count(const char * text, size_t length,
+                    const TokenizeOptions & options,
+                    const std::function<void (const char * token, size_t len,
+                                              int count)> & onToken)
+{
+    FastTokenizer tokenizer;
+    if (!tokenizer.init(options.splitchar, options.quotechar)) {
+        std::unordered_map<Utf8String, int> bagOfWords;
+        ParseContext pcontext("tokenize", text, length);
+        tokenize(bagOfWords, pcontext, options);
+        for (auto & entry: bagOfWords)
+            onToken(entry.first.rawData(), entry.first.rawLength(),
+                    entry.second);
+        return !bagOfWords.empty();
+    }
+
+    int minGram = options.ngramRange.first, maxGram = options.ngramRange.second;
+    checkNGramRange(minGram, maxGram);
+
+    static thread_local TokenCounter counter;
+    counter.clear();
+
+    const char * end = text + length;
+
+    // Last maxGram tokens, to make the n-grams
+    std::vector<std::string> previous(maxGram > 1 ? maxGram : 0);
+    size_t numTokens = 0;
+    std::string gram;
+
+    auto addToken = [&] (const char * token, size_t len)
+        {
+            bool stable = token >= text && token < end;
+
+            if (maxGram == 1) {
+                counter.add(token, len, stable);
+                return;
+            }
+
+            // Same n-grams as NGramer
+            size_t pos = numTokens++ % maxGram;
+            previous[pos].assign(token, len);
+            if (numTokens < (size_t)minGram)
+                return;
+
+            int numGrams = std::min<size_t>(numTokens, maxGram);
+            for (int n = minGram;  n <= numGrams;  ++n) {
+                if (n == 1) {
+                    counter.add(token, len, stable);
+                    continue;
+                }
+                gram.clear();
+                for (int i = n - 1;  i >= 0;  --i) {
+                    if (i != n - 1)
+                        gram += '_';
+                    gram += previous[(pos + maxGram - i) % maxGram];
+                }
+                counter.add(gram.data(), gram.size(), false /* stable */);
+            }
+        };
+
+    int count = 0;
+    auto aggregate = [&] (const char * token, size_t len) -> bool
+        {
+            ++count;
+            if (count <= options.offset)
+                return true; //continue
+
+            if (len != 0)
+                addToken(token, len);
+
+            if (count == options.limit+options.offset)
+                return false; //stop here
+
+            return true;
+        };
+
+    tokenizer.forEachToken(text, end, options.minTokenLength, aggregate);
+
+    counter.forEach(onToken);
+    bool result = !counter.empty();
+
+    // Don't keep pointers into the text past the call
+    counter.clear();
+    return result;
+}
+
+
 Utf8String token_extract(ParseContext& context,
                          int nth,
                          const TokenizeOptions & options)
@@ -51,6 +51,19 @@ bool tokenize(std::unordered_map<Utf8String, int>& bagOfWords,
               ParseContext& pcontext,
               const TokenizeOptions & options);
 
+/** Tokenize the UTF-8 text like tokenize(), calling onToken once for each
+    distinct token (or n-gram) with the number of times it occurs, in no
+    particular order.  When the separators are single byte characters and
+    the quote is empty or one of them, the tokens are counted straight from
+    the text, without making a string for each one.  The token passed to
+    onToken is only valid during the call.  Returns false if there were no
+    tokens.
+*/
+bool tokenize_count(const char * text, size_t length,
+                    const TokenizeOptions & options,
+                    const std::function<void (const char * token, size_t len,
+                                              int count)> & onToken);
+
 Utf8String token_extract(ParseContext& context,
                          int nth,
                          const TokenizeOptions & options);
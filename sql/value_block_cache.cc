@@ -0,0 +1,114 @@
+/** value_block_cache.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Per-thread cache of the small memory blocks used to hold the contents
+    of ExpressionValues.
+*/
+
+#include "value_block_cache.h"
+#include "mldb/jml/utils/environment.h"
+#include <cstdlib>
+#include <new>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<int> MLDB_VALUE_BLOCK_CACHE_SIZE
+("MLDB_VALUE_BLOCK_CACHE_SIZE", 1024);
+
+constexpr size_t GRANULARITY = 16;
+constexpr size_t NUM_CLASSES = 16;
+constexpr size_t MAX_CACHED_BYTES = GRANULARITY * NUM_CLASSES;
+
+inline size_t sizeClass(size_t bytes)
+{
+    return bytes == 0 ? 0 : (bytes - 1) / GRANULARITY;
+}
+
+struct FreeBlock {
+    FreeBlock * next;
+};
+
+// Trivially destructible, so still readable while the thread's other
+// thread_local objects are destroyed
+thread_local bool threadCacheDestroyed = false;
+
+struct ThreadCache {
+    ThreadCache()
+        : heads{}, counts{}
+    {
+    }
+
+    ~ThreadCache()
+    {
+        for (auto & h: heads) {
+            while (h) {
+                FreeBlock * next = h->next;
+                std::free(h);
+                h = next;
+            }
+        }
+        threadCacheDestroyed = true;
+    }
+
+    FreeBlock * heads[NUM_CLASSES];
+    int counts[NUM_CLASSES];
+};
+
+thread_local ThreadCache threadCache;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* VALUE BLOCK CACHE                                                         */
+/*****************************************************************************/
+
+void * allocateValueBlock(size_t bytes)
+{
+    if (bytes <= MAX_CACHED_BYTES && !threadCacheDestroyed) {
+        size_t cls = sizeClass(bytes);
+        FreeBlock * block = threadCache.heads[cls];
+        if (block) {
+            threadCache.heads[cls] = block->next;
+            --threadCache.counts[cls];
+            return block;
+        }
+        // Allocate the full size class so the block can be reused for
+        // any request in the class
+        bytes = (cls + 1) * GRANULARITY;
+    }
+
+    void * result = std::malloc(bytes);
+    if (!result)
+        throw std::bad_alloc();
+    return result;
+}
+
+void freeValueBlock(void * mem, size_t bytes) noexcept
+{
+    if (!mem)
+        return;
+
+    if (bytes <= MAX_CACHED_BYTES && !threadCacheDestroyed) {
+        size_t cls = sizeClass(bytes);
+        if (threadCache.counts[cls] < MLDB_VALUE_BLOCK_CACHE_SIZE) {
+            FreeBlock * block = static_cast<FreeBlock *>(mem);
+            block->next = threadCache.heads[cls];
+            threadCache.heads[cls] = block;
+            ++threadCache.counts[cls];
+            return;
+        }
+    }
+
+    std::free(mem);
+}
+
+} // namespace MLDB
@@ -0,0 +1,89 @@
+/** value_block_cache.h                                           -*- C++ -*-
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Per-thread cache of the small memory blocks used to hold the contents
+    of ExpressionValues.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* VALUE BLOCK CACHE                                                         */
+/*****************************************************************************/
+
+/** Query execution creates and destroys many small, short-lived blocks
+    (structured rows, embeddings and their shared_ptr control blocks),
+    usually on the same thread.  These functions keep freed blocks on a
+    per-thread free list per size class, so that in the steady state the
+    allocator isn't touched and threads don't contend on it.
+
+    Blocks come from malloc one by one, so a block may be freed on a
+    different thread from the one that allocated it.  Blocks larger than
+    the biggest size class go directly to malloc.
+
+    The number of blocks kept per size class and thread is set by the
+    MLDB_VALUE_BLOCK_CACHE_SIZE environment variable; 0 disables the
+    cache.
+*/
+
+/// Allocate a block of at least the given number of bytes
+void * allocateValueBlock(size_t bytes);
+
+/// Free a block allocated by allocateValueBlock with the same size
+void freeValueBlock(void * mem, size_t bytes) noexcept;
+
+
+/*****************************************************************************/
+/* VALUE BLOCK ALLOCATOR                                                     */
+/*****************************************************************************/
+
+/** Standard allocator that draws from the value block cache.  It's meant
+    for std::allocate_shared, which puts the object and its control block
+    in a single cached block.
+*/
+
+template<typename T>
+struct ValueBlockAllocator {
+    typedef T value_type;
+
+    ValueBlockAllocator() noexcept
+    {
+    }
+
+    template<typename U>
+    ValueBlockAllocator(const ValueBlockAllocator<U> &) noexcept
+    {
+    }
+
+    T * allocate(size_t n)
+    {
+        return static_cast<T *>(allocateValueBlock(n * sizeof(T)));
+    }
+
+    void deallocate(T * p, size_t n) noexcept
+    {
+        freeValueBlock(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator == (const ValueBlockAllocator<U> &) const noexcept
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator != (const ValueBlockAllocator<U> &) const noexcept
+    {
+        return false;
+    }
+};
+
+} // namespace MLDB
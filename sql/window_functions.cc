@@ -0,0 +1,323 @@
+/** window_functions.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Sliding window calculation of window functions.
+*/
+
+#include "window_functions.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/enum_description.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* WINDOW FRAME                                                              */
+/*****************************************************************************/
+
+DEFINE_ENUM_DESCRIPTION(WindowFrameUnit);
+
+WindowFrameUnitDescription::
+WindowFrameUnitDescription()
+{
+    addValue("ROWS", WINDOW_ROWS, "Frame offsets are a number of rows");
+    addValue("RANGE", WINDOW_RANGE,
+             "Frame offsets are a distance in the ORDER BY value");
+}
+
+static std::string printOffset(double offset)
+{
+    if (offset == (int64_t)offset)
+        return std::to_string((int64_t)offset);
+    return std::to_string(offset);
+}
+
+Utf8String
+WindowFrameBound::
+print() const
+{
+    switch (type) {
+    case UNBOUNDED_PRECEDING:  return "UNBOUNDED PRECEDING";
+    case PRECEDING:            return printOffset(offset) + " PRECEDING";
+    case CURRENT_ROW:          return "CURRENT ROW";
+    case FOLLOWING:            return printOffset(offset) + " FOLLOWING";
+    case UNBOUNDED_FOLLOWING:  return "UNBOUNDED FOLLOWING";
+    }
+    throw HttpReturnException(500, "Unknown window frame bound");
+}
+
+Utf8String
+WindowFrame::
+print() const
+{
+    return Utf8String(unit == WINDOW_ROWS ? "ROWS" : "RANGE")
+        + " BETWEEN " + start.print() + " AND " + end.print();
+}
+
+
+/*****************************************************************************/
+/* WINDOW FUNCTIONS                                                          */
+/*****************************************************************************/
+
+DEFINE_ENUM_DESCRIPTION(WindowFunctionType);
+
+WindowFunctionTypeDescription::
+WindowFunctionTypeDescription()
+{
+    addValue("sum", WINDOW_SUM, "Sum of the non-null values in the frame");
+    addValue("count", WINDOW_COUNT, "Number of non-null values in the frame");
+    addValue("avg", WINDOW_AVG, "Average of the non-null values in the frame");
+    addValue("min", WINDOW_MIN, "Minimum non-null value in the frame");
+    addValue("max", WINDOW_MAX, "Maximum non-null value in the frame");
+    addValue("row_number", WINDOW_ROW_NUMBER,
+             "Position of the row within its partition, starting at 1");
+}
+
+WindowFunctionType getWindowFunctionType(const Utf8String & name)
+{
+    if (name == "sum")
+        return WINDOW_SUM;
+    else if (name == "count")
+        return WINDOW_COUNT;
+    else if (name == "avg")
+        return WINDOW_AVG;
+    else if (name == "min")
+        return WINDOW_MIN;
+    else if (name == "max")
+        return WINDOW_MAX;
+    else if (name == "row_number")
+        return WINDOW_ROW_NUMBER;
+    throw HttpReturnException(400, "Function '" + name + "' can't be used as "
+                              "a window function; the window functions are "
+                              "sum, count, avg, min, max and row_number",
+                              "functionName", name);
+}
+
+size_t getWindowFunctionArity(WindowFunctionType type)
+{
+    return type == WINDOW_ROW_NUMBER ? 0 : 1;
+}
+
+namespace {
+
+/** Aggregate of the values within a frame.  Aggregates combine
+    associatively, and the default constructed one is the identity.
+*/
+struct FrameAggregate {
+    double sum = 0.0;
+    uint64_t count = 0;
+    CellValue min;
+    CellValue max;
+    Date ts = Date::negativeInfinity();
+
+    static FrameAggregate of(const CellValue & value, Date ts,
+                             WindowFunctionType type)
+    {
+        FrameAggregate result;
+        if (value.empty())
+            return result;
+        result.count = 1;
+        result.ts = ts;
+        if (type == WINDOW_SUM || type == WINDOW_AVG)
+            result.sum = value.toDouble();
+        else if (type == WINDOW_MIN)
+            result.min = value;
+        else if (type == WINDOW_MAX)
+            result.max = value;
+        return result;
+    }
+
+    /// Combine the aggregates of two adjacent runs of rows, in order
+    static FrameAggregate combine(const FrameAggregate & first,
+                                  const FrameAggregate & second)
+    {
+        if (second.count == 0)
+            return first;
+        if (first.count == 0)
+            return second;
+        FrameAggregate result;
+        result.sum = first.sum + second.sum;
+        result.count = first.count + second.count;
+        result.min = second.min < first.min ? second.min : first.min;
+        result.max = first.max < second.max ? second.max : first.max;
+        result.ts = std::max(first.ts, second.ts);
+        return result;
+    }
+
+    ExpressionValue value(WindowFunctionType type) const
+    {
+        if (type == WINDOW_COUNT)
+            return ExpressionValue(count, ts);
+        if (count == 0)
+            return ExpressionValue::null(ts);
+        switch (type) {
+        case WINDOW_SUM:  return ExpressionValue(sum, ts);
+        case WINDOW_AVG:  return ExpressionValue(sum / count, ts);
+        case WINDOW_MIN:  return ExpressionValue(min, ts);
+        case WINDOW_MAX:  return ExpressionValue(max, ts);
+        default:
+            throw HttpReturnException(500, "Unexpected window function");
+        }
+    }
+};
+
+/** Queue of the aggregates of the rows of a frame, which can be pushed
+    at the back and popped from the front in amortized constant time.
+    The front stack holds, for each element, the aggregate of it and of
+    everything that was pushed after it within the stack, so popping an
+    element never requires anything to be subtracted from an aggregate.
+    This works for operations like min and max that can't be undone, and
+    keeps sums from accumulating rounding errors.
+*/
+struct TwoStackQueue {
+    std::vector<FrameAggregate> front;  ///< Suffix aggregates; top is oldest
+    std::vector<FrameAggregate> back;   ///< Elements, newest last
+    FrameAggregate backAggregate;       ///< Aggregate of all of back
+
+    void push(FrameAggregate element)
+    {
+        backAggregate = FrameAggregate::combine(backAggregate, element);
+        back.emplace_back(std::move(element));
+    }
+
+    void pop()
+    {
+        if (front.empty()) {
+            // Move back onto front, newest first
+            FrameAggregate suffix;
+            for (ssize_t i = back.size() - 1;  i >= 0;  --i) {
+                suffix = FrameAggregate::combine(back[i], suffix);
+                front.push_back(suffix);
+            }
+            back.clear();
+            backAggregate = FrameAggregate();
+        }
+        ExcAssert(!front.empty());
+        front.pop_back();
+    }
+
+    FrameAggregate aggregate() const
+    {
+        if (front.empty())
+            return backAggregate;
+        return FrameAggregate::combine(front.back(), backAggregate);
+    }
+};
+
+} // file scope
+
+std::vector<ExpressionValue>
+calcWindowFunction(WindowFunctionType type,
+                   const WindowFrame & frame,
+                   const std::vector<CellValue> & values,
+                   const std::vector<Date> & timestamps,
+                   const std::vector<double> & orderKeys)
+{
+    size_t n = orderKeys.size();
+    std::vector<ExpressionValue> result;
+    result.reserve(n);
+
+    if (type == WINDOW_ROW_NUMBER) {
+        for (size_t i = 0;  i < n;  ++i)
+            result.emplace_back(i + 1, Date::negativeInfinity());
+        return result;
+    }
+
+    ExcAssertEqual(values.size(), n);
+    ExcAssertEqual(timestamps.size(), n);
+
+    // Index of the first row whose key is >= (or > if strict) the given
+    // one, searching forward from pos, which only ever increases
+    auto advance = [&] (size_t pos, double key, bool strict)
+        {
+            while (pos < n
+                   && (strict ? orderKeys[pos] <= key : orderKeys[pos] < key))
+                ++pos;
+            return pos;
+        };
+
+    // Both ends are positions in the partition that only move forward;
+    // the first row of the frame is [begin, and the end is end)
+    auto frameStart = [&] (size_t i, size_t pos) -> size_t
+        {
+            const WindowFrameBound & bound = frame.start;
+            switch (bound.type) {
+            case WindowFrameBound::UNBOUNDED_PRECEDING:
+                return 0;
+            case WindowFrameBound::UNBOUNDED_FOLLOWING:
+                return n;
+            default:
+                break;
+            }
+            if (frame.unit == WINDOW_ROWS) {
+                if (bound.type == WindowFrameBound::PRECEDING)
+                    return i >= bound.offset ? i - bound.offset : 0;
+                else if (bound.type == WindowFrameBound::FOLLOWING)
+                    return std::min<size_t>(n, i + bound.offset);
+                return i;
+            }
+            double key = orderKeys[i];
+            if (bound.type == WindowFrameBound::PRECEDING)
+                key -= bound.offset;
+            else if (bound.type == WindowFrameBound::FOLLOWING)
+                key += bound.offset;
+            return advance(pos, key, false /* strict */);
+        };
+
+    auto frameEnd = [&] (size_t i, size_t pos) -> size_t
+        {
+            const WindowFrameBound & bound = frame.end;
+            switch (bound.type) {
+            case WindowFrameBound::UNBOUNDED_PRECEDING:
+                return 0;
+            case WindowFrameBound::UNBOUNDED_FOLLOWING:
+                return n;
+            default:
+                break;
+            }
+            if (frame.unit == WINDOW_ROWS) {
+                if (bound.type == WindowFrameBound::PRECEDING)
+                    return i + 1 >= bound.offset ? i + 1 - bound.offset : 0;
+                else if (bound.type == WindowFrameBound::FOLLOWING)
+                    return std::min<size_t>(n, i + 1 + bound.offset);
+                return i + 1;
+            }
+            double key = orderKeys[i];
+            if (bound.type == WindowFrameBound::PRECEDING)
+                key -= bound.offset;
+            else if (bound.type == WindowFrameBound::FOLLOWING)
+                key += bound.offset;
+            return advance(pos, key, true /* strict */);
+        };
+
+    TwoStackQueue queue;
+    size_t begin = 0, end = 0;  // rows [begin, end) are in the queue
+
+    for (size_t i = 0;  i < n;  ++i) {
+        size_t newBegin = frameStart(i, begin);
+        size_t newEnd = std::max(frameEnd(i, end), newBegin);
+
+        // An empty frame that has jumped past the rows in the queue
+        if (newBegin >= end) {
+            queue = TwoStackQueue();
+            begin = end = newBegin;
+        }
+
+        for (;  end < newEnd;  ++end)
+            queue.push(FrameAggregate::of(values[end], timestamps[end], type));
+        for (;  begin < newBegin;  ++begin)
+            queue.pop();
+
+        result.emplace_back(queue.aggregate().value(type));
+    }
+
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,125 @@
+/** window_functions.h                                             -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Window functions, which calculate an aggregate over a frame of rows
+    around each row of an ordered partition.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* WINDOW FRAME                                                              */
+/*****************************************************************************/
+
+/** Unit in which the frame of a window function is expressed. */
+enum WindowFrameUnit {
+    WINDOW_ROWS,   ///< Offsets are numbers of rows
+    WINDOW_RANGE   ///< Offsets are distances in the value of the ORDER BY
+};
+
+DECLARE_ENUM_DESCRIPTION(WindowFrameUnit);
+
+/** One end of the frame of a window function. */
+struct WindowFrameBound {
+    enum Type {
+        UNBOUNDED_PRECEDING,
+        PRECEDING,
+        CURRENT_ROW,
+        FOLLOWING,
+        UNBOUNDED_FOLLOWING
+    };
+
+    WindowFrameBound(Type type = CURRENT_ROW, double offset = 0)
+        : type(type), offset(offset)
+    {
+    }
+
+    Type type;
+    double offset;   ///< For PRECEDING and FOLLOWING; never negative
+
+    Utf8String print() const;
+};
+
+/** Which rows, relative to the current one, a window function is
+    calculated over.  The default, as in standard SQL, is from the start of
+    the partition up to the last row that sorts equal to the current one.
+*/
+struct WindowFrame {
+    WindowFrame()
+        : unit(WINDOW_RANGE),
+          start(WindowFrameBound::UNBOUNDED_PRECEDING),
+          end(WindowFrameBound::CURRENT_ROW)
+    {
+    }
+
+    WindowFrameUnit unit;
+    WindowFrameBound start;
+    WindowFrameBound end;
+
+    /** Does the frame need the numeric value of the ORDER BY clause, and
+        not just which rows sort equal to each other?
+    */
+    bool needsOrderValue() const
+    {
+        return unit == WINDOW_RANGE
+            && (start.type == WindowFrameBound::PRECEDING
+                || start.type == WindowFrameBound::FOLLOWING
+                || end.type == WindowFrameBound::PRECEDING
+                || end.type == WindowFrameBound::FOLLOWING);
+    }
+
+    Utf8String print() const;
+};
+
+
+/*****************************************************************************/
+/* WINDOW FUNCTIONS                                                          */
+/*****************************************************************************/
+
+enum WindowFunctionType {
+    WINDOW_SUM,
+    WINDOW_COUNT,
+    WINDOW_AVG,
+    WINDOW_MIN,
+    WINDOW_MAX,
+    WINDOW_ROW_NUMBER
+};
+
+DECLARE_ENUM_DESCRIPTION(WindowFunctionType);
+
+/** Return the window function with the given name, or throw if there is
+    none.
+*/
+WindowFunctionType getWindowFunctionType(const Utf8String & name);
+
+/** Number of arguments taken by the given window function. */
+size_t getWindowFunctionArity(WindowFunctionType type);
+
+/** Calculate a window function over the rows of one partition, which are
+    given in the order of the window.  Arguments are:
+    - values: the value of the argument for each row; nulls are skipped;
+    - timestamps: the timestamp of each value;
+    - orderKeys: for each row, a number that is non-decreasing over the
+      partition.  For a frame that needsOrderValue(), it is the value of
+      the ORDER BY clause, negated for a descending order.  Otherwise it
+      only needs to be equal for rows that sort equal to each other.
+
+    Returns the value of the function for each row.  Each frame is
+    calculated in amortized constant time, as frames only ever move
+    forward over the partition.
+*/
+std::vector<ExpressionValue>
+calcWindowFunction(WindowFunctionType type,
+                   const WindowFrame & frame,
+                   const std::vector<CellValue> & values,
+                   const std::vector<Date> & timestamps,
+                   const std::vector<double> & orderKeys);
+
+} // namespace MLDB
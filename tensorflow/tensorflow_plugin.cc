@@ -5,6 +5,8 @@
 */
 
 #include <thread>
+#include <deque>
+#include <chrono>
 
 #include "mldb/core/mldb_entity.h"
 #include "mldb/core/function.h"
@@ -321,6 +323,21 @@ struct TensorflowGraphBase: public Function {
     SelectExpression inputs;
     SelectExpression outputs;
 
+    /// Maximum number of concurrent calls that are run together in a
+    /// single Session::Run.  One turns off batching.
+    int maxBatchSize = 1;
+
+    /// Maximum time in seconds that a call waits for others to join its
+    /// batch before it is run.
+    double batchDeadline = 0.001;
+
+    /// Number of sessions created on each device
+    int sessionsPerDevice = 5;
+
+    /// Device names (or parts of them, like "/gpu:0") to create sessions
+    /// on.  Empty means use the CPU only.
+    std::vector<std::string> devices;
+
     void init(std::unique_ptr<tensorflow::GraphDef> graphIn,
               SelectExpression inputs_,
               SelectExpression outputs_)
@@ -399,25 +416,34 @@ struct TensorflowGraphBase: public Function {
         // We need to create a session for each device, unfortunately,
         // due to Tensorflow having a "first matching" policy to
         // allocate devices to an executing graph.
-        std::vector<::tensorflow::Device *> devices;
-        tensorflow::DeviceFactory::AddDevices(options, "", &devices);
+        std::vector<::tensorflow::Device *> tfDevices;
+        tensorflow::DeviceFactory::AddDevices(options, "", &tfDevices);
         
-        int sessionsPerDevice = 5;
-
         // Operations hardcoded to the CPU.  These are those that
         // can't use GPUs or need large amounts of data to be
         // transferred back and forth and so don't make sense.
         set<string> hardcodedCpu = {
             /*"ExpandDims", "ResizeBilinear"*/ /*, "Cast", "Sub", "Mul", "ExpandDims/dim"*/ };
 
-        for (const auto & d: devices) {
+        for (const auto & d: tfDevices) {
             std::string deviceName = d->name();
             bool isCpuDevice = deviceName.find("/cpu:") != std::string::npos;
 
-            //if (isCpuDevice)
-            //    continue;
-            if (!isCpuDevice)
-                continue;
+            // Without an explicit list of devices, sessions are only
+            // created on the CPU
+            if (devices.empty()) {
+                if (!isCpuDevice)
+                    continue;
+            }
+            else {
+                bool selected = false;
+                for (const auto & pattern: devices) {
+                    if (deviceName.find(pattern) != std::string::npos)
+                        selected = true;
+                }
+                if (!selected)
+                    continue;
+            }
 
             // Set the device for all nodes where it's not hardcoded
             for (auto & node: *graph->mutable_node()) {
@@ -477,6 +503,16 @@ struct TensorflowGraphBase: public Function {
             }
         }
 
+        if (sessions.empty()) {
+            std::vector<std::string> available;
+            for (const auto & d: tfDevices)
+                available.push_back(d->name());
+            throw HttpReturnException
+                (400, "No TensorFlow device matches the requested devices",
+                 "requested", devices,
+                 "available", available);
+        }
+
         //std::this_thread::sleep_for(std::chrono::seconds(120));
     }
 
@@ -733,33 +769,8 @@ struct TensorflowGraphBase: public Function {
                 outputLayers.emplace_back(l.rawString());
             }
 
-            vector<Tensor> outputs;
-
-            auto doRun = [&] (int i)
-                {
-                    auto output = owner->call(inputTensors, inputLayers,
-                                              outputLayers, i);
-
-                    if (i == 0)
-                        outputs = std::move(output);
-                };
-
-
-#if 0
-            vector<std::thread> threads;
-            for (int i = 0;  i < 100;  ++i) {
-                threads.emplace_back([&,i] () { doRun(i); });
-                //std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            }
-
-            for (auto & t: threads)
-                t.join();
-
-#elif 0
-            parallelMap(0, 100, doRun);
-#else
-            doRun(0);
-#endif
+            vector<Tensor> outputs
+                = owner->callBatched(inputTensors, inputLayers, outputLayers);
 
             GraphExtractScope::RowScope outputRowScope(rowScope, outputs, outputTs);
             
@@ -1090,17 +1101,19 @@ struct TensorflowGraphBase: public Function {
             return ExpressionValue(std::move(cell), ts);
         }
         
-        auto flattened = tensor.flat<T>();
-        size_t n = flattened.size();
         DimsVector shape;
         for (unsigned i = 0;  i < tensor.dims();  ++i) {
             shape.emplace_back(tensor.dim_size(i));
         }
-        vector<CellValue> cells(n);
-        for (size_t i = 0;  i < n;  ++i) {
-            cells[i] = flattened(i);
-        }
-        return ExpressionValue(std::move(cells), ts, shape);
+
+        // The tensor's buffer is reference counted, so the embedding can
+        // point straight into it rather than copying each element into
+        // a cell.  The holder keeps the buffer alive.
+        auto holder = std::make_shared<tensorflow::Tensor>(tensor);
+        std::shared_ptr<const void> data(holder, holder->tensor_data().data());
+        return ExpressionValue::embedding(ts, std::move(data),
+                                          GetStorageType<T>::val,
+                                          std::move(shape));
     }
 
     static ExpressionValue tensorToValueT(const tensorflow::Tensor & tensor,
@@ -1254,7 +1267,6 @@ struct TensorflowGraphBase: public Function {
     {
         std::unique_lock<std::mutex> guard(queueLock);
         while (true) {
-            cerr << "spin on session " << &guard << endl;
             int bestSession = -1;
             double bestSessionScore = INFINITY;
             for (unsigned i = 0;  i < sessions.size();  ++i) {
@@ -1267,15 +1279,11 @@ struct TensorflowGraphBase: public Function {
                 }
             }
 
-            cerr << "bestSession = " << bestSession << endl;
-
             if (bestSession != -1) {
                 ++sessions[bestSession].numQueued;
                 auto onDel = [bestSession, this] (tensorflow::Session *)
                     {
-                        cerr << "before release session" << endl;
                         std::unique_lock<std::mutex> guard(this->queueLock);
-                        cerr << "after release session" << endl;
                         --this->sessions[bestSession].numQueued;
                         this->queueCond.notify_one();
                     };
@@ -1414,6 +1422,278 @@ struct TensorflowGraphBase: public Function {
         return outputs;
     }
 
+    /** A call waiting to be run as part of a batch.  It lives on the stack
+        of the calling thread, which waits until done is set.
+    */
+    struct PendingCall {
+        const std::vector<tensorflow::Tensor> * inputs;
+        const std::vector<std::string> * inputLayers;
+        const std::vector<std::string> * outputLayers;
+        std::chrono::steady_clock::time_point queued;
+        std::vector<tensorflow::Tensor> outputs;
+        std::exception_ptr exc;
+        bool done = false;
+    };
+
+    /// Calls that haven't yet been picked up by a batch.  Protected by
+    /// batchLock.
+    mutable std::deque<PendingCall *> batchQueue;
+    mutable bool batchLeaderActive = false;
+    mutable std::mutex batchLock;
+    mutable std::condition_variable batchCond;
+
+    /** Can the given call be run as part of a batch?  All of its inputs
+        need a leading dimension of the same non-zero size, which is the
+        one that calls are stacked along.
+    */
+    static bool isBatchable(const PendingCall & call)
+    {
+        const auto & inputs = *call.inputs;
+        if (inputs.empty())
+            return false;
+        for (const auto & t: inputs) {
+            if (t.dims() < 1 || t.dim_size(0) < 1
+                || t.dim_size(0) != inputs[0].dim_size(0))
+                return false;
+            if (t.dtype() != tensorflow::DT_STRING
+                && !tensorflow::DataTypeCanUseMemcpy(t.dtype()))
+                return false;
+        }
+        return true;
+    }
+
+    /** Can the two (batchable) calls be stacked into the same batch?  They
+        need to read and write the same layers, with tensors that agree
+        on everything but the leading dimension.
+    */
+    static bool canBatchTogether(const PendingCall & call1,
+                                 const PendingCall & call2)
+    {
+        if (*call1.inputLayers != *call2.inputLayers
+            || *call1.outputLayers != *call2.outputLayers)
+            return false;
+        for (size_t i = 0;  i < call1.inputs->size();  ++i) {
+            const auto & t1 = call1.inputs->at(i);
+            const auto & t2 = call2.inputs->at(i);
+            if (t1.dtype() != t2.dtype() || t1.dims() != t2.dims())
+                return false;
+            for (int d = 1;  d < t1.dims();  ++d) {
+                if (t1.dim_size(d) != t2.dim_size(d))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /** Stack the given tensors, which agree in everything but their
+        leading dimension, along that dimension.
+    */
+    static tensorflow::Tensor
+    concatRows(const std::vector<const tensorflow::Tensor *> & parts)
+    {
+        int64_t totalRows = 0;
+        for (auto * p: parts)
+            totalRows += p->dim_size(0);
+
+        tensorflow::TensorShape shape = parts[0]->shape();
+        shape.set_dim(0, totalRows);
+        tensorflow::Tensor result(parts[0]->dtype(), shape);
+
+        if (result.dtype() == tensorflow::DT_STRING) {
+            auto out = result.flat<std::string>();
+            size_t n = 0;
+            for (auto * p: parts) {
+                auto in = p->flat<std::string>();
+                for (size_t i = 0;  i < in.size();  ++i)
+                    out(n++) = in(i);
+            }
+        }
+        else {
+            char * out = const_cast<char *>(result.tensor_data().data());
+            for (auto * p: parts) {
+                auto in = p->tensor_data();
+                std::copy(in.data(), in.data() + in.size(), out);
+                out += in.size();
+            }
+        }
+
+        return result;
+    }
+
+    /** Return a copy of the rows [start, start + numRows) of the leading
+        dimension of the given tensor.
+    */
+    static tensorflow::Tensor
+    sliceRows(const tensorflow::Tensor & tensor,
+              int64_t start, int64_t numRows)
+    {
+        tensorflow::TensorShape shape = tensor.shape();
+        shape.set_dim(0, numRows);
+        tensorflow::Tensor result(tensor.dtype(), shape);
+
+        size_t rowElements = tensor.NumElements() / tensor.dim_size(0);
+
+        if (tensor.dtype() == tensorflow::DT_STRING) {
+            auto in = tensor.flat<std::string>();
+            auto out = result.flat<std::string>();
+            for (size_t i = 0;  i < (size_t)numRows * rowElements;  ++i)
+                out(i) = in(start * rowElements + i);
+        }
+        else {
+            auto in = tensor.tensor_data();
+            size_t rowBytes = in.size() / tensor.dim_size(0);
+            const char * first = in.data() + start * rowBytes;
+            std::copy(first, first + numRows * rowBytes,
+                      const_cast<char *>(result.tensor_data().data()));
+        }
+
+        return result;
+    }
+
+    /** Take the next batch off the front of the queue.  The oldest call is
+        always taken, along with any compatible ones up to maxBatchSize.
+        Must be called with batchLock held.
+    */
+    std::vector<PendingCall *> takeBatch() const
+    {
+        std::vector<PendingCall *> result = { batchQueue.front() };
+        batchQueue.pop_front();
+
+        if (!isBatchable(*result[0]))
+            return result;
+
+        for (auto it = batchQueue.begin();
+             it != batchQueue.end() && result.size() < (size_t)maxBatchSize;) {
+            if (isBatchable(**it) && canBatchTogether(*result[0], **it)) {
+                result.push_back(*it);
+                it = batchQueue.erase(it);
+            }
+            else ++it;
+        }
+
+        return result;
+    }
+
+    /** Run the given batch of calls in one Session::Run, and hand each of
+        them its share of the outputs.  Must be called without batchLock
+        held.
+    */
+    void runBatch(const std::vector<PendingCall *> & batch) const
+    {
+        try {
+            if (batch.size() == 1) {
+                batch[0]->outputs = call(*batch[0]->inputs,
+                                         *batch[0]->inputLayers,
+                                         *batch[0]->outputLayers,
+                                         0 /* n */);
+            }
+            else {
+                int64_t totalRows = 0;
+                for (auto * c: batch)
+                    totalRows += c->inputs->at(0).dim_size(0);
+
+                std::vector<tensorflow::Tensor> inputs;
+                for (size_t i = 0;  i < batch[0]->inputs->size();  ++i) {
+                    std::vector<const tensorflow::Tensor *> parts;
+                    for (auto * c: batch)
+                        parts.push_back(&c->inputs->at(i));
+                    inputs.emplace_back(concatRows(parts));
+                }
+
+                std::vector<tensorflow::Tensor> outputs
+                    = call(inputs, *batch[0]->inputLayers,
+                           *batch[0]->outputLayers, 0 /* n */);
+
+                for (const auto & output: outputs) {
+                    // Outputs that don't follow the batch dimension (for
+                    // example constants) are the same for every call
+                    bool isBatched = output.dims() >= 1
+                        && output.dim_size(0) == totalRows;
+                    int64_t start = 0;
+                    for (auto * c: batch) {
+                        int64_t numRows = c->inputs->at(0).dim_size(0);
+                        if (isBatched)
+                            c->outputs.emplace_back
+                                (sliceRows(output, start, numRows));
+                        else c->outputs.push_back(output);
+                        start += numRows;
+                    }
+                }
+            }
+        } catch (...) {
+            for (auto * c: batch)
+                c->exc = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> guard(batchLock);
+        for (auto * c: batch)
+            c->done = true;
+        batchCond.notify_all();
+    }
+
+    /** Run the graph, batching the call with other concurrent calls to
+        the same function.  Whenever no batch is being formed, the calling
+        thread takes over forming one: it waits until maxBatchSize calls
+        are queued or the oldest has waited batchDeadline seconds, and
+        then runs the batch itself.  Other callers sleep until their own
+        call has been run.
+    */
+    std::vector<tensorflow::Tensor>
+    callBatched(const std::vector<tensorflow::Tensor> & inputs,
+                const std::vector<string> & inputLayers,
+                const std::vector<string> & outputLayers) const
+    {
+        if (maxBatchSize <= 1)
+            return call(inputs, inputLayers, outputLayers, 0 /* n */);
+
+        PendingCall pending;
+        pending.inputs = &inputs;
+        pending.inputLayers = &inputLayers;
+        pending.outputLayers = &outputLayers;
+        pending.queued = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> guard(batchLock);
+        batchQueue.push_back(&pending);
+        batchCond.notify_all();
+
+        while (!pending.done) {
+            if (batchLeaderActive || batchQueue.empty()) {
+                batchCond.wait(guard);
+                continue;
+            }
+
+            batchLeaderActive = true;
+
+            if (isBatchable(*batchQueue.front())) {
+                auto deadline = batchQueue.front()->queued
+                    + std::chrono::duration_cast
+                        <std::chrono::steady_clock::duration>
+                        (std::chrono::duration<double>(batchDeadline));
+                while (batchQueue.size() < (size_t)maxBatchSize
+                       && std::chrono::steady_clock::now() < deadline) {
+                    batchCond.wait_until(guard, deadline);
+                }
+            }
+
+            std::vector<PendingCall *> batch = takeBatch();
+
+            // Let another thread form the next batch while we run this one
+            batchLeaderActive = false;
+            batchCond.notify_all();
+
+            guard.unlock();
+            runBatch(batch);
+            guard.lock();
+        }
+
+        guard.unlock();
+
+        if (pending.exc)
+            std::rethrow_exception(pending.exc);
+
+        return std::move(pending.outputs);
+    }
+
     virtual ExpressionValue
     apply(const FunctionApplier & applier,
           const ExpressionValue & context) const override
@@ -1577,6 +1857,10 @@ struct TensorflowGraphConfig {
     Url modelFileUrl;
     SelectExpression inputs;
     SelectExpression outputs;
+    int maxBatchSize = 1;
+    double batchDeadlineMs = 1.0;
+    int sessionsPerDevice = 5;
+    std::vector<std::string> devices;
 };
 
 
@@ -1595,6 +1879,40 @@ TensorflowGraphConfigDescription()
     addField("outputs", &TensorflowGraphConfig::outputs,
              "Outputs of the graph that are returned as the result of "
              "the function");
+    addField("maxBatchSize", &TensorflowGraphConfig::maxBatchSize,
+             "Maximum number of concurrent calls to the function that are "
+             "stacked along the first dimension of their inputs and run "
+             "together in a single pass over the graph.  The graph needs "
+             "to treat that dimension as a batch dimension.  The default "
+             "of 1 runs each call on its own.", 1);
+    addField("batchDeadlineMs", &TensorflowGraphConfig::batchDeadlineMs,
+             "Maximum time in milliseconds that a call waits for other "
+             "calls to join its batch when maxBatchSize is more than one.",
+             1.0);
+    addField("sessionsPerDevice", &TensorflowGraphConfig::sessionsPerDevice,
+             "Number of sessions created on each device, which is the "
+             "number of passes over the graph that can run on it at once.",
+             5);
+    addField("devices", &TensorflowGraphConfig::devices,
+             "Devices to run the graph on.  Each entry selects the devices "
+             "whose name contains it, for example `/gpu:0` or `/cpu:`.  "
+             "The default of an empty list runs on the CPU only.");
+    onPostValidate = [] (TensorflowGraphConfig * cfg,
+                         JsonParsingContext & context)
+        {
+            if (cfg->maxBatchSize < 1)
+                throw HttpReturnException
+                    (400, "maxBatchSize must be at least 1",
+                     "maxBatchSize", cfg->maxBatchSize);
+            if (cfg->batchDeadlineMs < 0)
+                throw HttpReturnException
+                    (400, "batchDeadlineMs can't be negative",
+                     "batchDeadlineMs", cfg->batchDeadlineMs);
+            if (cfg->sessionsPerDevice < 1)
+                throw HttpReturnException
+                    (400, "sessionsPerDevice must be at least 1",
+                     "sessionsPerDevice", cfg->sessionsPerDevice);
+        };
 }
 
 struct TensorflowGraph: public TensorflowGraphBase {
@@ -1629,6 +1947,11 @@ struct TensorflowGraph: public TensorflowGraphBase {
                 (500, "Couldn't load tensorflow graph model: parse error");
         }
 
+        maxBatchSize = functionConfig.maxBatchSize;
+        batchDeadline = functionConfig.batchDeadlineMs / 1000.0;
+        sessionsPerDevice = functionConfig.sessionsPerDevice;
+        devices = functionConfig.devices;
+
         this->init(std::move(graph), functionConfig.inputs, functionConfig.outputs);
 
         //cerr << SummarizeGraphDef(*this->graph);
@@ -47,3 +47,16 @@ BOOST_AUTO_TEST_CASE( conf_intervals_wilson )
     BOOST_CHECK_CLOSE( cI2.binomialUpperBound(200, 35), 0.2144, 0.1);
 }
 
+
+BOOST_AUTO_TEST_CASE( conf_intervals_normal )
+{
+    // 95% two sided: 1.96 standard errors on each side
+    ConfidenceIntervals ci(0.05);
+    auto b = ci.normalTwoSidedBound(10.0, 2.0);
+    BOOST_CHECK_CLOSE(b.first, 10.0 - 1.96 * 2.0, 0.1);
+    BOOST_CHECK_CLOSE(b.second, 10.0 + 1.96 * 2.0, 0.1);
+
+    b = ci.normalTwoSidedBound(10.0, 0.0);
+    BOOST_CHECK_EQUAL(b.first, 10.0);
+    BOOST_CHECK_EQUAL(b.second, 10.0);
+}
@@ -146,5 +146,35 @@ class TfIdfTest(MldbUnitTest):
         self.assertAlmostEqual(TfIdfTest.get_column(rez, 'output.jelly'), jelly_tfidf,
                         msg = "'jelly' tfidg is not equal to the one returned by scikit learn")
 
+    def test_min_document_frequency(self):
+        mldb.put("/v1/procedures/tf_idf_pruned", {
+            "type": "tfidf.train",
+            "params": {
+                "trainingData": "select * from bag_of_words",
+                "modelFileUrl": "file://tmp/MLDB-1101-pruned.idf",
+                "outputDataset": {
+                    "id": "tf_idf_pruned",
+                    "type": "sparse.mutable"
+                },
+                "minDocumentFrequency": 2,
+                "functionName": "tfidffunction_pruned",
+                "runOnCreation": True
+            }
+        })
+
+        self.assertTableResultEquals(
+            mldb.query("select * from tf_idf_pruned order by rowName() ASC"),
+            [ [ "_rowName", "count"],
+              ["butter", 2],
+              ["jelly", 3],
+              ["peanut", 2] ]
+        )
+
+        # Pruned terms are scored as if they weren't in the corpus
+        rez = mldb.get("/v1/query",
+                       q="select tfidffunction_pruned({{time: 1, bristol: 1} as input}) as *")
+        self.assertAlmostEqual(TfIdfTest.get_column(rez, 'output.time'),
+                               TfIdfTest.get_column(rez, 'output.bristol'))
+
 
 mldb.run_tests()
@@ -170,6 +170,56 @@ class SampledDatasetTest(unittest.TestCase):
             SELECT COLUMN EXPR (AS columnName() ORDER BY rowCount() DESC)
             FROM test_sampled_over_merged_sampled""")
 
+    def test_hash_method(self):
+        q = "select * from sample(toy, {fraction: 0.5, seed: 5, method: 'hash'})"
+        rez = mldb.get("/v1/query", q=q).json()
+        self.assertGreater(len(rez), 150)
+        self.assertLess(len(rez), 350)
+
+        # The same seed gives the same rows, in the order of the dataset
+        self.assertEqual(mldb.get("/v1/query", q=q).json(), rez)
+
+        # Rows are known to be in the sample or not without listing them
+        names = set(r['rowName'] for r in rez)
+        for i in (0, 1, 2, 3, 250, 499):
+            rowName = 'u%d' % i
+            found = mldb.get(
+                "/v1/query",
+                q=q + " where rowName() = '%s'" % rowName).json()
+            self.assertEqual(len(found), 1 if rowName in names else 0)
+
+        # Asking for a number of rows keeps about that many
+        rez = mldb.get(
+            "/v1/query",
+            q="select * from sample(toy, {rows: 100, method: 'hash'})").json()
+        self.assertGreater(len(rez), 30)
+        self.assertLess(len(rez), 200)
+
+    def test_reservoir_method(self):
+        q = "select * from sample(toy, {rows: 25, seed: 5, method: 'reservoir'})"
+        rez = mldb.get("/v1/query", q=q).json()
+        self.assertEqual(len(rez), 25)
+        self.assertEqual(len(set(r['rowName'] for r in rez)), 25)
+        self.assertEqual(mldb.get("/v1/query", q=q).json(), rez)
+
+        rez = mldb.get(
+            "/v1/query",
+            q="select * from sample(toy, {fraction: 0.1, method: 'reservoir'})")
+        self.assertEqual(len(rez.json()), 50)
+
+        # There are only 500 rows to pick from
+        rez = mldb.get(
+            "/v1/query",
+            q="select * from sample(toy, {rows: 1000, method: 'reservoir'})")
+        self.assertEqual(len(rez.json()), 500)
+
+    def test_only_index_method_with_replacement(self):
+        for method in ['hash', 'reservoir']:
+            with self.assertRaises(mldb_wrapper.ResponseException) as re:
+                mldb.get("/v1/query",
+                         q="select * from sample(toy, {rows: 10, "
+                           "withReplacement: 1, method: '%s'})" % method)
+
     def test_cant_create_wo_ds(self):
         # MLDB-1977
         msg = "You need to define the dataset key"
@@ -233,5 +233,65 @@ class LikeTest(MldbUnitTest):  # noqa
 
         self.assertEqual(res1[1], res2[1]);
 
+    def test_like_segments(self):
+        ds = mldb.create_dataset({ "id": "sample6", "type": "sparse.mutable" })
+        ds.record_row("a",[["x", "http://example.com/foo/bar", 0],
+                           ["y", "http://%/foo%", 0]])
+        ds.record_row("b",[["x", "http://example.com/bar/foo", 0],
+                           ["y", "%foo_bar%", 0]])
+        ds.record_row("c",[["x", u"caf\u00e9 cr\u00e8me", 0],
+                           ["y", "caf_ cr_me", 0]])
+        ds.record_row("d",[["x", "abab", 0], ["y", "ab%ab", 0]])
+        ds.record_row("e",[["x", "aba", 0], ["y", "ab%ba", 0]])
+        ds.record_row("f",[["x", "line\none", 0], ["y", "line_o%", 0]])
+        ds.commit()
+
+        # The pattern comes from each row
+        res = mldb.get('/v1/query', q='''
+            select x LIKE y as v, x NOT LIKE y as nv
+            from sample6
+            order by rowPath()
+        ''', format='aos').json()
+        self.assertEqual(res, [
+            { "_rowName": "a", "v": True, "nv": False },
+            { "_rowName": "b", "v": False, "nv": True },
+            { "_rowName": "c", "v": True, "nv": False },
+            { "_rowName": "d", "v": True, "nv": False },
+            { "_rowName": "e", "v": False, "nv": True },
+            { "_rowName": "f", "v": True, "nv": False }])
+
+        res = mldb.query('''
+            select x
+            from sample6
+            where x LIKE '%/foo%' and x LIKE 'http:__%'
+            order by rowPath()
+        ''')
+        self.assertEqual(res, [["_rowName", "x"],
+                               ["a", "http://example.com/foo/bar"],
+                               ["b", "http://example.com/bar/foo"]])
+
+    def test_regex_literals(self):
+        """
+        Regexes are only run on strings that contain the literal that
+        they require, which must not change their results.
+        """
+        res = mldb.get('/v1/query', q=r'''
+            select regex_match('abcd', 'ab?cd') as m1,
+                   regex_match('acd', 'ab?cd') as m2,
+                   regex_match('abbbd', 'ab+d') as m3,
+                   regex_match('xy', 'x(abc)*y') as m4,
+                   regex_search('xxfoo.barxx', 'foo\.bar') as s1,
+                   regex_search('xxfooXbarxx', 'foo\.bar') as s2,
+                   regex_search('FOO', '(?i)foo') as s3,
+                   regex_search('bar', 'foo|bar') as s4,
+                   regex_replace('hello', 'z+', 'x') as r1,
+                   regex_replace('hello', 'l+', 'L') as r2
+        ''', format='aos').json()
+        self.assertEqual(res, [{
+            "_rowName": "result",
+            "m1": True, "m2": True, "m3": True, "m4": True,
+            "s1": True, "s2": False, "s3": True, "s4": True,
+            "r1": "hello", "r2": "heLo" }])
+
 
 mldb.run_tests()
@@ -11,8 +11,11 @@
 #include <boost/test/unit_test.hpp>
 #include "mldb/plugins/frozen_column.h"
 #include "mldb/plugins/tabular_dataset_column.h"
+#include "mldb/plugins/tabular_dataset_chunk.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/arch/timers.h"
+#include "mldb/jml/db/persistent.h"
+#include <sstream>
 
 using namespace std;
 
@@ -29,6 +32,8 @@ freezeAndTest(const std::vector<CellValue> & cells)
         col.add(i, cells[i]);
     }
 
+    ColumnZoneMap zoneMap = ColumnZoneMap::fromColumn(col, cells.size());
+
     ColumnFreezeParameters params;
     std::shared_ptr<FrozenColumn> frozen = col.freeze(params);
 
@@ -37,6 +42,78 @@ freezeAndTest(const std::vector<CellValue> & cells)
     for (size_t i = 0;  i < cells.size();  ++i) {
         BOOST_REQUIRE_EQUAL(frozen->get(i), cells[i]);
     }
+
+    // Check the zone map against the values, and against the one that's
+    // recomputed from the frozen column
+    {
+        CellValue minValue, maxValue;
+        size_t numNulls = 0;
+        for (auto & c: cells) {
+            if (c.empty()) {
+                ++numNulls;
+                continue;
+            }
+            if (minValue.empty() || c < minValue)
+                minValue = c;
+            if (maxValue.empty() || maxValue < c)
+                maxValue = c;
+        }
+
+        ColumnZoneMap frozenZoneMap
+            = ColumnZoneMap::fromFrozenColumn(*frozen, cells.size());
+        for (auto * z: { &zoneMap, &frozenZoneMap }) {
+            BOOST_CHECK_EQUAL(z->minValue, minValue);
+            BOOST_CHECK_EQUAL(z->maxValue, maxValue);
+            BOOST_CHECK_EQUAL(z->numNulls, numNulls);
+        }
+        BOOST_CHECK_EQUAL(zoneMap.numDistinct, frozenZoneMap.numDistinct);
+    }
+
+    // Check that filtering rows gives the same result as a scan
+    if (!cells.empty()) {
+        CellValue pivot = cells[cells.size() / 2];
+        auto filter = [&] (const CellValue & val)
+            {
+                BOOST_REQUIRE(!val.empty());
+                return pivot.empty() || val < pivot;
+            };
+        std::vector<size_t> expected, rows;
+        for (size_t i = 0;  i < cells.size();  ++i) {
+            if (!cells[i].empty() && filter(cells[i]))
+                expected.push_back(i);
+        }
+        frozen->forEachRowWhere(filter,
+                                [&] (size_t rowNum)
+                                {
+                                    rows.push_back(rowNum);
+                                    return true;
+                                });
+        std::sort(rows.begin(), rows.end());
+        BOOST_CHECK_EQUAL_COLLECTIONS(rows.begin(), rows.end(),
+                                      expected.begin(), expected.end());
+    }
+
+    // Check that it round-trips through serialization, both copying and
+    // pointing into the serialized memory
+    std::ostringstream stream;
+    {
+        ML::DB::Store_Writer store(stream);
+        FrozenColumn::serializeColumn(*frozen, store);
+    }
+    auto serialized = std::make_shared<std::string>(stream.str());
+
+    for (bool mapped: { false, true }) {
+        ML::DB::Store_Reader store(serialized->data(), serialized->size());
+        std::shared_ptr<const void> mapping;
+        if (mapped)
+            mapping = serialized;
+        auto reconstituted = FrozenColumn::reconstitute(store, mapping);
+        BOOST_CHECK_EQUAL(reconstituted->format(), frozen->format());
+        BOOST_REQUIRE_EQUAL(reconstituted->size(), cells.size());
+        for (size_t i = 0;  i < cells.size();  ++i) {
+            BOOST_REQUIRE_EQUAL(reconstituted->get(i), cells[i]);
+        }
+    }
     
     return frozen;
 }
@@ -188,3 +265,125 @@ BOOST_AUTO_TEST_CASE( test_big_pos_neg_range_and_nulls )
 
     freezeAndTest(vals);
 }
+
+// Low cardinality strings with long runs go in a run length table
+BOOST_AUTO_TEST_CASE( test_run_length_strings )
+{
+    std::vector<CellValue> vals;
+    const char * countries[] = { "ca", "us", "fr", "ca" };
+    for (unsigned i = 0;  i < 4000;  ++i) {
+        if (i >= 1500 && i < 1600)
+            vals.emplace_back();  // a run of nulls
+        else vals.emplace_back(countries[i / 1000]);
+    }
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::RunLengthTableFrozenColumn");
+
+    size_t numCa = 0;
+    auto onRow = [&] (size_t rowNum)
+        {
+            BOOST_CHECK_EQUAL(vals.at(rowNum), CellValue("ca"));
+            ++numCa;
+            return true;
+        };
+    frozen->forEachMatchingRow(CellValue("ca"), onRow);
+    BOOST_CHECK_EQUAL(numCa, 2000);
+
+    size_t numNonNull = 0;
+    auto onValue = [&] (size_t rowNum, const CellValue & val)
+        {
+            BOOST_CHECK_EQUAL(vals.at(rowNum), val);
+            ++numNonNull;
+            return true;
+        };
+    frozen->forEach(onValue);
+    BOOST_CHECK_EQUAL(numNonNull, 3900);
+
+    size_t numDistinct = 0;
+    frozen->forEachDistinctValue([&] (const CellValue &)
+                                 { ++numDistinct;  return true; });
+    BOOST_CHECK_EQUAL(numDistinct, 4);  // ca, us, fr and null
+}
+
+// High cardinality strings aren't worth run length encoding
+BOOST_AUTO_TEST_CASE( test_no_run_length_for_distinct_strings )
+{
+    std::vector<CellValue> vals;
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        vals.emplace_back("value" + std::to_string(i % 10));
+    }
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::TableFrozenColumn");
+
+    size_t numMatching = 0;
+    frozen->forEachMatchingRow(CellValue("value3"),
+                               [&] (size_t rowNum)
+                               {
+                                   BOOST_CHECK_EQUAL(rowNum % 10, 3);
+                                   ++numMatching;
+                                   return true;
+                               });
+    BOOST_CHECK_EQUAL(numMatching, 100);
+}
+
+// Reals that fit in a float are stored as a float array
+BOOST_AUTO_TEST_CASE( test_frozen_floats )
+{
+    std::vector<CellValue> vals;
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        vals.emplace_back(i * 0.25);
+    }
+    vals.emplace_back();  // add a null
+    vals.emplace_back(-1.5);
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::DoubleFrozenColumn");
+    BOOST_CHECK_LT(frozen->memusage(), vals.size() * 5);
+
+    std::vector<double> extracted(vals.size());
+    frozen->extractNumbers(0, vals.size(), extracted.data());
+    for (size_t i = 0;  i < vals.size();  ++i) {
+        if (vals[i].empty())
+            BOOST_CHECK(std::isnan(extracted[i]));
+        else BOOST_CHECK_EQUAL(extracted[i], vals[i].toDouble());
+    }
+}
+
+// Reals that need full precision are stored as doubles
+BOOST_AUTO_TEST_CASE( test_frozen_doubles )
+{
+    std::vector<CellValue> vals;
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        vals.emplace_back(i / 3.0);
+    }
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::DoubleFrozenColumn");
+}
+
+// Timestamps are stored as bit-packed offsets from the earliest one
+BOOST_AUTO_TEST_CASE( test_frozen_timestamps )
+{
+    std::vector<CellValue> vals;
+    Date start = Date::fromSecondsSinceEpoch(1478000000.123);
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        vals.emplace_back(start.plusSeconds(i * 0.5));
+    }
+    vals.emplace_back();  // add a null
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::TimestampFrozenColumn");
+    BOOST_CHECK_LT(frozen->memusage(), vals.size() * 3);
+}
@@ -4,7 +4,7 @@
 # This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
 #
 
-import os, tempfile
+import os, tempfile, time
 from math import sqrt
 
 mldb = mldb_wrapper.wrap(mldb)  # noqa
@@ -480,6 +480,77 @@ class MLDB1750DistTables(MldbUnitTest):  # noqa
         # make sure the counts are the updated counts
         incrementAndTest([['host', 'patate']], None, [150, 50, 200], "get_stats_reloaded")
 
+    def test_snapshot_interval(self):
+        mldb.post('/v1/procedures', {
+            'type': 'experimental.distTable.train',
+            'params': {
+                'trainingData': """ SELECT host
+                                    FROM bid_req
+                                    ORDER BY order_
+                                """,
+                'outcomes': [['price', 'price']],
+                'distTableFileUrl': "file://tmp/mldb-1750_snapshot_interval.dt",
+                'runOnCreation': True
+            }
+        })
+
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "can't be negative"):
+            mldb.put('/v1/functions/get_stats_bad_interval', {
+                'type': 'experimental.distTable.getStats',
+                'params': {
+                    'distTableFileUrl': "file://tmp/mldb-1750_snapshot_interval.dt",
+                    'snapshotInterval': -1
+                }
+            })
+
+        mldb.put('/v1/functions/get_stats_periodic', {
+            'type': 'experimental.distTable.getStats',
+            'params': {
+                'distTableFileUrl': "file://tmp/mldb-1750_snapshot_interval.dt",
+                'statistics': ['count', 'sum'],
+                'snapshotInterval': 0.1
+            }
+        })
+
+        def getStats():
+            return mldb.query("""
+                SELECT get_stats_periodic({features: {host: 'frite.com'}})[stats] AS *
+            """)[1][1:]
+
+        self.assertEqual(getStats(), [0, 0])
+
+        for price in [5, 10, 20]:
+            mldb.post("/v1/functions/get_stats_periodic/routes/increment", {
+                'keys': [['host', 'frite.com']],
+                'outcomes': [price]
+            })
+
+        # the increments become visible once the snapshot is published
+        for i in range(100):
+            if getStats() == [3, 35]:
+                break
+            time.sleep(0.1)
+        self.assertEqual(getStats(), [3, 35])
+
+        # persisting always writes the latest counts
+        mldb.post("/v1/functions/get_stats_periodic/routes/persist", {
+            'modelFileUrl': "file://tmp/mldb-1750_snapshot_interval_persist.dt"
+        })
+        mldb.put('/v1/functions/get_stats_periodic_reloaded', {
+            'type': 'experimental.distTable.getStats',
+            'params': {
+                'distTableFileUrl': "file://tmp/mldb-1750_snapshot_interval_persist.dt",
+                'statistics': ['count', 'sum']
+            }
+        })
+        self.assertTableResultEquals(
+            mldb.query("""
+                SELECT get_stats_periodic_reloaded({features: {host: 'frite.com'}})[stats] AS *
+            """),
+            [["_rowName", "price.host.count", "price.host.sum"],
+             ["result", 3, 35]])
+
 
 
 if __name__ == '__main__':
@@ -101,6 +101,37 @@ class MLDB1753UseragentFunction(MldbUnitTest):  # noqa
             [["_rowName","browser.family","browser.version","device.brand","device.model","isSpider","os.family","os.version"],
             ["result",None,None,None,None,None,None,None]])
 
+    def test_cache(self):
+        # A tiny cache, so that entries get evicted and parsed again
+        mldb.put("/v1/functions/useragent_small_cache", {
+                "type": "http.useragent",
+                "params": {
+                        "regexFile": "mldb/ext/uap-core/regexes.yaml",
+                        "cacheSize": 2
+                    }
+            })
+        mldb.put("/v1/functions/useragent_no_cache", {
+                "type": "http.useragent",
+                "params": {
+                        "regexFile": "mldb/ext/uap-core/regexes.yaml",
+                        "cacheSize": 0
+                    }
+            })
+
+        uas = [
+            'Mozilla/5.0 (iPhone; CPU iPhone OS 5_1_1 like Mac OS X) AppleWebKit/534.46 (KHTML, like Gecko) Version/5.1 Mobile/9B206 Safari/7534.48.3',
+            'Mozilla/5.0 (Windows NT 6.1; WOW64; rv:40.0) Gecko/20100101 Firefox/40.1',
+            'Googlebot/2.1 (+http://www.google.com/bot.html)',
+            'Mozilla/5.0 (Linux; Android 4.4.2; Nexus 5 Build/KOT49H) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/32.0.1700.99 Mobile Safari/537.36'
+        ]
+        for i in range(3):
+            for ua in uas:
+                query = "select %s({ua: '" + ua + "'}) as *"
+                expected = mldb.query(query % "useragent_no_cache")
+                self.assertEqual(mldb.query(query % "useragent"), expected)
+                self.assertEqual(mldb.query(query % "useragent_small_cache"),
+                                 expected)
+
 
 if __name__ == '__main__':
     mldb.run_tests()
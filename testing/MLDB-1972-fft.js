@@ -70,4 +70,17 @@ mldb.log(resp);
 // Make sure that the inverse of an FFT is equal to the original input
 assertEqual(resp[0].columns[0][1], 1);
 
+// A leading dimension transforms each entry separately, in one call
+var resp = mldb.query("select fft([impulse(32), shifted_impulse(32, 1)], 'forward') = [fft(impulse(32), 'forward'), fft(shifted_impulse(32, 1), 'forward')] as r");
+
+mldb.log(resp);
+
+assertEqual(resp[0].columns[0][1], 1);
+
+var resp = mldb.query("select quantize(fft(fft([shifted_impulse(32, 3), shifted_impulse(32, 31)], 'forward'), 'backward'), 0.001) = [shifted_impulse(32, 3), shifted_impulse(32, 31)] as r");
+
+mldb.log(resp);
+
+assertEqual(resp[0].columns[0][1], 1);
+
 "success"
@@ -81,6 +81,62 @@ class Mldb775(MldbUnitTest):
             else:
                 raise Exception("identical")
 
+    def test_embedding_output(self):
+        inputs = [{"fwin": 1, "fwine": 2, "fwinette": 3}, {"a": "x"}, {}]
+        for mode in ["columns", "columnsAndValues"]:
+            mldb.put("/v1/functions/featHasherRow", {
+                "type": "feature_hasher",
+                "params": { "numBits": 4, "mode": mode }
+            })
+            mldb.put("/v1/functions/featHasherEmbedding", {
+                "type": "feature_hasher",
+                "params": { "numBits": 4, "mode": mode,
+                            "output": "embedding" }
+            })
+
+            for columns in inputs:
+                row = mldb.get("/v1/functions/featHasherRow/application",
+                               input={"columns": columns}).json()
+                embedding = mldb.get(
+                    "/v1/functions/featHasherEmbedding/application",
+                    input={"columns": columns}).json()
+                row = row["output"]["hash"]
+                embedding = embedding["output"]["hash"]
+                self.assertEqual(len(embedding), 2**4)
+                self.assertEqual(
+                    embedding,
+                    [row["hashColumn%d" % i] for i in range(2**4)])
+
+    def test_signed_hashing(self):
+        mldb.put("/v1/functions/featHasherSigned", {
+            "type": "feature_hasher",
+            "params": { "numBits": 10, "signedHashing": True,
+                        "output": "embedding" }
+        })
+        res = mldb.get("/v1/functions/featHasherSigned/application",
+                       input={"columns": {"a": 1, "b": 1, "c": 1}}).json()
+        values = res["output"]["hash"]
+        self.assertEqual(len(values), 2**10)
+        # each column goes to a single bucket, with a weight of 1 or -1
+        self.assertLessEqual(sum(abs(v) for v in values), 3)
+
+        res1 = mldb.get("/v1/functions/featHasherSigned/application",
+                        input={"columns": {"a": 1}}).json()
+        self.assertEqual(sorted(abs(v) for v in res1["output"]["hash"]
+                                if v != 0), [1])
+
+        # the same features hash the same way
+        res2 = mldb.get("/v1/functions/featHasherSigned/application",
+                        input={"columns": {"c": 5, "a": 1, "b": 2}}).json()
+        self.assertEqual(res2["output"]["hash"], values)
+
+    def test_bad_num_bits(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.put("/v1/functions/featHasherBad", {
+                "type": "feature_hasher",
+                "params": { "numBits": 0 }
+            })
+
 
 mldb.run_tests()
 
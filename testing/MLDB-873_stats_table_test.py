@@ -325,4 +325,47 @@ for row in js_rez:
     assert "columns" not in row
 
 
+#######
+# Test lookups in a larger table, with numeric keys that are looked up
+# as strings
+many = mldb.create_dataset({"type": "sparse.mutable", "id": "many_keys"})
+for i in range(2000):
+    many.record_row("row%d" % i, [["key", i % 500, now],
+                                  ["CLICK", i % 3, now]])
+many.commit()
+
+conf = {
+    "type": "statsTable.train",
+    "params": {
+        "trainingData": "select key from many_keys",
+        "outputDataset": "many_keys_out",
+        "outcomes": [["label", "CLICK = 0"]],
+        "statsTableFileUrl": "file://build/x86_64/tmp/mldb-873-stats_table_many.st",
+        "functionName": "manySt",
+        "runOnCreation": True
+    }
+}
+mldb.put("/v1/procedures/many_keys_proc", conf)
+
+for key in [0, 1, 250, 499]:
+    rez = mldb.get("/v1/functions/manySt/application",
+                   input={"keys": {"key": key}})
+    counts = rez.json()["output"]["counts"]
+    trials = [c[1][0][0][1][0] for c in counts if c[0] == "trial"][0]
+    labels = [c[1][0][0][1][0] for c in counts if c[0] == "label"][0]
+    assert trials == 4, trials
+    assert labels == len([i for i in range(key, 2000, 500) if i % 3 == 0]), \
+        labels
+
+    rez = mldb.get("/v1/functions/manySt/application",
+                   input={"keys": {"key": str(key)}})
+    assert rez.json()["output"]["counts"] == counts
+
+rez = mldb.get("/v1/functions/manySt/application",
+               input={"keys": {"key": 500}})
+trials = [c[1][0][0][1][0]
+          for c in rez.json()["output"]["counts"] if c[0] == "trial"][0]
+assert trials == 0, trials
+
+
 mldb.script.set_return("success")
@@ -314,6 +314,63 @@ class Mldb878Test(MldbUnitTest):  # noqa
             mldb.put("/v1/procedures/rocket_science", conf)
 
 
+    def test_parallel_folds(self):
+        def run_experiment(name, max_parallel_folds):
+            conf = {
+                "type": "classifier.experiment",
+                "params": {
+                    "experimentName": name,
+                    "inputData": "select {* EXCLUDING(label)} as features, label from toy",
+                    "kfold": 4,
+                    "modelFileUrlPattern": "file://build/x86_64/tmp/parallel-$runid.cls",
+                    "algorithm": "glz",
+                    "mode": "boolean",
+                    "configuration": {
+                        "glz": {
+                            "type": "glz",
+                            "normalize": False,
+                            "regularization": 'l2'
+                        }
+                    },
+                    "outputAccuracyDataset": True,
+                    "evalTrain": True,
+                    "maxParallelFolds": max_parallel_folds,
+                    "runOnCreation": True
+                }
+            }
+            rez = mldb.put("/v1/procedures/" + name, conf)
+            return rez.json()["status"]["firstRun"]["status"]
+
+        sequential = run_experiment("sequential_folds", 1)
+
+        # Running the folds at the same time gives the same results, in the
+        # same order
+        for name, max_parallel_folds in [("parallel_folds", 4),
+                                         ("auto_folds", 0)]:
+            parallel = run_experiment(name, max_parallel_folds)
+            self.assertEqual(len(parallel["folds"]), 4)
+            for i in range(4):
+                seq_fold = sequential["folds"][i]
+                par_fold = parallel["folds"][i]
+                self.assertEqual(par_fold["fold"], seq_fold["fold"])
+                self.assertEqual(par_fold["functionName"],
+                                 "%s_scorer_%d" % (name, i))
+                self.assertEqual(par_fold["accuracyDataset"],
+                                 "%s_results_%d" % (name, i))
+                self.assertAlmostEqual(par_fold["resultsTest"]["auc"],
+                                       seq_fold["resultsTest"]["auc"])
+                self.assertAlmostEqual(par_fold["resultsTrain"]["auc"],
+                                       seq_fold["resultsTrain"]["auc"])
+                count = mldb.query("select count(*) from %s_results_%d"
+                                   % (name, i))[1][1]
+                self.assertEqual(count, mldb.query(
+                    "select count(*) from toy where %s"
+                    % seq_fold["fold"]["testingWhere"])[1][1])
+
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "maxParallelFolds"):
+            run_experiment("bad_parallel_folds", -1)
+
     def test_uniqueScoreOutput(self):
         for unique in [True, False]:
             conf = {
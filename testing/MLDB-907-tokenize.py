@@ -225,5 +225,40 @@ class TokenizeTest(MldbUnitTest):  # noqa
             'columns' : [['tokenize(NULL)', None, '-Inf']]
         }])
 
+    def test_quotes(self):
+        # A closing quote followed by text other than a separator is dropped
+        result = mldb.get(
+            '/v1/query',
+            q="""SELECT tokenize('"a,b"c,d,"e"', {quoteChar: '"'})
+                        AS tokens""")
+        self.find_column(result, 'tokens.a,bc', 1)
+        self.find_column(result, 'tokens.d', 1)
+        self.find_column(result, 'tokens.e', 1)
+
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.get('/v1/query',
+                     q="""SELECT tokenize('a,"b', {quoteChar: '"'})""")
+
+    def test_single_byte_same_as_generic(self):
+        # A separator that isn't a single byte, and which isn't in the
+        # text, makes the generic tokenizer run instead of the fast one
+        texts = ["a,b,,c,a", '"x,y",x,"x""y",z"z"', u"été,ça,été,",
+                 ",,a b,a b c,,b c", ""]
+        options = ["{quoteChar: '\"'}",
+                   "{quoteChar: '\"', minTokenLength: 0}",
+                   "{minTokenLength: 2, offset: 1, limit: 3}",
+                   "{ngramRange: [1, 3]}",
+                   "{ngramRange: [2, 2], value: 'x'}"]
+        for text in texts:
+            for opts in options:
+                fast = mldb.query(
+                    u"SELECT print_json(tokenize('%s', %s)) AS t"
+                    % (text.replace("'", "''"), opts))
+                generic_opts = opts[:-1] + u", splitChars: ',…'}"
+                generic = mldb.query(
+                    u"SELECT print_json(tokenize('%s', %s)) AS t"
+                    % (text.replace("'", "''"), generic_opts))
+                self.assertEqual(fast, generic)
+
 if __name__ == '__main__':
     mldb.run_tests()
@@ -0,0 +1,152 @@
+/** admission_control_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the admission control of heavy requests.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/server/admission_control.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_classify )
+{
+    typedef AdmissionControl AC;
+
+    BOOST_CHECK_EQUAL(AC::classify("GET", "/v1/query"), AC::RC_QUERY);
+    BOOST_CHECK_EQUAL(AC::classify("GET", "/v1/datasets/ds/query"),
+                      AC::RC_QUERY);
+    BOOST_CHECK_EQUAL(AC::classify("GET", "/v1/functions/f/application"),
+                      AC::RC_FUNCTION);
+    BOOST_CHECK_EQUAL(AC::classify("GET", "/v1/functions/f/batch"),
+                      AC::RC_FUNCTION);
+    BOOST_CHECK_EQUAL(AC::classify("POST", "/v1/procedures"),
+                      AC::RC_PROCEDURE);
+    BOOST_CHECK_EQUAL(AC::classify("PUT", "/v1/procedures/p"),
+                      AC::RC_PROCEDURE);
+    BOOST_CHECK_EQUAL(AC::classify("POST", "/v1/procedures/p/runs"),
+                      AC::RC_PROCEDURE);
+    BOOST_CHECK_EQUAL(AC::classify("PUT", "/v1/procedures/p/runs/r/"),
+                      AC::RC_PROCEDURE);
+
+    // Reads and management calls aren't controlled
+    BOOST_CHECK_EQUAL(AC::classify("GET", "/v1/procedures/p/runs"),
+                      AC::RC_NONE);
+    BOOST_CHECK_EQUAL(AC::classify("GET", "/v1/datasets/ds"), AC::RC_NONE);
+    BOOST_CHECK_EQUAL(AC::classify("DELETE", "/v1/query"), AC::RC_NONE);
+    BOOST_CHECK_EQUAL(AC::classify("GET", "/v1/functions/f/info"),
+                      AC::RC_NONE);
+    BOOST_CHECK_EQUAL(AC::classify("GET", "/ping"), AC::RC_NONE);
+}
+
+BOOST_AUTO_TEST_CASE( test_unlimited )
+{
+    AdmissionControl admission(AdmissionControl::Config{});
+
+    std::vector<std::shared_ptr<void> > tickets;
+    for (int i = 0;  i < 100;  ++i) {
+        tickets.push_back(admission.admit(AdmissionControl::RC_QUERY, ""));
+        BOOST_REQUIRE(tickets.back());
+    }
+
+    Json::Value stats = admission.getStats();
+    BOOST_CHECK_EQUAL(stats["classes"]["query"]["running"].asInt(), 100);
+    tickets.clear();
+    stats = admission.getStats();
+    BOOST_CHECK_EQUAL(stats["classes"]["query"]["running"].asInt(), 0);
+    BOOST_CHECK_EQUAL(stats["classes"]["query"]["admitted"].asInt(), 100);
+}
+
+BOOST_AUTO_TEST_CASE( test_shares_and_queueing )
+{
+    typedef AdmissionControl AC;
+
+    AC::Config config;
+    config.slots = 4;
+    config.weights[AC::RC_QUERY] = 1;
+    config.weights[AC::RC_FUNCTION] = 2;
+    config.weights[AC::RC_PROCEDURE] = 1;
+    config.maxQueued = 1;
+    AC admission(config);
+
+    Json::Value stats = admission.getStats();
+    BOOST_CHECK_EQUAL(stats["classes"]["query"]["share"].asInt(), 1);
+    BOOST_CHECK_EQUAL(stats["classes"]["function"]["share"].asInt(), 2);
+    BOOST_CHECK_EQUAL(stats["classes"]["procedure"]["share"].asInt(), 1);
+
+    // Procedures may borrow all of the free slots
+    std::vector<std::shared_ptr<void> > procedures;
+    for (int i = 0;  i < 4;  ++i) {
+        procedures.push_back(admission.admit(AC::RC_PROCEDURE, ""));
+        BOOST_REQUIRE(procedures.back());
+    }
+
+    // But functions still get their share straight away
+    auto f1 = admission.admit(AC::RC_FUNCTION, "");
+    auto f2 = admission.admit(AC::RC_FUNCTION, "");
+    BOOST_CHECK(f1);
+    BOOST_CHECK(f2);
+
+    // A third function has to wait for a slot, and a fourth doesn't fit in
+    // the queue
+    std::atomic<bool> admitted(false);
+    std::thread waiter([&] ()
+        {
+            auto f3 = admission.admit(AC::RC_FUNCTION, "");
+            BOOST_CHECK(f3);
+            admitted = true;
+        });
+
+    while (admission.getStats()["classes"]["function"]["queued"].asInt() == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    BOOST_CHECK(!admission.admit(AC::RC_FUNCTION, ""));
+    BOOST_CHECK(!admitted);
+
+    // Finishing procedures doesn't make room while they're still over the
+    // total, but once under it the waiting function goes ahead rather than
+    // a new procedure
+    procedures.pop_back();
+    procedures.pop_back();
+    procedures.pop_back();
+    waiter.join();
+    BOOST_CHECK(admitted);
+
+    stats = admission.getStats();
+    BOOST_CHECK_EQUAL(stats["classes"]["function"]["rejected"].asInt(), 1);
+    BOOST_CHECK_EQUAL(stats["classes"]["function"]["waited"].asInt(), 1);
+    BOOST_CHECK_EQUAL(stats["classes"]["function"]["admitted"].asInt(), 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_tenants )
+{
+    typedef AdmissionControl AC;
+
+    AC::Config config;
+    config.maxPerTenant = 2;
+    AC admission(config);
+
+    auto t1 = admission.admit(AC::RC_QUERY, "a");
+    auto t2 = admission.admit(AC::RC_FUNCTION, "a");
+    BOOST_CHECK(t1);
+    BOOST_CHECK(t2);
+    BOOST_CHECK(!admission.admit(AC::RC_QUERY, "a"));
+    BOOST_CHECK(admission.admit(AC::RC_QUERY, "b"));
+    BOOST_CHECK(admission.admit(AC::RC_QUERY, ""));
+
+    t1.reset();
+    BOOST_CHECK(admission.admit(AC::RC_QUERY, "a"));
+    BOOST_CHECK_EQUAL(admission.getStats()["rejectedTenant"].asInt(), 1);
+}
@@ -0,0 +1,100 @@
+#
+# approx_aggregators_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the approximate aggregators: approx_count_distinct, approx_quantile,
+# approx_percentile and topk.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class ApproxAggregatorsTest(MldbUnitTest):  # noqa
+
+    num_rows = 20000
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({"id": "events", "type": "sparse.mutable"})
+        random.seed(1)
+        cls.values = []
+        for i in range(cls.num_rows):
+            value = random.random()
+            cls.values.append(value)
+            ds.record_row("r%d" % i, [["user", i % 5000, 0],
+                                      ["group", i % 2, 0],
+                                      ["value", value, 0],
+                                      ["item", int(value ** 3 * 100), 0]])
+        ds.commit()
+
+    def test_count_distinct(self):
+        res = mldb.query("select approx_count_distinct(user) as n, "
+                         "count_distinct(user) as exact from events")
+        self.assertEqual(res[1][2], 5000)
+        self.assertLess(abs(res[1][1] - 5000), 5000 * 0.05)
+
+    def test_count_distinct_small_is_exact(self):
+        res = mldb.query("select approx_count_distinct(group) as n "
+                         "from events")
+        self.assertEqual(res[1][1], 2)
+
+    def test_count_distinct_group_by(self):
+        res = mldb.query("select approx_count_distinct(user) as n "
+                         "from events group by group")
+        self.assertEqual(len(res), 3)
+        for row in res[1:]:
+            self.assertLess(abs(row[1] - 2500), 2500 * 0.05)
+
+    def test_quantiles(self):
+        values = sorted(self.values)
+        res = mldb.query("""
+            select approx_quantile(value, 0.5) as median,
+                   approx_percentile(value, 90) as p90,
+                   approx_quantile(value, 0) as min,
+                   approx_quantile(value, 1) as max
+            from events
+        """)
+        col = {name: i for i, name in enumerate(res[0])}
+        row = res[1]
+        self.assertLess(abs(row[col["median"]] - values[len(values) / 2]),
+                        0.01)
+        self.assertLess(abs(row[col["p90"]] - values[len(values) * 9 / 10]),
+                        0.01)
+        self.assertEqual(row[col["min"]], values[0])
+        self.assertEqual(row[col["max"]], values[-1])
+
+    def test_quantile_group_by(self):
+        res = mldb.query("select approx_quantile(value, 0.5) as median "
+                         "from events group by group")
+        for row in res[1:]:
+            self.assertLess(abs(row[1] - 0.5), 0.05)
+
+    def test_vertical_quantile(self):
+        res = mldb.query("select vertical_approx_quantile({value}, 0.5) "
+                         "as median from events")
+        self.assertLess(abs(res[1][1] - 0.5), 0.05)
+
+    def test_bad_quantile(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "quantile must be between 0 and 1"):
+            mldb.query("select approx_quantile(value, 2) from events")
+
+    def test_topk(self):
+        counts = {}
+        for v in self.values:
+            item = int(v ** 3 * 100)
+            counts[item] = counts.get(item, 0) + 1
+        expected = sorted(counts.items(), key=lambda x: (-x[1], x[0]))[:3]
+
+        res = mldb.query("select topk(item, 3) as * from events")
+        self.assertEqual(len(res[0]) - 1, 3)
+        found = dict(zip(res[0][1:], res[1][1:]))
+        for item, count in expected:
+            self.assertIn(str(item), found)
+            self.assertGreaterEqual(found[str(item)], count)
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,117 @@
+#
+# archive_index_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Members of tar and zip files opened through the archive index
+#
+
+import tarfile, zipfile, tempfile, io, shutil, os
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ArchiveIndexTest(MldbUnitTest):  # noqa
+
+    members = {
+        'a.csv' : 'x,y\n1,2\n3,4\n',
+        'dir/b.csv' : 'x,y\n' + ''.join('{},{}\n'.format(i, i * 2)
+                                        for i in range(1000)),
+        'l' * 120 + '/c.csv' : 'x,y\n5,6\n',
+    }
+
+    @classmethod
+    def setUpClass(cls):
+        cls.dir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+
+        def add_tar(name, mode, format):
+            with tarfile.open(os.path.join(cls.dir, name), mode,
+                              format=format) as t:
+                for member, content in cls.members.items():
+                    info = tarfile.TarInfo(member)
+                    info.size = len(content)
+                    t.addfile(info, io.BytesIO(content.encode('utf-8')))
+
+        add_tar('ustar.tar', 'w', tarfile.USTAR_FORMAT)
+        add_tar('gnu.tar', 'w', tarfile.GNU_FORMAT)
+        add_tar('pax.tar', 'w', tarfile.PAX_FORMAT)
+        # compressed tar files can't be indexed, and are streamed instead
+        add_tar('gnu.tar.gz', 'w:gz', tarfile.GNU_FORMAT)
+
+        for name, compression in [('stored.zip', zipfile.ZIP_STORED),
+                                  ('deflated.zip', zipfile.ZIP_DEFLATED)]:
+            with zipfile.ZipFile(os.path.join(cls.dir, name), 'w',
+                                 compression) as z:
+                z.writestr('dir/', '')
+                for member, content in cls.members.items():
+                    z.writestr(member, content)
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.dir)
+
+    def import_member(self, archive, member, output):
+        mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : {
+                'runOnCreation' : True,
+                'dataFileUrl' : 'archive+file://{}#{}'.format(
+                    os.path.join(self.dir, archive), member),
+                'outputDataset' : output,
+                'select' : 'x, y',
+                'named' : 'x'
+            }
+        })
+        return mldb.query("SELECT * FROM {} ORDER BY x".format(output))
+
+    def check_archive(self, archive):
+        ds = archive.replace('.', '_')
+        for i, member in enumerate(sorted(self.members)):
+            lines = self.members[member].splitlines()[1:]
+            expected = [['_rowName', 'x', 'y']] + sorted(
+                [[x, int(x), int(y)]
+                 for x, y in (line.split(',') for line in lines)],
+                key=lambda row: row[1])
+            self.assertTableResultEquals(
+                self.import_member(archive, member, '{}_{}'.format(ds, i)),
+                expected)
+
+    def test_ustar(self):
+        self.check_archive('ustar.tar')
+
+    def test_gnu(self):
+        self.check_archive('gnu.tar')
+
+    def test_pax(self):
+        self.check_archive('pax.tar')
+
+    def test_compressed_tar(self):
+        self.check_archive('gnu.tar.gz')
+
+    def test_stored_zip(self):
+        self.check_archive('stored.zip')
+
+    def test_deflated_zip(self):
+        self.check_archive('deflated.zip')
+
+    def test_missing_member(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "Couldn't find resource"):
+            self.import_member('deflated.zip', 'not_there.csv', 'missing')
+
+    def test_modified_archive(self):
+        # the cached index is not used once the archive changes
+        path = os.path.join(self.dir, 'modified.zip')
+        with zipfile.ZipFile(path, 'w') as z:
+            z.writestr('m.csv', 'x,y\n1,2\n')
+        self.assertTableResultEquals(
+            self.import_member('modified.zip', 'm.csv', 'modified1'),
+            [['_rowName', 'x', 'y'], ['1', 1, 2]])
+
+        with zipfile.ZipFile(path, 'w') as z:
+            z.writestr('filler.csv', 'x,y\n' * 100)
+            z.writestr('m.csv', 'x,y\n7,8\n9,10\n')
+        self.assertTableResultEquals(
+            self.import_member('modified.zip', 'm.csv', 'modified2'),
+            [['_rowName', 'x', 'y'], ['7', 7, 8], ['9', 9, 10]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,63 @@
+#
+# bucketize_approximate_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the approximate bucketize, which estimates the ranks from a sample of
+# the values, against the exact one.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class BucketizeApproximateTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        scores = list(range(10000))
+        random.shuffle(scores)
+        ds = mldb.create_dataset({"id": "input", "type": "sparse.mutable"})
+        for i, score in enumerate(scores):
+            ds.record_row("r%d" % i, [["score", score, 0],
+                                      ["tied", score % 10, 0]])
+        ds.commit()
+
+    def bucketize(self, output, order_by, approximate):
+        mldb.post("/v1/procedures", {
+            "type": "bucketize",
+            "params": {
+                "inputData": "select * from input order by " + order_by,
+                "outputDataset": {"id": output, "type": "sparse.mutable"},
+                "percentileBuckets": {"q1": [0, 25], "q2": [25, 50],
+                                      "top": [50, 100]},
+                "approximate": approximate,
+                "runOnCreation": True
+            }
+        })
+        return mldb.query("select bucket from %s order by rowName()" % output)
+
+    def test_matches_exact(self):
+        # With fewer rows than the size of the sample and no ties, the
+        # ranks are exact
+        for order_by in ["score", "score DESC"]:
+            name = order_by.replace(" ", "_")
+            self.assertEqual(self.bucketize(name + "_exact", order_by, False),
+                             self.bucketize(name + "_approx", order_by, True))
+
+    def test_ties_in_same_bucket(self):
+        self.bucketize("tied_approx", "tied", True)
+        buckets = dict(mldb.query("select bucket from tied_approx")[1:])
+        buckets_of_value = {}
+        for row_name, tied in mldb.query("select tied from input")[1:]:
+            buckets_of_value.setdefault(tied, set()).add(buckets[row_name])
+        self.assertEqual(len(buckets_of_value), 10)
+        for value, found in buckets_of_value.items():
+            self.assertEqual(len(found), 1)
+
+    def test_single_order_by_expression(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.bucketize("bad", "score, tied", True)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -17,6 +17,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <climits>
+#include <set>
 
 
 using namespace std;
@@ -373,3 +374,67 @@ BOOST_AUTO_TEST_CASE (test_path)
 
     BOOST_CHECK_EQUAL(p1, p2);
 }
+
+BOOST_AUTO_TEST_CASE (test_long_string_sharing)
+{
+    std::string s = "a string which is much too long to be stored inline";
+
+    std::unique_ptr<CellValue> cv1(new CellValue(s));
+    CellValue cv2 = *cv1;
+    CellValue cv3 = cv2;
+
+    // Copies share the same storage
+    BOOST_CHECK_EQUAL((void *)cv1->stringChars(), (void *)cv2.stringChars());
+    BOOST_CHECK_EQUAL((void *)cv2.stringChars(), (void *)cv3.stringChars());
+
+    // And it outlives the original
+    cv1.reset();
+    BOOST_CHECK_EQUAL(cv2.toString(), s);
+    cv2 = CellValue();
+    BOOST_CHECK_EQUAL(cv3.toString(), s);
+    BOOST_CHECK_EQUAL(cv3.hash(), CellValue(s).hash());
+
+    // Blobs and paths are shared in the same way
+    CellValue b1 = CellValue::blob(s);
+    CellValue b2 = b1;
+    BOOST_CHECK_EQUAL((void *)b1.blobData(), (void *)b2.blobData());
+    BOOST_CHECK_EQUAL(b2.blobLength(), s.size());
+
+    Path p = PathElement(s);
+    CellValue p1(p);
+    CellValue p2 = p1;
+    BOOST_CHECK_EQUAL(p2.coerceToPath(), p);
+}
+
+BOOST_AUTO_TEST_CASE (test_fast_hash)
+{
+    std::string s = "a string which is much too long to be stored inline";
+
+    std::vector<CellValue> values = {
+        CellValue(), CellValue(0), CellValue(1), CellValue(-1),
+        CellValue(std::numeric_limits<uint64_t>::max()),
+        CellValue(0.5), CellValue(1.0), CellValue("1"), CellValue("abc"),
+        CellValue(s), CellValue::blob("abc"), CellValue::blob(s),
+        CellValue(Path(PathElement("abc"))),
+        CellValue(Date::fromSecondsSinceEpoch(1))
+    };
+
+    // Equal values have equal hashes
+    for (auto & v: values) {
+        CellValue copy = v;
+        BOOST_CHECK_EQUAL(v.fastHash(), copy.fastHash());
+    }
+    BOOST_CHECK_EQUAL(CellValue(s).fastHash(), CellValue(s).fastHash());
+    BOOST_CHECK_EQUAL(CellValue(0.0).fastHash(), CellValue(-0.0).fastHash());
+
+    // Different values, including of different types, have different ones
+    std::set<uint64_t> hashes;
+    for (auto & v: values)
+        hashes.insert(v.fastHash());
+    BOOST_CHECK_EQUAL(hashes.size(), values.size());
+
+    // The stable hash is separate
+    BOOST_CHECK_NE(CellValue("abc").fastHash(), CellValue("abc").hash());
+    BOOST_CHECK_EQUAL(std::hash<CellValue>()(CellValue(s)),
+                      CellValue(s).fastHash());
+}
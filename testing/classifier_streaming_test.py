@@ -0,0 +1,111 @@
+#
+# classifier_streaming_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that training a classifier in streaming mode gives the same model as
+# training it in memory.
+#
+if False:
+    mldb_wrapper = None
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class ClassifierStreamingTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.put("/v1/procedures/csv_proc", {
+            "type": "import.text",
+            "params": {
+                'dataFileUrl' : 'file://mldb/testing/dataset/iris.data',
+                "outputDataset": {
+                    "id": "iris",
+                },
+                "runOnCreation": True,
+                "headers": ["a", "b", "c", "d", "class"]
+            }
+        })
+
+    def train(self, name, mode, label, streaming):
+        mldb.put("/v1/procedures/" + name, {
+            'type' : 'classifier.train',
+            'params' : {
+                'trainingData' : """
+                    select {a, b, c, d} as features, %s as label
+                    from iris
+                """ % label,
+                "mode": mode,
+                "configuration": {
+                    "glz": {
+                        "type": "glz",
+                        "verbosity": 3,
+                        "normalize": True,
+                        "regularization": "l2"
+                    },
+                },
+                "algorithm": "glz",
+                "streaming": streaming,
+                "modelFileUrl": "file://tmp/" + name + ".cls",
+                "functionName": name,
+                "runOnCreation": True
+            }
+        })
+
+    def check_same(self, mode, label):
+        self.train(mode + '_memory', mode, label, False)
+        self.train(mode + '_streaming', mode, label, True)
+
+        res = mldb.query("""
+            select %s_memory({features: {a, b, c, d}}) as memory,
+                   %s_streaming({features: {a, b, c, d}}) as streaming
+            from iris
+            order by rowName()
+        """ % (mode, mode))
+
+        header = res[0]
+        memory = [i for i, c in enumerate(header) if c.startswith('memory')]
+        streaming = [i for i, c in enumerate(header)
+                     if c.startswith('streaming')]
+        self.assertEqual(len(memory), len(streaming))
+        self.assertGreater(len(memory), 0)
+
+        for row in res[1:]:
+            for m, s in zip(memory, streaming):
+                self.assertAlmostEqual(row[m], row[s], places=3)
+
+    def test_boolean(self):
+        self.check_same('boolean', "class = 'Iris-setosa'")
+
+    def test_categorical(self):
+        self.check_same('categorical', "class")
+
+    def test_regression(self):
+        self.check_same('regression', "a")
+
+    def test_unsupported_algorithm(self):
+        msg = "can't be trained in streaming mode"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.put("/v1/procedures/dt_streaming", {
+                'type' : 'classifier.train',
+                'params' : {
+                    'trainingData' : """
+                        select {a, b, c, d} as features,
+                               class = 'Iris-setosa' as label
+                        from iris
+                    """,
+                    "configuration": {
+                        "dt": {
+                            "type": "decision_tree",
+                            "max_depth": 4
+                        },
+                    },
+                    "algorithm": "dt",
+                    "streaming": True,
+                    "modelFileUrl": "file://tmp/dt_streaming.cls",
+                    "runOnCreation": True
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,63 @@
+#
+# csv_export_parallel_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that the csv export, whose rows are formatted in parallel, writes
+# them in order, and that numParts splits them over several files.
+#
+
+import os
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class CsvExportParallelTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({"id": "ds", "type": "sparse.mutable"})
+        for i in range(5000):
+            ds.record_row("r%05d" % i, [["x", i, 0], ["y", "v,%d" % i, 0]])
+        ds.commit()
+        cls.tmp_dir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+
+    def export(self, name, num_parts=1):
+        mldb.post("/v1/procedures", {
+            "type": "export.csv",
+            "params": {
+                "exportData": "select x, y from ds order by rowName()",
+                "dataFileUrl": "file://" + os.path.join(self.tmp_dir, name),
+                "numParts": num_parts,
+                "runOnCreation": True
+            }
+        })
+
+    def read_lines(self, name):
+        with open(os.path.join(self.tmp_dir, name), 'rt') as f:
+            return f.read().splitlines()
+
+    def test_rows_in_order(self):
+        self.export("single.csv")
+        lines = self.read_lines("single.csv")
+        self.assertEqual(lines[0], "x,y")
+        self.assertEqual(lines[1:],
+                         ['%d,"v,%d"' % (i, i) for i in range(5000)])
+
+    def test_parts(self):
+        self.export("parts.csv", num_parts=3)
+        rows = []
+        for part in range(3):
+            lines = self.read_lines("parts-%05d.csv" % part)
+            self.assertEqual(lines[0], "x,y")
+            # Each part is in the order of the query
+            part_rows = [int(l.split(',')[0]) for l in lines[1:]]
+            self.assertEqual(part_rows, sorted(part_rows))
+            rows.extend(part_rows)
+        self.assertEqual(sorted(rows), list(range(5000)))
+
+    def test_bad_num_parts(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.export("none.csv", num_parts=0)
+
+if __name__ == '__main__':
+    mldb.run_tests()
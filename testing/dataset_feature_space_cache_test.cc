@@ -0,0 +1,97 @@
+/** dataset_feature_space_cache_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the cache of column information shared between feature spaces.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/server/mldb_server.h"
+#include "mldb/plugins/dataset_feature_space.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_column_info_cache )
+{
+    MldbServer server;
+    server.init();
+    server.start();
+
+    auto createDataset = [&] (int numRows)
+        {
+            server.restDelete("/v1/datasets/ds");
+
+            Json::Value config;
+            config["type"] = "tabular";
+            auto resp = server.restPut("/v1/datasets/ds", {}, config);
+            BOOST_REQUIRE_EQUAL(resp.responseCode, 201);
+
+            for (int i = 0;  i < numRows;  ++i) {
+                Json::Value row;
+                row["rowName"] = "row" + std::to_string(i);
+                row["columns"][0][0] = "x";
+                row["columns"][0][1] = i;
+                row["columns"][0][2] = "2016-01-01T00:00:00Z";
+                row["columns"][1][0] = "y";
+                row["columns"][1][1] = "label" + std::to_string(i % 3);
+                row["columns"][1][2] = "2016-01-01T00:00:00Z";
+                resp = server.restPost("/v1/datasets/ds/rows", {}, row);
+                BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+            }
+
+            resp = server.restPost("/v1/datasets/ds/commit");
+            BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+
+            PolyConfig datasetConfig;
+            datasetConfig.id = "ds";
+            return obtainDataset(&server, datasetConfig);
+        };
+
+    std::set<ColumnPath> columns = { ColumnPath("x"), ColumnPath("y") };
+
+    DatasetFeatureSpace::clearColumnInfoCache();
+    Json::Value before = DatasetFeatureSpace::getColumnInfoCacheStats();
+
+    auto dataset = createDataset(10);
+
+    DatasetFeatureSpace fs1(dataset, ML::REAL, columns, true /* bucketize */);
+    DatasetFeatureSpace fs2(dataset, ML::REAL, columns, true /* bucketize */);
+
+    Json::Value stats = DatasetFeatureSpace::getColumnInfoCacheStats();
+    BOOST_CHECK_EQUAL(stats["entries"].asInt(), 2);
+    BOOST_CHECK_EQUAL(stats["misses"].asInt() - before["misses"].asInt(), 2);
+    BOOST_CHECK_EQUAL(stats["hits"].asInt() - before["hits"].asInt(), 2);
+
+    // The second feature space shares the bucketized columns of the first
+    for (auto & c: fs1.columnInfo) {
+        auto & other = fs2.columnInfo.at(c.first);
+        BOOST_CHECK_EQUAL(other.columnName, c.second.columnName);
+        BOOST_CHECK_EQUAL(other.index, c.second.index);
+        BOOST_CHECK_EQUAL(other.distinctValues, c.second.distinctValues);
+        BOOST_CHECK_EQUAL(other.buckets.storage.get(),
+                          c.second.buckets.storage.get());
+        BOOST_CHECK_EQUAL(other.buckets.numEntries, 10);
+    }
+
+    // Unbucketized columns are cached separately
+    DatasetFeatureSpace fs3(dataset, ML::REAL, columns);
+    stats = DatasetFeatureSpace::getColumnInfoCacheStats();
+    BOOST_CHECK_EQUAL(stats["entries"].asInt(), 4);
+    BOOST_CHECK_EQUAL(fs3.columnInfo.at(ColumnPath("y")).distinctValues, 3);
+
+    // Replacing the dataset means the columns are bucketized again
+    dataset = createDataset(20);
+    DatasetFeatureSpace fs4(dataset, ML::REAL, columns, true /* bucketize */);
+    stats = DatasetFeatureSpace::getColumnInfoCacheStats();
+    BOOST_CHECK_EQUAL(stats["misses"].asInt() - before["misses"].asInt(), 6);
+    for (auto & c: fs4.columnInfo)
+        BOOST_CHECK_EQUAL(c.second.buckets.numEntries, 20);
+}
@@ -0,0 +1,85 @@
+#
+# dataset_memory_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the memory breakdown of /v1/datasets/<id>/memory and the summary of
+# /v1/memory.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class DatasetMemoryTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.create_dataset({"id": "mem", "type": "tabular"})
+        for i in range(1000):
+            mldb.post("/v1/datasets/mem/rows", {
+                "rowName": "r%d" % i,
+                "columns": [["x", i, 0], ["label", "l%d" % (i % 3), 0],
+                            ["sparse", 1, 0]] if i % 10 == 0
+                else [["x", i, 0], ["label", "l%d" % (i % 3), 0]]
+            })
+        mldb.post("/v1/datasets/mem/commit")
+
+        mldb.put("/v1/datasets/empty_mem", {
+            "type": "tabular",
+            "params": {"unknownColumns": "add"}
+        })
+        mldb.post("/v1/datasets/empty_mem/commit")
+
+        mldb.put("/v1/datasets/merged_mem", {
+            "type": "merged",
+            "params": {"datasets": [{"id": "mem"}]}
+        })
+
+    def test_dataset(self):
+        mem = mldb.get("/v1/datasets/mem/memory").json()
+        self.assertEqual(mem["rowCount"], 1000)
+        self.assertGreater(mem["totalBytes"], 0)
+
+        columns = {c["columnName"]: c for c in mem["columns"]}
+        self.assertEqual(set(columns), {"x", "label", "sparse"})
+        for c in columns.values():
+            self.assertEqual(sum(c["formats"].values()), c["totalBytes"])
+        self.assertEqual(mem["columnBytes"],
+                         sum(c["totalBytes"] for c in columns.values()))
+        self.assertEqual(
+            mem["columnBytes"],
+            sum(f["totalBytes"] for f in mem["formats"].values()))
+
+        self.assertGreater(mem["rowNames"], 0)
+        self.assertGreater(mem["timestamps"], 0)
+        self.assertGreater(mem["indexes"]["rowIndex"], 0)
+        self.assertEqual(
+            mem["totalBytes"],
+            mem["columnBytes"] + mem["rowNames"] + mem["timestamps"]
+            + mem["chunkOverhead"] + sum(mem["indexes"].values()))
+
+    def test_empty(self):
+        mem = mldb.get("/v1/datasets/empty_mem/memory").json()
+        self.assertEqual(mem["rowCount"], 0)
+        self.assertEqual(mem["columns"], [])
+
+    def test_unsupported(self):
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.get("/v1/datasets/merged_mem/memory")
+        self.assertEqual(re.exception.response.status_code, 400)
+
+    def test_summary(self):
+        summary = mldb.get("/v1/memory").json()
+        datasets = {d["id"]: d for d in summary["datasets"]}
+        self.assertEqual(
+            datasets["mem"]["totalBytes"],
+            mldb.get("/v1/datasets/mem/memory").json()["totalBytes"])
+        self.assertIsNone(datasets["merged_mem"]["totalBytes"])
+        self.assertGreaterEqual(summary["unknownDatasets"], 1)
+        self.assertEqual(summary["datasets"][0]["id"], "mem")
+        self.assertEqual(
+            summary["totalBytes"],
+            sum(d["totalBytes"] or 0 for d in summary["datasets"]))
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,91 @@
+#
+# dense_embedding_functions_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that the horizontal_*, norm and normalize functions and arithmetic
+# give the same results for embeddings stored as doubles, which run over
+# the storage directly, as for the same embeddings stored as atoms.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+# normalize() returns an embedding stored as doubles; the literals are
+# stored as atoms.  The values are exact in binary so they compare equal.
+DENSE = 'normalize([1, -2, 0, 4, 8], inf)'
+ATOMS = '[0.125, -0.25, 0, 0.5, 1]'
+
+DENSE_2 = 'normalize([2, 4, 6, 8, 8], inf)'
+ATOMS_2 = '[0.25, 0.5, 0.75, 1, 1]'
+
+
+class DenseEmbeddingFunctionsTest(MldbUnitTest):  # noqa
+
+    def value(self, expr):
+        res = mldb.query('select ' + expr + ' as x')
+        return res[1][1]
+
+    def values(self, expr):
+        res = mldb.query('select ' + expr + ' as x')
+        return res[0][1:], res[1][1:]
+
+    def check_same(self, template):
+        self.assertEqual(self.value(template.format(DENSE)),
+                         self.value(template.format(ATOMS)))
+
+    def test_horizontal(self):
+        for fn in ['count', 'sum', 'avg', 'min', 'max']:
+            self.check_same('horizontal_' + fn + '({})')
+        self.assertEqual(self.value('horizontal_sum(%s)' % DENSE), 1.375)
+        self.assertEqual(self.value('horizontal_min(%s)' % DENSE), -0.25)
+        self.assertEqual(self.value('horizontal_max(%s)' % DENSE), 1)
+        self.assertEqual(self.value('horizontal_count(%s)' % DENSE), 5)
+
+    def test_norm(self):
+        for p in ['0', '1', '2', '3', 'inf']:
+            self.check_same('norm({}, ' + p + ')')
+        self.assertEqual(self.value('norm(%s, 0)' % DENSE), 4)
+
+    def test_normalize(self):
+        for p in ['1', '2', 'inf']:
+            self.assertEqual(self.values('normalize(%s, %s)' % (DENSE, p)),
+                             self.values('normalize(%s, %s)' % (ATOMS, p)))
+
+    def test_arithmetic(self):
+        for op in ['+', '-', '*', '/']:
+            self.assertEqual(
+                self.values('%s %s %s' % (DENSE, op, DENSE_2)),
+                self.values('%s %s %s' % (ATOMS, op, ATOMS_2)))
+            self.assertEqual(
+                self.values('%s %s 4' % (DENSE, op)),
+                self.values('%s %s 4' % (ATOMS, op)))
+            self.assertEqual(
+                self.values('2 %s %s' % (op, DENSE_2)),
+                self.values('2 %s %s' % (op, ATOMS_2)))
+
+        for fn in ['diff', 'sum', 'product', 'quotient']:
+            self.assertEqual(
+                self.values('vector_%s(%s, %s)' % (fn, DENSE, DENSE_2)),
+                self.values('vector_%s(%s, %s)' % (fn, ATOMS, ATOMS_2)))
+
+        # Dot product of two dense embeddings
+        self.assertEqual(
+            self.value('horizontal_sum(%s * %s)' % (DENSE, DENSE_2)),
+            self.value('horizontal_sum(%s * %s)' % (ATOMS, ATOMS_2)))
+
+        # Modulus isn't done in double precision but still works
+        self.assertEqual(self.values('%s %% 1' % DENSE_2),
+                         self.values('%s %% 1' % ATOMS_2))
+
+    def test_shape(self):
+        names, vals = self.values('normalize([[1, 2], [3, 4]], inf) * 4')
+        self.assertEqual(names, ['x.0.0', 'x.0.1', 'x.1.0', 'x.1.1'])
+        self.assertEqual(vals, [1, 2, 3, 4])
+
+    def test_incompatible_shapes(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query('select %s + normalize([1, 2], 1)' % DENSE)
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,57 @@
+#
+# dense_row_embedding_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Check that training on a select * reads the same embeddings from each kind
+# of dataset as the general path through the select expression.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class DenseRowEmbeddingTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        points = [[random.gauss(5 * (i % 3), 1) for j in range(4)]
+                  for i in range(300)]
+
+        for ds_type in ['sparse.mutable', 'tabular', 'embedding']:
+            ds = mldb.create_dataset({
+                "id": ds_type.replace('.', '_'), "type": ds_type })
+            for i, point in enumerate(points):
+                ds.record_row("r%d" % i,
+                              [["x%d" % j, v, 0] for j, v in enumerate(point)])
+            ds.commit()
+
+    def train(self, dataset, where):
+        name = "%s_%s" % (dataset, 'fast' if where == 'true' else 'slow')
+        mldb.put("/v1/procedures/kmeans_" + name, {
+            "type": "kmeans.train",
+            "params": {
+                "trainingData": "select * from %s where %s" % (dataset, where),
+                "outputDataset": name + "_clusters",
+                "centroidsDataset": name + "_centroids",
+                "numClusters": 3,
+                "runOnCreation": True
+            }
+        })
+        return mldb.query("select * from %s_clusters order by rowName()"
+                          % name)
+
+    def test_same_clusters(self):
+        expected = None
+        for dataset in ['sparse_mutable', 'tabular', 'embedding']:
+            fast = self.train(dataset, 'true')
+            slow = self.train(dataset, 'x0 is not null')
+            self.assertEqual(fast, slow)
+            if expected is None:
+                expected = fast
+            self.assertEqual(fast, expected)
+            self.assertEqual(len(fast), 301)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,74 @@
+#
+# embedding_hnsw_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test nearest neighbor queries on an embedding dataset indexed with an HNSW
+# graph.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class EmbeddingHnswTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        cls.points = [[random.gauss(0, 1) for j in range(8)]
+                      for i in range(2000)]
+
+        for name, params in [('exact', {}),
+                             ('approx', {'index': 'hnsw'})]:
+            ds = mldb.create_dataset({
+                "id": name, "type": "embedding", "params": params })
+
+            # Two commits, so that the second adds to the graph built by the
+            # first
+            for start, end in [(0, 1000), (1000, len(cls.points))]:
+                for i in range(start, end):
+                    ds.record_row("r%d" % i,
+                                  [["x%d" % j, v, 0]
+                                   for j, v in enumerate(cls.points[i])])
+                ds.commit()
+
+            mldb.put("/v1/functions/nn_" + name, {
+                "type": 'embedding.neighbors',
+                "params": { 'dataset': name }
+            })
+
+    def neighbors(self, name, row, num):
+        res = mldb.query("select nn_%s({coords: '%s', numNeighbors: %d})"
+                         "[distances] as *" % (name, row, num))
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def test_recall(self):
+        found = 0
+        for i in range(0, len(self.points), 40):
+            exact = self.neighbors('exact', "r%d" % i, 10)
+            approx = self.neighbors('approx', "r%d" % i, 10)
+            self.assertEqual(len(approx), 10)
+            # Every row is its own nearest neighbor
+            self.assertEqual(approx["r%d" % i], 0)
+            found += len(set(exact) & set(approx))
+            for row, dist in approx.items():
+                if row in exact:
+                    self.assertAlmostEqual(dist, exact[row], places=4)
+
+        self.assertGreater(found, 0.9 * 10 * len(range(0, len(self.points), 40)))
+
+    def test_max_distance(self):
+        res = mldb.query("select nn_approx({coords: 'r1500', numNeighbors: 10, "
+                         "maxDistance: 0.0001})[distances] as *")
+        self.assertEqual(res[0][1:], ["r1500"])
+
+    def test_bad_params(self):
+        msg = "hnswNeighbors must be at least 2"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.create_dataset({
+                "id": "bad", "type": "embedding",
+                "params": { "index": "hnsw", "hnswNeighbors": 1 } })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,142 @@
+#
+# embedding_storage_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the float16 and int8 storage of embedding datasets, reranking of
+# their neighbors with the exact coordinates, and saving and reloading them
+# through their dataFileUrl.
+#
+import os
+import random
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 1000
+NUM_DIMS = 16
+
+
+class EmbeddingStorageTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        cls.points = [[random.gauss(0, 1) for j in range(NUM_DIMS)]
+                      for i in range(NUM_ROWS)]
+        cls.tmp_dir = tempfile.mkdtemp()
+
+        cls.create('exact', {})
+        cls.create('f16', {'storage': 'float16'})
+        cls.create('i8', {'storage': 'int8'})
+        cls.create('i8_rerank', {'storage': 'int8', 'rerankFactor': 4})
+
+    @classmethod
+    def create(cls, name, params, record=True):
+        try:
+            mldb.delete('/v1/datasets/' + name)
+        except mldb_wrapper.ResponseException:
+            pass
+        ds = mldb.create_dataset({
+            "id": name, "type": "embedding", "params": params})
+        if record:
+            for i, point in enumerate(cls.points):
+                ds.record_row("r%d" % i,
+                              [["x%d" % j, v, 0]
+                               for j, v in enumerate(point)])
+            ds.commit()
+
+        mldb.put("/v1/functions/nn_" + name, {
+            "type": 'embedding.neighbors',
+            "params": {'dataset': name}
+        })
+        return ds
+
+    def neighbors(self, name, row, num):
+        res = mldb.query("select nn_%s({coords: '%s', numNeighbors: %d})"
+                         "[distances] as *" % (name, row, num))
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def row(self, name, row):
+        res = mldb.query("select * from %s where rowName() = '%s'"
+                         % (name, row))
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def recall(self, name):
+        found = 0
+        for i in range(0, NUM_ROWS, 50):
+            exact = self.neighbors('exact', "r%d" % i, 10)
+            approx = self.neighbors(name, "r%d" % i, 10)
+            self.assertEqual(len(approx), 10)
+            self.assertEqual(approx["r%d" % i], 0)
+            found += len(set(exact) & set(approx))
+        return found / (10.0 * len(range(0, NUM_ROWS, 50)))
+
+    def test_values(self):
+        exact = self.row('exact', 'r10')
+        f16 = self.row('f16', 'r10')
+        i8 = self.row('i8', 'r10')
+        spread = max(exact.values()) - min(exact.values())
+        self.assertEqual(sorted(exact), sorted(f16))
+        for col, v in exact.items():
+            self.assertAlmostEqual(f16[col], v, delta=abs(v) / 1000 + 1e-6)
+            self.assertAlmostEqual(i8[col], v, delta=spread / 255)
+
+    def test_recall(self):
+        self.assertGreater(self.recall('f16'), 0.98)
+        self.assertGreater(self.recall('i8'), 0.8)
+
+    def test_rerank(self):
+        self.assertGreater(self.recall('i8_rerank'), self.recall('i8'))
+
+        # Reranked distances are the exact ones
+        exact = self.neighbors('exact', 'r7', 10)
+        reranked = self.neighbors('i8_rerank', 'r7', 10)
+        for row, dist in reranked.items():
+            if row in exact:
+                self.assertAlmostEqual(dist, exact[row], places=4)
+
+    def test_persistence(self):
+        for storage in ['float32', 'float16', 'int8']:
+            for index in ['vptree', 'hnsw']:
+                url = 'file://' + os.path.join(
+                    self.tmp_dir, '%s_%s.emb' % (storage, index))
+                params = {'storage': storage, 'index': index,
+                          'dataFileUrl': url}
+                if storage != 'float32':
+                    params['rerankFactor'] = 2
+                self.create('saved', params)
+                before = [self.neighbors('saved', "r%d" % i, 5)
+                          for i in range(0, NUM_ROWS, 100)]
+                row = self.row('saved', 'r3')
+
+                # Created again, the dataset is loaded from the file
+                self.create('saved', params, record=False)
+                after = [self.neighbors('saved', "r%d" % i, 5)
+                         for i in range(0, NUM_ROWS, 100)]
+                self.assertEqual(before, after)
+                self.assertEqual(self.row('saved', 'r3'), row)
+
+                msg = "can't be recorded to"
+                with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                             msg):
+                    mldb.post('/v1/datasets/saved/rows', {
+                        'rowName': 'new', 'columns': [['x0', 1, 0]]})
+
+    def test_mismatched_file(self):
+        url = 'file://' + os.path.join(self.tmp_dir, 'mismatched.emb')
+        self.create('mismatched', {'storage': 'float16', 'dataFileUrl': url})
+
+        msg = "different storage"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            self.create('mismatched', {'dataFileUrl': url}, record=False)
+
+    def test_bad_params(self):
+        msg = "rerankFactor is only used with float16 or int8 storage"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.create_dataset({
+                "id": "bad", "type": "embedding",
+                "params": {"rerankFactor": 2}})
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -535,3 +535,79 @@ BOOST_AUTO_TEST_CASE( test_superposition_with_search_row )
     BOOST_CHECK_EQUAL(jsonEncode(found), Json::parse(expected));
 }
 
+
+BOOST_AUTO_TEST_CASE( test_sort_key )
+{
+    Date ts;
+    double nan = std::numeric_limits<double>::quiet_NaN();
+
+    // Values which sort within and between types.  An integer and a float
+    // with the same value aren't included, as compare() says each is
+    // greater than the other.
+    std::vector<ExpressionValue> values = {
+        ExpressionValue(),
+        ExpressionValue(CellValue(), ts),
+        ExpressionValue(nan, ts),
+        ExpressionValue(-1e300, ts),
+        ExpressionValue(-3, ts),
+        ExpressionValue(-0.5, ts),
+        ExpressionValue(-0.0, ts),
+        ExpressionValue(0.25, ts),
+        ExpressionValue(1, ts),
+        ExpressionValue(1.5, ts),
+        ExpressionValue(1LL << 40, ts),
+        ExpressionValue(std::numeric_limits<double>::infinity(), ts),
+        ExpressionValue("", ts),
+        ExpressionValue("a", ts),
+        ExpressionValue(std::string("a\0b", 3), ts),
+        ExpressionValue("ab", ts),
+        ExpressionValue("b", ts),
+        ExpressionValue(Utf8String("\xc3\xa9t\xc3\xa9"), ts),
+        ExpressionValue(Date::fromSecondsSinceEpoch(-10), ts),
+        ExpressionValue(Date::fromSecondsSinceEpoch(1e9), ts)
+    };
+
+    auto sign = [] (int x) { return (x > 0) - (x < 0); };
+
+    for (bool descending: { false, true }) {
+        std::vector<std::string> keys;
+        for (auto & v: values) {
+            std::string key;
+            BOOST_REQUIRE(v.appendSortKey(key, descending));
+            keys.push_back(key);
+        }
+
+        for (size_t i = 0;  i < values.size();  ++i) {
+            for (size_t j = 0;  j < values.size();  ++j) {
+                // Timestamps can't be compared with other atoms
+                if (values[i].isAtom() && values[j].isAtom()
+                    && !values[i].getAtom().empty()
+                    && !values[j].getAtom().empty()
+                    && values[i].getAtom().isTimestamp()
+                       != values[j].getAtom().isTimestamp())
+                    continue;
+
+                int expected = sign(values[i].compare(values[j]));
+                if (descending)
+                    expected = -expected;
+                BOOST_CHECK_EQUAL(sign(keys[i].compare(keys[j])), expected);
+            }
+        }
+    }
+
+    // Keys of several values are compared value by value
+    std::string k1, k2;
+    ExpressionValue("a", ts).appendSortKey(k1);
+    ExpressionValue(2, ts).appendSortKey(k1);
+    ExpressionValue("ab", ts).appendSortKey(k2);
+    ExpressionValue(1, ts).appendSortKey(k2);
+    BOOST_CHECK_LT(k1, k2);
+
+    // Structured values have no key
+    std::string key;
+    RowValue row;
+    row.emplace_back(PathElement("a"), 1, ts);
+    BOOST_CHECK(!ExpressionValue(row).appendSortKey(key));
+    BOOST_CHECK(!ExpressionValue(CellValue::blob("x"), ts).appendSortKey(key));
+    BOOST_CHECK_EQUAL(key, "");
+}
@@ -0,0 +1,163 @@
+#
+# external_procedure_shared_table_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the exchange of the input and output of an external procedure
+# through tables in shared memory.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+# Reads the input table and writes the output table with the standard
+# library only, as described in the documentation of the procedure
+SCRIPT = """
+import json
+import mmap
+import os
+import struct
+
+
+def read_table(path):
+    with open(path, 'rb') as f:
+        mem = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    magic, header_offset, header_length = struct.unpack_from('<8sQQ', mem, 0)
+    assert magic == b'MLDBTBL1'
+    header = json.loads(
+        mem[header_offset:header_offset + header_length].decode('utf-8'))
+    n = header['numRows']
+
+    def strings(col):
+        offsets = struct.unpack_from('<%dq' % (n + 1), mem, col['offsets'][0])
+        data = col['data'][0]
+        return [mem[data + offsets[i]:data + offsets[i + 1]].decode('utf-8')
+                for i in range(n)]
+
+    def values(col):
+        if col['type'] == 'int64':
+            vals = struct.unpack_from('<%dq' % n, mem, col['data'][0])
+        elif col['type'] == 'float64':
+            vals = struct.unpack_from('<%dd' % n, mem, col['data'][0])
+        else:
+            vals = strings(col)
+        start, length = col['validity']
+        valid = bytearray(mem[start:start + length])
+        return [v if valid[i // 8] >> (i % 8) & 1 else None
+                for i, v in enumerate(vals)]
+
+    rows = strings(header['rowNames'])
+    columns = dict((c['name'], (c['type'], values(c)))
+                   for c in header['columns'])
+    return rows, columns
+
+
+def write_table(path, rows, columns):
+    n = len(rows)
+    buffers = []
+    end = [64]
+
+    def add(data):
+        offset = end[0]
+        buffers.append((offset, data))
+        end[0] = (offset + len(data) + 63) // 64 * 64
+        return [offset, len(data)]
+
+    def add_strings(strs):
+        encoded = [s.encode('utf-8') for s in strs]
+        offsets = [0]
+        for s in encoded:
+            offsets.append(offsets[-1] + len(s))
+        return (add(struct.pack('<%dq' % (n + 1), *offsets)),
+                add(b''.join(encoded)))
+
+    header = {'numRows': n, 'columns': []}
+    offsets, data = add_strings(rows)
+    header['rowNames'] = {'type': 'large_utf8', 'offsets': offsets,
+                          'data': data}
+    for name, type_, vals in columns:
+        valid = bytearray((n + 7) // 8)
+        for i, v in enumerate(vals):
+            if v is not None:
+                valid[i // 8] |= 1 << (i % 8)
+        col = {'name': name, 'type': type_, 'validity': add(bytes(valid))}
+        if type_ == 'large_utf8':
+            col['offsets'], col['data'] = \\
+                add_strings([v or u'' for v in vals])
+        else:
+            fmt = '<%d%s' % (n, 'q' if type_ == 'int64' else 'd')
+            col['data'] = add(struct.pack(fmt, *[v or 0 for v in vals]))
+        header['columns'].append(col)
+
+    encoded = json.dumps(header).encode('utf-8')
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<8sQQ', b'MLDBTBL1', end[0], len(encoded)))
+        for offset, data in buffers:
+            f.seek(offset)
+            f.write(data)
+        f.seek(end[0])
+        f.write(encoded)
+
+
+rows, columns = read_table(os.environ['MLDB_INPUT_TABLE'])
+x = columns['x'][1]
+y = columns['y'][1]
+z = columns['z'][1]
+write_table(os.environ['MLDB_OUTPUT_TABLE'], rows,
+            [('x2', 'int64', [v * 2 for v in x]),
+             ('label', 'large_utf8', [v.upper() for v in y]),
+             ('z', 'float64', z)])
+
+print(json.dumps({'numRows': len(rows),
+                  'types': dict((k, v[0]) for k, v in columns.items())}))
+"""
+
+
+class ExternalProcedureSharedTableTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in range(50):
+            row = [['x', i, 0], ['y', 'v%d' % i, 0]]
+            if i % 3:
+                row.append(['z', i / 4.0, 0])
+            ds.record_row('row%02d' % i, row)
+        ds.commit()
+
+    def test_round_trip(self):
+        res = mldb.put('/v1/procedures/shared_table_proc', {
+            'type': 'experimental.external.procedure',
+            'params': {
+                'inputData': 'select x, y, z from ds',
+                'outputDataset': {'id': 'shared_table_out',
+                                  'type': 'sparse.mutable'},
+                'scriptConfig': {'source': SCRIPT}
+            }
+        })
+        res = mldb.post('/v1/procedures/shared_table_proc/runs').json()
+        ret = res['status']['return']
+        self.assertEqual(ret['numRows'], 50)
+        self.assertEqual(ret['types'], {'x': 'int64', 'y': 'large_utf8',
+                                        'z': 'float64'})
+
+        self.assertTableResultEquals(
+            mldb.query('select x * 2 as x2, upper(y) as label, z from ds '
+                       'order by rowName()'),
+            mldb.query('select x2, label, z from shared_table_out '
+                       'order by rowName()'))
+
+    def test_missing_output(self):
+        mldb.put('/v1/procedures/shared_table_no_output', {
+            'type': 'experimental.external.procedure',
+            'params': {
+                'outputDataset': {'id': 'shared_table_none',
+                                  'type': 'sparse.mutable'},
+                'scriptConfig': {'source': 'print(1)'}
+            }
+        })
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.post('/v1/procedures/shared_table_no_output/runs')
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
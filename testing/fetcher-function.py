@@ -4,6 +4,9 @@
 # This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
 #
 
+import os
+import tempfile
+
 mldb = mldb_wrapper.wrap(mldb)  # noqa
 
 class FetcherFunction(MldbUnitTest):  # noqa
@@ -50,6 +53,52 @@ class FetcherFunction(MldbUnitTest):  # noqa
         self.assertTrue('content' in [cols[0][0], cols[1][0]])
         self.assertTrue('error' in [cols[0][0], cols[1][0]])
 
+    def test_batch_and_cache(self):
+        tmp_dir = tempfile.mkdtemp()
+        urls = []
+        for i in range(10):
+            path = os.path.join(tmp_dir, 'file%d.txt' % i)
+            with open(path, 'w') as f:
+                f.write('content %d' % i)
+            urls.append('file://' + path)
+
+        mldb.put('/v1/functions/fetch_cached', {
+            'type': 'fetcher',
+            'params': {'maxCacheEntries': 5, 'maxConcurrentFetches': 2}
+        })
+
+        inputs = [{'url': url} for url in urls]
+        inputs.append({'url': 'file://' + tmp_dir + '/does_not_exist'})
+        res = mldb.get('/v1/functions/fetch_cached/batch',
+                       input=inputs).json()
+        self.assertEqual(len(res), 11)
+        for i, output in enumerate(res[:10]):
+            self.assertEqual(output['error'], None)
+            self.assertEqual(output['content'],
+                             {'blob': ['content %d' % i]})
+        self.assertEqual(res[10]['content'], None)
+        self.assertNotEqual(res[10]['error'], None)
+
+        # The most recently fetched files are served from the cache, even
+        # once they are gone
+        for i in range(10):
+            os.remove(os.path.join(tmp_dir, 'file%d.txt' % i))
+        res = mldb.get('/v1/functions/fetch_cached/batch',
+                       input=inputs[5:10]).json()
+        for i, output in enumerate(res):
+            self.assertEqual(output['content'],
+                             {'blob': ['content %d' % (i + 5)]})
+        res = mldb.get('/v1/functions/fetch_cached/application',
+                       input=inputs[0]).json()
+        self.assertEqual(res['output']['content'], None)
+
+    def test_bad_params(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.put('/v1/functions/fetch_bad', {
+                'type': 'fetcher',
+                'params': {'maxConcurrentFetches': 0}
+            })
+
 
 if __name__ == '__main__':
     mldb.run_tests()
@@ -0,0 +1,135 @@
+/* frozen_memory_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the allocation of frozen column storage from huge page regions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/frozen_memory.h"
+#include "mldb/plugins/frozen_column.h"
+#include "mldb/plugins/tabular_dataset_column.h"
+#include "mldb/sql/cell_value.h"
+#include <cstring>
+
+using namespace std;
+
+using namespace MLDB;
+
+namespace {
+
+struct PolicyGuard {
+    PolicyGuard(const FrozenMemoryPolicy & policy)
+        : old(getFrozenMemoryPolicy())
+    {
+        setFrozenMemoryPolicy(policy);
+    }
+
+    ~PolicyGuard()
+    {
+        setFrozenMemoryPolicy(old);
+    }
+
+    FrozenMemoryPolicy old;
+};
+
+uint64_t sum(const std::vector<uint64_t> & values)
+{
+    uint64_t result = 0;
+    for (auto v: values)
+        result += v;
+    return result;
+}
+
+void testAllocation(FrozenMemoryPlacement placement)
+{
+    FrozenMemoryPolicy policy;
+    policy.hugePages = true;
+    policy.placement = placement;
+    PolicyGuard guard(policy);
+
+    uint64_t allocatedBefore = getFrozenMemoryStats().bytesAllocated;
+
+    std::vector<std::shared_ptr<void> > blocks;
+    for (size_t i = 0;  i < 100;  ++i) {
+        size_t length = i * 1000 + 1;
+        blocks.push_back(allocateFrozenBlock(length));
+        BOOST_REQUIRE_EQUAL((size_t)blocks.back().get() % 8, 0);
+        memset(blocks.back().get(), i, length);
+    }
+
+    // Large blocks get a region of their own
+    blocks.push_back(allocateFrozenBlock(5000000));
+    memset(blocks.back().get(), 255, 5000000);
+
+    for (size_t i = 0;  i < 100;  ++i) {
+        const unsigned char * p = (const unsigned char *)blocks[i].get();
+        BOOST_REQUIRE_EQUAL(p[0], i);
+        BOOST_REQUIRE_EQUAL(p[i * 1000], i);
+    }
+
+    FrozenMemoryStats stats = getFrozenMemoryStats();
+    BOOST_CHECK_GE(stats.bytesAllocated - allocatedBefore, 5000000 + 4950100);
+    BOOST_CHECK_GE(stats.bytesMapped, stats.bytesAllocated);
+    BOOST_CHECK_EQUAL(stats.bytesMapped % (2 * 1024 * 1024), 0);
+    BOOST_CHECK_LE(stats.hugePageBytes, stats.bytesMapped);
+    BOOST_CHECK_GE(stats.bytesPerNode.size(), 1);
+    BOOST_CHECK_LE(sum(stats.bytesPerNode), stats.bytesMapped);
+
+    // Regions are unmapped once their blocks are freed, apart from the
+    // one that's currently being allocated from
+    uint64_t mappedBefore = stats.bytesMapped;
+    blocks.clear();
+    stats = getFrozenMemoryStats();
+    BOOST_CHECK_EQUAL(stats.bytesAllocated, allocatedBefore);
+    BOOST_CHECK_LT(stats.bytesMapped, mappedBefore);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_default_policy )
+{
+    PolicyGuard guard(FrozenMemoryPolicy{});
+    auto block = allocateFrozenBlock(1000);
+    BOOST_CHECK_EQUAL((size_t)block.get() % 8, 0);
+    BOOST_CHECK_EQUAL(getFrozenMemoryStats().bytesAllocated, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_huge_pages )
+{
+    testAllocation(FROZEN_PLACEMENT_DEFAULT);
+}
+
+BOOST_AUTO_TEST_CASE( test_local_placement )
+{
+    testAllocation(FROZEN_PLACEMENT_LOCAL);
+}
+
+BOOST_AUTO_TEST_CASE( test_interleaved_placement )
+{
+    testAllocation(FROZEN_PLACEMENT_INTERLEAVE);
+}
+
+BOOST_AUTO_TEST_CASE( test_frozen_column_storage )
+{
+    FrozenMemoryPolicy policy;
+    policy.hugePages = true;
+    policy.placement = FROZEN_PLACEMENT_LOCAL;
+    PolicyGuard guard(policy);
+
+    uint64_t allocatedBefore = getFrozenMemoryStats().bytesAllocated;
+
+    TabularDatasetColumn col;
+    for (size_t i = 0;  i < 10000;  ++i)
+        col.add(i, CellValue((int64_t)(i * i)));
+    auto frozen = col.freeze(ColumnFreezeParameters());
+
+    BOOST_CHECK_GT(getFrozenMemoryStats().bytesAllocated, allocatedBefore);
+    for (size_t i = 0;  i < 10000;  ++i)
+        BOOST_REQUIRE_EQUAL(frozen->get(i), CellValue((int64_t)(i * i)));
+
+    frozen.reset();
+    BOOST_CHECK_EQUAL(getFrozenMemoryStats().bytesAllocated, allocatedBefore);
+}
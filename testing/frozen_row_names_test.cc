@@ -0,0 +1,111 @@
+/* frozen_row_names_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the front coded row names of tabular dataset chunks.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/tabular_dataset_chunk.h"
+#include "mldb/jml/db/persistent.h"
+#include <sstream>
+
+using namespace std;
+
+using namespace MLDB;
+
+namespace {
+
+void checkNames(const std::vector<Path> & names)
+{
+    FrozenRowNames frozen(names);
+    BOOST_REQUIRE_EQUAL(frozen.size(), names.size());
+
+    Path storage;
+    for (size_t i = 0;  i < names.size();  ++i) {
+        BOOST_REQUIRE_EQUAL(frozen.get(i, storage), names[i]);
+        BOOST_REQUIRE_EQUAL(frozen.get(i), names[i]);
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_empty )
+{
+    FrozenRowNames frozen((std::vector<Path>()));
+    BOOST_CHECK(frozen.empty());
+    BOOST_CHECK_EQUAL(frozen.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_url_names )
+{
+    std::vector<Path> names;
+    for (size_t i = 0;  i < 1000;  ++i) {
+        // Not inserted in sorted order
+        size_t n = (i * 7919) % 1000;
+        names.emplace_back(PathElement("http://www.example.com/products/item"
+                                       + std::to_string(n) + "?ref=home"));
+    }
+    checkNames(names);
+
+    // Shared prefixes are only stored once
+    size_t pathMemory = 0;
+    for (auto & n: names)
+        pathMemory += n.memusage();
+    BOOST_CHECK_LT(FrozenRowNames(names).memusage(), pathMemory / 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_structured_names )
+{
+    std::vector<Path> names;
+    names.emplace_back();
+    names.emplace_back(PathElement(""));
+    names.push_back(Path::parse("a.b.c"));
+    names.push_back(Path::parse("a.b"));
+    names.push_back(Path::parse("a.b.c"));  // duplicates are kept
+    names.push_back(Path::parse("\"a.b\".c"));
+    names.push_back(Path::parse("x.\"\".y"));
+    names.push_back(Path::parse("1.2.3.4.5.6.7.8.9.10.11.12.13.14.15.16.17.18"));
+    names.emplace_back(PathElement(std::string(1000, 'z')));
+    names.emplace_back(PathElement("\xc3\xa9t\xc3\xa9"));
+    for (size_t i = 0;  i < 100;  ++i)
+        names.emplace_back(PathElement("8f14e45f-ceea-467f-a0d6-"
+                                       + std::to_string(100000 + i * 31)));
+    checkNames(names);
+}
+
+BOOST_AUTO_TEST_CASE( test_chunk_row_names )
+{
+    MutableTabularDatasetChunk mutableChunk(1 /* numColumns */, 100);
+    std::vector<std::pair<ColumnPath, CellValue> > extra;
+    std::vector<Path> names;
+    for (size_t i = 0;  i < 100;  ++i) {
+        names.push_back(Path::parse("user" + std::to_string(99 - i)
+                                    + ".session"));
+        RowPath rowName = names.back();
+        CellValue val(i);
+        BOOST_REQUIRE_EQUAL(mutableChunk.add(rowName, Date(), &val, 1, extra),
+                            MutableTabularDatasetChunk::ADD_SUCCEEDED);
+    }
+    TabularDatasetChunk chunk = mutableChunk.freeze(ColumnFreezeParameters());
+
+    // And through serialization
+    std::ostringstream stream;
+    {
+        ML::DB::Store_Writer store(stream);
+        chunk.serialize(store);
+    }
+    std::string serialized = stream.str();
+    ML::DB::Store_Reader store(serialized.data(), serialized.size());
+    TabularDatasetChunk reconstituted
+        = TabularDatasetChunk::reconstitute(store, nullptr);
+
+    RowPath storage;
+    for (size_t i = 0;  i < names.size();  ++i) {
+        BOOST_REQUIRE_EQUAL(chunk.getRowPath(i), names[i]);
+        BOOST_REQUIRE_EQUAL(chunk.getRowPath(i, storage), names[i]);
+        BOOST_REQUIRE_EQUAL(reconstituted.getRowPath(i, storage), names[i]);
+    }
+}
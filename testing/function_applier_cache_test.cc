@@ -0,0 +1,68 @@
+/** function_applier_cache_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the cache of bound function appliers.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/function_collection.h"
+#include "mldb/rest/in_process_rest_connection.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_function_applier_cache )
+{
+    MldbServer server;
+    server.init();
+    server.start();
+
+    auto putFunction = [&] (const std::string & expression)
+        {
+            Json::Value config;
+            config["type"] = "sql.expression";
+            config["params"]["expression"] = expression;
+            auto resp = server.restPut("/v1/functions/f", {}, config);
+            BOOST_REQUIRE_EQUAL(resp.responseCode, 201);
+            return server.functions->getExistingEntity("f");
+        };
+
+    auto function = putFunction("x + 1 AS y");
+
+    auto applier1 = server.functions->getApplier(function.get());
+    auto applier2 = server.functions->getApplier(function.get());
+    BOOST_CHECK_EQUAL(applier1.get(), applier2.get());
+
+    StructValue input;
+    input.emplace_back(PathElement("x"), ExpressionValue(1, Date::notADate()));
+    ExpressionValue output = applier1->apply(std::move(input));
+    BOOST_CHECK_EQUAL(output.getColumn("y").getAtom(), 2);
+
+    // Putting a new configuration replaces the function, and so its applier
+    auto function2 = putFunction("x + 2 AS y");
+    BOOST_CHECK_NE(function.get(), function2.get());
+    auto applier3 = server.functions->getApplier(function2.get());
+    BOOST_CHECK_NE(applier1.get(), applier3.get());
+
+    // The old applier keeps working, as it holds on to its function
+    StructValue input2;
+    input2.emplace_back(PathElement("x"), ExpressionValue(1, Date::notADate()));
+    ExpressionValue output2 = applier1->apply(std::move(input2));
+    BOOST_CHECK_EQUAL(output2.getColumn("y").getAtom(), 2);
+
+    // The REST application route goes through the cache
+    auto resp = server.restGet("/v1/functions/f/application",
+                               { { "input", "{\"x\":3}" },
+                                 { "outputFormat", "json" } });
+    BOOST_CHECK_EQUAL(resp.responseCode, 200);
+    BOOST_CHECK_EQUAL(Json::parse(resp.response)["y"].asInt(), 5);
+}
@@ -0,0 +1,178 @@
+/** function_rpc_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the binary function application RPC endpoint.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/asio.hpp>
+
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/function_rpc_endpoint.h"
+#include "mldb/sql/cell_value_msgpack.h"
+#include "mldb/jml/utils/string_functions.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+struct RpcClient {
+    RpcClient(const std::string & address)
+        : sock(ioService)
+    {
+        auto parts = ML::split(address, ':');
+        BOOST_REQUIRE_EQUAL(parts.size(), 2);
+        boost::asio::ip::tcp::endpoint endpoint
+            (boost::asio::ip::address::from_string("127.0.0.1"),
+             std::stoi(parts[1]));
+        sock.connect(endpoint);
+
+        const std::string & name = FunctionRpcEndpoint::PEER_NAME;
+        std::string handshake = "APSv1000"
+            + MLDB::format("%8zd", name.size()) + name;
+        boost::asio::write(sock, boost::asio::buffer(handshake));
+    }
+
+    std::string call(const std::string & request)
+    {
+        uint64_t length = request.size();
+        boost::asio::write(sock, boost::asio::buffer(&length, 8));
+        boost::asio::write(sock, boost::asio::buffer(request));
+
+        boost::asio::read(sock, boost::asio::buffer(&length, 8));
+        std::string reply(length, '\0');
+        boost::asio::read(sock, boost::asio::buffer(&reply[0], length));
+        return reply;
+    }
+
+    boost::asio::io_service ioService;
+    boost::asio::ip::tcp::socket sock;
+};
+
+BOOST_AUTO_TEST_CASE( test_function_rpc )
+{
+    MldbServer server;
+    server.init();
+    server.start();
+
+    Json::Value config;
+    config["type"] = "sql.expression";
+    config["params"]["expression"] = "x + 1 AS y, v AS v";
+    auto resp = server.restPut("/v1/functions/f", {}, config);
+    BOOST_REQUIRE_EQUAL(resp.responseCode, 201);
+
+    FunctionRpcEndpoint rpc(&server);
+    string address = rpc.bindTcp(PortRange(18000, 19000), "127.0.0.1");
+
+    RpcClient client(address);
+
+    // Bind the function
+    uint64_t handle;
+    {
+        std::string request;
+        MsgPackWriter writer(request);
+        writer.writeArrayHeader(2);
+        writer.writeInt(1);
+        writer.writeString(Utf8String("f"));
+
+        std::string reply = client.call(request);
+        MsgPackReader reader(reply);
+        BOOST_REQUIRE_EQUAL(reader.readArrayHeader(), 2);
+        BOOST_REQUIRE_EQUAL(reader.readInt(), 0);
+        handle = reader.readUInt();
+    }
+
+    // Apply it to a batch of two inputs
+    {
+        std::string request;
+        MsgPackWriter writer(request);
+        writer.writeArrayHeader(3);
+        writer.writeInt(2);
+        writer.writeUInt(handle);
+        writer.writeArrayHeader(2);
+        for (int i = 0;  i < 2;  ++i) {
+            writer.writeMapHeader(2);
+            writer.writeString(Utf8String("x"));
+            writer.writeInt(i * 10);
+            writer.writeString(Utf8String("v"));
+            writer.writeArrayHeader(2);
+            writer.writeDouble(0.5);
+            writer.writeInt(i);
+        }
+
+        std::string reply = client.call(request);
+        MsgPackReader reader(reply);
+        BOOST_REQUIRE_EQUAL(reader.readArrayHeader(), 2);
+        BOOST_REQUIRE_EQUAL(reader.readInt(), 0);
+        BOOST_REQUIRE_EQUAL(reader.readArrayHeader(), 2);
+        for (int i = 0;  i < 2;  ++i) {
+            BOOST_REQUIRE_EQUAL(reader.readMapHeader(), 2);
+            BOOST_CHECK_EQUAL(reader.readString(), "y");
+            BOOST_CHECK_EQUAL(reader.readCellValue(), i * 10 + 1);
+            BOOST_CHECK_EQUAL(reader.readString(), "v");
+            BOOST_REQUIRE_EQUAL(reader.readArrayHeader(), 2);
+            BOOST_CHECK_EQUAL(reader.readCellValue(), 0.5);
+            BOOST_CHECK_EQUAL(reader.readCellValue(), i);
+        }
+        BOOST_CHECK(reader.eof());
+    }
+
+    auto checkError = [&] (const std::string & request, int expectedCode)
+        {
+            std::string reply = client.call(request);
+            MsgPackReader reader(reply);
+            BOOST_REQUIRE_EQUAL(reader.readArrayHeader(), 2);
+            BOOST_CHECK_EQUAL(reader.readInt(), expectedCode);
+            cerr << "error: " << reader.readString() << endl;
+        };
+
+    // Unknown function
+    {
+        std::string request;
+        MsgPackWriter writer(request);
+        writer.writeArrayHeader(2);
+        writer.writeInt(1);
+        writer.writeString(Utf8String("not_a_function"));
+        checkError(request, 404);
+    }
+
+    // Inputs which aren't maps
+    {
+        std::string request;
+        MsgPackWriter writer(request);
+        writer.writeArrayHeader(3);
+        writer.writeInt(2);
+        writer.writeUInt(handle);
+        writer.writeArrayHeader(1);
+        writer.writeInt(3);
+        checkError(request, 400);
+    }
+
+    // Garbage
+    checkError("\xc1", 400);
+
+    // Release the handle; it can't be used afterwards
+    {
+        std::string request;
+        MsgPackWriter writer(request);
+        writer.writeArrayHeader(2);
+        writer.writeInt(3);
+        writer.writeUInt(handle);
+
+        std::string reply = client.call(request);
+        MsgPackReader reader(reply);
+        BOOST_REQUIRE_EQUAL(reader.readArrayHeader(), 2);
+        BOOST_CHECK_EQUAL(reader.readInt(), 0);
+        reader.readNil();
+
+        checkError(request, 404);
+    }
+
+    rpc.shutdown();
+}
@@ -0,0 +1,75 @@
+#
+# gaussian_clustering_diagonal_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test gaussian clustering with diagonal covariances, including in enough
+# dimensions for the densities to underflow if they weren't kept as logs.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class GaussianClusteringDiagonalTest(MldbUnitTest):  # noqa
+
+    num_clusters = 3
+    points_per_cluster = 200
+    num_dims = 100
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({"id": "points", "type": "sparse.mutable"})
+        random.seed(1)
+        for c in range(cls.num_clusters):
+            for i in range(cls.points_per_cluster):
+                ds.record_row("c%d_%d" % (c, i),
+                              [["x%03d" % j, random.gauss(5 * c, 1 + j % 2), 0]
+                               for j in range(cls.num_dims)])
+        ds.commit()
+
+    def train(self, name, params):
+        config = {
+            "trainingData": "select * from points",
+            "outputDataset": "clusters_" + name,
+            "centroidsDataset": {"id": "centroids_" + name,
+                                 "type": "sparse.mutable"},
+            "numClusters": self.num_clusters,
+            "maxIterations": 10,
+            "runOnCreation": True
+        }
+        config.update(params)
+        mldb.put('/v1/procedures/em_' + name, {
+            'type': 'gaussianclustering.train',
+            'params': config
+        })
+
+    def check_clusters(self, name):
+        res = mldb.query("select cluster from clusters_%s" % name)
+        found = {}
+        for row in res[1:]:
+            found.setdefault(row[0][:row[0].index('_')], set()).add(row[1])
+
+        # Every point of a generated cluster is in the same cluster, and
+        # the generated clusters are all apart
+        self.assertEqual(len(found), self.num_clusters)
+        for clusters in found.values():
+            self.assertEqual(len(clusters), 1)
+        self.assertEqual(len(set.union(*found.values())), self.num_clusters)
+
+    def test_diagonal(self):
+        self.train("diagonal", {"covariance": "diagonal"})
+        self.check_clusters("diagonal")
+
+    def test_full(self):
+        self.train("full", {"covariance": "full"})
+        self.check_clusters("full")
+
+    def test_bad_covariance(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "covariance"):
+            self.train("bad", {"covariance": "spherical"})
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,96 @@
+#
+# geo_index_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that queries on geo_distance() over a geo.index dataset and the
+# geo.neighbors function return the same rows as scanning the dataset.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+POINTS = [(45.5017, -73.5673), (0.0, 179.9), (-33.8688, 151.2093),
+          (89.9, 10.0)]
+
+
+class GeoIndexTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.create_dataset({"id": "points", "type": "tabular"})
+        rng = random.Random(7)
+        for i in range(2000):
+            lat, lon = POINTS[i % len(POINTS)]
+            lat = max(-90, min(90, lat + rng.uniform(-1, 1)))
+            lon = lon + rng.uniform(-1, 1)
+            mldb.post("/v1/datasets/points/rows", {
+                "rowName": "p%d" % i,
+                "columns": [["lat", lat, 0], ["lon", lon, 0],
+                            ["even", i % 2 == 0, 0]]
+            })
+        mldb.post("/v1/datasets/points/rows", {
+            "rowName": "nowhere", "columns": [["even", True, 0]]
+        })
+        mldb.post("/v1/datasets/points/commit")
+
+        mldb.put("/v1/datasets/points_index", {
+            "type": "geo.index",
+            "params": {"dataset": "points"}
+        })
+
+        mldb.put("/v1/functions/nearest", {
+            "type": "geo.neighbors",
+            "params": {"dataset": "points_index", "defaultNumNeighbors": 5}
+        })
+
+    def check(self, where):
+        query = "SELECT lat, lon FROM %s WHERE " + where \
+            + " ORDER BY rowName()"
+        self.assertTableResultEquals(mldb.query(query % "points_index"),
+                                     mldb.query(query % "points"))
+
+    def test_within_distance(self):
+        for lat, lon in POINTS:
+            for distance in [0, 1000, 50000, 200000, 30000000]:
+                self.check("geo_distance(lat, lon, %f, %f) < %d"
+                           % (lat, lon, distance))
+                self.check("%d >= geo_distance(%f, %f, lat, lon)"
+                           % (distance, lat, lon))
+
+    def test_and(self):
+        self.check("geo_distance(lat, lon, 45.5, -73.5) < 80000 AND even")
+        self.check("rowName() != 'p0' AND "
+                   "geo_distance(lat, lon, 45.5, -73.5) <= 80000")
+
+    def test_neighbors(self):
+        for lat, lon in POINTS + [(10.0, 10.0)]:
+            res = mldb.query(
+                "SELECT nearest({lat: %f, lon: %f})[distances] AS *"
+                % (lat, lon))
+            expected = mldb.query(
+                "SELECT rowName() AS name, "
+                "geo_distance(lat, lon, %f, %f) AS d FROM points "
+                "WHERE lat IS NOT NULL "
+                "ORDER BY geo_distance(lat, lon, %f, %f), rowHash() LIMIT 5"
+                % (lat, lon, lat, lon))
+            names = [r[1] for r in expected[1:]]
+            self.assertEqual(res[0][1:], names)
+            for name, d in zip(names, res[1][1:]):
+                self.assertAlmostEqual(
+                    d, [r[2] for r in expected[1:] if r[1] == name][0])
+
+    def test_max_distance(self):
+        res = mldb.query("SELECT nearest({lat: 10, lon: 10, "
+                         "maxDistance: 1000000})[neighbors] AS *")
+        self.assertEqual(len(res[0]), 1)
+
+    def test_status(self):
+        mldb.query("SELECT * FROM points_index "
+                   "WHERE geo_distance(lat, lon, 0, 0) < 1")
+        status = mldb.get("/v1/datasets/points_index").json()["status"]
+        self.assertEqual(status["rowCount"], 2000)
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,65 @@
+#
+# group_by_partitioned_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test GROUP BY over enough distinct keys that the groups are spread over
+# all of the hash partitions and merged across buckets.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class GroupByPartitionedTest(MldbUnitTest):  # noqa
+
+    num_rows = 50000
+    num_keys = 5000
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({"id": "sales", "type": "sparse.mutable"})
+        random.seed(1)
+        cls.expected = {}
+        for i in range(cls.num_rows):
+            key = random.randint(0, cls.num_keys - 1)
+            amount = random.randint(1, 1000)
+            ds.record_row("r%d" % i, [["k", key, 0], ["amount", amount, 0]])
+            cls.expected.setdefault(key, []).append(amount)
+        ds.commit()
+
+        ds = mldb.create_dataset({"id": "mixed", "type": "sparse.mutable"})
+        ds.record_row("a", [["k", 1, 0]])
+        ds.record_row("b", [["k", 1.0, 0]])
+        ds.record_row("c", [["k", 2.5, 0]])
+        ds.record_row("d", [["k", "1", 0]])
+        ds.commit()
+
+    def test_aggregates(self):
+        res = mldb.query("""
+            select k, sum(amount) as sum, count(*) as count,
+                   min(amount) as min, max(amount) as max
+            from sales group by k
+        """)
+        col = {name: i for i, name in enumerate(res[0])}
+        self.assertEqual(len(res) - 1, len(self.expected))
+
+        # Groups come out in the order of their keys
+        keys = [row[col["k"]] for row in res[1:]]
+        self.assertEqual(keys, sorted(self.expected.keys()))
+
+        for row in res[1:]:
+            amounts = self.expected[row[col["k"]]]
+            self.assertEqual(row[col["count"]], len(amounts))
+            self.assertEqual(row[col["max"]], max(amounts))
+            self.assertEqual(row[col["min"]], min(amounts))
+            self.assertEqual(row[col["sum"]], sum(amounts))
+
+    def test_numbers_of_different_types(self):
+        # 1 and 1.0 are the same group, the string "1" isn't
+        res = mldb.query("select count(*) as count from mixed group by k")
+        self.assertEqual([row[1] for row in res[1:]], [2, 1, 1])
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,78 @@
+#
+# image_functions_batch_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that image.readpixels and image.proximatevoxels called with arrays of
+# coordinates return the same values as one call per position.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+def voxel(x, y, z):
+    return z * 16 + y * 4 + x
+
+
+class ImageFunctionsBatchTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.put("/v1/functions/pixels", {
+            "type": "image.readpixels",
+            "params": {"expression": "[[1,2,3],[4,5,6],[7,8,9]]"}
+        })
+
+        # 4x4x4 volume of one channel, indexed by [z][y][x][channel]
+        volume = [[[[voxel(x, y, z)] for x in range(4)] for y in range(4)]
+                  for z in range(4)]
+        mldb.put("/v1/functions/voxels", {
+            "type": "image.proximatevoxels",
+            "params": {"expression": str(volume), "range": 1}
+        })
+
+    def values(self, query):
+        res = mldb.query(query)
+        return res[1][1:]
+
+    def test_readpixels(self):
+        xs = [0, 2, 5, 1, -1]
+        ys = [0, 0, 1, 2, 1]
+        single = [self.values(
+            "SELECT pixels({x: %d, y: %d})[value]" % (x, y))[0]
+            for x, y in zip(xs, ys)]
+        self.assertEqual(single, [1, 3, 6, 8, 4])
+
+        batch = self.values("SELECT pixels({x: %s, y: %s})[value]"
+                            % (xs, ys))
+        self.assertEqual(batch, single)
+
+    def test_readpixels_mismatched(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query("SELECT pixels({x: [0, 1], y: [0]})")
+
+    def test_proximatevoxels(self):
+        positions = [(1, 1, 1), (2, 2, 2), (1, 2, 1)]
+        for x, y, z in positions:
+            res = self.values("SELECT voxels({x: %d, y: %d, z: %d})[value]"
+                              % (x, y, z))
+            expected = [voxel(x + i, y + j, z + k)
+                        for i in range(-1, 2) for j in range(-1, 2)
+                        for k in range(-1, 2)]
+            self.assertEqual(res, expected)
+
+        xs, ys, zs = [list(c) for c in zip(*positions)]
+        batch = self.values("SELECT voxels({x: %s, y: %s, z: %s})[value]"
+                            % (xs, ys, zs))
+        self.assertEqual(len(batch), 27 * len(positions))
+        for n, (x, y, z) in enumerate(positions):
+            single = self.values(
+                "SELECT voxels({x: %d, y: %d, z: %d})[value]" % (x, y, z))
+            self.assertEqual(batch[n * 27:(n + 1) * 27], single)
+
+    def test_proximatevoxels_edge(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query("SELECT voxels({x: [0], y: [1], z: [1]})")
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,698 @@
+// This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+/* import_bench.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Benchmark utility for the importers.  It generates text, JSON, word2vec
+   and xlsx fixtures with different shapes, writes them with each of the
+   compression codecs of the vfs and imports them, printing one JSON object
+   per case with its throughput, its peak memory and the time spent in each
+   stage of the import, so that runs can be compared between releases.
+*/
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "mldb/arch/timers.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/core/dataset.h"
+#include "mldb/core/procedure.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/server/dataset_collection.h"
+#include "mldb/server/forwarded_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/utils/testing/benchmarks.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+/// Time of each pass of each case, under "<case>/<pass>"
+Benchmarks benchmarks;
+
+/// Name of the case being run, which tags the commits of the output
+std::string currentCase;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* BENCH TIMED DATASET                                                       */
+/*****************************************************************************/
+
+/* The importers commit their output themselves, so the commit is timed by
+   recording into a dataset that forwards to the real one and times its
+   commits.  Chunked recording is forwarded too, so that the importers take
+   the same path as with the real dataset.
+*/
+
+namespace MLDB {
+
+struct BenchTimedDatasetConfig {
+    PolyConfigT<Dataset> dataset;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(BenchTimedDatasetConfig);
+
+DEFINE_STRUCTURE_DESCRIPTION(BenchTimedDatasetConfig);
+
+BenchTimedDatasetConfigDescription::
+BenchTimedDatasetConfigDescription()
+{
+    addField("dataset", &BenchTimedDatasetConfig::dataset,
+             "Dataset that rows are recorded into");
+}
+
+struct BenchTimedDataset: public ForwardedDataset {
+
+    BenchTimedDataset(MldbServer * owner,
+                      PolyConfig config,
+                      const std::function<bool (const Json::Value &)> & onProgress)
+        : ForwardedDataset(owner)
+    {
+        auto datasetConfig = config.params.convert<BenchTimedDatasetConfig>();
+        dataset = obtainDataset(owner, datasetConfig.dataset, onProgress);
+        setUnderlying(dataset);
+    }
+
+    virtual void commit() override
+    {
+        Benchmark bm(benchmarks, currentCase + "/commit");
+        ForwardedDataset::commit();
+    }
+
+    virtual MultiChunkRecorder getChunkRecorder() override
+    {
+        MultiChunkRecorder result = dataset->getChunkRecorder();
+        auto commit = std::move(result.commit);
+        result.commit = [=] ()
+            {
+                Benchmark bm(benchmarks, currentCase + "/commit");
+                commit();
+            };
+        return result;
+    }
+
+    virtual void
+    recordEmbedding(const std::vector<ColumnPath> & columnNames,
+                    const std::vector<std::tuple<RowPath, std::vector<float>, Date> > & rows) override
+    {
+        dataset->recordEmbedding(columnNames, rows);
+    }
+
+    std::shared_ptr<Dataset> dataset;
+};
+
+static RegisterDatasetType<BenchTimedDataset, BenchTimedDatasetConfig>
+regBenchTimed(builtinPackage(),
+              "bench.timed",
+              "Dataset that times the commits of another one",
+              "");
+
+} // namespace MLDB
+
+
+/*****************************************************************************/
+/* FIXTURE GENERATION                                                        */
+/*****************************************************************************/
+
+namespace {
+
+enum FixtureFormat {
+    TEXT,
+    JSON,
+    WORD2VEC,
+    XLSX
+};
+
+struct Fixture {
+    std::string name;
+    FixtureFormat format;
+    std::string contents;   ///< Uncompressed contents of the file
+    size_t rows;
+    Json::Value params;     ///< Extra parameters of the importer
+};
+
+static const char * const words[] = {
+    "alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta"
+};
+
+/** Comma separated values with a header, where each column is generated
+    by the given function.
+*/
+Fixture
+textFixture(const std::string & name, size_t nrows, size_t ncols,
+            const std::function<void (size_t, size_t, std::string &)> & gen)
+{
+    Fixture result{name, TEXT, "", nrows, Json::Value()};
+    std::string & out = result.contents;
+    for (size_t j = 0;  j < ncols;  ++j) {
+        out += (j ? ",c" : "c") + to_string(j);
+    }
+    out += '\n';
+    for (size_t i = 0;  i < nrows;  ++i) {
+        for (size_t j = 0;  j < ncols;  ++j) {
+            if (j)
+                out += ',';
+            gen(i, j, out);
+        }
+        out += '\n';
+    }
+    return result;
+}
+
+void genNumeric(size_t i, size_t j, std::string & out)
+{
+    if (j % 2)
+        out += to_string((int64_t)((i * 7919 + j) % 100003));
+    else out += MLDB::format("%.4f", (double)((i + 1) * (j + 3) % 1009) / 7.0);
+}
+
+void genQuoted(size_t i, size_t j, std::string & out)
+{
+    // Quoted, with separators and escaped quotes inside
+    out += '"';
+    out += words[(i + j) % 8];
+    out += ", ";
+    out += words[(i * 3 + j) % 8];
+    if (i % 5 == 0)
+        out += " \"\"quoted\"\"";
+    out += '"';
+}
+
+void genMixed(size_t i, size_t j, std::string & out)
+{
+    // Each column has a single type, so that they can be given
+    switch (j % 4) {
+    case 0: out += to_string((int64_t)(i * 31 + j));  break;
+    case 1: out += MLDB::format("%.3f", (double)(i % 1000) / 3.0);  break;
+    case 2: out += words[(i + j) % 8];  break;
+    case 3:
+        if (i % 3)  // some cells are empty
+            out += to_string((int64_t)(i % 17));
+        break;
+    }
+}
+
+/** One JSON object per line, either flat or with nested objects and
+    arrays.
+*/
+Fixture jsonFixture(const std::string & name, size_t nrows, bool nested)
+{
+    Fixture result{name, JSON, "", nrows, Json::Value()};
+    for (size_t i = 0;  i < nrows;  ++i) {
+        Json::Value row;
+        row["id"] = (Json::UInt)i;
+        row["x"] = (double)((i * 7919) % 10007) / 10.0;
+        row["label"] = words[i % 8];
+        row["flag"] = i % 3 == 0;
+        for (size_t j = 0;  j < 4;  ++j)
+            row["v" + to_string(j)] = (Json::Int)((i + 1) * (j + 3) % 101);
+        if (nested) {
+            row["user"]["name"] = words[(i * 3) % 8];
+            row["user"]["age"] = (Json::UInt)(i % 90);
+            for (size_t j = 0;  j < 4;  ++j)
+                row["tags"].append(words[(i + j) % 8]);
+        }
+        result.contents += row.toStringNoNewLine();
+        result.contents += '\n';
+    }
+    return result;
+}
+
+/** Binary word2vec format: a header with the number of words and the
+    number of dimensions, then each word followed by its vector of floats.
+*/
+Fixture word2vecFixture(const std::string & name, size_t nrows, int ndims)
+{
+    Fixture result{name, WORD2VEC, "", nrows, Json::Value()};
+    std::string & out = result.contents;
+    out += to_string(nrows) + " " + to_string(ndims) + "\n";
+    std::vector<float> vec(ndims);
+    for (size_t i = 0;  i < nrows;  ++i) {
+        out += "w" + to_string(i) + " ";
+        for (int j = 0;  j < ndims;  ++j)
+            vec[j] = (float)((i + 1) * (j + 3) % 101) / 100.0f;
+        out.append((const char *)vec.data(), ndims * sizeof(float));
+        out += '\n';
+    }
+    return result;
+}
+
+/** Zip archive with its entries stored without compression, which is
+    all that is needed for an xlsx workbook.
+*/
+std::string
+makeZip(const std::vector<std::pair<std::string, std::string> > & entries)
+{
+    std::string result, directory;
+
+    auto put16 = [] (std::string & out, uint16_t val)
+        {
+            out += char(val & 0xff);
+            out += char(val >> 8);
+        };
+    auto put32 = [&] (std::string & out, uint32_t val)
+        {
+            put16(out, val & 0xffff);
+            put16(out, val >> 16);
+        };
+
+    for (auto & entry: entries) {
+        const std::string & name = entry.first;
+        const std::string & data = entry.second;
+        uint32_t crc = crc32(0, (const Bytef *)data.data(), data.size());
+        uint32_t offset = result.size();
+
+        put32(result, 0x04034b50);  // local file header
+        put16(result, 20);          // version needed
+        put16(result, 0);           // flags
+        put16(result, 0);           // stored
+        put16(result, 0);           // time
+        put16(result, 0x21);        // date (1980-01-01)
+        put32(result, crc);
+        put32(result, data.size());
+        put32(result, data.size());
+        put16(result, name.size());
+        put16(result, 0);           // extra field length
+        result += name;
+        result += data;
+
+        put32(directory, 0x02014b50);  // central directory header
+        put16(directory, 20);          // version made by
+        put16(directory, 20);          // version needed
+        put16(directory, 0);
+        put16(directory, 0);
+        put16(directory, 0);
+        put16(directory, 0x21);
+        put32(directory, crc);
+        put32(directory, data.size());
+        put32(directory, data.size());
+        put16(directory, name.size());
+        put16(directory, 0);           // extra field length
+        put16(directory, 0);           // comment length
+        put16(directory, 0);           // disk number
+        put16(directory, 0);           // internal attributes
+        put32(directory, 0);           // external attributes
+        put32(directory, offset);
+        directory += name;
+    }
+
+    uint32_t directoryOffset = result.size();
+    result += directory;
+
+    put32(result, 0x06054b50);  // end of central directory
+    put16(result, 0);
+    put16(result, 0);
+    put16(result, entries.size());
+    put16(result, entries.size());
+    put32(result, directory.size());
+    put32(result, directoryOffset);
+    put16(result, 0);           // comment length
+
+    return result;
+}
+
+/** Workbook with a single sheet, half of whose columns are numbers and
+    half shared strings.
+*/
+Fixture xlsxFixture(const std::string & name, size_t nrows, size_t ncols)
+{
+    static const std::string ns
+        = "http://schemas.openxmlformats.org/spreadsheetml/2006/main";
+    static const std::string relNs
+        = "http://schemas.openxmlformats.org/officeDocument/2006/relationships";
+
+    std::string sheet
+        = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<worksheet xmlns=\"" + ns + "\"><sheetData>";
+    for (size_t i = 0;  i < nrows;  ++i) {
+        sheet += "<row r=\"" + to_string(i + 1) + "\">";
+        for (size_t j = 0;  j < ncols;  ++j) {
+            std::string ref = std::string(1, char('A' + j)) + to_string(i + 1);
+            if (j % 2) {
+                sheet += "<c r=\"" + ref + "\" t=\"s\"><v>"
+                    + to_string((i + j) % 8) + "</v></c>";
+            }
+            else {
+                sheet += "<c r=\"" + ref + "\"><v>"
+                    + to_string((i * 7919 + j) % 100003) + "</v></c>";
+            }
+        }
+        sheet += "</row>";
+    }
+    sheet += "</sheetData></worksheet>";
+
+    std::string strings
+        = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<sst xmlns=\"" + ns + "\" count=\"8\" uniqueCount=\"8\">";
+    for (auto & w: words)
+        strings += std::string("<si><t>") + w + "</t></si>";
+    strings += "</sst>";
+
+    std::string workbook
+        = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<workbook xmlns=\"" + ns + "\" xmlns:r=\"" + relNs + "\">"
+        "<workbookPr/><sheets>"
+        "<sheet name=\"Sheet1\" sheetId=\"1\" r:id=\"rId1\"/>"
+        "</sheets></workbook>";
+
+    std::string workbookRels
+        = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+        "<Relationship Id=\"rId1\" Type=\"" + relNs + "/worksheet\" "
+        "Target=\"worksheets/sheet1.xml\"/>"
+        "<Relationship Id=\"rId2\" Type=\"" + relNs + "/sharedStrings\" "
+        "Target=\"sharedStrings.xml\"/>"
+        "</Relationships>";
+
+    std::string contentTypes
+        = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+        "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+        "</Types>";
+
+    Fixture result{name, XLSX, "", nrows, Json::Value()};
+    result.contents = makeZip({ { "[Content_Types].xml", contentTypes },
+                                { "xl/workbook.xml", workbook },
+                                { "xl/_rels/workbook.xml.rels", workbookRels },
+                                { "xl/sharedStrings.xml", strings },
+                                { "xl/worksheets/sheet1.xml", sheet } });
+    return result;
+}
+
+std::vector<Fixture> makeFixtures(size_t nrows)
+{
+    std::vector<Fixture> result;
+    result.push_back(textFixture("text_narrow_numeric", nrows, 4, genNumeric));
+    result.push_back(textFixture("text_wide_numeric", nrows, 64, genNumeric));
+    result.push_back(textFixture("text_narrow_quoted", nrows, 4, genQuoted));
+    result.push_back(textFixture("text_wide_mixed", nrows, 64, genMixed));
+
+    // The same file, with the types of the columns given rather than
+    // detected
+    result.push_back(textFixture("text_wide_mixed_typed", nrows, 64, genMixed));
+    for (size_t j = 0;  j < 64;  ++j) {
+        static const char * const types[] = {
+            "integer", "number", "string", "integer"
+        };
+        result.back().params["columnTypes"]["c" + to_string(j)] = types[j % 4];
+    }
+
+    result.push_back(jsonFixture("json_flat", nrows, false));
+    result.push_back(jsonFixture("json_nested", nrows, true));
+    result.push_back(word2vecFixture("word2vec_100", nrows, 100));
+    result.push_back(xlsxFixture("xlsx_narrow", nrows, 8));
+    return result;
+}
+
+
+/*****************************************************************************/
+/* STAGES                                                                    */
+/*****************************************************************************/
+
+std::string importerName(FixtureFormat format)
+{
+    switch (format) {
+    case TEXT:      return "import.text";
+    case JSON:      return "import.json";
+    case WORD2VEC:  return "import.word2vec";
+    case XLSX:      return "experimental.import.xlsx";
+    }
+    throw MLDB::Exception("unknown fixture format");
+}
+
+/** Run the importer for the fixture.  With an empty output type, rows are
+    parsed but none are recorded.
+*/
+void runImport(MldbServer & server, const Fixture & fixture,
+               const std::string & url, const std::string & outputType)
+{
+    Json::Value params = fixture.params;
+    params["dataFileUrl"] = url;
+
+    Json::Value output;
+    if (!outputType.empty()) {
+        output["id"] = "bench_output";
+        output["type"] = "bench.timed";
+        output["params"]["dataset"]["type"] = outputType;
+    }
+
+    switch (fixture.format) {
+    case TEXT:
+    case JSON:
+        // These always have an output, so a where clause that is never
+        // true stops the rows from being recorded
+        if (outputType.empty()) {
+            params["where"] = "false";
+            output["id"] = "bench_output";
+            output["type"] = "tabular";
+        }
+        params["outputDataset"] = output;
+        break;
+    case WORD2VEC:
+        if (!outputType.empty())
+            params["outputDataset"] = output;
+        break;
+    case XLSX:
+        if (!outputType.empty())
+            params["output"] = output;
+        break;
+    }
+
+    Json::Value config;
+    config["type"] = importerName(fixture.format);
+    config["params"] = params;
+
+    auto procedure = obtainProcedure(&server, jsonDecode<PolyConfig>(config));
+    procedure->run(ProcedureRunConfig(), nullptr);
+
+    server.datasets->deleteEntry("bench_output");
+}
+
+/** Read the whole file through the vfs, returning the number of bytes
+    that were read.
+*/
+size_t readAll(const std::string & url,
+               const std::map<std::string, std::string> & options)
+{
+    filter_istream stream(url, options);
+    std::vector<char> buffer(1024 * 1024);
+    size_t result = 0;
+    while (stream) {
+        stream.read(buffer.data(), buffer.size());
+        result += stream.gcount();
+    }
+    return result;
+}
+
+/** Split the whole file into lines, returning the number of lines. */
+size_t splitAll(const std::string & url,
+                const std::map<std::string, std::string> & options)
+{
+    filter_istream stream(url, options);
+    std::string line;
+    size_t result = 0;
+    while (getline(stream, line))
+        ++result;
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MAIN                                                                      */
+/*****************************************************************************/
+
+int
+main(int argc, char * argv[])
+{
+    using namespace boost::program_options;
+    size_t nrows = 100000;
+    unsigned int iterations = 3;
+    std::string filter;
+    std::string dir = "tmp/import_bench";
+
+    options_description all_opt;
+    all_opt.add_options()
+        ("rows,r", value(&nrows),
+         "Number of rows in the generated fixtures (100000)")
+        ("iterations,i", value(&iterations),
+         "Number of times each stage of each case is run (3)")
+        ("filter,f", value(&filter),
+         "Only run cases whose name contains this string")
+        ("dir,d", value(&dir),
+         "Directory that the fixtures are written to (tmp/import_bench)")
+        ("help,H", "show help");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv)
+          .options(all_opt)
+          .run(),
+          vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << all_opt << endl;
+        return 1;
+    }
+
+    ExcAssert(nrows > 0);
+    ExcAssert(iterations > 0);
+
+    MldbServer server;
+    server.init();
+
+    makeUriDirectory(dir + "/");
+
+    static const char * const codecs[] = {
+        "", ".gz", ".bz2", ".xz", ".zst", ".lz4"
+    };
+
+    // Files are read either as a stream, or as a memory mapping under the
+    // decompressor.  The importers map uncompressed files themselves.
+    static const char * const sources[] = { "file", "mapped" };
+
+    for (auto & fixture: makeFixtures(nrows)) {
+        for (auto & codec: codecs) {
+            // The parts of an xlsx file are already compressed by the
+            // archive
+            if (fixture.format == XLSX && *codec)
+                continue;
+
+            std::string filename = dir + "/" + fixture.name
+                + (fixture.format == XLSX ? ".xlsx" : "") + codec;
+            std::string url = "file://" + filename;
+
+            std::string caseName = fixture.name + (*codec ? codec + 1 : "");
+            if (!filter.empty() && caseName.find(filter) == std::string::npos)
+                continue;
+
+            Timer setupTimer;
+            {
+                filter_ostream stream(filename);
+                stream << fixture.contents;
+                stream.close();
+            }
+            size_t fileBytes = getUriSize(url);
+            cerr << "wrote " << filename << " (" << fileBytes << " bytes) in "
+                 << setupTimer.elapsed() << endl;
+
+            bool isText = fixture.format == TEXT || fixture.format == JSON;
+
+            for (auto & source: sources) {
+                std::map<std::string, std::string> options;
+                if (std::string(source) == "mapped")
+                    options["mapped"] = "true";
+
+                currentCase = caseName + "." + source;
+                auto pass = [&] (const std::string & name)
+                    {
+                        return currentCase + "/" + name;
+                    };
+                auto total = [&] (const std::string & name)
+                    {
+                        return benchmarks.data_[pass(name)] / iterations;
+                    };
+
+                size_t peakRss = 0;
+
+                for (unsigned i = 0;  i < iterations;  ++i) {
+                    {
+                        Benchmark bm(benchmarks, pass("read"));
+                        ExcAssertEqual(readAll(url, options),
+                                       fixture.contents.size());
+                    }
+                    if (isText) {
+                        Benchmark bm(benchmarks, pass("split"));
+                        ExcAssertGreaterEqual(splitAll(url, options),
+                                              fixture.rows);
+                    }
+
+                    // The importers choose how they open the file, so the
+                    // remaining passes don't depend on the source
+                    if (std::string(source) != "file")
+                        continue;
+                    {
+                        Benchmark bm(benchmarks, pass("parse"));
+                        runImport(server, fixture, url, "");
+                    }
+
+                    resetPeakResidentSetSize();
+                    {
+                        Benchmark bm(benchmarks, pass("import"));
+                        runImport(server, fixture, url,
+                                  fixture.format == WORD2VEC
+                                  ? "embedding" : "tabular");
+                    }
+                    peakRss = std::max(peakRss, getPeakResidentSetSize());
+                }
+
+                // Each pass does the work of the previous one and some
+                // more, so the time of a stage is what its pass adds
+                double read = total("read");
+                double split = isText ? total("split") : read;
+
+                Json::Value result;
+                result["name"] = caseName;
+                result["format"] = importerName(fixture.format);
+                result["codec"] = *codec ? codec + 1 : "none";
+                result["source"] = source;
+                result["rows"] = (Json::UInt)fixture.rows;
+                result["fileBytes"] = (Json::UInt)fileBytes;
+                result["bytes"] = (Json::UInt)fixture.contents.size();
+                result["iterations"] = iterations;
+                result["stages"]["decompress"] = read;
+                if (isText)
+                    result["stages"]["split"] = std::max(0.0, split - read);
+
+                if (std::string(source) == "file") {
+                    double parse = total("parse");
+                    double import = total("import");
+                    double commit = total("commit");
+                    result["stages"]["parse"] = std::max(0.0, parse - split);
+                    result["stages"]["record"]
+                        = std::max(0.0, import - commit - parse);
+                    result["stages"]["commit"] = commit;
+                    result["seconds"] = import;
+                    result["MBPerSecond"] = fileBytes / 1000000.0 / import;
+                    result["uncompressedMBPerSecond"]
+                        = fixture.contents.size() / 1000000.0 / import;
+                    result["rowsPerSecond"] = fixture.rows / import;
+                    result["peakRssBytes"] = (Json::UInt)peakRss;
+                }
+                else {
+                    result["seconds"] = read;
+                    result["MBPerSecond"] = fileBytes / 1000000.0 / read;
+                    result["uncompressedMBPerSecond"]
+                        = fixture.contents.size() / 1000000.0 / read;
+                }
+
+                cout << result.toStringNoNewLine() << endl;
+            }
+
+            tryEraseUriObject(url);
+        }
+    }
+
+    benchmarks.dumpTotals(cerr);
+
+    server.shutdown();
+}
@@ -0,0 +1,101 @@
+#
+# import_glob_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test importing all of the files matching a wildcard in dataFileUrl.
+#
+
+import os
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ImportGlobTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        if not os.path.isdir("tmp/import_glob"):
+            os.makedirs("tmp/import_glob")
+        with open("tmp/import_glob/part-1.csv", "w") as f:
+            f.write("id,x\n1,a\n2,b\n3,c\n")
+        with open("tmp/import_glob/part-2.csv", "w") as f:
+            f.write("id,x\n4,d\n5,e\n")
+        with open("tmp/import_glob/other.csv", "w") as f:
+            f.write("id,x\n6,f\n")
+        with open("tmp/import_glob/bad-header.txt", "w") as f:
+            f.write("id,y\n7,g\n")
+        with open("tmp/import_glob/part-1.json", "w") as f:
+            f.write('{"id": 1, "x": "a"}\n{"id": 2, "x": "b"}\n')
+        with open("tmp/import_glob/part-2.json", "w") as f:
+            f.write('{"id": 3, "x": "c"}\n')
+
+    def test_text_glob(self):
+        mldb.put("/v1/procedures/import", {
+            "type": "import.text",
+            "params": {
+                "dataFileUrl": "file://tmp/import_glob/part-*.csv",
+                "outputDataset": "text_glob",
+                "select": "x, dataFileUrl() AS file",
+                "named": "id",
+                "maxConcurrentFiles": 2,
+                "runOnCreation": True
+            }
+        })
+        res = mldb.query("SELECT x, file FROM text_glob ORDER BY rowName()")
+        self.assertEqual([r[1] for r in res[1:]], ["a", "b", "c", "d", "e"])
+        self.assertTrue(res[1][2].endswith("part-1.csv"))
+        self.assertTrue(res[4][2].endswith("part-2.csv"))
+
+    def test_text_glob_limit(self):
+        mldb.put("/v1/procedures/import", {
+            "type": "import.text",
+            "params": {
+                "dataFileUrl": "file://tmp/import_glob/part-*.csv",
+                "outputDataset": "text_glob_limit",
+                "named": "id",
+                "limit": 4,
+                "runOnCreation": True
+            }
+        })
+        res = mldb.query("SELECT count(*) FROM text_glob_limit")
+        self.assertEqual(res[1][1], 4)
+
+    def test_text_glob_header_mismatch(self):
+        msg = "doesn't match the header"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.put("/v1/procedures/import", {
+                "type": "import.text",
+                "params": {
+                    "dataFileUrl": "file://tmp/import_glob/[ob]*",
+                    "outputDataset": "text_glob_bad",
+                    "named": "id",
+                    "runOnCreation": True
+                }
+            })
+
+    def test_no_match(self):
+        msg = "No files match"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.put("/v1/procedures/import", {
+                "type": "import.text",
+                "params": {
+                    "dataFileUrl": "file://tmp/import_glob/nothing-*.csv",
+                    "outputDataset": "text_glob_none",
+                    "runOnCreation": True
+                }
+            })
+
+    def test_json_glob(self):
+        mldb.put("/v1/procedures/import", {
+            "type": "import.json",
+            "params": {
+                "dataFileUrl": "file://tmp/import_glob/part-?.json",
+                "outputDataset": "json_glob",
+                "named": "id",
+                "runOnCreation": True
+            }
+        })
+        res = mldb.query("SELECT x FROM json_glob ORDER BY rowName()")
+        self.assertEqual(res[1:], [["1", "a"], ["2", "b"], ["3", "c"]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
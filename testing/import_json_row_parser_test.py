@@ -0,0 +1,71 @@
+#
+# import_json_row_parser_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that lines imported by import.json through its fast row parser give
+# the same rows as through the general JSON parser.
+#
+
+import os
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+LINES = [
+    '{"a": 1, "b": "x", "c": 2.5}',
+    '  { "a" : -3 , "b" : "y z" }  ',
+    '{"a": true, "b": false, "c": null}',
+    '{"nested": {"x": 1, "y": {"z": "deep"}}, "a": 4}',
+    '{"a": 1e3, "b": 12345678901234}',
+    '{"a": 99999999999999999999999, "b": -0.0}',
+    '{"escaped": "a\\"b", "a": 5}',
+    '{"arr": [1, 2, 3], "a": 6}',
+    '{"utf8": "\xc3\xa9t\xc3\xa9"}',
+    '{"a.b": 7}',
+    '{}',
+]
+
+class ImportJsonRowParserTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        if not os.path.isdir("tmp"):
+            os.makedirs("tmp")
+        with open("tmp/import_json_row_parser.json", "w") as f:
+            f.write("\n".join(LINES) + "\n")
+
+    def import_json(self, output, **params):
+        params.update({
+            "dataFileUrl": "file://tmp/import_json_row_parser.json",
+            "outputDataset": {"id": output, "type": "sparse.mutable"},
+            "runOnCreation": True
+        })
+        mldb.post("/v1/procedures", {
+            "type": "import.json",
+            "params": params
+        })
+
+    def test_same_rows(self):
+        # The fast parser is only used without select, where or named
+        self.import_json("fast")
+        self.import_json("general", named="lineNumber()")
+
+        query = "SELECT * FROM %s ORDER BY rowName()"
+        self.assertTableResultEquals(mldb.query(query % "fast"),
+                                     mldb.query(query % "general"))
+
+    def test_errors_still_reported(self):
+        with open("tmp/import_json_row_parser_bad.json", "w") as f:
+            f.write('{"a": 1}\n{"a": }\n')
+        msg = "Error parsing JSON row"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.post("/v1/procedures", {
+                "type": "import.json",
+                "params": {
+                    "dataFileUrl": "file://tmp/import_json_row_parser_bad.json",
+                    "outputDataset": "bad",
+                    "runOnCreation": True
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,65 @@
+#
+# import_text_column_types_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the columnTypes parameter of import.text.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ImportTextColumnTypesTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        with open("tmp/import_text_column_types.csv", "w") as f:
+            f.write("id,code,score,at\n")
+            f.write("1,007,1.5,2016-01-02T03:04:05Z\n")
+            f.write("2,\"123\",2,2016-02-03T04:05:06Z\n")
+            f.write("3,abc,-3e2,2016-03-04T05:06:07Z\n")
+
+    def run_import(self, ds, column_types, ignore_bad_lines=False):
+        mldb.put("/v1/procedures/import", {
+            "type": "import.text",
+            "params": {
+                "dataFileUrl": "file://tmp/import_text_column_types.csv",
+                "outputDataset": {"id": ds, "type": "sparse.mutable"},
+                "columnTypes": column_types,
+                "ignoreBadLines": ignore_bad_lines,
+                "runOnCreation": True
+            }
+        })
+
+    def test_declared_types(self):
+        self.run_import("declared", {"code": "string", "score": "number",
+                                     "at": "timestamp"})
+        res = mldb.query("SELECT code, score, at FROM declared "
+                         "ORDER BY rowName()")
+        self.assertEqual(res[1:], [
+            ["2", "007", 1.5, {"ts": "2016-01-02T03:04:05Z"}],
+            ["3", "123", 2, {"ts": "2016-02-03T04:05:06Z"}],
+            ["4", "abc", -300, {"ts": "2016-03-04T05:06:07Z"}]
+        ])
+
+    def test_inferred_by_default(self):
+        self.run_import("inferred", {})
+        res = mldb.query("SELECT code, at FROM inferred "
+                         "WHERE rowName() = '2'")
+        self.assertEqual(res[1], ["2", 7, "2016-01-02T03:04:05Z"])
+
+    def test_bad_value(self):
+        msg = "not an integer"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            self.run_import("bad", {"code": "integer"})
+
+        self.run_import("ignored", {"code": "integer"},
+                        ignore_bad_lines=True)
+        res = mldb.query("SELECT code FROM ignored ORDER BY rowName()")
+        self.assertEqual(res[1:], [["2", 7], ["3", 123]])
+
+    def test_unknown_column(self):
+        msg = "not in the CSV file"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            self.run_import("unknown", {"nothere": "string"})
+
+if __name__ == '__main__':
+    mldb.run_tests()
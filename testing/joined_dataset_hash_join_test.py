@@ -0,0 +1,84 @@
+#
+# joined_dataset_hash_join_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test equijoins between a large and a small dataset, which are done with
+# a hash join built on the smaller side.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class JoinedDatasetHashJoinTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        fact = mldb.create_dataset({"id": "fact", "type": "sparse.mutable"})
+        for i in range(5000):
+            cols = [["x", i, 0]]
+            if i % 10:
+                cols.append(["k", i % 53, 0])
+            fact.record_row("f%d" % i, cols)
+        fact.commit()
+
+        # Keys 0 to 39 are present, with key 7 twice
+        dim = mldb.create_dataset({"id": "dim", "type": "sparse.mutable"})
+        for i in range(40):
+            dim.record_row("d%d" % i, [["id", i, 0], ["label", "l%d" % i, 0]])
+        dim.record_row("d7bis", [["id", 7, 0], ["label", "other", 0]])
+        dim.record_row("dnull", [["label", "none", 0]])
+        dim.commit()
+
+    def count(self, query):
+        return mldb.query(query)[1][1]
+
+    def expected(self, outer):
+        num = 0
+        for i in range(5000):
+            k = i % 53 if i % 10 else None
+            if k is not None and k < 40:
+                num += 2 if k == 7 else 1
+            elif outer:
+                num += 1
+        return num
+
+    def test_inner(self):
+        self.assertEqual(
+            self.count("SELECT count(*) FROM fact JOIN dim "
+                       "ON fact.k = dim.id"),
+            self.expected(False))
+
+        # Same with the sides the other way around
+        self.assertEqual(
+            self.count("SELECT count(*) FROM dim JOIN fact "
+                       "ON fact.k = dim.id"),
+            self.expected(False))
+
+    def test_left(self):
+        self.assertEqual(
+            self.count("SELECT count(*) FROM fact LEFT JOIN dim "
+                       "ON fact.k = dim.id"),
+            self.expected(True))
+
+    def test_right(self):
+        # Every dim row but the one with a null key matches
+        self.assertEqual(
+            self.count("SELECT count(*) FROM fact RIGHT JOIN dim "
+                       "ON fact.k = dim.id"),
+            self.expected(False) + 1)
+
+    def test_values(self):
+        res = mldb.query("SELECT fact.x, dim.label FROM fact JOIN dim "
+                         "ON fact.k = dim.id WHERE fact.x < 60 "
+                         "ORDER BY fact.x, dim.label")
+        expected = [["_rowName", "fact.x", "dim.label"]]
+        for i in range(60):
+            k = i % 53
+            if i % 10 == 0 or k >= 40:
+                continue
+            labels = ["l7", "other"] if k == 7 else ["l%d" % k]
+            for label in labels:
+                row = "[f%d]-[d%s]" % (i, "7bis" if label == "other" else k)
+                expected.append([row, i, label])
+        self.assertEqual(res, expected)
+
+mldb.run_tests()
@@ -0,0 +1,98 @@
+#
+# joined_dataset_join_order_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test chains of inner joins which are run in a different order from the
+# one they are written in, as the large table is written first.  Joins with
+# a subselect are never reordered, so they give the result to compare with.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class JoinedDatasetJoinOrderTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        big = mldb.create_dataset({"id": "big", "type": "sparse.mutable"})
+        for i in range(2000):
+            big.record_row("b%d" % i, [["x", i, 0], ["k", i % 100, 0]])
+        big.commit()
+
+        mid = mldb.create_dataset({"id": "mid", "type": "sparse.mutable"})
+        for i in range(100):
+            mid.record_row("m%d" % i, [["id", i, 0], ["j", i % 50, 0]])
+        mid.commit()
+
+        # Only two of the 50 values of mid.j are here, so joining small
+        # first keeps the intermediate join small
+        small = mldb.create_dataset({"id": "small", "type": "sparse.mutable"})
+        for i in range(2):
+            small.record_row("s%d" % i, [["id", i, 0], ["label", "l%d" % i, 0]])
+        small.commit()
+
+        tiny = mldb.create_dataset({"id": "tiny", "type": "sparse.mutable"})
+        tiny.record_row("t0", [["label", "l1", 0]])
+        tiny.commit()
+
+    def expected(self):
+        result = []
+        for i in range(2000):
+            k = i % 100
+            if k % 50 < 2:
+                result.append(["[b%d]-[m%d]-[s%d]" % (i, k, k % 50),
+                               i, k, "l%d" % (k % 50)])
+        return sorted(result)
+
+    def rows(self, query):
+        return sorted(mldb.query(query)[1:])
+
+    def test_three_way(self):
+        select = "SELECT big.x, mid.id, small.label "
+        reordered = self.rows(
+            select + "FROM big JOIN mid ON big.k = mid.id "
+            "JOIN small ON mid.j = small.id")
+        self.assertEqual(reordered, self.expected())
+
+        as_written = self.rows(
+            select + "FROM big JOIN mid ON big.k = mid.id "
+            "JOIN (SELECT * FROM small) AS small ON mid.j = small.id")
+        self.assertEqual(reordered, as_written)
+
+    def test_conditions_in_one_clause(self):
+        # All of the conditions on the last join
+        reordered = self.rows(
+            "SELECT big.x, mid.id, small.label "
+            "FROM big JOIN mid JOIN small "
+            "ON big.k = mid.id AND mid.j = small.id")
+        self.assertEqual(reordered, self.expected())
+
+    def test_star(self):
+        query = ("SELECT * FROM big JOIN mid ON big.k = mid.id "
+                 "JOIN small ON mid.j = small.id "
+                 "ORDER BY rowName() LIMIT 5")
+        res = mldb.query(query)
+        self.assertEqual(sorted(res[0]),
+                         sorted(["_rowName", "big.x", "big.k", "mid.id",
+                                 "mid.j", "small.id", "small.label"]))
+        self.assertEqual(len(res), 6)
+
+    def test_four_way(self):
+        select = "SELECT big.x, mid.id, small.label, tiny.label AS t "
+        joins = ("FROM big JOIN mid ON big.k = mid.id "
+                 "JOIN small ON mid.j = small.id "
+                 "JOIN %s ON small.label = tiny.label "
+                 "WHERE big.x < 500")
+        reordered = self.rows(select + joins % "tiny")
+        as_written = self.rows(select + joins % "(SELECT * FROM tiny) AS tiny")
+        self.assertEqual(reordered, as_written)
+        self.assertEqual(len(reordered),
+                         len([i for i in range(500) if i % 100 % 50 == 1]))
+        for row in reordered:
+            self.assertEqual(row[0][-10:], "-[s1]-[t0]")
+
+    def test_count(self):
+        res = mldb.query("SELECT count(*) FROM big JOIN mid ON big.k = mid.id "
+                         "JOIN small ON mid.j = small.id")
+        self.assertEqual(res[1][1], len(self.expected()))
+
+mldb.run_tests()
@@ -0,0 +1,68 @@
+// This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+// Test of the batched row and column accessors of Javascript datasets
+
+function assertEqual(expr, val)
+{
+    if (expr == val)
+        return;
+    if (JSON.stringify(expr) == JSON.stringify(val))
+        return;
+
+    mldb.log(expr, 'IS NOT EQUAL TO', val);
+
+    throw "Assertion failure";
+}
+
+var ts = new Date("2015-01-01");
+
+var dataset = mldb.createDataset({type: 'sparse.mutable', id: 'test'});
+
+for (var i = 0;  i < 10;  ++i) {
+    var row = [ [ 'i', i, ts ], [ 's', 'v' + i, ts ] ];
+    if (i % 2)
+        row.push([ 'x', i / 2, ts ]);
+    dataset.recordRow('row' + i, row);
+}
+
+dataset.commit();
+
+assertEqual(dataset.getRowCount(), 10);
+
+var rowPaths = dataset.getRowPaths();
+assertEqual(rowPaths.length, 10);
+assertEqual(dataset.getRowPaths(2, 3), rowPaths.slice(2, 5));
+var rowNums = rowPaths.map(function (r) { return Number(r.substr(3)); });
+
+// Rows come in chunks, in the same order as the row paths
+var numRows = 0;
+for (var start = 0;  start < 10;  start += 4) {
+    var rows = dataset.getRows(start, 4);
+    assertEqual(rows.length, Math.min(4, 10 - start));
+    for (var j = 0;  j < rows.length;  ++j) {
+        assertEqual(rows[j][0], rowPaths[start + j]);
+        assertEqual(rows[j][1].length, rowNums[start + j] % 2 ? 3 : 2);
+        ++numRows;
+    }
+}
+assertEqual(numRows, 10);
+
+// Columns are in the order of the row paths
+
+var ints = dataset.getColumnArray('i');
+assertEqual(ints instanceof Uint32Array, true);
+assertEqual(Array.prototype.slice.call(ints), rowNums);
+
+var xs = dataset.getColumnArray('x');
+assertEqual(xs instanceof Float64Array, true);
+for (var i = 0;  i < 10;  ++i) {
+    if (rowNums[i] % 2)
+        assertEqual(xs[i], rowNums[i] / 2);
+    else assertEqual(isNaN(xs[i]), true);
+}
+
+var strs = dataset.getColumnArray('s');
+assertEqual(Array.isArray(strs), true);
+assertEqual(strs, rowNums.map(function (n) { return 'v' + n; }));
+
+"success"
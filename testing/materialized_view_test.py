@@ -0,0 +1,85 @@
+#
+# materialized_view_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that a materialized view over a tabular dataset has the same rows as
+# its GROUP BY query after each commit of the dataset.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+QUERY = ("SELECT region, count(*) AS n, count(amount) AS amounts, "
+         "sum(amount) AS total, min(amount) AS lo, max(amount) AS hi, "
+         "avg(amount) AS average FROM sales GROUP BY region")
+
+
+class MaterializedViewTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.create_dataset({
+            "id": "sales",
+            "type": "tabular",
+            "params": {"unknownColumns": "add"}
+        })
+        cls.record(0, 100)
+        mldb.post("/v1/datasets/sales/commit")
+
+        mldb.put("/v1/datasets/by_region", {
+            "type": "materialized.view",
+            "params": {"query": QUERY}
+        })
+
+    @classmethod
+    def record(cls, start, end):
+        for i in range(start, end):
+            cols = [["region", "r%d" % (i % 7), 0]]
+            if i % 5:
+                cols.append(["amount", i, 0])
+            mldb.post("/v1/datasets/sales/rows",
+                      {"rowName": "sale%d" % i, "columns": cols})
+
+    def check(self):
+        self.assertTableResultEquals(
+            mldb.query("SELECT * FROM by_region ORDER BY rowName()"),
+            mldb.query(QUERY + " ORDER BY rowName()"))
+
+    def test_appended_commits(self):
+        self.check()
+        generation = mldb.get("/v1/datasets/by_region").json()["status"]
+
+        # A new region and more rows of the existing ones
+        for start in [100, 250]:
+            self.record(start, start + 150)
+            mldb.post("/v1/datasets/sales/commit")
+            self.check()
+
+        status = mldb.get("/v1/datasets/by_region").json()["status"]
+        self.assertEqual(status["rowCount"], 7)
+        self.assertEqual(status["rowsAggregated"], 400)
+        self.assertEqual(status["commitsApplied"],
+                         generation["commitsApplied"] + 2)
+        self.assertNotIn("lastError", status)
+
+    def test_unsupported_queries(self):
+        mldb.create_dataset({"id": "mutable", "type": "sparse.mutable"})
+        mldb.post("/v1/datasets/mutable/commit")
+
+        for query in [
+                "SELECT region, earliest(amount) FROM sales GROUP BY region",
+                "SELECT region, sum(amount) * 2 FROM sales GROUP BY region",
+                "SELECT region, count(*) FROM sales GROUP BY region "
+                "HAVING count(*) > 10",
+                "SELECT region, count(*) FROM sales GROUP BY region "
+                "ORDER BY region",
+                "SELECT count(*) FROM sales",
+                "SELECT region, count(*) FROM mutable GROUP BY region"]:
+            with self.assertMldbRaises(status_code=400):
+                mldb.put("/v1/datasets/bad_view", {
+                    "type": "materialized.view",
+                    "params": {"query": query}
+                })
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
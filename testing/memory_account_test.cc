@@ -0,0 +1,128 @@
+/** memory_account_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the accounting of the memory used by queries.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/core/memory_account.h"
+#include "mldb/sql/expression_value.h"
+#include "mldb/sql/dataset_types.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/rest/in_process_rest_connection.h"
+#include "mldb/rest/cancellation_exception.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_memory_account )
+{
+    BOOST_CHECK(!MemoryAccount::current());
+
+    MemoryAccount procedure("procedure", "procedures/p/runs/r", 1000);
+    BOOST_CHECK(!procedure.parent);
+
+    {
+        MemoryAccountScope scope(&procedure);
+        BOOST_CHECK_EQUAL(MemoryAccount::current(), &procedure);
+
+        MemoryAccount query("query", "SELECT 1");
+        BOOST_CHECK_EQUAL(query.parent, &procedure);
+
+        Json::Value running = MemoryAccount::getRunningStats();
+        BOOST_REQUIRE_EQUAL(running.size(), 2);
+        BOOST_CHECK_EQUAL(running[0]["name"].asString(),
+                          "procedures/p/runs/r");
+        BOOST_CHECK_EQUAL(running[1]["type"].asString(), "query");
+        BOOST_CHECK_EQUAL(MemoryAccount::getRunningStats("query").size(), 1);
+
+        {
+            MemoryAccountScope scope(&query);
+            MemoryCharge charge;
+            BOOST_CHECK(charge.active());
+            charge.add(600);
+            BOOST_CHECK_EQUAL(query.bytes(), 600);
+            BOOST_CHECK_EQUAL(procedure.bytes(), 600);
+
+            // Going over the limit of the parent charges nothing
+            BOOST_CHECK_THROW(charge.add(600), CancellationException);
+            BOOST_CHECK_EQUAL(query.bytes(), 600);
+            BOOST_CHECK_EQUAL(procedure.bytes(), 600);
+            BOOST_CHECK(procedure.limitExceeded());
+            BOOST_CHECK(!query.limitExceeded());
+
+            charge.release(200);
+            BOOST_CHECK_EQUAL(procedure.bytes(), 400);
+        }
+
+        // Everything was released when the charge went away
+        BOOST_CHECK_EQUAL(query.bytes(), 0);
+        BOOST_CHECK_EQUAL(query.peakBytes(), 600);
+        BOOST_CHECK_EQUAL(procedure.bytes(), 0);
+        BOOST_CHECK_EQUAL(procedure.getStats()["limitBytes"].asInt(), 1000);
+    }
+
+    BOOST_CHECK(!MemoryAccount::current());
+    BOOST_CHECK_EQUAL(MemoryAccount::getRunningStats().size(), 1);
+
+    // With nothing current, charges are not accounted anywhere
+    MemoryCharge charge;
+    BOOST_CHECK(!charge.active());
+    charge.add(1000000);
+}
+
+BOOST_AUTO_TEST_CASE( test_query_memory_limit )
+{
+    MldbServer server;
+    server.init();
+    server.start();
+
+    Json::Value config;
+    config["type"] = "sparse.mutable";
+    auto resp = server.restPut("/v1/datasets/ds", {}, config);
+    BOOST_REQUIRE_EQUAL(resp.responseCode, 201);
+
+    for (int i = 0;  i < 1000;  ++i) {
+        Json::Value row;
+        row["rowName"] = "row" + std::to_string(i);
+        row["columns"][0][0] = "x";
+        row["columns"][0][1] = i;
+        row["columns"][0][2] = "2016-01-01T00:00:00Z";
+        resp = server.restPost("/v1/datasets/ds/rows", {}, row);
+        BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+    }
+
+    resp = server.restPost("/v1/datasets/ds/commit");
+    BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+
+    resp = server.restGet("/v1/runningQueries");
+    BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+    BOOST_CHECK_EQUAL(Json::parse(resp.response).size(), 0);
+
+    // A query run within an account is charged to it
+    std::string q = "SELECT x FROM ds ORDER BY x DESC";
+    {
+        MemoryAccount account("procedure", "test");
+        MemoryAccountScope scope(&account);
+        BOOST_CHECK_EQUAL(server.query(q).size(), 1000);
+        BOOST_CHECK_GT(account.peakBytes(), 1000 * sizeof(ExpressionValue));
+        BOOST_CHECK_EQUAL(account.bytes(), 0);
+    }
+
+    // When that takes it over its limit, the query is cancelled
+    {
+        MemoryAccount account("procedure", "test", 10000);
+        MemoryAccountScope scope(&account);
+        BOOST_CHECK_THROW(server.query(q), CancellationException);
+        BOOST_CHECK(account.limitExceeded());
+        BOOST_CHECK_EQUAL(account.bytes(), 0);
+    }
+}
@@ -0,0 +1,58 @@
+#
+# metrics_endpoint_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the Prometheus metrics returned by /metrics.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class MetricsEndpointTest(MldbUnitTest):  # noqa
+
+    def get_metrics(self):
+        res = mldb.get('/metrics')
+        samples = {}
+        for line in res.text.splitlines():
+            if not line or line.startswith('#'):
+                continue
+            name, value = line.rsplit(' ', 1)
+            samples[name] = float(value)
+        return res.text, samples
+
+    def test_format(self):
+        text, samples = self.get_metrics()
+        self.assertIn('# TYPE mldb_thread_pool_queue_depth gauge', text)
+        self.assertIn('mldb_thread_pool_jobs_submitted', samples)
+
+    def test_query_phases(self):
+        _, before = self.get_metrics()
+        mldb.get('/v1/query', q='SELECT 1')
+        mldb.get('/v1/query', q='SELECT 2')
+        text, after = self.get_metrics()
+        self.assertIn('# TYPE mldb_query_phase_duration_seconds histogram',
+                      text)
+
+        for phase in ['parse', 'execute', 'encode']:
+            count = 'mldb_query_phase_duration_seconds_count{phase="%s"}' \
+                    % phase
+            inf = 'mldb_query_phase_duration_seconds_bucket' \
+                  '{phase="%s",le="+Inf"}' % phase
+            self.assertEqual(after[count] - before.get(count, 0), 2)
+            self.assertEqual(after[inf], after[count])
+
+    def test_vfs(self):
+        mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : 'file://mldb/testing/dataset/iris.data',
+                'outputDataset' : 'iris',
+                'headers' : ['a', 'b', 'c', 'd', 'class'],
+                'runOnCreation' : True
+            }
+        })
+        _, samples = self.get_metrics()
+        opens = 'mldb_vfs_opens_total{scheme="file",mode="read"}'
+        self.assertGreaterEqual(samples.get(opens, 0), 1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -75,3 +75,32 @@ BOOST_AUTO_TEST_CASE(test_explain)
     }
 
 }
+
+BOOST_AUTO_TEST_CASE(test_extract_geo_distance_predicate)
+{
+    GeoDistancePredicate predicate;
+
+    auto where = SqlExpression::parse("geo_distance(t.lat, t.lon, 45.5, -73.5) < 1000");
+    BOOST_REQUIRE(extractGeoDistancePredicate("t", *where, predicate));
+    BOOST_CHECK_EQUAL(predicate.latitudeColumn, ColumnPath("lat"));
+    BOOST_CHECK_EQUAL(predicate.longitudeColumn, ColumnPath("lon"));
+    BOOST_CHECK_EQUAL(predicate.lat, 45.5);
+    BOOST_CHECK_EQUAL(predicate.lon, -73.5);
+    BOOST_CHECK_EQUAL(predicate.distance, 1000);
+    BOOST_CHECK(!predicate.inclusive);
+
+    where = SqlExpression::parse("1000 >= geo_distance(45.5, -73.5, lat, lon)");
+    BOOST_REQUIRE(extractGeoDistancePredicate("", *where, predicate));
+    BOOST_CHECK_EQUAL(predicate.latitudeColumn, ColumnPath("lat"));
+    BOOST_CHECK_EQUAL(predicate.lat, 45.5);
+    BOOST_CHECK(predicate.inclusive);
+    BOOST_CHECK(predicate.matches(1000));
+
+    for (auto w: { "geo_distance(lat, lon, 45.5, -73.5) > 1000",
+                   "geo_distance(lat, lon, x, -73.5) < 1000",
+                   "geo_distance(lat, lon, 45.5, -73.5) < y",
+                   "geo_distance(lat, lon, 'a', -73.5) < 1000" }) {
+        where = SqlExpression::parse(w);
+        BOOST_CHECK(!extractGeoDistancePredicate("", *where, predicate));
+    }
+}
@@ -22,6 +22,40 @@ using namespace std;
 
 using namespace MLDB;
 
+// This must run first, before anything loads the plugin
+BOOST_AUTO_TEST_CASE( test_plugin_loaded_on_first_use )
+{
+    MldbServer server;
+
+    server.init();
+    server.scanPlugins("file://build/x86_64/mldb_plugins/mongodb");
+
+    string httpBoundAddress = server.bindTcp(PortRange(17000,18000), "127.0.0.1");
+    server.start();
+
+    HttpRestProxy proxy(httpBoundAddress);
+
+    auto has = [] (const Json::Value & list, const std::string & name)
+        {
+            for (auto & v: list)
+                if (v.asString() == name)
+                    return true;
+            return false;
+        };
+
+    // The types are listed without the plugin being loaded
+    BOOST_CHECK(has(proxy.get("/v1/types/datasets").jsonBody(),
+                    "mongodb.dataset"));
+    BOOST_CHECK(!has(proxy.get("/v1/plugins").jsonBody(), "mongodb"));
+
+    // Using one of them loads it
+    auto doc = proxy.get("/v1/types/datasets/mongodb.dataset/doc",
+                         {}, {}, -1, true, nullptr, nullptr,
+                         true /* redirect */);
+    BOOST_CHECK_EQUAL(doc.code(), 200);
+    BOOST_CHECK(has(proxy.get("/v1/plugins").jsonBody(), "mongodb"));
+}
+
 BOOST_AUTO_TEST_CASE( test_plugin_loading )
 {
     MldbServer server;
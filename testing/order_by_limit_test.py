@@ -0,0 +1,53 @@
+#
+# order_by_limit_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that ORDER BY with a LIMIT, which only keeps the best rows of each
+# thread, returns the same rows as a full sort.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class OrderByLimitTest(MldbUnitTest):  # noqa
+
+    num_rows = 20000
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({"id": "spend", "type": "sparse.mutable"})
+        random.seed(1)
+        for i in range(cls.num_rows):
+            # Few distinct values, so that there are lots of ties
+            ds.record_row("u%d" % i, [["spend", random.randint(0, 500), 0],
+                                      ["user", i, 0]])
+        ds.commit()
+
+    def check(self, order_by, offset, limit):
+        full = mldb.query("select user from spend order by %s" % order_by)
+        res = mldb.query("select user from spend order by %s "
+                         "limit %d offset %d" % (order_by, limit, offset))
+        self.assertEqual(res[0], full[0])
+        self.assertEqual(res[1:], full[1 + offset:1 + offset + limit])
+
+    def test_limit(self):
+        self.check("spend DESC", 0, 100)
+        self.check("spend", 0, 1)
+
+    def test_limit_offset(self):
+        self.check("spend DESC, user", 50, 100)
+        self.check("spend", 19990, 100)
+
+    def test_limit_larger_than_dataset(self):
+        self.check("spend DESC", 0, 2 * self.num_rows)
+
+    def test_distinct_on(self):
+        res = mldb.query("select distinct on (spend) spend from spend "
+                         "order by spend DESC limit 10 offset 5")
+        self.assertEqual([r[1] for r in res[1:]], range(495, 485, -1))
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
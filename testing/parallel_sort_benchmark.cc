@@ -0,0 +1,122 @@
+/* parallel_sort_benchmark.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Compares the parallel radix sort against the parallel quicksort and
+   std::sort, and the merge path merge against std::inplace_merge, on
+   100M element vectors of hashes like those of rows and columns.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/server/parallel_merge_sort.h"
+#include "mldb/types/date.h"
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+constexpr size_t NUM_ELEMENTS = 100000000;
+
+std::vector<uint64_t> makeHashes(size_t n, int seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<uint64_t> result(n);
+    for (auto & h: result)
+        h = rng();
+    return result;
+}
+
+template<typename Fn>
+void runBenchmark(const std::string & name,
+                  std::vector<uint64_t> input,
+                  const std::vector<uint64_t> & expected,
+                  Fn && sortFn)
+{
+    Date before = Date::now();
+    sortFn(input);
+    Date after = Date::now();
+
+    cerr << name << ": " << after.secondsSince(before) * 1000.0 << "ms"
+         << endl;
+    BOOST_CHECK(input == expected);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( benchmark_sort )
+{
+    std::vector<uint64_t> hashes = makeHashes(NUM_ELEMENTS, 1);
+
+    std::vector<uint64_t> expected = hashes;
+    runBenchmark("std::sort", hashes, {}, [&] (std::vector<uint64_t> & v)
+                 {
+                     std::sort(v.begin(), v.end());
+                     expected = v;
+                     v.clear();
+                 });
+
+    runBenchmark("parallelQuickSortRecursive", hashes, expected,
+                 [] (std::vector<uint64_t> & v)
+                 {
+                     parallelQuickSortRecursive(v);
+                 });
+
+    runBenchmark("parallelRadixSort", hashes, expected,
+                 [] (std::vector<uint64_t> & v)
+                 {
+                     parallelRadixSort(v, [] (uint64_t h) { return h; });
+                 });
+
+    // Small integers, where radix sort skips the leading bytes
+    for (auto & h: hashes)
+        h &= 0xffffff;
+    expected = hashes;
+    std::sort(expected.begin(), expected.end());
+
+    runBenchmark("parallelQuickSortRecursive (24 bits)", hashes, expected,
+                 [] (std::vector<uint64_t> & v)
+                 {
+                     parallelQuickSortRecursive(v);
+                 });
+
+    runBenchmark("parallelRadixSort (24 bits)", hashes, expected,
+                 [] (std::vector<uint64_t> & v)
+                 {
+                     parallelRadixSort(v, [] (uint64_t h) { return h; });
+                 });
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_merge )
+{
+    std::vector<uint64_t> v1 = makeHashes(NUM_ELEMENTS / 2, 2);
+    std::vector<uint64_t> v2 = makeHashes(NUM_ELEMENTS / 2, 3);
+    std::sort(v1.begin(), v1.end());
+    std::sort(v2.begin(), v2.end());
+
+    std::vector<uint64_t> expected;
+    {
+        Date before = Date::now();
+        expected = v1;
+        size_t split = expected.size();
+        expected.insert(expected.end(), v2.begin(), v2.end());
+        std::inplace_merge(expected.begin(), expected.begin() + split,
+                           expected.end());
+        Date after = Date::now();
+        cerr << "std::inplace_merge: " << after.secondsSince(before) * 1000.0
+             << "ms" << endl;
+    }
+
+    {
+        Date before = Date::now();
+        std::vector<uint64_t> merged = parallelMerge(v1, v2);
+        Date after = Date::now();
+        cerr << "parallelMerge: " << after.secondsSince(before) * 1000.0
+             << "ms" << endl;
+        BOOST_CHECK(merged == expected);
+    }
+}
@@ -0,0 +1,149 @@
+/* parallel_sort_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Tests for the parallel radix sort and merge.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/server/parallel_merge_sort.h"
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+// Element with a key and its original position, to check stability
+struct Entry {
+    uint64_t key = 0;
+    size_t pos = 0;
+
+    bool operator == (const Entry & other) const
+    {
+        return key == other.key && pos == other.pos;
+    }
+};
+
+std::ostream & operator << (std::ostream & stream, const Entry & e)
+{
+    return stream << e.key << "@" << e.pos;
+}
+
+std::vector<Entry> makeEntries(size_t n, uint64_t mask, int seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<Entry> result(n);
+    for (size_t i = 0;  i < n;  ++i) {
+        result[i].key = rng() & mask;
+        result[i].pos = i;
+    }
+    return result;
+}
+
+void checkRadixSort(std::vector<Entry> entries, size_t threadThreshold)
+{
+    auto key = [] (const Entry & e) { return e.key; };
+
+    std::vector<Entry> expected = entries;
+    std::stable_sort(expected.begin(), expected.end(),
+                     [] (const Entry & e1, const Entry & e2)
+                     {
+                         return e1.key < e2.key;
+                     });
+
+    parallelRadixSort(entries, key, threadThreshold);
+
+    BOOST_REQUIRE_EQUAL(entries.size(), expected.size());
+    for (size_t i = 0;  i < entries.size();  ++i) {
+        if (!(entries[i] == expected[i])) {
+            BOOST_CHECK_EQUAL(entries[i], expected[i]);
+            break;
+        }
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_radix_sort )
+{
+    // Empty and trivial
+    checkRadixSort({}, 1 << 16);
+    checkRadixSort(makeEntries(1, -1, 1), 1 << 16);
+
+    for (size_t n: { 10, 255, 256, 1000, 100000, 1000000 }) {
+        // Hashes, small integers, many duplicates and high bits only
+        for (uint64_t mask: { ~0ULL, 0xffffULL, 0x7ULL, 0xff00000000000000ULL,
+                              0ULL }) {
+            checkRadixSort(makeEntries(n, mask, n), 1 << 16);
+            // Force the parallel path, even for small inputs
+            checkRadixSort(makeEntries(n, mask, n), 1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_radix_sort_integers )
+{
+    std::mt19937_64 rng(2);
+    std::vector<uint64_t> values(500000);
+    for (auto & v: values)
+        v = rng();
+    std::vector<uint64_t> expected = values;
+    std::sort(expected.begin(), expected.end());
+
+    parallelRadixSort(values, [] (uint64_t v) { return v; });
+    BOOST_CHECK(values == expected);
+}
+
+BOOST_AUTO_TEST_CASE( test_merge_path )
+{
+    std::mt19937_64 rng(3);
+    auto cmp = [] (const Entry & e1, const Entry & e2)
+        {
+            return e1.key < e2.key;
+        };
+
+    for (size_t n1: { 0, 1, 1000, 300000 }) {
+        for (size_t n2: { 0, 1, 5000, 200000 }) {
+            // Few distinct keys, so that ties between the inputs are common
+            std::vector<Entry> v1 = makeEntries(n1, 0xff, n1 + 1);
+            std::vector<Entry> v2 = makeEntries(n2, 0xff, n2 + 2);
+            for (auto & e: v2)
+                e.pos += n1;
+            std::stable_sort(v1.begin(), v1.end(), cmp);
+            std::stable_sort(v2.begin(), v2.end(), cmp);
+
+            std::vector<Entry> expected;
+            std::merge(v1.begin(), v1.end(), v2.begin(), v2.end(),
+                       std::back_inserter(expected), cmp);
+
+            // Small parts, so that there are many of them
+            std::vector<Entry> merged = parallelMerge(v1, v2, cmp, 1000);
+            BOOST_CHECK(v1.empty());
+            BOOST_CHECK(v2.empty());
+            BOOST_REQUIRE_EQUAL(merged.size(), expected.size());
+            BOOST_CHECK(merged == expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_merge_sort )
+{
+    // Enough elements for the merges to be done in parallel
+    std::mt19937_64 rng(4);
+    std::vector<std::vector<uint64_t> > range(16);
+    std::vector<uint64_t> expected;
+    for (auto & r: range) {
+        r.resize(100000);
+        for (auto & v: r)
+            v = rng() % 1000000;
+        expected.insert(expected.end(), r.begin(), r.end());
+    }
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<uint64_t> sorted = parallelMergeSort(range, std::less<uint64_t>(),
+                                                     1000 /* threadThreshold */);
+    BOOST_CHECK(sorted == expected);
+}
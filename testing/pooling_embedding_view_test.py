@@ -0,0 +1,81 @@
+#
+# pooling_embedding_view_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Check that pooling over an embedding dataset, which reads the rows of the
+# embedding directly, gives the same results as the aggregators would, for
+# single and batched application.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_WORDS = 200
+NUM_DIMS = 8
+
+
+class PoolingEmbeddingViewTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        cls.vectors = {}
+        ds = mldb.create_dataset({"id": "vectors", "type": "embedding"})
+        for i in range(NUM_WORDS):
+            word = "w%d" % i
+            vec = [random.uniform(-1, 1) for j in range(NUM_DIMS)]
+            cls.vectors[word] = vec
+            ds.record_row(word, [["x%d" % j, v, 0] for j, v in enumerate(vec)])
+        ds.commit()
+
+        mldb.put("/v1/functions/pool_all", {
+            "type": "pooling",
+            "params": {
+                "embeddingDataset": "vectors",
+                "aggregators": ["avg", "sum", "min", "max"]
+            }
+        })
+
+        cls.docs = []
+        for i in range(150):
+            words = {"w%d" % random.randrange(NUM_WORDS): 1
+                     for j in range(random.randrange(1, 30))}
+            # words which aren't in the embedding are ignored
+            words["unknown%d" % i] = 1
+            cls.docs.append(words)
+
+    def expected(self, words):
+        vecs = [self.vectors[w] for w in words if w in self.vectors]
+        cols = list(zip(*vecs))
+        return ([sum(c) / len(vecs) for c in cols]
+                + [sum(c) for c in cols]
+                + [min(c) for c in cols]
+                + [max(c) for c in cols])
+
+    def assert_close(self, result, expected):
+        self.assertEqual(len(result), len(expected))
+        for r, e in zip(result, expected):
+            self.assertAlmostEqual(r, e, places=4)
+
+    def test_apply(self):
+        for words in self.docs[:20]:
+            res = mldb.get("/v1/functions/pool_all/application",
+                           input={"words": words}).json()
+            self.assert_close(res["output"]["embedding"],
+                              self.expected(words))
+
+    def test_batch(self):
+        res = mldb.get("/v1/functions/pool_all/batch",
+                       input=[{"words": words} for words in self.docs]).json()
+        self.assertEqual(len(res), len(self.docs))
+        for output, words in zip(res, self.docs):
+            self.assert_close(output["embedding"], self.expected(words))
+
+    def test_no_known_words(self):
+        res = mldb.get("/v1/functions/pool_all/application",
+                       input={"words": {"nothing": 1}}).json()
+        self.assertEqual(res["output"]["embedding"], [0] * (4 * NUM_DIMS))
+
+if __name__ == '__main__':
+    mldb.run_tests()
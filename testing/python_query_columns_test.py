@@ -0,0 +1,119 @@
+#
+# python_query_columns_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of mldb.query_columns(), which returns the columns of a query as
+# arrays that numpy can use in place.
+#
+import ctypes
+import math
+import struct
+import unittest
+
+if False:
+    mldb_wrapper = None
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+
+def array_values(arr):
+    """Read the values of a column array through its __array_interface__,
+    as numpy would, flattened."""
+    iface = arr.__array_interface__
+    n = 1
+    for dim in iface['shape']:
+        n *= dim
+    fmt = '<%d%s' % (n, {'<f4': 'f', '<f8': 'd', '<i8': 'q'}[iface['typestr']])
+    ptr, readonly = iface['data']
+    assert readonly
+    return list(struct.unpack(fmt, ctypes.string_at(ptr,
+                                                    struct.calcsize(fmt))))
+
+
+class PythonQueryColumnsTest(MldbUnitTest): # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in range(10):
+            row = [['i', i, 0], ['s', 'v%d' % i, 0]]
+            if i % 2:
+                row.append(['x', i / 2.0, 0])
+            ds.record_row('row%d' % i, row)
+        ds.commit()
+
+    def query(self):
+        return mldb.query_columns(
+            'select i, x, s, [i, i * 2, i * 3] as e, '
+            '{i as a, s as b} as r from ds order by rowName()')
+
+    def test_row_names_and_order(self):
+        res = self.query()
+        self.assertEqual(list(res.keys()),
+                         ['_rowName', 'i', 'x', 's', 'e', 'r.a', 'r.b'])
+        self.assertEqual(res['_rowName'], ['row%d' % i for i in range(10)])
+
+    def test_int_column(self):
+        col = self.query()['i']
+        self.assertEqual(len(col), 10)
+        self.assertEqual(col.shape, (10,))
+        self.assertEqual(col.__array_interface__['typestr'], '<i8')
+        self.assertEqual(array_values(col), list(range(10)))
+
+    def test_nulls_are_nan(self):
+        col = self.query()['x']
+        self.assertEqual(col.__array_interface__['typestr'], '<f8')
+        values = array_values(col)
+        for i, v in enumerate(values):
+            if i % 2:
+                self.assertEqual(v, i / 2.0)
+            else:
+                self.assertTrue(math.isnan(v))
+
+    def test_strings_are_lists(self):
+        res = self.query()
+        self.assertEqual(res['s'], ['v%d' % i for i in range(10)])
+        self.assertEqual(res['r.b'], res['s'])
+        self.assertEqual(array_values(res['r.a']), list(range(10)))
+
+    def test_embedding(self):
+        col = self.query()['e']
+        self.assertEqual(col.shape, (10, 3))
+        values = array_values(col)
+        for i in range(10):
+            self.assertEqual(values[i * 3:i * 3 + 3], [i, i * 2, i * 3])
+
+    def test_float32_embedding(self):
+        col = mldb.query_columns(
+            "select normalize([i, 1], 2) as e from ds order by rowName()")['e']
+        self.assertEqual(col.shape, (10, 2))
+        self.assertIn(col.__array_interface__['typestr'], ['<f4', '<f8'])
+
+    def test_same_as_query(self):
+        res = self.query()
+        table = mldb.query('select i, x from ds order by rowName()')
+        cols = table[0]
+        for n, row in enumerate(table[1:]):
+            self.assertEqual(row[0], res['_rowName'][n])
+            self.assertEqual(row[cols.index('i')], array_values(res['i'])[n])
+
+    def test_shape_mismatch(self):
+        with self.assertRaises(Exception):
+            mldb.query_columns(
+                'select case when i % 2 then [1, 2] else [1, 2, 3] end as e '
+                'from ds')
+
+    def test_numpy(self):
+        try:
+            import numpy
+        except ImportError:
+            raise unittest.SkipTest('numpy is not installed')
+        res = self.query()
+        e = numpy.asarray(res['e'])
+        self.assertEqual(e.shape, (10, 3))
+        self.assertEqual(e[4].tolist(), [4, 8, 12])
+        self.assertFalse(e.flags.writeable)
+
+if __name__ == '__main__':
+    mldb.run_tests()
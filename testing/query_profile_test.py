@@ -0,0 +1,88 @@
+#
+# query_profile_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the profile returned by /v1/query?profile=true and recorded in
+# the details of procedure runs.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class QueryProfileTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(100):
+            ds.record_row('row' + str(i), [['x', i, 0], ['y', i % 7, 0]])
+        ds.commit()
+
+    def profile(self, query):
+        return mldb.get('/v1/query', q=query, profile=True).json()
+
+    def test_dataset_query(self):
+        prof = self.profile("SELECT x FROM ds WHERE y = 0")
+        self.assertEqual(prof['rowCount'], 15)
+        self.assertEqual(len(prof['elements']), 1)
+        self.assertEqual(prof['elements'][0]['element'], 'DatasetQuery')
+        self.assertEqual(prof['elements'][0]['rowsOut'], 15)
+        self.assertGreaterEqual(prof['wallTime'], 0)
+
+        # The where clause runs at least once per row
+        counts = { e['expression'] : e['evaluations']
+                   for e in prof['expressions'] }
+        self.assertGreaterEqual(counts.get('y = 0', 0), 100)
+        self.assertGreaterEqual(prof['evaluations'], 100)
+
+    def test_pipeline_query(self):
+        prof = self.profile(
+            "SELECT x FROM (SELECT x, y FROM ds) WHERE y = 0 ORDER BY x")
+        self.assertEqual(prof['rowCount'], 15)
+
+        elements = prof['elements']
+        self.assertGreater(len(elements), 1)
+        for el in elements:
+            self.assertGreaterEqual(el['numStarts'], 1)
+            self.assertGreaterEqual(el['wallTime'], el['selfWallTime'])
+            if el['source'] != -1:
+                source = elements[el['source']]
+                self.assertEqual(el['rowsIn'], source['rowsOut'])
+
+        # Somewhere the 100 rows of the subselect are filtered down to 15
+        self.assertIn(100, [el['rowsOut'] for el in elements])
+        self.assertIn(15, [el['rowsOut'] for el in elements])
+
+    def test_profile_bypasses_cache(self):
+        query = "SELECT y FROM ds WHERE y = 0"
+        mldb.get('/v1/query', q=query, cache=True)
+        prof = mldb.get('/v1/query', q=query, cache=True,
+                        profile=True).json()
+        self.assertEqual(len(prof['elements']), 1)
+        self.assertEqual(prof['elements'][0]['rowsOut'], 15)
+
+    def test_procedure_run(self):
+        mldb.put('/v1/procedures/transform', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' : 'SELECT x * 2 AS z FROM ds',
+                'outputDataset' : 'out',
+                'runOnCreation' : False
+            }
+        })
+
+        mldb.put('/v1/procedures/transform/runs/profiled',
+                 {'profile' : True})
+        details = mldb.get(
+            '/v1/procedures/transform/runs/profiled/details').json()
+        counts = { e['expression'] : e['evaluations']
+                   for e in details['profile']['expressions'] }
+        self.assertGreaterEqual(counts.get('x * 2', 0), 100)
+
+        # Without the flag, there's no profile
+        mldb.put('/v1/procedures/transform/runs/plain', {})
+        details = mldb.get(
+            '/v1/procedures/transform/runs/plain/details').json()
+        self.assertTrue(details is None or 'profile' not in details)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,124 @@
+/** query_result_cache_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the cache of query results.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/server/mldb_server.h"
+#include "mldb/rest/in_process_rest_connection.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_query_result_cache )
+{
+    MldbServer server;
+    server.init();
+    server.start();
+
+    auto createDataset = [&] (int numRows)
+        {
+            server.restDelete("/v1/datasets/ds");
+
+            Json::Value config;
+            config["type"] = "tabular";
+            auto resp = server.restPut("/v1/datasets/ds", {}, config);
+            BOOST_REQUIRE_EQUAL(resp.responseCode, 201);
+
+            for (int i = 0;  i < numRows;  ++i) {
+                Json::Value row;
+                row["rowName"] = "row" + std::to_string(i);
+                row["columns"][0][0] = "x";
+                row["columns"][0][1] = i;
+                row["columns"][0][2] = "2016-01-01T00:00:00Z";
+                row["columns"][1][0] = "y";
+                row["columns"][1][1] = "label" + std::to_string(i % 3);
+                row["columns"][1][2] = "2016-01-02T00:00:00Z";
+                resp = server.restPost("/v1/datasets/ds/rows", {}, row);
+                BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+            }
+
+            resp = server.restPost("/v1/datasets/ds/commit");
+            BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+        };
+
+    auto query = [&] (const std::string & q, bool cache)
+        {
+            auto resp = server.restGet("/v1/query",
+                                       { { "q", q },
+                                         { "cache", cache ? "true" : "false" } });
+            BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+            return Json::parse(resp.response);
+        };
+
+    auto stats = [&] ()
+        {
+            auto resp = server.restGet("/v1/queryCache");
+            BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+            return Json::parse(resp.response);
+        };
+
+    createDataset(10);
+
+    std::string q = "SELECT x, y, x * 2 AS z FROM ds WHERE x > 2 ORDER BY x";
+    Json::Value uncached = query(q, false);
+    BOOST_CHECK_EQUAL(uncached.size(), 7);
+    BOOST_CHECK_EQUAL(stats()["entries"].size(), 0);
+
+    // The first cached query fills the cache; the second is served from it
+    // with exactly the same results, including columns and timestamps
+    Json::Value first = query(q, true);
+    BOOST_CHECK_EQUAL(first, uncached);
+    Json::Value second = query("SELECT x, y, x * 2 AS z\n  FROM ds"
+                               "\n  WHERE x > 2 ORDER BY x", true);
+    BOOST_CHECK_EQUAL(second, uncached);
+
+    Json::Value s = stats();
+    BOOST_REQUIRE_EQUAL(s["entries"].size(), 1);
+    BOOST_CHECK_EQUAL(s["entries"][0]["query"].asString(), q);
+    BOOST_CHECK_EQUAL(s["entries"][0]["dataset"].asString(), "ds");
+    BOOST_CHECK_EQUAL(s["entries"][0]["rows"].asInt(), 7);
+    BOOST_CHECK_EQUAL(s["entries"][0]["hits"].asInt(), 1);
+    BOOST_CHECK_EQUAL(s["hits"].asInt(), 1);
+    BOOST_CHECK_EQUAL(s["misses"].asInt(), 1);
+
+    // Replacing the dataset means the results are recomputed
+    createDataset(20);
+    Json::Value third = query(q, true);
+    BOOST_CHECK_EQUAL(third.size(), 17);
+    s = stats();
+    BOOST_REQUIRE_EQUAL(s["entries"].size(), 1);
+    BOOST_CHECK_EQUAL(s["entries"][0]["hits"].asInt(), 0);
+    BOOST_CHECK_EQUAL(s["misses"].asInt(), 2);
+
+    // Queries on anything other than a dataset aren't cached
+    query("SELECT 1", true);
+    query("SELECT * FROM (SELECT x FROM ds)", true);
+    BOOST_CHECK_EQUAL(stats()["entries"].size(), 1);
+
+    // Nor are queries that read anything else than the dataset
+    Json::Value fnConfig;
+    fnConfig["type"] = "sql.expression";
+    fnConfig["params"]["expression"] = "x * 2 AS y";
+    auto resp = server.restPut("/v1/functions/f", {}, fnConfig);
+    BOOST_REQUIRE_EQUAL(resp.responseCode, 201);
+
+    query("SELECT x, now() AS t FROM ds", true);
+    query("SELECT x FROM ds WHERE x IN (SELECT x FROM ds WHERE x < 5)", true);
+    query("SELECT f({x}) AS y FROM ds", true);
+    query("SELECT x FROM ds ORDER BY f({x})[y]", true);
+    BOOST_CHECK_EQUAL(stats()["entries"].size(), 1);
+
+    // Builtins that only read the row still are
+    query("SELECT rowName() AS n, lower(y) AS l FROM ds", true);
+    BOOST_CHECK_EQUAL(stats()["entries"].size(), 2);
+}
@@ -0,0 +1,122 @@
+/** query_spill_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the spilling of sorted query rows to disk.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/query_spill.h"
+#include "mldb/rest/in_process_rest_connection.h"
+#include "mldb/jml/db/persistent.h"
+#include <sstream>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_expression_value_serialization )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1000);
+
+    StructValue row;
+    row.emplace_back(PathElement("x"), ExpressionValue(1, ts));
+    row.emplace_back(PathElement("a.b"), ExpressionValue("hello", ts));
+    row.emplace_back(PathElement("c"),
+                     ExpressionValue(std::vector<double>{ 1.5, 2.5, 3.5 },
+                                     ts.plusSeconds(1)));
+
+    std::vector<ExpressionValue> values = {
+        ExpressionValue::null(ts),
+        ExpressionValue(-3, ts),
+        ExpressionValue(2.5, ts),
+        ExpressionValue(Utf8String("\xc3\xa9t\xc3\xa9"), ts),
+        ExpressionValue(std::vector<CellValue>{ 1, "two", 3.0 }, ts, { 3 }),
+        ExpressionValue(std::move(row))
+    };
+
+    std::ostringstream stream;
+    {
+        ML::DB::Store_Writer store(stream);
+        for (auto & v: values)
+            serializeExpressionValue(store, v);
+    }
+
+    std::istringstream input(stream.str());
+    ML::DB::Store_Reader store(input);
+    for (auto & v: values) {
+        ExpressionValue v2 = reconstituteExpressionValue(store);
+        BOOST_CHECK_EQUAL(jsonEncodeStr(v2), jsonEncodeStr(v));
+        BOOST_CHECK_EQUAL(v2.getEffectiveTimestamp(),
+                          v.getEffectiveTimestamp());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_query_spill )
+{
+    MldbServer server;
+    server.init();
+    server.start();
+
+    Json::Value config;
+    config["type"] = "sparse.mutable";
+    auto resp = server.restPut("/v1/datasets/ds", {}, config);
+    BOOST_REQUIRE_EQUAL(resp.responseCode, 201);
+
+    for (int i = 0;  i < 2000;  ++i) {
+        Json::Value row;
+        row["rowName"] = "row" + std::to_string(i);
+        row["columns"][0][0] = "x";
+        row["columns"][0][1] = (i * 7919) % 2000;
+        row["columns"][0][2] = "2016-01-01T00:00:00Z";
+        row["columns"][1][0] = "y";
+        row["columns"][1][1] = "label" + std::to_string(i % 13);
+        row["columns"][1][2] = "2016-01-02T00:00:00Z";
+        resp = server.restPost("/v1/datasets/ds/rows", {}, row);
+        BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+    }
+
+    resp = server.restPost("/v1/datasets/ds/commit");
+    BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+
+    auto query = [&] (const std::string & q)
+        {
+            auto resp = server.restGet("/v1/query", { { "q", q } });
+            BOOST_REQUIRE_EQUAL(resp.responseCode, 200);
+            return Json::parse(resp.response);
+        };
+
+    std::vector<std::string> queries = {
+        "SELECT x, y, {x, y} AS s FROM ds ORDER BY y, x",
+        "SELECT x, y FROM ds ORDER BY x DESC OFFSET 100",
+        "SELECT DISTINCT ON (y) y, x FROM ds ORDER BY y, x DESC",
+        "SELECT y, count(*) AS c, min(x) AS m FROM ds "
+        "GROUP BY y, x % 50 ORDER BY c, m",
+        "SELECT x % 100 AS k, sum(x) AS s FROM ds "
+        "GROUP BY x % 100 ORDER BY s DESC OFFSET 3"
+    };
+
+    // Find the results with everything in memory, then again after a
+    // budget small enough that each query has to spill many runs
+    std::vector<Json::Value> inMemory;
+    for (auto & q: queries)
+        inMemory.push_back(query(q));
+
+    size_t oldBudget = setQueryMemoryBudget(10000);
+
+    for (unsigned i = 0;  i < queries.size();  ++i) {
+        uint64_t runsBefore = getQuerySpilledRuns();
+        Json::Value spilled = query(queries[i]);
+        BOOST_CHECK_GT(getQuerySpilledRuns(), runsBefore);
+        BOOST_CHECK_EQUAL(spilled, inMemory[i]);
+    }
+
+    setQueryMemoryBudget(oldBudget);
+}
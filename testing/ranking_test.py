@@ -60,5 +60,91 @@ class RankingTest(MldbUnitTest):  # noqa
         self.assertEqual(data[size][1], size - 1, str(data[size]))
         self.assertEqual(data[size][2], size - 1, str(data[size]))
 
+    def make_scores(self, name, size):
+        ds = mldb.create_dataset({'id' : name, 'type' : 'sparse.mutable'})
+        for i in range(size):
+            ds.record_row('row{}'.format(i), [['score', (i * 37) % size, 1]])
+        ds.commit()
+
+    def run_ranking(self, query, output, **kwargs):
+        params = {
+            'inputData' : query,
+            'outputDataset' : output,
+            'runOnCreation' : True
+        }
+        params.update(kwargs)
+        mldb.post('/v1/procedures', {
+            'type' : 'ranking',
+            'params' : params
+        })
+
+    def get_ranks(self, ds, output):
+        res = mldb.query("""
+            SELECT {0}.score AS score, {1}.rank AS rank
+            FROM {0} JOIN {1} ON {0}.rowName() = {1}.rowName()
+            ORDER BY score
+        """.format(ds, output))
+        return [(row[1], row[2]) for row in res[1:]]
+
+    def test_percentile(self):
+        self.make_scores('pct_ds', 10)
+        self.run_ranking('SELECT * FROM pct_ds ORDER BY score DESC',
+                         'pct_out', rankingType='percentile')
+        self.assertEqual(self.get_ranks('pct_ds', 'pct_out'),
+                         [(i, (10 - i) * 10) for i in range(10)])
+
+    def test_offset_limit(self):
+        self.make_scores('window_ds', 10)
+        self.run_ranking(
+            'SELECT * FROM window_ds ORDER BY score OFFSET 2 LIMIT 5',
+            'window_out')
+        res = mldb.query("""
+            SELECT window_ds.score AS score, window_out.rank AS rank
+            FROM window_ds JOIN window_out
+                ON window_ds.rowName() = window_out.rowName()
+            ORDER BY score
+        """)
+        self.assertEqual([(row[1], row[2]) for row in res[1:]],
+                         [(i, i - 2) for i in range(2, 7)])
+
+    def test_approximate(self):
+        size = 2000
+        self.make_scores('approx_ds', size)
+        self.run_ranking('SELECT * FROM approx_ds ORDER BY score',
+                         'approx_index', approximate=True)
+        self.run_ranking('SELECT * FROM approx_ds ORDER BY score DESC',
+                         'approx_pct', approximate=True,
+                         rankingType='percentile')
+
+        for score, rank in self.get_ranks('approx_ds', 'approx_index'):
+            self.assertLess(abs(rank - score), size * 0.01, (score, rank))
+
+        for score, rank in self.get_ranks('approx_ds', 'approx_pct'):
+            expected = 100.0 * (size - score) / size
+            self.assertLess(abs(rank - expected), 1, (score, rank))
+
+        # the timestamp is the latest of the order by values
+        res = mldb.query("SELECT latest_timestamp({*}) AS ts FROM approx_index "
+                         "LIMIT 1")
+        self.assertEqual(res[1][1], '1970-01-01T00:00:01Z')
+
+    def test_approximate_errors(self):
+        self.make_scores('approx_err_ds', 10)
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'offset or a limit'):
+            self.run_ranking(
+                'SELECT * FROM approx_err_ds ORDER BY score LIMIT 5',
+                'approx_err_out', approximate=True)
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'exactly one order by'):
+            self.run_ranking(
+                'SELECT * FROM approx_err_ds ORDER BY score, rowName()',
+                'approx_err_out', approximate=True)
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'numeric order by'):
+            self.run_ranking(
+                'SELECT * FROM approx_err_ds ORDER BY rowName()',
+                'approx_err_out', approximate=True)
+
 if __name__ == '__main__':
     mldb.run_tests()
@@ -0,0 +1,383 @@
+// This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+/* rest_latency_bench.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Open-loop load generator for the serving path of functions.  It applies
+   sql.expression, classifier and embedding.neighbors functions through the
+   REST routes of an in-process MldbServer at a fixed rate, and prints one
+   JSON object per function with its latency quantiles.
+
+   Requests are sent on a fixed schedule, whether or not the previous ones
+   have returned, and each latency is measured from the time at which its
+   request was scheduled rather than from when it was actually sent.  When
+   the server falls behind, the time that requests spend waiting to be sent
+   is counted in their latency, so the tail isn't hidden by the load
+   generator slowing down to the pace of the server (coordinated omission).
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "mldb/arch/metrics.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/core/dataset.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/http/http_rest_proxy.h"
+#include "mldb/io/port_range_service.h"
+#include "mldb/rest/in_process_rest_connection.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/types/date.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+/*****************************************************************************/
+/* SETUP                                                                     */
+/*****************************************************************************/
+
+typedef std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > Rows;
+
+static constexpr size_t EMBEDDING_WIDTH = 16;
+
+/** Perform a request to set up the benchmark, throwing if it fails. */
+void setupRequest(MldbServer & server, const std::string & verb,
+                  const std::string & resource, const Json::Value & payload)
+{
+    auto conn = server.restPerform(verb, resource, {}, payload);
+    if (conn.responseCode < 200 || conn.responseCode >= 300)
+        throw MLDB::Exception("setup request " + verb + " " + resource
+                              + " returned " + to_string(conn.responseCode)
+                              + ": " + conn.response);
+}
+
+double featureValue(size_t i, size_t j)
+{
+    return (double)((i + 1) * (j + 3) % 101) / 100.0;
+}
+
+/** Create the datasets behind the functions, and the functions. */
+void createFunctions(MldbServer & server, size_t nrows)
+{
+    PolyConfig config;
+    config.id = "bench_train";
+    config.type = "tabular";
+    auto training = obtainDataset(&server, config);
+
+    config.id = "bench_embedding";
+    config.type = "embedding";
+    auto embedding = obtainDataset(&server, config);
+
+    Rows trainingRows, embeddingRows;
+    Date ts = Date::fromSecondsSinceEpoch(0);
+    for (size_t i = 0;  i < nrows;  ++i) {
+        RowPath rowName("r" + to_string(i));
+
+        trainingRows.emplace_back(rowName, Rows::value_type::second_type());
+        double sum = 0;
+        for (size_t j = 0;  j < 4;  ++j) {
+            double v = featureValue(i, j);
+            sum += j % 2 ? -v : v;
+            trainingRows.back().second.emplace_back
+                (ColumnPath(std::string(1, char('a' + j))), v, ts);
+        }
+        trainingRows.back().second.emplace_back
+            (ColumnPath("label"), (int)(sum > 0), ts);
+
+        embeddingRows.emplace_back(rowName, Rows::value_type::second_type());
+        for (size_t j = 0;  j < EMBEDDING_WIDTH;  ++j) {
+            embeddingRows.back().second.emplace_back
+                (ColumnPath("v" + to_string(j)), featureValue(i, j), ts);
+        }
+    }
+
+    training->recordRows(trainingRows);
+    training->commit();
+    embedding->recordRows(embeddingRows);
+    embedding->commit();
+
+    Json::Value expr;
+    expr["type"] = "sql.expression";
+    expr["params"]["expression"] = "x * 2 + y AS z, x > y AS gt, "
+        "concat(label, '-', x) AS name";
+    setupRequest(server, "PUT", "/v1/functions/bench_expr", expr);
+
+    Json::Value train;
+    train["type"] = "classifier.train";
+    train["params"]["trainingData"]
+        = "SELECT {a, b, c, d} AS features, label FROM bench_train";
+    train["params"]["algorithm"] = "glz";
+    train["params"]["configuration"]["glz"]["type"] = "glz";
+    train["params"]["mode"] = "boolean";
+    train["params"]["modelFileUrl"] = "file://tmp/rest_latency_bench.cls";
+    train["params"]["functionName"] = "bench_cls";
+    train["params"]["runOnCreation"] = true;
+    setupRequest(server, "PUT", "/v1/procedures/bench_cls_train", train);
+
+    Json::Value neighbors;
+    neighbors["type"] = "embedding.neighbors";
+    neighbors["params"]["dataset"] = "bench_embedding";
+    neighbors["params"]["defaultNumNeighbors"] = 10;
+    setupRequest(server, "PUT", "/v1/functions/bench_nn", neighbors);
+}
+
+
+/*****************************************************************************/
+/* SCENARIOS                                                                 */
+/*****************************************************************************/
+
+struct Scenario {
+    std::string name;
+    std::string function;
+
+    /// Input of the i-th application of the function
+    std::function<Json::Value (size_t)> input;
+};
+
+std::vector<Scenario> scenarios()
+{
+    std::vector<Scenario> result;
+
+    result.push_back({"sql_expression", "bench_expr",
+                [] (size_t i)
+                {
+                    Json::Value input;
+                    input["x"] = (Json::Int)(i % 100);
+                    input["y"] = (Json::Int)(i % 7);
+                    input["label"] = "l" + to_string(i % 13);
+                    return input;
+                }});
+
+    result.push_back({"classifier", "bench_cls",
+                [] (size_t i)
+                {
+                    Json::Value input;
+                    for (size_t j = 0;  j < 4;  ++j) {
+                        input["features"][std::string(1, char('a' + j))]
+                            = featureValue(i * 7, j);
+                    }
+                    return input;
+                }});
+
+    result.push_back({"embedding_neighbors", "bench_nn",
+                [] (size_t i)
+                {
+                    Json::Value input;
+                    for (size_t j = 0;  j < EMBEDDING_WIDTH;  ++j)
+                        input["coords"].append(featureValue(i * 7, j));
+                    return input;
+                }});
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* LOAD GENERATION                                                           */
+/*****************************************************************************/
+
+struct LoadResult {
+    MetricHistogram latency;   ///< From scheduled time, in nanoseconds
+    MetricHistogram service;   ///< From actual send time, in nanoseconds
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> late{0};   ///< Requests sent after their time
+    double elapsed = 0.0;
+};
+
+/** Apply the function of the scenario qps times per second for the given
+    number of seconds, from the given number of worker threads.  Only the
+    requests scheduled after the warmup are recorded.
+
+    The i-th request is scheduled at start + i / qps.  A worker that is
+    free takes the next request and waits for its time; if all of the
+    workers are busy, requests are sent late and their latency includes
+    how late they were.
+*/
+void runLoad(const Scenario & scenario,
+             const std::function<int (const std::string &, const RestParams &)> & send,
+             double qps, double seconds, double warmup, int numWorkers,
+             LoadResult & result)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    uint64_t numWarmup = warmup * qps;
+    uint64_t numRequests = numWarmup + uint64_t(seconds * qps);
+    std::chrono::nanoseconds interval((int64_t)(1e9 / qps));
+    std::string resource = "/v1/functions/" + scenario.function + "/application";
+
+    std::atomic<uint64_t> next(0);
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(10);
+
+    auto work = [&] ()
+        {
+            for (;;) {
+                uint64_t i = next.fetch_add(1);
+                if (i >= numRequests)
+                    return;
+
+                RestParams params;
+                params.emplace_back("input",
+                                    scenario.input(i).toStringNoNewLine());
+
+                Clock::time_point scheduled = start + (int64_t)i * interval;
+                std::this_thread::sleep_until(scheduled);
+                Clock::time_point sent = Clock::now();
+
+                int code = send(resource, params);
+
+                if (i < numWarmup)
+                    continue;
+
+                result.latency.recordSince(scheduled);
+                result.service.recordSince(sent);
+                if (code != 200)
+                    result.errors.fetch_add(1);
+                if (sent - scheduled > interval)
+                    result.late.fetch_add(1);
+            }
+        };
+
+    std::vector<std::thread> workers;
+    for (int i = 0;  i < numWorkers;  ++i)
+        workers.emplace_back(work);
+    for (auto & t: workers)
+        t.join();
+
+    result.elapsed
+        = std::chrono::duration<double>(Clock::now() - start).count() - warmup;
+}
+
+Json::Value quantiles(const MetricHistogram & histogram)
+{
+    auto snapshot = histogram.snapshot();
+    Json::Value result;
+    result["p50"] = snapshot.quantile(0.5) / 1e6;
+    result["p90"] = snapshot.quantile(0.9) / 1e6;
+    result["p99"] = snapshot.quantile(0.99) / 1e6;
+    result["p999"] = snapshot.quantile(0.999) / 1e6;
+    result["max"] = snapshot.quantile(1.0) / 1e6;
+    result["mean"] = snapshot.count ? snapshot.sum / 1e6 / snapshot.count : 0.0;
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MAIN                                                                      */
+/*****************************************************************************/
+
+int
+main(int argc, char * argv[])
+{
+    using namespace boost::program_options;
+    size_t nrows = 10000;
+    double qps = 1000;
+    double seconds = 10;
+    double warmup = 1;
+    int numWorkers = 32;
+    std::string transport = "inprocess";
+    std::string filter;
+
+    options_description all_opt;
+    all_opt.add_options()
+        ("rows,r", value(&nrows),
+         "Number of rows in the datasets behind the functions (10000)")
+        ("qps,q", value(&qps),
+         "Number of requests per second to send (1000)")
+        ("seconds,s", value(&seconds),
+         "Number of seconds to measure for each function (10)")
+        ("warmup,w", value(&warmup),
+         "Number of seconds to send requests before measuring (1)")
+        ("workers,c", value(&numWorkers),
+         "Maximum number of requests in flight (32)")
+        ("transport,t", value(&transport),
+         "inprocess to call the REST router directly, or http to go "
+         "through a socket (inprocess)")
+        ("filter,f", value(&filter),
+         "Only run functions whose name contains this string")
+        ("help,H", "show help");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv)
+          .options(all_opt)
+          .run(),
+          vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << all_opt << endl;
+        return 1;
+    }
+
+    ExcAssert(nrows > 0);
+    ExcAssertGreater(qps, 0);
+    ExcAssertGreater(seconds, 0);
+    ExcAssertGreater(numWorkers, 0);
+    if (transport != "inprocess" && transport != "http")
+        throw MLDB::Exception("transport must be inprocess or http");
+
+    MldbServer server;
+    server.init();
+
+    std::string address;
+    if (transport == "http")
+        address = server.bindTcp(PortRange(17000, 18000), "127.0.0.1");
+    server.start();
+
+    Date setupStart = Date::now();
+    createFunctions(server, nrows);
+    cerr << "created functions over " << nrows << " rows in "
+         << Date::now().secondsSince(setupStart) << endl;
+
+    // Each thread of the http transport keeps its own connection
+    auto send = [&] (const std::string & resource, const RestParams & params)
+        -> int
+        {
+            if (transport == "inprocess")
+                return server.restGet(resource, params).responseCode;
+
+            thread_local std::unique_ptr<HttpRestProxy> proxy;
+            if (!proxy)
+                proxy.reset(new HttpRestProxy(address));
+            return proxy->get(resource, params, {}, -1, false).code();
+        };
+
+    for (auto & scenario: scenarios()) {
+        if (!filter.empty() && scenario.name.find(filter) == std::string::npos)
+            continue;
+
+        LoadResult load;
+        runLoad(scenario, send, qps, seconds, warmup, numWorkers, load);
+
+        uint64_t count = load.latency.snapshot().count;
+
+        Json::Value result;
+        result["name"] = scenario.name;
+        result["transport"] = transport;
+        result["targetQps"] = qps;
+        result["achievedQps"] = count / load.elapsed;
+        result["requests"] = (Json::UInt)count;
+        result["errors"] = (Json::UInt)load.errors.load();
+        result["lateRequests"] = (Json::UInt)load.late.load();
+        result["latencyMs"] = quantiles(load.latency);
+        result["serviceTimeMs"] = quantiles(load.service);
+
+        cout << result.toStringNoNewLine() << endl;
+    }
+
+    server.shutdown();
+}
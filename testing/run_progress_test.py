@@ -0,0 +1,89 @@
+#
+# run_progress_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the throughput and stage telemetry of procedure runs.
+#
+
+import os
+import tempfile
+import time
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class RunProgressTest(MldbUnitTest):  # noqa
+
+    def test_import_text_telemetry(self):
+        tmp_file = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp')
+        tmp_file.write('a,b,c\n')
+        for i in xrange(200000):
+            tmp_file.write('{},{},{}\n'.format(i, i * 10, i / 2))
+        tmp_file.flush()
+        size = os.path.getsize(tmp_file.name)
+
+        mldb.put('/v1/procedures/import_telemetry', {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : 'file://' + tmp_file.name,
+                'outputDataset' : { 'id' : 'ds', 'type' : 'tabular' }
+            }
+        })
+        location = mldb.post_async('/v1/procedures/import_telemetry/runs') \
+            .headers['Location']
+
+        seen = []
+        res = mldb.get(location).json()
+        while res['state'] != 'finished':
+            telemetry = res.get('progress', {}).get('telemetry')
+            if res['state'] == 'executing' and telemetry:
+                seen.append(telemetry)
+            time.sleep(0.001)
+            res = mldb.get(location).json()
+
+        self.assertGreater(len(seen), 0)
+        prev_rows = 0
+        for t in seen:
+            self.assertGreaterEqual(t['rows'], prev_rows)
+            prev_rows = t['rows']
+            self.assertEqual(t['expectedBytes'], size)
+            self.assertLessEqual(t['percent'], 100)
+            self.assertGreaterEqual(t['rowsPerSecond'], 0)
+            self.assertIn(t['stages'][0]['name'], ['import'])
+            for stage in t['stages']:
+                self.assertGreaterEqual(stage['cpuSeconds'], 0)
+                self.assertGreaterEqual(stage['seconds'], 0)
+            # Only the last stage is still running
+            for stage in t['stages'][:-1]:
+                self.assertTrue(stage['finished'])
+
+    def test_transform_stages(self):
+        ds = mldb.create_dataset({'id' : 'input', 'type' : 'sparse.mutable'})
+        for i in xrange(1000):
+            ds.record_row(str(i), [['x', i, 0]])
+        ds.commit()
+
+        mldb.put('/v1/procedures/transform_telemetry', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' : 'SELECT x * 2 AS y FROM input',
+                'outputDataset' : { 'id' : 'output', 'type' : 'tabular' }
+            }
+        })
+        location = mldb.post_async(
+            '/v1/procedures/transform_telemetry/runs').headers['Location']
+
+        res = mldb.get(location).json()
+        while res['state'] != 'finished':
+            telemetry = res.get('progress', {}).get('telemetry')
+            if res['state'] == 'executing' and telemetry:
+                self.assertIn(telemetry.get('stage'),
+                              [None, 'transform', 'commit'])
+            time.sleep(0.001)
+            res = mldb.get(location).json()
+
+        self.assertEqual(
+            mldb.get('/v1/query', q='SELECT count(*) AS c FROM output',
+                     format='aos').json()[0]['c'], 1000)
+
+if __name__ == '__main__':
+    mldb.run_tests()
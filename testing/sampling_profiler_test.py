@@ -0,0 +1,36 @@
+#
+# sampling_profiler_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of POST /v1/profiler.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class SamplingProfilerTest(MldbUnitTest):  # noqa
+
+    def test_json(self):
+        res = mldb.post('/v1/profiler', {'seconds' : 0.5,
+                                         'frequency' : 500,
+                                         'format' : 'json'}).json()
+        self.assertGreaterEqual(res['numSamples'], 0)
+        self.assertEqual(res['numDropped'], 0)
+        self.assertEqual(sum(s['count'] for s in res['stacks']),
+                         res['numSamples'])
+        for s in res['stacks']:
+            self.assertGreater(len(s['stack'].split(';')), 1)
+
+    def test_folded(self):
+        res = mldb.post('/v1/profiler', {'seconds' : 0.2})
+        for line in res.text.splitlines():
+            stack, count = line.rsplit(' ', 1)
+            self.assertGreater(int(count), 0)
+
+    def test_bad_arguments(self):
+        with self.assertMldbRaises(status_code=400):
+            mldb.post('/v1/profiler', {'seconds' : 0})
+        with self.assertMldbRaises(status_code=400):
+            mldb.post('/v1/profiler', {'seconds' : 0.1, 'format' : 'svg'})
+
+if __name__ == '__main__':
+    mldb.run_tests()
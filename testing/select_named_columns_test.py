@@ -0,0 +1,55 @@
+#
+# select_named_columns_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that selects where every clause is "x AS y" give the same rows as
+# the generic select path.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class SelectNamedColumnsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({"id": "ds", "type": "sparse.mutable"})
+        for i in range(10):
+            ds.record_row("row%d" % i, [["a", i, 0], ["b", "s%d" % i, 1]])
+        ds.commit()
+
+    def test_sorted_output(self):
+        res = mldb.query("SELECT b AS z, a AS y, a + 1 AS x FROM ds "
+                         "WHERE rowName() = 'row3'")
+        self.assertEqual(res, [["_rowName", "x", "y", "z"],
+                               ["row3", 4, 3, "s3"]])
+
+    def test_matches_generic_path(self):
+        # The star forces the generic path; the rows must be the same
+        named = mldb.query("SELECT a AS a, b AS b FROM ds ORDER BY rowName()")
+        generic = mldb.query("SELECT * FROM ds ORDER BY rowName()")
+        self.assertEqual(named, generic)
+
+    def test_duplicate_names(self):
+        res = mldb.query("SELECT a AS x, b AS x FROM ds "
+                         "WHERE rowName() = 'row1'")
+        expected = mldb.query("SELECT a AS x, b AS x, {} AS * FROM ds "
+                              "WHERE rowName() = 'row1'")
+        self.assertEqual(res, expected)
+
+    def test_nested_names(self):
+        res = mldb.query("SELECT a AS x.y, b AS x.z FROM ds "
+                         "WHERE rowName() = 'row2'")
+        self.assertEqual(res, [["_rowName", "x.y", "x.z"],
+                               ["row2", 2, "s2"]])
+
+    def test_timestamps(self):
+        res = mldb.get("/v1/query",
+                       q="SELECT a AS a, b AS b FROM ds "
+                         "WHERE rowName() = 'row0'",
+                       format="full").json()
+        generic = mldb.get("/v1/query",
+                           q="SELECT * FROM ds WHERE rowName() = 'row0'",
+                           format="full").json()
+        self.assertEqual(res, generic)
+
+mldb.run_tests()
@@ -0,0 +1,151 @@
+#
+# sharded_dataset_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the sharded dataset, comparing the results of queries run on its
+# shards with those of the same queries on a single dataset.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 300
+
+
+class ShardedDatasetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        port = mldb.get_http_bound_address().split(':')[-1]
+        shards = []
+        for i in range(3):
+            mldb.create_dataset({'id': 'shard%d' % i,
+                                 'type': 'sparse.mutable'})
+            shards.append('shard%d' % i)
+
+        # One of the shards goes through the HTTP interface, as it would
+        # on another server
+        mldb.create_dataset({'id': 'remote_shard', 'type': 'sparse.mutable'})
+        shards.append('http://localhost:%s/v1/datasets/remote_shard' % port)
+
+        sharded = mldb.create_dataset({
+            'id': 'sharded', 'type': 'sharded',
+            'params': {'shards': shards}})
+        single = mldb.create_dataset({'id': 'single',
+                                      'type': 'sparse.mutable'})
+
+        random.seed(1)
+        for i in range(NUM_ROWS):
+            cols = [['x', i % 7, 0], ['y', random.random(), 0],
+                    ['label', 'abc'[i % 3], 0]]
+            if i % 5:
+                cols.append(['z', i, 0])
+            sharded.record_row('r%d' % i, cols)
+            single.record_row('r%d' % i, cols)
+        sharded.commit()
+        single.commit()
+
+    def run_query(self, query, dataset):
+        return mldb.get('/v1/query', q=query % dataset, format='aos',
+                        rowNames=True).json()
+
+    def assertSameValues(self, res, expected):
+        if isinstance(expected, float):
+            self.assertAlmostEqual(res, expected, places=9)
+        elif isinstance(expected, dict):
+            self.assertEqual(sorted(res), sorted(expected))
+            for k in expected:
+                self.assertSameValues(res[k], expected[k])
+        elif isinstance(expected, list):
+            self.assertEqual(len(res), len(expected))
+            for r, e in zip(res, expected):
+                self.assertSameValues(r, e)
+        else:
+            self.assertEqual(res, expected)
+
+    def check(self, query, ordered=True):
+        res = self.run_query(query, 'sharded')
+        expected = self.run_query(query, 'single')
+        self.assertNotEqual(len(expected), 0)
+        if not ordered:
+            res.sort(key=lambda r: r['_rowName'])
+            expected.sort(key=lambda r: r['_rowName'])
+        self.assertSameValues(res, expected)
+
+    def test_partitioned(self):
+        counts = [mldb.query('SELECT count(*) FROM %s' % ds)[1][1]
+                  for ds in ['shard0', 'shard1', 'shard2', 'remote_shard']]
+        self.assertEqual(sum(counts), NUM_ROWS)
+        for c in counts:
+            self.assertGreater(c, 0)
+
+    def test_select_where(self):
+        self.check('SELECT * FROM %s', ordered=False)
+        self.check('SELECT x, z * 2 AS z2 FROM %s WHERE label = \'b\'',
+                   ordered=False)
+
+    def test_order_by_limit(self):
+        self.check('SELECT x, y FROM %s WHERE x > 3 '
+                   'ORDER BY y DESC LIMIT 10 OFFSET 5')
+        self.check('SELECT * FROM %s ORDER BY x, z LIMIT 20')
+        self.check('SELECT y NAMED label + rowName() FROM %s '
+                   'ORDER BY rowName() LIMIT 7')
+
+    def test_group_by(self):
+        self.check('SELECT x, count(*) AS n, sum(y) AS s, min(z), max(z), '
+                   'avg(y) AS a FROM %s GROUP BY x ORDER BY x')
+        self.check('SELECT label, count(z) AS n FROM %s WHERE x != 2 '
+                   'GROUP BY label HAVING count(*) > 60 '
+                   'ORDER BY count(*) DESC')
+        self.check('SELECT x + 1 AS k, sum(y) * 2 AS s FROM %s '
+                   'GROUP BY x + 1 ORDER BY sum(y) LIMIT 3 OFFSET 1')
+        self.check('SELECT label, x, max(y) FROM %s GROUP BY label, x',
+                   ordered=False)
+
+    def test_aggregate_without_group_by(self):
+        self.check('SELECT count(*) AS n, avg(z) AS a, min(y) FROM %s')
+
+    def test_run_here(self):
+        # These can't be run on the shards, but still give the same result
+        self.check('SELECT x, count_distinct(label) AS n FROM %s '
+                   'GROUP BY x ORDER BY x')
+        self.check('SELECT x AS w FROM %s ORDER BY w, rowName() LIMIT 5')
+        self.check('SELECT * FROM %s AS s JOIN single AS t '
+                   'ON s.rowName() = t.rowName() AND s.x = 3', ordered=False)
+
+    def test_record_after_commit(self):
+        for i in range(2):
+            mldb.create_dataset({'id': 'extra%d' % i,
+                                 'type': 'sparse.mutable'})
+        ds = mldb.create_dataset({
+            'id': 'sharded_extra', 'type': 'sharded',
+            'params': {'shards': ['extra0', 'extra1']}})
+
+        # count_distinct() is run here, over a copy of the rows which is
+        # taken again after each commit
+        query = 'SELECT count_distinct(x) FROM sharded_extra'
+        for i in range(10):
+            ds.record_row('r%d' % i, [['x', i, 0]])
+        ds.commit()
+        self.assertEqual(mldb.query(query)[1][1], 10)
+
+        for i in range(10, 15):
+            ds.record_row('r%d' % i, [['x', i, 0]])
+        ds.commit()
+        self.assertEqual(mldb.query(query)[1][1], 15)
+
+    def test_bad_params(self):
+        msg = "Remote shard URI must be of the form"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.create_dataset({
+                'id': 'bad', 'type': 'sharded',
+                'params': {'shards': ['http://localhost:1234/v1/ds']}})
+
+        msg = "at least one shard"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.create_dataset({
+                'id': 'bad', 'type': 'sharded', 'params': {'shards': []}})
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,129 @@
+/* sparse_mutable_frozen_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test that the compressed representation of committed data in the
+   sparse.mutable dataset returns what was recorded, including when new
+   commits are merged into it.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/sparse_matrix_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/types/date.h"
+#include <map>
+
+using namespace std;
+
+using namespace MLDB;
+
+typedef std::vector<std::tuple<ColumnPath, CellValue, Date> > Row;
+
+void testFrozen(MutableSparseMatrixDatasetConfig config)
+{
+    MldbServer server;
+    server.init();
+
+    PolyConfig pconfig;
+    pconfig.params = config;
+    MutableSparseMatrixDataset dataset(&server, pconfig, nullptr);
+
+    Date ts = Date::fromSecondsSinceEpoch(1000000);
+
+    std::map<RowPath, Row> recorded;
+
+    auto record = [&] (int i, int commit)
+        {
+            RowPath rowName(PathElement("row" + std::to_string(i)));
+            Row row;
+            row.emplace_back(PathElement("int"), i, ts);
+            row.emplace_back(PathElement("commit"), commit,
+                             ts.plusSeconds(commit));
+            if (i % 3 == 0)
+                row.emplace_back(PathElement("float"), i / 3.0, ts);
+            if (i % 5 == 0)
+                row.emplace_back(PathElement("str"),
+                                 "string number " + std::to_string(i), ts);
+            if (i % 7 == 0)
+                row.emplace_back(PathElement("short"), "ab", ts);
+            if (i % 11 == 0)
+                row.emplace_back(PathElement("neg"), -i, ts);
+            dataset.recordRow(rowName, row);
+            auto & r = recorded[rowName];
+            r.insert(r.end(), row.begin(), row.end());
+        };
+
+    // Several commits, some rows of which are recorded again in later ones
+    for (int commit = 0;  commit < 4;  ++commit) {
+        for (int i = commit * 500;  i < commit * 500 + 1000;  ++i)
+            record(i, commit);
+        dataset.commit();
+
+        auto matrix = dataset.getMatrixView();
+        auto index = dataset.getColumnIndex();
+
+        BOOST_REQUIRE_EQUAL(matrix->getRowCount(), recorded.size());
+
+        auto rowPaths = matrix->getRowPaths();
+        BOOST_REQUIRE_EQUAL(rowPaths.size(), recorded.size());
+        BOOST_CHECK_EQUAL(matrix->getRowPaths(10, 5).at(0), rowPaths.at(10));
+
+        // Rows in the right order, which is the same as the row stream
+        auto stream = dataset.getRowStream();
+        BOOST_REQUIRE(stream);
+        stream->initAt(0);
+        for (auto & rowPath: rowPaths) {
+            BOOST_CHECK_EQUAL(stream->next(), rowPath);
+        }
+
+        for (auto & r: recorded) {
+            BOOST_REQUIRE(matrix->knownRow(r.first));
+            MatrixNamedRow row = matrix->getRow(r.first);
+            BOOST_REQUIRE_EQUAL(row.columns.size(), r.second.size());
+            for (unsigned i = 0;  i < row.columns.size();  ++i) {
+                BOOST_CHECK_EQUAL(std::get<0>(row.columns[i]),
+                                  std::get<0>(r.second[i]));
+                BOOST_CHECK_EQUAL(std::get<1>(row.columns[i]),
+                                  std::get<1>(r.second[i]));
+                BOOST_CHECK_EQUAL(std::get<2>(row.columns[i]),
+                                  std::get<2>(r.second[i]));
+            }
+        }
+
+        BOOST_CHECK(!matrix->knownRow(RowPath(PathElement("unknown"))));
+
+        // Columns in other direction
+        ColumnPath str(PathElement("str"));
+        MatrixColumn column = index->getColumn(str);
+        size_t numStr = 0;
+        for (auto & r: recorded) {
+            for (auto & c: r.second)
+                numStr += std::get<0>(c) == str;
+        }
+        BOOST_CHECK_EQUAL(column.rows.size(), numStr);
+        for (auto & r: column.rows) {
+            BOOST_CHECK_EQUAL(std::get<1>(r).toString(),
+                              "string number "
+                              + std::get<0>(r).toUtf8String().rawString().substr(3));
+        }
+
+        BOOST_CHECK_EQUAL(index->getColumnPaths().size(), 6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_frozen_read_after_commit )
+{
+    MutableSparseMatrixDatasetConfig config;
+    config.consistencyLevel = WT_READ_AFTER_COMMIT;
+    testFrozen(config);
+}
+
+BOOST_AUTO_TEST_CASE( test_frozen_read_after_write )
+{
+    MutableSparseMatrixDatasetConfig config;
+    config.consistencyLevel = WT_READ_AFTER_WRITE;
+    config.favor = TF_FAVOR_READS;
+    testFrozen(config);
+}
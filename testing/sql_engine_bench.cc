@@ -0,0 +1,351 @@
+// This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+/* sql_engine_bench.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Benchmark utility for the hot paths of the SQL query engine.  It
+   generates synthetic tabular, sparse and embedding datasets, runs a fixed
+   set of queries against them and prints one JSON object per query with
+   its throughput and allocation count, so that runs can be compared.
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "mldb/arch/timers.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/core/dataset.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/types/date.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+/*****************************************************************************/
+/* ALLOCATION COUNTING                                                       */
+/*****************************************************************************/
+
+/* The global allocation functions are replaced so that each query can
+   report how many heap allocations it performed.  This is only done in
+   this binary.
+*/
+
+namespace {
+
+std::atomic<uint64_t> numAllocations(0);
+std::atomic<uint64_t> bytesAllocated(0);
+
+} // file scope
+
+void * operator new (std::size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    bytesAllocated.fetch_add(size, std::memory_order_relaxed);
+    void * result = std::malloc(size ? size : 1);
+    if (!result)
+        throw std::bad_alloc();
+    return result;
+}
+
+void * operator new[] (std::size_t size)
+{
+    return operator new (size);
+}
+
+void operator delete (void * ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[] (void * ptr) noexcept
+{
+    std::free(ptr);
+}
+
+
+/*****************************************************************************/
+/* DATASET GENERATION                                                        */
+/*****************************************************************************/
+
+namespace {
+
+typedef std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > Rows;
+
+/** Create a dataset of the given type and fill it with nrows rows
+    produced by the generator, recording in batches.
+*/
+void createBenchDataset(MldbServer & server,
+                        const std::string & id,
+                        const std::string & type,
+                        size_t nrows,
+                        const std::function<void (size_t, Rows::value_type &)> & gen)
+{
+    PolyConfig config;
+    config.id = id;
+    config.type = type;
+
+    auto dataset = obtainDataset(&server, config);
+
+    static constexpr size_t BATCH_SIZE = 10000;
+    Rows rows;
+    for (size_t i = 0;  i < nrows;  ++i) {
+        rows.emplace_back();
+        gen(i, rows.back());
+        if (rows.size() == BATCH_SIZE) {
+            dataset->recordRows(rows);
+            rows.clear();
+        }
+    }
+    if (!rows.empty())
+        dataset->recordRows(rows);
+
+    dataset->commit();
+}
+
+void createDatasets(MldbServer & server, size_t nrows)
+{
+    static const char * const labels[] = { "alpha", "beta", "gamma", "delta" };
+
+    // Dense, regular data with a low cardinality key for grouping and
+    // a unique key for joins
+    auto genTabular = [&] (size_t i, Rows::value_type & row)
+        {
+            Date ts = Date::fromSecondsSinceEpoch(i);
+            row.first = RowPath("r" + to_string(i));
+            auto & cols = row.second;
+            cols.emplace_back(ColumnPath("id"), (int64_t)i, ts);
+            cols.emplace_back(ColumnPath("k"), (int64_t)(i % 100), ts);
+            cols.emplace_back(ColumnPath("x"), (double)((i * 7919) % 10007), ts);
+            cols.emplace_back(ColumnPath("y"), (double)(i % 13) / 4.0 - 1.0, ts);
+            cols.emplace_back(ColumnPath("label"), labels[i % 4], ts);
+        };
+
+    createBenchDataset(server, "bench_tabular", "tabular", nrows, genTabular);
+    createBenchDataset(server, "bench_tabular_right", "tabular",
+                       nrows / 10 + 1, genTabular);
+
+    // Sparse data where each row has a handful of a large set of columns
+    auto genSparse = [&] (size_t i, Rows::value_type & row)
+        {
+            Date ts = Date::fromSecondsSinceEpoch(i);
+            row.first = RowPath("r" + to_string(i));
+            auto & cols = row.second;
+            cols.emplace_back(ColumnPath("k"), (int64_t)(i % 100), ts);
+            for (size_t j = 0;  j < 5;  ++j) {
+                size_t c = (i * 31 + j * 977) % 500;
+                cols.emplace_back(ColumnPath("c" + to_string(c)),
+                                  (double)(i % (j + 2)), ts);
+            }
+        };
+
+    createBenchDataset(server, "bench_sparse", "sparse.mutable", nrows,
+                       genSparse);
+
+    // Fixed width numeric vectors
+    static constexpr size_t EMBEDDING_WIDTH = 16;
+    auto genEmbedding = [&] (size_t i, Rows::value_type & row)
+        {
+            row.first = RowPath("r" + to_string(i));
+            auto & cols = row.second;
+            for (size_t j = 0;  j < EMBEDDING_WIDTH;  ++j) {
+                cols.emplace_back(ColumnPath("v" + to_string(j)),
+                                  (double)((i + 1) * (j + 3) % 101) / 100.0,
+                                  Date::notADate());
+            }
+        };
+
+    createBenchDataset(server, "bench_embedding", "embedding", nrows,
+                       genEmbedding);
+}
+
+
+/*****************************************************************************/
+/* QUERIES                                                                   */
+/*****************************************************************************/
+
+struct BenchQuery {
+    std::string name;
+    std::string query;
+    size_t rowsScanned;
+};
+
+std::vector<BenchQuery> benchQueries(size_t nrows)
+{
+    std::vector<BenchQuery> result;
+
+    result.push_back({"scan_filter_tabular",
+                "SELECT x FROM bench_tabular WHERE x > 5000 AND y < 0.5",
+                nrows});
+    result.push_back({"scan_filter_sparse",
+                "SELECT * FROM bench_sparse WHERE k < 10",
+                nrows});
+    result.push_back({"scan_filter_embedding",
+                "SELECT v0 FROM bench_embedding WHERE v0 > 0.5",
+                nrows});
+
+    static const char * const aggregators[] = {
+        "avg(x)", "sum(x)", "min(x)", "max(x)", "count(x)",
+        "count_distinct(x)", "string_agg(label, ',')", "earliest(x)",
+        "latest(x)", "variance(x)", "stddev(x)"
+    };
+
+    for (auto & agg: aggregators) {
+        std::string name = agg;
+        name = "group_by_" + name.substr(0, name.find('('));
+        result.push_back({name,
+                    "SELECT k, " + std::string(agg)
+                    + " AS v FROM bench_tabular GROUP BY k",
+                    nrows});
+    }
+
+    result.push_back({"group_by_sparse",
+                "SELECT k, count(*) AS v FROM bench_sparse GROUP BY k",
+                nrows});
+
+    result.push_back({"order_by_limit",
+                "SELECT x FROM bench_tabular ORDER BY x DESC LIMIT 100",
+                nrows});
+    result.push_back({"order_by_limit_offset",
+                "SELECT x FROM bench_tabular ORDER BY y, x "
+                "LIMIT 100 OFFSET 1000",
+                nrows});
+
+    size_t nright = nrows / 10 + 1;
+    result.push_back({"inner_join",
+                "SELECT a.x, b.y FROM bench_tabular AS a "
+                "JOIN bench_tabular_right AS b ON a.id = b.id",
+                nrows + nright});
+    result.push_back({"left_join",
+                "SELECT a.x, b.y FROM bench_tabular AS a "
+                "LEFT JOIN bench_tabular_right AS b ON a.id = b.id",
+                nrows + nright});
+    result.push_back({"join_group_by",
+                "SELECT a.k, count(*) AS n FROM bench_tabular AS a "
+                "JOIN bench_tabular_right AS b ON a.k = b.k "
+                "WHERE b.id < 1000 GROUP BY a.k",
+                nrows + nright});
+
+    static const char * const horizontals[] = {
+        "horizontal_count", "horizontal_sum", "horizontal_avg",
+        "horizontal_min", "horizontal_max", "horizontal_earliest",
+        "horizontal_latest"
+    };
+
+    for (auto & fn: horizontals) {
+        result.push_back({fn,
+                    "SELECT " + std::string(fn)
+                    + "({*}) AS v FROM bench_embedding",
+                    nrows});
+    }
+
+    result.push_back({"horizontal_string_agg",
+                "SELECT horizontal_string_agg({label, x}, ',') AS v "
+                "FROM bench_tabular",
+                nrows});
+
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MAIN                                                                      */
+/*****************************************************************************/
+
+int
+main(int argc, char * argv[])
+{
+    using namespace boost::program_options;
+    size_t nrows = 100000;
+    unsigned int iterations = 3;
+    std::string filter;
+
+    options_description all_opt;
+    all_opt.add_options()
+        ("rows,r", value(&nrows),
+         "Number of rows in the generated datasets (100000)")
+        ("iterations,i", value(&iterations),
+         "Number of times each query is run (3)")
+        ("filter,f", value(&filter),
+         "Only run queries whose name contains this string")
+        ("help,H", "show help");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv)
+          .options(all_opt)
+          .run(),
+          vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << all_opt << endl;
+        return 1;
+    }
+
+    ExcAssert(nrows > 0);
+    ExcAssert(iterations > 0);
+
+    MldbServer server;
+    server.init();
+
+    Timer setupTimer;
+    createDatasets(server, nrows);
+    cerr << "generated datasets with " << nrows << " rows in "
+         << setupTimer.elapsed() << endl;
+
+    for (auto & q: benchQueries(nrows)) {
+        if (!filter.empty() && q.name.find(filter) == std::string::npos)
+            continue;
+
+        // Warm up caches (and indexes built lazily by the datasets)
+        size_t rowsOutput = server.query(q.query).size();
+
+        double bestWall = INFINITY;
+        double totalWall = 0.0, totalCpu = 0.0;
+        uint64_t allocs = 0, bytes = 0;
+
+        for (unsigned i = 0;  i < iterations;  ++i) {
+            uint64_t allocsBefore = numAllocations.load();
+            uint64_t bytesBefore = bytesAllocated.load();
+            Timer timer;
+            rowsOutput = server.query(q.query).size();
+            double wall = timer.elapsed_wall();
+            totalCpu += timer.elapsed_cpu();
+            allocs += numAllocations.load() - allocsBefore;
+            bytes += bytesAllocated.load() - bytesBefore;
+            totalWall += wall;
+            bestWall = std::min(bestWall, wall);
+        }
+
+        Json::Value result;
+        result["name"] = q.name;
+        result["query"] = q.query;
+        result["iterations"] = iterations;
+        result["rowsScanned"] = (Json::UInt)q.rowsScanned;
+        result["rowsOutput"] = (Json::UInt)rowsOutput;
+        result["bestSeconds"] = bestWall;
+        result["meanSeconds"] = totalWall / iterations;
+        result["meanCpuSeconds"] = totalCpu / iterations;
+        result["rowsPerSecond"] = q.rowsScanned / bestWall;
+        result["allocationsPerQuery"] = (Json::UInt)(allocs / iterations);
+        result["bytesAllocatedPerQuery"] = (Json::UInt)(bytes / iterations);
+        result["allocationsPerRow"] = (double)allocs / iterations / q.rowsScanned;
+
+        cout << result.toStringNoNewLine() << endl;
+    }
+
+    server.shutdown();
+}
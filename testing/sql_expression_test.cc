@@ -9,6 +9,7 @@
 
 #include "mldb/sql/sql_expression.h"
 #include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/sql_batch_program.h"
 #include "mldb/arch/exception_handler.h"
 #include "server/dataset_context.h"
 #include "mldb/types/value_description.h"
@@ -1270,6 +1271,155 @@ BOOST_AUTO_TEST_CASE(test_colon_as)
     cerr << parsed.print() << endl;
 }
 
+// Counts how many times each column is read
+struct CountingBindingContext: public TestBindingContext {
+    std::shared_ptr<std::map<ColumnPath, int> > reads
+        = std::make_shared<std::map<ColumnPath, int> >();
+
+    ColumnGetter doGetColumn(const Utf8String & tableName,
+                             const ColumnPath & columnName)
+    {
+        auto getter = TestBindingContext::doGetColumn(tableName, columnName);
+        auto reads = this->reads;
+        return {[=] (const SqlRowScope & context,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter) -> const ExpressionValue &
+                {
+                    (*reads)[columnName] += 1;
+                    return getter(context, storage, filter);
+                },
+                getter.info};
+    }
+};
+
+BOOST_AUTO_TEST_CASE(test_bind_optimizations)
+{
+    CountingBindingContext context;
+    auto row = createRow({ { "x", 3 } });
+
+    auto run = [&] (const std::string & surface)
+        {
+            context.reads->clear();
+            auto bound = SqlExpression::parse(surface)->bind(context);
+            return bound(row, GET_LATEST);
+        };
+
+    // Constant subexpressions are only calculated once, when bound
+    auto folded = SqlExpression::parse("(1 + 2) * 3")->bind(context);
+    BOOST_CHECK(folded.metadata.isConstant);
+    BOOST_CHECK_EQUAL(folded(row, GET_LATEST).toInt(), 9);
+    auto bound = SqlExpression::parse("x + (1 + 2) * 3")->bind(context);
+    BOOST_CHECK(!bound.metadata.isConstant);
+    BOOST_CHECK_EQUAL(bound(row, GET_LATEST).toInt(), 12);
+
+    // The same operand on both sides is only read once
+    BOOST_CHECK_EQUAL(run("x * x").toInt(), 9);
+    BOOST_CHECK_EQUAL((*context.reads)[PathElement("x")], 1);
+    BOOST_CHECK(run("x = x").isTrue());
+    BOOST_CHECK_EQUAL((*context.reads)[PathElement("x")], 1);
+    BOOST_CHECK_EQUAL(run("(x + 1) - (x + 1)").toInt(), 0);
+    BOOST_CHECK_EQUAL((*context.reads)[PathElement("x")], 1);
+    BOOST_CHECK_EQUAL(run("x - 1").toInt(), 2);
+    BOOST_CHECK_EQUAL((*context.reads)[PathElement("x")], 1);
+    BOOST_CHECK(run("y = y").empty());
+
+    // A constant false makes an AND false without reading the other side
+    BOOST_CHECK(run("x > 2 AND 1 > 2").isFalse());
+    BOOST_CHECK_EQUAL((*context.reads)[PathElement("x")], 0);
+    BOOST_CHECK(run("x > 2 AND true").isTrue());
+    BOOST_CHECK(run("false OR x > 2").isTrue());
+    BOOST_CHECK(run("x > 5 OR false").isFalse());
+    BOOST_CHECK(run("y > 2 AND true").empty());
+    BOOST_CHECK(run("NULL OR y > 2").empty());
+}
+
+// Binding context whose columns can be read in batch from a TestBatchScope
+struct BatchBindingContext: public TestBindingContext {
+    ColumnGetter doGetColumn(const Utf8String & tableName,
+                             const ColumnPath & columnName)
+    {
+        auto result = TestBindingContext::doGetColumn(tableName, columnName);
+        result.batchColumnName = columnName;
+        return result;
+    }
+};
+
+struct TestBatchScope: public SqlBatchScope {
+    TestBatchScope(std::map<ColumnPath, std::vector<double> > columns)
+        : SqlBatchScope(columns.begin()->second.size()),
+          columns(std::move(columns))
+    {
+    }
+
+    std::map<ColumnPath, std::vector<double> > columns;
+
+    // NaN is used for nulls here
+    virtual void getColumn(const ColumnPath & columnName,
+                           SqlBatchValues & output) const
+    {
+        auto it = columns.find(columnName);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            bool isNull = it == columns.end() || std::isnan(it->second[i]);
+            output.values[i] = isNull ? 0.0 : it->second[i];
+            output.states[i] = isNull
+                ? SqlBatchValues::NULLVAL : SqlBatchValues::VALUE;
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE(test_batch_program)
+{
+    BatchBindingContext context;
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    TestBatchScope batch({ { PathElement("x"), { 1, 2, 3, nan, 0, -4 } },
+                           { PathElement("y"), { 0, 5, nan, 1, 0, 2 } } });
+
+    // The program must give the same results as the batchExec closures
+    for (std::string surface: { "x + y * 2 > 3",
+                "x * x - y / 2",
+                "NOT (x < 2) AND y != 0 OR x = 1",
+                "-x + (1 + 2) <= y",
+                "x / y",
+                "z > 1 OR x >= 2",
+                "x = 2 AND 1 > 2" }) {
+        auto expr = SqlExpression::parse(surface);
+        auto bound = expr->bind(context);
+        BOOST_REQUIRE(bound.batchExec);
+        auto program = SqlBatchProgram::compile(*expr, context);
+        BOOST_REQUIRE(program);
+
+        SqlBatchValues expected, output;
+        bound.batchExec(batch, expected);
+        program->run(batch, output);
+
+        for (size_t i = 0;  i < batch.numRows;  ++i) {
+            BOOST_CHECK_EQUAL((int)output.states[i], (int)expected.states[i]);
+            if (expected.states[i] == SqlBatchValues::VALUE)
+                BOOST_CHECK_EQUAL(output.values[i], expected.values[i]);
+        }
+    }
+
+    // Each column and repeated subexpression is only calculated once
+    auto program = SqlBatchProgram::compile
+        (*SqlExpression::parse("x * x + x * x"), context);
+    BOOST_REQUIRE(program);
+    BOOST_CHECK_EQUAL(program->size(), 3);
+
+    // Constants are calculated when compiling
+    program = SqlBatchProgram::compile
+        (*SqlExpression::parse("x > (1 + 2) * 3"), context);
+    BOOST_REQUIRE(program);
+    BOOST_CHECK_EQUAL(program->size(), 3);
+
+    // These need the interpreter
+    BOOST_CHECK(!SqlBatchProgram::compile(*SqlExpression::parse("x % 2"),
+                                          context));
+    BOOST_CHECK(!SqlBatchProgram::compile(*SqlExpression::parse("abs(x) > 1"),
+                                          context));
+    BOOST_CHECK(!SqlBatchProgram::compile(*SqlExpression::parse("x = 'a'"),
+                                          context));
+}
+
 BOOST_AUTO_TEST_CASE(test_alignment)
 {
     // Not really a test, but helpful for developers...
@@ -0,0 +1,71 @@
+/** statement_cache_test.cc
+    Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the cache of parsed query statements.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/server/statement_cache.h"
+#include "mldb/sql/sql_expression.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_normalize )
+{
+    BOOST_CHECK_EQUAL(StatementCache::normalize("  SELECT  x,\n\ty FROM ds  "),
+                      "SELECT x, y FROM ds");
+
+    // Whitespace within quotes is significant
+    BOOST_CHECK_EQUAL(StatementCache::normalize("SELECT 'a  b'  AS \"c  d\""),
+                      "SELECT 'a  b' AS \"c  d\"");
+
+    // Doubled quotes don't end the quoted text
+    BOOST_CHECK_EQUAL(StatementCache::normalize("SELECT 'it''s  ok'   AS x"),
+                      "SELECT 'it''s  ok' AS x");
+
+    // Comment markers inside quotes aren't comments
+    BOOST_CHECK_EQUAL(StatementCache::normalize("SELECT  '--'"),
+                      "SELECT '--'");
+
+    // Queries with comments are left alone
+    std::string commented = "SELECT x -- the x\n  FROM ds";
+    BOOST_CHECK_EQUAL(StatementCache::normalize(commented), commented);
+    commented = "SELECT /* the x */  x";
+    BOOST_CHECK_EQUAL(StatementCache::normalize(commented), commented);
+}
+
+BOOST_AUTO_TEST_CASE( test_cache )
+{
+    StatementCache cache;
+
+    auto stm1 = cache.get("SELECT x + 1 AS y FROM ds WHERE z = 2");
+    auto stm2 = cache.get("SELECT x + 1 AS y\n  FROM ds\n  WHERE z = 2");
+    BOOST_CHECK_EQUAL(stm1.get(), stm2.get());
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+
+    auto stm3 = cache.get("SELECT x + 2 AS y FROM ds WHERE z = 2");
+    BOOST_CHECK_NE(stm1.get(), stm3.get());
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+    BOOST_CHECK_EQUAL(stm3->select.print(),
+                      SelectStatement::parse("SELECT x + 2 AS y").select.print());
+
+    // Parse errors are thrown every time and not cached
+    BOOST_CHECK_THROW(cache.get("SELECT FROM WHERE"), std::exception);
+    BOOST_CHECK_THROW(cache.get("SELECT FROM WHERE"), std::exception);
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+    auto stm4 = cache.get("SELECT x + 1 AS y FROM ds WHERE z = 2");
+    BOOST_CHECK_NE(stm1.get(), stm4.get());
+    BOOST_CHECK_EQUAL(stm1->print(), stm4->print());
+}
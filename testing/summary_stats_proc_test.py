@@ -66,6 +66,38 @@ class SummaryStatsProcTest(MldbUnitTest):  # noqa
 
         ])
 
+    def test_row_scan(self):
+        # A WHERE clause means that the rows of the query are scanned, with
+        # all of the columns done together
+        mldb.post('/v1/procedures', {
+            'type' : 'summary.statistics',
+            'params' : {
+                'runOnCreation' : True,
+                'inputData' : "SELECT colA, colTxt AS txt, colC FROM ds "
+                              "WHERE rowName() != 'row3'",
+                'outputDataset' : {
+                    'id' : 'row_scan_output',
+                    'type' : 'sparse.mutable'
+                }
+            }
+        })
+        res = mldb.query("SELECT * FROM row_scan_output ORDER BY rowName()")
+        self.assertTableResultEquals(res, [
+            ["_rowName", "value.num_null", "value.num_unique",
+             "value.1st_quartile", "value.3rd_quartile", "value.avg",
+             "value.data_type", "value.max", "value.median", "value.min",
+             "value.most_frequent_items.1", "value.most_frequent_items.10",
+             "value.stddev", "value.most_frequent_items.20",
+             "value.most_frequent_items.banane",
+             "value.most_frequent_items.patate"],
+            ["colA", 0, 2, 1, 10, 5.5, "number", 10, 10, 1, 1, 1,
+             6.363961030678928, None, None, None],
+            ["colC", 1, 1, 20, 20, 20, "number", 20, 20, 20, None, None,
+             "NaN", 1, None, None],
+            ["txt", 0, 2, None, None, None, "categorical", None, None, None,
+             None, None, None, None, 1, 1]
+        ])
+
     def test_dottest_col_names(self):
         ds = mldb.create_dataset({
             'id' : 'dotted_col_ds',
@@ -207,6 +239,54 @@ class SummaryStatsProcTest(MldbUnitTest):  # noqa
         ])
 
 
+    def test_tabular_scan_matches_query(self):
+        # Tabular datasets have their columns scanned directly rather than
+        # queried; the statistics must be the same
+        rows = [
+            ['row1', [['colA', 1, 0], ['colB', 2, 0], ['colTxt', 'patate', 0]]],
+            ['row2', [['colA', 10, 0], ['colC', 20, 0], ['colTxt', 'banane', 0]]],
+            ['row3', [['colA', 1, 0], ['colTxt', 1, 0]]],
+            ['row4', [['colA', 2.5, 0], ['colB', 2, 0]]]
+        ]
+        for ds_type in ['sparse.mutable', 'tabular']:
+            ds = mldb.create_dataset({
+                'id' : 'scan_' + ds_type.split('.')[0],
+                'type' : ds_type
+            })
+            for row_name, cols in rows:
+                ds.record_row(row_name, cols)
+            ds.commit()
+
+        def run_proc(input_data, output):
+            mldb.post('/v1/procedures', {
+                'type' : 'summary.statistics',
+                'params' : {
+                    'runOnCreation' : True,
+                    'inputData' : input_data,
+                    'outputDataset' : {
+                        'id' : output,
+                        'type' : 'sparse.mutable'
+                    }
+                }
+            })
+            return mldb.get('/v1/query', format='aos',
+                            q='SELECT * FROM ' + output
+                              + ' ORDER BY rowName()').json()
+
+        for select in ['*', 'colA, colTxt AS txt, unexisting']:
+            expected = run_proc('SELECT %s FROM scan_sparse' % select,
+                                'scan_sparse_output')
+            res = run_proc('SELECT %s FROM scan_tabular' % select,
+                           'scan_tabular_output')
+            self.assertEqual(len(res), len(expected))
+            for row, expected_row in zip(res, expected):
+                stddev = row.pop('value.stddev', None)
+                expected_stddev = expected_row.pop('value.stddev', None)
+                if isinstance(expected_stddev, float):
+                    self.assertAlmostEqual(stddev, expected_stddev)
+                else:
+                    self.assertEqual(stddev, expected_stddev)
+                self.assertEqual(row, expected_row)
 
 if __name__ == '__main__':
     mldb.run_tests()
@@ -0,0 +1,80 @@
+#
+# svd_randomized_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Check that the randomized SVD algorithm finds the same singular vectors
+# as the Lanczos one on a low rank matrix.
+#
+import random
+import math
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class SvdRandomizedTest(MldbUnitTest):  # noqa
+
+    num_columns = 30
+    rank = 4
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        # Rank 4 matrix, with well separated singular values, plus noise
+        factors = [[random.gauss(0, 1) for j in range(cls.num_columns)]
+                   for k in range(cls.rank)]
+        scales = [8, 4, 2, 1]
+
+        ds = mldb.create_dataset({"id": "data", "type": "sparse.mutable"})
+        for i in range(500):
+            weights = [random.gauss(0, s) for s in scales]
+            row = []
+            for j in range(cls.num_columns):
+                v = sum(w * f[j] for w, f in zip(weights, factors))
+                row.append(["x%02d" % j, v + random.gauss(0, 0.01), 0])
+            ds.record_row("r%d" % i, row)
+        ds.commit()
+
+    def train(self, name, params):
+        config = {
+            "trainingData": "select * from data",
+            "columnOutputDataset": "columns_" + name,
+            "numSingularValues": self.rank
+        }
+        config.update(params)
+        mldb.post('/v1/procedures', {
+            "type": "svd.train",
+            "params": config
+        })
+
+        res = mldb.query("select * from columns_%s order by rowName()" % name)
+        header = res[0]
+        vectors = [[] for k in range(self.rank)]
+        for row in res[1:]:
+            for k in range(self.rank):
+                vectors[k].append(row[header.index("embedding.%d" % k)])
+        return vectors
+
+    def test_same_as_lanczos(self):
+        lanczos = self.train("lanczos", {"algorithm": "lanczos"})
+        randomized = self.train("randomized", {"algorithm": "randomized",
+                                               "oversampling": 5,
+                                               "powerIterations": 2})
+
+        for k in range(self.rank):
+            dot = sum(a * b for a, b in zip(lanczos[k], randomized[k]))
+            norm1 = math.sqrt(sum(a * a for a in lanczos[k]))
+            norm2 = math.sqrt(sum(b * b for b in randomized[k]))
+            # Singular vectors are only defined up to their sign
+            self.assertAlmostEqual(abs(dot) / (norm1 * norm2), 1.0, places=3)
+            self.assertAlmostEqual(norm1, norm2, delta=norm1 * 1e-3)
+
+    def test_bad_parameters(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "must not be negative"):
+            self.train("bad", {"algorithm": "randomized",
+                               "oversampling": -1})
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,104 @@
+#
+# tablesample_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the TABLESAMPLE clause and the estimate_* aggregators that scale
+# their results over the sample up to the whole table.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class TableSampleTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({"id": "big", "type": "tabular"})
+        for i in range(10000):
+            ds.record_row("r%d" % i, [["x", i % 100, 0],
+                                      ["label", "l%d" % (i % 4), 0]])
+        ds.commit()
+
+    def get(self, query):
+        res = mldb.query(query)
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def test_percent(self):
+        res = self.get("SELECT count(*) AS n FROM big TABLESAMPLE (10 PERCENT)")
+        self.assertGreater(res["n"], 700)
+        self.assertLess(res["n"], 1300)
+
+    def test_rows(self):
+        res = self.get("SELECT count(*) AS n FROM big TABLESAMPLE (250 ROWS)")
+        self.assertEqual(res["n"], 250)
+
+    def test_alias(self):
+        res = self.get("SELECT count(b.x) AS n FROM big AS b "
+                       "TABLESAMPLE (100 ROWS)")
+        self.assertEqual(res["n"], 100)
+
+    def test_repeatable(self):
+        query = ("SELECT sum(x) AS s FROM big "
+                 "TABLESAMPLE (5 PERCENT) REPEATABLE (42)")
+        self.assertEqual(self.get(query), self.get(query))
+
+    def test_errors(self):
+        for clause in ["(0 PERCENT)", "(150 PERCENT)", "(2.5 ROWS)",
+                       "(10)", "10 PERCENT"]:
+            with self.assertRaises(mldb_wrapper.ResponseException):
+                mldb.query("SELECT count(*) FROM big TABLESAMPLE " + clause)
+
+    def test_estimates(self):
+        res = self.get("""
+            SELECT estimate_count(x) AS count, estimate_sum(x) AS sum,
+                   estimate_avg(x) AS avg
+            FROM big TABLESAMPLE (20 PERCENT) REPEATABLE (1)
+        """)
+
+        # True values are 10000 rows, a sum of 495000 and an average of 49.5
+        for name, value in [("count", 10000), ("sum", 495000),
+                            ("avg", 49.5)]:
+            lower = res[name + ".lower"]
+            upper = res[name + ".upper"]
+            estimate = res[name + ".estimate"]
+            self.assertLessEqual(lower, estimate)
+            self.assertLessEqual(estimate, upper)
+            self.assertLess(lower, upper)
+            self.assertLess(abs(estimate - value), 0.1 * value)
+
+        # The count of a group is within its interval
+        res = self.get("""
+            SELECT estimate_count(x, 0.99) AS count
+            FROM big TABLESAMPLE (20 PERCENT) REPEATABLE (1)
+            WHERE label = 'l1'
+        """)
+        self.assertLess(res["count.lower"], 2500)
+        self.assertGreater(res["count.upper"], 2500)
+
+    def test_group_by(self):
+        res = mldb.query("""
+            SELECT estimate_count(x) AS count
+            FROM big TABLESAMPLE (1000 ROWS)
+            GROUP BY label ORDER BY label
+        """)
+        self.assertEqual(len(res), 5)
+        total = sum(row[res[0].index("count.estimate")] for row in res[1:])
+        self.assertAlmostEqual(total, 10000, places=6)
+
+    def test_exact_without_sample(self):
+        res = self.get("SELECT estimate_count(x) AS count, "
+                       "estimate_sum(x) AS sum FROM big")
+        self.assertEqual(res["count.estimate"], 10000)
+        self.assertEqual(res["count.lower"], 10000)
+        self.assertEqual(res["count.upper"], 10000)
+        self.assertEqual(res["sum.estimate"], 495000)
+        self.assertEqual(res["sum.lower"], 495000)
+
+    def test_bad_confidence(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query("SELECT estimate_avg(x, 2) FROM big "
+                       "TABLESAMPLE (10 PERCENT)")
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
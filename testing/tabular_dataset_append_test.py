@@ -0,0 +1,83 @@
+#
+# tabular_dataset_append_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that rows can be recorded into a tabular dataset and committed
+# after its first commit, and that the result is the same as if they had
+# all been committed at once.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetAppendTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for id in ["appended", "ref"]:
+            mldb.create_dataset({
+                "id": id,
+                "type": "tabular",
+                "params": {"unknownColumns": "add"}
+            })
+
+        def record(id, start, end):
+            for i in range(start, end):
+                cols = [["x", i, i // 1000], ["s", "str%d" % (i % 10), 0]]
+                if i % 3 == 0:
+                    cols.append(["day%d" % (i // 1000), i, 0])
+                mldb.post("/v1/datasets/%s/rows" % id,
+                          {"rowName": "row%d" % i, "columns": cols})
+
+        # Three days of rows appended one after the other, and the same
+        # rows committed at once
+        for day in range(3):
+            record("appended", day * 1000, (day + 1) * 1000)
+            mldb.post("/v1/datasets/appended/commit")
+        record("ref", 0, 3000)
+        mldb.post("/v1/datasets/ref/commit")
+
+    def check(self, query):
+        self.assertEqual(mldb.query(query % "appended"),
+                         mldb.query(query % "ref"))
+
+    def test_contents(self):
+        self.check("SELECT * FROM %s ORDER BY rowName()")
+        self.check("SELECT count(*), sum(x), min(s), max(day2) FROM %s")
+        self.check("SELECT x FROM %s WHERE x > 1990 AND x < 2010 "
+                   "ORDER BY rowName()")
+
+    def test_row_lookup(self):
+        self.check("SELECT x, s FROM %s WHERE rowName() = 'row5'")
+        self.check("SELECT x, s FROM %s WHERE rowName() = 'row2999'")
+        self.check("SELECT x, s FROM %s WHERE rowName() = 'missing'")
+
+    def test_timestamp_range(self):
+        self.check("SELECT earliest_timestamp({*}), latest_timestamp({*}) "
+                   "FROM %s")
+
+    def test_status(self):
+        status = mldb.get("/v1/datasets/appended").json()["status"]
+        self.assertEqual(status["rowCount"], 3000)
+        self.assertEqual(status["columnCount"], 5)
+
+    def test_duplicate_row(self):
+        mldb.create_dataset({"id": "dup", "type": "tabular"})
+        mldb.post("/v1/datasets/dup/rows",
+                  {"rowName": "a", "columns": [["x", 1, 0]]})
+        mldb.post("/v1/datasets/dup/commit")
+
+        mldb.post("/v1/datasets/dup/rows",
+                  {"rowName": "b", "columns": [["x", 2, 0]]})
+        mldb.post("/v1/datasets/dup/rows",
+                  {"rowName": "a", "columns": [["x", 3, 0]]})
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.post("/v1/datasets/dup/commit")
+
+        # The rows committed before are untouched
+        self.assertTableResultEquals(
+            mldb.query("SELECT x FROM dup ORDER BY rowName()"),
+            [["_rowName", "x"],
+             ["a", 1]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
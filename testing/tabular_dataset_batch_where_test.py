@@ -0,0 +1,77 @@
+#
+# tabular_dataset_batch_where_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that where clauses evaluated with the vectorized execution path of
+# the tabular dataset return the same rows as the scalar path of a sparse
+# dataset holding the same data.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetBatchWhereTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for kind, id in [("tabular", "tab"), ("sparse.mutable", "ref")]:
+            ds = mldb.create_dataset({
+                "id": id,
+                "type": kind,
+                "params": {"unknownColumns": "add"} if kind == "tabular" else {}
+            })
+            for i in range(3000):
+                cols = [["x", i, 0], ["y", (i % 13) / 4.0 - 1, 0]]
+                if i % 5:
+                    cols.append(["z", i % 11, 0])
+                if i % 1000 == 7:
+                    cols.append(["mixed", "str%d" % i, 0])
+                else:
+                    cols.append(["mixed", i % 3, 0])
+                if i == 42:
+                    cols.append(["big", 9007199254740993, 0])
+                ds.record_row("row%d" % i, cols)
+            ds.commit()
+
+    def check(self, where):
+        query = "SELECT rowName() AS n FROM %s WHERE " + where \
+                + " ORDER BY rowName()"
+        self.assertEqual(mldb.query(query % "tab"),
+                         mldb.query(query % "ref"))
+
+    def test_comparisons(self):
+        self.check("x > 2500")
+        self.check("x <= 3 OR x >= 2997")
+        self.check("y = 0.5")
+        self.check("y != -1 AND x < 100")
+
+    def test_arithmetic(self):
+        self.check("x * 2 - 1 > 5000")
+        self.check("-x / 4 < -700")
+        self.check("(x + y) / 2 > 1000")
+
+    def test_nulls(self):
+        self.check("z > 5")
+        self.check("NOT (z > 5)")
+        self.check("z < 3 OR x < 10")
+        self.check("z < 3 AND x < 100")
+        self.check("unknown > 3 OR x > 2990")
+
+    def test_functions(self):
+        self.check("abs(y) > 1")
+        self.check("sqrt(x) > 50")
+        self.check("floor(y) = 0")
+
+    def test_scalar_fallback(self):
+        # Columns with strings or integers which don't fit exactly in a
+        # double are evaluated with the scalar path
+        self.check("mixed > 1")
+        self.check("big > 9007199254740992")
+
+    def test_pagination(self):
+        res = mldb.query("SELECT rowName() FROM tab WHERE x > 100 "
+                         "ORDER BY rowName() LIMIT 10 OFFSET 5")
+        expected = mldb.query("SELECT rowName() FROM ref WHERE x > 100 "
+                              "ORDER BY rowName() LIMIT 10 OFFSET 5")
+        self.assertEqual(res, expected)
+
+mldb.run_tests()
@@ -0,0 +1,75 @@
+#
+# tabular_dataset_persistence_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that a tabular dataset with a dataFileUrl is saved on commit and
+# reloaded from the file when it is re-created.
+#
+
+import os
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetPersistenceTest(MldbUnitTest):  # noqa
+
+    url = "file://tmp/tabular_dataset_persistence_test.mldbds"
+
+    @classmethod
+    def setUpClass(cls):
+        path = "tmp/tabular_dataset_persistence_test.mldbds"
+        if os.path.exists(path):
+            os.remove(path)
+
+        ds = mldb.create_dataset({
+            "id": "saved",
+            "type": "tabular",
+            "params": {
+                "dataFileUrl": cls.url,
+                "unknownColumns": "add"
+            }
+        })
+        for i in range(1000):
+            ds.record_row("row%d" % i,
+                          [["int", i, 0],
+                           ["str", "val%d" % (i % 7), 0],
+                           ["float", i / 4.0, 0]])
+        ds.record_row("sparse", [["int", -1, 0], ["extra", "x", 0]])
+        ds.commit()
+
+    def test_reload(self):
+        mldb.put("/v1/datasets/loaded", {
+            "type": "tabular",
+            "params": {
+                "dataFileUrl": self.url
+            }
+        })
+
+        query = "SELECT * FROM %s ORDER BY rowName() LIMIT 20"
+        self.assertEqual(mldb.query(query % "saved"),
+                         mldb.query(query % "loaded"))
+
+        query = "SELECT count(*), sum(int), min(str), max(float) FROM %s"
+        self.assertEqual(mldb.query(query % "saved"),
+                         mldb.query(query % "loaded"))
+
+        self.assertTableResultEquals(
+            mldb.query("SELECT extra FROM loaded WHERE rowName() = 'sparse'"),
+            [["_rowName", "extra"],
+             ["sparse", "x"]])
+
+    def test_loaded_is_read_only(self):
+        mldb.put("/v1/datasets/loaded_ro", {
+            "type": "tabular",
+            "params": {
+                "dataFileUrl": self.url
+            }
+        })
+
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.post("/v1/datasets/loaded_ro/rows", {
+                "rowName": "new",
+                "columns": [["int", 1, 0]]
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
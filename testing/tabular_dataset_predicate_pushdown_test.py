@@ -0,0 +1,89 @@
+#
+# tabular_dataset_predicate_pushdown_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that simple predicates on a column that are pushed down into the
+# tabular dataset give the same rows as evaluating them on a sparse
+# dataset holding the same data.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetPredicatePushdownTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for kind, id in [("tabular", "tab"), ("sparse.mutable", "ref")]:
+            ds = mldb.create_dataset({
+                "id": id,
+                "type": kind,
+                "params": {"unknownColumns": "add"} if kind == "tabular" else {}
+            })
+            for i in range(3000):
+                cols = [["x", i, 0], ["s", "str%d" % (i % 10), 0]]
+                if i % 3:
+                    cols.append(["sparse", i % 7, 0])
+                ds.record_row("row%d" % i, cols)
+            ds.commit()
+
+    def check(self, where):
+        query = "SELECT rowName() AS n FROM %s WHERE " + where \
+                + " ORDER BY rowName()"
+        self.assertEqual(mldb.query(query % "tab"),
+                         mldb.query(query % "ref"))
+
+    def test_equality(self):
+        self.check("x = 5")
+        self.check("5 = x")
+        self.check("s = 'str3'")
+        self.check("s = 'nothing'")
+        self.check("sparse = 4")
+
+    def test_ranges(self):
+        self.check("x > 2990")
+        self.check("2990 < x")
+        self.check("x <= 3")
+        self.check("s >= 'str8'")
+        self.check("sparse < 2")
+
+    def test_in(self):
+        self.check("x IN (1, 5, 7000)")
+        self.check("s IN ('str1', 'str9', 'other')")
+        self.check("x IN (3, NULL)")
+
+    def test_between(self):
+        # x increases with the row number, so most chunks are skipped by
+        # their zone maps
+        self.check("x BETWEEN 1000 AND 1010")
+        self.check("x BETWEEN 10 AND 5")
+        self.check("x NOT BETWEEN 5 AND 2995")
+        self.check("s BETWEEN 'str2' AND 'str4'")
+        self.check("sparse BETWEEN 2 AND 3")
+        self.check("x BETWEEN NULL AND 3")
+
+    def test_in_subquery(self):
+        # IS TRUE stops the IN from being pushed down, so the reference
+        # evaluates it row by row
+        def check(where):
+            query = "SELECT rowName() AS n FROM %s WHERE %s ORDER BY rowName()"
+            expected = mldb.query(query % ("ref", "(%s) IS TRUE" % where))
+            self.assertEqual(mldb.query(query % ("tab", where)), expected)
+            self.assertEqual(mldb.query(query % ("ref", where)), expected)
+
+        # Small sets, and sets big enough for a Bloom filter
+        check("x IN (SELECT x FROM ref WHERE x < 5)")
+        check("x IN (SELECT x * 3 AS y FROM ref WHERE x < 900)")
+        check("s IN (SELECT s FROM ref WHERE x = 7)")
+        check("sparse IN (SELECT x FROM ref WHERE x BETWEEN 1 AND 2)")
+        check("x IN (SELECT x FROM ref WHERE x > 5000)")
+        check("x IN (SELECT x FROM ref WHERE x < 200) AND s = 'str3'")
+
+    def test_unknown_column(self):
+        self.check("unknown = 3")
+        self.check("unknown IN (1, 2)")
+
+    def test_and(self):
+        self.check("x < 100 AND s = 'str3'")
+        self.check("sparse = 2 AND x >= 2000")
+
+mldb.run_tests()
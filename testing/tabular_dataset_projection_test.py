@@ -0,0 +1,67 @@
+#
+# tabular_dataset_projection_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that queries on a tabular dataset which only read some of its
+# columns, and only take those from its rows, give the same results as on
+# a sparse dataset.
+#
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 200
+NUM_COLS = 50
+
+
+class TabularDatasetProjectionTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        tabular = mldb.create_dataset({
+            'id': 'tabular', 'type': 'tabular',
+            'params': {'unknownColumns': 'add'}})
+        sparse = mldb.create_dataset({'id': 'sparse',
+                                      'type': 'sparse.mutable'})
+        for i in range(NUM_ROWS):
+            cols = [['c%d' % j, i * j % 17, 0] for j in range(NUM_COLS)]
+            cols += [['x.a', i, 0], ['x.b', 'v%d' % (i % 4), 0]]
+            if i % 3 == 0:
+                # Only in some rows, so stored as a sparse column
+                cols.append(['extra%d' % (i % 2), i, 0])
+            tabular.record_row('r%d' % i, cols)
+            sparse.record_row('r%d' % i, cols)
+        tabular.commit()
+        sparse.commit()
+
+    def run_query(self, query, dataset):
+        return mldb.get('/v1/query', q=query % dataset, format='aos',
+                        rowNames=True).json()
+
+    def check(self, query):
+        expected = self.run_query(query, 'sparse')
+        self.assertNotEqual(len(expected), 0)
+        self.assertEqual(self.run_query(query, 'tabular'), expected)
+
+    def test_some_columns(self):
+        self.check('SELECT c3, c7 + c9 AS s FROM %s ORDER BY rowName()')
+        self.check('SELECT c1 FROM %s WHERE c2 > 5 ORDER BY c4, rowName()')
+        self.check('SELECT c5 FROM %s ORDER BY rowHash() LIMIT 10')
+
+    def test_structured_columns(self):
+        self.check('SELECT x FROM %s ORDER BY rowName()')
+        self.check('SELECT x.b, extra0 FROM %s ORDER BY x.a')
+
+    def test_group_by(self):
+        self.check('SELECT c2, count(*), sum(c11) FROM %s GROUP BY c2 '
+                   'ORDER BY c2')
+        self.check('SELECT x.b, max(extra1) FROM %s GROUP BY x.b '
+                   'ORDER BY x.b')
+
+    def test_whole_row(self):
+        self.check('SELECT columnCount() AS n, c0 FROM %s ORDER BY rowName()')
+        self.check('SELECT * EXCLUDING (c*) FROM %s ORDER BY rowName()')
+        self.check('SELECT horizontal_sum({c*}) AS s FROM %s '
+                   'ORDER BY rowName()')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,84 @@
+#
+# tabular_file_procedures_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the export.tabular and import.tabular procedures, including column
+# projection and skipping chunks from their statistics.
+#
+
+import os
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularFileProceduresTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        if not os.path.isdir("tmp/tabular_file"):
+            os.makedirs("tmp/tabular_file")
+
+        ds = mldb.create_dataset({"id": "src", "type": "sparse.mutable"})
+        for i in range(100):
+            cols = [["x", i, 0], ["label", "l%d" % (i % 4), 0]]
+            if i % 2:
+                cols.append(["odd", 1, 0])
+            ds.record_row("r%d" % i, cols)
+        ds.commit()
+
+        # Two files with disjoint ranges of x, so that a predicate on x
+        # can skip the whole of one of them
+        for name, where in [("low", "x < 50"), ("high", "x >= 50")]:
+            mldb.post("/v1/procedures", {
+                "type": "export.tabular",
+                "params": {
+                    "exportData": "SELECT * FROM src WHERE " + where,
+                    "dataFileUrl": "file://tmp/tabular_file/%s.mldbds" % name,
+                    "runOnCreation": True
+                }
+            })
+
+    def run_import(self, output, **params):
+        params.update({
+            "dataFileUrl": params.get("dataFileUrl",
+                                      "file://tmp/tabular_file/*.mldbds"),
+            "outputDataset": output,
+            "runOnCreation": True
+        })
+        res = mldb.post("/v1/procedures", {
+            "type": "import.tabular",
+            "params": params
+        })
+        return res.json()["status"]["firstRun"]["status"]
+
+    def test_roundtrip(self):
+        status = self.run_import("all")
+        self.assertEqual(status["rowCount"], 100)
+        query = "SELECT * FROM %s ORDER BY rowName()"
+        self.assertTableResultEquals(mldb.query(query % "all"),
+                                     mldb.query(query % "src"))
+
+    def test_projection(self):
+        self.run_import("projected", columns=["label"])
+        res = mldb.query("SELECT * FROM projected WHERE rowName() = 'r3'")
+        self.assertEqual(res, [["_rowName", "label"], ["r3", "l3"]])
+
+    def test_predicate(self):
+        status = self.run_import("filtered", columns=["x"],
+                                 where="x BETWEEN 60 AND 62 AND odd = 1")
+        self.assertEqual(status["rowCount"], 1)
+        self.assertGreaterEqual(status["chunksSkipped"], 1)
+        res = mldb.query("SELECT * FROM filtered")
+        self.assertEqual(res, [["_rowName", "x"], ["r61", 61]])
+
+    def test_predicate_skips_everything(self):
+        status = self.run_import("nothing", where="x > 1000")
+        self.assertEqual(status["rowCount"], 0)
+        self.assertEqual(status["chunksRead"], 0)
+
+    def test_unsupported_where(self):
+        msg = "must be a conjunction"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            self.run_import("bad", where="x > 5 OR x < 2")
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,100 @@
+#
+# tabular_replica_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the tabular.replica dataset, which copies the committed chunks of a
+# tabular dataset over HTTP and follows it when it is created again.
+#
+import os
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class TabularReplicaTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmp_dir = tempfile.mkdtemp()
+        port = mldb.get_http_bound_address().split(':')[-1]
+        cls.primary_uri = 'http://localhost:%s/v1/datasets/primary' % port
+        cls.create_primary(100)
+
+    @classmethod
+    def create_primary(cls, num_rows):
+        try:
+            mldb.delete('/v1/datasets/primary')
+        except mldb_wrapper.ResponseException:
+            pass
+        ds = mldb.create_dataset({'id': 'primary', 'type': 'tabular'})
+        for i in range(num_rows):
+            ds.record_row('r%d' % i, [['x', i, 0], ['label', 'abc'[i % 3], 0]])
+        ds.commit()
+
+    def create_replica(self, name, params={}):
+        config = {'primary': self.primary_uri,
+                  'dataFileUrl': 'file://' + os.path.join(self.tmp_dir, name)}
+        config.update(params)
+        return mldb.create_dataset({'id': name, 'type': 'tabular.replica',
+                                    'params': config})
+
+    def files(self, name):
+        return [f for f in os.listdir(self.tmp_dir) if f.startswith(name)]
+
+    def assertSameRows(self, query):
+        self.assertTableResultEquals(
+            mldb.query(query % 'replica1'), mldb.query(query % 'primary'))
+
+    def test_copy(self):
+        self.create_replica('replica1', {'pollInterval': '0s'})
+        self.assertSameRows('SELECT * FROM %s ORDER BY rowName()')
+        self.assertSameRows('SELECT count(*), sum(x) FROM %s '
+                            'WHERE label = \'b\'')
+        self.assertEqual(len(self.files('replica1')), 1)
+
+        msg = "doesn't allow recording"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.post('/v1/datasets/replica1/rows', {
+                'rowName': 'new', 'columns': [['x', 1, 0]]})
+
+        # Nothing new to copy
+        res = mldb.post('/v1/datasets/replica1/routes/sync').json()
+        self.assertEqual(res['copied'], False)
+
+    def test_follow_primary(self):
+        self.create_replica('replica2', {'pollInterval': '0s'})
+        query = 'SELECT count(*) FROM %s'
+        self.assertEqual(mldb.query(query % 'replica2')[1][1], 100)
+
+        # Created again, the primary is copied again by the next sync, and
+        # the file of the previous copy is removed
+        self.create_primary(150)
+        res = mldb.post('/v1/datasets/replica2/routes/sync').json()
+        self.assertEqual(res['copied'], True)
+        self.assertEqual(mldb.query(query % 'replica2')[1][1], 150)
+        self.assertEqual(len(self.files('replica2')), 1)
+
+    def test_poll(self):
+        self.create_replica('replica3', {'pollInterval': '1s'})
+        status = mldb.get('/v1/datasets/replica3').json()['status']
+        self.assertEqual(status['generation'], 2)
+
+    def test_primary_routes(self):
+        res = mldb.get('/v1/datasets/primary/routes/replication').json()
+        self.assertEqual(res['generation'], 2)
+        self.assertIn('instance', res)
+
+    def test_bad_params(self):
+        msg = "Primary URI must be of the form"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            self.create_replica('bad', {'primary': 'http://localhost:1/v1/ds'})
+
+        msg = "needs a dataFileUrl"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.create_dataset({
+                'id': 'bad', 'type': 'tabular.replica',
+                'params': {'primary': self.primary_uri}})
+
+if __name__ == '__main__':
+    mldb.run_tests()
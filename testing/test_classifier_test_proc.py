@@ -143,6 +143,40 @@ class TestClassifierTestProc(MldbUnitTest):  # noqa
         }
         self.assertEqual(res, truth)
 
+    def test_boolean_streaming(self):
+        exact = mldb.post('/v1/procedures',
+                          self._get_params('boolean', 'bool_label', 'weight')
+                          ).json()['status']['firstRun']['status']
+
+        params = self._get_params('boolean', 'bool_label', 'weight')
+        params['params']['streaming'] = True
+        params['params']['outputDataset'] = 'out_streaming'
+        streamed = mldb.post('/v1/procedures', params
+                             ).json()['status']['firstRun']['status']
+
+        # The scores aren't changed by rounding, so the stats are exactly
+        # the same
+        self.assert_recursive_almost_equal(streamed, exact)
+
+        # One row per distinct score, with the number of examples
+        res = mldb.get('/v1/query', q="""
+            SELECT score, count, truePositives, falsePositives
+            FROM out_streaming
+            ORDER BY score DESC
+            """,
+            format='soa', rowNames=0).json()
+        self.assertEqual(res, {
+            "score": [3, 2, 1],
+            "count": [1, 1, 2],
+            "truePositives": [1, 4, 4],
+            "falsePositives": [0, 0, 4]
+        })
+
+        params['params']['streamingPrecision'] = 0
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'streamingPrecision'):
+            mldb.post('/v1/procedures', params)
+
     def test_regression_no_weight(self):
         res = mldb.post('/v1/procedures',
                         self._get_params('regression', 'reg_label', '1')
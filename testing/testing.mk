@@ -101,6 +101,9 @@ $(eval $(call mldb_unit_test,MLDB-429-classifier-empty-label.js))
 $(eval $(call mldb_unit_test,MLDB-434-beh-dataset-nulls.js))
 $(eval $(call mldb_unit_test,MLDB-301-commit-empty-dataset.js))
 $(eval $(call mldb_unit_test,MLDB-283-embedding-nearest-neighbours.py))
+$(eval $(call mldb_unit_test,embedding_hnsw_test.py))
+$(eval $(call mldb_unit_test,embedding_storage_test.py))
+$(eval $(call mldb_unit_test,dense_row_embedding_test.py))
 $(eval $(call mldb_unit_test,MLDB-417-empty-svd.js))
 $(eval $(call mldb_unit_test,MLDB-485-svd_embedRow_returns_zeroes.py))
 $(eval $(call mldb_unit_test,MLDB-481-vp-tree-high-dimensional-cube.js))
@@ -203,6 +206,10 @@ $(eval $(call mldb_unit_test,MLDB-915-pivot-transform.py))
 $(eval $(call mldb_unit_test,MLDB-945-WHEN-in-proc-and-func.py))
 $(eval $(call mldb_unit_test,MLDB-923-embedding-literal.py))
 $(eval $(call mldb_unit_test,MLDB-953-normalize.py))
+$(eval $(call mldb_unit_test,dense_embedding_functions_test.py))
+$(eval $(call mldb_unit_test,window_functions_test.py))
+$(eval $(call mldb_unit_test,when_timestamp_range_test.py))
+$(eval $(call mldb_unit_test,external_procedure_shared_table_test.py))
 $(eval $(call mldb_unit_test,MLDB-956-sql-comments.py))
 $(eval $(call mldb_unit_test,MLDB-957-function-name.py))
 $(eval $(call mldb_unit_test,MLDB-961-glz-categorical.js))
@@ -237,6 +244,16 @@ $(eval $(call mldb_unit_test,MLDB-1026-slow-not-in.js))
 $(eval $(call mldb_unit_test,MLDB-974-slow-subquery.js))
 $(eval $(call mldb_unit_test,MLDB-1155_csv_line_endings.py))
 $(eval $(call test,MLDB-1040-invalid-requests,mldb,boost))
+$(eval $(call test,function_rpc_test,mldb,boost))
+$(eval $(call test,function_applier_cache_test,mldb,boost))
+$(eval $(call test,statement_cache_test,mldb,boost))
+$(eval $(call test,query_result_cache_test,mldb,boost))
+$(eval $(call test,query_spill_test,mldb,boost))
+$(eval $(call test,memory_account_test,mldb,boost))
+$(eval $(call test,dataset_feature_space_cache_test,mldb,boost))
+$(eval $(call test,admission_control_test,mldb,boost))
+$(eval $(call test,parallel_sort_test,base,boost))
+$(eval $(call test,parallel_sort_benchmark,base types,boost manual))
 $(eval $(call mldb_unit_test,MLDB-1081-getEmbedding_honors_limit_offset.py))
 $(eval $(call mldb_unit_test,MLDB-951-run-on-creation.py))
 $(eval $(call mldb_unit_test,MLDB-1092_conf_interval.py))
@@ -248,6 +265,7 @@ $(eval $(call mldb_unit_test,MLDB-1126_stemming.py))
 $(eval $(call mldb_unit_test,MLDB-1127-order-by-and-where-in-svd.py))
 $(eval $(call mldb_unit_test,MLDB-284-tsne-apply-function.py))
 $(eval $(call mldb_unit_test,MLDB-1119_pooling_function.py))
+$(eval $(call mldb_unit_test,pooling_embedding_view_test.py))
 $(eval $(call mldb_unit_test,MLDB-1172_column_expr_fail.py))
 $(eval $(call mldb_unit_test,MLDB-1104-input-data-spec.py))
 $(eval $(call mldb_unit_test,MLDB-1190_segfault_sqlexpr_jseval.py))
@@ -265,6 +283,7 @@ $(eval $(call mldb_unit_test,MLDB-1235-temporal-aggregators.py))
 $(eval $(call mldb_unit_test,MLDB-1260-json-errors.py))
 $(eval $(call mldb_unit_test,MLDB-1239-utf8-literal.py))
 $(eval $(call mldb_unit_test,MLDB-1353-EM.py))
+$(eval $(call mldb_unit_test,gaussian_clustering_diagonal_test.py))
 $(eval $(call mldb_unit_test,MLDB-1361_join_on_subselect.py))
 $(eval $(call mldb_unit_test,MLDB-1364_dataset_cant_be_overwritten.py))
 $(eval $(call mldb_unit_test,MLDB-1336-builtin-checks.py))
@@ -305,6 +324,7 @@ $(eval $(call mldb_unit_test,MLDB-1011-excel-import.js))
 $(eval $(call mldb_unit_test,MLDB-1121-csv-import-duplicates.py))
 $(eval $(call mldb_unit_test,MLDB-1098-csv-export.py))
 $(eval $(call mldb_unit_test,MLDB-1098-csv-export-advanced.py))
+$(eval $(call mldb_unit_test,csv_export_parallel_test.py))
 
 $(eval $(call mldb_unit_test,MLDB-1128-transform-utf8.js,,manual)) #manual -- requires specific local file?
 $(eval $(call mldb_unit_test,MLDB-1140-csv_reading_compression_test.py))
@@ -313,6 +333,7 @@ $(eval $(call mldb_unit_test,MLDB-1195-query-where-test.py))
 $(eval $(call mldb_unit_test,MLDB-1192-js-procedure-function.js))
 $(eval $(call mldb_unit_test,MLDBFB-308-where-outer-join-test.py,,manual)) #manual -- awaiting fix
 $(eval $(call mldb_unit_test,MLDB-1267-bucketize-ts-test.py))
+$(eval $(call mldb_unit_test,bucketize_approximate_test.py))
 $(eval $(call mldb_unit_test,MLDB-1322-sum_stem_token.py))
 $(eval $(call mldb_unit_test,python_mldb_interface_test.py))
 $(eval $(call mldb_unit_test,MLDB-1319-new-executor-function-binding.js))
@@ -364,7 +385,11 @@ $(eval $(call mldb_unit_test,MLDB-1636-row-column-path.js))
 $(eval $(call mldb_unit_test,MLDB-1648-path-values.js))
 $(eval $(call mldb_unit_test,MLDB-1562-join-with-in.js))
 $(eval $(call mldb_unit_test,MLDB-1802-select-orderby.py))
+$(eval $(call mldb_unit_test,order_by_limit_test.py))
+$(eval $(call mldb_unit_test,group_by_partitioned_test.py))
+$(eval $(call mldb_unit_test,approx_aggregators_test.py))
 $(eval $(call test,MLDB-1360-sparse-mutable-multithreaded-insert,mldb,boost))
+$(eval $(call test,sparse_mutable_frozen_test,mldb,boost))
 $(eval $(call mldb_unit_test,MLDBFB-440_error_on_ds_wo_cols.py))
 $(eval $(call mldb_unit_test,MLDBFB-509_pushed_non_printable_char_cant_query.py))
 $(eval $(call mldb_unit_test,MLDB-1355-explain-bad-alloc.js))
@@ -394,9 +419,13 @@ $(eval $(call mldb_unit_test,MLDB-1736_operator_precedence.py))
 $(eval $(call mldb_unit_test,MLDB-1734_case_statement.py))
 $(eval $(call mldb_unit_test,sign_function_test.py))
 $(eval $(call mldb_unit_test,import_text_test.py))
+$(eval $(call mldb_unit_test,archive_index_test.py))
 $(eval $(call mldb_unit_test,alias_resolving_test.py))
 $(eval $(call mldb_unit_test,MLDB-1753_useragent_function.py))
 $(eval $(call test,MLDB-1742-tabular-dataset-integer-columns,mldb,boost))
+$(eval $(call test,tiered_frozen_column_test,mldb,boost))
+$(eval $(call test,frozen_memory_test,mldb,boost))
+$(eval $(call test,frozen_row_names_test,mldb,boost))
 $(eval $(call mldb_unit_test,summary_stats_proc_test.py))
 $(eval $(call mldb_unit_test,MLDB-1766_dt_categorical.py))
 $(eval $(call mldb_unit_test,MLDB-1750-dist-tables.py))
@@ -436,6 +465,9 @@ $(eval $(call mldb_unit_test,MLDB-1713-wildcard-groupby.py))
 $(eval $(call mldb_unit_test,MLDB-1907-value-description-error.py))
 $(eval $(call mldb_unit_test,test_classifier_test_proc.py))
 $(eval $(call mldb_unit_test,MLDB-1937-svd-with-complex-select.py))
+$(eval $(call mldb_unit_test,svd_randomized_test.py))
+$(eval $(call mldb_unit_test,tsne_gradient_test.py))
+$(eval $(call mldb_unit_test,word2vec_import_test.py))
 $(eval $(call mldb_unit_test,fetcher-function.py))
 $(eval $(call mldb_unit_test,MLDB-1950-crash-in-merge.py))
 $(eval $(call mldb_unit_test,MLDB-408-task-cancellation.py))
@@ -445,8 +477,41 @@ $(eval $(call mldb_unit_test,MLDB-1788_select_col_as_star_err.py))
 $(eval $(call mldb_unit_test,MLDB-1972-fft.js))
 $(eval $(call mldb_unit_test,MLDB-1984-constant-functions.js))
 $(eval $(call mldb_unit_test,union_dataset_test.py))
+$(eval $(call mldb_unit_test,sharded_dataset_test.py))
 $(eval $(call mldb_unit_test,deepteach_test.py,tensorflow,manual))
 $(eval $(call mldb_unit_test,post_run_and_track_procedure_test.py))
 $(eval $(call mldb_unit_test,MLDB-2022-multiple-prediction-example.js))
 
-$(eval $(call mldb_unit_test,MLDB-2043_tabular_big_int.py))
\ No newline at end of file
+$(eval $(call mldb_unit_test,MLDB-2043_tabular_big_int.py))
+$(eval $(call mldb_unit_test,tabular_dataset_persistence_test.py))
+$(eval $(call mldb_unit_test,tabular_dataset_batch_where_test.py))
+$(eval $(call mldb_unit_test,tabular_dataset_projection_test.py))
+$(eval $(call mldb_unit_test,transform_background_freeze_test.py))
+$(eval $(call mldb_unit_test,tabular_dataset_predicate_pushdown_test.py))
+$(eval $(call mldb_unit_test,tabular_dataset_append_test.py))
+$(eval $(call mldb_unit_test,materialized_view_test.py))
+$(eval $(call mldb_unit_test,geo_index_test.py))
+$(eval $(call mldb_unit_test,joined_dataset_hash_join_test.py))
+$(eval $(call mldb_unit_test,joined_dataset_join_order_test.py))
+$(eval $(call mldb_unit_test,select_named_columns_test.py))
+$(eval $(call mldb_unit_test,import_text_column_types_test.py))
+$(eval $(call mldb_unit_test,import_glob_test.py))
+$(eval $(call mldb_unit_test,tabular_file_procedures_test.py))
+$(eval $(call mldb_unit_test,tabular_replica_test.py))
+$(eval $(call mldb_unit_test,import_json_row_parser_test.py))
+$(eval $(call mldb_unit_test,classifier_streaming_test.py))
+$(eval $(call mldb_unit_test,transposed_dataset_index_test.py))
+$(eval $(call mldb_unit_test,query_profile_test.py))
+$(eval $(call mldb_unit_test,metrics_endpoint_test.py))
+$(eval $(call mldb_unit_test,sampling_profiler_test.py))
+$(eval $(call mldb_unit_test,run_progress_test.py))
+$(eval $(call mldb_unit_test,python_query_columns_test.py))
+$(eval $(call mldb_unit_test,dataset_memory_test.py))
+$(eval $(call mldb_unit_test,tablesample_test.py))
+$(eval $(call mldb_unit_test,image_functions_batch_test.py))
+$(eval $(call mldb_unit_test,js_dataset_batch_access_test.js))
+
+$(eval $(call program,sql_engine_bench,mldb boost_program_options))
+$(eval $(call program,import_bench,mldb test_utils boost_program_options z))
+$(eval $(call program,rest_latency_bench,mldb boost_program_options))
+$(eval $(call program,training_bench,mldb test_utils boost_program_options))
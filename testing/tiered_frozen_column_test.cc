@@ -0,0 +1,180 @@
+/* tiered_frozen_column_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of frozen columns that are made cold and thawed again.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/tiered_frozen_column.h"
+#include "mldb/plugins/tabular_dataset_column.h"
+#include "mldb/plugins/tabular_dataset_chunk.h"
+#include <thread>
+#include <chrono>
+#include <stdlib.h>
+
+using namespace std;
+
+using namespace MLDB;
+
+namespace {
+
+CellValue makeValue(size_t i)
+{
+    switch (i % 3) {
+    case 0: return (int64_t)(i / 3);
+    case 1: return CellValue();
+    default: return Utf8String("value " + std::to_string(i % 10));
+    }
+}
+
+std::shared_ptr<FrozenColumn> makeColumn(size_t numRows)
+{
+    TabularDatasetColumn col;
+    for (size_t i = 0;  i < numRows;  ++i)
+        col.add(i, makeValue(i));
+    return col.freeze(ColumnFreezeParameters());
+}
+
+void checkColumn(const FrozenColumn & column, size_t numRows)
+{
+    BOOST_REQUIRE_EQUAL(column.size(), numRows);
+    for (size_t i = 0;  i < numRows;  ++i)
+        BOOST_REQUIRE_EQUAL(column.get(i), makeValue(i));
+}
+
+void waitForColdPeriod()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+struct PolicyGuard {
+    PolicyGuard(const TieredColumnPolicy & policy)
+        : old(getTieredColumnPolicy())
+    {
+        setTieredColumnPolicy(policy);
+    }
+
+    ~PolicyGuard()
+    {
+        setTieredColumnPolicy(old);
+    }
+
+    TieredColumnPolicy old;
+};
+
+void testColdColumns(const std::string & spillDirectory)
+{
+    TieredColumnPolicy policy;
+    policy.coldSeconds = 0.001;
+    policy.spillDirectory = spillDirectory;
+    PolicyGuard guard(policy);
+
+    auto frozen = makeColumn(10000);
+    size_t residentMemory = frozen->memusage();
+    auto column = makeTieredFrozenColumn(frozen);
+    frozen.reset();
+    checkColumn(*column, 10000);
+
+    waitForColdPeriod();
+    sweepTieredColumns();
+
+    TieredColumnStats stats = getTieredColumnStats();
+    BOOST_CHECK_EQUAL(stats.numColumns, 1);
+    BOOST_CHECK_EQUAL(stats.numResident, 0);
+    BOOST_CHECK_EQUAL(stats.residentBytes, 0);
+    BOOST_CHECK_GT(stats.coldBytes, 0);
+    BOOST_CHECK_EQUAL(stats.numSpilled, spillDirectory.empty() ? 0 : 1);
+    BOOST_CHECK_LT(column->memusage(), residentMemory);
+
+    // Accessing it makes it resident again, and it can be made cold again
+    // from the same compressed form
+    checkColumn(*column, 10000);
+    waitForColdPeriod();
+    sweepTieredColumns();
+    BOOST_CHECK_EQUAL(getTieredColumnStats().numResident, 0);
+    checkColumn(*column, 10000);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_tiering_disabled )
+{
+    PolicyGuard guard(TieredColumnPolicy{});
+    auto column = makeColumn(100);
+    BOOST_CHECK_EQUAL(makeTieredFrozenColumn(column), column);
+    BOOST_CHECK_EQUAL(getTieredColumnStats().numColumns, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_cold_columns_in_memory )
+{
+    testColdColumns("");
+}
+
+BOOST_AUTO_TEST_CASE( test_cold_columns_spilled )
+{
+    constexpr const char * spillPath = "tmp/tiered_frozen_column_test";
+    int res = system((string("rm -rf ") + spillPath + " && mkdir -p "
+                      + spillPath).c_str());
+    BOOST_REQUIRE_EQUAL(res, 0);
+
+    testColdColumns(spillPath);
+}
+
+BOOST_AUTO_TEST_CASE( test_resident_budget )
+{
+    TieredColumnPolicy policy;
+    policy.coldSeconds = 1000000;
+    PolicyGuard guard(policy);
+
+    auto column1 = makeTieredFrozenColumn(makeColumn(1000));
+    uint64_t column1Bytes = getTieredColumnStats().residentBytes;
+    auto column2 = makeTieredFrozenColumn(makeColumn(2000));
+    BOOST_CHECK_EQUAL(sweepTieredColumns(), 0);
+
+    // Using the first column makes the second the least recently used
+    waitForColdPeriod();
+    sweepTieredColumns();
+    checkColumn(*column1, 1000);
+
+    policy.residentBytes = column1Bytes;
+    setTieredColumnPolicy(policy);
+    sweepTieredColumns();
+
+    TieredColumnStats stats = getTieredColumnStats();
+    BOOST_CHECK_EQUAL(stats.numColumns, 2);
+    BOOST_CHECK_EQUAL(stats.numResident, 1);
+    BOOST_CHECK_EQUAL(stats.residentBytes, column1Bytes);
+
+    checkColumn(*column2, 2000);
+    checkColumn(*column1, 1000);
+}
+
+BOOST_AUTO_TEST_CASE( test_tiered_chunk )
+{
+    TieredColumnPolicy policy;
+    policy.coldSeconds = 0.001;
+    PolicyGuard guard(policy);
+
+    MutableTabularDatasetChunk mutableChunk(1 /* numColumns */, 1000);
+    std::vector<std::pair<ColumnPath, CellValue> > extra;
+    for (size_t i = 0;  i < 1000;  ++i) {
+        RowPath rowName(std::to_string(i));
+        CellValue val = makeValue(i);
+        BOOST_REQUIRE_EQUAL(mutableChunk.add(rowName, Date(), &val, 1, extra),
+                            MutableTabularDatasetChunk::ADD_SUCCEEDED);
+    }
+    TabularDatasetChunk chunk = mutableChunk.freeze(ColumnFreezeParameters());
+
+    // The column and the timestamps are tiered
+    BOOST_CHECK_EQUAL(getTieredColumnStats().numColumns, 2);
+
+    waitForColdPeriod();
+    sweepTieredColumns();
+    BOOST_CHECK_EQUAL(getTieredColumnStats().numResident, 0);
+
+    checkColumn(*chunk.columns[0], 1000);
+    BOOST_CHECK_EQUAL(chunk.timestamps->size(), 1000);
+}
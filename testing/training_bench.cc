@@ -0,0 +1,449 @@
+// This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+/* training_bench.cc
+   Copyright (c) 2016 Datacratic.  All rights reserved.
+
+   Benchmark utility for the training procedures.  It generates synthetic
+   datasets at several sizes, trains each classifier algorithm and each of
+   the unsupervised procedures on them, and prints one JSON object per
+   training with its wall time, CPU use, peak memory and hardware counters
+   (when they can be read), so that runs can be compared between releases.
+*/
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "mldb/arch/perf_counters.h"
+#include "mldb/arch/timers.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/core/dataset.h"
+#include "mldb/core/procedure.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/server/dataset_collection.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/date.h"
+#include "mldb/utils/testing/benchmarks.h"
+#include "mldb/vfs/fs_utils.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+/*****************************************************************************/
+/* DATASET GENERATION                                                        */
+/*****************************************************************************/
+
+namespace {
+
+typedef std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > Rows;
+
+static constexpr size_t NUM_FEATURES = 10;
+static constexpr size_t NUM_SPARSE_COLUMNS = 2000;
+static constexpr size_t VOCABULARY_SIZE = 5000;
+
+void recordAll(MldbServer & server, const std::string & id,
+               const std::string & type, Rows & rows)
+{
+    PolyConfig config;
+    config.id = id;
+    config.type = type;
+    auto dataset = obtainDataset(&server, config);
+    dataset->recordRows(rows);
+    dataset->commit();
+    rows.clear();
+}
+
+/** Create, for the given number of rows:
+    - dense_<n>, with numeric features x0 to x9, a boolean label that
+      depends on them with some noise, and a category;
+    - sparse_<n>, with 20 of 2000 columns set in each row, for svd;
+    - words_<n>, with the counts of words of a Zipf-like vocabulary in
+      each row, for tfidf.
+
+    The same seed is used each time, so the datasets are identical between
+    runs.
+*/
+void createDatasets(MldbServer & server, size_t nrows)
+{
+    std::mt19937 rng(nrows);
+    std::normal_distribution<double> normal;
+    std::uniform_int_distribution<int> sparseColumn(0, NUM_SPARSE_COLUMNS - 1);
+
+    // Weights of the features in the label
+    std::vector<double> weights(NUM_FEATURES);
+    for (auto & w: weights)
+        w = normal(rng);
+
+    Date ts = Date::fromSecondsSinceEpoch(0);
+    std::string suffix = "_" + to_string(nrows);
+
+    Rows rows;
+    for (size_t i = 0;  i < nrows;  ++i) {
+        rows.emplace_back(RowPath("r" + to_string(i)),
+                          Rows::value_type::second_type());
+        auto & cols = rows.back().second;
+
+        int category = i % 3;
+        double score = normal(rng) * 0.5;
+        for (size_t j = 0;  j < NUM_FEATURES;  ++j) {
+            double x = normal(rng) + (j % 3 == category ? 2.0 : 0.0);
+            score += weights[j] * x;
+            cols.emplace_back(ColumnPath("x" + to_string(j)), x, ts);
+        }
+        cols.emplace_back(ColumnPath("label"), score > 0, ts);
+        cols.emplace_back(ColumnPath("category"), category, ts);
+    }
+    recordAll(server, "dense" + suffix, "tabular", rows);
+
+    for (size_t i = 0;  i < nrows;  ++i) {
+        rows.emplace_back(RowPath("r" + to_string(i)),
+                          Rows::value_type::second_type());
+        auto & cols = rows.back().second;
+        for (size_t j = 0;  j < 20;  ++j) {
+            cols.emplace_back(ColumnPath("c" + to_string(sparseColumn(rng))),
+                              1, ts);
+        }
+    }
+    recordAll(server, "sparse" + suffix, "sparse.mutable", rows);
+
+    // Word k is drawn with a probability proportional to 1 / (k + 1)
+    std::vector<double> wordWeights(VOCABULARY_SIZE);
+    for (size_t k = 0;  k < VOCABULARY_SIZE;  ++k)
+        wordWeights[k] = 1.0 / (k + 1);
+    std::discrete_distribution<int> word(wordWeights.begin(),
+                                         wordWeights.end());
+
+    for (size_t i = 0;  i < nrows;  ++i) {
+        std::map<int, int> counts;
+        for (size_t j = 0;  j < 30;  ++j)
+            ++counts[word(rng)];
+
+        rows.emplace_back(RowPath("r" + to_string(i)),
+                          Rows::value_type::second_type());
+        auto & cols = rows.back().second;
+        for (auto & c: counts) {
+            cols.emplace_back(ColumnPath("w" + to_string(c.first)),
+                              c.second, ts);
+        }
+    }
+    recordAll(server, "words" + suffix, "sparse.mutable", rows);
+}
+
+
+/*****************************************************************************/
+/* TRAININGS                                                                 */
+/*****************************************************************************/
+
+struct Training {
+    std::string name;
+    std::string type;
+
+    /// Largest dataset to train on, for procedures that don't scale to
+    /// the largest sizes (0 is no limit)
+    size_t maxRows;
+
+    /// Parameters of the procedure, given the suffix of the datasets
+    std::function<Json::Value (const std::string & suffix)> params;
+};
+
+std::string features()
+{
+    std::string result;
+    for (size_t j = 0;  j < NUM_FEATURES;  ++j)
+        result += (j ? ", x" : "x") + to_string(j);
+    return result;
+}
+
+Json::Value classifierParams(const std::string & suffix,
+                             const std::string & algorithm,
+                             const Json::Value & configuration)
+{
+    Json::Value params;
+    params["trainingData"] = "SELECT {" + features() + "} AS features, "
+        "label FROM dense" + suffix;
+    params["mode"] = "boolean";
+    params["algorithm"] = algorithm;
+    params["configuration"][algorithm] = configuration;
+    params["modelFileUrl"] = "file://tmp/training_bench_" + algorithm + ".cls";
+    return params;
+}
+
+std::vector<Training> trainings()
+{
+    std::vector<Training> result;
+
+    // The configurations are those of container_files/classifiers.json,
+    // with their output turned off, so that they don't depend on the
+    // installation
+    Json::Value glz;
+    glz["type"] = "glz";
+    glz["verbosity"] = 0;
+    glz["normalize"] = true;
+    glz["regularization"] = "l2";
+
+    Json::Value stump;
+    stump["type"] = "stump";
+    stump["verbosity"] = 0;
+    stump["update_alg"] = "gentle";
+
+    Json::Value boostedStumps;
+    boostedStumps["type"] = "boosted_stumps";
+    boostedStumps["verbosity"] = 0;
+    boostedStumps["min_iter"] = 10;
+    boostedStumps["max_iter"] = 200;
+    boostedStumps["update_alg"] = "gentle";
+
+    Json::Value baggedTrees;
+    baggedTrees["type"] = "bagging";
+    baggedTrees["verbosity"] = 0;
+    baggedTrees["num_bags"] = 20;
+    baggedTrees["weak_learner"]["type"] = "decision_tree";
+    baggedTrees["weak_learner"]["verbosity"] = 0;
+    baggedTrees["weak_learner"]["max_depth"] = 5;
+
+    Json::Value naiveBayes;
+    naiveBayes["type"] = "naive_bayes";
+    naiveBayes["verbosity"] = 0;
+    naiveBayes["feature_prop"] = 1;
+
+    Json::Value nn;
+    nn["type"] = "perceptron";
+    nn["verbosity"] = 0;
+    nn["arch"] = 50;
+    nn["max_iter"] = 20;
+    nn["learning_rate"] = 0.01;
+    nn["batch_size"] = 10;
+
+    std::vector<std::pair<std::string, Json::Value> > algorithms = {
+        { "glz", glz },
+        { "stump", stump },
+        { "boosted_stumps", boostedStumps },
+        { "bagged_decision_trees", baggedTrees },
+        { "naive_bayes", naiveBayes },
+        { "nn", nn }
+    };
+
+    for (auto & a: algorithms) {
+        auto algorithm = a.first;
+        auto configuration = a.second;
+        result.push_back({"classifier." + algorithm, "classifier.train", 0,
+                    [=] (const std::string & suffix)
+                    {
+                        return classifierParams(suffix, algorithm,
+                                                configuration);
+                    }});
+    }
+
+    result.push_back({"randomforest", "randomforest.binary.train", 0,
+                [] (const std::string & suffix)
+                {
+                    Json::Value params;
+                    params["trainingData"] = "SELECT {" + features()
+                        + "} AS features, label FROM dense" + suffix;
+                    params["modelFileUrl"] = "file://tmp/training_bench_rf.cls";
+                    params["featureVectorSamplings"] = 5;
+                    params["featureSamplings"] = 20;
+                    params["maxDepth"] = 20;
+                    return params;
+                }});
+
+    result.push_back({"kmeans", "kmeans.train", 0,
+                [] (const std::string & suffix)
+                {
+                    Json::Value params;
+                    params["trainingData"] = "SELECT " + features()
+                        + " FROM dense" + suffix;
+                    params["numClusters"] = 10;
+                    params["metric"] = "euclidean";
+                    params["modelFileUrl"]
+                        = "file://tmp/training_bench.kms";
+                    return params;
+                }});
+
+    result.push_back({"svd", "svd.train", 0,
+                [] (const std::string & suffix)
+                {
+                    Json::Value params;
+                    params["trainingData"] = "SELECT * FROM sparse" + suffix;
+                    params["numSingularValues"] = 50;
+                    params["modelFileUrl"] = "file://tmp/training_bench.svd";
+                    return params;
+                }});
+
+    // t-SNE is quadratic in the number of rows
+    result.push_back({"tsne", "tsne.train", 10000,
+                [] (const std::string & suffix)
+                {
+                    Json::Value params;
+                    params["trainingData"] = "SELECT " + features()
+                        + " FROM dense" + suffix;
+                    params["numOutputDimensions"] = 2;
+                    params["modelFileUrl"] = "file://tmp/training_bench.tsn";
+                    return params;
+                }});
+
+    result.push_back({"gaussianclustering", "gaussianclustering.train", 0,
+                [] (const std::string & suffix)
+                {
+                    Json::Value params;
+                    params["trainingData"] = "SELECT " + features()
+                        + " FROM dense" + suffix;
+                    params["numClusters"] = 3;
+                    params["modelFileUrl"] = "file://tmp/training_bench.gs";
+                    return params;
+                }});
+
+    result.push_back({"tfidf", "tfidf.train", 0,
+                [] (const std::string & suffix)
+                {
+                    Json::Value params;
+                    params["trainingData"] = "SELECT * FROM words" + suffix;
+                    params["modelFileUrl"] = "file://tmp/training_bench.idf";
+                    return params;
+                }});
+
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MAIN                                                                      */
+/*****************************************************************************/
+
+int
+main(int argc, char * argv[])
+{
+    using namespace boost::program_options;
+    std::string sizesStr = "1000,10000,100000";
+    unsigned int iterations = 1;
+    std::string filter;
+
+    options_description all_opt;
+    all_opt.add_options()
+        ("sizes,s", value(&sizesStr),
+         "Comma separated numbers of rows of the datasets (1000,10000,100000)")
+        ("iterations,i", value(&iterations),
+         "Number of times each training is run (1)")
+        ("filter,f", value(&filter),
+         "Only run trainings whose name contains this string")
+        ("help,H", "show help");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv)
+          .options(all_opt)
+          .run(),
+          vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << all_opt << endl;
+        return 1;
+    }
+
+    ExcAssert(iterations > 0);
+
+    std::vector<std::string> sizeStrs;
+    boost::split(sizeStrs, sizesStr, boost::is_any_of(","));
+    std::vector<size_t> sizes;
+    for (auto & s: sizeStrs)
+        sizes.push_back(std::stoull(s));
+
+    MldbServer server;
+    server.init();
+
+    makeUriDirectory("tmp/");
+
+    int cpus = numCpus();
+
+    for (size_t nrows: sizes) {
+        ExcAssert(nrows > 0);
+
+        Timer setupTimer;
+        createDatasets(server, nrows);
+        cerr << "generated datasets with " << nrows << " rows in "
+             << setupTimer.elapsed() << endl;
+
+        std::string suffix = "_" + to_string(nrows);
+
+        for (auto & t: trainings()) {
+            if (!filter.empty() && t.name.find(filter) == std::string::npos)
+                continue;
+            if (t.maxRows && nrows > t.maxRows)
+                continue;
+
+            Json::Value config;
+            config["type"] = t.type;
+            config["params"] = t.params(suffix);
+
+            double bestWall = INFINITY;
+            double totalWall = 0.0, totalCpu = 0.0;
+            size_t peakRss = 0;
+            PerfCounts counts;
+
+            for (unsigned i = 0;  i < iterations;  ++i) {
+                auto procedure
+                    = obtainProcedure(&server, jsonDecode<PolyConfig>(config));
+
+                resetPeakResidentSetSize();
+                ProcessPerfCounters counters;
+                Timer timer;
+                procedure->run(ProcedureRunConfig(), nullptr);
+                counts += counters.read();
+                double wall = timer.elapsed_wall();
+                totalCpu += timer.elapsed_cpu();
+                totalWall += wall;
+                bestWall = std::min(bestWall, wall);
+                peakRss = std::max(peakRss, getPeakResidentSetSize());
+            }
+
+            double meanWall = totalWall / iterations;
+            double meanCpu = totalCpu / iterations;
+
+            Json::Value result;
+            result["name"] = t.name;
+            result["procedure"] = t.type;
+            result["rows"] = (Json::UInt)nrows;
+            result["iterations"] = iterations;
+            result["bestSeconds"] = bestWall;
+            result["meanSeconds"] = meanWall;
+            result["meanCpuSeconds"] = meanCpu;
+            result["cores"] = meanCpu / meanWall;
+            result["parallelEfficiency"] = meanCpu / meanWall / cpus;
+            result["peakRssBytes"] = (Json::UInt)peakRss;
+            if (PerfCounterGroup::available()) {
+                // Means per iteration, like the times
+                auto mean = [&] (uint64_t count)
+                    {
+                        return (Json::UInt)(count / iterations);
+                    };
+                Json::Value & c = result["counters"];
+                c["instructions"] = mean(counts.instructions);
+                c["cycles"] = mean(counts.cycles);
+                c["llcMisses"] = mean(counts.llcMisses);
+                c["branchMisses"] = mean(counts.branchMisses);
+                c["dtlbMisses"] = mean(counts.dtlbMisses);
+                c["ipc"] = counts.ipc();
+            }
+
+            cout << result.toStringNoNewLine() << endl;
+        }
+
+        for (auto & prefix: { "dense", "sparse", "words" })
+            server.datasets->deleteEntry(prefix + suffix);
+    }
+
+    server.shutdown();
+}
@@ -0,0 +1,49 @@
+#
+# transform_background_freeze_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that a transform into a tabular dataset, whose chunks are recorded in
+# batches and frozen in the background, keeps every row and value.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TransformBackgroundFreezeTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({"id": "src", "type": "sparse.mutable"})
+        # Wide rows, so that the output chunks fill up and rotate
+        for i in range(2000):
+            ds.record_row("r%d" % i,
+                          [["c%d" % j, i * j, 0] for j in range(200)])
+        ds.commit()
+
+    def transform(self, output, skip_empty=False):
+        mldb.post("/v1/procedures", {
+            "type": "transform",
+            "params": {
+                "inputData": "select *, c1 + c199 as s from src",
+                "outputDataset": {"id": output, "type": "tabular"},
+                "skipEmptyRows": skip_empty,
+                "runOnCreation": True
+            }
+        })
+
+    def test_all_rows_recorded(self):
+        self.transform("out")
+        self.assertTableResultEquals(
+            mldb.query("select count(*), sum(c5), sum(s) from out"),
+            [["_rowName", "count(*)", "sum(c5)", "sum(s)"],
+             ["[]", 2000, 5 * 1999 * 1000, 200 * 1999 * 1000]])
+        self.assertEqual(
+            mldb.query("select c7, s from out where rowName() = 'r1234'"),
+            [["_rowName", "c7", "s"], ["r1234", 7 * 1234, 200 * 1234]])
+
+    def test_skip_empty_rows(self):
+        self.transform("out_skip", skip_empty=True)
+        res = mldb.query("select count(*) from out_skip")
+        self.assertEqual(res[1][1], 2000)
+
+if __name__ == '__main__':
+    mldb.run_tests()
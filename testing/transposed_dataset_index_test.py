@@ -0,0 +1,62 @@
+#
+# transposed_dataset_index_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the in-memory index of the columns of a transposed dataset.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TransposedDatasetIndexTest(MldbUnitTest):  # noqa
+
+    def create_dataset(self, num_rows):
+        try:
+            mldb.delete('/v1/datasets/ds')
+        except mldb_wrapper.ResponseException:
+            pass
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'tabular'})
+        for i in range(num_rows):
+            ds.record_row('row' + str(i),
+                          [['x', i, 1], ['y', 'label' + str(i % 3), 2]])
+        ds.commit()
+
+    def test_index_matches_dataset(self):
+        self.create_dataset(2000)
+
+        mldb.put('/v1/datasets/uncached', {
+            'type' : 'transposed',
+            'params' : {
+                'dataset' : {'id' : 'ds'},
+                'cacheIndex' : False
+            }
+        })
+
+        queries = [
+            "SELECT row5, row1999 FROM {} ORDER BY rowName()",
+            "SELECT count(*) AS c FROM {}",
+            "SELECT row0, row7, row1500 FROM {} WHERE rowName() = 'y'"
+        ]
+
+        for q in queries:
+            expected = mldb.query(q.format('uncached'))
+            self.assertEqual(mldb.query(q.format('transpose(ds)')), expected)
+            # The second time is served from the index
+            self.assertEqual(mldb.query(q.format('transpose(ds)')), expected)
+
+    def test_commit_invalidates_index(self):
+        self.create_dataset(10)
+        res = mldb.query("SELECT row9 FROM transpose(ds) WHERE rowName() = 'x'")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'row9'],
+            ['x', 9]
+        ])
+
+        self.create_dataset(20)
+        res = mldb.query("SELECT row19 FROM transpose(ds) WHERE rowName() = 'x'")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'row19'],
+            ['x', 19]
+        ])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,93 @@
+#
+# tsne_gradient_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test the interpolation gradient of t-SNE, and reuse of the neighbors of an
+# embedding dataset.
+#
+import random
+import math
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class TsneGradientTest(MldbUnitTest):  # noqa
+
+    num_clusters = 3
+    points_per_cluster = 100
+
+    @classmethod
+    def setUpClass(cls):
+        for name, kind in [('points', 'sparse.mutable'),
+                           ('points_embedding', 'embedding')]:
+            ds = mldb.create_dataset({"id": name, "type": kind})
+            # Same points in both datasets
+            random.seed(1)
+            for c in range(cls.num_clusters):
+                for i in range(cls.points_per_cluster):
+                    ds.record_row("c%d_%d" % (c, i),
+                                  [["x%d" % j, random.gauss(10 * c, 1), 0]
+                                   for j in range(5)])
+            ds.commit()
+
+    def train(self, name, params):
+        config = {
+            "trainingData": "select * from points",
+            "rowOutputDataset": {"id": "tsne_" + name,
+                                 "type": "sparse.mutable"},
+            "perplexity": 10
+        }
+        config.update(params)
+        mldb.post('/v1/procedures', {
+            "type": "tsne.train",
+            "params": config
+        })
+
+        res = mldb.query("select x, y from tsne_%s" % name)
+        coords = {}
+        for row in res[1:]:
+            coords[row[0]] = (row[1], row[2])
+        return coords
+
+    def check_clusters(self, coords):
+        self.assertEqual(len(coords),
+                         self.num_clusters * self.points_per_cluster)
+
+        centers = {}
+        for c in range(self.num_clusters):
+            pts = [v for k, v in coords.items() if k.startswith("c%d_" % c)]
+            centers[c] = (sum(p[0] for p in pts) / len(pts),
+                          sum(p[1] for p in pts) / len(pts))
+
+        # Each point is closer to the center of its own cluster than to the
+        # others
+        for k, v in coords.items():
+            own = int(k[1:k.index('_')])
+            dists = [math.hypot(v[0] - centers[c][0], v[1] - centers[c][1])
+                     for c in range(self.num_clusters)]
+            self.assertEqual(dists.index(min(dists)), own)
+
+    def test_interpolation(self):
+        self.check_clusters(self.train("interpolation",
+                                       {"gradient": "interpolation"}))
+
+    def test_neighbors_dataset(self):
+        self.check_clusters(self.train("neighbors",
+                                       {"neighborsDataset":
+                                        "points_embedding"}))
+
+    def test_interpolation_needs_2d(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "numOutputDimensions to be 2"):
+            self.train("bad_dims", {"gradient": "interpolation",
+                                    "numOutputDimensions": 3})
+
+    def test_neighbors_dataset_must_be_embedding(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "must be a dataset of type embedding"):
+            self.train("bad_neighbors", {"neighborsDataset": "points"})
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
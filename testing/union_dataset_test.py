@@ -85,6 +85,36 @@ class UnionDatasetTest(MldbUnitTest):  # noqa
             [   "\"[\"\"A\"\"]\"", "A", 1 ],
             [   "\"[\"\"AA\"\"]\"", "AA", 999]])        
 
+    def test_dataset_stream_over_parts(self):
+        # Children with many chunks and an empty one in the middle, so that
+        # the stream is split along the parts of each child
+        for i in range(3):
+            ds = mldb.create_dataset({
+                'id' : 'tab' + str(i),
+                'type' : 'tabular' if i else 'sparse.mutable'})
+            for num in range(1000 * i):
+                ds.record_row('row' + str(num), [['x', num, 1]])
+            ds.commit()
+
+        mldb.put('/v1/datasets/union_tab', {
+            'type' : 'union',
+            'params' : {
+                'datasets' : [{'id' : 'tab1'}, {'id' : 'tab0'},
+                              {'id' : 'tab2'}]
+            }
+        })
+
+        res = mldb.query("SELECT count(*), sum(x) FROM union_tab")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'count(*)', 'sum(x)'],
+            ['[]', 3000, 999 * 500 + 1999 * 1000]
+        ])
+
+        res = mldb.query("SELECT x FROM union_tab WHERE x % 500 = 1")
+        self.assertEqual(sorted(r[0] for r in res[1:]),
+                         ['0.row1', '0.row501', '2.row1', '2.row1001',
+                          '2.row1501', '2.row501'])
+
     @unittest.skip("Unimplemented support")
     def test_query_from_ds(self):
         res = mldb.query("""
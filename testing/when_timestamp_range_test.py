@@ -0,0 +1,79 @@
+#
+# when_timestamp_range_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that WHEN clauses that are a range of timestamps, which are tested
+# directly on the timestamps and let datasets skip rows, give the same
+# results as the equivalent general expression, and that the timestamp
+# range of datasets is tracked as they are recorded.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+DATES = ['2015-01-%02dT00:00:00Z' % d for d in range(1, 11)]
+
+RANGES = [
+    ("value_timestamp() BETWEEN TIMESTAMP '{0}' AND TIMESTAMP '{1}'",
+     "NOT (value_timestamp() < TIMESTAMP '{0}' "
+     "OR value_timestamp() > TIMESTAMP '{1}')"),
+    ("value_timestamp() > TIMESTAMP '{0}' "
+     "AND value_timestamp() <= TIMESTAMP '{1}'",
+     "NOT (value_timestamp() <= TIMESTAMP '{0}' "
+     "OR value_timestamp() > TIMESTAMP '{1}')"),
+    ("TIMESTAMP '{0}' < value_timestamp()",
+     "NOT (value_timestamp() <= TIMESTAMP '{0}')"),
+    ("value_timestamp() = TIMESTAMP '{0}'",
+     "NOT (value_timestamp() != TIMESTAMP '{0}')"),
+    # Only part of the clause is a range
+    ("value_timestamp() >= TIMESTAMP '{0}' AND value_timestamp() "
+     "< TIMESTAMP '{1}' AND x > 3",
+     "NOT (value_timestamp() < TIMESTAMP '{0}' "
+     "OR value_timestamp() >= TIMESTAMP '{1}' OR x <= 3)"),
+    # Empty range
+    ("value_timestamp() BETWEEN TIMESTAMP '{1}' AND TIMESTAMP '{0}'",
+     "false"),
+]
+
+
+class WhenTimestampRangeTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for ds_id, ds_type in [('sparse', 'sparse.mutable'),
+                               ('tabular', 'tabular')]:
+            ds = mldb.create_dataset({'id': ds_id, 'type': ds_type})
+            for i in range(40):
+                # Tabular rows share a single timestamp
+                ts = DATES[i % len(DATES)]
+                row = [['x', i % 7, ts], ['y', 'v%d' % i, ts]]
+                if ds_type == 'sparse.mutable':
+                    row.append(['z', i, DATES[(i * 3) % len(DATES)]])
+                ds.record_row('row%02d' % i, row)
+            ds.commit()
+
+    def check_same(self, ds, fast, general):
+        for lo, hi in [(2, 6), (0, 9), (4, 4), (9, 9)]:
+            fmt = lambda e: e.format(DATES[lo], DATES[hi])
+            query = 'select * from %s when %s order by rowName()'
+            self.assertEqual(mldb.query(query % (ds, fmt(fast))),
+                             mldb.query(query % (ds, fmt(general))))
+
+    def test_ranges(self):
+        for ds in ['sparse', 'tabular']:
+            for fast, general in RANGES:
+                self.check_same(ds, fast, general)
+
+    def test_timestamp_range(self):
+        for ds in ['sparse', 'tabular']:
+            res = mldb.get('/v1/datasets/%s/timestampRange' % ds).json()
+            self.assertEqual(res, [DATES[0], DATES[-1]])
+
+    def test_empty_timestamp_range(self):
+        ds = mldb.create_dataset({'id': 'empty', 'type': 'sparse.mutable'})
+        ds.commit()
+        mldb.get('/v1/datasets/empty/timestampRange')
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
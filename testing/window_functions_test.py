@@ -0,0 +1,104 @@
+#
+# window_functions_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of window functions, ie aggregates with an OVER (...) clause, which
+# are calculated over a sliding frame of rows within each partition.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+GROUPS = ['a', 'b', 'c']
+
+
+class WindowFunctionsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        cls.data = {}
+        for i in range(60):
+            grp = GROUPS[i % 3]
+            # Some values are missing, and t has ties within a group
+            x = (i * 37) % 23 - 11
+            t = i // 2
+            row = [['grp', grp, 0], ['t', t, 0]]
+            if i % 5 != 0:
+                row.append(['x', x, 0])
+            else:
+                x = None
+            ds.record_row('row%02d' % i, row)
+            cls.data['row%02d' % i] = (grp, t, x)
+        ds.commit()
+
+    def query(self, expr):
+        res = mldb.query('select ' + expr + ' as w from ds order by rowName()')
+        return {row[0]: row[1] for row in res[1:]}
+
+    def partition(self, row):
+        grp = self.data[row][0]
+        rows = [r for r in self.data if self.data[r][0] == grp]
+        return sorted(rows, key=lambda r: (self.data[r][1], r))
+
+    def test_running_sum(self):
+        res = self.query('sum(x) over (partition by grp order by t)')
+        for row, val in res.items():
+            t = self.data[row][1]
+            xs = [self.data[r][2] for r in self.partition(row)
+                  if self.data[r][1] <= t and self.data[r][2] is not None]
+            self.assertEqual(val, sum(xs) if xs else None)
+
+    def test_sliding_min_max(self):
+        for fn, agg in [('min', min), ('max', max)]:
+            res = self.query(
+                fn + '(x) over (partition by grp order by t, rowName() '
+                'rows between 2 preceding and 1 following)')
+            for row, val in res.items():
+                part = self.partition(row)
+                i = part.index(row)
+                xs = [self.data[r][2] for r in part[max(0, i - 2):i + 2]
+                      if self.data[r][2] is not None]
+                self.assertEqual(val, agg(xs) if xs else None)
+
+    def test_range_offset(self):
+        res = self.query('count(x) over (partition by grp order by t '
+                         'range between 3 preceding and current row)')
+        for row, val in res.items():
+            t = self.data[row][1]
+            xs = [self.data[r][2] for r in self.partition(row)
+                  if t - 3 <= self.data[r][1] <= t
+                  and self.data[r][2] is not None]
+            self.assertEqual(val, len(xs))
+
+    def test_row_number(self):
+        res = self.query('row_number() over (partition by grp '
+                         'order by t desc, rowName() desc)')
+        for row, val in res.items():
+            part = list(reversed(self.partition(row)))
+            self.assertEqual(val, part.index(row) + 1)
+
+    def test_where(self):
+        # Window functions are calculated over the rows that match
+        res = mldb.query('select count(x) over (rows between unbounded '
+                         'preceding and unbounded following) as w '
+                         'from ds where grp = \'a\'')
+        expected = len([r for r in self.data.values()
+                        if r[0] == 'a' and r[2] is not None])
+        for row in res[1:]:
+            self.assertEqual(row[1], expected)
+
+    def test_errors(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query('select sum(x) over (order by t) from ds group by grp')
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query('select * from ds where sum(x) over (order by t) > 0')
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query('select stddev(x) over (order by t) from ds')
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query('select sum(x) over (order by t, x range between '
+                       '1 preceding and current row) from ds')
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,89 @@
+#
+# word2vec_import_test.py
+# 2016
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test import.word2vec on small binary files, both memory mapped and read
+# through a compressed stream.
+#
+import gzip
+import struct
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class Word2VecImportTest(MldbUnitTest):  # noqa
+
+    num_words = 25000
+    num_dims = 3
+
+    @classmethod
+    def write_vectors(cls, f, newlines):
+        f.write('%d %d\n' % (cls.num_words, cls.num_dims))
+        for i in range(cls.num_words):
+            f.write('w%d ' % i)
+            f.write(struct.pack('<%df' % cls.num_dims,
+                                *[i + j * 0.5 for j in range(cls.num_dims)]))
+            if newlines:
+                f.write('\n')
+
+    @classmethod
+    def setUpClass(cls):
+        cls.plain = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                                suffix='.bin')
+        cls.write_vectors(cls.plain, False)
+        cls.plain.flush()
+
+        cls.newlines = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                                   suffix='.bin')
+        cls.write_vectors(cls.newlines, True)
+        cls.newlines.flush()
+
+        cls.compressed = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                                     suffix='.bin.gz')
+        with gzip.GzipFile(fileobj=cls.compressed, mode='wb') as f:
+            cls.write_vectors(f, True)
+        cls.compressed.flush()
+
+    def run_import(self, name, f, **params):
+        config = {
+            "dataFileUrl": "file://" + f.name,
+            "outputDataset": {"id": name, "type": "embedding"},
+            "runOnCreation": True
+        }
+        config.update(params)
+        mldb.put('/v1/procedures/import_' + name, {
+            "type": "import.word2vec",
+            "params": config
+        })
+
+    def check(self, name, first, count):
+        res = mldb.query("select count(*) from %s" % name)
+        self.assertEqual(res[1][1], count)
+
+        for i in [first, first + count / 2, first + count - 1]:
+            res = mldb.query(
+                "select * from %s where rowName() = 'w%d'" % (name, i))
+            self.assertEqual(res[1][1:], [i + j * 0.5
+                                          for j in range(self.num_dims)])
+
+    def test_mapped(self):
+        self.run_import("plain", self.plain)
+        self.check("plain", 0, self.num_words)
+
+    def test_mapped_newlines(self):
+        self.run_import("newlines", self.newlines)
+        self.check("newlines", 0, self.num_words)
+
+    def test_mapped_offset_limit(self):
+        self.run_import("offset_limit", self.plain, offset=1000, limit=12000)
+        self.check("offset_limit", 1000, 12000)
+
+    def test_compressed(self):
+        self.run_import("compressed", self.compressed, offset=5, limit=20000)
+        self.check("compressed", 5, 20000)
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -140,10 +140,38 @@ fromIso8601Week(int year, int week, int day)
     return newDate.iso8601WeekStart().plusDays(day - 1);
 }
 
+bool
+Date::
+tryParseSecondsSinceEpoch(const char * str, size_t len, Date & result)
+{
+    // strtod needs a null terminated string; anything longer than this
+    // isn't a sensible number of seconds
+    char buf[64];
+    if (len == 0 || len >= sizeof(buf))
+        return false;
+    std::copy(str, str + len, buf);
+    buf[len] = 0;
+
+    int oldErrno = errno;
+    errno = 0;
+    char * end = 0;
+    double seconds = strtod(buf, &end);
+    bool ok = errno == 0 && end == buf + len;
+    errno = oldErrno;
+    if (!ok)
+        return false;
+    result = fromSecondsSinceEpoch(seconds);
+    return true;
+}
+
 Date
 Date::
 parseSecondsSinceEpoch(const std::string & date)
 {
+    Date result;
+    if (tryParseSecondsSinceEpoch(date.c_str(), date.length(), result))
+        return result;
+
     errno = 0;
     char * end = 0;
     double seconds = strtod(date.c_str(), &end);
@@ -183,10 +211,155 @@ parseIso8601(const std::string & date)
     }
 }
 
+namespace {
+
+/** Read n digits starting at p.  Rather than branching on each character,
+    bad is or-ed with whether any of them wasn't a digit.
+*/
+template<int n>
+MLDB_ALWAYS_INLINE int readDigits(const char * p, bool & bad)
+{
+    int result = 0;
+    for (int i = 0;  i < n;  ++i) {
+        unsigned d = (unsigned char)p[i] - '0';
+        bad |= d > 9;
+        result = result * 10 + int(d);
+    }
+    return result;
+}
+
+/** Number of days from 1970-01-01 to the given date of the proleptic
+    gregorian calendar, which is what boost::gregorian uses.
+*/
+int64_t daysSinceEpoch(int year, int month, int day)
+{
+    year -= month <= 2;
+    int64_t era = year / 400;
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100
+        + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+bool isLeapYear(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+} // file scope
+
+bool
+Date::
+tryParseIso8601DateTime(const char * str, size_t len, Date & result)
+{
+    // The shortest accepted string is YYYY-MM-DD, and with a time it's
+    // at least YYYY-MM-DDTHH:MM:SS
+    if (len != 10 && len < 19)
+        return false;
+
+    bool bad = str[4] != '-' || str[7] != '-';
+    int year = readDigits<4>(str, bad);
+    int month = readDigits<2>(str + 5, bad);
+    int day = readDigits<2>(str + 8, bad);
+
+    static const int monthDays[12]
+        = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    // The ranges are those of Iso8601Parser.  An invalid day of the month
+    // is left to the general parser, which reports it.
+    if (bad || year < 1400 || month < 1 || month > 12 || day < 1
+        || day > monthDays[month - 1] + (month == 2 && isLeapYear(year)))
+        return false;
+
+    double dateSeconds = daysSinceEpoch(year, month, day) * 86400.0;
+
+    if (len == 10) {
+        result = fromSecondsSinceEpoch(dateSeconds);
+        return true;
+    }
+
+    bad = (str[10] != 'T' && str[10] != ' ') || str[13] != ':'
+        || str[16] != ':';
+    int hours = readDigits<2>(str + 11, bad);
+    int minutes = readDigits<2>(str + 14, bad);
+    int seconds = readDigits<2>(str + 17, bad);
+    if (bad || hours > 23 || minutes > 59 || seconds > 60)
+        return false;
+
+    int64_t timeSeconds = hours * 3600 + minutes * 60 + seconds;
+    double time = timeSeconds;
+
+    const char * p = str + 19;
+    const char * e = str + len;
+
+    if (p != e && *p == '.') {
+        ++p;
+        // The general parser reads the time and its fraction as one
+        // decimal number, which is correctly rounded.  Dividing two
+        // exactly representable doubles is too, so up to 11 digits (which
+        // keeps the numerator under 2^53) we get an identical result.
+        static const double powersOfTen[12] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11 };
+        int64_t numerator = timeSeconds;
+        int digits = 0;
+        for (;  p != e && digits < 12;  ++p, ++digits) {
+            unsigned d = (unsigned char)*p - '0';
+            if (d > 9)
+                break;
+            numerator = numerator * 10 + d;
+        }
+        if (digits == 0 || digits > 11)
+            return false;
+        time = numerator / powersOfTen[digits];
+    }
+
+    if (p != e) {
+        if (*p == 'Z') {
+            ++p;
+        }
+        else if (*p == '+' || *p == '-') {
+            // ±hh, ±hhmm or ±hh:mm; a + means that the time is ahead of UTC
+            bool negative = *p == '+';
+            ++p;
+            if (e - p != 2 && e - p != 4 && e - p != 5)
+                return false;
+            bad = e - p == 5 && p[2] != ':';
+            int tzHours = readDigits<2>(p, bad);
+            int tzMinutes = e - p == 2 ? 0 : readDigits<2>(e - 2, bad);
+            if (bad || tzHours > 23 || tzMinutes > 59)
+                return false;
+            tzMinutes += tzHours * 60;
+            p = e;
+            time += (negative ? -tzMinutes : tzMinutes) * 60.0;
+        }
+        if (p != e)
+            return false;
+    }
+
+    result = fromSecondsSinceEpoch(dateSeconds + time);
+    return true;
+}
+
+Date
+Date::
+parseIso8601DateTime(const char * str, size_t len)
+{
+    Date result;
+    if (tryParseIso8601DateTime(str, len, result))
+        return result;
+    return parseIso8601DateTime(std::string(str, len));
+}
+
 Date
 Date::
 parseIso8601DateTime(const std::string & dateTimeStr)
 {
+    Date fast;
+    if (tryParseIso8601DateTime(dateTimeStr.data(), dateTimeStr.length(),
+                                fast))
+        return fast;
+
     if (dateTimeStr == "NaD" || dateTimeStr == "NaN")
         return notADate();
     else if (dateTimeStr == "Inf")
@@ -100,8 +100,24 @@ struct Date {
 
     static Date parseSecondsSinceEpoch(const std::string & date);
 
+    /** Parse a number of seconds since the epoch without allocating or
+        throwing.  Returns false if the string isn't entirely a number.
+    */
+    static bool tryParseSecondsSinceEpoch(const char * str, size_t len,
+                                          Date & result);
+
     static Date parseDefaultUtc(const std::string & date);
     static Date parseIso8601DateTime(const std::string & date);
+    static Date parseIso8601DateTime(const char * str, size_t len);
+
+    /** Parse the common fixed layout YYYY-MM-DD[(T| )HH:MM:SS[.fff]][Z|±hh[:mm]]
+        without allocating or throwing, giving exactly the same result as
+        parseIso8601DateTime().  Returns false for anything else, including
+        the other forms that parseIso8601DateTime() accepts, so that the
+        caller can fall back to it.
+    */
+    static bool tryParseIso8601DateTime(const char * str, size_t len,
+                                        Date & result);
 
     // Deprecated
     static Date parseIso8601(const std::string & date);
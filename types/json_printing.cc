@@ -11,7 +11,9 @@
 
 #include "json_printing.h"
 #include "dtoa.h"
+#include "mldb/arch/string_scan.h"
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include "mldb/ext/jsoncpp/value.h"
 
@@ -43,8 +45,18 @@ static char hexDigit(uint32_t c)
 */
 char * jsonEscapeCore(const char * str, size_t strLen, char * p, char * end)
 {
+    // Most strings need little or no escaping, so the characters up to
+    // the first one that does are found quickly and copied at once
+    size_t start = jsonSafeAsciiPrefix(str, strLen);
+    if (start > size_t(end - p))
+        return BUFFER_TOO_SMALL;
+    std::memcpy(p, str, start);
+    if (start == strLen)
+        return NO_ESCAPING;
+    p += start;
+
     bool anyEscaped = false;
-    for (unsigned i = 0;  i < strLen;  ++i) {
+    for (size_t i = start;  i < strLen;  ++i) {
         if (p + 4 >= end)
             return BUFFER_TOO_SMALL;
 
@@ -94,6 +106,27 @@ char * jsonEscapeCore(const char * str, size_t strLen, char * p, char * end)
 
 static constexpr size_t MAX_STACK_CHARS = 16384;
 
+/** Call onPlain for each run of bytes in the UTF-8 string that can be
+    written as they are inside a JSON string, and onChar with each of the
+    other characters, decoded.  Throws if the string isn't valid UTF-8.
+*/
+template<typename OnPlain, typename OnChar>
+void forEachJsonStringPart(const char * p, size_t len,
+                           OnPlain && onPlain, OnChar && onChar)
+{
+    const char * end = p + len;
+    while (p != end) {
+        size_t n = jsonSafeAsciiPrefix(p, end - p);
+        if (n) {
+            onPlain(p, n);
+            p += n;
+            if (p == end)
+                break;
+        }
+        onChar(utf8::next(p, end));
+    }
+}
+
 } // file scope
 
 bool isJsonValidAscii(char c)
@@ -241,39 +274,7 @@ void
 StreamJsonPrintingContext::
 writeStringUtf8(const Utf8String & s)
 {
-    stream << '\"';
-
-    for (auto it = s.begin(), end = s.end();  it != end;  ++it) {
-        int c = *it;
-        if (c >= ' ' && c < 127 && c != '\"' && c != '\\')
-            stream << (char)c;
-        else {
-            switch (c) {
-            case '\0':
-                throw MLDB::Exception("JSON strings may not contain embedded nulls");
-            case '\t': stream << "\\t";  break;
-            case '\n': stream << "\\n";  break;
-            case '\r': stream << "\\r";  break;
-            case '\b': stream << "\\b";  break;
-            case '\f': stream << "\\f";  break;
-            case '/':
-            case '\\':
-            case '\"': stream << '\\' << (char)c;  break;
-            default:
-                if (writeUtf8) {
-                    char buf[4];
-                    char * p = utf8::unchecked::append(c, buf);
-                    stream.write(buf, p - buf);
-                }
-                else {
-                    ExcAssert(c > 0 && c < 65536);
-                    stream << MLDB::format("\\u%04x", (unsigned)c);
-                }
-            }
-        }
-    }
-    
-    stream << '\"';
+    writeStringUtf8(s.rawData(), s.rawLength());
 }
 
 void
@@ -282,13 +283,13 @@ writeStringUtf8(const char * p, size_t len)
 {
     stream << '\"';
 
-    typedef utf8::iterator<const char *> It;
+    auto onPlain = [&] (const char * p, size_t n)
+        {
+            stream.write(p, n);
+        };
 
-    for (It it = It(p, p, p + len), end = It(p + len, p, p + len);  it != end;  ++it) {
-        int c = *it;
-        if (c >= ' ' && c < 127 && c != '\"' && c != '\\')
-            stream << (char)c;
-        else {
+    auto onChar = [&] (int c)
+        {
             switch (c) {
             case '\0':
                 throw MLDB::Exception("JSON strings may not contain embedded nulls");
@@ -311,9 +312,10 @@ writeStringUtf8(const char * p, size_t len)
                     stream << MLDB::format("\\u%04x", (unsigned)c);
                 }
             }
-        }
-    }
-    
+        };
+
+    forEachJsonStringPart(p, len, onPlain, onChar);
+
     stream << '\"';
 }
 
@@ -550,37 +552,7 @@ void
 StringJsonPrintingContext::
 writeStringUtf8(const Utf8String & s)
 {
-    write('"');
-
-    for (auto it = s.begin(), end = s.end();  it != end;  ++it) {
-        wchar_t c = *it;
-        if (c >= ' ' && c < 127 && c != '\"' && c != '\\')
-            write((char)c);
-        else {
-            switch (c) {
-            case '\t': write('\\', 't');  break;
-            case '\n': write('\\', 'n');  break;
-            case '\r': write('\\', 'r');  break;
-            case '\b': write('\\', 'b');  break;
-            case '\f': write('\\', 'f');  break;
-            case '/':
-            case '\\':
-            case '\"': write('\\', (char)c);  break;
-            default:
-                if (writeUtf8) {
-                    char buf[4];
-                    char * p = utf8::unchecked::append(c, buf);
-                    write(buf, p - buf);
-                }
-                else {
-                    ExcAssert(c >= 0 && c < 65536);
-                    write(MLDB::format("\\u%04x", (unsigned)c));
-                }
-            }
-        }
-    }
-    
-    write('"');
+    writeStringUtf8(s.rawData(), s.rawLength());
 }
 
 void
@@ -589,13 +561,13 @@ writeStringUtf8(const char * p, size_t len)
 {
     write('"');
 
-    typedef utf8::iterator<const char *> It;
+    auto onPlain = [&] (const char * p, size_t n)
+        {
+            str.append(p, n);
+        };
 
-    for (It it = It(p, p, p + len), end = It(p + len, p, p + len);  it != end;  ++it) {
-        wchar_t c = *it;
-        if (c >= ' ' && c < 127 && c != '\"' && c != '\\')
-            write((char)c);
-        else {
+    auto onChar = [&] (wchar_t c)
+        {
             switch (c) {
             case '\t': write('\\', 't');  break;
             case '\n': write('\\', 'n');  break;
@@ -616,9 +588,10 @@ writeStringUtf8(const char * p, size_t len)
                     write(MLDB::format("\\u%04x", (unsigned)c));
                 }
             }
-        }
-    }
-    
+        };
+
+    forEachJsonStringPart(p, len, onPlain, onChar);
+
     write('"');
 }
 
@@ -13,6 +13,7 @@
 #include "regex.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/types/value_description.h"
+#include <cstring>
 
 
 // NOTE: boost::regex is used due to issues with std::regex in GCC 4.6
@@ -187,6 +188,192 @@ suffix() const
 }
 
 
+/*****************************************************************************/
+/* REQUIRED LITERAL                                                          */
+/*****************************************************************************/
+
+/** Find the longest run of literal characters that every match of the
+    given ECMAScript regex must contain.  Only the top level of the regex
+    is looked at; groups, classes and escapes other than those of
+    punctuation break the runs, as do characters made optional by a
+    quantifier.  Anything that isn't understood, including alternation
+    at the top level and inline modifiers, gives up and returns an empty
+    string, which means that there is nothing to check.
+*/
+static std::string
+findRequiredLiteral(const std::string & r, std::regex::flag_type flags)
+{
+    using namespace std::regex_constants;
+
+    if (flags & (icase | basic | extended | awk | grep | egrep))
+        return std::string();
+
+    std::string best, current;
+    auto endRun = [&] ()
+        {
+            if (current.size() > best.size())
+                best = current;
+            current.clear();
+        };
+
+    size_t i = 0, n = r.size();
+
+    enum Quantifier { ONCE, OPTIONAL, REPEATED, INVALID };
+
+    // Read the quantifier (if any) after an atom
+    auto readQuantifier = [&] () -> Quantifier
+        {
+            if (i == n)
+                return ONCE;
+            Quantifier result;
+            char c = r[i];
+            if (c == '*' || c == '?') {
+                result = OPTIONAL;
+                ++i;
+            }
+            else if (c == '+') {
+                result = REPEATED;
+                ++i;
+            }
+            else if (c == '{') {
+                ++i;
+                size_t start = i;
+                unsigned long long minCount = 0;
+                while (i < n && isdigit(r[i]) && i - start < 9)
+                    minCount = minCount * 10 + (r[i++] - '0');
+                if (i == start)
+                    return INVALID;
+                while (i < n && (isdigit(r[i]) || r[i] == ','))
+                    ++i;
+                if (i == n || r[i] != '}')
+                    return INVALID;
+                ++i;
+                result = minCount == 0 ? OPTIONAL : REPEATED;
+            }
+            else return ONCE;
+
+            // Lazy or possessive
+            if (i < n && (r[i] == '?' || r[i] == '+'))
+                ++i;
+            return result;
+        };
+
+    // Skip a character class, with i pointing after the '['
+    auto skipClass = [&] () -> bool
+        {
+            if (i < n && r[i] == '^')
+                ++i;
+            if (i < n && r[i] == ']')
+                ++i;
+            while (i < n && r[i] != ']') {
+                if (r[i] == '\\') {
+                    i += 2;
+                }
+                else if (r[i] == '[' && i + 1 < n
+                         && (r[i + 1] == ':' || r[i + 1] == '.'
+                             || r[i + 1] == '=')) {
+                    // [:alpha:] and friends
+                    auto end = r.find(std::string(1, r[i + 1]) + "]", i + 2);
+                    if (end == std::string::npos)
+                        return false;
+                    i = end + 2;
+                }
+                else ++i;
+            }
+            if (i >= n)
+                return false;
+            ++i;
+            return true;
+        };
+
+    // Skip a group, with i pointing after the '('
+    auto skipGroup = [&] () -> bool
+        {
+            int depth = 1;
+            while (i < n && depth > 0) {
+                char c = r[i++];
+                if (c == '\\')
+                    ++i;
+                else if (c == '[') {
+                    if (!skipClass())
+                        return false;
+                }
+                else if (c == '(') {
+                    ++depth;
+                }
+                else if (c == ')') {
+                    --depth;
+                }
+            }
+            return depth == 0 && i <= n;
+        };
+
+    while (i < n) {
+        char c = r[i];
+        std::string literal;
+
+        if (c == '\\') {
+            if (i + 1 == n)
+                return std::string();
+            char e = r[i + 1];
+            i += 2;
+            if (e && strchr(".^$|()[]{}*+?\\/-", e)) {
+                literal = e;
+            }
+            else if (!strchr("dDwWsSbB", e)) {
+                // Escapes with more characters after them, backreferences,
+                // quoting, character codes, ...: we don't know enough
+                return std::string();
+            }
+        }
+        else if (c == '[') {
+            ++i;
+            if (!skipClass())
+                return std::string();
+        }
+        else if (c == '(') {
+            // Inline modifiers like (?i) change how the rest is matched
+            if (i + 2 < n && r[i + 1] == '?'
+                && (isalpha(r[i + 2]) || r[i + 2] == '-'))
+                return std::string();
+            ++i;
+            if (!skipGroup())
+                return std::string();
+        }
+        else if (c == '.' || c == '^' || c == '$') {
+            ++i;
+        }
+        else if (strchr("|)*+?{}]", c)) {
+            return std::string();
+        }
+        else {
+            // A literal character, with all of its UTF-8 bytes so that a
+            // quantifier applies to all of them
+            size_t start = i++;
+            while (i < n && ((unsigned char)r[i] & 0xc0) == 0x80)
+                ++i;
+            literal = r.substr(start, i - start);
+        }
+
+        Quantifier q = readQuantifier();
+        if (q == INVALID)
+            return std::string();
+
+        if (literal.empty() || q == OPTIONAL) {
+            endRun();
+        }
+        else {
+            current += literal;
+            if (q == REPEATED)
+                endRun();
+        }
+    }
+
+    endRun();
+    return best;
+}
+
+
 /*****************************************************************************/
 /* REGEX                                                                     */
 /*****************************************************************************/
@@ -198,6 +385,15 @@ struct Regex::Impl {
     {
         utf8 = boost::make_u32regex(surface.rawData(),
                                     syntaxFlagsToBoost(syntaxFlags));
+        requiredLiteral = findRequiredLiteral(surface.rawString(),
+                                              syntaxFlags);
+    }
+
+    bool mayMatch(const char * str, size_t len) const
+    {
+        return requiredLiteral.empty()
+            || memmem(str, len, requiredLiteral.data(),
+                      requiredLiteral.size());
     }
 
     std::regex::flag_type flags() const
@@ -224,6 +420,9 @@ struct Regex::Impl {
     /// Regex compiled to match UTF-8 data
     boost::u32regex utf8;
 
+    /// Bytes that every match contains, to reject strings quickly
+    std::string requiredLiteral;
+
     /// Regex compiled to match ASCII data.  Only initialized if the
     /// regex string is pure ASCII.
     //std::unique_ptr<boost::regex> ascii;
@@ -344,6 +543,22 @@ surface() const
     return impl->surface();
 }
 
+const std::string &
+Regex::
+requiredLiteral() const
+{
+    ExcAssert(impl);
+    return impl->requiredLiteral;
+}
+
+bool
+Regex::
+mayMatch(const char * str, size_t len) const
+{
+    ExcAssert(impl);
+    return impl->mayMatch(str, len);
+}
+
 
 /*****************************************************************************/
 /* REGEX ALGORITHMS                                                          */
@@ -355,6 +570,11 @@ Utf8String regex_replace(const Utf8String & str,
                          std::regex_constants::match_flag_type flags)
 {
     ExcAssert(regex.impl);
+
+    // Nothing to replace
+    if (!regex.impl->mayMatch(str.rawData(), str.rawLength()))
+        return str;
+
     std::basic_string<int32_t> matchStr(str.begin(), str.end());
     std::basic_string<int32_t> replacementStr(format.begin(), format.end());
 
@@ -369,6 +589,8 @@ bool regex_search(const Utf8String & str,
                   std::regex_constants::match_flag_type flags)
 {
     ExcAssert(regex.impl);
+    if (!regex.impl->mayMatch(str.rawData(), str.rawLength()))
+        return false;
     return boost::u32regex_search(str.rawString(), regex.impl->utf8,
                                   matchFlagsToBoost(flags));
     
@@ -400,6 +622,8 @@ bool regex_match(const Utf8String & str,
                  std::regex_constants::match_flag_type flags)
 {
     ExcAssert(regex.impl);
+    if (!regex.impl->mayMatch(str.rawData(), str.rawLength()))
+        return false;
     return boost::u32regex_match(str.rawString(), regex.impl->utf8,
                                  matchFlagsToBoost(flags));
 }
@@ -135,6 +135,21 @@ struct Regex {
     /** Return the surface form that was used to build this regex. */
     const Utf8String & surface() const;
 
+    /** Return a string of bytes that is contained in every string that the
+        regex matches, or an empty string if none could be found.  This is
+        found from the runs of literal characters in the regex that aren't
+        optional.
+    */
+    const std::string & requiredLiteral() const;
+
+    /** Return false if the regex can't match any part of the given UTF-8
+        string, as it doesn't contain the required literal.  This is much
+        quicker than running the regex, and allows most strings to be
+        rejected without running it at all.  True means that the regex
+        needs to be run to know.
+    */
+    bool mayMatch(const char * str, size_t len) const;
+
     /** Default match results type. */
     typedef std::match_results<Utf8String::const_iterator> match_results;
 
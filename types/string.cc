@@ -12,6 +12,7 @@
 #include "mldb/arch/exception.h"
 #include <unicode/unistr.h>
 #include "mldb/base/exc_assert.h"
+#include "mldb/arch/string_scan.h"
 #include <boost/algorithm/string.hpp>
 #include <boost/locale.hpp>
 
@@ -154,8 +155,14 @@ void
 Utf8String::
 doCheck() const
 {
+    // ASCII is always valid, so only what follows the first non-ASCII
+    // character needs to be decoded
+    size_t ascii = asciiPrefix(data_.data(), data_.length());
+    if (ascii == data_.length())
+        return;
+
     // Check if we find an invalid encoding
-    string::const_iterator end_it = utf8::find_invalid(data_.begin(), data_.end());
+    string::const_iterator end_it = utf8::find_invalid(data_.begin() + ascii, data_.end());
     if (end_it != data_.end())
         {
             throw MLDB::Exception("Invalid sequence within utf-8 string");
@@ -80,6 +80,21 @@ struct StructureDescriptionBase {
 
     std::vector<Fields::const_iterator> orderedFields;
 
+    /** Perfect hash table of the fields, used to look up the fields by
+        name when parsing.  The seed is chosen so that no two fields map
+        to the same slot, so a lookup is one hash and one string
+        comparison.  Empty slots are null.  Must be rebuilt with
+        indexFields() whenever fields are added.
+    */
+    std::vector<const FieldDescription *> fieldIndex;
+    uint64_t fieldIndexSeed = 0;
+
+    /** Rebuild fieldIndex from the current set of fields. */
+    void indexFields();
+
+    /** Return the field with the given name, or null if there is none. */
+    const FieldDescription * findField(const char * name) const;
+
     struct Exception: public MLDB::Exception {
         Exception(JsonParsingContext & context,
                   const std::string & message);
@@ -195,6 +210,7 @@ struct StructureDescription
         fd.offset = (size_t)&(p->*field);
         fd.fieldNum = fields.size() - 1;
         orderedFields.push_back(it);
+        indexFields();
         //using namespace std;
         //cerr << "offset = " << fd.offset << endl;
     }
@@ -229,6 +245,7 @@ struct StructureDescription
         fd.offset = (size_t)&(p->*field);
         fd.fieldNum = fields.size() - 1;
         orderedFields.push_back(it);
+        indexFields();
     }
 
     /** Add a description with an automatic default value derived
@@ -378,6 +395,8 @@ addParent(ValueDescriptionT<V> * description_)
         fd.fieldNum = fields.size() - 1;
         orderedFields.push_back(it);
     }
+
+    indexFields();
 }
 
 } // namespace MLDB
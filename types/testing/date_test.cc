@@ -629,3 +629,54 @@ BOOST_AUTO_TEST_CASE( test_cast_to_int_same_as_quantize_to_second )
 
     }
 }
+
+BOOST_AUTO_TEST_CASE( test_try_parse_iso8601_date_time )
+{
+    MLDB_TRACE_EXCEPTIONS(false);
+
+    // Everything that the fast path accepts must give exactly what the
+    // general parser gives
+    vector<string> fast = {
+        "2013-04-01", "1400-01-01", "9999-12-31", "2012-02-29",
+        "2013-04-01T09:08:07", "2013-04-01 09:08:07", "2013-04-01T09:08:07Z",
+        "2013-04-01T23:59:60Z", "2013-04-01T09:08:07.1",
+        "2013-04-01T09:08:07.123Z", "1969-07-20T20:17:40.12345678901Z",
+        "2013-04-01T09:08:07-04:00", "2013-04-01T09:08:07+04:30",
+        "2013-04-01T09:08:07.25+0430", "2013-04-01T09:08:07-12",
+        "1850-12-31T12:00:00.999999+23:59"
+    };
+
+    for (auto & s: fast) {
+        BOOST_TEST_CHECKPOINT(s);
+        Date date;
+        BOOST_CHECK(Date::tryParseIso8601DateTime(s.data(), s.size(), date));
+        Date expected;
+        Iso8601Parser parser(s);
+        BOOST_CHECK(parser.matchDateTime(expected));
+        BOOST_CHECK_EQUAL(date.secondsSinceEpoch(),
+                          expected.secondsSinceEpoch());
+        BOOST_CHECK_EQUAL(Date::parseIso8601DateTime(s.data(), s.size()),
+                          expected);
+    }
+
+    // Everything else is left to the general parser
+    vector<string> slow = {
+        "", "NaD", "Inf", "20130401", "2013-04", "2013-W23", "2013-123",
+        "2013-02-29", "1399-01-01", "2013-04-01T09:08", "2013-04-01T09:08:07.",
+        "2013-04-01T09:08:07.123456789012", "2013-04-01T09:08:07+4",
+        "2013-04-01T09:08:07+04:3", "2013-04-01T09:08:07+24:00",
+        "2013-04-01T24:00:00", "2013-04-01T09:08:07Zjunk", "2013-04-01x"
+    };
+
+    for (auto & s: slow) {
+        BOOST_TEST_CHECKPOINT(s);
+        Date date;
+        BOOST_CHECK(!Date::tryParseIso8601DateTime(s.data(), s.size(), date));
+    }
+
+    Date date;
+    BOOST_CHECK(Date::tryParseSecondsSinceEpoch("1420070400.5", 12, date));
+    BOOST_CHECK_EQUAL(date.secondsSinceEpoch(), 1420070400.5);
+    BOOST_CHECK(!Date::tryParseSecondsSinceEpoch("1420070400x", 11, date));
+    BOOST_CHECK(!Date::tryParseSecondsSinceEpoch("", 0, date));
+}
@@ -99,3 +99,44 @@ BOOST_AUTO_TEST_CASE(test_json_encode_decode_long_strings)
     StreamingJsonParsingContext context(payload, start, start + payload.size());
     BOOST_CHECK_THROW(context.expectStringUtf8(), ParseContext::Exception);
 }
+
+BOOST_AUTO_TEST_CASE(test_escaping_in_long_strings)
+{
+    // Characters that need escaping, at each position within and across
+    // the blocks that strings are scanned in
+    for (unsigned len: { 1, 15, 16, 17, 31, 32, 33, 100 }) {
+        for (unsigned pos = 0;  pos < len;  ++pos) {
+            for (string special: { "\"", "\\", "\n", "\x7f", "\xc3\xa9" }) {
+                string str(len, 'x');
+                str.replace(pos, 1, special);
+
+                string expected = "\"" + str.substr(0, pos);
+                if (special == "\n")
+                    expected += "\\n";
+                else if (special == "\"" || special == "\\")
+                    expected += "\\" + special;
+                else expected += special;
+                expected += str.substr(pos + special.size()) + "\"";
+
+                std::ostringstream stream;
+                StreamJsonPrintingContext context(stream);
+                context.writeStringUtf8(Utf8String(str));
+                BOOST_CHECK_EQUAL(stream.str(), expected);
+
+                std::string out;
+                StringJsonPrintingContext context2(out);
+                context2.writeStringUtf8(Utf8String(str));
+                BOOST_CHECK_EQUAL(out, expected);
+            }
+        }
+    }
+
+    // Invalid UTF-8 after a long run of ASCII is still caught
+    string invalid = string(40, 'x') + "\xc3";
+    BOOST_CHECK_THROW(Utf8String(invalid), std::exception);
+
+    std::ostringstream stream;
+    StreamJsonPrintingContext context(stream);
+    BOOST_CHECK_THROW(context.writeStringUtf8(invalid.data(), invalid.size()),
+                      std::exception);
+}
@@ -276,6 +276,21 @@ S2Description::S2Description()
     addField("val2", &S2::val2, "second value");
 }
 
+BOOST_AUTO_TEST_CASE( test_structure_field_lookup )
+{
+    // Fields of the parent and of the structure itself are found by name
+    S2 s = jsonDecodeStr<S2>(string("{\"val2\":\"b\",\"val1\":\"a\"}"));
+    BOOST_CHECK_EQUAL(s.val1, "a");
+    BOOST_CHECK_EQUAL(s.val2, "b");
+    BOOST_CHECK_EQUAL(jsonEncodeStr(s), "{\"val1\":\"a\",\"val2\":\"b\"}");
+
+    // Names that are close to those of fields aren't taken for them
+    for (string name: { "val", "val12", "val3", "Val1", "", "val1 " }) {
+        string json = "{\"" + name + "\":\"a\"}";
+        BOOST_CHECK_THROW(jsonDecodeStr<S2>(json), std::exception);
+    }
+}
+
 struct RecursiveStructure {
     std::map<std::string, std::shared_ptr<RecursiveStructure> > elements;
     std::vector<std::shared_ptr<RecursiveStructure> > vec;
@@ -375,6 +375,8 @@ operator = (const StructureDescriptionBase & other)
             .first;
         orderedFields.push_back(it);
     }
+
+    indexFields();
 }
 
 void
@@ -387,9 +389,73 @@ operator = (StructureDescriptionBase && other)
     fields = std::move(other.fields);
     fieldNames = std::move(other.fieldNames);
     orderedFields = std::move(other.orderedFields);
+    indexFields();
     // don't set owner
 }
 
+namespace {
+
+/// Hash of a field name for the field index of a structure description
+inline uint64_t fieldNameHash(const char * name, uint64_t seed)
+{
+    // FNV-1a, with the seed mixed into the offset basis
+    uint64_t h = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+    for (; *name;  ++name) {
+        h ^= (unsigned char)*name;
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+} // file scope
+
+void
+StructureDescriptionBase::
+indexFields()
+{
+    size_t size = 1;
+    while (size < 2 * fields.size())
+        size *= 2;
+
+    // Find a seed for which no two fields collide.  There are few fields,
+    // so one is normally found after a few tries; if not, the table is
+    // made bigger.
+    for (;;) {
+        for (uint64_t seed = 0;  seed < 64;  ++seed) {
+            std::vector<const FieldDescription *> index(size, nullptr);
+            bool collision = false;
+            for (auto & f: fields) {
+                auto & slot = index[fieldNameHash(f.first, seed) & (size - 1)];
+                if (slot) {
+                    collision = true;
+                    break;
+                }
+                slot = &f.second;
+            }
+            if (!collision) {
+                fieldIndex = std::move(index);
+                fieldIndexSeed = seed;
+                return;
+            }
+        }
+        size *= 2;
+    }
+}
+
+const StructureDescriptionBase::FieldDescription *
+StructureDescriptionBase::
+findField(const char * name) const
+{
+    if (fieldIndex.empty())
+        return nullptr;
+    const FieldDescription * fd
+        = fieldIndex[fieldNameHash(name, fieldIndexSeed)
+                     & (fieldIndex.size() - 1)];
+    if (fd && fd->fieldName == name)
+        return fd;
+    return nullptr;
+}
+
 StructureDescriptionBase::Exception::
 Exception(JsonParsingContext & context,
           const std::string & message)
@@ -445,14 +511,13 @@ parseJson(void * output, JsonParsingContext & context) const
                 try {
                     auto n = context.fieldNamePtr();
 
-                    auto it = fields.find(n);
-                    if (it == fields.end()) {
+                    const FieldDescription * fd = findField(n);
+                    if (!fd) {
                         context.onUnknownField(owner);
                     }
                     else {
-                        it->second.description
-                        ->parseJson(addOffset(output,
-                                              it->second.offset),
+                        fd->description
+                        ->parseJson(addOffset(output, fd->offset),
                                     context);
                     }
                 }
@@ -495,7 +560,7 @@ printJson(const void * input, JsonPrintingContext & context) const
         auto mbr = addOffset(input, fd.offset);
         if (fd.description->isDefault(mbr))
             continue;
-        context.startMember(it->first);
+        context.startMember(fd.fieldName.data(), fd.fieldName.size());
         fd.description->printJson(mbr, context);
     }
         
@@ -1,29 +1,35 @@
 /** atomic_shared_ptr.h                                            -*- C++ -*-
     Jeremy Barnes, 5 April 2016
     This file is part of MLDB. Copyright 2015 Datacratic. All rights reserved.
-*/    
+*/
 
 #pragma once
 
 #include "mldb/arch/spinlock.h"
+#include "mldb/compiler/compiler.h"
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <cstdint>
 
 namespace MLDB {
 
-// Note: in GCC 4.9+, we can use the std::atomic_xxx overloads for
-// std::shared_ptr.  Once the Concurrency TR is available, we can
-// replace with those classes.  For the moment we use a simple,
-// spinlock protected implementation that is a lowest common
-// denominator.
+/*****************************************************************************/
+/* SPINLOCK ATOMIC SHARED PTR                                                */
+/*****************************************************************************/
+
+/** Spinlock protected implementation of atomic_shared_ptr that is a lowest
+    common denominator.  It's what atomic_shared_ptr is on platforms where
+    the lock-free implementation below can't be used.
+*/
 template<typename T>
-struct atomic_shared_ptr {
+struct spinlock_atomic_shared_ptr {
 
-    atomic_shared_ptr(std::shared_ptr<T> ptr = nullptr)
+    spinlock_atomic_shared_ptr(std::shared_ptr<T> ptr = nullptr)
         : ptr(std::move(ptr))
     {
     }
-    
+
     std::shared_ptr<T> load() const
     {
         std::unique_lock<Spinlock> guard(lock);
@@ -64,4 +70,217 @@ private:
     std::shared_ptr<T> ptr;
 };
 
+
+/*****************************************************************************/
+/* LOCK FREE ATOMIC SHARED PTR                                               */
+/*****************************************************************************/
+
+/** Lock-free implementation of atomic_shared_ptr, using a split reference
+    count.
+
+    The shared_ptr lives in a heap allocated holder; a single 64 bit word
+    holds the address of the holder in its low 48 bits, and in its top 16
+    bits the number of readers that are currently copying the shared_ptr
+    out of it.  A reader increments that count in the same atomic operation
+    that reads the address, which keeps the holder alive while it copies
+    the shared_ptr, and then decrements it again.  A writer swaps in a new
+    holder with a count of zero, and moves the count of the old one onto the
+    old holder's own reference count; readers that find that the holder was
+    swapped out from under them decrement that reference count instead, and
+    whoever brings it to zero frees the holder.
+
+    A holder is never put back once it has been swapped out, so there is no
+    ABA problem.  An empty pointer is represented by a null holder, which
+    readers don't need to take a reference to.  Up to 65535 readers may be
+    in load() at the same time.
+*/
+template<typename T>
+struct lock_free_atomic_shared_ptr {
+
+    lock_free_atomic_shared_ptr(std::shared_ptr<T> ptr = nullptr)
+        : word(pack(makeHolder(std::move(ptr))))
+    {
+    }
+
+    ~lock_free_atomic_shared_ptr()
+    {
+        // Nobody else can be using it by now
+        delete holderOf(word.load());
+    }
+
+    lock_free_atomic_shared_ptr(const lock_free_atomic_shared_ptr &) = delete;
+    void operator = (const lock_free_atomic_shared_ptr &) = delete;
+
+    std::shared_ptr<T> load() const
+    {
+        Holder * holder = acquire();
+        if (!holder)
+            return nullptr;
+        std::shared_ptr<T> result = holder->ptr;
+        release(holder);
+        return result;
+    }
+
+    void store(std::shared_ptr<T> newVal)
+    {
+        exchange(std::move(newVal));
+    }
+
+    std::shared_ptr<T> exchange(std::shared_ptr<T> newVal)
+    {
+        uint64_t old = word.exchange(pack(makeHolder(std::move(newVal))));
+        Holder * holder = holderOf(old);
+        if (!holder)
+            return nullptr;
+        // The readers still in there only copy it, so we can too
+        std::shared_ptr<T> result = holder->ptr;
+        retire(holder, countOf(old));
+        return result;
+    }
+
+    bool compare_exchange_strong(std::shared_ptr<T> & expected,
+                                 std::shared_ptr<T> desired)
+    {
+        Holder * newHolder = nullptr;
+
+        for (;;) {
+            Holder * holder = acquire();
+            if ((holder ? holder->ptr.get() : nullptr) != expected.get()) {
+                expected = holder ? holder->ptr : nullptr;
+                release(holder);
+                delete newHolder;
+                return false;
+            }
+
+            if (!newHolder && desired)
+                newHolder = new Holder(std::move(desired));
+
+            uint64_t current = word.load();
+            while (holderOf(current) == holder) {
+                if (word.compare_exchange_weak(current, pack(newHolder))) {
+                    if (holder) {
+                        retire(holder, countOf(current));
+                        // Our own reference now goes through the holder
+                        releaseRetired(holder);
+                    }
+                    return true;
+                }
+            }
+
+            // Someone else swapped it in the meantime; the new value may
+            // still be the same pointer, so try again
+            release(holder);
+        }
+    }
+
+private:
+    struct Holder {
+        Holder(std::shared_ptr<T> ptr)
+            : ptr(std::move(ptr)), refs(0)
+        {
+        }
+
+        std::shared_ptr<T> ptr;
+
+        /// Number of references left once the holder is swapped out;
+        /// goes negative when readers release before the writer retires it
+        std::atomic<int64_t> refs;
+    };
+
+    static_assert(sizeof(void *) == 8,
+                  "lock_free_atomic_shared_ptr needs 64 bit pointers");
+
+    static constexpr int COUNT_SHIFT = 48;
+    static constexpr uint64_t ONE_READER = uint64_t(1) << COUNT_SHIFT;
+    static constexpr uint64_t POINTER_MASK = ONE_READER - 1;
+
+    static Holder * makeHolder(std::shared_ptr<T> ptr)
+    {
+        return ptr ? new Holder(std::move(ptr)) : nullptr;
+    }
+
+    static uint64_t pack(Holder * holder)
+    {
+        return reinterpret_cast<uint64_t>(holder);
+    }
+
+    static Holder * holderOf(uint64_t word)
+    {
+        return reinterpret_cast<Holder *>(word & POINTER_MASK);
+    }
+
+    static int64_t countOf(uint64_t word)
+    {
+        return word >> COUNT_SHIFT;
+    }
+
+    /** Take a reader's reference to the current holder, returning it, or
+        return null without taking one if the pointer is empty.
+    */
+    Holder * acquire() const
+    {
+        uint64_t current = word.load(std::memory_order_relaxed);
+        for (;;) {
+            if (!holderOf(current))
+                return nullptr;
+            if (word.compare_exchange_weak(current, current + ONE_READER,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed))
+                return holderOf(current);
+        }
+    }
+
+    /** Give back a reference taken by acquire(). */
+    void release(Holder * holder) const
+    {
+        if (!holder)
+            return;
+        uint64_t current = word.load(std::memory_order_relaxed);
+        while (holderOf(current) == holder) {
+            if (word.compare_exchange_weak(current, current - ONE_READER,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed))
+                return;
+        }
+        // It was swapped out, and our reference moved onto the holder
+        releaseRetired(holder);
+    }
+
+    /** Called once a holder has been swapped out, with the number of
+        readers that were copying from it at the time.
+    */
+    static void retire(Holder * holder, int64_t readers)
+    {
+        if (holder->refs.fetch_add(readers, std::memory_order_acq_rel)
+            + readers == 0)
+            delete holder;
+    }
+
+    static void releaseRetired(Holder * holder)
+    {
+        if (holder->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete holder;
+    }
+
+    mutable std::atomic<uint64_t> word;
+};
+
+
+/*****************************************************************************/
+/* ATOMIC SHARED PTR                                                         */
+/*****************************************************************************/
+
+// Note: in GCC 4.9+, we can use the std::atomic_xxx overloads for
+// std::shared_ptr, but libstdc++ implements those with a table of mutexes.
+// Once the Concurrency TR is available, we can replace with those classes.
+// For the moment we use our own lock-free implementation where addresses
+// fit in 48 bits, which is the case on x86_64 and aarch64.
+#if defined(__x86_64__) || defined(__aarch64__)
+template<typename T>
+using atomic_shared_ptr = lock_free_atomic_shared_ptr<T>;
+#else
+template<typename T>
+using atomic_shared_ptr = spinlock_atomic_shared_ptr<T>;
+#endif
+
 } // namespace MLDB
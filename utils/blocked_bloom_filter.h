@@ -0,0 +1,133 @@
+/** blocked_bloom_filter.h                                        -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Bloom filter over 64 bit hashes, in which all of the bits for a key
+    are in the same cache line.
+*/
+
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <stddef.h>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* BLOCKED BLOOM FILTER                                                      */
+/*****************************************************************************/
+
+/** Bloom filter for sets of keys that are already hashes, like RowHash or
+    ColumnHash, that is used to answer "definitely not there" without
+    touching the index that holds the keys.
+
+    The filter is split into 64 byte blocks, each of 8 words of 64 bits.
+    A key selects a block and sets one bit in each of its words, so that a
+    lookup reads a single cache line.  With the default of 16 bits per key
+    about 0.1% of lookups of absent keys are false positives.
+
+    Inserting into the same filter from several threads is not safe;
+    lookups are, once it's built.  A default constructed filter contains
+    everything, so that code can check it before it's built.
+*/
+
+struct BlockedBloomFilter {
+
+    BlockedBloomFilter() = default;
+
+    explicit BlockedBloomFilter(size_t numKeys, double bitsPerKey = 16)
+        : keyCapacity(numKeys)
+    {
+        numBlocks = numKeys * bitsPerKey / BLOCK_BITS + 1;
+
+        // One more block so that the blocks can start on a cache line
+        storage.reset(new uint64_t[(numBlocks + 1) * WORDS]());
+        size_t offset = (uintptr_t)storage.get() % BLOCK_BYTES;
+        blocks = storage.get() + (offset ? (BLOCK_BYTES - offset) / 8 : 0);
+    }
+
+    BlockedBloomFilter(BlockedBloomFilter && other) noexcept = default;
+    BlockedBloomFilter & operator = (BlockedBloomFilter && other) noexcept = default;
+
+    void insert(uint64_t hash)
+    {
+        hash = mix(hash);
+        uint64_t * block = blocks + blockFor(hash) * WORDS;
+        uint32_t h = hash;
+        for (unsigned i = 0;  i < WORDS;  ++i)
+            block[i] |= bitFor(h, i);
+    }
+
+    /** Return false if the key was definitely not inserted. */
+    bool mayContain(uint64_t hash) const
+    {
+        if (!numBlocks)
+            return true;
+        hash = mix(hash);
+        const uint64_t * block = blocks + blockFor(hash) * WORDS;
+        uint32_t h = hash;
+        uint64_t missing = 0;
+        for (unsigned i = 0;  i < WORDS;  ++i)
+            missing |= bitFor(h, i) & ~block[i];
+        return missing == 0;
+    }
+
+    /** Number of keys the filter was sized for.  More can be inserted,
+        but the false positive rate goes up.
+    */
+    size_t capacity() const
+    {
+        return keyCapacity;
+    }
+
+    size_t memUsage() const
+    {
+        return numBlocks * BLOCK_BYTES;
+    }
+
+private:
+    static constexpr unsigned WORDS = 8;
+    static constexpr unsigned BLOCK_BYTES = WORDS * 8;
+    static constexpr unsigned BLOCK_BITS = BLOCK_BYTES * 8;
+
+    /** Keys may have been chosen by bits of their hash, like shards of
+        an index, so they're mixed again (with the finalizer of
+        MurmurHash3) before the bits are taken.
+    */
+    static uint64_t mix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /// Block for the key, from the high 32 bits of its hash
+    size_t blockFor(uint64_t hash) const
+    {
+        return ((hash >> 32) * numBlocks) >> 32;
+    }
+
+    /// Bit of word i for the key, from the low 32 bits of its hash
+    static uint64_t bitFor(uint32_t h, unsigned i)
+    {
+        static constexpr uint32_t SALTS[WORDS] = {
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+        };
+        return uint64_t(1) << ((h * SALTS[i]) >> 26);
+    }
+
+    size_t keyCapacity = 0;
+    size_t numBlocks = 0;
+    std::unique_ptr<uint64_t[]> storage;
+
+    /// Start of the first block, within storage
+    uint64_t * blocks = nullptr;
+};
+
+} // namespace MLDB
@@ -0,0 +1,646 @@
+/** flat_hash_map.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Open addressing hash map that stores its entries inline, with one byte
+    of metadata per slot that is scanned a group of sixteen slots at a time.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace MLDB {
+
+namespace FlatHashMapDetail {
+
+/// Control byte of a slot that has never been used
+static constexpr int8_t CTRL_EMPTY = -128;
+
+/// Control byte of a slot whose entry was erased
+static constexpr int8_t CTRL_DELETED = -2;
+
+// A slot with an entry has the top 7 bits of its hash as control byte,
+// which are the only values with the sign bit clear.
+
+static constexpr size_t GROUP_WIDTH = 16;
+
+
+/*****************************************************************************/
+/* GROUP                                                                     */
+/*****************************************************************************/
+
+/** Control bytes of sixteen consecutive slots.  Each match function returns
+    a bitmask with bit i set if the control byte of slot i matches.
+*/
+
+struct Group {
+#if defined(__SSE2__)
+    explicit Group(const int8_t * ctrl)
+        : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl)))
+    {
+    }
+
+    uint32_t match(int8_t h2) const
+    {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+    }
+
+    uint32_t matchEmpty() const
+    {
+        return match(CTRL_EMPTY);
+    }
+
+    uint32_t matchEmptyOrDeleted() const
+    {
+        // Both have the sign bit set, which is what movemask extracts
+        return _mm_movemask_epi8(ctrl);
+    }
+
+    __m128i ctrl;
+#else
+    explicit Group(const int8_t * ctrl)
+    {
+        std::memcpy(this->ctrl, ctrl, GROUP_WIDTH);
+    }
+
+    uint32_t match(int8_t h2) const
+    {
+        uint32_t result = 0;
+        for (unsigned i = 0;  i < GROUP_WIDTH;  ++i)
+            result |= uint32_t(ctrl[i] == h2) << i;
+        return result;
+    }
+
+    uint32_t matchEmpty() const
+    {
+        return match(CTRL_EMPTY);
+    }
+
+    uint32_t matchEmptyOrDeleted() const
+    {
+        uint32_t result = 0;
+        for (unsigned i = 0;  i < GROUP_WIDTH;  ++i)
+            result |= uint32_t(ctrl[i] < 0) << i;
+        return result;
+    }
+
+    int8_t ctrl[GROUP_WIDTH];
+#endif
+};
+
+} // namespace FlatHashMapDetail
+
+
+/*****************************************************************************/
+/* FLAT HASH MAP                                                             */
+/*****************************************************************************/
+
+/** Hash map with the same interface as the parts of std::unordered_map
+    that are used on hot paths, but that keeps its entries in one array and
+    finds them with a probe of a separate array of control bytes.  A lookup
+    usually touches one cache line of control bytes and one entry, instead
+    of following the bucket and node pointers of std::unordered_map.
+
+    The capacity is a power of two, and is doubled when the table becomes
+    7/8 full.  Entries move when the table grows, so unlike with
+    std::unordered_map, any insertion invalidates iterators and references.
+    Erasing an entry leaves a tombstone and doesn't move any other entry.
+
+    The hash of the key is mixed before use, so that hashes that are only
+    well distributed in their high bits, such as ColumnIdHasher, are fine.
+*/
+
+template<typename Key, typename Value,
+         typename Hash = std::hash<Key>,
+         typename Equal = std::equal_to<Key> >
+struct FlatHashMap {
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<Key, Value> value_type;
+    typedef size_t size_type;
+
+private:
+    template<bool IsConst>
+    struct Iterator {
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename FlatHashMap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef typename std::conditional<IsConst, const value_type *,
+                                          value_type *>::type pointer;
+        typedef typename std::conditional<IsConst, const value_type &,
+                                          value_type &>::type reference;
+
+        Iterator()
+            : ctrl(nullptr), end(nullptr), slot(nullptr)
+        {
+        }
+
+        // Allows an iterator to be converted to a const_iterator
+        template<bool OtherConst,
+                 typename = typename std::enable_if<IsConst || !OtherConst>::type>
+        Iterator(const Iterator<OtherConst> & other)
+            : ctrl(other.ctrl), end(other.end), slot(other.slot)
+        {
+        }
+
+        reference operator * () const { return *slot; }
+        pointer operator -> () const { return slot; }
+
+        Iterator & operator ++ ()
+        {
+            ++ctrl;
+            ++slot;
+            skipEmpty();
+            return *this;
+        }
+
+        Iterator operator ++ (int)
+        {
+            Iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        template<bool OtherConst>
+        bool operator == (const Iterator<OtherConst> & other) const
+        {
+            return ctrl == other.ctrl;
+        }
+
+        template<bool OtherConst>
+        bool operator != (const Iterator<OtherConst> & other) const
+        {
+            return ctrl != other.ctrl;
+        }
+
+    private:
+        friend struct FlatHashMap;
+        template<bool> friend struct Iterator;
+
+        Iterator(const int8_t * ctrl, const int8_t * end, pointer slot)
+            : ctrl(ctrl), end(end), slot(slot)
+        {
+        }
+
+        void skipEmpty()
+        {
+            while (ctrl != end && *ctrl < 0) {
+                ++ctrl;
+                ++slot;
+            }
+        }
+
+        const int8_t * ctrl;
+        const int8_t * end;
+        pointer slot;
+    };
+
+public:
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    FlatHashMap() noexcept
+        : ctrl_(nullptr), slots_(nullptr), capacity_(0), size_(0),
+          growthLeft_(0)
+    {
+    }
+
+    explicit FlatHashMap(size_t initialSize)
+        : FlatHashMap()
+    {
+        reserve(initialSize);
+    }
+
+    FlatHashMap(const FlatHashMap & other)
+        : FlatHashMap()
+    {
+        reserve(other.size());
+        for (auto & v: other)
+            insertUnique(hashKey(v.first), v);
+    }
+
+    FlatHashMap(FlatHashMap && other) noexcept
+        : FlatHashMap()
+    {
+        swap(other);
+    }
+
+    ~FlatHashMap()
+    {
+        destroyAll();
+        deallocate(ctrl_, slots_, capacity_);
+    }
+
+    FlatHashMap & operator = (const FlatHashMap & other)
+    {
+        FlatHashMap newMe(other);
+        swap(newMe);
+        return *this;
+    }
+
+    FlatHashMap & operator = (FlatHashMap && other) noexcept
+    {
+        FlatHashMap newMe(std::move(other));
+        swap(newMe);
+        return *this;
+    }
+
+    void swap(FlatHashMap & other) noexcept
+    {
+        using std::swap;
+        swap(ctrl_, other.ctrl_);
+        swap(slots_, other.slots_);
+        swap(capacity_, other.capacity_);
+        swap(size_, other.size_);
+        swap(growthLeft_, other.growthLeft_);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /// Number of slots in the table, including the ones kept free
+    size_t capacity() const { return capacity_; }
+
+    iterator begin()
+    {
+        iterator result(ctrl_, ctrl_ + capacity_, slots_);
+        result.skipEmpty();
+        return result;
+    }
+
+    iterator end()
+    {
+        return iterator(ctrl_ + capacity_, ctrl_ + capacity_,
+                        slots_ + capacity_);
+    }
+
+    const_iterator begin() const
+    {
+        const_iterator result(ctrl_, ctrl_ + capacity_, slots_);
+        result.skipEmpty();
+        return result;
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(ctrl_ + capacity_, ctrl_ + capacity_,
+                              slots_ + capacity_);
+    }
+
+    /** Make sure that n entries can be held without the table growing. */
+    void reserve(size_t n)
+    {
+        if (n == 0)
+            return;
+        size_t newCapacity = FlatHashMapDetail::GROUP_WIDTH;
+        while (maxLoad(newCapacity) < n)
+            newCapacity *= 2;
+        if (newCapacity > capacity_)
+            rehash(newCapacity);
+    }
+
+    /** Remove all entries, but keep the memory. */
+    void clear()
+    {
+        destroyAll();
+        if (capacity_)
+            std::memset(ctrl_, FlatHashMapDetail::CTRL_EMPTY,
+                        capacity_ + FlatHashMapDetail::GROUP_WIDTH);
+        size_ = 0;
+        growthLeft_ = maxLoad(capacity_);
+    }
+
+    iterator find(const Key & key)
+    {
+        size_t i = findIndex(key, hashKey(key));
+        return i == NOT_FOUND ? end() : iteratorAt(i);
+    }
+
+    const_iterator find(const Key & key) const
+    {
+        size_t i = findIndex(key, hashKey(key));
+        return i == NOT_FOUND ? end() : const_iterator(iteratorAt(i));
+    }
+
+    size_t count(const Key & key) const
+    {
+        return findIndex(key, hashKey(key)) != NOT_FOUND;
+    }
+
+    Value & at(const Key & key)
+    {
+        size_t i = findIndex(key, hashKey(key));
+        if (i == NOT_FOUND)
+            throw std::out_of_range("FlatHashMap::at(): key not found");
+        return slots_[i].second;
+    }
+
+    const Value & at(const Key & key) const
+    {
+        size_t i = findIndex(key, hashKey(key));
+        if (i == NOT_FOUND)
+            throw std::out_of_range("FlatHashMap::at(): key not found");
+        return slots_[i].second;
+    }
+
+    Value & operator [] (const Key & key)
+    {
+        return try_emplace(key).first->second;
+    }
+
+    Value & operator [] (Key && key)
+    {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    /** Insert an entry with the given key and a value constructed from
+        args, unless there is already an entry with that key.  As with
+        std::unordered_map::try_emplace, the arguments are left alone if
+        nothing is inserted.
+    */
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key & key, Args&&... args)
+    {
+        return emplaceImpl(key, std::forward<Args>(args)...);
+    }
+
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key && key, Args&&... args)
+    {
+        return emplaceImpl(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /** Equivalent to try_emplace, except that a key of another type is
+        first converted to a Key.
+    */
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> emplace(K && key, Args&&... args)
+    {
+        return emplaceKey(std::is_same<typename std::decay<K>::type, Key>(),
+                          std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    std::pair<iterator, bool> insert(const value_type & value)
+    {
+        return emplaceImpl(value.first, value.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type && value)
+    {
+        return emplaceImpl(std::move(value.first), std::move(value.second));
+    }
+
+    /** Erase the entry at the given position, and return the position of
+        the next entry.
+    */
+    iterator erase(const_iterator it)
+    {
+        size_t i = it.ctrl - ctrl_;
+        slots_[i].~value_type();
+        setCtrl(i, FlatHashMapDetail::CTRL_DELETED);
+        --size_;
+        iterator result = iteratorAt(i);
+        ++result;
+        return result;
+    }
+
+    iterator erase(iterator it)
+    {
+        return erase(const_iterator(it));
+    }
+
+    size_t erase(const Key & key)
+    {
+        size_t i = findIndex(key, hashKey(key));
+        if (i == NOT_FOUND)
+            return 0;
+        erase(const_iterator(iteratorAt(i)));
+        return 1;
+    }
+
+private:
+    static constexpr size_t NOT_FOUND = size_t(-1);
+
+    /// Control bytes, with a copy of the first group after the last slot
+    /// so that a group can be loaded at any slot without wrapping around
+    int8_t * ctrl_;
+
+    /// Storage for the entries, constructed only where the slot is full
+    value_type * slots_;
+
+    size_t capacity_;
+    size_t size_;
+
+    /// Number of entries that can still go into empty slots before the
+    /// table grows; deleted slots are counted as used
+    size_t growthLeft_;
+
+    static size_t maxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    size_t hashKey(const Key & key) const
+    {
+        uint64_t h = Hash()(key);
+        h = (h ^ (h >> 32)) * 0x9e3779b97f4a7c15ULL;
+        return h ^ (h >> 29);
+    }
+
+    /// Control byte for an entry with the given hash
+    static int8_t h2(size_t hash)
+    {
+        return int8_t(hash >> 57);
+    }
+
+    iterator iteratorAt(size_t i) const
+    {
+        return iterator(ctrl_ + i, ctrl_ + capacity_, slots_ + i);
+    }
+
+    void setCtrl(size_t i, int8_t value)
+    {
+        ctrl_[i] = value;
+        if (i < FlatHashMapDetail::GROUP_WIDTH)
+            ctrl_[capacity_ + i] = value;
+    }
+
+    /** Calls fn(i) for each slot with the given control byte along the
+        probe sequence of hash, until fn returns true or a group with an
+        empty slot has been scanned.  Returns the slot for which fn returned
+        true, or NOT_FOUND.
+
+        Groups are visited with triangular steps, which visits each group of
+        a table whose size is a power of two.
+    */
+    template<typename Fn>
+    size_t probe(size_t hash, int8_t ctrl, Fn && fn) const
+    {
+        using namespace FlatHashMapDetail;
+        size_t mask = capacity_ - 1;
+        size_t pos = hash & mask;
+        for (size_t step = GROUP_WIDTH;  ;  step += GROUP_WIDTH) {
+            Group group(ctrl_ + pos);
+            for (uint32_t m = group.match(ctrl);  m;  m &= m - 1) {
+                size_t i = (pos + __builtin_ctz(m)) & mask;
+                if (fn(i))
+                    return i;
+            }
+            if (group.matchEmpty())
+                return NOT_FOUND;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    size_t findIndex(const Key & key, size_t hash) const
+    {
+        if (size_ == 0)
+            return NOT_FOUND;
+        return probe(hash, h2(hash),
+                     [&] (size_t i)
+                     {
+                         return Equal()(slots_[i].first, key);
+                     });
+    }
+
+    /// First empty or deleted slot along the probe sequence of hash.  The
+    /// table must have room for it.
+    size_t findFree(size_t hash) const
+    {
+        using namespace FlatHashMapDetail;
+        size_t mask = capacity_ - 1;
+        size_t pos = hash & mask;
+        for (size_t step = GROUP_WIDTH;  ;  step += GROUP_WIDTH) {
+            uint32_t m = Group(ctrl_ + pos).matchEmptyOrDeleted();
+            if (m)
+                return (pos + __builtin_ctz(m)) & mask;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> emplaceKey(std::true_type, K && key,
+                                         Args&&... args)
+    {
+        return emplaceImpl(std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> emplaceKey(std::false_type, K && key,
+                                         Args&&... args)
+    {
+        return emplaceImpl(Key(std::forward<K>(key)),
+                           std::forward<Args>(args)...);
+    }
+
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> emplaceImpl(K && key, Args&&... args)
+    {
+        size_t hash = hashKey(key);
+        size_t i = findIndex(key, hash);
+        if (i != NOT_FOUND)
+            return { iteratorAt(i), false };
+        i = insertUnique(hash, std::piecewise_construct,
+                         std::forward_as_tuple(std::forward<K>(key)),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+        return { iteratorAt(i), true };
+    }
+
+    /// Insert an entry, constructed from args, whose key isn't yet in the
+    /// table
+    template<typename... Args>
+    size_t insertUnique(size_t hash, Args&&... args)
+    {
+        if (growthLeft_ == 0)
+            grow();
+        size_t i = findFree(hash);
+        new (slots_ + i) value_type(std::forward<Args>(args)...);
+        if (ctrl_[i] == FlatHashMapDetail::CTRL_EMPTY)
+            --growthLeft_;
+        setCtrl(i, h2(hash));
+        ++size_;
+        return i;
+    }
+
+    void grow()
+    {
+        // If most of the used slots are tombstones, rehashing in place
+        // frees them without making the table any bigger
+        if (capacity_ && size_ <= maxLoad(capacity_) / 2)
+            rehash(capacity_);
+        else rehash(capacity_ ? 2 * capacity_ : FlatHashMapDetail::GROUP_WIDTH);
+    }
+
+    void rehash(size_t newCapacity)
+    {
+        int8_t * oldCtrl = ctrl_;
+        value_type * oldSlots = slots_;
+        size_t oldCapacity = capacity_;
+
+        allocate(newCapacity);
+
+        for (size_t i = 0;  i < oldCapacity;  ++i) {
+            if (oldCtrl[i] < 0)
+                continue;
+            size_t hash = hashKey(oldSlots[i].first);
+            size_t j = findFree(hash);
+            new (slots_ + j) value_type(std::move(oldSlots[i]));
+            oldSlots[i].~value_type();
+            setCtrl(j, h2(hash));
+        }
+        growthLeft_ = maxLoad(capacity_) - size_;
+
+        deallocate(oldCtrl, oldSlots, oldCapacity);
+    }
+
+    void allocate(size_t capacity)
+    {
+        size_t ctrlSize = capacity + FlatHashMapDetail::GROUP_WIDTH;
+        std::unique_ptr<int8_t[]> ctrl(new int8_t[ctrlSize]);
+        slots_ = std::allocator<value_type>().allocate(capacity);
+        ctrl_ = ctrl.release();
+        std::memset(ctrl_, FlatHashMapDetail::CTRL_EMPTY, ctrlSize);
+        capacity_ = capacity;
+    }
+
+    static void deallocate(int8_t * ctrl, value_type * slots, size_t capacity)
+    {
+        if (!capacity)
+            return;
+        delete[] ctrl;
+        std::allocator<value_type>().deallocate(slots, capacity);
+    }
+
+    void destroyAll()
+    {
+        if (size_ == 0)
+            return;
+        for (size_t i = 0;  i < capacity_;  ++i) {
+            if (ctrl_[i] >= 0)
+                slots_[i].~value_type();
+        }
+    }
+};
+
+template<typename Key, typename Value, typename Hash, typename Equal>
+constexpr size_t FlatHashMap<Key, Value, Hash, Equal>::NOT_FOUND;
+
+template<typename Key, typename Value, typename Hash, typename Equal>
+void swap(FlatHashMap<Key, Value, Hash, Equal> & m1,
+          FlatHashMap<Key, Value, Hash, Equal> & m2) noexcept
+{
+    m1.swap(m2);
+}
+
+} // namespace MLDB
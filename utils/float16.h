@@ -0,0 +1,87 @@
+/** float16.h                                                      -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Conversion between single precision floats and the IEEE 754 half
+    precision format, for storing large arrays of values which don't need
+    more than three significant digits in half of the space.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* FLOAT16                                                                   */
+/*****************************************************************************/
+
+/** Largest finite value of a half precision float. */
+static constexpr float FLOAT16_MAX = 65504.0f;
+
+/** Convert to the bits of a half precision float, rounding to the nearest
+    value with ties to even.  Values too large to be represented become
+    infinities, and NaNs stay NaNs.
+*/
+inline uint16_t floatToFloat16(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t absBits = bits & 0x7fffffff;
+
+    // Infinity or NaN; NaNs keep a mantissa bit so that they stay NaNs
+    if (absBits >= 0x7f800000)
+        return sign | 0x7c00 | (absBits > 0x7f800000 ? 0x200 : 0);
+
+    // Below the smallest normal half value of 2^-14, the result is
+    // subnormal, in units of 2^-24.  Scaling by 2^24 is exact, so the
+    // rounding is the one of nearbyint(), to even in the default mode.
+    if (absBits < 0x38800000) {
+        float absValue;
+        std::memcpy(&absValue, &absBits, 4);
+        return sign | (uint16_t)std::nearbyint(absValue * 16777216.0f);
+    }
+
+    // Normal value: rebias the exponent and round away the 13 bits of
+    // mantissa that don't fit.  A carry out of the mantissa correctly
+    // increments the exponent, up to infinity.
+    uint32_t rounded = absBits + 0xfff + ((absBits >> 13) & 1);
+    if (rounded >= 0x47800000)
+        return sign | 0x7c00;
+    return sign | ((rounded - 0x38000000) >> 13);
+}
+
+/** Convert the bits of a half precision float to a float, which is always
+    exact.
+*/
+inline float float16ToFloat(uint16_t value)
+{
+    uint32_t sign = uint32_t(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+
+    uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else {
+        // Zero or subnormal, in units of 2^-24
+        float result = mantissa * (1.0f / 16777216.0f);
+        return sign ? -result : result;
+    }
+
+    float result;
+    std::memcpy(&result, &bits, 4);
+    return result;
+}
+
+} // namespace MLDB
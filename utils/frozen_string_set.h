@@ -0,0 +1,177 @@
+/** frozen_string_set.h                                           -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Immutable set of strings indexed with a perfect hash, for fixed lists
+    such as stop words that are looked up very often.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* FROZEN STRING SET                                                         */
+/*****************************************************************************/
+
+/** Set of strings that can't be changed once built, in exchange for
+    lookups that take two hashes of the key and one string comparison, and
+    that can be made directly on a range of characters without creating a
+    std::string.
+
+    It uses hash and displace: the strings are split into small buckets
+    with one hash function, and each bucket gets a seed for a second hash
+    function that sends its strings to free slots of the table.
+*/
+
+struct FrozenStringSet {
+    FrozenStringSet() = default;
+
+    FrozenStringSet(std::initializer_list<std::string> strings)
+    {
+        build(std::vector<std::string>(strings));
+    }
+
+    template<typename It>
+    FrozenStringSet(It first, It last)
+    {
+        build(std::vector<std::string>(first, last));
+    }
+
+    /** Return 1 if the set contains the given string and 0 otherwise. */
+    size_t count(const char * str, size_t len) const
+    {
+        if (strings.empty())
+            return 0;
+        uint32_t bucket = hash(str, len, 0) % seeds.size();
+        int32_t index
+            = slots[hash(str, len, seeds[bucket]) & (slots.size() - 1)];
+        return index >= 0
+            && strings[index].size() == len
+            && std::memcmp(strings[index].data(), str, len) == 0;
+    }
+
+    size_t count(const std::string & str) const
+    {
+        return count(str.data(), str.size());
+    }
+
+    size_t size() const
+    {
+        return strings.size();
+    }
+
+    bool empty() const
+    {
+        return strings.empty();
+    }
+
+private:
+    std::vector<std::string> strings;
+
+    /// Seed of the second hash function of each bucket
+    std::vector<uint32_t> seeds;
+
+    /// Index in strings of the string in each slot, or -1 if it's free
+    std::vector<int32_t> slots;
+
+    static uint64_t hash(const char * str, size_t len, uint64_t seed)
+    {
+        // FNV-1a, with the seed mixed into the offset basis
+        uint64_t h = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+        for (size_t i = 0;  i < len;  ++i) {
+            h ^= (unsigned char)str[i];
+            h *= 1099511628211ULL;
+        }
+        return h ^ (h >> 29);
+    }
+
+    void build(std::vector<std::string> input)
+    {
+        std::sort(input.begin(), input.end());
+        input.erase(std::unique(input.begin(), input.end()), input.end());
+        strings = std::move(input);
+        if (strings.empty())
+            return;
+
+        // About four strings per bucket, and a table that is at most half
+        // full, finds a seed for each bucket after a few tries.
+        size_t numSlots = 1;
+        while (numSlots < 2 * strings.size())
+            numSlots *= 2;
+        size_t numBuckets = (strings.size() + 3) / 4;
+
+        std::vector<std::vector<uint32_t> > buckets(numBuckets);
+        for (uint32_t i = 0;  i < strings.size();  ++i) {
+            const std::string & s = strings[i];
+            buckets[hash(s.data(), s.size(), 0) % numBuckets].push_back(i);
+        }
+
+        // The biggest buckets are placed first, while there is room
+        std::vector<uint32_t> order(numBuckets);
+        for (uint32_t i = 0;  i < numBuckets;  ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(),
+                         [&] (uint32_t b1, uint32_t b2)
+                         {
+                             return buckets[b1].size() > buckets[b2].size();
+                         });
+
+        for (;;) {
+            if (tryPlace(buckets, order, numSlots))
+                return;
+            numSlots *= 2;
+        }
+    }
+
+    bool tryPlace(const std::vector<std::vector<uint32_t> > & buckets,
+                  const std::vector<uint32_t> & order,
+                  size_t numSlots)
+    {
+        static constexpr uint32_t MAX_SEED = 1 << 16;
+
+        seeds.assign(buckets.size(), 0);
+        slots.assign(numSlots, -1);
+        std::vector<size_t> placed;
+
+        for (uint32_t b: order) {
+            if (buckets[b].empty())
+                break;
+            bool found = false;
+            for (uint32_t seed = 1;  seed < MAX_SEED && !found;  ++seed) {
+                placed.clear();
+                found = true;
+                for (uint32_t i: buckets[b]) {
+                    const std::string & s = strings[i];
+                    size_t slot = hash(s.data(), s.size(), seed)
+                        & (numSlots - 1);
+                    if (slots[slot] != -1) {
+                        found = false;
+                        break;
+                    }
+                    slots[slot] = i;
+                    placed.push_back(slot);
+                }
+                if (found)
+                    seeds[b] = seed;
+                else {
+                    for (size_t slot: placed)
+                        slots[slot] = -1;
+                }
+            }
+            if (!found)
+                return false;
+        }
+        return true;
+    }
+};
+
+} // namespace MLDB
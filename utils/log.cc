@@ -9,6 +9,12 @@
 #include "log.h"
 #include "mldb/utils/config.h"
 #include "mldb/arch/exception.h"
+#include "mldb/ext/spdlog/include/spdlog/details/mpmc_bounded_q.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
 
 namespace {
     spdlog::level::level_enum stringToLevel(const std::string & level) {
@@ -30,14 +36,217 @@ namespace {
 
 namespace MLDB {
 
+namespace {
+
+/** Number of log messages that can wait to be written out before new ones
+    are dropped, from logging.queueSize or the MLDB_LOG_QUEUE_SIZE
+    environment variable.  With 0, messages are written by the thread that
+    logs them.
+*/
+int getLogQueueSize()
+{
+    int result = 4096;
+    if (const char * env = std::getenv("MLDB_LOG_QUEUE_SIZE"))
+        result = std::atoi(env);
+    auto config = Config::get();
+    if (config)
+        result = config->getInt("logging.queueSize", result);
+    return result;
+}
+
+struct LogQueue;
+
+/** Logger that hands its messages over to the background thread of the
+    log queue, which adds the timestamp, level and name and writes them to
+    the sink.  What is streamed into the message is still formatted by the
+    thread that logs it.
+*/
+struct QueuedLogger: public spdlog::logger {
+    QueuedLogger(const std::string & name, spdlog::sink_ptr sink,
+                 LogQueue & queue)
+        : spdlog::logger(name, std::move(sink)), queue(queue)
+    {
+    }
+
+    virtual void flush() override;
+
+    /// Format and write the message; called on the background thread
+    void write(spdlog::details::log_msg & msg)
+    {
+        spdlog::logger::_log_msg(msg);
+    }
+
+protected:
+    virtual void _log_msg(spdlog::details::log_msg & msg) override;
+
+private:
+    LogQueue & queue;
+};
+
+/** Bounded queue of log messages from any number of threads, written out
+    in order by a single background thread.  Adding a message never takes
+    a lock or waits: when the queue is full the message is dropped and
+    counted instead.
+*/
+struct LogQueue {
+    LogQueue(size_t size)
+        : capacity(roundUpToPowerOfTwo(size)), entries(capacity),
+          queued(0), written(0), dropped(0), sleeping(false),
+          thread([this] () { this->run(); })
+    {
+        thread.detach();
+    }
+
+    static size_t roundUpToPowerOfTwo(size_t size)
+    {
+        size_t result = 2;
+        while (result < size)
+            result *= 2;
+        return result;
+    }
+
+    void push(QueuedLogger * logger, spdlog::details::log_msg & msg)
+    {
+        Entry entry;
+        entry.logger = logger;
+        entry.msg = std::move(msg);
+        if (!entries.enqueue(std::move(entry))) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        if (sleeping.load())
+            wakeup.notify_one();
+    }
+
+    /** Wait for every message queued so far to be written out. */
+    void flush()
+    {
+        uint64_t target = queued.load(std::memory_order_acquire);
+        while (written.load(std::memory_order_acquire) < target) {
+            wakeup.notify_one();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    LogStats getStats() const
+    {
+        LogStats result;
+        result.queueSize = capacity;
+        result.written = written.load(std::memory_order_relaxed);
+        result.dropped = dropped.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    struct Entry {
+        QueuedLogger * logger = nullptr;
+        spdlog::details::log_msg msg;
+    };
+
+    void run()
+    {
+        Entry entry;
+        for (;;) {
+            while (entries.dequeue(entry)) {
+                try {
+                    entry.logger->write(entry.msg);
+                } catch (...) {
+                    // Nowhere to report it; the message is lost
+                }
+                entry.msg.clear();
+                written.fetch_add(1, std::memory_order_release);
+            }
+
+            // Producers only notify when we say we're sleeping, and may
+            // miss the window just before we wait; the timeout bounds the
+            // delay in that case.
+            std::unique_lock<std::mutex> guard(mutex);
+            sleeping = true;
+            if (written.load() == queued.load())
+                wakeup.wait_for(guard, std::chrono::milliseconds(50));
+            sleeping = false;
+        }
+    }
+
+    size_t capacity;
+    spdlog::details::mpmc_bounded_queue<Entry> entries;
+    std::atomic<uint64_t> queued;
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> sleeping;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::thread thread;
+};
+
+void
+QueuedLogger::
+flush()
+{
+    queue.flush();
+    spdlog::logger::flush();
+}
+
+void
+QueuedLogger::
+_log_msg(spdlog::details::log_msg & msg)
+{
+    // Errors are often followed by the end of the program, so make sure
+    // that they get out
+    bool mustFlush = msg.level >= spdlog::level::err;
+    queue.push(this, msg);
+    if (mustFlush)
+        queue.flush();
+}
+
+/** The log queue, or null when messages are written synchronously.  It's
+    never destroyed, as loggers may still be used while the program exits;
+    what it holds is written out by flushLogs() at exit instead.
+*/
+LogQueue * getLogQueue()
+{
+    static LogQueue * result = [] () -> LogQueue *
+        {
+            int size = getLogQueueSize();
+            if (size <= 0)
+                return nullptr;
+            LogQueue * queue = new LogQueue(size);
+            std::atexit(flushLogs);
+            return queue;
+        }();
+    return result;
+}
+
+} // file scope
+
 static constexpr char const * timestampFormat = "%Y-%m-%dT%T.%e%z";
 
 std::shared_ptr<spdlog::logger> getConfiguredLogger(const std::string & name, const std::string & format) {
-    std::shared_ptr<spdlog::logger> logger = spdlog::stdout_logger_mt(name);
+    std::shared_ptr<spdlog::logger> logger;
+    if (LogQueue * queue = getLogQueue()) {
+        logger = std::make_shared<QueuedLogger>
+            (name, spdlog::sinks::stdout_sink_mt::instance(), *queue);
+        spdlog::register_logger(logger);
+    }
+    else logger = spdlog::stdout_logger_mt(name);
     logger->set_pattern(format);
     return logger;
 }
 
+void flushLogs()
+{
+    if (LogQueue * queue = getLogQueue())
+        queue->flush();
+}
+
+LogStats getLogStats()
+{
+    if (LogQueue * queue = getLogQueue())
+        return queue->getStats();
+    return LogStats();
+}
+
 std::shared_ptr<spdlog::logger> getQueryLog() {
     static std::shared_ptr<spdlog::logger> queryLog =
         getConfiguredLogger("query-log", std::string("Q [") + timestampFormat + "] %l %v");
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "mldb/arch/demangle.h"
+#include "mldb/compiler/compiler.h"
 #include <memory>
 
 namespace spdlog {
@@ -24,6 +25,20 @@ std::shared_ptr<spdlog::logger> getQueryLog();
 std::shared_ptr<spdlog::logger> getMldbLog(const std::string & loggerName);
 std::shared_ptr<spdlog::logger> getServerLog();
 
+/** Statistics of the queue through which log messages are written out
+    by a background thread.
+*/
+struct LogStats {
+    size_t queueSize = 0;   ///< Messages that can wait; 0 if synchronous
+    uint64_t written = 0;   ///< Messages written out so far
+    uint64_t dropped = 0;   ///< Messages dropped because the queue was full
+};
+
+LogStats getLogStats();
+
+/** Wait for every message logged so far to be written out. */
+void flushLogs();
+
 template <typename Class>
 std::string
 getLoggerNameFromClass() {
@@ -49,10 +64,10 @@ struct LogDummy {
 };
 
 #define TRACE_MSG(logger)                                               \
-    !logger->should_log(spdlog::level::trace) ? (void) 0 : MLDB::LogDummy() & logger->trace()
+    MLDB_LIKELY(!logger->should_log(spdlog::level::trace)) ? (void) 0 : MLDB::LogDummy() & logger->trace()
 
 #define DEBUG_MSG(logger)                                               \
-    !logger->should_log(spdlog::level::debug) ? (void) 0 : MLDB::LogDummy() & logger->debug()
+    MLDB_LIKELY(!logger->should_log(spdlog::level::debug)) ? (void) 0 : MLDB::LogDummy() & logger->debug()
 
 #define INFO_MSG(logger)                                                \
     !logger->should_log(spdlog::level::info) ? (void) 0 : MLDB::LogDummy() & logger->info()
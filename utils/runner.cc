@@ -10,6 +10,7 @@
 
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -503,54 +504,49 @@ doRunImpl(const vector<string> & command,
         tie(task_.stdErrFd, childFds.stdErr) = CreateStdPipe(false);
     }
 
-    ::flockfile(stdout);
-    ::flockfile(stderr);
-    ::fflush_unlocked(NULL);
-    task_.wrapperPid = fork();
-    int savedErrno = errno;
-    ::funlockfile(stderr);
-    ::funlockfile(stdout);
-    if (task_.wrapperPid == -1) {
-        throw MLDB::Exception(savedErrno, "Runner::run fork");
+    /* The wrapper is launched with posix_spawn rather than fork, so that
+       the page tables of our potentially very large address space don't
+       need to be copied, nor committed, to start a subprocess. When it
+       can't be launched, the failure is reported through the status pipe
+       as it would be by the wrapper, and there is no process to reap. */
+    int launchErrno = 0;
+    try {
+        launchErrno = task_.spawnWrapper(command, childFds);
     }
-    else if (task_.wrapperPid == 0) {
-        try {
-            task_.runWrapper(command, childFds);
-        }
-        catch (...) {
-            ProcessStatus status;
-            status.state = ProcessState::STOPPED;
-            status.setErrorCodes(errno, LaunchError::SUBTASK_LAUNCH);
-            childFds.writeStatus(status);
-
-            exit(-1);
-        }
+    catch (...) {
+        launchErrno = errno;
+    }
+    if (launchErrno) {
+        task_.wrapperPid = 0;
+        ProcessStatus status;
+        status.state = ProcessState::STOPPED;
+        status.setErrorCodes(launchErrno, LaunchError::SUBTASK_LAUNCH);
+        childFds.writeStatus(status);
     }
-    else {
-        task_.statusState = ProcessState::LAUNCHING;
 
-        ML::set_file_flag(task_.statusFd, O_NONBLOCK);
-        auto statusCb = [&] (const epoll_event & event) {
-            handleChildStatus(event);
-        };
-        addFd(task_.statusFd, true, false, statusCb);
-        if (stdOutSink) {
-            ML::set_file_flag(task_.stdOutFd, O_NONBLOCK);
-            auto outputCb = [=] (const epoll_event & event) {
-                handleOutputStatus(event, task_.stdOutFd, stdOutSink_);
-            };
-            addFd(task_.stdOutFd, true, false, outputCb);
-        }
-        if (stdErrSink) {
-            ML::set_file_flag(task_.stdErrFd, O_NONBLOCK);
-            auto outputCb = [=] (const epoll_event & event) {
-                handleOutputStatus(event, task_.stdErrFd, stdErrSink_);
-            };
-            addFd(task_.stdErrFd, true, false, outputCb);
-        }
+    task_.statusState = ProcessState::LAUNCHING;
 
-        childFds.close();
+    ML::set_file_flag(task_.statusFd, O_NONBLOCK);
+    auto statusCb = [&] (const epoll_event & event) {
+        handleChildStatus(event);
+    };
+    addFd(task_.statusFd, true, false, statusCb);
+    if (stdOutSink) {
+        ML::set_file_flag(task_.stdOutFd, O_NONBLOCK);
+        auto outputCb = [=] (const epoll_event & event) {
+            handleOutputStatus(event, task_.stdOutFd, stdOutSink_);
+        };
+        addFd(task_.stdOutFd, true, false, outputCb);
+    }
+    if (stdErrSink) {
+        ML::set_file_flag(task_.stdErrFd, O_NONBLOCK);
+        auto outputCb = [=] (const epoll_event & event) {
+            handleOutputStatus(event, task_.stdErrFd, stdErrSink_);
+        };
+        addFd(task_.stdErrFd, true, false, outputCb);
     }
+
+    childFds.close();
 }
 
 bool
@@ -662,9 +658,9 @@ Task()
       statusState(ProcessState::UNKNOWN)
 {}
 
-void
+int
 Runner::Task::
-runWrapper(const vector<string> & command, ProcessFds & fds)
+spawnWrapper(const vector<string> & command, const ProcessFds & fds)
 {
     // Find runner_helper path
     string runnerHelper = findRunnerHelper();
@@ -672,8 +668,6 @@ runWrapper(const vector<string> & command, ProcessFds & fds)
     vector<string> preArgs = { /*"gdb", "--tty", "/dev/pts/48", "--args"*/ /*"../strace-code/strace", "-b", "execve", "-ftttT", "-o", "runner_helper.strace"*/ };
 
 
-    // Set up the arguments before we fork, as we don't want to call malloc()
-    // from the fork, and it can be called from c_str() in theory.
     auto len = command.size();
     char * argv[len + 3 + preArgs.size()];
 
@@ -694,25 +688,12 @@ runWrapper(const vector<string> & command, ProcessFds & fds)
     }
     argv[idx++] = nullptr;
 
-    std::vector<char *> env;
-
-    char * const * p = environ;
-
-    while (*p) {
-        env.push_back(*p);
-        ++p;
-    }
-
-    env.push_back(nullptr);
-
-    char * const * envp = &env[0];
-
-    int res = execve(argv[0], argv, envp);
-    if (res == -1) {
-        throw MLDB::Exception(errno, "launching runner helper");
-    }
-
-    throw MLDB::Exception("You are the King of Time!");
+    /* glibc implements posix_spawn with clone(CLONE_VM | CLONE_VFORK),
+       which shares our memory with the child until it has called exec, and
+       returns the error of exec when it fails. The wrapper closes the
+       descriptors that it doesn't need itself. */
+    return ::posix_spawn(&wrapperPid, argv[0], nullptr, nullptr,
+                         argv, environ);
 }
 
 string
@@ -758,12 +739,12 @@ void
 Runner::Task::
 postTerminate(Runner & runner)
 {
-    if (wrapperPid <= 0) {
-        throw MLDB::Exception("wrapperPid <= 0, has postTerminate been executed before?");
+    if (wrapperPid < 0) {
+        throw MLDB::Exception("wrapperPid < 0, has postTerminate been executed before?");
     }
 
     int wrapperPidStatus;
-    while (true) {
+    while (wrapperPid > 0) {
         int res = ::waitpid(wrapperPid, &wrapperPidStatus, 0);
         if (res == wrapperPid) {
             break;
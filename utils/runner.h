@@ -206,8 +206,11 @@ private:
         void setupInSink();
         void flushInSink();
         void flushStdInBuffer();
-        void runWrapper(const std::vector<std::string> & command,
-                        ProcessFds & fds);
+        /** Launch the runner helper to run the command, setting
+            wrapperPid. Returns 0 or the error that prevented the launch.
+        */
+        int spawnWrapper(const std::vector<std::string> & command,
+                         const ProcessFds & fds);
         std::string findRunnerHelper();
 
         void postTerminate(Runner & runner);
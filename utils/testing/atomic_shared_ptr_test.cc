@@ -0,0 +1,173 @@
+/* atomic_shared_ptr_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Tests and benchmark for the atomic_shared_ptr implementations.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/atomic_shared_ptr.h"
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+std::atomic<int> numLive(0);
+
+struct Counted {
+    Counted(int value)
+        : value(value)
+    {
+        ++numLive;
+    }
+
+    ~Counted()
+    {
+        --numLive;
+    }
+
+    int value;
+};
+
+template<typename Ptr>
+void testSingleThreaded()
+{
+    {
+        Ptr ptr;
+        BOOST_CHECK(!ptr.load());
+
+        auto one = std::make_shared<Counted>(1);
+        ptr.store(one);
+        BOOST_CHECK_EQUAL(ptr.load(), one);
+
+        auto two = std::make_shared<Counted>(2);
+        BOOST_CHECK_EQUAL(ptr.exchange(two), one);
+        BOOST_CHECK_EQUAL(ptr.load(), two);
+
+        // Fails, and gives back the current value
+        std::shared_ptr<Counted> expected = one;
+        BOOST_CHECK(!ptr.compare_exchange_strong(expected, one));
+        BOOST_CHECK_EQUAL(expected, two);
+        BOOST_CHECK_EQUAL(ptr.load(), two);
+
+        // Succeeds
+        BOOST_CHECK(ptr.compare_exchange_strong(expected, one));
+        BOOST_CHECK_EQUAL(expected, two);
+        BOOST_CHECK_EQUAL(ptr.load(), one);
+
+        // Empty values work in both directions
+        expected = one;
+        BOOST_CHECK(ptr.compare_exchange_strong(expected, nullptr));
+        BOOST_CHECK(!ptr.load());
+        expected = nullptr;
+        BOOST_CHECK(ptr.compare_exchange_strong(expected, two));
+        BOOST_CHECK_EQUAL(ptr.load(), two);
+        BOOST_CHECK_EQUAL(ptr.exchange(nullptr), two);
+        BOOST_CHECK(!ptr.exchange(nullptr));
+
+        Ptr initialized(one);
+        BOOST_CHECK_EQUAL(initialized.load().get(), one.get());
+    }
+
+    BOOST_CHECK_EQUAL(numLive, 0);
+}
+
+/** Have readers load the pointer over and over while writers replace it,
+    checking that they always see a live value.  Returns the number of
+    loads per second.
+*/
+template<typename Ptr>
+double runContended(int numReaders, int numWriters, double seconds)
+{
+    Ptr ptr(std::make_shared<Counted>(0));
+    std::atomic<bool> finished(false);
+    std::atomic<uint64_t> numLoads(0);
+    std::atomic<int> errors(0);
+
+    auto reader = [&] ()
+        {
+            uint64_t loads = 0;
+            while (!finished.load(std::memory_order_relaxed)) {
+                for (int i = 0;  i < 100;  ++i) {
+                    std::shared_ptr<Counted> val = ptr.load();
+                    if (!val || val->value < 0)
+                        ++errors;
+                }
+                loads += 100;
+            }
+            numLoads += loads;
+        };
+
+    auto writer = [&] ()
+        {
+            int i = 0;
+            while (!finished.load(std::memory_order_relaxed)) {
+                ptr.store(std::make_shared<Counted>(++i));
+                std::shared_ptr<Counted> expected = ptr.load();
+                ptr.compare_exchange_strong(expected,
+                                            std::make_shared<Counted>(++i));
+                ptr.exchange(std::make_shared<Counted>(++i));
+                std::this_thread::yield();
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < numReaders;  ++i)
+        threads.emplace_back(reader);
+    for (int i = 0;  i < numWriters;  ++i)
+        threads.emplace_back(writer);
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    finished = true;
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+    return numLoads / seconds;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_spinlock_atomic_shared_ptr )
+{
+    testSingleThreaded<spinlock_atomic_shared_ptr<Counted> >();
+}
+
+BOOST_AUTO_TEST_CASE( test_lock_free_atomic_shared_ptr )
+{
+    testSingleThreaded<lock_free_atomic_shared_ptr<Counted> >();
+}
+
+BOOST_AUTO_TEST_CASE( test_lock_free_atomic_shared_ptr_contended )
+{
+    runContended<lock_free_atomic_shared_ptr<Counted> >(8, 2, 0.5);
+    // Every value that was swapped out has been freed
+    BOOST_CHECK_EQUAL(numLive, 0);
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_atomic_shared_ptr )
+{
+    int numThreads = std::max<int>(2, std::thread::hardware_concurrency());
+
+    for (int readers: { 1, numThreads / 2, numThreads }) {
+        double spinlock
+            = runContended<spinlock_atomic_shared_ptr<Counted> >
+            (readers, 1, 0.25);
+        double lockFree
+            = runContended<lock_free_atomic_shared_ptr<Counted> >
+            (readers, 1, 0.25);
+        cerr << readers << " readers: spinlock " << spinlock / 1e6
+             << "M loads/s, lock-free " << lockFree / 1e6
+             << "M loads/s" << endl;
+    }
+
+    BOOST_CHECK_EQUAL(numLive, 0);
+}
@@ -1,5 +1,7 @@
 // This file is part of MLDB. Copyright 2015 Datacratic. All rights reserved.
 
+#include <fstream>
+
 #include "mldb/utils/testing/benchmarks.h"
 
 using namespace std;
@@ -21,6 +23,17 @@ collectBenchmark(const vector<string> & tags, double delta)
     }
 }
 
+void
+Benchmarks::
+collectCounters(const vector<string> & tags, const PerfCounts & counts)
+    noexcept
+{
+    Guard lock(dataLock_);
+    for (const string & tag: tags) {
+        counters_[tag] += counts;
+    }
+}
+
 void
 Benchmarks::
 dumpTotals(ostream & out)
@@ -31,7 +44,17 @@ dumpTotals(ostream & out)
     for (const auto & entry: data_) {
         result += ("  " + entry.first
                    + ": " + to_string(entry.second)
-                   + " s.\n");
+                   + " s.");
+        auto it = counters_.find(entry.first);
+        if (it != counters_.end()) {
+            const PerfCounts & c = it->second;
+            result += (" " + to_string(c.instructions) + " instructions, "
+                       + to_string(c.ipc()) + " IPC, "
+                       + to_string(c.llcMisses) + " LLC misses, "
+                       + to_string(c.branchMisses) + " branch misses, "
+                       + to_string(c.dtlbMisses) + " dTLB misses");
+        }
+        result += "\n";
     }
 
     out << result;
@@ -43,4 +66,32 @@ clear()
 {
     Guard lock(dataLock_);
     data_.clear();
+    counters_.clear();
+}
+
+
+/* PEAK RESIDENT SET SIZE */
+
+namespace MLDB {
+
+void
+resetPeakResidentSetSize()
+{
+    // Writing 5 resets the VmHWM of /proc/self/status
+    std::ofstream stream("/proc/self/clear_refs");
+    stream << "5" << endl;
 }
+
+size_t
+getPeakResidentSetSize()
+{
+    std::ifstream stream("/proc/self/status");
+    string line;
+    while (getline(stream, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::stoull(line.substr(6)) * 1024;
+    }
+    return 0;
+}
+
+} // namespace MLDB
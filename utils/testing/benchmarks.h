@@ -14,11 +14,13 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
 #include "mldb/types/date.h"
+#include "mldb/arch/perf_counters.h"
 
 
 namespace MLDB {
@@ -37,6 +39,10 @@ struct Benchmarks {
     void collectBenchmark(const std::vector<std::string> & tags,
                           double delta) noexcept;
 
+    /** Accumulate the hardware counters of a task under its tags. */
+    void collectCounters(const std::vector<std::string> & tags,
+                         const PerfCounts & counts) noexcept;
+
     void dumpTotals(std::ostream & ostream = std::cerr);
     void clear();
 
@@ -45,9 +51,24 @@ struct Benchmarks {
 
     Lock dataLock_;
     std::map<std::string, double> data_;
+
+    /// Only filled in when the hardware counters can be read
+    std::map<std::string, PerfCounts> counters_;
 };
 
 
+/** Reset the high water mark of the resident set size of the process, so
+    that the peak of the next operation can be read on its own.  This only
+    works on Linux; elsewhere the peak is that of the whole process.
+*/
+void resetPeakResidentSetSize();
+
+/** Return the peak resident set size of the process in bytes, since it
+    started or resetPeakResidentSetSize() was last called.
+*/
+size_t getPeakResidentSetSize();
+
+
 /****************************************************************************/
 /* BENCHMARK                                                                */
 /****************************************************************************/
@@ -56,21 +77,28 @@ struct Benchmarks {
    registers that delta for the associated tags to a central "Benchmarks"
    instance.
    It makes use of RAII, and thus starts counting time at instantiation and
-   stops when destroyed. */
+   stops when destroyed.  When they can be read, the hardware counters of
+   the threads of the process are collected over the same time. */
 
 struct Benchmark {
     Benchmark(Benchmarks & bInstance, const std::string & tag)
-        : bInstance_(bInstance), tags_({tag}), start_(Date::now())
-    {}
+        : bInstance_(bInstance), tags_({tag})
+    {
+        start();
+    }
 
     Benchmark(Benchmarks & bInstance, const std::vector<std::string> & tags)
-        : bInstance_(bInstance), tags_(tags), start_(Date::now())
-    {}
+        : bInstance_(bInstance), tags_(tags)
+    {
+        start();
+    }
 
     Benchmark(Benchmarks & bInstance,
               const std::initializer_list<std::string> & tags)
-        : bInstance_(bInstance), tags_(tags), start_(Date::now())
-    {}
+        : bInstance_(bInstance), tags_(tags)
+    {
+        start();
+    }
 
     ~Benchmark()
     {
@@ -81,11 +109,22 @@ struct Benchmark {
     {
         double delta = Date::now() - start_;
         bInstance_.collectBenchmark(tags_, delta);
+        if (counters_)
+            bInstance_.collectCounters(tags_, counters_->read());
     }
 
     Benchmarks & bInstance_;
     std::vector<std::string> tags_;
+    std::unique_ptr<ProcessPerfCounters> counters_;
     Date start_;
+
+private:
+    void start()
+    {
+        if (PerfCounterGroup::available())
+            counters_.reset(new ProcessPerfCounters());
+        start_ = Date::now();
+    }
 };
 
 } // namespace MLDB
@@ -0,0 +1,71 @@
+/* blocked_bloom_filter_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the blocked Bloom filter.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/blocked_bloom_filter.h"
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_empty_filter )
+{
+    // Not built yet, so it can't say that anything is absent
+    BlockedBloomFilter filter;
+    BOOST_CHECK(filter.mayContain(0));
+    BOOST_CHECK(filter.mayContain(12345));
+    BOOST_CHECK_EQUAL(filter.memUsage(), 0);
+
+    BlockedBloomFilter none(0);
+    BOOST_CHECK(!none.mayContain(12345));
+}
+
+BOOST_AUTO_TEST_CASE( test_false_positive_rate )
+{
+    std::mt19937_64 rng(1);
+
+    for (size_t n: { 10, 1000, 100000 }) {
+        BlockedBloomFilter filter(n);
+        std::vector<uint64_t> keys;
+        for (size_t i = 0;  i < n;  ++i) {
+            keys.push_back(rng());
+            filter.insert(keys.back());
+        }
+
+        // No false negatives
+        for (uint64_t k: keys)
+            BOOST_REQUIRE(filter.mayContain(k));
+
+        size_t numFalsePositives = 0, numTries = 1000000;
+        for (size_t i = 0;  i < numTries;  ++i)
+            numFalsePositives += filter.mayContain(rng());
+
+        double rate = 1.0 * numFalsePositives / numTries;
+        cerr << n << " keys: " << filter.memUsage() << " bytes, "
+             << rate * 100 << "% false positives" << endl;
+        BOOST_CHECK_LT(rate, 0.005);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_structured_keys )
+{
+    // Keys that share most of their bits, like consecutive integers or
+    // the hashes of a single index shard, still spread over the filter
+    size_t n = 100000;
+    BlockedBloomFilter filter(n);
+    for (uint64_t i = 0;  i < n;  ++i)
+        filter.insert(i << 23);
+
+    size_t numFalsePositives = 0;
+    for (uint64_t i = n;  i < 11 * n;  ++i)
+        numFalsePositives += filter.mayContain(i << 23);
+
+    BOOST_CHECK_LT(1.0 * numFalsePositives / (10 * n), 0.005);
+}
@@ -0,0 +1,90 @@
+/* flat_hash_map_benchmark.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Compares the flat hash map against std::unordered_map and
+   Lightweight_Hash for the access patterns of hot paths in MLDB: counting
+   with operator [], and finding keys which may not be there.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/flat_hash_map.h"
+#include "mldb/jml/utils/lightweight_hash.h"
+#include "mldb/types/date.h"
+#include <boost/test/unit_test.hpp>
+#include <unordered_map>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+/// Hash in the style of ColumnIdHasher, which only mixes the high bits
+struct MultiplyHasher {
+    size_t operator () (uint64_t id) const
+    {
+        return id * 0x9e3779b97f4a7c15ULL;
+    }
+};
+
+std::vector<uint64_t> makeKeys(size_t numKeys, size_t numDistinct)
+{
+    std::mt19937_64 rng(1);
+    std::vector<uint64_t> distinct(numDistinct);
+    for (auto & k: distinct)
+        k = rng();
+    std::vector<uint64_t> result(numKeys);
+    for (auto & k: result)
+        k = distinct[rng() % numDistinct];
+    return result;
+}
+
+template<typename Map>
+void runBenchmark(const std::string & name,
+                  const std::vector<uint64_t> & keys,
+                  const std::vector<uint64_t> & probes)
+{
+    Date before = Date::now();
+
+    Map counts;
+    for (uint64_t k: keys)
+        counts[k] += 1;
+
+    Date between = Date::now();
+
+    size_t found = 0;
+    for (uint64_t k: probes)
+        found += counts.find(k) != counts.end();
+
+    Date after = Date::now();
+
+    cerr << name << ": " << counts.size() << " keys; count "
+         << between.secondsSince(before) * 1000.0 << "ms; find "
+         << after.secondsSince(between) * 1000.0 << "ms (" << found
+         << " found)" << endl;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( benchmark_counting )
+{
+    for (size_t numDistinct: { 1000, 100000, 2000000 }) {
+        std::vector<uint64_t> keys = makeKeys(10000000, numDistinct);
+
+        // Half of the probes are for keys which aren't in the map
+        std::vector<uint64_t> probes = makeKeys(10000000, numDistinct);
+        for (size_t i = 0;  i < probes.size();  i += 2)
+            probes[i] += 1;
+
+        cerr << "--- " << numDistinct << " distinct keys" << endl;
+        runBenchmark<std::unordered_map<uint64_t, uint64_t, MultiplyHasher> >
+            ("unordered_map   ", keys, probes);
+        runBenchmark<Lightweight_Hash<uint64_t, uint64_t> >
+            ("Lightweight_Hash", keys, probes);
+        runBenchmark<FlatHashMap<uint64_t, uint64_t, MultiplyHasher> >
+            ("FlatHashMap     ", keys, probes);
+    }
+}
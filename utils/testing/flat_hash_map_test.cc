@@ -0,0 +1,190 @@
+/* flat_hash_map_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the flat hash map, against std::unordered_map.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/flat_hash_map.h"
+#include "mldb/jml/utils/testing/live_counting_obj.h"
+#include <boost/test/unit_test.hpp>
+#include <unordered_map>
+#include <random>
+#include <string>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_empty )
+{
+    FlatHashMap<int, int> m;
+    const FlatHashMap<int, int> & cm = m;
+    BOOST_CHECK(m.empty());
+    BOOST_CHECK_EQUAL(m.size(), 0);
+    BOOST_CHECK(m.begin() == m.end());
+    BOOST_CHECK(cm.begin() == cm.end());
+    BOOST_CHECK(m.find(1) == m.end());
+    BOOST_CHECK_EQUAL(m.count(1), 0);
+    BOOST_CHECK_EQUAL(m.erase(1), 0);
+    BOOST_CHECK_THROW(m.at(1), std::out_of_range);
+
+    FlatHashMap<int, int> m2(m);
+    BOOST_CHECK(m2.empty());
+    BOOST_CHECK_EQUAL(m2.capacity(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_basic )
+{
+    FlatHashMap<std::string, int> m;
+    m["one"] = 1;
+    BOOST_CHECK_EQUAL(m.size(), 1);
+    BOOST_CHECK_EQUAL(m["one"], 1);
+    BOOST_CHECK_EQUAL(m.at("one"), 1);
+
+    auto res = m.emplace("two", 2);
+    BOOST_CHECK(res.second);
+    BOOST_CHECK_EQUAL(res.first->first, "two");
+    BOOST_CHECK_EQUAL(res.first->second, 2);
+
+    // Emplacing an existing key leaves the value alone
+    res = m.emplace("two", 3);
+    BOOST_CHECK(!res.second);
+    BOOST_CHECK_EQUAL(res.first->second, 2);
+
+    res = m.insert({ "three", 3 });
+    BOOST_CHECK(res.second);
+    BOOST_CHECK_EQUAL(m.size(), 3);
+
+    int total = 0;
+    for (auto & v: m)
+        total += v.second;
+    BOOST_CHECK_EQUAL(total, 6);
+
+    BOOST_CHECK_EQUAL(m.erase("one"), 1);
+    BOOST_CHECK_EQUAL(m.erase("one"), 0);
+    BOOST_CHECK_EQUAL(m.count("one"), 0);
+    BOOST_CHECK_EQUAL(m.size(), 2);
+
+    FlatHashMap<std::string, int> m2;
+    m2.swap(m);
+    BOOST_CHECK(m.empty());
+    BOOST_CHECK_EQUAL(m2.size(), 2);
+    BOOST_CHECK_EQUAL(m2.at("three"), 3);
+
+    m2.clear();
+    BOOST_CHECK(m2.empty());
+    BOOST_CHECK(m2.find("two") == m2.end());
+    BOOST_CHECK(m2.begin() == m2.end());
+}
+
+BOOST_AUTO_TEST_CASE( test_erase_while_iterating )
+{
+    FlatHashMap<int, int> m;
+    for (int i = 0;  i < 1000;  ++i)
+        m[i] = i;
+
+    for (auto it = m.begin();  it != m.end();  ) {
+        if (it->first % 3 == 0)
+            it = m.erase(it);
+        else ++it;
+    }
+
+    BOOST_CHECK_EQUAL(m.size(), 666);
+    for (int i = 0;  i < 1000;  ++i)
+        BOOST_CHECK_EQUAL(m.count(i), i % 3 != 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_tombstones_reused )
+{
+    // Repeated inserts and erases mustn't make the table grow without bound
+    FlatHashMap<int, int> m;
+    for (int i = 0;  i < 100000;  ++i) {
+        m[i] = i;
+        if (i >= 10)
+            BOOST_REQUIRE_EQUAL(m.erase(i - 10), 1);
+    }
+    BOOST_CHECK_EQUAL(m.size(), 10);
+    BOOST_CHECK_LE(m.capacity(), 64);
+}
+
+BOOST_AUTO_TEST_CASE( test_random_against_unordered_map )
+{
+    std::mt19937 rng(1);
+    FlatHashMap<uint64_t, uint64_t> m;
+    std::unordered_map<uint64_t, uint64_t> expected;
+
+    for (int i = 0;  i < 200000;  ++i) {
+        // Small key range, so that there are plenty of hits and erases
+        uint64_t key = rng() % 5000;
+        switch (rng() % 4) {
+        case 0:
+        case 1:
+            m[key] += i;
+            expected[key] += i;
+            break;
+        case 2:
+            BOOST_REQUIRE_EQUAL(m.erase(key), expected.erase(key));
+            break;
+        case 3: {
+            auto it = m.find(key);
+            auto it2 = expected.find(key);
+            BOOST_REQUIRE_EQUAL(it == m.end(), it2 == expected.end());
+            if (it2 != expected.end())
+                BOOST_REQUIRE_EQUAL(it->second, it2->second);
+            break;
+        }
+        }
+        BOOST_REQUIRE_EQUAL(m.size(), expected.size());
+    }
+
+    size_t n = 0;
+    for (auto & v: m) {
+        BOOST_CHECK_EQUAL(expected.at(v.first), v.second);
+        ++n;
+    }
+    BOOST_CHECK_EQUAL(n, expected.size());
+
+    FlatHashMap<uint64_t, uint64_t> copied(m);
+    BOOST_CHECK_EQUAL(copied.size(), m.size());
+    for (auto & v: expected)
+        BOOST_CHECK_EQUAL(copied.at(v.first), v.second);
+}
+
+struct BadHash {
+    size_t operator () (int i) const
+    {
+        return i % 4;
+    }
+};
+
+BOOST_AUTO_TEST_CASE( test_colliding_hashes )
+{
+    // Every key has one of four hashes, so probes go a long way
+    FlatHashMap<int, int, BadHash> m;
+    for (int i = 0;  i < 500;  ++i)
+        m[i] = i;
+    for (int i = 0;  i < 500;  i += 2)
+        m.erase(i);
+    for (int i = 0;  i < 500;  ++i)
+        BOOST_CHECK_EQUAL(m.count(i), i % 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_constructed_and_destroyed )
+{
+    constructed = destroyed = 0;
+    {
+        FlatHashMap<int, Obj> m;
+        for (int i = 0;  i < 1000;  ++i)
+            m[i] = i;
+        for (int i = 0;  i < 1000;  i += 2)
+            m.erase(i);
+        FlatHashMap<int, Obj> m2(m);
+        FlatHashMap<int, Obj> m3(std::move(m2));
+        m = m3;
+        m3.clear();
+        BOOST_CHECK_EQUAL(constructed - destroyed, 500);
+    }
+    BOOST_CHECK_EQUAL(constructed, destroyed);
+}
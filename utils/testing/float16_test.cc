@@ -0,0 +1,90 @@
+/* float16_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the half precision float conversions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/float16.h"
+#include <boost/test/unit_test.hpp>
+#include <limits>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_known_values )
+{
+    BOOST_CHECK_EQUAL(floatToFloat16(0.0f), 0x0000);
+    BOOST_CHECK_EQUAL(floatToFloat16(-0.0f), 0x8000);
+    BOOST_CHECK_EQUAL(floatToFloat16(1.0f), 0x3c00);
+    BOOST_CHECK_EQUAL(floatToFloat16(-2.0f), 0xc000);
+    BOOST_CHECK_EQUAL(floatToFloat16(0.5f), 0x3800);
+    BOOST_CHECK_EQUAL(floatToFloat16(FLOAT16_MAX), 0x7bff);
+    BOOST_CHECK_EQUAL(floatToFloat16(1.0f / 16384), 0x0400);  // smallest normal
+    BOOST_CHECK_EQUAL(floatToFloat16(1.0f / 16777216), 0x0001);  // smallest subnormal
+
+    BOOST_CHECK_EQUAL(float16ToFloat(0x3c00), 1.0f);
+    BOOST_CHECK_EQUAL(float16ToFloat(0x7bff), FLOAT16_MAX);
+    BOOST_CHECK_EQUAL(float16ToFloat(0x0001), 1.0f / 16777216);
+    BOOST_CHECK_EQUAL(float16ToFloat(0x8001), -1.0f / 16777216);
+}
+
+BOOST_AUTO_TEST_CASE( test_special_values )
+{
+    float inf = std::numeric_limits<float>::infinity();
+    BOOST_CHECK_EQUAL(floatToFloat16(inf), 0x7c00);
+    BOOST_CHECK_EQUAL(floatToFloat16(-inf), 0xfc00);
+    BOOST_CHECK_EQUAL(float16ToFloat(0x7c00), inf);
+    BOOST_CHECK_EQUAL(float16ToFloat(0xfc00), -inf);
+
+    BOOST_CHECK(std::isnan(float16ToFloat
+                           (floatToFloat16(std::numeric_limits<float>::quiet_NaN()))));
+
+    // Too large to represent
+    BOOST_CHECK_EQUAL(floatToFloat16(65520.0f), 0x7c00);
+    BOOST_CHECK_EQUAL(floatToFloat16(-1e10f), 0xfc00);
+    // ... but this one rounds down to the largest value
+    BOOST_CHECK_EQUAL(floatToFloat16(65519.0f), 0x7bff);
+}
+
+BOOST_AUTO_TEST_CASE( test_rounding )
+{
+    // 1 + 2^-11 is halfway between 1 and the next half, and rounds to even
+    BOOST_CHECK_EQUAL(floatToFloat16(1.0f + 1.0f / 2048), 0x3c00);
+    BOOST_CHECK_EQUAL(floatToFloat16(1.0f + 3.0f / 2048), 0x3c02);
+    BOOST_CHECK_EQUAL(floatToFloat16(1.0f + 1.1f / 2048), 0x3c01);
+
+    // Same for subnormals, in units of 2^-24
+    BOOST_CHECK_EQUAL(floatToFloat16(0.5f / 16777216), 0x0000);
+    BOOST_CHECK_EQUAL(floatToFloat16(1.5f / 16777216), 0x0002);
+
+    // Rounding up the largest subnormal gives the smallest normal
+    BOOST_CHECK_EQUAL(floatToFloat16(1023.9f / 16777216), 0x0400);
+
+    // Rounding up the mantissa carries into the exponent
+    BOOST_CHECK_EQUAL(floatToFloat16(1.9999f), 0x4000);
+}
+
+BOOST_AUTO_TEST_CASE( test_round_trip )
+{
+    // Every half converts to a float exactly, and back to itself
+    for (unsigned i = 0;  i < 65536;  ++i) {
+        uint16_t h = i;
+        float f = float16ToFloat(h);
+        if (std::isnan(f)) {
+            BOOST_REQUIRE_EQUAL(h & 0x7c00, 0x7c00);
+            BOOST_REQUIRE(std::isnan(float16ToFloat(floatToFloat16(f))));
+            continue;
+        }
+        BOOST_REQUIRE_EQUAL(floatToFloat16(f), h);
+    }
+
+    // And the error of a conversion is at most half of a unit in the last
+    // place (2^-11 relative)
+    for (float f = 1e-4f;  f < 6e4f;  f *= 1.001f) {
+        float r = float16ToFloat(floatToFloat16(f));
+        BOOST_REQUIRE_LE(std::abs(r - f), f / 2048);
+    }
+}
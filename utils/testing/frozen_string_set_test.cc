@@ -0,0 +1,55 @@
+/* frozen_string_set_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of the frozen string set.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/frozen_string_set.h"
+#include <boost/test/unit_test.hpp>
+#include <set>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_empty )
+{
+    FrozenStringSet set;
+    BOOST_CHECK(set.empty());
+    BOOST_CHECK_EQUAL(set.count(""), 0);
+    BOOST_CHECK_EQUAL(set.count("a"), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_small )
+{
+    FrozenStringSet set{"the", "a", "an", "the", ""};
+    BOOST_CHECK_EQUAL(set.size(), 4);
+    BOOST_CHECK_EQUAL(set.count("the"), 1);
+    BOOST_CHECK_EQUAL(set.count("a"), 1);
+    BOOST_CHECK_EQUAL(set.count("an"), 1);
+    BOOST_CHECK_EQUAL(set.count(""), 1);
+    BOOST_CHECK_EQUAL(set.count("then"), 0);
+    BOOST_CHECK_EQUAL(set.count("th"), 0);
+
+    // Lookups of part of a buffer
+    const char * text = "another";
+    BOOST_CHECK_EQUAL(set.count(text, 2), 1);
+    BOOST_CHECK_EQUAL(set.count(text, 3), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_many )
+{
+    std::set<std::string> strings;
+    for (int i = 0;  i < 20000;  i += 2)
+        strings.insert("word" + std::to_string(i));
+
+    FrozenStringSet set(strings.begin(), strings.end());
+    BOOST_CHECK_EQUAL(set.size(), strings.size());
+
+    for (int i = 0;  i < 20000;  ++i) {
+        std::string s = "word" + std::to_string(i);
+        BOOST_CHECK_EQUAL(set.count(s), strings.count(s));
+    }
+}
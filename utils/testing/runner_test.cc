@@ -642,7 +642,7 @@ BOOST_AUTO_TEST_CASE( test_set_prctl_from_thread )
 
 #if 1
 /* This test ensures that onTerminate is called with the appropriate RunResult
- * when the runWrapper process fails. */
+ * when the runner helper can't be launched. */
 BOOST_AUTO_TEST_CASE( test_unexisting_runner_helper )
 {
     BlockedSignals blockedSigs2(SIGCHLD);
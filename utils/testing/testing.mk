@@ -17,8 +17,14 @@ $(eval $(call test,command_expression_test,command_expression test_utils,boost))
 $(eval $(call test,config_test,config,boost))
 $(eval $(call test,logger_test,log,boost))
 $(eval $(call test,compact_vector_test,arch,boost))
+$(eval $(call test,atomic_shared_ptr_test,arch,boost))
 $(eval $(call test,fixture_test,test_utils,boost))
 $(eval $(call test,print_utils_test,,boost))
+$(eval $(call test,frozen_string_set_test,,boost))
+$(eval $(call test,blocked_bloom_filter_test,,boost))
+$(eval $(call test,flat_hash_map_test,arch,boost))
+$(eval $(call test,flat_hash_map_benchmark,arch types,boost manual))
+$(eval $(call test,float16_test,,boost))
 
 
 $(eval $(call program,runner_test_helper,utils))
@@ -8,7 +8,9 @@
 
 #include "compressor.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
 #include <zlib.h>
+#include <cstring>
 #include <iostream>
 #include <mutex>
 #include <map>
@@ -382,6 +384,285 @@ finish(const OnData & onData)
 static Compressor::Register<GzipCompressor>
 registerGzipCompressor("gzip", {"gz"});
 
+
+/*****************************************************************************/
+/* GZIP DECOMPRESSOR                                                         */
+/*****************************************************************************/
+
+/** Gzip decompressor that handles files made of several members
+    concatenated together, as written by pigz or bgzip.
+
+    Members in the BGZF format (used by bgzip) record their compressed
+    length in their header, so a batch of them can be located without
+    decompressing anything and then decompressed in parallel.  Any other
+    member is decompressed as a stream.
+*/
+
+struct GzipDecompressor : public Decompressor {
+
+    GzipDecompressor();
+
+    virtual ~GzipDecompressor();
+
+    virtual size_t decompress(const char * data, size_t len,
+                              const OnData & onData);
+    
+    virtual size_t finish(const OnData & onData);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+struct GzipDecompressor::Itl : public z_stream {
+
+    /// Number of BGZF blocks (of up to 64kb each) decompressed together
+    static constexpr size_t MAX_BATCH_BLOCKS = 256;
+
+    /// Size of a gzip header with the BGZF extra field
+    static constexpr size_t BGZF_HEADER_SIZE = 18;
+
+    Itl()
+    {
+        zalloc = 0;
+        zfree = 0;
+        opaque = 0;
+        next_in = 0;
+        avail_in = 0;
+        int res = inflateInit2(this, 15 + 16);
+        if (res != Z_OK)
+            throw Exception("inflateInit2 failed");
+    }
+
+    ~Itl()
+    {
+        inflateEnd(this);
+    }
+
+    static size_t writeAll(const char * data, size_t len,
+                           const OnData & onData)
+    {
+        size_t done = 0;
+        while (done < len)
+            done += onData(data + done, len - done);
+        return done;
+    }
+
+    /** Return the length of the BGZF block at the start of the given
+        data, 0 if there isn't enough data yet to tell or to hold the
+        whole block, or -1 if it's not a BGZF block.
+    */
+    static ssize_t bgzfBlockLength(const char * data, size_t len)
+    {
+        if (len < BGZF_HEADER_SIZE)
+            return 0;
+
+        const unsigned char * p = (const unsigned char *)data;
+        if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4))
+            return -1;
+        unsigned xlen = p[10] | (p[11] << 8);
+        if (xlen < 6 || p[12] != 'B' || p[13] != 'C'
+            || (p[14] | (p[15] << 8)) != 2)
+            return -1;
+
+        size_t blockLength = (p[16] | (p[17] << 8)) + 1;
+        if (blockLength < BGZF_HEADER_SIZE + 8)
+            return -1;
+        return blockLength <= len ? blockLength : 0;
+    }
+
+    /** Decompress a single complete member. */
+    static std::string inflateMember(const char * data, size_t len)
+    {
+        // The uncompressed length mod 2^32 is the last field
+        const unsigned char * p = (const unsigned char *)data + len - 4;
+        size_t outputLength
+            = p[0] | (p[1] << 8) | (p[2] << 16) | ((size_t)p[3] << 24);
+
+        std::string result(outputLength, '\0');
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, 15 + 16) != Z_OK)
+            throw Exception("inflateInit2 failed");
+
+        stream.next_in = (Bytef *)data;
+        stream.avail_in = len;
+        stream.next_out = (Bytef *)&result[0];
+        stream.avail_out = outputLength;
+
+        int res = inflate(&stream, Z_FINISH);
+        bool ok = res == Z_STREAM_END && stream.avail_in == 0
+            && stream.total_out == outputLength;
+        inflateEnd(&stream);
+
+        if (!ok)
+            throw Exception("corrupt BGZF block in gzip stream");
+
+        return result;
+    }
+
+    /** Decompress the batch of BGZF blocks in parallel and write them out
+        in order.
+    */
+    size_t flushBatch(const OnData & onData)
+    {
+        if (batch.empty())
+            return 0;
+
+        std::vector<std::string> outputs(batch.size());
+
+        auto doBlock = [&] (size_t i)
+            {
+                outputs[i] = inflateMember(pending.data() + batch[i].first,
+                                           batch[i].second);
+            };
+
+        parallelMap(0, batch.size(), doBlock);
+
+        size_t result = 0;
+        for (auto & o: outputs)
+            result += writeAll(o.data(), o.size(), onData);
+
+        batch.clear();
+        return result;
+    }
+
+    /** Decompress as much of a streamed member as we have input for.
+        Clears streaming once the end of the member is reached.
+    */
+    size_t inflatePending(const OnData & onData)
+    {
+        static constexpr size_t BUF_SIZE = 131072;
+        char output[BUF_SIZE];
+        size_t result = 0;
+
+        next_in = (Bytef *)pending.data() + pendingPos;
+        avail_in = pending.size() - pendingPos;
+
+        do {
+            next_out = (Bytef *)output;
+            avail_out = BUF_SIZE;
+
+            int res = inflate(this, Z_NO_FLUSH);
+
+            size_t bytesWritten = (const char *)next_out - output;
+            result += writeAll(output, bytesWritten, onData);
+
+            if (res == Z_STREAM_END) {
+                inflateReset(this);
+                streaming = false;
+                break;
+            }
+            else if (res == Z_BUF_ERROR)
+                break;  // needs more input
+            else if (res != Z_OK)
+                throw Exception("error decompressing gzip stream: %s",
+                                msg ? msg : "unknown error");
+        } while (avail_in != 0 || avail_out == 0);
+
+        pendingPos = pending.size() - avail_in;
+        return result;
+    }
+
+    size_t process(const OnData & onData, bool atEnd)
+    {
+        size_t result = 0;
+
+        for (;;) {
+            if (streaming) {
+                result += inflatePending(onData);
+                if (streaming)
+                    break;  // member isn't finished; wait for more input
+                continue;
+            }
+
+            size_t avail = pending.size() - pendingPos;
+            if (avail == 0)
+                break;
+
+            ssize_t blockLength
+                = bgzfBlockLength(pending.data() + pendingPos, avail);
+
+            if (blockLength > 0) {
+                batch.emplace_back(pendingPos, blockLength);
+                pendingPos += blockLength;
+                if (batch.size() == MAX_BATCH_BLOCKS)
+                    result += flushBatch(onData);
+            }
+            else if (blockLength == 0 && !atEnd) {
+                break;  // wait for the rest of the block
+            }
+            else {
+                // Not a BGZF block (or a truncated one); everything before
+                // it goes out first, and then it's streamed
+                result += flushBatch(onData);
+                streaming = true;
+            }
+        }
+
+        if (atEnd)
+            result += flushBatch(onData);
+
+        // Drop consumed input, unless the batch still points into it
+        if (batch.empty() && pendingPos > 0) {
+            pending.erase(0, pendingPos);
+            pendingPos = 0;
+        }
+
+        return result;
+    }
+
+    size_t decompress(const char * data, size_t len, const OnData & onData)
+    {
+        pending.append(data, len);
+        return process(onData, false /* atEnd */);
+    }
+
+    size_t finish(const OnData & onData)
+    {
+        size_t result = process(onData, true /* atEnd */);
+        if (streaming)
+            throw Exception("gzip stream is truncated");
+        return result;
+    }
+
+    std::string pending;     ///< Input that hasn't been decompressed yet
+    size_t pendingPos = 0;   ///< Amount of pending that has been consumed
+    bool streaming = false;  ///< Are we part way through a streamed member?
+
+    /// Offset in pending and length of BGZF blocks to decompress
+    std::vector<std::pair<size_t, size_t> > batch;
+};
+
+GzipDecompressor::
+GzipDecompressor()
+    : itl(new Itl())
+{
+}
+
+GzipDecompressor::
+~GzipDecompressor()
+{
+}
+
+size_t
+GzipDecompressor::
+decompress(const char * data, size_t len, const OnData & onData)
+{
+    return itl->decompress(data, len, onData);
+}
+
+size_t
+GzipDecompressor::
+finish(const OnData & onData)
+{
+    return itl->finish(onData);
+}
+
+static Decompressor::Register<GzipDecompressor>
+registerGzipDecompressor("gzip", {"gz"});
+
 #if 0
 /*****************************************************************************/
 /* LZMA COMPRESSOR                                                           */
@@ -28,6 +28,7 @@
 #include <boost/version.hpp>
 #include <boost/lexical_cast.hpp>
 #include "mldb/arch/exception.h"
+#include "mldb/arch/metrics.h"
 #include <errno.h>
 #include <sstream>
 #include <thread>
@@ -35,6 +36,8 @@
 #include "ext/lzma/lzma.h"
 #include "lz4_filter.h"
 #include "fs_utils.h"
+#include "uri_cache.h"
+#include "read_ahead_file.h"
 
 
 using namespace std;
@@ -188,8 +191,9 @@ struct BoostDecompressor: public boost::iostreams::multichar_input_filter {
                 n -= numGenerated;
                 numWritten += numGenerated;
 
-                // Everything else gets buffered for next time
-                ExcAssertEqual(outbuf.size(), 0);
+                // Everything else gets buffered for next time.  The
+                // decompressor may call us again once the output is full,
+                // so this can add to what's already buffered.
                 ExcAssertEqual(outbufPos, 0);
                 outbuf.append(data + numGenerated, dataLength - numGenerated);
 
@@ -482,6 +486,60 @@ std::ios_base::openmode getMode(const std::map<std::string, std::string> & optio
     return result;
 }
 
+/// Metrics of the streams opened for one scheme and direction
+struct SchemeMetrics {
+    SchemeMetrics(const std::string & scheme, const std::string & mode)
+        : opens(MetricsRegistry::global().counter
+                ("mldb_vfs_opens_total",
+                 "Number of streams opened",
+                 { { "scheme", scheme }, { "mode", mode } })),
+          openSeconds(MetricsRegistry::global().histogram
+                      ("mldb_vfs_open_duration_seconds",
+                       "Time taken to open a stream",
+                       { { "scheme", scheme }, { "mode", mode } })),
+          objectBytes(MetricsRegistry::global().counter
+                      ("mldb_vfs_object_bytes_total",
+                       "Total size of the objects opened, when known",
+                       { { "scheme", scheme }, { "mode", mode } }))
+    {
+    }
+
+    MetricCounter & opens;
+    MetricHistogram & openSeconds;
+    MetricCounter & objectBytes;
+};
+
+SchemeMetrics & getSchemeMetrics(const std::string & scheme, bool forWriting)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<std::string, bool>,
+                    std::unique_ptr<SchemeMetrics> > allMetrics;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    auto & entry = allMetrics[{ scheme, forWriting }];
+    if (!entry)
+        entry.reset(new SchemeMetrics(scheme, forWriting ? "write" : "read"));
+    return *entry;
+}
+
+/** Create the handler for a stream with the given function, recording it
+    in the metrics of its scheme.
+*/
+template<typename CreateHandler>
+UriHandler
+openHandler(const std::string & scheme, bool forWriting,
+            CreateHandler && createHandler)
+{
+    SchemeMetrics * metrics = &getSchemeMetrics(scheme, forWriting);
+    auto start = std::chrono::steady_clock::now();
+    UriHandler result = createHandler();
+    metrics->openSeconds.recordSince(start);
+    metrics->opens.add();
+    if (result.info && result.info->size > 0)
+        metrics->objectBytes.add(result.info->size);
+    return result;
+}
+
 } // file scope
 
 void
@@ -519,9 +577,12 @@ open(const std::string & uri,
     //cerr << "opening scheme " << scheme << " resource " << resource
     //     << endl;
 
-    const auto & handler = getUriHandler(scheme);
     auto onException = [&]() { this->deferredFailure = true; };
-    UriHandler res = handler(scheme, resource, mode, options, onException);
+    UriHandler res = openHandler(scheme, true /* forWriting */, [&] ()
+        {
+            const auto & handler = getUriHandler(scheme);
+            return handler(scheme, resource, mode, options, onException);
+        });
     
     return openFromHandler(res, resource, options);
 }
@@ -765,12 +826,21 @@ open(const std::string & uri,
     string scheme, resource;
     std::tie(scheme, resource) = getScheme(uri);
 
-    const auto & handlerFactory = getUriHandler(scheme);
     auto onException = [&]() { this->deferredFailure = true; };
     auto options = createOptions(mode, compression, -1);
-    UriHandler handler = handlerFactory(scheme, resource, mode,
-                                        options,
-                                        onException);
+    UriHandler handler = openHandler(scheme, false /* forWriting */, [&] ()
+        {
+            UriHandler handler;
+            if (mode == ios::in)
+                handler = getCachedUriHandler(scheme, resource, options,
+                                              onException);
+            if (!handler.buf) {
+                const auto & handlerFactory = getUriHandler(scheme);
+                handler = handlerFactory(scheme, resource, mode, options,
+                                         onException);
+            }
+            return handler;
+        });
     
     openFromHandler(handler, resource, options);
 }
@@ -794,9 +864,18 @@ open(const std::string & uri,
     string scheme, resource;
     std::tie(scheme, resource) = getScheme(uri);
 
-    const auto & handlerFactory = getUriHandler(scheme);
     auto onException = [&]() { this->deferredFailure = true; };
-    UriHandler handler = handlerFactory(scheme, resource, ios::in, options, onException);
+    UriHandler handler = openHandler(scheme, false /* forWriting */, [&] ()
+        {
+            UriHandler handler
+                = getCachedUriHandler(scheme, resource, options, onException);
+            if (!handler.buf) {
+                const auto & handlerFactory = getUriHandler(scheme);
+                handler = handlerFactory(scheme, resource, ios::in, options,
+                                         onException);
+            }
+            return handler;
+        });
     openFromHandler(handler, resource, options);
 }
 
@@ -860,7 +939,7 @@ openFromStreambuf(std::streambuf * buf,
                      && (ends_with(resource, ".lz4")
                          || ends_with(resource, ".lz4~"))));
 
-    if (gzip) new_stream->push(gzip_decompressor());
+    if (gzip) new_stream->push(BoostDecompressor(Decompressor::create("gzip")));
     else if (bzip2) new_stream->push(bzip2_decompressor());
     else if (lzma) new_stream->push(lzma_decompressor());
     else if (lz4) new_stream->push(lz4_decompressor());
@@ -1057,6 +1136,13 @@ struct RegisterFileHandler {
             // MLDB-1303 mmap fails on empty files - force filebuf interface
             // on empty files despite the mapped option
             if (!options.count("mapped") || !info.size) {
+                if (info.size) {
+                    shared_ptr<std::streambuf> buf
+                        (makeReadAheadFileBuffer(resource));
+                    if (buf)
+                        return UriHandler(buf.get(), buf, info);
+                }
+
                 shared_ptr<std::filebuf> buf(new std::filebuf);
                 buf->open(resource, ios_base::openmode(mode));
 
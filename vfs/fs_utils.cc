@@ -13,6 +13,7 @@
 #include <memory>
 #include <map>
 #include <mutex>
+#include <algorithm>
 
 #include "boost/filesystem.hpp"
 #include "mldb/ext/googleurl/src/url_util.h"
@@ -27,6 +28,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <ftw.h>
+#include <fnmatch.h>
 
 
 using namespace std;
@@ -513,6 +515,59 @@ bool forEachUriObject(const std::string & urlPrefix,
         ->forEach(realUrl, onObject, onSubdir, delimiter, startAt);
 }
 
+bool uriHasWildcards(const std::string & uri)
+{
+    return uri.find_first_of("*?[") != string::npos;
+}
+
+bool forEachUriObjectMatching(const std::string & globPattern,
+                              const OnUriObject & onObject)
+{
+    size_t wildcard = globPattern.find_first_of("*?[");
+    if (wildcard == string::npos) {
+        throw MLDB::Exception("no wildcards in glob pattern " + globPattern);
+    }
+
+    // List the directory containing the first wildcard
+    size_t dirEnd = globPattern.rfind('/', wildcard);
+    if (dirEnd == string::npos) {
+        throw MLDB::Exception("glob pattern " + globPattern
+                              + " has wildcards in its scheme");
+    }
+    string prefix(globPattern, 0, dirEnd + 1);
+    string glob(globPattern, dirEnd + 1);
+    int depth = std::count(glob.begin(), glob.end(), '/');
+
+    auto onSubdir = [&] (const std::string & dirName, int dirDepth)
+        {
+            return dirDepth <= depth;
+        };
+
+    auto onMatchingObject = [&] (const std::string & uri,
+                                 const FsObjectInfo & info,
+                                 const OpenUriObject & open,
+                                 int objectDepth)
+        {
+            // Match the last depth + 1 path components, which are the
+            // ones under the prefix.  This works whichever form of the
+            // prefix the filesystem returns its URIs in.
+            size_t start = uri.size();
+            for (int i = 0;  i <= depth && start != string::npos;  ++i) {
+                start = start == 0 ? string::npos : uri.rfind('/', start - 1);
+            }
+            if (start == string::npos) {
+                return true;
+            }
+            string relative(uri, start + 1);
+            if (::fnmatch(glob.c_str(), relative.c_str(), FNM_PATHNAME) != 0) {
+                return true;
+            }
+            return onObject(uri, info, open, objectDepth);
+        };
+
+    return forEachUriObject(prefix, onMatchingObject, onSubdir);
+}
+
 string
 baseName(const std::string & filename)
 {
@@ -184,6 +184,22 @@ bool forEachUriObject(const std::string & uriPrefix,
                       const std::string & startAt = "");
 
 
+/** Does the given URI contain any of the glob wildcards "*", "?" or "["? */
+bool uriHasWildcards(const std::string & uri);
+
+/** Call onObject for each object whose URI matches the given glob
+    pattern.  The wildcards are those of fnmatch(): "*" and "?" don't
+    match a "/", so that "s3://bucket/logs/day?/part-*.csv" matches the
+    part files one directory under logs/.  Only the directory before the
+    first wildcard is listed, and subdirectories are only recursed into
+    as deep as the pattern goes.
+
+    Will return false if the result of an onObject call was false, true
+    otherwise.
+*/
+bool forEachUriObjectMatching(const std::string & globPattern,
+                              const OnUriObject & onObject);
+
 // wrappers around "basename" and "dirname" from the libc
 std::string baseName(const std::string & filename);
 std::string dirName(const std::string & filename);
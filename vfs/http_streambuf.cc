@@ -14,8 +14,15 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/http/http_client.h"
+#include "mldb/io/legacy_event_loop.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/base/exc_assert.h"
 #include <chrono>
+#include <condition_variable>
 #include <future>
+#include <mutex>
+#include <strings.h>
 
 
 using namespace std;
@@ -102,6 +109,9 @@ struct HttpStreamingDownloadSource {
             for (auto & o: options) {
                 if (o.first == "http-set-cookie")
                     proxy.setCookie(o.second);
+                else if (o.first == "http-num-requests"
+                         || o.first == "http-chunk-size")
+                    ;  // only used by ranged downloads
                 else if (o.first.find("http-") == 0)
                     throw MLDB::Exception("Unknown HTTP stream parameter " + o.first + " = " + o.second);
             }
@@ -316,6 +326,524 @@ makeHttpStreamingDownload(const std::string & uri,
     return { std::move(result), convertHeaderToInfo(header) };
 }
 
+
+/*****************************************************************************/
+/* HTTP RANGED DOWNLOADER                                                    */
+/*****************************************************************************/
+
+/// Size of each of the ranges requested by a ranged download
+EnvOption<size_t> MLDB_HTTP_DOWNLOAD_CHUNK_SIZE
+("MLDB_HTTP_DOWNLOAD_CHUNK_SIZE", 8 << 20);
+
+/// Number of ranges in flight at once in a ranged download; 1 disables them
+EnvOption<int> MLDB_HTTP_DOWNLOAD_REQUESTS("MLDB_HTTP_DOWNLOAD_REQUESTS", 8);
+
+/// Number of times a failed range is requested again before the download fails
+EnvOption<int> MLDB_HTTP_DOWNLOAD_RETRIES("MLDB_HTTP_DOWNLOAD_RETRIES", 3);
+
+namespace {
+
+struct HttpDownloadGlobals {
+    HttpDownloadGlobals()
+    {
+        loop.start();
+    }
+
+    /* Return the HttpClient for the given scheme://hostname[:port].  The
+       instances are kept alive until the death of the process, so that
+       their connections are reused by later downloads from the same
+       server.  This method is thread-safe. */
+    HttpClient & getClient(const std::string & baseUrl)
+    {
+        std::unique_lock<std::mutex> guard(clientsLock);
+        auto it = clients.find(baseUrl);
+        if (it == clients.end()) {
+            HttpClient newClient(loop, baseUrl, 32);
+            it = clients.insert(std::make_pair(baseUrl, std::move(newClient)))
+                .first;
+        }
+        return it->second;
+    }
+
+    LegacyEventLoop loop;
+
+private:
+    std::mutex clientsLock;
+    std::map<std::string, HttpClient> clients;
+};
+
+HttpDownloadGlobals &
+getHttpDownloadGlobals()
+{
+    static HttpDownloadGlobals globals;
+    return globals;
+}
+
+/** Resolve the location of a redirect relative to the URI that returned it */
+std::string
+resolveRedirect(const std::string & uri, const std::string & location)
+{
+    if (location.find("://") != string::npos)
+        return location;
+    string::size_type schemeEnd = uri.find("://");
+    ExcAssertNotEqual(schemeEnd, string::npos);
+    if (location.compare(0, 2, "//") == 0)
+        return string(uri, 0, schemeEnd + 1) + location;
+    string::size_type hostEnd = uri.find('/', schemeEnd + 3);
+    if (hostEnd == string::npos)
+        hostEnd = uri.size();
+    if (!location.empty() && location[0] == '/')
+        return string(uri, 0, hostEnd) + location;
+    string::size_type dirEnd = uri.rfind('/');
+    if (dirEnd < hostEnd)
+        return string(uri, 0, hostEnd) + "/" + location;
+    return string(uri, 0, dirEnd + 1) + location;
+}
+
+/** Find out with a HEAD request whether the server will serve the given
+    URI in ranges, and fill in its info if so.  Redirects are followed
+    here, as the HttpClient which makes the ranged requests doesn't, and
+    uri is updated to where they lead.
+*/
+bool
+probeRangedDownload(std::string & uri, FsObjectInfo & info)
+{
+    for (unsigned redirects = 0;  redirects < 10;  ++redirects) {
+        HttpHeader header;
+        bool didGetHeader = false;
+        auto onHeader = [&] (const HttpHeader & gotHeader)
+            {
+                header = gotHeader;
+                didGetHeader = true;
+                // Stop after the header, rather than waiting for a body
+                // that a HEAD doesn't have
+                return false;
+            };
+
+        HttpRestProxy proxy;
+        proxy.perform("HEAD", uri, HttpRestProxy::Content(),
+                      {}, {}, 10.0, false /* exceptions */,
+                      nullptr, onHeader, false /* follow redirects */);
+        if (!didGetHeader)
+            return false;
+
+        int code = header.responseCode();
+        if (code >= 300 && code < 400) {
+            const string & location = header.tryGetHeader("location");
+            if (location.empty())
+                return false;
+            uri = resolveRedirect(uri, location);
+            continue;
+        }
+
+        string acceptRanges = header.tryGetHeader("accept-ranges");
+        for (auto & c: acceptRanges)
+            c = tolower(c);
+        if (code != 200 || header.contentLength <= 0
+            || acceptRanges.find("bytes") == string::npos)
+            return false;
+
+        info = convertHeaderToInfo(header);
+        return true;
+    }
+
+    return false;
+}
+
+} // file scope
+
+/** Downloads an HTTP object with up to numRequests requests for ranges
+    of chunkSize bytes in flight at once, like S3Downloader does, which is
+    much faster than a single GET when one TCP stream can't fill the link
+    (for example for large files behind a CDN).  The requests go through
+    an HttpClient per server, whose curl multi handle keeps the HTTP/1.1
+    connections alive from one range to the next.  The ranges are handed
+    to the reader in order as they arrive.
+
+    Seeking within the ranges already requested keeps them; seeking
+    elsewhere starts a new set of ranges at the new position.  Ranges that
+    are no longer needed can't be cancelled, but their data is dropped as
+    it arrives.
+*/
+
+struct HttpRangedDownloader {
+    HttpRangedDownloader(const std::string & uri,
+                         const FsObjectInfo & info,
+                         size_t chunkSize, unsigned numRequests)
+        : info(info), chunkSize(chunkSize), numRequests(numRequests),
+          shared(std::make_shared<Shared>())
+    {
+        string::size_type schemeEnd = uri.find("://");
+        ExcAssertNotEqual(schemeEnd, string::npos);
+        string::size_type hostEnd = uri.find('/', schemeEnd + 3);
+        if (hostEnd == string::npos) {
+            client = &getHttpDownloadGlobals().getClient(uri);
+            resource = "/";
+        }
+        else {
+            client = &getHttpDownloadGlobals().getClient(string(uri, 0, hostEnd));
+            resource = string(uri, hostEnd);
+        }
+
+        std::unique_lock<std::mutex> guard(shared->mutex);
+        ensureRequests();
+    }
+
+    ~HttpRangedDownloader()
+    {
+        // Requests still in flight drop their data when they finish
+        std::unique_lock<std::mutex> guard(shared->mutex);
+        ++shared->generation;
+    }
+
+    std::streamsize read(char * s, std::streamsize n)
+    {
+        if (readOffset == (uint64_t)info.size)
+            return -1;
+
+        if (currentDone == current.size())
+            waitNextChunk();
+
+        size_t toDo = std::min<size_t>(current.size() - currentDone, n);
+        std::copy(current.data() + currentDone,
+                  current.data() + currentDone + toDo, s);
+        currentDone += toDo;
+        readOffset += toDo;
+        return toDo;
+    }
+
+    /// Current read position
+    uint64_t tell() const
+    {
+        return readOffset;
+    }
+
+    /** Move the read position to pos, returning it. */
+    uint64_t seek(int64_t pos)
+    {
+        if (pos < 0 || pos > info.size)
+            throw MLDB::Exception("seeking to %lld in HTTP object of %lld bytes",
+                                  (long long)pos, (long long)info.size);
+
+        uint64_t currentStart = readOffset - currentDone;
+        if (pos >= currentStart && pos < currentStart + current.size()) {
+            currentDone = pos - currentStart;
+            readOffset = pos;
+            return readOffset;
+        }
+
+        current.clear();
+        currentDone = 0;
+        readOffset = pos;
+
+        std::unique_lock<std::mutex> guard(shared->mutex);
+        if (pos >= nextChunk && pos < nextRequest) {
+            // Already requested; keep the ranges from the one holding pos
+            nextChunk = generationStart
+                + (pos - generationStart) / chunkSize * chunkSize;
+            shared->ready.erase(shared->ready.begin(),
+                                shared->ready.lower_bound(nextChunk));
+        }
+        else {
+            ++shared->generation;
+            shared->ready.clear();
+            shared->inFlight = 0;
+            shared->exc = nullptr;
+            generationStart = nextChunk = nextRequest = pos;
+        }
+        shared->neededFrom = nextChunk;
+        ensureRequests();
+
+        return readOffset;
+    }
+
+    FsObjectInfo info;
+
+private:
+    /* State shared with the requests in flight, which may finish after the
+       downloader is destroyed.  Protected by mutex. */
+    struct Shared {
+        std::mutex mutex;
+        std::condition_variable cond;
+
+        /// Incremented when the requests in flight are no longer needed
+        uint64_t generation = 0;
+
+        /// Ranges of the current generation before this are not needed
+        uint64_t neededFrom = 0;
+
+        /// Number of requests of the current generation in flight
+        unsigned inFlight = 0;
+
+        /// Ranges that arrived but weren't read yet, by their offset
+        std::map<uint64_t, std::string> ready;
+
+        /// Error that stopped the download
+        std::exception_ptr exc;
+    };
+
+    struct RangeCallbacks: public HttpClientCallbacks {
+        RangeCallbacks(HttpRangedDownloader * owner,
+                       uint64_t start, size_t length, int retries)
+            : owner(owner), shared(owner->shared), client(owner->client),
+              resource(owner->resource), expectedEtag(owner->info.etag),
+              generation(shared->generation),
+              start(start), length(length), retries(retries)
+        {
+        }
+
+        HttpRangedDownloader * owner;  ///< Only valid in the generation
+        std::shared_ptr<Shared> shared;
+        HttpClient * client;
+        std::string resource;
+        std::string expectedEtag;
+        uint64_t generation;
+        uint64_t start;
+        size_t length;
+        int retries;
+
+        int code = 0;
+        std::string etag;
+        std::string body;
+
+        void enqueue()
+        {
+            RestParams headers {
+                { "Range", "bytes=" + to_string(start) + "-"
+                           + to_string(start + length - 1) } };
+            // Callbacks of a request are owned by the request
+            std::shared_ptr<HttpClientCallbacks> self(this);
+            if (!client->get(resource, self, {}, headers)) {
+                throw MLDB::Exception("the http client could not enqueue "
+                                      "the request");
+            }
+        }
+
+        virtual void onResponseStart(const HttpRequest & rq,
+                                     const std::string & httpVersion,
+                                     int code)
+        {
+            this->code = code;
+            body.reserve(length);
+        }
+
+        virtual void onHeader(const HttpRequest & rq,
+                              const char * data, size_t size)
+        {
+            if (size > 5 && strncasecmp(data, "etag:", 5) == 0) {
+                etag.assign(data + 5, size - 5);
+                while (!etag.empty() && isspace(etag.back()))
+                    etag.pop_back();
+                while (!etag.empty() && isspace(etag.front()))
+                    etag.erase(0, 1);
+            }
+        }
+
+        virtual void onData(const HttpRequest & rq,
+                            const char * data, size_t size)
+        {
+            if (body.size() + size <= length)
+                body.append(data, size);
+        }
+
+        virtual void onDone(const HttpRequest & rq,
+                            HttpClientError errorCode)
+        {
+            std::unique_lock<std::mutex> guard(shared->mutex);
+            if (generation != shared->generation)
+                return;
+
+            string error;
+            bool recoverable = false;
+            if (errorCode != HttpClientError::None) {
+                error = errorMessage(errorCode);
+                recoverable = true;
+            }
+            else if (code != 206) {
+                // A 200 means that the server ignored the range
+                error = "HTTP code " + to_string(code);
+                recoverable = code >= 500;
+            }
+            else if (!etag.empty() && !expectedEtag.empty()
+                     && etag != expectedEtag) {
+                error = "etag '" + etag + "' differs from original etag '"
+                    + expectedEtag + "'";
+            }
+            else if (body.size() != length) {
+                error = "got " + to_string(body.size()) + " bytes instead of "
+                    + to_string(length);
+                recoverable = true;
+            }
+
+            if (!error.empty() && recoverable && retries > 0) {
+                cerr << "retrying range " << start << "-" << start + length
+                     << " of " << resource << " after " << error << endl;
+                try {
+                    (new RangeCallbacks(owner, start, length, retries - 1))
+                        ->enqueue();
+                    return;
+                } MLDB_CATCH_ALL {
+                    error = "retry failed";
+                }
+            }
+
+            if (!error.empty()) {
+                try {
+                    throw MLDB::Exception("%s getting range %lld-%lld of %s",
+                                          error.c_str(), (long long)start,
+                                          (long long)(start + length),
+                                          resource.c_str());
+                } MLDB_CATCH_ALL {
+                    shared->exc = std::current_exception();
+                }
+            }
+            else {
+                shared->inFlight -= 1;
+                if (start >= shared->neededFrom) {
+                    shared->ready[start] = std::move(body);
+                }
+                owner->ensureRequests();
+            }
+            shared->cond.notify_all();
+        }
+    };
+
+    /* Keep numRequests ranges in flight or waiting to be read.  Must be
+       called with shared->mutex held. */
+    void ensureRequests()
+    {
+        while (!shared->exc
+               && shared->inFlight + shared->ready.size() < numRequests
+               && nextRequest < (uint64_t)info.size) {
+            size_t length = std::min<uint64_t>(chunkSize,
+                                               info.size - nextRequest);
+            (new RangeCallbacks(this, nextRequest, length,
+                                MLDB_HTTP_DOWNLOAD_RETRIES))->enqueue();
+            shared->inFlight += 1;
+            nextRequest += length;
+        }
+    }
+
+    void waitNextChunk()
+    {
+        std::unique_lock<std::mutex> guard(shared->mutex);
+        shared->cond.wait(guard, [&] ()
+                          {
+                              return shared->exc
+                                  || shared->ready.count(nextChunk);
+                          });
+        if (shared->exc)
+            rethrow_exception(shared->exc);
+
+        auto it = shared->ready.find(nextChunk);
+        current = std::move(it->second);
+        shared->ready.erase(it);
+
+        // After a seek, the position can be in the middle of the range
+        currentDone = readOffset - nextChunk;
+        ExcAssertLess(currentDone, current.size());
+        nextChunk += current.size();
+        shared->neededFrom = nextChunk;
+        ensureRequests();
+    }
+
+    size_t chunkSize;
+    unsigned numRequests;
+    HttpClient * client;
+    std::string resource;
+    std::shared_ptr<Shared> shared;
+
+    /* Requests; protected by shared->mutex */
+    uint64_t generationStart = 0;  ///< Offset of the first range requested
+    uint64_t nextRequest = 0;      ///< Offset of the next range to request
+    uint64_t nextChunk = 0;        ///< Offset of the next range to read
+
+    /* Reader */
+    uint64_t readOffset = 0;       ///< Position in the object
+    std::string current;           ///< Range being read
+    size_t currentDone = 0;        ///< Bytes of current already read
+};
+
+struct HttpRangedDownloadSource {
+    HttpRangedDownloadSource(std::shared_ptr<HttpRangedDownloader> downloader)
+        : downloader(std::move(downloader))
+    {
+    }
+
+    typedef char char_type;
+    struct category
+        : boost::iostreams::input_seekable,
+          boost::iostreams::device_tag,
+          boost::iostreams::closable_tag
+    { };
+
+    std::streamsize read(char_type * s, std::streamsize n)
+    {
+        return downloader->read(s, n);
+    }
+
+    std::streampos seek(boost::iostreams::stream_offset off,
+                        std::ios_base::seekdir way)
+    {
+        int64_t pos = off;
+        if (way == std::ios_base::cur)
+            pos += downloader->tell();
+        else if (way == std::ios_base::end)
+            pos += downloader->info.size;
+        return downloader->seek(pos);
+    }
+
+    bool is_open() const
+    {
+        return !!downloader;
+    }
+
+    void close()
+    {
+        downloader.reset();
+    }
+
+    std::shared_ptr<HttpRangedDownloader> downloader;
+};
+
+/** Start a ranged download of the given URI, if the server supports them
+    and they are enabled.  Returns a null streambuf otherwise, in which
+    case a streaming download should be used instead.
+*/
+std::pair<std::unique_ptr<std::streambuf>, FsObjectInfo>
+makeHttpRangedDownload(const std::string & uri,
+                       const std::map<std::string, std::string> & options)
+{
+    size_t chunkSize = MLDB_HTTP_DOWNLOAD_CHUNK_SIZE;
+    int numRequests = MLDB_HTTP_DOWNLOAD_REQUESTS;
+
+    for (auto & o: options) {
+        if (o.first == "http-set-cookie")
+            return {};  // the cookie engine only sees streaming downloads
+        else if (o.first == "http-num-requests")
+            numRequests = std::stoi(o.second);
+        else if (o.first == "http-chunk-size")
+            chunkSize = std::stoull(o.second);
+        else if (o.first.find("http-") == 0)
+            throw MLDB::Exception("Unknown HTTP stream parameter " + o.first + " = " + o.second);
+    }
+
+    if (numRequests <= 1 || chunkSize == 0)
+        return {};
+
+    string rangedUri = uri;
+    FsObjectInfo info;
+    if (!probeRangedDownload(rangedUri, info))
+        return {};
+
+    auto downloader = std::make_shared<HttpRangedDownloader>
+        (rangedUri, info, chunkSize, numRequests);
+    std::unique_ptr<std::streambuf> result;
+    result.reset(new boost::iostreams::stream_buffer<HttpRangedDownloadSource>
+                 (HttpRangedDownloadSource(downloader), 131072));
+    return { std::move(result), std::move(info) };
+}
+
 struct HttpUrlFsHandler: UrlFsHandler {
     HttpRestProxy proxy;
 
@@ -448,7 +976,17 @@ struct RegisterHttpHandler {
 
         if (mode == ios::in) {
             std::pair<std::unique_ptr<std::streambuf>, FsObjectInfo> sb_info
-                = makeHttpStreamingDownload(scheme+"://"+resource, options);
+                = makeHttpRangedDownload(scheme+"://"+resource, options);
+            if (sb_info.first) {
+                std::shared_ptr<std::streambuf> buf(sb_info.first.release());
+                UriHandlerOptions handlerOptions;
+                handlerOptions.isForwardSeekable = true;
+                handlerOptions.isRandomSeekable = true;
+                return UriHandler(buf.get(), buf, sb_info.second,
+                                  handlerOptions);
+            }
+
+            sb_info = makeHttpStreamingDownload(scheme+"://"+resource, options);
             std::shared_ptr<std::streambuf> buf(sb_info.first.release());
             return UriHandler(buf.get(), buf, sb_info.second);
         }
@@ -0,0 +1,316 @@
+/* read_ahead_file.cc
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Streambuf reading local files with asynchronous read-ahead.
+*/
+
+#include "read_ahead_file.h"
+#include "mldb/arch/exception.h"
+#include "mldb/jml/utils/environment.h"
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<size_t> MLDB_FILE_READ_AHEAD_BLOCK_SIZE
+("MLDB_FILE_READ_AHEAD_BLOCK_SIZE", 1 << 20);
+
+EnvOption<int> MLDB_FILE_READ_AHEAD_BLOCKS("MLDB_FILE_READ_AHEAD_BLOCKS", 16);
+
+struct ReadAheadFileBuf: public std::streambuf {
+
+    ReadAheadFileBuf(const std::string & filename,
+                     int fd, size_t blockSize, size_t numBlocks)
+        : filename(filename), fd(fd),
+          blockSize(blockSize), blocks(numBlocks)
+    {
+        for (auto & b: blocks) {
+            b.data.reset(new char[blockSize]);
+        }
+
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        start(0);
+    }
+
+    ~ReadAheadFileBuf()
+    {
+        stop();
+        ::close(fd);
+    }
+
+protected:
+    virtual int_type underflow()
+    {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+
+        std::unique_lock<std::mutex> guard(mutex);
+
+        // Hand the block we were reading back to the reader thread
+        if (haveBlock) {
+            Block & done = blocks[consumeIdx];
+            startOffset = done.offset + done.size;
+            done.full = false;
+            haveBlock = false;
+            consumeIdx = (consumeIdx + 1) % blocks.size();
+            setg(nullptr, nullptr, nullptr);
+            cond.notify_all();
+        }
+
+        Block & block = blocks[consumeIdx];
+        cond.wait(guard, [&] () { return block.full || finished; });
+
+        if (!block.full) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return traits_type::eof();
+        }
+
+        haveBlock = true;
+        char * p = block.data.get();
+        setg(p, p, p + block.size);
+        return traits_type::to_int_type(*p);
+    }
+
+    virtual std::streamsize showmanyc()
+    {
+        return egptr() - gptr();
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which)
+    {
+        uint64_t current = position();
+
+        int64_t target;
+        if (dir == std::ios_base::beg) {
+            target = off;
+        }
+        else if (dir == std::ios_base::cur) {
+            if (off == 0) {
+                return current;  // tellg()
+            }
+            target = current + off;
+        }
+        else {
+            struct stat st;
+            if (::fstat(fd, &st) == -1) {
+                return pos_type(off_type(-1));
+            }
+            target = st.st_size + off;
+        }
+
+        if (target < 0) {
+            return pos_type(off_type(-1));
+        }
+
+        // Seeking within the block we have doesn't need to touch the file
+        if (haveBlock) {
+            const Block & block = blocks[consumeIdx];
+            if (target >= block.offset && target <= block.offset + block.size) {
+                setg(eback(), eback() + (target - block.offset), egptr());
+                return target;
+            }
+        }
+
+        stop();
+        start(target);
+        return target;
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        int64_t offset = 0;
+        size_t size = 0;
+        bool full = false;
+    };
+
+    /** Offset in the file of the next character to be read. */
+    uint64_t position() const
+    {
+        if (haveBlock) {
+            return blocks[consumeIdx].offset + (gptr() - eback());
+        }
+        return startOffset;
+    }
+
+    /** Start the reader thread at the given offset.  It must be
+        stopped. */
+    void start(uint64_t offset)
+    {
+        for (auto & b: blocks) {
+            b.full = false;
+        }
+        consumeIdx = 0;
+        haveBlock = false;
+        finished = false;
+        stopping = false;
+        error = nullptr;
+        startOffset = offset;
+        setg(nullptr, nullptr, nullptr);
+
+        reader = std::thread([=] () { this->runReader(offset); });
+    }
+
+    void stop()
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+        if (reader.joinable()) {
+            reader.join();
+        }
+    }
+
+    void runReader(uint64_t offset)
+    {
+        // Start the whole window at once so that the device sees a deep
+        // queue, then keep it ahead of us by one block for each we read
+        size_t window = blockSize * blocks.size();
+        ::posix_fadvise(fd, offset, window, POSIX_FADV_WILLNEED);
+
+        size_t idx = 0;
+        for (;;) {
+            Block & block = blocks[idx];
+            {
+                std::unique_lock<std::mutex> guard(mutex);
+                cond.wait(guard, [&] () { return !block.full || stopping; });
+                if (stopping) {
+                    return;
+                }
+            }
+
+            ::posix_fadvise(fd, offset + window, blockSize,
+                            POSIX_FADV_WILLNEED);
+
+            // The block isn't full, so the consumer doesn't look at it
+            // and it can be filled without the lock
+            size_t done = 0;
+            std::exception_ptr readError;
+            while (done < blockSize) {
+                ssize_t res = ::pread(fd, block.data.get() + done,
+                                      blockSize - done, offset + done);
+                if (res == -1) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    readError = std::make_exception_ptr
+                        (MLDB::Exception("reading file %s: %s",
+                                         filename.c_str(), strerror(errno)));
+                    break;
+                }
+                if (res == 0) {
+                    break;
+                }
+                done += res;
+            }
+
+            std::unique_lock<std::mutex> guard(mutex);
+            if (readError) {
+                error = readError;
+                finished = true;
+            }
+            else {
+                block.offset = offset;
+                block.size = done;
+                block.full = done > 0;
+                finished = done < blockSize;
+            }
+            cond.notify_all();
+            if (finished) {
+                return;
+            }
+
+            offset += done;
+            idx = (idx + 1) % blocks.size();
+        }
+    }
+
+    std::string filename;
+    int fd;
+    size_t blockSize;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<Block> blocks;    ///< Ring of blocks, filled in order
+    size_t consumeIdx = 0;        ///< Block the get area is in or waits on
+    bool haveBlock = false;       ///< Is the get area in blocks[consumeIdx]?
+    uint64_t startOffset = 0;     ///< Position when we have no block
+    bool finished = false;        ///< Reader thread has reached the end
+    bool stopping = false;        ///< Reader thread was asked to stop
+    std::exception_ptr error;     ///< Error that stopped the reader thread
+    std::thread reader;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* READ AHEAD FILE BUFFER                                                    */
+/*****************************************************************************/
+
+std::unique_ptr<std::streambuf>
+makeReadAheadFileBuffer(const std::string & filename)
+{
+    int numBlocksOpt = MLDB_FILE_READ_AHEAD_BLOCKS;
+    size_t blockSize = MLDB_FILE_READ_AHEAD_BLOCK_SIZE;
+    if (numBlocksOpt <= 0 || blockSize == 0) {
+        return nullptr;
+    }
+
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw MLDB::Exception("couldn't open file %s: %s",
+                              filename.c_str(), strerror(errno));
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    // Don't allocate more blocks than the file needs, but keep at least
+    // two so that reading overlaps parsing if the file grows
+    size_t numBlocks = numBlocksOpt;
+    size_t blocksNeeded = st.st_size / blockSize + 2;
+    if (blocksNeeded < numBlocks) {
+        numBlocks = blocksNeeded;
+    }
+
+    try {
+        return std::unique_ptr<std::streambuf>
+            (new ReadAheadFileBuf(filename, fd, blockSize, numBlocks));
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+} // namespace MLDB
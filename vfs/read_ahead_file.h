@@ -0,0 +1,47 @@
+/* read_ahead_file.h                                               -*- C++ -*-
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Streambuf reading local files with asynchronous read-ahead.
+*/
+
+#pragma once
+
+#include <streambuf>
+#include <memory>
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* READ AHEAD FILE BUFFER                                                    */
+/*****************************************************************************/
+
+/** Reading a local file through std::filebuf issues one small read at a
+    time from the thread that parses the data, so the device is idle while
+    the data is parsed, and parsing waits while the device reads.
+
+    This streambuf reads the file from a background thread into a ring of
+    MLDB_FILE_READ_AHEAD_BLOCKS blocks of MLDB_FILE_READ_AHEAD_BLOCK_SIZE
+    bytes (16 blocks of 1MB by default).  The kernel is told about the
+    whole window ahead of the reader, so it keeps many requests queued on
+    the device.  The get area points straight into the filled block, so
+    the data isn't copied again on its way to the reader.
+
+    Seeking is supported; seeking outside of the current block restarts
+    the read-ahead from the new position.
+*/
+
+/** Return a read-ahead streambuf for the given local file, or a null
+    pointer if read-ahead can't be used (it's disabled by setting
+    MLDB_FILE_READ_AHEAD_BLOCKS to 0, or the file isn't a regular file),
+    in which case the caller should fall back to std::filebuf.  Throws if
+    the file can't be opened.
+*/
+std::unique_ptr<std::streambuf>
+makeReadAheadFileBuffer(const std::string & filename);
+
+} // namespace MLDB
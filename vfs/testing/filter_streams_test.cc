@@ -26,6 +26,7 @@
 #include <stdint.h>
 #include <iostream>
 #include <fcntl.h>
+#include <zlib.h>
 
 #include "mldb/jml/utils/guard.h"
 #include "mldb/arch/exception_handler.h"
@@ -397,6 +398,85 @@ BOOST_AUTO_TEST_CASE( test_mem_scheme_in )
 
     BOOST_CHECK_EQUAL(text, result);
 }
+
+/* Compress the given text as a single gzip member, optionally in the BGZF
+   format with its block size in the header. */
+static string gzipMember(const string & text, bool bgzf)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    BOOST_REQUIRE_EQUAL(deflateInit2(&stream, 6, Z_DEFLATED, -15, 8,
+                                     Z_DEFAULT_STRATEGY), Z_OK);
+    string deflated(deflateBound(&stream, text.size()), '\0');
+    stream.next_in = (Bytef *)text.data();
+    stream.avail_in = text.size();
+    stream.next_out = (Bytef *)&deflated[0];
+    stream.avail_out = deflated.size();
+    BOOST_REQUIRE_EQUAL(deflate(&stream, Z_FINISH), Z_STREAM_END);
+    deflated.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    auto le16 = [] (string & s, unsigned v)
+        {
+            s += char(v & 0xff);
+            s += char((v >> 8) & 0xff);
+        };
+
+    string result = bgzf ? string("\x1f\x8b\x08\x04", 4) : string("\x1f\x8b\x08\x00", 4);
+    result += string(4, '\0');  // mtime
+    result += "\x00\xff";       // xfl, os
+    if (bgzf) {
+        le16(result, 6);
+        result += "BC";
+        le16(result, 2);
+        le16(result, 18 + deflated.size() + 8 - 1);
+    }
+    result += deflated;
+    uint32_t crc = crc32(0, (const Bytef *)text.data(), text.size());
+    le16(result, crc & 0xffff);
+    le16(result, crc >> 16);
+    le16(result, text.size() & 0xffff);
+    le16(result, text.size() >> 16);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_gzip_multiple_members )
+{
+    Call_Guard fn([&]() {deleteAllMemStreamStrings();});
+
+    string text;
+    for (int i = 0; i < 100000; i++) {
+        text += to_string(i) + ",AbCdEfGh\n";
+    }
+
+    auto check = [&] (bool bgzf)
+        {
+            // Blocks of 60000 bytes, with an empty normal member in the
+            // middle and an empty block at the end like bgzip writes
+            string compressed;
+            for (size_t i = 0;  i < text.size();  i += 60000) {
+                compressed += gzipMember(text.substr(i, 60000), bgzf);
+                if (i == 300000)
+                    compressed += gzipMember("", false);
+            }
+            compressed += gzipMember("", bgzf);
+            setMemStreamString("in_file.gz", compressed);
+
+            string result;
+            filter_istream inS("mem://in_file.gz");
+            while (inS) {
+                char buf[16384];
+                inS.read(buf, 16384);
+                result.append(buf, inS.gcount());
+            }
+
+            BOOST_CHECK_EQUAL(text.size(), result.size());
+            BOOST_CHECK(text == result);
+        };
+
+    check(false /* bgzf */);
+    check(true /* bgzf */);
+}
 #endif
 
 #if 1
@@ -618,3 +698,38 @@ BOOST_AUTO_TEST_CASE(test_empty_filter_stream_mapped)
     // but we can read it without failing
     BOOST_CHECK_EQUAL(stream.readAll(), "");
 }
+
+BOOST_AUTO_TEST_CASE(test_file_read_ahead)
+{
+    fs::create_directories("build/x86_64/tmp");
+    string filename = "build/x86_64/tmp/read_ahead.txt";
+    Call_Guard guard([&] () { ::unlink(filename.c_str()); });
+
+    // Several read-ahead blocks, not a multiple of the block size
+    string text;
+    for (int i = 0;  text.size() < 5000000;  i++) {
+        text += to_string(i) + ",AbCdEfGh\n";
+    }
+    {
+        ofstream out(filename.c_str());
+        out << text;
+    }
+
+    filter_istream stream(filename);
+    BOOST_CHECK_EQUAL(stream.readAll(), text);
+
+    stream.clear();
+    stream.seekg(1234567);
+    BOOST_CHECK_EQUAL(stream.tellg(), 1234567);
+    string str(10, 0);
+    stream.read(&str[0], 10);
+    BOOST_CHECK_EQUAL(str, text.substr(1234567, 10));
+
+    stream.seekg(12);
+    stream.read(&str[0], 10);
+    BOOST_CHECK_EQUAL(str, text.substr(12, 10));
+
+    stream.seekg(-10, ios::end);
+    stream.read(&str[0], 10);
+    BOOST_CHECK_EQUAL(str, text.substr(text.size() - 10));
+}
@@ -0,0 +1,177 @@
+/* http_ranged_download_test.cc
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Test of ranged, parallel HTTP downloads through filter_istream.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/io/asio_thread_pool.h"
+#include "mldb/io/event_loop.h"
+#include "mldb/http/http_header.h"
+#include "mldb/http/testing/test_http_services.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/utils/testing/watchdog.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+/* Serves /ranged with support for ranges, and /plain without */
+struct TestRangedService : public TestHttpService {
+    TestRangedService(EventLoop & eventLoop, const string & contents)
+        : TestHttpService(eventLoop), contents(contents), numRanges(0)
+    {
+    }
+
+    void handleHttpPayload(TestHttpSocketHandler & handler,
+                           const HttpHeader & header,
+                           const string & payload)
+    {
+        numReqs++;
+        bool ranged = header.resource == "/ranged";
+        if (!ranged && header.resource != "/plain") {
+            handler.sendResponse(404, string("Not found"), "text/plain");
+            return;
+        }
+
+        vector<pair<string, string> > headers;
+        if (ranged)
+            headers.emplace_back("Accept-Ranges", "bytes");
+
+        if (header.verb == "HEAD") {
+            headers.emplace_back("Content-Length", to_string(contents.size()));
+            HttpResponse response(200, string("text/plain"), headers);
+            handler.putResponseOnWire(std::move(response), nullptr,
+                                      TestHttpSocketHandler::NEXT_RECYCLE);
+            return;
+        }
+
+        const string & range = header.tryGetHeader("range");
+        if (!ranged || range.empty()) {
+            handler.putResponseOnWire(HttpResponse(200, "text/plain",
+                                                   contents, headers));
+            return;
+        }
+
+        size_t first, last;
+        if (sscanf(range.c_str(), "bytes=%zu-%zu", &first, &last) != 2
+            || first > last || last >= contents.size()) {
+            handler.sendResponse(416, string("Bad range"), "text/plain");
+            return;
+        }
+        numRanges++;
+        headers.emplace_back("Content-Range",
+                             "bytes " + to_string(first) + "-"
+                             + to_string(last) + "/"
+                             + to_string(contents.size()));
+        handler.putResponseOnWire(HttpResponse(206, "text/plain",
+                                               contents.substr(first,
+                                                               last - first + 1),
+                                               headers));
+    }
+
+    string contents;
+    std::atomic<int> numRanges;
+};
+
+string makeContents(size_t size)
+{
+    string result;
+    result.reserve(size);
+    for (size_t i = 0;  result.size() < size;  ++i)
+        result += to_string(i) + "\n";
+    result.resize(size);
+    return result;
+}
+
+string readAll(filter_istream & stream)
+{
+    return string(std::istreambuf_iterator<char>(stream),
+                  std::istreambuf_iterator<char>());
+}
+
+const std::map<string, string> smallChunks {
+    { "http-chunk-size", "65536" }, { "http-num-requests", "4" } };
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_ranged_download )
+{
+    ML::Watchdog watchdog(30);
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+    string contents = makeContents(1000003);
+    TestRangedService service(eventLoop, contents);
+    string baseUrl = service.start();
+
+    filter_istream stream(baseUrl + "/ranged", smallChunks);
+    BOOST_CHECK(stream.isRandomSeekable());
+    BOOST_CHECK_EQUAL(stream.info().size, contents.size());
+    BOOST_CHECK(readAll(stream) == contents);
+
+    // One request per chunk of the object
+    BOOST_CHECK_EQUAL(service.numRanges.load(),
+                      (contents.size() + 65535) / 65536);
+}
+
+BOOST_AUTO_TEST_CASE( test_ranged_download_seek )
+{
+    ML::Watchdog watchdog(30);
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+    string contents = makeContents(1000003);
+    TestRangedService service(eventLoop, contents);
+    string baseUrl = service.start();
+
+    filter_istream stream(baseUrl + "/ranged", smallChunks);
+
+    char buf[1000];
+    for (size_t offset: { 500000, 500100, 10, 999999, 700000, 0, 999000 }) {
+        stream.clear();
+        stream.seekg(offset);
+        BOOST_REQUIRE_EQUAL(stream.tellg(), offset);
+        stream.read(buf, sizeof(buf));
+        size_t expected = std::min(sizeof(buf), contents.size() - offset);
+        BOOST_REQUIRE_EQUAL((size_t)stream.gcount(), expected);
+        BOOST_CHECK_EQUAL(string(buf, expected),
+                          contents.substr(offset, expected));
+    }
+
+    stream.clear();
+    stream.seekg(-3, std::ios_base::end);
+    BOOST_CHECK_EQUAL(readAll(stream), contents.substr(contents.size() - 3));
+}
+
+BOOST_AUTO_TEST_CASE( test_download_without_ranges )
+{
+    ML::Watchdog watchdog(30);
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+    string contents = makeContents(300000);
+    TestRangedService service(eventLoop, contents);
+    string baseUrl = service.start();
+
+    // Falls back to a single streaming GET
+    filter_istream stream(baseUrl + "/plain", smallChunks);
+    BOOST_CHECK(!stream.isRandomSeekable());
+    BOOST_CHECK(readAll(stream) == contents);
+    BOOST_CHECK_EQUAL(service.numRanges.load(), 0);
+
+    // As it does when ranged downloads are disabled
+    filter_istream stream2(baseUrl + "/ranged",
+                           { { "http-num-requests", "1" } });
+    BOOST_CHECK(!stream2.isRandomSeekable());
+    BOOST_CHECK(readAll(stream2) == contents);
+    BOOST_CHECK_EQUAL(service.numRanges.load(), 0);
+}
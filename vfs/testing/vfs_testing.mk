@@ -1,5 +1,7 @@
 # This file is part of MLDB. Copyright 2015 Datacratic. All rights reserved.
 
-$(eval $(call test,filter_streams_test,vfs boost_filesystem boost_system,boost))
+$(eval $(call test,filter_streams_test,vfs boost_filesystem boost_system z,boost))
 
 $(TESTS)/filter_streams_test:	$(BIN)/lz4cli $(BIN)/zstd
+
+$(eval $(call test,http_ranged_download_test,vfs http test_services io_base,boost))
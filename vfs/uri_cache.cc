@@ -0,0 +1,195 @@
+/* uri_cache.cc
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Local disk cache for objects read from remote URIs.
+*/
+
+#include "uri_cache.h"
+#include "fs_utils.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/format.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/ext/xxhash/xxhash.h"
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <unistd.h>
+
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+
+namespace MLDB {
+
+const UriHandlerFactory &
+getUriHandler(const std::string & scheme);
+
+namespace {
+
+EnvOption<std::string> MLDB_VFS_CACHE_DIR("MLDB_VFS_CACHE_DIR", "");
+EnvOption<int64_t> MLDB_VFS_CACHE_BYTES("MLDB_VFS_CACHE_BYTES", 10LL << 30);
+
+const char * const CACHED_SCHEMES[] = { "s3", "http", "https", "hdfs", "sftp" };
+
+const std::string TMP_SUFFIX = ".tmp";
+
+std::atomic<uint64_t> downloadNumber(0);
+
+bool isCachedScheme(const std::string & scheme)
+{
+    for (auto & s: CACHED_SCHEMES)
+        if (scheme == s)
+            return true;
+    return false;
+}
+
+/** Remove the least recently used objects until the cache fits in its
+    budget.  The object that was just added is never removed.
+*/
+void evict(const fs::path & dir, const fs::path & keep)
+{
+    struct Entry {
+        std::time_t lastUsed;
+        uintmax_t size;
+        fs::path path;
+    };
+
+    std::vector<Entry> entries;
+    uintmax_t totalSize = 0;
+
+    boost::system::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end;  !ec && it != end;
+         it.increment(ec)) {
+        const fs::path & p = it->path();
+        if (p.extension() == TMP_SUFFIX)
+            continue;  // a download in progress
+        uintmax_t size = fs::file_size(p, ec);
+        if (ec)
+            continue;  // removed by another process
+        std::time_t lastUsed = fs::last_write_time(p, ec);
+        if (ec)
+            continue;
+        totalSize += size;
+        entries.push_back({ lastUsed, size, p });
+    }
+
+    if (totalSize <= (uintmax_t)MLDB_VFS_CACHE_BYTES.get())
+        return;
+
+    std::sort(entries.begin(), entries.end(),
+              [] (const Entry & e1, const Entry & e2)
+              {
+                  return e1.lastUsed < e2.lastUsed;
+              });
+
+    for (auto & e: entries) {
+        if (totalSize <= (uintmax_t)MLDB_VFS_CACHE_BYTES.get())
+            break;
+        if (e.path == keep)
+            continue;
+        // Readers that already have the file open keep their copy
+        if (fs::remove(e.path, ec))
+            totalSize -= e.size;
+    }
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* URI CACHE                                                                 */
+/*****************************************************************************/
+
+UriHandler
+getCachedUriHandler(const std::string & scheme,
+                    const std::string & resource,
+                    const std::map<std::string, std::string> & options,
+                    const OnUriHandlerException & onException)
+{
+    std::string dir = MLDB_VFS_CACHE_DIR;
+    if (dir.empty() || !isCachedScheme(scheme))
+        return UriHandler();
+
+    std::string uri = scheme + "://" + resource;
+    FsObjectInfo info = tryGetUriObjectInfo(uri);
+
+    // Without an etag or date we can't tell when the object changes
+    if (!info || info.size < 0
+        || (info.etag.empty() && !info.lastModified.isADate())
+        || info.size > MLDB_VFS_CACHE_BYTES.get())
+        return UriHandler();
+
+    std::string key = uri + '\0' + info.etag + '\0' + std::to_string(info.size)
+        + '\0' + info.lastModified.printIso8601();
+    fs::path path = fs::path(dir)
+        / MLDB::format("%016llx",
+                       (unsigned long long)XXH64(key.data(), key.size(), 0));
+
+    boost::system::error_code ec;
+    if ((int64_t)fs::file_size(path, ec) == info.size && !ec) {
+        // Hit; mark it as recently used
+        fs::last_write_time(path, std::time(nullptr), ec);
+    }
+    else {
+        fs::create_directories(dir, ec);
+
+        // Download under a temporary name, so that other readers never see
+        // a partial object
+        fs::path tmpPath = path;
+        tmpPath += MLDB::format(".%d.%lld", (int)getpid(),
+                                (long long)downloadNumber.fetch_add(1))
+            + TMP_SUFFIX;
+
+        std::map<std::string, std::string> remoteOptions = options;
+        remoteOptions.erase("mapped");
+        remoteOptions.erase("compression");
+
+        UriHandler remote
+            = getUriHandler(scheme)(scheme, resource, ios::in, remoteOptions,
+                                    onException);
+        {
+            std::ofstream out(tmpPath.string(), ios::binary);
+            if (!out)
+                throw MLDB::Exception("couldn't create cache file "
+                                      + tmpPath.string());
+            out << remote.buf;
+            out.close();
+            if (!out) {
+                fs::remove(tmpPath, ec);
+                throw MLDB::Exception("couldn't write cache file "
+                                      + tmpPath.string());
+            }
+        }
+
+        if ((int64_t)fs::file_size(tmpPath, ec) != info.size || ec) {
+            fs::remove(tmpPath, ec);
+            throw MLDB::Exception("reading " + uri + " for the cache got a "
+                                  "different size from its metadata");
+        }
+
+        fs::rename(tmpPath, path);
+        evict(dir, path);
+    }
+
+    std::map<std::string, std::string> localOptions = options;
+    localOptions["mapped"] = "true";
+
+    UriHandler result;
+    try {
+        result = getUriHandler("file")("file", path.string(), ios::in,
+                                       localOptions, onException);
+    } catch (const std::exception & exc) {
+        // Another process evicted it in the meantime; read it directly
+        return UriHandler();
+    }
+
+    // Readers see the metadata of the original object
+    result.info = std::make_shared<FsObjectInfo>(std::move(info));
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,46 @@
+/* uri_cache.h                                                     -*- C++ -*-
+   Copyright (c) 2016 Datacratic Inc.  All rights reserved.
+
+   This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+   Local disk cache for objects read from remote URIs.
+*/
+
+#pragma once
+
+#include "filter_streams_registry.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* URI CACHE                                                                 */
+/*****************************************************************************/
+
+/** Objects read from remote filesystems (s3, http, https, hdfs and sftp
+    URIs) can be kept in a directory on local disk, so that reading them
+    again doesn't go back over the network.
+
+    The cache is enabled by setting MLDB_VFS_CACHE_DIR to a directory.
+    Each object is stored under a hash of its URI, size, etag and
+    modification date, so a changed object is downloaded again rather
+    than served stale.  Once the cache is larger than MLDB_VFS_CACHE_BYTES
+    (10GB by default) the least recently used objects are removed.
+
+    The directory may be shared between processes.
+*/
+
+/** Return a handler reading the given object from the cache, downloading
+    it first if it's not there yet.  If the object can't be cached (the
+    cache is disabled, it's not a remote scheme, or the object has no
+    etag or modification date), a handler with a null buf is returned and
+    the caller should open the object directly.
+*/
+UriHandler
+getCachedUriHandler(const std::string & scheme,
+                    const std::string & resource,
+                    const std::map<std::string, std::string> & options,
+                    const OnUriHandlerException & onException);
+
+} // namespace MLDB
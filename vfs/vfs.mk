@@ -5,9 +5,11 @@ LIBVFS_SOURCES := \
         filter_streams.cc \
 	http_streambuf.cc \
 	compressor.cc \
-	zstandard.cc
+	zstandard.cc \
+	uri_cache.cc \
+	read_ahead_file.cc
 
-LIBVFS_LINK := arch boost_iostreams lzmapp types boost_filesystem http lz4 xxhash zstd
+LIBVFS_LINK := arch base boost_iostreams lzmapp types boost_filesystem http lz4 xxhash zstd
 
 $(eval $(call library,vfs,$(LIBVFS_SOURCES),$(LIBVFS_LINK)))
 
@@ -8,26 +8,66 @@
 
 #include "compressor.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
+#include "mldb/jml/utils/environment.h"
 #include "mldb/ext/zstd/lib/zstd.h"
 #include <zlib.h>
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
 namespace MLDB {
 
 
+namespace {
+
+/// Uncompressed size of each independent frame written by the compressor,
+/// or 0 to write a single frame
+EnvOption<size_t> MLDB_ZSTD_FRAME_SIZE("MLDB_ZSTD_FRAME_SIZE", 4 << 20);
+
+constexpr uint32_t ZSTD_FRAME_MAGIC = 0xFD2FB528;
+constexpr uint32_t ZSTD_SKIPPABLE_MAGIC_MIN = 0x184D2A50;
+constexpr uint32_t ZSTD_SKIPPABLE_MAGIC_MAX = 0x184D2A5F;
+
+// From the zstd seekable format
+constexpr uint32_t ZSTD_SEEK_TABLE_MAGIC = 0x184D2A5E;
+constexpr uint32_t ZSTD_SEEKABLE_MAGIC = 0x8F92EAB1;
+
+inline uint32_t readLe32(const unsigned char * p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline void appendLe32(std::string & s, uint32_t val)
+{
+    for (int i = 0;  i < 4;  ++i)
+        s += char((val >> (8 * i)) & 0xff);
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* ZSTANDARD COMPRESSOR                                                      */
 /*****************************************************************************/
 
+/** Zstandard compressor.  The output is cut into independent frames of
+    MLDB_ZSTD_FRAME_SIZE uncompressed bytes, followed by a seek table in
+    the zstd seekable format (a skippable frame, so any zstd decoder can
+    still read the file).  Independent frames can be decompressed in
+    parallel, and the seek table allows a reader to find the frame that
+    holds a given offset.
+*/
+
 struct ZStandardCompressor: public Compressor {
 
     ZStandardCompressor()
         : stream(ZSTD_createCStream()),
           outDataSize(ZSTD_CStreamOutSize()),
           outData(new char[outDataSize]),
-          outBuf{outData.get(),outDataSize,0}
+          outBuf{outData.get(),outDataSize,0},
+          frameSize(MLDB_ZSTD_FRAME_SIZE)
     {
     }
 
@@ -45,21 +85,35 @@ struct ZStandardCompressor: public Compressor {
 
     void open(int compressionLevel)
     {
+        level = compressionLevel;
         ZSTD_initCStream(stream, compressionLevel);
     }
 
     virtual size_t compress(const char * data, size_t len, const OnData & onData) override
     {
-        ZSTD_inBuffer inBuf{data, len, 0};
+        size_t done = 0;
+        while (done < len) {
+            size_t toDo = len - done;
+            if (frameSize)
+                toDo = std::min(toDo, frameSize - frameBytesIn);
 
-        while (inBuf.pos < inBuf.size) {
-            outBuf.pos = 0;
-            size_t res = ZSTD_compressStream(stream, &outBuf, &inBuf);
-            if (ZSTD_isError(res)) {
-                throw Exception("Error compression zstandard stream: %s",
-                                ZSTD_getErrorName(res));
+            ZSTD_inBuffer inBuf{data + done, toDo, 0};
+
+            while (inBuf.pos < inBuf.size) {
+                outBuf.pos = 0;
+                size_t res = ZSTD_compressStream(stream, &outBuf, &inBuf);
+                if (ZSTD_isError(res)) {
+                    throw Exception("Error compression zstandard stream: %s",
+                                    ZSTD_getErrorName(res));
+                }
+                writeAll(onData);
             }
-            writeAll(onData);
+
+            done += toDo;
+            frameBytesIn += toDo;
+
+            if (frameSize && frameBytesIn == frameSize)
+                endFrame(onData);
         }
 
         return len;
@@ -79,14 +133,50 @@ struct ZStandardCompressor: public Compressor {
 
     virtual size_t finish(const OnData & onData) override
     {
-        size_t result = 0;
+        // An empty input still gets a (single, empty) frame
+        if (frameBytesIn > 0 || frames.empty())
+            endFrame(onData);
+
+        if (!frameSize)
+            return 0;
+
+        // Seek table: one entry of compressed and decompressed size per
+        // frame, then the number of frames, a descriptor byte (no
+        // checksums) and the seekable format magic number
+        std::string table;
+        appendLe32(table, ZSTD_SEEK_TABLE_MAGIC);
+        appendLe32(table, frames.size() * 8 + 9);
+        for (auto & f: frames) {
+            appendLe32(table, f.first);
+            appendLe32(table, f.second);
+        }
+        appendLe32(table, frames.size());
+        table += char(0);
+        appendLe32(table, ZSTD_SEEKABLE_MAGIC);
+
+        size_t written = 0;
+        while (written < table.size())
+            written += onData(table.data() + written, table.size() - written);
+        return written;
+    }
+
+    /** Finish the current frame and record it in the seek table. */
+    void endFrame(const OnData & onData)
+    {
         size_t bytesLeft = -1;
         while (bytesLeft != 0) {
             outBuf.pos = 0;
             bytesLeft = ZSTD_endStream(stream, &outBuf);
-            result += writeAll(onData);
+            if (ZSTD_isError(bytesLeft)) {
+                throw Exception("Error compression zstandard stream: %s",
+                                ZSTD_getErrorName(bytesLeft));
+            }
+            writeAll(onData);
         }
-        return result;
+
+        frames.emplace_back(frameBytesOut, frameBytesIn);
+        frameBytesIn = frameBytesOut = 0;
+        ZSTD_initCStream(stream, level);
     }
 
     size_t writeAll(const OnData & onData)
@@ -96,6 +186,7 @@ struct ZStandardCompressor: public Compressor {
             written += onData(outData.get() + written,
                               outBuf.pos - written);
         }
+        frameBytesOut += written;
         return written;
     }
     
@@ -103,6 +194,14 @@ struct ZStandardCompressor: public Compressor {
     size_t outDataSize = 0;
     std::unique_ptr<char[]> outData;
     ZSTD_outBuffer outBuf;
+    int level = 0;
+
+    size_t frameSize;          ///< Uncompressed bytes per frame; 0 is unlimited
+    size_t frameBytesIn = 0;   ///< Uncompressed bytes in the current frame
+    size_t frameBytesOut = 0;  ///< Compressed bytes in the current frame
+
+    /// Compressed and uncompressed size of each finished frame
+    std::vector<std::pair<uint32_t, uint32_t> > frames;
 };
 
 static Compressor::Register<ZStandardCompressor>
@@ -113,8 +212,23 @@ registerZStandardCompressor("zstd", {"zst", "zstd"});
 /* ZSTANDARD DECOMPRESSOR                                                    */
 /*****************************************************************************/
 
+/** Zstandard decompressor.  Streams made of several frames (as written by
+    ZStandardCompressor, pzstd or zstd --rsyncable) are decompressed a
+    batch of frames at a time in parallel.  The end of a frame can be found
+    by walking its block headers, without decompressing it.  A frame that
+    is too big to buffer is streamed instead.
+*/
+
 struct ZStandardDecompressor: public Decompressor {
 
+    /// Frames up to this compressed size are buffered to be decompressed
+    /// in parallel; longer ones are streamed
+    static constexpr size_t MAX_BUFFERED_FRAME = 16 << 20;
+
+    /// Maximum number of frames and compressed bytes in a batch
+    static constexpr size_t MAX_BATCH_FRAMES = 64;
+    static constexpr size_t MAX_BATCH_BYTES = 64 << 20;
+
     ZStandardDecompressor()
         : stream(ZSTD_createDStream()),
           outDataSize(ZSTD_DStreamOutSize()),
@@ -136,27 +250,235 @@ struct ZStandardDecompressor: public Decompressor {
 
     virtual size_t decompress(const char * data, size_t len, const OnData & onData) override
     {
+        pending.append(data, len);
+        return process(onData, false /* atEnd */);
+    }
+    
+    virtual size_t finish(const OnData & onData) override
+    {
+        size_t result = process(onData, true /* atEnd */);
+        if (streaming || pendingPos != pending.size())
+            throw Exception("zstandard stream is truncated");
+        return result;
+    }
+
+    /** Scan the frame at the start of the given data.  scanned holds how
+        far through the frame previous calls got, and should be zero for
+        a new frame.  Returns the length of the frame when it's complete,
+        or zero if more data is needed.  Skippable frames are reported as
+        negative lengths.
+    */
+    static ssize_t scanFrame(const char * data, size_t len, size_t & scanned)
+    {
+        const unsigned char * p = (const unsigned char *)data;
+
+        if (scanned == 0) {
+            if (len < 8)
+                return 0;
+            uint32_t magic = readLe32(p);
+            if (magic >= ZSTD_SKIPPABLE_MAGIC_MIN
+                && magic <= ZSTD_SKIPPABLE_MAGIC_MAX) {
+                size_t frameLength = 8 + (size_t)readLe32(p + 4);
+                return frameLength <= len ? -(ssize_t)frameLength : 0;
+            }
+            if (magic != ZSTD_FRAME_MAGIC)
+                throw Exception("Invalid zstandard frame magic number");
+
+            // Frame header; see RFC 8878 section 3.1.1.1
+            unsigned descriptor = p[4];
+            unsigned fcsFlag = descriptor >> 6;
+            bool singleSegment = descriptor & 32;
+            unsigned dictIdFlag = descriptor & 3;
+            static const unsigned dictIdSizes[4] = { 0, 1, 2, 4 };
+            static const unsigned fcsSizes[4] = { 0, 2, 4, 8 };
+
+            size_t headerLength = 5 + !singleSegment + dictIdSizes[dictIdFlag]
+                + (fcsFlag == 0 ? singleSegment : fcsSizes[fcsFlag]);
+            if (len < headerLength)
+                return 0;
+            scanned = headerLength;
+        }
+
+        for (;;) {
+            if (len < scanned + 3)
+                return 0;
+            const unsigned char * b = p + scanned;
+            uint32_t blockHeader = b[0] | (b[1] << 8) | (b[2] << 16);
+            bool lastBlock = blockHeader & 1;
+            unsigned blockType = (blockHeader >> 1) & 3;
+            size_t blockSize = blockHeader >> 3;
+            if (blockType == 3)
+                throw Exception("Invalid zstandard block type");
+
+            // RLE blocks hold a single byte
+            size_t contentLength = blockType == 1 ? 1 : blockSize;
+            if (len < scanned + 3 + contentLength)
+                return 0;
+            scanned += 3 + contentLength;
+
+            if (lastBlock) {
+                bool checksum = p[4] & 4;
+                size_t frameLength = scanned + 4 * checksum;
+                return frameLength <= len ? frameLength : 0;
+            }
+        }
+    }
+
+    /** Decompress a complete frame on its own. */
+    static std::string decompressFrame(const char * data, size_t len)
+    {
+        std::shared_ptr<ZSTD_DStream> stream(ZSTD_createDStream(),
+                                             ZSTD_freeDStream);
+        ZSTD_initDStream(stream.get());
+
+        std::string result;
+        size_t chunkSize = ZSTD_DStreamOutSize();
         ZSTD_inBuffer inBuf{data, len, 0};
+        size_t res = -1;
+        while (res != 0) {
+            size_t done = result.size();
+            result.resize(done + chunkSize);
+            ZSTD_outBuffer out{&result[0] + done, chunkSize, 0};
+            res = ZSTD_decompressStream(stream.get(), &out, &inBuf);
+            if (ZSTD_isError(res)) {
+                throw Exception("Error decompressing zstandard stream: %s",
+                                ZSTD_getErrorName(res));
+            }
+            result.resize(done + out.pos);
+            if (res != 0 && inBuf.pos == inBuf.size && out.pos < chunkSize)
+                throw Exception("zstandard frame is truncated");
+        }
+        return result;
+    }
+
+    /** Decompress the batch of frames in parallel, and write them out in
+        order.
+    */
+    size_t flushBatch(const OnData & onData)
+    {
+        if (batch.empty())
+            return 0;
+
+        std::vector<std::string> outputs(batch.size());
+
+        auto doFrame = [&] (size_t i)
+            {
+                outputs[i] = decompressFrame(pending.data() + batch[i].first,
+                                             batch[i].second);
+            };
+
+        if (batch.size() == 1)
+            doFrame(0);
+        else parallelMap(0, batch.size(), doFrame);
 
-        while (inBuf.pos < inBuf.size) {
+        size_t result = 0;
+        for (auto & o: outputs) {
+            size_t written = 0;
+            while (written < o.size())
+                written += onData(o.data() + written, o.size() - written);
+            result += written;
+        }
+
+        batch.clear();
+        batchBytes = 0;
+        return result;
+    }
+
+    /** Stream the pending input through the decompression stream until
+        the end of the current frame or of the input.
+    */
+    size_t streamPending(const OnData & onData)
+    {
+        size_t result = 0;
+        ZSTD_inBuffer inBuf{pending.data() + pendingPos,
+                            pending.size() - pendingPos, 0};
+
+        while (streaming && inBuf.pos < inBuf.size) {
             outBuf.pos = 0;
             size_t res = ZSTD_decompressStream(stream, &outBuf, &inBuf);
             if (ZSTD_isError(res)) {
-                throw Exception("Error compression zstandard stream: %s",
+                throw Exception("Error decompressing zstandard stream: %s",
                                 ZSTD_getErrorName(res));
             }
-            writeAll(onData);
-            if (res == 0 && inBuf.pos < inBuf.size) {
-                throw Exception("Extra bytes at end of decompressed zstandard stream");
+            result += writeAll(onData);
+            if (res == 0) {
+                // End of the frame; the next one may be buffered again
+                ZSTD_initDStream(stream);
+                streaming = false;
             }
         }
-        
-        return len;
+
+        // Flush anything left in the decoder's internal buffers
+        while (streaming && outBuf.pos == outBuf.size) {
+            outBuf.pos = 0;
+            size_t res = ZSTD_decompressStream(stream, &outBuf, &inBuf);
+            if (ZSTD_isError(res)) {
+                throw Exception("Error decompressing zstandard stream: %s",
+                                ZSTD_getErrorName(res));
+            }
+            result += writeAll(onData);
+            if (res == 0) {
+                ZSTD_initDStream(stream);
+                streaming = false;
+            }
+        }
+
+        pendingPos += inBuf.pos;
+        return result;
     }
-    
-    virtual size_t finish(const OnData & onData) override
+
+    size_t process(const OnData & onData, bool atEnd)
     {
-        return 0;
+        size_t result = 0;
+
+        for (;;) {
+            if (streaming) {
+                result += streamPending(onData);
+                if (streaming)
+                    break;  // frame isn't finished; wait for more input
+                continue;
+            }
+
+            size_t avail = pending.size() - pendingPos;
+            if (avail == 0)
+                break;
+
+            ssize_t frameLength = scanFrame(pending.data() + pendingPos,
+                                            avail, frameScanned);
+
+            if (frameLength < 0) {
+                // Skippable frame (for example a seek table)
+                pendingPos += -frameLength;
+                frameScanned = 0;
+            }
+            else if (frameLength > 0) {
+                batch.emplace_back(pendingPos, frameLength);
+                batchBytes += frameLength;
+                pendingPos += frameLength;
+                frameScanned = 0;
+                if (batch.size() == MAX_BATCH_FRAMES
+                    || batchBytes >= MAX_BATCH_BYTES)
+                    result += flushBatch(onData);
+            }
+            else if (avail >= MAX_BUFFERED_FRAME) {
+                // Too big to buffer; everything before it goes out first
+                result += flushBatch(onData);
+                streaming = true;
+                frameScanned = 0;
+            }
+            else break;  // wait for the rest of the frame
+        }
+
+        if (atEnd)
+            result += flushBatch(onData);
+
+        // Drop consumed input, unless the batch still points into it
+        if (batch.empty() && pendingPos > 0) {
+            pending.erase(0, pendingPos);
+            pendingPos = 0;
+        }
+
+        return result;
     }
 
     size_t writeAll(const OnData & onData)
@@ -173,6 +495,15 @@ struct ZStandardDecompressor: public Decompressor {
     size_t outDataSize = 0;
     std::unique_ptr<char[]> outData;
     ZSTD_outBuffer outBuf;
+
+    std::string pending;      ///< Input that hasn't been decompressed yet
+    size_t pendingPos = 0;    ///< Amount of pending that has been consumed
+    size_t frameScanned = 0;  ///< How far scanFrame got in the current frame
+    bool streaming = false;   ///< Are we part way through a streamed frame?
+
+    /// Offset in pending and length of frames to decompress
+    std::vector<std::pair<size_t, size_t> > batch;
+    size_t batchBytes = 0;
 };
 
 static Decompressor::Register<ZStandardDecompressor>
@@ -12,7 +12,13 @@
 #include "mldb/base/scope.h"
 #include "mldb/vfs/filter_streams_registry.h"
 #include "mldb/arch/exception.h"
+#include "mldb/jml/utils/environment.h"
 #include <sstream>
+#include <algorithm>
+#include <mutex>
+#include <cstring>
+#include <unordered_map>
+#include <zlib.h>
 
 // libarchive support
 #include <archive.h>
@@ -146,6 +152,772 @@ bool iterateArchive(std::streambuf * archive,
 }
 
 
+
+/*****************************************************************************/
+/* ARCHIVE INDEX                                                             */
+/*****************************************************************************/
+
+/** Index of the members of an uncompressed tar or of a zip file, giving
+    where the data of each member lives within the archive.  It allows
+    members to be opened by reading just their bytes from the archive,
+    rather than streaming the archive from the start through libarchive.
+*/
+
+struct ArchiveMember {
+    enum Encoding {
+        STORED,       ///< Data is stored as-is
+        DEFLATED,     ///< Zip member compressed with raw deflate
+        UNSUPPORTED   ///< Needs libarchive (eg, encrypted or bzip2 zip)
+    };
+
+    std::string name;
+    std::shared_ptr<FsObjectInfo> info;
+    Encoding encoding = UNSUPPORTED;
+    uint64_t offset = 0;           ///< Offset of data (tar) or local header (zip)
+    bool hasLocalHeader = false;   ///< Data follows a zip local header
+    uint64_t storedSize = 0;       ///< Bytes taken within the archive
+};
+
+struct ArchiveIndex {
+    std::vector<ArchiveMember> members;
+    std::unordered_map<std::string, size_t> byName;
+
+    const ArchiveMember * find(const std::string & name) const
+    {
+        auto it = byName.find(name);
+        if (it == byName.end())
+            return nullptr;
+        return &members[it->second];
+    }
+
+    void add(ArchiveMember member)
+    {
+        byName[member.name] = members.size();
+        members.emplace_back(std::move(member));
+    }
+};
+
+/** Random access reads of the raw bytes of an archive.  Files are memory
+    mapped; other URIs are read through seeks on their stream, which only
+    works for those whose stream buffer supports seeking.
+*/
+struct ArchiveSource {
+    ArchiveSource(const std::string & uri)
+        : stream(uri, { { "mapped", "true" }, { "compression", "none" } }),
+          data(nullptr), size(0), seekable(false)
+    {
+        std::tie(data, size) = stream.mapped();
+        if (data) {
+            seekable = true;
+            return;
+        }
+
+        stream.seekg(0, ios::end);
+        std::streamoff end = stream.tellg();
+        if (stream && end >= 0) {
+            size = end;
+            seekable = true;
+        }
+        stream.clear();
+    }
+
+    void read(uint64_t offset, char * buf, size_t len)
+    {
+        if (offset > size || size - offset < len)
+            throw MLDB::Exception("Archive is truncated: reading %zd bytes "
+                                  "at offset %lld of %lld",
+                                  len, (long long)offset, (long long)size);
+        if (data) {
+            std::memcpy(buf, data + offset, len);
+            return;
+        }
+        stream.clear();
+        stream.seekg(offset);
+        stream.read(buf, len);
+        if (stream.gcount() != (std::streamsize)len)
+            throw MLDB::Exception("Short read from archive at offset %lld",
+                                  (long long)offset);
+    }
+
+    std::string read(uint64_t offset, size_t len)
+    {
+        std::string result(len, '\0');
+        read(offset, &result[0], len);
+        return result;
+    }
+
+    filter_istream stream;
+    const char * data;   ///< Whole archive, if it's memory mapped
+    uint64_t size;
+    bool seekable;
+};
+
+static uint64_t le16(const char * p)
+{
+    const unsigned char * u = (const unsigned char *)p;
+    return u[0] | (u[1] << 8);
+}
+
+static uint64_t le32(const char * p)
+{
+    return le16(p) | (le16(p + 2) << 16);
+}
+
+static uint64_t le64(const char * p)
+{
+    return le32(p) | (le32(p + 4) << 32);
+}
+
+/// Parse an octal (or GNU base-256) number from a tar header field
+static uint64_t parseTarNumber(const char * p, size_t len)
+{
+    uint64_t result = 0;
+    if ((unsigned char)p[0] & 0x80) {
+        result = p[0] & 0x7f;
+        for (size_t i = 1;  i < len;  ++i)
+            result = (result << 8) | (unsigned char)p[i];
+        return result;
+    }
+
+    size_t i = 0;
+    while (i < len && p[i] == ' ')
+        ++i;
+    for (;  i < len && p[i] >= '0' && p[i] <= '7';  ++i)
+        result = result * 8 + (p[i] - '0');
+    return result;
+}
+
+static std::string tarString(const char * p, size_t len)
+{
+    return std::string(p, strnlen(p, len));
+}
+
+static bool tarChecksumMatches(const char * header)
+{
+    uint64_t expected = parseTarNumber(header + 148, 8);
+    uint64_t sum = 0;
+    for (size_t i = 0;  i < 512;  ++i)
+        sum += (i >= 148 && i < 156) ? ' ' : (unsigned char)header[i];
+    return sum == expected;
+}
+
+/** Index a tar file by hopping from header to header.  Returns false if
+    it isn't a tar file.
+*/
+static bool indexTar(ArchiveSource & source, ArchiveIndex & index)
+{
+    uint64_t offset = 0;
+    std::string longName, paxPath;
+    int64_t paxSize = -1;
+    char header[512];
+
+    while (offset + 512 <= source.size) {
+        source.read(offset, header, 512);
+        if (std::all_of(header, header + 512,
+                        [] (char c) { return c == 0; }))
+            break;  // end of archive marker
+
+        if (!tarChecksumMatches(header)) {
+            if (offset == 0)
+                return false;
+            throw MLDB::Exception("Corrupt tar header at offset %lld",
+                                  (long long)offset);
+        }
+
+        uint64_t size = parseTarNumber(header + 124, 12);
+        uint64_t dataOffset = offset + 512;
+        char type = header[156];
+
+        if (type == 'L') {
+            // GNU long name of the next member
+            longName = source.read(dataOffset, size);
+            longName.resize(strnlen(longName.c_str(), longName.size()));
+        }
+        else if (type == 'x') {
+            // pax extended header for the next member, made of records
+            // like "<length> <key>=<value>\n"
+            std::string records = source.read(dataOffset, size);
+            size_t pos = 0;
+            while (pos < records.size()) {
+                size_t length = std::atoll(records.c_str() + pos);
+                size_t space = records.find(' ', pos);
+                size_t equals = records.find('=', pos);
+                if (length == 0 || pos + length > records.size()
+                    || space == string::npos || equals == string::npos
+                    || equals >= pos + length)
+                    break;
+                std::string key(records, space + 1, equals - space - 1);
+                std::string value(records, equals + 1,
+                                  pos + length - equals - 2);
+                if (key == "path")
+                    paxPath = value;
+                else if (key == "size")
+                    paxSize = std::atoll(value.c_str());
+                pos += length;
+            }
+        }
+        else if (type != 'g') {
+            std::string name;
+            if (!paxPath.empty())
+                name = paxPath;
+            else if (!longName.empty())
+                name = longName;
+            else {
+                name = tarString(header, 100);
+                std::string prefix;
+                if (std::memcmp(header + 257, "ustar", 5) == 0)
+                    prefix = tarString(header + 345, 155);
+                if (!prefix.empty())
+                    name = prefix + "/" + name;
+            }
+
+            if (paxSize >= 0)
+                size = paxSize;
+
+            // Regular and contiguous files; the rest is skipped like in
+            // iterateArchive()
+            if (type == '0' || type == '\0' || type == '7') {
+                ArchiveMember member;
+                member.name = std::move(name);
+                member.encoding = ArchiveMember::STORED;
+                member.offset = dataOffset;
+                member.storedSize = size;
+                member.info = std::make_shared<FsObjectInfo>();
+                member.info->exists = true;
+                member.info->size = size;
+                member.info->lastModified = Date::fromSecondsSinceEpoch
+                    (parseTarNumber(header + 136, 12));
+                member.info->ownerId
+                    = std::to_string(parseTarNumber(header + 108, 8));
+                member.info->ownerName = tarString(header + 297, 32);
+                index.add(std::move(member));
+            }
+
+            longName.clear();
+            paxPath.clear();
+            paxSize = -1;
+        }
+
+        offset = dataOffset + ((size + 511) & ~uint64_t(511));
+    }
+
+    return true;
+}
+
+/** Index a zip file from its central directory.  Returns false if it
+    isn't a zip file.
+*/
+static bool indexZip(ArchiveSource & source, ArchiveIndex & index)
+{
+    // The end of central directory record is within the last 64k
+    if (source.size < 22)
+        return false;
+    size_t tailSize = std::min<uint64_t>(source.size, 22 + 65535);
+    uint64_t tailOffset = source.size - tailSize;
+    std::string tail = source.read(tailOffset, tailSize);
+
+    ssize_t eocd = tailSize - 22;
+    while (eocd >= 0 && le32(&tail[eocd]) != 0x06054b50)
+        --eocd;
+    if (eocd < 0)
+        return false;
+
+    const char * e = &tail[eocd];
+    uint64_t numEntries = le16(e + 10);
+    uint64_t cdSize = le32(e + 12);
+    uint64_t cdOffset = le32(e + 16);
+
+    if (numEntries == 0xffff || cdSize == 0xffffffff
+        || cdOffset == 0xffffffff) {
+        // zip64: the real values are in the zip64 end of central
+        // directory record, found through the locator just before
+        if (tailOffset + eocd < 20)
+            throw MLDB::Exception("Corrupt zip64 archive");
+        std::string locator = source.read(tailOffset + eocd - 20, 20);
+        if (le32(&locator[0]) != 0x07064b50)
+            throw MLDB::Exception("Corrupt zip64 end of central directory "
+                                  "locator");
+        std::string record = source.read(le64(&locator[8]), 56);
+        if (le32(&record[0]) != 0x06064b50)
+            throw MLDB::Exception("Corrupt zip64 end of central directory");
+        numEntries = le64(&record[32]);
+        cdSize = le64(&record[40]);
+        cdOffset = le64(&record[48]);
+    }
+
+    std::string cd = source.read(cdOffset, cdSize);
+
+    size_t pos = 0;
+    for (uint64_t i = 0;  i < numEntries;  ++i) {
+        if (pos + 46 > cd.size() || le32(&cd[pos]) != 0x02014b50)
+            throw MLDB::Exception("Corrupt zip central directory");
+        const char * h = &cd[pos];
+        uint64_t flags = le16(h + 8);
+        uint64_t method = le16(h + 10);
+        uint64_t dosTime = le16(h + 12);
+        uint64_t dosDate = le16(h + 14);
+        uint64_t compressedSize = le32(h + 20);
+        uint64_t size = le32(h + 24);
+        size_t nameLen = le16(h + 28);
+        size_t extraLen = le16(h + 30);
+        size_t commentLen = le16(h + 32);
+        uint64_t localOffset = le32(h + 42);
+
+        if (pos + 46 + nameLen + extraLen + commentLen > cd.size())
+            throw MLDB::Exception("Corrupt zip central directory");
+
+        std::string name(h + 46, nameLen);
+
+        // The zip64 extra field holds the values that didn't fit
+        const char * extra = h + 46 + nameLen;
+        for (size_t x = 0;  x + 4 <= extraLen;) {
+            uint64_t id = le16(extra + x);
+            size_t len = le16(extra + x + 2);
+            if (id == 1) {
+                const char * v = extra + x + 4;
+                const char * vend = v + std::min(len, extraLen - x - 4);
+                auto next = [&] (uint64_t & field)
+                    {
+                        if (field == 0xffffffff && v + 8 <= vend) {
+                            field = le64(v);
+                            v += 8;
+                        }
+                    };
+                next(size);
+                next(compressedSize);
+                next(localOffset);
+            }
+            x += 4 + len;
+        }
+
+        pos += 46 + nameLen + extraLen + commentLen;
+
+        // Directories are skipped, like in iterateArchive()
+        if (name.empty() || name.back() == '/')
+            continue;
+
+        ArchiveMember member;
+        member.name = std::move(name);
+        if (flags & 1)
+            member.encoding = ArchiveMember::UNSUPPORTED;  // encrypted
+        else if (method == 0)
+            member.encoding = ArchiveMember::STORED;
+        else if (method == 8)
+            member.encoding = ArchiveMember::DEFLATED;
+        member.offset = localOffset;
+        member.hasLocalHeader = true;
+        member.storedSize = compressedSize;
+        member.info = std::make_shared<FsObjectInfo>();
+        member.info->exists = true;
+        member.info->size = size;
+        int month = (dosDate >> 5) & 0xf, day = dosDate & 0x1f;
+        if (month >= 1 && month <= 12 && day >= 1)
+            member.info->lastModified
+                = Date(1980 + (dosDate >> 9), month, day,
+                       dosTime >> 11, (dosTime >> 5) & 0x3f,
+                       (dosTime & 0x1f) * 2);
+        else member.info->lastModified = Date::notADate();
+        index.add(std::move(member));
+    }
+
+    return true;
+}
+
+/** Build the index of the given archive.  Returns null if the archive
+    isn't an uncompressed tar or a zip file, or if it can't be read at
+    random.
+*/
+static std::shared_ptr<const ArchiveIndex>
+buildArchiveIndex(const std::string & archiveUri)
+{
+    ArchiveSource source(archiveUri);
+    if (!source.seekable)
+        return nullptr;
+
+    auto result = std::make_shared<ArchiveIndex>();
+    char magic[4] = { 0, 0, 0, 0 };
+    if (source.size >= 4)
+        source.read(0, magic, 4);
+
+    if (std::memcmp(magic, "PK\3\4", 4) == 0
+        || std::memcmp(magic, "PK\5\6", 4) == 0) {
+        if (indexZip(source, *result))
+            return result;
+    }
+    else if (source.size >= 512 && indexTar(source, *result)) {
+        return result;
+    }
+    return nullptr;
+}
+
+/// Maximum number of archives whose index is kept in memory
+static EnvOption<int>
+MLDB_ARCHIVE_INDEX_CACHE_ENTRIES("MLDB_ARCHIVE_INDEX_CACHE_ENTRIES", 64);
+
+/** Return the index of the given archive, building it on the first
+    access.  Indexes are cached by the URI and the ETag (or the size and
+    modification date) of the archive, so a modified archive is indexed
+    again.  Archives that can't be indexed are cached as a null index, and
+    need to be streamed through libarchive.
+*/
+static std::shared_ptr<const ArchiveIndex>
+getArchiveIndex(const std::string & archiveUri)
+{
+    FsObjectInfo info = tryGetUriObjectInfo(archiveUri);
+    if (!info.exists)
+        return nullptr;
+
+    std::string key = archiveUri + "\n" + info.etag + "\n"
+        + std::to_string(info.size) + "\n"
+        + info.lastModified.printIso8601();
+
+    struct Entry {
+        std::shared_ptr<const ArchiveIndex> index;
+        uint64_t lastUsed;
+    };
+
+    static std::mutex cacheMutex;
+    static std::unordered_map<std::string, Entry> cache;
+    static uint64_t useCounter = 0;
+
+    {
+        std::unique_lock<std::mutex> guard(cacheMutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            it->second.lastUsed = ++useCounter;
+            return it->second.index;
+        }
+    }
+
+    // Built outside of the lock, as it reads from the archive
+    std::shared_ptr<const ArchiveIndex> index
+        = buildArchiveIndex(archiveUri);
+
+    std::unique_lock<std::mutex> guard(cacheMutex);
+    while (!cache.empty()
+           && cache.size() >= (size_t)MLDB_ARCHIVE_INDEX_CACHE_ENTRIES) {
+        auto oldest = cache.begin();
+        for (auto it = cache.begin();  it != cache.end();  ++it) {
+            if (it->second.lastUsed < oldest->second.lastUsed)
+                oldest = it;
+        }
+        cache.erase(oldest);
+    }
+    if (MLDB_ARCHIVE_INDEX_CACHE_ENTRIES > 0)
+        cache[key] = { index, ++useCounter };
+    return index;
+}
+
+
+/*****************************************************************************/
+/* ARCHIVE MEMBER STREAMS                                                    */
+/*****************************************************************************/
+
+/** Stored member of a memory mapped archive, read in place. */
+struct MappedMemberStreambuf: public std::streambuf {
+    MappedMemberStreambuf(std::shared_ptr<ArchiveSource> source,
+                          const char * data, size_t size)
+        : source(std::move(source))
+    {
+        char * p = const_cast<char *>(data);
+        setg(p, p, p + size);
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which)
+    {
+        off_type target = off;
+        if (dir == std::ios_base::cur)
+            target += gptr() - eback();
+        else if (dir == std::ios_base::end)
+            target += egptr() - eback();
+        if (target < 0 || target > egptr() - eback())
+            return pos_type(off_type(-1));
+        setg(eback(), eback() + target, egptr());
+        return target;
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+    std::shared_ptr<ArchiveSource> source;
+};
+
+/** Stored member of an archive, read from its range of the archive. */
+struct StoredMemberStreambuf: public std::streambuf {
+    StoredMemberStreambuf(std::shared_ptr<ArchiveSource> source,
+                          uint64_t start, uint64_t size)
+        : source(std::move(source)), start(start), size(size),
+          bufferOffset(0), buffer(BUFFER_SIZE)
+    {
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+
+    static constexpr size_t BUFFER_SIZE = 65536;
+
+    virtual int_type underflow()
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        bufferOffset += egptr() - eback();
+        if (bufferOffset >= size)
+            return traits_type::eof();
+
+        size_t len = std::min<uint64_t>(BUFFER_SIZE, size - bufferOffset);
+        source->read(start + bufferOffset, buffer.data(), len);
+        setg(buffer.data(), buffer.data(), buffer.data() + len);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    virtual std::streamsize showmanyc()
+    {
+        return size - bufferOffset - (gptr() - eback());
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which)
+    {
+        off_type current = bufferOffset + (gptr() - eback());
+        off_type target = off;
+        if (dir == std::ios_base::cur)
+            target += current;
+        else if (dir == std::ios_base::end)
+            target += size;
+        if (target < 0 || target > (off_type)size)
+            return pos_type(off_type(-1));
+
+        if (target >= (off_type)bufferOffset
+            && target <= (off_type)bufferOffset + (egptr() - eback())) {
+            setg(eback(), eback() + (target - bufferOffset), egptr());
+        }
+        else {
+            // Start reading again from the target
+            bufferOffset = target;
+            setg(buffer.data(), buffer.data(), buffer.data());
+        }
+        return target;
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+    std::shared_ptr<ArchiveSource> source;
+    uint64_t start;
+    uint64_t size;
+    uint64_t bufferOffset;   ///< Offset in the member of the buffer
+    std::vector<char> buffer;
+};
+
+/** Deflated zip member, inflated as it's read from its range of the
+    archive.
+*/
+struct DeflatedMemberStreambuf: public std::streambuf {
+    DeflatedMemberStreambuf(std::shared_ptr<ArchiveSource> source,
+                            uint64_t start, uint64_t storedSize)
+        : source(std::move(source)), start(start), storedSize(storedSize),
+          inputOffset(0), done(false), input(BUFFER_SIZE), output(BUFFER_SIZE)
+    {
+        std::memset(&zstream, 0, sizeof(zstream));
+        // Negative window bits means raw deflate, without a zlib header
+        if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK)
+            throw MLDB::Exception("inflateInit2 failed");
+        setg(output.data(), output.data(), output.data());
+    }
+
+    ~DeflatedMemberStreambuf()
+    {
+        inflateEnd(&zstream);
+    }
+
+    static constexpr size_t BUFFER_SIZE = 65536;
+
+    virtual int_type underflow()
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        while (!done) {
+            if (zstream.avail_in == 0) {
+                if (inputOffset >= storedSize)
+                    throw MLDB::Exception("Truncated deflated zip member");
+                size_t len = std::min<uint64_t>(BUFFER_SIZE,
+                                                storedSize - inputOffset);
+                source->read(start + inputOffset, input.data(), len);
+                inputOffset += len;
+                zstream.next_in = (Bytef *)input.data();
+                zstream.avail_in = len;
+            }
+
+            zstream.next_out = (Bytef *)output.data();
+            zstream.avail_out = output.size();
+            int res = inflate(&zstream, Z_NO_FLUSH);
+            if (res == Z_STREAM_END)
+                done = true;
+            else if (res != Z_OK && res != Z_BUF_ERROR)
+                throw MLDB::Exception("Error inflating zip member: %s",
+                                      zstream.msg ? zstream.msg : "unknown");
+
+            size_t produced = output.size() - zstream.avail_out;
+            if (produced > 0) {
+                setg(output.data(), output.data(), output.data() + produced);
+                return traits_type::to_int_type(*gptr());
+            }
+        }
+
+        return traits_type::eof();
+    }
+
+    std::shared_ptr<ArchiveSource> source;
+    uint64_t start;
+    uint64_t storedSize;
+    uint64_t inputOffset;  ///< Bytes of compressed data read so far
+    bool done;
+    z_stream zstream;
+    std::vector<char> input;
+    std::vector<char> output;
+};
+
+static UriHandler
+scanForArchiveMember(const std::string & archiveUri,
+                     const std::string & memberName,
+                     const std::map<std::string, std::string> & options);
+
+/** Open the given member of an indexed archive.  Each call reads from its
+    own stream of the archive, so several members can be read at once.
+*/
+static UriHandler
+openIndexedMember(const std::string & archiveUri,
+                  const ArchiveMember & member,
+                  const std::map<std::string, std::string> & options)
+{
+    if (member.encoding == ArchiveMember::UNSUPPORTED)
+        return scanForArchiveMember(archiveUri, member.name, options);
+
+    auto source = std::make_shared<ArchiveSource>(archiveUri);
+    if (!source->seekable)
+        throw MLDB::Exception("Archive " + archiveUri
+                              + " can no longer be read at random");
+
+    uint64_t dataOffset = member.offset;
+    if (member.hasLocalHeader) {
+        char header[30];
+        source->read(member.offset, header, 30);
+        if (le32(header) != 0x04034b50)
+            throw MLDB::Exception("Corrupt zip local header for "
+                                  + member.name);
+        dataOffset += 30 + le16(header + 26) + le16(header + 28);
+    }
+
+    if (dataOffset > source->size
+        || source->size - dataOffset < member.storedSize)
+        throw MLDB::Exception("Archive member " + member.name
+                              + " is truncated");
+
+    std::shared_ptr<std::streambuf> buf;
+    UriHandlerOptions handlerOptions;
+
+    if (member.encoding == ArchiveMember::DEFLATED) {
+        buf.reset(new DeflatedMemberStreambuf(source, dataOffset,
+                                              member.storedSize));
+    }
+    else {
+        handlerOptions.isForwardSeekable = true;
+        handlerOptions.isRandomSeekable = true;
+        if (source->data) {
+            const char * data = source->data + dataOffset;
+            buf.reset(new MappedMemberStreambuf(source, data,
+                                                member.storedSize));
+            handlerOptions.mapped = data;
+            handlerOptions.mappedSize = member.storedSize;
+        }
+        else {
+            buf.reset(new StoredMemberStreambuf(source, dataOffset,
+                                                member.storedSize));
+        }
+    }
+
+    return UriHandler(buf.get(), buf, member.info, handlerOptions);
+}
+
+/// Split archive+<archiveUri>#<member> into its archive URI and member
+static std::pair<std::string, std::string>
+splitArchiveMemberUri(const Utf8String & uri, const char * context)
+{
+    Utf8String archiveSource = uri;
+    if (!archiveSource.removePrefix("archive+"))
+        throw MLDB::Exception("archive URI '" + uri.rawString()
+                              + "' doesn't start with 'archive+' when "
+                              + context);
+
+    // Look for the last # to get the filename
+    auto foundIt = archiveSource.end();
+    for (auto it = archiveSource.begin(), end = archiveSource.end();
+         it != end;  ++it)
+        if (*it == '#')
+            foundIt = it;
+
+    if (foundIt == archiveSource.end())
+        throw MLDB::Exception("Extracting a file from an archive requires a # between archive URI and path within archive");
+
+    Utf8String archiveUri(archiveSource.begin(), foundIt);
+    Utf8String memberName(std::next(foundIt), archiveSource.end());
+    return { archiveUri.rawString(), memberName.rawString() };
+}
+
+/** Stream through the archive with libarchive, calling onObject for each
+    of its members with their full archive+ URI.
+*/
+static bool
+scanArchive(const std::string & archiveUri, const OnUriObject & onObject)
+{
+    filter_istream archiveStream(archiveUri);
+
+    auto onObject2 = [&] (const std::string & object,
+                          const FsObjectInfo & info,
+                          const OpenUriObject & open,
+                          int depth)
+        {
+            return onObject("archive+" + archiveUri + "#" + object,
+                            info, open, depth);
+        };
+
+    return iterateArchive(archiveStream.rdbuf(), onObject2);
+}
+
+static UriHandler
+scanForArchiveMember(const std::string & archiveUri,
+                     const std::string & memberName,
+                     const std::map<std::string, std::string> & options)
+{
+    std::string uri = "archive+" + archiveUri + "#" + memberName;
+    UriHandler result;
+
+    OnUriObject onObject = [&] (const std::string & archiveMemberUri,
+                                const FsObjectInfo & info,
+                                const OpenUriObject & open,
+                                int depth)
+        {
+            if (uri == archiveMemberUri) {
+                result = open(options);
+                return false;
+            }
+            return true;
+        };
+
+    scanArchive(archiveUri, onObject);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* ARCHIVE URL FS HANDLER                                                    */
+/*****************************************************************************/
+
 struct ArchiveUrlFsHandler: UrlFsHandler {
 
     ArchiveUrlFsHandler()
@@ -162,19 +934,16 @@ struct ArchiveUrlFsHandler: UrlFsHandler {
 
     virtual FsObjectInfo tryGetInfo(const Url & url) const
     {
-        Utf8String archiveSource(url.toDecodedString());
-        if (!archiveSource.removePrefix("archive+"))
-            throw MLDB::Exception("archive URI '" + url.toString() + "' doesn't start with 'archive+' when getting object info");
-
-        // Look for a # to get the filename
-        auto it = archiveSource.rfind('#');
-        if (it == archiveSource.end())
-            throw MLDB::Exception("Extracting a file from an archive requires a # between archive URI and path within archive");
-
-        Utf8String archiveUri(archiveSource.begin(), it);
-
-        // unused...
-        Utf8String toExtractPath(std::next(it), archiveSource.end());
+        std::string archiveUri, memberName;
+        std::tie(archiveUri, memberName)
+            = splitArchiveMemberUri(url.toDecodedString(),
+                                    "getting object info");
+
+        if (auto index = getArchiveIndex(archiveUri)) {
+            if (auto member = index->find(memberName))
+                return *member->info;
+            return FsObjectInfo();
+        }
 
         FsObjectInfo result;
 
@@ -190,9 +959,8 @@ struct ArchiveUrlFsHandler: UrlFsHandler {
                 return true;
             };
 
-        this->forEach(Url("archive+" + archiveUri), onObject, {},
-                      "/" /* delimiter */, "" /* startAt */);
-        
+        scanArchive(archiveUri, onObject);
+
         return result;
     }
 
@@ -229,18 +997,28 @@ struct ArchiveUrlFsHandler: UrlFsHandler {
         if (!archiveSource.removePrefix("archive+"))
             throw MLDB::Exception("archive URI '" + archiveSource.rawString() + "' doesn't start with 'archive+' when listing archive contents");
 
-        filter_istream archiveStream(archiveSource.rawString());
+        std::string archiveUri = archiveSource.rawString();
 
-        auto onObject2 = [&] (const std::string & object,
-                              const FsObjectInfo & info,
-                              const OpenUriObject & open,
-                              int depth)
-            {
-                return onObject(prefix.toString() + "#" + object, info, open, depth);
-            };
+        // With an index, members are opened straight from their offset
+        // and can be opened in any order, and from several threads
+        if (auto index = getArchiveIndex(archiveUri)) {
+            for (auto & member: index->members) {
+                const ArchiveMember * m = &member;
+                auto open = [=] (const std::map<std::string, std::string> & options)
+                    {
+                        // keep the index with its members alive
+                        auto keepIndex = index;
+                        return openIndexedMember(archiveUri, *m, options);
+                    };
 
+                if (!onObject(prefix.toString() + "#" + member.name,
+                              *member.info, open, 1 /* depth */))
+                    return false;
+            }
+            return true;
+        }
 
-        return iterateArchive(archiveStream.rdbuf(), onObject2);
+        return scanArchive(archiveUri, onObject);
     }
 };
 
@@ -262,57 +1040,24 @@ struct RegisterArchiveHandler {
 
         Utf8String uri = scheme + "://" + resource;
 
-        cerr << "uri = " << uri << endl;
-
-        Utf8String archiveSource = uri;
-        if (!archiveSource.removePrefix("archive+"))
-            throw MLDB::Exception("archive URI '" + uri.rawString() + "' doesn't start with 'archive+' when opening archive member");
-
-        //cerr << "archiveSource = " << archiveSource << endl;
-
-        // Look for a # to get the filename
-        auto foundIt = archiveSource.end();
-        for (auto it = archiveSource.begin(), end = archiveSource.end();
-             it != end;  ++it)
-            if (*it == '#')
-                foundIt = it;
-        
-        if (foundIt == archiveSource.end())
-            throw MLDB::Exception("Extracting a file from an archive requires a # between archive URI and path within archive");
-
-        Utf8String archiveUri(archiveSource.begin(), foundIt);
-
-        //cerr << "archiveUri = " << archiveUri << endl;
-
-        // unused...
-        Utf8String toExtractPath(std::next(foundIt), archiveSource.end());
-
-        //cerr << "uri = " << uri << " archiveSource = " << archiveSource
-        //     << " archiveUri = " << archiveUri << " toExtractPath = "
-        //     << toExtractPath << endl;
+        std::string archiveUri, toExtractPath;
+        std::tie(archiveUri, toExtractPath)
+            = splitArchiveMemberUri(uri, "opening archive member");
 
         UriHandler result;
+        if (auto index = getArchiveIndex(archiveUri)) {
+            if (auto member = index->find(toExtractPath))
+                result = openIndexedMember(archiveUri, *member, options);
+        }
+        else {
+            result = scanForArchiveMember(archiveUri, toExtractPath,
+                                          options);
+        }
 
-        OnUriObject onObject = [&] (const std::string & archiveMemberUri,
-                                    const FsObjectInfo & info,
-                                    const OpenUriObject & open,
-                                    int depth)
-            {
-                //cerr << "matching " << archiveMemberUri
-                //<< " against " << uri << endl;
-                if (uri.rawString() == archiveMemberUri) {
-                    result = open(options);
-                    return false;
-                }
-                return true;
-            };
-
-        forEachUriObject("archive+" + archiveUri.rawString(), onObject, {},
-                         "/" /* delimiter */, "" /* startAt */);
         if (!result.buf)
-            throw MLDB::Exception("Couldn't find resource " + toExtractPath.rawString()
-                                + " in archive " + archiveUri.rawString());
-        
+            throw MLDB::Exception("Couldn't find resource " + toExtractPath
+                                + " in archive " + archiveUri);
+
         return result;
     }
 
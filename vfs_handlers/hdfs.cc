@@ -7,15 +7,24 @@
 
 #include <memory>
 #include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
 #include <boost/iostreams/filtering_stream.hpp>
 
 #include "hdfs/hdfs.h"
 
 #include "googleurl/src/url_util.h"
 #include "mldb/arch/exception.h"
+#include "mldb/arch/exception_handler.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/filter_streams_registry.h"
+#include "mldb/vfs/fs_utils.h"
 #include "mldb/jml/utils/guard.h"
+#include "mldb/jml/utils/environment.h"
 #include "mldb/types/url.h"
 
 using namespace std;
@@ -25,6 +34,113 @@ constexpr int DEFAULT_PORT(50070);
 
 namespace {
 
+/** Path of the UNIX domain socket shared with the local datanode.  When
+    it's set, blocks stored on the local datanode are read straight from
+    its disks ("short-circuit" reads) rather than through its TCP
+    connection, which is much faster when MLDB runs beside the datanodes.
+    It must be the same as the dfs.domain.socket.path of the datanode.
+*/
+EnvOption<std::string>
+MLDB_HDFS_DOMAIN_SOCKET_PATH("MLDB_HDFS_DOMAIN_SOCKET_PATH", "");
+
+/// Number of threads reading chunks of a file at once; 0 reads it with
+/// a single sequential stream
+EnvOption<int> MLDB_HDFS_READ_THREADS("MLDB_HDFS_READ_THREADS", 4);
+
+/// Size of the chunks read by each thread
+EnvOption<size_t> MLDB_HDFS_READ_CHUNK_SIZE("MLDB_HDFS_READ_CHUNK_SIZE",
+                                            8 << 20);
+
+
+/****************************************************************************/
+/* HDFS CONNECTION                                                          */
+/****************************************************************************/
+
+/** Connection to the name node of an HDFS URL. */
+struct HDFSConnection {
+    HDFSConnection(const string & urlStr)
+        : fsHandle(nullptr)
+    {
+        Url url(urlStr);
+
+        string hostname = url.host();
+        int port = url.port();
+        if (port == -1) {
+            port = DEFAULT_PORT;
+        }
+        string username = url.username();
+        filename = url.path();
+
+        ExcAssertEqual(url.scheme(), "hdfs");
+        ExcAssert(!filename.empty());
+
+        hdfsBuilder * builder = hdfsNewBuilder();
+        string baseUrl = "hdfs://" + hostname + ":" + to_string(port);
+        hdfsBuilderSetNameNode(builder, baseUrl.c_str());
+
+        if (!username.empty()) {
+            hdfsBuilderSetUserName(builder, username.c_str());
+        }
+
+        string socketPath = MLDB_HDFS_DOMAIN_SOCKET_PATH;
+        if (!socketPath.empty()) {
+            hdfsBuilderConfSetStr(builder, "dfs.client.read.shortcircuit",
+                                  "true");
+            hdfsBuilderConfSetStr(builder, "dfs.domain.socket.path",
+                                  socketPath.c_str());
+        }
+
+        // The builder is freed by hdfsBuilderConnect
+        fsHandle = hdfsBuilderConnect(builder);
+        if (!fsHandle) {
+            throw MLDB::Exception(errno, "hdfsBuilderConnect " + baseUrl);
+        }
+    }
+
+    ~HDFSConnection()
+    {
+        hdfsDisconnect(fsHandle);
+    }
+
+    /** Information about the file, or an object where exists is false if
+        it doesn't exist.  The block size is returned in blockSize.
+    */
+    FsObjectInfo getInfo(int64_t * blockSize = nullptr) const
+    {
+        FsObjectInfo result;
+        hdfsFileInfo * info = hdfsGetPathInfo(fsHandle, filename.c_str());
+        if (!info) {
+            return result;
+        }
+        ML::Call_Guard guard([&] { hdfsFreeFileInfo(info, 1); });
+
+        result.exists = true;
+        result.size = info->mSize;
+        result.lastModified = Date::fromSecondsSinceEpoch(info->mLastMod);
+        if (info->mOwner) {
+            result.ownerId = result.ownerName = info->mOwner;
+        }
+        if (blockSize) {
+            *blockSize = info->mBlockSize;
+        }
+        return result;
+    }
+
+    hdfsFile open(int mode) const
+    {
+        hdfsFile result = hdfsOpenFile(fsHandle, filename.c_str(), mode,
+                                       0, 0, 0);
+        if (!result) {
+            throw MLDB::Exception(errno, "hdfsOpenFile " + filename);
+        }
+        return result;
+    }
+
+    hdfsFS fsHandle;
+    string filename;
+};
+
+
 /****************************************************************************/
 /* HDFS SOURCE IMPL                                                         */
 /****************************************************************************/
@@ -40,51 +156,24 @@ private:
     void cleanup() noexcept;
 
     int mode_;
-    hdfsFS fsHandle_;
+    std::shared_ptr<HDFSConnection> connection_;
     hdfsFile fileHandle_;
 };
 
 HDFSSourceImpl::
 HDFSSourceImpl(const string & urlStr, int mode)
-    : mode_(mode)
+    : mode_(mode), fileHandle_(nullptr)
 {
-    Url url(urlStr);
-
-    string hostname = url.host();
-    int port = url.port();
-    if (port == -1) {
-        port = DEFAULT_PORT;
-    }
-    string username = url.username();
-    string filename = url.path();
-
-    ExcAssertEqual(url.scheme(), "hdfs");
-    ExcAssert(!filename.empty());
-
-    hdfsBuilder * builder = hdfsNewBuilder();
-    string baseUrl = "hdfs://" + hostname + ":" + to_string(port);
-    hdfsBuilderSetNameNode(builder, baseUrl.c_str());
-
-    if (!username.empty()) {
-        hdfsBuilderSetUserName(builder, username.c_str());
-    }
-
-    bool ok(false);
-    ML::Call_Guard guard([&] { if (!ok) cleanup(); });
-
-    fsHandle_ = hdfsBuilderConnect(builder);
-    ExcAssert(fsHandle_ != nullptr);
+    connection_ = std::make_shared<HDFSConnection>(urlStr);
 
     /* "hdfsExists" returns the opposite of what it means */
-    if ((mode & O_WRONLY) == 0 && hdfsExists(fsHandle_, filename.c_str())) {
+    if ((mode & O_WRONLY) == 0
+        && hdfsExists(connection_->fsHandle,
+                      connection_->filename.c_str())) {
         throw MLDB::Exception("file does not exist");
     }
 
-    fileHandle_ = hdfsOpenFile(fsHandle_, filename.c_str(), mode, 0,
-                               0, 0);
-    ExcAssert(fileHandle_ != nullptr);
-
-    ok = true;
+    fileHandle_ = connection_->open(mode);
 }
 
 HDFSSourceImpl::
@@ -102,7 +191,7 @@ read(char * s, streamsize n)
     tSize readRes;
     {
         MLDB_TRACE_EXCEPTIONS(false);
-        readRes = hdfsRead(fsHandle_, fileHandle_, s, n);
+        readRes = hdfsRead(connection_->fsHandle, fileHandle_, s, n);
     }
     if (readRes == -1) {
         throw MLDB::Exception(errno, "hdfsRead");
@@ -117,7 +206,7 @@ write(const char* s, streamsize n)
 {
     ExcAssert((mode_ & O_WRONLY) == O_WRONLY);
 
-    tSize writeRes = hdfsWrite(fsHandle_, fileHandle_, s, n);
+    tSize writeRes = hdfsWrite(connection_->fsHandle, fileHandle_, s, n);
     if (writeRes == -1) {
         throw MLDB::Exception(errno, "hdfsWrite");
     }
@@ -131,13 +220,10 @@ cleanup()
     noexcept
 {
     if (fileHandle_) {
-        hdfsCloseFile(fsHandle_, fileHandle_);
+        hdfsCloseFile(connection_->fsHandle, fileHandle_);
         fileHandle_ = nullptr;
     }
-    if (fsHandle_) {
-        hdfsDisconnect(fsHandle_);
-        fsHandle_ = nullptr;
-    }
+    connection_.reset();
 }
 
 
@@ -180,6 +266,281 @@ private:
 };
 
 
+/****************************************************************************/
+/* HDFS PARALLEL READ BUF                                                   */
+/****************************************************************************/
+
+/** Streambuf reading a large HDFS file as a sequence of chunks, several of
+    which are fetched at once by a pool of reader threads.  A single HDFS
+    stream only ever reads from one datanode at a time, so consumers like
+    forEachChunk() that read a large file in order would otherwise be
+    limited to the bandwidth of one datanode.
+
+    Chunks are sized to divide the HDFS block size, so that each read is
+    normally served by a single datanode (or read locally with short-circuit
+    reads).  Each
+    thread has its own file handle and uses positional reads.  A ring of
+    two chunks per thread is kept, and the get area points straight into
+    the chunk being consumed.  Seeking outside of the current chunk
+    restarts the readers at the new position.
+*/
+struct HDFSParallelReadBuf: public std::streambuf {
+
+    HDFSParallelReadBuf(std::shared_ptr<HDFSConnection> connection,
+                        uint64_t fileSize, uint64_t blockSize,
+                        int numThreads, size_t chunkSize)
+        : connection(std::move(connection)),
+          fileSize(fileSize), chunkSize(chunkSize),
+          chunks(2 * numThreads), numThreads(numThreads)
+    {
+        // Make the chunks divide the block size when the block size
+        // allows, so that few reads need more than one datanode
+        if (blockSize > 0 && blockSize % chunkSize != 0) {
+            this->chunkSize = blockSize / std::max<uint64_t>
+                (1, blockSize / chunkSize);
+        }
+        for (auto & c: chunks) {
+            c.data.reset(new char[this->chunkSize]);
+        }
+        start(0);
+    }
+
+    ~HDFSParallelReadBuf()
+    {
+        stop();
+    }
+
+protected:
+    virtual int_type underflow()
+    {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+
+        std::unique_lock<std::mutex> guard(mutex);
+
+        // Hand the chunk we were reading back to the readers
+        if (haveChunk) {
+            chunks[consumeChunk % chunks.size()].full = false;
+            haveChunk = false;
+            ++consumeChunk;
+            setg(nullptr, nullptr, nullptr);
+            cond.notify_all();
+        }
+
+        if (chunkOffset(consumeChunk) >= fileSize) {
+            return traits_type::eof();
+        }
+
+        Chunk & chunk = chunks[consumeChunk % chunks.size()];
+        cond.wait(guard, [&] () { return chunk.full || error; });
+
+        if (!chunk.full) {
+            std::rethrow_exception(error);
+        }
+
+        haveChunk = true;
+        char * p = chunk.data.get();
+        // The first chunk can start part way through after a seek
+        size_t skip = chunkOffset(consumeChunk) < startOffset
+            ? startOffset - chunkOffset(consumeChunk) : 0;
+        setg(p, p + skip, p + chunk.size);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    virtual std::streamsize showmanyc()
+    {
+        return egptr() - gptr();
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which)
+    {
+        uint64_t current = position();
+
+        int64_t target;
+        if (dir == std::ios_base::beg) {
+            target = off;
+        }
+        else if (dir == std::ios_base::cur) {
+            if (off == 0) {
+                return current;  // tellg()
+            }
+            target = current + off;
+        }
+        else {
+            target = fileSize + off;
+        }
+
+        if (target < 0) {
+            return pos_type(off_type(-1));
+        }
+
+        // Seeking within the chunk we have doesn't need any reads
+        if (haveChunk) {
+            uint64_t offset = chunkOffset(consumeChunk);
+            const Chunk & chunk = chunks[consumeChunk % chunks.size()];
+            if (target >= offset && target <= offset + chunk.size) {
+                setg(eback(), eback() + (target - offset), egptr());
+                return target;
+            }
+        }
+
+        stop();
+        start(target);
+        return target;
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size = 0;
+        bool full = false;
+    };
+
+    uint64_t chunkOffset(uint64_t chunkNum) const
+    {
+        return chunkNum * chunkSize;
+    }
+
+    /** Offset in the file of the next character to be read. */
+    uint64_t position() const
+    {
+        if (haveChunk) {
+            return chunkOffset(consumeChunk) + (gptr() - eback());
+        }
+        return std::max(startOffset, chunkOffset(consumeChunk));
+    }
+
+    /** Start the reader threads at the given offset.  They must be
+        stopped. */
+    void start(uint64_t offset)
+    {
+        for (auto & c: chunks) {
+            c.full = false;
+        }
+        startOffset = offset;
+        consumeChunk = nextChunk = offset / chunkSize;
+        haveChunk = false;
+        stopping = false;
+        error = nullptr;
+        setg(nullptr, nullptr, nullptr);
+
+        for (int i = 0;  i < numThreads;  ++i) {
+            readers.emplace_back([=] () { this->runReader(); });
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+        for (auto & r: readers) {
+            r.join();
+        }
+        readers.clear();
+    }
+
+    void runReader()
+    {
+        hdfsFile file = nullptr;
+        ML::Call_Guard closeFile([&] {
+                if (file) {
+                    hdfsCloseFile(connection->fsHandle, file);
+                }
+            });
+
+        for (;;) {
+            uint64_t chunkNum;
+            {
+                // Take the next chunk, once its slot in the ring is free
+                std::unique_lock<std::mutex> guard(mutex);
+                cond.wait(guard, [&] ()
+                          {
+                              return stopping || error
+                                  || chunkOffset(nextChunk) >= fileSize
+                                  || nextChunk < consumeChunk + chunks.size();
+                          });
+                if (stopping || error
+                    || chunkOffset(nextChunk) >= fileSize) {
+                    return;
+                }
+                chunkNum = nextChunk++;
+            }
+
+            // Nobody else looks at a chunk that isn't full, so it can be
+            // filled without the lock
+            Chunk & chunk = chunks[chunkNum % chunks.size()];
+            uint64_t offset = chunkOffset(chunkNum);
+            size_t size = std::min<uint64_t>(chunkSize, fileSize - offset);
+            std::exception_ptr readError;
+
+            try {
+                if (!file) {
+                    file = connection->open(O_RDONLY);
+                }
+
+                size_t done = 0;
+                while (done < size) {
+                    tSize res = hdfsPread(connection->fsHandle, file,
+                                          offset + done,
+                                          chunk.data.get() + done,
+                                          (tSize)(size - done));
+                    if (res == -1) {
+                        throw MLDB::Exception(errno, "hdfsPread "
+                                              + connection->filename);
+                    }
+                    if (res == 0) {
+                        throw MLDB::Exception("HDFS file "
+                                              + connection->filename
+                                              + " is shorter than expected");
+                    }
+                    done += res;
+                }
+            } catch (...) {
+                readError = std::current_exception();
+            }
+
+            std::unique_lock<std::mutex> guard(mutex);
+            if (readError) {
+                if (!error) {
+                    error = readError;
+                }
+            }
+            else {
+                chunk.size = size;
+                chunk.full = true;
+            }
+            cond.notify_all();
+        }
+    }
+
+    std::shared_ptr<HDFSConnection> connection;
+    uint64_t fileSize;
+    uint64_t chunkSize;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<Chunk> chunks;     ///< Ring of chunks, chunk n in n % size
+    uint64_t consumeChunk = 0;     ///< Chunk the get area is in or waits on
+    uint64_t nextChunk = 0;        ///< Next chunk for a reader to fetch
+    bool haveChunk = false;        ///< Is the get area in consumeChunk?
+    uint64_t startOffset = 0;      ///< Where we started or last sought to
+    bool stopping = false;         ///< Reader threads were asked to stop
+    std::exception_ptr error;      ///< Error that stopped the readers
+    int numThreads;
+    std::vector<std::thread> readers;
+};
+
+
 /****************************************************************************/
 /* HDFS UL SOURCE                                                           */
 /****************************************************************************/
@@ -196,7 +557,7 @@ struct HDFSUlSource {
     };
 
     HDFSUlSource(const string & urlStr,
-                 const ML::OnUriHandlerException & onException)
+                 const OnUriHandlerException & onException)
         : onException_(onException)
     {
         try {
@@ -235,45 +596,71 @@ struct HDFSUlSource {
 
 private:
     shared_ptr<HDFSSourceImpl> impl_;
-    ML::OnUriHandlerException onException_;
+    OnUriHandlerException onException_;
 };
 
 /** Register HDFS with the filter streams API.
 */
 struct RegisterHDFSHandler {
-    static pair<streambuf *, bool>
+    static UriHandler
     getHDFSHandler(const string & scheme,
                    const string & resource,
                    ios_base::open_mode mode,
                    const map<string, string> & options,
-                   const ML::OnUriHandlerException & onException)
+                   const OnUriHandlerException & onException)
     {
-        streambuf * result;
-
         string::size_type pos = scheme.find("hdfs://");
         if (pos != string::npos)
             throw MLDB::Exception("malformed hdfs url");
         string url = "hdfs://" + resource;
 
         if (mode == ios::in) {
-            result = new boost::iostreams::stream_buffer<HDFSDlSource>(HDFSDlSource(url), 131072);
+            int numThreads = MLDB_HDFS_READ_THREADS;
+            size_t chunkSize = MLDB_HDFS_READ_CHUNK_SIZE;
+
+            auto connection = std::make_shared<HDFSConnection>(url);
+            int64_t blockSize = 0;
+            auto info = std::make_shared<FsObjectInfo>
+                (connection->getInfo(&blockSize));
+            if (!info->exists) {
+                throw MLDB::Exception("file does not exist");
+            }
+
+            // Files that fit in a single chunk are read with a single
+            // stream
+            if (numThreads > 0 && chunkSize > 0
+                && info->size > (int64_t)chunkSize) {
+                std::shared_ptr<std::streambuf> buf
+                    (new HDFSParallelReadBuf(connection, info->size,
+                                             blockSize, numThreads,
+                                             chunkSize));
+                UriHandlerOptions handlerOptions;
+                handlerOptions.isForwardSeekable = true;
+                handlerOptions.isRandomSeekable = true;
+                return UriHandler(buf.get(), buf, info, handlerOptions);
+            }
+
+            std::shared_ptr<std::streambuf> buf
+                (new boost::iostreams::stream_buffer<HDFSDlSource>
+                 (HDFSDlSource(url), 131072));
+            return UriHandler(buf.get(), buf, info);
         }
         else if (mode == ios::out) {
-             result =
-                 new boost::iostreams::stream_buffer<HDFSUlSource>(HDFSUlSource(url, onException),
-                                                                   131072);
+            std::shared_ptr<std::streambuf> buf
+                (new boost::iostreams::stream_buffer<HDFSUlSource>
+                 (HDFSUlSource(url, onException), 131072));
+            return UriHandler(buf.get(), buf);
         }
         else {
             throw MLDB::Exception("no way to create HDFS handler for non in/out");
         }
-        return make_pair(result, true);
     }
 
     RegisterHDFSHandler()
     {
         /* this enables googleuri to parse our urls properly */
         url_util::AddStandardScheme("hdfs");
-        ML::registerUriHandler("hdfs", getHDFSHandler);
+        registerUriHandler("hdfs", getHDFSHandler);
     }
 
 } registerHDFSHandler;
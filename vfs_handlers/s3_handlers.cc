@@ -11,11 +11,14 @@
 #include <exception>
 #include <thread>
 #include <chrono>
+#include <mutex>
+#include <map>
 #include <boost/iostreams/stream_buffer.hpp>
 #include "mldb/jml/utils/ring_buffer.h"
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/base/hash.h"
+#include "mldb/jml/utils/environment.h"
 #include "mldb/types/url.h"
 #include "mldb/vfs/filter_streams_registry.h"
 #include "mldb/vfs/fs_utils.h"
@@ -133,7 +136,24 @@ size_t getTotalSystemMemory()
     return pages * page_size;
 }
 
+/** Downloads an S3 object with several ranged GET requests in flight at
+    once.  The number of requests in flight and their sizes adapt to the
+    throughput of each request, like a TCP congestion window: the window
+    grows by one request for each response that keeps up with the best
+    per-request throughput seen so far, and halves when throughput drops
+    to less than half of it (ie, we're saturating the link or being
+    throttled).  Request sizes track what a request can fetch in
+    TARGET_REQUEST_SECONDS.
+*/
+
 struct S3Downloader {
+    /// Aim for requests taking this long, so that per-request latency
+    /// is amortized but a slow request doesn't hold up the reader
+    static constexpr double TARGET_REQUEST_SECONDS = 1.0;
+
+    /// Number of requests in flight at the start of a download
+    static constexpr unsigned INITIAL_WINDOW = 4;
+
     S3Downloader(const S3Api * api,
                  const string & bucket,
                  const string & resource, // starts with "/", unescaped (buggy)
@@ -166,16 +186,26 @@ struct S3Downloader {
         size_t sysMemory = getTotalSystemMemory();
         maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
 
-        /* The maximum number of concurrent requests is set depending on
-           the total size of the stream. */
-        maxRqs = 1;
-        if (fileInfo.size > 1024 * 1024)
-            maxRqs = 5;
-        if (fileInfo.size > 16 * 1024 * 1024)
-            maxRqs = 15;
-        if (fileInfo.size > 256 * 1024 * 1024)
-            maxRqs = 30;
+        /* There's no point in having more concurrent requests than
+           chunks of the minimum size. */
+        maxRqs = std::max<uint64_t>(1, std::min<uint64_t>
+                                    (api->maxDownloadRequests,
+                                     downloadSize / baseChunkSize));
         chunks.resize(maxRqs);
+        windowRqs = maxRqs < INITIAL_WINDOW ? maxRqs : INITIAL_WINDOW;
+
+        /* Start with requests sized for the bandwidth of previous
+           downloads, if we know it. */
+        double knownMbps = getS3DownloadBandwidthMbps();
+        nextChunkSize = baseChunkSize;
+        if (knownMbps > 0.0) {
+            size_t chunkSize = knownMbps * 1000000.0 * TARGET_REQUEST_SECONDS
+                / maxRqs;
+            nextChunkSize = std::max(baseChunkSize,
+                                     std::min(chunkSize, maxChunkSize));
+        }
+
+        startTime = Date::now();
 
         /* Kick start the requests */
         ensureRequests();
@@ -241,6 +271,10 @@ struct S3Downloader {
             ML::futex_wait(activeRqs, activeRqs);
         }
         excPtrHandler.rethrowIfSet();
+
+        if (endOfDownload())
+            recordS3Download(downloadSize,
+                             Date::now().secondsSince(startTime));
     }
 
     const FsObjectInfo & info()
@@ -338,7 +372,7 @@ private:
             if (excPtrHandler.hasException()) {
                 break;
             }
-            if (activeRqs == maxRqs) {
+            if (activeRqs >= windowRqs) {
                 break;
             }
             ExcAssert(activeRqs < maxRqs);
@@ -358,7 +392,7 @@ private:
 
     void ensureRequest()
     {
-        size_t chunkSize = getChunkSize(currentRq);
+        size_t chunkSize = nextChunkSize;
         uint64_t end = requestedBytes + chunkSize;
         if (end > fileInfo.size) {
             end = fileInfo.size;
@@ -370,10 +404,12 @@ private:
         activeRqs++;
         chunk.setQuerying();
 
+        Date requestTime = Date::now();
         auto onResponse
-            = [&, chunkNr, chunkSize] (S3Api::Response && response,
-                                       std::exception_ptr excPtr) {
-            this->handleResponse(chunkNr, chunkSize, std::move(response), excPtr);
+            = [&, chunkNr, chunkSize, requestTime]
+            (S3Api::Response && response, std::exception_ptr excPtr) {
+            this->handleResponse(chunkNr, chunkSize, requestTime,
+                                 std::move(response), excPtr);
         };
         S3Api::Range range(offset + requestedBytes, chunkSize);
         api->getAsync(onResponse, bucket, resource, range);
@@ -383,6 +419,7 @@ private:
     }
 
     void handleResponse(unsigned int chunkNr, size_t chunkSize,
+                        Date requestTime,
                         S3Api::Response && response,
                         std::exception_ptr excPtr)
     {
@@ -409,6 +446,7 @@ private:
                                     resource.c_str());
             }
             ExcAssertEqual(response.body().size(), chunkSize);
+            adaptWindow(chunkSize, Date::now().secondsSince(requestTime));
             Chunk & chunk = chunks[chunkNr];
             chunk.assign(std::move(response.body_));
         }
@@ -419,12 +457,36 @@ private:
         ML::futex_wake(activeRqs);
     }
 
-    size_t getChunkSize(unsigned int chunkNbr)
-        const
+    /** Update the request window and size from a response of the given
+        size that took the given time.
+    */
+    void adaptWindow(size_t chunkSize, double seconds)
     {
-        size_t chunkSize = std::min(baseChunkSize * (1 << (chunkNbr / 2)),
-                                    maxChunkSize);
-        return chunkSize;
+        // Latency dominates the time of the last, short chunk
+        if (chunkSize < baseChunkSize || seconds <= 0.0)
+            return;
+
+        double mbps = chunkSize / seconds / 1000000.0;
+
+        std::unique_lock<std::mutex> guard(windowMutex);
+
+        if (mbps > bestRqMbps)
+            bestRqMbps = mbps;
+
+        if (mbps >= 0.5 * bestRqMbps) {
+            if (windowRqs < maxRqs)
+                windowRqs = windowRqs + 1;
+        }
+        else {
+            windowRqs = std::max(1U, windowRqs / 2);
+            // Forget the peak slowly so that the window can grow again
+            bestRqMbps = 0.75 * bestRqMbps;
+        }
+
+        size_t targetSize = mbps * 1000000.0 * TARGET_REQUEST_SECONDS;
+        targetSize = (nextChunkSize + targetSize) / 2;
+        nextChunkSize = std::max(baseChunkSize,
+                                 std::min(targetSize, maxChunkSize));
     }
 
     /* static variables, set during or right after construction */
@@ -453,6 +515,12 @@ private:
 
     /* http requests */
     unsigned int maxRqs; /* maximum number of concurrent http requests */
+    std::atomic<unsigned int> windowRqs; /* current number of concurrent
+                                          * http requests allowed */
+    std::atomic<size_t> nextChunkSize; /* size of the next request */
+    std::mutex windowMutex; /* protects the window adaptation */
+    double bestRqMbps = 0.0; /* best throughput of a single request */
+    Date startTime; /* when the download started */
     uint64_t requestedBytes; /* total number of bytes that have been
                               * requested, including the non-received ones */
     vector<Chunk> chunks; /* chunks */
@@ -547,7 +615,26 @@ inline void touch(const char * start, size_t size)
 }
 
 
+/** Maximum memory used by the buffers of a single upload; 0 means 5% of
+    system memory.  Part sizes are capped so that all of the parts in
+    flight fit in the budget.
+*/
+EnvOption<size_t> MLDB_S3_UPLOAD_BUFFER_BYTES("MLDB_S3_UPLOAD_BUFFER_BYTES", 0);
+
+/// Number of times a failed part is uploaded again before the upload fails
+EnvOption<int> MLDB_S3_UPLOAD_PART_RETRIES("MLDB_S3_UPLOAD_PART_RETRIES", 5);
+
+/** Uploads an S3 object as a multipart upload with up to
+    metadata.numRequests parts in flight at once.  Writes block once all
+    requests are busy, which bounds the memory used to the buffer budget.
+    Each part keeps its data until S3 acknowledges it, so that a part that
+    fails is uploaded again on its own without restarting the upload.
+*/
+
 struct S3Uploader {
+    /// S3 refuses parts smaller than this, except for the last one
+    static constexpr size_t MIN_PART_SIZE = 5 * 1024 * 1024;
+
     S3Uploader(const S3Api * api,
                const string & bucket,
                const string & resource, // starts with "/", unescaped (buggy)
@@ -562,12 +649,29 @@ struct S3Uploader {
           currentRq(0),
           activeRqs(0)
     {
+        if (metadata.numRequests == 0) {
+            metadata.numRequests = 1;
+        }
+
         /* Maximum chunk size is what we can do in 3 seconds, up to 1% of
            system memory. */
         maxChunkSize = api->bandwidthToServiceMbps * 3.0 * 1000000;
         size_t sysMemory = getTotalSystemMemory();
         maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
 
+        /* Each part in flight is held twice (by us for retries, and by
+           the request), plus the one being written. */
+        size_t budget = MLDB_S3_UPLOAD_BUFFER_BYTES;
+        if (budget == 0) {
+            budget = sysMemory / 20;
+        }
+        maxChunkSize = std::min<size_t>(maxChunkSize,
+                                        budget / (2 * metadata.numRequests + 1));
+        if (maxChunkSize < MIN_PART_SIZE) {
+            maxChunkSize = MIN_PART_SIZE;
+        }
+        chunkSize = std::min(chunkSize, maxChunkSize);
+
         try {
             S3Api::MultiPartUpload upload
               = api->obtainMultiPartUpload(bucket, resource, metadata,
@@ -601,10 +705,7 @@ struct S3Uploader {
 
         size_t remaining = chunkSize - current.size();
         while (n > 0) {
-            if (excPtrHandler.hasException() && onException) {
-                onException();
-            }
-            excPtrHandler.rethrowIfSet();
+            rethrowIfFailed();
             size_t toDo = min(remaining, (size_t) n);
             if (toDo < n) {
                 flush();
@@ -625,35 +726,25 @@ struct S3Uploader {
         if (!force) {
             ExcAssert(current.size() > 0);
         }
-        while (activeRqs == metadata.numRequests) {
-            ML::futex_wait(activeRqs, activeRqs);
-        }
-        if (excPtrHandler.hasException() && onException) {
-            onException();
-        }
-        excPtrHandler.rethrowIfSet();
 
-        unsigned int rqNbr(currentRq);
-        auto onResponse = [&, rqNbr] (S3Api::Response && response,
-                                      std::exception_ptr excPtr) {
-            this->handleResponse(rqNbr, std::move(response), excPtr);
-        };
+        /* Backpressure: wait for a request to be free */
+        waitForRequests(metadata.numRequests - 1);
 
         unsigned int partNumber = currentRq + 1;
-        if (etags.size() < partNumber) {
-            etags.resize(partNumber);
+        {
+            std::unique_lock<std::mutex> guard(partsMutex);
+            if (etags.size() < partNumber) {
+                etags.resize(partNumber);
+            }
+            parts[currentRq].data = std::move(current);
         }
-
-        activeRqs++;
-        api->putAsync(onResponse, bucket, resource,
-                      MLDB::format("partNumber=%d&uploadId=%s",
-                                 partNumber, uploadId),
-                      {}, {}, current);
+        current.clear();
+        startPart(currentRq);
 
         if (currentRq % 5 == 0 && chunkSize < maxChunkSize)
-            chunkSize *= 2;
+            chunkSize = std::min(chunkSize * 2, maxChunkSize);
 
-        current.clear();
+        current.reserve(chunkSize);
         currentRq = partNumber;
     }
 
@@ -673,10 +764,23 @@ struct S3Uploader {
 
             string etag = response.getHeader("etag");
             ExcAssert(etag.size() > 0);
+
+            std::unique_lock<std::mutex> guard(partsMutex);
             etags[rqNbr] = etag;
+            parts.erase(rqNbr);
         }
         catch (const std::exception & exc) {
-            excPtrHandler.takeCurrentException();
+            std::unique_lock<std::mutex> guard(partsMutex);
+            Part & part = parts[rqNbr];
+            if (part.retries < MLDB_S3_UPLOAD_PART_RETRIES) {
+                ++part.retries;
+                cerr << "retrying upload of part " << rqNbr + 1
+                     << " of " << resource << ": " << exc.what() << endl;
+                failedParts.push_back(rqNbr);
+            }
+            else {
+                excPtrHandler.takeCurrentException();
+            }
         }
         activeRqs--;
         ML::futex_wake(activeRqs);
@@ -692,13 +796,7 @@ struct S3Uploader {
             /* for empty files, force the creation of a single empty part */
             flush(true);
         }
-        while (activeRqs > 0) {
-            ML::futex_wait(activeRqs, activeRqs);
-        }
-        if (excPtrHandler.hasException() && onException) {
-            onException();
-        }
-        excPtrHandler.rethrowIfSet();
+        waitForRequests(0);
 
         string finalEtag;
         try {
@@ -716,6 +814,72 @@ struct S3Uploader {
     }
 
 private:
+    /* Data of a part that was sent but not acknowledged yet */
+    struct Part {
+        std::string data;
+        int retries = 0;
+    };
+
+    void startPart(unsigned int rqNbr)
+    {
+        const std::string * data;
+        {
+            /* map nodes don't move, so the data is stable until the part
+               is erased on success */
+            std::unique_lock<std::mutex> guard(partsMutex);
+            data = &parts[rqNbr].data;
+        }
+
+        auto onResponse = [this, rqNbr] (S3Api::Response && response,
+                                         std::exception_ptr excPtr) {
+            this->handleResponse(rqNbr, std::move(response), excPtr);
+        };
+
+        activeRqs++;
+        api->putAsync(onResponse, bucket, resource,
+                      MLDB::format("partNumber=%d&uploadId=%s",
+                                   rqNbr + 1, uploadId),
+                      {}, {}, *data);
+    }
+
+    void rethrowIfFailed()
+    {
+        if (excPtrHandler.hasException() && onException) {
+            onException();
+        }
+        excPtrHandler.rethrowIfSet();
+    }
+
+    /* Wait until no more than maxActive requests are pending, uploading
+       again the parts that failed in the meantime. */
+    void waitForRequests(unsigned int maxActive)
+    {
+        for (;;) {
+            rethrowIfFailed();
+
+            std::vector<unsigned int> toRetry;
+            {
+                std::unique_lock<std::mutex> guard(partsMutex);
+                toRetry.swap(failedParts);
+            }
+            for (unsigned int rqNbr: toRetry) {
+                startPart(rqNbr);
+            }
+
+            unsigned int active = activeRqs;
+            if (toRetry.empty() && active <= maxActive) {
+                std::unique_lock<std::mutex> guard(partsMutex);
+                if (failedParts.empty()) {
+                    break;
+                }
+                continue;
+            }
+            if (active > maxActive) {
+                ML::futex_wait(activeRqs, active);
+            }
+        }
+    }
+
     const S3Api * api;
     std::string bucket;
     std::string resource;
@@ -734,6 +898,10 @@ private:
     std::vector<std::string> etags; /* etags of individual chunks */
     unsigned int currentRq;  /* number of done requests */
     atomic<unsigned int> activeRqs; /* number of pending http requests */
+
+    std::mutex partsMutex; /* protects parts, failedParts and etags */
+    std::map<unsigned int, Part> parts; /* parts in flight */
+    std::vector<unsigned int> failedParts; /* parts to upload again */
 };
 
 
@@ -26,6 +26,7 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/soa/credentials/credential_provider.h"
+#include "mldb/jml/utils/environment.h"
 #include <thread>
 #include <unordered_map>
 
@@ -35,6 +36,16 @@ using namespace std;
 
 namespace MLDB {
 
+/** Number of bytes of a file in flight at once over SFTP.  Streams read
+    and write in blocks of this size, which libssh2 splits into as many
+    SFTP requests as needed and pipelines, so that throughput isn't bound
+    by the round trip time of one request.
+*/
+EnvOption<size_t> MLDB_SFTP_WINDOW_BYTES("MLDB_SFTP_WINDOW_BYTES", 4 << 20);
+
+/// Number of idle connections to each host kept for later streams
+EnvOption<int> MLDB_SFTP_IDLE_CONNECTIONS("MLDB_SFTP_IDLE_CONNECTIONS", 4);
+
 
 /*****************************************************************************/
 /* SOCKET CONNECTION                                                         */
@@ -379,7 +390,7 @@ downloadTo(const std::string & filename) const
     uint64_t done = 0;
     std::ofstream stream(filename.c_str());
 
-    size_t bufSize = 1024 * 1024;
+    size_t bufSize = MLDB_SFTP_WINDOW_BYTES;
 
     char * buf = new char[bufSize];
             
@@ -417,6 +428,18 @@ downloadTo(const std::string & filename) const
 /* SFTP CONNECTION                                                           */
 /*****************************************************************************/
 
+/** Grow the receive window of the channel under the SFTP session, so that
+    the server can send a whole read window without waiting for us to
+    acknowledge it.  The default window is too small to keep a high
+    latency link busy.
+*/
+static void growReceiveWindow(LIBSSH2_SFTP * sftp_session)
+{
+    LIBSSH2_CHANNEL * channel = libssh2_sftp_get_channel(sftp_session);
+    libssh2_channel_receive_window_adjust2(channel, MLDB_SFTP_WINDOW_BYTES,
+                                           0 /* force */, nullptr);
+}
+
 SftpConnection::
 SftpConnection()
     : sftp_session(0)
@@ -446,6 +469,7 @@ connectPasswordAuth(const std::string & hostname,
                             + lastError());
     }
 
+    growReceiveWindow(sftp_session);
 }
 
 void
@@ -466,6 +490,7 @@ connectPublicKeyAuth(const std::string & hostname,
                             + lastError());
     }
 
+    growReceiveWindow(sftp_session);
 }
 
 SftpConnection::Directory
@@ -547,7 +572,7 @@ uploadFile(const char * start,
     for (; offset < size; ) {
         /* write data in a loop until we block */ 
         size_t toSend = std::min<size_t>(size - offset,
-                                         1024 * 1024);
+                                         MLDB_SFTP_WINDOW_BYTES);
 
         ssize_t rc = libssh2_sftp_write(handle,
                                         start + offset,
@@ -660,6 +685,8 @@ struct SftpStreamingDownloadSource {
         {
             BOOST_STATIC_ASSERT(sizeof(char_type) == 1);
 
+            // n is a whole window, which libssh2 reads ahead as many
+            // requests in flight at once
             ssize_t numRead = libssh2_sftp_read(handle, s, n);
             if (numRead < 0) {
                 throw MLDB::Exception("read(): " + owner->lastError());
@@ -766,6 +793,7 @@ struct SftpStreamingUploadSource {
 
             while (done < n) {
 
+                // libssh2 sends the whole window as pipelined requests
                 ssize_t rc = libssh2_sftp_write(handle, s + done, n - done);
             
                 if (rc == -1) {
@@ -858,7 +886,7 @@ streamingUploadStreambuf(const std::string & path,
     std::unique_ptr<std::streambuf> result;
     result.reset(new boost::iostreams::stream_buffer<SftpStreamingUploadSource>
                  (SftpStreamingUploadSource(this, path, onException),
-                  131072));
+                  MLDB_SFTP_WINDOW_BYTES));
     return result;
 }
 
@@ -880,7 +908,7 @@ streamingDownloadStreambuf(const std::string & path) const
     std::unique_ptr<std::streambuf> result;
     result.reset(new boost::iostreams::stream_buffer<SftpStreamingDownloadSource>
                  (SftpStreamingDownloadSource(this, path),
-                  131072));
+                  MLDB_SFTP_WINDOW_BYTES));
     return result;
 }
 
@@ -903,11 +931,41 @@ namespace {
 struct SftpHostInfo {
     std::string sftpHost;
     std::shared_ptr<SftpConnection> connection;  //< Used to access this uri
+
+    /// Opens a new connection to the host, with the same credentials
+    std::function<std::shared_ptr<SftpConnection> ()> connect;
+
+    /// Connections that streams have finished with, most recent last
+    std::vector<std::shared_ptr<SftpConnection> > idle;
 };
 
 std::mutex sftpHostsLock;
 std::unordered_map<std::string, SftpHostInfo> sftpHosts;
 
+std::shared_ptr<SftpConnection>
+connectPassword(const std::string & hostname,
+                const std::string & username,
+                const std::string & password,
+                const std::string & port)
+{
+    auto result = std::make_shared<SftpConnection>();
+    result->connectPasswordAuth(hostname, username, password, port);
+    return result;
+}
+
+std::shared_ptr<SftpConnection>
+connectPublicKey(const std::string & hostname,
+                 const std::string & username,
+                 const std::string & publicKeyFile,
+                 const std::string & privateKeyFile,
+                 const std::string & port)
+{
+    auto result = std::make_shared<SftpConnection>();
+    result->connectPublicKeyAuth(hostname, username,
+                                 publicKeyFile, privateKeyFile, port);
+    return result;
+}
+
 } // file scope
 
 /** Sftp support for filter_ostream opens.  Register the host name here, and
@@ -926,8 +984,9 @@ void registerSftpHostPassword(const std::string & hostname,
 
     SftpHostInfo info;
     info.sftpHost = hostname;
-    info.connection = std::make_shared<SftpConnection>();
-    info.connection->connectPasswordAuth(hostname, username, password, port);
+    info.connect = std::bind(connectPassword, hostname, username, password,
+                             port);
+    info.connection = info.connect();
     
     sftpHosts[hostname] = info;
 }
@@ -945,11 +1004,9 @@ void registerSftpHostPublicKey(const std::string & hostname,
 
     SftpHostInfo info;
     info.sftpHost = hostname;
-    info.connection = std::make_shared<SftpConnection>();
-    info.connection->connectPublicKeyAuth(hostname, username,
-                                          publicKeyFile,
-                                          privateKeyFile,
-                                          port);
+    info.connect = std::bind(connectPublicKey, hostname, username,
+                             publicKeyFile, privateKeyFile, port);
+    info.connection = info.connect();
     sftpHosts[hostname] = info;
 }
 
@@ -968,14 +1025,18 @@ struct RegisterSftpHandler {
                                 + resource);
         string connStr(resource, 0, pos);
 
-        const auto & connection = getSftpConnectionFromConnStr(connStr);
+        // Each stream has a connection of its own, which goes back to the
+        // cache once the stream buffer is destroyed
+        auto connection = acquireSftpConnection(connStr);
+        auto deleteBuf = [connection] (std::streambuf * buf) { delete buf; };
         string path = resource.substr(connStr.size());
         if (mode == ios::in) {
             std::shared_ptr<std::streambuf> buf
-                (connection.streamingDownloadStreambuf(path).release());
+                (connection->streamingDownloadStreambuf(path).release(),
+                 deleteBuf);
 
             SftpConnection::Attributes attr;
-            if (!connection.getAttributes(path, attr)) {
+            if (!connection->getAttributes(path, attr)) {
                 throw MLDB::Exception("Couldn't read attributes for sftp "
                                     "resource");
             }
@@ -990,8 +1051,9 @@ struct RegisterSftpHandler {
         }
         if (mode == ios::out) {
             std::shared_ptr<std::streambuf> buf
-                (connection.streamingUploadStreambuf(path, onException)
-                 .release());
+                (connection->streamingUploadStreambuf(path, onException)
+                 .release(),
+                 deleteBuf);
             return UriHandler(buf.get(), buf);
         }
         throw MLDB::Exception("no way to create sftp handler for non in/out");
@@ -1028,12 +1090,61 @@ const SftpConnection & getSftpConnectionFromConnStr(const std::string & connStr)
 
     SftpHostInfo info;
     info.sftpHost = host;
-    info.connection = std::make_shared<SftpConnection>();
-    info.connection->connectPasswordAuth(host, creds.id, creds.secret, port);
+    info.connect = std::bind(connectPassword, host, creds.id, creds.secret,
+                             port);
+    info.connection = info.connect();
+    if (it != sftpHosts.end())
+        info.idle = std::move(it->second.idle);
     sftpHosts[connStr] = info;
     return *info.connection.get();
 }
 
+/** Return an idle connection to the host of connStr that is still alive,
+    or open a new one.  The connection is for the exclusive use of the
+    caller, as a libssh2 session can't be used from two threads at once.
+    It goes back to the cache of idle connections of the host when the
+    returned pointer is released, so that later opens of files on the same
+    host don't pay for a new ssh handshake and authentication.
+*/
+std::shared_ptr<SftpConnection>
+acquireSftpConnection(const std::string & connStr)
+{
+    // Make sure the host is known, and how to connect to it
+    getSftpConnectionFromConnStr(connStr);
+
+    std::shared_ptr<SftpConnection> connection;
+    std::function<std::shared_ptr<SftpConnection> ()> connect;
+    {
+        std::unique_lock<std::mutex> guard(sftpHostsLock);
+        SftpHostInfo & info = sftpHosts[connStr];
+        while (!info.idle.empty() && !connection) {
+            connection = std::move(info.idle.back());
+            info.idle.pop_back();
+            if (!connection->isAlive())
+                connection.reset();
+        }
+        connect = info.connect;
+    }
+
+    if (!connection)
+        connection = connect();
+
+    auto release = [connStr, connection] (SftpConnection *)
+        {
+            std::unique_lock<std::mutex> guard(sftpHostsLock);
+            auto it = sftpHosts.find(connStr);
+            if (it == sftpHosts.end())
+                return;
+            auto & idle = it->second.idle;
+            idle.push_back(connection);
+            if (idle.size()
+                > (size_t)std::max(0, MLDB_SFTP_IDLE_CONNECTIONS.get()))
+                idle.erase(idle.begin());
+        };
+
+    return std::shared_ptr<SftpConnection>(connection.get(), release);
+}
+
 namespace {
 
 string connStrFromUri(const string & uri) {
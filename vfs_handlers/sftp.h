@@ -197,4 +197,12 @@ void registerSftpHostPublicKey(const std::string & hostname,
 
 const SftpConnection & getSftpConnectionFromConnStr(const std::string & connStr);
 
+/** Return a connection to the host of connStr for the exclusive use of the
+    caller, taken from the host's cache of idle connections if possible.
+    The connection goes back to the cache when the last copy of the
+    returned pointer is released.
+*/
+std::shared_ptr<SftpConnection>
+acquireSftpConnection(const std::string & connStr);
+
 } // namespace MLDB